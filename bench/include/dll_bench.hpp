@@ -0,0 +1,180 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Minimal micro-benchmark harness for DLL.
+ *
+ * Each benchmark is registered with DLL_BENCH and runs a set of iterations,
+ * after some warmup iterations. The time of each iteration is either
+ * measured by the harness or given by the benchmark itself (for the
+ * per-layer timings of the trainer for instance). The statistics of all the
+ * benchmarks are printed and can be written in JSON.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dll_bench {
+
+/*!
+ * \brief The statistics of one benchmark
+ */
+struct bench_result {
+    std::string name;       ///< The name of the benchmark
+    size_t iterations = 0;  ///< The number of measured iterations
+    size_t items      = 0;  ///< The number of items processed by one iteration
+    double median     = 0;  ///< The median time of one iteration, in nanoseconds
+    double min        = 0;  ///< The minimum time of one iteration, in nanoseconds
+    double max        = 0;  ///< The maximum time of one iteration, in nanoseconds
+    double mean       = 0;  ///< The mean time of one iteration, in nanoseconds
+    double stddev     = 0;  ///< The standard deviation of the time of one iteration, in nanoseconds
+
+    /*!
+     * \brief Returns the median throughput, in items per second
+     */
+    double throughput() const {
+        return median > 0 ? items * 1e9 / median : 0.0;
+    }
+};
+
+/*!
+ * \brief The state of a running benchmark
+ */
+struct bench_state {
+    size_t warmup;      ///< The number of warmup iterations
+    size_t repetitions; ///< The number of measured iterations
+
+    std::vector<double> times; ///< The time of each measured iteration, in nanoseconds
+    size_t items = 1;          ///< The number of items processed by one iteration
+
+    bench_state(size_t warmup, size_t repetitions) : warmup(warmup), repetitions(repetitions) {}
+
+    /*!
+     * \brief Measure the given functor.
+     * \param n The number of items processed by one call of the functor
+     * \param fun The functor to measure
+     */
+    template <typename Functor>
+    void run(size_t n, Functor&& fun) {
+        items = n;
+
+        for (size_t i = 0; i < warmup; ++i) {
+            fun();
+        }
+
+        for (size_t i = 0; i < repetitions; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            fun();
+            auto end = std::chrono::steady_clock::now();
+
+            times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+    }
+
+    /*!
+     * \brief Run the given functor, which returns the time of the iteration
+     * it has measured itself, in nanoseconds.
+     * \param n The number of items processed by one call of the functor
+     * \param fun The functor to run
+     */
+    template <typename Functor>
+    void run_manual(size_t n, Functor&& fun) {
+        items = n;
+
+        for (size_t i = 0; i < warmup; ++i) {
+            fun();
+        }
+
+        for (size_t i = 0; i < repetitions; ++i) {
+            times.push_back(fun());
+        }
+    }
+};
+
+/*!
+ * \brief A registered benchmark
+ */
+struct bench_entry {
+    std::string name;                       ///< The name of the benchmark
+    std::function<void(bench_state&)> fun;  ///< The benchmark
+};
+
+/*!
+ * \brief Returns the registry of all the benchmarks
+ */
+inline std::vector<bench_entry>& registry() {
+    static std::vector<bench_entry> benchmarks;
+    return benchmarks;
+}
+
+/*!
+ * \brief Helper to register a benchmark from a static variable
+ */
+struct bench_register {
+    bench_register(const std::string& name, std::function<void(bench_state&)> fun) {
+        registry().push_back({name, std::move(fun)});
+    }
+};
+
+/*!
+ * \brief Compute the statistics of the times of the given state
+ */
+inline bench_result compute_result(const std::string& name, bench_state& state) {
+    bench_result result;
+
+    result.name       = name;
+    result.iterations = state.times.size();
+    result.items      = state.items;
+
+    auto& times = state.times;
+
+    if (times.empty()) {
+        return result;
+    }
+
+    std::sort(times.begin(), times.end());
+
+    const size_t n = times.size();
+
+    result.median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2.0;
+    result.min    = times.front();
+    result.max    = times.back();
+
+    for (auto t : times) {
+        result.mean += t;
+    }
+
+    result.mean /= n;
+
+    for (auto t : times) {
+        result.stddev += (t - result.mean) * (t - result.mean);
+    }
+
+    result.stddev = std::sqrt(result.stddev / n);
+
+    return result;
+}
+
+} //end of namespace dll_bench
+
+#define DLL_BENCH_CAT_IMPL(a, b) a##b
+#define DLL_BENCH_CAT(a, b) DLL_BENCH_CAT_IMPL(a, b)
+
+/*!
+ * \brief Define and register a benchmark with the given name
+ */
+#define DLL_BENCH(name)                                                                                    \
+    static void DLL_BENCH_CAT(dll_bench_fun_, __LINE__)(dll_bench::bench_state & state);                  \
+    static dll_bench::bench_register DLL_BENCH_CAT(dll_bench_reg_, __LINE__)(name, DLL_BENCH_CAT(dll_bench_fun_, __LINE__)); \
+    static void DLL_BENCH_CAT(dll_bench_fun_, __LINE__)(dll_bench::bench_state & state)
@@ -0,0 +1,92 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// End-to-end benchmarks: one epoch of training of complete networks on a
+// subset of MNIST. The benchmarks are skipped when MNIST is not available.
+
+#include "dll_bench.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/rbm/rbm.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+constexpr size_t N = 5000; ///< The number of training images
+
+DLL_BENCH("epoch/mnist/mlp") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 250>::layer_t,
+            dll::dense_layer_desc<250, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<100>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(N);
+
+    if (dataset.training_images.empty()) {
+        return;
+    }
+
+    mnist::normalize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    state.run(dataset.training_images.size(), [&]() { dbn->fine_tune(dataset.training_images, dataset.training_labels, 1); });
+}
+
+DLL_BENCH("epoch/mnist/cnn") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 8, 5, 5>::layer_t,
+            dll::mp_2d_layer_desc<8, 24, 24, 2, 2>::layer_t,
+            dll::conv_layer_desc<8, 12, 12, 8, 5, 5>::layer_t,
+            dll::mp_2d_layer_desc<8, 8, 8, 2, 2>::layer_t,
+            dll::dense_layer_desc<8 * 4 * 4, 150>::layer_t,
+            dll::dense_layer_desc<150, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<100>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(N);
+
+    if (dataset.training_images.empty()) {
+        return;
+    }
+
+    mnist::normalize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    state.run(dataset.training_images.size(), [&]() { dbn->fine_tune(dataset.training_images, dataset.training_labels, 1); });
+}
+
+DLL_BENCH("epoch/mnist/dbn_pretrain") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 500, dll::momentum, dll::batch_size<100>>::layer_t,
+            dll::rbm_desc<500, 250, dll::momentum, dll::batch_size<100>>::layer_t,
+            dll::rbm_desc<250, 10, dll::momentum, dll::batch_size<100>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<100>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(N);
+
+    if (dataset.training_images.empty()) {
+        return;
+    }
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    state.run(dataset.training_images.size(), [&]() { dbn->pretrain(dataset.training_images, 1); });
+}
+
+} //end of anonymous namespace
@@ -0,0 +1,193 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// Throughput of the data generators, without any network: each iteration is
+// one complete epoch of a generator over a synthetic dataset of random
+// images and the throughput is in batches per second.
+//
+// The pretransforms of the in-memory generators are applied once, when they
+// are created, they are benchmarked with the out-of-memory generators, which
+// apply them to each big batch.
+
+#include <random>
+#include <vector>
+
+#include "dll_bench.hpp"
+
+#include "dll/generators.hpp"
+
+namespace {
+
+constexpr size_t N       = 10000; ///< The number of images
+constexpr size_t Classes = 10;    ///< The number of classes
+
+using image_t = etl::fast_dyn_matrix<float, 1, 28, 28>;
+
+/*!
+ * \brief A dataset of random images (pixels in [0, 255]) and labels
+ */
+struct dataset_t {
+    std::vector<image_t> images;
+    std::vector<size_t> labels;
+
+    dataset_t() : images(N), labels(N) {
+        std::mt19937_64 engine(42);
+        std::uniform_real_distribution<float> pixel(0.0f, 255.0f);
+        std::uniform_int_distribution<size_t> label(0, Classes - 1);
+
+        for (size_t i = 0; i < N; ++i) {
+            for (auto& v : images[i]) {
+                v = pixel(engine);
+            }
+
+            labels[i] = label(engine);
+        }
+    }
+};
+
+/*!
+ * \brief Returns the dataset shared by all the benchmarks
+ */
+const dataset_t& dataset() {
+    static dataset_t data;
+    return data;
+}
+
+/*!
+ * \brief Run complete epochs of the given generator, as the trainers do.
+ * \param shuffle Indicates if the generator is shuffled at each epoch
+ */
+template <typename Generator>
+void epoch_bench(dll_bench::bench_state& state, Generator& generator, bool shuffle = false) {
+    volatile float result = 0.0f;
+
+    generator->set_train();
+
+    state.run(generator->batches(), [&]() {
+        generator->prepare_epoch();
+
+        if (shuffle) {
+            generator->reset_shuffle();
+        } else {
+            generator->reset();
+        }
+
+        float sum = 0.0f;
+
+        while (generator->has_next_batch()) {
+            sum += generator->data_batch()[0] + generator->label_batch()[0];
+
+            generator->next_batch();
+        }
+
+        result = sum;
+    });
+
+    cpp_unused(result);
+}
+
+/*!
+ * \brief Benchmark an in-memory generator with the given options
+ */
+template <typename... Parameters>
+void inmemory_bench(dll_bench::bench_state& state, bool shuffle = false) {
+    auto& data = dataset();
+
+    auto generator = dll::make_generator(data.images, data.labels, N, Classes, dll::inmemory_data_generator_desc<Parameters...>{});
+
+    epoch_bench(state, generator, shuffle);
+}
+
+/*!
+ * \brief Benchmark an out-of-memory generator with the given options
+ */
+template <typename... Parameters>
+void outmemory_bench(dll_bench::bench_state& state, bool shuffle = false) {
+    auto& data = dataset();
+
+    auto generator = dll::make_generator(data.images, data.labels, N, Classes, dll::outmemory_data_generator_desc<Parameters...>{});
+
+    epoch_bench(state, generator, shuffle);
+}
+
+// In-memory generators
+
+DLL_BENCH("generator/inmemory/plain") {
+    inmemory_bench<dll::batch_size<100>>(state);
+}
+
+DLL_BENCH("generator/inmemory/categorical") {
+    inmemory_bench<dll::batch_size<100>, dll::categorical>(state);
+}
+
+DLL_BENCH("generator/inmemory/shuffle") {
+    inmemory_bench<dll::batch_size<100>, dll::categorical>(state, true);
+}
+
+DLL_BENCH("generator/inmemory/batch_1000") {
+    inmemory_bench<dll::batch_size<1000>, dll::categorical>(state);
+}
+
+DLL_BENCH("generator/inmemory/noise") {
+    inmemory_bench<dll::batch_size<100>, dll::categorical, dll::noise<30>>(state);
+}
+
+DLL_BENCH("generator/inmemory/mirroring") {
+    inmemory_bench<dll::batch_size<100>, dll::categorical, dll::horizontal_mirroring>(state);
+}
+
+DLL_BENCH("generator/inmemory/random_crop") {
+    inmemory_bench<dll::batch_size<100>, dll::categorical, dll::random_crop<24, 24>>(state);
+}
+
+DLL_BENCH("generator/inmemory/elastic") {
+    inmemory_bench<dll::batch_size<100>, dll::categorical, dll::elastic_distortion<3>>(state);
+}
+
+DLL_BENCH("generator/inmemory/threaded/noise") {
+    inmemory_bench<dll::batch_size<100>, dll::categorical, dll::noise<30>, dll::threaded>(state);
+}
+
+DLL_BENCH("generator/inmemory/threaded/elastic") {
+    inmemory_bench<dll::batch_size<100>, dll::categorical, dll::elastic_distortion<3>, dll::threaded>(state);
+}
+
+DLL_BENCH("generator/inmemory/threaded/elastic_4") {
+    inmemory_bench<dll::batch_size<100>, dll::categorical, dll::elastic_distortion<3>, dll::threaded, dll::augmentation_threads<4>>(state);
+}
+
+// Out-of-memory generators
+
+DLL_BENCH("generator/outmemory/plain") {
+    outmemory_bench<dll::batch_size<100>, dll::categorical>(state);
+}
+
+DLL_BENCH("generator/outmemory/big_batch") {
+    outmemory_bench<dll::batch_size<100>, dll::big_batch_size<10>, dll::categorical>(state);
+}
+
+DLL_BENCH("generator/outmemory/scale_pre") {
+    outmemory_bench<dll::batch_size<100>, dll::big_batch_size<10>, dll::categorical, dll::scale_pre<255>>(state);
+}
+
+DLL_BENCH("generator/outmemory/normalize_pre") {
+    outmemory_bench<dll::batch_size<100>, dll::big_batch_size<10>, dll::categorical, dll::normalize_pre>(state);
+}
+
+DLL_BENCH("generator/outmemory/binarize_pre") {
+    outmemory_bench<dll::batch_size<100>, dll::big_batch_size<10>, dll::categorical, dll::binarize_pre<127>>(state);
+}
+
+DLL_BENCH("generator/outmemory/noise") {
+    outmemory_bench<dll::batch_size<100>, dll::big_batch_size<10>, dll::categorical, dll::noise<30>>(state);
+}
+
+DLL_BENCH("generator/outmemory/threaded/noise") {
+    outmemory_bench<dll::batch_size<100>, dll::big_batch_size<10>, dll::categorical, dll::noise<30>, dll::threaded>(state);
+}
+
+} //end of anonymous namespace
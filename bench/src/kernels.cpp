@@ -0,0 +1,276 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// Micro benchmarks of the main kernels of the layers and of the updaters.
+//
+// The forward passes are measured directly on the layers. The backward
+// passes and the gradients are taken from the per-layer profile of the SGD
+// trainer, for one mini-batch of random data.
+
+#include "dll_bench.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/lstm_layer.hpp"
+#include "dll/neural/recurrent_last_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/rbm/rbm.hpp"
+#include "dll/dbn.hpp"
+
+namespace {
+
+constexpr size_t B = 64; ///< The batch size of all the benchmarks
+
+/*!
+ * \brief Fill the labels of a batch with one-hot classes
+ */
+template <typename Labels>
+void fill_labels(Labels& labels) {
+    labels = 0;
+
+    for (size_t i = 0; i < etl::dim<0>(labels); ++i) {
+        labels(i, i % etl::dim<1>(labels)) = 1.0;
+    }
+}
+
+/*!
+ * \brief Measure one phase of the training of the layer I of the given
+ * network, with the per-layer profile of the trainer.
+ */
+template <size_t I, typename DBN, typename Inputs, typename Labels>
+void profile_layer(dll_bench::bench_state& state, DBN& dbn, Inputs& inputs, Labels& labels, size_t dll::layer_profile::*phase) {
+    dll::sgd_trainer<DBN> trainer(dbn);
+
+    trainer.enable_profiling();
+
+    state.run_manual(etl::dim<0>(inputs), [&]() {
+        trainer.profile.reset();
+        trainer.train_batch(0, inputs, labels);
+        return double(trainer.profile.layers[I].*phase);
+    });
+}
+
+// Dense
+
+using dense_dbn_t = dll::dbn_desc<
+    dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 1024>::layer_t,
+        dll::dense_layer_desc<1024, 1024>::layer_t,
+        dll::dense_layer_desc<1024, 10, dll::softmax>::layer_t>,
+    dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<B>>::dbn_t;
+
+template <typename Functor>
+void dense_bench(Functor&& fun) {
+    auto dbn = std::make_unique<dense_dbn_t>();
+
+    etl::fast_dyn_matrix<float, B, 28 * 28> inputs;
+    etl::fast_dyn_matrix<float, B, 10> labels;
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    fill_labels(labels);
+
+    fun(*dbn, inputs, labels);
+}
+
+DLL_BENCH("dense/1024x1024/forward") {
+    auto layer = std::make_unique<dll::dense_layer_desc<1024, 1024>::layer_t>();
+
+    etl::fast_dyn_matrix<float, B, 1024> input;
+    etl::fast_dyn_matrix<float, B, 1024> output;
+
+    input = etl::uniform_generator(0.0, 1.0);
+
+    state.run(B, [&]() { layer->test_forward_batch(output, input); });
+}
+
+DLL_BENCH("dense/1024x1024/backward") {
+    dense_bench([&](auto& dbn, auto& inputs, auto& labels) { profile_layer<1>(state, dbn, inputs, labels, &dll::layer_profile::backward); });
+}
+
+DLL_BENCH("dense/1024x1024/gradients") {
+    dense_bench([&](auto& dbn, auto& inputs, auto& labels) { profile_layer<1>(state, dbn, inputs, labels, &dll::layer_profile::gradients); });
+}
+
+// Convolution
+
+using conv_dbn_t = dll::dbn_desc<
+    dll::dbn_layers<
+        dll::conv_layer_desc<1, 28, 28, 32, 5, 5>::layer_t,
+        dll::conv_layer_desc<32, 24, 24, 32, 3, 3>::layer_t,
+        dll::dense_layer_desc<32 * 22 * 22, 10, dll::softmax>::layer_t>,
+    dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<B>>::dbn_t;
+
+template <typename Functor>
+void conv_bench(Functor&& fun) {
+    auto dbn = std::make_unique<conv_dbn_t>();
+
+    etl::fast_dyn_matrix<float, B, 1, 28, 28> inputs;
+    etl::fast_dyn_matrix<float, B, 10> labels;
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    fill_labels(labels);
+
+    fun(*dbn, inputs, labels);
+}
+
+DLL_BENCH("conv/1x28x28-32x5x5/forward") {
+    auto layer = std::make_unique<dll::conv_layer_desc<1, 28, 28, 32, 5, 5>::layer_t>();
+
+    etl::fast_dyn_matrix<float, B, 1, 28, 28> input;
+    etl::fast_dyn_matrix<float, B, 32, 24, 24> output;
+
+    input = etl::uniform_generator(0.0, 1.0);
+
+    state.run(B, [&]() { layer->test_forward_batch(output, input); });
+}
+
+DLL_BENCH("conv/32x24x24-32x3x3/forward") {
+    auto layer = std::make_unique<dll::conv_layer_desc<32, 24, 24, 32, 3, 3>::layer_t>();
+
+    etl::fast_dyn_matrix<float, B, 32, 24, 24> input;
+    etl::fast_dyn_matrix<float, B, 32, 22, 22> output;
+
+    input = etl::uniform_generator(0.0, 1.0);
+
+    state.run(B, [&]() { layer->test_forward_batch(output, input); });
+}
+
+DLL_BENCH("conv/32x24x24-32x3x3/backward") {
+    conv_bench([&](auto& dbn, auto& inputs, auto& labels) { profile_layer<1>(state, dbn, inputs, labels, &dll::layer_profile::backward); });
+}
+
+DLL_BENCH("conv/1x28x28-32x5x5/gradients") {
+    conv_bench([&](auto& dbn, auto& inputs, auto& labels) { profile_layer<0>(state, dbn, inputs, labels, &dll::layer_profile::gradients); });
+}
+
+DLL_BENCH("conv/32x24x24-32x3x3/gradients") {
+    conv_bench([&](auto& dbn, auto& inputs, auto& labels) { profile_layer<1>(state, dbn, inputs, labels, &dll::layer_profile::gradients); });
+}
+
+// Pooling
+
+using pool_dbn_t = dll::dbn_desc<
+    dll::dbn_layers<
+        dll::conv_layer_desc<1, 28, 28, 32, 5, 5>::layer_t,
+        dll::mp_2d_layer_desc<32, 24, 24, 2, 2>::layer_t,
+        dll::dense_layer_desc<32 * 12 * 12, 10, dll::softmax>::layer_t>,
+    dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<B>>::dbn_t;
+
+DLL_BENCH("pooling/mp_2d-32x24x24/forward") {
+    dll::mp_2d_layer_desc<32, 24, 24, 2, 2>::layer_t layer;
+
+    etl::fast_dyn_matrix<float, B, 32, 24, 24> input;
+    etl::fast_dyn_matrix<float, B, 32, 12, 12> output;
+
+    input = etl::uniform_generator(0.0, 1.0);
+
+    state.run(B, [&]() { layer.test_forward_batch(output, input); });
+}
+
+DLL_BENCH("pooling/mp_2d-32x24x24/backward") {
+    auto dbn = std::make_unique<pool_dbn_t>();
+
+    etl::fast_dyn_matrix<float, B, 1, 28, 28> inputs;
+    etl::fast_dyn_matrix<float, B, 10> labels;
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    fill_labels(labels);
+
+    profile_layer<1>(state, *dbn, inputs, labels, &dll::layer_profile::backward);
+}
+
+// LSTM
+
+template <typename... Options>
+using lstm_dbn_t = typename dll::dbn_desc<
+    dll::dbn_layers<
+        typename dll::lstm_layer_desc<28, 28, 100, dll::last_only, Options...>::layer_t,
+        dll::recurrent_last_layer_desc<28, 100>::layer_t,
+        dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+    dll::updater<dll::updater_type::ADAM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<B>>::dbn_t;
+
+template <typename... Options, typename Functor>
+void lstm_bench(Functor&& fun) {
+    auto dbn = std::make_unique<lstm_dbn_t<Options...>>();
+
+    etl::fast_dyn_matrix<float, B, 28, 28> inputs;
+    etl::fast_dyn_matrix<float, B, 10> labels;
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    fill_labels(labels);
+
+    fun(*dbn, inputs, labels);
+}
+
+DLL_BENCH("lstm/28x28-100/forward") {
+    lstm_bench([&](auto& dbn, auto& inputs, auto& labels) { profile_layer<0>(state, dbn, inputs, labels, &dll::layer_profile::forward); });
+}
+
+DLL_BENCH("lstm/28x28-100/gradients") {
+    lstm_bench([&](auto& dbn, auto& inputs, auto& labels) { profile_layer<0>(state, dbn, inputs, labels, &dll::layer_profile::gradients); });
+}
+
+DLL_BENCH("lstm/28x28-100/forward/fast") {
+    lstm_bench<dll::fast_activations>([&](auto& dbn, auto& inputs, auto& labels) { profile_layer<0>(state, dbn, inputs, labels, &dll::layer_profile::forward); });
+}
+
+DLL_BENCH("lstm/28x28-100/gradients/fast") {
+    lstm_bench<dll::fast_activations>([&](auto& dbn, auto& inputs, auto& labels) { profile_layer<0>(state, dbn, inputs, labels, &dll::layer_profile::gradients); });
+}
+
+// RBM
+
+template <typename... Options>
+void rbm_bench(dll_bench::bench_state& state) {
+    auto rbm = std::make_unique<typename dll::rbm_desc<28 * 28, 500, dll::batch_size<B>, Options...>::layer_t>();
+
+    std::vector<etl::dyn_vector<float>> samples(16 * B, etl::dyn_vector<float>(28 * 28));
+
+    for (auto& sample : samples) {
+        sample = etl::uniform_generator(0.0, 1.0);
+    }
+
+    // One epoch is 16 mini-batches of CD-1
+    state.run(samples.size(), [&]() { rbm->template train<false>(samples, 1); });
+}
+
+DLL_BENCH("rbm/784x500/cd1") { rbm_bench(state); }
+DLL_BENCH("rbm/784x500/cd1/fast") { rbm_bench<dll::fast_activations>(state); }
+
+// Updaters
+
+template <dll::updater_type UT>
+void updater_bench(dll_bench::bench_state& state) {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 1024>::layer_t,
+            dll::dense_layer_desc<1024, 10, dll::softmax>::layer_t>,
+        dll::updater<UT>, dll::trainer<dll::sgd_trainer>, dll::batch_size<B>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, B, 28 * 28> inputs;
+    etl::fast_dyn_matrix<float, B, 10> labels;
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    fill_labels(labels);
+
+    profile_layer<0>(state, *dbn, inputs, labels, &dll::layer_profile::gradients);
+}
+
+DLL_BENCH("updater/sgd") { updater_bench<dll::updater_type::SGD>(state); }
+DLL_BENCH("updater/momentum") { updater_bench<dll::updater_type::MOMENTUM>(state); }
+DLL_BENCH("updater/nesterov") { updater_bench<dll::updater_type::NESTEROV>(state); }
+DLL_BENCH("updater/adagrad") { updater_bench<dll::updater_type::ADAGRAD>(state); }
+DLL_BENCH("updater/rmsprop") { updater_bench<dll::updater_type::RMSPROP>(state); }
+DLL_BENCH("updater/adam") { updater_bench<dll::updater_type::ADAM>(state); }
+DLL_BENCH("updater/adam_correct") { updater_bench<dll::updater_type::ADAM_CORRECT>(state); }
+DLL_BENCH("updater/adamax") { updater_bench<dll::updater_type::ADAMAX>(state); }
+DLL_BENCH("updater/nadam") { updater_bench<dll::updater_type::NADAM>(state); }
+DLL_BENCH("updater/adadelta") { updater_bench<dll::updater_type::ADADELTA>(state); }
+
+} //end of anonymous namespace
@@ -0,0 +1,121 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "dll_bench.hpp"
+
+namespace {
+
+void print_usage() {
+    std::cout << "Usage: dll_bench [options]" << std::endl;
+    std::cout << "  --filter=<text>    Only run the benchmarks containing text" << std::endl;
+    std::cout << "  --warmup=<n>       Number of warmup iterations (default 2)" << std::endl;
+    std::cout << "  --repetitions=<n>  Number of measured iterations (default 10)" << std::endl;
+    std::cout << "  --json=<file>      Write the results in JSON to file" << std::endl;
+    std::cout << "  --list             List the benchmarks" << std::endl;
+}
+
+void write_json(std::ostream& out, const std::vector<dll_bench::bench_result>& results) {
+    out << "{\n  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+
+        out << "    {\"name\": \"" << r.name << "\""
+            << ", \"iterations\": " << r.iterations
+            << ", \"items\": " << r.items
+            << ", \"median_ns\": " << r.median
+            << ", \"min_ns\": " << r.min
+            << ", \"max_ns\": " << r.max
+            << ", \"mean_ns\": " << r.mean
+            << ", \"stddev_ns\": " << r.stddev
+            << ", \"items_per_second\": " << r.throughput() << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n}\n";
+}
+
+bool starts_with(const std::string& str, const std::string& prefix) {
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+} //end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::string json;
+    size_t warmup      = 2;
+    size_t repetitions = 10;
+    bool list          = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+
+        if (starts_with(arg, "--filter=")) {
+            filter = arg.substr(9);
+        } else if (starts_with(arg, "--warmup=")) {
+            warmup = std::stoul(arg.substr(9));
+        } else if (starts_with(arg, "--repetitions=")) {
+            repetitions = std::max<size_t>(1, std::stoul(arg.substr(14)));
+        } else if (starts_with(arg, "--json=")) {
+            json = arg.substr(7);
+        } else if (arg == "--list") {
+            list = true;
+        } else {
+            print_usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::vector<dll_bench::bench_result> results;
+
+    for (auto& bench : dll_bench::registry()) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        if (list) {
+            std::cout << bench.name << std::endl;
+            continue;
+        }
+
+        dll_bench::bench_state state(warmup, repetitions);
+
+        bench.fun(state);
+
+        if (state.times.empty()) {
+            std::cout << bench.name << ": skipped" << std::endl;
+            continue;
+        }
+
+        auto result = dll_bench::compute_result(bench.name, state);
+
+        char buffer[512];
+        snprintf(buffer, 512, "%-32s median:%12.3fus min:%12.3fus stddev:%10.3fus %14.1f items/s",
+                 result.name.c_str(), result.median / 1000.0, result.min / 1000.0, result.stddev / 1000.0, result.throughput());
+        std::cout << buffer << std::endl;
+
+        results.push_back(result);
+    }
+
+    if (!json.empty()) {
+        std::ofstream out(json);
+
+        if (!out) {
+            std::cout << "dll_bench: error: impossible to write " << json << std::endl;
+            return 1;
+        }
+
+        write_json(out, results);
+    }
+
+    return 0;
+}
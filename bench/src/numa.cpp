@@ -0,0 +1,76 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// Memory bandwidth benchmarks of the NUMA placements of a data cache. The
+// items are bytes, the throughput is the bandwidth in bytes per second.
+//
+// The cache is read in parallel by the kernel threads, either after being
+// first-touched by a single thread (all its pages on one node) or after
+// being interleaved on all the nodes.
+
+#include <numeric>
+#include <vector>
+
+#include "dll_bench.hpp"
+
+#include "dll/util/numa.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace {
+
+constexpr size_t N      = 64 * 1024 * 1024; ///< The number of floats of the cache (256MB)
+constexpr size_t Chunks = 256;              ///< The number of chunks read in parallel
+
+/*!
+ * \brief Read the complete cache in parallel
+ */
+float parallel_read(const std::vector<float>& cache) {
+    std::array<float, Chunks> sums;
+
+    dll::parallel_kernel(0, Chunks, [&](size_t c) {
+        const size_t chunk = cache.size() / Chunks;
+
+        float sum = 0.0f;
+        for (size_t i = c * chunk; i < (c + 1) * chunk; ++i) {
+            sum += cache[i];
+        }
+
+        sums[c] = sum;
+    });
+
+    return std::accumulate(sums.begin(), sums.end(), 0.0f);
+}
+
+template <typename Prepare>
+void bandwidth_bench(dll_bench::bench_state& state, Prepare&& prepare) {
+    std::vector<float> cache(N, 1.0f);
+
+    prepare(cache);
+
+    volatile float result = 0.0f;
+
+    state.run(N * sizeof(float), [&]() { result = parallel_read(cache); });
+
+    cpp_unused(result);
+}
+
+DLL_BENCH("numa/bandwidth/first_touch") {
+    bandwidth_bench(state, [](auto& /*cache*/) {});
+}
+
+DLL_BENCH("numa/bandwidth/interleave") {
+    bandwidth_bench(state, [](auto& cache) { dll::numa_interleave(cache.data(), cache.size() * sizeof(float)); });
+}
+
+// Note: the kernel threads stay pinned for the next benchmarks
+DLL_BENCH("numa/bandwidth/pinned_interleave") {
+    dll::numa_pin_kernels();
+
+    bandwidth_bench(state, [](auto& cache) { dll::numa_interleave(cache.data(), cache.size() * sizeof(float)); });
+}
+
+} //end of anonymous namespace
@@ -44,5 +44,8 @@ int main(int /*argc*/, char* /*argv*/ []) {
     // Show where the time was spent
     dll::dump_timers_pretty();
 
+    // Show the memory used by the training
+    dll::dump_memory_pretty();
+
     return 0;
 }
@@ -24,6 +24,7 @@
 #include "decay_type.hpp"
 #include "sparsity_method.hpp"
 #include "bias_mode.hpp"
+#include "storage_type.hpp"
 #include "initializer.hpp"
 #include "output.hpp"
 
@@ -106,6 +107,8 @@ struct copy_id;
 struct elastic_id;
 struct batch_size_id;
 struct big_batch_size_id;
+struct big_batch_budget_id;
+struct big_batch_free_memory_id;
 struct visible_id;
 struct hidden_id;
 struct pooling_id;
@@ -124,6 +127,15 @@ struct watcher_id;
 struct sparsity_id;
 struct bias_id;
 struct momentum_id;
+struct parallel_gibbs_id;
+struct fft_conv_id;
+struct sparse_input_id;
+struct binary_input_id;
+struct transposed_weights_id;
+struct fast_activations_id;
+struct sampled_softmax_id;
+struct statistics_every_id;
+struct async_cd_id;
 struct serial_id;
 struct verbose_id;
 struct horizontal_id;
@@ -134,6 +146,7 @@ struct svm_concatenate_id;
 struct svm_scale_id;
 struct init_weights_id;
 struct clip_gradients_id;
+struct global_clip_gradients_id;
 struct weight_type_id;
 struct free_energy_id;
 struct no_epoch_error_id;
@@ -141,10 +154,15 @@ struct random_crop_id;
 struct batch_mode_id;
 struct dbn_only_id;
 struct last_only_id;
+struct variable_length_id;
 struct horizontal_mirroring_id;
 struct vertical_mirroring_id;
 struct categorical_id;
+struct sparse_labels_id;
 struct threaded_id;
+struct prefetch_id;
+struct sharded_id;
+struct augmentation_threads_id;
 struct nop_id;
 struct no_bias_id;
 struct elastic_distortion_id;
@@ -157,6 +175,35 @@ struct updater_id;
 struct early_stopping_id;
 struct early_training_id;
 struct truncate_id;
+struct parallel_sgd_id;
+struct sgd_checkpoint_id;
+struct gradient_accumulation_id;
+struct frozen_layers_id;
+struct selective_backprop_id;
+struct overlap_gradients_id;
+struct pipeline_updates_id;
+struct pipeline_stages_id;
+struct micro_batches_id;
+struct arena_id;
+struct flat_parameters_id;
+struct checkpoint_every_id;
+struct pipelined_pretrain_id;
+struct spill_pretrain_id;
+struct data_storage_id;
+struct autotune_id;
+struct fast_layers_id;
+struct index_shuffle_id;
+struct length_buckets_id;
+struct numa_id;
+struct augment_cache_id;
+struct async_validation_id;
+struct backup_every_id;
+struct pool_stride_id;
+struct channels_last_id;
+struct top_k_error_id;
+struct compressed_cache_id;
+struct async_reads_id;
+struct fixed_shapes_id;
 
 /*!
  * \brief Sets the minibatch size
@@ -175,6 +222,30 @@ struct batch_size : value_conf_elt<batch_size_id, size_t, B> {};
 template <size_t B>
 struct big_batch_size : value_conf_elt<big_batch_size_id, size_t, B> {};
 
+/*!
+ * \brief Sets the memory budget of the batches kept in cache by the
+ * threaded generators.
+ *
+ * The number of cached batches is computed at the construction of the
+ * generator from the size of a batch, instead of big_batch_size.
+ *
+ * \tparam MB The budget, in megabytes
+ */
+template <size_t MB>
+struct big_batch_budget : value_conf_elt<big_batch_budget_id, size_t, MB> {};
+
+/*!
+ * \brief Sets the memory budget of the batches kept in cache by the
+ * threaded generators as a percentage of the available memory at the
+ * construction of the generator.
+ *
+ * When big_batch_budget is set as well, the smallest budget is used.
+ *
+ * \tparam P The percentage of the available memory
+ */
+template <size_t P>
+struct big_batch_free_memory : value_conf_elt<big_batch_free_memory_id, size_t, P> {};
+
 /*!
  * \brief Sets the updater type
  * \tparam UT The updater type
@@ -344,6 +415,101 @@ struct watcher : template_type_conf_elt<watcher_id, T> {};
  */
 struct momentum : basic_conf_elt<momentum_id> {};
 
+/*!
+ * \brief Run the Gibbs chains of Contrastive Divergence in parallel, by
+ * shards of the batch
+ */
+struct parallel_gibbs : basic_conf_elt<parallel_gibbs_id> {};
+
+/*!
+ * \brief Compute the convolutions of a convolutional RBM in the frequency
+ * domain, for large kernels
+ */
+struct fft_conv : basic_conf_elt<fft_conv_id> {};
+
+/*!
+ * \brief Compute the products with the input of the layer in CSR format,
+ * for very sparse inputs (bag-of-words).
+ *
+ * The cost of the products and of the gradients of the weights is
+ * proportional to the number of non-zeros of the input. Only the rows of
+ * the weights of the non-zero inputs are updated (and decayed) by the
+ * updaters supporting sparse gradients.
+ */
+struct sparse_input : basic_conf_elt<sparse_input_id> {};
+
+/*!
+ * \brief Compute the products with the binary input of the RBM from its
+ * bit-packed representation.
+ *
+ * Each input is packed in 64 bits words and the products with the weights
+ * only accumulate the rows of the weights of the units that are on. The
+ * input must be binary (binarize_pre or binarize_layer), any non-zero value
+ * is taken as one.
+ */
+struct binary_input : basic_conf_elt<binary_input_id> {};
+
+/*!
+ * \brief Keep a transposed copy of the weights of the RBM during Contrastive
+ * Divergence, for the reconstructions of the visible units.
+ *
+ * The copy is refreshed after each update of the weights. The
+ * reconstructions are then products with weights in their native layout,
+ * instead of the tiles of the weights read once for the reconstruction and
+ * the next hidden activation. This is not compatible with the asynchronous
+ * workers (async_cd) and the parallel Gibbs chains use the weights directly.
+ */
+struct transposed_weights : basic_conf_elt<transposed_weights_id> {};
+
+/*!
+ * \brief Compute the sigmoid, the hyperbolic tangent and the softmax of the
+ * layer with fast approximations of the exponential.
+ *
+ * This is supported by the dense layers, the LSTM layers (gates and
+ * activation) and the dense RBMs. The absolute error of the activations is
+ * below 1e-6 in single precision (see dll/util/fast_math.hpp).
+ */
+struct fast_activations : basic_conf_elt<fast_activations_id> {};
+
+/*!
+ * \brief Train the softmax output layer with a sampled softmax.
+ *
+ * During training, the softmax, its errors and its gradients are only
+ * computed over the classes of the samples of the batch and S negative
+ * classes sampled uniformly. The full softmax is used for the evaluation and
+ * the prediction. This is only supported by the dense layers with a softmax
+ * activation, as the last layer of a network trained with the categorical
+ * cross entropy.
+ *
+ * \tparam S The number of sampled negative classes
+ */
+template <size_t S>
+struct sampled_softmax : value_conf_elt<sampled_softmax_id, size_t, S> {};
+
+/*!
+ * \brief Compute the reconstruction error and the sparsity of the RBM only
+ * every N mini-batches.
+ *
+ * The statistics are still computed for every batch displayed by a verbose
+ * watcher.
+ *
+ * \tparam N The number of mini-batches between two measures
+ */
+template <size_t N>
+struct statistics_every : value_conf_elt<statistics_every_id, size_t, N> {};
+
+/*!
+ * \brief Train the RBM asynchronously with several workers.
+ *
+ * Each worker trains its own mini-batches with its own Contrastive
+ * Divergence trainer and updates the shared weights without any lock
+ * (Hogwild).
+ *
+ * \tparam W The number of workers (0 for all the cores)
+ */
+template <size_t W = 0>
+struct async_cd : value_conf_elt<async_cd_id, size_t, W> {};
+
 /*!
  * \brief Disable threading
  */
@@ -379,11 +545,44 @@ struct vertical_mirroring : basic_conf_elt<vertical_mirroring_id> {};
  */
 struct categorical : basic_conf_elt<categorical_id> {};
 
+/*!
+ * \brief Keep the categorical labels as class indices.
+ *
+ * The label caches of the generators store one index per sample instead of
+ * a one-hot vector and the categorical cross entropy is computed directly
+ * from the indices.
+ */
+struct sparse_labels : basic_conf_elt<sparse_labels_id> {};
+
 /*!
  * \brief Use a thread for data augmentation.
  */
 struct threaded : basic_conf_elt<threaded_id> {};
 
+/*!
+ * \brief Prefetch the next big batches on a background thread
+ * (out-of-memory generators only).
+ * \tparam D The depth of the prefetch queue, in big batches
+ */
+template <size_t D = 2>
+struct prefetch : value_conf_elt<prefetch_id, size_t, D> {};
+
+/*!
+ * \brief Read the dataset of an out-of-memory generator in shards of S
+ * samples, in a random order each epoch, through a shuffle buffer of B
+ * samples (one shard by default).
+ */
+template <size_t S, size_t B = 0>
+struct sharded : value_pair_conf_elt<sharded_id, size_t, S, B> {};
+
+/*!
+ * \brief Sets the number of threads augmenting the data
+ * (in-memory generators only).
+ * \tparam N The number of augmentation threads
+ */
+template <size_t N>
+struct augmentation_threads : value_conf_elt<augmentation_threads_id, size_t, N> {};
+
 /*!
  * \brief Sets the elastic distortion kernel
  * \tparam K The elastic distortion kernel
@@ -453,6 +652,12 @@ struct no_epoch_error : basic_conf_elt<no_epoch_error_id> {};
  */
 struct clip_gradients : basic_conf_elt<clip_gradients_id> {};
 
+/*!
+ * \brief Enable gradient clipping on the global norm of the gradients of all
+ * the layers of the network, instead of the norm of each gradient.
+ */
+struct global_clip_gradients : basic_conf_elt<global_clip_gradients_id> {};
+
 /*!
  * \brief Indicates that the layer is only made to be used in a DBN.
  *
@@ -467,6 +672,16 @@ struct dbn_only : basic_conf_elt<dbn_only_id> {};
  */
 struct last_only : basic_conf_elt<last_only_id> {};
 
+/*!
+ * \brief Process variable-length sequences, padded with zeros, in a
+ * recurrent layer.
+ *
+ * Each batch is only computed up to its longest sequence, the outputs of
+ * the padding are set to zero and their errors are not propagated. The
+ * recurrent last layer takes the last step of each sequence.
+ */
+struct variable_length : basic_conf_elt<variable_length_id> {};
+
 /*!
  * \brief Do nothing (for TMP)
  */
@@ -477,6 +692,12 @@ struct nop : basic_conf_elt<nop_id> {};
  */
 struct no_bias : basic_conf_elt<no_bias_id> {};
 
+/*!
+ * \brief Benchmark the convolution strategies for the shapes of the layer
+ * and use the fastest. The selections are cached on disk.
+ */
+struct autotune : basic_conf_elt<autotune_id> {};
+
 /*!
  * \brief Use batch mode in DBN (Do not process the complete dataset at once)
  */
@@ -489,6 +710,355 @@ struct batch_mode : basic_conf_elt<batch_mode_id> {};
 template <size_t T>
 struct truncate : value_conf_elt<truncate_id, size_t, T> {};
 
+/*!
+ * \brief Use data-parallel SGD over S shards.
+ *
+ * Each training step processes S mini-batches concurrently on replicas of
+ * the training context, using the thread pool of the network. The gradients
+ * of the shards are summed before the weights are updated, so this is
+ * equivalent to training with batches of S * batch_size samples.
+ *
+ * \tparam S The number of shards
+ */
+template <size_t S>
+struct parallel_sgd : value_conf_elt<parallel_sgd_id, size_t, S> {};
+
+/*!
+ * \brief Checkpoint the activations of every K-th layer during SGD.
+ *
+ * The activations of the other layers are released after the forward pass
+ * and computed again, segment by segment, during the backward pass. This
+ * trades one more forward pass for the memory of the activations of the
+ * dynamic contexts.
+ *
+ * \tparam K The number of layers of each segment
+ */
+template <size_t K>
+struct sgd_checkpoint : value_conf_elt<sgd_checkpoint_id, size_t, K> {};
+
+/*!
+ * \brief Accumulate the gradients of M mini-batches before each update of
+ * the weights.
+ *
+ * This is equivalent to training with batches of M * batch_size samples,
+ * while the training contexts are only sized for batch_size samples. Only
+ * one more copy of the gradients is kept.
+ *
+ * \tparam M The number of accumulated mini-batches
+ */
+template <size_t M>
+struct gradient_accumulation : value_conf_elt<gradient_accumulation_id, size_t, M> {};
+
+/*!
+ * \brief Freeze the first K layers of the network during fine-tuning.
+ *
+ * The outputs of the frozen layers are computed once, in test mode, into a
+ * cache of the whole training set. Then only the remaining layers are
+ * trained from this cache, the frozen layers are neither forward nor
+ * backward propagated anymore.
+ *
+ * \tparam K The number of frozen layers
+ */
+template <size_t K>
+struct frozen_layers : value_conf_elt<frozen_layers_id, size_t, K> {};
+
+/*!
+ * \brief Only backpropagate the P percent of the samples with the highest
+ * loss, during SGD (Selective-Backprop).
+ *
+ * Each mini-batch is first forward propagated to score its samples, with
+ * the norm of the errors of the last layer. The selected samples are
+ * buffered until a full mini-batch of them is ready to be trained. The
+ * samples with a low loss do not cost a backward pass anymore.
+ *
+ * \tparam P The percentage of the samples that are backpropagated (100 to disable)
+ */
+template <size_t P>
+struct selective_backprop : value_conf_elt<selective_backprop_id, size_t, P> {};
+
+/*!
+ * \brief Overlap the computation and the application of the gradients of
+ * each layer with the backward pass of the lower layers, during SGD.
+ *
+ * Once the errors of a layer have been propagated to the layer below, its
+ * gradients are computed and applied by a task of a work-stealing pool,
+ * while the main thread keeps propagating the errors.
+ */
+struct overlap_gradients : basic_conf_elt<overlap_gradients_id> {};
+
+/*!
+ * \brief Pipeline the updates of the weights with the forward pass of the
+ * next batch, during SGD.
+ *
+ * The gradients of each layer are computed and applied in the background
+ * after the backward pass, the next forward pass only waits for the update
+ * of a layer just before using it. The updates are the same, only their
+ * timing changes. Between the batches, the watchers may see weights that
+ * are not yet updated, the updates are completed at the end of each epoch.
+ */
+struct pipeline_updates : basic_conf_elt<pipeline_updates_id> {};
+
+/*!
+ * \brief Use pipeline-parallel SGD over S stages.
+ *
+ * The layers are split in S contiguous stages of balanced cost, each stage
+ * being run by its own thread. Each training step processes several
+ * mini-batches (the micro-batches, see micro_batches) on replicas of the
+ * training context, the micro-batches flowing through the stages. The
+ * gradients of the micro-batches are summed before the weights of each
+ * stage are updated, so this is equivalent to training with batches of
+ * M * batch_size samples.
+ *
+ * \tparam S The number of stages
+ */
+template <size_t S>
+struct pipeline_stages : value_conf_elt<pipeline_stages_id, size_t, S> {};
+
+/*!
+ * \brief Sets the number of micro-batches of each step of pipeline-parallel
+ * SGD (see pipeline_stages), the number of stages by default.
+ *
+ * \tparam M The number of micro-batches
+ */
+template <size_t M>
+struct micro_batches : value_conf_elt<micro_batches_id, size_t, M> {};
+
+/*!
+ * \brief Allocate the training contexts of the network from an arena.
+ *
+ * The contexts of all the layers are laid out in one contiguous 64-byte
+ * aligned block owned by the network, which is reused across epochs and
+ * across trainings.
+ */
+struct arena : basic_conf_elt<arena_id> {};
+
+/*!
+ * \brief Keep a flat store of all the parameters of the network.
+ *
+ * The backups of the weights are a single contiguous copy of all the
+ * parameters and the parameters can be stored to a file with a single
+ * write.
+ */
+struct flat_parameters : basic_conf_elt<flat_parameters_id> {};
+
+/*!
+ * \brief Checkpoint the training every N mini-batches.
+ *
+ * The parameters and the state of the updater are copied into a snapshot
+ * which is written to the checkpoint file of the network by a background
+ * thread.
+ *
+ * \tparam N The number of mini-batches between two checkpoints
+ */
+template <size_t N>
+struct checkpoint_every : value_conf_elt<checkpoint_every_id, size_t, N> {};
+
+/*!
+ * \brief Stream the representation of each trained layer to the next layer
+ * during pretraining.
+ *
+ * Instead of computing the complete representation of the dataset before
+ * training the next layer, the batches are computed on the fly by a
+ * producer thread, into a bounded queue. This saves the memory of the
+ * intermediate datasets, but the representations are computed again at
+ * each epoch.
+ */
+struct pipelined_pretrain : basic_conf_elt<pipelined_pretrain_id> {};
+
+/*!
+ * \brief Spill the representation of each trained layer to a memory-mapped
+ * file during pretraining, instead of keeping it in memory.
+ *
+ * The files are created in the spill_directory of the network.
+ */
+struct spill_pretrain : basic_conf_elt<spill_pretrain_id> {};
+
+/*!
+ * \brief Sets the storage type of the data cache of the in-memory generators.
+ *
+ * With a compact storage, the raw samples are stored narrowed and they are
+ * widened, and pre-processed, when the batches are generated.
+ *
+ * \tparam S The storage type
+ */
+template <storage_type S>
+struct data_storage : value_conf_elt<data_storage_id, storage_type, S> {};
+
+/*!
+ * \brief Compress the compact data cache of the in-memory generators by
+ * blocks of samples, with LZ4.
+ *
+ * The shuffle only changes the order of the blocks, and of the samples
+ * inside each block. The next blocks are decompressed on their own threads
+ * while the current batch is used.
+ *
+ * \tparam B The number of samples of a block
+ */
+template <size_t B = 1024>
+struct compressed_cache : value_conf_elt<compressed_cache_id, size_t, B> {};
+
+/*!
+ * \brief Make the memory-mapped generator read its batches ahead into its
+ * own buffers, with asynchronous reads (io_uring on Linux, a few threads
+ * otherwise), instead of serving views of the mapping.
+ *
+ * A data batch is then only valid until the next batch.
+ *
+ * \tparam D The number of batches being read or used at once
+ */
+template <size_t D = 4>
+struct async_reads : value_conf_elt<async_reads_id, size_t, D> {};
+
+/*!
+ * \brief A shape known at compile-time, for instance the number of inputs
+ * and outputs of a dense layer or the size of the filters of a
+ * convolutional layer.
+ */
+template <size_t... Dims>
+struct shape {
+    static constexpr size_t dimensions = sizeof...(Dims); ///< The number of dimensions
+};
+
+/*!
+ * \brief Sets the shapes for which a dynamic layer uses kernels specialized
+ * at compile-time.
+ *
+ * When the layer is initialized, it uses the kernel of the first shape
+ * matching its own, if any, and the generic code otherwise.
+ *
+ * \tparam Shapes The shapes, as dll::shape
+ */
+template <typename... Shapes>
+struct fixed_shapes : type_conf_elt<fixed_shapes_id, cpp::type_list<Shapes...>> {};
+
+/*!
+ * \brief The shapes [V x H] of the dynamic dense layers and RBMs having
+ * specialized kernels by default.
+ *
+ * These are the small output layers, for which the fixed loops are faster
+ * than the generic matrix product.
+ */
+using default_dense_shapes = fixed_shapes<shape<784, 10>, shape<500, 10>, shape<250, 10>, shape<200, 10>, shape<100, 10>, shape<784, 100>>;
+
+/*!
+ * \brief The filter shapes [NW1 x NW2] of the dynamic convolutional layers
+ * having specialized kernels by default.
+ */
+using default_conv_shapes = fixed_shapes<shape<3, 3>, shape<5, 5>>;
+
+/*!
+ * \brief Shuffle the samples of the in-memory generators through a
+ * permutation of indices instead of moving the samples in their cache.
+ *
+ * The batches are then gathered into a contiguous buffer. With a block
+ * larger than one, the blocks of contiguous samples are shuffled, and the
+ * samples inside each block, which keeps the gathers local.
+ *
+ * \tparam B The number of samples of the shuffled blocks
+ */
+template <size_t B = 1>
+struct index_shuffle : value_conf_elt<index_shuffle_id, size_t, B> {};
+
+/*!
+ * \brief Make the in-memory generators emit batches of sequences of similar
+ * lengths, for the variable_length recurrent layers.
+ *
+ * The samples are sequences [T x S] padded with zeros. They are sorted by
+ * length through the index shuffle, the shuffle then only changes the order
+ * of the batches and the order of the sequences of the same length.
+ */
+struct length_buckets : basic_conf_elt<length_buckets_id> {};
+
+/*!
+ * \brief Use the NUMA policy: the data caches are interleaved on all the
+ * nodes and the worker threads are pinned to cores.
+ *
+ * The policy can also be enabled with the DLL_NUMA environment variable.
+ */
+struct numa : basic_conf_elt<numa_id> {};
+
+/*!
+ * \brief Sets the layers that are kept static in a hybrid network.
+ *
+ * The other layers of a hybrid network are replaced by their dynamic
+ * version.
+ *
+ * \tparam Layers The layers to keep as is
+ */
+template <typename... Layers>
+struct fast_layers : type_conf_elt<fast_layers_id, cpp::type_list<Layers...>> {};
+
+/*!
+ * \brief Cache the augmented samples of an in-memory generator and reuse
+ * each of them for K epochs.
+ *
+ * The augmented samples are kept in a LRU cache of at most M samples (0 for
+ * the whole dataset). A sample that is not in the cache anymore is
+ * augmented again, the same way, so the size of the cache only changes the
+ * augmentation cost, never the generated data.
+ *
+ * \tparam K The number of epochs each augmented variant is used for
+ * \tparam M The maximum number of cached samples
+ */
+template <size_t K, size_t M = 0>
+struct augment_cache : value_pair_conf_elt<augment_cache_id, size_t, K, M> {};
+
+/*!
+ * \brief Evaluate the validation set in background, on a snapshot of the
+ * weights, while the next epoch is trained.
+ *
+ * The early stopping decisions are taken one epoch late.
+ */
+struct async_validation : basic_conf_elt<async_validation_id> {};
+
+/*!
+ * \brief Backup the best weights of the early stopping at most every N
+ * epochs.
+ *
+ * The improvements found less than N epochs after the last backup are not
+ * saved, the restored weights are the weights of the last backup.
+ *
+ * \tparam N The minimum number of epochs between two backups
+ */
+template <size_t N>
+struct backup_every : value_conf_elt<backup_every_id, size_t, N> {};
+
+/*!
+ * \brief Compute the convolutional stack of the inference engine in the
+ * channels-last layout ([H x W x C] per sample).
+ *
+ * The convolutional and max pooling layers work on the channels-last
+ * activations, the layout is only converted at the edges of the stack. The
+ * training is not changed.
+ */
+struct channels_last : basic_conf_elt<channels_last_id> {};
+
+/*!
+ * \brief Make the error of a classification network the top-K error: a
+ * sample is misclassified when its label is not one of the K classes with
+ * the largest outputs.
+ *
+ * The error is computed in the same pass as the loss, it is used by the
+ * evaluation, the error of the epochs and the early stopping.
+ *
+ * \tparam K The number of classes considered for each sample
+ */
+template <size_t K>
+struct top_k_error : value_conf_elt<top_k_error_id, size_t, K> {};
+
+/*!
+ * \brief Sets the strides of a 2D pooling layer, the windows overlap when
+ * the strides are smaller than the pooling ratios.
+ *
+ * A stride of 0 (the default) is the pooling ratio, i.e. non-overlapping
+ * windows.
+ *
+ * \tparam S1 The stride of the first dimension
+ * \tparam S2 The stride of the second dimension
+ */
+template <size_t S1, size_t S2 = S1>
+struct pool_stride : value_pair_conf_elt<pool_stride_id, size_t, S1, S2> {};
+
 /*!
  * \brief Conditional shuffle (shuffle if Cond = true)
  */
@@ -507,12 +1077,24 @@ using clipping_cond = std::conditional_t<Cond, clip_gradients, nop>;
 template <bool Cond>
 using normalize_pre_cond = std::conditional_t<Cond, normalize_pre, nop>;
 
+/*!
+ * \brief Conditional sparse labels.
+ */
+template <bool Cond>
+using sparse_labels_cond = std::conditional_t<Cond, sparse_labels, nop>;
+
 /*!
  * \brief Conditional auto-encoder configuration.
  */
 template <bool Cond>
 using autoencoder_cond = std::conditional_t<Cond, autoencoder, nop>;
 
+/*!
+ * \brief Conditional NUMA policy.
+ */
+template <bool Cond>
+using numa_cond = std::conditional_t<Cond, numa, nop>;
+
 } //end of dll namespace
 
 #include "short_conf.hpp"
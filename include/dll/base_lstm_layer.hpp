@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <fstream>
+#include <vector>
 
 #include "cpp_utils/assert.hpp" //Assertions
 #include "cpp_utils/io.hpp"     // For binary writing
@@ -16,10 +18,19 @@
 
 #include "layer.hpp"
 #include "layer_traits.hpp"
+#include "util/gpu.hpp"
+#include "util/parallel.hpp"
+#include "util/sequences.hpp"
 #include "util/tmp.hpp"
 
 namespace dll {
 
+/*!
+ * \brief The minimum number of hidden values processed by one task of the
+ * parallel element-wise passes of the LSTM layers
+ */
+constexpr size_t lstm_parallel_grain = 2048;
+
 /*!
  * \brief Base class for LSTM layers (fast / dynamic)
  */
@@ -33,6 +44,8 @@ struct base_lstm_layer : layer<Derived> {
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
 
+    static constexpr bool fast_activations = desc::parameters::template contains<dll::fast_activations>(); ///< Use the fast approximations of the gates and of the activation
+
     /*!
      * \brief Initialize the neural layer
      */
@@ -47,6 +60,397 @@ struct base_lstm_layer : layer<Derived> {
     base_lstm_layer& operator=(const base_lstm_layer& rhs) = delete;
     base_lstm_layer& operator=(base_lstm_layer&& rhs) = delete;
 
+    /*
+     * The four gates are packed in (i, g, f, o) order: U is stored as one
+     * [S x 4H] matrix, W as one [H x 4H] matrix and the biases as one [4H]
+     * vector. The input projection of all the time steps is computed with
+     * one GEMM and each recurrent step with one [B x H] * [H x 4H] GEMM.
+     */
+
+    mutable etl::dyn_matrix<weight, 2> u_p; ///< The packed U weights
+    mutable etl::dyn_matrix<weight, 2> w_p; ///< The packed W weights
+    mutable etl::dyn_matrix<weight, 1> b_p; ///< The packed biases
+
+    mutable etl::dyn_matrix<weight, 2> u_p_grad; ///< The gradients of the packed U weights
+    mutable etl::dyn_matrix<weight, 2> w_p_grad; ///< The gradients of the packed W weights
+    mutable etl::dyn_matrix<weight, 1> b_p_grad; ///< The gradients of the packed biases
+
+    mutable etl::dyn_matrix<weight, 3> a_t; ///< The activated gates [T x B x 4H]
+    mutable etl::dyn_matrix<weight, 3> x_t; ///< The input [T x B x S]
+    mutable etl::dyn_matrix<weight, 3> s_t; ///< The cell states [T x B x H]
+    mutable etl::dyn_matrix<weight, 3> h_t; ///< The hidden states [T x B x H]
+
+    mutable etl::dyn_matrix<weight, 3> delta_t;   ///< The errors [T x B x H]
+    mutable etl::dyn_matrix<weight, 3> d_h_t;     ///< The gradients of the hidden states [T x B x H]
+    mutable etl::dyn_matrix<weight, 3> d_c_t;     ///< The gradients of the cell states [T x B x H]
+    mutable etl::dyn_matrix<weight, 3> d_x_t;     ///< The gradients of the input [T x B x S]
+    mutable etl::dyn_matrix<weight, 3> d_a_t;     ///< The gradients of the gates of the last pass [T x B x 4H]
+    mutable etl::dyn_matrix<weight, 3> d_a_sum_t; ///< The gradients of the gates of all the passes [T x B x 4H]
+
+    mutable etl::dyn_matrix<weight, 2> step_a; ///< The gates of one step of a batch of streams [n x 4H]
+    mutable etl::dyn_matrix<weight, 2> step_x; ///< The input of one step of a batch of streams [n x S]
+
+    /*
+     * With variable-length sequences, only the steps of the longest
+     * sequence of the batch are computed. The outputs of the padding of each
+     * sequence are set to zero and their errors are ignored, so that they do
+     * not contribute to the gradients.
+     */
+
+    mutable std::vector<size_t> lengths; ///< The length of each sequence of the batch (only for variable-length sequences)
+
+    /*!
+     * \brief Returns the number of time steps to compute for the current
+     * batch
+     */
+    size_t active_time_steps(size_t time_steps) const {
+        return lengths.empty() ? time_steps : *std::max_element(lengths.begin(), lengths.end());
+    }
+
+    /*!
+     * \brief Indicates if the time step t of the sample b is part of its
+     * sequence (not padding)
+     */
+    bool in_sequence(size_t b, size_t t) const {
+        return lengths.empty() || t < lengths[b];
+    }
+
+    void prepare_cache(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
+        if (cpp_unlikely(!a_t.memory_start() || etl::dim<1>(a_t) != Batch)) {
+            u_p.resize(sequence_length, 4 * hidden_units);
+            w_p.resize(hidden_units, 4 * hidden_units);
+            b_p.resize(4 * hidden_units);
+
+            u_p_grad.resize(sequence_length, 4 * hidden_units);
+            w_p_grad.resize(hidden_units, 4 * hidden_units);
+            b_p_grad.resize(4 * hidden_units);
+
+            a_t.resize(time_steps, Batch, 4 * hidden_units);
+            x_t.resize(time_steps, Batch, sequence_length);
+            s_t.resize(time_steps, Batch, hidden_units);
+            h_t.resize(time_steps, Batch, hidden_units);
+
+            delta_t.resize(time_steps, Batch, hidden_units);
+            d_h_t.resize(time_steps, Batch, hidden_units);
+            d_c_t.resize(time_steps, Batch, hidden_units);
+            d_x_t.resize(time_steps, Batch, sequence_length);
+            d_a_t.resize(time_steps, Batch, 4 * hidden_units);
+            d_a_sum_t.resize(time_steps, Batch, 4 * hidden_units);
+        }
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void forward_batch_impl(H&& output, const V& x, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
+        const size_t Batch = etl::dim<0>(x);
+        const size_t HH    = hidden_units;
+        const size_t T     = etl::dim<1>(output);
+
+        // The caches are sized for all the steps, time_steps can be shorter for variable-length sequences
+        prepare_cache(Batch, T, sequence_length, hidden_units);
+
+        pack_weights(hidden_units);
+
+        // 1. Rearrange input
+
+        for (size_t b = 0; b < Batch; ++b) {
+            for (size_t t = 0; t < time_steps; ++t) {
+                x_t(t)(b) = x(b)(t);
+            }
+        }
+
+        // 2. Input projection of all the time steps at once
+
+        auto x_2d = etl::custom_dyn_matrix<weight, 2>(x_t.memory_start(), time_steps * Batch, sequence_length);
+        auto a_2d = etl::custom_dyn_matrix<weight, 2>(a_t.memory_start(), time_steps * Batch, 4 * HH);
+
+        a_2d = bias_add_2d(x_2d * u_p, b_p);
+
+        cpu_access(a_t);
+
+        // 3. Forward propagation through time
+
+        for (size_t t = 0; t < time_steps; ++t) {
+            if (t > 0) {
+                a_t(t) += h_t(t - 1) * w_p;
+            }
+
+            cpu_access(a_t, s_t, h_t);
+
+            weight* a_s = a_t.memory_start() + t * Batch * 4 * HH;
+            weight* s_s = s_t.memory_start() + t * Batch * HH;
+            weight* h_s = h_t.memory_start() + t * Batch * HH;
+
+            // The samples are independent once the GEMM is done
+            for_each_sample(Batch, HH, [&](size_t b) {
+                weight* a       = a_s + b * 4 * HH;
+                weight* s       = s_s + b * HH;
+                weight* h       = h_s + b * HH;
+                const weight* p = t > 0 ? s - Batch * HH : s;
+
+                for (size_t j = 0; j < HH; ++j) {
+                    const weight i_v = f_activate_scalar<function::SIGMOID, fast_activations>(a[j]);
+                    const weight g_v = f_activate_scalar<function::TANH, fast_activations>(a[HH + j]);
+                    const weight f_v = f_activate_scalar<function::SIGMOID, fast_activations>(a[2 * HH + j]);
+                    const weight o_v = f_activate_scalar<function::SIGMOID, fast_activations>(a[3 * HH + j]);
+
+                    a[j]          = i_v;
+                    a[HH + j]     = g_v;
+                    a[2 * HH + j] = f_v;
+                    a[3 * HH + j] = o_v;
+
+                    if (t == 0) {
+                        s[j] = g_v * i_v;
+                        h[j] = f_activate_scalar<activation_function, fast_activations>(s[j]) * o_v;
+                    } else {
+                        s[j] = f_activate_scalar<activation_function, fast_activations>(g_v * i_v + p[j] * f_v);
+                        h[j] = s[j] * o_v;
+                    }
+                }
+            });
+
+            cpu_modified(a_t, s_t, h_t);
+        }
+
+        // 4. Rearrange the output, the padding is set to zero
+
+        for (size_t b = 0; b < Batch; ++b) {
+            for (size_t t = 0; t < T; ++t) {
+                if (t < time_steps && in_sequence(b, t)) {
+                    output(b)(t) = h_t(t)(b);
+                } else {
+                    output(b)(t) = 0;
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Pack the weights of the gates for step_batch_impl()
+     */
+    void prepare_steps_impl(size_t sequence_length, size_t hidden_units) const {
+        u_p.resize(sequence_length, 4 * hidden_units);
+        w_p.resize(hidden_units, 4 * hidden_units);
+        b_p.resize(4 * hidden_units);
+
+        pack_weights(hidden_units);
+    }
+
+    /*!
+     * \brief Advance a batch of streams by k time steps from their states.
+     *
+     * The weights must have been packed by prepare_steps_impl(). The first
+     * step of a stream that has not been started is computed as the first
+     * step of a sequence, its states must be zero.
+     *
+     * \param output The hidden states of each step [n x k x H]
+     * \param x The input of each step [n x k x S]
+     * \param h The hidden states of the streams [n x H], updated
+     * \param c The cell states of the streams [n x H], updated
+     * \param started Indicates for each stream if it has already been started
+     */
+    void step_batch_impl(weight* output, const weight* x, size_t n, size_t k, weight* h, weight* c, const uint8_t* started, size_t sequence_length, size_t hidden_units) const {
+        const size_t S  = sequence_length;
+        const size_t HH = hidden_units;
+
+        if (cpp_unlikely(etl::dim<0>(step_a) != n)) {
+            step_a.resize(n, 4 * HH);
+            step_x.resize(n, S);
+        }
+
+        auto h_2d = etl::custom_dyn_matrix<weight, 2>(h, n, HH);
+
+        for (size_t t = 0; t < k; ++t) {
+            for (size_t b = 0; b < n; ++b) {
+                std::copy_n(x + (b * k + t) * S, S, step_x.memory_start() + b * S);
+            }
+
+            // The previous hidden states of the streams not started are zero
+            step_a = bias_add_2d(step_x * u_p, b_p);
+            step_a += h_2d * w_p;
+
+            weight* a_s = step_a.memory_start();
+
+            for_each_sample(n, HH, [&](size_t b) {
+                weight* a        = a_s + b * 4 * HH;
+                weight* h_b      = h + b * HH;
+                weight* c_b      = c + b * HH;
+                weight* o_b      = output + (b * k + t) * HH;
+                const bool first = t == 0 && !started[b];
+
+                for (size_t j = 0; j < HH; ++j) {
+                    const weight i_v = f_activate_scalar<function::SIGMOID, fast_activations>(a[j]);
+                    const weight g_v = f_activate_scalar<function::TANH, fast_activations>(a[HH + j]);
+                    const weight f_v = f_activate_scalar<function::SIGMOID, fast_activations>(a[2 * HH + j]);
+                    const weight o_v = f_activate_scalar<function::SIGMOID, fast_activations>(a[3 * HH + j]);
+
+                    if (first) {
+                        c_b[j] = g_v * i_v;
+                        h_b[j] = f_activate_scalar<activation_function, fast_activations>(c_b[j]) * o_v;
+                    } else {
+                        c_b[j] = f_activate_scalar<activation_function, fast_activations>(g_v * i_v + c_b[j] * f_v);
+                        h_b[j] = c_b[j] * o_v;
+                    }
+
+                    o_b[j] = h_b[j];
+                }
+            });
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template <typename Output, typename C>
+    void backward_batch_impl(Output& output, C& context, size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps, bool direct = true) const {
+        const size_t Batch = etl::dim<0>(context.errors);
+        const size_t HH    = hidden_units;
+
+        // 1. Rearrange input/errors
+
+        for (size_t b = 0; b < Batch; ++b) {
+            for (size_t t = 0; t < time_steps; ++t) {
+                if (in_sequence(b, t)) {
+                    delta_t(t)(b) = context.errors(b)(t);
+                } else {
+                    delta_t(t)(b) = 0;
+                }
+            }
+        }
+
+        d_a_t     = 0;
+        d_a_sum_t = 0;
+
+        // 2. Backpropagation through time
+
+        size_t ttt = time_steps - 1;
+
+        do {
+            const size_t last_step = std::max(int(time_steps) - int(bptt_steps), 0);
+
+            // Backpropagation through time
+            for (int tt = ttt; tt >= int(last_step); --tt) {
+                const size_t t = tt;
+
+                cpu_access(a_t, s_t, delta_t, d_h_t, d_c_t, d_a_t, d_a_sum_t);
+
+                const size_t n = std::min(t + 1, time_steps - 1);
+
+                // Each sample only writes its own gradients, no reduction is necessary
+                for_each_sample(Batch, HH, [&](size_t b) {
+                    const weight* a     = a_t.memory_start() + (t * Batch + b) * 4 * HH;
+                    const weight* s     = s_t.memory_start() + (t * Batch + b) * HH;
+                    const weight* p     = t > 0 ? s - Batch * HH : s;
+                    const weight* delta = delta_t.memory_start() + (t * Batch + b) * HH;
+                    const weight* n_h   = d_h_t.memory_start() + (n * Batch + b) * HH;
+                    const weight* n_c   = d_c_t.memory_start() + (n * Batch + b) * HH;
+                    weight* d_c         = d_c_t.memory_start() + (t * Batch + b) * HH;
+                    weight* d_a         = d_a_t.memory_start() + (t * Batch + b) * 4 * HH;
+                    weight* d_a_sum     = d_a_sum_t.memory_start() + (t * Batch + b) * 4 * HH;
+
+                    for (size_t j = 0; j < HH; ++j) {
+                        const weight i_v = a[j];
+                        const weight g_v = a[HH + j];
+                        const weight f_v = a[2 * HH + j];
+                        const weight o_v = a[3 * HH + j];
+
+                        weight d_h_v = delta[j];
+                        weight d_c_v = o_v * d_h_v;
+
+                        if (t != time_steps - 1) {
+                            d_h_v += n_h[j];
+                            d_c_v = o_v * d_h_v * f_derivative_scalar<activation_function>(s[j]) + n_c[j];
+                        } else {
+                            d_c_v *= f_derivative_scalar<activation_function>(s[j]);
+                        }
+
+                        d_a[j]          = i_v * (weight(1) - i_v) * g_v * d_c_v;
+                        d_a[HH + j]     = (weight(1) - g_v * g_v) * i_v * d_c_v;
+                        d_a[2 * HH + j] = t == 0 ? weight(0) : f_v * (weight(1) - f_v) * p[j] * d_c_v;
+                        d_a[3 * HH + j] = o_v * (weight(1) - o_v) * s[j] * d_h_v;
+
+                        for (size_t k = 0; k < 4; ++k) {
+                            d_a_sum[k * HH + j] += d_a[k * HH + j];
+                        }
+
+                        // Update for the next step
+                        d_c[j] = f_v * d_c_v;
+                    }
+                });
+
+                cpu_modified(d_c_t, d_a_t, d_a_sum_t);
+
+                // The part going back to h, for the next step
+                d_h_t(t) = d_a_t(t) * trans(w_p);
+            }
+
+            // If only the last time step is used, no need to use the other errors
+            if constexpr (desc::parameters::template contains<last_only>()) {
+                break;
+            }
+        } while (ttt-- > 1);
+
+        // 3. Compute the gradients of all the time steps at once
+
+        cpu_access(x_t, h_t, d_a_t, d_a_sum_t);
+
+        auto x_2d   = etl::custom_dyn_matrix<weight, 2>(x_t.memory_start(), time_steps * Batch, sequence_length);
+        auto d_a_2d = etl::custom_dyn_matrix<weight, 2>(d_a_sum_t.memory_start(), time_steps * Batch, 4 * HH);
+
+        u_p_grad = trans(x_2d) * d_a_2d;
+        b_p_grad = bias_batch_sum_2d(d_a_2d);
+
+        if (time_steps > 1) {
+            // W only sees the gates of the steps t > 0 and the hidden states of the steps t - 1
+            auto h_prev_2d = etl::custom_dyn_matrix<weight, 2>(h_t.memory_start(), (time_steps - 1) * Batch, HH);
+            auto d_a_next  = etl::custom_dyn_matrix<weight, 2>(d_a_sum_t.memory_start() + Batch * 4 * HH, (time_steps - 1) * Batch, 4 * HH);
+
+            w_p_grad = trans(h_prev_2d) * d_a_next;
+        } else {
+            w_p_grad = 0;
+        }
+
+        unpack_gradients(context, hidden_units);
+
+        // 4. The part going back to x, with the gates of the last pass
+
+        if (direct) {
+            auto d_x_2d      = etl::custom_dyn_matrix<weight, 2>(d_x_t.memory_start(), time_steps * Batch, sequence_length);
+            auto d_a_last_2d = etl::custom_dyn_matrix<weight, 2>(d_a_t.memory_start(), time_steps * Batch, 4 * HH);
+
+            d_x_2d = d_a_last_2d * trans(u_p);
+
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < time_steps; ++t) {
+                    output(b)(t) = d_x_t(t)(b);
+                }
+
+                // The steps after the longest sequence have no influence
+                for (size_t t = time_steps; t < etl::dim<1>(output); ++t) {
+                    output(b)(t) = 0;
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template <typename C>
+    void compute_gradients_impl(C& context, size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps) const {
+        if constexpr (!C::layer) {
+            backward_batch_impl(x_t, context, time_steps, sequence_length, hidden_units, bptt_steps, false);
+        }
+    }
+
     /*!
      * \brief Backup the weights in the secondary weights matrix
      */
@@ -160,6 +564,105 @@ struct base_lstm_layer : layer<Derived> {
     }
 
 private:
+    /*!
+     * \brief Call the given functor for each sample of the batch, in
+     * parallel over blocks of samples.
+     *
+     * The blocks are large enough to amortize the scheduling, small batches
+     * are run serially.
+     */
+    template <typename Functor>
+    static void for_each_sample(size_t Batch, size_t hidden_units, Functor&& fun) {
+        const size_t block  = std::max(size_t(1), lstm_parallel_grain / hidden_units);
+        const size_t blocks = (Batch + block - 1) / block;
+
+        parallel_kernel(0, blocks, [&](size_t k) {
+            const size_t last = std::min(Batch, (k + 1) * block);
+
+            for (size_t b = k * block; b < last; ++b) {
+                fun(b);
+            }
+        });
+    }
+
+    /*!
+     * \brief Pack the weights of the four gates in the packed matrices
+     */
+    void pack_weights(size_t hidden_units) const {
+        auto& d = as_derived();
+
+        cpu_access(d.w_i, d.u_i, d.b_i, d.w_g, d.u_g, d.b_g, d.w_f, d.u_f, d.b_f, d.w_o, d.u_o, d.b_o);
+
+        auto pack = [hidden_units](auto& packed, size_t k, const auto& m) {
+            for (size_t r = 0; r < etl::dim<0>(m); ++r) {
+                for (size_t j = 0; j < hidden_units; ++j) {
+                    packed(r, k * hidden_units + j) = m(r, j);
+                }
+            }
+        };
+
+        pack(u_p, 0, d.u_i);
+        pack(u_p, 1, d.u_g);
+        pack(u_p, 2, d.u_f);
+        pack(u_p, 3, d.u_o);
+
+        pack(w_p, 0, d.w_i);
+        pack(w_p, 1, d.w_g);
+        pack(w_p, 2, d.w_f);
+        pack(w_p, 3, d.w_o);
+
+        for (size_t j = 0; j < hidden_units; ++j) {
+            b_p(j)                    = d.b_i(j);
+            b_p(hidden_units + j)     = d.b_g(j);
+            b_p(2 * hidden_units + j) = d.b_f(j);
+            b_p(3 * hidden_units + j) = d.b_o(j);
+        }
+
+        cpu_modified(u_p, w_p, b_p);
+    }
+
+    /*!
+     * \brief Unpack the packed gradients into the gradients of the context
+     */
+    template <typename C>
+    void unpack_gradients(C& context, size_t hidden_units) const {
+        auto unpack = [hidden_units](auto& m, size_t k, const auto& packed) {
+            for (size_t r = 0; r < etl::dim<0>(m); ++r) {
+                for (size_t j = 0; j < hidden_units; ++j) {
+                    m(r, j) = packed(r, k * hidden_units + j);
+                }
+            }
+        };
+
+        auto unpack_bias = [hidden_units](auto& m, size_t k, const auto& packed) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                m(j) = packed(k * hidden_units + j);
+            }
+        };
+
+        cpu_access(w_p_grad, u_p_grad, b_p_grad);
+
+        // The gradients are in (w, u, b) order for the gates (i, g, f, o)
+
+        unpack(std::get<0>(context.up.context)->grad, 0, w_p_grad);
+        unpack(std::get<1>(context.up.context)->grad, 0, u_p_grad);
+        unpack_bias(std::get<2>(context.up.context)->grad, 0, b_p_grad);
+        unpack(std::get<3>(context.up.context)->grad, 1, w_p_grad);
+        unpack(std::get<4>(context.up.context)->grad, 1, u_p_grad);
+        unpack_bias(std::get<5>(context.up.context)->grad, 1, b_p_grad);
+        unpack(std::get<6>(context.up.context)->grad, 2, w_p_grad);
+        unpack(std::get<7>(context.up.context)->grad, 2, u_p_grad);
+        unpack_bias(std::get<8>(context.up.context)->grad, 2, b_p_grad);
+        unpack(std::get<9>(context.up.context)->grad, 3, w_p_grad);
+        unpack(std::get<10>(context.up.context)->grad, 3, u_p_grad);
+        unpack_bias(std::get<11>(context.up.context)->grad, 3, b_p_grad);
+
+        cpu_modified(std::get<0>(context.up.context)->grad, std::get<1>(context.up.context)->grad, std::get<2>(context.up.context)->grad,
+                     std::get<3>(context.up.context)->grad, std::get<4>(context.up.context)->grad, std::get<5>(context.up.context)->grad,
+                     std::get<6>(context.up.context)->grad, std::get<7>(context.up.context)->grad, std::get<8>(context.up.context)->grad,
+                     std::get<9>(context.up.context)->grad, std::get<10>(context.up.context)->grad, std::get<11>(context.up.context)->grad);
+    }
+
     //CRTP Deduction
 
     /*!
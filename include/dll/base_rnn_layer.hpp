@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <fstream>
+#include <vector>
 
 #include "cpp_utils/assert.hpp" //Assertions
 #include "cpp_utils/io.hpp"     // For binary writing
@@ -16,6 +18,8 @@
 
 #include "layer.hpp"
 #include "layer_traits.hpp"
+#include "util/gpu.hpp"
+#include "util/sequences.hpp"
 #include "util/tmp.hpp"
 
 namespace dll {
@@ -47,13 +51,63 @@ struct base_rnn_layer : layer<Derived> {
     base_rnn_layer& operator=(const base_rnn_layer& rhs) = delete;
     base_rnn_layer& operator=(base_rnn_layer&& rhs) = delete;
 
-    mutable etl::dyn_matrix<float, 3> x_t;
-    mutable etl::dyn_matrix<float, 3> s_t;
+    /*
+     * The recurrent and input weights are packed as one [W;U] matrix of
+     * [(H + S) x H]. The caches are time-major and each row of xh_t holds
+     * the previous hidden state followed by the input, [h(t-1) | x(t)], so
+     * that each time step is a single GEMM and truncated BPTT streams
+     * through contiguous memory.
+     */
+
+    mutable etl::dyn_matrix<weight, 2> wu;      ///< The packed [W;U] weights
+    mutable etl::dyn_matrix<weight, 2> wu_grad; ///< The gradients of the packed weights
+
+    mutable etl::dyn_matrix<weight, 3> xh_t; ///< The packed [h(t-1) | x(t)] input [T x B x (H + S)]
+    mutable etl::dyn_matrix<weight, 3> s_t;  ///< The hidden states [T x B x H]
+
+    mutable etl::dyn_matrix<weight, 3> d_xh_t;    ///< The gradients of the packed input of the last pass [T x B x (H + S)]
+    mutable etl::dyn_matrix<weight, 3> d_h_t;     ///< The gradients of the hidden states [T x B x H]
+    mutable etl::dyn_matrix<weight, 3> d_h_sum_t; ///< The gradients of the hidden states of all the passes [T x B x H]
+
+    mutable etl::dyn_matrix<weight, 2> step_xh; ///< The packed input of one step of a batch of streams [n x (H + S)]
+    mutable etl::dyn_matrix<weight, 2> step_s;  ///< The hidden states of one step of a batch of streams [n x H]
+
+    /*
+     * With variable-length sequences, only the steps of the longest
+     * sequence of the batch are computed. The outputs of the padding of each
+     * sequence are set to zero and their errors are ignored, so that they do
+     * not contribute to the gradients.
+     */
+
+    mutable std::vector<size_t> lengths; ///< The length of each sequence of the batch (only for variable-length sequences)
+
+    /*!
+     * \brief Returns the number of time steps to compute for the current
+     * batch
+     */
+    size_t active_time_steps(size_t time_steps) const {
+        return lengths.empty() ? time_steps : *std::max_element(lengths.begin(), lengths.end());
+    }
+
+    /*!
+     * \brief Indicates if the time step t of the sample b is part of its
+     * sequence (not padding)
+     */
+    bool in_sequence(size_t b, size_t t) const {
+        return lengths.empty() || t < lengths[b];
+    }
 
     void prepare_cache(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
-        if (cpp_unlikely(!x_t.memory_start())) {
-            x_t.resize(time_steps, Batch, sequence_length);
+        if (cpp_unlikely(!s_t.memory_start() || etl::dim<1>(s_t) != Batch)) {
+            wu.resize(hidden_units + sequence_length, hidden_units);
+            wu_grad.resize(hidden_units + sequence_length, hidden_units);
+
+            xh_t.resize(time_steps, Batch, hidden_units + sequence_length);
             s_t.resize(time_steps, Batch, hidden_units);
+
+            d_xh_t.resize(time_steps, Batch, hidden_units + sequence_length);
+            d_h_t.resize(time_steps, Batch, hidden_units);
+            d_h_sum_t.resize(time_steps, Batch, hidden_units);
         }
     }
 
@@ -67,71 +121,155 @@ struct base_rnn_layer : layer<Derived> {
      */
     template <typename H, typename V, typename W, typename U, typename B>
     void forward_batch_impl(H&& output, const V& x, const W& w, const U& u, const B& b, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
-        const auto Batch = etl::dim<0>(x);
+        const size_t Batch = etl::dim<0>(x);
+        const size_t K     = hidden_units + sequence_length;
+        const size_t T     = etl::dim<1>(output);
+
+        // The caches are sized for all the steps, time_steps can be shorter for variable-length sequences
+        prepare_cache(Batch, T, sequence_length, hidden_units);
+
+        cpu_access(x, w, u, b);
+
+        // 1. Pack the weights
+
+        pack_weights(w, u, sequence_length, hidden_units);
 
-        prepare_cache(Batch, time_steps, sequence_length, hidden_units);
+        cpu_modified(wu);
 
-        // 1. Rearrange input
+        // 2. Rearrange input, there is no previous state for t == 0
 
         for (size_t b = 0; b < Batch; ++b) {
             for (size_t t = 0; t < time_steps; ++t) {
-                x_t(t)(b) = x(b)(t);
+                weight* xh = xh_t.memory_start() + (t * Batch + b) * K;
+
+                if (t == 0) {
+                    std::fill(xh, xh + hidden_units, weight(0));
+                }
+
+                for (size_t i = 0; i < sequence_length; ++i) {
+                    xh[hidden_units + i] = x(b, t, i);
+                }
             }
         }
 
-        // 2. Forward propagation through time
+        cpu_modified(xh_t);
+
+        // 3. Forward propagation through time
+
+        for (size_t t = 0; t < time_steps; ++t) {
+            s_t(t) = xh_t(t) * wu;
+
+            cpu_access(s_t, xh_t);
 
-        // t == 0
+            // Fused bias and activation, the state is also stored in the input of the next step
 
-        s_t(0) = f_activate<activation_function>(bias_add_2d(x_t(0) * u, b));
+            weight* s = s_t.memory_start() + t * Batch * hidden_units;
 
-        for (size_t t = 1; t < time_steps; ++t) {
-            s_t(t) = f_activate<activation_function>(bias_add_2d(x_t(t) * u + s_t(t - 1) * w, b));
+            for (size_t bb = 0; bb < Batch; ++bb) {
+                weight* next = t + 1 < time_steps ? xh_t.memory_start() + ((t + 1) * Batch + bb) * K : nullptr;
+
+                for (size_t j = 0; j < hidden_units; ++j) {
+                    s[j] = f_activate_scalar<activation_function>(s[j] + b(j));
+
+                    if (next) {
+                        next[j] = s[j];
+                    }
+                }
+
+                s += hidden_units;
+            }
+
+            cpu_modified(s_t, xh_t);
         }
 
-        // 3. Rearrange the output
+        // 4. Rearrange the output, the padding is set to zero
 
         for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                output(b)(t) = s_t(t)(b);
+            for (size_t t = 0; t < T; ++t) {
+                if (t < time_steps && in_sequence(b, t)) {
+                    output(b)(t) = s_t(t)(b);
+                } else {
+                    output(b)(t) = 0;
+                }
             }
         }
     }
 
     /*!
-     * \brief Backpropagate the errors to the previous layers
-     * \param output The ETL expression into which write the output
-     * \param context The training context
+     * \brief Pack the weights for step_batch_impl()
+     * \param w The W weights matrix
+     * \param u The U weights matrix
      */
-    template <typename H, typename C, typename W, typename U>
-    void backward_batch_impl(H&& output, C& context, const W& w, const U& u, size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps, bool direct = true) const {
-        cpp_unused(sequence_length);
+    template <typename W, typename U>
+    void prepare_steps_impl(const W& w, const U& u, size_t sequence_length, size_t hidden_units) const {
+        wu.resize(hidden_units + sequence_length, hidden_units);
 
-        const size_t Batch = etl::dim<0>(context.errors);
+        pack_weights(w, u, sequence_length, hidden_units);
+    }
 
-        etl::dyn_matrix<float, 3> delta_t(time_steps, Batch, hidden_units);
-        etl::dyn_matrix<float, 3> d_h_t(time_steps, Batch, hidden_units);
-        etl::dyn_matrix<float, 3> d_x_t(time_steps, Batch, sequence_length);
+    /*!
+     * \brief Advance a batch of streams by k time steps from their states.
+     *
+     * The weights must have been packed by prepare_steps_impl(). The
+     * hidden states of a stream that has not been started must be zero.
+     *
+     * \param output The hidden states of each step [n x k x H]
+     * \param x The input of each step [n x k x S]
+     * \param h The hidden states of the streams [n x H], updated
+     * \param b The biases
+     */
+    template <typename B>
+    void step_batch_impl(weight* output, const weight* x, size_t n, size_t k, weight* h, const B& b, size_t sequence_length, size_t hidden_units) const {
+        const size_t S  = sequence_length;
+        const size_t HH = hidden_units;
+        const size_t K  = HH + S;
+
+        if (cpp_unlikely(etl::dim<0>(step_s) != n)) {
+            step_xh.resize(n, K);
+            step_s.resize(n, HH);
+        }
 
-        // 1. Rearrange errors
+        for (size_t t = 0; t < k; ++t) {
+            for (size_t bb = 0; bb < n; ++bb) {
+                weight* xh = step_xh.memory_start() + bb * K;
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                delta_t(t)(b) = context.errors(b)(t);
+                std::copy_n(h + bb * HH, HH, xh);
+                std::copy_n(x + (bb * k + t) * S, S, xh + HH);
+            }
+
+            step_s = step_xh * wu;
+
+            const weight* s = step_s.memory_start();
+
+            for (size_t bb = 0; bb < n; ++bb) {
+                weight* h_b = h + bb * HH;
+                weight* o_b = output + (bb * k + t) * HH;
+
+                for (size_t j = 0; j < HH; ++j) {
+                    h_b[j] = f_activate_scalar<activation_function>(s[bb * HH + j] + b(j));
+                    o_b[j] = h_b[j];
+                }
             }
         }
+    }
 
-        // 2. Get the gradients from the context
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template <typename H, typename C, typename W, typename U>
+    void backward_batch_impl(H&& output, C& context, const W& w, const U& u, size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps, bool direct = true) const {
+        cpp_unused(w);
+        cpp_unused(u);
 
-        auto& w_grad = std::get<0>(context.up.context)->grad;
-        auto& u_grad = std::get<1>(context.up.context)->grad;
-        auto& b_grad = std::get<2>(context.up.context)->grad;
+        const size_t Batch = etl::dim<0>(context.errors);
+        const size_t K     = hidden_units + sequence_length;
 
-        w_grad = 0;
-        u_grad = 0;
-        b_grad = 0;
+        d_xh_t    = 0;
+        d_h_sum_t = 0;
 
-        // 3. Backpropagation through time
+        // 1. Backpropagation through time
 
         size_t ttt = time_steps - 1;
 
@@ -142,40 +280,98 @@ struct base_rnn_layer : layer<Derived> {
             for (int tt = ttt; tt >= int(last_step); --tt) {
                 const size_t t = tt;
 
-                if(t == time_steps - 1){
-                    d_h_t(t) = delta_t(t) >> f_derivative<activation_function>(s_t(t));
-                } else {
-                    d_h_t(t) = (delta_t(t) + d_h_t(t + 1)) >> f_derivative<activation_function>(s_t(t));
-                }
+                cpu_access(s_t, d_h_t, d_h_sum_t, d_xh_t, context.errors);
 
-                if (t > 0) {
-                    w_grad += etl::batch_outer(s_t(t - 1), d_h_t(t));
-                }
+                const weight* s = s_t.memory_start() + t * Batch * hidden_units;
+                weight* d_h     = d_h_t.memory_start() + t * Batch * hidden_units;
+                weight* d_h_sum = d_h_sum_t.memory_start() + t * Batch * hidden_units;
 
-                u_grad += etl::batch_outer(x_t(t), d_h_t(t));
-                b_grad += etl::bias_batch_sum_2d(d_h_t(t));
+                // Fused gathering of the errors and derivative of the activation
 
-                // Gradients to the input
-                d_x_t(t) = d_h_t(t) * trans(u);
+                for (size_t b = 0; b < Batch; ++b) {
+                    const weight* next = t + 1 < time_steps ? d_xh_t.memory_start() + ((t + 1) * Batch + b) * K : nullptr;
+                    const bool valid   = in_sequence(b, t);
 
-                // Update for next steps
-                d_h_t(t) = d_h_t(t) * trans(w);
-            }
+                    for (size_t j = 0; j < hidden_units; ++j) {
+                        weight delta = valid ? context.errors(b, t, j) : weight(0);
+
+                        if (next) {
+                            delta += next[j];
+                        }
+
+                        d_h[j] = delta * f_derivative_scalar<activation_function>(s[j]);
+                        d_h_sum[j] += d_h[j];
+                    }
+
+                    s += hidden_units;
+                    d_h += hidden_units;
+                    d_h_sum += hidden_units;
+                }
 
-            --ttt;
+                cpu_modified(d_h_t, d_h_sum_t);
+
+                // Gradients to the previous state and to the input
+                d_xh_t(t) = d_h_t(t) * trans(wu);
+            }
 
             // If only the last time step is used, no need to use the other errors
             if constexpr (desc::parameters::template contains<last_only>()) {
                 break;
             }
-        } while (ttt != 0);
+        } while (ttt-- > 1);
+
+        // 2. Compute the gradients of all the time steps at once
+
+        cpu_access(xh_t, d_h_sum_t);
+
+        auto xh_2d  = etl::custom_dyn_matrix<weight, 2>(xh_t.memory_start(), time_steps * Batch, K);
+        auto d_h_2d = etl::custom_dyn_matrix<weight, 2>(d_h_sum_t.memory_start(), time_steps * Batch, hidden_units);
+
+        wu_grad = trans(xh_2d) * d_h_2d;
+
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+        auto& u_grad = std::get<1>(context.up.context)->grad;
+        auto& b_grad = std::get<2>(context.up.context)->grad;
+
+        cpu_access(wu_grad);
+
+        for (size_t i = 0; i < hidden_units; ++i) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                w_grad(i, j) = wu_grad(i, j);
+            }
+        }
+
+        for (size_t i = 0; i < sequence_length; ++i) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                u_grad(i, j) = wu_grad(hidden_units + i, j);
+            }
+        }
+
+        cpu_modified(w_grad, u_grad);
+
+        b_grad = bias_batch_sum_2d(d_h_2d);
 
         // 3. Rearrange for the output
 
         if (direct) {
+            cpu_access(d_xh_t);
+
             for (size_t b = 0; b < Batch; ++b) {
                 for (size_t t = 0; t < time_steps; ++t) {
-                    output(b)(t) = d_x_t(t)(b);
+                    const weight* d_x = d_xh_t.memory_start() + (t * Batch + b) * K + hidden_units;
+
+                    for (size_t i = 0; i < sequence_length; ++i) {
+                        output(b, t, i) = d_x[i];
+                    }
+                }
+            }
+
+            cpu_modified(output);
+
+            // The steps after the longest sequence have no influence
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = time_steps; t < etl::dim<1>(output); ++t) {
+                    output(b)(t) = 0;
                 }
             }
         }
@@ -188,7 +384,7 @@ struct base_rnn_layer : layer<Derived> {
     template <typename C, typename W, typename U>
     void compute_gradients_impl(C& context, const W& w, const U& u, size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps) const {
         if constexpr (!C::layer){
-            backward_batch_impl(x_t, context, w, u, time_steps, sequence_length, hidden_units, bptt_steps, false);
+            backward_batch_impl(xh_t, context, w, u, time_steps, sequence_length, hidden_units, bptt_steps, false);
         }
     }
 
@@ -261,6 +457,24 @@ struct base_rnn_layer : layer<Derived> {
     }
 
 private:
+    /*!
+     * \brief Pack the W and U weights in the [W;U] matrix
+     */
+    template <typename W, typename U>
+    void pack_weights(const W& w, const U& u, size_t sequence_length, size_t hidden_units) const {
+        for (size_t i = 0; i < hidden_units; ++i) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                wu(i, j) = w(i, j);
+            }
+        }
+
+        for (size_t i = 0; i < sequence_length; ++i) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                wu(hidden_units + i, j) = u(i, j);
+            }
+        }
+    }
+
     //CRTP Deduction
 
     /*!
@@ -20,18 +20,30 @@
 #include "cpp_utils/maybe_parallel.hpp" //conditional parallel loops
 #include "cpp_utils/static_if.hpp"      //static_if for compile-time reduction
 
+#include <array>
+#include <thread>
+#include <vector>
+
 #include "etl/etl.hpp"
 
 #include "util/batch.hpp"
+#include "util/conv_gradients.hpp"
+#include "util/fast_random.hpp"
+#include "util/fft_conv.hpp"
+#include "util/bit_pack.hpp"
+#include "util/csr.hpp"
+#include "util/parallel.hpp"
+#include "util/reduction.hpp"
+#include "util/memory.hpp"
 #include "util/timers.hpp"
+#include "util/gpu.hpp"
+#include "util/updater_kernels.hpp"
 #include "decay_type.hpp"
 #include "layer_traits.hpp"
 #include "util/blas.hpp"
 
 namespace dll {
 
-#define STATIC_IF_DECAY(d, ...) if constexpr (decay == d) { __VA_ARGS__; }
-
 /*!
  * \brief Base class for all standard trainer
  */
@@ -42,31 +54,104 @@ struct base_trainer {
     bool init = true; ///< Helper to indicate if first epoch of CD
 
     /*!
-     * \brief Update the gradients given some type of decay
-     * \param grad The gradients to update
-     * \param rbm The current RBM
-     * \param penalty The penalty to apply
-     * \tparam decay The type of decay to apply
+     * \brief Returns the number of bytes of the heap buffers of the trainer.
+     *
+     * The static buffers are part of the size of the trainer itself.
      */
-    template <decay_type decay, typename V, typename G>
-    void update_grad(G& grad, const V& value, const RBM& rbm, double penalty) {
-        STATIC_IF_DECAY(decay_type::NONE, grad = grad - penalty);
-        STATIC_IF_DECAY(decay_type::L1, grad = grad - rbm.l1_weight_cost * abs(value) - penalty);
-        STATIC_IF_DECAY(decay_type::L2, grad = grad - rbm.l2_weight_cost * value - penalty);
-        STATIC_IF_DECAY(decay_type::L1L2, grad = grad - rbm.l1_weight_cost * abs(value) - rbm.l2_weight_cost * value - penalty);
+    size_t buffer_memory() const {
+        return 0;
     }
 };
 
-template<typename Grad, typename T>
-void apply_clip_gradients(Grad& grad, T t, size_t n){
-    auto grad_l2_norm = std::sqrt(etl::sum(grad >> grad) / (n * n));
+/* The update weights procedure */
+
+/*!
+ * \brief Returns the fused tensor to update the given parameters of the RBM
+ * with their gradients.
+ *
+ * \param value The parameters
+ * \param grad The gradients of the parameters
+ * \param inc The momentum increments of the parameters (only used with momentum)
+ * \param rbm The RBM
+ * \param penalty The penalty to subtract from the gradients
+ * \param eps The learning rate
+ */
+template <typename RBM, typename V, typename G, typename I>
+fused_tensor<typename RBM::weight> cd_tensor(V& value, const G& grad, I& inc, const RBM& rbm, double penalty, double eps) {
+    fused_tensor<typename RBM::weight> t;
 
-    if(grad_l2_norm > t){
-        grad = grad >> (t / grad_l2_norm);
+    cpu_access(value, grad);
+
+    t.w    = value.memory_start();
+    t.g    = grad.memory_start();
+    t.size = etl::size(value);
+
+    if constexpr (rbm_layer_traits<RBM>::has_momentum()) {
+        cpu_access(inc);
+
+        t.s0         = inc.memory_start();
+        t.step.beta1 = rbm.momentum;
+    } else {
+        cpp_unused(inc);
     }
+
+    t.step.eps     = eps;
+    t.step.l1      = rbm.l1_weight_cost;
+    t.step.l2      = rbm.l2_weight_cost;
+    t.step.penalty = penalty;
+
+    return t;
 }
 
-/* The update weights procedure */
+/*!
+ * \brief Apply the gradients of the RBM to its weights and biases, with the
+ * decay, the penalties and the momentum, in one pass over each of them.
+ *
+ * \param rbm The RBM
+ * \param t The trainer, with the gradients
+ * \param penalties The penalties of the weights, the hidden biases and the visible biases
+ * \param eps The learning rate
+ * \param n_samples The number of samples of the batch (for gradient clipping)
+ */
+template <bool Clip, typename RBM, typename Trainer>
+void cd_apply_gradients(RBM& rbm, Trainer& t, const std::array<double, 3>& penalties, double eps, size_t n_samples) {
+    using rbm_t  = RBM;
+    using weight = typename rbm_t::weight;
+
+    constexpr bool momentum = rbm_layer_traits<rbm_t>::has_momentum();
+    constexpr auto wd       = w_decay(rbm_layer_traits<rbm_t>::decay());
+    constexpr auto bd       = b_decay(rbm_layer_traits<rbm_t>::decay());
+
+    auto w = cd_tensor(rbm.w, t.w_grad, t.w_inc, rbm, penalties[0], eps);
+    auto b = cd_tensor(rbm.b, t.b_grad, t.b_inc, rbm, penalties[1], eps);
+    auto c = cd_tensor(rbm.c, t.c_grad, t.c_inc, rbm, penalties[2], eps);
+
+    if constexpr (Clip) {
+        // The norms are computed with the decayed gradients, the clipping is applied by the update
+        const auto clip = rbm.gradient_clip;
+
+        w.step.scale = clip_scale<wd>(w, n_samples, clip);
+        b.step.scale = clip_scale<bd>(b, n_samples, clip);
+        c.step.scale = clip_scale<bd>(c, n_samples, clip);
+    } else {
+        cpp_unused(n_samples);
+    }
+
+    cd_fused_update<momentum, wd>(w);
+    // The biases are updated in one launch, without allocating the list of tensors
+    auto& biases = kernel_scratch<fused_tensor<weight>>(2);
+
+    biases[0] = b;
+    biases[1] = c;
+
+    cd_fused_update<momentum, bd>(biases);
+
+    cpu_modified(rbm.w, rbm.b, rbm.c);
+
+    if constexpr (momentum) {
+        cpu_modified(t.w_inc, t.b_inc, t.c_inc);
+    }
+}
 
 /*!
  * \brief Given the gradients of the RBM, update it according to the training
@@ -94,12 +179,6 @@ void update_normal(RBM& rbm, Trainer& t) {
         w_penalty = h_penalty = cost * (t.q_global_t - p);
     }
 
-    //Apply L1/L2 regularization and penalties to the biases
-
-    t.template update_grad<w_decay(rbm_layer_traits<rbm_t>::decay())>(t.w_grad, rbm.w, rbm, w_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.b_grad, rbm.b, rbm, h_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.c_grad, rbm.c, rbm, v_penalty);
-
     //Local sparsity method
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
         auto decay_rate = rbm.decay_rate;
@@ -112,46 +191,18 @@ void update_normal(RBM& rbm, Trainer& t) {
 
         t.b_grad -= q_local_penalty;
 
-        for (size_t i = 0; i < num_hidden(rbm); ++i) {
-            for (size_t j = 0; j < num_visible(rbm); ++j) {
-                t.w_grad(j, i) -= q_local_penalty(i);
-            }
-        }
+        // The penalty of each hidden unit is subtracted from its column, in one pass over the rows
+        t.w_grad -= etl::rep_l(q_local_penalty, num_visible(rbm));
     }
 
     //TODO the batch is not necessary full!
-    const auto n_samples = double(etl::dim<0>(t.v1));
-
-    // Gradients clipping
-    if constexpr (rbm_layer_traits<rbm_t>::has_clip_gradients()){
-        auto grad_t = rbm.gradient_clip;
-
-        apply_clip_gradients(t.w_grad, grad_t, n_samples);
-        apply_clip_gradients(t.b_grad, grad_t, n_samples);
-        apply_clip_gradients(t.c_grad, grad_t, n_samples);
-    }
+    const size_t n_samples = etl::dim<0>(t.v1);
 
     // Scale the learning rate with the size of the batch
-    auto eps = rbm.learning_rate / n_samples;
+    auto eps = rbm.learning_rate / double(n_samples);
 
-    //Apply momentum and learning rate
-    if constexpr (rbm_layer_traits<rbm_t>::has_momentum()) {
-        auto momentum = rbm.momentum;
-
-        t.w_inc = momentum * t.w_inc + eps * t.w_grad;
-        t.b_inc = momentum * t.b_inc + eps * t.b_grad;
-        t.c_inc = momentum * t.c_inc + eps * t.c_grad;
-
-        rbm.w += t.w_inc;
-        rbm.b += t.b_inc;
-        rbm.c += t.c_inc;
-    }
-    //Apply the learning rate
-    else {
-        rbm.w += eps * t.w_grad;
-        rbm.b += eps * t.b_grad;
-        rbm.c += eps * t.c_grad;
-    }
+    //Apply L1/L2 regularization, penalties, clipping, momentum and learning rate
+    cd_apply_gradients<rbm_layer_traits<rbm_t>::has_clip_gradients()>(rbm, t, {{w_penalty, h_penalty, v_penalty}}, eps, n_samples);
 
     //Check for NaN
     nan_check_deep_3(rbm.w, rbm.b, rbm.c);
@@ -184,12 +235,6 @@ void update_convolutional(RBM& rbm, Trainer& t) {
         w_penalty = h_penalty = cost * (t.q_global_t - p);
     }
 
-    //Apply L1/L2 regularization and penalties to the biases
-
-    t.template update_grad<w_decay(rbm_layer_traits<rbm_t>::decay())>(t.w_grad, rbm.w, rbm, w_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.b_grad, rbm.b, rbm, h_penalty);
-    t.template update_grad<b_decay(rbm_layer_traits<rbm_t>::decay())>(t.c_grad, rbm.c, rbm, v_penalty);
-
     //Local sparsity method
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
         auto decay_rate = rbm.decay_rate;
@@ -220,24 +265,8 @@ void update_convolutional(RBM& rbm, Trainer& t) {
     constexpr auto n_samples = RBM::batch_size;
     auto eps             = rbm.learning_rate / n_samples;
 
-    //Apply momentum and learning rate
-    if constexpr (rbm_layer_traits<rbm_t>::has_momentum()) {
-        auto momentum = rbm.momentum;
-
-        t.w_inc = momentum * t.w_inc + eps * t.w_grad;
-        t.b_inc = momentum * t.b_inc + eps * t.b_grad;
-        t.c_inc = momentum * t.c_inc + eps * t.c_grad;
-
-        rbm.w += t.w_inc;
-        rbm.b += t.b_inc;
-        rbm.c += t.c_inc;
-    }
-    //Apply learning rate only
-    else {
-        rbm.w += eps * t.w_grad;
-        rbm.b += eps * t.b_grad;
-        rbm.c += eps * t.c_grad;
-    }
+    //Apply L1/L2 regularization, penalties to the biases, momentum and learning rate
+    cd_apply_gradients<false>(rbm, t, {{w_penalty, h_penalty, v_penalty}}, eps, n_samples);
 
     //Check for NaN
     nan_check_deep(rbm.w);
@@ -247,11 +276,205 @@ void update_convolutional(RBM& rbm, Trainer& t) {
 
 /* The training procedures */
 
+/*!
+ * \brief Run the Gibbs chains of the samples [first, last) of the batch.
+ *
+ * The chains of the samples (and the persistent chains) are independent,
+ * this is used to run the chains of a batch by shards, in parallel.
+ */
+template <bool Persistent, size_t K, typename RBM, typename Trainer>
+void gibbs_chains(RBM& rbm, Trainer& t, size_t first, size_t last) {
+    auto v1   = etl::slice(t.v1, first, last);
+    auto h1_a = etl::slice(t.h1_a, first, last);
+    auto h1_s = etl::slice(t.h1_s, first, last);
+    auto v2_a = etl::slice(t.v2_a, first, last);
+    auto v2_s = etl::slice(t.v2_s, first, last);
+    auto h2_a = etl::slice(t.h2_a, first, last);
+    auto h2_s = etl::slice(t.h2_s, first, last);
+
+    //First step
+    rbm.template batch_activate_hidden<true, true>(h1_a, h1_s, v1, v1);
+
+    //CD-1
+    if constexpr (Persistent) {
+        auto p_h_a = etl::slice(t.p_h_a, first, last);
+        auto p_h_s = etl::slice(t.p_h_s, first, last);
+
+        if (t.init) {
+            p_h_a = h1_a;
+            p_h_s = h1_s;
+        }
+
+        rbm.template batch_activate_visible<true, false>(p_h_a, p_h_s, v2_a, v2_s);
+        rbm.template batch_activate_hidden<true, true>(h2_a, h2_s, v2_a, v2_s);
+    } else {
+        rbm.template batch_activate_visible<true, false>(h1_a, h1_s, v2_a, v2_s);
+        rbm.template batch_activate_hidden<true, (K > 1)>(h2_a, h2_s, v2_a, v2_s);
+    }
+
+    //CD-k
+    for (size_t k = 1; k < K; ++k) {
+        rbm.template batch_activate_visible<true, false>(h2_a, h2_s, v2_a, v2_s);
+        rbm.template batch_activate_hidden<true, true>(h2_a, h2_s, v2_a, v2_s);
+    }
+}
+
+/*!
+ * \brief Run the Gibbs chains of the full batch, by shards in parallel.
+ *
+ * The statistics are then computed on the full batch, as in the serial
+ * case.
+ */
+template <bool Persistent, size_t K, typename RBM, typename Trainer>
+void parallel_gibbs_chains(RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("cd:gibbs:parallel");
+
+    const size_t B      = etl::dim<0>(t.v1);
+    const size_t shards = std::max<size_t>(1, std::min<size_t>(B, thread_budget()));
+
+    // The samplings of each shard are drawn from the batch and shard indices, not in the order of the threads
+    const uint64_t batch = rbm.sampler.reserve(1);
+
+    parallel_kernel(0, shards, [&](size_t s) {
+        random_shard_section random(batch, s);
+
+        gibbs_chains<Persistent, K>(rbm, t, s * B / shards, (s + 1) * B / shards);
+    });
+}
+
+/*!
+ * \brief The statistics of a batch, computed with the gradients of the biases
+ */
+struct cd_batch_statistics {
+    double error    = 0.0; ///< The mean squared reconstruction error
+    double activity = 0.0; ///< The mean hidden activation probability
+};
+
+/*!
+ * \brief The number of units handled by one task of the bias kernels
+ */
+constexpr size_t cd_bias_block = 4096;
+
+/*!
+ * \brief Compute pos - neg summed over the batch, in one pass, for
+ * each unit of the block [first, last). If Stats, also returns the sum of
+ * the squared differences (visible) or the sum of neg (hidden).
+ *
+ * \param pos The positive activations, [B, N, S]
+ * \param neg The negative activations, [B, N, S]
+ * \param grad The gradients of the N biases
+ * \param scale The scale of the gradients
+ * \param mean If Mean, the mean negative activation of each of the N units
+ */
+template <bool Stats, bool Visible, bool Mean, typename T>
+double cd_bias_block_gradients(const T* pos, const T* neg, T* grad, size_t B, size_t N, size_t S, size_t first, size_t last, T scale, T* mean) {
+    double stat = 0.0;
+
+    for (size_t i = first; i < last; ++i) {
+        double sum   = 0.0;
+        double a_sum = 0.0;
+
+        for (size_t b = 0; b < B; ++b) {
+            const size_t offset = (b * N + i) * S;
+
+            for (size_t s = 0; s < S; ++s) {
+                const T d = pos[offset + s] - neg[offset + s];
+
+                sum += d;
+
+                if constexpr (Stats && Visible) {
+                    stat += double(d) * d;
+                } else if constexpr ((Stats || Mean) && !Visible) {
+                    a_sum += neg[offset + s];
+                }
+            }
+        }
+
+        grad[i] = scale * sum;
+
+        if constexpr (Mean && !Visible) {
+            mean[i] = T(a_sum / (double(B) * S));
+        }
+
+        stat += a_sum;
+    }
+
+    return stat;
+}
+
+/*!
+ * \brief Compute the gradients of the biases of a RBM and, if Stats, the
+ * reconstruction error and the sparsity of the batch, in one pass over the
+ * activations.
+ *
+ * The activations are seen as [B, N, S], with S = 1 for dense RBMs and the
+ * size of the feature maps for convolutional RBMs. The gradient of a bias is
+ * the sum over the batch, divided by S.
+ *
+ * If Mean, the mean activation of each hidden unit (over the batch and the
+ * feature map), needed by the sparsity methods, is computed in the same
+ * pass into h_mean [NH].
+ */
+template <bool Stats, bool Mean = false, typename Trainer, typename T = std::decay_t<decltype(*std::declval<Trainer&>().vf.memory_start())>>
+cd_batch_statistics cd_bias_gradients(Trainer& t, size_t NV, size_t SV, size_t NH, size_t SH, T* h_mean = nullptr) {
+    dll::auto_timer timer("cd:bias_gradients");
+
+    using weight = std::decay_t<decltype(*t.vf.memory_start())>;
+
+    const size_t B = etl::dim<0>(t.v1);
+
+    const size_t v_tasks = (NV + cd_bias_block - 1) / cd_bias_block;
+    const size_t h_tasks = (NH + cd_bias_block - 1) / cd_bias_block;
+
+    auto& partials = kernel_scratch<double>(v_tasks + h_tasks);
+
+    parallel_kernel(0, v_tasks + h_tasks, [&](size_t task) {
+        if (task < v_tasks) {
+            const size_t first = task * cd_bias_block;
+            const size_t last  = std::min(NV, first + cd_bias_block);
+
+            partials[task] = cd_bias_block_gradients<Stats, true, false>(t.vf.memory_start(), t.v2_a.memory_start(), t.c_grad.memory_start(), B, NV, SV, first, last, weight(1.0 / SV), h_mean);
+        } else {
+            const size_t first = (task - v_tasks) * cd_bias_block;
+            const size_t last  = std::min(NH, first + cd_bias_block);
+
+            partials[task] = cd_bias_block_gradients<Stats, false, Mean>(t.h1_a.memory_start(), t.h2_a.memory_start(), t.b_grad.memory_start(), B, NH, SH, first, last, weight(1.0 / SH), h_mean);
+        }
+    });
+
+    cd_batch_statistics stats;
+
+    if constexpr (Stats) {
+        stats.error    = tree_sum(partials.data(), v_tasks);
+        stats.activity = tree_sum(partials.data() + v_tasks, h_tasks);
+
+        stats.error /= double(B) * NV * SV;
+        stats.activity /= double(B) * NH * SH;
+    }
+
+    return stats;
+}
+
+/*!
+ * \brief Compute the reconstruction of the given hidden batch into v2 and
+ * the hidden representation of the reconstruction into h2 (one Gibbs step)
+ */
+template <bool S, typename RBM, typename Trainer, typename H>
+void cd_gibbs_step(RBM& rbm, Trainer& t, const H& h_a, const H& h_s) {
+    if constexpr (rbm_layer_traits<RBM>::has_transposed_weights()) {
+        rbm.batch_activate_visible_transposed(h_a, h_s, t.v2_a, t.v2_s, t.w_t);
+        rbm.template batch_activate_hidden<true, S>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+    } else {
+        //The reconstruction and the second hidden activation share the reads of the weights
+        rbm.template batch_activate_visible_hidden<S>(h_a, h_s, t.v2_a, t.v2_s, t.h2_a, t.h2_s);
+    }
+}
+
 /*!
  * \brief Compute the gradients for a fully-connected RBM
  */
 template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
-void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
+cd_batch_statistics compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t, bool statistics) {
     dll::auto_timer timer("cd:gradients:normal:batch");
 
     cpp_assert(etl::dim<0>(input_batch) == etl::dim<0>(expected_batch), "Invalid batch sizes");
@@ -262,7 +485,6 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
     cpp_assert(etl::size(t.v1) >= etl::size(input_batch), "Invalid input to compute_gradients_normal");
     cpp_assert(etl::size(t.vf) >= etl::size(expected_batch), "Invalid input to compute_gradients_normal");
 
-    const auto B          = etl::dim<0>(t.v1);
     const size_t IB       = etl::dim<0>(input_batch);
     const bool full_batch = (IB == RBM::batch_size);
 
@@ -278,27 +500,44 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
         etl::slice(t.vf, 0, IB) = expected_batch;
     }
 
-    //First step
-    rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
-
-    if (Persistent && t.init) {
-        t.p_h_a = t.h1_a;
-        t.p_h_s = t.h1_s;
-    }
+    constexpr bool sparse = rbm_layer_traits<RBM>::has_sparse_input();
+    constexpr bool binary = rbm_layer_traits<RBM>::has_binary_input();
 
-    //CD-1
-    if constexpr (Persistent) {
-        rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+    // With sparse or binary input, the chains are not sharded, only the first step is sparse
+    if constexpr (rbm_layer_traits<RBM>::has_parallel_gibbs() && !sparse && !binary) {
+        parallel_gibbs_chains<Persistent, K>(rbm, t);
     } else {
-        rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-    }
+        //First step
+        if constexpr (sparse) {
+            auto& csr = csr_workspace<typename RBM::weight>();
+            csr.assign(t.v1);
+
+            rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, csr);
+        } else if constexpr (binary) {
+            auto& bits = bit_workspace();
+            bits.assign(t.v1);
+
+            rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, bits);
+        } else {
+            rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
+        }
 
-    //CD-k
-    for (size_t k = 1; k < K; ++k) {
-        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        if (Persistent && t.init) {
+            t.p_h_a = t.h1_a;
+            t.p_h_s = t.h1_s;
+        }
+
+        //CD-1
+        if constexpr (Persistent) {
+            cd_gibbs_step<true>(rbm, t, t.p_h_a, t.p_h_s);
+        } else {
+            cd_gibbs_step<(K > 1)>(rbm, t, t.h1_a, t.h1_s);
+        }
+
+        //CD-k
+        for (size_t k = 1; k < K; ++k) {
+            cd_gibbs_step<true>(rbm, t, t.h2_a, t.h2_s);
+        }
     }
 
     //Compute the gradients
@@ -306,18 +545,42 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
     {
         dll::auto_timer timer("cd:batch_compute_gradients:std");
 
-        t.w_grad = batch_outer(t.vf, t.h1_a);
-        t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+        // The reconstructions are dense, only the positive phase is sparse
+        if constexpr (sparse) {
+            auto& csr = csr_workspace<typename RBM::weight>();
+            csr.assign(t.vf);
 
-        t.b_grad = t.h1_a(0) - t.h2_a(0);
-        for (size_t b = 1; b < B; b++) {
-            t.b_grad += t.h1_a(b) - t.h2_a(b);
-        }
+            csr_batch_outer(t.w_grad, csr, t.h1_a);
+        } else if constexpr (binary) {
+            auto& bits = bit_workspace();
+            bits.assign(t.vf);
 
-        t.c_grad = t.vf(0) - t.v2_a(0);
-        for (size_t b = 1; b < B; b++) {
-            t.c_grad += t.vf(b) - t.v2_a(b);
+            bit_batch_outer(t.w_grad, bits, t.h1_a);
+        } else {
+            t.w_grad = batch_outer(t.vf, t.h1_a);
         }
+
+        t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+    }
+
+    // The gradients of the biases and the statistics of the batch in one pass
+
+    const size_t NV = etl::dim<1>(t.v1);
+    const size_t NH = etl::dim<1>(t.h1_a);
+
+    // The local sparsity target needs the mean activation of each hidden unit
+    constexpr bool local_target = rbm_layer_traits<RBM>::sparsity_method() == sparsity_method::LOCAL_TARGET;
+
+    typename RBM::weight* h_mean = nullptr;
+
+    if constexpr (local_target) {
+        h_mean = t.q_local_batch.memory_start();
+    }
+
+    if (statistics) {
+        return cd_bias_gradients<true, local_target>(t, NV, 1, NH, 1, h_mean);
+    } else {
+        return cd_bias_gradients<false, local_target>(t, NV, 1, NH, 1, h_mean);
     }
 }
 
@@ -332,7 +595,17 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
 
     using rbm_t  = RBM;                    ///< The type of the RBM being trained
 
-    compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t);
+    // The mean activation is needed by the global sparsity target, the statistics by the watcher
+    constexpr bool global_target = rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET;
+
+    const bool statistics = global_target || context.compute_statistics;
+
+    auto stats = compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t, statistics);
+
+    // The hidden activations of the first step are reused for the free energy
+    if constexpr (rbm_layer_traits<rbm_t>::free_energy()) {
+        context.batch_free_energy = rbm.batch_free_energy(t.v1, t.h1_a, etl::dim<0>(input_batch));
+    }
 
     if (Persistent) {
         t.p_h_a = t.h2_a;
@@ -341,19 +614,16 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
         t.init = false;
     }
 
-    context.batch_error = mean((t.vf - t.v2_a) >> (t.vf - t.v2_a));
-
     nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
 
-    //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
+    //The mean activation probabilities (the local ones are computed with the gradients of the biases)
+    t.q_global_batch = stats.activity;
 
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
-        t.q_local_batch = mean_l(t.h2_a);
+    if (context.compute_statistics) {
+        context.batch_error    = stats.error;
+        context.batch_sparsity = stats.activity;
     }
 
-    context.batch_sparsity = t.q_global_batch;
-
     //Update the weights and biases based on the gradients
     t.update(rbm);
 }
@@ -382,36 +652,52 @@ void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_bat
         etl::slice(t.vf, 0, B) = expected_batch;
     }
 
-    //First step
-    rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
+    constexpr bool fft = rbm_layer_traits<RBM>::has_fft_conv();
 
-    if (Persistent && t.init) {
-        t.p_h_a = t.h1_a;
-        t.p_h_s = t.h1_s;
+    // The spectra of the weights are computed once for all the steps of the chain
+    // The spectra of v1 and v2 are kept for the gradients, unless the chains are sharded
+    if constexpr (fft) {
+        rbm.fft_plan.lock_weights(rbm.w, etl::dim<2>(t.v1), etl::dim<3>(t.v1), !rbm_layer_traits<RBM>::has_parallel_gibbs());
     }
 
-    //CD-1
-    if (Persistent) {
-        rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+    if constexpr (rbm_layer_traits<RBM>::has_parallel_gibbs()) {
+        parallel_gibbs_chains<Persistent, N>(rbm, t);
     } else {
-        rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, (N > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-    }
+        //First step
+        rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
 
-    //CD-k
-    for (size_t k = 1; k < N; ++k) {
-        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
-        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        if (Persistent && t.init) {
+            t.p_h_a = t.h1_a;
+            t.p_h_s = t.h1_s;
+        }
+
+        //CD-1
+        if (Persistent) {
+            rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s);
+            rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        } else {
+            rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s);
+            rbm.template batch_activate_hidden<true, (N > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        }
+
+        //CD-k
+        for (size_t k = 1; k < N; ++k) {
+            rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+            rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s);
+        }
     }
 
-    //Compute gradients
+    //Compute gradients, the positive and the negative phases in a single GEMM (or a single pass over the spectra)
 
     {
         dll::auto_timer timer("cd:batch_compute_gradients_conv");
 
-        t.w_pos = conv_4d_valid_filter_flipped(t.vf, t.h1_a);
-        t.w_neg = conv_4d_valid_filter_flipped(t.v2_a, t.h2_a);
+        if constexpr (fft) {
+            rbm.fft_plan.weight_gradients(t.w_grad, t.vf, t.h1_a, t.v2_a, t.h2_a);
+            rbm.fft_plan.unlock_weights();
+        } else {
+            cd_conv_weight_gradients(t.w_grad, t.vf, t.h1_a, t.v2_a, t.h2_a);
+        }
     }
 }
 
@@ -424,8 +710,18 @@ void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch,
 
     using rbm_t = RBM; ///< The type of the RBM being trained
 
+    // The mean activation is needed by the global sparsity target, the statistics by the watcher
+    constexpr bool global_target = rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET;
+
+    const bool statistics = global_target || context.compute_statistics;
+
     compute_gradients_conv<Persistent, N>(input_batch, expected_batch, rbm, t);
 
+    // The hidden activations of the first step are reused for the free energy
+    if constexpr (rbm_layer_traits<rbm_t>::free_energy()) {
+        context.batch_free_energy = rbm.batch_free_energy(t.v1, t.h1_a, etl::dim<0>(input_batch));
+    }
+
     if (Persistent) {
         t.p_h_a = t.h2_a;
         t.p_h_s = t.h2_s;
@@ -433,34 +729,44 @@ void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch,
         t.init = false;
     }
 
-    //Compute the gradients
-    t.w_grad = t.w_pos - t.w_neg;
-    t.b_grad = mean_r(sum_l(t.h1_a - t.h2_a));
-    t.c_grad = mean_r(sum_l(t.vf - t.v2_a));
+    // The gradients of the biases and the statistics of the batch in one pass
+
+    const size_t NC = etl::dim<1>(t.v1);
+    const size_t K  = etl::dim<1>(t.h1_a);
+    const size_t SV = etl::dim<2>(t.v1) * etl::dim<3>(t.v1);
+    const size_t SH = etl::dim<2>(t.h1_a) * etl::dim<3>(t.h1_a);
+
+    // The mean activation of each group is needed by the sparsity of Lee (only b_bias are supported for now)
+    constexpr bool lee = rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE && rbm_layer_traits<rbm_t>::bias_mode() == bias_mode::SIMPLE;
+
+    typename rbm_t::weight* h_mean = nullptr;
+
+    if constexpr (lee) {
+        h_mean = t.b_bias.memory_start();
+    }
+
+    auto stats = statistics ? cd_bias_gradients<true, lee>(t, NC, SV, K, SH, h_mean) : cd_bias_gradients<false, lee>(t, NC, SV, K, SH, h_mean);
 
     nan_check_deep(t.w_grad);
     nan_check_deep(t.b_grad);
     nan_check_deep(t.c_grad);
 
-    //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
+    //The mean activation probabilities
+    t.q_global_batch = stats.activity;
 
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
         t.q_local_batch = mean_l(t.h2_a);
     }
 
-    //Compute the biases for sparsity
-
-    //Only b_bias are supported for now
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE && rbm_layer_traits<rbm_t>::bias_mode() == bias_mode::SIMPLE) {
-        t.b_bias = mean_r(mean_l(t.h2_a)) - rbm.pbias;
+    //Compute the biases for sparsity, from the mean activations
+    if constexpr (lee) {
+        t.b_bias -= rbm.pbias;
     }
 
-    //Accumulate the sparsity
-    context.batch_sparsity = t.q_global_batch;
-
-    //Accumulate the error
-    context.batch_error = mean(etl::scale((t.vf - t.v2_a), (t.vf - t.v2_a)));
+    if (context.compute_statistics) {
+        context.batch_error    = stats.error;
+        context.batch_sparsity = stats.activity;
+    }
 
     //Update the weights and biases based on the gradients
     t.update(rbm);
@@ -524,6 +830,12 @@ struct base_cd_trainer : base_trainer<RBM> {
     etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    static constexpr bool transposed = rbm_layer_traits<rbm_t>::has_transposed_weights(); ///< Indicates if the weights are kept transposed
+
+    static_assert(!transposed || rbm_layer_traits<rbm_t>::async_workers() == 1, "The transposed weights are not supported with asynchronous workers");
+
+    etl::fast_matrix<weight, transposed ? num_hidden : 1, transposed ? num_visible : 1> w_t; ///< The transposed weights, for the reconstructions
+
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm), q_global_t(0.0), q_local_t(0.0) {
         if constexpr (rbm_layer_traits<rbm_t>::has_momentum()) {
@@ -531,6 +843,10 @@ struct base_cd_trainer : base_trainer<RBM> {
             b_inc = 0;
             c_inc = 0;
         }
+
+        if constexpr (transposed) {
+            w_t = etl::transpose(rbm.w);
+        }
     }
 
     /*!
@@ -538,6 +854,11 @@ struct base_cd_trainer : base_trainer<RBM> {
      */
     void update(RBM& rbm) {
         update_normal(rbm, *this);
+
+        // The reconstructions of the next batch use the transposed copy
+        if constexpr (transposed) {
+            w_t = etl::transpose(rbm.w);
+        }
     }
 
     /*!
@@ -610,6 +931,12 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
     etl::dyn_matrix<weight> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::dyn_matrix<weight> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    static constexpr bool transposed = rbm_layer_traits<rbm_t>::has_transposed_weights(); ///< Indicates if the weights are kept transposed
+
+    static_assert(!transposed || rbm_layer_traits<rbm_t>::async_workers() == 1, "The transposed weights are not supported with asynchronous workers");
+
+    etl::dyn_matrix<weight> w_t; ///< The transposed weights, for the reconstructions (empty if not used)
+
     template <bool M = rbm_layer_traits<rbm_t>::has_momentum(), cpp_disable_iff(M)>
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm),
@@ -631,8 +958,13 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
               q_local_batch(rbm.num_hidden),
               q_local_t(rbm.num_hidden, static_cast<weight>(0.0)),
               p_h_a(batch_size, rbm.num_hidden),
-              p_h_s(batch_size, rbm.num_hidden){
+              p_h_s(batch_size, rbm.num_hidden),
+              w_t(transposed ? rbm.num_hidden : 0, transposed ? rbm.num_visible : 0){
         static_assert(!rbm_layer_traits<rbm_t>::has_momentum(), "This constructor should only be used without momentum support");
+
+        if constexpr (transposed) {
+            w_t = etl::transpose(rbm.w);
+        }
     }
 
     template <bool M = rbm_layer_traits<rbm_t>::has_momentum(), cpp_enable_iff(M)>
@@ -656,8 +988,13 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
               q_local_batch(rbm.num_hidden),
               q_local_t(rbm.num_hidden, static_cast<weight>(0.0)),
               p_h_a(batch_size, rbm.num_hidden),
-              p_h_s(batch_size, rbm.num_hidden){
+              p_h_s(batch_size, rbm.num_hidden),
+              w_t(transposed ? rbm.num_hidden : 0, transposed ? rbm.num_visible : 0){
         static_assert(rbm_layer_traits<rbm_t>::has_momentum(), "This constructor should only be used with momentum support");
+
+        if constexpr (transposed) {
+            w_t = etl::transpose(rbm.w);
+        }
     }
 
     /*!
@@ -665,6 +1002,11 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
      */
     void update(RBM& rbm) {
         update_normal(rbm, *this);
+
+        // The reconstructions of the next batch use the transposed copy
+        if constexpr (transposed) {
+            w_t = etl::transpose(rbm.w);
+        }
     }
 
     /*!
@@ -675,6 +1017,18 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
         train_normal<Persistent, N>(input_batch, expected_batch, context, rbm, *this);
     }
 
+    /*!
+     * \brief Returns the number of bytes of the heap buffers of the trainer
+     */
+    size_t buffer_memory() const {
+        return buffer_bytes(v1) + buffer_bytes(vf) + buffer_bytes(h1_a) + buffer_bytes(h1_s)
+             + buffer_bytes(v2_a) + buffer_bytes(v2_s) + buffer_bytes(h2_a) + buffer_bytes(h2_s)
+             + buffer_bytes(w_grad) + buffer_bytes(b_grad) + buffer_bytes(c_grad)
+             + buffer_bytes(w_inc) + buffer_bytes(b_inc) + buffer_bytes(c_inc)
+             + buffer_bytes(q_local_batch) + buffer_bytes(q_local_t) + buffer_bytes(p_h_a) + buffer_bytes(p_h_s)
+             + buffer_bytes(w_t);
+    }
+
     /*!
      * \brief Return the name of the trainer
      */
@@ -744,9 +1098,6 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::
     conditional_fast_matrix_t<Persistent, weight, batch_size, K, NH1, NH2> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     conditional_fast_matrix_t<Persistent, weight, batch_size, K, NH1, NH2> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
-    etl::fast_matrix<weight, W_DIMS> w_pos; ///< The positive gradients
-    etl::fast_matrix<weight, W_DIMS> w_neg; ///< The negative gradients
-
     etl::fast_matrix<weight, batch_size, NC, NV1, NV2> v1; ///< Input
     etl::fast_matrix<weight, batch_size, NC, NV1, NV2> vf; ///< Expected
 
@@ -851,9 +1202,6 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
     etl::dyn_matrix<weight, 4> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::dyn_matrix<weight, 4> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
-    etl::dyn_matrix<weight, 4> w_pos; ///< The positive gradients
-    etl::dyn_matrix<weight, 4> w_neg; ///< The negative gradients
-
     etl::dyn_matrix<weight, 4> v1; ///< Input
     etl::dyn_matrix<weight, 4> vf; ///< Expected
 
@@ -882,8 +1230,6 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
              c_bias(rbm.nc, 0.0),
              p_h_a(batch_size, rbm.k, rbm.nh1, rbm.nh2),
              p_h_s(batch_size, rbm.k, rbm.nh1, rbm.nh2),
-             w_pos(DYN_W_DIMS),
-             w_neg(DYN_W_DIMS),
              v1(batch_size, rbm.nc, rbm.nv1, rbm.nv2),
              vf(batch_size, rbm.nc, rbm.nv1, rbm.nv2),
              h1_a(batch_size, rbm.k, rbm.nh1, rbm.nh2),
@@ -911,6 +1257,19 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
         train_convolutional<Persistent, N>(input_batch, expected_batch, context, rbm, *this);
     }
 
+    /*!
+     * \brief Returns the number of bytes of the heap buffers of the trainer
+     */
+    size_t buffer_memory() const {
+        return buffer_bytes(w_grad) + buffer_bytes(b_grad) + buffer_bytes(c_grad)
+             + buffer_bytes(w_inc) + buffer_bytes(b_inc) + buffer_bytes(c_inc)
+             + buffer_bytes(q_local_batch) + buffer_bytes(q_local_t)
+             + buffer_bytes(w_bias) + buffer_bytes(b_bias) + buffer_bytes(c_bias)
+             + buffer_bytes(p_h_a) + buffer_bytes(p_h_s)
+             + buffer_bytes(v1) + buffer_bytes(vf) + buffer_bytes(h1_a) + buffer_bytes(h1_s)
+             + buffer_bytes(v2_a) + buffer_bytes(v2_s) + buffer_bytes(h2_a) + buffer_bytes(h2_s);
+    }
+
     /*!
      * \brief Return the name of the trainer
      */
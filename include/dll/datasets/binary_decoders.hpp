@@ -0,0 +1,198 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Parallel decoders of the binary dataset files (MNIST and CIFAR-10)
+ * directly into the caches of the generators.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace decode_detail {
+
+/*!
+ * \brief The number of samples converted by one task
+ */
+constexpr size_t decode_block = 256;
+
+/*!
+ * \brief Read the given part of a file into the buffer
+ * \return true if the part could be read completely, false otherwise
+ */
+inline bool read_part(const std::string& path, size_t offset, size_t size, std::vector<uint8_t>& buffer) {
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file) {
+        return false;
+    }
+
+    buffer.resize(size);
+
+    file.seekg(offset);
+    file.read(reinterpret_cast<char*>(buffer.data()), size);
+
+    return size_t(file.gcount()) == size;
+}
+
+/*!
+ * \brief Read a big-endian 32 bits integer
+ */
+inline uint32_t read_be32(const uint8_t* data) {
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+/*!
+ * \brief Read the header of an IDX file
+ * \param path The path of the file
+ * \param dimensions The number of dimensions of one sample
+ * \param count The number of samples in the file
+ * \param size The number of values of one sample
+ * \return true if the header is valid, false otherwise
+ */
+inline bool read_idx_header(const std::string& path, size_t dimensions, size_t& count, size_t& size) {
+    std::vector<uint8_t> header;
+
+    if (!read_part(path, 0, 4 * (dimensions + 2), header)) {
+        return false;
+    }
+
+    // Unsigned bytes (0x08) with the given number of dimensions
+    if (header[0] != 0 || header[1] != 0 || header[2] != 0x08 || header[3] != dimensions + 1) {
+        return false;
+    }
+
+    count = read_be32(header.data() + 4);
+    size  = 1;
+
+    for (size_t d = 0; d < dimensions; ++d) {
+        size *= read_be32(header.data() + 8 + 4 * d);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Convert n samples of bytes into the cache, in parallel
+ */
+template <typename T>
+void convert_samples(T* out, const uint8_t* in, size_t n, size_t size, size_t in_stride) {
+    parallel_kernel(0, (n + decode_block - 1) / decode_block, [=](size_t block) {
+        const size_t last = std::min(n, (block + 1) * decode_block);
+
+        for (size_t i = block * decode_block; i < last; ++i) {
+            std::transform(in + i * in_stride, in + i * in_stride + size, out + i * size, [](uint8_t v) { return T(v); });
+        }
+    });
+}
+
+} //end of namespace decode_detail
+
+/*!
+ * \brief Decode the images of an IDX file (MNIST) into the given cache,
+ * which must be contiguous and sized for the samples to read.
+ *
+ * \param cache The cache of the samples [N x ...]
+ * \param path The path of the IDX image file
+ * \param start The index of the first sample to read
+ *
+ * \return true if the samples were decoded, false otherwise
+ */
+template <typename Cache>
+bool decode_idx_images(Cache& cache, const std::string& path, size_t start) {
+    const size_t n = etl::dim<0>(cache);
+
+    size_t count = 0;
+    size_t size  = 0;
+
+    if (!decode_detail::read_idx_header(path, 2, count, size)) {
+        return false;
+    }
+
+    if (start + n > count || size != etl::size(cache) / std::max(n, size_t(1))) {
+        return false;
+    }
+
+    std::vector<uint8_t> buffer;
+
+    if (!decode_detail::read_part(path, 16 + start * size, n * size, buffer)) {
+        return false;
+    }
+
+    decode_detail::convert_samples(cache.memory_start(), buffer.data(), n, size, size);
+
+    cpu_modified(cache);
+
+    return true;
+}
+
+/*!
+ * \brief Decode a set of CIFAR-10 binary files into the given caches,
+ * which must be contiguous and sized for the samples to read. The files
+ * are read in order until the caches are full.
+ *
+ * \param cache The cache of the samples [N x 3 x 32 x 32]
+ * \param labels The categorical labels [N x 10], which must be zero
+ * \param files The paths of the binary files
+ *
+ * \return true if all the samples were decoded, false otherwise
+ */
+template <typename Cache, typename Labels>
+bool decode_cifar10(Cache& cache, Labels& labels, const std::vector<std::string>& files) {
+    using T = etl::value_t<Cache>;
+
+    constexpr size_t size   = 3 * 32 * 32;
+    constexpr size_t record = size + 1;
+    constexpr size_t batch  = 10000;
+
+    const size_t n = etl::dim<0>(cache);
+
+    T* out = cache.memory_start();
+
+    std::vector<uint8_t> buffer;
+
+    size_t read = 0;
+
+    for (auto& file : files) {
+        if (read == n) {
+            break;
+        }
+
+        const size_t m = std::min(batch, n - read);
+
+        if (!decode_detail::read_part(file, 0, m * record, buffer)) {
+            return false;
+        }
+
+        decode_detail::convert_samples(out + read * size, buffer.data() + 1, m, size, record);
+
+        for (size_t i = 0; i < m; ++i) {
+            labels(read + i, buffer[i * record] % 10) = 1;
+        }
+
+        read += m;
+    }
+
+    cpu_modified(cache);
+
+    return read == n;
+}
+
+} //end of dll namespace
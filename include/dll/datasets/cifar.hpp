@@ -9,8 +9,45 @@
 
 #include "cifar/cifar10_reader.hpp"
 
+#include "dll/datasets/binary_decoders.hpp"
+
 namespace dll {
 
+/*!
+ * \brief Read the CIFAR-10 samples of the given binary files into the
+ * caches of a generator.
+ *
+ * The contiguous caches are decoded directly, in parallel, the others
+ * (compact storage) are filled by the CIFAR-10 reader.
+ *
+ * \param generator The generator, sized for the samples to read
+ * \param folder The folder of the binary files
+ * \param files The names of the binary files
+ * \param read The CIFAR-10 reader for the other caches
+ */
+template <typename Generator, typename Reader>
+void read_cifar10(Generator& generator, const std::string& folder, const std::vector<std::string>& files, Reader&& read) {
+    using cache_t = decltype(generator.input_cache);
+
+    if constexpr (etl::is_etl_expr<cache_t>) {
+        if constexpr (etl::all_dma<cache_t> && etl::dimensions<decltype(generator.label_cache)>() == 2) {
+            std::vector<std::string> paths;
+
+            for (auto& file : files) {
+                paths.push_back(folder + "/" + file);
+            }
+
+            if (!decode_cifar10(generator.input_cache, generator.label_cache, paths)) {
+                std::cerr << "Something went wrong, impossible to load CIFAR-10 from " << folder << std::endl;
+            }
+
+            return;
+        }
+    }
+
+    read();
+}
+
 /*!
  * \brief Create a data generator around the CIFAR-10 train set
  * \param folder The folder in which the CIFAR-10 train files are
@@ -38,7 +75,9 @@ auto make_cifar10_generator_train(const std::string& folder, size_t limit, Param
     generator->label_cache = 0;
 
     // Read all the necessary images and labels
-    cifar::read_training_categorical(folder, m, generator->input_cache, generator->label_cache);
+    read_cifar10(*generator, folder, {"data_batch_1.bin", "data_batch_2.bin", "data_batch_3.bin", "data_batch_4.bin", "data_batch_5.bin"}, [&] {
+        cifar::read_training_categorical(folder, m, generator->input_cache, generator->label_cache);
+    });
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
@@ -73,7 +112,9 @@ auto make_cifar10_generator_test(const std::string& folder, size_t limit, Parame
     generator->label_cache = 0;
 
     // Read all the necessary images and labels
-    cifar::read_test_categorical(folder, m, generator->input_cache, generator->label_cache);
+    read_cifar10(*generator, folder, {"test_batch.bin"}, [&] {
+        cifar::read_test_categorical(folder, m, generator->input_cache, generator->label_cache);
+    });
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
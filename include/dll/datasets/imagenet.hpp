@@ -11,22 +11,143 @@
 #include <unordered_map>
 #include <utility>
 #include <string>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 #include <dirent.h>
+#include <sys/stat.h>
 
 // Only for image loading...
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "dll/util/thread_budget.hpp"
 
 namespace dll {
 
 namespace imagenet {
 
-inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path){
-    files.reserve(1200000);
+/*!
+ * \brief A class directory of the training set
+ */
+struct class_directory {
+    size_t label;               ///< The label of the class
+    int64_t mtime_sec  = 0;     ///< The modification time of the directory (seconds)
+    int64_t mtime_nsec = 0;     ///< The modification time of the directory (nanoseconds)
+    std::vector<size_t> images; ///< The images of the class
+};
+
+/*!
+ * \brief Get the modification time of the given directory
+ * \return true if the directory exists, false otherwise
+ */
+inline bool directory_mtime(const std::string& path, int64_t& sec, int64_t& nsec) {
+    struct stat st;
+
+    if (stat(path.c_str(), &st) || !S_ISDIR(st.st_mode)) {
+        return false;
+    }
+
+    sec  = st.st_mtim.tv_sec;
+    nsec = st.st_mtim.tv_nsec;
+
+    return true;
+}
+
+/*!
+ * \brief Call the functor on each of the n directories, in parallel.
+ *
+ * The work is dominated by the latency of the file system, not by the
+ * CPU, the threads are only used to have several requests in flight.
+ */
+template <typename Functor>
+void for_each_directory(size_t n, Functor fun) {
+    std::atomic<size_t> next{0};
+
+    auto work = [&] {
+        for (size_t i = next++; i < n; i = next++) {
+            fun(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (size_t t = 1; t < budget_workers(n); ++t) {
+        threads.emplace_back(work);
+    }
+
+    work();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+/*!
+ * \brief Returns the path of the directory of the given class
+ */
+inline std::string class_path(const std::string& file_path, size_t label) {
+    return file_path + "/n" + (label < 10000000 ? "0" : "") + std::to_string(label);
+}
+
+/*!
+ * \brief Scan the directory of the given class
+ */
+inline void scan_class(const std::string& file_path, class_directory& c) {
+    const auto path = class_path(file_path, c.label);
+
+    directory_mtime(path, c.mtime_sec, c.mtime_nsec);
+
+    c.images.clear();
+
+    auto dir = opendir(path.c_str());
+
+    if (!dir) {
+        std::cerr << "ERROR: Failed to open directory: " << path << std::endl;
+        return;
+    }
 
     struct dirent* entry;
+
+    while ((entry = readdir(dir))) {
+        std::string image_name(entry->d_name);
+
+        if (image_name.find("n") != 0) {
+            continue;
+        }
+
+        std::string image_number(image_name.begin() + image_name.find('_') + 1, image_name.end() - 5);
+
+        c.images.push_back(std::atoi(image_number.c_str()));
+    }
+
+    closedir(dir);
+}
+
+/*!
+ * \brief Scan the training set in the given directory, the classes being
+ * sorted by label and scanned in parallel.
+ *
+ * \return true if the directory was scanned, false otherwise
+ */
+inline bool scan_classes(const std::string& file_path, std::vector<class_directory>& classes) {
     auto dir = opendir(file_path.c_str());
 
+    if (!dir) {
+        std::cerr << "ERROR: Failed to open directory: " << file_path << std::endl;
+        return false;
+    }
+
+    struct dirent* entry;
+
     while ((entry = readdir(dir))) {
         std::string file_name(entry->d_name);
 
@@ -35,29 +156,397 @@ inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unord
         }
 
         std::string label_name(file_name.begin() + 1, file_name.end());
-        size_t label = std::atoi(label_name.c_str());
 
+        classes.emplace_back();
+        classes.back().label = std::atoi(label_name.c_str());
+    }
+
+    closedir(dir);
+
+    std::sort(classes.begin(), classes.end(), [](auto& lhs, auto& rhs) { return lhs.label < rhs.label; });
+
+    for_each_directory(classes.size(), [&](size_t c) { scan_class(file_path, classes[c]); });
+
+    return true;
+}
+
+constexpr uint64_t manifest_magic = 0x31584e49474d4944; ///< The magic number of the manifests ("DIMGINX1")
+
+/*!
+ * \brief Load the manifest of the training set, if it is still valid.
+ *
+ * The manifest is only valid if the modification times of the directory
+ * and of all the class directories did not change since it was written.
+ *
+ * \return true if the manifest was loaded, false otherwise
+ */
+inline bool read_manifest(const std::string& index_path, const std::string& file_path, std::vector<class_directory>& classes) {
+    std::ifstream stream(index_path, std::ios::binary);
+
+    if (!stream) {
+        return false;
+    }
+
+    auto read = [&stream](auto& value) {
+        return bool(stream.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    };
+
+    uint64_t magic = 0;
+    uint64_t n     = 0;
+    int64_t sec    = 0;
+    int64_t nsec   = 0;
+
+    if (!read(magic) || magic != manifest_magic || !read(sec) || !read(nsec) || !read(n)) {
+        return false;
+    }
+
+    int64_t current_sec  = 0;
+    int64_t current_nsec = 0;
+
+    if (!directory_mtime(file_path, current_sec, current_nsec) || current_sec != sec || current_nsec != nsec) {
+        return false;
+    }
+
+    classes.resize(n);
+
+    for (auto& c : classes) {
+        uint64_t label = 0;
+        uint64_t count = 0;
+
+        if (!read(label) || !read(c.mtime_sec) || !read(c.mtime_nsec) || !read(count)) {
+            return false;
+        }
+
+        c.label = label;
+        c.images.resize(count);
+
+        static_assert(sizeof(size_t) == sizeof(uint64_t), "The manifest stores 64-bit image ids");
+
+        if (count && !stream.read(reinterpret_cast<char*>(c.images.data()), count * sizeof(uint64_t))) {
+            return false;
+        }
+    }
+
+    std::atomic<bool> valid{true};
+
+    for_each_directory(classes.size(), [&](size_t i) {
+        int64_t s  = 0;
+        int64_t ns = 0;
+
+        auto& c = classes[i];
+
+        if (!directory_mtime(class_path(file_path, c.label), s, ns) || s != c.mtime_sec || ns != c.mtime_nsec) {
+            valid = false;
+        }
+    });
+
+    return valid;
+}
+
+/*!
+ * \brief Write the manifest of the training set.
+ *
+ * The manifest is written in a temporary file and renamed, a concurrent
+ * reader either sees the complete manifest or no manifest. The failures
+ * are ignored, the training set being scanned again at the next run.
+ */
+inline void write_manifest(const std::string& index_path, const std::string& file_path, const std::vector<class_directory>& classes) {
+    int64_t sec  = 0;
+    int64_t nsec = 0;
+
+    if (!directory_mtime(file_path, sec, nsec)) {
+        return;
+    }
+
+    const std::string tmp_path = index_path + ".tmp";
+
+    {
+        std::ofstream stream(tmp_path, std::ios::binary);
+
+        auto write = [&stream](auto value) {
+            stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+        write(manifest_magic);
+        write(sec);
+        write(nsec);
+        write(uint64_t(classes.size()));
+
+        for (auto& c : classes) {
+            write(uint64_t(c.label));
+            write(c.mtime_sec);
+            write(c.mtime_nsec);
+            write(uint64_t(c.images.size()));
+
+            stream.write(reinterpret_cast<const char*>(c.images.data()), c.images.size() * sizeof(uint64_t));
+        }
+
+        if (!stream) {
+            std::remove(tmp_path.c_str());
+            return;
+        }
+    }
+
+    std::rename(tmp_path.c_str(), index_path.c_str());
+}
+
+/*!
+ * \brief Read the list of the files of the training set and the labels of
+ * the classes.
+ *
+ * The manifest of the files is cached in the index file, it is used
+ * instead of scanning the directories as long as none of the directories
+ * has been modified. The labels are numbered in the order of the WordNet
+ * ids of the classes.
+ *
+ * \param files The files, as (class, image) pairs
+ * \param label_map The label of each class
+ * \param file_path The directory of the training set
+ * \param index_path The path to the index file
+ */
+inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path, const std::string& index_path) {
+    std::vector<class_directory> classes;
+
+    if (!read_manifest(index_path, file_path, classes)) {
+        classes.clear();
+
+        if (!scan_classes(file_path, classes)) {
+            return;
+        }
+
+        write_manifest(index_path, file_path, classes);
+    }
+
+    size_t total = 0;
+
+    for (auto& c : classes) {
+        total += c.images.size();
+    }
+
+    files.reserve(total);
+
+    for (auto& c : classes) {
         auto l = label_map.size();
-        label_map[label] = l;
+        label_map[c.label] = l;
+
+        for (auto image : c.images) {
+            files.emplace_back(c.label, image);
+        }
+    }
+}
+
+/*!
+ * \brief Read the list of the files of the training set and the labels of
+ * the classes, the index file being next to the training set directory.
+ *
+ * \param files The files, as (class, image) pairs
+ * \param label_map The label of each class
+ * \param file_path The directory of the training set
+ */
+inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unordered_map<size_t, float>& label_map, const std::string& file_path) {
+    read_files(files, label_map, file_path, file_path + ".index");
+}
 
-        struct dirent* sub_entry;
-        auto sub_dir = opendir((file_path + "/" + file_name).c_str());
+/*!
+ * \brief Decode the given image file into the given planar target.
+ *
+ * The image is resized to the size of the target if necessary.
+ *
+ * \param image_path The path to the image
+ * \param image The target (channels x width x height)
+ * \param mat The decoding buffer
+ * \param resized The resizing buffer
+ */
+template <typename T>
+void decode_image(const std::string& image_path, T&& image, cv::Mat& mat, cv::Mat& resized) {
+    const size_t width  = etl::dim<1>(image);
+    const size_t height = etl::dim<2>(image);
 
-        while ((sub_entry = readdir(sub_dir))) {
-            std::string image_name(sub_entry->d_name);
+    mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
 
-            if (image_name.find("n") != 0){
-                continue;
-            }
+    if (!mat.data || mat.empty()) {
+        std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
+        image = 0;
+        return;
+    }
 
-            std::string image_number(image_name.begin() + image_name.find('_') + 1, image_name.end() - 5);
-            size_t image = std::atoi(image_number.c_str());
+    const cv::Mat* source = &mat;
 
-            files.emplace_back(label, image);
+    if (size_t(mat.cols) != width || size_t(mat.rows) != height) {
+        cv::resize(mat, resized, cv::Size(width, height));
+        source = &resized;
+    }
+
+    if (cpp_likely(source->channels() == 3)) {
+        for (size_t y = 0; y < height; ++y) {
+            const auto* row = source->ptr<cv::Vec3b>(y);
+
+            for (size_t x = 0; x < width; ++x) {
+                image(0, x, y) = row[x].val[0];
+                image(1, x, y) = row[x].val[1];
+                image(2, x, y) = row[x].val[2];
+            }
+        }
+    } else {
+        for (size_t y = 0; y < height; ++y) {
+            const auto* row = source->ptr<unsigned char>(y);
+
+            for (size_t x = 0; x < width; ++x) {
+                image(0, x, y) = row[x];
+            }
         }
+
+        image(1) = 0;
+        image(2) = 0;
     }
 }
 
+/*!
+ * \brief A pool of threads decoding images directly into the batches of
+ * the generators.
+ *
+ * The pool does not queue any decoded image, each worker decodes into the
+ * final location, so the memory used is bounded by the decoding buffers of
+ * the workers.
+ */
+struct decoder_pool {
+    /*!
+     * \brief A decoder thread
+     */
+    struct worker {
+        std::thread thread;             ///< The thread of the worker
+        cv::Mat mat;                    ///< The decoding buffer
+        cv::Mat resized;                ///< The resizing buffer
+        std::atomic<size_t> decoded{0}; ///< The number of images decoded by this worker
+        std::atomic<size_t> busy_ns{0}; ///< The time spent decoding, in nanoseconds
+    };
+
+    std::vector<std::unique_ptr<worker>> workers; ///< The decoder threads
+
+    std::mutex run_lock;                    ///< Serializes the jobs of several generators
+    std::mutex lock;                        ///< The lock for the job
+    std::condition_variable job_condition;  ///< Signals a new job to the workers
+    std::condition_variable done_condition; ///< Signals the end of a job
+
+    std::function<void(size_t, worker&)> task; ///< The task of the current job
+    size_t job      = 0;                       ///< The index of the current job
+    size_t n        = 0;                       ///< The number of items of the current job
+    size_t finished = 0;                       ///< The number of workers done with the current job
+    bool stop_flag  = false;                   ///< Indicates to the workers to stop
+
+    std::atomic<size_t> next{0}; ///< The next item to decode
+
+    /*!
+     * \brief Create a pool with the given number of decoders
+     * \param threads The number of decoder threads
+     */
+    explicit decoder_pool(size_t threads = available_threads()) {
+        threads = std::max(threads, size_t(1));
+
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back(std::make_unique<worker>());
+        }
+
+        for (auto& w : workers) {
+            auto* current = w.get();
+            w->thread = std::thread([this, current] { work(*current); });
+        }
+    }
+
+    decoder_pool(const decoder_pool& rhs) = delete;
+    decoder_pool& operator=(const decoder_pool& rhs) = delete;
+
+    /*!
+     * \brief Stop and join all the decoders
+     */
+    ~decoder_pool() {
+        cpp::with_lock(lock, [this] { stop_flag = true; });
+
+        job_condition.notify_all();
+
+        for (auto& w : workers) {
+            w->thread.join();
+        }
+    }
+
+    /*!
+     * \brief Run the given task on the items [0, n) and wait for them
+     * \param items The number of items
+     * \param t The task to run on each item
+     */
+    void run(size_t items, std::function<void(size_t, worker&)> t) {
+        std::lock_guard<std::mutex> run_guard(run_lock);
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        task     = std::move(t);
+        n        = items;
+        next     = 0;
+        finished = 0;
+        ++job;
+
+        job_condition.notify_all();
+
+        done_condition.wait(ulock, [this] { return finished == workers.size(); });
+    }
+
+    /*!
+     * \brief Display the throughput of each decoder
+     * \param stream The stream to print to
+     */
+    void display(std::ostream& stream = std::cout) const {
+        for (size_t t = 0; t < workers.size(); ++t) {
+            const size_t decoded = workers[t]->decoded;
+            const double seconds = workers[t]->busy_ns / 1e9;
+
+            stream << "decoder " << t << ": " << decoded << " images, " << (seconds > 0.0 ? decoded / seconds : 0.0) << " images/s" << std::endl;
+        }
+    }
+
+private:
+    /*!
+     * \brief The main loop of a decoder
+     */
+    void work(worker& w) {
+        size_t seen = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                job_condition.wait(ulock, [this, seen] { return stop_flag || job != seen; });
+
+                if (stop_flag) {
+                    return;
+                }
+
+                seen = job;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+
+            size_t local = 0;
+            for (size_t i = next++; i < n; i = next++) {
+                task(i, w);
+                ++local;
+            }
+
+            auto end = std::chrono::steady_clock::now();
+
+            w.decoded += local;
+            w.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                if (++finished == workers.size()) {
+                    done_condition.notify_one();
+                }
+            }
+        }
+    }
+};
+
 struct image_iterator : std::iterator<
                                      std::input_iterator_tag,
                                      etl::fast_dyn_matrix<float, 3, 256, 256>,
@@ -68,14 +557,17 @@ struct image_iterator : std::iterator<
 
     using value_type = etl::fast_dyn_matrix<float, 3, 256, 256>;
 
+    static constexpr bool batch_decoder = true; ///< The iterator can decode batches with its pool
+
     std::string imagenet_path;
     std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files;
     std::shared_ptr<std::unordered_map<size_t, float>> labels;
+    std::shared_ptr<decoder_pool> pool;
 
     size_t index;
 
-    image_iterator(const std::string& imagenet_path, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, std::shared_ptr<std::unordered_map<size_t, float>> labels, size_t index) :
-        imagenet_path(imagenet_path), files(files), labels(labels), index(index)
+    image_iterator(const std::string& imagenet_path, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, std::shared_ptr<std::unordered_map<size_t, float>> labels, std::shared_ptr<decoder_pool> pool, size_t index) :
+        imagenet_path(imagenet_path), files(files), labels(labels), pool(pool), index(index)
     {
         // Nothing else to init
     }
@@ -99,55 +591,43 @@ struct image_iterator : std::iterator<
         return *this;
     }
 
-    value_type operator*() {
-        auto& image_file = (*files)[index];
+    /*!
+     * \brief Returns the path of the image at the given index
+     */
+    std::string image_path(size_t i) const {
+        auto& image_file = (*files)[i];
 
         auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
 
-        auto image_path =
-            std::string(imagenet_path) + "/train" + label + label +
-            "_" + std::to_string(image_file.second) + ".JPEG";
-
-        auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
+        return std::string(imagenet_path) + "/train" + label + label + "_" + std::to_string(image_file.second) + ".JPEG";
+    }
 
+    value_type operator*() {
         value_type image;
+        cv::Mat mat;
+        cv::Mat resized;
 
-        if (!mat.data || mat.empty()) {
-            std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (mat.cols != 256 || mat.rows != 256) {
-            std::cerr << "ERROR: Image of invalid size: " << image_path << std::endl;
-            image = 0;
-            return image;
-        }
-
-        if (cpp_likely(mat.channels() == 3)) {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    auto pixel = mat.at<cv::Vec3b>(y, x);
-
-                    image(0, x, y) = pixel.val[0];
-                    image(1, x, y) = pixel.val[1];
-                    image(2, x, y) = pixel.val[2];
-                }
-            }
-        } else {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    image(0, x, y) = mat.at<unsigned char>(y, x);
-                }
-            }
-
-            image(1) = 0;
-            image(2) = 0;
-        }
+        decode_image(image_path(index), image, mat, resized);
 
         return image;
     }
 
+    /*!
+     * \brief Decode the n next images directly into the given batch, using
+     * the decoder pool.
+     *
+     * The iterator itself is not advanced.
+     *
+     * \param batch The batch to fill
+     * \param n The number of images to decode
+     */
+    template <typename B>
+    void decode_batch(B&& batch, size_t n) const {
+        pool->run(n, [this, &batch](size_t i, decoder_pool::worker& w) {
+            decode_image(image_path(index + i), batch(i), w.mat, w.resized);
+        });
+    }
+
     bool operator==(const image_iterator& rhs) const {
         return index == rhs.index;
     }
@@ -218,6 +698,7 @@ template<typename... Parameters>
 auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*parameters*/){
     auto train_files = std::make_shared<std::vector<std::pair<size_t, size_t>>>();
     auto labels      = std::make_shared<std::unordered_map<size_t, float>>();
+    auto pool        = std::make_shared<imagenet::decoder_pool>();
 
     imagenet::read_files(*train_files, *labels, std::string(folder) + "train");
 
@@ -227,8 +708,8 @@ auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*paramete
     std::shuffle(train_files->begin(), train_files->end(), engine);
 
     // The image iterators
-    imagenet::image_iterator iit(folder, train_files, labels, 0);
-    imagenet::image_iterator iend(folder, train_files, labels, train_files->size());
+    imagenet::image_iterator iit(folder, train_files, labels, pool, 0);
+    imagenet::image_iterator iend(folder, train_files, labels, pool, train_files->size());
 
     // The label iterators
     imagenet::label_iterator lit(train_files, labels, 0);
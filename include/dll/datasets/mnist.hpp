@@ -9,11 +9,42 @@
 
 #include "mnist/mnist_reader.hpp"
 
+#include "dll/datasets/binary_decoders.hpp"
+
 namespace dll {
 
 using mnist_example_t = etl::fast_dyn_matrix<float, 1, 28, 28>;
 using mnist_example_nc_t = etl::fast_dyn_matrix<float, 28, 28>;
 
+/*!
+ * \brief Read the MNIST images of the given file into the cache of a
+ * generator.
+ *
+ * The contiguous caches are decoded directly, in parallel, the others
+ * (compact storage) are filled by the MNIST reader.
+ *
+ * \param cache The cache, sized for the samples to read
+ * \param path The path of the image file
+ * \param limit The limit size (0 = no limit)
+ * \param start The index of the first sample
+ *
+ * \return true if the images were read, false otherwise
+ */
+template <typename Cache>
+bool read_mnist_images(Cache& cache, const std::string& path, size_t limit, size_t start) {
+    if constexpr (etl::is_etl_expr<Cache>) {
+        if constexpr (etl::all_dma<Cache>) {
+            cpp_unused(limit);
+
+            return decode_idx_images(cache, path, start);
+        } else {
+            return mnist::read_mnist_image_file_flat(cache, path, limit, start);
+        }
+    } else {
+        return mnist::read_mnist_image_file_flat(cache, path, limit, start);
+    }
+}
+
 /*!
  * \brief Create a data generator around the MNIST train set
  * \param folder The folder in which the MNIST train files are
@@ -39,7 +70,7 @@ auto make_mnist_generator_train_impl(const std::string& folder, size_t start, si
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
     // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
+    if(!read_mnist_images(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
         std::cerr << "Something went wrong, impossible to load MNIST training images" << std::endl;
         return generator;
     }
@@ -82,7 +113,7 @@ auto make_mnist_generator_test_impl(const std::string& folder, size_t start, siz
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
     // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
+    if(!read_mnist_images(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
         std::cerr << "Something went wrong, impossible to load MNIST test images" << std::endl;
         return generator;
     }
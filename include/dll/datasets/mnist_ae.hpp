@@ -9,6 +9,8 @@
 
 #include "mnist/mnist_reader.hpp"
 
+#include "dll/datasets/mnist.hpp"
+
 namespace dll {
 
 /*!
@@ -35,13 +37,11 @@ auto make_mnist_ae_generator_train(const std::string& folder, size_t start, size
     auto generator = prepare_generator(input, input, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::autoencoder>{});
 
     // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
+    if(!read_mnist_images(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
         std::cerr << "Something went wrong, impossible to load MNIST training images" << std::endl;
         return generator;
     }
 
-    generator->label_cache = generator->input_cache;
-
     // Apply the transformations on the input
     generator->finalize_prepared_data();
 
@@ -72,13 +72,11 @@ auto make_mnist_ae_generator_test(const std::string& folder, size_t start, size_
     auto generator = prepare_generator(input, input, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::autoencoder>{});
 
     // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
+    if(!read_mnist_images(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
         std::cerr << "Something went wrong, impossible to load MNIST test images" << std::endl;
         return generator;
     }
 
-    generator->label_cache = generator->input_cache;
-
     // Apply the transformations on the input
     generator->finalize_prepared_data();
 
@@ -37,6 +37,41 @@ struct generic_dyn_dbn_desc : generic_dbn_desc<DBN_T, Layers, Parameters...> {
     using network_t = dbn_t;
 };
 
+/*!
+ * \brief Select the dynamic version of a layer, unless it is in the list
+ * of fast layers.
+ */
+template <typename Layer, typename Fast>
+using hybrid_layer_t = std::conditional_t<Fast::template contains<Layer>(), Layer, typename Layer::desc::dyn_layer_t>;
+
+template <typename Layers, typename Fast>
+struct hybrid_layers_t;
+
+template <bool Labels, typename... Layers, typename Fast>
+struct hybrid_layers_t <dll::detail::layers<Labels, Layers...>, Fast> {
+    using hybrid_t = dll::detail::layers<Labels, hybrid_layer_t<Layers, Fast>...>;
+};
+
+template <template <typename> typename DBN_T, typename Layers, typename... Parameters>
+struct generic_hybrid_dbn_desc : generic_dbn_desc<DBN_T, Layers, Parameters...> {
+    using fast_t = detail::get_type_t<fast_layers<>, Parameters...>; ///< The layers kept static
+
+    /* Dynify the layers that are not fast */
+    using layers      = typename hybrid_layers_t<Layers, fast_t>::hybrid_t;
+    using base_layers = Layers;
+
+    /*! The DBN type */
+    using dbn_t = DBN_T<generic_hybrid_dbn_desc<DBN_T, Layers, Parameters...>>;
+
+    /*!
+     * \brief The network type.
+     *
+     * This is the same as the DBN type, only kept for legacy
+     * reasons.
+     */
+    using network_t = dbn_t;
+};
+
 /*!
  * \brief A descriptor for a multi-layer dynamic network.
  * \tparam Layers The set of layers
@@ -45,6 +80,20 @@ struct generic_dyn_dbn_desc : generic_dbn_desc<DBN_T, Layers, Parameters...> {
 template <typename Layers, typename... Parameters>
 using dyn_dbn_desc = generic_dyn_dbn_desc<dbn, Layers, Parameters...>;
 
+/*!
+ * \brief A descriptor for a multi-layer hybrid network.
+ *
+ * The layers listed in the fast_layers parameter are used as is, with
+ * their fixed-size kernels, the other layers are replaced by their dynamic
+ * version. Only the hot layers are then specialized at compile-time, the
+ * rest of the network is compiled once for all sizes.
+ *
+ * \tparam Layers The set of layers
+ * \tparam Parameters The set of parameters for this network
+ */
+template <typename Layers, typename... Parameters>
+using hybrid_dbn_desc = generic_hybrid_dbn_desc<dbn, Layers, Parameters...>;
+
 /*!
  * \brief A descriptor for a multi-layer dynamic network.
  * \tparam Layers The set of layers
@@ -12,6 +12,10 @@
 
 #pragma once
 
+#include "dll/function.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/generators.hpp"
+
 namespace dll {
 
 namespace dbn_detail {
@@ -73,22 +77,14 @@ struct weight_type_same<I, DBN, T, cpp::disable_if_t<layer_traits<typename DBN::
 
 // validate the weight type of the layers
 
-template <size_t I, typename DBN, typename T, typename Enable = void>
-struct validate_weight_type_impl;
-
-template <size_t I, typename DBN, typename T>
-struct validate_weight_type_impl< I, DBN, T, std::enable_if_t<(I == DBN::layers_t::size - 1)> > {
-    static constexpr bool value = weight_type_same<I, DBN, T>::value;
-};
-
-template <size_t I, typename DBN, typename T>
-struct validate_weight_type_impl< I, DBN, T, std::enable_if_t<(I < DBN::layers_t::size - 1)> > {
-    static constexpr bool value = weight_type_same<I, DBN, T>::value && validate_weight_type_impl<I + 1, DBN, T>::value;
-};
+template <typename DBN, typename T, size_t... I>
+constexpr bool validate_weight_type_impl(std::index_sequence<I...> /*indices*/) {
+    return (weight_type_same<I, DBN, T>::value && ...);
+}
 
 template <typename DBN, typename T>
 struct validate_weight_type {
-    static constexpr bool value = validate_weight_type_impl<0, DBN, T>::value;
+    static constexpr bool value = validate_weight_type_impl<DBN, T>(std::make_index_sequence<DBN::layers_t::size>());
 };
 
 // Compute the distance between two iterators, only if random_access
@@ -102,11 +98,17 @@ size_t fast_distance(Iterator& first, Iterator& last) {
     }
 }
 
-template <typename D, size_t N, typename T>
+/*!
+ * \brief Apply functors on the layers of the DBN given by the index sequence.
+ *
+ * Each function is a single fold expression, the pair variants are simply
+ * empty for a DBN with only one layer.
+ */
+template <typename D, typename T>
 struct for_each_impl;
 
 template <typename D, size_t... I>
-struct for_each_impl<D, 1, std::index_sequence<I...>> {
+struct for_each_impl<D, std::index_sequence<I...>> {
     D& dbn;
 
     for_each_impl(D& dbn)
@@ -114,76 +116,175 @@ struct for_each_impl<D, 1, std::index_sequence<I...>> {
 
     template <typename Functor>
     void for_each_layer(Functor&& functor) {
-        functor(dbn.template layer_get<0>());
+        (functor(dbn.template layer_get<I>()), ...);
     }
 
     template <typename Functor>
     void for_each_layer_i(Functor&& functor) {
-        functor(dbn.template layer_get<0>(), 0);
+        (functor(I, dbn.template layer_get<I>()), ...);
     }
 
     template <typename Functor>
     void for_each_layer_pair(Functor&& functor) {
-        cpp_unused(functor);
-        // Nothing to do here
+        (functor(dbn.template layer_get<I>(), dbn.template layer_get<I + 1>()), ...);
     }
 
     template <typename Functor>
     void for_each_layer_pair_i(Functor&& functor) {
-        cpp_unused(functor);
-        // Nothing to do here
+        (functor(I, dbn.template layer_get<I>(), dbn.template layer_get<I + 1>()), ...);
     }
 
     template <typename Functor>
     void for_each_layer_rpair(Functor&& functor) {
-        cpp_unused(functor);
-        // Nothing to do here
+        (functor(dbn.template layer_get<D::layers - I - 2>(), dbn.template layer_get<D::layers - I - 1>()), ...);
     }
 
     template <typename Functor>
     void for_each_layer_rpair_i(Functor&& functor) {
-        cpp_unused(functor);
-        // Nothing to do here
+        (functor(D::layers - I - 2, dbn.template layer_get<D::layers - I - 2>(), dbn.template layer_get<D::layers - I - 1>()), ...);
     }
 };
 
-template <typename D, size_t N, size_t... I>
-struct for_each_impl<D, N, std::index_sequence<I...>> {
-    D& dbn;
+/*!
+ * \brief Indicates if the layer L2 can be fused into the layer L1 for
+ * inference. The two layers are then computed at once by
+ * L1::test_forward_batch_fused.
+ */
+template <typename L1, typename L2, typename Enable = void>
+struct is_fusable_pair : std::false_type {};
 
-    for_each_impl(D& dbn)
-            : dbn(dbn) {}
+template <typename L1, typename L2>
+struct is_fusable_pair<L1, L2, std::enable_if_t<L1::template fuses_with<L2>::value>> : std::true_type {};
 
-    template <typename Functor>
-    void for_each_layer(Functor&& functor) {
-        (functor(dbn.template layer_get<I>()), ...);
-    }
+/*!
+ * \brief Indicates if the global pooling layer L1 can give its output
+ * directly to the dense layer L2 in the inference engine, without storing
+ * it in the buffers of the engine.
+ */
+template <typename L1, typename L2, typename Enable = void>
+struct is_fusable_head : std::false_type {};
 
-    template <typename Functor>
-    void for_each_layer_i(Functor&& functor) {
-        (functor(I, dbn.template layer_get<I>()), ...);
-    }
+template <typename L1, typename L2>
+struct is_fusable_head<L1, L2, std::enable_if_t<L1::global_pooling>> : is_fusable_pair<L1, L2> {};
 
-    template <typename Functor>
-    void for_each_layer_pair(Functor&& functor) {
-        (functor(dbn.template layer_get<I>(), dbn.template layer_get<I + 1>()), ...);
-    }
+/*!
+ * \brief Indicates if the layer is an identity at inference, and can be
+ * skipped.
+ */
+template <typename L, typename Enable = void>
+struct is_inference_identity : std::false_type {};
 
-    template <typename Functor>
-    void for_each_layer_pair_i(Functor&& functor) {
-        (functor(I, dbn.template layer_get<I>(), dbn.template layer_get<I + 1>()), ...);
-    }
+template <typename L>
+struct is_inference_identity<L, std::enable_if_t<L::inference_identity>> : std::true_type {};
 
-    template <typename Functor>
-    void for_each_layer_rpair(Functor&& functor) {
-        (functor(dbn.template layer_get<D::layers - I - 2>(), dbn.template layer_get<D::layers - I - 1>()), ...);
-    }
+/*!
+ * \brief Indicates if the layer is a view: its output is its input, with
+ * the same values, and it does not need to be computed. The next layer
+ * reads directly the input of such a layer.
+ */
+template <typename L, typename Enable = void>
+struct is_view_layer : std::false_type {};
 
-    template <typename Functor>
-    void for_each_layer_rpair_i(Functor&& functor) {
-        (functor(D::layers - I - 2, dbn.template layer_get<D::layers - I - 2>(), dbn.template layer_get<D::layers - I - 1>()), ...);
-    }
-};
+template <typename L>
+struct is_view_layer<L, std::enable_if_t<L::view_layer>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the layer can be computed in place, its output
+ * overwriting its input. The backward pass of such a layer does not use its
+ * input.
+ */
+template <typename L, typename Enable = void>
+struct is_inplace_layer : std::false_type {};
+
+template <typename L>
+struct is_inplace_layer<L, std::enable_if_t<L::inplace>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the layer has biases
+ */
+template <typename L, typename Enable = void>
+struct has_biases : std::true_type {};
+
+template <typename L>
+struct has_biases<L, std::enable_if_t<L::no_bias>> : std::false_type {};
+
+/*!
+ * \brief Indicates if the layer is made of sub layers (group and merge
+ * layers)
+ */
+template <typename L, typename Enable = void>
+struct has_sub_layers : std::false_type {};
+
+template <typename L>
+struct has_sub_layers<L, std::void_t<decltype(std::declval<L&>().layers)>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the spatial dimensions of the input of the layer can
+ * be changed after its initialization
+ */
+template <typename L, typename Enable = void>
+struct has_resize_input : std::false_type {};
+
+template <typename L>
+struct has_resize_input<L, std::void_t<decltype(std::declval<L&>().resize_input(std::declval<const std::vector<size_t>&>()))>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the labels of an auto-encoder generator of the given
+ * description are exactly its data (no augmentation of the data)
+ */
+template <typename Desc, typename Enable = void>
+struct is_plain_ae_desc : std::bool_constant<Desc::AutoEncoder> {};
+
+template <typename Desc>
+struct is_plain_ae_desc<Desc, std::void_t<decltype(Desc::Noise)>> : std::bool_constant<Desc::AutoEncoder && !is_augmented<Desc>> {};
+
+/*!
+ * \brief Indicates if the label batches of the generator are its data
+ * batches, in which case the output can be compared to the data batch
+ * directly
+ */
+template <typename G, typename Enable = void>
+struct labels_are_data : std::false_type {};
+
+template <typename G>
+struct labels_are_data<G, std::void_t<typename G::desc>> : is_plain_ae_desc<typename G::desc> {};
+
+/*!
+ * \brief Indicates if the layer is a merge of sibling RBMs, consuming the
+ * same input, which are pretrained concurrently
+ */
+template <typename L, typename Enable = void>
+struct is_rbm_siblings : std::false_type {};
+
+template <size_t D, typename... Layers>
+struct is_rbm_siblings<merge_layer_impl<merge_layer_desc<D, Layers...>>> : std::bool_constant<(decay_layer_traits<Layers>::is_rbm_layer() && ...)> {};
+
+/*!
+ * \brief Indicates if the layer is pretrained, an RBM or sibling RBMs
+ */
+template <typename L>
+struct is_pretrained_layer : std::bool_constant<decay_layer_traits<L>::is_rbm_layer() || is_rbm_siblings<L>::value> {};
+
+/*!
+ * \brief The batch size of the pretraining of the layer (an RBM or
+ * sibling RBMs)
+ */
+template <typename L, typename Enable = void>
+struct pretrain_batch_size : std::integral_constant<size_t, L::batch_size> {};
+
+template <typename L>
+struct pretrain_batch_size<L, std::enable_if_t<is_rbm_siblings<L>::value>> : std::integral_constant<size_t, L::template layer_type<0>::batch_size> {};
+
+/*!
+ * \brief Indicates if the normalization layer L2 can be folded into the
+ * weights and biases of the layer L1 for inference.
+ */
+template <typename L1, typename L2, typename Enable = void>
+struct is_foldable_pair : std::false_type {};
+
+template <typename L1, typename L2>
+struct is_foldable_pair<L1, L2, std::enable_if_t<L2::foldable_normalization && (decay_layer_traits<L1>::is_standard_dense_layer() || decay_layer_traits<L1>::is_standard_convolutional_layer())>>
+        : std::bool_constant<L1::activation_function == function::IDENTITY && has_biases<L1>::value> {};
 
 } //end of namespace dbn_detail
 
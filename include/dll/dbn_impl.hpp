@@ -16,20 +16,36 @@
 
 #pragma once
 
+#include <numeric>
+
 #include "cpp_utils/maybe_parallel.hpp"
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "generators.hpp"
 #include "unit_type.hpp"
 #include "trainer/dbn_trainer.hpp"
+#include "trainer/distillation.hpp"
 #include "trainer/rbm_trainer_fwd.hpp"
 #include "dll/trainer/rbm_training_context.hpp"
 #include "dbn_common.hpp"
 #include "svm_common.hpp"
+#include "svm_grid_search.hpp"
 #include "util/export.hpp"
+#include "util/loss_kernels.hpp"
 #include "util/timers.hpp"
+#include "util/arena.hpp"
+#include "util/confusion_matrix.hpp"
+#include "util/distributed.hpp"
+#include "util/parameter_store.hpp"
+#include "util/prune.hpp"
+#include "util/memory.hpp"
+#include "util/numa.hpp"
+#include "util/parallel.hpp"
 #include "util/random.hpp"
+#include "util/reduction.hpp"
 #include "util/ready.hpp"
+#include "inference_engine.hpp"
+#include "inference_server.hpp"
 #include "dbn_detail.hpp" // dbn_detail namespace
 
 namespace dll {
@@ -53,26 +69,47 @@ struct is_output_layer {
     static constexpr bool value = !traits::is_transform_layer();
 };
 
-template<size_t Layer, typename DBN, typename Enable = void>
-struct find_output_layer {
-    static constexpr size_t L = Layer;
-};
+/*!
+ * \brief Returns the index of the last layer of the DBN that is not a
+ * transform layer
+ */
+template<typename DBN, size_t... I>
+constexpr size_t find_output_layer(std::index_sequence<I...> /*indices*/) {
+    constexpr bool output[] = {is_output_layer<typename DBN::template layer_type<I>>::value...};
 
-template<size_t Layer, typename DBN>
-struct find_output_layer<Layer, DBN, std::enable_if_t<!is_output_layer<typename DBN::template layer_type<Layer>>::value>> {
-    static constexpr size_t L = find_output_layer<Layer - 1, DBN>::L;
-};
+    for (size_t i = sizeof...(I); i > 0; --i) {
+        if (output[i - 1]) {
+            return i - 1;
+        }
+    }
 
-template<size_t Layer, typename DBN, typename Enable = void>
-struct find_rbm_layer {
-    static constexpr size_t L = Layer;
-};
+    return 0;
+}
 
-template<size_t Layer, typename DBN>
-struct find_rbm_layer<Layer, DBN, std::enable_if_t<(Layer < DBN::layers_t::size)>> {
-    static constexpr bool RBM = decay_layer_traits<typename DBN::template layer_type<Layer>>::is_rbm_layer();
-    static constexpr size_t L = RBM ? Layer : find_rbm_layer<Layer + 1, DBN>::L;
-};
+/*!
+ * \brief Returns the index of the first RBM layer (or merge of sibling RBMs)
+ * of the DBN, or the number of layers if there are no RBM layer
+ */
+template<typename DBN, size_t... I>
+constexpr size_t find_rbm_layer(std::index_sequence<I...> /*indices*/) {
+    constexpr bool rbm[] = {dbn_detail::is_pretrained_layer<typename DBN::template layer_type<I>>::value...};
+
+    for (size_t i = 0; i < sizeof...(I); ++i) {
+        if (rbm[i]) {
+            return i;
+        }
+    }
+
+    return sizeof...(I);
+}
+
+/*!
+ * \brief Indicates if all the layers of the DBN are dense RBMs
+ */
+template<typename DBN, size_t... I>
+constexpr bool all_dense_rbm_layers(std::index_sequence<I...> /*indices*/) {
+    return (decay_layer_traits<typename DBN::template layer_type<I>>::is_dense_rbm_layer() && ...);
+}
 
 /*!
  * \brief A Deep Belief Network implementation
@@ -101,9 +138,9 @@ struct dbn final {
     using output_policy_t = typename desc::output_policy_t;                                          ///< The output policy
 
     static constexpr size_t input_layer_n   = 0;                                                   ///< The index of the input layer
-    static constexpr size_t output_layer_n  = find_output_layer<layers_t::size - 1, this_type>::L; ///< The index of the output layer
-    static constexpr size_t rbm_layer_n     = find_rbm_layer<0, this_type>::L;                     ///< The index of the first RBM layer
-    static constexpr bool pretrain_possible = rbm_layer_n < layers_t::size;                        ///< Indicates if pretraining is possible
+    static constexpr size_t output_layer_n  = find_output_layer<this_type>(std::make_index_sequence<layers_t::size>()); ///< The index of the output layer
+    static constexpr size_t rbm_layer_n     = find_rbm_layer<this_type>(std::make_index_sequence<layers_t::size>());    ///< The index of the first RBM layer
+    static constexpr bool pretrain_possible = rbm_layer_n < layers_t::size;                                             ///< Indicates if pretraining is possible
 
     using input_layer_t = layer_type<input_layer_n>;           ///< The type of the input layer
     using input_one_t   = typename input_layer_t::input_one_t; ///< The type of one input
@@ -125,11 +162,11 @@ private:
 public:
     using full_output_t = etl::dyn_vector<weight>; ///< The type of output for concatenated activation probabilities
 
-    using for_each_impl_t      = dbn_detail::for_each_impl<this_type, layers_t::size, std::make_index_sequence<layers_t::size>>;
-    using for_each_pair_impl_t = dbn_detail::for_each_impl<this_type, layers_t::size, std::make_index_sequence<layers_t::size - 1>>;
+    using for_each_impl_t      = dbn_detail::for_each_impl<this_type, std::make_index_sequence<layers_t::size>>;
+    using for_each_pair_impl_t = dbn_detail::for_each_impl<this_type, std::make_index_sequence<layers_t::size - 1>>;
 
-    using const_for_each_impl_t      = dbn_detail::for_each_impl<const this_type, layers_t::size, std::make_index_sequence<layers_t::size>>;
-    using const_for_each_pair_impl_t = dbn_detail::for_each_impl<const this_type, layers_t::size, std::make_index_sequence<layers_t::size - 1>>;
+    using const_for_each_impl_t      = dbn_detail::for_each_impl<const this_type, std::make_index_sequence<layers_t::size>>;
+    using const_for_each_pair_impl_t = dbn_detail::for_each_impl<const this_type, std::make_index_sequence<layers_t::size - 1>>;
 
     static constexpr size_t layers         = layers_t::size;     ///< The number of layers
     static constexpr size_t batch_size     = desc::BatchSize;    ///< The batch size (for finetuning)
@@ -162,28 +199,40 @@ public:
     weight goal     = 0.0; ///< The learning goal
     size_t patience = 1;   ///< The patience for early stopping goals
 
+    size_t validation_subset     = 0; ///< The number of validation samples evaluated at each epoch (0 for the full validation set)
+    size_t full_validation_every = 0; ///< The period, in epochs, of the evaluation of the full validation set with a subset (0 for never)
+
+    std::string spill_directory = "/tmp"; ///< The directory of the spilled representations (spill_pretrain)
+
+    std::string checkpoint_file = "dll.checkpoint"; ///< The file of the checkpoints of the training (checkpoint_every)
+    bool resume_checkpoint      = false;            ///< Resume the training from the checkpoint file
+
+    communicator* distributed = nullptr; ///< The communicator of the distributed fine-tuning (none for a single node)
+    size_t hogwild_threads    = 0;       ///< The number of workers of the hogwild_trainer (0 for the thread budget)
+
 #ifdef DLL_SVM_SUPPORT
     //TODO Ideally these fields should be private
-    svm::model svm_model;    ///< The learned model
-    svm::problem problem;    ///< libsvm is stupid, therefore, you cannot destroy the problem if you want to use the model...
-    bool svm_loaded = false; ///< Indicates if a SVM model has been loaded (and therefore must be saved)
-#endif                       //DLL_SVM_SUPPORT
+    svm::model svm_model;        ///< The learned model
+    svm::problem problem;        ///< libsvm is stupid, therefore, you cannot destroy the problem if you want to use the model...
+    bool svm_loaded     = false; ///< Indicates if a SVM model has been loaded (and therefore must be saved)
+    bool problem_loaded = false; ///< Indicates if the SVM problem has been built
+#endif                           //DLL_SVM_SUPPORT
 
     mutable output_policy_t out; ///< The output policy instance
 
     using categorical_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::sparse_labels_cond<dbn_traits<this_type>::sparse_labels()>, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>, dll::numa_cond<dbn_traits<this_type>::numa()>>,
+        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::sparse_labels_cond<dbn_traits<this_type>::sparse_labels()>, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     using ae_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
+        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>, dll::numa_cond<dbn_traits<this_type>::numa()>>,
         outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     using reg_generator_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
+        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>, dll::numa_cond<dbn_traits<this_type>::numa()>>,
         outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
     template<size_t B>
@@ -207,6 +256,12 @@ public:
         inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
         outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
 
+    template<size_t B>
+    using rbm_clean_generator_fast_t = inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>;
+
+    template<size_t B>
+    using rbm_clean_ingenerator_fast_inner_t = inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>>;
+
     template<size_t B>
     using rbm_denoising_ingenerator_fast_inner_t = inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>>;
 
@@ -219,66 +274,178 @@ public:
 private:
     cpp::thread_pool<!dbn_traits<this_type>::is_serial()> pool;
 
-    template<size_t I, cpp_disable_iff(I == layers)>
-    void dyn_init(){
-        using fast_t = detail::layer_type_t<I, typename desc::base_layers>;
+    training_arena context_arena; ///< The arena for the training contexts
+
+    parameter_store<weight> flat_store; ///< The flat store of the parameters
+
+    /*!
+     * \brief Add the parameters of the given layer to the flat store
+     */
+    template <typename L>
+    void add_flat_parameters(L& layer) {
+        if constexpr (dbn_detail::has_sub_layers<L>::value) {
+            cpp::for_each(layer.layers, [this](auto& sub_layer) {
+                this->add_flat_parameters(sub_layer);
+            });
+        } else if constexpr (decay_layer_traits<L>::is_neural_layer()) {
+            cpp::for_each(layer.trainable_parameters(), [this](auto& variable) {
+                static_assert(std::is_same<etl::value_t<std::decay_t<decltype(variable)>>, weight>::value,
+                              "flat_parameters needs all the parameters of the same type");
+
+                flat_store.add(variable.memory_start(), etl::size(variable));
+            });
+
+            // The visible biases are not trained by SGD, but are part of the RBM
+            if constexpr (decay_layer_traits<L>::is_rbm_layer()) {
+                flat_store.add(layer.c.memory_start(), etl::size(layer.c));
+            }
+        }
+    }
+
+    tracked_memory weights_memory{memory_category::WEIGHTS}; ///< The tracked memory of the parameters
+
+    /*!
+     * \brief Returns the number of bytes of the parameters of the given layer
+     */
+    template <typename L>
+    static size_t parameters_bytes(L& layer) {
+        size_t bytes = 0;
+
+        if constexpr (dbn_detail::has_sub_layers<L>::value) {
+            cpp::for_each(layer.layers, [&bytes](auto& sub_layer) {
+                bytes += this_type::parameters_bytes(sub_layer);
+            });
+        } else if constexpr (decay_layer_traits<L>::is_neural_layer()) {
+            cpp::for_each(layer.trainable_parameters(), [&bytes](auto& variable) {
+                bytes += buffer_bytes(variable);
+            });
+
+            if constexpr (decay_layer_traits<L>::is_rbm_layer()) {
+                bytes += buffer_bytes(layer.c);
+            }
+        }
+
+        return bytes;
+    }
+
+    std::array<bool, layers> folded{}; ///< Indicates the normalization layers folded into their previous layer
+
+    /*!
+     * \brief Fold the normalization layers following L and the next layers
+     */
+    template <size_t L>
+    void fold_batch_normalization_impl(size_t& n) {
+        if constexpr (L + 1 < layers) {
+            if constexpr (dbn_detail::is_foldable_pair<layer_type<L>, layer_type<L + 1>>::value) {
+                if (!folded[L + 1]) {
+                    using bn_t = layer_type<L + 1>;
+
+                    auto& layer = layer_get<L>();
+                    auto& bn    = layer_get<L + 1>();
+
+                    auto scale = etl::force_temporary(bn.gamma / etl::sqrt(bn.var + bn_t::e));
+
+                    for (size_t k = 0; k < etl::size(scale); ++k) {
+                        if constexpr (decay_layer_traits<layer_type<L>>::is_dense_layer()) {
+                            for (size_t i = 0; i < etl::dim<0>(layer.w); ++i) {
+                                layer.w(i, k) *= scale(k);
+                            }
+                        } else {
+                            layer.w(k) *= scale(k);
+                        }
+
+                        layer.b(k) = (layer.b(k) - bn.mean(k)) * scale(k) + bn.beta(k);
+                    }
+
+                    bn.gamma = 1.0;
+                    bn.beta  = 0.0;
+                    bn.mean  = 0.0;
+                    bn.var   = 1.0 - bn_t::e;
 
-        decltype(auto) dyn_rbm = layer_get<I>();
+                    folded[L + 1] = true;
+                    ++n;
+                }
+            }
+
+            fold_batch_normalization_impl<L + 1>(n);
+        }
+    }
 
-        fast_t::dyn_init(dyn_rbm);
+    template<size_t I>
+    void dyn_init_layer(){
+        using fast_t = detail::layer_type_t<I, typename desc::base_layers>;
 
-        dyn_init<I+1>();
+        // The layers kept static in a hybrid network have nothing to init
+        if constexpr (!std::is_same<fast_t, layer_type<I>>::value) {
+            fast_t::dyn_init(layer_get<I>());
+        }
     }
 
-    template<size_t I, cpp_enable_iff(I == layers)>
-    void dyn_init(){}
+    template<size_t... I>
+    void dyn_init(std::index_sequence<I...> /*indices*/){
+        (dyn_init_layer<I>(), ...);
+    }
 
     template<size_t L = rbm_layer_n>
     auto get_rbm_generator_desc(){
-        static_assert(decay_layer_traits<layer_type<L>>::is_rbm_layer(), "Invalid use of get_rbm_generator_desc");
+        static_assert(dbn_detail::is_pretrained_layer<layer_type<L>>::value, "Invalid use of get_rbm_generator_desc");
 
-        return rbm_generator_fast_t<layer_type<L>::batch_size>{};
+        return rbm_generator_fast_t<dbn_detail::pretrain_batch_size<layer_type<L>>::value>{};
     }
 
     template<size_t L = rbm_layer_n>
     auto get_rbm_denoising_generator_desc(){
-        static_assert(decay_layer_traits<layer_type<L>>::is_rbm_layer(), "Invalid use of get_rbm_denoising_generator_desc");
+        static_assert(dbn_detail::is_pretrained_layer<layer_type<L>>::value, "Invalid use of get_rbm_denoising_generator_desc");
 
-        return rbm_denoising_generator_fast_t<layer_type<L>::batch_size>{};
+        return rbm_denoising_generator_fast_t<dbn_detail::pretrain_batch_size<layer_type<L>>::value>{};
     }
 
     template<size_t L = rbm_layer_n>
     auto get_rbm_generator_inner_desc(){
-        static_assert(decay_layer_traits<layer_type<L>>::is_rbm_layer(), "Invalid use of get_rbm_generator_inner_desc");
+        static_assert(dbn_detail::is_pretrained_layer<layer_type<L>>::value, "Invalid use of get_rbm_generator_inner_desc");
 
-        return rbm_generator_fast_inner_t<layer_type<L>::batch_size>{};
+        return rbm_generator_fast_inner_t<dbn_detail::pretrain_batch_size<layer_type<L>>::value>{};
     }
 
     template<size_t L = rbm_layer_n>
     auto get_rbm_ingenerator_inner_desc(){
-        static_assert(decay_layer_traits<layer_type<L>>::is_rbm_layer(), "Invalid use of get_rbm_generator_inner_desc");
+        static_assert(dbn_detail::is_pretrained_layer<layer_type<L>>::value, "Invalid use of get_rbm_generator_inner_desc");
+
+        return rbm_ingenerator_fast_inner_t<dbn_detail::pretrain_batch_size<layer_type<L>>::value>{};
+    }
+
+    template<size_t L = rbm_layer_n>
+    auto get_rbm_clean_generator_desc(){
+        static_assert(dbn_detail::is_pretrained_layer<layer_type<L>>::value, "Invalid use of get_rbm_clean_generator_desc");
+
+        return rbm_clean_generator_fast_t<dbn_detail::pretrain_batch_size<layer_type<L>>::value>{};
+    }
+
+    template<size_t L = rbm_layer_n>
+    auto get_rbm_clean_ingenerator_inner_desc(){
+        static_assert(dbn_detail::is_pretrained_layer<layer_type<L>>::value, "Invalid use of get_rbm_clean_ingenerator_inner_desc");
 
-        return rbm_ingenerator_fast_inner_t<layer_type<L>::batch_size>{};
+        return rbm_clean_ingenerator_fast_inner_t<dbn_detail::pretrain_batch_size<layer_type<L>>::value>{};
     }
 
-    template <size_t L, cpp_enable_iff((L < layers - 1) && decay_layer_traits<layer_type<L>>::is_rbm_layer())>
+    template <size_t L, cpp_enable_iff((L < layers - 1) && dbn_detail::is_pretrained_layer<layer_type<L>>::value)>
     void validate_pretraining_base() const {
-        static_assert(layer_type<L>::batch_size == layer_type<rbm_layer_n>::batch_size, "Incoherent batch sizes in network");
+        static_assert(dbn_detail::pretrain_batch_size<layer_type<L>>::value == dbn_detail::pretrain_batch_size<layer_type<rbm_layer_n>>::value, "Incoherent batch sizes in network");
 
         validate_pretraining_base<L + 1>();
     }
 
-    template <size_t L, cpp_enable_iff((L == layers - 1) && decay_layer_traits<layer_type<L>>::is_rbm_layer())>
+    template <size_t L, cpp_enable_iff((L == layers - 1) && dbn_detail::is_pretrained_layer<layer_type<L>>::value)>
     void validate_pretraining_base() const {
-        static_assert(layer_type<L>::batch_size == layer_type<rbm_layer_n>::batch_size, "Incoherent batch sizes in network");
+        static_assert(dbn_detail::pretrain_batch_size<layer_type<L>>::value == dbn_detail::pretrain_batch_size<layer_type<rbm_layer_n>>::value, "Incoherent batch sizes in network");
     }
 
-    template <size_t L, cpp_enable_iff((L < layers - 1) && !decay_layer_traits<layer_type<L>>::is_rbm_layer())>
+    template <size_t L, cpp_enable_iff((L < layers - 1) && !dbn_detail::is_pretrained_layer<layer_type<L>>::value)>
     void validate_pretraining_base() const {
         validate_pretraining_base<L + 1>();
     }
 
-    template <size_t L, cpp_enable_iff((L == layers - 1) && !decay_layer_traits<layer_type<L>>::is_rbm_layer())>
+    template <size_t L, cpp_enable_iff((L == layers - 1) && !dbn_detail::is_pretrained_layer<layer_type<L>>::value)>
     void validate_pretraining_base() const {
         // Nothing to do
     }
@@ -300,11 +467,16 @@ public:
      *
      * This is the only way to create a DBN.
      */
-    dbn() : pool(etl::threads) {
+    dbn() : pool(thread_budget()) {
         //Nothing else to init
 
         if constexpr (!std::is_same<typename desc::base_layers, typename desc::layers>::value) {
-            this->template dyn_init<0>();
+            this->dyn_init(std::make_index_sequence<layers>());
+        }
+
+        if (dbn_traits<this_type>::numa() || numa_env().pin) {
+            numa_pin_pool(pool, thread_budget());
+            numa_pin_kernels();
         }
 
         // Update defaults for each updater type
@@ -328,6 +500,8 @@ public:
         if(updater == updater_type::NADAM){
             learning_rate = 0.002;
         }
+
+        track_memory();
     }
 
     //No copying
@@ -338,6 +512,141 @@ public:
     dbn(dbn&& dbn) = delete;
     dbn& operator=(dbn&& dbn) = delete;
 
+    /*!
+     * \brief Returns the thread pool of the network
+     */
+    auto& get_pool() {
+        return pool;
+    }
+
+    /*!
+     * \brief Update the tracked memory of the parameters of the network.
+     *
+     * The dynamic layers may have been initialized since the construction
+     * of the network, this is done again before each training.
+     */
+    void track_memory() {
+        size_t bytes = 0;
+
+        for_each_layer([&bytes](auto& layer) {
+            bytes += this_type::parameters_bytes(layer);
+        });
+
+        weights_memory.track(bytes);
+    }
+
+    /*!
+     * \brief Returns the arena for the training contexts of the network
+     */
+    training_arena& get_arena() {
+        return context_arena;
+    }
+
+    /*!
+     * \brief Create an inference engine for this network.
+     *
+     * The engine preallocates the buffers for all the activations of batches
+     * of up to max_batch samples, so that forward propagation does not
+     * allocate memory.
+     *
+     * \param max_batch The maximum number of samples in a batch
+     * \param sample One sample of input, to compute the shapes of the outputs
+     */
+    inference_engine<this_type> make_inference_engine(size_t max_batch, const input_one_t& sample = input_one_t{}) const {
+        return {*this, max_batch, sample};
+    }
+
+    /*!
+     * \brief Fold the batch normalization layers into the weights and the
+     * biases of the layers preceding them.
+     *
+     * At inference, a batch normalization is an affine transform of its
+     * input, which can be merged in a preceding dense or convolutional layer
+     * without activation function. The folded normalization layers are reset
+     * to identity and are skipped by the inference engines.
+     *
+     * The network should only be used for inference after this.
+     *
+     * \return The number of folded layers
+     */
+    size_t fold_batch_normalization() {
+        size_t n = 0;
+        fold_batch_normalization_impl<0>(n);
+        return n;
+    }
+
+    /*!
+     * \brief Indicates if the layer I has been folded into its previous layer
+     */
+    bool is_folded(size_t I) const {
+        return folded[I];
+    }
+
+    /*!
+     * \brief Prune the weights of smallest magnitude of the dense layers and
+     * of the RBMs.
+     *
+     * The weights are pruned by groups of block consecutive weights of the
+     * same input, by the L1 norm of the group. The groups of the size of
+     * the blocks of the inference engine (see sparsify()) make the pruned
+     * layers faster, the unstructured pruning (block = 1) leaves more
+     * non-zero blocks for the same sparsity.
+     *
+     * \param sparsity The ratio of groups to prune
+     * \param scope Prune each layer to the sparsity or use a global
+     * threshold for all the layers
+     * \param block The number of weights of a group
+     *
+     * \return The number of zero weights of the pruned layers
+     */
+    size_t prune(double sparsity, prune_scope scope = prune_scope::LAYER, size_t block = 1) {
+        block = std::max(block, size_t(1));
+
+        std::vector<double> scores;
+
+        double threshold = -1.0;
+
+        if (scope == prune_scope::GLOBAL) {
+            for_each_layer([&](auto& layer) {
+                if constexpr (is_prunable_layer<std::decay_t<decltype(layer)>>::value) {
+                    prune_detail::group_scores(scores, layer.w, block);
+                }
+            });
+
+            threshold = prune_detail::sparsity_threshold(scores, sparsity);
+        }
+
+        size_t zeros = 0;
+
+        for_each_layer([&](auto& layer) {
+            if constexpr (is_prunable_layer<std::decay_t<decltype(layer)>>::value) {
+                if (scope == prune_scope::LAYER) {
+                    scores.clear();
+                    prune_detail::group_scores(scores, layer.w, block);
+
+                    threshold = prune_detail::sparsity_threshold(scores, sparsity);
+                }
+
+                zeros += prune_detail::zero_groups(layer.w, block, threshold);
+            }
+        });
+
+        return zeros;
+    }
+
+    /*!
+     * \brief Create a server coalescing single-sample requests into batches
+     * for this network.
+     *
+     * \param max_batch The maximum number of samples in a batch
+     * \param deadline The maximum time a request waits for a batch to form
+     * \param sample One sample of input, to compute the shapes of the outputs
+     * \param workers The number of workers of each replica (0 for the default)
+     */
+    auto make_inference_server(size_t max_batch, std::chrono::microseconds deadline, const input_one_t& sample = input_one_t{}, size_t workers = 0) const {
+        return std::make_unique<inference_server<this_type>>(*this, max_batch, deadline, sample, workers);
+    }
+
     /*!
      * \brief Prints a textual representation of the network.
      */
@@ -503,9 +812,13 @@ public:
      * twice will erase the first saved weights.
      */
     void backup_weights() {
-        for_each_layer([](auto& layer) {
-            layer.backup_weights();
-        });
+        if constexpr (dbn_traits<this_type>::has_flat_parameters()) {
+            flat_parameters().snapshot();
+        } else {
+            for_each_layer([](auto& layer) {
+                layer.backup_weights();
+            });
+        }
     }
 
     /*!
@@ -515,9 +828,69 @@ public:
      * Calling this function twice will restore the same weights.
      */
     void restore_weights() {
-        for_each_layer([](auto& layer) {
-            layer.restore_weights();
+        if constexpr (dbn_traits<this_type>::has_flat_parameters()) {
+            flat_parameters().restore();
+        } else {
+            for_each_layer([](auto& layer) {
+                layer.restore_weights();
+            });
+        }
+    }
+
+    /*!
+     * \brief Returns the flat store of all the parameters of the network.
+     *
+     * The tensors of the store are updated to the current parameters of the
+     * layers, the dynamic layers may have been initialized since the last
+     * call.
+     */
+    parameter_store<weight>& flat_parameters() {
+        flat_store.clear();
+
+        for_each_layer([this](auto& layer) {
+            this->add_flat_parameters(layer);
         });
+
+        return flat_store;
+    }
+
+    /*!
+     * \brief Store all the parameters of the network to the given file,
+     * with a single write of the flat store.
+     *
+     * Contrary to store(), only the parameters are stored, in a format with
+     * a header checked by load_parameters().
+     *
+     * \param file The path to the file
+     */
+    void store_parameters(const std::string& file) {
+        std::ofstream os(file, std::ofstream::binary);
+        flat_parameters().write(os);
+    }
+
+    /*!
+     * \brief Store all the parameters of the network to the given file, in
+     * a format that can be mapped in memory and used in place by the
+     * inference engine (see map() of the inference engine).
+     *
+     * \param file The path to the file
+     * \return true if the file was written, false otherwise
+     */
+    bool store_mapped(const std::string& file) {
+        return write_mapped_model(file, flat_parameters());
+    }
+
+    /*!
+     * \brief Load all the parameters of the network from a file written by
+     * store_parameters().
+     *
+     * \param file The path to the file
+     * \return true if the parameters were loaded, false if the file does not
+     * match the network
+     */
+    bool load_parameters(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        return flat_parameters().read(is);
     }
 
     /*!
@@ -658,6 +1031,8 @@ public:
 
         dll::auto_timer timer("net:pretrain");
 
+        track_memory();
+
         watcher_t watcher;
 
         watcher.pretraining_begin(*this, max_epochs);
@@ -689,7 +1064,7 @@ public:
         validate_pretraining();
 
         // Create generator around the data
-        auto generator = make_generator(
+        auto generator = make_borrowed_generator(
             training_data, training_data,
             training_data.size(), output_size(),
             get_rbm_generator_desc());
@@ -715,7 +1090,7 @@ public:
         validate_pretraining();
 
         // Create generator around the data
-        auto generator = make_generator(
+        auto generator = make_borrowed_generator(
             first, last,
             first, last,
             std::distance(first, last), output_size(),
@@ -740,6 +1115,8 @@ public:
 
         dll::auto_timer timer("net:pretrain:denoising");
 
+        track_memory();
+
         watcher_t watcher;
 
         watcher.pretraining_begin(*this, max_epochs);
@@ -765,6 +1142,9 @@ public:
     /*!
      * \brief Pretrain the network by training all layers in an unsupervised
      * manner, the network will learn to reconstruct noisy input.
+     *
+     * Only the clean samples and their representations are stored, the
+     * noise is drawn on the fly for each batch.
      */
     template <typename Clean, cpp_disable_iff(is_generator<Clean>)>
     void pretrain_denoising(const Clean& clean, size_t max_epochs) {
@@ -772,15 +1152,31 @@ public:
 
         validate_pretraining();
 
-        // Create generator around the data
-        auto generator = make_generator(
-            clean, clean,
-            clean.size(), output_size(),
-            get_rbm_denoising_generator_desc());
+        if constexpr (batch_mode()) {
+            // Create generator around the data
+            auto generator = make_generator(
+                clean, clean,
+                clean.size(), output_size(),
+                get_rbm_denoising_generator_desc());
 
-        generator->set_safe();
+            generator->set_safe();
 
-        pretrain_denoising(*generator, max_epochs);
+            pretrain_denoising(*generator, max_epochs);
+        } else {
+            // The labels are not used, only the clean samples are kept
+            std::vector<size_t> labels(clean.size(), 0);
+
+            auto clean_generator = make_generator(
+                clean, labels,
+                clean.size(), 1,
+                get_rbm_clean_generator_desc());
+
+            clean_generator->set_safe();
+
+            noisy_data_generator<std::decay_t<decltype(*clean_generator)>, desc::Noise> generator(*clean_generator);
+
+            pretrain_denoising(generator, max_epochs);
+        }
     }
 
     /*!
@@ -837,11 +1233,27 @@ public:
         cpp_assert(std::distance(first, last) == std::distance(lfirst, llast), "There must be the same number of values than labels");
         cpp_assert(dll::input_size(layer_get<layers - 1>()) == dll::output_size(layer_get<layers - 2>()) + labels, "There is no room for the labels units");
 
+        // Create generator around the data
+        auto generator = make_borrowed_generator(
+            first, last,
+            first, last,
+            std::distance(first, last), output_size(),
+            get_rbm_generator_desc());
+
+        generator->set_safe();
+
+        std::vector<size_t> label_values;
+        label_values.reserve(std::distance(lfirst, llast));
+
+        for (auto it = lfirst; it != llast; ++it) {
+            label_values.push_back(static_cast<size_t>(*it));
+        }
+
         watcher_t watcher;
 
         watcher.pretraining_begin(*this, max_epochs);
 
-        train_with_labels<0>(first, last, watcher, std::forward<LabelIterator>(lfirst), std::forward<LabelIterator>(llast), labels, max_epochs);
+        train_with_labels<0>(*generator, watcher, label_values, labels, max_epochs);
 
         watcher.pretraining_end(*this);
     }
@@ -871,6 +1283,36 @@ public:
             std::max_element(std::prev(output_a.end(), labels), output_a.end()));
     }
 
+    /*!
+     * \brief Generate samples from the network with several Gibbs chains,
+     * run in parallel on the last RBM.
+     *
+     * The initial states are propagated up to the last RBM, which runs the
+     * chains (see standard_rbm::sample_chains), and the samples are then
+     * propagated down to the input space, with the activation probabilities
+     * of each layer.
+     *
+     * \param samples The output [N x V]
+     * \param init The initial states of the C chains in the input space [C x V]
+     * \param burn_in The number of Gibbs steps before the first sample (at least one)
+     * \param thinning The number of Gibbs steps between two samples of a chain
+     */
+    template <typename Samples, typename Init>
+    void sample_chains(Samples&& samples, const Init& init, size_t burn_in, size_t thinning = 1) const {
+        static_assert(dbn_detail::all_dense_rbm_layers<this_type>(std::make_index_sequence<layers>()), "Only networks of dense RBMs can be sampled");
+
+        decltype(auto) top = layer_get<layers - 1>();
+
+        etl::dyn_matrix<weight, 2> top_init(etl::dim<0>(init), dll::input_size(top));
+        etl::dyn_matrix<weight, 2> top_samples(etl::dim<0>(samples), dll::input_size(top));
+
+        sample_up<0>(top_init, init);
+
+        top.sample_chains(top_samples, top_init, burn_in, thinning);
+
+        sample_down<layers - 1>(samples, top_samples);
+    }
+
     //Note: features_sub are alias functions for forward_one
 
     /*!
@@ -922,7 +1364,7 @@ public:
     // Forward one batch at a time
 
     // Forward functions are not perfect:
-    // TODO: Transform layers should be applied inline
+    // Only the in-place layers are applied inline, and only on temporaries
 
     /*
      * \brief Return the test representation for the given input batch.
@@ -936,9 +1378,34 @@ public:
      */
     template <size_t LS, size_t L, typename Input>
     decltype(auto) test_forward_batch_impl(Input&& sample) const {
-        if constexpr (L != LS) {
+        if constexpr (L != LS && fuse_next<L>::value) {
+            // The layer and the following layer are computed at once
+            auto next = layer_get<L>().test_forward_batch_fused(layer_get<L + 1>(), sample);
+
+            if constexpr (L + 1 == LS) {
+                return next;
+            } else {
+                return test_forward_batch_impl<LS, L + 2>(std::move(next));
+            }
+        } else if constexpr (L != LS && dbn_detail::is_inference_identity<layer_type<L>>::value) {
+            // The layer does nothing at inference
+            return test_forward_batch_impl<LS, L + 1>(std::forward<Input>(sample));
+        } else if constexpr (L != LS && dbn_detail::is_view_layer<layer_type<L>>::value && etl::decay_traits<Input>::dimensions() == layer_type<L>::D + 1) {
+            // The sample has already the shape of the output of the layer
+            return test_forward_batch_impl<LS, L + 1>(std::forward<Input>(sample));
+        } else if constexpr (dbn_detail::is_inplace_layer<layer_type<L>>::value && !std::is_reference<Input>::value) {
+            // The sample is a temporary owned by the network, the layer
+            // overwrites it instead of allocating a new output
+            layer_get<L>().test_forward_batch(sample, sample);
+
+            if constexpr (L == LS) {
+                return std::decay_t<Input>(std::move(sample));
+            } else {
+                return test_forward_batch_impl<LS, L + 1>(std::move(sample));
+            }
+        } else if constexpr (L != LS) {
             decltype(auto) next = layer_get<L>().test_forward_batch(sample);
-            return test_forward_batch_impl<LS, L + 1>(next);
+            return test_forward_batch_impl<LS, L + 1>(std::forward<decltype(next)>(next));
         } else {
             return layer_get<L>().test_forward_batch(sample);
         }
@@ -956,9 +1423,19 @@ public:
      */
     template <size_t LS, size_t L, typename Input>
     decltype(auto) train_forward_batch_impl(Input&& sample) {
-        if constexpr (L != LS) {
+        if constexpr (dbn_detail::is_inplace_layer<layer_type<L>>::value && !std::is_reference<Input>::value) {
+            // The sample is a temporary owned by the network, the layer
+            // overwrites it instead of allocating a new output
+            layer_get<L>().train_forward_batch(sample, sample);
+
+            if constexpr (L == LS) {
+                return std::decay_t<Input>(std::move(sample));
+            } else {
+                return train_forward_batch_impl<LS, L + 1>(std::move(sample));
+            }
+        } else if constexpr (L != LS) {
             decltype(auto) next = layer_get<L>().train_forward_batch(sample);
-            return train_forward_batch_impl<LS, L + 1>(next);
+            return train_forward_batch_impl<LS, L + 1>(std::forward<decltype(next)>(next));
         } else {
             return layer_get<L>().train_forward_batch(sample);
         }
@@ -1328,6 +1805,58 @@ public:
         }
     }
 
+    /*!
+     * \brief Export the features of all the given samples into one file.
+     *
+     * The features are computed by chunks with forward_many and streamed to
+     * the file with large buffered writes. In the DLL format, each sample is
+     * written on its own line.
+     *
+     * \param first Iterator to the first sample
+     * \param last Iterator to the past-the-end sample
+     * \param file The output file
+     * \param f The format of the exported features
+     * \param chunk The number of samples forwarded at once
+     * \param background Indicates if the writes are done by a background thread
+     *
+     * \return true if all the features were exported, false otherwise
+     */
+    template <typename Iterator>
+    bool export_features(Iterator first, Iterator last, const std::string& file, format f = format::BINARY, size_t chunk = 1024, bool background = true) const {
+        const size_t n = std::distance(first, last);
+
+        if (!n) {
+            return false;
+        }
+
+        features_writer<weight> writer(file, f, n, background);
+
+        for (size_t i = 0; i < n; i += chunk) {
+            auto next = first;
+            std::advance(next, std::min(chunk, n - i));
+
+            writer.append(forward_many(first, next));
+
+            first = next;
+        }
+
+        return writer.finish();
+    }
+
+    /*!
+     * \brief Export the features of all the given samples into one file.
+     * \param samples The container of samples
+     * \param file The output file
+     * \param f The format of the exported features
+     * \param chunk The number of samples forwarded at once
+     * \param background Indicates if the writes are done by a background thread
+     * \return true if all the features were exported, false otherwise
+     */
+    template <typename Samples>
+    bool export_features(const Samples& samples, const std::string& file, format f = format::BINARY, size_t chunk = 1024, bool background = true) const {
+        return export_features(std::begin(samples), std::end(samples), file, f, chunk, background);
+    }
+
     template <typename Output>
     size_t predict_label(const Output& result) const {
         return std::distance(result.begin(), std::max_element(result.begin(), result.end()));
@@ -1369,36 +1898,121 @@ public:
     }
 
     /*!
-     * \brief Fine tune the network for classifcation with a generator.
+     * \brief Fine tune the network continuously on a stream of samples,
+     * until the stream is closed.
      *
-     * \param train_generator A generator for training data and labels
-     * \param val_generator A generator for validation data and labels
-     * \param max_epochs The maximum number of epochs to train the network for.
+     * \param generator An online generator fed with the samples and labels
      *
-     * \return The final classification error
+     * \return The classification error of the last period of the stream
      */
-    template <typename Generator, typename ValGenerator>
-    weight fine_tune_val(Generator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
-        dll::auto_timer timer("net:train:ft");
+    template <typename Generator>
+    weight fine_tune_online(Generator& generator) {
+        dll::auto_timer timer("net:train:ft:online");
 
-        validate_generator(train_generator);
-        validate_generator(val_generator);
+        validate_generator(generator);
 
         dll::dbn_trainer<this_type> trainer;
-        return trainer.train(*this, train_generator, val_generator, max_epochs);
+        return trainer.train_online(*this, generator);
     }
 
     /*!
-     * \brief Fine tune the network for classifcation.
-     * \param training_data A container containing all the samples
-     * \param labels A container containing all the labels
-     * \param max_epochs The maximum number of epochs to train the network for.
-     * \return The final classification error
+     * \brief Change the spatial dimensions of the input of the network.
+     *
+     * The dynamic convolutional, pooling and batch normalization layers are
+     * resized, their parameters being kept. The transform layers follow the
+     * shape of their input. The other layers must keep the same input, for
+     * instance the dense layers after a global pooling layer.
+     *
+     * \param input_shape The new shape of one input [C, H, W]
      */
-    template <typename Input, typename Labels>
-    weight fine_tune(const Input& training_data, Labels& labels, size_t max_epochs) {
-        // Create generator around the containers
-        auto generator = dll::make_generator(
+    void resize_input(const std::vector<size_t>& input_shape) {
+        auto shape = input_shape;
+
+        for_each_layer([&shape](auto& layer) {
+            using layer_t = std::decay_t<decltype(layer)>;
+
+            if constexpr (dbn_detail::has_resize_input<layer_t>::value) {
+                shape = layer.resize_input(shape);
+            } else {
+                if constexpr (!decay_layer_traits<layer_t>::is_transform_layer()) {
+                    cpp_assert(std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<>()) == layer.input_size(), "The layer cannot be resized");
+                }
+
+                shape = layer.output_shape(shape);
+            }
+        });
+    }
+
+    /*!
+     * \brief Fine tune the network for classification, with a progressive
+     * resolution of the images.
+     *
+     * Each phase trains the network on the images of the generator resized
+     * to the resolution of the phase, the network being resized with them.
+     * At the end, the network is resized back to the full resolution of the
+     * generator. Only the spatial layers can change their resolution (see
+     * resize_input), the network is typically made of dynamic convolutional
+     * and pooling layers, followed by a global pooling head. Each phase is a
+     * separate training, the epochs being counted from zero.
+     *
+     * \param generator A generator for images and labels, at full resolution
+     * \param schedule The phases of the training
+     *
+     * \return The final classification error
+     */
+    template <typename Generator>
+    weight fine_tune_progressive(Generator& generator, const std::vector<resolution_phase>& schedule) {
+        dll::auto_timer timer("net:train:ft:progressive");
+
+        resized_data_generator<Generator> resized(generator);
+
+        const auto full = resized.shape();
+
+        weight error = 0;
+
+        for (auto& phase : schedule) {
+            resized.set_resolution(phase.height, phase.width);
+            resize_input(resized.shape());
+
+            error = fine_tune(resized, phase.epochs);
+        }
+
+        resize_input(full);
+
+        return error;
+    }
+
+    /*!
+     * \brief Fine tune the network for classifcation with a generator.
+     *
+     * \param train_generator A generator for training data and labels
+     * \param val_generator A generator for validation data and labels
+     * \param max_epochs The maximum number of epochs to train the network for.
+     *
+     * \return The final classification error
+     */
+    template <typename Generator, typename ValGenerator>
+    weight fine_tune_val(Generator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
+        dll::auto_timer timer("net:train:ft");
+
+        validate_generator(train_generator);
+        validate_generator(val_generator);
+
+        dll::dbn_trainer<this_type> trainer;
+        return trainer.train(*this, train_generator, val_generator, max_epochs);
+    }
+
+    /*!
+     * \brief Fine tune the network for classifcation.
+     * \param training_data A container containing all the samples
+     * \param labels A container containing all the labels
+     * \param max_epochs The maximum number of epochs to train the network for.
+     * \return The final classification error
+     */
+    template <typename Input, typename Labels>
+    weight fine_tune(const Input& training_data, Labels& labels, size_t max_epochs) {
+        // Create generator around the containers
+        auto generator = dll::make_borrowed_generator(
             training_data, labels,
             training_data.size(), output_size(), categorical_generator_t{});
 
@@ -1419,7 +2033,7 @@ public:
     template <typename Iterator, typename LIterator>
     weight fine_tune(Iterator&& first, Iterator&& last, LIterator&& lfirst, LIterator&& llast, size_t max_epochs) {
         // Create generator around the iterators
-        auto generator = dll::make_generator(
+        auto generator = dll::make_borrowed_generator(
             std::forward<Iterator>(first), std::forward<Iterator>(last),
             std::forward<LIterator>(lfirst), std::forward<LIterator>(llast),
             std::distance(lfirst, llast), output_size(), categorical_generator_t{});
@@ -1458,7 +2072,7 @@ public:
     template <typename Samples, cpp_disable_iff(is_generator<Samples>)>
     weight fine_tune_ae(const Samples& training_data, size_t max_epochs) {
         // Create generator around the containers
-        auto generator = dll::make_generator(
+        auto generator = dll::make_borrowed_generator(
             training_data, training_data,
             training_data.size(), output_size(), ae_generator_t{});
 
@@ -1477,7 +2091,7 @@ public:
     template <typename Iterator>
     weight fine_tune_ae(Iterator&& first, Iterator&& last, size_t max_epochs) {
         // Create generator around the iterators
-        auto generator = make_generator(
+        auto generator = make_borrowed_generator(
             std::forward<Iterator>(first), std::forward<Iterator>(last),
             std::forward<Iterator>(first), std::forward<Iterator>(last),
             std::distance(first, last), output_size(), ae_generator_t{});
@@ -1517,7 +2131,7 @@ public:
         // Create generator around the containers
         cpp_assert(inputs.size() == outputs.size(), "The number of inputs does not match the number of outputs for training.");
 
-        auto generator = dll::make_generator(
+        auto generator = dll::make_borrowed_generator(
             inputs, outputs,
             inputs.size(), output_size(), reg_generator_t{});
 
@@ -1540,7 +2154,7 @@ public:
         // Create generator around the iterators
         cpp_assert(std::distance(in_first, in_last) == std::distance(out_first, out_last), "The number of inputs does not match the number of outputs for training.");
 
-        auto generator = make_generator(
+        auto generator = make_borrowed_generator(
             std::forward<InIterator>(in_first), std::forward<InIterator>(in_last),
             std::forward<OutIterator>(out_first), std::forward<OutIterator>(out_last),
             std::distance(in_first, in_last), output_size(), reg_generator_t{});
@@ -1550,6 +2164,34 @@ public:
         return fine_tune_reg(*generator, max_epochs);
     }
 
+    // Fine tune by knowledge distillation
+
+    /*!
+     * \brief Fine tune the network (the student) on the soft targets of a
+     * trained teacher network.
+     *
+     * The targets are computed once with the inference engine of the
+     * teacher (see distillation_targets) and the network is trained on
+     * them as for regression, with its own loss (cross-entropy by default).
+     *
+     * \param teacher The trained teacher network
+     * \param samples A container containing all the samples
+     * \param labels A container containing the hard labels of the samples
+     * \param max_epochs The maximum number of epochs to train the network for.
+     * \param options The parameters of the distillation
+     * \return The final average loss
+     */
+    template <typename Teacher, typename Samples, typename Labels>
+    weight fine_tune_distill(const Teacher& teacher, const Samples& samples, const Labels& labels, size_t max_epochs, const distillation_options& options = {}) {
+        dll::auto_timer timer("net:train:ft:distill");
+
+        auto targets = distillation_targets(teacher, samples, labels, options);
+
+        cpp_assert(targets.empty() || etl::size(targets.front()) == output_size(), "The outputs of the teacher do not match the outputs of the network");
+
+        return fine_tune_reg(samples, targets, max_epochs);
+    }
+
     template <size_t I, typename Input>
     auto prepare_output() const {
         using layer_input_t = typename types_helper<I, Input>::input_t;
@@ -1582,16 +2224,7 @@ public:
 
         auto metrics = evaluate_metrics(generator);
 
-        char buffer[512];
-
-        snprintf(buffer, 512, "\nEvaluation Results\n");
-        out << buffer;
-        snprintf(buffer, 512, "   error: %.5f \n", std::get<0>(metrics));
-        out << buffer;
-        snprintf(buffer, 512, "    loss: %.5f \n", std::get<1>(metrics));
-        out << buffer;
-        snprintf(buffer, 512, "evaluation took %dms \n", int(watch.elapsed()));
-        out << buffer;
+        print_evaluation(metrics, watch.elapsed());
     }
 
     /*!
@@ -1639,9 +2272,13 @@ public:
      */
     template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
     void evaluate_ae(Generator& generator){
+        cpp::stop_watch<std::chrono::milliseconds> watch;
+
         validate_generator(generator);
 
-        evaluate(generator);
+        auto metrics = evaluate_metrics_ae(generator);
+
+        print_evaluation(metrics, watch.elapsed());
     }
 
     /*!
@@ -1654,11 +2291,11 @@ public:
      */
     template <typename Samples, cpp_enable_iff(!is_generator<Samples>)>
     void evaluate_ae(const Samples&  samples){
-        auto generator = make_generator(samples, samples, samples.size(), output_size(), ae_generator_t{});
+        auto generator = make_borrowed_generator(samples, samples, samples.size(), output_size(), ae_generator_t{});
 
         generator->set_safe();
 
-        return evaluate(*generator);
+        return evaluate_ae(*generator);
     }
 
     /*!
@@ -1673,11 +2310,11 @@ public:
      */
     template <typename InputIterator>
     void evaluate_ae(InputIterator&& iit, InputIterator&& iend){
-        auto generator = make_generator(iit, iend, iit, iend, std::distance(iit, iend), output_size(), ae_generator_t{});
+        auto generator = make_borrowed_generator(iit, iend, iit, iend, std::distance(iit, iend), output_size(), ae_generator_t{});
 
         generator->set_safe();
 
-        evaluate(*generator);
+        evaluate_ae(*generator);
     }
 
     /*!
@@ -1797,7 +2434,7 @@ public:
     double evaluate_error_ae(Generator& generator){
         validate_generator(generator);
 
-        auto metrics = evaluate_metrics(generator);
+        auto metrics = evaluate_metrics_ae(generator);
 
         return std::get<0>(metrics);
     }
@@ -1813,11 +2450,11 @@ public:
      */
     template <typename Samples, cpp_enable_iff(!is_generator<Samples>)>
     double evaluate_error_ae(const Samples&  samples){
-        auto generator = make_generator(samples, samples, samples.size(), output_size(), ae_generator_t{});
+        auto generator = make_borrowed_generator(samples, samples, samples.size(), output_size(), ae_generator_t{});
 
         generator->set_safe();
 
-        return evaluate_error(*generator);
+        return evaluate_error_ae(*generator);
     }
 
     /*!
@@ -1833,11 +2470,11 @@ public:
      */
     template <typename InputIterator>
     double evaluate_error_ae(InputIterator&& iit, InputIterator&& iend){
-        auto generator = make_generator(iit, iend, iit, iend, std::distance(iit, iend), output_size(), ae_generator_t{});
+        auto generator = make_borrowed_generator(iit, iend, iit, iend, std::distance(iit, iend), output_size(), ae_generator_t{});
 
         generator->set_safe();
 
-        return evaluate_error(*generator);
+        return evaluate_error_ae(*generator);
     }
 
     /*!
@@ -1897,53 +2534,24 @@ public:
 
     using metrics_t = std::tuple<double, double>; ///< The metrics returned by evaluate_metrics
 
+    /*!
+     * \brief Compute the error and the loss of the n first samples of the
+     * output, in a single traversal.
+     *
+     * \param n The number of samples
+     * \param s The normalization factor of the metrics
+     * \param output The output of the network
+     * \param labels The expected labels
+     *
+     * \return A tuple containing the error and the loss
+     */
     template <typename Output, typename Labels>
-    std::tuple<double, double> compute_loss(size_t n, bool full_batch, double s, Output&& output, Labels&& labels) {
-        double batch_loss;
-        double batch_error;
-
-        if constexpr (loss == loss_function::CATEGORICAL_CROSS_ENTROPY) {
-            dll::auto_timer timer("net:compute_loss:CCE");
-
-            if (cpp_unlikely(!full_batch)) {
-                auto soutput = slice(output, 0, n);
-
-                batch_loss  = etl::ml::cce_loss(soutput, labels, -1.0 / s);
-                batch_error = etl::ml::cce_error(soutput, labels, 1.0 / s);
-            } else {
-                batch_loss  = etl::ml::cce_loss(output, labels, -1.0 / s);
-                batch_error = etl::ml::cce_error(output, labels, 1.0 / s);
-            }
-        } else if constexpr (loss == loss_function::BINARY_CROSS_ENTROPY) {
-            dll::auto_timer timer("net:compute_loss:BCE");
-
-            // Avoid Nan in log(out) or log(1-out)
-            auto out = etl::force_temporary(etl::clip(output, 0.001, 0.999));
-
-            if (cpp_unlikely(!full_batch)) {
-                auto sout = slice(out, 0, n);
-
-                batch_loss  = (-1.0 / (s * output_size())) * sum((labels >> log(sout)) + ((1.0 - labels) >> log(1.0 - sout)));
-                batch_error = (1.0 / (s * output_size())) * asum(labels - sout);
-            } else {
-                batch_loss  = (-1.0 / (s * output_size())) * sum((labels >> log(out)) + ((1.0 - labels) >> log(1.0 - out)));
-                batch_error = (1.0 / (s * output_size())) * asum(labels - output);
-            }
-        } else { // MEAN_SQUARED_ERROR
-            dll::auto_timer timer("net:compute_loss:MSE");
-
-            if (cpp_unlikely(!full_batch)) {
-                auto soutput = slice(output, 0, n);
+    std::tuple<double, double> compute_loss(size_t n, double s, const Output& output, const Labels& labels) {
+        dll::auto_timer timer("net:compute_loss");
 
-                batch_loss  = (1.0 / (2.0 * s)) * sum((soutput - labels) >> (soutput - labels));
-                batch_error = (1.0 / s) * asum(labels - soutput);
-            } else {
-                batch_loss  = (1.0 / (2.0 * s)) * sum((output - labels) >> (output - labels));
-                batch_error = (1.0 / s) * asum(labels - output);
-            }
-        }
+        auto [batch_error, batch_loss] = loss_metrics<loss, dbn_traits<this_type>::top_k_error()>(output, labels, n);
 
-        return std::make_tuple(batch_error, batch_loss);
+        return std::make_tuple(batch_error / s, batch_loss / s);
     }
 
     /*!
@@ -1958,18 +2566,13 @@ public:
      */
     template <typename Output, typename Labels>
     metrics_t evaluate_metrics_batch(Output&& output, Labels&& labels, size_t n, bool normalize){
-        const bool full_batch = n == etl::dim<0>(output);
-
         double s = 1.0;
 
         if(normalize){
             s = n;
         }
 
-        // TODO Detect if labels are categorical already or not
-        // And change the way this is done
-
-        return compute_loss(n, full_batch, s, output, labels);
+        return compute_loss(n, s, output, labels);
     }
 
     /*!
@@ -1984,6 +2587,13 @@ public:
     metrics_t evaluate_metrics(Generator& generator){
         validate_generator(generator);
 
+        if constexpr (!dbn_traits<this_type>::is_serial()) {
+            if (thread_budget() > 1 && generator.batches() > 1) {
+                confusion_matrix confusion;
+                return parallel_evaluate_metrics<false>(generator, confusion);
+            }
+        }
+
         auto forward_helper = [this](auto&& input_batch){
             return this->forward_batch(input_batch);
         };
@@ -1991,6 +2601,215 @@ public:
         return evaluate_metrics(generator, forward_helper);
     }
 
+    /*!
+     * \brief Evaluate the network on the given auto-encoder task and return
+     * the evaluation metrics of the reconstructions.
+     *
+     * When the labels of the generator are its data, the reconstructions
+     * are compared directly to the input batches, the labels are never
+     * copied.
+     *
+     * \param generator The data generator
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator>
+    metrics_t evaluate_metrics_ae(Generator& generator){
+        validate_generator(generator);
+
+        constexpr bool ae = dbn_detail::labels_are_data<Generator>::value;
+
+        if constexpr (!dbn_traits<this_type>::is_serial()) {
+            if (thread_budget() > 1 && generator.batches() > 1) {
+                confusion_matrix confusion;
+                return parallel_evaluate_metrics<false, ae>(generator, confusion);
+            }
+        }
+
+        auto forward_helper = [this](auto&& input_batch){
+            return this->forward_batch(input_batch);
+        };
+
+        return evaluate_metrics<ae>(generator, forward_helper);
+    }
+
+    /*!
+     * \brief Compute the confusion matrix of the network on the given
+     * classification task.
+     *
+     * \param generator The data generator
+     *
+     * \return The confusion matrix
+     */
+    template <typename Generator>
+    confusion_matrix evaluate_confusion(Generator& generator){
+        validate_generator(generator);
+
+        confusion_matrix confusion;
+        parallel_evaluate_metrics<true>(generator, confusion);
+        return confusion;
+    }
+
+private:
+    /*!
+     * \brief Print the metrics of an evaluation on the console
+     */
+    void print_evaluation(const metrics_t& metrics, size_t duration){
+        char buffer[512];
+
+        snprintf(buffer, 512, "\nEvaluation Results\n");
+        out << buffer;
+        if constexpr (dbn_traits<this_type>::top_k_error() > 1) {
+            snprintf(buffer, 512, "   top-%lu error: %.5f \n", dbn_traits<this_type>::top_k_error(), std::get<0>(metrics));
+        } else {
+            snprintf(buffer, 512, "   error: %.5f \n", std::get<0>(metrics));
+        }
+        out << buffer;
+        snprintf(buffer, 512, "    loss: %.5f \n", std::get<1>(metrics));
+        out << buffer;
+        snprintf(buffer, 512, "evaluation took %dms \n", int(duration));
+        out << buffer;
+    }
+
+    /*!
+     * \brief Copy a batch of a generator into the given buffer, only
+     * allocating it when the size of the batch changes
+     */
+    template <typename Buffer, typename Batch>
+    static void load_batch(Buffer& buffer, const Batch& batch){
+        if (etl::dim<0>(buffer) != etl::dim<0>(batch)) {
+            buffer = Buffer(batch);
+        } else {
+            buffer = batch;
+        }
+    }
+
+    /*!
+     * \brief Evaluate the network on the given generator, with the batches
+     * distributed on the thread pool of the network.
+     *
+     * The batches are taken in order from the generator, under a lock. Each
+     * worker forward propagates them with its own inference engine and
+     * keeps the metrics of each of its batches, and its own confusion
+     * matrix. The metrics of the batches are then reduced in the order of
+     * the batches, with the same tree as the serial evaluation, the result
+     * does not depend on the number of workers.
+     *
+     * \param generator The data generator
+     * \param confusion The confusion matrix to fill (only if Confusion is true)
+     *
+     * \tparam AE Compare the output with the input batches, the labels of the
+     * generator being its data
+     *
+     * \return The evaluation metrics
+     */
+    template <bool Confusion, bool AE = false, typename Generator>
+    metrics_t parallel_evaluate_metrics(Generator& generator, confusion_matrix& confusion){
+        dll::auto_timer timer("net:evaluate:parallel");
+
+        using data_batch_t  = std::decay_t<decltype(generator.data_batch())>;
+        using label_batch_t = std::decay_t<decltype(generator.label_batch())>;
+
+        using input_buffer_t = etl::dyn_matrix<etl::value_t<data_batch_t>, etl::decay_traits<data_batch_t>::dimensions()>;
+        using label_buffer_t = etl::dyn_matrix<etl::value_t<label_batch_t>, etl::decay_traits<label_batch_t>::dimensions()>;
+
+        generator.reset();
+        generator.set_test();
+
+        if (!generator.has_next_batch()) {
+            return std::make_tuple(0.0, 0.0);
+        }
+
+        // The shapes of a dynamic network are only known from a sample
+        input_one_t sample;
+
+        if constexpr (!etl::all_fast<input_one_t>) {
+            sample.inherit_if_null(generator.data_batch()(0));
+        }
+
+        const size_t workers = budget_workers(generator.batches());
+
+        // The metrics of each batch, with its index in the generation
+        using batch_metrics = std::pair<size_t, std::pair<double, double>>;
+
+        std::vector<std::vector<batch_metrics>> metrics(workers);
+        std::vector<confusion_matrix> confusions(workers);
+
+        std::mutex lock;
+
+        size_t taken = 0;
+
+        for (size_t t = 0; t < workers; ++t) {
+            pool.do_task([&, t]() {
+                // The batches are already computed in parallel, avoid oversubscription
+                worker_section section;
+
+                auto engine = this->make_inference_engine(Generator::batch_size, sample);
+
+                input_buffer_t inputs;
+                label_buffer_t labels;
+
+                while (true) {
+                    size_t b;
+
+                    {
+                        std::lock_guard<std::mutex> l(lock);
+
+                        if (!generator.has_next_batch()) {
+                            break;
+                        }
+
+                        load_batch(inputs, generator.data_batch());
+
+                        if constexpr (!AE) {
+                            load_batch(labels, generator.label_batch());
+                        }
+
+                        generator.next_batch();
+
+                        b = taken++;
+                    }
+
+                    const size_t n = etl::dim<0>(inputs);
+
+                    auto output = engine.forward(inputs);
+
+                    if constexpr (AE) {
+                        cpp_assert(etl::size(output) == etl::size(inputs), "The reconstructions must be of the size of the input");
+
+                        metrics[t].emplace_back(b, loss_metrics<loss, dbn_traits<this_type>::top_k_error()>(output, inputs, n));
+                    } else {
+                        metrics[t].emplace_back(b, loss_metrics<loss, dbn_traits<this_type>::top_k_error()>(output, labels, n));
+                    }
+
+                    if constexpr (Confusion) {
+                        confusions[t].add_batch(output, labels, n);
+                    }
+                }
+            });
+        }
+
+        pool.wait();
+
+        std::vector<std::pair<double, double>> batches(taken);
+
+        for (size_t t = 0; t < workers; ++t) {
+            for (auto& [b, batch] : metrics[t]) {
+                batches[b] = batch;
+            }
+
+            if constexpr (Confusion) {
+                confusion.merge(confusions[t]);
+            }
+        }
+
+        auto [total_error, total_loss] = tree_sum(batches);
+
+        return std::make_tuple(total_error / generator.size(), total_loss / generator.size());
+    }
+
+public:
+
     /*!
      * \brief Evaluate the network on the given classification task
      * and return the evaluation metrics.
@@ -1998,9 +2817,12 @@ public:
      * \param generator The data generator
      * \param helper The function to use to compute a batch of output
      *
+     * \tparam AE Compare the output with the input batches, the labels of the
+     * generator being its data
+     *
      * \return The evaluation metrics
      */
-    template <typename Generator, typename Helper>
+    template <bool AE = false, typename Generator, typename Helper>
     metrics_t evaluate_metrics(Generator& generator, Helper&& helper){
         validate_generator(generator);
 
@@ -2010,23 +2832,31 @@ public:
         // Set the generator in test mode
         generator.set_test();
 
-        double error = 0.0;
-        double loss  = 0.0;
+        // The metrics of the batches are reduced like in the parallel evaluation
+        std::vector<std::pair<double, double>> batches;
 
         while(generator.has_next_batch()){
             auto input_batch = generator.data_batch();
-            auto label_batch = generator.label_batch();
 
             decltype(auto) output = helper(input_batch);
 
-            auto [batch_error, batch_loss] = evaluate_metrics_batch(output, label_batch, etl::dim<0>(input_batch), false);
+            if constexpr (AE) {
+                auto [batch_error, batch_loss] = evaluate_metrics_batch(output, input_batch, etl::dim<0>(input_batch), false);
 
-            error += batch_error;
-            loss += batch_loss;
+                batches.emplace_back(batch_error, batch_loss);
+            } else {
+                auto label_batch = generator.label_batch();
+
+                auto [batch_error, batch_loss] = evaluate_metrics_batch(output, label_batch, etl::dim<0>(input_batch), false);
+
+                batches.emplace_back(batch_error, batch_loss);
+            }
 
             generator.next_batch();
         }
 
+        auto [error, loss] = tree_sum(batches);
+
         error /= generator.size();
         loss /= generator.size();
 
@@ -2052,40 +2882,142 @@ public:
         full_activation_probabilities<0, layers - 1>(input, result, i);
     }
 
-    template <typename Input>
-    auto full_activation_probabilities(const Input& input) const {
-        full_output_t result(full_output_size());
-        full_activation_probabilities(input, result);
-        return result;
-    }
+    /*!
+     * \brief Write the outputs of the layer I (and the following) for a
+     * batch into their columns of the full features, from the given column
+     */
+    template <size_t I, typename Input, typename Result>
+    void full_activation_probabilities_batch(const Input& input, Result& result, size_t offset) const {
+        auto output = forward_batch<I, I>(input);
 
-    template <typename Functor>
-    void for_each_layer(Functor&& functor) {
-        for_each_impl_t(*this).for_each_layer(std::forward<Functor>(functor));
-    }
+        const size_t n      = etl::dim<0>(input);
+        const size_t size   = etl::size(output) / n;
+        const size_t stride = etl::dim<1>(result);
 
-    template <typename Functor>
-    void for_each_layer_i(Functor&& functor) {
-        for_each_impl_t(*this).for_each_layer_i(std::forward<Functor>(functor));
-    }
+        cpu_access(output, result);
 
-    template <typename Functor>
-    void for_each_layer_pair(Functor&& functor) {
-        for_each_pair_impl_t(*this).for_each_layer_pair(std::forward<Functor>(functor));
-    }
+        for (size_t s = 0; s < n; ++s) {
+            std::copy_n(output.memory_start() + s * size, size, result.memory_start() + s * stride + offset);
+        }
 
-    template <typename Functor>
-    void for_each_layer_pair_i(Functor&& functor) {
-        for_each_pair_impl_t(*this).for_each_layer_pair_i(std::forward<Functor>(functor));
-    }
+        cpu_modified(result);
 
-    template <typename Functor>
-    void for_each_layer_rpair(Functor&& functor) {
-        for_each_pair_impl_t(*this).for_each_layer_rpair(std::forward<Functor>(functor));
+        if constexpr (I + 1 < layers) {
+            full_activation_probabilities_batch<I + 1>(output, result, offset + size);
+        }
     }
 
-    template <typename Functor>
-    void for_each_layer_rpair_i(Functor&& functor) {
+    /*!
+     * \brief Gather n samples into a batch
+     * \param first Iterator to the first sample
+     * \param n The number of samples
+     */
+    template <typename Iterator>
+    static auto make_samples_batch(Iterator first, size_t n) {
+        using sample_t = std::decay_t<decltype(*first)>;
+
+        auto batch = make_samples_batch(n, *first, std::make_index_sequence<etl::decay_traits<sample_t>::dimensions()>());
+
+        for (size_t i = 0; i < n; ++i, ++first) {
+            batch(i) = *first;
+        }
+
+        return batch;
+    }
+
+    /*!
+     * \brief Create a batch of n samples of the shape of the given sample
+     */
+    template <typename Sample, size_t... I>
+    static auto make_samples_batch(size_t n, const Sample& sample, std::index_sequence<I...> /*seq*/) {
+        return etl::dyn_matrix<weight, sizeof...(I) + 1>(n, etl::dim(sample, I)...);
+    }
+
+    template <typename Input>
+    auto full_activation_probabilities(const Input& input) const {
+        full_output_t result(full_output_size());
+        full_activation_probabilities(input, result);
+        return result;
+    }
+
+    /*!
+     * \brief Compute the concatenated outputs of all the layers for a batch
+     * of inputs.
+     *
+     * Each layer writes the outputs of the batch directly into its own range
+     * of columns of the result.
+     *
+     * \param input The batch of inputs
+     * \param result The features [n x full_output_size()]
+     */
+    template <typename Input, typename Result>
+    void full_activation_probabilities_batch(const Input& input, Result&& result) const {
+        cpp_assert(etl::dim<1>(result) == full_output_size(), "Invalid size of the full features");
+
+        full_activation_probabilities_batch<0>(input, result, 0);
+    }
+
+    /*!
+     * \brief Compute the concatenated outputs of all the layers for the
+     * given samples.
+     *
+     * The samples are forward propagated by batches, in parallel over the
+     * batches.
+     *
+     * \param first Iterator to the first sample
+     * \param last Iterator to the end of the samples
+     * \return the features [N x full_output_size()]
+     */
+    template <typename Iterator>
+    etl::dyn_matrix<weight, 2> full_activation_probabilities_many(Iterator first, Iterator last) {
+        const size_t n = std::distance(first, last);
+
+        etl::dyn_matrix<weight, 2> result(n, full_output_size());
+
+        const size_t batches = (n + batch_size - 1) / batch_size;
+
+        cpp::maybe_parallel_foreach_n(pool, 0, batches, [this, &first, &result, n](size_t b) {
+            // The batches are already computed in parallel, avoid oversubscription
+            worker_section section;
+
+            const size_t begin = b * batch_size;
+            const size_t end   = std::min(begin + batch_size, n);
+
+            auto input = make_samples_batch(std::next(first, begin), end - begin);
+
+            this->full_activation_probabilities_batch(input, etl::slice(result, begin, end));
+        });
+
+        return result;
+    }
+
+    template <typename Functor>
+    void for_each_layer(Functor&& functor) {
+        for_each_impl_t(*this).for_each_layer(std::forward<Functor>(functor));
+    }
+
+    template <typename Functor>
+    void for_each_layer_i(Functor&& functor) {
+        for_each_impl_t(*this).for_each_layer_i(std::forward<Functor>(functor));
+    }
+
+    template <typename Functor>
+    void for_each_layer_pair(Functor&& functor) {
+        for_each_pair_impl_t(*this).for_each_layer_pair(std::forward<Functor>(functor));
+    }
+
+    template <typename Functor>
+    void for_each_layer_pair_i(Functor&& functor) {
+        for_each_pair_impl_t(*this).for_each_layer_pair_i(std::forward<Functor>(functor));
+    }
+
+    template <typename Functor>
+    void for_each_layer_rpair(Functor&& functor) {
+        for_each_pair_impl_t(*this).for_each_layer_rpair(std::forward<Functor>(functor));
+    }
+
+    template <typename Functor>
+    void for_each_layer_rpair_i(Functor&& functor) {
         for_each_pair_impl_t(*this).for_each_layer_rpair_i(std::forward<Functor>(functor));
     }
 
@@ -2132,25 +3064,16 @@ private:
     }
 
 public:
-    template <typename Samples, typename Labels>
+    template <typename Samples, typename Labels, cpp_disable_iff(is_generator<Samples>)>
     bool svm_train(const Samples& training_data, const Labels& labels, const svm_parameter& parameters = default_svm_parameters()) {
         cpp::stop_watch<std::chrono::seconds> watch;
 
         make_problem(training_data, labels, dbn_traits<this_type>::scale());
 
-        //Make libsvm quiet
-        svm::make_quiet();
-
-        //Make sure parameters are not messed up
-        if (!svm::check(problem, parameters)) {
+        if (!svm_train(parameters)) {
             return false;
         }
 
-        //Train the SVM
-        svm_model = svm::train(problem, parameters);
-
-        svm_loaded = true;
-
         out << "SVM training took " << watch.elapsed() << "s" << std::endl;
 
         return true;
@@ -2165,44 +3088,75 @@ public:
             std::forward<LIterator>(lfirst), std::forward<LIterator>(llast),
             dbn_traits<this_type>::scale());
 
-        //Make libsvm quiet
-        svm::make_quiet();
-
-        //Make sure parameters are not messed up
-        if (!svm::check(problem, parameters)) {
+        if (!svm_train(parameters)) {
             return false;
         }
 
-        //Train the SVM
-        svm_model = svm::train(problem, parameters);
+        out << "SVM training took " << watch.elapsed() << "s" << std::endl;
 
-        svm_loaded = true;
+        return true;
+    }
+
+    /*!
+     * \brief Train the SVM on the samples of the given generator.
+     *
+     * The features are computed batch by batch, only the libsvm problem
+     * holds them for the whole dataset. The labels of the generator are
+     * either the classes or categorical.
+     *
+     * \param generator The generator of the samples
+     * \param parameters The parameters of the SVM
+     * \return true if the SVM has been trained, false otherwise
+     */
+    template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
+    bool svm_train(Generator& generator, const svm_parameter& parameters = default_svm_parameters()) {
+        static_assert(!dbn_traits<this_type>::scale(), "svm_train() with a generator does not support svm_scale");
+
+        cpp::stop_watch<std::chrono::seconds> watch;
+
+        make_generator_problem(generator);
+
+        if (!svm_train(parameters)) {
+            return false;
+        }
 
         out << "SVM training took " << watch.elapsed() << "s" << std::endl;
 
         return true;
     }
 
-    template <typename Samples, typename Labels>
-    bool svm_grid_search(const Samples& training_data, const Labels& labels, size_t n_fold = 5, const svm::rbf_grid& g = svm::rbf_grid()) {
-        make_problem(training_data, labels, dbn_traits<this_type>::scale());
+    /*!
+     * \brief Train the SVM on the problem built by the last training or
+     * grid search, without extracting the features again.
+     * \param parameters The parameters of the SVM
+     * \return true if the SVM has been trained, false otherwise
+     */
+    bool svm_train(const svm_parameter& parameters = default_svm_parameters()) {
+        cpp_assert(problem_loaded, "svm_train() needs a problem built by a previous training or grid search");
 
         //Make libsvm quiet
         svm::make_quiet();
 
-        auto parameters = default_svm_parameters();
-
         //Make sure parameters are not messed up
         if (!svm::check(problem, parameters)) {
             return false;
         }
 
-        //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
+        //Train the SVM
+        svm_model = svm::train(problem, parameters);
+
+        svm_loaded = true;
 
         return true;
     }
 
+    template <typename Samples, typename Labels>
+    bool svm_grid_search(const Samples& training_data, const Labels& labels, size_t n_fold = 5, const svm::rbf_grid& g = svm::rbf_grid()) {
+        make_problem(training_data, labels, dbn_traits<this_type>::scale());
+
+        return svm_grid_search(n_fold, g);
+    }
+
     template <typename It, typename LIt>
     bool svm_grid_search(It&& first, It&& last, LIt&& lfirst, LIt&& llast, size_t n_fold = 5, const svm::rbf_grid& g = svm::rbf_grid()) {
         make_problem(
@@ -2210,6 +3164,23 @@ public:
             std::forward<LIt>(lfirst), std::forward<LIt>(llast),
             dbn_traits<this_type>::scale());
 
+        return svm_grid_search(n_fold, g);
+    }
+
+    /*!
+     * \brief Perform a grid search on the problem built by the last training
+     * or grid search, without extracting the features again.
+     *
+     * The points of the grid and the folds are evaluated in parallel on the
+     * thread pool of the network, all sharing the same problem.
+     *
+     * \param n_fold The number of folds of the cross validation
+     * \param g The grid to search
+     * \return true if the search has been performed, false otherwise
+     */
+    bool svm_grid_search(size_t n_fold = 5, const svm::rbf_grid& g = svm::rbf_grid()) {
+        cpp_assert(problem_loaded, "svm_grid_search() needs a problem built by a previous training or grid search");
+
         //Make libsvm quiet
         svm::make_quiet();
 
@@ -2221,7 +3192,7 @@ public:
         }
 
         //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
+        svm_parallel_grid_search(pool, problem.sub, parameters, n_fold, g, out);
 
         return true;
     }
@@ -2246,52 +3217,263 @@ private:
     template <size_t I, typename Enable = void>
     struct inline_next : std::false_type {};
 
+    //A layer can be fused with the following layer for inference (conv and
+    //pooling, batch normalization and activation)
+    template <size_t I, typename Enable = void>
+    struct fuse_next : std::false_type {};
+
+    template <size_t I>
+    struct fuse_next<I, std::enable_if_t<(I + 1 < layers)>> : dbn_detail::is_fusable_pair<layer_type<I>, layer_type<I + 1>> {};
+
+    //The pooling and transform layers are never trained, they are
+    //propagated at once with the trained layer before them
+    template <size_t I>
+    struct inline_next<I, std::enable_if_t<(I < layers)>> : cpp::bool_constant<layer_traits<layer_type<I>>::is_pooling_layer() || layer_traits<layer_type<I>>::is_transform_layer()> {};
+
+    /*!
+     * \brief Returns the index of the first layer after the layer I that is
+     * not propagated at once with it
+     */
     template <size_t I>
-    struct inline_next<I, std::enable_if_t<(I < layers)>> : cpp::bool_constant<layer_traits<layer_type<I>>::is_pooling_layer()> {};
+    static constexpr size_t inline_end() {
+        if constexpr (inline_next<I + 1>::value) {
+            return inline_end<I + 1>();
+        } else {
+            return I + 1;
+        }
+    }
+
+    /*!
+     * \brief Prepare one output of the layers [I, E) for the given input
+     */
+    template <size_t I, size_t E, typename Input>
+    auto chain_one_output(const Input& input) const {
+        auto one = prepare_one_ready_output(layer_get<I>(), input);
 
+        if constexpr (I + 1 < E) {
+            return chain_one_output<I + 1, E>(one);
+        } else {
+            return one;
+        }
+    }
+
+    /*!
+     * \brief Propagate a batch through the layers [I, E) for pretraining, only
+     * the output of the last layer is returned
+     */
+    template <size_t I, size_t E, typename Batch>
+    auto chain_forward_batch(const Batch& batch) {
+        auto output = layer_get<I>().train_forward_batch(batch);
+
+        if constexpr (I + 1 < E) {
+            return chain_forward_batch<I + 1, E>(output);
+        } else {
+            return output;
+        }
+    }
+
+    /*!
+     * \brief Notify the watcher of the layers [I, E), propagated without
+     * being trained
+     */
+    template <size_t I, size_t E>
+    void watch_inline_layers(watcher_t& watcher, size_t samples) {
+        if constexpr (I < E) {
+            watcher.pretrain_layer(*this, I, layer_get<I>(), samples);
+
+            watch_inline_layers<I + 1, E>(watcher, samples);
+        }
+    }
+
+    /*!
+     * \brief Pretrain the layers after the run of pooling and transform
+     * layers following the layer I.
+     *
+     * The whole run is propagated batch by batch, only the output of its
+     * last layer is stored for the next trained layer. The intermediate
+     * outputs, at full resolution, only exist for one batch at a time.
+     */
     template <size_t I, typename Generator>
     void inline_layer_pretrain(Generator& generator, watcher_t& watcher, size_t max_epochs) {
-        decltype(auto) layer = layer_get<I>();
-        decltype(auto) next_layer = layer_get<I + 1>();
+        static constexpr size_t E = inline_end<I>();
+
+        watch_inline_layers<I + 1, E>(watcher, generator.size());
+
+        if constexpr (E < layers && train_next<E>::value) {
+            if constexpr (dbn_traits<this_type>::is_spill_pretrain()) {
+                // Spill the representation of the run to a file
+                auto next_generator = spill_next_generator<I, E>(generator);
+
+                // Release the memory if possible
+                generator.clear();
+
+                this->template pretrain_layer<E>(*next_generator, watcher, max_epochs);
+            } else {
+                // Reset correctly the generator
+                generator.reset();
+                generator.set_test();
+
+                // Need one output in order to create the generator
+                auto one = chain_one_output<I, E>(generator.data_batch()(0));
+
+                // Prepare a generator to hold the data
+                auto next_generator = prepare_generator(
+                    one, one,
+                    generator.size(), output_size(),
+                    get_rbm_ingenerator_inner_desc());
+
+                next_generator->set_safe();
+
+                // Compute the input of the next layer
+                // using batch activation
+
+                size_t i = 0;
+                while (generator.has_next_batch()) {
+                    auto next_batch = chain_forward_batch<I, E>(generator.data_batch());
+
+                    next_generator->set_data_batch(i, next_batch);
+                    next_generator->set_label_batch(i, next_batch);
+
+                    i += etl::dim<0>(next_batch);
 
-        watcher.pretrain_layer(*this, I+1, next_layer, generator.size());
+                    generator.next_batch();
+                }
 
+                // Release the memory if possible
+                generator.clear();
+
+                this->template pretrain_layer<E>(*next_generator, watcher, max_epochs);
+            }
+        } else {
+            cpp_unused(max_epochs);
+        }
+    }
+
+    /*!
+     * \brief Compute the representation of the layers [I, E) of the whole
+     * generator into a binary dataset file and map it into a generator.
+     *
+     * The file is unlinked as soon as it is mapped, its space is released
+     * once the generator is destroyed.
+     */
+    template <size_t I, size_t E = I + 1, typename Generator>
+    auto spill_next_generator(Generator& generator) {
         // Reset correctly the generator
         generator.reset();
         generator.set_test();
 
-        // Need one output in order to create the generator
-        auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
-        auto two = prepare_one_ready_output(next_layer, one);
+        // Need one output in order to know the shape of the representation
+        auto one = chain_one_output<I, E>(generator.data_batch()(0));
+
+        using one_t   = decltype(one);
+        using value_t = etl::value_t<one_t>;
+
+        const std::string path = spill_directory + "/dll_pretrain_" + std::to_string(::getpid()) + "_" + std::to_string(I) + ".dlld";
+
+        binary_dataset_writer<value_t> writer(path, one, generator.size());
+
+        while (generator.has_next_batch()) {
+            writer.append(chain_forward_batch<I, E>(generator.data_batch()));
+
+            generator.next_batch();
+        }
+
+        writer.finish();
+
+        auto next_generator = make_mmap_generator<value_t, etl::dimensions<one_t>()>(
+            path, 1,
+            mmap_data_generator_desc<dll::batch_size<dbn_detail::pretrain_batch_size<layer_type<rbm_layer_n>>::value>, dll::autoencoder>{});
+
+        std::remove(path.c_str());
+
+        return next_generator;
+    }
+
+    /*!
+     * \brief Create views of the samples of the given storage, one per row
+     */
+    template <typename T, size_t D, size_t... S>
+    static std::vector<etl::custom_dyn_matrix<T, D - 1>> sample_views(etl::dyn_matrix<T, D>& storage, std::index_sequence<S...> /*seq*/) {
+        std::vector<etl::custom_dyn_matrix<T, D - 1>> views;
+
+        const size_t n      = etl::dim<0>(storage);
+        const size_t stride = n ? etl::size(storage) / n : 0;
+
+        views.reserve(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            views.emplace_back(storage.memory_start() + i * stride, etl::dim<S + 1>(storage)...);
+        }
+
+        return views;
+    }
+
+    /*!
+     * \brief Allocate the storage of n samples of the given batch
+     */
+    template <typename T, size_t D, typename Batch, size_t... S>
+    static etl::dyn_matrix<T, D> sample_storage(size_t n, const Batch& batch, std::index_sequence<S...> /*seq*/) {
+        return etl::dyn_matrix<T, D>(n, etl::dim<S + 1>(batch)...);
+    }
+
+    /*!
+     * \brief Pretrain the sibling RBMs of a merge layer concurrently.
+     *
+     * The input of the layer is computed once, in a single block of memory.
+     * Each RBM is then trained on its own thread, with its own trainer and
+     * CD buffers, from its own generator reading the shared input in place.
+     * The kernels of each RBM are run serially on its thread.
+     */
+    template <typename Layer, typename Generator>
+    void pretrain_siblings(Layer& layer, Generator& generator, size_t max_epochs) {
+        dll::auto_timer timer("net:pretrain:siblings");
+
+        using batch_t = std::decay_t<decltype(generator.data_batch())>;
+        using value_t = etl::value_t<batch_t>;
 
-        // Prepare a generator to hold the data
-        auto next_generator = prepare_generator(
-            two, two,
-            generator.size(), output_size(),
-            get_rbm_ingenerator_inner_desc());
+        constexpr size_t D = etl::dimensions<batch_t>();
 
-        next_generator->set_safe();
+        generator.reset();
+        generator.set_test();
 
-        // Compute the input of the next layer
-        // using batch activation
+        auto storage = sample_storage<value_t, D>(generator.size(), generator.data_batch(), std::make_index_sequence<D - 1>());
 
         size_t i = 0;
-        while(generator.has_next_batch()){
-            auto batch = layer.train_forward_batch(generator.data_batch());
-            auto next_batch = next_layer.train_forward_batch(batch);
+        while (generator.has_next_batch()) {
+            auto&& batch = generator.data_batch();
+
+            const size_t rows = etl::dim<0>(batch);
 
-            next_generator->set_data_batch(i, next_batch);
-            next_generator->set_label_batch(i, next_batch);
+            etl::slice(storage, i, i + rows) = batch;
 
-            i += etl::dim<0>(next_batch);
+            i += rows;
 
             generator.next_batch();
         }
 
-        // Release the memory if possible
-        generator.clear();
+        auto samples = sample_views(storage, std::make_index_sequence<D - 1>());
+
+        thread_reservation reservation(Layer::n_layers);
 
-        pretrain_layer<I + 2>(*next_generator, watcher, max_epochs);
+        std::vector<std::thread> threads;
+
+        cpp::for_each(layer.layers, [&](auto& rbm) {
+            threads.emplace_back([&samples, &rbm, max_epochs] {
+                using rbm_t = std::decay_t<decltype(rbm)>;
+
+                auto view = make_borrowed_generator(samples, samples, samples.size(), 1, rbm_ingenerator_fast_inner_t<rbm_t::batch_size>{});
+
+                worker_section section;
+
+                rbm.template train<!watcher_t::ignore_sub,               //Enable the RBM Watcher or not
+                                   dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
+                    (*view, max_epochs);
+            });
+        });
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
     }
 
     template <size_t I, typename Generator>
@@ -2308,15 +3490,39 @@ private:
                 layer.template train<!watcher_t::ignore_sub,               //Enable the RBM Watcher or not
                                      dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
                     (generator, max_epochs);
+
+                if constexpr (is_memory_watcher<watcher_t>::value) {
+                    watcher.pretraining_memory(*this, I);
+                }
+            } else if constexpr (dbn_detail::is_rbm_siblings<layer_t>::value) {
+                // Train the sibling RBMs at the same time
+                pretrain_siblings(layer, generator, max_epochs);
+
+                if constexpr (is_memory_watcher<watcher_t>::value) {
+                    watcher.pretraining_memory(*this, I);
+                }
             }
 
-            //When the next layer is a pooling layer, a lot of memory can be saved by directly computing
-            //the activations of two layers at once
+            //When the next layers are pooling or transform layers, a lot of memory can be saved by
+            //directly computing the activations of all of them at once
             if constexpr (inline_next<I + 1>::value) {
                 this->template inline_layer_pretrain<I>(generator, watcher, max_epochs);
             }
 
-            if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value) {
+            if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value && dbn_traits<this_type>::is_pipelined_pretrain()) {
+                // Stream the representation to the next layer
+                streamed_data_generator<layer_t, Generator> next_generator(layer, generator);
+
+                this->template pretrain_layer<I + 1>(next_generator, watcher, max_epochs);
+            } else if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value && dbn_traits<this_type>::is_spill_pretrain()) {
+                // Spill the representation of the next layer to a file
+                auto next_generator = spill_next_generator<I>(generator);
+
+                // Release the memory if possible
+                generator.clear();
+
+                this->template pretrain_layer<I + 1>(*next_generator, watcher, max_epochs);
+            } else if constexpr (train_next<I + 1>::value && !inline_next<I + 1>::value) {
                 // Reset correctly the generator
                 generator.reset();
                 generator.set_test();
@@ -2375,7 +3581,40 @@ private:
                     (generator, max_epochs);
             }
 
-            if constexpr (train_next<I + 1>::value) {
+            if constexpr (train_next<I + 1>::value && is_noisy_generator<Generator>::value) {
+                // Reset correctly the generator
+                generator.reset();
+                generator.set_test();
+
+                // Only the clean representation is computed and stored,
+                // the next layer gets new noise on top of it
+                auto one = prepare_one_ready_output(layer, generator.label_batch()(0));
+
+                auto clean_generator = prepare_generator(
+                    one, size_t(0),
+                    generator.size(), 1,
+                    get_rbm_clean_ingenerator_inner_desc());
+
+                clean_generator->set_safe();
+
+                size_t i = 0;
+                while (generator.has_next_batch()) {
+                    auto next_batch = layer.train_forward_batch(generator.label_batch());
+
+                    clean_generator->set_data_batch(i, next_batch);
+
+                    i += etl::dim<0>(next_batch);
+
+                    generator.next_batch();
+                }
+
+                // Release the memory if possible
+                generator.clear();
+
+                noisy_data_generator<std::decay_t<decltype(*clean_generator)>, Generator::noise> next_generator(*clean_generator);
+
+                pretrain_layer_denoising<I + 1>(next_generator, watcher, max_epochs);
+            } else if constexpr (train_next<I + 1>::value) {
                 // Reset correctly the generator
                 generator.reset();
                 generator.set_test();
@@ -2602,58 +3841,156 @@ private:
 
     /* Train with labels */
 
-    template <size_t I, typename Iterator, typename LabelIterator>
-    std::enable_if_t<(I < layers)> train_with_labels(Iterator first, Iterator last, watcher_t& watcher, LabelIterator lit, LabelIterator lend, size_t labels, size_t max_epochs) {
-        using layer_t = layer_type<I>;
+    /*
+     * The representation of each layer is computed in batch into the
+     * contiguous cache of the generator of the next layer. The labels are
+     * appended to the representation of the layer before the last one.
+     */
 
-        decltype(auto) layer = layer_get<I>();
+    template <size_t I, typename Generator>
+    void train_with_labels(Generator& generator, watcher_t& watcher, const std::vector<size_t>& label_values, size_t labels, size_t max_epochs) {
+        if constexpr (I < layers) {
+            using layer_t = layer_type<I>;
 
-        auto input_size = std::distance(first, last);
+            decltype(auto) layer = layer_get<I>();
 
-        watcher.pretrain_layer(*this, I, layer, input_size);
+            watcher.pretrain_layer(*this, I, layer, generator.size());
 
-        if constexpr (layer_traits<layer_t>::is_trained()) {
-            layer.template train<!watcher_t::ignore_sub,               //Enable the RBM Watcher or not
-                                    dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
-                (first, last, max_epochs);
-        }
+            if constexpr (layer_traits<layer_t>::is_trained()) {
+                layer.template train<!watcher_t::ignore_sub,               //Enable the RBM Watcher or not
+                                     dbn_detail::rbm_watcher_t<watcher_t>> //Replace the RBM watcher if not void
+                    (generator, max_epochs);
+            }
+
+            if constexpr (I < layers - 1) {
+                // Reset correctly the generator
+                generator.reset();
+                generator.set_test();
 
-        if (I < layers - 1) {
-            auto next_a = this_type::template forward_many<I, I>(first, last);
+                // Need one output in order to create the generator
+                auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
 
-            //If the next layer is the last layer
-            if (I == layers - 2) {
-                using input_t = std::decay_t<decltype(*first)>;
-                auto big_next_a = layer.template prepare_output<input_t>(input_size, true, labels);
+                if constexpr (I == layers - 2) {
+                    using value_t = etl::value_t<decltype(one)>;
 
-                //Cannot use std copy since the sub elements have different size
-                for (size_t i = 0; i < next_a.size(); ++i) {
-                    for (size_t j = 0; j < next_a[i].size(); ++j) {
-                        big_next_a[i][j] = next_a[i][j];
+                    const size_t features = etl::size(one);
+
+                    etl::dyn_matrix<value_t, 1> big_one(features + labels);
+
+                    auto next_generator = prepare_generator(
+                        big_one, big_one,
+                        generator.size(), output_size(),
+                        get_rbm_ingenerator_inner_desc());
+
+                    next_generator->set_safe();
+
+                    etl::dyn_matrix<value_t, 2> big_batch;
+
+                    size_t i = 0;
+                    while (generator.has_next_batch()) {
+                        auto next_batch = layer.train_forward_batch(generator.data_batch());
+
+                        const size_t B = etl::dim<0>(next_batch);
+
+                        if (etl::dim<0>(big_batch) != B) {
+                            big_batch.resize(B, features + labels);
+                        }
+
+                        // The labels are appended to the flat representation
+                        auto flat = etl::reshape(next_batch, B, features);
+
+                        for (size_t b = 0; b < B; ++b) {
+                            for (size_t j = 0; j < features; ++j) {
+                                big_batch(b, j) = flat(b, j);
+                            }
+
+                            for (size_t l = 0; l < labels; ++l) {
+                                big_batch(b, features + l) = label_values[i + b] == l ? 1.0 : 0.0;
+                            }
+                        }
+
+                        next_generator->set_data_batch(i, big_batch);
+                        next_generator->set_label_batch(i, big_batch);
+
+                        i += B;
+
+                        generator.next_batch();
                     }
-                }
 
-                size_t i = 0;
-                while (lit != lend) {
-                    decltype(auto) label = *lit;
+                    // Release the memory if possible
+                    generator.clear();
+
+                    train_with_labels<I + 1>(*next_generator, watcher, label_values, labels, max_epochs);
+                } else {
+                    // Prepare a generator to hold the data
+                    auto next_generator = prepare_generator(
+                        one, one,
+                        generator.size(), output_size(),
+                        get_rbm_ingenerator_inner_desc());
+
+                    next_generator->set_safe();
 
-                    for (size_t l = 0; l < labels; ++l) {
-                        big_next_a[i][dll::output_size(layer) + l] = label == l ? 1.0 : 0.0;
+                    size_t i = 0;
+                    while (generator.has_next_batch()) {
+                        auto next_batch = layer.train_forward_batch(generator.data_batch());
+
+                        next_generator->set_data_batch(i, next_batch);
+                        next_generator->set_label_batch(i, next_batch);
+
+                        i += etl::dim<0>(next_batch);
+
+                        generator.next_batch();
                     }
 
-                    ++i;
-                    ++lit;
-                }
+                    // Release the memory if possible
+                    generator.clear();
 
-                train_with_labels<I + 1>(big_next_a.begin(), big_next_a.end(), watcher, lit, lend, labels, max_epochs);
-            } else {
-                train_with_labels<I + 1>(next_a.begin(), next_a.end(), watcher, lit, lend, labels, max_epochs);
+                    train_with_labels<I + 1>(*next_generator, watcher, label_values, labels, max_epochs);
+                }
             }
         }
     }
 
-    template <size_t I, typename Iterator, typename LabelIterator>
-    std::enable_if_t<(I == layers)> train_with_labels(Iterator, Iterator, watcher_t&, LabelIterator, LabelIterator, size_t, size_t) {}
+    /* Sampling */
+
+    /*!
+     * \brief Propagate the given batch from the visible space of the Ith
+     * layer to the visible space of the last layer
+     */
+    template <size_t I, typename Output, typename Input>
+    void sample_up(Output& output, const Input& input) const {
+        if constexpr (I == layers - 1) {
+            output = input;
+        } else {
+            decltype(auto) layer = layer_get<I>();
+
+            etl::dyn_matrix<weight, 2> next(etl::dim<0>(input), dll::output_size(layer));
+
+            layer.batch_activate_hidden(next, input);
+
+            sample_up<I + 1>(output, next);
+        }
+    }
+
+    /*!
+     * \brief Propagate the given batch from the visible space of the Ith
+     * layer to the input space of the network
+     */
+    template <size_t I, typename Output, typename Input>
+    void sample_down(Output&& output, const Input& input) const {
+        if constexpr (I == 0) {
+            output = input;
+        } else {
+            decltype(auto) layer = layer_get<I - 1>();
+
+            etl::dyn_matrix<weight, 2> v_a(etl::dim<0>(input), dll::input_size(layer));
+            etl::dyn_matrix<weight, 2> v_s(etl::dim<0>(input), dll::input_size(layer));
+
+            layer.template batch_activate_visible<true, false>(input, input, v_a, v_s);
+
+            sample_down<I - 1>(output, v_a);
+        }
+    }
 
     /* Predict with labels */
 
@@ -2723,8 +4060,177 @@ private:
     template <typename Input>
     using svm_samples_t = std::vector<svm_sample_t<Input>>;
 
+    /*!
+     * \brief Compute the features of the given sample directly into a
+     * libsvm sample.
+     *
+     * Only the non-zero features are stored, libsvm considers the missing
+     * features as zero.
+     *
+     * \param nodes The libsvm sample to allocate and fill
+     * \param sample The sample to extract the features from
+     */
+    template <typename Input>
+    void make_svm_sample(svm_node*& nodes, const Input& sample) const {
+        auto features = get_final_activation_probabilities(sample);
+
+        make_svm_nodes(nodes, features.begin(), features.end());
+    }
+
+    /*!
+     * \brief Store the given features into a libsvm sample.
+     *
+     * Only the non-zero features are stored, libsvm considers the missing
+     * features as zero.
+     *
+     * \param nodes The libsvm sample to allocate and fill
+     * \param first Iterator to the first feature
+     * \param last Iterator to the end of the features
+     */
+    template <typename Iterator>
+    static void make_svm_nodes(svm_node*& nodes, Iterator first, Iterator last) {
+        size_t non_zero = 0;
+        for (auto it = first; it != last; ++it) {
+            non_zero += *it != weight(0);
+        }
+
+        nodes = new svm_node[non_zero + 1];
+
+        size_t i = 0;
+        size_t j = 0;
+
+        for (auto it = first; it != last; ++it) {
+            ++i;
+
+            if (*it != weight(0)) {
+                nodes[j].index = i;
+                nodes[j].value = *it;
+                ++j;
+            }
+        }
+
+        nodes[j].index = -1;
+    }
+
+    /*!
+     * \brief Create the svm problem directly from the samples, in parallel.
+     *
+     * The features of each sample are written directly into the libsvm
+     * problem, they are never all held in an intermediate container.
+     *
+     * \param first Iterator to the first sample
+     * \param n The number of samples
+     * \param lfirst Iterator to the first label
+     */
+    template <typename Iterator, typename LIterator>
+    void make_streamed_problem(Iterator first, size_t n, LIterator lfirst) {
+        const size_t n_features = dbn_traits<this_type>::concatenate() ? full_output_size() : output_size();
+
+        problem = svm::problem(n, n_features);
+
+        for (size_t i = 0; i < n; ++i, ++lfirst) {
+            problem.sub.y[i] = *lfirst;
+        }
+
+        if constexpr (dbn_traits<this_type>::concatenate()) {
+            // The features of all the layers are computed by batches
+            const size_t batches = (n + batch_size - 1) / batch_size;
+
+            cpp::maybe_parallel_foreach_n(pool, 0, batches, [this, &first, n, n_features](size_t b) {
+                // The batches are already computed in parallel, avoid oversubscription
+                worker_section section;
+
+                const size_t begin = b * batch_size;
+                const size_t end   = std::min(begin + batch_size, n);
+
+                auto input = make_samples_batch(std::next(first, begin), end - begin);
+
+                etl::dyn_matrix<weight, 2> features(end - begin, n_features);
+
+                this->full_activation_probabilities_batch(input, features);
+
+                for (size_t i = 0; i < end - begin; ++i) {
+                    const weight* row = features.memory_start() + i * n_features;
+
+                    make_svm_nodes(problem.sub.x[begin + i], row, row + n_features);
+                }
+            });
+        } else {
+            cpp::maybe_parallel_foreach_n(pool, 0, n, [this, &first](size_t i) {
+                // The samples are already computed in parallel, avoid oversubscription
+                worker_section section;
+
+                this->make_svm_sample(problem.sub.x[i], *std::next(first, i));
+            });
+        }
+
+        problem_loaded = true;
+    }
+
+    /*!
+     * \brief Create the svm problem from the batches of a generator.
+     *
+     * \param generator The generator of the samples
+     */
+    template <typename Generator>
+    void make_generator_problem(Generator& generator) {
+        using label_batch_t = std::decay_t<decltype(generator.label_batch())>;
+
+        static_assert(etl::dimensions<label_batch_t>() <= 2, "svm_train() only supports class and categorical labels");
+
+        const size_t n_features = dbn_traits<this_type>::concatenate() ? full_output_size() : output_size();
+
+        problem = svm::problem(generator.size(), n_features);
+
+        generator.set_test();
+        generator.reset();
+
+        size_t i = 0;
+
+        while (generator.has_next_batch()) {
+            decltype(auto) input  = generator.data_batch();
+            decltype(auto) labels = generator.label_batch();
+
+            const size_t n = etl::dim<0>(input);
+
+            etl::dyn_matrix<weight, 2> features(n, n_features);
+
+            if constexpr (dbn_traits<this_type>::concatenate()) {
+                full_activation_probabilities_batch(input, features);
+            } else {
+                features = etl::reshape(forward_batch(input), n, n_features);
+            }
+
+            cpu_access(features, labels);
+
+            for (size_t s = 0; s < n; ++s, ++i) {
+                if constexpr (etl::dimensions<label_batch_t>() == 2) {
+                    problem.sub.y[i] = etl::max_index(labels(s));
+                } else {
+                    problem.sub.y[i] = labels[s];
+                }
+
+                const weight* row = features.memory_start() + s * n_features;
+
+                make_svm_nodes(problem.sub.x[i], row, row + n_features);
+            }
+
+            generator.next_batch();
+        }
+
+        cpp_assert(i == generator.size(), "Invalid number of samples in the generator");
+
+        problem_loaded = true;
+    }
+
     template <typename Samples, typename Labels>
     void make_problem(const Samples& training_data, const Labels& labels, bool scale = false) {
+        // The features must be first all computed to be scaled
+        if (!scale) {
+            make_streamed_problem(std::begin(training_data), std::size(training_data), std::begin(labels));
+            return;
+        }
+
         svm_samples_t<safe_value_t<Samples>> svm_samples;
 
         //Get all the activation probabilities
@@ -2734,6 +4240,8 @@ private:
 
         //static_cast ensure using the correct overload
         problem = svm::make_problem(labels, static_cast<const svm_samples_t<safe_value_t<Samples>>&>(svm_samples), scale);
+
+        problem_loaded = true;
     }
 
     /*!
@@ -2741,6 +4249,16 @@ private:
      */
     template <typename Iterator, typename LIterator>
     void make_problem(Iterator first, Iterator last, LIterator&& lfirst, LIterator&& llast, bool scale = false) {
+        using category = typename std::iterator_traits<std::decay_t<Iterator>>::iterator_category;
+
+        // The features must be first all computed to be scaled
+        if constexpr (std::is_base_of<std::random_access_iterator_tag, category>::value) {
+            if (!scale) {
+                make_streamed_problem(first, std::distance(first, last), lfirst);
+                return;
+            }
+        }
+
         svm_samples_t<safe_value_t<Iterator>> svm_samples;
 
         //Get all the activation probabilities
@@ -2753,6 +4271,8 @@ private:
             std::forward<LIterator>(lfirst), std::forward<LIterator>(llast),
             svm_samples.begin(), svm_samples.end(),
             scale);
+
+        problem_loaded = true;
     }
 
 #endif //DLL_SVM_SUPPORT
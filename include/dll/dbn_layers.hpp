@@ -236,15 +236,26 @@ struct layer_type<I, cpp::type_list<Head, T...>> {
     using type = typename layer_type<I - 1, cpp::type_list<T...>>::type;
 };
 
+/*!
+ * \brief Deduce the type of the Ith leaf of a set of layers.
+ *
+ * Only used in unevaluated context, the deduction from the base classes
+ * is done at constant depth, instead of one instantiation per index.
+ */
+template <size_t I, typename T>
+T leaf_type(const layers_leaf<I, T>* leaf);
+
 /*!
  * \copydoc layer_type
  */
 template <size_t I, bool Labels, typename... Layers>
 struct layer_type<I, layers<Labels, Layers...>> {
+    static_assert(I < sizeof...(Layers), "index out of range");
+
     /*!
      * \brief The type of the layer
      */
-    using type = typename layer_type<I, cpp::type_list<Layers...>>::type;
+    using type = decltype(leaf_type<I>(std::declval<const typename layers<Labels, Layers...>::base_t*>()));
 };
 
 /*!
@@ -111,7 +111,166 @@ struct dbn_traits {
      * \brief Indicates if the DBN clip its gradients
      */
     static constexpr bool has_clip_gradients() noexcept {
-        return desc::parameters::template contains<clip_gradients>();
+        return desc::parameters::template contains<clip_gradients>() || has_global_clip_gradients();
+    }
+
+    /*!
+     * \brief Indicates if the DBN clip its gradients on the global norm of
+     * the gradients of all its layers
+     */
+    static constexpr bool has_global_clip_gradients() noexcept {
+        return desc::parameters::template contains<global_clip_gradients>();
+    }
+
+    /*!
+     * \brief Returns the number of shards used for data-parallel SGD (1 if disabled)
+     */
+    static constexpr size_t sgd_shards() noexcept {
+        return get_value_l_v<dll::parallel_sgd<1>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the number of layers of each checkpointed segment of SGD (0 if disabled)
+     */
+    static constexpr size_t sgd_checkpoint() noexcept {
+        return get_value_l_v<dll::sgd_checkpoint<0>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the number of mini-batches accumulated before each update of SGD (1 if disabled)
+     */
+    static constexpr size_t gradient_accumulation() noexcept {
+        return get_value_l_v<dll::gradient_accumulation<1>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the number of frozen layers at the front of the network during fine-tuning (0 if disabled)
+     */
+    static constexpr size_t frozen_layers() noexcept {
+        return get_value_l_v<dll::frozen_layers<0>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the percentage of the samples backpropagated by SGD (100 if disabled)
+     */
+    static constexpr size_t selective_backprop() noexcept {
+        return get_value_l_v<dll::selective_backprop<100>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Indicates if SGD overlaps the gradients of the layers with the backward pass
+     */
+    static constexpr bool sgd_overlap() noexcept {
+        return desc::parameters::template contains<overlap_gradients>();
+    }
+
+    /*!
+     * \brief Indicates if SGD pipelines the updates of the weights with the next forward pass
+     */
+    static constexpr bool sgd_pipeline() noexcept {
+        return desc::parameters::template contains<pipeline_updates>();
+    }
+
+    /*!
+     * \brief Returns the number of stages of pipeline-parallel SGD (1 if disabled)
+     */
+    static constexpr size_t pipeline_stages() noexcept {
+        return get_value_l_v<dll::pipeline_stages<1>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the number of micro-batches of each step of pipeline-parallel SGD
+     */
+    static constexpr size_t micro_batches() noexcept {
+        constexpr size_t micro = get_value_l_v<dll::micro_batches<0>, typename desc::parameters>;
+
+        return micro ? micro : pipeline_stages();
+    }
+
+    /*!
+     * \brief Returns the number of mini-batches staged for each step of SGD
+     * (data-parallel shards or pipelined micro-batches), 1 if none are
+     */
+    static constexpr size_t staged_batches() noexcept {
+        return pipeline_stages() > 1 ? micro_batches() : sgd_shards();
+    }
+
+    /*!
+     * \brief Indicates if the categorical labels are kept as class indices during training
+     */
+    static constexpr bool sparse_labels() noexcept {
+        return desc::parameters::template contains<dll::sparse_labels>();
+    }
+
+    /*!
+     * \brief Indicates if the training contexts are allocated from an arena
+     */
+    static constexpr bool uses_arena() noexcept {
+        return desc::parameters::template contains<arena>();
+    }
+
+    /*!
+     * \brief Indicates if the network keeps a flat store of its parameters
+     */
+    static constexpr bool has_flat_parameters() noexcept {
+        return desc::parameters::template contains<flat_parameters>();
+    }
+
+    /*!
+     * \brief Returns the number of mini-batches between two checkpoints of the training (0 if disabled)
+     */
+    static constexpr size_t checkpoint_every() noexcept {
+        return get_value_l_v<dll::checkpoint_every<0>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Indicates if the pretraining streams the representations of the layers
+     */
+    static constexpr bool is_pipelined_pretrain() noexcept {
+        return desc::parameters::template contains<pipelined_pretrain>();
+    }
+
+    /*!
+     * \brief Indicates if the pretraining spills the representations of the layers to files
+     */
+    static constexpr bool is_spill_pretrain() noexcept {
+        return desc::parameters::template contains<spill_pretrain>();
+    }
+
+    /*!
+     * \brief Indicates if the network uses the NUMA policy
+     */
+    static constexpr bool numa() noexcept {
+        return desc::parameters::template contains<dll::numa>();
+    }
+
+    /*!
+     * \brief Indicates if the validation set is evaluated in background
+     * during the next epoch
+     */
+    static constexpr bool async_validation() noexcept {
+        return desc::parameters::template contains<dll::async_validation>();
+    }
+
+    /*!
+     * \brief Returns the minimum number of epochs between two backups of the best weights
+     */
+    static constexpr size_t backup_every() noexcept {
+        return get_value_l_v<dll::backup_every<1>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Indicates if the inference engine computes the convolutions in the channels-last layout
+     */
+    static constexpr bool channels_last() noexcept {
+        return desc::parameters::template contains<dll::channels_last>();
+    }
+
+    /*!
+     * \brief Returns the number of classes considered by the error of a sample (1 for the top-1 error)
+     */
+    static constexpr size_t top_k_error() noexcept {
+        return get_value_l_v<dll::top_k_error<1>, typename desc::parameters>;
     }
 
     /*!
@@ -0,0 +1,263 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Inference of an ensemble of networks on shared input batches
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "dll/inference_engine.hpp"
+
+namespace dll {
+
+/*!
+ * \brief An inference plan for an ensemble of networks of the same type
+ * (trained with different seeds for instance), whose outputs are averaged.
+ *
+ * All the members are computed on the same input batch, which is given
+ * (and preprocessed) only once.
+ *
+ * When the first layer of the networks is a dense layer, the first layers
+ * of all the members are computed by a single GEMM with their weights
+ * concatenated, the input being read only once. The weights are copied at
+ * the creation of the engine. The other layers are computed by one
+ * inference engine per member.
+ *
+ * Otherwise, the batch is split into chunks small enough to stay in cache
+ * and each chunk goes through all the members before the next one.
+ *
+ * The engine keeps a reference to the networks, it must not outlive them.
+ */
+template <typename DBN>
+struct ensemble_engine {
+    using dbn_t    = DBN;                     ///< The network type
+    using weight   = typename dbn_t::weight;  ///< The data type
+    using engine_t = inference_engine<dbn_t>; ///< The engine of one member
+
+    static constexpr size_t layers      = dbn_t::layers;                           ///< The number of layers of the members
+    static constexpr bool fused         = engine_detail::is_one_dense<dbn_t, 0>(); ///< Indicates if the first layers are computed together
+    static constexpr size_t chunk_bytes = 1UL << 18;                               ///< The size of the chunks of input when the first layers are not fused
+
+private:
+    using first_layer_t = typename dbn_t::template layer_type<0>; ///< The type of the first layer
+
+    std::vector<const dbn_t*> members; ///< The networks of the ensemble
+    std::vector<engine_t> engines;     ///< The inference engine of each member
+    const size_t max_batch;            ///< The maximum number of samples in a batch
+
+    size_t output_size = 0; ///< The number of outputs of one sample
+
+    etl::dyn_matrix<weight, 2> first_w;   ///< The concatenated weights of the first layers [V x (M * H)]
+    etl::dyn_matrix<weight, 1> first_b;   ///< The concatenated biases of the first layers
+    etl::dyn_matrix<weight, 1> first_out; ///< The outputs of the first layers, for all the members
+    etl::dyn_matrix<weight, 1> hidden;    ///< The outputs of the first layer of one member, contiguous
+    etl::dyn_matrix<weight, 1> average;   ///< The averaged outputs
+
+public:
+    /*!
+     * \brief Create the inference plan of the given ensemble
+     * \param members The networks of the ensemble (at least one)
+     * \param max_batch The maximum number of samples in a batch
+     * \param sample One sample of input, to compute the shapes of the outputs
+     */
+    ensemble_engine(std::vector<const dbn_t*> members, size_t max_batch, const typename dbn_t::input_one_t& sample = typename dbn_t::input_one_t{})
+            : members(std::move(members)), max_batch(max_batch) {
+        cpp_assert(!this->members.empty(), "An ensemble needs at least one network");
+
+        engines.reserve(this->members.size());
+
+        for (auto* member : this->members) {
+            engines.emplace_back(member->make_inference_engine(max_batch, sample));
+        }
+
+        output_size = engines.front().output_size();
+        average     = etl::dyn_matrix<weight, 1>(max_batch * output_size);
+
+        if constexpr (fused) {
+            concatenate_first_layers();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of networks of the ensemble
+     */
+    size_t size() const {
+        return members.size();
+    }
+
+    /*!
+     * \brief Returns the maximum number of samples in a batch
+     */
+    size_t batch_capacity() const {
+        return max_batch;
+    }
+
+    /*!
+     * \brief Forward propagate a batch of input through all the networks
+     * and average their outputs.
+     *
+     * The returned batch [n x outputs] is a view inside the buffers of the
+     * engine, it is only valid until the next call.
+     *
+     * \param input The batch of input (at most batch_capacity() samples)
+     * \return a view of the averaged outputs of the batch
+     */
+    template <typename Input>
+    auto forward(const Input& input) {
+        const size_t n = etl::dim<0>(input);
+
+        cpp_assert(n <= max_batch, "Too many samples for the ensemble engine");
+
+        auto result = etl::custom_dyn_matrix<weight, 2>(average.memory_start(), n, output_size);
+
+        if constexpr (fused) {
+            forward_fused(result, input, n);
+        } else {
+            forward_chunked(result, input, n);
+        }
+
+        result *= weight(1.0) / weight(members.size());
+
+        return result;
+    }
+
+    /*!
+     * \brief Forward propagate a batch of input and store the label
+     * predicted by the ensemble for each sample.
+     *
+     * \param input The batch of input (at most batch_capacity() samples)
+     * \param labels The output labels, must have enough space for the batch
+     */
+    template <typename Input, typename Labels>
+    void predict(const Input& input, Labels&& labels) {
+        auto output = forward(input);
+
+        for (size_t i = 0; i < etl::dim<0>(output); ++i) {
+            labels[i] = etl::max_index(output(i));
+        }
+    }
+
+private:
+    /*!
+     * \brief Concatenate the weights and the biases of the first layers of
+     * all the members.
+     */
+    void concatenate_first_layers() {
+        constexpr size_t V = first_layer_t::num_visible;
+        constexpr size_t H = first_layer_t::num_hidden;
+
+        const size_t M = members.size();
+
+        first_w   = etl::dyn_matrix<weight, 2>(V, M * H);
+        first_b   = etl::dyn_matrix<weight, 1>(M * H, weight(0));
+        first_out = etl::dyn_matrix<weight, 1>(max_batch * M * H);
+        hidden    = etl::dyn_matrix<weight, 1>(max_batch * H);
+
+        for (size_t m = 0; m < M; ++m) {
+            auto& layer = members[m]->template layer_get<0>();
+
+            cpu_access(layer.w, layer.b);
+
+            for (size_t v = 0; v < V; ++v) {
+                for (size_t h = 0; h < H; ++h) {
+                    first_w(v, m * H + h) = layer.w(v, h);
+                }
+            }
+
+            if constexpr (dbn_detail::has_biases<first_layer_t>::value) {
+                for (size_t h = 0; h < H; ++h) {
+                    first_b[m * H + h] = layer.b[h];
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the first layers of all the members with one GEMM and
+     * the following layers with the engine of each member
+     */
+    template <typename Result, typename Input>
+    void forward_fused(Result& result, const Input& input, size_t n) {
+        constexpr size_t V = first_layer_t::num_visible;
+        constexpr size_t H = first_layer_t::num_hidden;
+
+        const size_t M = members.size();
+
+        auto all = etl::custom_dyn_matrix<weight, 2>(first_out.memory_start(), n, M * H);
+
+        all = etl::reshape(input, n, V) * first_w;
+
+        if constexpr (dbn_detail::has_biases<first_layer_t>::value) {
+            all = bias_add_2d(all, first_b);
+        }
+
+        cpu_access(all);
+
+        for (size_t m = 0; m < M; ++m) {
+            // The outputs of the member are gathered to be contiguous
+            auto member_hidden = etl::custom_dyn_matrix<weight, 2>(hidden.memory_start(), n, H);
+
+            for (size_t s = 0; s < n; ++s) {
+                std::copy_n(first_out.memory_start() + (s * M + m) * H, H, member_hidden.memory_start() + s * H);
+            }
+
+            cpu_modified(member_hidden);
+
+            if constexpr (first_layer_t::activation_function != function::IDENTITY) {
+                member_hidden = f_activate<first_layer_t::activation_function>(member_hidden);
+            }
+
+            if constexpr (layers > 1) {
+                accumulate(result, engines[m].template forward_from<1>(member_hidden), m, n);
+            } else {
+                accumulate(result, member_hidden, m, n);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute all the members by chunks of the batch, each chunk of
+     * input going through all the members while in cache
+     */
+    template <typename Result, typename Input>
+    void forward_chunked(Result& result, const Input& input, size_t n) {
+        const size_t sample_bytes = (etl::size(input) / std::max(n, size_t(1))) * sizeof(weight);
+        const size_t chunk        = std::max(size_t(1), std::min(n, chunk_bytes / std::max(sample_bytes, size_t(1))));
+
+        for (size_t first = 0; first < n; first += chunk) {
+            const size_t last = std::min(first + chunk, n);
+
+            auto input_chunk  = etl::slice(input, first, last);
+            auto result_chunk = etl::slice(result, first, last);
+
+            for (size_t m = 0; m < members.size(); ++m) {
+                accumulate(result_chunk, engines[m].forward(input_chunk), m, last - first);
+            }
+        }
+    }
+
+    /*!
+     * \brief Add the outputs of the member m to the result
+     */
+    template <typename Result, typename Output>
+    void accumulate(Result&& result, const Output& output, size_t m, size_t n) {
+        auto flat = etl::reshape(output, n, output_size);
+
+        if (m == 0) {
+            result = flat;
+        } else {
+            result += flat;
+        }
+    }
+};
+
+} //end of dll namespace
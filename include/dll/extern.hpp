@@ -0,0 +1,55 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Explicit instantiations of the common layers and trainers.
+ *
+ * Including this header declares the common dynamic layers and their
+ * Contrastive Divergence trainers, in float, as extern templates. Their
+ * members are then not compiled again in each translation unit but taken
+ * from the prebuilt library (make release_dll_lib), that must be linked
+ * in the application (release/lib/libdll.a).
+ *
+ * The templated members (the forward and backward functions on any input
+ * type) are still instantiated in the application.
+ */
+
+#pragma once
+
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/neural/dyn_conv_layer.hpp"
+#include "dll/rbm/dyn_rbm.hpp"
+#include "dll/rbm/dyn_conv_rbm.hpp"
+#include "dll/contrastive_divergence.hpp"
+
+/*!
+ * \brief The list of the types of the library, each element is given to
+ * the macro X.
+ */
+#define DLL_EXTERN_TYPES(X)                                                                     \
+    X(dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<>>)                                   \
+    X(dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<dll::relu>>)                          \
+    X(dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<dll::softmax>>)                       \
+    X(dll::dyn_conv_layer_impl<dll::dyn_conv_layer_desc<>>)                                     \
+    X(dll::dyn_conv_layer_impl<dll::dyn_conv_layer_desc<dll::relu>>)                            \
+    X(dll::dyn_rbm_impl<dll::dyn_rbm_desc<>>)                                                   \
+    X(dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::momentum>>)                                      \
+    X(dll::dyn_conv_rbm_impl<dll::dyn_conv_rbm_desc<>>)                                         \
+    X(dll::dyn_conv_rbm_impl<dll::dyn_conv_rbm_desc<dll::momentum>>)                            \
+    X(dll::base_cd_trainer<1, dll::dyn_rbm_impl<dll::dyn_rbm_desc<>>, false>)                   \
+    X(dll::base_cd_trainer<1, dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::momentum>>, false>)      \
+    X(dll::base_cd_trainer<1, dll::dyn_conv_rbm_impl<dll::dyn_conv_rbm_desc<>>, false>)         \
+    X(dll::base_cd_trainer<1, dll::dyn_conv_rbm_impl<dll::dyn_conv_rbm_desc<dll::momentum>>, false>)
+
+#define DLL_EXTERN_DECLARE(...) extern template struct __VA_ARGS__;
+#define DLL_EXTERN_DEFINE(...) template struct __VA_ARGS__;
+
+// The library itself defines DLL_EXTERN_IMPL to instantiate the types
+#ifndef DLL_EXTERN_IMPL
+DLL_EXTERN_TYPES(DLL_EXTERN_DECLARE)
+#endif
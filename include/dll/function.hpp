@@ -12,6 +12,10 @@
 
 #pragma once
 
+#include <cmath>
+
+#include "dll/util/fast_math.hpp"
+
 namespace dll {
 
 /*!
@@ -49,6 +53,14 @@ inline std::string to_string(function f) {
     return "UNDEFINED";
 }
 
+/*!
+ * \brief Indicates if the activation function has a fast approximation
+ * (for the layers with fast_activations)
+ */
+constexpr bool has_fast_activation(function f) {
+    return f == function::SIGMOID || f == function::TANH || f == function::SOFTMAX;
+}
+
 /*!
  * \brief Computes the activations from the given input using the specified activation function
  * \param expr The input expression
@@ -95,4 +107,59 @@ decltype(auto) f_derivative(E&& expr) {
     }
 }
 
+/*!
+ * \brief Computes the activation of one value using the specified
+ * activation function.
+ *
+ * This is used by the fused kernels of the recurrent layers. Softmax is not
+ * an element-wise function and is not supported.
+ *
+ * \param x The input value
+ * \tparam F The activation function to use
+ * \tparam Fast Use the fast approximations of the sigmoid and of tanh
+ * \return The result of the activation function
+ */
+template <function F, bool Fast = false, typename T>
+T f_activate_scalar(T x) {
+    static_assert(F != function::SOFTMAX, "Softmax cannot be computed element-wise");
+
+    if constexpr (F == function::IDENTITY) {
+        return x;
+    } else if constexpr (F == function::SIGMOID) {
+        if constexpr (Fast) {
+            return fast_sigmoid(x);
+        } else {
+            return T(1) / (T(1) + std::exp(-x));
+        }
+    } else if constexpr (F == function::TANH) {
+        if constexpr (Fast) {
+            return fast_tanh(x);
+        } else {
+            return std::tanh(x);
+        }
+    } else if constexpr (F == function::RELU) {
+        return x > T(0) ? x : T(0);
+    }
+}
+
+/*!
+ * \brief Computes the derivative from one output value using the specified
+ * activation function
+ * \param y The output value
+ * \tparam F The activation function to use
+ * \return The derivative of the activation function
+ */
+template <function F, typename T>
+T f_derivative_scalar(T y) {
+    if constexpr (F == function::IDENTITY || F == function::SOFTMAX) {
+        return T(1);
+    } else if constexpr (F == function::SIGMOID) {
+        return y * (T(1) - y);
+    } else if constexpr (F == function::TANH) {
+        return T(1) - y * y;
+    } else if constexpr (F == function::RELU) {
+        return y > T(0) ? T(1) : T(0);
+    }
+}
+
 } //end of dll namespace
@@ -47,6 +47,13 @@ constexpr bool is_augmented =
             (Desc::random_crop_x > 0 && Desc::random_crop_y > 0)
         ||  Desc::HorizontalMirroring || Desc::VerticalMirroring || Desc::Noise || Desc::ElasticDistortion;
 
+/*!
+ * \brief Helper to tell from the generator description if its data cache
+ * uses a compact storage
+ */
+template<typename Desc>
+constexpr bool is_compact = Desc::Storage != storage_type::NATIVE;
+
 /*!
  * \brief Helper to tell from the generator description if it is
  * threaded.
@@ -54,7 +61,54 @@ constexpr bool is_augmented =
 template<typename Desc>
 static constexpr bool is_threaded = Desc::Threaded;
 
+/*!
+ * \brief Helper to tell from the generator description if it is
+ * prefetching its big batches in background.
+ */
+template<typename Desc>
+static constexpr bool is_prefetched = Desc::Prefetch > 0;
+
+/*!
+ * \brief Helper to tell from the generator description if it is
+ * reading its data in shuffled shards.
+ */
+template<typename Desc>
+static constexpr bool is_sharded = Desc::ShardSize > 0;
+
+/*!
+ * \brief Traits to test if a data iterator can decode several samples at
+ * once, directly into a batch of the generator.
+ */
+template <typename T, typename = int>
+struct is_batch_decoder_impl : std::false_type {};
+
+/*!
+ * \brief Traits to test if a data iterator can decode several samples at
+ * once, directly into a batch of the generator.
+ */
+template <typename T>
+struct is_batch_decoder_impl<T, decltype((void)T::batch_decoder, 0)> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a data iterator can decode several samples at
+ * once, directly into a batch of the generator.
+ *
+ * Such an iterator must provide a decode_batch(batch, n) function
+ * filling the n first samples of the batch from its current position.
+ */
+template <typename T>
+constexpr bool is_batch_decoder = is_batch_decoder_impl<T>::value;
+
 } // end of namespace dll
 
 #include "dll/generators/inmemory_data_generator.hpp"
 #include "dll/generators/outmemory_data_generator.hpp"
+#include "dll/generators/mmap_data_generator.hpp"
+#include "dll/generators/streamed_data_generator.hpp"
+#include "dll/generators/noisy_data_generator.hpp"
+#include "dll/generators/resized_data_generator.hpp"
+#include "dll/generators/online_data_generator.hpp"
+#include "dll/generators/pipeline_data_generator.hpp"
+#include "dll/generators/borrowed_data_generator.hpp"
+#include "dll/generators/feature_data_generator.hpp"
+#include "dll/generators/synthetic_data_generator.hpp"
@@ -7,13 +7,70 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <thread>
+#include <utility>
 
+#include "dll/util/cpu.hpp"
+#include "dll/util/gpu.hpp"
 #include "dll/util/random.hpp"
 
 namespace dll {
 
+/*!
+ * \brief Copy a window of a 3D image into the target, optionally mirrored.
+ *
+ * With direct memory, each row of each channel is a single contiguous copy
+ * (reversed for the horizontal mirroring), so cropping and mirroring cost
+ * a single write of the target.
+ *
+ * \param target The target [C x H x W]
+ * \param image The source image
+ * \param y_offset The first row of the window
+ * \param x_offset The first column of the window
+ * \param hflip Indicates if the window is mirrored horizontally
+ * \param vflip Indicates if the window is mirrored vertically
+ */
+template <typename O, typename T>
+void copy_window(O&& target, const T& image, size_t y_offset, size_t x_offset, bool hflip, bool vflip) {
+    const size_t C  = etl::dim<0>(image);
+    const size_t Y  = etl::dim<1>(image);
+    const size_t X  = etl::dim<2>(image);
+    const size_t cy = etl::dim<1>(target);
+    const size_t cx = etl::dim<2>(target);
+
+    if constexpr (etl::all_dma<std::decay_t<O>, T>) {
+        cpu_access(image);
+
+        const auto* in = image.memory_start();
+        auto* out      = target.memory_start();
+
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t y = 0; y < cy; ++y) {
+                const auto* src = in + (c * Y + y_offset + (vflip ? cy - 1 - y : y)) * X + x_offset;
+                auto* dst       = out + (c * cy + y) * cx;
+
+                if (hflip) {
+                    std::reverse_copy(src, src + cx, dst);
+                } else {
+                    std::copy(src, src + cx, dst);
+                }
+            }
+        }
+
+        cpu_modified(target);
+    } else {
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t y = 0; y < cy; ++y) {
+                for (size_t x = 0; x < cx; ++x) {
+                    target(c, y, x) = image(c, y_offset + (vflip ? cy - 1 - y : y), x_offset + (hflip ? cx - 1 - x : x));
+                }
+            }
+        }
+    }
+}
+
 /*!
  * \brief Randomly extract crops of a certain size from images
  */
@@ -67,16 +124,46 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x != 0 && Desc::r
      */
     template <typename O, typename T>
     void transform_first(O&& target, const T& image) {
-        const size_t y_offset = dist_y(dll::rand_engine());
-        const size_t x_offset = dist_x(dll::rand_engine());
+        transform_first(target, image, dll::rand_engine());
+    }
 
-        for (size_t c = 0; c < etl::dim<0>(image); ++c) {
-            for (size_t y = 0; y < random_crop_y; ++y) {
-                for (size_t x = 0; x < random_crop_x; ++x) {
-                    target(c, y, x) = image(c, y_offset + y, x_offset + x);
-                }
-            }
-        }
+    /*!
+     * \brief Transform an image using the given random engine.
+     *
+     * This is used as the first step for data augmentation.
+     *
+     * \param target The target output
+     * \param image The input image
+     * \param g The random engine
+     */
+    template <typename O, typename T, typename G>
+    void transform_first(O&& target, const T& image, G& g) {
+        const size_t y_offset = dist_y(g);
+        const size_t x_offset = dist_x(g);
+
+        copy_window(target, image, y_offset, x_offset, false, false);
+    }
+
+    /*!
+     * \brief Transform an image and mirror it in the same pass, using the
+     * given random engine.
+     *
+     * This gives the same result as transform_first() followed by the
+     * transform of the mirrorer.
+     *
+     * \param target The target output
+     * \param image The input image
+     * \param mirrorer The random mirrorer
+     * \param g The random engine
+     */
+    template <typename O, typename T, typename M, typename G>
+    void transform_first_mirror(O&& target, const T& image, M& mirrorer, G& g) {
+        const size_t y_offset = dist_y(g);
+        const size_t x_offset = dist_x(g);
+
+        auto mirror = mirrorer.flips(g);
+
+        copy_window(target, image, y_offset, x_offset, mirror.first, mirror.second);
     }
 
     /*!
@@ -89,16 +176,10 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x != 0 && Desc::r
      */
     template <typename O, typename T>
     void transform_first_test(O&& target, const T& image) {
-        const size_t y_offset = (x - random_crop_x) / 2;
-        const size_t x_offset = (y - random_crop_y) / 2;
+        const size_t y_offset = (y - random_crop_y) / 2;
+        const size_t x_offset = (x - random_crop_x) / 2;
 
-        for (size_t c = 0; c < etl::dim<0>(image); ++c) {
-            for (size_t y = 0; y < random_crop_y; ++y) {
-                for (size_t x = 0; x < random_crop_x; ++x) {
-                    target(c, y, x) = image(c, y_offset + y, x_offset + x);
-                }
-            }
-        }
+        copy_window(target, image, y_offset, x_offset, false, false);
     }
 };
 
@@ -137,6 +218,36 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x == 0 || Desc::r
         target = image;
     }
 
+    /*!
+     * \brief Transform an image using the given random engine.
+     *
+     * This is used as the first step for data augmentation.
+     *
+     * \param target The target output
+     * \param image The input image
+     * \param g The random engine
+     */
+    template <typename O, typename T, typename G>
+    void transform_first(O&& target, const T& image, G& g) {
+        cpp_unused(g);
+        target = image;
+    }
+
+    /*!
+     * \brief Transform an image and mirror it, using the given random
+     * engine.
+     *
+     * \param target The target output
+     * \param image The input image
+     * \param mirrorer The random mirrorer
+     * \param g The random engine
+     */
+    template <typename O, typename T, typename M, typename G>
+    void transform_first_mirror(O&& target, const T& image, M& mirrorer, G& g) {
+        target = image;
+        mirrorer.transform(target, g);
+    }
+
     /*!
      * \brief Transform an image for test.
      *
@@ -202,7 +313,17 @@ struct random_mirrorer<Desc, std::enable_if_t<Desc::HorizontalMirroring || Desc:
      */
     template <typename O>
     void transform(O&& target) {
-        auto choice = dist(dll::rand_engine());
+        transform(target, dll::rand_engine());
+    }
+
+    /*!
+     * \brief Apply the transform on the input using the given random engine
+     * \param target The input to transform
+     * \param g The random engine
+     */
+    template <typename O, typename G>
+    void transform(O&& target, G& g) {
+        auto choice = dist(g);
 
         if (horizontal && vertical && choice == 1) {
             for (size_t c = 0; c < etl::dim<0>(target); ++c) {
@@ -226,6 +347,25 @@ struct random_mirrorer<Desc, std::enable_if_t<Desc::HorizontalMirroring || Desc:
             }
         }
     }
+
+    /*!
+     * \brief Draw the mirroring of one image, with the same random choice
+     * as transform().
+     * \param g The random engine
+     * \return A pair indicating if the image is mirrored horizontally and
+     * vertically
+     */
+    template <typename G>
+    std::pair<bool, bool> flips(G& g) {
+        auto choice = dist(g);
+
+        if (horizontal && vertical) {
+            // The vertical flips of the first choice cancel out
+            return {choice == 1 || choice == 2, false};
+        }
+
+        return {horizontal && choice == 1, vertical && choice == 1};
+    }
 };
 
 /*!
@@ -258,6 +398,27 @@ struct random_mirrorer<Desc, std::enable_if_t<!Desc::HorizontalMirroring && !Des
     static void transform(O&& target) {
         cpp_unused(target);
     }
+
+    /*!
+     * \brief Apply the transform on the input using the given random engine
+     * \param target The input to transform
+     * \param g The random engine
+     */
+    template <typename O, typename G>
+    static void transform(O&& target, G& g) {
+        cpp_unused(target);
+        cpp_unused(g);
+    }
+
+    /*!
+     * \brief Draw the mirroring of one image: never mirrored
+     * \param g The random engine
+     */
+    template <typename G>
+    static std::pair<bool, bool> flips(G& g) {
+        cpp_unused(g);
+        return {false, false};
+    }
 };
 
 /*!
@@ -298,8 +459,16 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise != 0>> {
      */
     template <typename O>
     void transform(O&& target) {
-        auto& g = dll::rand_engine();
+        transform(target, dll::rand_engine());
+    }
 
+    /*!
+     * \brief Apply the transform on the input using the given random engine
+     * \param target The input to transform
+     * \param g The random engine
+     */
+    template <typename O, typename G>
+    void transform(O&& target, G& g) {
         for (auto& v : target) {
             v *= dist(g) < N * 10 ? 0.0 : 1.0;
         }
@@ -336,6 +505,17 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
     static void transform(O&& target) {
         cpp_unused(target);
     }
+
+    /*!
+     * \brief Apply the transform on the input using the given random engine
+     * \param target The input to transform
+     * \param g The random engine
+     */
+    template <typename O, typename G>
+    static void transform(O&& target, G& g) {
+        cpp_unused(target);
+        cpp_unused(g);
+    }
 };
 
 /*!
@@ -344,8 +524,6 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
 template <typename Desc, typename Enable = void>
 struct elastic_distorter;
 
-// TODO This needs to be made MUCH faster
-
 /*!
  * \copydoc elastic_distorter
  */
@@ -357,7 +535,20 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
     static constexpr size_t mid   = K / 2;                           ///< Half of the kernel
     static constexpr double sigma = 0.8 + 0.3 * ((K - 1) * 0.5 - 1); ///< Sigma for gaussian kernel
 
-    etl::fast_dyn_matrix<weight, K, K> kernel; ///< The precomputed kernel
+    /*!
+     * \brief The precomputed 1D kernel.
+     *
+     * The 2D gaussian kernel is the outer product of this kernel with
+     * itself. The normalization by K * K of the blur is folded in.
+     */
+    etl::fast_dyn_matrix<weight, K> kernel;
+
+    etl::dyn_matrix<weight> d_x;      ///< The displacement field in x
+    etl::dyn_matrix<weight> d_y;      ///< The displacement field in y
+    etl::dyn_matrix<weight> d_x_blur; ///< The blurred displacement field in x
+    etl::dyn_matrix<weight> d_y_blur; ///< The blurred displacement field in y
+    etl::dyn_matrix<weight> tmp;      ///< Temporary for the first pass of the blur
+    etl::dyn_matrix<weight> source;   ///< Copy of the channel being resampled
 
     static_assert(K % 2 == 1, "The kernel size must be odd");
 
@@ -369,19 +560,25 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
     elastic_distorter(const T& image) {
         static_assert(etl::dimensions<T>() == 3, "elastic_distorter can only be used with 3D images");
 
-        cpp_unused(image);
+        const size_t width  = etl::dim<1>(image);
+        const size_t height = etl::dim<2>(image);
+
+        d_x      = etl::dyn_matrix<weight>(width, height);
+        d_y      = etl::dyn_matrix<weight>(width, height);
+        d_x_blur = etl::dyn_matrix<weight>(width, height);
+        d_y_blur = etl::dyn_matrix<weight>(width, height);
+        tmp      = etl::dyn_matrix<weight>(width, height);
+        source   = etl::dyn_matrix<weight>(width, height);
 
         // Precompute the gaussian kernel
 
-        auto gaussian = [](double x, double y) {
+        auto gaussian = [](double x) {
             auto Z = 2.0 * M_PI * sigma * sigma;
-            return (1.0 / Z) * std::exp(-((x * x + y * y) / (2.0 * sigma * sigma)));
+            return (1.0 / (std::sqrt(Z) * K)) * std::exp(-((x * x) / (2.0 * sigma * sigma)));
         };
 
         for (size_t i = 0; i < K; ++i) {
-            for (size_t j = 0; j < K; ++j) {
-                kernel(i, j) = gaussian(double(i) - mid, double(j) - mid);
-            }
+            kernel(i) = gaussian(double(i) - mid);
         }
     }
 
@@ -399,22 +596,26 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
      */
     template <typename O>
     void transform(O&& target) {
+        transform(target, dll::rand_engine());
+    }
+
+    /*!
+     * \brief Apply the transform on the input using the given random engine
+     * \param target The input to transform
+     * \param g The random engine
+     */
+    template <typename O, typename G>
+    void transform(O&& target, G& g) {
         const size_t width  = etl::dim<1>(target);
         const size_t height = etl::dim<2>(target);
 
         // 0. Generate random displacement fields
 
-        etl::dyn_matrix<weight> d_x(width, height);
-        etl::dyn_matrix<weight> d_y(width, height);
-
-        d_x = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
-        d_y = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
+        d_x = etl::uniform_generator(g, -1.0, 1.0);
+        d_y = etl::uniform_generator(g, -1.0, 1.0);
 
         // 1. Gaussian blur the displacement fields
 
-        etl::dyn_matrix<weight> d_x_blur(width, height);
-        etl::dyn_matrix<weight> d_y_blur(width, height);
-
         gaussian_blur(d_x, d_x_blur);
         gaussian_blur(d_y, d_y_blur);
 
@@ -425,61 +626,97 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
 
         // 3. Apply the displacement field (using bilinear interpolation)
 
-        auto safe = [&](size_t channel, weight x, weight y) {
-            if (x < 0 || y < 0 || x > width - 1 || y > height - 1) {
-                return target(channel, 0UL, 0UL);
-            } else {
-                return target(channel, size_t(x), size_t(y));
-            }
-        };
-
         for (size_t channel = 0; channel < etl::dim<0>(target); ++channel) {
-            for (int x = 0; x < int(width); ++x) {
-                for (int y = 0; y < int(height); ++y) {
-                    auto dx = d_x_blur(x, y);
-                    auto dy = d_y_blur(x, y);
+            source = target(channel);
+
+            const weight* src = source.memory_start();
+            const weight fill = src[0];
 
-                    weight px = x + dx;
-                    weight py = y + dy;
+            auto safe = [&](long x, long y) {
+                if (x < 0 || y < 0 || x > long(width) - 1 || y > long(height) - 1) {
+                    return fill;
+                } else {
+                    return src[x * height + y];
+                }
+            };
+
+            for (size_t x = 0; x < width; ++x) {
+                for (size_t y = 0; y < height; ++y) {
+                    const weight px = x + d_x_blur(x, y);
+                    const weight py = y + d_y_blur(x, y);
 
-                    weight a = safe(channel, std::floor(px), std::floor(py));
-                    weight b = safe(channel, std::ceil(px), std::floor(py));
-                    weight c = safe(channel, std::ceil(px), std::ceil(py));
-                    weight d = safe(channel, std::floor(px), std::ceil(py));
+                    const weight fx = std::floor(px);
+                    const weight fy = std::floor(py);
+                    const weight cx = std::ceil(px);
+                    const weight cy = std::ceil(py);
 
-                    auto e = a * (1.0 - (px - std::floor(px))) + d * (px - std::floor(px));
-                    auto f = b * (1.0 - (px - std::floor(px))) + c * (px - std::floor(px));
+                    const weight a = safe(long(fx), long(fy));
+                    const weight b = safe(long(cx), long(fy));
+                    const weight c = safe(long(cx), long(cy));
+                    const weight d = safe(long(fx), long(cy));
 
-                    auto value = e * (1.0 - (py - std::floor(py))) + f * (py - std::floor(py));
+                    const weight wx = px - fx;
+                    const weight wy = py - fy;
 
-                    target(channel, x, y) = value;
+                    const weight e = a * (1.0 - wx) + d * wx;
+                    const weight f = b * (1.0 - wx) + c * wx;
+
+                    target(channel, x, y) = e * (1.0 - wy) + f * wy;
                 }
             }
         }
     }
 
     /*!
-     * \brief Apply a gaussian blur on the distortion matrix
+     * \brief Apply a gaussian blur on the distortion matrix.
+     *
+     * The blur is computed as two separable passes, first along the
+     * contiguous dimension and then along the rows, each inner loop
+     * running over contiguous memory.
      */
-    void gaussian_blur(const etl::dyn_matrix<weight>& d, etl::dyn_matrix<weight>& d_blur) {
-        const size_t width  = etl::dim<0>(d);
-        const size_t height = etl::dim<1>(d);
+    DLL_KERNEL_CLONES void gaussian_blur(const etl::dyn_matrix<weight>& d, etl::dyn_matrix<weight>& d_blur) {
+        const long width  = etl::dim<0>(d);
+        const long height = etl::dim<1>(d);
 
-        for (size_t j = 0; j < width; ++j) {
-            for (size_t k = 0; k < height; ++k) {
-                weight sum(0.0);
+        const weight* in = d.memory_start();
+        weight* t        = tmp.memory_start();
+        weight* out      = d_blur.memory_start();
 
-                for (size_t p = 0; p < K; ++p) {
-                    if (long(j) + p - mid >= 0 && long(j) + p - mid < width) {
-                        for (size_t q = 0; q < K; ++q) {
-                            if (long(k) + q - mid >= 0 && long(k) + q - mid < height) {
-                                sum += kernel(p, q) * d(j + p - mid, k + q - mid);
-                            }
-                        }
-                    }
+        // 1. Pass along the contiguous dimension
+
+        tmp = 0;
+
+        for (long j = 0; j < width; ++j) {
+            for (long q = 0; q < long(K); ++q) {
+                const long shift = q - long(mid);
+                const weight w   = kernel(q);
+
+                const long first = std::max(0L, -shift);
+                const long last  = std::min(height, height - shift);
+
+                for (long k = first; k < last; ++k) {
+                    t[j * height + k] += w * in[j * height + k + shift];
                 }
+            }
+        }
+
+        // 2. Pass along the rows
+
+        for (long j = 0; j < width; ++j) {
+            for (long k = 0; k < height; ++k) {
+                out[j * height + k] = in[j * height + k];
+            }
+
+            for (long p = 0; p < long(K); ++p) {
+                const long jj = j + p - long(mid);
+
+                if (jj >= 0 && jj < width) {
+                    const weight w = kernel(p);
 
-                d_blur(j, k) = d(j, k) - (sum / (K * K));
+                    for (long k = 0; k < height; ++k) {
+                        out[j * height + k] -= w * t[jj * height + k];
+                    }
+                }
             }
         }
     }
@@ -515,6 +752,17 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion == 0>> {
     static void transform(O&& target) {
         cpp_unused(target);
     }
+
+    /*!
+     * \brief Apply the transform on the input using the given random engine
+     * \param target The input to transform
+     * \param g The random engine
+     */
+    template <typename O, typename G>
+    static void transform(O&& target, G& g) {
+        cpp_unused(target);
+        cpp_unused(g);
+    }
 };
 
 } //end of dll namespace
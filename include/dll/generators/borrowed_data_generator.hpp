@@ -0,0 +1,586 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator borrowing the samples of the
+ * caller instead of copying them
+ */
+
+#pragma once
+
+#include <iterator>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace dll {
+
+namespace borrowed_detail {
+
+/*!
+ * \brief Traits indicating if a descriptor is the descriptor of an
+ * in-memory generator
+ */
+template <typename Desc>
+struct is_inmemory_desc : std::false_type {};
+
+/*!
+ * \copydoc is_inmemory_desc
+ */
+template <typename... Parameters>
+struct is_inmemory_desc<inmemory_data_generator_desc<Parameters...>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the samples of the iterator can be read in place: the
+ * iterator is random access and gives references to ETL containers with
+ * direct memory.
+ */
+template <typename Iterator>
+constexpr bool is_borrowable_iterator() {
+    using traits   = std::iterator_traits<Iterator>;
+    using value_t  = typename traits::value_type;
+    using category = typename traits::iterator_category;
+
+    if constexpr (etl::is_etl_expr<value_t>) {
+        return std::is_base_of<std::random_access_iterator_tag, category>::value
+            && std::is_reference<typename traits::reference>::value
+            && etl::all_dma<value_t>;
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief Indicates if the labels of the iterator are given as ETL samples
+ */
+template <typename LIterator>
+constexpr bool is_etl_labels = etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>;
+
+/*!
+ * \brief The type of the label cache of the generator, unused when the
+ * labels are borrowed
+ */
+template <typename Desc, typename T, typename LIterator, bool Borrowed = is_etl_labels<LIterator>>
+struct label_cache_type {
+    using type = typename label_cache_helper<Desc, T, LIterator>::cache_type; ///< The type of the label cache
+};
+
+/*!
+ * \copydoc label_cache_type
+ */
+template <typename Desc, typename T, typename LIterator>
+struct label_cache_type<Desc, T, LIterator, true> {
+    using type = etl::dyn_matrix<T, 1>; ///< The type of the label cache
+};
+
+/*!
+ * \brief Indicates if a generator with the given descriptor can borrow the
+ * samples and the labels of the given iterators.
+ *
+ * The augmented generators, the compact storages, the index shuffle and
+ * the length buckets need their own cache. Scalar labels are always copied
+ * in a cache, they are small.
+ */
+template <typename Iterator, typename LIterator, typename Desc>
+constexpr bool is_borrowable() {
+    if constexpr (is_inmemory_desc<Desc>::value) {
+        return !is_augmented<Desc> && !is_compact<Desc> && !Desc::IndexShuffle && !Desc::LengthBuckets
+            && is_borrowable_iterator<Iterator>()
+            && (!is_etl_labels<LIterator> || is_borrowable_iterator<LIterator>())
+            && std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<LIterator>::iterator_category>::value;
+    } else {
+        return false;
+    }
+}
+
+} //end of namespace borrowed_detail
+
+/*!
+ * \brief A sequence of samples of the caller, read in place.
+ *
+ * When the samples are contiguous in memory, in order and do not need to
+ * be transformed, the batches are views of the memory of the caller.
+ * Otherwise, the samples of each batch are gathered (and transformed) into
+ * a buffer of one batch.
+ *
+ * \tparam Desc The descriptor of the generator
+ * \tparam Iterator The iterator of the samples
+ * \tparam Transform Indicates if the pre-transformations of the descriptor are applied
+ */
+template <typename Desc, typename Iterator, bool Transform>
+struct borrowed_samples {
+    using sample_t = std::decay_t<typename std::iterator_traits<Iterator>::value_type>; ///< The type of a sample
+    using weight   = etl::value_t<sample_t>;                                             ///< The data type
+
+    static constexpr size_t D          = etl::dimensions<sample_t>() + 1; ///< The number of dimensions of a batch
+    static constexpr size_t batch_size = Desc::BatchSize;                 ///< The size of the batches
+
+    static constexpr bool transformed = Transform && (pre_transformer<Desc>::scale || pre_transformer<Desc>::normalize || pre_transformer<Desc>::binarize); ///< Indicates if the samples are transformed
+
+    using batch_t  = etl::custom_dyn_matrix<weight, D>; ///< The type of a batch
+    using buffer_t = etl::dyn_matrix<weight, D>;        ///< The type of the batch buffer
+
+    Iterator first;          ///< The first sample
+    size_t n        = 0;     ///< The number of samples
+    bool contiguous = false; ///< Indicates if the samples are contiguous in memory
+
+    mutable buffer_t buffer;              ///< The gathered current batch
+    mutable size_t gathered = size_t(-1); ///< The first sample of the gathered batch
+
+    /*!
+     * \brief Borrow the n samples starting at first
+     */
+    void init(Iterator first, size_t n) {
+        this->first = first;
+        this->n     = n;
+
+        if (!n) {
+            return;
+        }
+
+        cache_helper<Desc, Iterator>::init(batch_size, first, buffer);
+
+        // The samples can be used in place only if they directly follow each other
+        contiguous = !transformed;
+
+        const size_t sample_size = etl::size(*first);
+        const weight* base       = (*first).memory_start();
+
+        auto it = first;
+
+        for (size_t i = 0; i < n && contiguous; ++i, ++it) {
+            cpu_access(*it);
+
+            contiguous = etl::size(*it) == sample_size && (*it).memory_start() == base + i * sample_size;
+        }
+    }
+
+    /*!
+     * \brief Release the batch buffer
+     */
+    void clear() {
+        buffer.clear();
+        gathered = size_t(-1);
+    }
+
+    /*!
+     * \brief Indicates that the gathered batch is not valid anymore
+     */
+    void invalidate() const {
+        gathered = size_t(-1);
+    }
+
+    /*!
+     * \brief Returns the batch of samples starting at the given position
+     * \param order The order of the samples
+     * \param shuffled Indicates if the order is not the natural order
+     * \param current The position of the first sample of the batch
+     */
+    batch_t batch(const std::vector<size_t>& order, bool shuffled, size_t current) const {
+        const size_t rows = std::min(batch_size, n - current);
+
+        if (contiguous && !shuffled) {
+            // The batch is only read, never written
+            auto* memory = const_cast<weight*>((*std::next(first, current)).memory_start());
+
+            return view(memory, rows, std::make_index_sequence<D - 1>());
+        }
+
+        if (gathered != current) {
+            for (size_t i = 0; i < rows; ++i) {
+                const auto& sample = *std::next(first, shuffled ? order[current + i] : current + i);
+
+                if constexpr (Transform) {
+                    pre_transformer<Desc>::copy(buffer(i), sample);
+                } else {
+                    buffer(i) = sample;
+                }
+            }
+
+            buffer.invalidate_gpu();
+
+            gathered = current;
+        }
+
+        return view(buffer.memory_start(), rows, std::make_index_sequence<D - 1>());
+    }
+
+private:
+    /*!
+     * \brief Create a view of rows samples at the given memory
+     */
+    template <size_t... I>
+    batch_t view(weight* memory, size_t rows, std::index_sequence<I...> /*seq*/) const {
+        return batch_t(memory, rows, etl::dim<I + 1>(buffer)...);
+    }
+};
+
+/*!
+ * \brief A data generator reading the samples of the caller in place
+ * instead of copying the whole dataset in a cache.
+ *
+ * The container of the samples must outlive the generator and must not be
+ * modified while it is used. When the samples are contiguous in memory
+ * (for instance a vector of fast matrices), do not need pre-processing and
+ * are not shuffled, the batches are views of the samples. Otherwise, only
+ * the current batch is gathered in a buffer. Shuffling only changes the
+ * order in which the samples are read.
+ *
+ * The samples given as labels (auto-encoders) are borrowed the same way,
+ * the batches of the inputs being used directly when the labels are the
+ * inputs. The other labels are kept in a cache.
+ */
+template <typename Iterator, typename LIterator, typename Desc>
+struct borrowed_data_generator {
+    using desc                 = Desc;                                                                           ///< The generator descriptor
+    using weight               = etl::value_t<std::decay_t<typename std::iterator_traits<Iterator>::value_type>>; ///< The data type
+    using label_cache_helper_t = label_cache_helper<Desc, weight, LIterator>;                                    ///< The helper for the label cache
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+
+    static constexpr bool etl_labels = borrowed_detail::is_etl_labels<LIterator>; ///< Indicates if the labels are borrowed
+
+    using data_t  = borrowed_samples<Desc, Iterator, true>;             ///< The borrowed samples
+    using label_t = borrowed_samples<Desc, LIterator, desc::AutoEncoder>; ///< The borrowed labels
+
+    using label_cache_type = typename borrowed_detail::label_cache_type<Desc, weight, LIterator>::type; ///< The type of the label cache
+
+private:
+    data_t data;                 ///< The borrowed samples
+    std::vector<size_t> order;   ///< The order of the samples
+    bool shuffled       = false; ///< Indicates if the order is shuffled
+    bool labels_as_data = false; ///< Indicates if the labels are the samples
+
+    mutable std::conditional_t<etl_labels, label_t, int> labels; ///< The borrowed labels
+
+    label_cache_type label_cache;          ///< The label cache, when not borrowed
+    mutable label_cache_type label_buffer; ///< The gathered current label batch
+    mutable size_t gathered = size_t(-1);  ///< The index of the gathered label batch
+
+    size_t current = 0;     ///< The current index
+    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    tracked_memory memory{memory_category::GENERATOR}; ///< The tracked memory of the buffers
+
+public:
+    /*!
+     * \brief Construct a generator borrowing the given samples
+     */
+    borrowed_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes) {
+        const size_t n = std::distance(first, last);
+
+        data.init(first, n);
+
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
+
+        if constexpr (etl_labels) {
+            if constexpr (std::is_same<Iterator, LIterator>::value && desc::AutoEncoder) {
+                labels_as_data = first == lfirst;
+            }
+
+            if (!labels_as_data) {
+                labels.init(lfirst, n);
+            }
+
+            cpp_unused(n_classes);
+        } else {
+            label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+            label_cache_helper_t::init(batch_size, n_classes, lfirst, label_buffer);
+
+            auto lit = lfirst;
+
+            for (size_t i = 0; i < n; ++i, ++lit) {
+                label_cache_helper_t::set(i, lit, label_cache);
+            }
+        }
+
+        track_memory();
+
+        cpp_unused(llast);
+    }
+
+    borrowed_data_generator(const borrowed_data_generator& rhs) = delete;
+    borrowed_data_generator operator=(const borrowed_data_generator& rhs) = delete;
+
+    borrowed_data_generator(borrowed_data_generator&& rhs) = delete;
+    borrowed_data_generator operator=(borrowed_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Borrowed Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "        Contiguous: " << (data.contiguous ? "yes" : "no") << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     *
+     * This is only done if the generator is marked as safe. The borrowed
+     * samples are not touched.
+     */
+    void clear() {
+        if (is_safe) {
+            data.clear();
+
+            if constexpr (etl_labels) {
+                labels.clear();
+            } else {
+                label_cache.clear();
+                label_buffer.clear();
+            }
+
+            memory.track(0);
+        }
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        reset();
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        block_shuffle(order, 1, dll::random_engine());
+
+        shuffled = true;
+        gathered = size_t(-1);
+
+        data.invalidate();
+
+        if constexpr (etl_labels) {
+            labels.invalidate();
+        }
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return order.size();
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        return data.batch(order, shuffled, current);
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        if constexpr (etl_labels) {
+            if constexpr (std::is_same<data_t, label_t>::value) {
+                if (labels_as_data) {
+                    return data_batch();
+                }
+            }
+
+            return labels.batch(order, shuffled, current);
+        } else {
+            const size_t rows = std::min(batch_size, size() - current);
+
+            if (!shuffled) {
+                return etl::slice(label_cache, current, current + rows);
+            }
+
+            if (gathered != current) {
+                for (size_t i = 0; i < rows; ++i) {
+                    label_buffer(i) = label_cache(order[current + i]);
+                }
+
+                label_buffer.invalidate_gpu();
+
+                gathered = current;
+            }
+
+            return etl::slice(label_buffer, 0, rows);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the batches of data are views of the borrowed
+     * samples
+     */
+    bool contiguous() const {
+        return data.contiguous;
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return data_t::D - 1;
+    }
+
+private:
+    /*!
+     * \brief Track the memory of the buffers of the generator
+     */
+    void track_memory() {
+        size_t bytes = buffer_bytes(data.buffer) + order.size() * sizeof(size_t);
+
+        if constexpr (etl_labels) {
+            if (!labels_as_data) {
+                bytes += buffer_bytes(labels.buffer);
+            }
+        } else {
+            bytes += buffer_bytes(label_cache) + buffer_bytes(label_buffer);
+        }
+
+        memory.track(bytes);
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Iterator, typename LIterator, typename Desc>
+std::ostream& operator<<(std::ostream& os, borrowed_data_generator<Iterator, LIterator, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Make a generator borrowing the samples of the iterators when the
+ * descriptor and the layout of the samples allow it, or copying them in a
+ * generator of the descriptor otherwise.
+ */
+template <typename Iterator, typename LIterator, typename Desc>
+auto make_borrowed_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n, size_t n_classes, const Desc& desc) {
+    if constexpr (borrowed_detail::is_borrowable<Iterator, LIterator, Desc>()) {
+        cpp_unused(n);
+        cpp_unused(desc);
+
+        return std::make_unique<borrowed_data_generator<Iterator, LIterator, Desc>>(first, last, lfirst, llast, n_classes);
+    } else {
+        return make_generator(first, last, lfirst, llast, n, n_classes, desc);
+    }
+}
+
+/*!
+ * \brief Make a generator borrowing the samples of the containers when the
+ * descriptor and the layout of the samples allow it, or copying them in a
+ * generator of the descriptor otherwise.
+ */
+template <typename Container, typename LContainer, typename Desc>
+auto make_borrowed_generator(const Container& container, const LContainer& lcontainer, size_t n, size_t n_classes, const Desc& desc) {
+    return make_borrowed_generator(std::begin(container), std::end(container), std::begin(lcontainer), std::end(lcontainer), n, n_classes, desc);
+}
+
+} //end of dll namespace
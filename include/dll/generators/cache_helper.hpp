@@ -7,9 +7,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <thread>
 
+#include "dll/util/memory.hpp"
+
 namespace dll {
 
 /*!
@@ -49,10 +52,11 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_1d<typename std::it
      * \brief Init the big cache
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param batches The number of batches of the big cache
      */
-    static void init_big(Iterator& it, big_cache_type& cache) {
+    static void init_big(Iterator& it, big_cache_type& cache, size_t batches = big_batch_size) {
         auto one = *it;
-        cache    = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one));
+        cache    = big_cache_type(batches, batch_size, etl::dim<0>(one));
     }
 };
 
@@ -84,14 +88,15 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_3d<typename std::it
      * \brief Init the big cache
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param batches The number of batches of the big cache
      */
-    static void init_big(Iterator& it, big_cache_type& cache) {
+    static void init_big(Iterator& it, big_cache_type& cache, size_t batches = big_batch_size) {
         auto one = *it;
 
         if (Desc::random_crop_x && Desc::random_crop_y) {
-            cache = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one), Desc::random_crop_y, Desc::random_crop_x);
+            cache = big_cache_type(batches, batch_size, etl::dim<0>(one), Desc::random_crop_y, Desc::random_crop_x);
         } else {
-            cache = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+            cache = big_cache_type(batches, batch_size, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
         }
     }
 };
@@ -124,16 +129,55 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_2d<typename std::it
      * \brief Init the big cache
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param batches The number of batches of the big cache
      */
-    static void init_big(Iterator& it, big_cache_type& cache) {
+    static void init_big(Iterator& it, big_cache_type& cache, size_t batches = big_batch_size) {
         auto one = *it;
 
         if (Desc::random_crop_x && Desc::random_crop_y) {
-            cache = big_cache_type(big_batch_size, batch_size, Desc::random_crop_y, Desc::random_crop_x);
+            cache = big_cache_type(batches, batch_size, Desc::random_crop_y, Desc::random_crop_x);
         } else {
-            cache = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one), etl::dim<1>(one));
+            cache = big_cache_type(batches, batch_size, etl::dim<0>(one), etl::dim<1>(one));
         }
     }
 };
 
+/*!
+ * \brief Returns the number of batches kept in cache by a threaded
+ * generator.
+ *
+ * Without memory budget (big_batch_budget or big_batch_free_memory), this
+ * is the big batch size of the descriptor. Otherwise, this is the number
+ * of batches fitting in the budget, but not more than the batches of the
+ * dataset. The result is a multiple of step, at least step.
+ *
+ * \param batch_bytes The bytes of one cached batch (data and labels)
+ * \param batches The number of batches of the dataset
+ * \param step The granularity of the cache (the number of producer threads)
+ */
+template <typename Desc>
+size_t big_batch_cache_size(size_t batch_bytes, size_t batches, size_t step = 1) {
+    size_t budget = Desc::BigBatchBudget * 1024UL * 1024UL;
+
+    if (Desc::BigBatchFreeMemory) {
+        const size_t available = available_memory();
+
+        // If the available memory is not known, only the fixed budget is used
+        if (available) {
+            const size_t fraction = available / 100 * Desc::BigBatchFreeMemory;
+
+            budget = budget ? std::min(budget, fraction) : fraction;
+        }
+    }
+
+    if (!budget) {
+        return std::max(step, Desc::BigBatchSize / step * step);
+    }
+
+    const size_t fit   = budget / std::max(batch_bytes, size_t(1));
+    const size_t epoch = (batches + step - 1) / step * step;
+
+    return std::max(step, std::min(fit, epoch) / step * step);
+}
+
 } //end of dll namespace
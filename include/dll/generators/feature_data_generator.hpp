@@ -0,0 +1,305 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Data generator producing the features of a trained network on top
+ * of another generator
+ */
+
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief A data generator whose data batches are the outputs of a trained
+ * network for the batches of an underlying generator.
+ *
+ * This is a stage of a pipeline of networks: the features of a pretrained
+ * network can be used to train another network (with fine_tune or
+ * svm_train) without being stored for the whole dataset. The features of a
+ * batch are computed lazily, when the batch is first accessed. The label
+ * batches are the ones of the underlying generator.
+ *
+ * With caching, the features of each batch are kept once computed, the
+ * next passes over the same batches do not compute them again. The cache
+ * is only valid as long as the order of the underlying generator does not
+ * change, it is dropped when the generator is shuffled. It should not be
+ * used on top of an augmented generator.
+ *
+ * The generator keeps a reference to the underlying generator and to the
+ * network, it must not outlive them.
+ *
+ * \tparam Generator The type of the underlying generator
+ * \tparam DBN The type of the network
+ */
+template <typename Generator, typename DBN>
+struct feature_data_generator {
+    using generator_t = Generator; ///< The type of the underlying generator
+    using dbn_t       = DBN;       ///< The type of the network
+
+    using input_batch_t = std::decay_t<decltype(std::declval<const Generator&>().data_batch())>;                 ///< The type of an input batch
+    using batch_t       = std::decay_t<decltype(std::declval<const dbn_t&>().forward_batch(std::declval<const input_batch_t&>()))>; ///< The type of a batch of features
+    using weight        = etl::value_t<batch_t>;                                                                 ///< The data type
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = Generator::batch_size; ///< The size of the generated batches
+
+private:
+    generator_t& generator; ///< The underlying generator
+    const dbn_t& dbn;       ///< The network computing the features
+    const bool caching;     ///< Indicates if the features are cached
+
+    mutable batch_t batch;                              ///< The features of the current batch
+    mutable bool loaded = false;                        ///< Indicates if the features of the current batch have been computed
+    mutable std::vector<std::unique_ptr<batch_t>> cache; ///< The cached features of each batch
+
+public:
+    /*!
+     * \brief Create a generator of the features of the given network on
+     * top of the given generator
+     * \param generator The underlying generator
+     * \param dbn The trained network
+     * \param caching Indicates if the features of each batch are kept once computed
+     */
+    feature_data_generator(generator_t& generator, const dbn_t& dbn, bool caching = false) : generator(generator), dbn(dbn), caching(caching) {}
+
+    feature_data_generator(const feature_data_generator& rhs) = delete;
+    feature_data_generator operator=(const feature_data_generator& rhs) = delete;
+
+    feature_data_generator(feature_data_generator&& rhs) = delete;
+    feature_data_generator operator=(feature_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Feature Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "           Caching: " << (caching ? "yes" : "no") << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        generator.set_safe();
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     *
+     * This is only done if the underlying generator is safe.
+     */
+    void clear() {
+        generator.clear();
+        batch.clear();
+        cache.clear();
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        generator.set_test();
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        generator.set_train();
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        generator.reset();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        generator.reset_shuffle();
+        loaded = false;
+        cache.clear();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        generator.shuffle();
+        loaded = false;
+        cache.clear();
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        generator.prepare_epoch();
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return generator.current_batch();
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return generator.size();
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return generator.augmented_size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return generator.batches();
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return generator.has_next_batch();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        generator.next_batch();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Returns the current data batch, the features of the network
+     * for the current batch of the underlying generator.
+     *
+     * The features are computed once for each batch.
+     *
+     * \return a a batch of features.
+     */
+    const batch_t& data_batch() const {
+        if (caching) {
+            const size_t b = generator.current_batch();
+
+            if (cache.size() <= b) {
+                cache.resize(generator.batches());
+            }
+
+            if (!cache[b]) {
+                cache[b] = std::make_unique<batch_t>(dbn.forward_batch(generator.data_batch()));
+            }
+
+            return *cache[b];
+        }
+
+        if (!loaded) {
+            batch = dbn.forward_batch(generator.data_batch());
+
+            loaded = true;
+        }
+
+        return batch;
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label (the labels of the underlying generator).
+     */
+    decltype(auto) label_batch() const {
+        return generator.label_batch();
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return etl::dimensions<batch_t>() - 1;
+    }
+};
+
+/*!
+ * \brief Traits to test if a generator computes the features of a network
+ */
+template <typename T>
+struct is_feature_generator : std::false_type {};
+
+/*!
+ * \copydoc is_feature_generator
+ */
+template <typename Generator, typename DBN>
+struct is_feature_generator<feature_data_generator<Generator, DBN>> : std::true_type {};
+
+/*!
+ * \brief Create a generator of the features of the given network on top of
+ * the given generator
+ * \param generator The underlying generator
+ * \param dbn The trained network
+ * \param caching Indicates if the features of each batch are kept once computed
+ */
+template <typename Generator, typename DBN>
+feature_data_generator<Generator, DBN> make_feature_generator(Generator& generator, const DBN& dbn, bool caching = false) {
+    return {generator, dbn, caching};
+}
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Generator, typename DBN>
+std::ostream& operator<<(std::ostream& os, feature_data_generator<Generator, DBN>& generator) {
+    return generator.display(os);
+}
+
+} //end of dll namespace
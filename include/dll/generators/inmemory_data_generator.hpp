@@ -12,11 +12,278 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
 #include <thread>
+#include <vector>
+
+#include "dll/util/compact_storage.hpp"
+#include "dll/util/compressed_storage.hpp"
+#include "dll/util/gpu.hpp"
+#include "dll/util/memory.hpp"
+#include "dll/util/numa.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/sequences.hpp"
+#include "dll/util/spsc_ring.hpp"
 
 namespace dll {
 
+/*!
+ * \brief Shuffle a permutation of the indices of the samples, by blocks
+ * of contiguous samples.
+ *
+ * The order of the blocks is shuffled, then the order of the samples
+ * inside each block.
+ *
+ * \param order The permutation to fill
+ * \param block The number of samples in a block
+ * \param g The random generator
+ */
+template <typename G>
+void block_shuffle(std::vector<size_t>& order, size_t block, G&& g) {
+    std::iota(order.begin(), order.end(), 0);
+
+    if (block <= 1) {
+        std::shuffle(order.begin(), order.end(), g);
+        return;
+    }
+
+    const size_t n      = order.size();
+    const size_t blocks = n / block + (n % block == 0 ? 0 : 1);
+
+    std::vector<size_t> block_order(blocks);
+    std::iota(block_order.begin(), block_order.end(), 0);
+    std::shuffle(block_order.begin(), block_order.end(), g);
+
+    size_t i = 0;
+
+    for (auto b : block_order) {
+        const size_t first = b * block;
+        const size_t last  = std::min(n, first + block);
+        const size_t start = i;
+
+        for (size_t j = first; j < last; ++j) {
+            order[i++] = j;
+        }
+
+        std::shuffle(order.begin() + start, order.begin() + i, g);
+    }
+}
+
+/*!
+ * \brief Fill the data and label caches of a generator from the iterators,
+ * the pre-transformations are fused in the copy of each sample.
+ *
+ * When the generator is threaded and both iterators are random access, the
+ * samples are copied in parallel, by blocks.
+ *
+ * \param first The iterator on the beginning on data
+ * \param lfirst The iterator on the beginning on labels
+ * \param n The number of samples
+ * \param input_cache The data cache to fill
+ * \param label_cache The label cache to fill
+ * \param labels Indicates if the label cache must be filled, it is not when
+ * the labels are the data
+ */
+template <typename Desc, typename LabelHelper, typename Iterator, typename LIterator, typename DataCache, typename LabelCache>
+void fill_caches(Iterator first, LIterator lfirst, size_t n, DataCache& input_cache, LabelCache& label_cache, bool labels = true) {
+    auto fill = [&](size_t begin, size_t end) {
+        auto it  = std::next(first, begin);
+        auto lit = std::next(lfirst, begin);
+
+        for (size_t i = begin; i < end; ++i, ++it, ++lit) {
+            pre_transformer<Desc>::copy(input_cache(i), *it);
+
+            if (labels) {
+                LabelHelper::set(i, lit, label_cache);
+
+                // In case of auto-encoders, the label images also need to be transformed
+                if constexpr (Desc::AutoEncoder) {
+                    pre_transformer<Desc>::transform(label_cache(i));
+                }
+            }
+        }
+    };
+
+    using category  = typename std::iterator_traits<Iterator>::iterator_category;
+    using lcategory = typename std::iterator_traits<LIterator>::iterator_category;
+
+    constexpr bool random_access = std::is_base_of<std::random_access_iterator_tag, category>::value && std::is_base_of<std::random_access_iterator_tag, lcategory>::value;
+
+    if constexpr (Desc::Threaded && random_access) {
+        constexpr size_t block = 256;
+
+        parallel_kernel(0, n / block + (n % block == 0 ? 0 : 1), [&](size_t b) {
+            fill(b * block, std::min(n, (b + 1) * block));
+        });
+    } else {
+        fill(0, n);
+    }
+}
+
+/*!
+ * \brief Indicates if the labels given to an auto-encoder generator are its
+ * data, in which case they are not stored a second time.
+ *
+ * \param input The data (an iterator or a pointer to an example)
+ * \param label The labels (an iterator or a pointer to an example)
+ */
+template <typename Desc, typename DataCache, typename LabelCache, typename DIterator, typename LIt>
+bool labels_are_inputs(const DIterator& input, const LIt& label) {
+    if constexpr (Desc::AutoEncoder && std::is_same<DataCache, LabelCache>::value && std::is_same<DIterator, LIt>::value) {
+        return input == label;
+    } else {
+        cpp_unused(input);
+        cpp_unused(label);
+
+        return false;
+    }
+}
+
+/*!
+ * \brief A bounded LRU cache of augmented samples.
+ *
+ * Each entry holds one augmented variant of one sample. An entry holding
+ * an older variant of its sample is replaced when the sample is augmented
+ * again. The cache can be used by several threads.
+ */
+template <typename Cache>
+struct augmentation_cache {
+    static constexpr size_t npos = size_t(-1); ///< Marker of no slot
+
+    Cache samples;                ///< The cached samples
+    std::vector<size_t> keys;     ///< The sample held by each slot
+    std::vector<size_t> variants; ///< The variant held by each slot
+    std::vector<size_t> prev;     ///< The previous (more recent) slot of each slot
+    std::vector<size_t> next;     ///< The next (less recent) slot of each slot
+    std::vector<size_t> slots;    ///< The slot of each sample (npos if not cached)
+
+    size_t head = npos; ///< The most recently used slot
+    size_t tail = npos; ///< The least recently used slot
+    size_t used = 0;    ///< The number of used slots
+
+    size_t hits   = 0; ///< The number of samples found in the cache
+    size_t misses = 0; ///< The number of samples that needed to be augmented
+
+    std::mutex lock; ///< The lock protecting the cache
+
+    /*!
+     * \brief Initialize the cache
+     * \param n The number of samples of the dataset
+     * \param storage The storage of the cached samples, one per slot
+     */
+    void init(size_t n, Cache&& storage) {
+        samples = std::move(storage);
+
+        const size_t capacity = etl::dim<0>(samples);
+
+        keys.assign(capacity, npos);
+        variants.assign(capacity, npos);
+        prev.assign(capacity, npos);
+        next.assign(capacity, npos);
+        slots.assign(n, npos);
+    }
+
+    /*!
+     * \brief Copy the given variant of the given sample into target, if it is
+     * in the cache.
+     * \return true if the sample was in the cache, false otherwise
+     */
+    template <typename O>
+    bool get(size_t key, size_t variant, O&& target) {
+        std::lock_guard<std::mutex> l(lock);
+
+        const size_t slot = slots[key];
+
+        if (slot == npos || variants[slot] != variant) {
+            ++misses;
+            return false;
+        }
+
+        target = samples(slot);
+
+        unlink(slot);
+        push_front(slot);
+
+        ++hits;
+
+        return true;
+    }
+
+    /*!
+     * \brief Store the given variant of the given sample, evicting the least
+     * recently used sample if the cache is full.
+     */
+    template <typename I>
+    void put(size_t key, size_t variant, const I& sample) {
+        std::lock_guard<std::mutex> l(lock);
+
+        size_t slot = slots[key];
+
+        if (slot != npos) {
+            unlink(slot);
+        } else if (used < keys.size()) {
+            slot = used++;
+        } else {
+            slot = tail;
+
+            unlink(slot);
+            slots[keys[slot]] = npos;
+        }
+
+        keys[slot]     = key;
+        variants[slot] = variant;
+        slots[key]     = slot;
+
+        samples(slot) = sample;
+
+        push_front(slot);
+    }
+
+private:
+    /*!
+     * \brief Remove the given slot from the LRU list
+     */
+    void unlink(size_t slot) {
+        if (prev[slot] != npos) {
+            next[prev[slot]] = next[slot];
+        } else {
+            head = next[slot];
+        }
+
+        if (next[slot] != npos) {
+            prev[next[slot]] = prev[slot];
+        } else {
+            tail = prev[slot];
+        }
+
+        prev[slot] = npos;
+        next[slot] = npos;
+    }
+
+    /*!
+     * \brief Insert the given slot as the most recently used
+     */
+    void push_front(size_t slot) {
+        next[slot] = head;
+
+        if (head != npos) {
+            prev[head] = slot;
+        }
+
+        head = slot;
+
+        if (tail == npos) {
+            tail = slot;
+        }
+    }
+};
+
 /*!
  * \brief a in-memory data generator
  */
@@ -27,7 +294,7 @@ struct inmemory_data_generator;
  * \copydoc inmemory_data_generator
  */
 template <typename Iterator, typename LIterator, typename Desc>
-struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc>>> {
+struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_compact<Desc>>> {
     using desc                 = Desc;                                                              ///< The generator descriptor
     using weight               = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< The data type
     using data_cache_helper_t  = cache_helper<Desc, Iterator>;                                      ///< The helper for the data cache
@@ -36,21 +303,507 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     using data_cache_type  = typename data_cache_helper_t::cache_type;  ///< The type of the data cache
     using label_cache_type = typename label_cache_helper_t::cache_type; ///< The type of the label cache
 
-    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+
+    data_cache_type input_cache;  ///< The input cache
+    label_cache_type label_cache; ///< The label cache
+
+    // The following are only used with index_shuffle
+
+    std::vector<size_t> order;             ///< The order of the samples
+    mutable data_cache_type data_buffer;   ///< The gathered current data batch
+    mutable label_cache_type label_buffer; ///< The gathered current label batch
+    mutable size_t gathered = size_t(-1);  ///< The index of the gathered batch
+
+    // The following are only used with length_buckets
+
+    std::vector<size_t> lengths; ///< The length of the sequence of each sample
+    bool bucketed = false;       ///< Indicates if the order is sorted by length
+
+    size_t current      = 0;     ///< The current index
+    bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
+    bool labels_as_data = false; ///< Indicates if the labels are the data (the label cache is empty)
+
+    tracked_memory memory{memory_category::GENERATOR}; ///< The tracked memory of the caches
+
+    template <typename Input, typename Label>
+    inmemory_data_generator(const Input& input, const Label& label, size_t n, size_t n_classes){
+        labels_as_data = labels_are_inputs<desc, data_cache_type, label_cache_type>(&input, &label);
+
+        // Initialize both caches for enough elements
+        data_cache_helper_t::init(n, &input, input_cache);
+
+        if (!labels_as_data) {
+            label_cache_helper_t::init(n, n_classes, &label, label_cache);
+        }
+
+        init_index_shuffle(n, n_classes, &input, &label);
+
+        interleave_caches();
+    }
+
+    /*!
+     * \brief Construct an inmemory data generator
+     */
+    inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes){
+        const size_t n = std::distance(first, last);
+
+        labels_as_data = labels_are_inputs<desc, data_cache_type, label_cache_type>(first, lfirst);
+
+        data_cache_helper_t::init(n, first, input_cache);
+
+        if (!labels_as_data) {
+            label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        }
+
+        init_index_shuffle(n, n_classes, first, lfirst);
+
+        // Fill the cache, the samples are transformed as they are copied
+
+        fill_caches<desc, label_cache_helper_t>(first, lfirst, n, input_cache, label_cache, !labels_as_data);
+
+        interleave_caches();
+
+        cpp_unused(llast);
+    }
+
+    inmemory_data_generator(const inmemory_data_generator& rhs) = delete;
+    inmemory_data_generator operator=(const inmemory_data_generator& rhs) = delete;
+
+    inmemory_data_generator(inmemory_data_generator&& rhs) = delete;
+    inmemory_data_generator operator=(inmemory_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "In-Memory Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+
+        if (augmented_size() != size()) {
+            stream << "    Augmented Size: " << augmented_size() << std::endl;
+        }
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     *
+     * This is only done if the generator is marked as safe it is safe.
+     */
+    void clear() {
+        if (is_safe) {
+            input_cache.clear();
+            label_cache.clear();
+
+            if constexpr (desc::IndexShuffle > 0) {
+                data_buffer.clear();
+                label_buffer.clear();
+                order.clear();
+            }
+
+            memory.track(0);
+        }
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current  = 0;
+        gathered = size_t(-1);
+
+        // Without shuffle, the samples are simply sorted by length
+        if constexpr (desc::LengthBuckets) {
+            if (!bucketed) {
+                update_lengths();
+
+                std::iota(order.begin(), order.end(), 0);
+                std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return lengths[a] < lengths[b]; });
+
+                bucketed = true;
+            }
+        }
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        reset();
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        if constexpr (desc::LengthBuckets) {
+            update_lengths();
+
+            length_bucket_shuffle(order, lengths, batch_size, dll::random_engine());
+
+            bucketed = true;
+            gathered = size_t(-1);
+        } else if constexpr (desc::IndexShuffle > 0) {
+            block_shuffle(order, desc::IndexShuffle, dll::random_engine());
+
+            gathered = size_t(-1);
+        } else if (labels_as_data) {
+            etl::shuffle(input_cache, dll::random_engine());
+        } else {
+            etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        }
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch(){
+        input_cache.ensure_gpu_up_to_date();
+
+        if (!labels_as_data) {
+            label_cache.ensure_gpu_up_to_date();
+        }
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return etl::dim<0>(input_cache);
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     *
+     * This number may be an estimate, depending on which augmentation
+     * techniques are enabled.
+     *
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return etl::dim<0>(input_cache);
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        if constexpr (desc::IndexShuffle > 0) {
+            gather();
+            return etl::slice(data_buffer, 0, std::min(batch_size, size() - current));
+        } else {
+            return etl::slice(input_cache, current, std::min(current + batch_size, size()));
+        }
+    }
+
+    /*!
+     * \brief Returns the current label batch.
+     *
+     * When the labels are the data, this is the data batch.
+     *
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        if constexpr (std::is_same<data_cache_type, label_cache_type>::value) {
+            if (labels_as_data) {
+                return data_batch();
+            }
+        }
+
+        if constexpr (desc::IndexShuffle > 0) {
+            gather();
+            return etl::slice(label_buffer, 0, std::min(batch_size, size() - current));
+        } else {
+            return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        }
+    }
+
+    /*!
+     * \brief Set some part of the data to a new set of value
+     * \param i The beginning at which to start storing the new data
+     * \param input_batch An input batch
+     */
+    template <typename Input>
+    void set_data_batch(size_t i, Input&& input_batch) {
+        if constexpr (desc::IndexShuffle > 0) {
+            for (size_t j = 0; j < etl::dim<0>(input_batch); ++j) {
+                input_cache(order[i + j]) = input_batch(j);
+            }
+
+            gathered = size_t(-1);
+
+            // The lengths are computed again at the next reset
+            if constexpr (desc::LengthBuckets) {
+                lengths.clear();
+                bucketed = false;
+            }
+        } else {
+            etl::slice(input_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
+        }
+    }
+
+    /*!
+     * \brief Set some part of the labels to a new set of value.
+     *
+     * When the labels are the data, they are already set by
+     * set_data_batch and nothing is done.
+     *
+     * \param i The beginning at which to start storing the new data
+     * \param input_batch A label batch
+     */
+    template <typename Input>
+    void set_label_batch(size_t i, Input&& input_batch) {
+        if (labels_as_data) {
+            return;
+        }
+
+        if constexpr (desc::IndexShuffle > 0) {
+            for (size_t j = 0; j < etl::dim<0>(input_batch); ++j) {
+                label_cache(order[i + j]) = input_batch(j);
+            }
+
+            gathered = size_t(-1);
+        } else {
+            etl::slice(label_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
+        }
+    }
+
+    /*!
+     * \brief Finalize the dataset if it was filled directly after having being prepared.
+     */
+    void finalize_prepared_data() {
+        pre_scaler<desc>::transform_all(input_cache);
+        pre_normalizer<desc>::transform_all(input_cache);
+        pre_binarizer<desc>::transform_all(input_cache);
+
+        // In case of auto-encoders, the label images also need to be transformed
+        if constexpr (desc::AutoEncoder) {
+            if (!labels_as_data) {
+                pre_scaler<desc>::transform_all(label_cache);
+                pre_normalizer<desc>::transform_all(label_cache);
+                pre_binarizer<desc>::transform_all(label_cache);
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return etl::dimensions<data_cache_type>() - 1;
+    }
+
+private:
+    /*!
+     * \brief Interleave the caches on the NUMA nodes, if enabled
+     */
+    void interleave_caches() {
+        if (desc::Numa || numa_env().interleave) {
+            numa_interleave(input_cache.memory_start(), buffer_bytes(input_cache));
+
+            if (!labels_as_data) {
+                numa_interleave(label_cache.memory_start(), buffer_bytes(label_cache));
+            }
+        }
+    }
+
+    /*!
+     * \brief Initialize the order and the batch buffers of the index
+     * shuffle and track the memory of the generator
+     */
+    template <typename DIterator, typename LIt>
+    void init_index_shuffle(size_t n, size_t n_classes, DIterator first, LIt lfirst) {
+        if constexpr (desc::IndexShuffle > 0) {
+            data_cache_helper_t::init(batch_size, first, data_buffer);
+
+            if (!labels_as_data) {
+                label_cache_helper_t::init(batch_size, n_classes, lfirst, label_buffer);
+            }
+
+            order.resize(n);
+            std::iota(order.begin(), order.end(), 0);
+        } else {
+            cpp_unused(n);
+            cpp_unused(n_classes);
+            cpp_unused(first);
+            cpp_unused(lfirst);
+        }
+
+        memory.track(buffer_bytes(input_cache) + buffer_bytes(label_cache) + buffer_bytes(data_buffer) + buffer_bytes(label_buffer));
+    }
+
+    /*!
+     * \brief Compute the length of the sequence of each sample, if they
+     * are not already known
+     */
+    void update_lengths() {
+        if (lengths.size() != size()) {
+            lengths.resize(size());
+
+            for (size_t i = 0; i < size(); ++i) {
+                lengths[i] = sequence_length(input_cache(i));
+            }
+        }
+    }
+
+    /*!
+     * \brief Gather the samples of the current batch, in the shuffled
+     * order, into the batch buffers
+     */
+    void gather() const {
+        if (gathered != current) {
+            const size_t n = std::min(batch_size, size() - current);
+
+            for (size_t i = 0; i < n; ++i) {
+                data_buffer(i) = input_cache(order[current + i]);
+            }
+
+            data_buffer.invalidate_gpu();
+
+            if (!labels_as_data) {
+                for (size_t i = 0; i < n; ++i) {
+                    label_buffer(i) = label_cache(order[current + i]);
+                }
+
+                label_buffer.invalidate_gpu();
+            }
+
+            gathered = current;
+        }
+    }
+};
+
+/*!
+ * \brief An in-memory data generator storing its data cache with a compact
+ * storage type.
+ *
+ * The raw samples are narrowed in the cache. The samples of each batch are
+ * widened and pre-processed (scaling, normalization and binarization) when
+ * the batch is generated. Shuffling only changes the order in which the
+ * samples are read.
+ *
+ * With a compressed cache, the cache is compressed by blocks of samples. The
+ * shuffle keeps the samples of a block together and the blocks of the next
+ * batch are decompressed in background while the current batch is used.
+ */
+template <typename Iterator, typename LIterator, typename Desc>
+struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && is_compact<Desc>>> {
+    using desc                 = Desc;                                                              ///< The generator descriptor
+    using weight               = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< The data type
+    using data_cache_helper_t  = cache_helper<Desc, Iterator>;                                      ///< The helper for the data cache
+    using label_cache_helper_t = label_cache_helper<Desc, weight, LIterator>;                       ///< The helper for the label cache
+
+    using data_cache_type  = typename data_cache_helper_t::cache_type;  ///< The type of the data batches
+    using label_cache_type = typename label_cache_helper_t::cache_type; ///< The type of the label cache
+    using storage_t        = std::conditional_t<
+        (desc::CompressedBlock > 0),
+        compressed_storage<weight, desc::Storage, desc::CompressedBlock>,
+        compact_storage<weight, desc::Storage>>; ///< The type of the compact data cache
+
+    static constexpr bool compressed = desc::CompressedBlock > 0; ///< Indicates if the data cache is compressed
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+
+    storage_t input_cache;        ///< The compact input cache
+    label_cache_type label_cache; ///< The label cache
+
+    static_assert(!desc::LengthBuckets, "Length buckets are not supported with a compact data storage");
+
+    std::vector<size_t> order; ///< The order of the samples
 
-    static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+    mutable data_cache_type data_buffer;   ///< The widened current data batch
+    mutable label_cache_type label_buffer; ///< The current label batch
+    mutable size_t widened = size_t(-1);   ///< The index of the widened data batch
+    mutable size_t gathered = size_t(-1);  ///< The index of the gathered label batch
 
-    data_cache_type input_cache;  ///< The input cache
-    label_cache_type label_cache; ///< The label cache
+    size_t current      = 0;     ///< The current index
+    bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
+    bool labels_as_data = false; ///< Indicates if the labels are the data (the label cache is empty)
 
-    size_t current = 0;     ///< The current index
-    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+    tracked_memory memory{memory_category::GENERATOR}; ///< The tracked memory of the caches
 
     template <typename Input, typename Label>
     inmemory_data_generator(const Input& input, const Label& label, size_t n, size_t n_classes){
-        // Initialize both caches for enough elements
-        data_cache_helper_t::init(n, &input, input_cache);
-        label_cache_helper_t::init(n, n_classes, &label, label_cache);
+        init(n, n_classes, &input, &label);
     }
 
     /*!
@@ -59,33 +812,28 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes){
         const size_t n = std::distance(first, last);
 
-        data_cache_helper_t::init(n, first, input_cache);
-        label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        init(n, n_classes, first, lfirst);
 
         // Fill the cache
 
         size_t i = 0;
         while (first != last) {
-            input_cache(i) = *first;
+            input_cache.set(i, *first);
 
-            label_cache_helper_t::set(i, lfirst, label_cache);
+            if (!labels_as_data) {
+                label_cache_helper_t::set(i, lfirst, label_cache);
+            }
 
             ++i;
             ++first;
             ++lfirst;
         }
 
-        // Transform if necessary
+        finalize_prepared_data();
 
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
-
-        // In case of auto-encoders, the label images also need to be transformed
-        if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
+        // The compressed size is only known once the cache is filled
+        if constexpr (compressed) {
+            track_memory();
         }
 
         cpp_unused(llast);
@@ -103,12 +851,13 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return stream
      */
     std::ostream& display(std::ostream& stream) const {
-        stream << "In-Memory Data Generator" << std::endl;
+        stream << "In-Memory Data Generator (compact)" << std::endl;
         stream << "              Size: " << size() << std::endl;
         stream << "           Batches: " << batches() << std::endl;
+        stream << "             Cache: " << input_cache.bytes() / 1024 << "KiB" << std::endl;
 
-        if (augmented_size() != size()) {
-            stream << "    Augmented Size: " << augmented_size() << std::endl;
+        if constexpr (compressed) {
+            stream << "      Uncompressed: " << input_cache.raw_bytes() / 1024 << "KiB" << std::endl;
         }
 
         return stream;
@@ -138,6 +887,9 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         if (is_safe) {
             input_cache.clear();
             label_cache.clear();
+            order.clear();
+
+            memory.track(0);
         }
     }
 
@@ -160,13 +912,14 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      */
     void reset() {
         current = 0;
+        widened = gathered = size_t(-1);
     }
 
     /*!
      * \brief Reset the generator and shuffle the order of samples
      */
     void reset_shuffle() {
-        current = 0;
+        reset();
         shuffle();
     }
 
@@ -178,15 +931,21 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     void shuffle() {
         cpp_assert(!current, "Shuffle should only be performed on start of generation");
 
-        etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        // The samples of a compressed block are read together
+        if constexpr (compressed) {
+            block_shuffle(order, desc::CompressedBlock, dll::random_engine());
+        } else {
+            std::shuffle(order.begin(), order.end(), dll::random_engine());
+        }
+
+        widened = gathered = size_t(-1);
     }
 
     /*!
      * \brief Prepare the dataset for an epoch
      */
     void prepare_epoch(){
-        input_cache.ensure_gpu_up_to_date();
-        label_cache.ensure_gpu_up_to_date();
+        // Nothing can be done here
     }
 
     /*!
@@ -202,19 +961,15 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return The number of elements in the generator
      */
     size_t size() const {
-        return etl::dim<0>(input_cache);
+        return order.size();
     }
 
     /*!
      * \brief Returns the augmented number of elements in the generator.
-     *
-     * This number may be an estimate, depending on which augmentation
-     * techniques are enabled.
-     *
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return etl::dim<0>(input_cache);
+        return size();
     }
 
     /*!
@@ -247,15 +1002,67 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return a a batch of data.
      */
     auto data_batch() const {
-        return etl::slice(input_cache, current, std::min(current + batch_size, size()));
+        const size_t n = std::min(batch_size, size() - current);
+
+        if (widened != current) {
+            const size_t sample_size = etl::size(data_buffer) / batch_size;
+
+            cpu_access(data_buffer);
+
+            for (size_t i = 0; i < n; ++i) {
+                input_cache.get(order[current + i], data_buffer.memory_start() + i * sample_size);
+            }
+
+            // The samples must be marked before the pre-processing, which may run on the GPU
+            cpu_modified(data_buffer);
+
+            for (size_t i = 0; i < n; ++i) {
+                pre_scaler<desc>::transform(data_buffer(i));
+                pre_normalizer<desc>::transform(data_buffer(i));
+                pre_binarizer<desc>::transform(data_buffer(i));
+            }
+
+            widened = current;
+
+            // The blocks of the next batch are decompressed while this one is used
+            if constexpr (compressed) {
+                const size_t next = current + batch_size;
+
+                if (next < size()) {
+                    input_cache.prefetch(order[next]);
+                    input_cache.prefetch(order[std::min(next + batch_size, size()) - 1]);
+                }
+            }
+        }
+
+        return etl::slice(data_buffer, 0, n);
     }
 
     /*!
-     * \brief Returns the current label batch
+     * \brief Returns the current label batch.
+     *
+     * When the labels are the data, this is the widened data batch.
+     *
      * \return a a batch of label.
      */
     auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        if constexpr (std::is_same<data_cache_type, label_cache_type>::value) {
+            if (labels_as_data) {
+                return data_batch();
+            }
+        }
+
+        const size_t n = std::min(batch_size, size() - current);
+
+        if (gathered != current) {
+            for (size_t i = 0; i < n; ++i) {
+                label_buffer(i) = label_cache(order[current + i]);
+            }
+
+            gathered = current;
+        }
+
+        return etl::slice(label_buffer, 0, n);
     }
 
     /*!
@@ -265,7 +1072,11 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      */
     template <typename Input>
     void set_data_batch(size_t i, Input&& input_batch) {
-        etl::slice(input_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
+        cpu_access(input_batch);
+
+        input_cache.set(i, input_batch);
+
+        widened = size_t(-1);
     }
 
     /*!
@@ -275,22 +1086,30 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      */
     template <typename Input>
     void set_label_batch(size_t i, Input&& input_batch) {
+        // The labels are the data, already set by set_data_batch
+        if (labels_as_data) {
+            return;
+        }
+
         etl::slice(label_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
+
+        gathered = size_t(-1);
     }
 
     /*!
      * \brief Finalize the dataset if it was filled directly after having being prepared.
+     *
+     * The data are pre-processed when they are widened, only the labels
+     * need to be transformed.
      */
     void finalize_prepared_data() {
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
-
         // In case of auto-encoders, the label images also need to be transformed
         if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
+            if (!labels_as_data) {
+                pre_scaler<desc>::transform_all(label_cache);
+                pre_normalizer<desc>::transform_all(label_cache);
+                pre_binarizer<desc>::transform_all(label_cache);
+            }
         }
     }
 
@@ -301,6 +1120,42 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     static constexpr size_t dimensions() {
         return etl::dimensions<data_cache_type>() - 1;
     }
+
+private:
+    /*!
+     * \brief Initialize the caches and the buffers for n samples
+     */
+    template <typename DIterator, typename LIt>
+    void init(size_t n, size_t n_classes, DIterator first, LIt lfirst) {
+        labels_as_data = labels_are_inputs<desc, data_cache_type, label_cache_type>(first, lfirst);
+
+        data_cache_helper_t::init(batch_size, first, data_buffer);
+
+        if (!labels_as_data) {
+            label_cache_helper_t::init(batch_size, n_classes, lfirst, label_buffer);
+            label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        }
+
+        input_cache.init(n, etl::size(data_buffer) / batch_size);
+
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
+
+        track_memory();
+    }
+
+    /*!
+     * \brief Track the memory of the caches and the buffers
+     */
+    void track_memory() {
+        size_t bytes = input_cache.bytes() + buffer_bytes(label_cache) + buffer_bytes(data_buffer) + buffer_bytes(label_buffer);
+
+        if constexpr (compressed) {
+            bytes += input_cache.decoded_bytes();
+        }
+
+        memory.track(bytes);
+    }
 };
 
 /*!
@@ -313,14 +1168,43 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     using data_cache_helper_t  = cache_helper<desc, Iterator>;                ///< The helper for the data cache
     using label_cache_helper_t = label_cache_helper<desc, weight, LIterator>; ///< The helper for the label cache
 
-    using data_cache_type  = typename data_cache_helper_t::cache_type;     ///< The type of the data cache
-    using big_cache_type   = typename data_cache_helper_t::big_cache_type; ///< The type of big data cache
-    using label_cache_type = typename label_cache_helper_t::cache_type;    ///< The type of the label cache
+    using data_cache_type      = typename data_cache_helper_t::cache_type;      ///< The type of the data cache
+    using big_cache_type       = typename data_cache_helper_t::big_cache_type;  ///< The type of big data cache
+    using label_cache_type     = typename label_cache_helper_t::cache_type;     ///< The type of the label cache
+    using big_label_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
 
     static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
 
-    static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
-    static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
+    static constexpr size_t batch_size = desc::BatchSize;           ///< The size of the generated batches
+    static constexpr size_t threads    = desc::AugmentationThreads; ///< The number of augmentation threads
+    static constexpr size_t reuse      = desc::AugmentReuse;        ///< The number of epochs an augmented sample is reused (0 to disable the cache)
+
+    static_assert(!is_compact<Desc>, "Compact data storage is not supported with data augmentation");
+    static_assert(!desc::LengthBuckets, "Length buckets are not supported with data augmentation");
+
+    /*!
+     * \brief An augmentation thread.
+     *
+     * The worker w fills the batches b such that b % threads == w, which
+     * are always stored in the same slots of the big batch cache.
+     */
+    struct augment_worker {
+        random_cropper<Desc> cropper;      ///< The random cropper
+        random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
+        elastic_distorter<Desc> distorter; ///< The elastic distorter
+        random_noise<Desc> noiser;         ///< The random noiser
+
+        spsc_ring ring;     ///< The ring synchronizing the batches of the worker
+        std::thread thread; ///< The thread of the worker
+
+        /*!
+         * \brief Construct a new worker with the augmenters of the given generator
+         */
+        explicit augment_worker(const inmemory_data_generator& generator)
+                : cropper(generator.cropper), mirrorer(generator.mirrorer), distorter(generator.distorter), noiser(generator.noiser), ring(generator.big_batch_size / threads) {}
+    };
+
+    const size_t big_batch_size; ///< The number of batches kept in cache
 
     data_cache_type input_cache;  ///< The data cache
     big_cache_type batch_cache;   ///< The data batch cache
@@ -331,148 +1215,65 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     elastic_distorter<Desc> distorter; ///< The elastic distorter
     random_noise<Desc> noiser;         ///< The random noiser
 
+    // The following are only used with augment_cache
 
-    size_t current = 0;     ///< The current index
-    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
-
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
+    std::vector<size_t> order;                     ///< The order of the samples
+    big_label_cache_type label_batch_cache;        ///< The label batch cache
+    augmentation_cache<data_cache_type> augmented; ///< The cache of the augmented samples
 
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
-    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
+    size_t current      = 0;     ///< The current index
+    bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
+    bool labels_as_data = false; ///< Indicates if the labels are the (not augmented) data
 
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
+    std::vector<std::unique_ptr<augment_worker>> workers; ///< The augmentation threads
+    std::atomic<bool> train_mode{false};                  ///< The train mode status
+    thread_reservation reservation{threads};              ///< The threads of the budget used by the augmentation
 
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    tracked_memory memory{memory_category::GENERATOR}; ///< The tracked memory of the caches
 
     /*!
      * \brief Construct an inmemory data generator
      */
     inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes)
-            : cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
+            : big_batch_size(cached_batches(first, lfirst, n_classes, std::distance(first, last))), cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
         const size_t n = std::distance(first, last);
 
-        data_cache_helper_t::init(n, first, input_cache);
-        data_cache_helper_t::init_big(first, batch_cache);
+        // The labels of a denoising auto-encoder are the data, before noise
+        labels_as_data = labels_are_inputs<desc, data_cache_type, label_cache_type>(first, lfirst);
 
-        label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        data_cache_helper_t::init(n, first, input_cache);
+        data_cache_helper_t::init_big(first, batch_cache, big_batch_size);
 
-        // Fill the cache
+        if (!labels_as_data) {
+            label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        }
 
-        size_t i = 0;
-        while (first != last) {
-            input_cache(i) = *first;
+        // Fill the cache, the samples are transformed as they are copied
 
-            label_cache_helper_t::set(i, lfirst, label_cache);
+        fill_caches<desc, label_cache_helper_t>(first, lfirst, n, input_cache, label_cache, !labels_as_data);
 
-            ++i;
-            ++first;
-            ++lfirst;
-        }
+        if constexpr (reuse > 0) {
+            order.resize(n);
+            std::iota(order.begin(), order.end(), 0);
 
-        // Transform if necessary
+            label_cache_helper_t::init_big(n_classes, lfirst, label_batch_cache, big_batch_size);
 
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
+            const size_t capacity = desc::AugmentCacheSize ? std::min(desc::AugmentCacheSize, n) : n;
 
-        // In case of auto-encoders, the label images also need to be transformed
-        if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
+            augmented.init(n, augmented_storage(capacity, std::make_index_sequence<dimensions()>()));
         }
 
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
-        }
+        memory.track(buffer_bytes(input_cache) + buffer_bytes(batch_cache) + buffer_bytes(label_cache) + buffer_bytes(label_batch_cache) + buffer_bytes(augmented.samples));
 
         cpp_unused(llast);
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    bool found = false;
-
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < size()) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
-
-                    // if not found, wait for a ready to compute batch
-
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
-
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < size()) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
-
-                            return false;
-                        });
-
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
-                }
-
-                // Get the batch that needs to be read
-                const size_t batch = indices[index];
-
-                // Get the index from where to read inside the input cache
-                const size_t input_n = batch * batch_size;
-
-                for (size_t i = 0; i < batch_size && input_n + i < size(); ++i) {
-                    if (train_mode) {
-                        // Random crop the image
-                        cropper.transform_first(batch_cache(index)(i), input_cache(input_n + i));
-
-                        // Mirror the image
-                        mirrorer.transform(batch_cache(index)(i));
-
-                        // Distort the image
-                        distorter.transform(batch_cache(index)(i));
-
-                        // Noise the image
-                        noiser.transform(batch_cache(index)(i));
-                    } else {
-                        // Center crop the image
-                        cropper.transform_first_test(batch_cache(index)(i), input_cache(input_n + i));
-                    }
-                }
-
-                // Notify a waiter that one batch is ready
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    status[index] = true;
+        for (size_t w = 0; w < threads; ++w) {
+            workers.emplace_back(std::make_unique<augment_worker>(*this));
+        }
 
-                    ready_condition.notify_one();
-                }
-            }
-        });
+        for (size_t w = 0; w < threads; ++w) {
+            workers[w]->thread = std::thread([this, w] { augment(w); });
+        }
     }
 
     inmemory_data_generator(const inmemory_data_generator& rhs) = delete;
@@ -490,6 +1291,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
         stream << "In-Memory Data Generator" << std::endl;
         stream << "              Size: " << size() << std::endl;
         stream << "           Batches: " << batches() << std::endl;
+        stream << "    Cached Batches: " << big_batch_size << std::endl;
 
         if (augmented_size() != size()) {
             stream << "    Augmented Size: " << augmented_size() << std::endl;
@@ -523,6 +1325,10 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
             input_cache.clear();
             batch_cache.clear();
             label_cache.clear();
+            label_batch_cache.clear();
+            augmented.samples.clear();
+
+            memory.track(0);
         }
     }
 
@@ -544,25 +1350,22 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \brief Destructs the inmemory_data_generator
      */
     ~inmemory_data_generator() {
-        cpp::with_lock(main_lock, [this] { stop_flag = true; });
-
-        condition.notify_all();
+        for (auto& worker : workers) {
+            worker->ring.stop();
+        }
 
-        main_thread.join();
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
     }
 
     /*!
      * \brief Reset the generation to its beginning
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
+        for (auto& worker : workers) {
+            worker->ring.reset();
         }
-
-        condition.notify_one();
     }
 
     /*!
@@ -590,7 +1393,14 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     void shuffle() {
         cpp_assert(!current, "Shuffle should only be performed on start of generation");
 
-        etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        // The cached samples are found by their index, the cache is not moved
+        if constexpr (reuse > 0) {
+            block_shuffle(order, 1, dll::random_engine());
+        } else if (labels_as_data) {
+            etl::shuffle(input_cache, dll::random_engine());
+        } else {
+            etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        }
     }
 
     /*!
@@ -650,18 +1460,12 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * This should only be called if the generator has a next batch.
      */
     void next_batch() {
-        // Get information from batch that has been consumed
         const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
 
-            status[b] = false;
-            indices[b] += big_batch_size;
-
-            condition.notify_one();
-        }
+        // Give back the slot of the consumed batch to its worker
+        auto& ring = workers[batch % threads]->ring;
+        ring.consumer_wait(batch / threads);
+        ring.consumer_release();
 
         current += batch_size;
     }
@@ -671,32 +1475,12 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return a a batch of data.
      */
     auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
         const auto b     = batch % big_batch_size;
 
-        if (status[b]) {
-            const auto input_n = indices[b] * batch_size + batch_size;
-
-            if (input_n > size()) {
-                return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
-            } else {
-                return etl::slice(batch_cache(b), 0, batch_size);
-            }
-        }
-
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        workers[batch % threads]->ring.consumer_wait(batch / threads);
 
-        const auto input_n = indices[b] * batch_size + batch_size;
-
-        if (input_n > size()) {
-            return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
-        } else {
-            return etl::slice(batch_cache(b), 0, batch_size);
-        }
+        return etl::slice(batch_cache(b), 0, std::min(batch_size, size() - current));
     }
 
     /*!
@@ -704,7 +1488,22 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return a a batch of label.
      */
     auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        if constexpr (reuse > 0) {
+            const auto batch = current / batch_size;
+
+            // The labels are gathered by the worker, in the order of the samples
+            workers[batch % threads]->ring.consumer_wait(batch / threads);
+
+            return etl::slice(label_batch_cache(batch % big_batch_size), 0, std::min(batch_size, size() - current));
+        } else {
+            if constexpr (std::is_same<data_cache_type, label_cache_type>::value) {
+                if (labels_as_data) {
+                    return etl::slice(input_cache, current, std::min(current + batch_size, size()));
+                }
+            }
+
+            return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        }
     }
 
     /*!
@@ -714,16 +1513,152 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     static constexpr size_t dimensions() {
         return etl::dimensions<data_cache_type>() - 1;
     }
+
+private:
+    /*!
+     * \brief Returns the number of batches to keep in cache
+     * \param first An iterator to the first sample
+     * \param lfirst An iterator to the first label
+     * \param n_classes The number of classes
+     * \param n The number of samples
+     */
+    static size_t cached_batches(Iterator first, LIterator lfirst, size_t n_classes, size_t n) {
+        big_cache_type data;
+        big_label_cache_type labels;
+
+        // The caches of one batch give the size of a cached batch
+        data_cache_helper_t::init_big(first, data, 1);
+
+        if constexpr (reuse > 0) {
+            label_cache_helper_t::init_big(n_classes, lfirst, labels, 1);
+        } else {
+            cpp_unused(lfirst);
+            cpp_unused(n_classes);
+        }
+
+        return big_batch_cache_size<desc>(buffer_bytes(data) + buffer_bytes(labels), (n + batch_size - 1) / batch_size, threads);
+    }
+
+    /*!
+     * \brief Create the storage of the cache of augmented samples, with the
+     * dimensions of the augmented samples
+     * \param capacity The number of cached samples
+     */
+    template <size_t... I>
+    data_cache_type augmented_storage(size_t capacity, std::index_sequence<I...> /*seq*/) const {
+        return data_cache_type(capacity, etl::dim(batch_cache, I + 2)...);
+    }
+
+    /*!
+     * \brief Augment one sample
+     * \param worker The augmentation worker
+     * \param target The augmented sample
+     * \param source The input sample
+     * \param g The random engine
+     */
+    template <typename O, typename I>
+    static void augment_sample(augment_worker& worker, O&& target, const I& source, dll::random_engine& g) {
+        // Random crop and mirror the image, in a single pass
+        worker.cropper.transform_first_mirror(target, source, worker.mirrorer, g);
+
+        // Distort the image
+        worker.distorter.transform(target, g);
+
+        // Noise the image
+        worker.noiser.transform(target, g);
+    }
+
+    /*!
+     * \brief The main loop of the augmentation thread w.
+     *
+     * Each sample is augmented with its own random engine, seeded from the
+     * DLL seed, the generation and the index of the sample, so that the
+     * augmented data does not depend on the number of threads.
+     *
+     * \param w The index of the worker
+     */
+    void augment(size_t w) {
+        auto& worker = *workers[w];
+
+        // The augmentation runs concurrently with the training, avoid oversubscription
+        worker_section section;
+
+        // The number of batches produced by this worker per generation
+        const size_t limit = (batches() + threads - 1 - w) / threads;
+
+        size_t generation = 0;
+
+        while (true) {
+            // Wait for a free slot in the batch cache
+            const size_t item = worker.ring.producer_acquire(limit, [&generation] { ++generation; });
+
+            // If there is no more work for the thread, exit
+            if (item == size_t(-1)) {
+                return;
+            }
+
+            const size_t batch = item * threads + w;
+
+            // The index of the batch inside the batch cache
+            const size_t index = batch % big_batch_size;
+
+            // Get the index from where to read inside the input cache
+            const size_t input_n = batch * batch_size;
+
+            for (size_t i = 0; i < batch_size && input_n + i < size(); ++i) {
+                // Without the cache, the samples are moved by the shuffle
+                const size_t id = reuse > 0 ? order[input_n + i] : input_n + i;
+
+                if constexpr (reuse > 0) {
+                    if (labels_as_data) {
+                        label_batch_cache(index)(i) = input_cache(id);
+                    } else {
+                        label_batch_cache(index)(i) = label_cache(id);
+                    }
+                }
+
+                if (train_mode) {
+                    if constexpr (reuse > 0) {
+                        // The variant is seeded by the sample, not by its position
+                        const size_t variant = generation / reuse;
+
+                        if (!augmented.get(id, variant, batch_cache(index)(i))) {
+                            std::seed_seq seq{dll::seed(), variant, id};
+                            dll::random_engine g(seq);
+
+                            augment_sample(worker, batch_cache(index)(i), input_cache(id), g);
+
+                            augmented.put(id, variant, batch_cache(index)(i));
+                        }
+                    } else {
+                        std::seed_seq seq{dll::seed(), generation, id};
+                        dll::random_engine g(seq);
+
+                        augment_sample(worker, batch_cache(index)(i), input_cache(id), g);
+                    }
+                } else {
+                    // Center crop the image
+                    worker.cropper.transform_first_test(batch_cache(index)(i), input_cache(id));
+                }
+            }
+
+            // Notify the reader that one batch is ready
+            worker.ring.producer_publish();
+        }
+    }
 };
 
 template <typename Iterator, typename LIterator, typename Desc>
-const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc>>>::batch_size;
+const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_compact<Desc>>>::batch_size;
+
+template <typename Iterator, typename LIterator, typename Desc>
+const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && is_compact<Desc>>>::batch_size;
 
 template <typename Iterator, typename LIterator, typename Desc>
 const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc>>>::batch_size;
 
 template <typename Iterator, typename LIterator, typename Desc>
-const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc>>>::big_batch_size;
+const size_t inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc>>>::threads;
 
 /*!
  * \brief Display the given generator on the given stream
@@ -756,11 +1691,26 @@ struct inmemory_data_generator_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The memory budget of the cached batches of the threaded generators, in MB (0 to use the big batch size)
+     */
+    static constexpr size_t BigBatchBudget = detail::get_value_v<big_batch_budget<0>, Parameters...>;
+
+    /*!
+     * \brief The percentage of the available memory for the cached batches of the threaded generators (0 to use the big batch size)
+     */
+    static constexpr size_t BigBatchFreeMemory = detail::get_value_v<big_batch_free_memory<0>, Parameters...>;
+
     /*!
      * \brief Indicates if the generators must make the labels categorical
      */
     static constexpr bool Categorical = parameters::template contains<categorical>();
 
+    /*!
+     * \brief Indicates if the categorical labels are kept as class indices
+     */
+    static constexpr bool SparseLabels = parameters::template contains<sparse_labels>();
+
     /*!
      * \brief Indicates if horizontal mirroring should be used as augmentation.
      */
@@ -791,6 +1741,11 @@ struct inmemory_data_generator_desc {
      */
     static constexpr size_t Noise = detail::get_value_v<noise<0>, Parameters...>;
 
+    /*!
+     * \brief The number of augmentation threads
+     */
+    static constexpr size_t AugmentationThreads = detail::get_value_v<augmentation_threads<1>, Parameters...>;
+
     /*!
      * \brief The scaling
      */
@@ -811,16 +1766,65 @@ struct inmemory_data_generator_desc {
      */
     static constexpr bool AutoEncoder = parameters::template contains<autoencoder>();
 
+    /*!
+     * \brief Indicates if the caches are filled in parallel
+     */
+    static constexpr bool Threaded = parameters::template contains<threaded>();
+
+    /*!
+     * \brief The storage type of the data cache
+     */
+    static constexpr storage_type Storage = detail::get_value_v<data_storage<storage_type::NATIVE>, Parameters...>;
+
+    /*!
+     * \brief The number of samples of the compressed blocks of the data
+     * cache (0 to disable the compression)
+     */
+    static constexpr size_t CompressedBlock = detail::get_value_v<compressed_cache<0>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the batches are made of sequences of similar lengths
+     */
+    static constexpr bool LengthBuckets = parameters::template contains<length_buckets>();
+
+    /*!
+     * \brief The block size of the index shuffle (0 to move the samples)
+     *
+     * The length buckets always use the index shuffle.
+     */
+    static constexpr size_t IndexShuffle = std::max(detail::get_value_v<index_shuffle<0>, Parameters...>, size_t(LengthBuckets ? 1 : 0));
+
+    /*!
+     * \brief Indicates if the data cache is interleaved on the NUMA nodes
+     */
+    static constexpr bool Numa = parameters::template contains<numa>();
+
+    /*!
+     * \brief The number of epochs an augmented sample is reused (0 to disable the cache)
+     */
+    static constexpr size_t AugmentReuse = detail::get_value_1<augment_cache<0, 0>, Parameters...>::value;
+
+    /*!
+     * \brief The maximum number of cached augmented samples (0 for the whole dataset)
+     */
+    static constexpr size_t AugmentCacheSize = detail::get_value_2<augment_cache<0, 0>, Parameters...>::value;
+
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(BigBatchFreeMemory <= 100, "The cached batches cannot use more than the available memory");
+    static_assert(AugmentationThreads > 0, "There must be at least one augmentation thread");
+    static_assert(BigBatchBudget || BigBatchFreeMemory || BigBatchSize % AugmentationThreads == 0, "The big batch size must be a multiple of the number of augmentation threads");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
+    static_assert(!CompressedBlock || Storage != storage_type::NATIVE, "compressed_cache needs a compact data_storage");
+    static_assert(!CompressedBlock || CompressedBlock >= BatchSize, "The compressed blocks must be at least as large as a batch");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
-                batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id, elastic_distortion_id,
-                categorical_id, noise_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                batch_size_id, big_batch_size_id, big_batch_budget_id, big_batch_free_memory_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id, elastic_distortion_id,
+                categorical_id, sparse_labels_id, noise_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, augmentation_threads_id,
+                data_storage_id, index_shuffle_id, length_buckets_id, numa_id, threaded_id, augment_cache_id, compressed_cache_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
@@ -21,7 +21,7 @@ struct label_cache_helper;
  * This version makes the label categorical.
  */
 template <typename Desc, typename T, typename LIterator>
-struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
+struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical && !Desc::SparseLabels && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
     using cache_type     = etl::dyn_matrix<T, 2>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 3>; ///< The type of the big cache
 
@@ -47,9 +47,10 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical
      * \param n_classes The number of classes
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param batches The number of batches of the big cache
      */
-    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache) {
-        cache = big_cache_type(big_batch_size, batch_size, n_classes);
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache, size_t batches = big_batch_size) {
+        cache = big_cache_type(batches, batch_size, n_classes);
 
         cpp_unused(it);
     }
@@ -70,10 +71,11 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical
 /*!
  * \brief Helper to create and initialize a cache for labels.
  *
- * This version keeps the flat label as such.
+ * This version keeps the flat label as such. With sparse labels, the
+ * categorical labels are also kept as such, as class indices.
  */
 template <typename Desc, typename T, typename LIterator>
-struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<!Desc::Categorical && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
+struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<(!Desc::Categorical || Desc::SparseLabels) && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
     using cache_type     = etl::dyn_matrix<T, 1>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 2>; ///< The type of the big cache
 
@@ -99,9 +101,10 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<!Desc::Categorica
      * \param n_classes The number of classes
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param batches The number of batches of the big cache
      */
-    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache) {
-        cache = big_cache_type(big_batch_size, batch_size);
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache, size_t batches = big_batch_size) {
+        cache = big_cache_type(batches, batch_size);
 
         cpp_unused(it);
         cpp_unused(n_classes);
@@ -154,10 +157,11 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<etl::is_1d<typena
      * \param n_classes The number of classes
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param batches The number of batches of the big cache
      */
-    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache) {
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache, size_t batches = big_batch_size) {
         auto one = *it;
-        cache    = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one));
+        cache    = big_cache_type(batches, batch_size, etl::dim<0>(one));
 
         cpp_unused(it);
         cpp_unused(n_classes);
@@ -210,10 +214,11 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<etl::is_3d<typena
      * \param n_classes The number of classes
      * \param it An iterator to an element
      * \param cache The big cache to initialize
+     * \param batches The number of batches of the big cache
      */
-    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache) {
+    static void init_big(size_t n_classes, const LIterator& it, big_cache_type& cache, size_t batches = big_batch_size) {
         auto one = *it;
-        cache    = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+        cache    = big_cache_type(batches, batch_size, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
 
         cpp_unused(it);
         cpp_unused(n_classes);
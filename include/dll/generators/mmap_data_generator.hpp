@@ -0,0 +1,704 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Binary dataset format and a data generator reading it through a
+ * memory mapping.
+ *
+ * The file is made of a header, followed by the samples stored
+ * contiguously and then by the labels (one 32 bits integer per sample).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "dll/util/async_reader.hpp"
+#include "dll/util/mapped_file.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The header of a DLL binary dataset file
+ */
+struct binary_dataset_header {
+    static constexpr size_t max_dimensions = 4;  ///< The maximum number of dimensions of a sample
+    static constexpr size_t alignment      = 64; ///< The alignment of the sections
+
+    char magic[4]                  = {'D', 'L', 'L', 'D'}; ///< The magic number of the format
+    uint32_t version               = 1;                    ///< The version of the format
+    uint32_t dtype                 = 0;                    ///< The type of the values (0: float, 1: double)
+    uint32_t dimensions            = 0;                    ///< The number of dimensions of a sample
+    uint64_t samples               = 0;                    ///< The number of samples
+    uint64_t shape[max_dimensions] = {};                   ///< The shape of a sample
+    uint64_t data_offset           = 0;                    ///< The offset of the samples in the file
+    uint64_t labels_offset         = 0;                    ///< The offset of the labels in the file
+
+    /*!
+     * \brief Returns the number of values of a sample
+     */
+    size_t sample_size() const {
+        return std::accumulate(shape, shape + dimensions, size_t(1), std::multiplies<size_t>());
+    }
+
+    /*!
+     * \brief Indicates if the header is a valid DLL binary header
+     */
+    bool valid() const {
+        return !std::memcmp(magic, "DLLD", 4) && version == 1 && dimensions > 0 && dimensions <= max_dimensions;
+    }
+};
+
+/*!
+ * \brief Return the binary type tag of the given value type
+ */
+template <typename T>
+constexpr uint32_t binary_dtype() {
+    static_assert(std::is_same<T, float>::value || std::is_same<T, double>::value, "Binary datasets only support float and double");
+
+    return std::is_same<T, float>::value ? 0 : 1;
+}
+
+/*!
+ * \brief Write a dataset in the DLL binary format.
+ *
+ * All the samples must have the same shape. The pre-processing steps
+ * (scaling, normalization, ...) must be done before since the generator
+ * serves the values as they are in the file.
+ *
+ * \param path The path of the file to write
+ * \param samples The container of samples
+ * \param labels The container of labels
+ *
+ * \return true if the dataset was written, false otherwise
+ */
+template <typename Container, typename LContainer>
+bool write_binary_dataset(const std::string& path, const Container& samples, const LContainer& labels) {
+    using sample_t = std::decay_t<decltype(*std::begin(samples))>;
+    using T        = etl::value_t<sample_t>;
+
+    constexpr size_t D = etl::decay_traits<sample_t>::dimensions();
+
+    static_assert(D <= binary_dataset_header::max_dimensions, "Too many dimensions for the binary format");
+
+    if (samples.empty() || samples.size() != labels.size()) {
+        std::cerr << "ERROR: Invalid dataset for binary dump: " << path << std::endl;
+        return false;
+    }
+
+    auto align = [](size_t offset) {
+        return (offset + binary_dataset_header::alignment - 1) / binary_dataset_header::alignment * binary_dataset_header::alignment;
+    };
+
+    binary_dataset_header header;
+    header.dtype      = binary_dtype<T>();
+    header.dimensions = D;
+    header.samples    = samples.size();
+
+    for (size_t d = 0; d < D; ++d) {
+        header.shape[d] = etl::dim(*std::begin(samples), d);
+    }
+
+    const size_t sample_size = header.sample_size();
+
+    header.data_offset   = align(sizeof(binary_dataset_header));
+    header.labels_offset = align(header.data_offset + header.samples * sample_size * sizeof(T));
+
+    std::ofstream os(path, std::ofstream::binary);
+
+    if (!os) {
+        std::cerr << "ERROR: Impossible to open the binary dataset: " << path << std::endl;
+        return false;
+    }
+
+    auto pad = [&os](size_t offset) {
+        while (size_t(os.tellp()) < offset) {
+            os.put(0);
+        }
+    };
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad(header.data_offset);
+
+    std::vector<T> buffer(sample_size);
+
+    for (auto& sample : samples) {
+        if (etl::size(sample) != sample_size) {
+            std::cerr << "ERROR: All the samples must have the same shape: " << path << std::endl;
+            return false;
+        }
+
+        std::copy(sample.begin(), sample.end(), buffer.begin());
+        os.write(reinterpret_cast<const char*>(buffer.data()), sample_size * sizeof(T));
+    }
+
+    pad(header.labels_offset);
+
+    for (auto& label : labels) {
+        const uint32_t value = label;
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    return bool(os);
+}
+
+/*!
+ * \brief Incremental writer of a dataset in the DLL binary format.
+ *
+ * The number of samples and their shape must be known in advance, the
+ * samples are then appended batch per batch. The labels are all zero.
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct binary_dataset_writer {
+    std::string path;             ///< The path of the file
+    std::ofstream os;             ///< The output stream
+    binary_dataset_header header; ///< The header of the dataset
+    size_t written = 0;           ///< The number of samples already written
+
+    /*!
+     * \brief Create the given binary dataset
+     * \param path The path of the file to write
+     * \param one One sample, to get the shape of the samples
+     * \param samples The number of samples of the dataset
+     */
+    template <typename Sample>
+    binary_dataset_writer(const std::string& path, const Sample& one, size_t samples) : path(path), os(path, std::ofstream::binary) {
+        constexpr size_t D = etl::decay_traits<Sample>::dimensions();
+
+        static_assert(D <= binary_dataset_header::max_dimensions, "Too many dimensions for the binary format");
+
+        header.dtype      = binary_dtype<T>();
+        header.dimensions = D;
+        header.samples    = samples;
+
+        for (size_t d = 0; d < D; ++d) {
+            header.shape[d] = etl::dim(one, d);
+        }
+
+        header.data_offset   = align(sizeof(binary_dataset_header));
+        header.labels_offset = align(header.data_offset + samples * header.sample_size() * sizeof(T));
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open the binary dataset: " << path << std::endl;
+            return;
+        }
+
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        pad(header.data_offset);
+    }
+
+    /*!
+     * \brief Append a batch of samples to the dataset
+     * \param batch The batch of samples
+     */
+    template <typename Batch>
+    void append(const Batch& batch) {
+        const size_t n = etl::dim<0>(batch);
+
+        cpp_assert(written + n <= header.samples, "Too many samples for the binary dataset");
+        cpp_assert(etl::size(batch) == n * header.sample_size(), "Invalid shape for the binary dataset");
+
+        std::vector<T> buffer(etl::size(batch));
+        std::copy(batch.begin(), batch.end(), buffer.begin());
+
+        os.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(T));
+
+        written += n;
+    }
+
+    /*!
+     * \brief Write the labels and close the dataset
+     * \return true if the complete dataset was written, false otherwise
+     */
+    bool finish() {
+        pad(header.labels_offset);
+
+        const uint32_t zero = 0;
+        for (size_t i = 0; i < header.samples; ++i) {
+            os.write(reinterpret_cast<const char*>(&zero), sizeof(zero));
+        }
+
+        os.close();
+
+        if (!os || written != header.samples) {
+            std::cerr << "ERROR: Incomplete binary dataset: " << path << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    static size_t align(size_t offset) {
+        return (offset + binary_dataset_header::alignment - 1) / binary_dataset_header::alignment * binary_dataset_header::alignment;
+    }
+
+    void pad(size_t offset) {
+        while (size_t(os.tellp()) < offset) {
+            os.put(0);
+        }
+    }
+};
+
+/*!
+ * \brief A data generator serving the batches directly from a memory
+ * mapped DLL binary dataset.
+ *
+ * The samples are never copied, the data batches are views inside the
+ * mapping. Since a view must be contiguous, shuffling only changes the
+ * order of the batches, not of the samples inside a batch.
+ *
+ * With asynchronous reads, the next batches are read ahead, in their order,
+ * into aligned buffers and the data batches are views inside these
+ * buffers. The labels are still read from the mapping.
+ *
+ * \tparam T The type of the values
+ * \tparam D The number of dimensions of a sample
+ * \tparam Desc The descriptor of the generator
+ */
+template <typename T, size_t D, typename Desc>
+struct mmap_data_generator {
+    using desc   = Desc; ///< The generator descriptor
+    using weight = T;    ///< The data type
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+
+    static constexpr size_t depth = desc::AsyncReads; ///< The number of batches read ahead (0 without asynchronous reads)
+
+    static_assert(D > 0 && D <= binary_dataset_header::max_dimensions, "Invalid number of dimensions for a binary dataset");
+
+    mapped_file file;             ///< The mapped dataset
+    binary_dataset_header header; ///< The header of the dataset
+
+    size_t n_classes;          ///< The number of classes
+    size_t current = 0;        ///< The current index
+    std::vector<size_t> order; ///< The order of the batches
+
+    std::unique_ptr<async_reader> reader; ///< The asynchronous reader of the batches
+
+    mutable etl::dyn_matrix<T, Desc::Categorical ? 2 : 1> label_buffer; ///< The buffer for the current labels
+
+    /*!
+     * \brief Construct a new mmap_data_generator on the given file.
+     *
+     * If the file cannot be mapped or is not a valid dataset, the
+     * generator is empty.
+     *
+     * \param path The path to the binary dataset
+     * \param n_classes The number of classes
+     */
+    mmap_data_generator(const std::string& path, size_t n_classes) : file(path), n_classes(n_classes) {
+        if (!file.memory || file.length < sizeof(binary_dataset_header)) {
+            std::cerr << "ERROR: Impossible to map the binary dataset: " << path << std::endl;
+            return;
+        }
+
+        std::memcpy(&header, file.at(0), sizeof(header));
+
+        if (!header.valid() || header.dtype != binary_dtype<T>() || header.dimensions != D) {
+            std::cerr << "ERROR: Invalid binary dataset (or invalid type/dimensions): " << path << std::endl;
+            header.samples = 0;
+            return;
+        }
+
+        if (header.labels_offset + header.samples * sizeof(uint32_t) > file.length) {
+            std::cerr << "ERROR: Truncated binary dataset: " << path << std::endl;
+            header.samples = 0;
+            return;
+        }
+
+        order.resize(batches());
+        std::iota(order.begin(), order.end(), 0);
+
+        if constexpr (desc::Categorical) {
+            label_buffer = etl::dyn_matrix<T, 2>(batch_size, n_classes);
+        } else {
+            label_buffer = etl::dyn_matrix<T, 1>(batch_size);
+        }
+
+        if constexpr (depth > 0) {
+            reader = std::make_unique<async_reader>(path, depth, batch_bytes(batch_size));
+
+            if (!reader->valid()) {
+                std::cerr << "ERROR: Impossible to read the binary dataset asynchronously, using the mapping: " << path << std::endl;
+                reader.reset();
+            }
+
+            restart();
+        }
+    }
+
+    mmap_data_generator(const mmap_data_generator& rhs) = delete;
+    mmap_data_generator operator=(const mmap_data_generator& rhs) = delete;
+
+    mmap_data_generator(mmap_data_generator&& rhs) = delete;
+    mmap_data_generator operator=(mmap_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Memory-Mapped Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "             Reads: " << (reader ? reader->backend() : "mapping") << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing to do, the memory is owned by the page cache
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing to do, the memory is owned by the page cache
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+        restart();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of batches
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the batches.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::shuffle(order.begin(), order.end(), dll::rand_engine());
+
+        restart();
+    }
+
+    /*!
+     * \brief Returns the current order of the batches, to checkpoint it
+     */
+    const std::vector<size_t>& shuffle_order() const {
+        return order;
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning with the given order of
+     * the batches, taken from shuffle_order()
+     */
+    void restore_order(const std::vector<size_t>& new_order) {
+        cpp_assert(new_order.size() == order.size(), "Invalid order of the batches");
+
+        order   = new_order;
+        current = 0;
+
+        restart();
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return header.samples;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+
+        if (reader) {
+            // The slot of the previous batch receives the last batch read ahead
+            const size_t ahead = current / batch_size + depth - 1;
+
+            if (ahead < batches()) {
+                reader->wait(ahead % depth);
+                submit(ahead);
+            }
+
+            return;
+        }
+
+        // Let the kernel read the next batch in advance
+        if (has_next_batch()) {
+            const size_t first = order[current / batch_size] * batch_size;
+            const size_t n     = std::min(batch_size, size() - first);
+
+            file.will_need(header.data_offset + first * header.sample_size() * sizeof(T), n * header.sample_size() * sizeof(T));
+        }
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     *
+     * With asynchronous reads, the batch is only valid until the next
+     * batch.
+     *
+     * \return a a batch of data, as a view inside the mapping or inside the
+     * buffer of the read.
+     */
+    auto data_batch() const {
+        const size_t first = order[current / batch_size] * batch_size;
+        const size_t n     = std::min(batch_size, size() - first);
+
+        auto* memory = reinterpret_cast<const T*>(file.at(header.data_offset)) + first * header.sample_size();
+
+        if (reader) {
+            auto* read = reinterpret_cast<const T*>(reader->wait((current / batch_size) % depth));
+
+            if (read) {
+                memory = read;
+            } else {
+                std::cerr << "ERROR: Asynchronous read of the binary dataset failed, using the mapping" << std::endl;
+            }
+        }
+
+        return make_view(const_cast<T*>(memory), n, std::make_index_sequence<D>());
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        if constexpr (desc::AutoEncoder) {
+            return data_batch();
+        } else {
+            const size_t first = order[current / batch_size] * batch_size;
+            const size_t n     = std::min(batch_size, size() - first);
+
+            auto* labels = reinterpret_cast<const uint32_t*>(file.at(header.labels_offset)) + first;
+
+            if constexpr (desc::Categorical) {
+                label_buffer = T(0);
+
+                for (size_t i = 0; i < n; ++i) {
+                    label_buffer(i, labels[i]) = T(1);
+                }
+            } else {
+                for (size_t i = 0; i < n; ++i) {
+                    label_buffer(i) = T(labels[i]);
+                }
+            }
+
+            return etl::slice(label_buffer, 0, n);
+        }
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Returns the number of bytes of n samples
+     */
+    size_t batch_bytes(size_t n) const {
+        return n * header.sample_size() * sizeof(T);
+    }
+
+    /*!
+     * \brief Read the batch at the given position of the order into its slot
+     */
+    void submit(size_t b) {
+        const size_t first = order[b] * batch_size;
+        const size_t n     = std::min(batch_size, size() - first);
+
+        reader->submit(b % depth, header.data_offset + batch_bytes(first), batch_bytes(n));
+    }
+
+    /*!
+     * \brief Start the reads of the first batches of the order
+     */
+    void restart() {
+        if (!reader) {
+            return;
+        }
+
+        reader->drain();
+
+        for (size_t b = 0; b < std::min(depth, batches()); ++b) {
+            submit(b);
+        }
+    }
+
+    /*!
+     * \brief Create a view over the n samples at the given memory
+     */
+    template <size_t... I>
+    auto make_view(T* memory, size_t n, std::index_sequence<I...> /*seq*/) const {
+        return etl::custom_dyn_matrix<T, D + 1>(memory, n, size_t(header.shape[I])...);
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename T, size_t D, typename Desc>
+std::ostream& operator<<(std::ostream& os, mmap_data_generator<T, D, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Descriptor for a mmap_data_generator
+ */
+template <typename... Parameters>
+struct mmap_data_generator_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*!
+     * \brief The size of a batch
+     */
+    static constexpr size_t BatchSize = detail::get_value_v<batch_size<1>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the generators must make the labels categorical
+     */
+    static constexpr bool Categorical = parameters::template contains<categorical>();
+
+    /*!
+     * \brief Indicates if this is an auto-encoder task
+     */
+    static constexpr bool AutoEncoder = parameters::template contains<autoencoder>();
+
+    /*!
+     * \brief The number of batches read ahead asynchronously (0 to serve
+     * views of the mapping)
+     */
+    static constexpr size_t AsyncReads = detail::get_value_v<async_reads<0>, Parameters...>;
+
+    static_assert(BatchSize > 0, "The batch size must be larger than one");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<batch_size_id, categorical_id, autoencoder_id, async_reads_id, nop_id>, Parameters...>,
+        "Invalid parameters type for mmap_data_generator_desc");
+
+    /*!
+     * The generator type
+     */
+    template <typename T, size_t D>
+    using generator_t = mmap_data_generator<T, D, mmap_data_generator_desc<Parameters...>>;
+};
+
+/*!
+ * \brief Make a memory-mapped data generator on the given binary dataset
+ * \tparam T The type of the values
+ * \tparam D The number of dimensions of a sample
+ * \param path The path to the binary dataset
+ * \param n_classes The number of classes
+ */
+template <typename T, size_t D, typename... Parameters>
+auto make_mmap_generator(const std::string& path, size_t n_classes, const mmap_data_generator_desc<Parameters...>& /*desc*/) {
+    using generator_t = typename mmap_data_generator_desc<Parameters...>::template generator_t<T, D>;
+    return std::make_unique<generator_t>(path, n_classes);
+}
+
+} //end of dll namespace
@@ -0,0 +1,278 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Data generator adding noise on the fly to a clean generator
+ */
+
+#pragma once
+
+#include <utility>
+
+#include "dll/util/fast_random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A data generator for denoising training, on top of a generator of
+ * clean samples.
+ *
+ * The data batches are the clean batches of the underlying generator with
+ * masking noise applied on the fly, each value being set to zero with a
+ * probability of Noise percent. The label batches are the clean batches.
+ * Only the clean samples are stored and a new noise is drawn each time a
+ * batch is generated.
+ *
+ * The generator keeps a reference to the underlying generator, it must
+ * outlive it.
+ *
+ * \tparam Generator The type of the underlying generator
+ * \tparam Noise The amount of noise, in percent
+ */
+template <typename Generator, size_t Noise>
+struct noisy_data_generator {
+    using generator_t = Generator; ///< The type of the underlying generator
+
+    using clean_batch_t = std::decay_t<decltype(std::declval<const Generator&>().data_batch())>; ///< The type of a clean batch
+    using weight        = etl::value_t<clean_batch_t>;                                           ///< The data type
+    using batch_t       = etl::dyn_matrix<weight, etl::dimensions<clean_batch_t>()>;               ///< The type of a noisy batch
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = Generator::batch_size; ///< The size of the generated batches
+    static constexpr size_t noise      = Noise;                 ///< The amount of noise (in percent)
+
+private:
+    generator_t& generator; ///< The underlying generator
+
+    mutable random_stream stream; ///< The random stream of the noise
+    mutable batch_t batch;        ///< The current noisy batch
+    mutable bool loaded = false;  ///< Indicates if the noise of the current batch has been drawn
+
+public:
+    /*!
+     * \brief Create a noisy generator on top of the given generator
+     * \param generator The underlying generator of clean samples
+     */
+    explicit noisy_data_generator(generator_t& generator) : generator(generator) {}
+
+    noisy_data_generator(const noisy_data_generator& rhs) = delete;
+    noisy_data_generator operator=(const noisy_data_generator& rhs) = delete;
+
+    noisy_data_generator(noisy_data_generator&& rhs) = delete;
+    noisy_data_generator operator=(noisy_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Noisy Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "             Noise: " << Noise << "%" << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        generator.set_safe();
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     *
+     * This is only done if the underlying generator is safe.
+     */
+    void clear() {
+        generator.clear();
+        batch.clear();
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        generator.set_test();
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        generator.set_train();
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        generator.reset();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        generator.reset_shuffle();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        generator.shuffle();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        generator.prepare_epoch();
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return generator.current_batch();
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return generator.size();
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return generator.augmented_size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return generator.batches();
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return generator.has_next_batch();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        generator.next_batch();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Returns the current data batch, the clean batch with noise.
+     *
+     * The noise is drawn once for each batch.
+     *
+     * \return a a batch of data.
+     */
+    const batch_t& data_batch() const {
+        if (!loaded) {
+            decltype(auto) clean = generator.data_batch();
+
+            if (etl::size(batch) != etl::size(clean) || etl::dim<0>(batch) != etl::dim<0>(clean)) {
+                resize(clean, std::make_index_sequence<etl::dimensions<clean_batch_t>()>());
+            }
+
+            masking_noise(stream, batch, clean, Noise / 100.0f);
+
+            loaded = true;
+        }
+
+        return batch;
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label (the clean batch).
+     */
+    decltype(auto) label_batch() const {
+        return generator.data_batch();
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return etl::dimensions<batch_t>() - 1;
+    }
+
+private:
+    /*!
+     * \brief Allocate the noisy batch with the dimensions of the clean batch
+     */
+    template <typename Clean, size_t... I>
+    void resize(const Clean& clean, std::index_sequence<I...> /*seq*/) const {
+        batch = batch_t(etl::dim<I>(clean)...);
+    }
+};
+
+/*!
+ * \brief Traits to test if a generator adds the noise on the fly
+ */
+template <typename T>
+struct is_noisy_generator : std::false_type {};
+
+/*!
+ * \copydoc is_noisy_generator
+ */
+template <typename Generator, size_t Noise>
+struct is_noisy_generator<noisy_data_generator<Generator, Noise>> : std::true_type {};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Generator, size_t Noise>
+std::ostream& operator<<(std::ostream& os, noisy_data_generator<Generator, Noise>& generator) {
+    return generator.display(os);
+}
+
+} //end of dll namespace
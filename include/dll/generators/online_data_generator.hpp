@@ -0,0 +1,395 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Data generator fed by a stream of samples
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief A data generator fed by a live stream of labelled samples, for the
+ * continuous training of a network.
+ *
+ * The samples are pushed by producers into a bounded ring buffer and are
+ * consumed once by the training, by mini-batches. The generator has no
+ * fixed size, the training runs as long as the stream is not closed.
+ *
+ * The stream is split into periods of a fixed number of batches, each
+ * period being one epoch for the trainer (the watcher and the momentum),
+ * has_next_batch() returns false at the end of a period and reset() starts
+ * the next one.
+ *
+ * The labels are the indices of the classes, the label batches are
+ * one-hot encoded.
+ *
+ * \tparam Sample The type of one sample
+ * \tparam BatchSize The size of the generated batches
+ */
+template <typename Sample, size_t BatchSize>
+struct online_data_generator {
+    using sample_t = Sample;                 ///< The type of one sample
+    using weight   = etl::value_t<sample_t>; ///< The data type
+
+    static constexpr size_t sample_dimensions = etl::dimensions<sample_t>(); ///< The number of dimensions of one sample
+
+    using batch_t       = etl::dyn_matrix<weight, sample_dimensions + 1>; ///< The type of a data batch
+    using label_batch_t = etl::dyn_matrix<weight, 2>;                     ///< The type of a label batch
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = BatchSize; ///< The size of the generated batches
+
+private:
+    const size_t n_classes; ///< The number of classes
+    const size_t capacity;  ///< The maximum number of samples in the buffer
+    const size_t period;    ///< The number of batches of a period
+
+    mutable std::mutex lock;               ///< The lock protecting the buffer
+    mutable std::condition_variable ready; ///< Signals a change of the buffer
+
+    batch_t samples;            ///< The ring buffer of samples
+    std::vector<size_t> labels; ///< The ring buffer of labels
+
+    size_t head   = 0;     ///< The position of the first sample in the buffer
+    size_t count  = 0;     ///< The number of samples in the buffer
+    size_t pushed = 0;     ///< The number of samples pushed since the creation
+    bool closed   = false; ///< Indicates if the stream is closed
+
+    size_t current = 0; ///< The index of the current batch in the period
+
+    mutable batch_t batch;       ///< The current data batch
+    mutable label_batch_t label; ///< The current label batch
+    mutable bool loaded = false; ///< Indicates if the current batch has been copied from the buffer
+
+public:
+    /*!
+     * \brief Create an online generator
+     * \param n_classes The number of classes
+     * \param capacity The maximum number of batches in the buffer
+     * \param period The number of batches of a period (epoch)
+     */
+    explicit online_data_generator(size_t n_classes, size_t capacity = 16, size_t period = 100)
+            : n_classes(n_classes), capacity(std::max(capacity, size_t(1)) * batch_size), period(std::max(period, size_t(1))), labels(this->capacity) {}
+
+    online_data_generator(const online_data_generator& rhs) = delete;
+    online_data_generator operator=(const online_data_generator& rhs) = delete;
+
+    online_data_generator(online_data_generator&& rhs) = delete;
+    online_data_generator operator=(online_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Push a new sample into the stream.
+     *
+     * This blocks while the buffer is full.
+     *
+     * \param sample The sample
+     * \param label The class of the sample
+     *
+     * \return false if the stream is closed, true otherwise
+     */
+    bool push(const sample_t& sample, size_t label) {
+        {
+            std::unique_lock<std::mutex> ulock(lock);
+
+            ready.wait(ulock, [this] { return closed || count < capacity; });
+
+            if (closed) {
+                return false;
+            }
+
+            if (!etl::size(samples)) {
+                allocate(sample, std::make_index_sequence<sample_dimensions>());
+            }
+
+            const size_t tail = (head + count) % capacity;
+
+            samples(tail) = sample;
+            labels[tail]  = label;
+
+            ++count;
+            ++pushed;
+        }
+
+        ready.notify_all();
+
+        return true;
+    }
+
+    /*!
+     * \brief Close the stream, the training stops once the remaining
+     * samples have been trained.
+     */
+    void close() {
+        cpp::with_lock(lock, [this] { closed = true; });
+
+        ready.notify_all();
+    }
+
+    /*!
+     * \brief Indicates if the stream is closed and all its samples have
+     * been consumed.
+     */
+    bool finished() const {
+        std::lock_guard<std::mutex> l(lock);
+
+        return closed && !count;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Online Data Generator" << std::endl;
+        stream << "            Pushed: " << size() << std::endl;
+        stream << "            Period: " << batches() << std::endl;
+        stream << "            Buffer: " << capacity << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing to do, the samples are consumed only once
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing to do, the samples are consumed only once
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Start the next period of the stream
+     */
+    void reset() {
+        current = 0;
+    }
+
+    /*!
+     * \brief Start the next period of the stream, the stream is never
+     * shuffled.
+     */
+    void reset_shuffle() {
+        reset();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples, nothing to do for a stream
+     */
+    void shuffle() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the period
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of samples pushed so far, the stream has no
+     * fixed size.
+     * \return The number of samples pushed so far
+     */
+    size_t size() const {
+        std::lock_guard<std::mutex> l(lock);
+
+        return pushed;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches of a period.
+     * \return The number of batches of a period
+     */
+    size_t batches() const {
+        return period;
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch in the current
+     * period.
+     *
+     * This blocks until a complete batch has been pushed or the stream has
+     * been closed. The last batch of a closed stream may be incomplete.
+     *
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        if (current == period) {
+            return false;
+        }
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        ready.wait(ulock, [this] { return closed || count >= batch_size; });
+
+        return count > 0;
+    }
+
+    /*!
+     * \brief Moves to the next batch, the samples of the current batch are
+     * removed from the buffer.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            const size_t n = std::min(count, batch_size);
+
+            head = (head + n) % capacity;
+            count -= n;
+        }
+
+        ready.notify_all();
+
+        ++current;
+        loaded = false;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    const batch_t& data_batch() const {
+        load();
+
+        return batch;
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label (one-hot).
+     */
+    const label_batch_t& label_batch() const {
+        load();
+
+        return label;
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return sample_dimensions;
+    }
+
+private:
+    /*!
+     * \brief Allocate the buffer with the dimensions of the first sample
+     */
+    template <size_t... I>
+    void allocate(const sample_t& sample, std::index_sequence<I...> /*seq*/) {
+        samples = batch_t(capacity, etl::dim<I>(sample)...);
+    }
+
+    /*!
+     * \brief Copy the current batch out of the buffer
+     */
+    void load() const {
+        if (loaded) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> l(lock);
+
+        const size_t n = std::min(count, batch_size);
+
+        if (etl::dim<0>(batch) != n || etl::size(batch) != n * (etl::size(samples) / capacity)) {
+            resize(n, std::make_index_sequence<sample_dimensions>());
+        }
+
+        label = 0;
+
+        for (size_t i = 0; i < n; ++i) {
+            const size_t j = (head + i) % capacity;
+
+            batch(i) = samples(j);
+            label(i, labels[j]) = 1;
+        }
+
+        loaded = true;
+    }
+
+    /*!
+     * \brief Allocate the current batch with n samples
+     */
+    template <size_t... I>
+    void resize(size_t n, std::index_sequence<I...> /*seq*/) const {
+        batch = batch_t(n, etl::dim<I + 1>(samples)...);
+        label = label_batch_t(n, n_classes);
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Sample, size_t BatchSize>
+std::ostream& operator<<(std::ostream& os, online_data_generator<Sample, BatchSize>& generator) {
+    return generator.display(os);
+}
+
+} //end of dll namespace
@@ -13,7 +13,15 @@
 #pragma once
 
 #include <atomic>
+#include <numeric>
+#include <random>
 #include <thread>
+#include <vector>
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/memory.hpp"
+#include "dll/util/random.hpp"
+#include "dll/util/spsc_ring.hpp"
 
 namespace dll {
 
@@ -27,7 +35,7 @@ struct outmemory_data_generator;
  * \copydoc outmemory_data_generator
  */
 template <typename Iterator, typename LIterator, typename Desc>
-struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc>>> {
+struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc> && !is_prefetched<Desc> && !is_sharded<Desc>>> {
     using desc                 = Desc;                                        ///< The generator descriptor
     using weight               = etl::value_t<typename Iterator::value_type>; ///< The data type
     using data_cache_helper_t  = cache_helper<Desc, Iterator>;                ///< The helper for the data cache
@@ -48,6 +56,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     size_t current_b    = 0;     ///< The current batch
     bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
 
+    tracked_memory memory{memory_category::GENERATOR}; ///< The tracked memory of the caches
+
     const size_t _size; ///< The size of the dataset
     Iterator orig_it;   ///< The original first iterator on data
     LIterator orig_lit; ///< The original first iterator on label
@@ -69,6 +79,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         data_cache_helper_t::init_big(first, batch_cache);
         label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
 
+        memory.track(buffer_bytes(batch_cache) + buffer_bytes(label_cache));
+
         reset();
 
         cpp_unused(last);
@@ -122,6 +134,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         if (is_safe) {
             batch_cache.clear();
             label_cache.clear();
+
+            memory.track(0);
         }
     }
 
@@ -146,22 +160,25 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         current_b = 0;
 
         for (size_t b = 0; b < big_batch_size && current_real < _size; ++b) {
+            // Let the iterator decode the whole batch at once if it can
+            if constexpr (is_batch_decoder<Iterator>) {
+                it.decode_batch(batch_cache(b), std::min(batch_size, _size - current_real));
+            }
+
             for (size_t i = 0; i < batch_size && current_real < _size;) {
                 auto sub = batch_cache(b)(i);
 
-                sub = *it;
-
-                pre_scaler<desc>::transform(sub);
-                pre_normalizer<desc>::transform(sub);
-                pre_binarizer<desc>::transform(sub);
+                if constexpr (is_batch_decoder<Iterator>) {
+                    pre_transformer<desc>::transform(sub);
+                } else {
+                    pre_transformer<desc>::copy(sub, *it);
+                }
 
                 label_cache_helper_t::set(i, lit, label_cache(b));
 
                 // In case of auto-encoders, the label images also need to be transformed
                 if constexpr (desc::AutoEncoder) {
-                    pre_scaler<desc>::transform(label_cache(b)(i));
-                    pre_normalizer<desc>::transform(label_cache(b)(i));
-                    pre_binarizer<desc>::transform(label_cache(b)(i));
+                    pre_transformer<desc>::transform(label_cache(b)(i));
                 }
 
                 ++i;
@@ -292,6 +309,569 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     }
 };
 
+/*!
+ * \copydoc outmemory_data_generator
+ *
+ * This version prefetches the next big batches on a background thread
+ * while the current one is being consumed.
+ *
+ * When the generator is sharded, the data is split into shards of
+ * contiguous samples. Once shuffled, the shards are read in a random
+ * order, each of them sequentially, and the samples are drawn at random
+ * from a shuffle buffer refilled from the shards. This gives a shuffled
+ * epoch with only sequential reads of the storage.
+ */
+template <typename Iterator, typename LIterator, typename Desc>
+struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc> && (is_prefetched<Desc> || is_sharded<Desc>)>> {
+    using desc                 = Desc;                                        ///< The generator descriptor
+    using weight               = etl::value_t<typename Iterator::value_type>; ///< The data type
+    using data_cache_helper_t  = cache_helper<Desc, Iterator>;                ///< The helper for the data cache
+    using label_cache_helper_t = label_cache_helper<Desc, weight, LIterator>; ///< The helper for the label cache
+
+    using big_data_cache_type  = typename data_cache_helper_t::big_cache_type;  ///< The type of the big data cache
+    using big_label_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
+    using data_cache_type      = typename data_cache_helper_t::cache_type;      ///< The type of the shuffle buffer of data
+    using label_cache_type     = typename label_cache_helper_t::cache_type;     ///< The type of the shuffle buffer of labels
+
+    static constexpr bool dll_generator    = true;                                ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size     = desc::BatchSize;                     ///< The size of the batch
+    static constexpr size_t big_batch_size = desc::BigBatchSize;                  ///< The number of batches kept in cache
+    static constexpr size_t depth          = desc::Prefetch ? desc::Prefetch : 2; ///< The number of big batches in the prefetch queue
+    static constexpr size_t shard_size     = desc::ShardSize;                     ///< The number of samples of a shard (0 if not sharded)
+    static constexpr size_t buffer_size    = desc::ShuffleBuffer;                 ///< The number of samples of the shuffle buffer
+
+    std::vector<big_data_cache_type> batch_caches;  ///< The data batch caches (one per slot)
+    std::vector<big_label_cache_type> label_caches; ///< The label batch caches (one per slot)
+
+    data_cache_type shuffle_data;    ///< The shuffle buffer of data
+    label_cache_type shuffle_labels; ///< The shuffle buffer of labels
+    std::vector<size_t> shard_order; ///< The order of the shards for the current epoch
+    size_t shard_seed = 0;           ///< The seed of the shuffle buffer for the current epoch
+    bool shuffled     = false;       ///< Indicates if the current epoch is shuffled
+
+    mutable volatile bool ready[depth]; ///< Indicates if each slot has been filled
+
+    mutable std::mutex main_lock;                    ///< The main lock
+    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for a free slot
+    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for a ready slot
+
+    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
+
+    std::thread main_thread; ///< The prefetching thread
+
+    size_t current   = 0;     ///< The current index
+    size_t current_b = 0;     ///< The current batch inside the current slot
+    size_t slot      = 0;     ///< The current slot
+    bool is_safe     = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    tracked_memory memory{memory_category::GENERATOR}; ///< The tracked memory of the caches
+
+    const size_t _size; ///< The size of the dataset
+    Iterator orig_it;   ///< The original first iterator on data
+    LIterator orig_lit; ///< The original first iterator on label
+
+    /*!
+     * \brief Construct an outmemory_data_generator
+     * \param first The iterator on the beginning on data
+     * \param last The iterator on the end  on data
+     * \param lfirst The iterator on the beginning on labels
+     * \param llast The iterator on the end  on labels
+     * \param n_classes The number of classes
+     * \param size The size of the entire dataset
+     */
+    outmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes, size_t size)
+            : batch_caches(depth), label_caches(depth), _size(size), orig_it(first), orig_lit(lfirst) {
+        for (size_t s = 0; s < depth; ++s) {
+            data_cache_helper_t::init_big(first, batch_caches[s]);
+            label_cache_helper_t::init_big(n_classes, lfirst, label_caches[s]);
+        }
+
+        if constexpr (is_sharded<Desc>) {
+            data_cache_helper_t::init(std::min(buffer_size, size), first, shuffle_data);
+            label_cache_helper_t::init(std::min(buffer_size, size), n_classes, lfirst, shuffle_labels);
+
+            shard_order.resize(shards());
+        }
+
+        memory.track(depth * (buffer_bytes(batch_caches[0]) + buffer_bytes(label_caches[0])) + buffer_bytes(shuffle_data) + buffer_bytes(shuffle_labels));
+
+        reset();
+
+        cpp_unused(last);
+        cpp_unused(llast);
+    }
+
+    outmemory_data_generator(const outmemory_data_generator& rhs) = delete;
+    outmemory_data_generator& operator=(const outmemory_data_generator& rhs) = delete;
+
+    outmemory_data_generator(outmemory_data_generator&& rhs) = delete;
+    outmemory_data_generator& operator=(outmemory_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Destructs the outmemory_data_generator
+     */
+    ~outmemory_data_generator() {
+        stop_prefetch();
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Out-Of-Memory Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "    Prefetch Depth: " << depth << std::endl;
+
+        if constexpr (is_sharded<Desc>) {
+            stream << "            Shards: " << shards() << " x " << shard_size << std::endl;
+            stream << "    Shuffle Buffer: " << buffer_size << std::endl;
+        }
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     *
+     * This is only done if the generator is marked as safe it is safe.
+     */
+    void clear() {
+        if (is_safe) {
+            stop_prefetch();
+
+            for (size_t s = 0; s < depth; ++s) {
+                batch_caches[s].clear();
+                label_caches[s].clear();
+            }
+
+            shuffle_data.clear();
+            shuffle_labels.clear();
+
+            memory.track(0);
+        }
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Fill the given slot from the iterators
+     * \param s The slot to fill
+     * \param it The current iterator on data
+     * \param lit The current iterator on labels
+     * \param current_read The number of samples already read
+     */
+    void fill_slot(size_t s, Iterator& it, LIterator& lit, size_t& current_read) {
+        auto& batch_cache = batch_caches[s];
+        auto& label_cache = label_caches[s];
+
+        for (size_t b = 0; b < big_batch_size && current_read < _size; ++b) {
+            // Let the iterator decode the whole batch at once if it can
+            if constexpr (is_batch_decoder<Iterator>) {
+                it.decode_batch(batch_cache(b), std::min(batch_size, _size - current_read));
+            }
+
+            for (size_t i = 0; i < batch_size && current_read < _size;) {
+                auto sub = batch_cache(b)(i);
+
+                if constexpr (is_batch_decoder<Iterator>) {
+                    pre_transformer<desc>::transform(sub);
+                } else {
+                    pre_transformer<desc>::copy(sub, *it);
+                }
+
+                label_cache_helper_t::set(i, lit, label_cache(b));
+
+                // In case of auto-encoders, the label images also need to be transformed
+                if constexpr (desc::AutoEncoder) {
+                    pre_transformer<desc>::transform(label_cache(b)(i));
+                }
+
+                ++i;
+                ++current_read;
+                ++it;
+                ++lit;
+            }
+        }
+    }
+
+    /*!
+     * \brief The state of the reading of the shards, owned by the
+     * prefetching thread
+     */
+    struct shard_reader {
+        Iterator it;          ///< The current iterator on data
+        LIterator lit;        ///< The current iterator on labels
+        size_t shard    = 0;  ///< The current position in the order of the shards
+        size_t read     = 0;  ///< The number of samples already read from the current shard
+        size_t buffered = 0;  ///< The number of samples in the shuffle buffer
+        dll::random_engine g; ///< The random engine of the shuffle buffer
+    };
+
+    /*!
+     * \brief Returns the number of shards of the dataset
+     */
+    size_t shards() const {
+        return shard_size ? _size / shard_size + (_size % shard_size == 0 ? 0 : 1) : 0;
+    }
+
+    /*!
+     * \brief Read the next sample of the shards into the given position of
+     * the shuffle buffer.
+     * \return false if all the shards have been read, true otherwise
+     */
+    bool read_sample(shard_reader& reader, size_t position) {
+        if (reader.shard == shards()) {
+            return false;
+        }
+
+        // Seek to the beginning of the next shard
+        if (!reader.read) {
+            reader.it  = std::next(orig_it, shard_order[reader.shard] * shard_size);
+            reader.lit = std::next(orig_lit, shard_order[reader.shard] * shard_size);
+        }
+
+        shuffle_data(position) = *reader.it;
+        label_cache_helper_t::set(position, reader.lit, shuffle_labels);
+
+        ++reader.it;
+        ++reader.lit;
+
+        if (++reader.read == std::min(shard_size, _size - shard_order[reader.shard] * shard_size)) {
+            reader.read = 0;
+            ++reader.shard;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Fill the given slot with random samples of the shuffle buffer
+     * \param s The slot to fill
+     * \param reader The state of the reading of the shards
+     * \param current_read The number of samples already generated
+     */
+    void fill_slot_shuffled(size_t s, shard_reader& reader, size_t& current_read) {
+        auto& batch_cache = batch_caches[s];
+        auto& label_cache = label_caches[s];
+
+        for (size_t b = 0; b < big_batch_size && current_read < _size; ++b) {
+            for (size_t i = 0; i < batch_size && current_read < _size; ++i, ++current_read) {
+                std::uniform_int_distribution<size_t> dist(0, reader.buffered - 1);
+
+                const size_t r = dist(reader.g);
+
+                pre_transformer<desc>::copy(batch_cache(b)(i), shuffle_data(r));
+
+                label_cache(b)(i) = shuffle_labels(r);
+
+                if constexpr (desc::AutoEncoder) {
+                    pre_transformer<desc>::transform(label_cache(b)(i));
+                }
+
+                // Replace the sample, or shrink the buffer at the end of the shards
+                if (!read_sample(reader, r)) {
+                    --reader.buffered;
+
+                    if (r != reader.buffered) {
+                        shuffle_data(r)   = shuffle_data(reader.buffered);
+                        shuffle_labels(r) = shuffle_labels(reader.buffered);
+                    }
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Start the prefetching thread from the beginning of the data
+     */
+    void start_prefetch() {
+        for (size_t s = 0; s < depth; ++s) {
+            ready[s] = false;
+        }
+
+        stop_flag = false;
+
+        main_thread = std::thread([this] {
+            Iterator it   = orig_it;
+            LIterator lit = orig_lit;
+
+            size_t current_read = 0;
+
+            shard_reader reader{orig_it, orig_lit};
+
+            if constexpr (is_sharded<Desc>) {
+                if (shuffled) {
+                    SERIAL_SECTION {
+                        reader.g.seed(shard_seed);
+
+                        while (reader.buffered < etl::dim<0>(shuffle_data) && read_sample(reader, reader.buffered)) {
+                            ++reader.buffered;
+                        }
+                    }
+                }
+            }
+
+            for (size_t s = 0; current_read < _size; s = (s + 1) % depth) {
+                {
+                    std::unique_lock<std::mutex> ulock(main_lock);
+
+                    // Wait for the reader to give back the slot
+                    if (ready[s] && !stop_flag) {
+                        dll::auto_timer timer("generator:prefetch:producer_stall");
+
+                        condition.wait(ulock, [this, s] { return stop_flag || !ready[s]; });
+                    }
+
+                    if (stop_flag) {
+                        return;
+                    }
+                }
+
+                {
+                    dll::auto_timer timer("generator:prefetch:fill");
+
+                    SERIAL_SECTION {
+                        if (is_sharded<Desc> && shuffled) {
+                            fill_slot_shuffled(s, reader, current_read);
+                        } else {
+                            fill_slot(s, it, lit, current_read);
+                        }
+                    }
+
+                    // The upload overlaps with the training on the previous slots
+                    gpu_upload(batch_caches[s], label_caches[s]);
+                }
+
+                // Notify the reader that one slot is ready
+
+                {
+                    std::unique_lock<std::mutex> ulock(main_lock);
+
+                    ready[s] = true;
+
+                    ready_condition.notify_one();
+                }
+            }
+        });
+    }
+
+    /*!
+     * \brief Stop the prefetching thread, if running
+     */
+    void stop_prefetch() {
+        if (main_thread.joinable()) {
+            cpp::with_lock(main_lock, [this] { stop_flag = true; });
+
+            condition.notify_all();
+
+            main_thread.join();
+        }
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        stop_prefetch();
+
+        current   = 0;
+        current_b = 0;
+        slot      = 0;
+        shuffled  = false;
+
+        start_prefetch();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        if constexpr (is_sharded<Desc>) {
+            stop_prefetch();
+
+            current   = 0;
+            current_b = 0;
+            slot      = 0;
+
+            shuffle();
+        } else {
+            cpp_unreachable("Impossible to shuffle out-of-memory data set");
+        }
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * This should only be done when the generator is at the beginning.
+     * Only a sharded generator can be shuffled, by drawing a new order of
+     * the shards.
+     */
+    void shuffle() {
+        if constexpr (is_sharded<Desc>) {
+            cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+            stop_prefetch();
+
+            std::iota(shard_order.begin(), shard_order.end(), 0);
+            std::shuffle(shard_order.begin(), shard_order.end(), dll::rand_engine());
+
+            shard_seed = dll::rand_engine()();
+            shuffled   = true;
+
+            start_prefetch();
+        } else {
+            cpp_unreachable("Impossible to shuffle out-of-memory data set");
+        }
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch(){
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     *
+     * This number may be an estimate, depending on which augmentation
+     * techniques are enabled.
+     *
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        ++current_b;
+
+        // Give back the slot to the prefetching thread
+        if (current_b == big_batch_size) {
+            {
+                std::unique_lock<std::mutex> ulock(main_lock);
+
+                ready[slot] = false;
+
+                condition.notify_one();
+            }
+
+            current_b = 0;
+            slot      = (slot + 1) % depth;
+        }
+
+        current += batch_size;
+    }
+
+    /*!
+     * \brief Wait for the current slot to be filled
+     */
+    void wait_slot() const {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        if (!ready[slot]) {
+            dll::auto_timer timer("generator:prefetch:consumer_stall");
+
+            ready_condition.wait(ulock, [this] { return ready[slot]; });
+        }
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        wait_slot();
+
+        return etl::slice(batch_caches[slot](current_b), 0, std::min(batch_size, _size - current));
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        wait_slot();
+
+        return etl::slice(label_caches[slot](current_b), 0, std::min(batch_size, _size - current));
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return etl::dimensions<big_data_cache_type>() - 2;
+    }
+};
+
 /*!
  * \copydoc outmemory_data_generator
  */
@@ -305,9 +885,10 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     using big_data_cache_type  = typename data_cache_helper_t::big_cache_type;  ///< The type of the big data cache
     using big_label_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
 
-    static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
-    static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
-    static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
+    static constexpr bool dll_generator = true;            ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size  = desc::BatchSize; ///< The size of the generated batches
+
+    const size_t big_batch_size; ///< The number of batches kept in cache
 
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
@@ -316,17 +897,12 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     size_t current_read = 0;     ///< The current index read
     bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
 
-    mutable volatile bool status[big_batch_size];    ///< Status of each batch
-    mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
+    tracked_memory memory{memory_category::GENERATOR}; ///< The tracked memory of the caches
 
-    mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
-    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
+    mutable spsc_ring ring; ///< The ring synchronizing the batches with the thread
 
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
-
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    std::thread main_thread;             ///< The main thread
+    std::atomic<bool> train_mode{false}; ///< The train mode status
 
     const size_t _size; ///< The size of the dataset
     Iterator orig_it;   ///< The original first iterator on data
@@ -349,72 +925,41 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \param size The size of the entire dataset
      */
     outmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes, size_t size)
-            : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit), cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
-        data_cache_helper_t::init_big(first, batch_cache);
-        label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
+            : big_batch_size(cached_batches(first, lfirst, n_classes, size)), ring(big_batch_size), _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit), cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
+        data_cache_helper_t::init_big(first, batch_cache, big_batch_size);
+        label_cache_helper_t::init_big(n_classes, lfirst, label_cache, big_batch_size);
+
+        memory.track(buffer_bytes(batch_cache) + buffer_bytes(label_cache));
 
         cpp_unused(last);
         cpp_unused(llast);
 
         main_thread = std::thread([this] {
             while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    bool found = false;
-
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < _size) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
-
-                    // if not found, wait for a ready to compute batch
-
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
-
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < _size) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
-
-                            return false;
-                        });
-
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
+                // Wait for a free slot, restarting from the beginning on reset
+                const size_t batch = ring.producer_acquire(batches(), [this] {
+                    current_read = 0;
+                    it           = orig_it;
+                    lit          = orig_lit;
+                });
+
+                // If there is no more work for the thread, exit
+                if (batch == size_t(-1)) {
+                    return;
                 }
 
+                // The index of the batch inside the batch cache
+                const size_t index = batch % big_batch_size;
+
                 SERIAL_SECTION {
                     for (size_t i = 0; i < batch_size && current_read < _size; ++i) {
                         auto sub = batch_cache(index)(i);
 
                         if (train_mode) {
-                            // Random crop the image
-                            cropper.transform_first(sub, *it);
-
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
+                            // Random crop and mirror the image, in a single pass
+                            cropper.transform_first_mirror(sub, *it, mirrorer, dll::rand_engine());
 
-                            // Mirror the image
-                            mirrorer.transform(sub);
+                            pre_transformer<desc>::transform(sub);
 
                             // Distort the image
                             distorter.transform(sub);
@@ -425,18 +970,14 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
                             // Center crop the image
                             cropper.transform_first_test(sub, *it);
 
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
+                            pre_transformer<desc>::transform(sub);
                         }
 
                         label_cache_helper_t::set(i, lit, label_cache(index));
 
                         // In case of auto-encoders, the label images also need to be transformed
                         if constexpr (desc::AutoEncoder){
-                            pre_scaler<desc>::transform(label_cache(index)(i));
-                            pre_normalizer<desc>::transform(label_cache(index)(i));
-                            pre_binarizer<desc>::transform(label_cache(index)(i));
+                            pre_transformer<desc>::transform(label_cache(index)(i));
                         }
 
                         ++it;
@@ -445,15 +986,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
                     }
                 }
 
-                // Notify a waiter that one batch is ready
-
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
-
-                    status[index] = true;
-
-                    ready_condition.notify_one();
-                }
+                // Notify the reader that one batch is ready
+                ring.producer_publish();
             }
         });
     }
@@ -468,9 +1002,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \brief Destructs the outmemory_data_generator
      */
     ~outmemory_data_generator() {
-        cpp::with_lock(main_lock, [this] { stop_flag = true; });
-
-        condition.notify_all();
+        ring.stop();
 
         main_thread.join();
     }
@@ -484,6 +1016,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         stream << "Out-Of-Memory Data Generator" << std::endl;
         stream << "              Size: " << size() << std::endl;
         stream << "           Batches: " << batches() << std::endl;
+        stream << "    Cached Batches: " << big_batch_size << std::endl;
 
         if (augmented_size() != size()) {
             stream << "    Augmented Size: " << augmented_size() << std::endl;
@@ -516,6 +1049,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         if (is_safe) {
             batch_cache.clear();
             label_cache.clear();
+
+            memory.track(0);
         }
     }
 
@@ -537,18 +1072,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \brief Reset the generation
      */
     void reset_generation() {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
-        current_read = 0;
-        it           = orig_it;
-        lit          = orig_lit;
-
-        for (size_t b = 0; b < big_batch_size; ++b) {
-            status[b]  = false;
-            indices[b] = b;
-        }
-
-        condition.notify_one();
+        ring.reset();
     }
 
     /*!
@@ -632,18 +1156,9 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * This should only be called if the generator has a next batch.
      */
     void next_batch() {
-        // Get information from batch that has been consumed
-        const auto batch = current / batch_size;
-        const auto b     = batch % big_batch_size;
-
-        {
-            std::unique_lock<std::mutex> ulock(main_lock);
-
-            status[b] = false;
-            indices[b] += big_batch_size;
-
-            condition.notify_one();
-        }
+        // Give back the slot of the consumed batch to the thread
+        ring.consumer_wait(current / batch_size);
+        ring.consumer_release();
 
         current += batch_size;
     }
@@ -653,18 +1168,10 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return a a batch of data.
      */
     auto data_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
         const auto b     = batch % big_batch_size;
 
-        if (status[b]) {
-            return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
-        }
-
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        ring.consumer_wait(batch);
 
         return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
     }
@@ -674,18 +1181,10 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return a a batch of label.
      */
     auto label_batch() const {
-        std::unique_lock<std::mutex> ulock(main_lock);
-
         const auto batch = current / batch_size;
         const auto b     = batch % big_batch_size;
 
-        if (status[b]) {
-            return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
-        }
-
-        ready_condition.wait(ulock, [this, b] {
-            return status[b];
-        });
+        ring.consumer_wait(batch);
 
         return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
     }
@@ -697,21 +1196,46 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     static constexpr size_t dimensions() {
         return etl::dimensions<big_data_cache_type>() - 2;
     }
+
+private:
+    /*!
+     * \brief Returns the number of batches to keep in cache
+     * \param first An iterator to the first sample
+     * \param lfirst An iterator to the first label
+     * \param n_classes The number of classes
+     * \param size The number of samples
+     */
+    static size_t cached_batches(Iterator first, LIterator lfirst, size_t n_classes, size_t size) {
+        big_data_cache_type data;
+        big_label_cache_type labels;
+
+        // The caches of one batch give the size of a cached batch
+        data_cache_helper_t::init_big(first, data, 1);
+        label_cache_helper_t::init_big(n_classes, lfirst, labels, 1);
+
+        return big_batch_cache_size<desc>(buffer_bytes(data) + buffer_bytes(labels), (size + batch_size - 1) / batch_size);
+    }
 };
 
 // Allow odr-use of the constexpr static members
 
 template <typename Iterator, typename LIterator, typename Desc>
-const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc>>>::batch_size;
+const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc> && !is_prefetched<Desc> && !is_sharded<Desc>>>::batch_size;
 
 template <typename Iterator, typename LIterator, typename Desc>
-const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc>>>::big_batch_size;
+const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc> && !is_prefetched<Desc> && !is_sharded<Desc>>>::big_batch_size;
 
 template <typename Iterator, typename LIterator, typename Desc>
-const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_threaded<Desc>>>::batch_size;
+const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc> && (is_prefetched<Desc> || is_sharded<Desc>)>>::batch_size;
+
+template <typename Iterator, typename LIterator, typename Desc>
+const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc> && (is_prefetched<Desc> || is_sharded<Desc>)>>::big_batch_size;
 
 template <typename Iterator, typename LIterator, typename Desc>
-const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_threaded<Desc>>>::big_batch_size;
+const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc> && !is_threaded<Desc> && (is_prefetched<Desc> || is_sharded<Desc>)>>::depth;
+
+template <typename Iterator, typename LIterator, typename Desc>
+const size_t outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_augmented<Desc> || is_threaded<Desc>>>::batch_size;
 
 /*!
  * \brief Display the given generator on the given stream
@@ -744,11 +1268,26 @@ struct outmemory_data_generator_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The memory budget of the cached batches of the threaded generators, in MB (0 to use the big batch size)
+     */
+    static constexpr size_t BigBatchBudget = detail::get_value_v<big_batch_budget<0>, Parameters...>;
+
+    /*!
+     * \brief The percentage of the available memory for the cached batches of the threaded generators (0 to use the big batch size)
+     */
+    static constexpr size_t BigBatchFreeMemory = detail::get_value_v<big_batch_free_memory<0>, Parameters...>;
+
     /*!
      * \brief Indicates if the generators must make the labels categorical
      */
     static constexpr bool Categorical = parameters::template contains<categorical>();
 
+    /*!
+     * \brief Indicates if the categorical labels are kept as class indices
+     */
+    static constexpr bool SparseLabels = parameters::template contains<sparse_labels>();
+
     /*!
      * \brief Indicates if horizontal mirroring should be used as augmentation.
      */
@@ -764,6 +1303,21 @@ struct outmemory_data_generator_desc {
      */
     static constexpr bool Threaded = parameters::template contains<threaded>();
 
+    /*!
+     * \brief The number of big batches prefetched in background (0 to disable)
+     */
+    static constexpr size_t Prefetch = detail::get_value_v<prefetch<0>, Parameters...>;
+
+    /*!
+     * \brief The number of samples of a shard (0 to disable sharding)
+     */
+    static constexpr size_t ShardSize = detail::get_value_1<sharded<0, 0>, Parameters...>::value;
+
+    /*!
+     * \brief The number of samples of the shuffle buffer (one shard by default)
+     */
+    static constexpr size_t ShuffleBuffer = detail::get_value_2<sharded<0, 0>, Parameters...>::value ? detail::get_value_2<sharded<0, 0>, Parameters...>::value : ShardSize;
+
     /*!
      * \brief The random cropping X
      */
@@ -806,14 +1360,19 @@ struct outmemory_data_generator_desc {
 
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(BigBatchFreeMemory <= 100, "The cached batches cannot use more than the available memory");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
+    static_assert(Prefetch != 1, "The prefetch queue needs at least two big batches");
+    static_assert(!(Prefetch && Threaded), "prefetch and threaded cannot be used together");
+    static_assert(!(ShardSize && (Threaded || HorizontalMirroring || VerticalMirroring || random_crop_x || random_crop_y || ElasticDistortion || Noise)),
+                  "sharded reading is not compatible with augmentation and threaded");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
-                batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id,
-                elastic_distortion_id, categorical_id, noise_id, threaded_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                batch_size_id, big_batch_size_id, big_batch_budget_id, big_batch_free_memory_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id,
+                elastic_distortion_id, categorical_id, sparse_labels_id, noise_id, threaded_id, prefetch_id, sharded_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
@@ -0,0 +1,794 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Data generator fed by a pipeline of stages
+ *
+ * A pipeline is built from a source of labelled samples and a chain of
+ * stages (decoding, pretransformation, augmentation, ...):
+ *
+ * \code
+ * auto generator = dll::make_pipeline(files.size(), [&](size_t i) { return std::make_pair(files[i], labels[i]); })
+ *     .stage([](std::string&& file) { return decode(file); }, 4, "pipeline:decode")
+ *     .stage([](image&& img) { return normalize(img); }, 1, "pipeline:pretransform")
+ *     .template generator<32>(10);
+ * \endcode
+ *
+ * Each stage runs on its own threads, connected to the next stage by a
+ * bounded channel, and the last stage is batched by a regular DLL
+ * generator, consumed unchanged by the trainers.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "dll/util/random.hpp"
+#include "dll/util/thread_budget.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief One sample flowing through a pipeline
+ */
+template <typename T>
+struct pipeline_item {
+    size_t index = 0; ///< The position of the sample in the epoch
+    size_t label = 0; ///< The label of the sample
+    T value;          ///< The value of the sample, as produced by the last stage
+};
+
+/*!
+ * \brief A bounded channel between two stages of a pipeline, with any
+ * number of producers and consumers.
+ */
+template <typename T>
+struct pipeline_channel {
+    /*!
+     * \brief Prepare the channel for a new epoch
+     * \param capacity The maximum number of samples in the channel
+     */
+    void open(size_t capacity) {
+        std::lock_guard<std::mutex> l(lock);
+
+        items.clear();
+
+        this->capacity = std::max(capacity, size_t(1));
+        closed         = false;
+        aborted        = false;
+    }
+
+    /*!
+     * \brief Push a sample into the channel, blocking while the channel is
+     * full
+     * \return false if the channel was aborted, true otherwise
+     */
+    bool push(pipeline_item<T>&& item) {
+        {
+            std::unique_lock<std::mutex> ulock(lock);
+
+            ready.wait(ulock, [this] { return aborted || items.size() < capacity; });
+
+            if (aborted) {
+                return false;
+            }
+
+            items.push_back(std::move(item));
+        }
+
+        ready.notify_all();
+
+        return true;
+    }
+
+    /*!
+     * \brief Pop a sample from the channel, blocking while the channel is
+     * empty and not closed
+     * \return false if the channel was aborted or is closed and empty, true otherwise
+     */
+    bool pop(pipeline_item<T>& item) {
+        {
+            std::unique_lock<std::mutex> ulock(lock);
+
+            ready.wait(ulock, [this] { return aborted || closed || !items.empty(); });
+
+            if (aborted || items.empty()) {
+                return false;
+            }
+
+            item = std::move(items.front());
+            items.pop_front();
+        }
+
+        ready.notify_all();
+
+        return true;
+    }
+
+    /*!
+     * \brief Indicates that no more samples will be pushed
+     */
+    void close() {
+        cpp::with_lock(lock, [this] { closed = true; });
+
+        ready.notify_all();
+    }
+
+    /*!
+     * \brief Abort the channel, waking up all the producers and consumers
+     */
+    void abort() {
+        cpp::with_lock(lock, [this] { aborted = true; });
+
+        ready.notify_all();
+    }
+
+private:
+    std::mutex lock;                    ///< The lock protecting the channel
+    std::condition_variable ready;      ///< Signals a change of the channel
+    std::deque<pipeline_item<T>> items; ///< The samples in the channel
+    size_t capacity = 1;                ///< The maximum number of samples in the channel
+    bool closed     = false;            ///< Indicates that no more samples will be pushed
+    bool aborted    = false;            ///< Indicates that the channel was aborted
+};
+
+/*!
+ * \brief The stages of a pipeline and their threads.
+ *
+ * The source only produces the samples that are at most window positions
+ * ahead of the first sample not yet consumed, so that the samples reordered
+ * by the parallel stages never exceed the window.
+ */
+struct pipeline_graph {
+    /*!
+     * \brief One stage of the pipeline
+     */
+    struct stage {
+        std::string name;            ///< The name of the stage
+        size_t threads;              ///< The number of threads of the stage
+        std::function<void()> work;  ///< The loop of one thread of the stage
+        std::function<void()> open;  ///< Prepare the output of the stage for an epoch
+        std::function<void()> abort; ///< Abort the output of the stage
+    };
+
+    const size_t size;         ///< The number of samples of the source
+    size_t window = 1;         ///< The maximum number of samples in flight
+    std::vector<stage> stages; ///< The stages, from the source
+
+    std::vector<size_t> order;        ///< The order of the samples in the epoch
+    std::atomic<size_t> cursor{0};    ///< The next position produced by the source
+    std::vector<std::thread> workers; ///< The threads of all the stages
+
+    explicit pipeline_graph(size_t size) : size(size), order(size) {
+        std::iota(order.begin(), order.end(), 0);
+    }
+
+    /*!
+     * \brief Returns the total number of threads of the stages
+     */
+    size_t threads() const {
+        size_t t = 0;
+
+        for (auto& s : stages) {
+            t += s.threads;
+        }
+
+        return t;
+    }
+
+    /*!
+     * \brief Start the threads of all the stages for an epoch
+     */
+    void start() {
+        cursor   = 0;
+        consumed = 0;
+        stopped  = false;
+
+        for (auto& s : stages) {
+            s.open();
+        }
+
+        for (auto& s : stages) {
+            for (size_t t = 0; t < s.threads; ++t) {
+                workers.emplace_back(s.work);
+            }
+        }
+    }
+
+    /*!
+     * \brief Stop the threads of all the stages
+     */
+    void stop() {
+        cpp::with_lock(lock, [this] { stopped = true; });
+
+        ready.notify_all();
+
+        for (auto& s : stages) {
+            s.abort();
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        workers.clear();
+    }
+
+    /*!
+     * \brief Take the next position of the source, waiting while it is too
+     * far ahead of the consumer
+     * \param position The taken position
+     * \return false if the source is finished or the pipeline stopped
+     */
+    bool acquire(size_t& position) {
+        position = cursor++;
+
+        if (position >= size) {
+            return false;
+        }
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        ready.wait(ulock, [this, position] { return stopped || position < consumed + window; });
+
+        return !stopped;
+    }
+
+    /*!
+     * \brief Indicates that the next n samples have been consumed
+     */
+    void release(size_t n) {
+        cpp::with_lock(lock, [this, n] { consumed += n; });
+
+        ready.notify_all();
+    }
+
+private:
+    std::mutex lock;               ///< The lock protecting the consumed samples
+    std::condition_variable ready; ///< Signals consumed samples or the end of the epoch
+    size_t consumed = 0;           ///< The number of consumed samples in the epoch
+    bool stopped    = false;       ///< Indicates that the pipeline is stopped
+};
+
+template <typename Sample, size_t BatchSize>
+struct pipeline_data_generator;
+
+/*!
+ * \brief Builder of a pipeline whose last stage produces values of type T
+ */
+template <typename T>
+struct data_pipeline {
+    using value_type = T; ///< The type of the values of the last stage
+
+    /*!
+     * \brief Create a builder from the given graph and output of its last stage
+     */
+    data_pipeline(std::shared_ptr<pipeline_graph> graph, std::shared_ptr<pipeline_channel<T>> output)
+            : graph(std::move(graph)), output(std::move(output)) {}
+
+    /*!
+     * \brief Add a stage transforming the values of the last stage.
+     *
+     * The stage is called concurrently by its threads and must therefore
+     * be thread-safe. The values are produced in any order, the generator
+     * restores the order of the source.
+     *
+     * \param fun The functor of the stage, called with an rvalue of the value
+     * \param threads The number of threads of the stage
+     * \param name The name of the stage, for the timers (must be a string literal)
+     *
+     * \return The builder of the extended pipeline
+     */
+    template <typename Functor>
+    auto stage(Functor fun, size_t threads = 1, const char* name = "pipeline:stage") const {
+        using result_t = std::decay_t<decltype(fun(std::declval<T&&>()))>;
+
+        auto next      = std::make_shared<pipeline_channel<result_t>>();
+        auto in        = output;
+        auto remaining = std::make_shared<std::atomic<size_t>>(0);
+        auto* g        = graph.get();
+
+        threads = std::max(threads, size_t(1));
+
+        pipeline_graph::stage s;
+
+        s.name    = name;
+        s.threads = threads;
+
+        s.work = [in, next, remaining, fun, name]() mutable {
+            pipeline_item<T> item;
+
+            while (in->pop(item)) {
+                pipeline_item<result_t> result;
+
+                result.index = item.index;
+                result.label = item.label;
+
+                {
+                    dll::auto_timer timer(name);
+
+                    result.value = fun(std::move(item.value));
+                }
+
+                if (!next->push(std::move(result))) {
+                    break;
+                }
+            }
+
+            // The last thread of the stage closes the channel
+            if (--*remaining == 0) {
+                next->close();
+            }
+        };
+
+        s.open  = [next, remaining, threads, g] { next->open(g->window); *remaining = threads; };
+        s.abort = [next] { next->abort(); };
+
+        graph->stages.push_back(std::move(s));
+
+        return data_pipeline<result_t>(graph, next);
+    }
+
+    /*!
+     * \brief Create the generator batching the values of the last stage.
+     *
+     * The values must be ETL containers of the same dimensions. The labels
+     * are the indices of the classes, the label batches are one-hot
+     * encoded. The builder must not be used anymore after this call.
+     *
+     * \param n_classes The number of classes
+     * \param depth The maximum number of batches in flight in the pipeline
+     */
+    template <size_t BatchSize>
+    std::unique_ptr<pipeline_data_generator<T, BatchSize>> generator(size_t n_classes, size_t depth = 4) const {
+        graph->window = std::max(depth, size_t(2)) * BatchSize;
+
+        return std::make_unique<pipeline_data_generator<T, BatchSize>>(graph, output, n_classes);
+    }
+
+private:
+    std::shared_ptr<pipeline_graph> graph;       ///< The stages of the pipeline
+    std::shared_ptr<pipeline_channel<T>> output; ///< The output of the last stage
+};
+
+/*!
+ * \brief Start a pipeline from the given source.
+ *
+ * The source is called with the index of the sample (in [0, size)) and
+ * returns a pair of the value of the sample and of its label. It is called
+ * concurrently by its threads and must therefore be thread-safe.
+ *
+ * \param size The number of samples of the source
+ * \param source The source of the samples
+ * \param threads The number of threads of the source
+ *
+ * \return The builder of the pipeline
+ */
+template <typename Source>
+auto make_pipeline(size_t size, Source source, size_t threads = 1) {
+    using value_t = std::decay_t<decltype(source(size_t(0)).first)>;
+
+    auto graph     = std::make_shared<pipeline_graph>(size);
+    auto next      = std::make_shared<pipeline_channel<value_t>>();
+    auto remaining = std::make_shared<std::atomic<size_t>>(0);
+    auto* g        = graph.get();
+
+    threads = std::max(threads, size_t(1));
+
+    pipeline_graph::stage s;
+
+    s.name    = "source";
+    s.threads = threads;
+
+    s.work = [g, next, remaining, source]() mutable {
+        size_t position;
+
+        while (g->acquire(position)) {
+            pipeline_item<value_t> item;
+
+            item.index = position;
+
+            {
+                dll::auto_timer timer("pipeline:source");
+
+                auto sample = source(g->order[position]);
+
+                item.value = std::move(sample.first);
+                item.label = sample.second;
+            }
+
+            if (!next->push(std::move(item))) {
+                break;
+            }
+        }
+
+        // The last thread of the source closes the channel
+        if (--*remaining == 0) {
+            next->close();
+        }
+    };
+
+    s.open  = [next, remaining, threads, g] { next->open(g->window); *remaining = threads; };
+    s.abort = [next] { next->abort(); };
+
+    graph->stages.push_back(std::move(s));
+
+    return data_pipeline<value_t>(graph, next);
+}
+
+/*!
+ * \brief A data generator batching the output of a pipeline.
+ *
+ * The pipeline runs in the background during the epoch, the batches are
+ * assembled in the order of the source (shuffled at each shuffle of the
+ * generator), whatever the number of threads of the stages. The threads
+ * of the stages are reserved from the thread budget of the library while
+ * the generator is alive.
+ *
+ * \tparam Sample The type of one sample, produced by the last stage
+ * \tparam BatchSize The size of the generated batches
+ */
+template <typename Sample, size_t BatchSize>
+struct pipeline_data_generator {
+    using sample_t = Sample;                 ///< The type of one sample
+    using weight   = etl::value_t<sample_t>; ///< The data type
+
+    static constexpr size_t sample_dimensions = etl::dimensions<sample_t>(); ///< The number of dimensions of one sample
+
+    using batch_t       = etl::dyn_matrix<weight, sample_dimensions + 1>; ///< The type of a data batch
+    using label_batch_t = etl::dyn_matrix<weight, 2>;                     ///< The type of a label batch
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = BatchSize; ///< The size of the generated batches
+
+private:
+    std::shared_ptr<pipeline_graph> graph;              ///< The stages of the pipeline
+    std::shared_ptr<pipeline_channel<sample_t>> output; ///< The output of the last stage
+
+    const size_t n_classes;         ///< The number of classes
+    thread_reservation reservation; ///< The threads of the stages
+
+    mutable std::vector<pipeline_item<sample_t>> slots; ///< The samples in flight, by position modulo the window
+    mutable std::vector<bool> filled;                   ///< Indicates if a slot holds its sample
+
+    size_t current = 0; ///< The index of the current batch
+
+    mutable batch_t batch;       ///< The current data batch
+    mutable label_batch_t label; ///< The current label batch
+    mutable bool loaded = false; ///< Indicates if the current batch has been assembled
+
+public:
+    /*!
+     * \brief Create a generator on the given pipeline, see
+     * data_pipeline::generator()
+     */
+    pipeline_data_generator(std::shared_ptr<pipeline_graph> graph, std::shared_ptr<pipeline_channel<sample_t>> output, size_t n_classes)
+            : graph(std::move(graph)), output(std::move(output)), n_classes(n_classes), reservation(this->graph->threads()),
+              slots(this->graph->window), filled(this->graph->window, false) {
+        start();
+    }
+
+    pipeline_data_generator(const pipeline_data_generator& rhs) = delete;
+    pipeline_data_generator operator=(const pipeline_data_generator& rhs) = delete;
+
+    pipeline_data_generator(pipeline_data_generator&& rhs) = delete;
+    pipeline_data_generator operator=(pipeline_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Stop the pipeline
+     */
+    ~pipeline_data_generator() {
+        graph->stop();
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Pipeline Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "            Window: " << graph->window << std::endl;
+        stream << "            Stages:";
+
+        for (auto& s : graph->stages) {
+            stream << " " << s.name << "(" << s.threads << ")";
+        }
+
+        stream << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing to do, the samples are produced at each epoch
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing to do, the samples are produced at each epoch
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        graph->stop();
+        start();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of the samples
+     */
+    void reset_shuffle() {
+        graph->stop();
+        std::shuffle(graph->order.begin(), graph->order.end(), dll::rand_engine());
+        start();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        reset_shuffle();
+    }
+
+    /*!
+     * \brief Returns the current order of the samples, to checkpoint it
+     */
+    const std::vector<size_t>& shuffle_order() const {
+        return graph->order;
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning with the given order of
+     * the samples, taken from shuffle_order()
+     */
+    void restore_order(const std::vector<size_t>& order) {
+        cpp_assert(order.size() == graph->order.size(), "Invalid order of the samples");
+
+        graph->stop();
+        graph->order = order;
+        start();
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return graph->size;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return (size() + batch_size - 1) / batch_size;
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < batches();
+    }
+
+    /*!
+     * \brief Moves to the next batch, letting the source produce the
+     * samples of another batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        load();
+
+        const size_t first = current * batch_size;
+        const size_t n     = current_size();
+
+        for (size_t i = first; i < first + n; ++i) {
+            filled[i % graph->window] = false;
+        }
+
+        graph->release(n);
+
+        ++current;
+        loaded = false;
+    }
+
+    /*!
+     * \brief Returns the current data batch, waiting for the pipeline if
+     * necessary
+     * \return a a batch of data.
+     */
+    const batch_t& data_batch() const {
+        load();
+
+        return batch;
+    }
+
+    /*!
+     * \brief Returns the current label batch, waiting for the pipeline if
+     * necessary
+     * \return a a batch of label (one-hot).
+     */
+    const label_batch_t& label_batch() const {
+        load();
+
+        return label;
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return sample_dimensions;
+    }
+
+private:
+    /*!
+     * \brief Start the pipeline from the beginning
+     */
+    void start() {
+        current = 0;
+        loaded  = false;
+
+        std::fill(filled.begin(), filled.end(), false);
+
+        graph->start();
+    }
+
+    /*!
+     * \brief Returns the number of samples of the current batch
+     */
+    size_t current_size() const {
+        return std::min(batch_size, size() - current * batch_size);
+    }
+
+    /*!
+     * \brief Wait for the samples of the current batch and assemble it
+     */
+    void load() const {
+        if (loaded) {
+            return;
+        }
+
+        dll::auto_timer timer("pipeline:batch");
+
+        const size_t first = current * batch_size;
+        const size_t n     = current_size();
+
+        const size_t window = graph->window;
+
+        // The samples of the next batches are kept until their batch
+        while (!std::all_of(filled.begin() + first % window, filled.begin() + first % window + n, [](bool f) { return f; })) {
+            pipeline_item<sample_t> item;
+
+            const bool popped = output->pop(item);
+
+            cpp_assert(popped, "The pipeline ended before the end of the epoch");
+            cpp_unused(popped);
+
+            const size_t slot = item.index % window;
+
+            slots[slot]  = std::move(item);
+            filled[slot] = true;
+        }
+
+        if (etl::dim<0>(batch) != n || !etl::size(batch)) {
+            resize(n, std::make_index_sequence<sample_dimensions>());
+        }
+
+        label = 0;
+
+        for (size_t i = 0; i < n; ++i) {
+            auto& item = slots[(first + i) % window];
+
+            batch(i) = item.value;
+            label(i, item.label) = 1;
+        }
+
+        loaded = true;
+    }
+
+    /*!
+     * \brief Allocate the current batch with n samples
+     */
+    template <size_t... I>
+    void resize(size_t n, std::index_sequence<I...> /*seq*/) const {
+        const auto& sample = slots[(current * batch_size) % graph->window].value;
+
+        batch = batch_t(n, etl::dim<I>(sample)...);
+        label = label_batch_t(n, n_classes);
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Sample, size_t BatchSize>
+std::ostream& operator<<(std::ostream& os, pipeline_data_generator<Sample, BatchSize>& generator) {
+    return generator.display(os);
+}
+
+} //end of dll namespace
@@ -0,0 +1,417 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Data generator downsampling the images of another generator, for
+ * progressive-resolution training
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A phase of a progressive-resolution training
+ */
+struct resolution_phase {
+    size_t epochs; ///< The number of epochs of the phase
+    size_t height; ///< The height of the images during the phase
+    size_t width;  ///< The width of the images during the phase
+};
+
+/*!
+ * \brief Downsample the images [C x H x W] to [C x h x w] by averaging the
+ * boxes of (H / h) x (W / w) pixels, the factors being integers.
+ */
+template <typename T>
+void downsample_box(T* out, const T* in, size_t C, size_t H, size_t W, size_t h, size_t w) {
+    const size_t fy = H / h;
+    const size_t fx = W / w;
+
+    const T scale = T(1) / T(fy * fx);
+
+    for (size_t c = 0; c < C; ++c) {
+        const T* plane = in + c * H * W;
+        T* o           = out + c * h * w;
+
+        std::fill_n(o, h * w, T(0));
+
+        for (size_t y = 0; y < H; ++y) {
+            const T* row = plane + y * W;
+            T* orow      = o + (y / fy) * w;
+
+            for (size_t x = 0; x < w; ++x) {
+                for (size_t k = 0; k < fx; ++k) {
+                    orow[x] += row[x * fx + k];
+                }
+            }
+        }
+
+        for (size_t i = 0; i < h * w; ++i) {
+            o[i] *= scale;
+        }
+    }
+}
+
+/*!
+ * \brief Resize the images [C x H x W] to [C x h x w] with bilinear
+ * interpolation, the pixels being sampled at their centers.
+ */
+template <typename T>
+void resize_bilinear(T* out, const T* in, size_t C, size_t H, size_t W, size_t h, size_t w) {
+    // The sampling positions only depend on the output coordinates
+    auto positions = [](size_t n, size_t N, std::vector<size_t>& first, std::vector<T>& alpha) {
+        first.resize(n);
+        alpha.resize(n);
+
+        const double ratio = double(N) / double(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            const double p = std::min(std::max((i + 0.5) * ratio - 0.5, 0.0), double(N - 1));
+
+            first[i] = std::min(size_t(p), N > 1 ? N - 2 : 0);
+            alpha[i] = N > 1 ? T(p - first[i]) : T(0);
+        }
+    };
+
+    std::vector<size_t> ys;
+    std::vector<size_t> xs;
+    std::vector<T> ay;
+    std::vector<T> ax;
+
+    positions(h, H, ys, ay);
+    positions(w, W, xs, ax);
+
+    const size_t dx = W > 1 ? 1 : 0;
+    const size_t dy = H > 1 ? W : 0;
+
+    for (size_t c = 0; c < C; ++c) {
+        const T* plane = in + c * H * W;
+        T* o           = out + c * h * w;
+
+        for (size_t y = 0; y < h; ++y) {
+            const T* r0 = plane + ys[y] * W;
+            const T* r1 = r0 + dy;
+
+            for (size_t x = 0; x < w; ++x) {
+                const size_t i = xs[x];
+
+                const T top    = r0[i] + ax[x] * (r0[i + dx] - r0[i]);
+                const T bottom = r1[i] + ax[x] * (r1[i + dx] - r1[i]);
+
+                o[y * w + x] = top + ay[y] * (bottom - top);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Resize the images [C x H x W] to [C x h x w], with a box filter for
+ * integer downsampling factors and with bilinear interpolation otherwise.
+ */
+template <typename T>
+void resize_image(T* out, const T* in, size_t C, size_t H, size_t W, size_t h, size_t w) {
+    if (h == H && w == W) {
+        std::copy_n(in, C * H * W, out);
+    } else if (h <= H && w <= W && H % h == 0 && W % w == 0) {
+        downsample_box(out, in, C, H, W, h, w);
+    } else {
+        resize_bilinear(out, in, C, H, W, h, w);
+    }
+}
+
+/*!
+ * \brief A data generator for progressive-resolution training, on top of a
+ * generator of images [C x H x W].
+ *
+ * The data batches are the batches of the underlying generator resized to
+ * the current resolution, when they are loaded. The label batches are the
+ * batches of the underlying generator. Only the images at full resolution
+ * are stored by the underlying generator.
+ *
+ * The generator keeps a reference to the underlying generator, it must
+ * outlive it.
+ *
+ * \tparam Generator The type of the underlying generator
+ */
+template <typename Generator>
+struct resized_data_generator {
+    using generator_t = Generator; ///< The type of the underlying generator
+
+    using full_batch_t = std::decay_t<decltype(std::declval<const Generator&>().data_batch())>; ///< The type of a full resolution batch
+    using weight       = etl::value_t<full_batch_t>;                                            ///< The data type
+    using batch_t      = etl::dyn_matrix<weight, 4>;                                            ///< The type of a resized batch
+
+    static_assert(etl::dimensions<full_batch_t>() == 4, "The resized generator needs batches of images [B x C x H x W]");
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = Generator::batch_size; ///< The size of the generated batches
+
+private:
+    generator_t& generator; ///< The underlying generator
+
+    size_t height = 0; ///< The current height of the images (0 for the full resolution)
+    size_t width  = 0; ///< The current width of the images (0 for the full resolution)
+
+    mutable batch_t batch;       ///< The current resized batch
+    mutable bool loaded = false; ///< Indicates if the current batch has been resized
+
+public:
+    /*!
+     * \brief Create a resized generator on top of the given generator, at
+     * full resolution
+     * \param generator The underlying generator of images
+     */
+    explicit resized_data_generator(generator_t& generator) : generator(generator) {}
+
+    resized_data_generator(const resized_data_generator& rhs) = delete;
+    resized_data_generator operator=(const resized_data_generator& rhs) = delete;
+
+    resized_data_generator(resized_data_generator&& rhs) = delete;
+    resized_data_generator operator=(resized_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Set the resolution of the generated images, 0 for the full
+     * resolution
+     */
+    void set_resolution(size_t height, size_t width) {
+        this->height = height;
+        this->width  = width;
+
+        loaded = false;
+    }
+
+    /*!
+     * \brief Returns the shape of one generated image [C, h, w]
+     */
+    std::vector<size_t> shape() const {
+        decltype(auto) full = generator.data_batch();
+
+        return {etl::dim<1>(full), height ? height : etl::dim<2>(full), width ? width : etl::dim<3>(full)};
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Resized Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+
+        if (height) {
+            stream << "        Resolution: " << height << "x" << width << std::endl;
+        } else {
+            stream << "        Resolution: full" << std::endl;
+        }
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        generator.set_safe();
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     *
+     * This is only done if the underlying generator is safe.
+     */
+    void clear() {
+        generator.clear();
+        batch.clear();
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        generator.set_test();
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        generator.set_train();
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        generator.reset();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        generator.reset_shuffle();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        generator.shuffle();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        generator.prepare_epoch();
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return generator.current_batch();
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return generator.size();
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return generator.augmented_size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return generator.batches();
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return generator.has_next_batch();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        generator.next_batch();
+        loaded = false;
+    }
+
+    /*!
+     * \brief Returns the current data batch, resized to the current
+     * resolution.
+     *
+     * The batch is resized once, when it is first accessed.
+     *
+     * \return a a batch of data.
+     */
+    const batch_t& data_batch() const {
+        if (!loaded) {
+            decltype(auto) full = generator.data_batch();
+
+            const size_t B = etl::dim<0>(full);
+            const size_t C = etl::dim<1>(full);
+            const size_t H = etl::dim<2>(full);
+            const size_t W = etl::dim<3>(full);
+
+            const size_t h = height ? height : H;
+            const size_t w = width ? width : W;
+
+            cpp_assert(h > 0 && w > 0, "Invalid resolution");
+
+            if (etl::dim<0>(batch) != B || etl::dim<1>(batch) != C || etl::dim<2>(batch) != h || etl::dim<3>(batch) != w) {
+                batch = batch_t(B, C, h, w);
+            }
+
+            cpu_access(full);
+
+            parallel_kernel(0, B, [&](size_t i) {
+                resize_image(batch.memory_start() + i * C * h * w, full.memory_start() + i * C * H * W, C, H, W, h, w);
+            });
+
+            cpu_modified(batch);
+
+            loaded = true;
+        }
+
+        return batch;
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    decltype(auto) label_batch() const {
+        return generator.label_batch();
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return 3;
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Generator>
+std::ostream& operator<<(std::ostream& os, resized_data_generator<Generator>& generator) {
+    return generator.display(os);
+}
+
+} //end of dll namespace
@@ -0,0 +1,343 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Data generator streaming the output of a layer
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace dll {
+
+/*!
+ * \brief A data generator streaming the representation of a trained layer
+ * on top of another generator.
+ *
+ * The batches of the underlying generator are forward propagated through
+ * the layer by a producer thread, into a bounded queue. The next layer can
+ * then be trained while the representations are computed, without holding
+ * a copy of the complete representation in memory. The representations are
+ * computed again at each epoch.
+ *
+ * The generator keeps a reference to the layer and to the underlying
+ * generator, they must outlive it.
+ *
+ * \tparam Layer The type of the trained layer
+ * \tparam Generator The type of the underlying generator
+ */
+template <typename Layer, typename Generator>
+struct streamed_data_generator {
+    using layer_t     = Layer;     ///< The type of the layer
+    using generator_t = Generator; ///< The type of the underlying generator
+
+    using batch_t = std::decay_t<decltype(std::declval<const Layer&>().train_forward_batch(std::declval<Generator&>().data_batch()))>; ///< The type of a batch
+    using weight  = etl::value_t<batch_t>;                                                                                              ///< The data type
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = Generator::batch_size; ///< The size of the generated batches
+
+private:
+    const layer_t& layer;   ///< The trained layer
+    generator_t& generator; ///< The underlying generator
+    const size_t capacity;  ///< The maximum number of batches in the queue
+
+    size_t current = 0; ///< The index of the current batch
+
+    mutable std::mutex lock;               ///< The lock protecting the queue
+    mutable std::condition_variable ready; ///< Signals a change of the queue
+    mutable std::deque<batch_t> queue;     ///< The produced batches
+    mutable batch_t batch;                 ///< The current batch
+    mutable bool loaded = false;           ///< Indicates if the current batch has been taken from the queue
+
+    bool stop_flag    = false; ///< Indicates to the producer to stop
+    bool shuffle_next = false; ///< Indicates if the next generation must be shuffled
+    std::thread producer;      ///< The producer thread
+
+public:
+    /*!
+     * \brief Create a streamed generator on top of the given generator
+     * \param layer The trained layer
+     * \param generator The underlying generator
+     * \param capacity The maximum number of batches computed in advance
+     */
+    streamed_data_generator(const layer_t& layer, generator_t& generator, size_t capacity = 4)
+            : layer(layer), generator(generator), capacity(std::max(capacity, size_t(1))) {
+        start();
+    }
+
+    streamed_data_generator(const streamed_data_generator& rhs) = delete;
+    streamed_data_generator operator=(const streamed_data_generator& rhs) = delete;
+
+    streamed_data_generator(streamed_data_generator&& rhs) = delete;
+    streamed_data_generator operator=(streamed_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Stop the production
+     */
+    ~streamed_data_generator() {
+        stop();
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Streamed Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "             Queue: " << capacity << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing to do, nothing is kept in memory
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing to do, nothing is kept in memory
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        stop();
+        start();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the underlying generator
+     */
+    void reset_shuffle() {
+        stop();
+        shuffle_next = true;
+        start();
+    }
+
+    /*!
+     * \brief Shuffle the underlying generator.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        reset_shuffle();
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return generator.size();
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return generator.batches();
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < batches();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        if (!loaded) {
+            data_batch();
+        }
+
+        ++current;
+        loaded = false;
+    }
+
+    /*!
+     * \brief Returns the current data batch, waiting for the producer if
+     * necessary
+     * \return a a batch of data.
+     */
+    const batch_t& data_batch() const {
+        if (!loaded) {
+            std::unique_lock<std::mutex> ulock(lock);
+
+            ready.wait(ulock, [this] { return !queue.empty(); });
+
+            batch = std::move(queue.front());
+            queue.pop_front();
+
+            loaded = true;
+
+            ready.notify_all();
+        }
+
+        return batch;
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label (the same as the data batch).
+     */
+    const batch_t& label_batch() const {
+        return data_batch();
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return etl::dimensions<batch_t>() - 1;
+    }
+
+private:
+    /*!
+     * \brief Start the producer from the beginning of the underlying
+     * generator
+     */
+    void start() {
+        current   = 0;
+        loaded    = false;
+        stop_flag = false;
+
+        queue.clear();
+
+        if (shuffle_next) {
+            generator.reset_shuffle();
+            shuffle_next = false;
+        } else {
+            generator.reset();
+        }
+
+        generator.set_test();
+
+        producer = std::thread([this] { produce(); });
+    }
+
+    /*!
+     * \brief Stop the producer
+     */
+    void stop() {
+        if (producer.joinable()) {
+            cpp::with_lock(lock, [this] { stop_flag = true; });
+
+            ready.notify_all();
+
+            producer.join();
+        }
+    }
+
+    /*!
+     * \brief The main loop of the producer
+     */
+    void produce() {
+        while (generator.has_next_batch()) {
+            auto next = layer.train_forward_batch(generator.data_batch());
+
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                ready.wait(ulock, [this] { return stop_flag || queue.size() < capacity; });
+
+                if (stop_flag) {
+                    return;
+                }
+
+                queue.push_back(std::move(next));
+            }
+
+            ready.notify_all();
+
+            generator.next_batch();
+        }
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Layer, typename Generator>
+std::ostream& operator<<(std::ostream& os, streamed_data_generator<Layer, Generator>& generator) {
+    return generator.display(os);
+}
+
+} //end of dll namespace
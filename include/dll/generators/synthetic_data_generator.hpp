@@ -0,0 +1,350 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Data generator of random samples and labels, for benchmarks
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A data generator of random samples, uniform in [-1, 1), and of
+ * random labels, to benchmark a network without any dataset.
+ *
+ * By default, the samples are generated once, at the creation of the
+ * generator, and each epoch goes through the same samples. With fresh
+ * samples, each batch is generated when it is loaded, with a simple
+ * xorshift generator running at about memory speed, so that a large number
+ * of samples can be used without holding them in memory.
+ *
+ * The labels are the indices of the classes, the label batches are
+ * one-hot encoded.
+ *
+ * \tparam Sample The type of one sample
+ * \tparam BatchSize The size of the generated batches
+ */
+template <typename Sample, size_t BatchSize>
+struct synthetic_data_generator {
+    using sample_t = Sample;                 ///< The type of one sample
+    using weight   = etl::value_t<sample_t>; ///< The data type
+
+    static constexpr size_t sample_dimensions = etl::dimensions<sample_t>(); ///< The number of dimensions of one sample
+
+    using batch_t       = etl::dyn_matrix<weight, sample_dimensions + 1>; ///< The type of a data batch
+    using label_batch_t = etl::dyn_matrix<weight, 2>;                     ///< The type of a label batch
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = BatchSize; ///< The size of the generated batches
+
+private:
+    const size_t n;         ///< The number of samples of an epoch
+    const size_t n_classes; ///< The number of classes
+    const bool fresh;       ///< Indicates if the samples are generated for each batch
+
+    std::array<size_t, sample_dimensions> dims; ///< The dimensions of one sample
+
+    mutable uint64_t state; ///< The state of the xorshift generator
+
+    batch_t samples;            ///< All the samples (not fresh)
+    std::vector<size_t> labels; ///< All the labels (not fresh)
+
+    size_t current = 0; ///< The index of the current batch
+
+    mutable batch_t batch;       ///< The current data batch
+    mutable label_batch_t label; ///< The current label batch
+    mutable bool loaded = false; ///< Indicates if the current batch has been loaded
+
+public:
+    /*!
+     * \brief Create a synthetic generator
+     * \param sample A sample with the dimensions of the generated samples
+     * \param n The number of samples of an epoch
+     * \param n_classes The number of classes
+     * \param fresh Generate new samples for each batch, instead of once
+     */
+    synthetic_data_generator(const sample_t& sample, size_t n, size_t n_classes, bool fresh = false)
+            : n(n), n_classes(std::max(n_classes, size_t(1))), fresh(fresh), state(dll::rand_engine()() | 1) {
+        for (size_t d = 0; d < sample_dimensions; ++d) {
+            dims[d] = etl::dim(sample, d);
+        }
+
+        if (!fresh) {
+            samples = allocate(n, std::make_index_sequence<sample_dimensions>());
+            labels.resize(n);
+
+            fill(samples.memory_start(), etl::size(samples));
+
+            for (auto& l : labels) {
+                l = next() % this->n_classes;
+            }
+        }
+
+        batch = allocate(std::min(n, batch_size), std::make_index_sequence<sample_dimensions>());
+        label = label_batch_t(std::min(n, batch_size), this->n_classes);
+    }
+
+    synthetic_data_generator(const synthetic_data_generator& rhs) = delete;
+    synthetic_data_generator operator=(const synthetic_data_generator& rhs) = delete;
+
+    synthetic_data_generator(synthetic_data_generator&& rhs) = delete;
+    synthetic_data_generator operator=(synthetic_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Synthetic Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "           Classes: " << n_classes << std::endl;
+        stream << "             Fresh: " << (fresh ? "yes" : "no") << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brier Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing to do, the samples are needed by the next epochs
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+        loaded  = false;
+    }
+
+    /*!
+     * \brief Reset the generator, the random samples are not shuffled
+     */
+    void reset_shuffle() {
+        reset();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples, nothing to do for random
+     * samples
+     */
+    void shuffle() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return n;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return n;
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return (n + batch_size - 1) / batch_size;
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < batches();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        ++current;
+        loaded = false;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    const batch_t& data_batch() const {
+        load();
+
+        return batch;
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label (one-hot).
+     */
+    const label_batch_t& label_batch() const {
+        load();
+
+        return label;
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return sample_dimensions;
+    }
+
+private:
+    /*!
+     * \brief Returns a batch of s samples
+     */
+    template <size_t... I>
+    batch_t allocate(size_t s, std::index_sequence<I...> /*seq*/) const {
+        return batch_t(s, dims[I]...);
+    }
+
+    /*!
+     * \brief Returns the next value of the xorshift generator
+     */
+    uint64_t next() const {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+
+        return state * 2685821657736338717ULL;
+    }
+
+    /*!
+     * \brief Fill the given memory with random values in [-1, 1)
+     */
+    void fill(weight* out, size_t size) const {
+        constexpr double scale = 2.0 / double(1 << 24);
+
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = weight((next() >> 40) * scale - 1.0);
+        }
+    }
+
+    /*!
+     * \brief Load the current batch, the last batch may be incomplete
+     */
+    void load() const {
+        if (loaded) {
+            return;
+        }
+
+        const size_t first = current * batch_size;
+        const size_t s     = std::min(batch_size, n - first);
+
+        if (etl::dim<0>(batch) != s) {
+            batch = allocate(s, std::make_index_sequence<sample_dimensions>());
+            label = label_batch_t(s, n_classes);
+        }
+
+        label = 0;
+
+        if (fresh) {
+            fill(batch.memory_start(), etl::size(batch));
+
+            for (size_t i = 0; i < s; ++i) {
+                label(i, next() % n_classes) = 1;
+            }
+        } else {
+            const size_t sample_size = etl::size(samples) / n;
+
+            std::copy_n(samples.memory_start() + first * sample_size, s * sample_size, batch.memory_start());
+
+            for (size_t i = 0; i < s; ++i) {
+                label(i, labels[first + i]) = 1;
+            }
+        }
+
+        cpu_modified(batch);
+
+        loaded = true;
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Sample, size_t BatchSize>
+std::ostream& operator<<(std::ostream& os, synthetic_data_generator<Sample, BatchSize>& generator) {
+    return generator.display(os);
+}
+
+} //end of dll namespace
@@ -12,6 +12,8 @@
 
 #include "cpp_utils/data.hpp"
 
+#include "dll/util/gpu.hpp"
+
 namespace dll {
 
 /*!
@@ -182,4 +184,82 @@ struct pre_normalizer <Desc, std::enable_if_t<!Desc::NormalizePre>> {
     }
 };
 
+/*!
+ * \brief Apply all the pre-transformations of a generator (scale, normalize
+ * and binarize, in this order) to one sample at once.
+ *
+ * The copy from the source is fused with the transformations. Scaling and
+ * binarization are done in a single read of the source and a single write
+ * of the target. The normalization needs the statistics of the sample first,
+ * so it is done right after the copy, while the sample is still in cache.
+ */
+template <typename Desc>
+struct pre_transformer {
+    static constexpr bool scale     = Desc::ScalePre != 0;    ///< Indicates if the inputs are scaled
+    static constexpr bool normalize = Desc::NormalizePre;     ///< Indicates if the inputs are normalized
+    static constexpr bool binarize  = Desc::BinarizePre != 0; ///< Indicates if the inputs are binarized
+
+    /*!
+     * \brief Apply the transformations on the sample
+     * \param target The sample to transform
+     */
+    template <typename O>
+    static void transform(O&& target) {
+        pre_scaler<Desc>::transform(target);
+        pre_normalizer<Desc>::transform(target);
+        pre_binarizer<Desc>::transform(target);
+    }
+
+    /*!
+     * \brief Copy the source sample into the target and apply the
+     * transformations
+     * \param target The sample to fill
+     * \param source The source sample
+     */
+    template <typename O, typename I>
+    static void copy(O&& target, const I& source) {
+        if constexpr (etl::is_etl_expr<I>) {
+            copy_expr(target, source);
+        } else {
+            target = source;
+            transform(target);
+        }
+    }
+
+private:
+    /*!
+     * \copydoc copy
+     */
+    template <typename O, typename I>
+    static void copy_expr(O&& target, const I& source) {
+        using T = etl::value_t<std::decay_t<O>>;
+
+        if constexpr (!scale && !normalize && !binarize) {
+            target = source;
+        } else if constexpr (!normalize && !binarize) {
+            target = source / T(Desc::ScalePre);
+        } else if constexpr (!normalize && etl::all_dma<std::decay_t<O>, I>) {
+            cpu_access(source);
+
+            const auto* in = source.memory_start();
+            auto* out      = target.memory_start();
+
+            for (size_t i = 0; i < etl::size(target); ++i) {
+                T x = in[i];
+
+                if constexpr (scale) {
+                    x /= T(Desc::ScalePre);
+                }
+
+                out[i] = x > Desc::BinarizePre ? T(1) : T(0);
+            }
+
+            cpu_modified(target);
+        } else {
+            target = source;
+            transform(target);
+        }
+    }
+};
+
 } //end of dll namespace
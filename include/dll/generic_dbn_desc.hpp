@@ -106,6 +106,13 @@ struct generic_dbn_desc {
 
     static_assert(BatchSize > 0, "Batch size must be at least 1");
     static_assert(BigBatchSize > 0, "Big Batch size must be at least 1");
+    static_assert(detail::get_value_v<parallel_sgd<1>, Parameters...> > 0, "Parallel SGD needs at least 1 shard");
+    static_assert(detail::get_value_v<gradient_accumulation<1>, Parameters...> > 0, "Gradient accumulation needs at least 1 mini-batch");
+    static_assert(detail::get_value_v<selective_backprop<100>, Parameters...> > 0 && detail::get_value_v<selective_backprop<100>, Parameters...> <= 100,
+                  "Selective backprop needs a percentage in ]0, 100]");
+    static_assert(!(parameters::template contains<pipelined_pretrain>() && parameters::template contains<spill_pretrain>()),
+                  "pipelined_pretrain and spill_pretrain are mutually exclusive");
+    static_assert(detail::get_value_v<top_k_error<1>, Parameters...> > 0, "The top-K error needs at least one class");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
@@ -114,7 +121,8 @@ struct generic_dbn_desc {
                 trainer_id, watcher_id, weight_decay_id, big_batch_size_id, batch_size_id, verbose_id, no_epoch_error_id,
                 batch_mode_id, svm_concatenate_id, svm_scale_id, serial_id, shuffle_id, shuffle_pre_id, loss_id,
                 normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, noise_id, updater_id,
-                early_stopping_id, early_training_id, clip_gradients_id, output_policy_id>,
+                early_stopping_id, early_training_id, clip_gradients_id, global_clip_gradients_id, output_policy_id, parallel_sgd_id, sgd_checkpoint_id, gradient_accumulation_id, frozen_layers_id, selective_backprop_id, overlap_gradients_id, pipeline_updates_id, pipeline_stages_id, micro_batches_id, sparse_labels_id, arena_id, flat_parameters_id, checkpoint_every_id,
+                pipelined_pretrain_id, spill_pretrain_id, fast_layers_id, numa_id, async_validation_id, backup_every_id, channels_last_id, top_k_error_id>,
             Parameters...>,
         "Invalid parameters type");
 };
@@ -124,3 +132,4 @@ struct generic_dbn_desc {
 // Include the trainers
 #include "dll/trainer/conjugate_gradient.hpp"
 #include "dll/trainer/stochastic_gradient_descent.hpp"
+#include "dll/trainer/hogwild.hpp"
@@ -0,0 +1,1780 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Inference-only forward propagation with preallocated buffers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <tuple>
+
+#include "etl/etl.hpp"
+
+#include "dll/dbn_detail.hpp"
+#include "dll/dbn_traits.hpp"
+#include "dll/layer_fwd.hpp"
+#include "dll/util/channels_last.hpp"
+#include "dll/util/gemv.hpp"
+#include "dll/util/mapped_model.hpp"
+#include "dll/util/prune.hpp"
+#include "dll/util/quantize.hpp"
+#include "dll/util/ready.hpp"
+#include "dll/util/stream_states.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the layer has an int8 forward path
+ */
+template <typename Layer>
+struct is_int8_layer : std::false_type {};
+
+template <typename Desc>
+struct is_int8_layer<dense_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_int8_layer<conv_layer_impl<Desc>> : std::true_type {};
+
+namespace engine_detail {
+
+/*!
+ * \brief Indicates if the layer L is a dense layer computed by the
+ * single-sample path
+ */
+template <typename DBN, size_t L>
+constexpr bool is_one_dense() {
+    using layer_t = typename DBN::template layer_type<L>;
+
+    return is_int8_layer<layer_t>::value && decay_layer_traits<layer_t>::is_dense_layer();
+}
+
+/*!
+ * \brief Indicates if the layer L is supported by the single-sample path,
+ * either computed or skipped
+ */
+template <typename DBN, size_t L>
+constexpr bool is_one_layer() {
+    using layer_t = typename DBN::template layer_type<L>;
+
+    if constexpr (is_one_dense<DBN, L>() || dbn_detail::is_inference_identity<layer_t>::value || dbn_detail::is_view_layer<layer_t>::value) {
+        return true;
+    } else if constexpr (L > 0) {
+        return dbn_detail::is_foldable_pair<typename DBN::template layer_type<L - 1>, layer_t>::value;
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief Returns the number of outputs of the layer L if it is computed by
+ * the single-sample path, 0 otherwise
+ */
+template <typename DBN, size_t L>
+constexpr size_t one_size() {
+    if constexpr (is_one_dense<DBN, L>()) {
+        return DBN::template layer_type<L>::num_hidden;
+    } else {
+        return 0;
+    }
+}
+
+/*!
+ * \brief Indicates if all the layers are supported by the single-sample
+ * path, with at least one dense layer
+ */
+template <typename DBN, size_t... I>
+constexpr bool one_supported(std::index_sequence<I...> /*seq*/) {
+    return (is_one_layer<DBN, I>() && ...) && (is_one_dense<DBN, I>() || ...);
+}
+
+/*!
+ * \brief Returns the largest output of the dense layers
+ */
+template <typename DBN, size_t... I>
+constexpr size_t one_max_size(std::index_sequence<I...> /*seq*/) {
+    return std::max({one_size<DBN, I>()...});
+}
+
+/*!
+ * \brief Returns the index of the last dense layer
+ */
+template <typename DBN, size_t... I>
+constexpr size_t one_last(std::index_sequence<I...> /*seq*/) {
+    return std::max({(is_one_dense<DBN, I>() ? I : 0)...});
+}
+
+/*!
+ * \brief Indicates if the layer is a convolution computed in the
+ * channels-last layout
+ */
+template <typename Layer>
+struct is_channels_last_conv : std::false_type {};
+
+template <typename Desc>
+struct is_channels_last_conv<conv_layer_impl<Desc>> : std::bool_constant<conv_layer_impl<Desc>::activation_function != function::SOFTMAX> {};
+
+template <typename Desc>
+struct is_channels_last_conv<conv_same_layer_impl<Desc>> : std::bool_constant<conv_same_layer_impl<Desc>::activation_function != function::SOFTMAX> {};
+
+/*!
+ * \brief Indicates if the layer is a pooling computed in the channels-last
+ * layout (the max poolings of each channel with non-overlapping windows)
+ */
+template <typename Layer, typename Enable = void>
+struct is_channels_last_pool : std::false_type {};
+
+template <typename Layer>
+struct is_channels_last_pool<Layer, std::enable_if_t<Layer::fusable_pool>> : std::true_type {};
+
+/*!
+ * \brief Apply the activation function of the layer to a batch of output,
+ * with the fast approximations if the layer uses them
+ */
+template <typename Layer, typename Output>
+void activate(Output& output) {
+    if constexpr (Layer::desc::parameters::template contains<fast_activations>() && has_fast_activation(Layer::activation_function) && etl::all_dma<Output>) {
+        f_activate_fast<Layer::activation_function>(output);
+    } else {
+        output = f_activate<Layer::activation_function>(output);
+    }
+}
+
+/*!
+ * \brief Indicates if the layer is an embedding, whose weights can be mapped
+ */
+template <typename Layer>
+struct is_embedding_layer : std::false_type {};
+
+template <typename Desc>
+struct is_embedding_layer<embedding_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_embedding_layer<dyn_embedding_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the layer is a recurrent layer computed step by step by
+ * the streaming inference
+ */
+template <typename Layer>
+struct is_stream_layer : std::false_type {};
+
+template <typename Desc>
+struct is_stream_layer<rnn_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_stream_layer<dyn_rnn_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_stream_layer<lstm_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_stream_layer<dyn_lstm_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the recurrent layer has a cell state
+ */
+template <typename Layer>
+struct has_cell_state : std::false_type {};
+
+template <typename Desc>
+struct has_cell_state<lstm_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct has_cell_state<dyn_lstm_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the layer only keeps the last step of a sequence
+ */
+template <typename Layer>
+struct is_recurrent_last : std::false_type {};
+
+template <typename Desc>
+struct is_recurrent_last<recurrent_last_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_recurrent_last<dyn_recurrent_last_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Returns the number of recurrent layers at the beginning of the
+ * network
+ */
+template <typename DBN, size_t... I>
+constexpr size_t stream_layers(std::index_sequence<I...> /*seq*/) {
+    size_t n     = 0;
+    bool leading = true;
+
+    ((leading = leading && is_stream_layer<typename DBN::template layer_type<I>>::value, n += leading ? 1 : 0), ...);
+
+    return n;
+}
+
+/*!
+ * \brief Indicates if the network can be streamed: its R first layers are
+ * recurrent and are either the whole network or followed by a
+ * recurrent_last layer
+ */
+template <typename DBN, size_t R>
+constexpr bool streaming() {
+    if constexpr (R == 0) {
+        return false;
+    } else if constexpr (R == DBN::layers) {
+        return true;
+    } else {
+        return is_recurrent_last<typename DBN::template layer_type<R>>::value;
+    }
+}
+
+} //end of namespace engine_detail
+
+/*!
+ * \brief An inference plan for a network.
+ *
+ * All the activations are stored in two preallocated buffers, sized for
+ * the largest layer output and the maximum batch size, used alternatively
+ * as input and output of the layers. A forward propagation does not
+ * allocate any memory for the activations.
+ *
+ * The weights of the dense and convolutional layers can be quantized to
+ * int8 with quantize(). These layers are then computed with int8 inputs
+ * and weights, accumulated in int32, and only their outputs are
+ * dequantized.
+ *
+ * The weights of the pruned dense layers can be stored by blocks with
+ * sparsify(), only their non-zero blocks are then computed.
+ *
+ * The dense, convolutional and embedding layers can use their parameters
+ * directly in a model file mapped in memory, with map(), without loading
+ * them in the network. The rows of a mapped embedding are gathered from the
+ * mapping, the rows of the next indices being prefetched.
+ *
+ * The dropout layers and the normalization layers folded into their
+ * previous layer (see fold_batch_normalization() of the network) are
+ * skipped, as well as the shape layers when their input has already the
+ * right shape.
+ *
+ * A global average pooling followed by a dense layer (the classifier head)
+ * is computed at once, the pooled values are kept in a small buffer of
+ * their own and never go through the ping/pong buffers.
+ *
+ * The weights of the dense and convolutional layers are packed in panels at
+ * the creation of the engine (when its batches are small, see packed_batch),
+ * the small batches are then computed by a blocked kernel on the packed
+ * weights, the convolutions by a product with the patches of each sample.
+ *
+ * With the channels_last option of the network, the convolutions and the max
+ * poolings work on channels-last activations ([H x W x C] per sample), the
+ * convolutions being products of the contiguous patches with the packed
+ * filters. The activations are converted to channels-last by the first
+ * layer of each convolutional stack and back when leaving it (before the
+ * dense layers or at the output). The layers computed element by element
+ * (activation, scale, ...) do not change the layout. The channels-last
+ * convolutions are always computed in floating point with the packed
+ * filters, even when the engine is quantized or sparse.
+ *
+ * The networks of dense layers have a single-sample path, forward_one(),
+ * computed with matrix-vector products on the packed weights, without any
+ * allocation.
+ *
+ * The networks starting with recurrent layers (RNN or LSTM), either alone or
+ * followed by a recurrent_last layer, can be streamed with step(): the
+ * engine keeps the recurrent states of each open stream and advances a batch
+ * of streams by a few frames, each frame costing one step instead of the
+ * forward propagation of a whole sequence.
+ *
+ * The engine keeps a reference to the network, it must not outlive it.
+ */
+template <typename DBN>
+struct inference_engine {
+    using dbn_t  = DBN;                    ///< The network type
+    using weight = typename dbn_t::weight; ///< The data type
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers
+
+private:
+    template <size_t L, typename Input>
+    struct shapes_helper {
+        using output_t = std::decay_t<decltype(prepare_one_ready_output(std::declval<const typename dbn_t::template layer_type<L>&>(), std::declval<const Input&>()))>;
+
+        using shape_t = std::array<size_t, etl::dimensions<output_t>()>;
+
+        using type = decltype(std::tuple_cat(std::declval<std::tuple<shape_t>>(), std::declval<typename shapes_helper<L + 1, output_t>::type>()));
+    };
+
+    template <typename Input>
+    struct shapes_helper<layers, Input> {
+        using type = std::tuple<>;
+    };
+
+    using shapes_t = typename shapes_helper<0, typename dbn_t::input_one_t>::type;
+
+    using layers_seq = std::make_index_sequence<layers>; ///< The sequence of the indices of the layers
+
+public:
+    static constexpr bool single_sample = engine_detail::one_supported<dbn_t>(layers_seq()); ///< Indicates if the network supports forward_one()
+    static constexpr size_t single_last = engine_detail::one_last<dbn_t>(layers_seq());      ///< The last layer computed by forward_one()
+    static constexpr size_t single_size = engine_detail::one_max_size<dbn_t>(layers_seq());  ///< The largest output of a layer computed by forward_one()
+    static constexpr size_t single_out  = engine_detail::one_size<dbn_t, single_last>();     ///< The size of the output of forward_one()
+    static constexpr size_t stack_limit = 2048;                                              ///< The largest output kept on the stack by forward_one()
+    static constexpr size_t packed_batch = 32;                                               ///< The largest batch computed with the packed weights
+    static constexpr size_t embedding_prefetch = 8;                                          ///< The distance of the prefetch of the rows of a mapped embedding
+    static constexpr bool channels_last  = dbn_traits<dbn_t>::channels_last();               ///< Indicates if the convolutional stack is channels-last
+    static constexpr size_t stream_layers = engine_detail::stream_layers<dbn_t>(layers_seq()); ///< The number of recurrent layers computed step by step by step()
+    static constexpr bool streaming       = engine_detail::streaming<dbn_t, stream_layers>();  ///< Indicates if the network supports step()
+
+private:
+
+    const dbn_t& dbn;       ///< The network
+    const size_t max_batch; ///< The maximum number of samples in a batch
+
+    shapes_t shapes;     ///< The shape of one output of each layer
+    size_t max_size  = 0; ///< The size of the largest output of one sample
+    size_t head_size = 0; ///< The size of the largest pooled output of one sample given to a fused dense layer
+
+    etl::dyn_matrix<weight, 1> ping; ///< The buffer for the outputs of the even layers
+    etl::dyn_matrix<weight, 1> pong; ///< The buffer for the outputs of the odd layers
+    etl::dyn_matrix<weight, 1> head; ///< The buffer for the pooled outputs given to a fused dense layer
+
+    bool quantized   = false; ///< Indicates if the int8 forward path is used
+    bool calibrating = false; ///< Indicates if the ranges of the inputs are being recorded
+
+    std::array<int8_weights, layers> int8_w; ///< The quantized weights of each layer
+    std::array<float, layers> ranges{};      ///< The calibrated range of the input of each layer
+    std::vector<int8_t> int8_input;          ///< The buffer for the quantized input of a layer
+    std::vector<int8_t> int8_patches;        ///< The buffer for the quantized patches of a convolution
+
+    std::array<block_sparse_weights<weight>, layers> sparse_w; ///< The block-sparse weights of each sparse dense layer
+
+    std::array<weight*, layers> mapped{}; ///< The parameters of each layer in the mapped model, if any
+
+    std::array<packed_gemv_weights<weight>, layers> packed_w; ///< The packed weights of each dense and convolutional layer
+    std::vector<weight> packed_patches;                       ///< The buffer for the patches of a convolution with packed weights
+    bool packed     = false;                                  ///< Indicates if the weights are packed
+    bool one_packed = false;                                  ///< Indicates if the weights are packed for forward_one()
+
+    etl::dyn_matrix<weight, 1> layout; ///< The buffer for the conversions of the layout of the activations (channels_last)
+    bool nhwc = false;                 ///< Indicates if the current activations are channels-last
+    std::array<size_t, 3> nhwc_shape;  ///< The shape [C, H, W] of the current channels-last activations
+
+    stream_states<weight> streams;     ///< The recurrent states of the open streams
+    std::vector<weight> step_ping;     ///< The buffer for the outputs of the even recurrent layers [n x k x H]
+    std::vector<weight> step_pong;     ///< The buffer for the outputs of the odd recurrent layers [n x k x H]
+    std::vector<weight> step_h;        ///< The gathered hidden states of a layer [n x H]
+    std::vector<weight> step_c;        ///< The gathered cell states of a layer [n x H]
+    std::vector<weight> step_last;     ///< The last step of the recurrent layers, for the layers after recurrent_last [n x H]
+    std::vector<uint8_t> step_started; ///< Indicates if each stream of the step has already been started
+
+public:
+    /*!
+     * \brief Create the inference plan of the given network
+     * \param dbn The network
+     * \param max_batch The maximum number of samples in a batch
+     * \param sample One sample of input, to compute the shapes of the outputs
+     */
+    inference_engine(const dbn_t& dbn, size_t max_batch, const typename dbn_t::input_one_t& sample) : dbn(dbn), max_batch(max_batch) {
+        init_shapes<0>(sample);
+
+        ping = etl::dyn_matrix<weight, 1>(max_batch * max_size);
+        pong = etl::dyn_matrix<weight, 1>(max_batch * max_size);
+
+        if (head_size) {
+            head = etl::dyn_matrix<weight, 1>(max_batch * head_size);
+        }
+
+        // The packed weights are only used by the small batches, forward_one()
+        // and the channels-last convolutions
+        if (single_sample || channels_last || max_batch <= packed_batch) {
+            pack_layers();
+        }
+
+        if constexpr (channels_last) {
+            layout = etl::dyn_matrix<weight, 1>(max_batch * std::max(max_size, etl::size(sample)));
+        }
+
+        if constexpr (streaming) {
+            init_streams(std::make_index_sequence<stream_layers>());
+        }
+    }
+
+    /*!
+     * \brief Returns the maximum number of samples in a batch
+     */
+    size_t batch_capacity() const {
+        return max_batch;
+    }
+
+    /*!
+     * \brief Returns the number of outputs of the network for one sample
+     */
+    size_t output_size() const {
+        auto& shape = std::get<layers - 1>(shapes);
+
+        size_t size = 1;
+
+        for (size_t d = 0; d < shape.size(); ++d) {
+            size *= shape[d];
+        }
+
+        return size;
+    }
+
+    /*!
+     * \brief Forward propagate a batch of input through the network.
+     *
+     * The returned batch is a view inside the buffers of the engine, it is
+     * only valid until the next call.
+     *
+     * \param input The batch of input (at most batch_capacity() samples)
+     * \return a view of the output of the last layer for the batch
+     */
+    template <typename Input>
+    auto forward(const Input& input) {
+        return forward_from<0>(input);
+    }
+
+    /*!
+     * \brief Forward propagate a batch of outputs of the layer L - 1 (or of
+     * input when L is zero) through the layers from L to the end of the
+     * network.
+     *
+     * The batch must not be a view inside the buffers of the engine.
+     *
+     * \param input The batch (at most batch_capacity() samples)
+     * \return a view of the output of the last layer for the batch
+     */
+    template <size_t L, typename Input>
+    auto forward_from(const Input& input) {
+        static_assert(L < layers, "Invalid first layer");
+
+        const size_t n = etl::dim<0>(input);
+
+        cpp_assert(n <= max_batch, "Too many samples for the inference engine");
+
+        if constexpr (channels_last) {
+            nhwc = false;
+
+            auto output = forward_impl<L>(input, n, false);
+
+            // The output of the network is always channels-first
+            if (nhwc) {
+                to_channels_first_in_place(output, n);
+            }
+
+            return output;
+        } else {
+            return forward_impl<L>(input, n, false);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a batch of input and store the predicted
+     * label of each sample.
+     *
+     * \param input The batch of input (at most batch_capacity() samples)
+     * \param labels The output labels, must have enough space for the batch
+     */
+    template <typename Input, typename Labels>
+    void predict(const Input& input, Labels&& labels) {
+        auto output = forward(input);
+
+        for (size_t i = 0; i < etl::dim<0>(output); ++i) {
+            labels[i] = etl::max_index(output(i));
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a single sample through the network, with the
+     * packed weights.
+     *
+     * The activations are kept on the stack when the layers are small enough
+     * (see stack_limit), in the buffers of the engine otherwise, nothing is
+     * allocated. The floating point weights are always used, even when the
+     * engine is quantized or sparse.
+     *
+     * \param sample The input sample
+     * \param output The output of the last layer, must have its size
+     */
+    template <typename Input, typename Output>
+    void forward_one(const Input& sample, Output& output) {
+        static_assert(single_sample, "forward_one() only supports networks of dense layers");
+
+        cpp_assert(one_packed, "The weights are not packed for forward_one()");
+        cpp_assert(etl::size(output) == single_out, "Invalid output size for forward_one()");
+
+        cpu_access(sample);
+
+        forward_one_raw(sample.memory_start(), output.memory_start());
+
+        cpu_modified(output);
+    }
+
+    /*!
+     * \brief Forward propagate a single sample and return its predicted label
+     * \param sample The input sample
+     * \return The index of the largest output of the last layer
+     */
+    template <typename Input>
+    size_t predict_one(const Input& sample) {
+        static_assert(single_sample, "predict_one() only supports networks of dense layers");
+
+        cpp_assert(one_packed, "The weights are not packed for forward_one()");
+
+        cpu_access(sample);
+
+        if constexpr (single_size <= stack_limit) {
+            std::array<weight, single_out> output;
+
+            forward_one_raw(sample.memory_start(), output.data());
+
+            return std::max_element(output.begin(), output.end()) - output.begin();
+        } else {
+            const weight* output = forward_one_raw(sample.memory_start(), nullptr);
+
+            return std::max_element(output, output + single_out) - output;
+        }
+    }
+
+    /*!
+     * \brief Pack (again) the weights of the dense and convolutional layers.
+     *
+     * This must be done again if the weights of the network are modified,
+     * map() and unmap() pack the weights themselves.
+     *
+     * \return true if the weights are packed, false if the network has a
+     * single-sample path but a normalization layer is not folded
+     */
+    bool pack() {
+        pack_layers();
+
+        if (single_sample && !one_packed) {
+            std::cerr << "ERROR: The normalization layers must be folded for forward_one()" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Release the packed weights, the batches are then computed with
+     * the weights of the network (forward_one() cannot be used anymore)
+     */
+    void unpack() {
+        for (auto& w : packed_w) {
+            w.clear();
+        }
+
+        packed_patches.clear();
+
+        packed     = false;
+        one_packed = false;
+    }
+
+    /*!
+     * \brief Indicates if the layer L has packed weights
+     */
+    bool is_packed(size_t L) const {
+        return !packed_w[L].empty();
+    }
+
+    /*!
+     * \brief Returns the memory of the packed weights, in bytes
+     */
+    size_t packed_memory() const {
+        size_t bytes = packed_patches.size() * sizeof(weight);
+
+        for (auto& w : packed_w) {
+            bytes += w.memory();
+        }
+
+        return bytes;
+    }
+
+    /*!
+     * \brief Indicates if the weights are packed for forward_one()
+     */
+    bool is_one_packed() const {
+        return one_packed;
+    }
+
+    /*!
+     * \brief Quantize the dense and convolutional layers to int8.
+     *
+     * The weights are quantized per output channel. The range of the input
+     * of each layer is calibrated by forward propagating the batches of the
+     * given generator in floating point.
+     *
+     * \param generator The generator of calibration batches
+     */
+    template <typename Generator>
+    void quantize(Generator& generator) {
+        quantized   = false;
+        calibrating = true;
+        ranges      = {};
+
+        generator.reset();
+        generator.set_test();
+
+        while (generator.has_next_batch()) {
+            forward(generator.data_batch());
+            generator.next_batch();
+        }
+
+        calibrating = false;
+
+        size_t input_size   = 0;
+        size_t patches_size = 0;
+
+        quantize_layers<0>(input_size, patches_size);
+
+        int8_input.resize(max_batch * input_size);
+        int8_patches.resize(patches_size);
+
+        quantized = true;
+    }
+
+    /*!
+     * \brief Go back to the floating point forward path
+     */
+    void dequantize() {
+        quantized = false;
+    }
+
+    /*!
+     * \brief Indicates if the int8 forward path is used
+     */
+    bool is_quantized() const {
+        return quantized;
+    }
+
+    /*!
+     * \brief Store the weights of the sparse enough dense layers by blocks.
+     *
+     * This must be done again if the weights of the network are modified.
+     * The int8 forward path takes precedence over the sparse path.
+     *
+     * \param min_sparsity The minimum ratio of zero blocks of the weights of
+     * a layer to store them by blocks
+     *
+     * \return The number of sparse layers
+     */
+    size_t sparsify(double min_sparsity = 0.5) {
+        size_t n = 0;
+        sparsify_layers<0>(min_sparsity, n);
+        return n;
+    }
+
+    /*!
+     * \brief Go back to the dense weights for all the layers
+     */
+    void densify() {
+        for (auto& w : sparse_w) {
+            w.clear();
+        }
+    }
+
+    /*!
+     * \brief Indicates if the layer L is computed with block-sparse weights
+     */
+    bool is_sparse(size_t L) const {
+        return !sparse_w[L].empty();
+    }
+
+    /*!
+     * \brief Use the parameters of the given mapped model in place for the
+     * dense, convolutional and embedding layers.
+     *
+     * The model must contain the parameters of a network of the same type,
+     * the parameters of the network itself are not used anymore by these
+     * layers. The other layers with parameters must be skipped at inference
+     * (folded normalization layers). The model must outlive the engine.
+     * The int8 path still quantizes the parameters of the network.
+     *
+     * The model can be mapped read-only, so that all the processes serving
+     * the same model share a single copy of the embeddings in the page
+     * cache.
+     *
+     * \param model The mapped model
+     * \return true if the model is used, false if it does not match the
+     * network
+     */
+    bool map(const mapped_model<weight>& model) {
+        mapped = {};
+
+        if (!model.valid()) {
+            std::cerr << "ERROR: Invalid mapped model" << std::endl;
+            return false;
+        }
+
+        size_t offset = 0;
+
+        if (!map_layers<0>(model, offset) || offset != model.size()) {
+            mapped = {};
+
+            std::cerr << "ERROR: The mapped model does not match the network" << std::endl;
+            return false;
+        }
+
+        if (packed) {
+            pack_layers();
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Go back to the parameters of the network
+     */
+    void unmap() {
+        mapped = {};
+
+        if (packed) {
+            pack_layers();
+        }
+    }
+
+    /*!
+     * \brief Indicates if the layer L uses the parameters of a mapped model
+     */
+    bool is_mapped(size_t L) const {
+        return mapped[L];
+    }
+
+    /*!
+     * \brief Hint the kernel that the given rows of the mapped embedding
+     * layer L will soon be read.
+     *
+     * The pages of the hot rows (the most frequent indices) are then read
+     * ahead of the first batches using them. Nothing is done if the layer is
+     * not mapped.
+     *
+     * \param rows The indices of the rows
+     */
+    template <size_t L, typename Rows>
+    void will_need_rows(const Rows& rows) const {
+        static_assert(engine_detail::is_embedding_layer<typename dbn_t::template layer_type<L>>::value, "will_need_rows() is only for embedding layers");
+
+        if (!mapped[L]) {
+            return;
+        }
+
+        auto& layer = dbn.template layer_get<L>();
+
+        const size_t V = etl::dim<0>(layer.w);
+        const size_t K = etl::dim<1>(layer.w);
+
+        for (auto row : rows) {
+            cpp_assert(size_t(row) < V, "Invalid row of the embedding");
+            cpp_unused(V);
+
+            will_need_memory(mapped[L] + size_t(row) * K, K * sizeof(weight));
+        }
+    }
+
+    /*!
+     * \brief Returns the memory of the block-sparse weights, in bytes
+     */
+    size_t sparse_memory() const {
+        size_t bytes = 0;
+
+        for (auto& w : sparse_w) {
+            bytes += w.memory();
+        }
+
+        return bytes;
+    }
+
+    /*!
+     * \brief Open a new stream for step().
+     *
+     * The recurrent states of the stream are zero, its first frame is the
+     * first step of a sequence.
+     *
+     * \return the identifier of the stream
+     */
+    size_t open_stream() {
+        static_assert(streaming, "The network does not support streaming");
+
+        return streams.open();
+    }
+
+    /*!
+     * \brief Close the given stream, its identifier can be given to the next
+     * opened stream
+     */
+    void close_stream(size_t stream) {
+        streams.close(stream);
+    }
+
+    /*!
+     * \brief Reset the recurrent states of the given stream, its next frame
+     * is the first step of a new sequence
+     */
+    void reset_stream(size_t stream) {
+        cpp_assert(streams.is_open(stream), "The stream is not open");
+
+        streams.reset(stream);
+    }
+
+    /*!
+     * \brief Returns the number of frames already given to the stream
+     */
+    size_t stream_steps(size_t stream) const {
+        return streams.steps(stream);
+    }
+
+    /*!
+     * \brief Advance a batch of streams by k frames each.
+     *
+     * The recurrent layers are computed for the k steps of all the streams at
+     * once, from the states kept for each stream. The outputs of a stream are
+     * the outputs of the forward propagation of the sequence of all its
+     * frames since it was opened (or reset), the sequence being not limited
+     * to the time steps of the layers.
+     *
+     * When the recurrent layers are followed by a recurrent_last layer, only
+     * the last step of each stream is propagated through the rest of the
+     * network, otherwise the outputs of the k steps are returned.
+     *
+     * The returned batch is a view inside the buffers of the engine, it is
+     * only valid until the next call.
+     *
+     * \param ids The open streams to advance, each at most once
+     * \param frames The frames of each stream [n x k x S], or [n x S] for a single frame
+     * \return a view of the output of the last layer for the streams
+     */
+    template <typename Input>
+    auto step(const std::vector<size_t>& ids, const Input& frames) {
+        static_assert(streaming, "The network does not support streaming");
+        static_assert(etl::all_dma<Input>, "The frames must be in memory");
+        static_assert(etl::dimensions<Input>() == 2 || etl::dimensions<Input>() == 3, "The frames must be [n x k x S] or [n x S]");
+
+        const size_t n = ids.size();
+        const size_t k = etl::dimensions<Input>() == 3 ? etl::dim(frames, 1) : 1;
+
+        cpp_assert(n == etl::dim<0>(frames), "There must be frames for each stream");
+        cpp_assert(n <= max_batch, "Too many streams for the inference engine");
+
+        step_started.resize(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            cpp_assert(streams.is_open(ids[i]), "The stream is not open");
+
+            step_started[i] = streams.steps(ids[i]) > 0;
+        }
+
+        cpu_access(frames);
+
+        weight* last = step_layers<0>(ids, frames.memory_start(), n, k);
+
+        streams.advance(ids, k);
+
+        const size_t H = dbn.template layer_get<stream_layers - 1>().hidden_units;
+
+        if constexpr (stream_layers == layers) {
+            return etl::custom_dyn_matrix<weight, 3>(last, n, k, H);
+        } else {
+            // The recurrent_last layer only keeps the last step of each stream
+            step_last.resize(n * H);
+
+            for (size_t i = 0; i < n; ++i) {
+                std::copy_n(last + (i * k + k - 1) * H, H, step_last.data() + i * H);
+            }
+
+            auto features = etl::custom_dyn_matrix<weight, 2>(step_last.data(), n, H);
+
+            if constexpr (stream_layers + 1 == layers) {
+                return features;
+            } else {
+                return forward_from<stream_layers + 1>(features);
+            }
+        }
+    }
+
+private:
+    /*!
+     * \brief Register the recurrent layers in the states of the streams and
+     * pack their weights
+     */
+    template <size_t... I>
+    void init_streams(std::index_sequence<I...> /*seq*/) {
+        auto add = [this](auto& layer, bool cell) {
+            streams.add_layer(layer.hidden_units, cell);
+            layer.prepare_steps();
+        };
+
+        (add(dbn.template layer_get<I>(), engine_detail::has_cell_state<typename dbn_t::template layer_type<I>>::value), ...);
+    }
+
+    /*!
+     * \brief Advance the streams through the recurrent layers from L to the
+     * last one
+     *
+     * \return a pointer to the outputs of the last recurrent layer [n x k x H]
+     */
+    template <size_t L>
+    weight* step_layers(const std::vector<size_t>& ids, const weight* input, size_t n, size_t k) {
+        auto& layer = dbn.template layer_get<L>();
+
+        const size_t H = layer.hidden_units;
+
+        auto& output = L % 2 ? step_pong : step_ping;
+
+        output.resize(n * k * H);
+        step_h.resize(n * H);
+        step_c.resize(n * H);
+
+        streams.gather(L, ids, step_h.data(), step_c.data());
+
+        layer.step_batch(output.data(), input, n, k, step_h.data(), step_c.data(), step_started.data());
+
+        streams.scatter(L, ids, step_h.data(), step_c.data());
+
+        if constexpr (L + 1 < stream_layers) {
+            return step_layers<L + 1>(ids, output.data(), n, k);
+        } else {
+            return output.data();
+        }
+    }
+
+    /*!
+     * \brief Pack the weights of all the dense and convolutional layers
+     */
+    void pack_layers() {
+        size_t patches_size = 0;
+
+        const bool folded = pack_layers<0>(patches_size);
+
+        packed_patches.resize(patches_size);
+
+        packed     = true;
+        one_packed = single_sample && folded;
+    }
+
+    /*!
+     * \brief Pack the weights of the layer L and of the following layers
+     * \return false if a normalization layer is not folded
+     */
+    template <size_t L>
+    bool pack_layers(size_t& patches_size) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        bool valid = true;
+
+        if constexpr (is_int8_layer<layer_t>::value) {
+            constexpr bool dense = decay_layer_traits<layer_t>::is_dense_layer();
+
+            const weight* w = nullptr;
+            const weight* b = nullptr;
+
+            // The parameters of a mapped layer are in the model
+            if (mapped[L]) {
+                w = mapped[L];
+
+                if constexpr (!layer_t::no_bias) {
+                    b = mapped[L] + etl::size(dbn.template layer_get<L>().w);
+                }
+            } else {
+                auto& layer = dbn.template layer_get<L>();
+
+                cpu_access(layer.w);
+
+                w = layer.w.memory_start();
+
+                if constexpr (!layer_t::no_bias) {
+                    cpu_access(layer.b);
+
+                    b = layer.b.memory_start();
+                }
+            }
+
+            if constexpr (dense) {
+                constexpr size_t H = layer_t::num_hidden;
+
+                packed_w[L].pack([w](size_t v, size_t h) { return w[v * H + h]; }, b, layer_t::num_visible, H);
+            } else if constexpr (channels_last) {
+                pack_channels_last<L>(w, b, patches_size);
+            } else {
+                // The filters are transposed once, the channels are the outputs
+                constexpr size_t CW = layer_t::NC * layer_t::NW1 * layer_t::NW2;
+
+                packed_w[L].pack([w](size_t v, size_t k) { return w[k * CW + v]; }, b, CW, layer_t::K);
+
+                patches_size = std::max(patches_size, layer_t::NH1 * layer_t::NH2 * CW);
+            }
+        } else if constexpr (channels_last && engine_detail::is_channels_last_conv<layer_t>::value) {
+            auto& layer = dbn.template layer_get<L>();
+
+            cpu_access(layer.w, layer.b);
+
+            pack_channels_last<L>(layer.w.memory_start(), layer.b.memory_start(), patches_size);
+
+            valid = false;
+        } else if constexpr (!dbn_detail::is_inference_identity<layer_t>::value && !dbn_detail::is_view_layer<layer_t>::value) {
+            // A normalization layer can only be skipped once folded
+            valid = L > 0 && dbn.is_folded(L);
+        }
+
+        if constexpr (L + 1 < layers) {
+            return pack_layers<L + 1>(patches_size) && valid;
+        } else {
+            return valid;
+        }
+    }
+
+    /*!
+     * \brief Returns the zero padding of the first dimension of the
+     * convolutional layer L
+     */
+    template <size_t L>
+    static constexpr size_t conv_padding_1() {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        return (layer_t::NH1 + layer_t::NW1 - 1 - layer_t::NV1) / 2;
+    }
+
+    /*!
+     * \brief Returns the zero padding of the second dimension of the
+     * convolutional layer L
+     */
+    template <size_t L>
+    static constexpr size_t conv_padding_2() {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        return (layer_t::NH2 + layer_t::NW2 - 1 - layer_t::NV2) / 2;
+    }
+
+    /*!
+     * \brief Pack the filters [K x NC x NW1 x NW2] of the convolutional layer
+     * L for the channels-last patches, whose rows are ordered [NW1 x NW2 x NC]
+     */
+    template <size_t L>
+    void pack_channels_last(const weight* w, const weight* b, size_t& patches_size) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        constexpr size_t NC  = layer_t::NC;
+        constexpr size_t NW1 = layer_t::NW1;
+        constexpr size_t NW2 = layer_t::NW2;
+        constexpr size_t CW  = NC * NW1 * NW2;
+
+        auto filter = [w](size_t v, size_t k) {
+            const size_t c = v % NC;
+            const size_t q = (v / NC) % NW2;
+            const size_t p = v / (NC * NW2);
+
+            return w[k * CW + (c * NW1 + p) * NW2 + q];
+        };
+
+        packed_w[L].pack(filter, dbn_detail::has_biases<layer_t>::value ? b : nullptr, CW, layer_t::K);
+
+        // A 1x1 convolution without padding reads the input directly
+        if constexpr (NW1 * NW2 > 1) {
+            patches_size = std::max(patches_size, layer_t::NH1 * layer_t::NH2 * CW);
+        }
+    }
+
+    /*!
+     * \brief Extract the patches of one sample of the input of the
+     * convolutional layer L, one row of NC x NW1 x NW2 values for each
+     * output position
+     */
+    template <size_t L, typename T>
+    static void extract_patches(T* patch, const T* in) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        constexpr size_t NC  = layer_t::NC;
+        constexpr size_t NV1 = layer_t::NV1;
+        constexpr size_t NV2 = layer_t::NV2;
+        constexpr size_t NW1 = layer_t::NW1;
+        constexpr size_t NW2 = layer_t::NW2;
+
+        for (size_t i = 0; i < layer_t::NH1; ++i) {
+            for (size_t j = 0; j < layer_t::NH2; ++j) {
+                for (size_t c = 0; c < NC; ++c) {
+                    for (size_t p = 0; p < NW1; ++p) {
+                        for (size_t q = 0; q < NW2; ++q) {
+                            *patch++ = in[(c * NV1 + i + p) * NV2 + j + q];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a batch through the layer L with its packed
+     * weights
+     */
+    template <size_t L, typename Output, typename Input>
+    void packed_forward(Output& output, const Input& input, size_t n) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        cpu_access(input);
+
+        if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+            packed_gemm(output.memory_start(), input.memory_start(), n, packed_w[L], layer_t::num_hidden, 1);
+        } else {
+            constexpr size_t NH = layer_t::NH1 * layer_t::NH2;
+            constexpr size_t NV = layer_t::NC * layer_t::NV1 * layer_t::NV2;
+
+            for (size_t s = 0; s < n; ++s) {
+                extract_patches<L>(packed_patches.data(), input.memory_start() + s * NV);
+
+                // The output positions are the rows, the channels the columns
+                packed_gemm(output.memory_start() + s * layer_t::K * NH, packed_patches.data(), NH, packed_w[L], 1, NH);
+            }
+        }
+
+        cpu_modified(output);
+
+        if constexpr (layer_t::activation_function != function::IDENTITY) {
+            engine_detail::activate<layer_t>(output);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a single sample from its raw memory to the
+     * raw memory of the output.
+     *
+     * Without output, the output of the last layer stays in the buffers of
+     * the engine, which is only possible when they are used.
+     *
+     * \return the output of the last layer
+     */
+    const weight* forward_one_raw(const weight* input, weight* output) {
+        if constexpr (single_size <= stack_limit) {
+            std::array<weight, single_size> a;
+            std::array<weight, single_size> b;
+
+            return forward_one_layer<0>(input, a.data(), b.data(), output);
+        } else {
+            return forward_one_layer<0>(input, ping.memory_start(), pong.memory_start(), output);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a single sample from the layer L to the end.
+     *
+     * The dense layers write alternatively in the two buffers, the last one
+     * writes directly into the output.
+     */
+    template <size_t L>
+    const weight* forward_one_layer(const weight* input, weight* buffer, weight* other, weight* output) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        if constexpr (engine_detail::is_one_dense<dbn_t, L>()) {
+            weight* y = (L == single_last && output) ? output : buffer;
+
+            packed_gemv(y, input, packed_w[L]);
+
+            activate_one<layer_t::activation_function, layer_t::fast_activations>(y, layer_t::num_hidden);
+
+            if constexpr (L < single_last) {
+                return forward_one_layer<L + 1>(y, other, buffer, output);
+            } else {
+                return y;
+            }
+        } else {
+            // The skipped layers leave their input unchanged, the layers
+            // after the last dense layer are never reached
+            return forward_one_layer<L + 1>(input, buffer, other, output);
+        }
+    }
+
+    /*!
+     * \brief Quantize the weights of the layer L and of the following
+     * layers.
+     */
+    template <size_t L>
+    void quantize_layers(size_t& input_size, size_t& patches_size) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        if constexpr (is_int8_layer<layer_t>::value) {
+            auto& layer = dbn.template layer_get<L>();
+
+            if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+                // The channels are the columns of the weights
+                quantize_channels(int8_w[L], [&layer](size_t c, size_t i) { return layer.w(i, c); }, layer_t::num_hidden, layer_t::num_visible);
+            } else {
+                constexpr size_t CW = layer_t::NC * layer_t::NW1 * layer_t::NW2;
+
+                quantize_channels(int8_w[L], [&layer](size_t c, size_t i) { return layer.w[c * CW + i]; }, layer_t::K, CW);
+
+                patches_size = std::max(patches_size, layer_t::NH1 * layer_t::NH2 * CW);
+            }
+
+            input_size = std::max(input_size, layer_t::input_size());
+        }
+
+        if constexpr (L + 1 < layers) {
+            quantize_layers<L + 1>(input_size, patches_size);
+        }
+    }
+
+    /*!
+     * \brief Returns the number of parameters of the layer in the flat
+     * store (see flat_parameters() of the network)
+     */
+    template <typename L>
+    static size_t parameters_size(const L& layer) {
+        size_t n = 0;
+
+        if constexpr (dbn_detail::has_sub_layers<L>::value) {
+            cpp::for_each(layer.layers, [&n](auto& sub_layer) {
+                n += parameters_size(sub_layer);
+            });
+        } else if constexpr (decay_layer_traits<L>::is_neural_layer()) {
+            cpp::for_each(layer.trainable_parameters(), [&n](auto& variable) {
+                n += etl::size(variable);
+            });
+
+            if constexpr (decay_layer_traits<L>::is_rbm_layer()) {
+                n += etl::size(layer.c);
+            }
+        }
+
+        return n;
+    }
+
+    /*!
+     * \brief Find the parameters of the layer L and of the following layers
+     * in the mapped model
+     * \return false if a layer with parameters cannot be mapped
+     */
+    template <size_t L>
+    bool map_layers(const mapped_model<weight>& model, size_t& offset) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        const size_t n = parameters_size(dbn.template layer_get<L>());
+
+        bool valid = offset + n <= model.size();
+
+        if constexpr (is_int8_layer<layer_t>::value || engine_detail::is_embedding_layer<layer_t>::value) {
+            if (valid) {
+                mapped[L] = model.data() + offset;
+            }
+        } else {
+            // The parameters of the other layers are not used at inference
+            valid = valid && (!n || (L > 0 && dbn.is_folded(L)));
+        }
+
+        offset += n;
+
+        if constexpr (L + 1 < layers) {
+            return map_layers<L + 1>(model, offset) && valid;
+        } else {
+            return valid;
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a batch through the layer L with the
+     * parameters of the mapped model
+     */
+    template <size_t L, typename Output, typename Input>
+    void mapped_forward(Output& output, const Input& input, size_t n) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        weight* memory = mapped[L];
+
+        if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+            constexpr size_t V = layer_t::num_visible;
+            constexpr size_t H = layer_t::num_hidden;
+
+            output = etl::reshape(input, n, V) * etl::custom_dyn_matrix<weight, 2>(memory, V, H);
+
+            if constexpr (!layer_t::no_bias) {
+                output = bias_add_2d(output, etl::custom_dyn_matrix<weight, 1>(memory + V * H, H));
+            }
+        } else {
+            constexpr size_t K  = layer_t::K;
+            constexpr size_t NC = layer_t::NC;
+            constexpr size_t NW = NC * layer_t::NW1 * layer_t::NW2;
+
+            auto w = etl::custom_dyn_matrix<weight, 4>(memory, K, NC, layer_t::NW1, layer_t::NW2);
+
+            output = etl::ml::convolution_forward(etl::reshape(input, n, NC, layer_t::NV1, layer_t::NV2), w);
+
+            if constexpr (!layer_t::no_bias) {
+                output = bias_add_4d(output, etl::custom_dyn_matrix<weight, 1>(memory + K * NW, K));
+            }
+        }
+
+        if constexpr (layer_t::activation_function != function::IDENTITY) {
+            engine_detail::activate<layer_t>(output);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a batch through the embedding layer L with
+     * the rows of the mapped model.
+     *
+     * The rows are scattered in the table, and most of them are not in the
+     * caches, the row of a later index is prefetched while a row is copied.
+     */
+    template <size_t L, typename Output, typename Input>
+    void mapped_embedding_forward(Output& output, const Input& input, size_t n) {
+        auto& layer = dbn.template layer_get<L>();
+
+        const size_t V = etl::dim<0>(layer.w);
+        const size_t K = etl::dim<1>(layer.w);
+        const size_t N = n * layer.input_size();
+
+        const weight* w = mapped[L];
+
+        auto row = [V, K, w](weight index) {
+            const auto r = size_t(index);
+
+            cpp_assert(r < V, "Invalid index for the embedding");
+            cpp_unused(V);
+
+            return w + r * K;
+        };
+
+        cpu_access(input);
+
+        const weight* in = input.memory_start();
+        weight* out      = output.memory_start();
+
+        for (size_t i = 0; i < N; ++i) {
+            if (i + embedding_prefetch < N) {
+                __builtin_prefetch(row(in[i + embedding_prefetch]));
+            }
+
+            std::copy_n(row(in[i]), K, out + i * K);
+        }
+
+        cpu_modified(output);
+    }
+
+    /*!
+     * \brief Store the weights of the layer L and of the following layers by
+     * blocks, if they are sparse enough
+     */
+    template <size_t L>
+    void sparsify_layers(double min_sparsity, size_t& n) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        sparse_w[L].clear();
+
+        if constexpr (is_int8_layer<layer_t>::value && decay_layer_traits<layer_t>::is_dense_layer()) {
+            using block_t = block_sparse_weights<weight>;
+
+            auto sparsify_weights = [&](const auto& w) {
+                if (1.0 - block_density<block_t::block>(w) >= min_sparsity) {
+                    sparse_w[L].assign(w);
+                    ++n;
+                }
+            };
+
+            // The weights of a mapped layer are in the model
+            if (mapped[L]) {
+                sparsify_weights(etl::custom_dyn_matrix<weight, 2>(mapped[L], layer_t::num_visible, layer_t::num_hidden));
+            } else {
+                sparsify_weights(dbn.template layer_get<L>().w);
+            }
+        }
+
+        if constexpr (L + 1 < layers) {
+            sparsify_layers<L + 1>(min_sparsity, n);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a batch through the dense layer L with its
+     * block-sparse weights
+     */
+    template <size_t L, typename Output, typename Input>
+    void sparse_forward(Output& output, const Input& input, size_t n) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        block_sparse_mul(output, input, sparse_w[L], n);
+
+        if constexpr (!layer_t::no_bias) {
+            // The biases of a mapped layer are in the model
+            if (mapped[L]) {
+                output = bias_add_2d(output, etl::custom_dyn_matrix<weight, 1>(mapped[L] + layer_t::num_visible * layer_t::num_hidden, layer_t::num_hidden));
+            } else {
+                output = bias_add_2d(output, dbn.template layer_get<L>().b);
+            }
+        }
+
+        if constexpr (layer_t::activation_function != function::IDENTITY) {
+            engine_detail::activate<layer_t>(output);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a batch through the layer L with the int8
+     * path
+     */
+    template <size_t L, typename Output, typename Input>
+    void int8_forward(Output& output, const Input& input, size_t n) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        auto& layer = dbn.template layer_get<L>();
+
+        const float scale = int8_scale(ranges[L]);
+
+        quantize_values(int8_input.data(), etl::reshape(input, n * layer_t::input_size()), n * layer_t::input_size(), scale);
+
+        if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+            int8_gemm(output.memory_start(), int8_input.data(), n, int8_w[L], scale, layer_t::num_hidden, 1);
+
+            if constexpr (!layer_t::no_bias) {
+                output = bias_add_2d(output, layer.b);
+            }
+        } else {
+            constexpr size_t NH = layer_t::NH1 * layer_t::NH2;
+            constexpr size_t NV = layer_t::NC * layer_t::NV1 * layer_t::NV2;
+
+            for (size_t s = 0; s < n; ++s) {
+                extract_patches<L>(int8_patches.data(), int8_input.data() + s * NV);
+
+                int8_gemm(output.memory_start() + s * layer_t::K * NH, int8_patches.data(), NH, int8_w[L], scale, 1, NH);
+            }
+
+            if constexpr (!layer_t::no_bias) {
+                output = bias_add_4d(output, layer.b);
+            }
+        }
+
+        if constexpr (layer_t::activation_function != function::IDENTITY) {
+            engine_detail::activate<layer_t>(output);
+        }
+    }
+
+    /*!
+     * \brief Compute the shape of the output of the layer L and of the
+     * following layers.
+     */
+    template <size_t L, typename Input>
+    void init_shapes(const Input& input) {
+        auto one = prepare_one_ready_output(dbn.template layer_get<L>(), input);
+
+        auto& shape = std::get<L>(shapes);
+
+        for (size_t d = 0; d < shape.size(); ++d) {
+            shape[d] = etl::dim(one, d);
+        }
+
+        max_size = std::max(max_size, etl::size(one));
+
+        if constexpr (L + 1 < layers) {
+            if constexpr (dbn_detail::is_fusable_head<typename dbn_t::template layer_type<L>, typename dbn_t::template layer_type<L + 1>>::value) {
+                head_size = std::max(head_size, etl::size(one));
+            }
+
+            init_shapes<L + 1>(one);
+        }
+    }
+
+    /*!
+     * \brief Create a batch view of n outputs of the layer L in one of the
+     * buffers
+     */
+    template <size_t L, size_t... I>
+    auto output_view(size_t n, bool use_pong, std::index_sequence<I...> /*seq*/) {
+        auto& shape = std::get<L>(shapes);
+
+        weight* memory = use_pong ? pong.memory_start() : ping.memory_start();
+
+        return etl::custom_dyn_matrix<weight, sizeof...(I) + 1>(memory, n, shape[I]...);
+    }
+
+    /*!
+     * \brief Forward propagate a batch through the layer L only
+     */
+    template <size_t L, typename Output, typename Input>
+    void layer_forward(Output& output, const Input& input, size_t n) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        if constexpr (channels_last) {
+            if constexpr (engine_detail::is_channels_last_pool<layer_t>::value) {
+                channels_last_forward<L>(output, input, n);
+                return;
+            } else if constexpr (engine_detail::is_channels_last_conv<layer_t>::value) {
+                if (!packed_w[L].empty()) {
+                    channels_last_forward<L>(output, input, n);
+                    return;
+                }
+            }
+
+            // The other layers, except the element-wise ones, need
+            // channels-first activations
+            if constexpr (!dbn_detail::is_inplace_layer<layer_t>::value) {
+                if (nhwc) {
+                    nhwc = false;
+
+                    to_channels_first(layout.memory_start(), input.memory_start(), n, nhwc_shape[0], nhwc_shape[1], nhwc_shape[2]);
+
+                    auto converted = same_shape_view(layout.memory_start(), input, std::make_index_sequence<etl::dimensions<Input>()>());
+
+                    layer_forward<L>(output, converted, n);
+                    return;
+                }
+            }
+        }
+
+        if (calibrating) {
+            ranges[L] = std::max(ranges[L], float(etl::max(etl::abs(input))));
+        }
+
+        if constexpr (is_int8_layer<layer_t>::value) {
+            if (quantized) {
+                int8_forward<L>(output, input, n);
+            } else if (!sparse_w[L].empty()) {
+                if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+                    sparse_forward<L>(output, input, n);
+                }
+            } else if (!packed_w[L].empty() && n <= packed_batch) {
+                packed_forward<L>(output, input, n);
+            } else if (mapped[L]) {
+                mapped_forward<L>(output, input, n);
+            } else {
+                dbn.template layer_get<L>().test_forward_batch(output, input);
+            }
+        } else if constexpr (engine_detail::is_embedding_layer<layer_t>::value) {
+            if (mapped[L]) {
+                mapped_embedding_forward<L>(output, input, n);
+            } else {
+                dbn.template layer_get<L>().test_forward_batch(output, input);
+            }
+        } else {
+            cpp_unused(n);
+
+            dbn.template layer_get<L>().test_forward_batch(output, input);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a batch through the layer L in the
+     * channels-last layout, the input being converted first if it is
+     * channels-first
+     */
+    template <size_t L, typename Output, typename Input>
+    void channels_last_forward(Output& output, const Input& input, size_t n) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        cpu_access(input);
+
+        const weight* in = input.memory_start();
+
+        if constexpr (engine_detail::is_channels_last_conv<layer_t>::value) {
+            constexpr size_t NC  = layer_t::NC;
+            constexpr size_t NV1 = layer_t::NV1;
+            constexpr size_t NV2 = layer_t::NV2;
+            constexpr size_t K   = layer_t::K;
+            constexpr size_t NH  = layer_t::NH1 * layer_t::NH2;
+
+            if (!nhwc) {
+                to_channels_last(layout.memory_start(), in, n, NC, NV1, NV2);
+                in = layout.memory_start();
+            }
+
+            for (size_t s = 0; s < n; ++s) {
+                const weight* sample = in + s * NC * NV1 * NV2;
+
+                if constexpr (layer_t::NW1 * layer_t::NW2 > 1) {
+                    channels_last_patches(packed_patches.data(), sample, NC, NV1, NV2, layer_t::NW1, layer_t::NW2, conv_padding_1<L>(), conv_padding_2<L>());
+
+                    sample = packed_patches.data();
+                }
+
+                // The output positions are the rows, the channels are contiguous
+                packed_gemm(output.memory_start() + s * K * NH, sample, NH, packed_w[L], K, 1);
+            }
+
+            cpu_modified(output);
+
+            if constexpr (layer_t::activation_function != function::IDENTITY) {
+                engine_detail::activate<layer_t>(output);
+            }
+
+            nhwc_shape = {K, layer_t::NH1, layer_t::NH2};
+        } else {
+            constexpr size_t C  = layer_t::I1;
+            constexpr size_t H  = layer_t::I2;
+            constexpr size_t W  = layer_t::I3;
+
+            if (!nhwc) {
+                to_channels_last(layout.memory_start(), in, n, C, H, W);
+                in = layout.memory_start();
+            }
+
+            channels_last_max_pool(output.memory_start(), in, n, C, H, W, layer_t::SC1, layer_t::SC2);
+
+            cpu_modified(output);
+
+            nhwc_shape = {C, H / layer_t::SC1, W / layer_t::SC2};
+        }
+
+        nhwc = true;
+    }
+
+    /*!
+     * \brief Convert the channels-last output of the network back to
+     * channels-first
+     */
+    template <typename Output>
+    void to_channels_first_in_place(Output& output, size_t n) {
+        weight* memory = output.memory_start();
+
+        std::copy_n(memory, n * nhwc_shape[0] * nhwc_shape[1] * nhwc_shape[2], layout.memory_start());
+
+        to_channels_first(memory, layout.memory_start(), n, nhwc_shape[0], nhwc_shape[1], nhwc_shape[2]);
+
+        cpu_modified(output);
+
+        nhwc = false;
+    }
+
+    /*!
+     * \brief Create a view of the given memory with the shape of the given
+     * batch
+     */
+    template <typename Input, size_t... I>
+    static auto same_shape_view(weight* memory, const Input& input, std::index_sequence<I...> /*seq*/) {
+        return etl::custom_dyn_matrix<weight, sizeof...(I)>(memory, etl::dim(input, I)...);
+    }
+
+    /*!
+     * \brief Forward propagate the batch from the layer L to the end
+     */
+    template <size_t L, typename Input>
+    auto forward_impl(const Input& input, size_t n, bool use_pong) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        constexpr size_t D = std::tuple_size<std::tuple_element_t<L, shapes_t>>::value;
+
+        // A view layer is skipped when its input has its output shape, the
+        // next layer reads the same memory
+        if constexpr (L + 1 < layers && dbn_detail::is_view_layer<layer_t>::value && etl::dimensions<Input>() == D + 1) {
+            return forward_impl<L + 1>(input, n, use_pong);
+        } else {
+            return forward_compute<L>(input, n, use_pong);
+        }
+    }
+
+    /*!
+     * \brief Compute the layer L for the batch and forward propagate it to
+     * the end
+     */
+    template <size_t L, typename Input>
+    auto forward_compute(const Input& input, size_t n, bool use_pong) {
+        using layer_t = typename dbn_t::template layer_type<L>;
+
+        if constexpr (L > 0 && (dbn_detail::is_inference_identity<layer_t>::value || dbn_detail::is_foldable_pair<typename dbn_t::template layer_type<L - 1>, layer_t>::value)) {
+            // The input of a skipped layer is always a view of one of the
+            // buffers, of the same type as its output
+            if (dbn_detail::is_inference_identity<layer_t>::value || dbn.is_folded(L)) {
+                if constexpr (L + 1 < layers) {
+                    return forward_impl<L + 1>(input, n, use_pong);
+                } else {
+                    return input;
+                }
+            }
+        }
+
+        if constexpr (L + 1 < layers && dbn_detail::is_fusable_head<layer_t, typename dbn_t::template layer_type<L + 1>>::value) {
+            constexpr size_t D = std::tuple_size<std::tuple_element_t<L + 1, shapes_t>>::value;
+
+            // The pooled values only go through the small head buffer, the
+            // dense layer reads them from there
+            auto pooled = etl::custom_dyn_matrix<weight, 2>(head.memory_start(), n, std::get<L>(shapes)[0]);
+            auto output = output_view<L + 1>(n, use_pong, std::make_index_sequence<D>());
+
+            layer_forward<L>(pooled, input, n);
+            layer_forward<L + 1>(output, pooled, n);
+
+            if constexpr (L + 2 < layers) {
+                return forward_impl<L + 2>(output, n, !use_pong);
+            } else {
+                return output;
+            }
+        } else {
+            constexpr size_t D = std::tuple_size<std::tuple_element_t<L, shapes_t>>::value;
+
+            // The output of an in-place layer overwrites its input, in the buffer
+            // of the previous layer
+            constexpr bool inplace = L > 0 && dbn_detail::is_inplace_layer<layer_t>::value;
+
+            const bool out_pong = inplace ? !use_pong : use_pong;
+
+            auto output = output_view<L>(n, out_pong, std::make_index_sequence<D>());
+
+            layer_forward<L>(output, input, n);
+
+            if constexpr (L + 1 < layers) {
+                return forward_impl<L + 1>(output, n, !out_pong);
+            } else {
+                return output;
+            }
+        }
+    }
+};
+
+/*!
+ * \brief The comparison of the floating point and int8 forward paths of a
+ * network
+ */
+struct quantization_report {
+    double fp32_error; ///< The classification error in floating point
+    double int8_error; ///< The classification error in int8
+    double fp32_time;  ///< The time of the evaluation in floating point, in milliseconds
+    double int8_time;  ///< The time of the evaluation in int8, in milliseconds
+};
+
+/*!
+ * \brief Compare the accuracy and the speed of the floating point and int8
+ * inference of a network on the same test generator.
+ *
+ * The reference error is computed with evaluate_error of the network, the
+ * timings are measured with an inference engine in both modes.
+ *
+ * \param dbn The network
+ * \param calibration The generator of calibration batches
+ * \param test The test generator
+ * \param os The stream to print the report to
+ * \return The report
+ */
+template <typename DBN, typename Calibration, typename Test>
+quantization_report int8_quantization_report(DBN& dbn, Calibration& calibration, Test& test, std::ostream& os = std::cout) {
+    auto engine = dbn.make_inference_engine(std::max(Calibration::batch_size, Test::batch_size));
+
+    auto engine_forward = [&engine](auto&& input_batch) {
+        return engine.forward(input_batch);
+    };
+
+    auto timed = [&](auto&& evaluate) {
+        auto start = std::chrono::steady_clock::now();
+        evaluate();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    quantization_report report;
+
+    report.fp32_error = dbn.evaluate_error(test);
+    report.fp32_time  = timed([&] { dbn.evaluate_metrics(test, engine_forward); });
+
+    engine.quantize(calibration);
+
+    report.int8_time = timed([&] { report.int8_error = std::get<0>(dbn.evaluate_metrics(test, engine_forward)); });
+
+    os << "fp32: error=" << report.fp32_error << " time=" << report.fp32_time << "ms" << std::endl;
+    os << "int8: error=" << report.int8_error << " time=" << report.int8_time << "ms"
+       << " (x" << (report.int8_time > 0.0 ? report.fp32_time / report.int8_time : 0.0) << ")" << std::endl;
+
+    return report;
+}
+
+} //end of dll namespace
@@ -0,0 +1,456 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Request-coalescing front-end for serving a network, with one
+ * replica per NUMA node
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll/inference_engine.hpp"
+#include "dll/util/metrics.hpp"
+#include "dll/util/numa.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Statistics of an inference server
+ */
+struct inference_stats {
+    size_t requests   = 0;   ///< The number of completed requests
+    size_t batches    = 0;   ///< The number of dispatched batches
+    double p50        = 0.0; ///< The median latency, in microseconds
+    double p99        = 0.0; ///< The 99th percentile latency, in microseconds
+    double throughput = 0.0; ///< The number of requests per second
+
+    /*!
+     * \brief Returns the average number of samples per batch
+     */
+    double average_batch() const {
+        return batches ? double(requests) / batches : 0.0;
+    }
+};
+
+/*!
+ * \brief Serve single-sample requests by coalescing them into batches.
+ *
+ * The requests are queued and the workers form batches of up to max_batch
+ * samples. A batch is dispatched as soon as it is full or when the oldest
+ * queued request has waited for the given deadline. The batch is forwarded
+ * with an inference_engine and the results are given back through
+ * futures.
+ *
+ * With the replicate NUMA policy (DLL_NUMA) on a machine with several
+ * nodes, the server has one replica per node: a copy of the network
+ * allocated on the node (see numa_replicas), a queue and workers pinned to
+ * the CPUs of the node, each with its own engine allocated on the node. A
+ * request goes to the replica of the node of the submitting thread, unless
+ * this replica has a full round of batches pending, then it goes to the
+ * least-loaded replica. Otherwise, there is a single replica using the
+ * network directly.
+ *
+ * The server keeps a reference to the network, it must not outlive it.
+ * The replicas are copies of the network at the creation of the server.
+ */
+template <typename DBN>
+struct inference_server {
+    using dbn_t       = DBN;                         ///< The network type
+    using weight      = typename dbn_t::weight;      ///< The data type
+    using input_one_t = typename dbn_t::input_one_t; ///< The type of one input
+    using engine_t    = inference_engine<dbn_t>;     ///< The type of the inference engine
+    using clock       = std::chrono::steady_clock;   ///< The clock for the latencies
+
+    using batch_t  = etl::dyn_matrix<weight, etl::dimensions<input_one_t>() + 1>;                 ///< The type of an input batch
+    using output_t = decltype(std::declval<engine_t&>().forward(std::declval<const batch_t&>())); ///< The type of an output batch
+    using result_t = etl::dyn_matrix<weight, etl::dimensions<output_t>() - 1>;                     ///< The type of one result
+
+    static constexpr size_t latency_window = 1 << 16; ///< The number of latencies kept for the percentiles
+
+private:
+    /*!
+     * \brief A queued request
+     */
+    struct request {
+        input_one_t sample;             ///< The sample to forward
+        std::promise<result_t> promise; ///< The promise of the result
+        clock::time_point start;        ///< The time of submission
+    };
+
+    /*!
+     * \brief A replica of the network with its queue and its workers
+     */
+    struct replica {
+        const dbn_t& network; ///< The network of the replica
+
+        std::mutex lock;               ///< The lock protecting the queue
+        std::condition_variable ready; ///< Signals new requests to the workers
+        std::deque<request> queue;     ///< The queued requests
+        bool stop_flag = false;        ///< Indicates to the workers to stop
+
+        std::atomic<size_t> pending{0}; ///< The number of submitted requests not yet served
+
+        mutable std::mutex stats_lock; ///< The lock protecting the statistics
+        std::vector<size_t> latencies; ///< The last latencies, in microseconds
+        size_t completed  = 0;         ///< The number of completed requests
+        size_t dispatched = 0;         ///< The number of dispatched batches
+
+        std::vector<std::thread> workers; ///< The worker threads
+
+        explicit replica(const dbn_t& network) : network(network) {
+            latencies.reserve(latency_window);
+        }
+    };
+
+    const size_t max_batch;                   ///< The maximum number of samples in a batch
+    const std::chrono::microseconds deadline; ///< The maximum time a request waits for a batch to form
+    const input_one_t sample;                 ///< One sample of input, for the shapes of the engines
+
+    std::unique_ptr<numa_replicas<dbn_t>> copies;   ///< The copies of the network on each node (replicated only)
+    std::vector<std::unique_ptr<replica>> replicas; ///< The replicas
+
+    clock::time_point started; ///< The start of the server
+
+public:
+    /*!
+     * \brief Create a server for the given network
+     * \param dbn The network to serve
+     * \param max_batch The maximum number of samples in a batch
+     * \param deadline The maximum time a request waits for a batch to form
+     * \param sample One sample of input, to compute the shapes
+     * \param workers The number of workers of each replica, 0 for one
+     * worker without replication and one worker per CPU of the node with
+     * replication
+     */
+    inference_server(const dbn_t& dbn, size_t max_batch, std::chrono::microseconds deadline, const input_one_t& sample = input_one_t{}, size_t workers = 0)
+            : max_batch(max_batch), deadline(deadline), sample(sample) {
+        auto& topology = get_numa_topology();
+
+        const bool replicated = numa_env().replicate && topology.nodes() > 1;
+
+        if (replicated) {
+            copies = std::make_unique<numa_replicas<dbn_t>>(dbn);
+
+            for (size_t n = 0; n < copies->size(); ++n) {
+                replicas.emplace_back(std::make_unique<replica>(copies->node(n)));
+            }
+        } else {
+            replicas.emplace_back(std::make_unique<replica>(dbn));
+        }
+
+        started = clock::now();
+
+        for (size_t n = 0; n < replicas.size(); ++n) {
+            const size_t count = workers ? workers : replicated ? topology.cpus[n].size() : 1;
+
+            for (size_t w = 0; w < count; ++w) {
+                replicas[n]->workers.emplace_back([this, n, replicated, count] { work(n, replicated, count > 1); });
+            }
+        }
+    }
+
+    inference_server(const inference_server& rhs) = delete;
+    inference_server& operator=(const inference_server& rhs) = delete;
+
+    /*!
+     * \brief Stop the server, after the queued requests are served
+     */
+    ~inference_server() {
+        for (auto& r : replicas) {
+            cpp::with_lock(r->lock, [&r] { r->stop_flag = true; });
+
+            r->ready.notify_all();
+        }
+
+        for (auto& r : replicas) {
+            for (auto& worker : r->workers) {
+                worker.join();
+            }
+        }
+    }
+
+    /*!
+     * \brief Submit a sample to the server
+     * \param sample The sample to forward
+     * \return a future to the output of the network for this sample
+     */
+    std::future<result_t> submit(const input_one_t& sample) {
+        auto& r = *replicas[route()];
+
+        std::future<result_t> future;
+
+        ++r.pending;
+
+        {
+            std::unique_lock<std::mutex> ulock(r.lock);
+
+            r.queue.push_back({sample, std::promise<result_t>(), clock::now()});
+            future = r.queue.back().promise.get_future();
+        }
+
+        r.ready.notify_one();
+
+        return future;
+    }
+
+    /*!
+     * \brief Returns the number of replicas of the server
+     */
+    size_t replica_count() const {
+        return replicas.size();
+    }
+
+    /*!
+     * \brief Returns the statistics of the server
+     */
+    inference_stats stats() const {
+        inference_stats s;
+
+        std::vector<size_t> merged;
+
+        for (auto& r : replicas) {
+            std::lock_guard<std::mutex> l(r->stats_lock);
+
+            s.requests += r->completed;
+            s.batches += r->dispatched;
+
+            merged.insert(merged.end(), r->latencies.begin(), r->latencies.end());
+        }
+
+        finish_stats(s, merged);
+
+        return s;
+    }
+
+    /*!
+     * \brief Returns the statistics of the given replica of the server
+     * \param n The index of the replica (its NUMA node)
+     */
+    inference_stats stats(size_t n) const {
+        auto& r = *replicas[n];
+
+        inference_stats s;
+        std::vector<size_t> latencies;
+
+        {
+            std::lock_guard<std::mutex> l(r.stats_lock);
+
+            s.requests = r.completed;
+            s.batches  = r.dispatched;
+            latencies  = r.latencies;
+        }
+
+        finish_stats(s, latencies);
+
+        return s;
+    }
+
+    /*!
+     * \brief Export the statistics of the server as gauges of the given
+     * exporter, the server must outlive the exporter.
+     *
+     * With several replicas, the requests and the throughput of each
+     * replica are exported as well.
+     *
+     * \param exporter The metrics exporter
+     * \param name The prefix of the gauges
+     */
+    void export_stats(metrics_exporter& exporter, const std::string& name = "inference") const {
+        exporter.add_gauge(name + "_requests", [this] { return double(stats().requests); });
+        exporter.add_gauge(name + "_batches", [this] { return double(stats().batches); });
+        exporter.add_gauge(name + "_latency_p50_us", [this] { return stats().p50; });
+        exporter.add_gauge(name + "_latency_p99_us", [this] { return stats().p99; });
+        exporter.add_gauge(name + "_throughput", [this] { return stats().throughput; });
+
+        if (replicas.size() > 1) {
+            for (size_t n = 0; n < replicas.size(); ++n) {
+                const std::string prefix = name + "_node" + std::to_string(n);
+
+                exporter.add_gauge(prefix + "_requests", [this, n] { return double(stats(n).requests); });
+                exporter.add_gauge(prefix + "_throughput", [this, n] { return stats(n).throughput; });
+            }
+        }
+    }
+
+private:
+    /*!
+     * \brief Complete the percentiles and the throughput of the given
+     * statistics
+     */
+    void finish_stats(inference_stats& s, std::vector<size_t>& latencies) const {
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+
+            s.p50 = latencies[latencies.size() / 2];
+            s.p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - started).count();
+
+        s.throughput = elapsed > 0 ? s.requests * 1e6 / elapsed : 0.0;
+    }
+
+    /*!
+     * \brief Returns the replica serving the next request of the calling
+     * thread: the replica of its node, unless it is overloaded
+     */
+    size_t route() const {
+        if (replicas.size() == 1) {
+            return 0;
+        }
+
+        const size_t local = numa_current_node() % replicas.size();
+
+        // The local replica is used as long as its workers have less than a full batch each
+        if (replicas[local]->pending < max_batch * replicas[local]->workers.size()) {
+            return local;
+        }
+
+        size_t best = local;
+
+        for (size_t n = 0; n < replicas.size(); ++n) {
+            if (replicas[n]->pending < replicas[best]->pending) {
+                best = n;
+            }
+        }
+
+        return best;
+    }
+
+    /*!
+     * \brief Initialize an input batch from the shape of one sample
+     */
+    template <size_t... I>
+    void init_batch(batch_t& batch, std::index_sequence<I...> /*seq*/) const {
+        batch = batch_t(max_batch, etl::dim<I>(sample)...);
+    }
+
+    /*!
+     * \brief The main function of a worker of the replica n.
+     *
+     * The engine and the batch of the worker are allocated by the worker,
+     * after it is pinned, so they are local to its node. With replication
+     * or several workers, the parallelism is given by the workers and the
+     * kernels run serially, the shared kernel pool is not bound to a node.
+     */
+    void work(size_t n, bool pinned, bool several) {
+        if (pinned) {
+            numa_pin_node(n);
+        }
+
+        if (pinned || several) {
+            worker_section section;
+
+            serve(*replicas[n]);
+        } else {
+            serve(*replicas[n]);
+        }
+    }
+
+    /*!
+     * \brief The main loop of a worker of the given replica
+     */
+    void serve(replica& r) {
+        engine_t engine(r.network, max_batch, sample);
+
+        batch_t batch;
+        init_batch(batch, std::make_index_sequence<etl::dimensions<input_one_t>()>());
+
+        const size_t capacity = engine.batch_capacity();
+
+        std::vector<request> current;
+        current.reserve(capacity);
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> ulock(r.lock);
+
+                r.ready.wait(ulock, [&r] { return r.stop_flag || !r.queue.empty(); });
+
+                if (r.queue.empty()) {
+                    return;
+                }
+
+                // Wait for the batch to fill up, or for the deadline of the oldest request
+                auto limit = r.queue.front().start + deadline;
+                r.ready.wait_until(ulock, limit, [&r, capacity] { return r.stop_flag || r.queue.size() >= capacity; });
+
+                const size_t n = std::min(capacity, r.queue.size());
+
+                for (size_t i = 0; i < n; ++i) {
+                    current.push_back(std::move(r.queue.front()));
+                    r.queue.pop_front();
+                }
+            }
+
+            // The remaining requests are for the other workers
+            r.ready.notify_one();
+
+            forward_batch(r, engine, batch, current);
+
+            current.clear();
+        }
+    }
+
+    /*!
+     * \brief Forward the given requests and fulfill their promises
+     */
+    void forward_batch(replica& r, engine_t& engine, batch_t& batch, std::vector<request>& requests) {
+        const size_t n = requests.size();
+
+        for (size_t i = 0; i < n; ++i) {
+            batch(i) = requests[i].sample;
+        }
+
+        auto output = engine.forward(etl::slice(batch, 0, n));
+
+        auto end = clock::now();
+
+        for (size_t i = 0; i < n; ++i) {
+            requests[i].promise.set_value(result_t(output(i)));
+        }
+
+        r.pending -= n;
+
+        for (auto& req : requests) {
+            record_timer("inference:request", std::chrono::duration_cast<std::chrono::nanoseconds>(end - req.start).count());
+        }
+
+        std::lock_guard<std::mutex> l(r.stats_lock);
+
+        for (auto& req : requests) {
+            const size_t latency = std::chrono::duration_cast<std::chrono::microseconds>(end - req.start).count();
+
+            if (r.latencies.size() < latency_window) {
+                r.latencies.push_back(latency);
+            } else {
+                r.latencies[r.completed % latency_window] = latency;
+            }
+
+            ++r.completed;
+        }
+
+        ++r.dispatched;
+    }
+};
+
+} //end of dll namespace
@@ -6,6 +6,7 @@
 //=======================================================================
 
 #include "dll/util/random.hpp"
+#include "dll/util/fast_random.hpp"
 
 /*!
  * \brief Initialization methods
@@ -15,6 +16,67 @@
 
 namespace dll {
 
+namespace initializer_detail {
+
+/*!
+ * \brief Returns the random stream of the initializers.
+ *
+ * The weights are filled from this stream by chunks, in parallel, so the
+ * weights only depend on the seed and on the order of the
+ * initializations, not on the number of threads.
+ */
+inline random_stream& init_stream() {
+    static random_stream stream;
+    return stream;
+}
+
+/*!
+ * \brief Fill the given weights with numbers from a normal distribution
+ * \param w The weights to fill
+ * \param mean The mean of the distribution
+ * \param stddev The standard deviation of the distribution
+ */
+template <typename W>
+void normal_fill(W& w, double mean, double stddev) {
+    using T = etl::value_t<W>;
+
+    T* out = w.memory_start();
+
+    const T m = mean;
+    const T s = stddev;
+
+    generate_normal_parallel<T>(init_stream(), etl::size(w), [out, m, s](size_t i, T z) { out[i] = m + s * z; });
+
+    cpu_modified(w);
+}
+
+/*!
+ * \brief Fill the given weights with numbers from a uniform distribution
+ * \param w The weights to fill
+ * \param a The lower bound of the distribution
+ * \param b The upper bound of the distribution
+ */
+template <typename W>
+void uniform_fill(W& w, double a, double b) {
+    using T = etl::value_t<W>;
+
+    T* out = w.memory_start();
+
+    const size_t n = etl::size(w);
+    const T first  = a;
+    const T range  = b - a;
+
+    init_stream().generate_blocks_parallel(n, [out, n, first, range](size_t k, const std::array<uint32_t, 4>& r) {
+        for (size_t j = 0; j < 4 && 4 * k + j < n; ++j) {
+            out[4 * k + j] = first + range * to_uniform<T>(r[j]);
+        }
+    });
+
+    cpu_modified(w);
+}
+
+} //end of namespace initializer_detail
+
 /*!
  * \brief Initialization function no-op
  */
@@ -85,7 +147,7 @@ struct init_normal {
         constexpr auto mean   = etl::value_t<B>(Mean::num) / etl::value_t<B>(Mean::den);
         constexpr auto stddev = etl::value_t<B>(Std::num) / etl::value_t<B>(Std::den);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), mean, stddev);
+        initializer_detail::normal_fill(b, mean, stddev);
     }
 };
 
@@ -109,7 +171,7 @@ struct init_uniform {
         constexpr auto a = etl::value_t<W>(A::num) / etl::value_t<W>(A::den);
         constexpr auto b = etl::value_t<W>(B::num) / etl::value_t<W>(B::den);
 
-        w = etl::uniform_generator<etl::value_t<W>>(dll::rand_engine(), a, b);
+        initializer_detail::uniform_fill(w, a, b);
     }
 };
 
@@ -130,7 +192,7 @@ struct init_lecun {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) / sqrt(double(nin));
+        initializer_detail::normal_fill(b, 0.0, 1.0 / sqrt(double(nin)));
     }
 };
 
@@ -149,7 +211,7 @@ struct init_xavier {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(1.0 / nin);
+        initializer_detail::normal_fill(b, 0.0, sqrt(1.0 / nin));
     }
 };
 
@@ -166,7 +228,7 @@ struct init_xavier_full {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / (nin + nout));
+        initializer_detail::normal_fill(b, 0.0, sqrt(2.0 / (nin + nout)));
     }
 };
 
@@ -185,7 +247,7 @@ struct init_he {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / nin);
+        initializer_detail::normal_fill(b, 0.0, sqrt(2.0 / nin));
     }
 };
 
@@ -74,12 +74,33 @@ struct dense_layer_impl;
 template <typename Desc>
 struct dyn_dense_layer_impl;
 
+template <typename Desc>
+struct tied_dense_layer_impl;
+
 template <typename Desc>
 struct conv_layer_impl;
 
 template <typename Desc>
 struct dyn_conv_layer_impl;
 
+template <typename Desc>
+struct one_hot_conv_layer_impl;
+
+template <typename Desc>
+struct embedding_layer_impl;
+
+template <typename Desc>
+struct dyn_embedding_layer_impl;
+
+template <typename Desc>
+struct conv_same_layer_impl;
+
+template <typename Desc>
+struct grouped_conv_layer_impl;
+
+template <typename Desc>
+struct dyn_grouped_conv_layer_impl;
+
 template <typename Desc>
 struct deconv_layer_impl;
 
@@ -113,4 +134,22 @@ struct dyn_merge_layer_desc;
 template <typename Desc>
 struct dyn_merge_layer_impl;
 
+template <typename Desc>
+struct rnn_layer_impl;
+
+template <typename Desc>
+struct dyn_rnn_layer_impl;
+
+template <typename Desc>
+struct lstm_layer_impl;
+
+template <typename Desc>
+struct dyn_lstm_layer_impl;
+
+template <typename Desc>
+struct recurrent_last_layer_impl;
+
+template <typename Desc>
+struct dyn_recurrent_last_layer_impl;
+
 } //end of dll namespace
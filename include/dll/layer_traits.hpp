@@ -172,6 +172,61 @@ struct rbm_layer_traits {
         return base_traits::has_clip_gradients;
     }
 
+    /*!
+     * \brief Indicates if the Gibbs chains of the RBM are run in parallel
+     */
+    static constexpr bool has_parallel_gibbs() {
+        return base_traits::has_parallel_gibbs;
+    }
+
+    /*!
+     * \brief Indicates if the convolutional RBM computes its convolutions
+     * by FFT
+     */
+    static constexpr bool has_fft_conv() {
+        return base_traits::has_fft_conv;
+    }
+
+    /*!
+     * \brief Indicates if the RBM computes the products with its input in
+     * CSR format
+     */
+    static constexpr bool has_sparse_input() {
+        return base_traits::has_sparse_input;
+    }
+
+    /*!
+     * \brief Indicates if the RBM computes the products with its input in
+     * bit-packed format
+     */
+    static constexpr bool has_binary_input() {
+        return base_traits::has_binary_input;
+    }
+
+    /*!
+     * \brief Indicates if Contrastive Divergence keeps a transposed copy of
+     * the weights of the RBM for the reconstructions
+     */
+    static constexpr bool has_transposed_weights() {
+        return base_traits::has_transposed_weights;
+    }
+
+    /*!
+     * \brief Returns the number of batches between two measures of the
+     * reconstruction error and the sparsity
+     */
+    static constexpr size_t statistics_every() {
+        return base_traits::statistics_every;
+    }
+
+    /*!
+     * \brief Returns the number of asynchronous workers of the RBM training
+     * (0 for all the cores)
+     */
+    static constexpr size_t async_workers() {
+        return base_traits::async_workers;
+    }
+
     /*!
      * \brief Indicates if the RBM training is made verbose.
      */
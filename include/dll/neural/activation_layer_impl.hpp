@@ -26,6 +26,18 @@ struct activation_layer_impl : transform_layer<activation_layer_impl<Desc>> {
 
     static constexpr function activation_function = desc::activation_function;
 
+    /*!
+     * \brief Indicates if the layer can be computed in place. The softmax
+     * needs the complete input of a sample to compute each output.
+     */
+    static constexpr bool inplace = activation_function != function::SOFTMAX;
+
+    /*!
+     * \brief Indicates if the activation can be fused into the kernel of a
+     * preceding layer, for inference.
+     */
+    static constexpr bool fusable_activation = activation_function != function::SOFTMAX;
+
     activation_layer_impl() = default;
 
     /*!
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -26,6 +27,8 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     static constexpr size_t Input = desc::Input; ///< The input size
     static constexpr weight e     = 1e-8;        ///< Epsilon for numerical stability
 
+    static constexpr bool foldable_normalization = true; ///< Indicates if the layer can be folded into a preceding layer for inference
+
     using input_one_t  = etl::fast_dyn_matrix<weight, Input>; ///< The type of one input
     using output_one_t = etl::fast_dyn_matrix<weight, Input>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;            ///< The type of the input
@@ -49,6 +52,16 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     std::unique_ptr<etl::fast_matrix<weight, Input>> bak_gamma; ///< Backup gamma
     std::unique_ptr<etl::fast_matrix<weight, Input>> bak_beta;  ///< Backup beta
 
+    /*!
+     * \brief Indicates if the given activation layer can be fused with this
+     * layer for inference.
+     */
+    template <typename Act, typename Enable = void>
+    struct fuses_with : std::false_type {};
+
+    template <typename Act>
+    struct fuses_with<Act, std::enable_if_t<Act::fusable_activation>> : std::true_type {};
+
     batch_normalization_2d_layer_impl() : base_type() {
         gamma = 1.0;
         beta = 0.0;
@@ -127,6 +140,32 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         }
     }
 
+    /*!
+     * \brief Apply the layer and the following activation layer to the
+     * given batch of input, for inference.
+     *
+     * The normalization and the activation are computed in a single pass
+     * over the input.
+     *
+     * \param act The activation layer following this layer
+     * \param input A batch of input
+     * \return The batch of activated output
+     */
+    template <typename Act, typename V>
+    auto test_forward_batch_fused(const Act& act, const V& input) const {
+        dll::auto_timer timer("bn:2d:test:forward_fused");
+
+        static_assert(fuses_with<Act>::value, "The activation layer cannot be fused with this layer");
+
+        cpp_unused(act);
+
+        etl::dyn_matrix<weight, 2> output(etl::dim<0>(input), Input);
+
+        batch_norm_test_forward<Act::activation_function>(input, output, gamma, beta, mean, var, etl::dim<0>(input), Input, 1, e);
+
+        return output;
+    }
+
     /*!
      * \brief Apply the layer to the batch of input
      * \param output The batch of output
@@ -138,16 +177,10 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
 
         const auto B = etl::dim<0>(input);
 
-        last_mean = etl::bias_batch_mean_2d(input);
-        last_var  = etl::bias_batch_var_2d(input, last_mean);
-        inv_var   = 1.0 / etl::sqrt(last_var + e);
-
         input_pre.inherit_if_null(input);
 
-        for(size_t b = 0; b < B; ++b){
-            input_pre(b) = (input(b) - last_mean) >> inv_var;
-            output(b)    = (input_pre(b) >> gamma) + beta;
-        }
+        // Single pass statistics, then normalization
+        batch_norm_train_forward(input, input_pre, output, gamma, beta, last_mean, last_var, inv_var, B, Input, 1, e);
 
         // Update the current mean and variance
         mean = momentum * mean + (1.0 - momentum) * last_mean;
@@ -180,12 +213,8 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         auto& dgamma = std::get<0>(context.up.context)->grad;
         auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        dbeta  = bias_batch_sum_2d(context.errors);
-        dgamma = bias_batch_sum_2d(input_pre >> context.errors);
-
-        for(size_t b = 0; b < B; ++b){
-            output(b) = (1.0 / B) >> inv_var >> gamma >> ((B >> context.errors(b)) - (input_pre(b) >> dgamma) - dbeta);
-        }
+        // The gradients and the errors are computed in a single kernel
+        batch_norm_backward(context.errors, input_pre, output, gamma, inv_var, dgamma, dbeta, B, Input, 1);
     }
 
     /*!
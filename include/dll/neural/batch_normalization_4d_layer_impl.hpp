@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -28,6 +29,8 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     static constexpr size_t H       = desc::Height;  ///< The height of feature maps
     static constexpr weight e        = 1e-8;          ///< Epsilon for numerical stability
 
+    static constexpr bool foldable_normalization = true; ///< Indicates if the layer can be folded into a preceding layer for inference
+
     using input_one_t  = etl::fast_dyn_matrix<weight, Kernels, W, H>; ///< The type of one input
     using output_one_t = etl::fast_dyn_matrix<weight, Kernels, W, H>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;                    ///< The type of the input
@@ -51,6 +54,16 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     std::unique_ptr<etl::fast_matrix<weight, Kernels>> bak_gamma; ///< Backup gamma
     std::unique_ptr<etl::fast_matrix<weight, Kernels>> bak_beta;  ///< Backup beta
 
+    /*!
+     * \brief Indicates if the given activation layer can be fused with this
+     * layer for inference.
+     */
+    template <typename Act, typename Enable = void>
+    struct fuses_with : std::false_type {};
+
+    template <typename Act>
+    struct fuses_with<Act, std::enable_if_t<Act::fusable_activation>> : std::true_type {};
+
     batch_normalization_4d_layer_impl() : base_type() {
         gamma = 1.0;
         beta = 0.0;
@@ -129,6 +142,32 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
         }
     }
 
+    /*!
+     * \brief Apply the layer and the following activation layer to the
+     * given batch of input, for inference.
+     *
+     * The normalization and the activation are computed in a single pass
+     * over the input.
+     *
+     * \param act The activation layer following this layer
+     * \param input A batch of input
+     * \return The batch of activated output
+     */
+    template <typename Act, typename V>
+    auto test_forward_batch_fused(const Act& act, const V& input) const {
+        dll::auto_timer timer("bn:4d:test:forward_fused");
+
+        static_assert(fuses_with<Act>::value, "The activation layer cannot be fused with this layer");
+
+        cpp_unused(act);
+
+        etl::dyn_matrix<weight, 4> output(etl::dim<0>(input), Kernels, W, H);
+
+        batch_norm_test_forward<Act::activation_function>(input, output, gamma, beta, mean, var, etl::dim<0>(input), Kernels, W * H, e);
+
+        return output;
+    }
+
     /*!
      * \brief Apply the layer to the batch of input
      * \param output The batch of output
@@ -136,35 +175,13 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
-        cpp_unused(output);
-
         const auto B = etl::dim<0>(input);
         const auto S = B * W * H;
 
-        // Compute the mean of the mini-batch
-        last_mean = etl::bias_batch_mean_4d(input);
-
-        // Compute the variance of the mini-batch
-        last_var  = 0;
-
-        for (size_t b = 0; b < B; ++b) {
-            for (size_t k = 0; k < Kernels; ++k) {
-                last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
-            }
-        }
-
-        last_var /= S;
-
-        inv_var  = 1.0 / etl::sqrt(last_var + e);
-
         input_pre.inherit_if_null(input);
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
-                output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
-            }
-        }
+        // Single pass statistics, then normalization
+        batch_norm_train_forward(input, input_pre, output, gamma, beta, last_mean, last_var, inv_var, B, Kernels, W * H, e);
 
         //// Update the current mean and variance
         mean = momentum * mean + (1.0 - momentum) * last_mean;
@@ -191,27 +208,12 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     template<typename HH, typename C>
     void backward_batch(HH&& output, C& context) const {
         const auto B = etl::dim<0>(context.input);
-        const auto S = B * W * H;
-
-        auto dxhat = etl::force_temporary_dim_only(context.errors);
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                dxhat(b)(k) = context.errors(b)(k) >> gamma(k);
-            }
-        }
-
-        auto dxhat_l      = etl::bias_batch_sum_4d(dxhat);
-        auto dxhat_xhat_l = etl::bias_batch_sum_4d(dxhat >> input_pre);
-
-        *dxhat_l;
-        *dxhat_xhat_l;
+        auto& dgamma = std::get<0>(context.up.context)->grad;
+        auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = ((1.0 / S) * inv_var(k)) >> (S * dxhat(b)(k) - dxhat_l(k) - (input_pre(b)(k) >> dxhat_xhat_l(k)));
-            }
-        }
+        // The gradients and the errors are computed in a single kernel
+        batch_norm_backward(context.errors, input_pre, output, gamma, inv_var, dgamma, dbeta, B, Kernels, W * H);
     }
 
     /*!
@@ -220,11 +222,15 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        // Gradients of gamma
-        std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
+        // If the layer is not the first one, the gradients already have been computed
 
-        // Gradients of beta
-        std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        if (!C::layer) {
+            // Gradients of gamma
+            std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
+
+            // Gradients of beta
+            std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        }
     }
 
     /*!
@@ -319,7 +325,8 @@ struct sgd_context<DBN, batch_normalization_4d_layer_impl<Desc>, L> {
     using layer_t = batch_normalization_4d_layer_impl<Desc>; ///< The current layer type
     using weight  = typename layer_t::weight;           ///< The data type for this layer
 
-    static constexpr auto batch_size = DBN::batch_size;
+    static constexpr auto batch_size = DBN::batch_size; ///< The batch size of the network
+    static constexpr auto layer      = L;               ///< The layer's index
 
     etl::fast_matrix<weight, batch_size, layer_t::Kernels, layer_t::W, layer_t::H> input;  ///< A batch of input
     etl::fast_matrix<weight, batch_size, layer_t::Kernels, layer_t::W, layer_t::H> output; ///< A batch of output
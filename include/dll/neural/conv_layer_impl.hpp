@@ -9,7 +9,10 @@
 
 #include "dll/neural_layer.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/timers.hpp"     // for auto_timer
+#include "dll/util/conv_tuner.hpp" // for tuned_conv_forward
+#include "dll/util/conv_direct.hpp" // for gemm_conv1x1_forward
+#include "dll/util/gpu.hpp"        // for cpu_access
 
 namespace dll {
 
@@ -37,6 +40,8 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
 
     static constexpr auto activation_function = desc::activation_function; ///< The activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto tuned               = desc::parameters::template contains<dll::autotune>(); ///< Auto-tune the convolutions
+    static constexpr bool pointwise           = NW1 == 1 && NW2 == 1; ///< Indicates if the convolution is a GEMM
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -57,6 +62,21 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    /*!
+     * \brief Indicates if the given pooling layer can be fused with this
+     * layer for inference.
+     *
+     * This is the case for spatial max pooling of the output of this layer
+     * with a monotonic activation function, since the maximum can then be
+     * taken before the bias and the activation.
+     */
+    template <typename Pool, typename Enable = void>
+    struct fuses_with : std::false_type {};
+
+    template <typename Pool>
+    struct fuses_with<Pool, std::enable_if_t<Pool::fusable_pool>>
+            : cpp::bool_constant<Pool::I1 == K && Pool::I2 == NH1 && Pool::I3 == NH2 && activation_function != function::SOFTMAX> {};
+
     /*!
      * \brief Initialize a conv layer with basic weights.
      */
@@ -154,21 +174,61 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        if constexpr (etl::dimensions<V>() == 4) {
+        if constexpr (tuned && etl::dimensions<V>() == 4) {
+            tuned_conv_forward(output, v, w);
+        } else if constexpr (pointwise && same_conv_fast_path<H1, V>) {
+            gemm_conv1x1_forward(output, v, w);
+        } else if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward(v, w);
         } else {
             output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
         }
 
-        if constexpr (!no_bias) {
-            output = bias_add_4d(output, b);
-        }
+        // The bias and the activation are applied in a single pass, except
+        // for softmax which is not element-wise
+        if constexpr (!no_bias && activation_function != function::IDENTITY && activation_function != function::SOFTMAX) {
+            output = f_activate<activation_function>(bias_add_4d(output, b));
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_4d(output, b);
+            }
 
-        if constexpr (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+            if constexpr (activation_function != function::IDENTITY) {
+                output = f_activate<activation_function>(output);
+            }
         }
     }
 
+    /*!
+     * \brief Apply the layer and the following max pooling layer to the
+     * given batch of input, for inference.
+     *
+     * The convolution of each sample is computed with one GEMM into a small
+     * workspace and pooled directly from there, the full output of the
+     * convolution is never written to memory.
+     *
+     * \param pool The max pooling layer following this layer
+     * \param v A batch of input
+     * \return The batch of pooled output
+     */
+    template <typename Pool, typename V>
+    auto test_forward_batch_fused(const Pool& pool, const V& v) const {
+        dll::auto_timer timer("conv:forward_batch_pooled");
+
+        static_assert(fuses_with<Pool>::value, "The pooling layer cannot be fused with this layer");
+
+        cpp_unused(pool);
+
+        etl::dyn_matrix<weight, 4> output(etl::dim<0>(v), K, Pool::O2, Pool::O3);
+
+        if constexpr (etl::dimensions<V>() == 4) {
+            forward_pooled<Pool>(output, v);
+        } else {
+            forward_pooled<Pool>(output, etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2));
+        }
+
+        return output;
+    }
 
     /*!
      * \brief Prepare one empty output for this layer
@@ -189,6 +249,76 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
         return output_t{samples};
     }
 
+    /*!
+     * \brief Compute the pooled output of the layer.
+     *
+     * The activation functions are monotonic, so the maximum of each
+     * pooling window is taken on the raw convolution and the bias and
+     * the activation are only applied to the pooled values.
+     *
+     * \param output The pooled output [B x K x O2 x O3]
+     * \param input The input [B x NC x NV1 x NV2]
+     */
+    template <typename Pool, typename O, typename I>
+    void forward_pooled(O& output, const I& input) const {
+        static constexpr size_t C1 = Pool::SC1; ///< The first spatial pooling ratio
+        static constexpr size_t C2 = Pool::SC2; ///< The second spatial pooling ratio
+
+        static constexpr size_t O1 = Pool::O2; ///< The first spatial output dimension
+        static constexpr size_t O2 = Pool::O3; ///< The second spatial output dimension
+
+        static constexpr size_t CW = NC * NW1 * NW2;
+        static constexpr size_t NH = NH1 * NH2;
+
+        const size_t B = etl::dim<0>(input);
+
+        weight* workspace = conv_workspace<weight>(K * CW + CW * NH + K * NH);
+
+        auto w_2d   = etl::custom_dyn_matrix<weight, 2>(workspace, K, CW);
+        auto col    = etl::custom_dyn_matrix<weight, 2>(workspace + K * CW, CW, NH);
+        auto result = etl::custom_dyn_matrix<weight, 2>(workspace + K * CW + CW * NH, K, NH);
+
+        cpu_access(input, w, b);
+
+        std::copy(w.memory_start(), w.memory_end(), workspace);
+
+        cpu_modified(w_2d);
+
+        for (size_t s = 0; s < B; ++s) {
+            im2col(workspace + K * CW, input, s, NC, NW1, NW2, NH1, NH2);
+
+            cpu_modified(col);
+
+            result = w_2d * col;
+
+            cpu_access(result);
+
+            for (size_t k = 0; k < K; ++k) {
+                const weight* r = result.memory_start() + k * NH;
+
+                for (size_t i = 0; i < O1; ++i) {
+                    for (size_t j = 0; j < O2; ++j) {
+                        weight max = r[(i * C1) * NH2 + j * C2];
+
+                        for (size_t ii = 0; ii < C1; ++ii) {
+                            for (size_t jj = 0; jj < C2; ++jj) {
+                                max = std::max(max, r[(i * C1 + ii) * NH2 + j * C2 + jj]);
+                            }
+                        }
+
+                        if constexpr (!no_bias) {
+                            max += b(k);
+                        }
+
+                        output(s, k, i, j) = f_activate_scalar<activation_function>(max);
+                    }
+                }
+            }
+        }
+
+        cpu_modified(output);
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -225,7 +355,11 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv:backward_batch");
 
-        if constexpr (etl::dimensions<H>() == 4) {
+        if constexpr (tuned && etl::dimensions<H>() == 4) {
+            tuned_conv_backward(output, context.errors, w);
+        } else if constexpr (pointwise && same_conv_fast_path<H, decltype(context.errors)>) {
+            gemm_conv1x1_backward(output, context.errors, w);
+        } else if constexpr (etl::dimensions<H>() == 4) {
             output = etl::ml::convolution_backward(context.errors, w);
         } else {
             etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2) = etl::ml::convolution_backward(context.errors, w);
@@ -240,7 +374,13 @@ struct conv_layer_impl final : neural_layer<conv_layer_impl<Desc>, Desc> {
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        if constexpr (tuned) {
+            tuned_conv_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors);
+        } else if constexpr (pointwise) {
+            gemm_conv1x1_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors);
+        } else {
+            std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        }
 
         if constexpr (!no_bias) {
             std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
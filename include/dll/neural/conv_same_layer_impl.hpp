@@ -9,6 +9,7 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/conv_direct.hpp"
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -39,6 +40,7 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     static constexpr size_t P2 = (NW2 - 1) / 2;
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr auto kernel              = select_same_conv_kernel(NW1, NW2); ///< The convolution kernel
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -138,7 +140,11 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        if constexpr (etl::dimensions<V>() == 4) {
+        if constexpr (kernel == same_conv_kernel::GEMM_1X1 && same_conv_fast_path<H1, V>) {
+            gemm_conv1x1_forward(output, v, w);
+        } else if constexpr (kernel == same_conv_kernel::DIRECT_3X3 && same_conv_fast_path<H1, V>) {
+            direct_conv3x3_forward(output, v, w);
+        } else if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward<1, 1, P1, P2>(v, w);
         } else {
             output = etl::ml::convolution_forward<1, 1, P1, P2>(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
@@ -200,7 +206,13 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv_same:backward_batch");
 
-        output = etl::ml::convolution_backward<1, 1, P1, P2>(context.errors, w);
+        if constexpr (kernel == same_conv_kernel::GEMM_1X1 && same_conv_fast_path<H, decltype(context.errors)>) {
+            gemm_conv1x1_backward(output, context.errors, w);
+        } else if constexpr (kernel == same_conv_kernel::DIRECT_3X3 && same_conv_fast_path<H, decltype(context.errors)>) {
+            direct_conv3x3_backward(output, context.errors, w);
+        } else {
+            output = etl::ml::convolution_backward<1, 1, P1, P2>(context.errors, w);
+        }
     }
 
     /*!
@@ -211,7 +223,15 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv_same:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter<1, 1, P1, P2>(context.input, context.errors);
+        auto& grad = std::get<0>(context.up.context)->grad;
+
+        if constexpr (kernel == same_conv_kernel::GEMM_1X1 && same_conv_fast_path<decltype(context.errors), decltype(context.input)>) {
+            gemm_conv1x1_backward_filter(grad, context.input, context.errors);
+        } else if constexpr (kernel == same_conv_kernel::DIRECT_3X3 && same_conv_fast_path<decltype(context.errors), decltype(context.input)>) {
+            direct_conv3x3_backward_filter(grad, context.input, context.errors);
+        } else {
+            grad = etl::ml::convolution_backward_filter<1, 1, P1, P2>(context.input, context.errors);
+        }
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
 };
@@ -9,6 +9,8 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/conv_tuner.hpp" // for im2col_deconv_forward
+
 namespace dll {
 
 /*!
@@ -128,7 +130,11 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
+        if constexpr (etl::decay_traits<V>::dimensions() == 4) {
+            im2col_deconv_forward(output, v, w);
+        } else {
+            output = etl::conv_4d_full_flipped(v, w);
+        }
 
         if constexpr (etl::decay_traits<H1>::is_fast) {
             static constexpr auto batch_size = etl::decay_traits<H1>::template dim<0>();
@@ -200,7 +206,7 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::conv_4d_valid_flipped(context.errors, w);
+            im2col_deconv_backward(output, context.errors, w);
         } else {
             static constexpr auto B               = etl::decay_traits<H>::template dim<0>();
             etl::reshape<B, NC, NV1, NV2>(output) = etl::conv_4d_valid_flipped(context.errors, w);
@@ -213,7 +219,7 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        std::get<0>(context.up.context)->grad = etl::conv_4d_valid_filter_flipped(context.errors, context.input);
+        im2col_deconv_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors);
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
 };
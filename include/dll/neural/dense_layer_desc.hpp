@@ -25,7 +25,8 @@ struct dense_layer_desc {
      */
     using parameters = cpp::type_list<Parameters...>;
 
-    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>;            ///< The layer's activation function
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>; ///< The layer's activation function
+    static constexpr size_t sampled_negatives = detail::get_value_v<sampled_softmax<0>, Parameters...>;         ///< The number of negatives of the sampled softmax
 
     using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
     using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
@@ -41,11 +42,12 @@ struct dense_layer_desc {
 
     static_assert(num_visible > 0, "There must be at least 1 visible unit");
     static_assert(num_hidden > 0, "There must be at least 1 hidden unit");
+    static_assert(sampled_negatives == 0 || activation_function == function::SOFTMAX, "sampled_softmax is only supported with the softmax activation");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-            weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>,
+            weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, sparse_input_id, fast_activations_id, sampled_softmax_id>,
             Parameters...>,
         "Invalid parameters type for dense_layer_desc");
 };
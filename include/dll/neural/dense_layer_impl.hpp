@@ -10,7 +10,12 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/csr.hpp"             // for sparse_input
+#include "dll/util/dense_backward.hpp"  // for the fused backward pass
+#include "dll/util/gemv.hpp"            // for f_activate_fast
+#include "dll/util/gpu.hpp"             // for cpu_access
+#include "dll/util/sampled_softmax.hpp" // for sampled_softmax
+#include "dll/util/timers.hpp"          // for auto_timer
 
 namespace dll {
 
@@ -31,6 +36,17 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
 
     static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr bool sparse_input        = desc::parameters::template contains<dll::sparse_input>(); ///< Use the input in CSR format
+    static constexpr bool fast_activations    = desc::parameters::template contains<dll::fast_activations>(); ///< Use the fast approximations of the activation functions
+    static constexpr size_t sampled_negatives = desc::sampled_negatives; ///< The number of negatives of the sampled softmax (0 for the full softmax)
+
+    static constexpr bool sparse_gradients = sparse_input; ///< Only the rows of the non-zero inputs have gradients
+
+    /*!
+     * \brief Indicates if the derivative of the activation and the reduction
+     * of the biases are fused into the backward pass
+     */
+    static constexpr bool fused_backward = activation_function != function::IDENTITY || !no_bias;
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -51,6 +67,8 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    const w_type* tied_grad = nullptr; ///< The gradients of the weights computed by a tied layer (see tied_dense_layer)
+
     /*!
      * \brief Initialize a dense layer with basic weights.
      *
@@ -145,13 +163,34 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        output = etl::reshape(input, Batch, num_visible) * w;
+        if constexpr (sparse_input && etl::all_dma<V, std::decay_t<H>>) {
+            auto& csr = csr_workspace<weight>();
 
-        if constexpr (!no_bias) {
-            output = bias_add_2d(output, b);
+            csr.assign(etl::reshape(input, Batch, num_visible));
+            csr_mul(output, csr, w);
+        } else {
+            output = etl::reshape(input, Batch, num_visible) * w;
+        }
+
+        // The fast activations are applied in place, after the bias
+        if constexpr (fast_activations && has_fast_activation(activation_function) && etl::all_dma<std::decay_t<H>>) {
+            if constexpr (!no_bias) {
+                output = bias_add_2d(output, b);
+            }
+
+            f_activate_fast<activation_function>(output);
         }
+        // The bias and the activation are applied in a single pass, except
+        // for softmax which is not element-wise
+        else if constexpr (!no_bias && activation_function != function::SOFTMAX) {
+            output = f_activate<activation_function>(bias_add_2d(output, b));
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_2d(output, b);
+            }
 
-        output = f_activate<activation_function>(output);
+            output = f_activate<activation_function>(output);
+        }
     }
 
     /*!
@@ -196,15 +235,50 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void adapt_errors(C& context) const {
-        dll::unsafe_auto_timer timer("dense:adapt_errors");
+        // The derivative is applied by the backward pass (or the gradients
+        // for the first layer), in the same sweep as the reduction of the
+        // biases
+        if constexpr (fused_backward) {
+            context.adapt_pending = true;
+        }
+    }
+
+    /*!
+     * \brief Compute the sampled softmax of the batch of the context and its
+     * errors, in place of the forward pass and of the errors of the loss.
+     *
+     * \param context The training context, whose input is loaded
+     * \param labels The labels of the batch
+     * \param n The number of samples of the batch
+     *
+     * \return A pair containing the error and the loss of the batch, not normalized
+     */
+    template <typename C, typename Labels>
+    std::pair<double, double> sampled_errors(C& context, const Labels& labels, size_t n) const {
+        dll::auto_timer timer("dense:sampled_errors");
+
+        static_assert(sampled_negatives > 0, "sampled_errors is only available with sampled_softmax");
 
-        if constexpr (activation_function != function::IDENTITY){
-            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        sample_classes(context.sampled, labels, n, num_hidden, sampled_negatives);
+
+        const weight* bias = nullptr;
+
+        if constexpr (!no_bias) {
+            cpu_access(b);
+            bias = b.memory_start();
         }
+
+        return sampled_softmax_errors(context.sampled, context.input, w, bias, n);
     }
 
     /*!
      * \brief Backpropagate the errors to the previous layers
+     *
+     * When the derivative of the activation is pending, the errors are
+     * processed by tiles of rows: the derivative and the reduction of the
+     * biases are applied to the tile, which is then multiplied by the
+     * weights while still in cache.
+     *
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
@@ -214,6 +288,44 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
 
         // The reshape has no overhead, so better than SFINAE for nothing
         constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
+
+        // Only the errors of the candidates of the sampled softmax are backpropagated
+        if constexpr (sampled_negatives > 0) {
+            if (context.sampled.active) {
+                etl::reshape<Batch, num_visible>(output) = context.sampled.sampled_errors() * etl::transpose(context.sampled.weights());
+                return;
+            }
+        }
+
+        if constexpr (fused_backward) {
+            if (context.adapt_pending) {
+                constexpr size_t R = dense_backward_rows(num_hidden);
+
+                weight* b_grad = start_adapt(context);
+
+                cpu_access(w);
+
+                weight* errors = context.errors.memory_start();
+                weight* out    = output.memory_start();
+
+                for (size_t first = 0; first < Batch; first += R) {
+                    const size_t rows = std::min(R, Batch - first);
+
+                    dense_derivative_rows<activation_function>(errors, context.output.memory_start(), b_grad, first, first + rows, num_hidden);
+
+                    auto tile_errors = etl::custom_dyn_matrix<weight, 2>(errors + first * num_hidden, rows, num_hidden);
+                    auto tile_output = etl::custom_dyn_matrix<weight, 2>(out + first * num_visible, rows, num_visible);
+
+                    tile_output = tile_errors * etl::transpose(w);
+                }
+
+                end_adapt(context);
+                cpu_modified(output);
+
+                return;
+            }
+        }
+
         etl::reshape<Batch, num_visible>(output) = context.errors * etl::transpose(w);
     }
 
@@ -225,10 +337,105 @@ struct dense_layer_impl final : neural_layer<dense_layer_impl<Desc>, Desc> {
     void compute_gradients(C& context) const {
         dll::unsafe_auto_timer timer("dense:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        if constexpr (sampled_negatives > 0) {
+            if (context.sampled.active) {
+                weight* b_grad = nullptr;
+
+                if constexpr (!no_bias) {
+                    cpu_access(std::get<1>(context.up.context)->grad);
+                    b_grad = std::get<1>(context.up.context)->grad.memory_start();
+                }
+
+                sampled_softmax_gradients(context.sampled, context.input, std::get<0>(context.up.context)->grad, b_grad);
+
+                if constexpr (!no_bias) {
+                    cpu_modified(std::get<1>(context.up.context)->grad);
+                }
+
+                return;
+            }
+        }
+
+        // The first layer has no backward pass, its derivative is applied here
+        if constexpr (fused_backward) {
+            if (context.adapt_pending) {
+                constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
+
+                weight* b_grad = start_adapt(context);
+
+                dense_derivative_rows<activation_function>(context.errors.memory_start(), context.output.memory_start(), b_grad, 0, Batch, num_hidden);
+
+                end_adapt(context);
+            }
+        }
+
+        if constexpr (sparse_input) {
+            auto& sub = *std::get<0>(context.up.context);
+            auto& csr = csr_workspace<weight>();
+
+            csr.assign(context.input);
+
+            if constexpr (has_sparse_rows<std::decay_t<decltype(sub)>>::value) {
+                sparse_csr_gradients(sub, csr, context.errors);
+            } else {
+                csr_batch_outer(sub.grad, csr, context.errors);
+            }
+        } else {
+            std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+
+            // The gradients of the tied layer are accumulated into the single tensor
+            if (tied_grad) {
+                std::get<0>(context.up.context)->grad += *tied_grad;
+            }
+        }
+
+        // The biases are reduced with the derivative, except when it was
+        // not needed (the last layer)
+        if constexpr (!no_bias) {
+            if (!context.bias_reduced) {
+                std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+            }
+
+            context.bias_reduced = false;
+        }
+    }
+
+private:
+    /*!
+     * \brief Start applying the pending derivative to the errors of the
+     * context, the gradients of the biases being reset
+     * \return the gradients of the biases to accumulate into, nullptr if the
+     * layer has no biases
+     */
+    template <typename C>
+    static weight* start_adapt(C& context) {
+        context.adapt_pending = false;
+
+        cpu_access(context.errors, context.output);
+
+        if constexpr (no_bias) {
+            return nullptr;
+        } else {
+            auto& b_grad = std::get<1>(context.up.context)->grad;
+
+            b_grad = 0;
+            cpu_access(b_grad);
+
+            context.bias_reduced = true;
+
+            return b_grad.memory_start();
+        }
+    }
+
+    /*!
+     * \brief Finish applying the derivative to the errors of the context
+     */
+    template <typename C>
+    static void end_adapt(C& context) {
+        cpu_modified(context.errors);
 
         if constexpr (!no_bias) {
-            std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+            cpu_modified(std::get<1>(context.up.context)->grad);
         }
     }
 };
@@ -278,6 +485,11 @@ struct sgd_context<DBN, dense_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, num_hidden> output;
     etl::fast_matrix<weight, batch_size, num_hidden> errors;
 
+    bool adapt_pending = false; ///< Indicates if the derivative of the activation is still to be applied to the errors
+    bool bias_reduced  = false; ///< Indicates if the gradients of the biases were reduced with the derivative
+
+    sampled_softmax_state<weight> sampled; ///< The state of the sampled softmax (sampled_softmax only)
+
     sgd_context(const dense_layer_impl<Desc>& /* layer */)
             : output(0.0), errors(0.0) {}
 };
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/fast_random.hpp"
 
 namespace dll {
 
@@ -24,11 +25,12 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
 
     static constexpr float p = float(desc::Drop) / 100.0f; ///< The dropout rate
 
-    mutable decltype(etl::state_inverted_dropout_mask(dll::rand_engine(), p)) dropout; ///< The dropout mask generator (ETL)
+    mutable random_stream dropout;      ///< The random stream for the dropout masks
+    mutable std::vector<uint64_t> mask; ///< The bit-packed mask of the last training batch
 
-    dropout_layer_impl() : dropout(dll::rand_engine(), p) {
-        // Nothing else to init
-    }
+    static constexpr bool inference_identity = true; ///< Indicates that the layer is an identity at inference
+
+    dropout_layer_impl() = default;
 
     /*!
      * \brief Returns a full string representation of the layer
@@ -96,9 +98,9 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
     void train_forward_batch(Output& output, const Input& input) const noexcept {
         dll::auto_timer timer("dropout:train:forward");
 
-        // Note: For now, cannot do on one pass because of state_inverted dropout not copy-able
-        output = dropout;
-        output = output >> input;
+        // Inverted dropout, the test forward is a simple copy
+        dropout_bits(dropout, mask, etl::size(input), p);
+        apply_dropout_bits(output, input, mask, p);
     }
 
     /*!
@@ -122,7 +124,7 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
     void backward_batch(H&& output, C& context) const {
         dll::unsafe_auto_timer timer("dropout:backward");
 
-        output = context.errors;
+        apply_dropout_bits(output, context.errors, mask, p);
     }
 
     /*!
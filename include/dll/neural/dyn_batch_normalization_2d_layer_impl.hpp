@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -25,6 +26,8 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
 
     static constexpr weight e     = 1e-8;        ///< Epsilon for numerical stability
 
+    static constexpr bool foldable_normalization = true; ///< Indicates if the layer can be folded into a preceding layer for inference
+
     using input_one_t  = etl::dyn_matrix<weight, 1>; ///< The type of one input
     using output_one_t = etl::dyn_matrix<weight, 1>; ///< The type of one output
     using input_t      = std::vector<input_one_t>; ///< The type of the input
@@ -156,16 +159,10 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
 
         const auto B = etl::dim<0>(input);
 
-        last_mean = etl::bias_batch_mean_2d(input);
-        last_var  = etl::bias_batch_var_2d(input, last_mean);
-        inv_var   = 1.0 / etl::sqrt(last_var + e);
-
         input_pre.inherit_if_null(input);
 
-        for(size_t b = 0; b < B; ++b){
-            input_pre(b) = (input(b) - last_mean) >> inv_var;
-            output(b)    = (input_pre(b) >> gamma) + beta;
-        }
+        // Single pass statistics, then normalization
+        batch_norm_train_forward(input, input_pre, output, gamma, beta, last_mean, last_var, inv_var, B, Input, 1, e);
 
         // Update the current mean and variance
         mean = momentum * mean + (1.0 - momentum) * last_mean;
@@ -198,12 +195,8 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
         auto& dgamma = std::get<0>(context.up.context)->grad;
         auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        dbeta  = bias_batch_sum_2d(context.errors);
-        dgamma = bias_batch_sum_2d(input_pre >> context.errors);
-
-        for(size_t b = 0; b < B; ++b){
-            output(b) = (1.0 / B) >> inv_var >> gamma >> ((B >> context.errors(b)) - (input_pre(b) >> dgamma) - dbeta);
-        }
+        // The gradients and the errors are computed in a single kernel
+        batch_norm_backward(context.errors, input_pre, output, gamma, inv_var, dgamma, dbeta, B, Input, 1);
     }
 
     /*!
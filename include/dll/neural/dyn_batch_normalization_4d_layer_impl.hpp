@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -25,6 +26,8 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
 
     static constexpr weight e = 1e-8; ///< Epsilon for numerical stability
 
+    static constexpr bool foldable_normalization = true; ///< Indicates if the layer can be folded into a preceding layer for inference
+
     using input_one_t  = etl::dyn_matrix<weight, 3>; ///< The type of one input
     using output_one_t = etl::dyn_matrix<weight, 3>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;   ///< The type of the input
@@ -76,6 +79,24 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
         beta = 0.0;
     }
 
+    /*!
+     * \brief Change the spatial dimensions of the input of the layer, the
+     * parameters and the statistics being kept
+     * \param input_shape The new shape of the input [K, W, H]
+     * \return The new shape of the output
+     */
+    std::vector<size_t> resize_input(const std::vector<size_t>& input_shape) {
+        cpp_assert(input_shape.size() == 3 && input_shape[0] == Kernels, "Only the spatial dimensions of the input can change");
+
+        W = input_shape[1];
+        H = input_shape[2];
+
+        // The normalized input is allocated at the next training batch
+        input_pre.clear();
+
+        return {Kernels, W, H};
+    }
+
     /*!
      * \brief Returns a string representation of the layer
      */
@@ -156,35 +177,13 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template <typename Input, typename Output>
     void train_forward_batch(Output& output, const Input& input) {
-        cpp_unused(output);
-
         const auto B = etl::dim<0>(input);
         const auto S = B * W * H;
 
-        // Compute the mean of the mini-batch
-        last_mean = etl::bias_batch_mean_4d(input);
-
-        // Compute the variance of the mini-batch
-        last_var  = 0;
-
-        for (size_t b = 0; b < B; ++b) {
-            for (size_t k = 0; k < Kernels; ++k) {
-                last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
-            }
-        }
-
-        last_var /= S;
-
-        inv_var  = 1.0 / etl::sqrt(last_var + e);
-
         input_pre.inherit_if_null(input);
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
-                output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
-            }
-        }
+        // Single pass statistics, then normalization
+        batch_norm_train_forward(input, input_pre, output, gamma, beta, last_mean, last_var, inv_var, B, Kernels, W * H, e);
 
         //// Update the current mean and variance
         mean = momentum * mean + (1.0 - momentum) * last_mean;
@@ -211,27 +210,12 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
     template<typename HH, typename C>
     void backward_batch(HH&& output, C& context) const {
         const auto B = etl::dim<0>(context.input);
-        const auto S = B * W * H;
-
-        auto dxhat = etl::force_temporary_dim_only(context.errors);
-
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                dxhat(b)(k) = context.errors(b)(k) >> gamma(k);
-            }
-        }
 
-        auto dxhat_l      = etl::bias_batch_sum_4d(dxhat);
-        auto dxhat_xhat_l = etl::bias_batch_sum_4d(dxhat >> input_pre);
+        auto& dgamma = std::get<0>(context.up.context)->grad;
+        auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        *dxhat_l;
-        *dxhat_xhat_l;
-
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = ((1.0 / S) * inv_var(k)) >> (S * dxhat(b)(k) - dxhat_l(k) - (input_pre(b)(k) >> dxhat_xhat_l(k)));
-            }
-        }
+        // The gradients and the errors are computed in a single kernel
+        batch_norm_backward(context.errors, input_pre, output, gamma, inv_var, dgamma, dbeta, B, Kernels, W * H);
     }
 
     /*!
@@ -240,11 +224,15 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        // Gradients of gamma
-        std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
+        // If the layer is not the first one, the gradients already have been computed
 
-        // Gradients of beta
-        std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        if (!C::layer) {
+            // Gradients of gamma
+            std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
+
+            // Gradients of beta
+            std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        }
     }
 
     /*!
@@ -344,7 +332,8 @@ struct sgd_context<DBN, dyn_batch_normalization_4d_layer_impl<Desc>, L> {
     using layer_t          = dyn_batch_normalization_4d_layer_impl<Desc>;            ///< The current layer type
     using weight           = typename layer_t::weight;                          ///< The data type for this layer
 
-    static constexpr auto batch_size = DBN::batch_size;
+    static constexpr auto batch_size = DBN::batch_size; ///< The batch size of the network
+    static constexpr auto layer      = L;               ///< The layer's index
 
     etl::dyn_matrix<weight, 4> input;  ///< A batch of input
     etl::dyn_matrix<weight, 4> output; ///< A batch of output
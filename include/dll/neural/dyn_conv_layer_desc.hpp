@@ -30,6 +30,9 @@ struct dyn_conv_layer_desc {
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
+    /*! The filter shapes with specialized kernels */
+    using shapes = detail::get_type_t<default_conv_shapes, Parameters...>;
+
     /*! The conv type */
     using layer_t = dyn_conv_layer_impl<dyn_conv_layer_desc<Parameters...>>;
 
@@ -38,7 +41,7 @@ struct dyn_conv_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, autotune_id, fixed_shapes_id>, Parameters...>,
         "Invalid parameters type for dyn_conv_layer_desc");
 };
 
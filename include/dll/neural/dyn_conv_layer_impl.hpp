@@ -10,7 +10,9 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/timers.hpp"     // for auto_timer
+#include "dll/util/conv_tuner.hpp" // for tuned_conv_forward
+#include "dll/util/shape_kernels.hpp" // for the fixed shapes
 
 namespace dll {
 
@@ -28,6 +30,7 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
 
     static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto tuned               = desc::parameters::template contains<dll::autotune>(); ///< Auto-tune the convolutions
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -40,6 +43,8 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     using w_type = etl::dyn_matrix<weight, 4>; ///< The type of the weights
     using b_type = etl::dyn_matrix<weight, 1>; ///< The type of the biases
 
+    using kernels_t = conv_shape_kernels<weight>; ///< The kernels specialized for some filter shapes
+
     //Weights and biases
     w_type w; ///< Weights
     b_type b; ///< Hidden biases
@@ -58,6 +63,8 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     size_t nw1; ///< The first dimension of the filters
     size_t nw2; ///< The second dimension of the filters
 
+    typename kernels_t::kernel_t forward_kernel = nullptr; ///< The kernel of the filter shape of the layer, if any
+
     dyn_conv_layer_impl(): base_type() {
         // Nothing else to init
     }
@@ -82,6 +89,8 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
 
         w_initializer::initialize(w, input_size(), output_size());
         b_initializer::initialize(b, input_size(), output_size());
+
+        forward_kernel = select_shape_kernel<kernels_t>(typename desc::shapes{}, std::array<size_t, 2>{{nw1, nw2}});
     }
 
     /*!
@@ -152,6 +161,24 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
         return {k, nh1, nh2};
     }
 
+    /*!
+     * \brief Change the spatial dimensions of the input of the layer, the
+     * weights being kept
+     * \param input_shape The new shape of the input [C, H, W]
+     * \return The new shape of the output
+     */
+    std::vector<size_t> resize_input(const std::vector<size_t>& input_shape) {
+        cpp_assert(input_shape.size() == 3 && input_shape[0] == nc, "Only the spatial dimensions of the input can change");
+        cpp_assert(input_shape[1] >= nw1 && input_shape[2] >= nw2, "The input cannot be smaller than the filters");
+
+        nv1 = input_shape[1];
+        nv2 = input_shape[2];
+        nh1 = nv1 - nw1 + 1;
+        nh2 = nv2 - nw2 + 1;
+
+        return {k, nh1, nh2};
+    }
+
     using base_type::forward_batch;
 
     /*!
@@ -164,18 +191,38 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        if constexpr (etl::dimensions<V>() == 4) {
-            output = etl::ml::convolution_forward(v, w);
+        if constexpr (tuned && etl::dimensions<V>() == 4) {
+            tuned_conv_forward(output, v, w);
+        } else if constexpr (etl::dimensions<V>() == 4) {
+            if constexpr (etl::all_dma<std::decay_t<H1>, V>) {
+                if (forward_kernel) {
+                    cpu_access(v, w);
+
+                    forward_kernel(output.memory_start(), v.memory_start(), w.memory_start(), etl::dim<0>(v), nc, k, nv1, nv2);
+
+                    cpu_modified(output);
+                } else {
+                    output = etl::ml::convolution_forward(v, w);
+                }
+            } else {
+                output = etl::ml::convolution_forward(v, w);
+            }
         } else {
             output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w);
         }
 
-        if constexpr (!no_bias) {
-            output = bias_add_4d(output, b);
-        }
+        // The bias and the activation are applied in a single pass, except
+        // for softmax which is not element-wise
+        if constexpr (!no_bias && activation_function != function::IDENTITY && activation_function != function::SOFTMAX) {
+            output = f_activate<activation_function>(bias_add_4d(output, b));
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_4d(output, b);
+            }
 
-        if constexpr (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+            if constexpr (activation_function != function::IDENTITY) {
+                output = f_activate<activation_function>(output);
+            }
         }
     }
 
@@ -246,7 +293,9 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv:backward_batch");
 
-        if constexpr (etl::dimensions<H>() == 4) {
+        if constexpr (tuned && etl::dimensions<H>() == 4) {
+            tuned_conv_backward(output, context.errors, w);
+        } else if constexpr (etl::dimensions<H>() == 4) {
             output = etl::ml::convolution_backward(context.errors, w);
         } else {
             etl::reshape(output, etl::dim<0>(output), nc, nv1, nv2) = etl::ml::convolution_backward(context.errors, w);
@@ -261,7 +310,11 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        if constexpr (tuned) {
+            tuned_conv_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors);
+        } else {
+            std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        }
 
         if constexpr (!no_bias) {
             std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
@@ -10,6 +10,7 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/conv_direct.hpp"
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -60,6 +61,8 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     size_t p1; ///< The first dimension padding
     size_t p2; ///< The second dimension padding
 
+    same_conv_kernel kernel = same_conv_kernel::ETL; ///< The convolution kernel
+
     dyn_conv_same_layer_impl(): base_type() {
         // Nothing else to init
     }
@@ -81,6 +84,8 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
         this->p1 = (nw1 - 1) / 2;
         this->p2 = (nw2 - 1) / 2;
 
+        this->kernel = select_same_conv_kernel(nw1, nw2);
+
         w = etl::dyn_matrix<weight, 4>(k, nc, nw1, nw2);
 
         b = etl::dyn_vector<weight>(k);
@@ -165,6 +170,23 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
         return {k, nh1, nh2};
     }
 
+    /*!
+     * \brief Change the spatial dimensions of the input of the layer, the
+     * weights being kept
+     * \param input_shape The new shape of the input [C, H, W]
+     * \return The new shape of the output
+     */
+    std::vector<size_t> resize_input(const std::vector<size_t>& input_shape) {
+        cpp_assert(input_shape.size() == 3 && input_shape[0] == nc, "Only the spatial dimensions of the input can change");
+
+        nv1 = input_shape[1];
+        nv2 = input_shape[2];
+        nh1 = nv1;
+        nh2 = nv2;
+
+        return {k, nh1, nh2};
+    }
+
     /*!
      * \brief Apply the layer to the given batch of input.
      *
@@ -175,7 +197,15 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
 
-        if constexpr (etl::dimensions<V>() == 4) {
+        if constexpr (same_conv_fast_path<H1, V>) {
+            if (kernel == same_conv_kernel::GEMM_1X1) {
+                gemm_conv1x1_forward(output, v, w);
+            } else if (kernel == same_conv_kernel::DIRECT_3X3) {
+                direct_conv3x3_forward(output, v, w);
+            } else {
+                output = etl::ml::convolution_forward(v, w, 1, 1, p1, p2);
+            }
+        } else if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward(v, w, 1, 1, p1, p2);
         } else {
             output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w, 1, 1, p1, p2);
@@ -248,7 +278,17 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        output = etl::ml::convolution_backward(context.errors, w, 1, 1, p1, p2);
+        if constexpr (same_conv_fast_path<H, decltype(context.errors)>) {
+            if (kernel == same_conv_kernel::GEMM_1X1) {
+                gemm_conv1x1_backward(output, context.errors, w);
+            } else if (kernel == same_conv_kernel::DIRECT_3X3) {
+                direct_conv3x3_backward(output, context.errors, w);
+            } else {
+                output = etl::ml::convolution_backward(context.errors, w, 1, 1, p1, p2);
+            }
+        } else {
+            output = etl::ml::convolution_backward(context.errors, w, 1, 1, p1, p2);
+        }
     }
 
     /*!
@@ -257,7 +297,19 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors, 1, 1, p1, p2);
+        auto& grad = std::get<0>(context.up.context)->grad;
+
+        if constexpr (same_conv_fast_path<decltype(context.errors), decltype(context.input)>) {
+            if (kernel == same_conv_kernel::GEMM_1X1) {
+                gemm_conv1x1_backward_filter(grad, context.input, context.errors);
+            } else if (kernel == same_conv_kernel::DIRECT_3X3) {
+                direct_conv3x3_backward_filter(grad, context.input, context.errors);
+            } else {
+                grad = etl::ml::convolution_backward_filter(context.input, context.errors, 1, 1, p1, p2);
+            }
+        } else {
+            grad = etl::ml::convolution_backward_filter(context.input, context.errors, 1, 1, p1, p2);
+        }
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
 };
@@ -10,6 +10,8 @@
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/conv_tuner.hpp" // for im2col_deconv_forward
+
 namespace dll {
 
 /*!
@@ -150,7 +152,11 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
+        if constexpr (etl::decay_traits<V>::dimensions() == 4) {
+            im2col_deconv_forward(output, v, w);
+        } else {
+            output = etl::conv_4d_full_flipped(v, w);
+        }
 
         const auto batch_size = etl::dim<0>(output);
 
@@ -223,7 +229,7 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::conv_4d_valid_flipped(context.errors, w);
+            im2col_deconv_backward(output, context.errors, w);
         } else {
             const auto B                          = etl::dim<0>(output);
             etl::reshape(output, B, nc, nv1, nv2) = etl::conv_4d_valid_flipped(context.errors, w);
@@ -236,7 +242,7 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        //TODO Update the gradients (probably with conv_4d_valid_filter)
+        im2col_deconv_backward_filter(std::get<0>(context.up.context)->grad, context.input, context.errors);
         std::get<1>(context.up.context)->grad = etl::mean_r(etl::sum_l(context.errors));
     }
 };
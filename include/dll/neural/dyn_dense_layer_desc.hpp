@@ -30,6 +30,9 @@ struct dyn_dense_layer_desc {
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
+    /*! The shapes with specialized kernels */
+    using shapes = detail::get_type_t<default_dense_shapes, Parameters...>;
+
     /*! The dense type */
     using layer_t = dyn_dense_layer_impl<dyn_dense_layer_desc<Parameters...>>;
 
@@ -39,7 +42,7 @@ struct dyn_dense_layer_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
-            cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>,
+            cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id, fast_activations_id, fixed_shapes_id>,
         Parameters...>,
         "Invalid parameters type for dense_layer_desc");
 };
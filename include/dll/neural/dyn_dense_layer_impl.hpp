@@ -9,6 +9,7 @@
 
 #include "dll/base_traits.hpp"  // The traits
 #include "dll/neural_layer.hpp" // The base class
+#include "dll/util/shape_kernels.hpp" // For the fixed shapes
 #include "dll/util/timers.hpp"  // For auto_timer
 
 namespace dll {
@@ -27,6 +28,7 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
     static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr bool fast_activations    = desc::parameters::template contains<dll::fast_activations>(); ///< Use the fast approximations of the activation functions
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -39,6 +41,8 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     using w_type = etl::dyn_matrix<weight, 2>; ///< The type of the weights
     using b_type = etl::dyn_matrix<weight, 1>; ///< The type of the biases
 
+    using kernels_t = dense_shape_kernels<activation_function, weight, fast_activations>; ///< The kernels specialized for some shapes
+
     //Weights and biases
     w_type w; ///< Weights
     b_type b; ///< Hidden biases
@@ -50,6 +54,8 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     size_t num_visible; ///< The number of visible units
     size_t num_hidden;  ///< The number of hidden units
 
+    typename kernels_t::kernel_t forward_kernel = nullptr; ///< The kernel of the shape of the layer, if any
+
     dyn_dense_layer_impl() : base_type() {}
 
     /*!
@@ -64,6 +70,8 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
         w_initializer::initialize(w, input_size(), output_size());
         b_initializer::initialize(b, input_size(), output_size());
+
+        forward_kernel = select_shape_kernel<kernels_t>(typename desc::shapes{}, std::array<size_t, 2>{{num_visible, num_hidden}});
     }
 
     /*!
@@ -149,13 +157,41 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
+        // The product, the bias and the activation at once, with the
+        // kernel of the shape of the layer
+        if constexpr (etl::all_dma<V, std::decay_t<H>>) {
+            if (forward_kernel) {
+                cpu_access(input, w, b);
+
+                forward_kernel(output.memory_start(), input.memory_start(), w.memory_start(), no_bias ? nullptr : b.memory_start(), Batch);
+
+                cpu_modified(output);
+
+                return;
+            }
+        }
+
         output = etl::reshape(input, Batch, num_visible) * w;
 
-        if constexpr (!no_bias) {
-            output = bias_add_2d(output, b);
+        // The fast activations are applied in place, after the bias
+        if constexpr (fast_activations && has_fast_activation(activation_function) && etl::all_dma<std::decay_t<H>>) {
+            if constexpr (!no_bias) {
+                output = bias_add_2d(output, b);
+            }
+
+            f_activate_fast<activation_function>(output);
         }
+        // The bias and the activation are applied in a single pass, except
+        // for softmax which is not element-wise
+        else if constexpr (!no_bias && activation_function != function::SOFTMAX) {
+            output = f_activate<activation_function>(bias_add_2d(output, b));
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_2d(output, b);
+            }
 
-        output = f_activate<activation_function>(output);
+            output = f_activate<activation_function>(output);
+        }
     }
 
     /*!
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/fast_random.hpp"
 
 namespace dll {
 
@@ -24,28 +25,18 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
 
     float p; ///< The dropout probability
 
-    using dropout_t = decltype(etl::state_inverted_dropout_mask(dll::rand_engine(), p));
+    mutable random_stream dropout;      ///< The random stream for the dropout masks
+    mutable std::vector<uint64_t> mask; ///< The bit-packed mask of the last training batch
 
-    dropout_t* dropout = nullptr; ///< The dropout mask generator (ETL)
+    static constexpr bool inference_identity = true; ///< Indicates that the layer is an identity at inference
 
     dyn_dropout_layer_impl() = default;
 
-    /*!
-     * \brief Delete the layer and frees all allocated resources
-     */
-    ~dyn_dropout_layer_impl() {
-        if (dropout) {
-            delete dropout;
-        }
-    }
-
     /*!
      * \brief Initialize the dynamic layer
      */
     void init_layer(float p) {
         this->p = p;
-
-        dropout = new dropout_t(dll::rand_engine(), p);
     }
 
     /*!
@@ -103,9 +94,9 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
     void train_forward_batch(Output& output, const Input& input) const {
         dll::auto_timer timer("dropout:train:forward");
 
-        // Note: For now, cannot do on one pass because of state_inverted dropout not copy-able
-        output = *dropout;
-        output = output >> input;
+        // Inverted dropout, the test forward is a simple copy
+        dropout_bits(dropout, mask, etl::size(input), p);
+        apply_dropout_bits(output, input, mask, p);
     }
 
     /*!
@@ -129,7 +120,7 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
     void backward_batch(H&& output, C& context) const {
         dll::unsafe_auto_timer timer("dropout:backward");
 
-        output = context.errors;
+        apply_dropout_bits(output, context.errors, mask, p);
     }
 
     /*!
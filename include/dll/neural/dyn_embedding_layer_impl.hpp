@@ -9,7 +9,8 @@
 
 #include "dll/neural_layer_no_bias.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/timers.hpp"      // for auto_timer
+#include "dll/util/sparse_rows.hpp" // for sparse_embedding_gradients
 
 namespace dll {
 
@@ -32,6 +33,8 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
     using input_t      = std::vector<input_one_t>;   ///< The type of the input
     using output_t     = std::vector<output_one_t>;  ///< The type of the output
 
+    static constexpr bool sparse_gradients = true; ///< Only the rows of the used indices have gradients
+
     using w_type = etl::dyn_matrix<weight, 2>; ///< The type of the weights
 
     //Weights and biases
@@ -197,7 +200,13 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
     void compute_gradients(C& context) const {
         dll::auto_timer timer("embedding:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);;
+        auto& sub = *std::get<0>(context.up.context);
+
+        if constexpr (has_sparse_rows<std::decay_t<decltype(sub)>>::value) {
+            sparse_embedding_gradients(sub, context.input, context.errors);
+        } else {
+            sub.grad = batch_embedding_gradients(context.input, context.errors, w);
+        }
     }
 };
 
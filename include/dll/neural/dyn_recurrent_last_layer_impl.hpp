@@ -7,9 +7,13 @@
 
 #pragma once
 
+#include <algorithm>
+
 #include "dll/base_traits.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/gpu.hpp"
+#include "dll/util/sequences.hpp" // for sequence_lengths
+#include "dll/util/timers.hpp"    // for auto_timer
 
 namespace dll {
 
@@ -33,6 +37,8 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
     size_t time_steps;   ///< The number of time steps
     size_t hidden_units; ///< The number of hidden units
 
+    mutable std::vector<size_t> lengths; ///< The length of each sequence of the batch (only for variable-length sequences)
+
     /*!
      * \brief Initialize the dynamic layer
      */
@@ -108,8 +114,30 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b) = input(b)(time_steps - 1);
+        // The last step of each sequence, before its padding
+        if constexpr (desc::parameters::template contains<variable_length>()) {
+            sequence_lengths(lengths, input);
+        }
+
+        if constexpr (etl::all_dma<H, V>) {
+            // Copy the last hidden states directly, without an expression per sample
+            const size_t T  = etl::dim<1>(input);
+            const size_t HH = etl::dim<2>(input);
+
+            cpu_access(input);
+
+            const weight* in = input.memory_start();
+            weight* out      = output.memory_start();
+
+            for (size_t b = 0; b < Batch; ++b) {
+                std::copy_n(in + (b * T + last_step(b)) * HH, HH, out + b * HH);
+            }
+
+            cpu_modified(output);
+        } else {
+            for(size_t b = 0; b < Batch; ++b){
+                output(b) = input(b)(last_step(b));
+            }
         }
     }
 
@@ -175,13 +203,41 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
 
         const auto Batch = etl::dim<0>(output);
 
-        output = 0;
+        if constexpr (etl::all_dma<H, decltype(context.errors)>) {
+            // The errors are sparse in time, each step is written only once
+            const size_t T  = etl::dim<1>(output);
+            const size_t HH = etl::dim<2>(output);
+
+            cpu_access(context.errors);
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b)(time_steps - 1) = context.errors(b);
+            const weight* errors = context.errors.memory_start();
+            weight* out          = output.memory_start();
+
+            for (size_t b = 0; b < Batch; ++b) {
+                const size_t last = last_step(b);
+
+                std::fill_n(out + b * T * HH, last * HH, weight(0));
+                std::copy_n(errors + b * HH, HH, out + (b * T + last) * HH);
+                std::fill_n(out + (b * T + last + 1) * HH, (T - last - 1) * HH, weight(0));
+            }
+
+            cpu_modified(output);
+        } else {
+            output = 0;
+
+            for(size_t b = 0; b < Batch; ++b){
+                output(b)(last_step(b)) = context.errors(b);
+            }
         }
     }
 
+    /*!
+     * \brief Returns the last time step of the given sample of the batch
+     */
+    size_t last_step(size_t b) const {
+        return lengths.empty() ? time_steps - 1 : lengths[b] - 1;
+    }
+
     /*!
      * \brief Compute the gradients for this layer, if any
      * \param context The trainng context
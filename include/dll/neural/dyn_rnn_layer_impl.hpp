@@ -162,7 +162,39 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
 
         cpp_assert(etl::dim<0>(output) == etl::dim<0>(x), "The number of samples must be consistent");
 
-        base_type::forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units);
+        // Only the steps of the longest sequence of the batch are computed
+        if constexpr (desc::parameters::template contains<variable_length>()) {
+            sequence_lengths(this->lengths, x);
+        }
+
+        base_type::forward_batch_impl(output, x, w, u, b, this->active_time_steps(time_steps), sequence_length, hidden_units);
+    }
+
+    /*!
+     * \brief Pack the weights for step_batch()
+     */
+    void prepare_steps() const {
+        base_type::prepare_steps_impl(w, u, sequence_length, hidden_units);
+    }
+
+    /*!
+     * \brief Advance a batch of streams by k time steps from their states.
+     *
+     * The weights must have been packed by prepare_steps().
+     *
+     * \param output The hidden states of each step [n x k x H]
+     * \param x The input of each step [n x k x S]
+     * \param h The hidden states of the streams [n x H], updated
+     * \param c The cell states of the streams [n x H], updated (unused, no cell state)
+     * \param started Indicates for each stream if it has already been started
+     */
+    void step_batch(weight* output, const weight* x, size_t n, size_t k, weight* h, weight* c, const uint8_t* started) const {
+        dll::auto_timer timer("rnn:step_batch");
+
+        cpp_unused(c);
+        cpp_unused(started);
+
+        base_type::step_batch_impl(output, x, n, k, h, b, sequence_length, hidden_units);
     }
 
     /*!
@@ -225,7 +257,7 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("rnn:backward_batch");
 
-        base_type::backward_batch_impl(output, context, w, u, time_steps, sequence_length, hidden_units, bptt_steps);
+        base_type::backward_batch_impl(output, context, w, u, this->active_time_steps(time_steps), sequence_length, hidden_units, bptt_steps);
     }
 
     /*!
@@ -236,7 +268,7 @@ struct dyn_rnn_layer_impl final : base_rnn_layer<dyn_rnn_layer_impl<Desc>, Desc>
     void compute_gradients(C& context) const {
         dll::auto_timer timer("rnn:compute_gradients");
 
-        base_type::compute_gradients_impl(context, w, u, time_steps, sequence_length, hidden_units, bptt_steps);
+        base_type::compute_gradients_impl(context, w, u, this->active_time_steps(time_steps), sequence_length, hidden_units, bptt_steps);
     }
 };
 
@@ -9,7 +9,8 @@
 
 #include "dll/neural_layer_no_bias.hpp"
 
-#include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/timers.hpp"      // for auto_timer
+#include "dll/util/sparse_rows.hpp" // for sparse_embedding_gradients
 
 namespace dll {
 
@@ -29,6 +30,8 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
     static constexpr size_t I = desc::I; ///< The input size
     static constexpr size_t K = desc::K; ///< The embedding size
 
+    static constexpr bool sparse_gradients = true; ///< Only the rows of the used indices have gradients
+
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
 
     using input_one_t  = etl::fast_dyn_matrix<weight, I>;    ///< The type of one input
@@ -172,7 +175,13 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
     void compute_gradients(C& context) const {
         dll::auto_timer timer("embedding:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);;
+        auto& sub = *std::get<0>(context.up.context);
+
+        if constexpr (has_sparse_rows<std::decay_t<decltype(sub)>>::value) {
+            sparse_embedding_gradients(sub, context.input, context.errors);
+        } else {
+            sub.grad = batch_embedding_gradients(context.input, context.errors, w);
+        }
     }
 };
 
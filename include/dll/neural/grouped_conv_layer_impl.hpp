@@ -0,0 +1,375 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/timers.hpp"       // for auto_timer
+#include "dll/util/conv_direct.hpp"  // for gemm_conv1x1_forward
+#include "dll/util/grouped_conv.hpp" // for grouped_conv_forward
+
+namespace dll {
+
+/*!
+ * \brief Grouped convolutional layer of neural network.
+ *
+ * The convolutions with one group are computed like the standard
+ * convolutional layer, with a GEMM for 1x1 filters. The convolutions with
+ * several groups are computed with the dedicated grouped kernels.
+ */
+template <typename Desc>
+struct grouped_conv_layer_impl final : neural_layer<grouped_conv_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                          ///< The descriptor of the layer
+    using weight      = typename desc::weight;         ///< The data type of the layer
+    using this_type   = grouped_conv_layer_impl<desc>; ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>; ///< The base type of the layer
+    using layer_t     = this_type;                     ///< The type of this layer
+    using dyn_layer_t = typename desc::dyn_layer_t;    ///< The type of this layer
+
+    static constexpr size_t NV1 = desc::NV1; ///< The first dimension of the visible units
+    static constexpr size_t NV2 = desc::NV2; ///< The second dimension of the visible units
+    static constexpr size_t NW1 = desc::NW1; ///< The first dimension of the filter
+    static constexpr size_t NW2 = desc::NW2; ///< The second dimension of the filter
+    static constexpr size_t NC  = desc::NC;  ///< The number of input channels
+    static constexpr size_t K   = desc::K;   ///< The number of filters
+    static constexpr size_t G   = desc::G;   ///< The number of groups
+    static constexpr size_t CG  = NC / G;    ///< The number of input channels of a group
+
+    static constexpr size_t NH1 = NV1 - NW1 + 1; //By definition
+    static constexpr size_t NH2 = NV2 - NW2 + 1; //By definition
+
+    static constexpr auto activation_function = desc::activation_function; ///< The activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr bool pointwise           = G == 1 && NW1 == 1 && NW2 == 1; ///< Indicates if the convolution is a GEMM
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, NC, NV1, NV2>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, K, NH1, NH2>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>; ///< The type of the input
+    using output_t     = std::vector<output_one_t>; ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, K, CG, NW1, NW2>; ///< The type of the weights
+    using b_type = etl::fast_matrix<weight, K>; ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    /*!
+     * \brief Initialize a grouped conv layer with basic weights.
+     */
+    grouped_conv_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), output_size());
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    // No copying or moving
+    grouped_conv_layer_impl(const grouped_conv_layer_impl& rhs) = delete;
+    grouped_conv_layer_impl& operator=(const grouped_conv_layer_impl& rhs) = delete;
+
+    // No copying or moving
+    grouped_conv_layer_impl(const grouped_conv_layer_impl&& rhs) = delete;
+    grouped_conv_layer_impl& operator=(const grouped_conv_layer_impl&& rhs) = delete;
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return NC * NV1 * NV2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return K * NH1 * NH2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return K * CG * NW1 * NW2;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        const char* name = CG == 1 ? "DepthwiseConv" : "GroupedConv";
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return name;
+        } else {
+            char buffer[512];
+            snprintf(buffer, 512, "%s (%s)", name, to_string(activation_function).c_str());
+            return {buffer};
+        }
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "GroupedConv(%lu): %lux%lux%lu -> (%lux%lux%lux%lu) -> %lux%lux%lu", G, NC, NV1, NV2, K, CG, NW1, NW2, K, NH1, NH2);
+        } else {
+            snprintf(buffer, 512, "GroupedConv(%lu): %lux%lux%lu -> (%lux%lux%lux%lu) -> %s -> %lux%lux%lu", G, NC, NV1, NV2, K, CG, NW1, NW2, to_string(activation_function).c_str(), K, NH1, NH2);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {K, NH1, NH2};
+    }
+
+    using base_type::forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("grouped_conv:forward_batch");
+
+        if constexpr (etl::dimensions<V>() != 4) {
+            convolve(output, etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2));
+        } else {
+            convolve(output, v);
+        }
+
+        // The bias and the activation are applied in a single pass, except
+        // for softmax which is not element-wise
+        if constexpr (!no_bias && activation_function != function::IDENTITY && activation_function != function::SOFTMAX) {
+            output = f_activate<activation_function>(bias_add_4d(output, b));
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_4d(output, b);
+            }
+
+            if constexpr (activation_function != function::IDENTITY) {
+                output = f_activate<activation_function>(output);
+            }
+        }
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM& dyn){
+        dyn.init_layer(NC, NV1, NV2, K, NW1, NW2, G);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("grouped_conv:adapt_errors");
+
+        if constexpr (activation_function != function::IDENTITY){
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("grouped_conv:backward_batch");
+
+        if constexpr (pointwise && same_conv_fast_path<H, decltype(context.errors)>) {
+            gemm_conv1x1_backward(output, context.errors, w);
+        } else if constexpr (G == 1 && etl::dimensions<H>() == 4) {
+            output = etl::ml::convolution_backward(context.errors, w);
+        } else if constexpr (G == 1) {
+            etl::reshape(output, etl::dim<0>(output), NC, NV1, NV2) = etl::ml::convolution_backward(context.errors, w);
+        } else {
+            static_assert(etl::all_dma<std::decay_t<H>>, "The grouped convolution needs the gradients of the input in memory");
+
+            grouped_conv_backward(output, context.errors, w, G);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("grouped_conv:compute_gradients");
+
+        auto& grad = std::get<0>(context.up.context)->grad;
+
+        if constexpr (pointwise) {
+            gemm_conv1x1_backward_filter(grad, context.input, context.errors);
+        } else if constexpr (G == 1) {
+            grad = etl::ml::convolution_backward_filter(context.input, context.errors);
+        } else {
+            grouped_conv_backward_filter(grad, context.input, context.errors, G);
+        }
+
+        if constexpr (!no_bias) {
+            std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        }
+    }
+
+private:
+    /*!
+     * \brief Compute the raw convolution of the given batch of input
+     * \param output The output [B x K x NH1 x NH2]
+     * \param v The input [B x NC x NV1 x NV2]
+     */
+    template <typename H1, typename V>
+    void convolve(H1&& output, const V& v) const {
+        if constexpr (pointwise && same_conv_fast_path<H1, V>) {
+            gemm_conv1x1_forward(output, v, w);
+        } else if constexpr (G == 1) {
+            output = etl::ml::convolution_forward(v, w);
+        } else if constexpr (!etl::all_dma<V>) {
+            convolve(output, etl::force_temporary(v));
+        } else {
+            static_assert(etl::all_dma<std::decay_t<H1>>, "The grouped convolution needs its output in memory");
+
+            grouped_conv_forward(output, v, w, G);
+        }
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t grouped_conv_layer_impl<Desc>::NV1;
+
+template <typename Desc>
+const size_t grouped_conv_layer_impl<Desc>::NV2;
+
+template <typename Desc>
+const size_t grouped_conv_layer_impl<Desc>::NH1;
+
+template <typename Desc>
+const size_t grouped_conv_layer_impl<Desc>::NH2;
+
+template <typename Desc>
+const size_t grouped_conv_layer_impl<Desc>::NC;
+
+template <typename Desc>
+const size_t grouped_conv_layer_impl<Desc>::NW1;
+
+template <typename Desc>
+const size_t grouped_conv_layer_impl<Desc>::NW2;
+
+template <typename Desc>
+const size_t grouped_conv_layer_impl<Desc>::K;
+
+template <typename Desc>
+const size_t grouped_conv_layer_impl<Desc>::G;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<grouped_conv_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = true;  ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of the sgd_context for grouped_conv_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, grouped_conv_layer_impl<Desc>, L> {
+    using layer_t = grouped_conv_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t NV1 = layer_t::NV1;
+    static constexpr size_t NV2 = layer_t::NV2;
+    static constexpr size_t NH1 = layer_t::NH1;
+    static constexpr size_t NH2 = layer_t::NH2;
+    static constexpr size_t NC  = layer_t::NC;
+    static constexpr size_t K   = layer_t::K;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, NC, NV1, NV2> input;
+    etl::fast_matrix<weight, batch_size, K, NH1, NH2> output;
+    etl::fast_matrix<weight, batch_size, K, NH1, NH2> errors;
+
+    sgd_context(const grouped_conv_layer_impl<Desc>& /* layer */)
+            : output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
@@ -0,0 +1,66 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Describe a convolutional layer over one-hot encoded sequences.
+ *
+ * The input is a sequence of I indices in a vocabulary of V elements,
+ * standing for a one-hot matrix [V x I]. The K filters span the complete
+ * vocabulary and NW positions of the sequence. With NW == I, this is a
+ * dense layer over the one-hot input.
+ */
+template <size_t V_T, size_t I_T, size_t K_T, size_t NW_T, typename... Parameters>
+struct one_hot_conv_layer_desc {
+    static constexpr size_t V  = V_T;  ///< The size of the vocabulary
+    static constexpr size_t I  = I_T;  ///< The size of each input
+    static constexpr size_t K  = K_T;  ///< The number of filters
+    static constexpr size_t NW = NW_T; ///< The width of the filters
+
+    /*!
+     * \brief A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>; ///< The layer's activation function
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The one-hot conv type */
+    using layer_t = one_hot_conv_layer_impl<one_hot_conv_layer_desc<V, I, K, NW, Parameters...>>;
+
+    /*! The one-hot conv type (there is no dynamic version) */
+    using dyn_layer_t = layer_t;
+
+    static_assert(V > 0, "At least one char in vocabulary is necessary");
+    static_assert(I > 0, "At least one input is necessary");
+    static_assert(K > 0, "At least one filter is necessary");
+    static_assert(NW > 0 && NW <= I, "The filters must fit in the input");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id>, Parameters...>,
+        "Invalid parameters type for one_hot_conv_layer_desc");
+};
+
+/*!
+ * \brief Describe a convolutional layer over one-hot encoded sequences.
+ */
+template <size_t V_T, size_t I_T, size_t K_T, size_t NW_T, typename... Parameters>
+using one_hot_conv_layer = typename one_hot_conv_layer_desc<V_T, I_T, K_T, NW_T, Parameters...>::layer_t;
+
+} //end of dll namespace
@@ -0,0 +1,272 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/timers.hpp"       // for auto_timer
+#include "dll/util/one_hot_conv.hpp" // for one_hot_conv_forward
+
+namespace dll {
+
+/*!
+ * \brief Convolutional layer over one-hot encoded sequences.
+ *
+ * The input of this layer are the indices of the hot elements, like the
+ * input of an embedding layer, instead of the one-hot matrices. The
+ * convolution gathers the weights of each index and the gradients are
+ * only computed for the rows of the indices of the batch.
+ *
+ * This layer can only be the first layer of a network.
+ */
+template <typename Desc>
+struct one_hot_conv_layer_impl final : neural_layer<one_hot_conv_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                          ///< The descriptor of the layer
+    using weight      = typename desc::weight;         ///< The data type of the layer
+    using this_type   = one_hot_conv_layer_impl<desc>; ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>; ///< The base type of the layer
+    using layer_t     = this_type;                     ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;    ///< The dynamic version of this layer
+
+    static constexpr size_t V  = desc::V;    ///< The vocabulary size
+    static constexpr size_t I  = desc::I;    ///< The input size
+    static constexpr size_t K  = desc::K;    ///< The number of filters
+    static constexpr size_t NW = desc::NW;   ///< The width of the filters
+    static constexpr size_t NH = I - NW + 1; ///< The width of the output
+
+    static constexpr auto activation_function = desc::activation_function; ///< The activation function
+
+    static constexpr bool sparse_gradients = true; ///< Only the rows of the used indices have gradients
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, I>;        ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, K, NH, 1>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>;               ///< The type of the input
+    using output_t     = std::vector<output_one_t>;              ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, V, NW, K>; ///< The type of the weights
+    using b_type = etl::fast_matrix<weight, K>;        ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    /*!
+     * \brief Initialize a one-hot conv layer with basic weights.
+     */
+    one_hot_conv_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), output_size());
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return I;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return K * NH;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return V * NW * K;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return "OneHotConv";
+        } else {
+            return "OneHotConv (" + to_string(activation_function) + ")";
+        }
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "OneHotConv: %lux%lu -> (%lux%lux%lu) -> %lux%lux1", V, I, K, V, NW, K, NH);
+        } else {
+            snprintf(buffer, 512, "OneHotConv: %lux%lu -> (%lux%lux%lu) -> %s -> %lux%lux1", V, I, K, V, NW, to_string(activation_function).c_str(), K, NH);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {K, NH, 1};
+    }
+
+    using base_type::forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename In>
+    void forward_batch(H1&& output, const In& v) const {
+        dll::auto_timer timer("one_hot_conv:forward_batch");
+
+        if constexpr (!etl::all_dma<In>) {
+            forward_batch(output, etl::force_temporary(v));
+        } else {
+            static_assert(etl::all_dma<std::decay_t<H1>>, "The one-hot convolution needs its output in memory");
+
+            one_hot_conv_forward(output, v, w, b);
+
+            if constexpr (activation_function != function::IDENTITY) {
+                output = f_activate<activation_function>(output);
+            }
+        }
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("one_hot_conv:adapt_errors");
+
+        if constexpr (activation_function != function::IDENTITY){
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("one_hot_conv:compute_gradients");
+
+        one_hot_conv_gradients(*std::get<0>(context.up.context), context.input, context.errors);
+
+        std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t one_hot_conv_layer_impl<Desc>::V;
+
+template <typename Desc>
+const size_t one_hot_conv_layer_impl<Desc>::I;
+
+template <typename Desc>
+const size_t one_hot_conv_layer_impl<Desc>::K;
+
+template <typename Desc>
+const size_t one_hot_conv_layer_impl<Desc>::NW;
+
+template <typename Desc>
+const size_t one_hot_conv_layer_impl<Desc>::NH;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<one_hot_conv_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of the sgd_context for one_hot_conv_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, one_hot_conv_layer_impl<Desc>, L> {
+    using layer_t = one_hot_conv_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t I  = layer_t::I;
+    static constexpr size_t K  = layer_t::K;
+    static constexpr size_t NH = layer_t::NH;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, I> input;
+    etl::fast_matrix<weight, batch_size, K, NH, 1> output;
+    etl::fast_matrix<weight, batch_size, K, NH, 1> errors;
+
+    sgd_context(const one_hot_conv_layer_impl<Desc>& /* layer */)
+            : output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
@@ -7,8 +7,11 @@
 
 #pragma once
 
+#include <algorithm>
+
 #include "dll/base_traits.hpp"
 
+#include "dll/util/gpu.hpp"
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -102,8 +105,25 @@ struct recurrent_last_layer_impl final : layer<recurrent_last_layer_impl<Desc>>
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b) = input(b)(time_steps - 1);
+        if constexpr (etl::all_dma<H, V>) {
+            // Copy the last hidden states directly, without an expression per sample
+            const size_t T  = etl::dim<1>(input);
+            const size_t HH = etl::dim<2>(input);
+
+            cpu_access(input);
+
+            const weight* in = input.memory_start();
+            weight* out      = output.memory_start();
+
+            for (size_t b = 0; b < Batch; ++b) {
+                std::copy_n(in + (b * T + time_steps - 1) * HH, HH, out + b * HH);
+            }
+
+            cpu_modified(output);
+        } else {
+            for(size_t b = 0; b < Batch; ++b){
+                output(b) = input(b)(time_steps - 1);
+            }
         }
     }
 
@@ -164,10 +184,31 @@ struct recurrent_last_layer_impl final : layer<recurrent_last_layer_impl<Desc>>
 
         const auto Batch = etl::dim<0>(output);
 
-        output = 0;
+        if constexpr (etl::all_dma<H, decltype(context.errors)>) {
+            // The errors are sparse in time, each step is written only once
+            const size_t T  = etl::dim<1>(output);
+            const size_t HH = etl::dim<2>(output);
+
+            cpu_access(context.errors);
+
+            const weight* errors = context.errors.memory_start();
+            weight* out          = output.memory_start();
+
+            for (size_t b = 0; b < Batch; ++b) {
+                const size_t last = time_steps - 1;
+
+                std::fill_n(out + b * T * HH, last * HH, weight(0));
+                std::copy_n(errors + b * HH, HH, out + (b * T + last) * HH);
+                std::fill_n(out + (b * T + last + 1) * HH, (T - last - 1) * HH, weight(0));
+            }
+
+            cpu_modified(output);
+        } else {
+            output = 0;
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b)(time_steps - 1) = context.errors(b);
+            for(size_t b = 0; b < Batch; ++b){
+                output(b)(time_steps - 1) = context.errors(b);
+            }
         }
     }
 
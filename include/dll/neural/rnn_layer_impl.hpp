@@ -150,6 +150,33 @@ struct rnn_layer_impl final : base_rnn_layer<rnn_layer_impl<Desc>, Desc> {
         base_type::forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units);
     }
 
+    /*!
+     * \brief Pack the weights for step_batch()
+     */
+    void prepare_steps() const {
+        base_type::prepare_steps_impl(w, u, sequence_length, hidden_units);
+    }
+
+    /*!
+     * \brief Advance a batch of streams by k time steps from their states.
+     *
+     * The weights must have been packed by prepare_steps().
+     *
+     * \param output The hidden states of each step [n x k x H]
+     * \param x The input of each step [n x k x S]
+     * \param h The hidden states of the streams [n x H], updated
+     * \param c The cell states of the streams [n x H], updated (unused, no cell state)
+     * \param started Indicates for each stream if it has already been started
+     */
+    void step_batch(weight* output, const weight* x, size_t n, size_t k, weight* h, weight* c, const uint8_t* started) const {
+        dll::auto_timer timer("rnn:step_batch");
+
+        cpp_unused(c);
+        cpp_unused(started);
+
+        base_type::step_batch_impl(output, x, n, k, h, b, sequence_length, hidden_units);
+    }
+
     /*!
      * \brief Prepare one empty output for this layer
      * \return an empty ETL matrix suitable to store one output of this layer
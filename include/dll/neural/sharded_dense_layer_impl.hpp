@@ -0,0 +1,434 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_traits.hpp"
+#include "dll/neural_layer.hpp"
+
+#include "dll/util/column_shards.hpp" // for the sharded kernels
+#include "dll/util/gpu.hpp"           // for cpu_access
+#include "dll/util/timers.hpp"        // for auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Dense layer of neural network whose weights are sharded by output
+ * columns, for model parallelism on very large layers.
+ *
+ * The weights are stored as S shards [V x H / S], each shard holding a
+ * contiguous range of the outputs. The forward pass, the backward pass and
+ * the gradients of each shard are computed by its own task, with the
+ * weights of the shard only. On NUMA machines, the weights and the
+ * gradients of each shard are bound to a node (see column_shards.hpp).
+ */
+template <typename Desc>
+struct sharded_dense_layer_impl final : neural_layer<sharded_dense_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                          ///< The descriptor of the layer
+    using weight      = typename desc::weight;         ///< The data type for this layer
+    using this_type   = sharded_dense_layer_impl<desc>; ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>; ///< The base type
+    using layer_t     = this_type;                     ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;    ///< The dynamic version of this layer
+
+    static constexpr size_t num_visible  = desc::num_visible;      ///< The number of visible units
+    static constexpr size_t num_hidden   = desc::num_hidden;       ///< The number of hidden units
+    static constexpr size_t shards       = desc::shards;           ///< The number of shards
+    static constexpr size_t shard_hidden = num_hidden / shards;    ///< The number of hidden units of each shard
+
+    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, num_visible>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, num_hidden>;  ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                  ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                 ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, shards, num_visible, shard_hidden>; ///< The type of the weights
+    using b_type = etl::fast_matrix<weight, num_hidden>;                        ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights, shard by shard
+    b_type b; ///< Hidden biases
+
+    //Backup Weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    /*!
+     * \brief Initialize a sharded dense layer with basic weights.
+     */
+    sharded_dense_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), output_size());
+        b_initializer::initialize(b, input_size(), output_size());
+
+        bind_shards(w);
+    }
+
+    /*!
+     * \brief Returns the input size of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return num_visible;
+    }
+
+    /*!
+     * \brief Returns the output size of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns the number of parameters of this layer
+     */
+    static constexpr size_t parameters() noexcept {
+        // Weights + Biases
+        return num_visible * num_hidden + num_hidden;
+    }
+
+    /*!
+     * \brief Returns the weight between the visible unit v and the hidden
+     * unit h
+     */
+    weight& weight_at(size_t v, size_t h) {
+        return w(h / shard_hidden, v, h % shard_hidden);
+    }
+
+    /*!
+     * \brief Returns the weight between the visible unit v and the hidden
+     * unit h
+     */
+    const weight& weight_at(size_t v, size_t h) const {
+        return w(h / shard_hidden, v, h % shard_hidden);
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+        snprintf(buffer, 512, "Dense (%s) [%lu shards]", to_string(activation_function).c_str(), shards);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+        snprintf(buffer, 512, "Dense: %lu -> %s -> %lu [%lu shards]", num_visible, to_string(activation_function).c_str(), num_hidden, shards);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {num_hidden};
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void forward_batch(H&& output, const V& input) const {
+        dll::auto_timer timer("sharded_dense:forward_batch");
+
+        const auto Batch = etl::dim<0>(input);
+
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
+
+        if constexpr (etl::all_dma<V, std::decay_t<H>>) {
+            cpu_access(input);
+
+            forward_shards(output.memory_start(), input.memory_start(), Batch);
+
+            cpu_modified(output);
+        } else {
+            etl::dyn_matrix<weight, 2> in(Batch, num_visible);
+            etl::dyn_matrix<weight, 2> out(Batch, num_hidden);
+
+            in = etl::reshape(input, Batch, num_visible);
+
+            forward_shards(out.memory_start(), in.memory_start(), Batch);
+
+            output = out;
+        }
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the fast
+     * version of the layer.
+     *
+     * This layer is its own dynamic version, there is nothing to init.
+     */
+    template <typename DLayer>
+    static void dyn_init(DLayer& dyn) {
+        cpp_unused(dyn);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * The derivative is applied by each shard on its columns, with the
+     * reduction of the biases, in the backward pass (or the gradients for
+     * the first layer).
+     *
+     * \param context the training context
+     */
+    template <typename C>
+    void adapt_errors(C& context) const {
+        context.adapt_pending = true;
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     *
+     * Each shard backpropagates its columns of the errors, the errors of
+     * all the shards are then summed.
+     *
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template <typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::unsafe_auto_timer timer("sharded_dense:backward_batch");
+
+        static_assert(etl::all_dma<std::decay_t<H>>, "The errors of the previous layer must be in memory");
+
+        constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
+
+        cpu_access(w, context.errors, context.output);
+
+        weight* errors    = context.errors.memory_start();
+        weight* b_grad    = start_biases(context);
+        weight* partials  = context.partials.data();
+        const bool derivative = context.adapt_pending;
+
+        for_each_shard(shards, [&](size_t s) {
+            const size_t first = s * shard_hidden;
+
+            shard_derivative<activation_function>(errors, context.output.memory_start(), b_grad, derivative, Batch, num_hidden, first, shard_hidden);
+            shard_backward(partials + s * Batch * num_visible, errors, shard_weights(s), Batch, num_visible, num_hidden, first, shard_hidden);
+        });
+
+        context.adapt_pending = false;
+        context.bias_reduced  = true;
+
+        end_biases(context);
+
+        reduce_shards(output.memory_start(), partials, shards, Batch, num_visible);
+
+        cpu_modified(context.errors);
+        cpu_modified(output);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template <typename C>
+    void compute_gradients(C& context) const {
+        dll::unsafe_auto_timer timer("sharded_dense:compute_gradients");
+
+        constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
+
+        auto& grad = std::get<0>(context.up.context)->grad;
+
+        // The gradients of a shard are local to the node of the shard
+        if (!context.grad_bound) {
+            bind_shards(grad);
+            context.grad_bound = true;
+        }
+
+        cpu_access(grad, context.input, context.errors, context.output);
+
+        weight* errors    = context.errors.memory_start();
+        weight* g         = grad.memory_start();
+        const bool reduce = !context.bias_reduced;
+        weight* b_grad    = reduce ? start_biases(context) : nullptr;
+        const bool derivative = context.adapt_pending;
+
+        for_each_shard(shards, [&](size_t s) {
+            const size_t first = s * shard_hidden;
+
+            // The first layer has no backward pass
+            if (reduce) {
+                shard_derivative<activation_function>(errors, context.output.memory_start(), b_grad, derivative, Batch, num_hidden, first, shard_hidden);
+            }
+
+            shard_gradients(g + s * num_visible * shard_hidden, context.input.memory_start(), errors, Batch, num_visible, num_hidden, first, shard_hidden);
+        });
+
+        if (reduce) {
+            end_biases(context);
+            cpu_modified(context.errors);
+        }
+
+        context.adapt_pending = false;
+        context.bias_reduced  = false;
+
+        cpu_modified(grad);
+    }
+
+private:
+    /*!
+     * \brief Returns the weights of the shard s [V x H / S]
+     */
+    const weight* shard_weights(size_t s) const {
+        return w.memory_start() + s * num_visible * shard_hidden;
+    }
+
+    /*!
+     * \brief Compute the output of the layer for a batch, shard by shard
+     */
+    void forward_shards(weight* out, const weight* in, size_t batch) const {
+        cpu_access(w, b);
+
+        for_each_shard(shards, [&](size_t s) {
+            shard_forward<activation_function>(out, in, shard_weights(s), b.memory_start(), batch, num_visible, num_hidden, s * shard_hidden, shard_hidden);
+        });
+
+        // The softmax needs all the columns of a row
+        if constexpr (activation_function == function::SOFTMAX) {
+            parallel_kernel(0, batch, [&](size_t r) {
+                activate_one<function::SOFTMAX>(out + r * num_hidden, num_hidden);
+            });
+        }
+    }
+
+    /*!
+     * \brief Bind each shard of the given tensor [S x V x H / S] to the
+     * NUMA node of the shard
+     */
+    template <typename T>
+    static void bind_shards(T& tensor) {
+        constexpr size_t shard_size = num_visible * shard_hidden;
+
+        for (size_t s = 0; s < shards; ++s) {
+            numa_bind(tensor.memory_start() + s * shard_size, shard_size * sizeof(weight), shard_node(s, shards));
+        }
+    }
+
+    /*!
+     * \brief Start the reduction of the gradients of the biases
+     * \return the gradients of the biases
+     */
+    template <typename C>
+    static weight* start_biases(C& context) {
+        auto& b_grad = std::get<1>(context.up.context)->grad;
+
+        cpu_access(b_grad);
+
+        return b_grad.memory_start();
+    }
+
+    /*!
+     * \brief Finish the reduction of the gradients of the biases
+     */
+    template <typename C>
+    static void end_biases(C& context) {
+        cpu_modified(std::get<1>(context.up.context)->grad);
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t sharded_dense_layer_impl<Desc>::num_visible;
+
+template <typename Desc>
+const size_t sharded_dense_layer_impl<Desc>::num_hidden;
+
+template <typename Desc>
+const size_t sharded_dense_layer_impl<Desc>::shards;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<sharded_dense_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief specialization of sgd_context for sharded_dense_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, sharded_dense_layer_impl<Desc>, L> {
+    using layer_t = sharded_dense_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto num_visible = layer_t::num_visible;
+    static constexpr auto num_hidden  = layer_t::num_hidden;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, num_visible> input;
+    etl::fast_matrix<weight, batch_size, num_hidden> output;
+    etl::fast_matrix<weight, batch_size, num_hidden> errors;
+
+    std::vector<weight> partials; ///< The errors backpropagated by each shard [S x B x V]
+
+    bool adapt_pending = false; ///< Indicates if the derivative of the activation is still to be applied to the errors
+    bool bias_reduced  = false; ///< Indicates if the gradients of the biases were reduced in the backward pass
+    bool grad_bound    = false; ///< Indicates if the gradients have been bound to the nodes of the shards
+
+    sgd_context(const sharded_dense_layer_impl<Desc>& /* layer */)
+            : output(0.0), errors(0.0), partials(layer_t::shards * batch_size * num_visible) {}
+};
+
+} //end of dll namespace
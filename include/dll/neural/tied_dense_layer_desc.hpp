@@ -0,0 +1,61 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Descriptor for a dense layer whose weights are tied to the
+ * transpose of the weights of a dense layer of hiddens visible units and of
+ * visibles hidden units (the encoder of an auto-encoder).
+ *
+ * The layer only has its own biases, the weights are the ones of the
+ * encoder, bound with tie().
+ */
+template <size_t visibles, size_t hiddens, typename... Parameters>
+struct tied_dense_layer_desc {
+    static constexpr size_t num_visible = visibles; ///< The number of visible units of the layer
+    static constexpr size_t num_hidden  = hiddens;  ///< The number of hidden units of the layer
+
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>; ///< The layer's activation function
+
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The tied dense type */
+    using layer_t = tied_dense_layer_impl<tied_dense_layer_desc<visibles, hiddens, Parameters...>>;
+
+    /*! The tied dense type (the weights are the ones of the encoder) */
+    using dyn_layer_t = layer_t;
+
+    static_assert(num_visible > 0, "There must be at least 1 visible unit");
+    static_assert(num_hidden > 0, "There must be at least 1 hidden unit");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_bias_id>, Parameters...>,
+        "Invalid parameters type for tied_dense_layer_desc");
+};
+
+/*!
+ * \brief Describe a dense layer with tied weights
+ */
+template <size_t visibles, size_t hiddens, typename... Parameters>
+using tied_dense_layer = typename tied_dense_layer_desc<visibles, hiddens, Parameters...>::layer_t;
+
+} //end of dll namespace
@@ -7,10 +7,20 @@
 
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
 #include "cpp_utils/stop_watch.hpp"
 
 #include "layer_traits.hpp"
 #include "dbn_traits.hpp"
+#include "util/gpu.hpp"
 
 #ifndef DLL_DETAIL_ONLY
 #include <opencv2/opencv.hpp>
@@ -122,27 +132,259 @@ constexpr inline size_t best_width(const size_t total) {
     return ct_sqrt(total);
 }
 
+/*!
+ * \brief Compute the minimum and the maximum of n > 0 values in a single
+ * pass, written so that the compiler vectorizes it
+ */
+template <typename T>
+std::pair<T, T> minmax(const T* values, size_t n) {
+    T min = values[0];
+    T max = values[0];
+
+    for (size_t i = 1; i < n; ++i) {
+        min = values[i] < min ? values[i] : min;
+        max = values[i] > max ? values[i] : max;
+    }
+
+    return {min, max};
+}
+
+/*!
+ * \brief The mapping of weights to gray levels
+ */
+struct gray_normalization {
+    double min;   ///< The weight mapped to black
+    double scale; ///< The factor from the weights to [0, 1]
+
+    /*!
+     * \brief Returns the gray level of the given weight
+     */
+    template <typename T>
+    uint8_t operator()(T value) const {
+        return uint8_t(std::min(std::max((value - min) * scale, 0.0), 1.0) * 255);
+    }
+};
+
+/*!
+ * \brief Returns the mapping of the given n weights to gray levels, scaled
+ * from their minimum to their maximum if scale is true
+ */
+template <typename T>
+gray_normalization normalization(const T* values, size_t n, bool scale) {
+    if (!scale || !n) {
+        return {0.0, 1.0};
+    }
+
+    auto range = minmax(values, n);
+
+    return {double(range.first), 1.0 / (double(range.second) - double(range.first) + 1e-8)};
+}
+
 } //end of namespace detail
 
 #ifndef DLL_DETAIL_ONLY
 
+/*!
+ * \brief An OpenCV window refreshed by its own UI thread.
+ *
+ * The training thread only copies what must be drawn into the back buffer
+ * of a double-buffered snapshot. The UI thread swaps the buffers, renders
+ * the front snapshot and refreshes the window at a fixed frame rate, the
+ * drawing and the event loop of the GUI never block the training.
+ *
+ * \tparam Snapshot The type of the data rendered in the window
+ */
+template <typename Snapshot>
+struct ocv_window {
+    using snapshot_t = Snapshot;                                         ///< The type of the rendered data
+    using render_t   = std::function<void(const snapshot_t&, cv::Mat&)>; ///< The type of the rendering functor
+
+    /*!
+     * \brief Create a new window, not opened yet
+     * \param title The title of the window
+     * \param fps The number of refreshes of the window per second
+     */
+    explicit ocv_window(std::string title, size_t fps = 25)
+            : title(std::move(title)), fps(std::max(fps, size_t(1))) {}
+
+    ocv_window(const ocv_window& rhs) = delete;
+    ocv_window& operator=(const ocv_window& rhs) = delete;
+
+    /*!
+     * \brief Close the window and stop its UI thread
+     */
+    ~ocv_window() {
+        close();
+    }
+
+    /*!
+     * \brief Open the window and start its UI thread, if not already open
+     * \param render_functor The functor rendering a snapshot into the image
+     * of the window
+     */
+    void open(render_t render_functor) {
+        if (thread.joinable()) {
+            return;
+        }
+
+        render  = std::move(render_functor);
+        running = true;
+
+        thread = std::thread([this] { run(); });
+    }
+
+    /*!
+     * \brief Update the snapshot rendered in the window.
+     *
+     * The functor fills the back buffer, it is the only work done on the
+     * calling thread, the rendering is done by the UI thread.
+     *
+     * \param update_functor The functor filling the snapshot
+     */
+    template <typename Update>
+    void update(Update&& update_functor) {
+        std::lock_guard<std::mutex> l(lock);
+
+        update_functor(snapshots[1 - front]);
+
+        dirty = true;
+    }
+
+    /*!
+     * \brief Wait until a key is pressed in the window, once the last
+     * snapshot has been rendered.
+     */
+    void wait_key() {
+        std::unique_lock<std::mutex> ulock(lock);
+
+        if (!running) {
+            return;
+        }
+
+        key_requested = true;
+
+        key_pressed.wait(ulock, [this] { return !key_requested; });
+    }
+
+    /*!
+     * \brief Stop the UI thread of the window
+     */
+    void close() {
+        if (!thread.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            running = false;
+        }
+
+        thread.join();
+    }
+
+private:
+    /*!
+     * \brief The loop of the UI thread
+     */
+    void run() {
+        cv::namedWindow(title, cv::WINDOW_NORMAL);
+
+        const int delay = std::max(1, int(1000 / fps));
+
+        while (true) {
+            bool fresh = false;
+            bool key   = false;
+            bool stop  = false;
+
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                if (dirty) {
+                    front = 1 - front;
+                    dirty = false;
+                    fresh = true;
+                }
+
+                key  = key_requested;
+                stop = !running;
+            }
+
+            // The front buffer is only written by the training thread after the next swap
+            if (fresh) {
+                render(snapshots[front], image);
+            }
+
+            if (!image.empty()) {
+                cv::imshow(title, image);
+            }
+
+            if (stop) {
+                break;
+            }
+
+            cv::waitKey(key ? 0 : delay);
+
+            if (key) {
+                {
+                    std::lock_guard<std::mutex> l(lock);
+
+                    key_requested = false;
+                }
+
+                key_pressed.notify_all();
+            }
+        }
+    }
+
+    const std::string title; ///< The title of the window
+    const size_t fps;        ///< The number of refreshes per second
+
+    render_t render;     ///< The rendering functor
+    cv::Mat image;       ///< The image of the window, only used by the UI thread
+    std::thread thread;  ///< The UI thread
+
+    std::mutex lock;                     ///< The lock protecting the snapshots and the flags
+    std::condition_variable key_pressed; ///< Signals that the requested key has been pressed
+
+    snapshot_t snapshots[2];    ///< The double-buffered snapshot
+    size_t front       = 0;     ///< The index of the snapshot being rendered
+    bool dirty         = false; ///< Indicates if the back snapshot has been updated
+    bool running       = false; ///< Indicates if the UI thread is running
+    bool key_requested = false; ///< Indicates if a key press has been requested
+};
+
 /*!
  * \brief The base type for an OpenCV visualizer
  */
 template <typename RBM>
 struct base_ocv_rbm_visualizer {
+    using weights_t = std::decay_t<decltype(std::declval<RBM>().w)>; ///< The type of the weights
+
+    /*!
+     * \brief A snapshot of the weights of the RBM
+     */
+    struct snapshot_t {
+        std::string caption; ///< The caption of the view
+        weights_t w;         ///< The weights
+    };
+
+    using draw_t = std::function<void(const weights_t&, cv::Mat&)>; ///< The type of the drawing functor
+
     cpp::stop_watch<std::chrono::seconds> watch; ///< The timer for entire training
 
     const size_t width;  ///< The width of the view
     const size_t height; ///< The height of the view
 
-    cv::Mat buffer_image; ///< The OpenCV buffer image
-
     /*!
      * \brief Initialize the base_ocv_rbm_visualizer
+     * \param width The width of the view
+     * \param height The height of the view
+     * \param fps The number of refreshes of the view per second
+     * \param draw The functor drawing the weights into the view
      */
-    base_ocv_rbm_visualizer(size_t width, size_t height)
-            : width(width), height(height), buffer_image(cv::Size(width, height), CV_8UC1) {
+    base_ocv_rbm_visualizer(size_t width, size_t height, size_t fps, draw_t draw)
+            : width(width), height(height), draw(std::move(draw)), window("RBM Training", fps) {
         //Nothing to init
     }
 
@@ -176,9 +418,20 @@ struct base_ocv_rbm_visualizer {
             std::cout << "   sparsity_target(Local)=" << rbm.sparsity_target << std::endl;
         }
 
-        cv::namedWindow("RBM Training", cv::WINDOW_NORMAL);
+        open();
+    }
 
-        refresh();
+    /*!
+     * \brief Indicates the end of an epoch of pretraining.
+     * \param epoch The epoch that just finished training
+     * \param context The RBM's training context
+     * \param rbm The RBM being trained
+     */
+    void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
+               context.reconstruction_error, context.free_energy, context.sparsity);
+
+        snapshot(rbm, "epoch " + std::to_string(epoch));
     }
 
     /*!
@@ -189,7 +442,8 @@ struct base_ocv_rbm_visualizer {
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window..." << std::endl;
-        cv::waitKey(0);
+        window.wait_key();
+        window.close();
 
         cpp_unused(rbm);
     }
@@ -209,21 +463,57 @@ struct base_ocv_rbm_visualizer {
     }
 
     /*!
-     * \brief Refresh the view
+     * \brief Open the view
      */
-    void refresh() {
-        cv::imshow("RBM Training", buffer_image);
-        cv::waitKey(30);
+    void open() {
+        window.open([this](const snapshot_t& snapshot, cv::Mat& image) {
+            image.create(cv::Size(width, height), CV_8UC1);
+            image = cv::Scalar(255);
+
+            cv::putText(image, snapshot.caption, cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+
+            draw(snapshot.w, image);
+        });
+    }
+
+    /*!
+     * \brief Show the current weights of the given RBM in the view.
+     *
+     * Only the weights are copied on the calling thread, they are drawn
+     * by the UI thread.
+     *
+     * \param rbm The RBM to show
+     * \param caption The caption of the view
+     */
+    void snapshot(const RBM& rbm, const std::string& caption) {
+        window.update([&](snapshot_t& snapshot) {
+            snapshot.caption = caption;
+            snapshot.w       = rbm.w;
+
+            cpu_access(snapshot.w);
+        });
     }
+
+    /*!
+     * \brief Wait for a key press in the view
+     */
+    void wait_key() {
+        window.wait_key();
+    }
+
+private:
+    draw_t draw;                    ///< The functor drawing the weights
+    ocv_window<snapshot_t> window; ///< The view
 };
 
 //rbm_ocv_config is used instead of directly passing the parameters because
 //adding non-type template parameters would break dll::watcher
 
-template <size_t P = 20, bool S = true>
+template <size_t P = 20, bool S = true, size_t F = 25>
 struct rbm_ocv_config {
     static constexpr auto padding = P; ///< The padding
     static constexpr auto scale   = S; ///< The scaling
+    static constexpr auto fps     = F; ///< The number of refreshes per second
 };
 
 template <typename RBM, typename C = rbm_ocv_config<>, typename Enable = void>
@@ -246,15 +536,20 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
     static constexpr auto padding = C::padding; ///< The padding
 
     using base_type = base_ocv_rbm_visualizer<RBM>;
-    using base_type::buffer_image;
-    using base_type::refresh;
+    using weights_t = typename base_type::weights_t;
 
     opencv_rbm_visualizer()
             : base_type(
                   filter_shape.width * tile_shape.width + (tile_shape.height + 1) * 1 + 2 * padding,
-                  filter_shape.height * tile_shape.height + (tile_shape.height + 1) * 1 + 2 * padding) {}
+                  filter_shape.height * tile_shape.height + (tile_shape.height + 1) * 1 + 2 * padding,
+                  C::fps, [](const weights_t& w, cv::Mat& image) { draw_weights(w, image); }) {}
+
+    /*!
+     * \brief Draw the given weights into the given image
+     */
+    static void draw_weights(const weights_t& w, cv::Mat& image) {
+        const auto norm = detail::normalization(w.memory_start(), etl::size(w), scale);
 
-    void draw_weights(const RBM& rbm) {
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
                 auto real_h = hi * tile_shape.height + hj;
@@ -263,14 +558,6 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                     break;
                 }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
-
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
-
                 for (size_t i = 0; i < filter_shape.width; ++i) {
                     for (size_t j = 0; j < filter_shape.height; ++j) {
                         auto real_v = i * filter_shape.height + j;
@@ -279,40 +566,14 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                             break;
                         }
 
-                        auto value = rbm.w(real_v, real_h);
-
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
-                        }
-
-                        buffer_image.template at<uint8_t>(
+                        image.template at<uint8_t>(
                             padding + 1 + hi * (filter_shape.height + 1) + i,
-                            padding + 1 + hj * (filter_shape.width + 1) + j) = value * 255;
+                            padding + 1 + hj * (filter_shape.width + 1) + j) = norm(w(real_v, real_h));
                     }
                 }
             }
         }
     }
-
-    /*!
-     * \brief Indicates the end of an epoch of pretraining.
-     * \param epoch The epoch that just finished training
-     * \param context The RBM's training context
-     * \param rbm The RBM being trained
-     */
-    void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
-        printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
-               context.reconstruction_error, context.free_energy, context.sparsity);
-
-        buffer_image = cv::Scalar(255);
-
-        cv::putText(buffer_image, "epoch " + std::to_string(epoch), cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
-
-        draw_weights(rbm);
-
-        refresh();
-    }
 };
 
 template <typename RBM, typename C>
@@ -333,16 +594,22 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
     static constexpr auto padding = C::padding; ///< The padding
 
     using base_type = base_ocv_rbm_visualizer<RBM>;
-    using base_type::buffer_image;
-    using base_type::refresh;
+    using weights_t = typename base_type::weights_t;
 
     opencv_rbm_visualizer()
             : base_type(
                   filter_shape.width * tile_shape.width + (tile_shape.height + 1) * 1 + 2 * padding,
-                  filter_shape.height * tile_shape.height + (tile_shape.height + 1) * 1 + 2 * padding) {}
+                  filter_shape.height * tile_shape.height + (tile_shape.height + 1) * 1 + 2 * padding,
+                  C::fps, [](const weights_t& w, cv::Mat& image) { draw_weights(w, image); }) {}
+
+    /*!
+     * \brief Draw the filters of the first channel of the given weights
+     * into the given image
+     */
+    static void draw_weights(const weights_t& w, cv::Mat& image) {
+        static constexpr size_t filter_size = rbm_t::NW1 * rbm_t::NW2;
 
-    void draw_weights(const RBM& rbm) {
-        size_t channel = 0;
+        const size_t channel = 0;
 
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
@@ -352,50 +619,19 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
                     break;
                 }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
-
-                if (scale) {
-                    min = etl::min(rbm.w(channel)(real_k));
-                    max = etl::max(rbm.w(channel)(real_k));
-                }
+                // Each filter is normalized on its own
+                const auto norm = detail::normalization(w.memory_start() + (real_k * rbm_t::NC + channel) * filter_size, filter_size, scale);
 
                 for (size_t fi = 0; fi < filter_shape.width; ++fi) {
                     for (size_t fj = 0; fj < filter_shape.height; ++fj) {
-                        auto value = rbm.w(channel, real_k, fi, fj);
-
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
-                        }
-
-                        buffer_image.template at<uint8_t>(
+                        image.template at<uint8_t>(
                             padding + 1 + hi * (filter_shape.width + 1) + fi,
-                            padding + 1 + hj * (filter_shape.height + 1) + fj) = value * 255;
+                            padding + 1 + hj * (filter_shape.height + 1) + fj) = norm(w(real_k, channel, fi, fj));
                     }
                 }
             }
         }
     }
-
-    /*!
-     * \brief Indicates the end of an epoch of pretraining.
-     * \param epoch The epoch that just finished training
-     * \param context The RBM's training context
-     * \param rbm The RBM being trained
-     */
-    void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
-        printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
-               context.reconstruction_error, context.free_energy, context.sparsity);
-
-        buffer_image = cv::Scalar(255);
-
-        cv::putText(buffer_image, "epoch " + std::to_string(epoch), cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
-
-        draw_weights(rbm);
-
-        refresh();
-    }
 };
 
 template <typename DBN, typename C = rbm_ocv_config<>, typename Enable = void>
@@ -410,6 +646,8 @@ struct opencv_dbn_visualizer {
     static std::vector<cv::Mat> buffer_images; ///< The buffer images
     static size_t current_image;               ///< The current images
 
+    ocv_window<cv::Mat> window{"DBN Training", C::fps}; ///< The view, refreshed by its own thread
+
     opencv_dbn_visualizer() = default;
 
     //Pretraining phase
@@ -424,7 +662,7 @@ struct opencv_dbn_visualizer {
 
         std::cout << "DBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
 
-        cv::namedWindow("DBN Training", cv::WINDOW_NORMAL);
+        window.open([](const cv::Mat& snapshot, cv::Mat& image) { snapshot.copyTo(image); });
     }
 
     /*!
@@ -524,6 +762,10 @@ struct opencv_dbn_visualizer {
                     "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
                     cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
+        cpu_access(rbm.w);
+
+        const auto norm = detail::normalization(rbm.w.memory_start(), etl::size(rbm.w), scale);
+
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
                 auto real_h = hi * tile_shape.height + hj;
@@ -532,14 +774,6 @@ struct opencv_dbn_visualizer {
                     break;
                 }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
-
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
-
                 for (size_t i = 0; i < filter_shape.width; ++i) {
                     for (size_t j = 0; j < filter_shape.height; ++j) {
                         auto real_v = i * filter_shape.height + j;
@@ -548,16 +782,9 @@ struct opencv_dbn_visualizer {
                             break;
                         }
 
-                        auto value = rbm.w(real_v, real_h);
-
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
-                        }
-
                         buffer_image.template at<uint8_t>(
                             padding + 1 + hi * (filter_shape.width + 1) + i,
-                            padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
+                            padding + 1 + hj * (filter_shape.height + 1) + j) = norm(rbm.w(real_v, real_h));
                     }
                 }
             }
@@ -588,7 +815,7 @@ struct opencv_dbn_visualizer {
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        window.wait_key();
     }
 
     /*!
@@ -647,7 +874,7 @@ struct opencv_dbn_visualizer {
         std::cout << "Total training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window" << std::endl;
-        cv::waitKey(0);
+        window.wait_key();
     }
 
     //Utility functions
@@ -656,8 +883,7 @@ struct opencv_dbn_visualizer {
      * \brief Refresh the view
      */
     void refresh() {
-        cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        window.update([](cv::Mat& snapshot) { buffer_images[current_image].copyTo(snapshot); });
     }
 };
 
@@ -679,6 +905,8 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
     static std::vector<cv::Mat> buffer_images; ///< The buffer images
     static size_t current_image;               ///< The current images
 
+    ocv_window<cv::Mat> window{"DBN Training", C::fps}; ///< The view, refreshed by its own thread
+
     opencv_dbn_visualizer() = default;
 
     //Pretraining phase
@@ -692,7 +920,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
     void pretraining_begin(const DBN& dbn, size_t max_epochs) {
         std::cout << "DBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
 
-        cv::namedWindow("DBN Training", cv::WINDOW_NORMAL);
+        window.open([](const cv::Mat& snapshot, cv::Mat& image) { snapshot.copyTo(image); });
 
         cpp_unused(dbn);
     }
@@ -778,6 +1006,10 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
                     "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
                     cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
+        cpu_access(rbm.w);
+
+        const auto norm = detail::normalization(rbm.w.memory_start(), etl::size(rbm.w), scale);
+
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
                 auto real_h = hi * tile_shape.height + hj;
@@ -786,14 +1018,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
                     break;
                 }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
-
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
-
                 for (size_t i = 0; i < filter_shape.width; ++i) {
                     for (size_t j = 0; j < filter_shape.height; ++j) {
                         auto real_v = i * filter_shape.height + j;
@@ -802,16 +1026,9 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
                             break;
                         }
 
-                        auto value = rbm.w(real_v, real_h);
-
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
-                        }
-
                         buffer_image.template at<uint8_t>(
                             padding + 1 + hi * (filter_shape.width + 1) + i,
-                            padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
+                            padding + 1 + hj * (filter_shape.height + 1) + j) = norm(rbm.w(real_v, real_h));
                     }
                 }
             }
@@ -842,7 +1059,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        window.wait_key();
     }
 
     /*!
@@ -867,8 +1084,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
      * \brief Refresh the view
      */
     void refresh() {
-        cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        window.update([](cv::Mat& snapshot) { buffer_images[current_image].copyTo(snapshot); });
     }
 };
 
@@ -890,6 +1106,8 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     static std::vector<cv::Mat> buffer_images; ///< The buffer images
     static size_t current_image;               ///< The current images
 
+    ocv_window<cv::Mat> window{"CDBN Training", C::fps}; ///< The view, refreshed by its own thread
+
     opencv_dbn_visualizer() = default;
 
     //Pretraining phase
@@ -903,7 +1121,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     void pretraining_begin(const DBN& dbn, size_t max_epochs) {
         std::cout << "CDBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
 
-        cv::namedWindow("CDBN Training", cv::WINDOW_NORMAL);
+        window.open([](const cv::Mat& snapshot, cv::Mat& image) { snapshot.copyTo(image); });
 
         cpp_unused(dbn);
     }
@@ -992,7 +1210,11 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
                     "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
                     cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
-        size_t channel = 0;
+        static constexpr size_t filter_size = rbm_t::NW1 * rbm_t::NW2;
+
+        const size_t channel = 0;
+
+        cpu_access(rbm.w);
 
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
@@ -1002,26 +1224,14 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
                     break;
                 }
 
-                typename RBM::weight min;
-                typename RBM::weight max;
-
-                if (scale) {
-                    min = etl::min(rbm.w(channel)(real_k));
-                    max = etl::max(rbm.w(channel)(real_k));
-                }
+                // Each filter is normalized on its own
+                const auto norm = detail::normalization(rbm.w.memory_start() + (real_k * rbm_t::NC + channel) * filter_size, filter_size, scale);
 
                 for (size_t fi = 0; fi < filter_shape.width; ++fi) {
                     for (size_t fj = 0; fj < filter_shape.height; ++fj) {
-                        auto value = rbm.w(channel, real_k, fi, fj);
-
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
-                        }
-
                         buffer_image.template at<uint8_t>(
                             padding + 1 + hi * (filter_shape.width + 1) + fi,
-                            padding + 1 + hj * (filter_shape.height + 1) + fj) = value * 255;
+                            padding + 1 + hj * (filter_shape.height + 1) + fj) = norm(rbm.w(real_k, channel, fi, fj));
                     }
                 }
             }
@@ -1052,7 +1262,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        window.wait_key();
     }
 
     /*!
@@ -1065,8 +1275,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     //Utility functions
 
     void refresh() {
-        cv::imshow("CDBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        window.update([](cv::Mat& snapshot) { buffer_images[current_image].copyTo(snapshot); });
     }
 };
 
@@ -1078,12 +1287,10 @@ size_t opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
 
 template <typename RBM>
 void visualize_rbm(const RBM& rbm) {
-    cv::namedWindow("RBM Training", cv::WINDOW_NORMAL);
-
     opencv_rbm_visualizer<RBM> visualizer;
-    visualizer.draw_weights(rbm);
-    visualizer.refresh();
-    cv::waitKey(0);
+    visualizer.open();
+    visualizer.snapshot(rbm, "");
+    visualizer.wait_key();
 }
 
 #endif
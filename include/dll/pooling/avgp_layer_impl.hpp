@@ -9,6 +9,9 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/gpu.hpp"
+#include "dll/util/pooling.hpp"
+
 namespace dll {
 
 /*!
@@ -46,8 +49,15 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
         cpp_unused(pre);
 
         char buffer[1024];
-        snprintf(buffer, 1024, "AVGP(2d): %lux%lux%lu -> (%lux%lu) -> %lux%lux%lu",
-                 base::I1, base::I2, base::I3, base::C1, base::C2, base::O1, base::O2, base::O3);
+
+        if (base::strided) {
+            snprintf(buffer, 1024, "AVGP(2d): %lux%lux%lu -> (%lux%lu/%lux%lu) -> %lux%lux%lu",
+                     base::I1, base::I2, base::I3, base::C1, base::C2, base::S1, base::S2, base::O1, base::O2, base::O3);
+        } else {
+            snprintf(buffer, 1024, "AVGP(2d): %lux%lux%lu -> (%lux%lu) -> %lux%lux%lu",
+                     base::I1, base::I2, base::I3, base::C1, base::C2, base::O1, base::O2, base::O3);
+        }
+
         return {buffer};
     }
 
@@ -68,7 +78,17 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = etl::ml::avg_pool_forward<base::C1, base::C2>(input);
+        static_assert(!base::strided || etl::all_dma<Input, Output>, "The strided pooling needs direct memory");
+
+        if constexpr (etl::all_dma<Input, Output>) {
+            cpu_access(input);
+
+            avg_pool_2d_forward(output.memory_start(), input.memory_start(), etl::dim<0>(input) * base::I1, base::I2, base::I3, base::C1, base::C2, base::S1, base::S2);
+
+            cpu_modified(output);
+        } else {
+            output = etl::ml::avg_pool_forward<base::C1, base::C2>(input);
+        }
     }
 
     /*!
@@ -79,7 +99,7 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
      */
     template<typename DLayer>
     static void dyn_init(DLayer& dyn){
-        dyn.init_layer(base::I1, base::I2, base::I3, base::C1, base::C2);
+        dyn.init_layer(base::I1, base::I2, base::I3, base::C1, base::C2, base::S1, base::S2);
     }
 
     /*!
@@ -103,9 +123,18 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
     void backward_batch(H&& output, C& context) const {
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-        static constexpr size_t C3 = base::C3; ///< The pooling second dimension
 
-        output = etl::ml::avg_pool_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        static_assert(!base::strided || etl::all_dma<std::decay_t<H>, decltype(context.errors)>, "The strided pooling needs direct memory");
+
+        if constexpr (etl::all_dma<std::decay_t<H>, decltype(context.errors)>) {
+            cpu_access(context.errors);
+
+            avg_pool_2d_backward(output.memory_start(), context.errors.memory_start(), etl::dim<0>(context.errors) * base::I1, base::I2, base::I3, C1, C2, base::S1, base::S2);
+
+            cpu_modified(output);
+        } else {
+            output = etl::ml::avg_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        }
     }
 
     /*!
@@ -9,6 +9,9 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/gpu.hpp"
+#include "dll/util/pooling.hpp"
+
 namespace dll {
 
 /*!
@@ -46,8 +49,15 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
         cpp_unused(pre);
 
         char buffer[1024];
-        snprintf(buffer, 1024, "AVGP(2d): %lux%lux%lu -> (%lux%lu) -> %lux%lux%lu",
-                 base::i1, base::i2, base::i3, base::c1, base::c2, base::o1, base::o2, base::o3);
+
+        if (base::strided()) {
+            snprintf(buffer, 1024, "AVGP(2d): %lux%lux%lu -> (%lux%lu/%lux%lu) -> %lux%lux%lu",
+                     base::i1, base::i2, base::i3, base::c1, base::c2, base::s1, base::s2, base::o1, base::o2, base::o3);
+        } else {
+            snprintf(buffer, 1024, "AVGP(2d): %lux%lux%lu -> (%lux%lu) -> %lux%lux%lu",
+                     base::i1, base::i2, base::i3, base::c1, base::c2, base::o1, base::o2, base::o3);
+        }
+
         return {buffer};
     }
 
@@ -68,7 +78,17 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        output = etl::ml::avg_pool_forward(input, base::c1, base::c2);
+        if constexpr (etl::all_dma<Input, Output>) {
+            cpu_access(input);
+
+            avg_pool_2d_forward(output.memory_start(), input.memory_start(), etl::dim<0>(input) * base::i1, base::i2, base::i3, base::c1, base::c2, base::s1, base::s2);
+
+            cpu_modified(output);
+        } else {
+            cpp_assert(!base::strided(), "The strided pooling needs direct memory");
+
+            output = etl::ml::avg_pool_forward(input, base::c1, base::c2);
+        }
     }
 
     /*!
@@ -104,7 +124,17 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
         size_t c1 = base::c1;
         size_t c2 = base::c2;
 
-        output = etl::ml::avg_pool_backward(context.input, context.output, context.errors, c1, c2);
+        if constexpr (etl::all_dma<std::decay_t<H>, decltype(context.errors)>) {
+            cpu_access(context.errors);
+
+            avg_pool_2d_backward(output.memory_start(), context.errors.memory_start(), etl::dim<0>(context.errors) * base::i1, base::i2, base::i3, c1, c2, base::s1, base::s2);
+
+            cpu_modified(output);
+        } else {
+            cpp_assert(!base::strided(), "The strided pooling needs direct memory");
+
+            output = etl::ml::avg_pool_backward(context.input, context.output, context.errors, c1, c2);
+        }
     }
 
     /*!
@@ -153,8 +183,8 @@ struct sgd_context<DBN, dyn_avgp_2d_layer_impl<Desc>, L> {
 
     sgd_context(const layer_t& layer)
             : input(batch_size, layer.i1, layer.i2, layer.i3),
-              output(batch_size, layer.i1, layer.i2 / layer.c1, layer.i3 / layer.c2),
-              errors(batch_size, layer.i1, layer.i2 / layer.c1, layer.i3 / layer.c2) {}
+              output(batch_size, layer.o1, layer.o2, layer.o3),
+              errors(batch_size, layer.o1, layer.o2, layer.o3) {}
 };
 
 /*!
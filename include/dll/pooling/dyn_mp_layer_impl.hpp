@@ -7,8 +7,13 @@
 
 #pragma once
 
+#include <vector>
+
 #include "pooling_layer.hpp"
 
+#include "dll/util/gpu.hpp"
+#include "dll/util/pooling.hpp"
+
 namespace dll {
 
 /*!
@@ -28,6 +33,8 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    mutable std::vector<uint8_t> argmax; ///< The offsets of the maximums of the last training batch
+
     dyn_mp_2d_layer_impl() = default;
 
     /*!
@@ -46,8 +53,15 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
         cpp_unused(pre);
 
         char buffer[1024];
-        snprintf(buffer, 1024, "MP(2d): %lux%lux%lu -> (%lux%lu) -> %lux%lux%lu",
-                 base::i1, base::i2, base::i3, base::c1, base::c2, base::o1, base::o2, base::o3);
+
+        if (base::strided()) {
+            snprintf(buffer, 1024, "MP(2d): %lux%lux%lu -> (%lux%lu/%lux%lu) -> %lux%lux%lu",
+                     base::i1, base::i2, base::i3, base::c1, base::c2, base::s1, base::s2, base::o1, base::o2, base::o3);
+        } else {
+            snprintf(buffer, 1024, "MP(2d): %lux%lux%lu -> (%lux%lu) -> %lux%lux%lu",
+                     base::i1, base::i2, base::i3, base::c1, base::c2, base::o1, base::o2, base::o3);
+        }
+
         return {buffer};
     }
 
@@ -68,9 +82,50 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
+        if constexpr (etl::all_dma<Input, Output>) {
+            if (pool_kernel_supported(base::c1, base::c2)) {
+                cpu_access(input);
+
+                max_pool_2d_forward(output.memory_start(), nullptr, input.memory_start(), etl::dim<0>(input) * base::i1, base::i2, base::i3, base::c1, base::c2, base::s1, base::s2);
+
+                cpu_modified(output);
+
+                return;
+            }
+        }
+
+        cpp_assert(!base::strided(), "The strided pooling needs direct memory and windows of at most 256 values");
+
         output = etl::ml::max_pool_forward(input, base::c1, base::c2);
     }
 
+    using base::train_forward_batch;
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample,
+     * recording the positions of the maximums for the backward pass
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output&& output, const Input& input) const {
+        if constexpr (etl::all_dma<Input, std::decay_t<Output>>) {
+            if (pool_kernel_supported(base::c1, base::c2)) {
+                argmax.resize(etl::size(output));
+
+                cpu_access(input);
+
+                max_pool_2d_forward(output.memory_start(), argmax.data(), input.memory_start(), etl::dim<0>(input) * base::i1, base::i2, base::i3, base::c1, base::c2, base::s1, base::s2);
+
+                cpu_modified(output);
+
+                return;
+            }
+        }
+
+        forward_batch(output, input);
+    }
+
     /*!
      * \brief Initialize the dynamic version of the layer from the
      * fast version of the layer
@@ -104,6 +159,26 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
         size_t c1 = base::c1;
         size_t c2 = base::c2;
 
+        // Scatter the errors to the maximums recorded by the forward pass
+        if constexpr (etl::all_dma<std::decay_t<H>, decltype(context.errors)>) {
+            // The strided windows have no ETL implementation, the maximums are found again
+            if (base::strided() && argmax.size() != etl::size(context.errors)) {
+                train_forward_batch(context.output, context.input);
+            }
+
+            if (pool_kernel_supported(c1, c2) && argmax.size() == etl::size(context.errors)) {
+                cpu_access(context.errors);
+
+                max_pool_2d_backward(output.memory_start(), argmax.data(), context.errors.memory_start(), etl::dim<0>(context.errors) * base::i1, base::i2, base::i3, c1, c2, base::s1, base::s2);
+
+                cpu_modified(output);
+
+                return;
+            }
+        }
+
+        cpp_assert(!base::strided(), "The strided pooling needs direct memory and windows of at most 256 values");
+
         output = etl::ml::max_pool_backward(context.input, context.output, context.errors, c1, c2);
     }
 
@@ -153,8 +228,8 @@ struct sgd_context<DBN, dyn_mp_2d_layer_impl<Desc>, L> {
 
     sgd_context(const layer_t& layer)
             : input(batch_size, layer.i1, layer.i2, layer.i3),
-              output(batch_size, layer.i1, layer.i2 / layer.c1, layer.i3 / layer.c2),
-              errors(batch_size, layer.i1, layer.i2 / layer.c1, layer.i3 / layer.c2) {}
+              output(batch_size, layer.o1, layer.o2, layer.o3),
+              errors(batch_size, layer.o1, layer.o2, layer.o3) {}
 };
 
 /*!
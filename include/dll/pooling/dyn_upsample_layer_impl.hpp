@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include "dll/util/gpu.hpp"
+#include "dll/util/upsample.hpp"
+
 #include "unpooling_layer.hpp"
 
 namespace dll {
@@ -68,6 +71,25 @@ struct dyn_upsample_3d_layer_impl final : dyn_unpooling_3d_layer<dyn_upsample_3d
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
+        if constexpr (etl::all_dma<Input, Output>) {
+            // Spatial upsampling by 2 or 4, with the direct kernels
+            if (upsample_kernel_supported(base::c1, base::c2, base::c3)) {
+                const size_t planes = etl::dim<0>(input) * base::i1;
+
+                cpu_access(input);
+
+                if (base::c2 == 2) {
+                    upsample_2d_forward<2, 2>(output.memory_start(), input.memory_start(), planes, base::i2, base::i3);
+                } else {
+                    upsample_2d_forward<4, 4>(output.memory_start(), input.memory_start(), planes, base::i2, base::i3);
+                }
+
+                cpu_modified(output);
+
+                return;
+            }
+        }
+
         output = etl::upsample_3d(input, base::c1, base::c2, base::c3);
     }
 
@@ -95,7 +117,11 @@ struct dyn_upsample_3d_layer_impl final : dyn_unpooling_3d_layer<dyn_upsample_3d
     }
 
     /*!
-     * \brief Backpropagate the errors to the previous layers
+     * \brief Backpropagate the errors to the previous layers.
+     *
+     * Each input value is replicated in a block of the output, its errors
+     * are the sum of the errors of the block.
+     *
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
@@ -105,12 +131,32 @@ struct dyn_upsample_3d_layer_impl final : dyn_unpooling_3d_layer<dyn_upsample_3d
         const size_t c2 = base::c2;
         const size_t c3 = base::c3;
 
+        if constexpr (etl::all_dma<H, decltype(context.errors)>) {
+            if (upsample_kernel_supported(c1, c2, c3)) {
+                const size_t planes = etl::dim<0>(context.errors) * base::i1;
+
+                cpu_access(context.errors);
+
+                if (c2 == 2) {
+                    upsample_2d_backward<2, 2>(output.memory_start(), context.errors.memory_start(), planes, base::i2, base::i3);
+                } else {
+                    upsample_2d_backward<4, 4>(output.memory_start(), context.errors.memory_start(), planes, base::i2, base::i3);
+                }
+
+                cpu_modified(output);
+
+                return;
+            }
+        }
+
+        const weight block = c1 * c2 * c3;
+
         if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::max_pool_3d(context.errors, c1, c2, c3);
+            output = block * etl::avg_pool_3d(context.errors, c1, c2, c3);
         } else {
             const size_t B = etl::dim<0>(output);
 
-            etl::reshape(output, B, base::i1, base::i2, base::i3) = etl::max_pool_3d(context.errors, c1, c2, c3);
+            etl::reshape(output, B, base::i1, base::i2, base::i3) = block * etl::avg_pool_3d(context.errors, c1, c2, c3);
         }
     }
 
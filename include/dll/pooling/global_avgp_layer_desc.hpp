@@ -0,0 +1,50 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+namespace dll {
+
+/*!
+ * \brief Description of a Global Average Pooling layer.
+ */
+template <size_t T_I1, size_t T_I2, size_t T_I3, typename... Parameters>
+struct global_avgp_layer_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr size_t I1 = T_I1; ///< The number of channels of the input
+    static constexpr size_t I2 = T_I2; ///< The second dimension of the input
+    static constexpr size_t I3 = T_I3; ///< The third dimension of the input
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The layer type */
+    using layer_t = global_avgp_layer_impl<global_avgp_layer_desc<T_I1, T_I2, T_I3, Parameters...>>;
+
+    /*! The dynamic layer type */
+    using dyn_layer_t = dyn_global_avgp_layer_impl<dyn_global_avgp_layer_desc<Parameters...>>;
+
+    static_assert(I1 > 0, "There must be at least one channel");
+    static_assert(I2 > 0 && I3 > 0, "The planes cannot be empty");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        "Invalid parameters type for global_avgp_layer_desc");
+};
+
+/*!
+ * \brief Description of a Global Average Pooling layer.
+ */
+template <size_t T_I1, size_t T_I2, size_t T_I3, typename... Parameters>
+using global_avgp_layer = typename global_avgp_layer_desc<T_I1, T_I2, T_I3, Parameters...>::layer_t;
+
+} //end of dll namespace
@@ -0,0 +1,283 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/layer.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/base_traits.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/pooling.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Global average pooling layer.
+ *
+ * Each channel of the input is reduced to its mean, the output is a
+ * vector with one value per channel, which can be given directly to a
+ * dense layer.
+ */
+template <typename Desc>
+struct global_avgp_layer_impl final : layer<global_avgp_layer_impl<Desc>> {
+    using desc        = Desc;                            ///< The layer descriptor
+    using weight      = typename desc::weight;           ///< The layer weight type
+    using this_type   = global_avgp_layer_impl<Desc>;    ///< The type of this layer
+    using base_type   = layer<this_type>;                ///< The layer base type
+    using layer_t     = this_type;                       ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;      ///< The dynamic version of this layer
+
+    static constexpr size_t I1 = desc::I1; ///< The first dimension of the input (channels)
+    static constexpr size_t I2 = desc::I2; ///< The second dimension of the input
+    static constexpr size_t I3 = desc::I3; ///< The third dimension of the input
+    static constexpr size_t O1 = I1;       ///< The dimension of the output
+
+    static constexpr bool global_pooling = true; ///< Indicates that the layer reduces its input to one value per channel
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, I1, I2, I3>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, O1>;         ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                 ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                ///< The type of the output
+
+    /*!
+     * \brief Indicates if the given dense layer can be fused with this
+     * layer for inference.
+     *
+     * The pooled output is small enough to stay in cache, it is given
+     * directly to the dense layer without being stored in the buffers of
+     * the network.
+     */
+    template <typename Dense, typename Enable = void>
+    struct fuses_with : std::false_type {};
+
+    template <typename Dense>
+    struct fuses_with<Dense, std::enable_if_t<decay_layer_traits<Dense>::is_standard_dense_layer() && !decay_layer_traits<Dense>::is_dynamic()>>
+            : cpp::bool_constant<Dense::num_visible == O1> {};
+
+    global_avgp_layer_impl() = default;
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return I1 * I2 * I3;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return O1;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return 0;
+    }
+
+    /*!
+     * \brief Get a string representation of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        return "GAVGP";
+    }
+
+    /*!
+     * \brief Get a string representation of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[1024];
+        snprintf(buffer, 1024, "GAVGP: %lux%lux%lu -> %lu", I1, I2, I3, O1);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {O1};
+    }
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    static void forward_batch(Output& output, const Input& input) {
+        static_assert(etl::all_dma<Input, Output>, "The global pooling needs direct memory");
+
+        cpu_access(input);
+
+        global_avg_pool_forward(output.memory_start(), input.memory_start(), etl::dim<0>(input) * I1, I2 * I3);
+
+        cpu_modified(output);
+    }
+
+    /*!
+     * \brief Compute the output of the dense layer following this layer
+     * directly from the pooled input.
+     *
+     * \param dense The dense layer following this layer
+     * \param v A batch of input
+     * \return The batch of output of the dense layer
+     */
+    template <typename Dense, typename V>
+    auto test_forward_batch_fused(const Dense& dense, const V& v) const {
+        static_assert(fuses_with<Dense>::value, "The dense layer cannot be fused with this layer");
+
+        const size_t B = etl::dim<0>(v);
+
+        etl::dyn_matrix<weight, 2> pooled(B, O1);
+        etl::dyn_matrix<weight, 2> output(B, Dense::num_hidden);
+
+        forward_batch(pooled, v);
+        dense.test_forward_batch(output, pooled);
+
+        return output;
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    static output_one_t prepare_one_output() {
+        return output_one_t();
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DLayer>
+    static void dyn_init(DLayer& dyn){
+        dyn.init_layer(I1, I2, I3);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        cpp_unused(context);
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        static_assert(etl::all_dma<std::decay_t<H>, decltype(context.errors)>, "The global pooling needs direct memory");
+
+        cpu_access(context.errors);
+
+        global_avg_pool_backward(output.memory_start(), context.errors.memory_start(), etl::dim<0>(context.errors) * I1, I2 * I3);
+
+        cpu_modified(output);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        cpp_unused(context);
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t global_avgp_layer_impl<Desc>::I1;
+
+template <typename Desc>
+const size_t global_avgp_layer_impl<Desc>::I2;
+
+template <typename Desc>
+const size_t global_avgp_layer_impl<Desc>::I3;
+
+template <typename Desc>
+const size_t global_avgp_layer_impl<Desc>::O1;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<global_avgp_layer_impl<Desc>> {
+    static constexpr bool is_neural     = false; ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = true;  ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of sgd_context for global_avgp_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, global_avgp_layer_impl<Desc>, L> {
+    using layer_t = global_avgp_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t I1 = layer_t::I1; ///< The input first dimension
+    static constexpr size_t I2 = layer_t::I2; ///< The input second dimension
+    static constexpr size_t I3 = layer_t::I3; ///< The input third dimension
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, I1, I2, I3> input;
+    etl::fast_matrix<weight, batch_size, I1> output;
+    etl::fast_matrix<weight, batch_size, I1> errors;
+
+    sgd_context(const global_avgp_layer_impl<Desc>& /*layer*/){}
+};
+
+} //end of dll namespace
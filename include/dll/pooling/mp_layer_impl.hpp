@@ -7,8 +7,12 @@
 
 #pragma once
 
+#include <vector>
+
 #include "pooling_layer.hpp"
 
+#include "dll/util/gpu.hpp"
+#include "dll/util/pooling.hpp"
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -30,6 +34,16 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    static constexpr bool fusable_pool = !base::strided; ///< Indicates if the pooling can be fused into a preceding convolution
+    static constexpr size_t SC1        = base::C1;       ///< The first spatial pooling ratio
+    static constexpr size_t SC2        = base::C2;       ///< The second spatial pooling ratio
+
+    static constexpr bool direct_kernel = base::C1 * base::C2 <= 256; ///< Indicates if the direct kernels can be used
+
+    static_assert(direct_kernel || !base::strided, "The strided max pooling windows are limited to 256 values");
+
+    mutable std::vector<uint8_t> argmax; ///< The offsets of the maximums of the last training batch
+
     mp_2d_layer_impl() = default;
 
     /*!
@@ -48,8 +62,15 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
         cpp_unused(pre);
 
         char buffer[1024];
-        snprintf(buffer, 1024, "MP(2D): %lux%lux%lu -> (%lux%lu) -> %lux%lux%lu",
-                 base::I1, base::I2, base::I3, base::C1, base::C2, base::O1, base::O2, base::O3);
+
+        if (base::strided) {
+            snprintf(buffer, 1024, "MP(2D): %lux%lux%lu -> (%lux%lu/%lux%lu) -> %lux%lux%lu",
+                     base::I1, base::I2, base::I3, base::C1, base::C2, base::S1, base::S2, base::O1, base::O2, base::O3);
+        } else {
+            snprintf(buffer, 1024, "MP(2D): %lux%lux%lu -> (%lux%lu) -> %lux%lux%lu",
+                     base::I1, base::I2, base::I3, base::C1, base::C2, base::O1, base::O2, base::O3);
+        }
+
         return {buffer};
     }
 
@@ -72,7 +93,42 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     static void forward_batch(Output& output, const Input& input) {
         dll::auto_timer timer("mp:forward_batch");
 
-        output = etl::ml::max_pool_forward<base::C1, base::C2>(input);
+        static_assert(!base::strided || etl::all_dma<Input, Output>, "The strided pooling needs direct memory");
+
+        if constexpr (etl::all_dma<Input, Output> && direct_kernel) {
+            cpu_access(input);
+
+            max_pool_2d_forward(output.memory_start(), nullptr, input.memory_start(), etl::dim<0>(input) * base::I1, base::I2, base::I3, base::C1, base::C2, base::S1, base::S2);
+
+            cpu_modified(output);
+        } else {
+            output = etl::ml::max_pool_forward<base::C1, base::C2>(input);
+        }
+    }
+
+    using base::train_forward_batch;
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample,
+     * recording the positions of the maximums for the backward pass
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output&& output, const Input& input) const {
+        if constexpr (etl::all_dma<Input, std::decay_t<Output>> && direct_kernel) {
+            dll::auto_timer timer("mp:train:forward_batch");
+
+            argmax.resize(etl::size(output));
+
+            cpu_access(input);
+
+            max_pool_2d_forward(output.memory_start(), argmax.data(), input.memory_start(), etl::dim<0>(input) * base::I1, base::I2, base::I3, base::C1, base::C2, base::S1, base::S2);
+
+            cpu_modified(output);
+        } else {
+            forward_batch(output, input);
+        }
     }
 
     /*!
@@ -83,7 +139,7 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
      */
     template<typename DLayer>
     static void dyn_init(DLayer& dyn){
-        dyn.init_layer(base::I1, base::I2, base::I3, base::C1, base::C2);
+        dyn.init_layer(base::I1, base::I2, base::I3, base::C1, base::C2, base::S1, base::S2);
     }
 
     /*!
@@ -110,7 +166,29 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
 
-        output = etl::ml::max_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        static_assert(!base::strided || etl::all_dma<std::decay_t<H>, decltype(context.errors)>, "The strided pooling needs direct memory");
+
+        // Scatter the errors to the maximums recorded by the forward pass
+        if constexpr (etl::all_dma<std::decay_t<H>, decltype(context.errors)> && direct_kernel) {
+            // The strided windows have no ETL implementation, the maximums are found again
+            if (base::strided && argmax.size() != etl::size(context.errors)) {
+                train_forward_batch(context.output, context.input);
+            }
+
+            if (argmax.size() == etl::size(context.errors)) {
+                cpu_access(context.errors);
+
+                max_pool_2d_backward(output.memory_start(), argmax.data(), context.errors.memory_start(), etl::dim<0>(context.errors) * base::I1, base::I2, base::I3, C1, C2, base::S1, base::S2);
+
+                cpu_modified(output);
+
+                return;
+            }
+        }
+
+        if constexpr (!base::strided) {
+            output = etl::ml::max_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        }
     }
 
     /*!
@@ -185,6 +263,10 @@ struct mp_3d_layer_impl final : pooling_3d_layer<mp_3d_layer_impl<Desc>, Desc> {
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    static constexpr bool fusable_pool = base::C1 == 1; ///< Indicates if the pooling can be fused into a preceding convolution
+    static constexpr size_t SC1        = base::C2;      ///< The first spatial pooling ratio
+    static constexpr size_t SC2        = base::C3;      ///< The second spatial pooling ratio
+
     mp_3d_layer_impl() = default;
 
     /*!
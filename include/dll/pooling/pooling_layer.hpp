@@ -26,12 +26,15 @@ struct pooling_2d_layer : layer<Parent> {
     static constexpr size_t I3 = desc::I3; ///< The third dimension of the input
     static constexpr size_t C1 = desc::C1; ///< The first dimension pooling ratio
     static constexpr size_t C2 = desc::C2; ///< The second dimension pooling ratio
+    static constexpr size_t S1 = desc::S1; ///< The first dimension stride
+    static constexpr size_t S2 = desc::S2; ///< The second dimension stride
 
-    static constexpr size_t O1 = I1;      ///< The first dimension of the output
-    static constexpr size_t O2 = I2 / C1; ///< The second dimension of the output
-    static constexpr size_t O3 = I3 / C2; ///< The third dimension of the output
+    static constexpr size_t O1 = I1;                 ///< The first dimension of the output
+    static constexpr size_t O2 = (I2 - C1) / S1 + 1; ///< The second dimension of the output
+    static constexpr size_t O3 = (I3 - C2) / S2 + 1; ///< The third dimension of the output
 
-    static constexpr bool is_nop = C1 * C2 == 1; ///< Indicate if the operation has no effect
+    static constexpr bool is_nop  = C1 * C2 == 1 && S1 * S2 == 1; ///< Indicate if the operation has no effect
+    static constexpr bool strided = S1 != C1 || S2 != C2;         ///< Indicate if the windows are strided (overlapping or sparse)
 
     using input_one_t  = etl::fast_dyn_matrix<weight, I1, I2, I3>; ///< The type of one input
     using output_one_t = etl::fast_dyn_matrix<weight, O1, O2, O3>; ///< The type of one output
@@ -116,6 +119,8 @@ struct dyn_pooling_2d_layer : layer<Parent> {
     size_t i3; ///< The third dimension of the input
     size_t c1; ///< The first dimension pooling ratio
     size_t c2; ///< The second dimension pooling ratio
+    size_t s1; ///< The first dimension stride
+    size_t s2; ///< The second dimension stride
 
     size_t o1; ///< The first dimension of the output
     size_t o2; ///< The second dimension of the output
@@ -125,16 +130,41 @@ struct dyn_pooling_2d_layer : layer<Parent> {
 
     /*!
      * \brief Initialize the dynamic layer
+     *
+     * A stride of 0 is the pooling ratio, i.e. non-overlapping windows.
      */
-    void init_layer(size_t i1, size_t i2, size_t i3, size_t c1, size_t c2){
+    void init_layer(size_t i1, size_t i2, size_t i3, size_t c1, size_t c2, size_t s1 = 0, size_t s2 = 0){
         this->i1 = i1;
         this->i2 = i2;
         this->i3 = i3;
         this->c1 = c1;
         this->c2 = c2;
+        this->s1 = s1 ? s1 : c1;
+        this->s2 = s2 ? s2 : c2;
         this->o1 = i1;
-        this->o2 = i2 / c1;
-        this->o3 = i3 / c2;
+        this->o2 = (i2 - c1) / this->s1 + 1;
+        this->o3 = (i3 - c2) / this->s2 + 1;
+    }
+
+    /*!
+     * \brief Indicates if the windows are strided (overlapping or sparse)
+     */
+    bool strided() const noexcept {
+        return s1 != c1 || s2 != c2;
+    }
+
+    /*!
+     * \brief Change the spatial dimensions of the input of the layer
+     * \param input_shape The new shape of the input [C, H, W]
+     * \return The new shape of the output
+     */
+    std::vector<size_t> resize_input(const std::vector<size_t>& input_shape) {
+        cpp_assert(input_shape.size() == 3 && input_shape[0] == i1, "Only the spatial dimensions of the input can change");
+        cpp_assert(input_shape[1] >= c1 && input_shape[2] >= c2, "The input cannot be smaller than the pooling windows");
+
+        init_layer(input_shape[0], input_shape[1], input_shape[2], c1, c2, s1, s2);
+
+        return {o1, o2, o3};
     }
 
     /*!
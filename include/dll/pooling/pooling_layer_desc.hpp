@@ -20,17 +20,21 @@ struct pooling_2d_layer_desc {
     static constexpr size_t C1 = T_C1; ///< The pooling first dimension
     static constexpr size_t C2 = T_C2; ///< The pooling second dimension
 
+    static constexpr size_t S1 = detail::get_value_1<pool_stride<0, 0>, Parameters...>::value ? detail::get_value_1<pool_stride<0, 0>, Parameters...>::value : C1; ///< The stride of the first dimension
+    static constexpr size_t S2 = detail::get_value_2<pool_stride<0, 0>, Parameters...>::value ? detail::get_value_2<pool_stride<0, 0>, Parameters...>::value : C2; ///< The stride of the second dimension
+
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
     static_assert(C1 > 0, "Cannot shrink a layer by less than 1");
     static_assert(C2 > 0, "Cannot shrink a layer by less than 1");
-    static_assert(I2 % C1 == 0, "Input dimension is not divisible by C");
-    static_assert(I3 % C2 == 0, "Input dimension is not divisible by C");
+    static_assert(I2 >= C1 && I3 >= C2, "The pooling windows must fit in the input");
+    static_assert(S1 != C1 || I2 % C1 == 0, "Input dimension is not divisible by C");
+    static_assert(S2 != C2 || I3 % C2 == 0, "Input dimension is not divisible by C");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, pool_stride_id>, Parameters...>,
         "Invalid parameters type for pooling_layer");
 };
 
@@ -44,7 +48,7 @@ struct dyn_pooling_2d_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, pool_stride_id>, Parameters...>,
         "Invalid parameters type for pooling_layer");
 };
 
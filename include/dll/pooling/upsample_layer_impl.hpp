@@ -8,6 +8,8 @@
 #pragma once
 
 #include "dll/base_traits.hpp"
+#include "dll/util/gpu.hpp"
+#include "dll/util/upsample.hpp"
 #include "unpooling_layer.hpp"
 
 namespace dll {
@@ -70,7 +72,14 @@ struct upsample_3d_layer_impl final : unpooling_3d_layer<upsample_3d_layer_impl<
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = etl::upsample_3d<base::C1, base::C2, base::C3>(input);
+        if constexpr (base::C1 == 1 && etl::all_dma<Input, Output>) {
+            // Spatial upsampling, with the direct kernel
+            cpu_access(input);
+            upsample_2d_forward<base::C2, base::C3>(output.memory_start(), input.memory_start(), etl::dim<0>(input) * base::I1, base::I2, base::I3);
+            cpu_modified(output);
+        } else {
+            output = etl::upsample_3d<base::C1, base::C2, base::C3>(input);
+        }
     }
 
     /*!
@@ -97,7 +106,11 @@ struct upsample_3d_layer_impl final : unpooling_3d_layer<upsample_3d_layer_impl<
     }
 
     /*!
-     * \brief Backpropagate the errors to the previous layers
+     * \brief Backpropagate the errors to the previous layers.
+     *
+     * Each input value is replicated in a block of the output, its errors
+     * are the sum of the errors of the block.
+     *
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
@@ -107,12 +120,18 @@ struct upsample_3d_layer_impl final : unpooling_3d_layer<upsample_3d_layer_impl<
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
         static constexpr size_t C3 = base::C3; ///< The pooling third dimension
 
-        if constexpr (etl::decay_traits<H>::dimensions() == 4) {
-            output = etl::max_pool_3d<C1, C2, C3>(context.errors);
+        constexpr weight block = C1 * C2 * C3;
+
+        if constexpr (C1 == 1 && etl::all_dma<H, decltype(context.errors)>) {
+            cpu_access(context.errors);
+            upsample_2d_backward<C2, C3>(output.memory_start(), context.errors.memory_start(), etl::dim<0>(context.errors) * base::I1, base::I2, base::I3);
+            cpu_modified(output);
+        } else if constexpr (etl::decay_traits<H>::dimensions() == 4) {
+            output = block * etl::avg_pool_3d<C1, C2, C3>(context.errors);
         } else {
             constexpr auto B = etl::decay_traits<H>::template dim<0>();
 
-            etl::reshape<B, base::I1, base::I2, base::I3>(output) = etl::max_pool_3d<C1, C2, C3>(context.errors);
+            etl::reshape<B, base::I1, base::I2, base::I3>(output) = block * etl::avg_pool_3d<C1, C2, C3>(context.errors);
         }
     }
 
@@ -16,6 +16,12 @@
 #include <vector>
 #include <iostream>
 #include <iomanip>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+
+#include <sys/stat.h>
 
 #include "dll/rbm/rbm.hpp"
 #include "dll/rbm/conv_rbm.hpp"
@@ -23,6 +29,8 @@
 #include "dll/neural/conv_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/text_reader.hpp"
+#include "dll/generators/mmap_data_generator.hpp"
+#include "dll/generators/synthetic_data_generator.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -32,11 +40,17 @@ namespace dll {
 namespace processor {
 
 struct options {
-    bool quiet  = false;
-    bool mkl    = false;
-    bool cublas = false;
-    bool cufft  = false;
-    bool cache  = false;
+    bool quiet   = false;
+    bool mkl     = false;
+    bool cublas  = false;
+    bool cufft   = false;
+    bool gpu     = false;
+    bool cache   = false;
+    bool pch     = false;
+    bool release = false;
+    bool dynamic = false;
+    bool pgo     = false;
+    bool lto     = false;
 };
 
 template <typename LastLayer, typename Enable = void>
@@ -105,6 +119,7 @@ struct training_desc {
     double l2_weight_cost = stupid_default;
 
     std::string trainer = "none";
+    std::string loss    = "none";
 
     bool verbose = false;
 };
@@ -113,6 +128,34 @@ struct weights_desc {
     std::string file = "weights.dat";
 };
 
+/*!
+ * \brief The description of a benchmark of the network on synthetic data
+ */
+struct bench_desc {
+    size_t warmup  = 1;     ///< The number of epochs before the timed epochs
+    size_t epochs  = 3;     ///< The number of timed epochs
+    size_t samples = 10000; ///< The number of samples of an epoch
+    bool fresh     = false; ///< Generate new samples for each batch
+};
+
+/*!
+ * \brief The description of a sweep, independent runs of the same network
+ * in parallel, each with its own seed and/or training data source
+ */
+struct sweep_desc {
+    std::vector<size_t> seeds;        ///< The seed of each task
+    std::vector<std::string> samples; ///< The training samples of each task
+    std::vector<std::string> labels;  ///< The training labels of each task
+    size_t threads = 0;               ///< The number of cores of each task (0 to split the cores evenly)
+
+    /*!
+     * \brief Returns the number of tasks of the sweep
+     */
+    size_t tasks() const {
+        return std::max(seeds.size(), samples.size());
+    }
+};
+
 struct task {
     std::vector<std::string> default_actions;
 
@@ -124,11 +167,165 @@ struct task {
     dll::processor::pretraining_desc pt_desc;
     dll::processor::training_desc ft_desc;
     dll::processor::weights_desc w_desc;
+    dll::processor::bench_desc bench;
     dll::processor::general_desc general_desc;
+    dll::processor::sweep_desc sweep;
 };
 
+/*!
+ * \brief Set the seed of DLL for a task of a sweep.
+ *
+ * This must be called before the creation of the network.
+ */
+inline void sweep_seed() {
+    if (auto* seed = std::getenv("DLLP_SEED")) {
+        dll::set_seed(std::stoul(seed));
+    }
+}
+
+/*!
+ * \brief Set the training data source of the task of a sweep
+ * \param t The task to modify
+ */
+inline void sweep_sources(task& t) {
+    if (auto* samples = std::getenv("DLLP_SWEEP_SAMPLES")) {
+        t.training.samples.source_file = samples;
+    }
+
+    if (auto* labels = std::getenv("DLLP_SWEEP_LABELS")) {
+        t.training.labels.source_file = labels;
+    }
+}
+
+/*!
+ * \brief Returns the path of the cache of the samples of the given data
+ * source, after the transformations.
+ *
+ * The path is the hash of the source, of its modification time, of the
+ * reader and of all the transformations, returns an empty string if the
+ * samples cannot be cached.
+ */
+template <bool Three, typename Sample>
+std::string samples_cache_file(const datasource& ds) {
+    // The noise is random, it must be drawn again for each run
+    if (ds.normal_noise) {
+        return {};
+    }
+
+    struct stat attr;
+    if (stat(ds.source_file.c_str(), &attr)) {
+        return {};
+    }
+
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer), "%s|%ld|%s|%d%d%d%d|%.17g|%.17g|%ld|%d|%lu|%lu",
+             ds.source_file.c_str(), long(attr.st_mtime), ds.reader.c_str(), ds.binarize, ds.normalize, ds.scale, ds.shift,
+             ds.scale_d, ds.shift_d, ds.limit, Three, sizeof(etl::value_t<Sample>), etl::decay_traits<Sample>::dimensions());
+
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (const char* c = buffer; *c; ++c) {
+        hash ^= static_cast<unsigned char>(*c);
+        hash *= 1099511628211ULL;
+    }
+
+    const auto* dir = std::getenv("DLLP_CACHE");
+    const std::string directory(dir ? dir : ".dllp_cache");
+
+    snprintf(buffer, sizeof(buffer), "/data-%016llx.dlld", static_cast<unsigned long long>(hash));
+
+    return directory + buffer;
+}
+
+/*!
+ * \brief Create an empty sample of the shape of the given header
+ */
+template <typename Sample, size_t... I>
+Sample make_cached_sample(const binary_dataset_header& header, std::index_sequence<I...> /*seq*/) {
+    if constexpr (etl::decay_traits<Sample>::is_fast) {
+        return Sample();
+    } else {
+        return Sample(header.shape[I]...);
+    }
+}
+
+/*!
+ * \brief Read the samples from their cache file
+ * \return true if the samples were read, false otherwise
+ */
+template <typename Sample>
+bool read_cached_samples(const std::string& file, std::vector<Sample>& samples) {
+    using T = etl::value_t<Sample>;
+
+    constexpr size_t D = etl::decay_traits<Sample>::dimensions();
+
+    mapped_file mapping(file);
+
+    if (!mapping.memory || mapping.length < sizeof(binary_dataset_header)) {
+        return false;
+    }
+
+    binary_dataset_header header;
+    std::memcpy(&header, mapping.at(0), sizeof(header));
+
+    if (!header.valid() || header.dtype != binary_dtype<T>() || header.dimensions != D || !header.samples) {
+        return false;
+    }
+
+    const size_t sample_size = header.sample_size();
+
+    if (header.data_offset + header.samples * sample_size * sizeof(T) > mapping.length) {
+        return false;
+    }
+
+    samples.reserve(header.samples);
+
+    const auto* data = reinterpret_cast<const T*>(mapping.at(header.data_offset));
+
+    for (size_t i = 0; i < header.samples; ++i) {
+        samples.push_back(make_cached_sample<Sample>(header, std::make_index_sequence<D>()));
+
+        if (etl::size(samples.back()) != sample_size) {
+            samples.clear();
+            return false;
+        }
+
+        std::copy_n(data + i * sample_size, sample_size, samples.back().begin());
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write the samples into their cache file
+ */
+template <typename Sample>
+void write_cached_samples(const std::string& file, const std::vector<Sample>& samples) {
+    const auto slash = file.rfind('/');
+
+    if (slash != std::string::npos) {
+        mkdir(file.substr(0, slash).c_str(), 0755);
+    }
+
+    // The labels are not part of the cache
+    std::vector<uint32_t> labels(samples.size());
+
+    // The cache file only appears once complete
+    if (write_binary_dataset(file + ".tmp", samples, labels)) {
+        std::rename((file + ".tmp").c_str(), file.c_str());
+    } else {
+        std::remove((file + ".tmp").c_str());
+    }
+}
+
 template <bool Three, typename Sample>
 bool read_samples(const datasource& ds, std::vector<Sample>& samples) {
+    const auto cache_file = samples_cache_file<Three, Sample>(ds);
+
+    if (!cache_file.empty() && read_cached_samples(cache_file, samples)) {
+        return true;
+    }
+
     size_t limit = 0;
 
     if (ds.limit > 0) {
@@ -185,6 +382,10 @@ bool read_samples(const datasource& ds, std::vector<Sample>& samples) {
         mnist::normalize_each(samples);
     }
 
+    if (!cache_file.empty() && !samples.empty()) {
+        write_cached_samples(cache_file, samples);
+    }
+
     return !samples.empty();
 }
 
@@ -216,6 +417,95 @@ inline void print_title(const std::string& value) {
     std::cout << std::string(25, ' ') << std::endl;
 }
 
+/*!
+ * \brief Time the given number of epochs of the functor, after the warmup
+ * epochs, and print the throughput
+ *
+ * \param name The name of the phase
+ * \param desc The description of the benchmark
+ * \param samples The number of samples of one epoch
+ * \param epoch The functor running the given number of epochs
+ */
+template <typename Functor>
+void bench_phase(const std::string& name, const bench_desc& desc, size_t samples, Functor&& epoch) {
+    if (desc.warmup) {
+        epoch(desc.warmup);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    epoch(desc.epochs);
+
+    auto end = std::chrono::steady_clock::now();
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    const double rate    = seconds > 0.0 ? desc.epochs * samples / seconds : 0.0;
+
+    const auto flags     = std::cout.flags();
+    const auto precision = std::cout.precision();
+
+    std::cout << std::setw(12) << std::left << name << std::right
+              << "|" << std::setw(8) << desc.epochs
+              << "|" << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+              << "|" << std::setw(14) << std::setprecision(1) << rate
+              << "|" << std::setw(12) << std::setprecision(3) << (seconds > 0.0 ? 1e6 * seconds / (desc.epochs * samples) : 0.0)
+              << "|" << std::endl;
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+/*!
+ * \brief Benchmark the pretraining (if possible), the training (if
+ * possible) and the inference of the network on synthetic data and print
+ * the throughput of each phase.
+ *
+ * The samples have the shape of the input of the network, the labels are
+ * uniform over its outputs.
+ */
+template <typename DBN>
+void bench(DBN& dbn, const bench_desc& desc) {
+    using dbn_t    = std::decay_t<DBN>;
+    using sample_t = typename dbn_t::input_one_t;
+
+    using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
+
+    const size_t n = std::max(desc.samples, size_t(1));
+
+    synthetic_data_generator<sample_t, dbn_t::batch_size> generator(sample_t{}, n, dbn.output_size(), desc.fresh);
+
+    generator.display();
+
+    std::cout << std::endl;
+    std::cout << "   Warmup epochs: " << desc.warmup << std::endl;
+    std::cout << std::endl;
+    std::cout << "Phase       |  Epochs |     Seconds |     Samples/s |   us/sample |" << std::endl;
+
+    if constexpr (dbn_t::pretrain_possible) {
+        bench_phase("pretrain", desc, n, [&](size_t epochs) {
+            generator.reset();
+            dbn.pretrain(generator, epochs);
+        });
+    }
+
+    if constexpr (sgd_possible<last_layer>::value) {
+        bench_phase("train", desc, n, [&](size_t epochs) {
+            generator.reset();
+            dbn.fine_tune(generator, epochs);
+        });
+    }
+
+    auto engine = dbn.make_inference_engine(dbn_t::batch_size);
+
+    bench_phase("inference", desc, n, [&](size_t epochs) {
+        for (size_t e = 0; e < epochs; ++e) {
+            for (generator.reset(); generator.has_next_batch(); generator.next_batch()) {
+                engine.forward(generator.data_batch());
+            }
+        }
+    });
+}
+
 template <typename Container, bool Three, typename DBN>
 void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
     print_title("Network");
@@ -382,6 +672,10 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 std::cout << std::endl;
             }
             std::cout << std::endl;
+        } else if (action == "bench") {
+            print_title("Benchmark");
+
+            bench(dbn, task.bench);
         } else if (action == "save") {
             print_title("Save Weights");
 
@@ -227,9 +227,14 @@ private:
     }
 
     template<typename H>
-    auto get_batch_c_rep(H&& /*h*/) const {
-        static constexpr auto batch_size = etl::decay_traits<H>::template dim<0>();
-        return etl::force_temporary(etl::rep_l<batch_size>(etl::rep<NV1, NV2>(c)));
+    auto get_batch_c_rep(H&& h) const {
+        if constexpr (etl::all_fast<H>) {
+            static constexpr auto batch_size = etl::decay_traits<H>::template dim<0>();
+            return etl::force_temporary(etl::rep_l<batch_size>(etl::rep<NV1, NV2>(c)));
+        } else {
+            const auto batch_size = etl::dim<0>(h);
+            return etl::force_temporary(etl::rep_l(etl::rep<NV1, NV2>(c), batch_size));
+        }
     }
 
     template<typename H>
@@ -324,6 +329,10 @@ struct rbm_layer_base_traits<conv_rbm_mp_impl<Desc>> {
 
     static constexpr bool has_momentum       = param::template contains<momentum>();                       ///< Does the RBM has momentum
     static constexpr bool has_clip_gradients = param::template contains<clip_gradients>();                 ///< Does the RBM has gradient clipping
+    static constexpr bool has_parallel_gibbs = param::template contains<parallel_gibbs>();                 ///< Does the RBM run its Gibbs chains in parallel
+    static constexpr bool has_fft_conv       = false;                                                      ///< Does the RBM compute its convolutions by FFT
+    static constexpr size_t statistics_every = get_value_l_v<dll::statistics_every<1>, param>;             ///< The number of batches between two measures of the statistics
+    static constexpr size_t async_workers    = get_value_l_v<dll::async_cd<1>, param>;                     ///< The number of asynchronous workers of Contrastive Divergence
     static constexpr bool is_verbose         = param::template contains<verbose>();                        ///< Does the RBM is verbose
     static constexpr bool has_shuffle        = param::template contains<shuffle>();                        ///< Does the RBM has shuffle
     static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
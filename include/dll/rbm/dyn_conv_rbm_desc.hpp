@@ -71,7 +71,7 @@ struct dyn_conv_rbm_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-                             batch_size_id, momentum_id, visible_id, hidden_id, dbn_only_id, clip_gradients_id,
+                             batch_size_id, momentum_id, visible_id, hidden_id, dbn_only_id, clip_gradients_id, parallel_gibbs_id, fft_conv_id, statistics_every_id, async_cd_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id,
                              bias_id, weight_type_id, shuffle_id, verbose_id, nop_id>,
                          Parameters...>,
@@ -50,6 +50,9 @@ struct dyn_rbm_desc {
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
+    /*! The shapes with specialized kernels */
+    using shapes = detail::get_type_t<default_dense_shapes, Parameters...>;
+
     /*! The type of the trainer to use to train the RBM */
     template <typename RBM>
     using trainer_t = typename detail::get_template_type<trainer_rbm<cd1_trainer_t>, Parameters...>::template value<RBM>;
@@ -67,7 +70,7 @@ struct dyn_rbm_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<batch_size_id, momentum_id, visible_id, hidden_id, weight_decay_id, verbose_id,
-                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, free_energy_id, clip_gradients_id>,
+                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, free_energy_id, clip_gradients_id, parallel_gibbs_id, statistics_every_id, async_cd_id, sparse_input_id, binary_input_id, transposed_weights_id, fast_activations_id, fixed_shapes_id>,
                          Parameters...>,
         "Invalid parameters type");
 
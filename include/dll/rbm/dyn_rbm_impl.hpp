@@ -11,6 +11,7 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/rbm/standard_rbm.hpp"
+#include "dll/util/shape_kernels.hpp"
 
 namespace dll {
 
@@ -37,10 +38,14 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
     static constexpr unit_type hidden_unit  = desc::hidden_unit;
     static constexpr size_t batch_size      = desc::BatchSize; ///< The mini-batch size
 
+    static constexpr bool sparse_gradients = base_type::sparse_input; ///< Only the rows of the non-zero inputs have gradients
+
     using w_type = etl::dyn_matrix<weight>; ///< The type of the weights
     using b_type = etl::dyn_vector<weight>; ///< The type of the biases
     using c_type = etl::dyn_vector<weight>;
 
+    using kernels_t = dense_shape_kernels<function::IDENTITY, weight>; ///< The kernels specialized for some shapes
+
     //Weights and biases
     w_type w; ///< Weights
     b_type b; ///< Hidden biases
@@ -66,6 +71,8 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
     size_t num_visible;
     size_t num_hidden;
 
+    typename kernels_t::kernel_t product_kernel = nullptr; ///< The kernel of the shape of the layer, if any
+
     dyn_rbm_impl() : base_type() {}
 
     /*!
@@ -90,6 +97,8 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
               num_hidden(num_hidden) {
         //Initialize the weights with a zero-mean and unit variance Gaussian distribution
         w = etl::normal_generator<weight>() * 0.1;
+
+        select_kernels();
     }
 
     /*!
@@ -112,6 +121,8 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
 
         //Initialize the weights with a zero-mean and unit variance Gaussian distribution
         w = etl::normal_generator<weight>() * 0.1;
+
+        select_kernels();
     }
 
     /*!
@@ -186,6 +197,28 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
         this->batch_activate_hidden(output, input);
     }
 
+    /*!
+     * \brief Compute the product of a batch of visible units with the
+     * weights, h = v * w, with the kernel of the shape of the layer if it has
+     * one
+     */
+    template <typename H, typename V, typename W>
+    void hidden_product(H&& h, const V& v, const W& w) const {
+        if constexpr (etl::all_dma<std::decay_t<H>, V, W>) {
+            if (product_kernel && etl::dim<0>(w) == num_visible && etl::dim<1>(w) == num_hidden) {
+                cpu_access(v, w);
+
+                product_kernel(h.memory_start(), v.memory_start(), w.memory_start(), nullptr, etl::dim<0>(h));
+
+                cpu_modified(h);
+
+                return;
+            }
+        }
+
+        h = v * w;
+    }
+
     // This is specific to dyn because of the nv/nh
     void init_cg_context() {
         if (!this->cg_context_ptr) {
@@ -247,9 +280,37 @@ struct dyn_rbm_impl final : public standard_rbm<dyn_rbm_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        if constexpr (base_type::sparse_input) {
+            auto& sub = *std::get<0>(context.up.context);
+            auto& csr = csr_workspace<weight>();
+
+            csr.assign(context.input);
+
+            if constexpr (has_sparse_rows<std::decay_t<decltype(sub)>>::value) {
+                sparse_csr_gradients(sub, csr, context.errors);
+            } else {
+                csr_batch_outer(sub.grad, csr, context.errors);
+            }
+        } else if constexpr (base_type::binary_input) {
+            auto& bits = bit_workspace();
+
+            bits.assign(context.input);
+
+            bit_batch_outer(std::get<0>(context.up.context)->grad, bits, context.errors);
+        } else {
+            std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        }
+
         std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
     }
+
+private:
+    /*!
+     * \brief Select the kernels of the shape of the layer
+     */
+    void select_kernels() {
+        product_kernel = select_shape_kernel<kernels_t>(typename desc::shapes{}, std::array<size_t, 2>{{num_visible, num_hidden}});
+    }
 };
 
 /*!
@@ -293,6 +354,12 @@ struct rbm_layer_base_traits<dyn_rbm_impl<Desc>> {
 
     static constexpr bool has_momentum       = param::template contains<momentum>();                       ///< Does the RBM has momentum
     static constexpr bool has_clip_gradients = param::template contains<clip_gradients>();                 ///< Does the RBM has gradient clipping
+    static constexpr bool has_parallel_gibbs = param::template contains<parallel_gibbs>();                 ///< Does the RBM run its Gibbs chains in parallel
+    static constexpr bool has_sparse_input   = param::template contains<sparse_input>();                   ///< Does the RBM compute the products with its input in CSR format
+    static constexpr bool has_binary_input   = param::template contains<binary_input>();                   ///< Does the RBM compute the products with its bit-packed binary input
+    static constexpr bool has_transposed_weights = param::template contains<transposed_weights>();         ///< Does the RBM keep transposed weights for its reconstructions
+    static constexpr size_t statistics_every = get_value_l_v<dll::statistics_every<1>, param>;             ///< The number of batches between two measures of the statistics
+    static constexpr size_t async_workers    = get_value_l_v<dll::async_cd<1>, param>;                     ///< The number of asynchronous workers of Contrastive Divergence
     static constexpr bool is_verbose         = param::template contains<verbose>();                        ///< Does the RBM is verbose
     static constexpr bool has_shuffle        = param::template contains<shuffle>();                        ///< Does the RBM has shuffle
     static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
@@ -353,8 +420,8 @@ struct cg_context<dyn_rbm_impl<Desc>> {
     etl::dyn_matrix<weight, 2> gr_w_tmp;
     etl::dyn_matrix<weight, 1> gr_b_tmp;
 
-    std::vector<etl::dyn_vector<weight>> gr_probs_a;
-    std::vector<etl::dyn_vector<weight>> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_probs_a; ///< The activation probabilities of the batch
+    etl::dyn_matrix<weight, 2> gr_diffs;   ///< The errors of the batch
 
     cg_context(size_t num_visible, size_t num_hidden) :
         gr_w_incs(num_visible, num_hidden), gr_b_incs(num_hidden),
@@ -0,0 +1,184 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Probabilistic Max Pooling kernels
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace pmp_detail {
+
+/*!
+ * \brief Probabilistic max pooling of one [H x W] channel of activations.
+ *
+ * For each CxC block of activations x, the hidden probabilities are
+ * exp(x) / (1 + sum(exp(x))) and the probability of the pooling unit
+ * is 1 / (1 + sum(exp(x))). The exponentials are computed once per unit,
+ * shifted by the maximum of the block to avoid overflows.
+ *
+ * \param h The hidden probabilities [H x W], or nullptr
+ * \param p The pooling probabilities [H / C x W / C], or nullptr
+ * \param x The activations [H x W]
+ */
+template <typename T>
+void pmp_channel(T* h, T* p, const T* x, size_t H, size_t W, size_t C) {
+    const size_t PW = W / C;
+
+    thread_local std::vector<T> workspace;
+    workspace.resize(2 * PW + C * W);
+
+    T* block_max = workspace.data();
+    T* block_sum = block_max + PW;
+    T* e         = block_sum + PW;
+
+    for (size_t bi = 0; bi < H / C; ++bi) {
+        const T* x_rows = x + bi * C * W;
+
+        // The maximum of each block, never less than the "off" state
+        std::fill(block_max, block_max + PW, T(0));
+
+        for (size_t ii = 0; ii < C; ++ii) {
+            const T* x_row = x_rows + ii * W;
+
+            for (size_t bj = 0; bj < PW; ++bj) {
+                T m = block_max[bj];
+
+                for (size_t jj = 0; jj < C; ++jj) {
+                    m = std::max(m, x_row[bj * C + jj]);
+                }
+
+                block_max[bj] = m;
+            }
+        }
+
+        // The exponentials and the normalizer of each block
+
+        for (size_t bj = 0; bj < PW; ++bj) {
+            block_sum[bj] = std::exp(-block_max[bj]);
+        }
+
+        for (size_t ii = 0; ii < C; ++ii) {
+            const T* x_row = x_rows + ii * W;
+            T* e_row       = e + ii * W;
+
+            for (size_t bj = 0; bj < PW; ++bj) {
+                const T m = block_max[bj];
+                T s(0);
+
+                for (size_t jj = 0; jj < C; ++jj) {
+                    e_row[bj * C + jj] = std::exp(x_row[bj * C + jj] - m);
+                    s += e_row[bj * C + jj];
+                }
+
+                block_sum[bj] += s;
+            }
+        }
+
+        if (h) {
+            for (size_t ii = 0; ii < C; ++ii) {
+                const T* e_row = e + ii * W;
+                T* h_row       = h + (bi * C + ii) * W;
+
+                for (size_t bj = 0; bj < PW; ++bj) {
+                    const T inv = T(1) / block_sum[bj];
+
+                    for (size_t jj = 0; jj < C; ++jj) {
+                        h_row[bj * C + jj] = e_row[bj * C + jj] * inv;
+                    }
+                }
+            }
+        }
+
+        if (p) {
+            for (size_t bj = 0; bj < PW; ++bj) {
+                p[bi * PW + bj] = std::exp(-block_max[bj]) / block_sum[bj];
+            }
+        }
+    }
+}
+
+} //end of namespace pmp_detail
+
+/*!
+ * \brief Compute the probabilities of the hidden units with Probabilistic
+ * Max Pooling, in place.
+ *
+ * This computes the same thing as etl::p_max_pool_h, the channels are
+ * processed in parallel.
+ *
+ * \param h The activations [... x H x W], replaced by the probabilities
+ * \param C The pooling ratio
+ */
+template <typename H>
+void prob_max_pool_h(H&& h, size_t C) {
+    constexpr size_t D = etl::dimensions<H>();
+
+    const size_t NH1 = etl::dim(h, D - 2);
+    const size_t NH2 = etl::dim(h, D - 1);
+    const size_t N   = etl::size(h) / (NH1 * NH2);
+
+    cpp_assert(NH1 % C == 0 && NH2 % C == 0, "The pooling ratio must divide the hidden dimensions");
+
+    cpu_access(h);
+
+    auto* h_m = h.memory_start();
+
+    parallel_kernel(0, N, [&](size_t i) {
+        pmp_detail::pmp_channel(h_m + i * NH1 * NH2, decltype(h_m)(nullptr), h_m + i * NH1 * NH2, NH1, NH2, C);
+    });
+
+    cpu_modified(h);
+}
+
+/*!
+ * \brief Compute the probabilities of the pooling units with Probabilistic
+ * Max Pooling.
+ *
+ * This computes the same thing as etl::p_max_pool_p, the channels are
+ * processed in parallel.
+ *
+ * \param p The pooling probabilities [... x H / C x W / C]
+ * \param x The activations [... x H x W]
+ * \param C The pooling ratio
+ */
+template <typename P, typename X>
+void prob_max_pool_p(P&& p, const X& x, size_t C) {
+    constexpr size_t D = etl::dimensions<X>();
+
+    const size_t NH1 = etl::dim(x, D - 2);
+    const size_t NH2 = etl::dim(x, D - 1);
+    const size_t N   = etl::size(x) / (NH1 * NH2);
+
+    cpp_assert(NH1 % C == 0 && NH2 % C == 0, "The pooling ratio must divide the hidden dimensions");
+    cpp_assert(etl::size(p) == N * (NH1 / C) * (NH2 / C), "Invalid size of the pooling probabilities");
+
+    cpu_access(x);
+
+    auto* p_m       = p.memory_start();
+    const auto* x_m = x.memory_start();
+
+    parallel_kernel(0, N, [&](size_t i) {
+        pmp_detail::pmp_channel(decltype(p_m)(nullptr), p_m + i * (NH1 / C) * (NH2 / C), x_m + i * NH1 * NH2, NH1, NH2, C);
+    });
+
+    cpu_modified(p);
+}
+
+} //end of dll namespace
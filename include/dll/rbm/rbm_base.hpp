@@ -15,6 +15,7 @@
 #include "dll/generators.hpp"
 #include "dll/layer.hpp"
 #include "dll/trainer/rbm_trainer_fwd.hpp"
+#include "dll/util/fast_random.hpp"
 
 namespace dll {
 
@@ -66,6 +67,8 @@ struct rbm_base : layer<Parent> {
 
     weight gradient_clip = 5.0; ///< The default gradient clipping value
 
+    mutable random_stream sampler; ///< The random stream for the sampling of the units
+
     /*!
      * \brief Construct an empty rbm_base
      */
@@ -74,7 +74,7 @@ struct rbm_desc {
     static_assert(
         detail::is_valid_v<cpp::type_list<momentum_id, verbose_id, batch_size_id, visible_id,
                                         hidden_id, weight_decay_id, init_weights_id, sparsity_id, trainer_rbm_id, watcher_id,
-                                        weight_type_id, shuffle_id, free_energy_id, dbn_only_id, nop_id, clip_gradients_id>,
+                                        weight_type_id, shuffle_id, free_energy_id, dbn_only_id, nop_id, clip_gradients_id, parallel_gibbs_id, statistics_every_id, async_cd_id, sparse_input_id, binary_input_id, transposed_weights_id, fast_activations_id>,
                          Parameters...>,
         "Invalid parameters type for rbm_desc");
 
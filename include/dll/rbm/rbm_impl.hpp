@@ -49,6 +49,8 @@ struct rbm_impl final : public standard_rbm<rbm_impl<Desc>, Desc> {
     static constexpr unit_type visible_unit = desc::visible_unit; ///< The type of visible units
     static constexpr unit_type hidden_unit  = desc::hidden_unit;  ///< The type of hidden units
 
+    static constexpr bool sparse_gradients = base_type::sparse_input; ///< Only the rows of the non-zero inputs have gradients
+
     static constexpr bool dbn_only = rbm_layer_traits<this_type>::is_dbn_only();
 
     using w_type = etl::fast_matrix<weight, num_visible, num_hidden>; ///< The type used to store weights
@@ -208,7 +210,27 @@ struct rbm_impl final : public standard_rbm<rbm_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        if constexpr (base_type::sparse_input) {
+            auto& sub = *std::get<0>(context.up.context);
+            auto& csr = csr_workspace<weight>();
+
+            csr.assign(context.input);
+
+            if constexpr (has_sparse_rows<std::decay_t<decltype(sub)>>::value) {
+                sparse_csr_gradients(sub, csr, context.errors);
+            } else {
+                csr_batch_outer(sub.grad, csr, context.errors);
+            }
+        } else if constexpr (base_type::binary_input) {
+            auto& bits = bit_workspace();
+
+            bits.assign(context.input);
+
+            bit_batch_outer(std::get<0>(context.up.context)->grad, bits, context.errors);
+        } else {
+            std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        }
+
         std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
     }
 };
@@ -262,6 +284,12 @@ struct rbm_layer_base_traits<rbm_impl<Desc>> {
 
     static constexpr bool has_momentum       = param::template contains<momentum>();                       ///< Does the RBM has momentum
     static constexpr bool has_clip_gradients = param::template contains<clip_gradients>();                 ///< Does the RBM has gradient clipping
+    static constexpr bool has_parallel_gibbs = param::template contains<parallel_gibbs>();                 ///< Does the RBM run its Gibbs chains in parallel
+    static constexpr bool has_sparse_input   = param::template contains<sparse_input>();                   ///< Does the RBM compute the products with its input in CSR format
+    static constexpr bool has_binary_input   = param::template contains<binary_input>();                   ///< Does the RBM compute the products with its bit-packed binary input
+    static constexpr bool has_transposed_weights = param::template contains<transposed_weights>();         ///< Does the RBM keep transposed weights for its reconstructions
+    static constexpr size_t statistics_every = get_value_l_v<dll::statistics_every<1>, param>;             ///< The number of batches between two measures of the statistics
+    static constexpr size_t async_workers    = get_value_l_v<dll::async_cd<1>, param>;                     ///< The number of asynchronous workers of Contrastive Divergence
     static constexpr bool is_verbose         = param::template contains<verbose>();                        ///< Does the RBM is verbose
     static constexpr bool has_shuffle        = param::template contains<shuffle>();                        ///< Does the RBM has shuffle
     static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
@@ -328,8 +356,8 @@ struct cg_context<rbm_impl<Desc>> {
     etl::fast_matrix<weight, num_visible, num_hidden> gr_w_tmp;
     etl::fast_vector<weight, num_hidden> gr_b_tmp;
 
-    std::vector<etl::dyn_vector<weight>> gr_probs_a;
-    std::vector<etl::dyn_vector<weight>> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_probs_a; ///< The activation probabilities of the batch
+    etl::dyn_matrix<weight, 2> gr_diffs;   ///< The errors of the batch
 };
 
 } //end of dll namespace
@@ -144,6 +144,18 @@ struct standard_conv_rbm : public rbm_base<Parent, Desc> {
         return free_energy(as_derived().v1);
     }
 
+    /*!
+     * \brief Return the sum of the free energies of the first n samples of
+     * a batch, reusing the hidden activation probabilities of the batch
+     * \param v The batch of inputs
+     * \param h_a The hidden activation probabilities of the batch
+     * \param n The number of samples of the batch
+     */
+    template <typename V, typename H>
+    weight batch_free_energy(const V& v, const H& h_a, size_t n) const {
+        return as_derived().batch_free_energy_impl(v, h_a, n);
+    }
+
     friend base_type;
 
 private:
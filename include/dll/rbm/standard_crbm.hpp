@@ -14,6 +14,7 @@
 
 #include <cstddef>
 #include <ctime>
+#include <limits>
 #include <random>
 
 #include "cpp_utils/assert.hpp"     //Assertions
@@ -23,6 +24,7 @@
 #include "etl/etl.hpp"
 
 #include "standard_conv_rbm.hpp" //The base class
+#include "dll/util/fft_conv.hpp"  //Convolutions in the frequency domain
 #include "rbm_tmp.hpp"           // static_if macros
 
 namespace dll {
@@ -50,6 +52,12 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
     static constexpr unit_type visible_unit = desc::visible_unit; ///< The visible unit type
     static constexpr unit_type hidden_unit  = desc::hidden_unit;  ///< The hidden unit type
 
+    /*!
+     * \brief The convolutions by FFT, the spectra of the weights are locked
+     * by the trainer during each batch
+     */
+    mutable fft_conv_plan<weight> fft_plan;
+
     standard_crbm() = default;
 
     // Make base class them participate in overload resolution
@@ -82,7 +90,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
         H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
         H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, h_s, h_a));
 
         nan_check_deep(h_a);
 
@@ -116,8 +124,8 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         nan_check_deep(v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, v_s = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, v_s = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, v_s, v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, sample_normal(as_derived().sampler, v_s, v_a));
 
         if (S) {
             nan_check_deep(v_s);
@@ -135,7 +143,11 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         using namespace etl;
 
-        h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
+        if constexpr (rbm_layer_traits<derived_t>::has_fft_conv() && etl::all_dma<std::decay_t<H1>, V1>) {
+            fft_plan.valid_correlation(h_a, v_a, as_derived().w);
+        } else {
+            h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
+        }
 
         auto b_rep = as_derived().get_batch_b_rep(v_a);
 
@@ -152,7 +164,7 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         nan_check_deep(h_a);
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, h_s, h_a));
 
         if (S) {
             nan_check_deep(h_s);
@@ -168,7 +180,11 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         as_derived().template validate_outputs<H1, H2, 1>();
 
-        v_a = etl::conv_4d_full(h_s, as_derived().w);
+        if constexpr (rbm_layer_traits<derived_t>::has_fft_conv() && etl::all_dma<std::decay_t<V1>, H2>) {
+            fft_plan.full_convolution(v_a, h_s, as_derived().w);
+        } else {
+            v_a = etl::conv_4d_full(h_s, as_derived().w);
+        }
 
         auto c_rep = as_derived().get_batch_c_rep(h_s);
 
@@ -177,8 +193,8 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         nan_check_deep(v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, v_s = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, v_s = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, v_s, v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, sample_normal(as_derived().sampler, v_s, v_a));
 
         if (S) {
             nan_check_deep(v_s);
@@ -236,6 +252,35 @@ private:
         }
     }
 
+    template <typename V, typename H>
+    weight batch_free_energy_impl(const V& v, const H& h_a, size_t n) const {
+        dll::auto_timer timer("crbm:batch_free_energy");
+
+        if constexpr (desc::visible_unit == unit_type::BINARY && desc::hidden_unit == unit_type::BINARY) {
+            // The hidden probabilities are sigmoid(x), log(1 + e^x) is -log(1 - sigmoid(x))
+            constexpr weight max_h = 1.0 - std::numeric_limits<weight>::epsilon();
+
+            weight energy = etl::sum(etl::log(1.0 - etl::min(etl::slice(h_a, 0, n), max_h)));
+
+            for (size_t b = 0; b < n; ++b) {
+                energy -= etl::sum(as_derived().c >> etl::sum_r(v(b)));
+            }
+
+            return energy;
+        } else {
+            // The probabilities of Gaussian visible units are scaled, x must be computed again
+            cpp_unused(h_a);
+
+            weight energy = 0.0;
+
+            for (size_t b = 0; b < n; ++b) {
+                energy += free_energy_impl(v(b));
+            }
+
+            return energy;
+        }
+    }
+
     /*!
      * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
      * \return a reference to the derived object.
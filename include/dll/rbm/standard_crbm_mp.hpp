@@ -25,6 +25,7 @@
 #include "dll/rbm/standard_conv_rbm.hpp" //The base class
 #include "dll/base_conf.hpp"             //The configuration helpers
 #include "dll/rbm/rbm_tmp.hpp"           // static_if macros
+#include "dll/rbm/prob_pooling.hpp"      // Probabilistic Max Pooling kernels
 
 namespace dll {
 
@@ -78,13 +79,13 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
         H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
 
-        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::p_max_pool_h(b_rep + h_a, this->C(), this->C()));
-        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::p_max_pool_h((1.0 / (0.1 * 0.1)) >> (b_rep + h_a), this->C(), this->C()));
+        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = b_rep + h_a; prob_max_pool_h(h_a, this->C()));
+        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = (1.0 / (0.1 * 0.1)) >> (b_rep + h_a); prob_max_pool_h(h_a, this->C()));
         H_PROBS(unit_type::RELU, h_a = max(b_rep + h_a, 0.0));
         H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
         H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, h_s, h_a));
 
         nan_check_etl(h_a);
 
@@ -111,8 +112,8 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
         nan_check_deep(v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, v_s = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, v_s = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, v_s, v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, sample_normal(as_derived().sampler, v_s, v_a));
 
         if (S) {
             nan_check_deep(v_s);
@@ -132,14 +133,15 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         v_cv = etl::conv_4d_valid_flipped(as_derived().reshape_v_a(v_a), as_derived().w);
 
         if (pooling_unit == unit_type::BINARY) {
-            p_a = etl::p_max_pool_p(b_rep + v_cv(0), C(), C());
+            v_cv(0) = b_rep + v_cv(0);
+            prob_max_pool_p(p_a, v_cv, C());
         }
 
         nan_check_etl(p_a);
 
         if (S) {
             if (pooling_unit == unit_type::BINARY) {
-                p_s = r_bernoulli(p_a);
+                sample_bernoulli(as_derived().sampler, p_s, p_a);
             }
 
             nan_check_etl(p_s);
@@ -170,13 +172,13 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
         H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
 
-        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::p_max_pool_h(b_rep + h_a, this->C(), this->C()));
-        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::p_max_pool_h((1.0 / (0.1 * 0.1)) >> (b_rep + h_a), this->C(), this->C()));
+        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = b_rep + h_a; prob_max_pool_h(h_a, this->C()));
+        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = (1.0 / (0.1 * 0.1)) >> (b_rep + h_a); prob_max_pool_h(h_a, this->C()));
         H_PROBS(unit_type::RELU, h_a = max(b_rep + h_a, 0.0));
         H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
         H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+        H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, h_s, h_a));
 
         nan_check_deep(h_a);
 
@@ -203,14 +205,15 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         auto h_a = etl::force_temporary(etl::conv_4d_valid_flipped(v_a, as_derived().w));
 
         if (pooling_unit == unit_type::BINARY) {
-            p_a = etl::p_max_pool_p(b_rep + h_a, C(), C());
+            h_a = b_rep + h_a;
+            prob_max_pool_p(p_a, h_a, C());
         }
 
         nan_check_etl(p_a);
 
         if (S) {
             if (pooling_unit == unit_type::BINARY) {
-                p_s = r_bernoulli(p_a);
+                sample_bernoulli(as_derived().sampler, p_s, p_a);
             }
 
             nan_check_etl(p_s);
@@ -237,8 +240,8 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(c_rep + v_a));
         V_PROBS(unit_type::GAUSSIAN, v_a = c_rep + v_a);
 
-        V_SAMPLE_PROBS(unit_type::BINARY, v_s = bernoulli(v_a));
-        V_SAMPLE_PROBS(unit_type::GAUSSIAN, v_s = normal_noise(v_a));
+        V_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, v_s, v_a));
+        V_SAMPLE_PROBS(unit_type::GAUSSIAN, sample_normal(as_derived().sampler, v_s, v_a));
 
         nan_check_deep(v_a);
 
@@ -348,6 +351,18 @@ private:
         }
     }
 
+    template <typename V, typename H>
+    weight batch_free_energy_impl(const V& v, const H& /*h_a*/, size_t n) const {
+        // The hidden probabilities are pooled, x must be computed again
+        weight energy = 0.0;
+
+        for (size_t b = 0; b < n; ++b) {
+            energy += free_energy_impl(v(b));
+        }
+
+        return energy;
+    }
+
     /*!
      * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
      * \return a reference to the derived object.
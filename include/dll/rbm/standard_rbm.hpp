@@ -8,10 +8,12 @@
 #pragma once
 
 #include <cmath>
+#include <limits>
 #include <vector>
 #include <random>
 #include <functional>
 #include <ctime>
+#include <thread>
 
 #include "cpp_utils/stop_watch.hpp" //Performance counter
 #include "cpp_utils/assert.hpp"
@@ -19,6 +21,11 @@
 #include "etl/etl.hpp"
 
 #include "dll/util/checks.hpp"    //NaN checks
+#include "dll/util/bit_pack.hpp"  //binary_input
+#include "dll/util/csr.hpp"       //sparse_input
+#include "dll/util/input_statistics.hpp" //init_weights
+#include "dll/util/parallel.hpp"  //parallel_kernel
+#include "dll/util/rbm_kernels.hpp" //fused activations
 #include "dll/util/timers.hpp"    //auto_timer
 #include "dll/rbm/rbm_base.hpp"       //The base class
 #include "dll/base_conf.hpp"      //Descriptor configuration
@@ -48,7 +55,14 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
     static constexpr unit_type visible_unit = desc::visible_unit; ///< The type of visible unit
     static constexpr unit_type hidden_unit  = desc::hidden_unit;  ///< The type of hidden unit
 
+    static constexpr bool sparse_input = desc::parameters::template contains<dll::sparse_input>(); ///< Use the input in CSR format
+    static constexpr bool binary_input = desc::parameters::template contains<dll::binary_input>(); ///< Use the input in bit-packed format
+
+    static constexpr bool fast_activations = desc::parameters::template contains<dll::fast_activations>(); ///< Use the fast approximation of the sigmoid
+
     static_assert(visible_unit != unit_type::SOFTMAX, "Softmax Visible units are not support");
+    static_assert(!binary_input || visible_unit == unit_type::BINARY, "Bit-packed input is only supported with binary visible units");
+    static_assert(!(binary_input && sparse_input), "The input cannot be both in CSR and in bit-packed format");
     static_assert(hidden_unit != unit_type::GAUSSIAN, "Gaussian hidden units are not supported");
 
     /*!
@@ -91,6 +105,43 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         return free_energy(rbm, rbm.v1);
     }
 
+    /*!
+     * \brief Return the sum of the free energies of the first n samples of
+     * a batch.
+     *
+     * The hidden activation probabilities of the batch, computed with the
+     * current weights, are reused. With binary hidden units, log(1 + e^x) is
+     * -log(1 - sigmoid(x)), the whole batch is therefore computed in one pass
+     * without any product with the weights. The probabilities of saturated
+     * units are clamped to the precision of the weight type.
+     *
+     * \param v The batch of inputs
+     * \param h_a The hidden activation probabilities of the batch
+     * \param n The number of samples of the batch
+     */
+    template <typename V, typename H>
+    weight batch_free_energy([[maybe_unused]] const V& v, [[maybe_unused]] const H& h_a, [[maybe_unused]] size_t n) const {
+        dll::auto_timer timer("rbm:batch_free_energy");
+
+        if constexpr (hidden_unit == unit_type::BINARY && (visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN)) {
+            constexpr weight max_h = 1.0 - std::numeric_limits<weight>::epsilon();
+
+            auto& rbm = as_derived();
+            auto rv = etl::slice(v, 0, n);
+
+            // -sum(log(1 + e^(xj)))
+            const weight hidden = etl::sum(etl::log(1.0 - etl::min(etl::slice(h_a, 0, n), max_h)));
+
+            if constexpr (visible_unit == unit_type::BINARY) {
+                return -etl::sum(rv >> etl::rep_l(rbm.c, n)) + hidden;
+            } else {
+                return etl::sum(etl::pow(rv - etl::rep_l(rbm.c, n), 2) / 2.0) + hidden;
+            }
+        } else {
+            return 0.0;
+        }
+    }
+
     //Various functions
 
     /*!
@@ -103,10 +154,13 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
 
     /*!
      * \brief Initalize the weights using the training inputs
+     * \param generator The generator of the training inputs
+     * \param max_samples The maximum number of samples to use, 0 for all the samples
+     * \return The statistics of the inputs used for the initialization
      */
     template <typename Generator>
-    void init_weights(Generator& generator) {
-        init_weights(generator, as_derived());
+    input_statistics init_weights(Generator& generator, size_t max_samples = 0) {
+        return init_weights(generator, as_derived(), max_samples);
     }
 
     /*!
@@ -173,6 +227,79 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         batch_std_activate_visible<P, S>(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), as_derived().c, as_derived().w);
     }
 
+    /*!
+     * \brief Compute the reconstruction of a batch with a transposed copy of
+     * the weights [H x V].
+     *
+     * \param h_a The batch activation probabilities of the hidden representation
+     * \param h_s The batch activation samples of the hidden representation
+     * \param v_a The batch output of the visible activation probabilities
+     * \param v_s The batch output of the visible activation samples (not computed)
+     * \param w_t The transposed weights
+     */
+    template <typename H, typename V, typename WT>
+    void batch_activate_visible_transposed(const H& h_a, const H& h_s, V&& v_a, V&& v_s, const WT& w_t) const {
+        if constexpr (etl::all_dma<std::decay_t<V>>) {
+            dll::auto_timer timer("rbm:std:batch_activate_visible:transposed");
+
+            cpp_assert(etl::dim<0>(w_t) == etl::dim<1>(as_derived().w) && etl::dim<1>(w_t) == etl::dim<0>(as_derived().w), "Invalid transposed weights");
+
+            v_a = h_s * w_t;
+
+            fused_visible_activation<visible_unit, fast_activations>(v_a, as_derived().c);
+
+            nan_check_deep(v_a);
+        } else {
+            cpp_unused(w_t);
+
+            batch_activate_visible<true, false>(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s));
+        }
+    }
+
+    /*!
+     * \brief Compute the reconstruction of a batch and the hidden
+     * representation of this reconstruction (one step of the Gibbs chain).
+     *
+     * For large weights, the two products are computed together tile by
+     * tile of the weights, in order to read them only once from memory.
+     *
+     * \tparam S Compute the samples of the second hidden representation
+     *
+     * \param h_a The batch activation probabilities of the hidden representation
+     * \param h_s The batch activation samples of the hidden representation
+     * \param v_a The batch output of the visible activation probabilities
+     * \param v_s The batch output of the visible activation samples (not computed)
+     * \param h2_a The batch output of the second hidden activation probabilities
+     * \param h2_s The batch output of the second hidden activation samples
+     */
+    template <bool S = true, typename H, typename V, typename H2>
+    void batch_activate_visible_hidden(const H& h_a, const H& h_s, V&& v_a, V&& v_s, H2&& h2_a, H2&& h2_s) const {
+        constexpr bool blocked_units =
+            (visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN || visible_unit == unit_type::RELU)
+            && hidden_unit != unit_type::SOFTMAX;
+
+        if constexpr (blocked_units && etl::all_dma<std::decay_t<V>, std::decay_t<H2>, H>) {
+            if (etl::size(as_derived().w) * sizeof(weight) >= blocked_gibbs_threshold) {
+                dll::auto_timer timer("rbm:std:batch_activate_visible_hidden");
+
+                blocked_visible_hidden_activation<visible_unit, hidden_unit, S, fast_activations>(
+                    as_derived().sampler, h_s, v_a, h2_a, h2_s, as_derived().b, as_derived().c, as_derived().w);
+
+                nan_check_deep(v_a);
+                nan_check_deep(h2_a);
+
+                if (S) {
+                    nan_check_deep(h2_s);
+                }
+
+                return;
+            }
+        }
+
+        batch_activate_visible<true, false>(h_a, h_s, v_a, v_s);
+        batch_activate_hidden<true, S>(h2_a, h2_s, v_a, v_s);
+    }
+
     // batch_activate_hidden
 
     /*!
@@ -187,6 +314,70 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, as_derived().b, as_derived().w);
     }
 
+    /*!
+     * \brief Compute the hidden representation of a batch with the given
+     * weights and biases.
+     *
+     * Special functions to be used by optimizer.
+     *
+     * \param h_a The batch output to set the activation probabilities of the hidden representation
+     * \param h_s The batch output to set the activation samples of the hidden representation
+     * \param v_a The batch input activation probabilities of the visible representation
+     * \param v_s The batch input the activation samples of the visible representation
+     * \param b The biases
+     * \param w The weights
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, const B& b, const W& w) const {
+        batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w);
+    }
+
+    /*!
+     * \brief Compute the hidden representation from the given sparse input
+     * \param h_a The batch output to set the activation probabilities of the hidden representation
+     * \param h_s The batch output to set the activation samples of the hidden representation
+     * \param v The batch input of the visible representation, in CSR format
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename T>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const csr_batch<T>& v) const {
+        batch_std_activate_hidden_sparse<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v, as_derived().b, as_derived().w);
+    }
+
+    /*!
+     * \brief Compute the hidden representation from the given binary input
+     * \param h_a The batch output to set the activation probabilities of the hidden representation
+     * \param h_s The batch output to set the activation samples of the hidden representation
+     * \param v The batch input of the visible representation, bit-packed
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const bit_batch& v) const {
+        batch_std_activate_hidden_sparse<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v, as_derived().b, as_derived().w);
+    }
+
+    /*!
+     * \brief Compute the activation probabilities of the hidden units of
+     * binary input with the binarized weights of the RBM.
+     *
+     * The products are computed with popcounts, the biases and the
+     * activation are the ones of the RBM.
+     *
+     * \param h_a The batch output to set the activation probabilities
+     * \param v The batch input of the visible representation, bit-packed
+     * \param bw The weights of the RBM binarized with binarize_weights()
+     */
+    template <typename H>
+    void batch_activate_hidden(H&& h_a, const bit_batch& v, const binary_weights<weight>& bw) const {
+        static_assert(etl::all_dma<std::decay_t<H>> && hidden_unit != unit_type::SOFTMAX, "The binarized weights need a DMA output and element-wise hidden units");
+
+        cpp_assert(bw.inputs == as_derived().input_size() && v.rows == etl::dim<0>(h_a), "Invalid binarized weights or batch");
+
+        dll::auto_timer timer("rbm:std:batch_activate_hidden:binary_weights");
+
+        binary_weights_mul(h_a, v, bw);
+
+        fused_hidden_activation<hidden_unit, true, false, fast_activations>(as_derived().sampler, h_a, h_a, as_derived().b);
+    }
+
     /*!
      * \brief Compute the hidden representation from a given batch of input
      *
@@ -195,7 +386,19 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
      */
     template <typename H, typename V>
     void batch_activate_hidden(H&& h_a, const V& v_a) const {
-        if constexpr (etl::decay_traits<V>::dimensions() == 2) {
+        if constexpr (sparse_input && etl::all_dma<V>) {
+            auto& csr = csr_workspace<weight>();
+
+            csr.assign(etl::reshape(v_a, etl::dim(h_a, 0), as_derived().input_size()));
+
+            batch_std_activate_hidden_sparse<true, false>(std::forward<H>(h_a), std::forward<H>(h_a), csr, as_derived().b, as_derived().w);
+        } else if constexpr (binary_input && etl::all_dma<V>) {
+            auto& bits = bit_workspace();
+
+            bits.assign(etl::reshape(v_a, etl::dim(h_a, 0), as_derived().input_size()));
+
+            batch_std_activate_hidden_sparse<true, false>(std::forward<H>(h_a), std::forward<H>(h_a), bits, as_derived().b, as_derived().w);
+        } else if constexpr (etl::decay_traits<V>::dimensions() == 2) {
             batch_std_activate_hidden<true, false>(std::forward<H>(h_a), std::forward<H>(h_a), v_a, v_a, as_derived().b, as_derived().w);
         } else {
             batch_std_activate_hidden<true, false>(std::forward<H>(h_a), std::forward<H>(h_a),
@@ -204,6 +407,77 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         }
     }
 
+    // Sampling
+
+    /*!
+     * \brief Generate samples from the model with several Gibbs chains, run
+     * in parallel.
+     *
+     * Each chain starts from a row of init, runs burn_in Gibbs steps and
+     * then gives one sample every thinning steps. The samples of the chains
+     * are written round by round: the rth sample of the chain c is the row
+     * r * C + c of the output. The visible units are sampled between the
+     * steps (their mean is used for Gaussian and ReLU visible units) and the
+     * output is set to their activation probabilities.
+     *
+     * \param samples The output [N x V]
+     * \param init The initial visible states of the C chains [C x V]
+     * \param burn_in The number of Gibbs steps before the first sample (at least one)
+     * \param thinning The number of Gibbs steps between two samples of a chain
+     */
+    template <typename Samples, typename Init>
+    void sample_chains(Samples&& samples, const Init& init, size_t burn_in, size_t thinning = 1) const {
+        dll::auto_timer timer("rbm:std:sample_chains");
+
+        const size_t C  = etl::dim<0>(init);
+        const size_t N  = etl::dim<0>(samples);
+        const size_t NV = as_derived().input_size();
+        const size_t NH = as_derived().output_size();
+
+        cpp_assert(C > 0, "At least one chain is necessary");
+        cpp_assert(etl::dim<1>(init) == NV && etl::dim<1>(samples) == NV, "The samples must be in the visible space of the RBM");
+
+        const size_t rounds = (N + C - 1) / C;
+        const size_t shards = std::max<size_t>(1, std::min<size_t>(C, thread_budget()));
+
+        parallel_kernel(0, shards, [&](size_t s) {
+            const size_t first = s * C / shards;
+            const size_t last  = (s + 1) * C / shards;
+
+            if (first == last) {
+                return;
+            }
+
+            etl::dyn_matrix<weight, 2> v_a(last - first, NV);
+            etl::dyn_matrix<weight, 2> v_s(last - first, NV);
+            etl::dyn_matrix<weight, 2> h_a(last - first, NH);
+            etl::dyn_matrix<weight, 2> h_s(last - first, NH);
+
+            v_s = etl::slice(init, first, last);
+
+            for (size_t r = 0; r < rounds; ++r) {
+                const size_t steps = std::max<size_t>(1, r ? thinning : burn_in);
+
+                for (size_t k = 0; k < steps; ++k) {
+                    this->template batch_activate_hidden<true, true>(h_a, h_s, v_s, v_s);
+                    this->template batch_activate_visible<true, false>(h_a, h_s, v_a, v_s);
+
+                    if constexpr (visible_unit == unit_type::BINARY) {
+                        sample_bernoulli(as_derived().sampler, v_s, v_a);
+                    } else {
+                        v_s = v_a;
+                    }
+                }
+
+                for (size_t c = first; c < last; ++c) {
+                    if (r * C + c < N) {
+                        samples(r * C + c) = v_a(c - first);
+                    }
+                }
+            }
+        });
+    }
+
     //Display functions
 
     /*!
@@ -302,33 +576,22 @@ private:
      * \brief Initalize the weights using the training inputs
      */
     template <typename Generator>
-    static void init_weights(Generator& generator, parent_t& rbm) {
-        const auto size = generator.size();
+    static input_statistics init_weights(Generator& generator, parent_t& rbm, size_t max_samples = 0) {
+        // All the features are counted in a single pass over the batches
+        auto stats = compute_input_statistics(generator, max_samples);
+
+        cpp_assert(stats.features() == num_visible(rbm), "The size of the training sample must match visible units");
 
         //Initialize the visible biases to log(pi/(1-pi))
         for (size_t i = 0; i < num_visible(rbm); ++i) {
-            generator.reset();
-
-            size_t count = 0;
-
-            while(generator.has_next_batch()){
-                auto labels = generator.label_batch();
-
-                for(size_t b = 0; b < etl::dim<0>(labels); ++b){
-                    if(labels(b)[i] == 1){
-                        ++count;
-                    }
-                }
-
-                generator.next_batch();
-            }
-
-            auto pi = static_cast<double>(count) / size;
+            auto pi = stats.ones_ratio(i);
             pi += 0.0001;
             rbm.c(i) = log(pi / (1.0 - pi));
 
             cpp_assert(std::isfinite(rbm.c(i)), "NaN verify");
         }
+
+        return stats;
     }
 
     /*!
@@ -338,12 +601,18 @@ private:
     static void init_weights(Iterator first, Iterator last, parent_t& rbm) {
         auto size = std::distance(first, last);
 
+        std::vector<size_t> counts(num_visible(rbm), 0);
+
+        // Single pass over the samples, for all the visible units
+        for (auto it = first; it != last; ++it) {
+            for (size_t i = 0; i < num_visible(rbm); ++i) {
+                counts[i] += (*it)[i] == 1;
+            }
+        }
+
         //Initialize the visible biases to log(pi/(1-pi))
         for (size_t i = 0; i < num_visible(rbm); ++i) {
-            auto count = std::count_if(first, last,
-                                       [i](auto& a) { return a[i] == 1; });
-
-            auto pi = static_cast<double>(count) / size;
+            auto pi = static_cast<double>(counts[i]) / size;
             pi += 0.0001;
             rbm.c(i) = log(pi / (1.0 - pi));
 
@@ -499,7 +768,7 @@ private:
             H_PROBS(unit_type::SOFTMAX, h_a = stable_softmax(b + (v_a * w)));
 
             //Sample values from input
-            H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+            H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, h_s, h_a));
             H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b + (v_a * w)), 0.0));
             H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b + (v_a * w), 1.0), 0.0), 1.0));
             H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b + (v_a * w), 6.0), 0.0), 6.0));
@@ -548,8 +817,19 @@ private:
         }
     }
 
+    /*!
+     * \brief Compute the product of a batch of visible units with the
+     * weights, h = v * w.
+     *
+     * The dynamic RBM replaces it with the kernel of its shape.
+     */
+    template <typename H, typename V, typename W>
+    void hidden_product(H&& h, const V& v, const W& w) const {
+        h = v * w;
+    }
+
     template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
-    static void batch_std_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w) {
+    void batch_std_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w) const {
         dll::auto_timer timer("rbm:std:batch_activate_hidden");
 
         using namespace etl;
@@ -558,38 +838,140 @@ private:
 
         cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
 
-        H_PROBS(unit_type::BINARY, h_a = etl::sigmoid(rep_l(b, Batch) + v_a * w));
-        H_PROBS(unit_type::RELU, h_a = max(rep_l(b, Batch) + v_a * w, 0.0));
-        H_PROBS(unit_type::RELU1, h_a = min(max(rep_l(b, Batch) + v_a * w, 0.0), 1.0));
-        H_PROBS(unit_type::RELU6, h_a = min(max(rep_l(b, Batch) + v_a * w, 0.0), 6.0));
+        // The product is computed directly in the output, the bias, the
+        // activation and the sampling are then applied in a single pass
+        if constexpr (hidden_unit != unit_type::SOFTMAX && etl::all_dma<std::decay_t<H1>, std::decay_t<H2>>) {
+            if constexpr (P) {
+                as_derived().hidden_product(h_a, v_a, w);
+            } else {
+                as_derived().hidden_product(h_s, v_a, w);
+            }
 
-        H_PROBS_MULTI(unit_type::SOFTMAX){
-            auto x = etl::force_temporary(rep_l(b, Batch) + v_a * w);
+            fused_hidden_activation<hidden_unit, P, S, fast_activations>(as_derived().sampler, h_a, h_s, b);
+        } else {
+            H_PROBS(unit_type::BINARY, h_a = etl::sigmoid(rep_l(b, Batch) + v_a * w));
+            H_PROBS(unit_type::RELU, h_a = max(rep_l(b, Batch) + v_a * w, 0.0));
+            H_PROBS(unit_type::RELU1, h_a = min(max(rep_l(b, Batch) + v_a * w, 0.0), 1.0));
+            H_PROBS(unit_type::RELU6, h_a = min(max(rep_l(b, Batch) + v_a * w, 0.0), 6.0));
 
-            for (size_t b = 0; b < Batch; ++b) {
-                h_a(b) = stable_softmax(x(b));
+            H_PROBS_MULTI(unit_type::SOFTMAX){
+                auto x = etl::force_temporary(rep_l(b, Batch) + v_a * w);
+
+                for (size_t b = 0; b < Batch; ++b) {
+                    h_a(b) = stable_softmax(x(b));
+                }
             }
-        }
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
-        H_SAMPLE_PROBS_MULTI(unit_type::SOFTMAX){
-            for (size_t b = 0; b < Batch; ++b) {
-                h_s(b) = stable_softmax(h_a(b));
+            H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, h_s, h_a));
+            H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
+            H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
+            H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
+            H_SAMPLE_PROBS_MULTI(unit_type::SOFTMAX){
+                for (size_t b = 0; b < Batch; ++b) {
+                    h_s(b) = stable_softmax(h_a(b));
+                }
             }
+
+            H_SAMPLE_INPUT(unit_type::BINARY, h_s = bernoulli(etl::sigmoid(rep_l(b, Batch) + v_a * w)));
+            H_SAMPLE_INPUT(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
+            H_SAMPLE_INPUT(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
+            H_SAMPLE_INPUT(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
+            H_SAMPLE_INPUT_MULTI(unit_type::RELU1){
+                auto x = etl::force_temporary(rep_l(b, Batch) + v_a * w);
+
+                for (size_t b = 0; b < Batch; ++b) {
+                    h_s(b) = one_if_max(stable_softmax(x(b)));
+                }
+            }
+        }
+
+        if (P) {
+            nan_check_deep(h_a);
+        }
+
+        if (S) {
+            nan_check_deep(h_s);
         }
+    }
 
-        H_SAMPLE_INPUT(unit_type::BINARY, h_s = bernoulli(etl::sigmoid(rep_l(b, Batch) + v_a * w)));
-        H_SAMPLE_INPUT(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
-        H_SAMPLE_INPUT(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
-        H_SAMPLE_INPUT(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
-        H_SAMPLE_INPUT_MULTI(unit_type::RELU1){
-            auto x = etl::force_temporary(rep_l(b, Batch) + v_a * w);
+    /*!
+     * \brief Compute the product of a CSR batch with the weights
+     */
+    template <typename H, typename T, typename W>
+    static void sparse_product(H&& h, const csr_batch<T>& v, const W& w) {
+        csr_mul(h, v, w);
+    }
+
+    /*!
+     * \brief Compute the product of a bit-packed batch with the weights
+     */
+    template <typename H, typename W>
+    static void sparse_product(H&& h, const bit_batch& v, const W& w) {
+        bit_mul(h, v, w);
+    }
+
+    /*!
+     * \brief Compute the hidden representation of a sparse (CSR) or a
+     * binary (bit-packed) batch.
+     *
+     * The product with the weights is computed from the non-zeros of the
+     * input, the activation functions are then the same as for the dense
+     * input.
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename SV, typename B, typename W>
+    void batch_std_activate_hidden_sparse(H1&& h_a, H2&& h_s, const SV& v, const B& b, const W& w) const {
+        dll::auto_timer timer("rbm:std:batch_activate_hidden:sparse");
 
-            for (size_t b = 0; b < Batch; ++b) {
-                h_s(b) = one_if_max(stable_softmax(x(b)));
+        using namespace etl;
+
+        const auto Batch = etl::dim<0>(h_a);
+
+        cpp_assert(etl::dim<0>(h_s) == Batch && v.rows == Batch, "The number of batch must be consistent");
+
+        if constexpr (hidden_unit != unit_type::SOFTMAX && etl::all_dma<std::decay_t<H1>, std::decay_t<H2>>) {
+            if constexpr (P) {
+                sparse_product(h_a, v, w);
+            } else {
+                sparse_product(h_s, v, w);
+            }
+
+            fused_hidden_activation<hidden_unit, P, S, fast_activations>(as_derived().sampler, h_a, h_s, b);
+        } else {
+            etl::dyn_matrix<weight, 2> x(Batch, etl::dim<1>(w));
+
+            sparse_product(x, v, w);
+
+            x = rep_l(b, Batch) + x;
+
+            H_PROBS(unit_type::BINARY, h_a = etl::sigmoid(x));
+            H_PROBS(unit_type::RELU, h_a = max(x, 0.0));
+            H_PROBS(unit_type::RELU1, h_a = min(max(x, 0.0), 1.0));
+            H_PROBS(unit_type::RELU6, h_a = min(max(x, 0.0), 6.0));
+
+            H_PROBS_MULTI(unit_type::SOFTMAX){
+                for (size_t b = 0; b < Batch; ++b) {
+                    h_a(b) = stable_softmax(x(b));
+                }
+            }
+
+            H_SAMPLE_PROBS(unit_type::BINARY, sample_bernoulli(as_derived().sampler, h_s, h_a));
+            H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(x), 0.0));
+            H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(x, 1.0), 0.0), 1.0));
+            H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(x, 6.0), 0.0), 6.0));
+            H_SAMPLE_PROBS_MULTI(unit_type::SOFTMAX){
+                for (size_t b = 0; b < Batch; ++b) {
+                    h_s(b) = stable_softmax(h_a(b));
+                }
+            }
+
+            H_SAMPLE_INPUT(unit_type::BINARY, h_s = bernoulli(etl::sigmoid(x)));
+            H_SAMPLE_INPUT(unit_type::RELU, h_s = max(logistic_noise(x), 0.0));
+            H_SAMPLE_INPUT(unit_type::RELU1, h_s = min(max(ranged_noise(x, 1.0), 0.0), 1.0));
+            H_SAMPLE_INPUT(unit_type::RELU6, h_s = min(max(ranged_noise(x, 6.0), 0.0), 6.0));
+            H_SAMPLE_INPUT_MULTI(unit_type::SOFTMAX){
+                for (size_t b = 0; b < Batch; ++b) {
+                    h_s(b) = one_if_max(stable_softmax(x(b)));
+                }
             }
         }
 
@@ -612,13 +994,19 @@ private:
 
         cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
 
-        V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s))));
-        V_PROBS(unit_type::GAUSSIAN, v_a = rep_l(c, Batch) + transpose(w * transpose(h_s)));
-        V_PROBS(unit_type::RELU, v_a = max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0));
+        if constexpr (P && etl::all_dma<std::decay_t<V>>) {
+            v_a = h_s * etl::transpose(w);
 
-        V_SAMPLE_INPUT(unit_type::BINARY, v_s = bernoulli(etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s)))));
-        V_SAMPLE_INPUT(unit_type::GAUSSIAN, v_s = normal_noise(rep_l(c, Batch) + transpose(w * transpose(h_s))));
-        V_SAMPLE_INPUT(unit_type::RELU, v_s = logistic_noise(max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0)));
+            fused_visible_activation<visible_unit, fast_activations>(v_a, c);
+        } else {
+            V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s))));
+            V_PROBS(unit_type::GAUSSIAN, v_a = rep_l(c, Batch) + transpose(w * transpose(h_s)));
+            V_PROBS(unit_type::RELU, v_a = max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0));
+
+            V_SAMPLE_INPUT(unit_type::BINARY, v_s = bernoulli(etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s)))));
+            V_SAMPLE_INPUT(unit_type::GAUSSIAN, v_s = normal_noise(rep_l(c, Batch) + transpose(w * transpose(h_s))));
+            V_SAMPLE_INPUT(unit_type::RELU, v_s = logistic_noise(max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0)));
+        }
 
         if (P) {
             nan_check_deep(v_a);
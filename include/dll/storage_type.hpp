@@ -0,0 +1,22 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+namespace dll {
+
+/*!
+ * \brief The storage types of the data caches
+ */
+enum class storage_type {
+    NATIVE, ///< The samples are stored with their own type
+    UINT8,  ///< The samples are stored as 8-bit unsigned integers (raw pixels)
+    FP16,   ///< The samples are stored as IEEE half-precision floating points
+    BF16    ///< The samples are stored as bfloat16 floating points
+};
+
+} //end of dll namespace
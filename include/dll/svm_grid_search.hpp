@@ -0,0 +1,242 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Parallel grid search of the parameters of a RBF SVM
+ */
+
+#pragma once
+
+//SVM Support is optional cause it requires libsvm
+
+#ifdef DLL_SVM_SUPPORT
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+#include "nice_svm.hpp"
+
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The result of a grid search
+ */
+struct svm_grid_result {
+    double c        = 0.0; ///< The best C
+    double gamma    = 0.0; ///< The best gamma
+    double accuracy = 0.0; ///< The cross-validation accuracy of the best point
+    size_t points   = 0;   ///< The number of points of the grid
+    size_t pruned   = 0;   ///< The number of points that were not completely evaluated
+};
+
+/*!
+ * \brief Returns the values of one axis of the grid
+ */
+inline std::vector<double> svm_grid_values(double first, double last, size_t steps, svm::grid_search_type type) {
+    std::vector<double> values;
+
+    for (size_t i = 0; i < steps; ++i) {
+        const double t = steps > 1 ? double(i) / (steps - 1) : 0.0;
+
+        if (type == svm::grid_search_type::EXP) {
+            values.push_back(first * std::pow(last / first, t));
+        } else {
+            values.push_back(first + t * (last - first));
+        }
+    }
+
+    return values;
+}
+
+/*!
+ * \brief The subproblems of the folds of a cross validation.
+ *
+ * The subproblems only point to the samples of the complete problem, no
+ * sample is copied.
+ */
+struct svm_folds {
+    std::vector<size_t> perm;              ///< The shuffled indices of the samples
+    std::vector<size_t> starts;            ///< The first position of each fold in perm
+    std::vector<std::vector<double>> y;    ///< The labels of the training set of each fold
+    std::vector<std::vector<svm_node*>> x; ///< The samples of the training set of each fold
+    std::vector<svm_problem> problems;     ///< The training problem of each fold
+
+    /*!
+     * \brief Split the given problem into n_fold folds
+     */
+    svm_folds(const svm_problem& problem, size_t n_fold) {
+        const size_t n = problem.l;
+
+        perm.resize(n);
+        std::iota(perm.begin(), perm.end(), 0);
+        std::shuffle(perm.begin(), perm.end(), dll::rand_engine());
+
+        for (size_t f = 0; f <= n_fold; ++f) {
+            starts.push_back(f * n / n_fold);
+        }
+
+        y.resize(n_fold);
+        x.resize(n_fold);
+        problems.resize(n_fold);
+
+        for (size_t f = 0; f < n_fold; ++f) {
+            for (size_t p = 0; p < n; ++p) {
+                if (p < starts[f] || p >= starts[f + 1]) {
+                    y[f].push_back(problem.y[perm[p]]);
+                    x[f].push_back(problem.x[perm[p]]);
+                }
+            }
+
+            problems[f].l = y[f].size();
+            problems[f].y = y[f].data();
+            problems[f].x = x[f].data();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of folds
+     */
+    size_t size() const {
+        return problems.size();
+    }
+};
+
+/*!
+ * \brief Perform a grid search of C and gamma, with cross validation, on
+ * the given thread pool.
+ *
+ * Each fold of each point of the grid is an independent task, all the tasks
+ * share the same read-only problem. A point is pruned as soon as it cannot
+ * reach the accuracy of the best point anymore, even if all its remaining
+ * samples were correctly classified.
+ *
+ * \param pool The thread pool
+ * \param problem The problem
+ * \param parameters The parameters of the SVM, C and gamma are searched
+ * \param n_fold The number of folds of the cross validation
+ * \param g The grid to search
+ * \param out The stream to report the progress to
+ * \return The result of the search
+ */
+template <typename Pool, typename Out>
+svm_grid_result svm_parallel_grid_search(Pool& pool, const svm_problem& problem, svm_parameter parameters, size_t n_fold, const svm::rbf_grid& g, Out& out) {
+    // The probability estimates would run another cross-validation
+    parameters.probability = 0;
+
+    const auto c_values     = svm_grid_values(g.c_first, g.c_last, g.c_steps, g.c_search);
+    const auto gamma_values = svm_grid_values(g.gamma_first, g.gamma_last, g.gamma_steps, g.gamma_search);
+
+    const size_t n      = problem.l;
+    const size_t points = c_values.size() * gamma_values.size();
+
+    svm_folds folds(problem, std::max(size_t(2), std::min(n_fold, n)));
+
+    std::vector<size_t> correct(points, 0);
+    std::vector<size_t> evaluated(points, 0);
+    std::vector<bool> pruned(points, false);
+
+    size_t best      = points;
+    size_t best_hits = 0;
+    size_t done      = 0;
+
+    std::mutex lock;
+
+    // Done when the point is complete, under the lock
+    auto report = [&](size_t p) {
+        ++done;
+
+        if (!pruned[p] && (best == points || correct[p] > best_hits)) {
+            best      = p;
+            best_hits = correct[p];
+        }
+
+        if (pruned[p]) {
+            out << "Grid search [" << done << "/" << points << "] C=" << c_values[p / gamma_values.size()]
+                << " gamma=" << gamma_values[p % gamma_values.size()] << " pruned" << std::endl;
+        } else {
+            out << "Grid search [" << done << "/" << points << "] C=" << c_values[p / gamma_values.size()]
+                << " gamma=" << gamma_values[p % gamma_values.size()] << " accuracy=" << (100.0 * correct[p] / n) << "%" << std::endl;
+        }
+    };
+
+    for (size_t p = 0; p < points; ++p) {
+        for (size_t f = 0; f < folds.size(); ++f) {
+            pool.do_task([&, p, f]() {
+                const size_t first = folds.starts[f];
+                const size_t last  = folds.starts[f + 1];
+
+                {
+                    std::lock_guard<std::mutex> l(lock);
+
+                    // Even with all the remaining samples correct, the point would not be better
+                    if (pruned[p] || (best != points && correct[p] + (n - evaluated[p]) <= best_hits)) {
+                        pruned[p] = true;
+                        evaluated[p] += last - first;
+
+                        if (evaluated[p] == n) {
+                            report(p);
+                        }
+
+                        return;
+                    }
+                }
+
+                auto local = parameters;
+
+                local.C     = c_values[p / gamma_values.size()];
+                local.gamma = gamma_values[p % gamma_values.size()];
+
+                auto* model = ::svm_train(&folds.problems[f], &local);
+
+                size_t hits = 0;
+
+                for (size_t i = first; i < last; ++i) {
+                    hits += ::svm_predict(model, problem.x[folds.perm[i]]) == problem.y[folds.perm[i]];
+                }
+
+                ::svm_free_and_destroy_model(&model);
+
+                std::lock_guard<std::mutex> l(lock);
+
+                correct[p] += hits;
+                evaluated[p] += last - first;
+
+                if (evaluated[p] == n) {
+                    report(p);
+                }
+            });
+        }
+    }
+
+    pool.wait();
+
+    svm_grid_result result;
+
+    result.points = points;
+    result.pruned = std::count(pruned.begin(), pruned.end(), true);
+
+    if (best != points) {
+        result.c        = c_values[best / gamma_values.size()];
+        result.gamma    = gamma_values[best % gamma_values.size()];
+        result.accuracy = double(best_hits) / n;
+    }
+
+    out << "Best: C=" << result.c << " gamma=" << result.gamma << " accuracy=" << (100.0 * result.accuracy) << "%"
+        << " (" << result.pruned << "/" << points << " points pruned)" << std::endl;
+
+    return result;
+}
+
+} //end of dll namespace
+
+#endif //DLL_SVM_SUPPORT
@@ -7,8 +7,19 @@
 
 #pragma once
 
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
 #include "cpp_utils/stop_watch.hpp"
 
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/loss_kernels.hpp"
+#include "dll/util/parallel.hpp"
+
 namespace dll {
 
 /*!
@@ -56,6 +67,63 @@ struct label_predictor {
     }
 };
 
+/*!
+ * \brief Compute the index of the maximum of each row of the given batch
+ * of outputs [N x ...], in parallel over the rows.
+ *
+ * Each row is scanned twice, once for its maximum and once for its first
+ * position, both loops being vectorized by the compiler.
+ *
+ * \param output The batch of outputs
+ * \param predicted The indices of the maximums
+ */
+template <typename Output>
+void argmax_rows(const Output& output, std::vector<size_t>& predicted) {
+    const size_t n = etl::dim<0>(output);
+    const size_t k = etl::size(output) / n;
+
+    predicted.resize(n);
+
+    cpu_access(output);
+
+    const auto* out = output.memory_start();
+
+    parallel_kernel(0, n, [&](size_t i) {
+        const auto* row = out + i * k;
+
+        auto max = row[0];
+
+        for (size_t j = 1; j < k; ++j) {
+            max = row[j] > max ? row[j] : max;
+        }
+
+        size_t index = 0;
+
+        while (index + 1 < k && row[index] != max) {
+            ++index;
+        }
+
+        predicted[i] = index;
+    });
+}
+
+/*!
+ * \brief Utility to predict the labels of a batch of inputs with the batched
+ * forward path of the network
+ */
+struct batch_predictor {
+    /*!
+     * \brief Compute the predicted labels of the given batch using the given
+     * DBN
+     */
+    template <typename T, typename B>
+    void operator()(T& dbn, const B& batch, std::vector<size_t>& predicted) {
+        const auto output = dbn->forward_batch(batch);
+
+        argmax_rows(output, predicted);
+    }
+};
+
 template <typename DBN, typename Functor, typename Samples, typename Labels>
 double test_set(DBN& dbn, const Samples& images, const Labels& labels, Functor&& f) {
     return test_set(dbn, images.begin(), images.end(), labels.begin(), labels.end(), std::forward<Functor>(f));
@@ -84,6 +152,159 @@ double test_set(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIter
     return (images - success) / static_cast<double>(images);
 }
 
+namespace test_detail {
+
+/*!
+ * \brief Allocate a batch of n samples of the same shape as the given sample
+ */
+template <typename Batch, typename Sample, size_t... I>
+Batch make_batch(size_t n, const Sample& sample, std::index_sequence<I...> /*seq*/) {
+    return Batch(n, etl::dim<I>(sample)...);
+}
+
+/*!
+ * \brief Copy the samples by blocks of batch_size into a batch and call the
+ * functor on each batch, with its number of samples
+ */
+template <typename Iterator, typename Functor>
+void for_each_batch(Iterator first, Iterator last, size_t batch_size, Functor&& f) {
+    using sample_t = std::decay_t<decltype(*first)>;
+    using weight   = etl::value_t<sample_t>;
+    using batch_t  = etl::dyn_matrix<weight, etl::dimensions<sample_t>() + 1>;
+
+    static constexpr size_t D = etl::dimensions<sample_t>();
+
+    batch_t batch;
+
+    while (first != last) {
+        const size_t n = std::min<size_t>(batch_size, std::distance(first, last));
+
+        if (etl::dim<0>(batch) != n || etl::size(batch) != n * etl::size(*first)) {
+            batch = make_batch<batch_t>(n, *first, std::make_index_sequence<D>());
+        }
+
+        for (size_t i = 0; i < n; ++i, ++first) {
+            batch(i) = *first;
+        }
+
+        f(batch, n);
+    }
+}
+
+} //end of namespace test_detail
+
+/*!
+ * \brief Compute the classification error of the network on the given
+ * samples, by batches.
+ *
+ * The samples are copied by blocks of batch_size into a batch, whose labels
+ * are predicted at once by the batch functor (batch_predictor).
+ *
+ * \param dbn The network
+ * \param first The beginning of the range of the samples
+ * \param last The end of the range of the samples
+ * \param lfirst The beginning of the range of the labels
+ * \param f The batch functor predicting the labels of a batch
+ * \param batch_size The number of samples predicted at once
+ *
+ * \return The classification error
+ */
+template <typename DBN, typename Functor, typename Iterator, typename LIterator>
+double test_set_batch(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator /*llast*/, Functor&& f, size_t batch_size = 256) {
+    size_t success = 0;
+    size_t images  = 0;
+
+    std::vector<size_t> predicted;
+
+    test_detail::for_each_batch(first, last, batch_size, [&](const auto& batch, size_t n) {
+        f(dbn, batch, predicted);
+
+        for (size_t i = 0; i < n; ++i, ++lfirst) {
+            success += predicted[i] == size_t(*lfirst);
+        }
+
+        images += n;
+    });
+
+    return images ? (images - success) / static_cast<double>(images) : 0.0;
+}
+
+/*!
+ * \brief Compute the classification error of the network on the given
+ * samples, by batches.
+ *
+ * \param dbn The network
+ * \param images The container of samples
+ * \param labels The container of labels
+ * \param f The batch functor predicting the labels of a batch
+ * \param batch_size The number of samples predicted at once
+ *
+ * \return The classification error
+ */
+template <typename DBN, typename Functor, typename Samples, typename Labels>
+double test_set_batch(DBN& dbn, const Samples& images, const Labels& labels, Functor&& f, size_t batch_size = 256) {
+    return test_set_batch(dbn, images.begin(), images.end(), labels.begin(), labels.end(), std::forward<Functor>(f), batch_size);
+}
+
+/*!
+ * \brief Compute the top-k classification error of the network on the
+ * given samples, by batches: a sample is misclassified when its label is
+ * not one of the k largest outputs of the network.
+ *
+ * The outputs of each batch are computed with the batched forward path of
+ * the network and the rank of the labels in parallel over the samples,
+ * without sorting the outputs.
+ *
+ * \param dbn The network
+ * \param first The beginning of the range of the samples
+ * \param last The end of the range of the samples
+ * \param lfirst The beginning of the range of the labels
+ * \param k The number of classes considered for each sample
+ * \param batch_size The number of samples predicted at once
+ *
+ * \return The top-k classification error
+ */
+template <typename DBN, typename Iterator, typename LIterator>
+double test_set_top_k(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIterator /*llast*/, size_t k, size_t batch_size = 256) {
+    double errors = 0.0;
+    size_t images = 0;
+
+    std::vector<size_t> labels;
+
+    test_detail::for_each_batch(first, last, batch_size, [&](const auto& batch, size_t n) {
+        labels.resize(n);
+
+        for (size_t i = 0; i < n; ++i, ++lfirst) {
+            labels[i] = size_t(*lfirst);
+        }
+
+        const auto output = dbn->forward_batch(batch);
+
+        errors += top_k_errors(output, n, k, [&labels](size_t i) { return labels[i]; });
+
+        images += n;
+    });
+
+    return images ? errors / static_cast<double>(images) : 0.0;
+}
+
+/*!
+ * \brief Compute the top-k classification error of the network on the
+ * given samples, by batches.
+ *
+ * \param dbn The network
+ * \param images The container of samples
+ * \param labels The container of labels
+ * \param k The number of classes considered for each sample
+ * \param batch_size The number of samples predicted at once
+ *
+ * \return The top-k classification error
+ */
+template <typename DBN, typename Samples, typename Labels>
+double test_set_top_k(DBN& dbn, const Samples& images, const Labels& labels, size_t k, size_t batch_size = 256) {
+    return test_set_top_k(dbn, images.begin(), images.end(), labels.begin(), labels.end(), k, batch_size);
+}
+
 template <typename DBN, typename Samples>
 double test_set_ae(DBN& dbn, const Samples& images) {
     return test_set_ae(dbn, images.begin(), images.end());
@@ -12,6 +12,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
 #include <string>
 #include <fstream>
 #include <iostream>
@@ -24,16 +28,38 @@
 #include "cpp_utils/tmp.hpp"
 #include "etl/etl_light.hpp"
 
+#include "dll/util/parallel.hpp"
+
 namespace dll {
 namespace text {
 
-template<typename Container, typename Functor>
-void read_images(Container& images, const std::string& path, size_t limit, Functor func){
-    using Image = typename Container::value_type;
+namespace text_detail {
+
+/*!
+ * \brief A sample file of a text directory
+ */
+struct sample_file {
+    size_t id;        ///< The index of the sample, starting at one
+    std::string path; ///< The full path of the file
+};
+
+/*!
+ * \brief List the sample files (<id>.dat) of the given directory
+ * \param path The directory
+ * \param limit The maximum number of samples (0 for no limit)
+ * \return the selected files, in directory order
+ */
+inline std::vector<sample_file> list_files(const std::string& path, size_t limit) {
+    std::vector<sample_file> files;
 
-    struct dirent* entry;
     auto dir = opendir(path.c_str());
 
+    if (!dir) {
+        return files;
+    }
+
+    struct dirent* entry;
+
     while ((entry = readdir(dir))) {
         std::string file_name(entry->d_name);
 
@@ -43,49 +69,226 @@ void read_images(Container& images, const std::string& path, size_t limit, Funct
 
         int id = std::atoi(std::string(file_name.begin(), file_name.begin() + file_name.size() - 4).c_str());
 
-        if(!limit || id - 1 < (int) limit){
-            std::vector<double> temp;
+        if (id > 0 && (!limit || id - 1 < (int) limit)) {
+            files.push_back({size_t(id), path + "/" + file_name});
+        }
+    }
+
+    closedir(dir);
 
-            std::string full_path(path + "/" + file_name);
+    return files;
+}
 
-            std::ifstream file(full_path);
+/*!
+ * \brief Read the complete file in the given buffer, which is reused
+ * between calls
+ * \return true if the file could be read, false otherwise
+ */
+inline bool read_file(const std::string& path, std::string& buffer) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
 
-            size_t lines = 0;
-            size_t columns = 0;
+    if (!file) {
+        return false;
+    }
 
-            // There is a bug in G++7.1 that causes this false positive
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wstrict-aliasing"
-            std::string line;
-            while (std::getline(file, line)) {
-                std::istringstream ss(line);
-                std::string value;
+    buffer.resize(static_cast<size_t>(file.tellg()));
 
-                while (std::getline(ss, value, ';')) {
-                    auto v = std::atof(value.c_str());
-                    temp.push_back(v);
+    file.seekg(0);
+    file.read(buffer.data(), buffer.size());
 
-                    if(lines == 0){
-                        ++columns;
-                    }
-                }
+    return true;
+}
 
-                ++lines;
-            }
-#pragma GCC diagnostic pop
+/*!
+ * \brief Parse one value, an empty value is zero
+ */
+inline double parse_value(const char* first, const char* last) {
+    while (first < last && (*first == ' ' || *first == '\t')) {
+        ++first;
+    }
+
+    if (first < last && *first == '+') {
+        ++first;
+    }
+
+    double value = 0.0;
+
+#ifdef __cpp_lib_to_chars
+    std::from_chars(first, last, value);
+#else
+    // The buffer is null-terminated and strtod stops at the separator
+    if (first < last) {
+        value = std::strtod(first, nullptr);
+    }
+#endif
+
+    return value;
+}
+
+/*!
+ * \brief Parse the values of a sample, separated by ';', one row per line
+ *
+ * \param first The beginning of the text
+ * \param last The end of the text
+ * \param fun The functor called with the index and the value of each value
+ *
+ * \return the number of lines and the number of columns of the first line
+ */
+template <typename Functor>
+std::pair<size_t, size_t> parse_values(const char* first, const char* last, Functor&& fun) {
+    size_t lines   = 0;
+    size_t columns = 0;
+    size_t i       = 0;
+
+    while (first < last) {
+        const char* eol = std::find(first, last, '\n');
+
+        while (first < eol) {
+            const char* sep = std::find(first, eol, ';');
 
-            if((int) images.size() < id){
-                images.resize(id);
+            fun(i++, parse_value(first, sep));
+
+            if (lines == 0) {
+                ++columns;
             }
 
-            images[id - 1] = func(1, lines, columns);
+            first = sep == eol ? eol : sep + 1;
+        }
+
+        ++lines;
 
-            size_t i = 0;
-            for (auto& value : temp) {
-                images[id - 1][i++] = static_cast<typename Image::value_type>(value);
+        first = eol == last ? last : eol + 1;
+    }
+
+    return {lines, columns};
+}
+
+} //end of namespace text_detail
+
+/*!
+ * \brief Read the samples of the given directory into the given container.
+ *
+ * The files are parsed in parallel, each one from a single buffer.
+ *
+ * \param images The container of samples
+ * \param path The directory of the samples
+ * \param limit The maximum number of samples (0 for no limit)
+ * \param func The functor creating one sample from its dimensions
+ */
+template<typename Container, typename Functor>
+void read_images(Container& images, const std::string& path, size_t limit, Functor func){
+    using Image = typename Container::value_type;
+
+    auto files = text_detail::list_files(path, limit);
+
+    size_t n = images.size();
+
+    for (auto& file : files) {
+        n = std::max(n, file.id);
+    }
+
+    images.resize(n);
+
+    parallel_kernel(0, files.size(), [&](size_t f) {
+        thread_local std::string buffer;
+        thread_local std::vector<double> temp;
+
+        auto& file = files[f];
+
+        if (!text_detail::read_file(file.path, buffer)) {
+            return;
+        }
+
+        temp.clear();
+
+        auto [lines, columns] = text_detail::parse_values(buffer.data(), buffer.data() + buffer.size(), [](size_t /*i*/, double v) {
+            temp.push_back(v);
+        });
+
+        auto& image = images[file.id - 1];
+
+        image = func(1, lines, columns);
+
+        size_t i = 0;
+        for (auto& value : temp) {
+            image[i++] = static_cast<typename Image::value_type>(value);
+        }
+    });
+}
+
+/*!
+ * \brief Read the samples of the given directory into a single contiguous
+ * tensor [N x 1 x H x W].
+ *
+ * The files are parsed in parallel, directly into the tensor. All the
+ * samples must have the dimensions of the first one. The missing samples
+ * are set to zero.
+ *
+ * \param path The directory of the samples
+ * \param limit The maximum number of samples (0 for no limit)
+ *
+ * \return the tensor of all the samples
+ */
+template <typename T = float>
+etl::dyn_matrix<T, 4> read_images_tensor(const std::string& path, size_t limit = 0) {
+    auto files = text_detail::list_files(path, limit);
+
+    if (files.empty()) {
+        return {};
+    }
+
+    size_t n = 0;
+
+    for (auto& file : files) {
+        n = std::max(n, file.id);
+    }
+
+    // The dimensions of the samples are those of the first file
+
+    std::string first;
+
+    text_detail::read_file(files.front().path, first);
+
+    auto [lines, columns] = text_detail::parse_values(first.data(), first.data() + first.size(), [](size_t /*i*/, double /*v*/) {});
+
+    const size_t S = lines * columns;
+
+    etl::dyn_matrix<T, 4> images(n, 1, lines, columns);
+
+    T* memory = images.memory_start();
+
+    std::fill_n(memory, images.size(), T(0));
+
+    std::atomic<bool> invalid(false);
+
+    parallel_kernel(0, files.size(), [&](size_t f) {
+        thread_local std::string buffer;
+
+        auto& file = files[f];
+
+        if (!text_detail::read_file(file.path, buffer)) {
+            invalid = true;
+            return;
+        }
+
+        T* sample = memory + (file.id - 1) * S;
+
+        auto dims = text_detail::parse_values(buffer.data(), buffer.data() + buffer.size(), [sample, S](size_t i, double v) {
+            if (i < S) {
+                sample[i] = static_cast<T>(v);
             }
+        });
+
+        if (dims.first * dims.second != S) {
+            invalid = true;
         }
+    });
+
+    if (invalid) {
+        std::cerr << "ERROR: Some samples could not be read or do not have the same dimensions in " << path << std::endl;
     }
+
+    return images;
 }
 
 template<template<typename...> typename  Container = std::vector, typename Label = uint8_t>
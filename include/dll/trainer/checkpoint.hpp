@@ -0,0 +1,118 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Utilities for the activation checkpointing of the SGD trainer
+ */
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "dll/dbn_detail.hpp"
+#include "dll/util/memory.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The peak memory of the activations held by the training contexts
+ */
+struct context_memory_report {
+    size_t full         = 0; ///< The bytes of the activations when every layer is kept
+    size_t checkpointed = 0; ///< The peak bytes of the activations with checkpointing
+};
+
+/*!
+ * \brief Indicates if the training forward pass of the layer can be
+ * computed a second time for the same batch.
+ *
+ * The dropout layers would draw a different mask and the batch
+ * normalization layers would update their running statistics twice.
+ */
+template <typename L, typename Enable = void>
+struct is_recomputable_layer : std::bool_constant<!dbn_detail::is_inference_identity<L>::value> {};
+
+template <typename L>
+struct is_recomputable_layer<L, std::enable_if_t<L::foldable_normalization>> : std::false_type {};
+
+/*!
+ * \brief Indicates if all the layers of the DBN before the layer First can
+ * be recomputed
+ */
+template <typename DBN, size_t First, size_t... I>
+constexpr bool are_recomputable_layers(std::index_sequence<I...> /*seq*/) {
+    return ((I >= First || is_recomputable_layer<typename DBN::template layer_type<I>>::value) && ...);
+}
+
+/*!
+ * \brief Release the memory of a buffer, saving its shape.
+ *
+ * Only the dynamic buffers can be released, the storage of the static
+ * buffers is part of their type.
+ *
+ * \param m The buffer to release
+ * \param dims The saved shape of the buffer
+ * \return The number of released bytes
+ */
+template <typename M>
+size_t release_buffer(M& m, std::vector<size_t>& dims) {
+    if constexpr (!etl::is_fast<M>) {
+        if (dims.empty() && etl::size(m)) {
+            const size_t bytes = buffer_bytes(m);
+
+            for (size_t d = 0; d < etl::dimensions(m); ++d) {
+                dims.push_back(etl::dim(m, d));
+            }
+
+            m = M();
+
+            return bytes;
+        }
+    } else {
+        cpp_unused(m);
+        cpp_unused(dims);
+    }
+
+    return 0;
+}
+
+/*!
+ * \brief Allocate again a buffer released by release_buffer
+ */
+template <typename M, size_t... I>
+void restore_buffer(M& m, const std::vector<size_t>& dims, std::index_sequence<I...> /*seq*/) {
+    m = M(dims[I]...);
+}
+
+/*!
+ * \brief Allocate again a buffer released by release_buffer, if necessary.
+ *
+ * \param m The buffer to restore
+ * \param dims The saved shape of the buffer
+ * \return The number of allocated bytes
+ */
+template <typename M>
+size_t restore_buffer(M& m, std::vector<size_t>& dims) {
+    if constexpr (!etl::is_fast<M>) {
+        if (!dims.empty()) {
+            restore_buffer(m, dims, std::make_index_sequence<etl::decay_traits<M>::dimensions()>());
+
+            dims.clear();
+
+            return buffer_bytes(m);
+        }
+    } else {
+        cpp_unused(m);
+        cpp_unused(dims);
+    }
+
+    return 0;
+}
+
+} //end of dll namespace
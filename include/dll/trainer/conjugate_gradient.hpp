@@ -18,23 +18,21 @@
 
 #include <utility>
 
-#include "dll/util/batch.hpp"
-
 namespace dll {
 
 /*!
  * \brief The context of the gradient search for a batch
  */
-template <typename Sample, typename Label>
+template <typename Inputs, typename Labels>
 struct gradient_context {
     size_t max_iterations; ///< The maximum number of iterations
     size_t epoch;          ///< The current epoch
-    batch<Sample> inputs;  ///< The inputs
-    batch<Label> targets;  ///< The targets
+    const Inputs& inputs;  ///< The batch of inputs
+    const Labels& targets; ///< The batch of targets
     size_t start_layer;    ///< The index of the starting layer
 
-    gradient_context(batch<Sample> i, batch<Label> t, size_t e)
-            : max_iterations(5), epoch(e), inputs(std::move(i)), targets(std::move(t)), start_layer(0) {
+    gradient_context(const Inputs& i, const Labels& t, size_t e)
+            : max_iterations(5), epoch(e), inputs(i), targets(t), start_layer(0) {
         //Nothing else to init
     }
 };
@@ -67,18 +65,7 @@ struct cg_trainer_base {
      * \param batch_size The batch size of the network
      */
     void init_training(size_t batch_size) {
-        dbn.for_each_layer([batch_size](auto& rbm) {
-            auto& ctx = rbm.get_cg_context();
-
-            if (ctx.is_trained) {
-                const auto n_hidden = num_hidden(rbm);
-
-                for (size_t i = 0; i < batch_size; ++i) {
-                    ctx.gr_probs_a.emplace_back(n_hidden);
-                    ctx.gr_probs_s.emplace_back(n_hidden);
-                }
-            }
-        });
+        prepare_batch(batch_size);
     }
 
     /*!
@@ -92,191 +79,108 @@ struct cg_trainer_base {
      */
     template <typename Inputs, typename Labels>
     std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
-        using T = etl::dyn_matrix<etl::value_t<Inputs>, etl::decay_traits<Inputs>::dimensions() - 1>;
-        using L = etl::dyn_matrix<etl::value_t<Labels>, etl::decay_traits<Labels>::dimensions() - 1>;
+        static_assert(etl::decay_traits<Inputs>::dimensions() == 2, "CG only supports batches of 1D inputs");
 
-        std::vector<T> inputs_cache(etl::dim<0>(inputs));
-        std::vector<L> labels_cache(etl::dim<0>(labels));
-
-        for(size_t i = 0; i < etl::dim<0>(inputs); ++i){
-            inputs_cache[i] = inputs(i);
-            labels_cache[i] = labels(i);
-        }
-
-        gradient_context<decltype(inputs_cache.begin()), decltype(labels_cache.begin())> context(
-            make_batch(inputs_cache.begin(), inputs_cache.end()),
-            make_batch(labels_cache.begin(), labels_cache.end()),
-            epoch);
+        gradient_context<Inputs, Labels> context(inputs, labels, epoch);
 
         minimize(context);
 
-        //TODO Compute the mini-batch error
-        return std::make_pair(0.0, 0.0);
-    }
-
-    /* Gradient */
-
-    template <bool Temp, typename R1, typename R2, typename C1, typename C2, typename D>
-    static void update_diffs(R1&, R2& r2, C1& c1, C2& c2, std::vector<D>& diffs, size_t n_samples) {
-        auto n_visible = num_visible(r2);
-        auto n_hidden  = num_hidden(r2);
+        auto output = dbn.forward_batch(inputs);
 
-        for (size_t sample = 0; sample < n_samples; ++sample) {
-            D diff(n_visible);
+        auto[error, loss] = dbn.evaluate_metrics_batch(output, labels, etl::dim<0>(inputs), true);
 
-            for (size_t i = 0; i < n_visible; ++i) {
-                double s = 0.0;
-                for (size_t j = 0; j < n_hidden; ++j) {
-                    s += diffs[sample][j] * (Temp ? c2.gr_w_tmp(i, j) : r2.w(i, j));
-                }
-
-                if (R1::hidden_unit != unit_type::RELU) {
-                    s *= c1.gr_probs_a[sample][i] * (1.0 - c1.gr_probs_a[sample][i]);
-                }
-
-                diff[i] = s;
-            }
-
-            diffs[sample].swap(diff);
-        }
+        return std::make_pair(error, loss);
     }
 
-    template <bool Temp, typename R, typename D, typename V>
-    static void update_incs(R& r, std::vector<D>& diffs, const V& visibles) {
-        auto& ctx = r.get_cg_context();
-
-        auto n_visible = num_visible(r);
-        auto n_hidden  = num_hidden(r);
-
-        auto it            = visibles.begin();
-        auto end           = visibles.end();
-        size_t sample = 0;
+    /* Gradient */
 
-        while (it != end) {
-            auto& v = *it;
-            auto& d = diffs[sample];
+    /*!
+     * \brief Size the buffers of the trained layers for batches of n samples
+     */
+    void prepare_batch(size_t n) {
+        dbn.for_each_layer([n](auto& rbm) {
+            auto& ctx = rbm.get_cg_context();
 
-            for (size_t i = 0; i < n_visible; ++i) {
-                for (size_t j = 0; j < n_hidden; ++j) {
-                    ctx.gr_w_incs(i, j) += v[i] * d[j];
-                }
-            }
+            if (ctx.is_trained && etl::dim<0>(ctx.gr_probs_a) != n) {
+                const auto n_hidden = num_hidden(rbm);
 
-            for (size_t j = 0; j < n_hidden; ++j) {
-                ctx.gr_b_incs(j) += d[j];
+                ctx.gr_probs_a = etl::dyn_matrix<weight, 2>(n, n_hidden);
+                ctx.gr_diffs   = etl::dyn_matrix<weight, 2>(n, n_hidden);
             }
-
-            ++it;
-            ++sample;
-        }
+        });
     }
 
     /*!
-     * \brief Compute the gradient of one context
+     * \brief Compute the gradient of one context.
+     *
+     * The complete batch is propagated at once through each layer, the
+     * gradients are computed with one matrix product per layer.
+     *
      * \param contex The current gradient context
      * \param cost The current cost
      */
-    template <bool Temp, typename Sample, typename Target>
-    void gradient(const gradient_context<Sample, Target>& context, weight& cost) {
-        const auto n_hidden = output_size(dbn.template layer_get<layers - 1>());
-        auto n_samples      = context.inputs.size();
-
-        static std::vector<std::vector<weight>> diffs;
-        diffs.resize(n_samples);
+    template <bool Temp, typename Inputs, typename Labels>
+    void gradient(const gradient_context<Inputs, Labels>& context, weight& cost) {
+        const size_t n = etl::dim<0>(context.inputs);
 
-        dbn.for_each_layer([](auto& rbm) {
-            rbm.get_cg_context().gr_w_incs = 0.0;
-            rbm.get_cg_context().gr_b_incs = 0.0;
-        });
+        prepare_batch(n);
 
-        cost         = 0.0;
-        weight error = 0.0;
-
-        auto it  = context.inputs.begin();
-        auto end = context.inputs.end();
-        auto tit = context.targets.begin();
-
-        size_t sample = 0;
-
-        while (it != end) {
-            auto& input  = *it;
-            auto output  = std::ref(dbn.template layer_get<0>().get_cg_context().gr_probs_a[sample]);
-            auto& target = *tit;
-
-            dbn.for_each_layer_i([&input, &output, sample](size_t I, auto& rbm) {
-                auto& ctx        = rbm.get_cg_context();
-                auto& output_ref = static_cast<etl::dyn_vector<weight>&>(output);
-
-                if (I == 0) {
-                    rbm.activate_hidden(output_ref, ctx.gr_probs_s[sample], input, input, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
-                } else {
-                    rbm.activate_hidden(ctx.gr_probs_a[sample], ctx.gr_probs_s[sample], output_ref, output_ref, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
-                    output = std::ref(ctx.gr_probs_a[sample]);
-                }
-            });
+        // Forward propagation of the batch
 
-            auto& diff = diffs[sample];
-            diff.resize(n_hidden);
+        const etl::dyn_matrix<weight, 2>* previous = nullptr;
 
-            auto& result = dbn.template layer_get<layers - 1>().get_cg_context().gr_probs_a[sample];
-            weight scale = std::accumulate(result.begin(), result.end(), 0.0);
+        dbn.for_each_layer_i([&context, &previous](size_t I, auto& rbm) {
+            auto& ctx = rbm.get_cg_context();
 
-            for (auto& r : result) {
-                r *= (1.0 / scale);
+            if (I == 0) {
+                rbm.template batch_activate_hidden<true, false>(ctx.gr_probs_a, ctx.gr_probs_a, context.inputs, context.inputs, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
+            } else {
+                rbm.template batch_activate_hidden<true, false>(ctx.gr_probs_a, ctx.gr_probs_a, *previous, *previous, Temp ? ctx.gr_b_tmp : rbm.b, Temp ? ctx.gr_w_tmp : rbm.w);
             }
 
-            for (size_t i = 0; i < n_hidden; ++i) {
-                diff[i] = result[i] - target[i];
-                cost += target[i] * log(result[i]);
-                error += diff[i] * diff[i];
-            }
+            previous = &ctx.gr_probs_a;
+        });
 
-            ++it;
-            ++tit;
-            ++sample;
-        }
+        // Errors of the last layer
 
-        cost = -cost;
+        auto& last_ctx = dbn.template layer_get<layers - 1>().get_cg_context();
+        auto& result   = last_ctx.gr_probs_a;
 
-        //Get pointers to the different gr_probs
-        std::array<std::vector<etl::dyn_vector<weight>>*, layers> probs_refs;
-        dbn.for_each_layer_i([&probs_refs](size_t I, auto& rbm) {
-            probs_refs[I] = &rbm.get_cg_context().gr_probs_a;
-        });
+        for (size_t i = 0; i < n; ++i) {
+            result(i) *= weight(1.0) / etl::sum(result(i));
+        }
 
-        update_incs<Temp>(dbn.template layer_get<layers - 1>(), diffs, dbn.template layer_get<layers - 2>().get_cg_context().gr_probs_a);
+        last_ctx.gr_diffs = result - context.targets;
 
-#ifdef __clang__
-        dbn.for_each_layer_rpair_i([n_samples, &probs_refs](size_t I, auto& r1, auto& r2) {
-            auto& c1 = r1.get_cg_context();
-            auto& c2 = r2.get_cg_context();
+        cost = -etl::sum(context.targets >> etl::log(result));
 
-            this_type::update_diffs<Temp>(r1, r2, c1, c2, diffs, n_samples);
+        const weight error = etl::sum(last_ctx.gr_diffs >> last_ctx.gr_diffs);
 
-            if (I > 0) {
-                this_type::update_incs<Temp>(r1, diffs, *probs_refs[I - 1]);
-            }
-        });
+        // Backpropagation of the errors of the batch
 
-#else
-        std::vector<std::vector<weight>>& diffs_p = diffs;
+        dbn.for_each_layer_rpair([](auto& r1, auto& r2) {
+            using r1_t = std::decay_t<decltype(r1)>;
 
-        dbn.for_each_layer_rpair_i([&diffs_p, n_samples, &probs_refs](size_t I, auto& r1, auto& r2) {
             auto& c1 = r1.get_cg_context();
             auto& c2 = r2.get_cg_context();
 
-            this_type::update_diffs<Temp>(r1, r2, c1, c2, diffs_p, n_samples);
+            c2.gr_w_incs = etl::transpose(c1.gr_probs_a) * c2.gr_diffs;
+            c2.gr_b_incs = bias_batch_sum_2d(c2.gr_diffs);
 
-            if (I > 0) {
-                this_type::update_incs<Temp>(r1, diffs_p, *probs_refs[I - 1]);
+            c1.gr_diffs = c2.gr_diffs * etl::transpose(Temp ? c2.gr_w_tmp : r2.w);
+
+            if constexpr (r1_t::hidden_unit != unit_type::RELU) {
+                c1.gr_diffs = c1.gr_diffs >> c1.gr_probs_a >> (1.0 - c1.gr_probs_a);
             }
         });
-#endif
 
-        update_incs<Temp>(dbn.template layer_get<0>(), diffs, context.inputs);
+        auto& first_ctx = dbn.template layer_get<0>().get_cg_context();
+
+        first_ctx.gr_w_incs = etl::transpose(context.inputs) * first_ctx.gr_diffs;
+        first_ctx.gr_b_incs = bias_batch_sum_2d(first_ctx.gr_diffs);
 
         if (Debug) {
-            std::cout << "evaluating(" << Temp << "): cost:" << cost << " error: " << (error / n_samples) << std::endl;
+            std::cout << "evaluating(" << Temp << "): cost:" << cost << " error: " << (error / n) << std::endl;
         }
     }
 
@@ -389,8 +293,8 @@ struct cg_trainer_base {
     /*!
      * \brief Minimize the gradient of the given context
      */
-    template <typename Sample, typename Target>
-    void minimize(const gradient_context<Sample, Target>& context) {
+    template <typename Inputs, typename Labels>
+    void minimize(const gradient_context<Inputs, Labels>& context) {
         constexpr weight INT   = 0.1;       //Don't reevaluate within 0.1 of the limit of the current bracket
         constexpr weight EXT   = 3.0;       //Extrapolate maximum 3 times the current step-size
         constexpr weight SIG   = 0.1;       //Maximum allowed maximum ration between previous and new slopes
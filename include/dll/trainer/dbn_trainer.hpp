@@ -7,6 +7,11 @@
 
 #pragma once
 
+#include <algorithm>
+#include <future>
+#include <numeric>
+#include <sstream>
+
 #include "cpp_utils/algorithm.hpp" // For parallel_shuffle
 
 #include "etl/etl.hpp"
@@ -15,11 +20,61 @@
 #include "dll/util/timers.hpp"
 #include "dll/util/random.hpp"
 #include "dll/util/batch.hpp" // For make_batch
+#include "dll/util/checkpoint_file.hpp" // For checkpoint_writer
 #include "dll/test.hpp"
 #include "dll/dbn_traits.hpp"
 
 namespace dll {
 
+/*!
+ * \brief Traits to test if a trainer can train over several ranks
+ */
+template <typename T, typename = int>
+struct is_distributed_trainer : std::false_type {};
+
+/*!
+ * \copydoc is_distributed_trainer
+ */
+template <typename T>
+struct is_distributed_trainer<T, decltype((void)T::distributed_trainer, 0)> : std::integral_constant<bool, T::distributed_trainer> {};
+
+/*!
+ * \brief Traits to test if a trainer trains the epochs asynchronously
+ */
+template <typename T, typename = int>
+struct is_hogwild_trainer : std::false_type {};
+
+/*!
+ * \copydoc is_hogwild_trainer
+ */
+template <typename T>
+struct is_hogwild_trainer<T, decltype((void)T::hogwild, 0)> : std::integral_constant<bool, T::hogwild> {};
+
+/*!
+ * \brief Traits to test if a trainer only backpropagates a part of the samples
+ */
+template <typename T, typename = int>
+struct is_selective_trainer : std::false_type {};
+
+/*!
+ * \copydoc is_selective_trainer
+ */
+template <typename T>
+struct is_selective_trainer<T, decltype((void)T::selective_trainer, 0)> : std::integral_constant<bool, T::selective_trainer> {};
+
+/*!
+ * \brief Traits to test if a generator exposes its order of generation, so
+ * that it can be checkpointed
+ */
+template <typename G, typename = int>
+struct has_shuffle_order : std::false_type {};
+
+/*!
+ * \copydoc has_shuffle_order
+ */
+template <typename G>
+struct has_shuffle_order<G, decltype((void)std::declval<const G&>().shuffle_order(), 0)> : std::true_type {};
+
 /*!
  * \brief A generic trainer for Deep Belief Network
  *
@@ -32,6 +87,8 @@ struct dbn_trainer {
     using weight     = typename dbn_t::weight; ///< The data type for this layer
     using error_type = typename dbn_t::weight; ///< The error type
 
+    static constexpr size_t frozen = dbn_traits<dbn_t>::frozen_layers(); ///< The number of frozen layers
+
     /*!
      * \brief The trainer for the given RBM
      */
@@ -60,6 +117,24 @@ struct dbn_trainer {
     size_t best_epoch     = 0;   ///< The best epoch
     size_t patience       = 0;   ///< The current patience
 
+    std::unique_ptr<checkpoint_writer<weight>> checkpointer; ///< The background writer of the checkpoints
+    parameter_store<weight> checkpoint_state;                ///< The state of the updater of the trainer
+    std::vector<double*> checkpoint_scalars;                 ///< The scalar state of the updater of the trainer
+    size_t checkpoint_batches = 0;                           ///< The number of mini-batches trained since the start of the training
+
+    std::string epoch_random;        ///< The state of the random engine at the start of the current epoch
+    std::string resume_random;       ///< The state of the random engine at the resumed checkpoint
+    std::vector<size_t> epoch_order; ///< The order of the generator in the current epoch, if it exposes it
+    size_t resume_epoch = 0;         ///< The epoch of the resumed checkpoint
+    size_t resume_batch = 0;         ///< The number of mini-batches of the resumed epoch already trained
+    bool resuming       = false;     ///< Indicates that the next epoch continues the resumed checkpoint
+
+    std::unique_ptr<dbn_t> val_snapshot;  ///< The snapshot of the network evaluated in background (async_validation)
+    std::unique_ptr<dbn_t> best_snapshot; ///< The snapshot of the best epoch (async_validation)
+
+    size_t backup_epoch = 0;     ///< The epoch of the backed up weights
+    bool backup_pending = false; ///< Indicates that the backup of the current weights has been deferred
+
     /*!
      * \brief Initialize the training
      * \param dbn The network to train
@@ -72,19 +147,47 @@ struct dbn_trainer {
         //Initialize the momentum
         dbn.momentum = dbn.initial_momentum;
 
+        dbn.track_memory();
+
         watcher.fine_tuning_begin(dbn, max_epochs);
 
+        // Release the previous trainer first so that its memory can be reused
+        trainer.reset();
         trainer = std::make_unique<trainer_t<dbn_t>>(dbn);
 
+        if constexpr (dbn_traits<dbn_t>::uses_arena()) {
+            dbn.get_arena().display(dbn.out);
+        }
+
         //Initialize the trainer if necessary
         trainer->init_training(batch_size);
 
+        if constexpr (is_distributed_trainer<trainer_t<dbn_t>>::value) {
+            if (dbn.distributed && dbn.distributed->size() > 1) {
+                trainer->init_distributed(*dbn.distributed);
+            }
+        }
+
+        if constexpr (is_profile_watcher<watcher_t<dbn_t>>::value) {
+            trainer->enable_profiling();
+        }
+
         // Set the initial error and loss
         current_error = 0.0;
         current_loss = 0.0;
 
         current_val_error = 0.0;
         current_val_loss = 0.0;
+
+        backup_epoch   = 0;
+        backup_pending = false;
+
+        resuming = false;
+
+        // The state of a resumed training replaces the initial state
+        if constexpr (dbn_traits<dbn_t>::checkpoint_every() > 0) {
+            start_checkpoints(dbn);
+        }
     }
 
     /*!
@@ -97,6 +200,11 @@ struct dbn_trainer {
      * \return the final error
      */
     error_type stop_training(dbn_t& dbn, size_t epoch, size_t max_epochs){
+        // Make sure that the last checkpoint is on disk
+        if (checkpointer) {
+            checkpointer->wait();
+        }
+
         // Depending on the strategy, try to restore the best weights
 
         if(epoch == max_epochs){
@@ -105,28 +213,334 @@ struct dbn_trainer {
 
             if constexpr (s != strategy::NONE) {
                 if(best_epoch < max_epochs - 1){
-                    dbn.restore_weights();
+                    restore_best(dbn);
 
                     if (is_error(s)) {
-                        dbn.out << "Restore the best (error) weights from epoch " << best_epoch << std::endl;
+                        dbn.out << "Restore the best (error) weights from epoch " << backup_epoch << std::endl;
                     } else {
-                        dbn.out << "Restore the best (loss) weights from epoch " << best_epoch << std::endl;
+                        dbn.out << "Restore the best (loss) weights from epoch " << backup_epoch << std::endl;
                     }
                 }
             }
         }
 
+        if constexpr (is_selective_trainer<trainer_t<dbn_t>>::value) {
+            trainer->selective_report(dbn.out);
+        }
+
         watcher.fine_tuning_end(dbn);
 
         return current_error;
     }
 
+    /*!
+     * \brief Backup the weights of the best epoch.
+     *
+     * The copy is deferred until the weights are modified again, at the
+     * start of the next epoch, and is never made if the training stops
+     * before. With the validation in background, the best epoch is known one
+     * epoch late and its weights are only left in the snapshot, which is
+     * swapped with the snapshot of the best epoch instead of being copied.
+     *
+     * \param epoch The best epoch
+     */
+    void backup_best(size_t epoch){
+        // At most one backup every backup_every epochs
+        if (epoch && epoch < backup_epoch + dbn_traits<dbn_t>::backup_every()) {
+            return;
+        }
+
+        backup_epoch = epoch;
+
+        if (val_snapshot) {
+            std::swap(val_snapshot, best_snapshot);
+        } else {
+            backup_pending = true;
+        }
+    }
+
+    /*!
+     * \brief Make the deferred backup of the weights, before they are
+     * modified.
+     */
+    void commit_backup(dbn_t& dbn){
+        if (backup_pending) {
+            dll::auto_timer timer("net:trainer:backup");
+
+            dbn.backup_weights();
+
+            backup_pending = false;
+        }
+    }
+
+    /*!
+     * \brief Restore the weights of the best epoch into the network
+     */
+    void restore_best(dbn_t& dbn){
+        if (best_snapshot) {
+            std::stringstream stream;
+            best_snapshot->store(stream);
+            dbn.load(stream);
+        } else if (backup_pending) {
+            // The weights have not been modified since the backup
+            backup_pending = false;
+        } else {
+            dbn.restore_weights();
+        }
+    }
+
+    /*!
+     * \brief Copy the current weights of the network into the snapshot
+     * evaluated in background.
+     *
+     * The complete network is copied, with the statistics of its
+     * normalization layers, not only its trainable parameters.
+     */
+    void update_val_snapshot(const dbn_t& dbn){
+        dll::auto_timer timer("net:trainer:val_snapshot");
+
+        std::stringstream stream;
+        dbn.store(stream);
+
+        if (!val_snapshot) {
+            val_snapshot = std::make_unique<dbn_t>();
+        }
+
+        val_snapshot->load(stream);
+    }
+
+    /*!
+     * \brief Prepare the checkpoints of the training and resume from the
+     * checkpoint file if asked.
+     * \param dbn The network to train
+     */
+    void start_checkpoints(dbn_t& dbn){
+        trainer->updater_state(checkpoint_state, checkpoint_scalars);
+
+        checkpoint_batches = 0;
+
+        if (dbn.resume_checkpoint) {
+            checkpoint_file_header header;
+            std::string training;
+
+            if (load_checkpoint(dbn.checkpoint_file, dbn.flat_parameters(), checkpoint_state, checkpoint_scalars, uint32_t(dbn_traits<dbn_t>::updater()), header, training)) {
+                trainer->iteration = header.iteration;
+
+                if (restore_training_state(dbn, training)) {
+                    resuming     = true;
+                    resume_epoch = header.epoch;
+                    resume_batch = header.batch;
+                } else {
+                    dbn.out << "WARNING: Invalid training state in checkpoint " << dbn.checkpoint_file << ", only the weights are resumed" << std::endl;
+                }
+
+                dbn.out << "Resume from checkpoint " << dbn.checkpoint_file << " (epoch " << header.epoch << ", batch " << header.batch << ", iteration " << header.iteration << ")" << std::endl;
+            } else {
+                dbn.out << "WARNING: Impossible to resume from checkpoint " << dbn.checkpoint_file << std::endl;
+            }
+        }
+
+        // Release the previous writer first, it writes its last snapshot
+        checkpointer.reset();
+        checkpointer = std::make_unique<checkpoint_writer<weight>>(dbn.checkpoint_file);
+    }
+
+    /*!
+     * \brief Returns the serialized state of the random engine of DLL
+     */
+    static std::string random_state(){
+        std::ostringstream stream;
+        stream << dll::rand_engine();
+        return stream.str();
+    }
+
+    /*!
+     * \brief Restore the random engine of DLL from a serialized state
+     */
+    static void set_random_state(const std::string& state){
+        if (!state.empty()) {
+            std::istringstream stream(state);
+            stream >> dll::rand_engine();
+        }
+    }
+
+    /*!
+     * \brief Serialize the state of the training loop: the early stopping,
+     * the momentum, the random states and the order of the generator
+     */
+    std::string training_state(const dbn_t& dbn) const {
+        std::string state;
+
+        checkpoint_write(state, double(current_error));
+        checkpoint_write(state, double(current_loss));
+        checkpoint_write(state, double(current_val_error));
+        checkpoint_write(state, double(current_val_loss));
+        checkpoint_write(state, double(best_error));
+        checkpoint_write(state, double(best_loss));
+        checkpoint_write(state, uint64_t(best_epoch));
+        checkpoint_write(state, uint64_t(patience));
+        checkpoint_write(state, double(dbn.momentum));
+        checkpoint_write(state, epoch_random);
+        checkpoint_write(state, random_state());
+        checkpoint_write(state, epoch_order);
+
+        return state;
+    }
+
+    /*!
+     * \brief Restore the state of the training loop from a checkpoint
+     * \return true if the state was valid, false otherwise
+     */
+    bool restore_training_state(dbn_t& dbn, const std::string& state){
+        checkpoint_reader reader(state);
+
+        double values[7] = {};
+        uint64_t epoch   = 0;
+        uint64_t wait    = 0;
+
+        for (size_t i = 0; i < 6; ++i) {
+            reader.read(values[i]);
+        }
+
+        reader.read(epoch);
+        reader.read(wait);
+        reader.read(values[6]);
+        reader.read(epoch_random);
+        reader.read(resume_random);
+        reader.read(epoch_order);
+
+        if (!reader.valid) {
+            epoch_random.clear();
+            resume_random.clear();
+            epoch_order.clear();
+            return false;
+        }
+
+        current_error     = values[0];
+        current_loss      = values[1];
+        current_val_error = values[2];
+        current_val_loss  = values[3];
+        best_error        = values[4];
+        best_loss         = values[5];
+        best_epoch        = epoch;
+        patience          = wait;
+        dbn.momentum      = values[6];
+
+        // The weights of the best epoch are not checkpointed, the resumed weights are the oldest that can be restored
+        if constexpr (dbn_t::early != strategy::NONE) {
+            backup_pending = true;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Reset and shuffle the generator for a new epoch.
+     *
+     * The first epoch of a resumed training restores the order of the
+     * generator of the checkpoint, either directly if the generator exposes
+     * it or by replaying the shuffles of the previous epochs, and skips the
+     * mini-batches already trained. The random engine is then restored to
+     * its state at the checkpoint.
+     *
+     * \param generator The generator of the training data
+     * \param epoch The current epoch
+     */
+    template <typename Generator>
+    void shuffle_epoch(Generator& generator, size_t epoch){
+        if (resuming) {
+            dll::auto_timer timer("net:trainer:resume");
+
+            resuming = false;
+
+            bool restored = false;
+
+            if constexpr (has_shuffle_order<Generator>::value) {
+                if (!epoch_order.empty()) {
+                    generator.restore_order(epoch_order);
+                    restored = true;
+                }
+            }
+
+            if (!restored) {
+                for (size_t e = 0; e < epoch; ++e) {
+                    reset_shuffle(generator);
+                }
+
+                set_random_state(epoch_random);
+                reset_shuffle(generator);
+            }
+
+            for (size_t b = 0; b < resume_batch && generator.has_next_batch(); ++b) {
+                generator.next_batch();
+            }
+
+            set_random_state(resume_random);
+
+            return;
+        }
+
+        if constexpr (dbn_traits<dbn_t>::checkpoint_every() > 0) {
+            epoch_random = random_state();
+        }
+
+        reset_shuffle(generator);
+
+        if constexpr (dbn_traits<dbn_t>::checkpoint_every() > 0 && has_shuffle_order<Generator>::value) {
+            epoch_order = generator.shuffle_order();
+        }
+    }
+
+    /*!
+     * \brief Returns the first epoch of the training, the epoch of the
+     * checkpoint for a resumed training
+     */
+    size_t first_epoch() const {
+        return resuming ? resume_epoch : 0;
+    }
+
+    /*!
+     * \brief Take a checkpoint of the training if enough mini-batches were
+     * trained since the last one.
+     *
+     * Only a copy of the parameters, of the state of the updater and of the
+     * state of the training loop is made, the file is written in
+     * background.
+     *
+     * \param dbn The network being trained
+     * \param epoch The current epoch
+     * \param batch The number of mini-batches trained in the epoch
+     */
+    void checkpoint_batch([[maybe_unused]] dbn_t& dbn, [[maybe_unused]] size_t epoch, [[maybe_unused]] size_t batch){
+        if constexpr (dbn_traits<dbn_t>::checkpoint_every() > 0) {
+            if (++checkpoint_batches % dbn_traits<dbn_t>::checkpoint_every() == 0) {
+                dll::auto_timer timer("net:trainer:checkpoint");
+
+                flush_updates();
+
+                checkpointer->save(dbn.flat_parameters(), checkpoint_state, checkpoint_scalars, uint32_t(dbn_traits<dbn_t>::updater()), epoch, batch, trainer->iteration, training_state(dbn));
+            }
+        }
+    }
+
+    /*!
+     * \brief Complete the pipelined updates of the weights (pipeline_updates),
+     * before the weights are used outside of the training of the batches
+     */
+    void flush_updates(){
+        if constexpr (dbn_traits<dbn_t>::sgd_pipeline()) {
+            trainer->flush_updates();
+        }
+    }
+
     /*!
      * \brief Start a new epoch
      * \param dbn The network that is trained
      * \param epoch The current epoch
      */
     void start_epoch(dbn_t& dbn, size_t epoch){
+        commit_backup(dbn);
+
         watcher.ft_epoch_start(epoch, dbn);
     }
 
@@ -157,14 +571,14 @@ struct dbn_trainer {
                     best_error = error;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    backup_best(epoch);
                 }
             } else {
                 if(!epoch || loss < best_loss){
                     best_loss = loss;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    backup_best(epoch);
                 }
             }
         }
@@ -178,9 +592,9 @@ struct dbn_trainer {
                     dbn.out << "Stopping: Loss below goal";
 
                     if(epoch != best_epoch){
-                        dbn.restore_weights();
+                        restore_best(dbn);
 
-                        dbn.out << ", restore weights from epoch " << best_epoch;
+                        dbn.out << ", restore weights from epoch " << backup_epoch;
                     }
 
                     dbn.out << std::endl;
@@ -194,9 +608,9 @@ struct dbn_trainer {
                     dbn.out << "Stopping: Error below goal";
 
                     if(epoch != best_epoch){
-                        dbn.restore_weights();
+                        restore_best(dbn);
 
-                        dbn.out << ", restore weights from epoch " << best_epoch;
+                        dbn.out << ", restore weights from epoch " << backup_epoch;
                     }
 
                     dbn.out << std::endl;
@@ -213,9 +627,9 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Loss has been increasing for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best(dbn);
 
-                            dbn.out << ", restore weights from epoch " << best_epoch;
+                            dbn.out << ", restore weights from epoch " << backup_epoch;
                         }
 
                         dbn.out << std::endl;
@@ -235,9 +649,9 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Error has been increasing for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best(dbn);
 
-                            dbn.out << ", restore weights from epoch " << best_epoch;
+                            dbn.out << ", restore weights from epoch " << backup_epoch;
                         }
 
                         dbn.out << std::endl;
@@ -257,9 +671,9 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Loss has been increasing (from best) for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best(dbn);
 
-                            dbn.out << ", restore weights from epoch " << best_epoch;
+                            dbn.out << ", restore weights from epoch " << backup_epoch;
                         }
 
                         dbn.out << std::endl;
@@ -279,9 +693,9 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Error has been increasing (from best) for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best(dbn);
 
-                            dbn.out << ", restore weights from epoch " << best_epoch;
+                            dbn.out << ", restore weights from epoch " << backup_epoch;
                         }
 
                         dbn.out << std::endl;
@@ -376,16 +790,248 @@ struct dbn_trainer {
         if constexpr (dbn_traits<dbn_t>::error_on_epoch()){
             dll::auto_timer timer("net:trainer:train:epoch:error");
 
-            auto forward_helper = [this, &dbn](auto&& input_batch) -> decltype(auto) {
-                return this->trainer->template forward_batch_helper<false>(dbn, input_batch);
-            };
+            if constexpr (dbn_traits<dbn_t>::is_serial()) {
+                auto forward_helper = [this, &dbn](auto&& input_batch) -> decltype(auto) {
+                    return this->trainer->template forward_batch_helper<false>(dbn, input_batch);
+                };
 
-            std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator, forward_helper);
+                std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator, forward_helper);
+            } else {
+                // The batches are distributed on the thread pool of the network
+                std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator);
+            }
         }
 
         return std::make_pair(new_error, new_loss);
     }
 
+    /*!
+     * \brief Indicates if the early stopping would stop the training with
+     * the given validation statistics, without changing its state
+     *
+     * \param dbn The network being trained
+     * \param epoch The current epoch
+     * \param val_stats The validation error and loss
+     *
+     * \return true if the training would be stopped, false otherwise
+     */
+    bool about_to_stop(const dbn_t& dbn, size_t epoch, const std::pair<double, double>& val_stats) const {
+        static constexpr auto s = dbn_t::early;
+
+        if constexpr (dbn_traits<dbn_t>::error_on_epoch() && !dbn_traits<dbn_t>::early_uses_training()) {
+            const double error = val_stats.first;
+            const double loss  = val_stats.second;
+
+            if constexpr (s == strategy::LOSS_GOAL) {
+                return loss <= dbn.goal;
+            } else if constexpr (s == strategy::ERROR_GOAL) {
+                return error <= dbn.goal;
+            } else if constexpr (s == strategy::LOSS_DIRECT) {
+                return epoch && patience == 1 && loss > current_val_loss;
+            } else if constexpr (s == strategy::ERROR_DIRECT) {
+                return epoch && patience == 1 && error > current_val_error;
+            } else if constexpr (s == strategy::LOSS_BEST) {
+                return epoch && patience == 1 && loss > best_loss;
+            } else if constexpr (s == strategy::ERROR_BEST) {
+                return epoch && patience == 1 && error > best_error;
+            }
+        }
+
+        cpp_unused(dbn);
+        cpp_unused(epoch);
+        cpp_unused(val_stats);
+
+        return false;
+    }
+
+    /*!
+     * \brief Indicates if the full validation set must be evaluated at the
+     * given epoch, instead of the validation subset.
+     *
+     * The full validation set is evaluated every full_validation_every
+     * epochs and at the last epoch.
+     */
+    static bool full_validation(const dbn_t& dbn, size_t epoch, size_t max_epochs) {
+        return epoch + 1 == max_epochs || (dbn.full_validation_every && (epoch + 1) % dbn.full_validation_every == 0);
+    }
+
+    /*!
+     * \brief Copy a fixed random subset of validation_subset samples of the
+     * validation generator into an in-memory generator.
+     *
+     * \param dbn The network being trained
+     * \param generator The generator for the validation data
+     * \return The generator of the subset, or nullptr to evaluate the full validation set
+     */
+    template <typename Generator>
+    auto make_validation_subset(const dbn_t& dbn, Generator& generator) {
+        using label_batch_t = std::decay_t<decltype(generator.label_batch())>;
+        using input_one_t   = typename dbn_t::input_one_t;
+
+        static_assert(etl::dimensions<label_batch_t>() <= 2, "validation_subset only supports vector and sparse labels");
+
+        generator.reset();
+        generator.set_test();
+
+        // The shapes of a dynamic network are only known from a sample
+        input_one_t one;
+
+        if constexpr (!etl::all_fast<input_one_t>) {
+            one.inherit_if_null(generator.data_batch()(0));
+        }
+
+        // Sparse labels are kept as scalar labels in the subset
+        auto label = [&]() {
+            if constexpr (etl::dimensions<label_batch_t>() == 1) {
+                return weight(0);
+            } else {
+                return etl::dyn_vector<weight>(etl::dim<1>(generator.label_batch()));
+            }
+        }();
+
+        const size_t n = generator.size();
+        const size_t k = dbn.validation_subset;
+
+        decltype(prepare_generator(one, label, k, dbn.output_size(), inmemory_data_generator_desc<dll::batch_size<Generator::batch_size>>{})) subset;
+
+        if (!dbn_traits<dbn_t>::error_on_epoch() || !k || k >= n) {
+            return subset;
+        }
+
+        dll::auto_timer timer("net:trainer:validation_subset");
+
+        // The same random samples are evaluated at each epoch
+
+        std::vector<size_t> selected(n);
+        std::iota(selected.begin(), selected.end(), size_t(0));
+        std::shuffle(selected.begin(), selected.end(), dll::rand_engine());
+        selected.resize(k);
+        std::sort(selected.begin(), selected.end());
+
+        subset = prepare_generator(one, label, k, dbn.output_size(), inmemory_data_generator_desc<dll::batch_size<Generator::batch_size>>{});
+
+        subset->set_safe();
+
+        size_t i    = 0;
+        size_t next = 0;
+
+        while (next < k && generator.has_next_batch()) {
+            decltype(auto) data_batch  = generator.data_batch();
+            decltype(auto) label_batch = generator.label_batch();
+
+            const size_t b = etl::dim<0>(data_batch);
+
+            for (; next < k && selected[next] < i + b; ++next) {
+                const size_t j = selected[next] - i;
+
+                subset->set_data_batch(next, etl::slice(data_batch, j, j + 1));
+                subset->set_label_batch(next, etl::slice(label_batch, j, j + 1));
+            }
+
+            i += b;
+
+            generator.next_batch();
+        }
+
+        return subset;
+    }
+
+    /*!
+     * \brief Compute the validation error and loss at the given epoch, on
+     * the validation subset if there is one.
+     *
+     * The full validation set is evaluated instead of the subset at the
+     * scheduled epochs and when the early stopping would stop the training
+     * with the statistics of the subset.
+     *
+     * \param dbn The network being trained
+     * \param val_generator The generator for the validation data
+     * \param subset The generator of the validation subset (nullptr for none)
+     * \param epoch The current epoch
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return a pair containing (error, loss)
+     */
+    template <typename ValGenerator, typename Subset>
+    std::pair<double, double> compute_val_error_loss(dbn_t& dbn, ValGenerator& val_generator, Subset* subset, size_t epoch, size_t max_epochs) {
+        if (!subset || full_validation(dbn, epoch, max_epochs)) {
+            return compute_error_loss(dbn, val_generator);
+        }
+
+        auto val_stats = compute_error_loss(dbn, *subset);
+
+        if (about_to_stop(dbn, epoch, val_stats)) {
+            return compute_error_loss(dbn, val_generator);
+        }
+
+        return val_stats;
+    }
+
+    /*!
+     * \brief Train one mini-batch, of features of the frozen layers if
+     * there are any
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        if constexpr (frozen > 0) {
+            return trainer->train_batch_frozen(epoch, inputs, labels);
+        } else {
+            return trainer->train_batch(epoch, inputs, labels);
+        }
+    }
+
+    /*!
+     * \brief Compute the outputs of the frozen layers for the complete
+     * generator, into an in-memory generator.
+     *
+     * \param dbn The network being trained
+     * \param generator The generator for the training data
+     * \return The generator of the features of the last frozen layer
+     */
+    template <typename Generator>
+    auto make_frozen_cache(const dbn_t& dbn, Generator& generator) {
+        dll::auto_timer timer("net:trainer:frozen_cache");
+
+        using label_batch_t = std::decay_t<decltype(generator.label_batch())>;
+
+        static_assert(etl::dimensions<label_batch_t>() <= 2, "frozen_layers only supports vector and sparse labels");
+
+        generator.reset();
+        generator.set_test();
+
+        auto one = dbn.template prepare_output<frozen - 1, typename dbn_t::input_one_t>();
+
+        // Sparse labels are kept as scalar labels in the cache
+        auto label = [&]() {
+            if constexpr (etl::dimensions<label_batch_t>() == 1) {
+                return weight(0);
+            } else {
+                return etl::dyn_vector<weight>(etl::dim<1>(generator.label_batch()));
+            }
+        }();
+
+        auto cache = prepare_generator(
+            one, label,
+            generator.size(), dbn.output_size(),
+            inmemory_data_generator_desc<dll::batch_size<dbn_t::batch_size>>{});
+
+        cache->set_safe();
+
+        size_t i = 0;
+        while (generator.has_next_batch()) {
+            auto features = dbn.template forward_batch<frozen - 1>(generator.data_batch());
+
+            cache->set_data_batch(i, features);
+            cache->set_label_batch(i, generator.label_batch());
+
+            i += etl::dim<0>(features);
+
+            generator.next_batch();
+        }
+
+        return cache;
+    }
+
     /*!
      * \brief Train the network for one epoch
      * \param generator The generator for training data
@@ -396,19 +1042,154 @@ struct dbn_trainer {
         // Set the generator in train mode
         generator.set_train();
 
+        // Data-parallel (or pipeline-parallel) SGD: Train one mini-batch per shard (or micro-batch) at a time
+        if constexpr (dbn_traits<dbn_t>::staged_batches() > 1) {
+            constexpr size_t shards = dbn_traits<dbn_t>::staged_batches();
+
+            while(generator.has_next_batch()){
+                dll::auto_timer timer("net:trainer:train:epoch:batch");
+
+                watcher.ft_batch_start(epoch, dbn);
+
+                size_t staged = 0;
+                size_t batch  = 0;
+
+                while(staged < shards && generator.has_next_batch()){
+                    trainer->stage_batch(staged++, generator.data_batch(), generator.label_batch());
+
+                    batch = generator.current_batch();
+
+                    dll::auto_timer next_timer("generator:next_batch");
+                    generator.next_batch();
+                }
+
+                auto [batch_error, batch_loss] = trainer->train_staged_batches(epoch, staged);
+
+                watcher.ft_batch_end(epoch, batch, generator.batches(), batch_error, batch_loss, dbn);
+
+                checkpoint_batch(dbn, epoch, generator.current_batch());
+            }
+
+            if constexpr (dbn_traits<dbn_t>::pipeline_stages() > 1 && is_profile_watcher<watcher_t<dbn_t>>::value) {
+                watcher.ft_epoch_profile(epoch, trainer->profile, dbn);
+                trainer->profile.reset();
+            }
+
+            return;
+        }
+
+        // Gradient accumulation: Update the weights once per group of mini-batches
+        if constexpr (dbn_traits<dbn_t>::gradient_accumulation() > 1) {
+            constexpr size_t accumulate = dbn_traits<dbn_t>::gradient_accumulation();
+
+            while(generator.has_next_batch()){
+                dll::auto_timer timer("net:trainer:train:epoch:batch");
+
+                watcher.ft_batch_start(epoch, dbn);
+
+                size_t batch = 0;
+
+                for(size_t i = 0; i < accumulate && generator.has_next_batch(); ++i){
+                    trainer->accumulate_batch(generator.data_batch(), generator.label_batch());
+
+                    batch = generator.current_batch();
+
+                    dll::auto_timer next_timer("generator:next_batch");
+                    generator.next_batch();
+                }
+
+                auto [batch_error, batch_loss] = trainer->train_accumulated_batches(epoch);
+
+                watcher.ft_batch_end(epoch, batch, generator.batches(), batch_error, batch_loss, dbn);
+
+                checkpoint_batch(dbn, epoch, generator.current_batch());
+            }
+
+            return;
+        }
+
+        // Distributed training: Train the batches of this rank, synchronized with the other ranks
+        if constexpr (is_distributed_trainer<trainer_t<dbn_t>>::value) {
+            if (trainer->is_distributed()) {
+                train_epoch_distributed(dbn, generator, epoch);
+                return;
+            }
+        }
+
+        // Hogwild: All the workers train their own batches at the same time
+        if constexpr (is_hogwild_trainer<trainer_t<dbn_t>>::value) {
+            trainer->train_epoch(epoch, generator, [&](size_t batch, double batch_error, double batch_loss) {
+                watcher.ft_batch_end(epoch, batch, generator.batches(), batch_error, batch_loss, dbn);
+
+                checkpoint_batch(dbn, epoch, batch + 1);
+            });
+
+            return;
+        }
+
         //Train one mini-batch at a time
         while(generator.has_next_batch()){
             dll::auto_timer timer("net:trainer:train:epoch:batch");
 
             watcher.ft_batch_start(epoch, dbn);
 
-            auto [batch_error, batch_loss] = trainer->train_batch(
-                epoch,
-                generator.data_batch(),
-                generator.label_batch());
+            auto [batch_error, batch_loss] = train_batch(epoch, generator.data_batch(), generator.label_batch());
 
             watcher.ft_batch_end(epoch, generator.current_batch(), generator.batches(), batch_error, batch_loss, dbn);
 
+            checkpoint_batch(dbn, epoch, generator.current_batch() + 1);
+
+            dll::auto_timer next_timer("generator:next_batch");
+            generator.next_batch();
+        }
+
+        flush_updates();
+
+        if constexpr (is_profile_watcher<watcher_t<dbn_t>>::value) {
+            watcher.ft_epoch_profile(epoch, trainer->profile, dbn);
+            trainer->profile.reset();
+        }
+
+        if constexpr (is_memory_watcher<watcher_t<dbn_t>>::value) {
+            watcher.ft_epoch_memory(epoch, dbn);
+        }
+    }
+
+    /*!
+     * \brief Train the network for one epoch over all the ranks.
+     *
+     * The batches of the generator are distributed in round-robin between
+     * the ranks, each rank only reads its own batches. Every rank trains
+     * the same number of batches, the last batches of the epoch that
+     * cannot be given to all the ranks are skipped. The ranks must use the
+     * same seed, to shuffle the generator in the same order.
+     *
+     * \param dbn The network to train
+     * \param generator The generator for training data
+     * \param epoch The current epoch
+     */
+    template<typename Generator>
+    void train_epoch_distributed(dbn_t& dbn, Generator& generator, size_t epoch){
+        const size_t ranks = dbn.distributed->size();
+        const size_t rank  = dbn.distributed->rank();
+        const size_t steps = (generator.batches() / ranks) * ranks;
+
+        for (size_t b = 0; b < steps && generator.has_next_batch(); ++b) {
+            if (b % ranks == rank) {
+                dll::auto_timer timer("net:trainer:train:epoch:batch");
+
+                watcher.ft_batch_start(epoch, dbn);
+
+                auto [batch_error, batch_loss] = trainer->train_batch_distributed(epoch, generator.data_batch(), generator.label_batch());
+
+                watcher.ft_batch_end(epoch, generator.current_batch(), generator.batches(), batch_error, batch_loss, dbn);
+
+                // All the ranks have the same weights, only the first one saves them
+                if (!rank) {
+                    checkpoint_batch(dbn, epoch, b + 1);
+                }
+            }
+
             generator.next_batch();
         }
     }
@@ -477,6 +1258,27 @@ struct dbn_trainer {
      */
     template <typename Generator>
     error_type train(DBN& dbn, Generator& generator, size_t max_epochs) {
+        if constexpr (frozen > 0) {
+            auto cache = make_frozen_cache(dbn, generator);
+
+            return train_impl(dbn, generator, *cache, max_epochs);
+        } else {
+            return train_impl(dbn, generator, generator, max_epochs);
+        }
+    }
+
+    /*!
+     * \brief Train the network for max_epochs
+     *
+     * \param dbn The network to be trained
+     * \param generator The generator for the training data
+     * \param source The generator of the trained mini-batches, either generator or the cache of the frozen layers
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename Generator, typename Source>
+    error_type train_impl(DBN& dbn, Generator& generator, Source& source, size_t max_epochs) {
         dll::auto_timer timer("net:trainer:train");
 
         // Initialization steps
@@ -484,7 +1286,7 @@ struct dbn_trainer {
 
         //Train the model for max_epochs epoch
 
-        size_t epoch = 0;
+        size_t epoch = first_epoch();
         for (; epoch < max_epochs; ++epoch) {
             dll::auto_timer timer("net:trainer:train:epoch");
 
@@ -492,15 +1294,19 @@ struct dbn_trainer {
                 dll::auto_timer timer("net:trainer:train:epoch:prepare");
 
                 // Shuffle before the epoch if necessary
-                reset_shuffle(generator);
+                shuffle_epoch(source, epoch);
 
                 // This will ensure maximum performance for the training
-                generator.prepare_epoch();
+                source.prepare_epoch();
             }
 
             start_epoch(dbn, epoch);
 
-            auto [error, loss] = train_epoch(dbn, generator, epoch);
+            // Train one epoch of training data
+            train_epoch_only(dbn, source, epoch);
+
+            // Compute the error at this epoch
+            auto [error, loss] = compute_error_loss(dbn, generator);
 
             if(stop_epoch(dbn, epoch, error, loss)){
                 break;
@@ -512,6 +1318,81 @@ struct dbn_trainer {
         return stop_training(dbn, epoch, max_epochs);
     }
 
+    /*!
+     * \brief Train the network continuously on a stream of samples, until
+     * the stream is closed.
+     *
+     * Each period of the stream is an epoch, whose error and loss are the
+     * mean of the errors and losses of its batches, the samples of the
+     * stream being trained only once. The checkpoints are taken every
+     * checkpoint_every mini-batches, as for a normal training.
+     *
+     * \param dbn The network to be trained
+     * \param generator The online generator of the training data
+     *
+     * \return The error of the last period
+     */
+    template <typename Generator>
+    error_type train_online(DBN& dbn, Generator& generator) {
+        dll::auto_timer timer("net:trainer:train:online");
+
+        // Initialization steps
+        start_training(dbn, 0);
+
+        size_t epoch = 0;
+        for (; !generator.finished(); ++epoch) {
+            dll::auto_timer timer("net:trainer:train:epoch");
+
+            // Start the next period of the stream
+            generator.reset();
+
+            start_epoch(dbn, epoch);
+
+            double error = 0.0;
+            double loss  = 0.0;
+            size_t n     = 0;
+
+            while(generator.has_next_batch()){
+                dll::auto_timer timer("net:trainer:train:epoch:batch");
+
+                watcher.ft_batch_start(epoch, dbn);
+
+                auto [batch_error, batch_loss] = train_batch(epoch, generator.data_batch(), generator.label_batch());
+
+                watcher.ft_batch_end(epoch, generator.current_batch(), generator.batches(), batch_error, batch_loss, dbn);
+
+                checkpoint_batch(dbn, epoch, generator.current_batch() + 1);
+
+                error += batch_error;
+                loss += batch_loss;
+                ++n;
+
+                generator.next_batch();
+            }
+
+            flush_updates();
+
+            // The stream has been closed at the end of the previous period
+            if (!n) {
+                break;
+            }
+
+            //After some time increase the momentum
+            if (dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM && epoch == dbn.final_momentum_epoch) {
+                dbn.momentum = dbn.final_momentum;
+            }
+
+            current_error = error / n;
+            current_loss  = loss / n;
+
+            watcher.ft_epoch_end(epoch, current_error, current_loss, dbn);
+        }
+
+        // Finalization, there are no best weights to restore
+
+        return stop_training(dbn, epoch, epoch + 1);
+    }
+
     /*!
      * \brief Train the network for max_epochs
      *
@@ -524,6 +1405,28 @@ struct dbn_trainer {
      */
     template <typename TrainGenerator, typename ValGenerator>
     error_type train(DBN& dbn, TrainGenerator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
+        if constexpr (frozen > 0) {
+            auto cache = make_frozen_cache(dbn, train_generator);
+
+            return train_impl(dbn, train_generator, *cache, val_generator, max_epochs);
+        } else {
+            return train_impl(dbn, train_generator, train_generator, val_generator, max_epochs);
+        }
+    }
+
+    /*!
+     * \brief Train the network for max_epochs
+     *
+     * \param dbn The network to be trained
+     * \param train_generator The generator for the training data
+     * \param source The generator of the trained mini-batches, either train_generator or the cache of the frozen layers
+     * \param val_generator The generator for the validation data
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename TrainGenerator, typename Source, typename ValGenerator>
+    error_type train_impl(DBN& dbn, TrainGenerator& train_generator, Source& source, ValGenerator& val_generator, size_t max_epochs) {
         dll::auto_timer timer("net:trainer:train");
 
         // The validation generator is always in test mode
@@ -532,22 +1435,32 @@ struct dbn_trainer {
         // Initialization steps
         start_training(dbn, max_epochs);
 
+        auto subset = make_validation_subset(dbn, val_generator);
+
+        static_assert(!dbn_traits<dbn_t>::async_validation() || dbn_traits<dbn_t>::error_on_epoch(),
+                      "async_validation cannot be used with no_epoch_error, there is no validation to run in background");
+
+        if constexpr (dbn_traits<dbn_t>::async_validation()) {
+            return train_impl_async(dbn, train_generator, source, val_generator, subset.get(), max_epochs);
+        }
+
         //Train the model for max_epochs epoch
 
-        size_t epoch = 0;
+        size_t epoch = first_epoch();
         for (; epoch < max_epochs; ++epoch) {
             dll::auto_timer timer("net:trainer:train:epoch");
 
             // Shuffle before the epoch if necessary
-            if(dbn_traits<dbn_t>::shuffle()){
-                train_generator.reset_shuffle();
-            } else {
-                train_generator.reset();
-            }
+            shuffle_epoch(source, epoch);
 
             start_epoch(dbn, epoch);
 
-            auto [train_stats, val_stats] = train_epoch(dbn, train_generator, val_generator, epoch);
+            // Train one epoch of training data
+            train_epoch_only(dbn, source, epoch);
+
+            // Compute the training and validation errors at this epoch
+            auto train_stats = compute_error_loss(dbn, train_generator);
+            auto val_stats   = compute_val_error_loss(dbn, val_generator, subset.get(), epoch, max_epochs);
 
             if (stop_epoch(dbn, epoch, train_stats, val_stats)) {
                 break;
@@ -558,6 +1471,100 @@ struct dbn_trainer {
 
         return stop_training(dbn, epoch, max_epochs);
     }
+
+    /*!
+     * \brief Train the network for max_epochs, with the validation set
+     * evaluated in background.
+     *
+     * The validation of an epoch runs on a snapshot of the weights while
+     * the next epoch is trained. The end of an epoch (watcher, early
+     * stopping) is therefore handled one epoch late, once its validation is
+     * done. If the training is stopped early, the weights of the best epoch
+     * are restored since the network has already trained one more epoch.
+     *
+     * With a validation subset, the snapshot is evaluated again on the
+     * full validation set when the early stopping would stop the training.
+     *
+     * \param dbn The network to be trained
+     * \param train_generator The generator for the training data
+     * \param source The generator of the trained mini-batches, either train_generator or the cache of the frozen layers
+     * \param val_generator The generator for the validation data
+     * \param subset The generator of the validation subset (nullptr for none)
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename TrainGenerator, typename Source, typename ValGenerator, typename Subset>
+    error_type train_impl_async(DBN& dbn, TrainGenerator& train_generator, Source& source, ValGenerator& val_generator, Subset* subset, size_t max_epochs) {
+        // The validation and the training statistics of the previous epoch
+        std::future<std::pair<double, double>> pending_val;
+        std::pair<double, double> pending_train;
+        bool pending_full = true;
+
+        auto finish_epoch = [&](size_t finished) {
+            dll::auto_timer timer("net:trainer:train:epoch:val_wait");
+
+            auto val_stats = pending_val.get();
+
+            // The snapshot still holds the weights of the finished epoch
+            if (!pending_full && about_to_stop(dbn, finished, val_stats)) {
+                auto [val_error, val_loss] = val_snapshot->evaluate_metrics(val_generator);
+                val_stats = std::make_pair(val_error, val_loss);
+            }
+
+            return stop_epoch(dbn, finished, pending_train, val_stats);
+        };
+
+        size_t epoch = first_epoch();
+        for (; epoch < max_epochs; ++epoch) {
+            dll::auto_timer timer("net:trainer:train:epoch");
+
+            // Shuffle before the epoch if necessary
+            shuffle_epoch(source, epoch);
+
+            start_epoch(dbn, epoch);
+
+            // Train one epoch of training data, while the previous epoch is validated
+            train_epoch_only(dbn, source, epoch);
+
+            auto train_stats = compute_error_loss(dbn, train_generator);
+
+            if (pending_val.valid() && finish_epoch(epoch - 1)) {
+                // The network has been trained one more epoch since the finished one. stop_epoch already
+                // restored the best weights, unless the finished epoch was the best one
+                if (best_epoch == epoch - 1) {
+                    restore_best(dbn);
+                }
+
+                break;
+            }
+
+            update_val_snapshot(dbn);
+
+            pending_train = train_stats;
+            pending_full  = !subset || full_validation(dbn, epoch, max_epochs);
+            pending_val   = std::async(std::launch::async, [this, &val_generator, subset, full = pending_full]() {
+                auto [val_error, val_loss] = full ? val_snapshot->evaluate_metrics(val_generator) : val_snapshot->evaluate_metrics(*subset);
+                return std::make_pair(val_error, val_loss);
+            });
+        }
+
+        // The validation of the last epoch
+        if (pending_val.valid()) {
+            if (finish_epoch(max_epochs - 1)) {
+                epoch = max_epochs - 1;
+            }
+        }
+
+        // Finalization
+
+        auto error = stop_training(dbn, epoch, max_epochs);
+
+        val_snapshot.reset();
+        best_snapshot.reset();
+
+        return error;
+    }
 };
 
 } //end of dll namespace
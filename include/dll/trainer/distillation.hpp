@@ -0,0 +1,215 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Soft targets of a teacher network for knowledge distillation
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The parameters of a knowledge distillation
+ */
+struct distillation_options {
+    double temperature = 1.0; ///< The temperature softening the outputs of the teacher
+    double alpha       = 0.0; ///< The weight of the hard labels in the targets, in [0, 1]
+    size_t batch       = 256; ///< The size of the batches forwarded by the teacher
+    std::string cache;        ///< The file caching the soft targets (empty to disable the cache)
+};
+
+namespace distillation_detail {
+
+/*!
+ * \brief Load the soft targets from the given cache file
+ * \return true if the cache contains n targets of k values, false otherwise
+ */
+template <typename T>
+bool load_targets(const std::string& path, std::vector<etl::dyn_matrix<T, 1>>& targets, size_t n, size_t k) {
+    std::ifstream is(path, std::ios::binary);
+
+    uint64_t header[2] = {0, 0};
+
+    if (!is || !is.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != n || header[1] != k) {
+        return false;
+    }
+
+    targets.clear();
+    targets.reserve(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        targets.emplace_back(k);
+
+        if (!is.read(reinterpret_cast<char*>(targets.back().memory_start()), k * sizeof(T))) {
+            targets.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Store the soft targets into the given cache file
+ */
+template <typename T>
+void store_targets(const std::string& path, const std::vector<etl::dyn_matrix<T, 1>>& targets, size_t k) {
+    std::ofstream os(path, std::ios::binary);
+
+    const uint64_t header[2] = {targets.size(), k};
+
+    os.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    for (auto& target : targets) {
+        os.write(reinterpret_cast<const char*>(target.memory_start()), k * sizeof(T));
+    }
+}
+
+/*!
+ * \brief Soften the given probabilities with the given temperature, in
+ * place: softmax(log(p) / T).
+ */
+template <typename T>
+void soften(T* p, size_t k, double temperature) {
+    if (temperature == 1.0) {
+        return;
+    }
+
+    double sum = 0.0;
+
+    for (size_t j = 0; j < k; ++j) {
+        p[j] = std::pow(std::max(double(p[j]), 1e-30), 1.0 / temperature);
+        sum += p[j];
+    }
+
+    for (size_t j = 0; j < k; ++j) {
+        p[j] /= sum;
+    }
+}
+
+/*!
+ * \brief Initialize a batch of input from the shape of one sample
+ */
+template <typename Batch, typename Sample, size_t... I>
+Batch make_batch(size_t n, const Sample& sample, std::index_sequence<I...> /*seq*/) {
+    return Batch(n, etl::dim<I>(sample)...);
+}
+
+} //end of namespace distillation_detail
+
+/*!
+ * \brief Compute the targets of a student network from the outputs of a
+ * trained teacher network.
+ *
+ * The samples are forwarded by batches through an inference engine of the
+ * teacher, whose outputs must be probabilities (softmax). The outputs are
+ * softened with the temperature and mixed with the one-hot hard labels
+ * with the weight alpha. With the cross-entropy loss, training on these
+ * targets is training on the sum of the losses on the hard labels and on
+ * the soft targets, weighted by alpha and 1 - alpha.
+ *
+ * If a cache file is given, the targets are read from it when it holds the
+ * targets of as many samples and classes, and are written to it otherwise.
+ * The cache is not checked against the samples or the options.
+ *
+ * \param teacher The trained teacher network
+ * \param samples The input samples
+ * \param labels The hard labels of the samples
+ * \param options The parameters of the distillation
+ *
+ * \return the target of each sample
+ */
+template <typename Teacher, typename Samples, typename Labels>
+auto distillation_targets(const Teacher& teacher, const Samples& samples, const Labels& labels, const distillation_options& options = {}) {
+    using sample_t = std::decay_t<decltype(*samples.begin())>;
+    using weight   = typename Teacher::weight;
+    using batch_t  = etl::dyn_matrix<weight, etl::dimensions<sample_t>() + 1>;
+
+    cpp_assert(samples.size() == labels.size(), "The number of samples does not match the number of labels");
+    cpp_assert(options.alpha >= 0.0 && options.alpha <= 1.0, "The weight of the hard labels must be in [0, 1]");
+    cpp_assert(options.temperature > 0.0, "The temperature must be positive");
+
+    std::vector<etl::dyn_matrix<weight, 1>> targets;
+
+    const size_t n = samples.size();
+
+    if (!n) {
+        return targets;
+    }
+
+    const size_t max_batch = std::max(size_t(1), std::min(options.batch, n));
+
+    auto engine = teacher.make_inference_engine(max_batch, *samples.begin());
+
+    const size_t k = engine.output_size();
+
+    if (!options.cache.empty() && distillation_detail::load_targets(options.cache, targets, n, k)) {
+        return targets;
+    }
+
+    auto batch = distillation_detail::make_batch<batch_t>(max_batch, *samples.begin(), std::make_index_sequence<etl::dimensions<sample_t>()>());
+
+    targets.reserve(n);
+
+    auto sit = samples.begin();
+    auto lit = labels.begin();
+
+    for (size_t first = 0; first < n; first += max_batch) {
+        const size_t b = std::min(max_batch, n - first);
+
+        for (size_t i = 0; i < b; ++i, ++sit) {
+            batch(i) = *sit;
+        }
+
+        auto output = engine.forward(etl::slice(batch, 0, b));
+
+        for (size_t i = 0; i < b; ++i, ++lit) {
+            targets.emplace_back(k);
+
+            auto& target = targets.back();
+
+            target = etl::reshape(output(i), k);
+
+            cpu_access(target);
+            distillation_detail::soften(target.memory_start(), k, options.temperature);
+            cpu_modified(target);
+
+            if (options.alpha > 0.0) {
+                const auto label = size_t(*lit);
+
+                cpp_assert(label < k, "Invalid label for the teacher");
+
+                target *= weight(1.0 - options.alpha);
+                target[label] += weight(options.alpha);
+            }
+        }
+    }
+
+    if (!options.cache.empty()) {
+        distillation_detail::store_targets(options.cache, targets, k);
+    }
+
+    return targets;
+}
+
+} //end of dll namespace
@@ -0,0 +1,145 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file hogwild.hpp
+ * \brief Lock-free asynchronous Stochastic Gradient Descent (Hogwild)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "dll/util/batch.hpp"    // For copy_batch
+#include "dll/util/parallel.hpp" // For worker_section
+
+namespace dll {
+
+/*!
+ * \brief Asynchronous Stochastic Gradient Descent without locks (Hogwild).
+ *
+ * Several workers pull the mini-batches of the shared generator and each
+ * of them trains on its own batch with its own context, updating the
+ * shared weights directly, without any lock nor synchronization with the
+ * other workers. Updates of different workers can thus overwrite each
+ * other, this is negligible when the updates are sparse (sparse inputs or
+ * embeddings), where they rarely touch the same weights.
+ *
+ * Each worker has its own state of the updater (momentum for instance)
+ * and runs its kernels serially. The number of workers is
+ * dbn.hogwild_threads, the available threads of the budget by default.
+ */
+template <typename DBN>
+struct hogwild_trainer : sgd_trainer<DBN> {
+    using dbn_t     = DBN;                    ///< The type of DBN being trained
+    using weight    = typename dbn_t::weight; ///< The data type for this layer
+    using base_type = sgd_trainer<dbn_t>;     ///< The synchronous trainer
+    using worker_t  = sgd_trainer<dbn_t>;     ///< The trainer of one worker
+
+    static constexpr bool hogwild             = true;  ///< The trainer trains the epochs asynchronously
+    static constexpr bool distributed_trainer = false; ///< The trainer cannot train over several ranks
+
+    static_assert(base_type::shards == 1 && base_type::checkpoint == 0 && base_type::accumulate == 1 && base_type::frozen == 0 && !base_type::pipelined,
+                  "hogwild_trainer cannot be used with parallel_sgd, sgd_checkpoint, gradient_accumulation, frozen_layers or pipeline_updates");
+
+    std::vector<std::unique_ptr<worker_t>> workers; ///< The other workers, the trainer itself being the first one
+
+    /*!
+     * \brief Construct a new hogwild_trainer
+     * \param dbn The DBN being trained
+     */
+    explicit hogwild_trainer(dbn_t& dbn) : base_type(dbn) {
+        const size_t threads = dbn.hogwild_threads ? dbn.hogwild_threads : available_threads();
+
+        for (size_t t = 1; t < threads; ++t) {
+            workers.push_back(std::make_unique<worker_t>(dbn));
+        }
+    }
+
+    /*!
+     * \brief Initialize the training of all the workers
+     * \param batch_size The batch size
+     */
+    void init_training(size_t batch_size) {
+        base_type::init_training(batch_size);
+
+        for (auto& worker : workers) {
+            worker->init_training(batch_size);
+        }
+    }
+
+    /*!
+     * \brief Train all the batches of the generator, with all the workers
+     * at once.
+     *
+     * The batches are taken from the generator under a lock and copied
+     * by the workers, the training itself is done without any lock.
+     *
+     * \param epoch The current epoch
+     * \param generator The generator of the batches
+     * \param batch_end The functor called (under lock) with the index, the
+     * error and the loss of each trained batch
+     */
+    template <typename Generator, typename Functor>
+    void train_epoch(size_t epoch, Generator& generator, Functor&& batch_end) {
+        dll::auto_timer timer("hogwild::train_epoch");
+
+        std::mutex lock;
+
+        auto work = [&](worker_t& worker) {
+            batch_copy_t<decltype(generator.data_batch())> inputs;
+            batch_copy_t<decltype(generator.label_batch())> labels;
+
+            // The workers are already running in parallel, avoid oversubscription
+            worker_section section;
+
+            while (true) {
+                size_t batch = 0;
+
+                {
+                    std::lock_guard<std::mutex> l(lock);
+
+                    if (!generator.has_next_batch()) {
+                        break;
+                    }
+
+                    copy_batch(inputs, generator.data_batch());
+                    copy_batch(labels, generator.label_batch());
+
+                    batch = generator.current_batch();
+
+                    generator.next_batch();
+                }
+
+                auto metrics = worker.train_batch(epoch, inputs, labels);
+
+                std::lock_guard<std::mutex> l(lock);
+
+                batch_end(batch, metrics.first, metrics.second);
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for (auto& worker : workers) {
+            threads.emplace_back([&work, &worker] { work(*worker); });
+        }
+
+        work(*this);
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+} //end of dll namespace
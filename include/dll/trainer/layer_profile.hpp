@@ -0,0 +1,138 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Per-layer profile of the training
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "dll/layer_traits.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The profile of one layer during the training
+ */
+struct layer_profile {
+    std::string name;     ///< The short description of the layer
+    size_t flops      = 0; ///< The theoretical number of FLOP of the forward propagation of one sample
+    size_t bytes      = 0; ///< The number of bytes read and written by the forward propagation of one sample
+    size_t parameters = 0; ///< The number of parameters of the layer
+
+    size_t forward   = 0; ///< The time spent in forward propagation, in nanoseconds
+    size_t backward  = 0; ///< The time spent in backward propagation, in nanoseconds
+    size_t gradients = 0; ///< The time spent in computing and applying the gradients, in nanoseconds
+};
+
+/*!
+ * \brief The profile of one stage of pipeline-parallel training
+ */
+struct stage_profile {
+    size_t first = 0; ///< The first layer of the stage
+    size_t last  = 0; ///< The end of the layers of the stage
+
+    size_t forward   = 0; ///< The time spent in forward propagation, in nanoseconds
+    size_t backward  = 0; ///< The time spent in backward propagation, in nanoseconds
+    size_t gradients = 0; ///< The time spent in computing and applying the gradients, in nanoseconds
+    size_t idle      = 0; ///< The time spent waiting for the other stages (the bubble), in nanoseconds
+};
+
+/*!
+ * \brief The profile of all the layers of a network during the training
+ */
+struct network_profile {
+    std::vector<layer_profile> layers; ///< The profile of each layer
+    size_t samples = 0;                ///< The number of profiled samples
+    size_t batches = 0;                ///< The number of profiled batches
+
+    std::vector<stage_profile> stages; ///< The profile of each stage (pipeline-parallel training)
+    size_t micro_batches = 0;          ///< The number of micro-batches of each step (pipeline-parallel training)
+
+    /*!
+     * \brief Reset the timings, but keep the description of the layers
+     */
+    void reset() {
+        for (auto& layer : layers) {
+            layer.forward   = 0;
+            layer.backward  = 0;
+            layer.gradients = 0;
+        }
+
+        for (auto& stage : stages) {
+            stage.forward   = 0;
+            stage.backward  = 0;
+            stage.gradients = 0;
+            stage.idle      = 0;
+        }
+
+        samples = 0;
+        batches = 0;
+    }
+};
+
+/*!
+ * \brief Returns the theoretical number of FLOP of the forward propagation
+ * of one sample through the given layer.
+ *
+ * Only the dense and convolutional layers are counted precisely, the other
+ * layers are counted as one operation per output.
+ */
+template <typename Layer>
+size_t layer_flops(const Layer& layer) {
+    using traits = decay_layer_traits<Layer>;
+
+    if constexpr (traits::is_dense_layer() || traits::is_dense_rbm_layer()) {
+        return 2 * etl::size(layer.w);
+    } else if constexpr (traits::is_deconvolutional_layer()) {
+        return 2 * dll::input_size(layer) * (etl::size(layer.w) / etl::dim<0>(layer.w));
+    } else if constexpr (traits::is_convolutional_layer() || traits::is_convolutional_rbm_layer()) {
+        return 2 * dll::output_size(layer) * (etl::size(layer.w) / etl::dim<0>(layer.w));
+    } else {
+        return dll::output_size(layer);
+    }
+}
+
+/*!
+ * \brief Returns the number of parameters of the given layer
+ */
+template <typename Layer>
+size_t layer_parameters(const Layer& layer) {
+    using traits = decay_layer_traits<Layer>;
+
+    if constexpr (traits::is_neural_layer() || traits::is_rbm_layer()) {
+        size_t n = 0;
+
+        cpp::for_each(layer.trainable_parameters(), [&n](auto& variable) {
+            n += etl::size(variable);
+        });
+
+        return n;
+    } else {
+        cpp_unused(layer);
+        return 0;
+    }
+}
+
+/*!
+ * \brief Initialize the description of the given layer in its profile
+ */
+template <typename Weight, typename Layer>
+void init_layer_profile(layer_profile& profile, const Layer& layer) {
+    profile.name       = layer.to_short_string();
+    profile.flops      = layer_flops(layer);
+    profile.bytes      = (dll::input_size(layer) + dll::output_size(layer)) * sizeof(Weight);
+    profile.parameters = layer_parameters(layer);
+}
+
+} //end of dll namespace
@@ -7,14 +7,20 @@
 
 #pragma once
 
+#include <algorithm>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "cpp_utils/algorithm.hpp"
 
 #include "dll/decay_type.hpp"
 #include "dll/util/batch.hpp"
+#include "dll/util/memory.hpp"
 #include "dll/util/timers.hpp"
 #include "dll/util/random.hpp"
+#include "dll/util/parallel.hpp"
 #include "dll/layer_traits.hpp"
 #include "dll/trainer/rbm_trainer_fwd.hpp"
 #include "dll/trainer/rbm_training_context.hpp"
@@ -71,6 +77,8 @@ struct rbm_trainer {
     size_t total_batches  = 0;   ///< The total number of batches
     error_type last_error = 0.0; ///< The last training error
 
+    static constexpr size_t async_workers = rbm_layer_traits<RBM>::async_workers(); ///< The number of asynchronous workers
+
     //Note: input_first/input_last only relevant for its size, not
     //values since they can point to the input of the first level
     //and not the current level
@@ -132,6 +140,19 @@ struct rbm_trainer {
         //Allocate the trainer
         auto trainer = get_trainer(rbm);
 
+        //Allocate the trainers of the other asynchronous workers
+        std::vector<trainer_type> workers;
+
+        if constexpr (async_workers != 1) {
+            const size_t threads = async_workers ? async_workers : available_threads();
+
+            for (size_t t = 1; t < threads; ++t) {
+                workers.push_back(get_trainer(rbm));
+            }
+        }
+
+        tracked_memory trainer_memory(memory_category::TRAINER, (1 + workers.size()) * (sizeof(trainer_t<rbm_t>) + trainer->buffer_memory()));
+
         //Train for max_epochs epoch
         for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
             //Shuffle if necessary
@@ -151,7 +172,11 @@ struct rbm_trainer {
             init_epoch();
 
             //Train on all the data
-            train_sub(generator, trainer, context, rbm);
+            if (workers.empty()) {
+                train_sub(generator, trainer, context, rbm);
+            } else {
+                train_sub_async(generator, trainer, workers, context, rbm);
+            }
 
             //Finalize the current epoch
             finalize_epoch(epoch, context, rbm);
@@ -160,15 +185,17 @@ struct rbm_trainer {
         return finalize_training(rbm);
     }
 
-    size_t batches = 0; ///< The number of batches
-    size_t samples = 0; ///< The number of samples
+    size_t batches  = 0; ///< The number of batches
+    size_t measured = 0; ///< The number of batches whose statistics were computed
+    size_t samples  = 0; ///< The number of samples
 
     /*!
      * \brief Initialization of the epoch
      */
     void init_epoch() {
-        batches = 0;
-        samples = 0;
+        batches  = 0;
+        measured = 0;
+        samples  = 0;
     }
 
     template <typename Generator>
@@ -182,19 +209,114 @@ struct rbm_trainer {
         }
     }
 
+    /*!
+     * \brief Train all the batches of the generator with several workers at
+     * once (Hogwild).
+     *
+     * The batches are taken from the generator under a lock and copied by
+     * the workers, each worker trains its batches with its own trainer and
+     * updates the weights of the RBM without any lock. The statistics of
+     * the batches are gathered under the lock.
+     */
+    template <typename Generator>
+    void train_sub_async(Generator& generator, trainer_type& trainer, std::vector<trainer_type>& workers, rbm_training_context& context, rbm_t& rbm) {
+        dll::auto_timer timer("rbm_trainer:train:async");
+
+        std::mutex lock;
+
+        auto work = [&](trainer_type& worker) {
+            batch_copy_t<decltype(generator.data_batch())> input;
+            batch_copy_t<decltype(generator.label_batch())> expected;
+
+            rbm_training_context local;
+
+            // The workers are already running in parallel, avoid oversubscription
+            worker_section section;
+
+            while (true) {
+                {
+                    std::lock_guard<std::mutex> l(lock);
+
+                    if (!generator.has_next_batch()) {
+                        break;
+                    }
+
+                    copy_batch(input, generator.data_batch());
+                    copy_batch(expected, generator.label_batch());
+
+                    generator.next_batch();
+
+                    start_batch(input, local);
+                }
+
+                worker->train_batch(input, expected, local);
+
+                std::lock_guard<std::mutex> l(lock);
+
+                end_batch(local, context, rbm);
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for (auto& worker : workers) {
+            threads.emplace_back([&work, &worker] { work(worker); });
+        }
+
+        work(trainer);
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
     template <typename InputBatch, typename ExpectedBatch>
     void train_batch(InputBatch&& input, ExpectedBatch&& expected, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
-        ++batches;
+        start_batch(input, context);
 
         trainer->train_batch(input, expected, context);
 
-        context.reconstruction_error += context.batch_error;
-        context.sparsity += context.batch_sparsity;
+        end_batch(context, context, rbm);
+    }
+
+    /*!
+     * \brief Count a new batch and decide if its statistics are computed
+     * \param input The input batch
+     * \param batch_context The context the batch is trained with
+     */
+    template <typename InputBatch>
+    void start_batch(const InputBatch& input, rbm_training_context& batch_context) {
+        ++batches;
+        samples += etl::dim<0>(input);
+
+        // The batches displayed by the watcher always have their statistics
+        constexpr size_t every = rbm_layer_traits<rbm_t>::statistics_every();
+
+        batch_context.compute_statistics = (EnableWatcher && rbm_layer_traits<rbm_t>::is_verbose()) || (batches - 1) % every == 0;
+    }
+
+    /*!
+     * \brief Gather the statistics of a trained batch in the epoch context
+     * \param batch_context The context the batch has been trained with
+     * \param context The context of the epoch
+     * \param rbm The RBM being trained
+     */
+    void end_batch(const rbm_training_context& batch_context, rbm_training_context& context, rbm_t& rbm) {
+        // The watcher displays the last batch of the epoch context
+        context.batch_error       = batch_context.batch_error;
+        context.batch_sparsity    = batch_context.batch_sparsity;
+        context.batch_free_energy = batch_context.batch_free_energy;
+
+        if (batch_context.compute_statistics) {
+            context.reconstruction_error += batch_context.batch_error;
+            context.sparsity += batch_context.batch_sparsity;
 
+            ++measured;
+        }
+
+        // The free energy of the batch is computed by the trainer
         if constexpr (EnableWatcher && rbm_layer_traits<rbm_t>::free_energy()) {
-            for (auto& v : input) {
-                context.free_energy += rbm.free_energy(v);
-            }
+            context.free_energy += batch_context.batch_free_energy;
         }
 
         if (EnableWatcher && rbm_layer_traits<rbm_t>::is_verbose()) {
@@ -204,8 +326,8 @@ struct rbm_trainer {
 
     void finalize_epoch(size_t epoch, rbm_training_context& context, rbm_t& rbm) {
         //Average all the gathered information
-        context.reconstruction_error /= batches;
-        context.sparsity /= batches;
+        context.reconstruction_error /= measured;
+        context.sparsity /= measured;
         context.free_energy /= samples;
 
         //After some time increase the momentum
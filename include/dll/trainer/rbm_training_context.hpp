@@ -21,8 +21,11 @@ struct rbm_training_context {
     double free_energy          = 0.0; ///< The mean free energy
     double sparsity             = 0.0; ///< The mean sparsity
 
-    double batch_error    = 0.0; ///< The mean reconstruction error for the last batch
-    double batch_sparsity = 0.0; ///< The mean sparsity for the last batch
+    double batch_error       = 0.0; ///< The mean reconstruction error for the last batch
+    double batch_sparsity    = 0.0; ///< The mean sparsity for the last batch
+    double batch_free_energy = 0.0; ///< The sum of the free energies of the last batch (free_energy)
+
+    bool compute_statistics = true; ///< Indicates if the error and the sparsity of the next batch must be computed
 };
 
 } //end of dll namespace
@@ -15,11 +15,29 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "dll/trainer/context_fwd.hpp" // For sgd_context
 #include "dll/util/checks.hpp"         // For NaN checks
+#include "dll/util/batch_merge.hpp"    // For batch_merge_at
+#include "dll/util/loss_kernels.hpp"   // For loss_errors
+#include "dll/util/updater_kernels.hpp" // For fused_update
 #include "dll/util/timers.hpp"         // For auto_timer
+#include "dll/util/arena.hpp"          // For training_arena
+#include "dll/util/memory.hpp"         // For tracked_memory
+#include "dll/util/sparse_rows.hpp"    // For sparse_rows
+#include "dll/util/parameter_store.hpp" // For updater_state
+#include "dll/trainer/layer_profile.hpp" // For network_profile
+#include "dll/trainer/checkpoint.hpp"    // For activation checkpointing
+#include "dll/util/distributed.hpp"      // For gradient_reducer
+#include "dll/util/task_pool.hpp"        // For work_stealing_pool
+#include "dll/util/sampled_softmax.hpp"  // For is_sampled_softmax_layer
+#include "dll/util/pipeline.hpp"         // For pipeline_workers
+#include "dll/util/fast_random.hpp"      // For random_shard_section
 
 namespace dll {
 
@@ -70,7 +88,7 @@ struct updater_sub_context;
  * \brief Specialization of updater_sub_context for SGD updater
  */
 template<typename Layer, size_t I>
-struct updater_sub_context <Layer, I, updater_type::SGD> {
+struct updater_sub_context <Layer, I, updater_type::SGD> : sparse_rows<Layer, I> {
     /*!
      * \brief The type of the variable to optimize
      */
@@ -162,7 +180,7 @@ struct updater_sub_context <Layer, I, updater_type::RMSPROP> {
  * \brief Specialization of updater_sub_context for Adagrad updater
  */
 template<typename Layer, size_t I>
-struct updater_sub_context <Layer, I, updater_type::ADAGRAD> {
+struct updater_sub_context <Layer, I, updater_type::ADAGRAD> : sparse_rows<Layer, I> {
     /*!
      * \brief The type of the variable to optimize
      */
@@ -192,9 +210,9 @@ struct updater_sub_context <Layer, I, updater_type::ADADELTA> {
     using type = std::remove_reference_t<decltype(std::get<I>(std::declval<Layer>().trainable_parameters()))>;
 
     type grad; ///< The gradients of the variable
-    type g;
-    type x;
-    type v;
+    type g;    ///< The accumulated squared gradients
+    type x;    ///< The accumulated squared updates
+    type v;    ///< The last update
 
     /*!
      * \brief Construct the sub_context for the given layer
@@ -212,7 +230,7 @@ struct updater_sub_context <Layer, I, updater_type::ADADELTA> {
  * \brief The context for the Adam updater
  */
 template<typename Layer, size_t I>
-struct updater_sub_context <Layer, I, updater_type::ADAM> {
+struct updater_sub_context <Layer, I, updater_type::ADAM> : sparse_rows<Layer, I> {
     /*!
      * \brief The type of the variable to optimize
      */
@@ -245,20 +263,16 @@ struct updater_sub_context <Layer, I, updater_type::ADAM_CORRECT> {
 
     type grad; ///< The gradients of the variable
     type m;    ///< Estimates of the first moment of the gradient
-    type mt;   ///< Corrected estimates of the first moment of the gradient
     type v;    ///< Estimates of the second moment of the gradient
-    type vt;   ///< Corrected estimates of the second moment of the gradient
 
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
      */
-    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), mt(grad), v(grad), vt(grad) {
+    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), v(grad) {
         grad = 0;
         m = 0;
-        mt = 0;
         v = 0;
-        vt = 0;
     }
 };
 
@@ -274,22 +288,18 @@ struct updater_sub_context <Layer, I, updater_type::NADAM> {
 
     type grad; ///< The gradients of the variable
     type m;    ///< Estimates of the first moment of the gradient
-    type mt;   ///< Corrected estimates of the first moment of the gradient
     type v;    ///< Estimates of the second moment of the gradient
-    type vt;   ///< Corrected estimates of the second moment of the gradient
 
-    double m_schedule;
+    double m_schedule; ///< The product of the momentum schedule
 
     /*!
      * \brief Construct the sub_context for the given layer
      * \param layer The layer to build the context for
      */
-    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), mt(grad), v(grad), vt(grad) {
+    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), v(grad) {
         grad = 0;
         m = 0;
-        mt = 0;
         v = 0;
-        vt = 0;
 
         m_schedule = 1.0;
     }
@@ -457,6 +467,30 @@ struct full_sgd_context<DBN, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers
     }
 };
 
+/*!
+ * \brief Create the context of one layer, from the arena of the network
+ * if it uses one.
+ * \param dbn The DBN being trained
+ * \param layer The layer to create the context for
+ */
+template <typename Context, typename DBN, typename Layer>
+std::shared_ptr<Context> make_context(DBN& dbn, Layer& layer) {
+    if constexpr (dbn_traits<DBN>::uses_arena()) {
+        return std::allocate_shared<Context>(arena_allocator<Context>(dbn.get_arena()), layer);
+    } else {
+        return std::make_shared<Context>(layer);
+    }
+}
+
+/*!
+ * \brief Returns an estimation of the memory needed by the contexts of a DBN
+ */
+template<template<typename, typename, size_t> typename Context, typename DBN, size_t... I>
+constexpr size_t context_bytes(std::index_sequence<I...> /*seq*/){
+    // Each shared context also holds a control block
+    return ((sizeof(Context<DBN, typename DBN::template layer_type<I>, I>) + 2 * training_arena::alignment) + ...);
+}
+
 /*!
  * \brief Build the context for a DBN for the given sequence of layers
  * \param dbn The DBN to build the context from
@@ -467,7 +501,7 @@ auto build_context(DBN& dbn, std::index_sequence<I...> /*seq*/){
         (
             (std::make_pair(
                 std::ref(dbn.template layer_get<I>()),  // Reference to the layer
-                std::make_shared<Context<DBN, typename DBN::template layer_type<I>, I>>(dbn.template layer_get<I>()))
+                make_context<Context<DBN, typename DBN::template layer_type<I>, I>>(dbn, dbn.template layer_get<I>()))
             )...
         );
 }
@@ -481,6 +515,45 @@ auto build_context(DBN& dbn){
     return build_context<Context>(dbn, std::make_index_sequence<DBN::layers>());
 }
 
+/*!
+ * \brief Build the gradient accumulators of one layer, one SGD updater sub
+ * context per trainable variable
+ * \param layer The layer to build the accumulators for
+ */
+template <typename Layer>
+auto build_layer_accumulators(const Layer& layer) {
+    if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+        return build_sub_context<updater_sub_context, updater_type::SGD>(layer);
+    } else {
+        cpp_unused(layer);
+        return std::tuple<>();
+    }
+}
+
+/*!
+ * \brief Build the gradient accumulators for the given sequence of layers
+ * \param dbn The DBN to build the accumulators for
+ */
+template <typename DBN, size_t... I>
+auto build_accumulators(DBN& dbn, std::index_sequence<I...> /*seq*/) {
+    return std::make_tuple(build_layer_accumulators(dbn.template layer_get<I>())...);
+}
+
+/*!
+ * \brief Build the gradient accumulators of a DBN, nothing is built if the
+ * DBN does not accumulate gradients
+ * \param dbn The DBN to build the accumulators for
+ */
+template <typename DBN>
+auto build_accumulators(DBN& dbn) {
+    if constexpr (dbn_traits<DBN>::gradient_accumulation() > 1) {
+        return build_accumulators(dbn, std::make_index_sequence<DBN::layers>());
+    } else {
+        cpp_unused(dbn);
+        return std::tuple<>();
+    }
+}
+
 /*!
  * \brief Simple gradient descent trainer
  */
@@ -490,12 +563,151 @@ struct sgd_trainer {
     using weight    = typename dbn_t::weight; ///< The data type for this layer
     using this_type = sgd_trainer<dbn_t>;     ///< The type of this layer
 
-    static constexpr auto layers     = dbn_t::layers;     ///< The number of layers
-    static constexpr auto batch_size = dbn_t::batch_size; ///< The batch size for training
+    static constexpr auto layers     = dbn_t::layers;                   ///< The number of layers
+    static constexpr auto batch_size = dbn_t::batch_size;               ///< The batch size for training
+    static constexpr auto shards     = dbn_traits<dbn_t>::sgd_shards(); ///< The number of data-parallel shards
+    static constexpr auto checkpoint = dbn_traits<dbn_t>::sgd_checkpoint(); ///< The number of layers of each checkpointed segment
+    static constexpr auto accumulate = dbn_traits<dbn_t>::gradient_accumulation(); ///< The number of accumulated mini-batches
+    static constexpr auto frozen     = dbn_traits<dbn_t>::frozen_layers();         ///< The number of frozen layers at the front of the network
+    static constexpr bool overlap    = dbn_traits<dbn_t>::sgd_overlap();           ///< Indicates if the gradients overlap the backward pass
+    static constexpr bool pipelined  = dbn_traits<dbn_t>::sgd_pipeline();          ///< Indicates if the updates overlap the next forward pass
+    static constexpr auto stages     = dbn_traits<dbn_t>::pipeline_stages();       ///< The number of pipeline-parallel stages
+    static constexpr auto replicas   = dbn_traits<dbn_t>::staged_batches();        ///< The number of replicas of the context (shards or micro-batches)
+    static constexpr auto selective  = dbn_traits<dbn_t>::selective_backprop();    ///< The percentage of the samples that are backpropagated
+
+    /*!
+     * \brief Indicates if the trainer can train over several ranks
+     */
+    static constexpr bool distributed_trainer = shards == 1 && stages == 1 && checkpoint == 0 && accumulate == 1 && frozen == 0 && selective == 100;
+
+    /*!
+     * \brief Indicates if the trainer only backpropagates a part of the samples
+     */
+    static constexpr bool selective_trainer = selective < 100;
+
+    /*!
+     * \brief The first layer of the last checkpointed segment, which is
+     * never recomputed
+     */
+    static constexpr size_t last_segment = checkpoint ? ((layers - 1) / checkpoint) * checkpoint : 0;
+
+    static_assert(shards == 1 || !dbn_traits<dbn_t>::is_serial(), "parallel_sgd cannot be used on serial networks");
+    static_assert(checkpoint == 0 || shards == 1, "sgd_checkpoint cannot be used with parallel_sgd");
+    static_assert(accumulate == 1 || (shards == 1 && checkpoint == 0), "gradient_accumulation cannot be used with parallel_sgd or sgd_checkpoint");
+    static_assert(are_recomputable_layers<dbn_t, last_segment>(std::make_index_sequence<layers>()),
+                  "sgd_checkpoint cannot recompute dropout or batch normalization layers");
+    static_assert(frozen == 0 || (shards == 1 && checkpoint == 0 && accumulate == 1),
+                  "frozen_layers cannot be used with parallel_sgd, sgd_checkpoint or gradient_accumulation");
+    static_assert(frozen < layers, "frozen_layers must leave at least one trained layer");
+    static_assert(!overlap || (shards == 1 && checkpoint == 0 && accumulate == 1 && frozen == 0 && !dbn_traits<dbn_t>::has_global_clip_gradients()),
+                  "overlap_gradients cannot be used with parallel_sgd, sgd_checkpoint, gradient_accumulation, frozen_layers or global_clip_gradients");
+    static_assert(!pipelined || (!overlap && shards == 1 && checkpoint == 0 && accumulate == 1 && frozen == 0 && !dbn_traits<dbn_t>::has_global_clip_gradients()),
+                  "pipeline_updates cannot be used with overlap_gradients, parallel_sgd, sgd_checkpoint, gradient_accumulation, frozen_layers or global_clip_gradients");
+    static_assert(stages == 1 || !dbn_traits<dbn_t>::is_serial(), "pipeline_stages cannot be used on serial networks");
+    static_assert(stages <= layers, "pipeline_stages needs at least one layer per stage");
+    static_assert(stages == 1 || (shards == 1 && checkpoint == 0 && accumulate == 1 && frozen == 0 && !overlap && !pipelined && !dbn_traits<dbn_t>::has_global_clip_gradients()),
+                  "pipeline_stages cannot be used with parallel_sgd, sgd_checkpoint, gradient_accumulation, frozen_layers, overlap_gradients, pipeline_updates or global_clip_gradients");
+    static_assert(!dbn_traits<dbn_t>::sparse_labels() || dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY,
+                  "sparse_labels is only supported with the categorical cross entropy");
+    static_assert(frozen == 0 || !is_utility_layer<typename dbn_t::template layer_type<frozen>>, "The first trained layer cannot be a group or merge layer");
+    static_assert(only_last_sampled_softmax<dbn_t>(std::make_index_sequence<layers>()), "sampled_softmax can only be used on the last layer");
+    static_assert(!is_sampled_softmax_layer<typename dbn_t::template layer_type<layers - 1>>::value || dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY,
+                  "sampled_softmax is only supported with the categorical cross entropy");
+    static_assert(selective == 100 || (shards == 1 && stages == 1 && checkpoint == 0 && accumulate == 1 && frozen == 0 && !overlap && !pipelined),
+                  "selective_backprop cannot be used with parallel_sgd, pipeline_stages, sgd_checkpoint, gradient_accumulation, frozen_layers, overlap_gradients or pipeline_updates");
+    static_assert(selective == 100 || !is_sampled_softmax_layer<typename dbn_t::template layer_type<layers - 1>>::value,
+                  "selective_backprop cannot be used with sampled_softmax");
+
+    using context_t      = decltype(build_context<full_sgd_context>(std::declval<dbn_t&>())); ///< The type of the full context
+    using accumulators_t = decltype(build_accumulators(std::declval<dbn_t&>()));              ///< The type of the gradient accumulators
+    using input_batch_t  = std::decay_t<decltype(std::get<0>(std::declval<context_t&>()).second->input)>; ///< The type of a batch of inputs
+
+    /*!
+     * \brief A shard for data-parallel training, or a micro-batch for
+     * pipeline-parallel training.
+     *
+     * Each shard holds a replica of the full context and the labels of
+     * the mini-batch it has been given.
+     */
+    struct sgd_shard {
+        context_t context; ///< The replicated context
+
+        /*!
+         * \brief The labels of the staged mini-batch
+         */
+        std::decay_t<decltype(std::get<layers - 1>(std::declval<context_t&>()).second->output)> labels;
+
+        size_t n = 0; ///< The number of samples in the staged mini-batch
+
+        std::pair<double, double> metrics; ///< The error and the loss of the staged mini-batch
+
+        /*!
+         * \brief Construct a new shard for the given network
+         * \param dbn The network being trained
+         */
+        explicit sgd_shard(dbn_t& dbn) : context(build_context<full_sgd_context>(dbn)), labels(std::get<layers - 1>(context).second->output) {
+            this_type::init_context(context);
+        }
+    };
 
-    dbn_t& dbn;                                                  ///< The DBN being trained
-    decltype(build_context<full_sgd_context>(dbn)) full_context; ///< The context
-    size_t iteration;                                            ///< The current iteration
+    dbn_t& dbn;                            ///< The DBN being trained
+    context_t full_context;                ///< The context
+    std::vector<sgd_shard> shard_contexts; ///< The shards for data-parallel training (or the micro-batches of pipeline-parallel training)
+    size_t iteration;                      ///< The current iteration
+
+    network_profile profile; ///< The per-layer profile of the training
+    bool profiling = false;  ///< Indicates if the layers are profiled
+
+    std::array<std::array<std::vector<size_t>, 3>, layers> released; ///< The shapes of the released buffers of each context
+    size_t released_bytes = 0;                                       ///< The number of bytes currently released
+    context_memory_report memory;                                    ///< The memory of the activations of the contexts
+    tracked_memory tracked{memory_category::CONTEXT};                ///< The tracked memory of the contexts
+
+    accumulators_t accumulators;    ///< The accumulated gradients of each layer
+    size_t accumulated       = 0;   ///< The number of samples accumulated since the last update
+    double accumulated_error = 0.0; ///< The sum of the errors of the accumulated samples
+    double accumulated_loss  = 0.0; ///< The sum of the losses of the accumulated samples
+
+    std::vector<fused_tensor<weight>> pending_biases; ///< The biases waiting for a multi-tensor update
+    bool batch_biases = false;                        ///< Indicates if the updates of the biases are batched
+
+    /*!
+     * \brief An update waiting for the global norm of the gradients
+     */
+    struct clipped_update {
+        void (*apply)(sgd_trainer& trainer, const clipped_update& update); ///< Apply the update of the layer
+        void* layer;                                                        ///< The layer
+        void* context;                                                      ///< The context of the layer
+        size_t epoch;                                                       ///< The current epoch
+        size_t n;                                                           ///< The number of samples of the batch
+    };
+
+    std::vector<fused_tensor<weight>> clipped_tensors; ///< The gradients of the global norm (global gradient clipping)
+    std::vector<clipped_update> clipped_updates;       ///< The updates waiting for the global norm
+    double clipped_sum  = 0.0;                         ///< The sum of the squares of the gradients of other types
+    size_t clipped_n    = 0;                           ///< The number of samples of the waiting updates
+    double global_scale = 1.0;                         ///< The scale of all the gradients (global gradient clipping)
+
+    std::unique_ptr<work_stealing_pool> gradient_tasks; ///< The pool computing the gradients in the background (overlap_gradients and pipeline_updates)
+    std::array<task_group, layers> pending_updates;     ///< The pending update of each layer (pipeline_updates)
+    bool pending_iteration = false;                     ///< Indicates if the iteration of the pending updates is not yet counted
+
+    communicator* comm = nullptr;                       ///< The communicator of the distributed training
+    std::unique_ptr<gradient_reducer<weight>> reducer; ///< The background reduction of the gradients
+
+    std::unique_ptr<pipeline_workers> stage_workers; ///< The threads of the stages (pipeline_stages)
+    std::vector<size_t> stage_bounds;                ///< The first layer of each stage, and the end of the last one
+    std::vector<size_t> stage_busy;                  ///< The time spent working by each stage on the current step, in nanoseconds
+
+    input_batch_t pending_inputs;       ///< The selected inputs waiting for a full batch (selective_backprop)
+    std::vector<weight> pending_labels; ///< The labels of the selected inputs (selective_backprop)
+    std::vector<double> scores;         ///< The scores of the samples of the current batch (selective_backprop)
+    std::vector<size_t> ranks;          ///< The samples of the current batch, the selected ones first (selective_backprop)
+    size_t pending_samples = 0;         ///< The number of selected inputs waiting
+    size_t scored_samples  = 0;         ///< The number of scored samples
+    size_t trained_samples = 0;         ///< The number of backpropagated samples
+    size_t score_ns        = 0;         ///< The time spent scoring the samples, in nanoseconds
+    size_t train_ns        = 0;         ///< The time spent training the selected samples, in nanoseconds
 
     // Transform layers need to inherit dimensions from back
 
@@ -510,7 +722,11 @@ struct sgd_trainer {
         if (ctx2.errors.size() == 0) {
             ctx2.output = ctx1.output;
             ctx2.errors = ctx1.output;
-            ctx2.input  = ctx1.output;
+
+            // The input of an in-place layer is never stored
+            if constexpr (!dbn_detail::is_inplace_layer<std::decay_t<typename L2::first_type>>::value) {
+                ctx2.input = ctx1.output;
+            }
         }
     }
 
@@ -520,102 +736,245 @@ struct sgd_trainer {
     template<typename L1, typename L2, cpp_disable_iff(decay_layer_traits<typename L2::first_type>::is_transform_layer())>
     static void inherit_from_front(L1& /*l1*/, L2& /*l2*/){ }
 
+    /*!
+     * \brief Size the arena of the network for the full context and the
+     * contexts of the shards
+     * \param dbn The network being trained
+     * \return the network
+     */
+    static dbn_t& prepare_arena(dbn_t& dbn) {
+        if constexpr (dbn_traits<dbn_t>::uses_arena()) {
+            dbn.get_arena().reserve((replicas > 1 ? replicas + 1 : 1) * context_bytes<full_sgd_context, dbn_t>(std::make_index_sequence<layers>()));
+        }
+
+        return dbn;
+    }
+
     /*!
      * \brief construct a new sgd_trainer
      * \param dbn The DBN being trained
      */
-    explicit sgd_trainer(dbn_t& dbn) : dbn(dbn), full_context(build_context<full_sgd_context>(dbn)), iteration(1) {
+    explicit sgd_trainer(dbn_t& dbn) : dbn(dbn), full_context(build_context<full_sgd_context>(prepare_arena(dbn))), iteration(1), accumulators(build_accumulators(dbn)) {
+        init_context(full_context);
+
+        size_t gradients = 0;
+
+        cpp::for_each(full_context, [this, &gradients](auto& layer_ctx) {
+            using layer_t = std::decay_t<decltype(layer_ctx.first)>;
+
+            // The buffers of a bound view layer are the buffers of the previous layer
+            if constexpr (dbn_detail::is_view_layer<layer_t>::value) {
+                memory.full += layer_ctx.second->storage.size() * sizeof(weight);
+            } else if constexpr (!is_utility_layer<layer_t>) {
+                auto& ctx = *layer_ctx.second;
+
+                memory.full += buffer_bytes(ctx.input) + buffer_bytes(ctx.output) + buffer_bytes(ctx.errors);
+            }
+
+            if constexpr (decay_layer_traits<layer_t>::is_neural_layer()) {
+                cpp::for_each(layer_ctx.first.trainable_parameters(), [&gradients](auto& variable) {
+                    gradients += buffer_bytes(variable);
+                });
+            }
+        });
+
+        memory.checkpointed = checkpoint ? 0 : memory.full;
+
+        if constexpr (checkpoint > 0) {
+            release_segments(std::make_index_sequence<last_segment>());
+        }
+
+        if constexpr (overlap || pipelined) {
+            gradient_tasks = std::make_unique<work_stealing_pool>(budget_workers(layers > 1 ? layers - 1 : 1));
+        }
+
+        if constexpr (replicas > 1) {
+            shard_contexts.reserve(replicas);
+
+            for (size_t s = 0; s < replicas; ++s) {
+                shard_contexts.emplace_back(dbn);
+            }
+        }
+
+        if constexpr (stages > 1) {
+            // The stages are balanced on the theoretical cost of the layers
+            std::vector<size_t> costs;
+
+            cpp::for_each(full_context, [&costs](auto& layer_ctx) {
+                costs.push_back(layer_flops(layer_ctx.first) + 1);
+            });
+
+            stage_bounds = partition_stages(costs, stages);
+            stage_busy.resize(stages);
+
+            stage_workers = std::make_unique<pipeline_workers>(stages);
+        }
+
+        // Track the activations, the gradients and the state of the updater of every replica of the context
+        parameter_store<weight> state;
+        std::vector<double*> scalars;
+        updater_state(state, scalars);
+
+        tracked.track((replicas > 1 ? replicas + 1 : 1) * (memory.full - released_bytes + gradients + state.size() * sizeof(weight)));
+    }
+
+    /*!
+     * \brief Initialize a freshly built full context
+     * \param context The context to initialize
+     */
+    static void init_context(context_t& context) {
         // Inherit dimensions from front to end (for transform layers)
+        // The view layers are bound to the buffers of the previous layer
 
-        cpp::for_each_pair(full_context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
+        cpp::for_each_pair(context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
             constexpr bool l2_transform = decay_layer_traits<decltype(layer_ctx_2.first)>::is_transform_layer();
+            constexpr bool l2_view      = dbn_detail::is_view_layer<std::decay_t<decltype(layer_ctx_2.first)>>::value;
 
-            if (l2_transform) {
+            if constexpr (l2_view) {
+                this_type::bind_view(*layer_ctx_1.second, *layer_ctx_2.second);
+            } else if (l2_transform) {
                 this_type::inherit_from_front(layer_ctx_1, layer_ctx_2);
             }
         });
     }
 
     /*!
-     * \brief Initialize the training
+     * \brief Bind the context of a view layer to the output and the errors
+     * of the previous layer
+     * \param ctx1 The context of the previous layer
+     * \param ctx2 The context of the view layer
      */
-    void init_training(size_t) {}
+    template <typename C1, typename C2>
+    static void bind_view(C1& ctx1, C2& ctx2) {
+        auto& output = get_output(ctx1);
+        auto& errors = get_errors(ctx1);
 
-    // CPP17 Replace SFINAE with if constexpr
+        cpp_assert(etl::size(output) == etl::size(ctx2.input), "Invalid sizes for the view layer");
+        cpp_assert(etl::size(errors) == etl::size(ctx2.errors), "Invalid sizes for the view layer");
+
+        ctx2.bind(output.memory_start(), errors.memory_start());
+    }
 
     /*!
-     * \brief Compute the errors of the last layer given the loss function
+     * \brief Bind again the view layers following the layer I, after its
+     * buffers have been allocated again
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+    template <size_t I>
+    void rebind_views() {
+        if constexpr (I + 1 < layers && dbn_detail::is_view_layer<typename dbn_t::template layer_type<I + 1>>::value) {
+            bind_view(*std::get<I>(full_context).second, *std::get<I + 1>(full_context).second);
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
-
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = labels(i) - last_ctx.output(i);
-            }
-        } else {
-            last_ctx.errors = labels - last_ctx.output;
+            rebind_views<I + 1>();
         }
-
-        // Note: No need to multiply by the derivative of
-        // the activation function since the terms are
-        // canceling out in the derivative of the loss
     }
 
     /*!
-     * \brief Compute the errors of the last layer given the loss function
+     * \brief Initialize the training
+     */
+    void init_training(size_t) {}
+
+    /*!
+     * \brief Enable the per-layer profiling of the training.
+     *
+     * Only the mini-batches trained by train_batch() and the micro-batches
+     * of the pipeline-parallel training are profiled.
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+    void enable_profiling() {
+        profiling = true;
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+        profile.layers.resize(layers);
+        profile.reset();
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = 2.0 * (labels(i) - last_ctx.output(i));
+        cpp::for_each_i(full_context, [this](size_t i, auto& layer_ctx) {
+            init_layer_profile<weight>(profile.layers[i], layer_ctx.first);
+        });
+
+        if constexpr (stages > 1) {
+            profile.stages.resize(stages);
+            profile.micro_batches = replicas;
+
+            for (size_t s = 0; s < stages; ++s) {
+                profile.stages[s].first = stage_bounds[s];
+                profile.stages[s].last  = stage_bounds[s + 1];
             }
-        } else {
-            last_ctx.errors = 2.0 * (labels - last_ctx.output);
+
+            profile.reset();
         }
+    }
 
-        // Multiply by the derivative of the activation function
-        last_layer.adapt_errors(last_ctx);
+    /*!
+     * \brief Returns the memory of the activations (inputs, outputs and
+     * errors) of the contexts.
+     *
+     * With checkpointing, this is the peak measured during the training so
+     * far, otherwise both sizes are the same.
+     */
+    context_memory_report context_memory() const {
+        return memory;
     }
 
     /*!
-     * \brief Compute the errors of the last layer given the loss function
+     * \brief Collect the state of the updater of all the layers.
+     *
+     * The state tensors (momentum, moments, ...) are added to the store, in
+     * the order of the layers, and the scalar state to the given vector.
+     *
+     * \param state The store of the state tensors
+     * \param scalars The scalar state of the updater
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+    void updater_state(parameter_store<weight>& state, std::vector<double*>& scalars) {
+        state.clear();
+        scalars.clear();
 
-        // Avoid Nan from division by ((1 - out) * out)
-        auto out = etl::force_temporary(etl::clip(last_ctx.output, 0.001, 0.999));
+        cpp::for_each(full_context, [&state, &scalars](auto& layer_ctx) {
+            this_type::updater_state_layer(layer_ctx.first, *layer_ctx.second, state, scalars);
+        });
+    }
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+    /*!
+     * \brief Compute the errors of the last layer given the loss function.
+     *
+     * The errors, the error and the loss of the batch are computed in a
+     * single traversal of the output. With a sampled softmax, the output of
+     * the last layer is only computed here, for the candidate classes.
+     *
+     * \param context The training context
+     * \param n The number of samples of the batch
+     * \param labels The labels of the batch
+     *
+     * \return A pair containing the error and the loss of the batch, not normalized
+     */
+    template <loss_function F, typename Context, typename Labels>
+    static std::pair<double, double> last_errors(Context& context, size_t n, const Labels& labels) {
+        auto& last_layer = std::get<layers - 1>(context).first;
+        auto& last_ctx   = *std::get<layers - 1>(context).second;
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = (labels(i) - out(i)) / ((1.0 - out(i)) >> out(i));
-            }
-        } else {
-            last_ctx.errors = (labels - out) / ((1.0 - out) >> out);
+        if constexpr (is_sampled_softmax_layer<std::decay_t<decltype(last_layer)>>::value) {
+            return last_layer.sampled_errors(last_ctx, labels, n);
         }
 
-        // Check for NAN before derivative
-        nan_check_etl(last_ctx.errors);
+        auto metrics = loss_errors<F, dbn_traits<dbn_t>::top_k_error()>(get_output(last_ctx), labels, last_ctx.errors, n);
+
+        if constexpr (F == loss_function::CATEGORICAL_CROSS_ENTROPY) {
+            // Note: No need to multiply by the derivative of
+            // the activation function since the terms are
+            // canceling out in the derivative of the loss
+            cpp_unused(last_layer);
+        } else if constexpr (F == loss_function::BINARY_CROSS_ENTROPY) {
+            // Check for NAN before derivative
+            nan_check_etl(last_ctx.errors);
 
-        // Multiply by the derivative of the activation function
-        last_layer.adapt_errors(last_ctx);
+            // Multiply by the derivative of the activation function
+            last_layer.adapt_errors(last_ctx);
+
+            // Check for NAN after derivative
+            nan_check_etl(last_ctx.errors);
+        } else {
+            // Multiply by the derivative of the activation function
+            last_layer.adapt_errors(last_ctx);
+        }
 
-        // Check for NAN after derivative
-        nan_check_etl(last_ctx.errors);
+        return metrics;
     }
 
     /*!
@@ -629,12 +988,9 @@ struct sgd_trainer {
     std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
         dll::auto_timer timer("sgd::train_batch");
 
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+        auto& first_ctx = *std::get<0>(full_context).second;
 
-        const auto n          = etl::dim<0>(inputs);
-        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+        const auto n = etl::dim<0>(inputs);
 
         // Ensure that the data batch and the label batch are of the same size
         cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
@@ -642,6 +998,26 @@ struct sgd_trainer {
         // Ensure that the context can hold the inputs
         cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
 
+        if constexpr (selective < 100) {
+            return train_batch_selective(epoch, inputs, labels);
+        }
+
+        if (cpp_unlikely(profiling)) {
+            return train_batch_profiled(epoch, inputs, labels);
+        }
+
+        if constexpr (checkpoint > 0) {
+            return train_batch_checkpointed(epoch, inputs, labels);
+        }
+
+        if constexpr (overlap) {
+            return train_batch_overlapped(epoch, inputs, labels);
+        }
+
+        if constexpr (pipelined) {
+            return train_batch_pipelined(epoch, inputs, labels);
+        }
+
         //Feedforward pass
 
         {
@@ -650,22 +1026,41 @@ struct sgd_trainer {
             forward_batch_helper<true>(inputs);
         }
 
+        auto metrics = train_forwarded(epoch, n, labels);
+
+        // The error and the loss were computed with the errors of the last layer
+
+        return std::make_pair(metrics.first / n, metrics.second / n);
+    }
+
+    /*!
+     * \brief Backpropagate a batch already forward propagated in the full
+     * context and update the weights
+     *
+     * \param epoch The current epoch
+     * \param n The number of samples of the batch
+     * \param labels A batch of labels
+     *
+     * \return a pair containing the error and the loss for the batch, not normalized
+     */
+    template <typename Labels>
+    std::pair<double, double> train_forwarded(size_t epoch, size_t n, const Labels& labels) {
+        std::pair<double, double> metrics;
+
         {
             dll::auto_timer timer("sgd::backward");
 
             //Compute the errors of the last layer
 
-            last_errors<dbn_t::loss>(full_batch, n, labels);
+            metrics = last_errors<dbn_t::loss>(full_context, n, labels);
 
             // Backpropagate the error
 
-            bool last = true;
-
-            cpp::for_each_rpair(full_context, [&last](auto& layer_ctx_1, auto& layer_ctx_2) {
-                backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
-            });
-
-            first_layer.adapt_errors(first_ctx);
+            if constexpr (frozen > 0) {
+                backward_trained(std::make_index_sequence<layers - frozen>());
+            } else {
+                backward_context(full_context);
+            }
         }
 
         // Compute and apply the gradients
@@ -673,163 +1068,1869 @@ struct sgd_trainer {
         {
             dll::auto_timer timer("sgd::grad");
 
-            cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
-                this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+            batched_biases_update([this, epoch, n]() {
+                if constexpr (frozen > 0) {
+                    this->apply_trained_gradients(epoch, n, std::make_index_sequence<layers - frozen>());
+                } else {
+                    cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
+                        this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+                    });
+                }
             });
         }
 
         // Update the counter of iterations
         ++iteration;
 
-        // Compute error and loss
-
-        {
-            dll::auto_timer timer("sgd::error");
+        return metrics;
+    }
 
-            auto[error, loss] = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, true);
+    /*!
+     * \brief Train a batch of data, only backpropagating the samples with
+     * the highest loss (selective_backprop).
+     *
+     * The batch is forward propagated to score its samples with the squared
+     * norm of the errors of the last layer. The selected samples are added
+     * to the pending samples, which are trained as soon as they fill a
+     * batch. The pending samples are kept from one batch to the next.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the whole batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_selective(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        static_assert(etl::dimensions<Labels>() <= 2, "selective_backprop only supports vector and sparse labels");
 
-            return std::make_pair(error, loss);
-        }
-    }
+        dll::auto_timer timer("sgd::train_batch:selective");
 
-    template <typename Layer, typename Context>
-    void apply_gradients_layer(size_t epoch, size_t n, Layer& layer, Context& context){
-        if constexpr (is_utility_layer<Layer>) {
-            cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n](auto& sub_layer, auto& sub_context) {
-                this->apply_gradients_layer(epoch, n, sub_layer, sub_context);
-            });
-        } else {
-            // Compute the gradients
-            layer.compute_gradients(context);
+        auto& first_ctx = *std::get<0>(full_context).second;
+        auto& last_ctx  = *std::get<layers - 1>(full_context).second;
 
-            // Apply the gradients
-            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
-        }
-    }
+        const size_t n     = etl::dim<0>(inputs);
+        const size_t width = etl::dimensions<Labels>() == 1 ? 1 : etl::size(labels) / n;
 
-    template <typename Layer, typename Context, typename Errors, cpp_disable_iff(is_utility_layer<Layer>)>
-    static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
-        if(!last){
-            layer.adapt_errors(context);
-        }
+        stop_timer watch;
+        watch.start();
 
-        last = false;
+        std::pair<double, double> metrics;
 
-        layer.backward_batch(errors, context);
-    }
+        {
+            dll::auto_timer timer("sgd::selective:score");
 
-    template <size_t L, typename Layer, typename Context, typename Errors>
-    static void backward_layer_group(Layer& layer, Context& context, Errors&& errors, bool& last){
-        auto& sub_layer   = std::get<L>(layer.layers);
-        auto& sub_context = std::get<L>(context.sub_contexts);
+            forward_batch_helper<true>(inputs);
 
-        if (!last) {
-            sub_layer.adapt_errors(sub_context);
+            metrics = last_errors<dbn_t::loss>(full_context, n, labels);
         }
 
-        last = false;
+        // Score the samples
 
-        if constexpr (L == 0) {
-            sub_layer.backward_batch(errors, sub_context);
-        } else {
-            auto& prev_sub_context = std::get<L - 1>(context.sub_contexts);
+        auto& errors = last_ctx.errors;
 
-            sub_layer.backward_batch(prev_sub_context.errors, sub_context);
+        cpu_access(errors);
 
-            backward_layer_group<L - 1>(layer, context, errors, last);
-        }
-    }
+        const size_t row = etl::size(errors) / etl::dim<0>(errors);
 
-    template <typename Layer, typename Context, typename Errors, cpp_enable_iff(is_group_layer<Layer>)>
-    static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
-        backward_layer_group<Layer::n_layers - 1>(layer, context, errors, last);
-    }
+        scores.resize(n);
+        ranks.resize(n);
 
-    template <typename Layer, typename Context, typename Errors, cpp_enable_iff(is_merge_layer<Layer>)>
-    static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
-        errors = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const weight* e = errors.memory_start() + i * row;
 
-        // Dispatch all the sub contexts
+            double s = 0.0;
 
-        cpp::for_each_i(layer.layers, context.sub_contexts, [&context, &errors, &last](size_t i, auto& sub_layer, auto& sub_context){
-            batch_dispatch(get_errors(sub_context), context.errors, i);
+            for (size_t j = 0; j < row; ++j) {
+                s += double(e[j]) * double(e[j]);
+            }
 
-            auto back_errors = errors;
+            scores[i] = s;
+        }
 
-            bool sub_last = last;
-            backward_layer(sub_layer, sub_context, back_errors, sub_last);
+        std::iota(ranks.begin(), ranks.end(), size_t(0));
 
-            errors += back_errors;
-        });
+        const size_t k = (n * selective + 99) / 100;
 
-        last = false;
-    }
+        std::nth_element(ranks.begin(), ranks.begin() + (k - 1), ranks.end(), [this](size_t a, size_t b) { return scores[a] > scores[b]; });
 
-    template <bool Train, typename Layer, typename Inputs, typename Context, cpp_disable_iff(is_utility_layer<Layer>)>
-    static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
-        context.input = inputs;
+        // Queue the selected samples
 
-        if constexpr (Train) {
-            layer.train_forward_batch(context.output, context.input);
-        } else {
-            layer.test_forward_batch(context.output, context.input);
+        if (cpp_unlikely(etl::size(pending_inputs) == 0)) {
+            pending_inputs = first_ctx.input;
         }
-    }
 
-    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
-    static void forward_layer_group(Layer& layer, Inputs&& inputs, Context& context) {
-        if constexpr (L < Layer::n_layers) {
-            auto& sub_layer   = std::get<L>(layer.layers);
-            auto& sub_context = std::get<L>(context.sub_contexts);
+        pending_labels.resize(batch_size * width);
 
-            sub_context.input = inputs;
+        score_ns += watch.stop_ns();
+        scored_samples += n;
 
-            if constexpr (Train) {
-                sub_layer.train_forward_batch(sub_context.output, sub_context.input);
+        for (size_t s = 0; s < k; ++s) {
+            const size_t i = ranks[s];
+
+            pending_inputs(pending_samples) = inputs(i);
+
+            if constexpr (etl::dimensions<Labels>() == 1) {
+                pending_labels[pending_samples] = labels(i);
             } else {
-                sub_layer.test_forward_batch(sub_context.output, sub_context.input);
+                for (size_t j = 0; j < width; ++j) {
+                    pending_labels[pending_samples * width + j] = labels(i, j);
+                }
             }
 
-            forward_layer_group<Train, L + 1>(layer, sub_context.output, context);
+            if (++pending_samples == batch_size) {
+                train_pending<Labels>(epoch, width);
+            }
         }
-    }
 
-    template <bool Train, typename Layer, typename Inputs, typename Context, cpp_enable_iff(is_group_layer<Layer>)>
-    static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
-        forward_layer_group<Train, 0>(layer, inputs, context);
+        return std::make_pair(metrics.first / n, metrics.second / n);
     }
 
-    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
-    static void forward_layer_merge(Layer& layer, Inputs&& inputs, Context& context) {
-        if constexpr (L < Layer::n_layers) {
-            auto& sub_layer   = std::get<L>(layer.layers);
-            auto& sub_context = std::get<L>(context.sub_contexts);
+    /*!
+     * \brief Train the full batch of pending samples (selective_backprop)
+     * \param epoch The current epoch
+     * \param width The number of values of each label
+     */
+    template <typename Labels>
+    void train_pending(size_t epoch, size_t width) {
+        dll::auto_timer timer("sgd::selective:train");
 
-            forward_layer<Train>(sub_layer, inputs, sub_context);
+        stop_timer watch;
+        watch.start();
 
-            forward_layer_merge<Train, L + 1>(layer, inputs, context);
-        }
-    }
+        using label_batch_t = etl::dyn_matrix<etl::value_t<Labels>, etl::dimensions<Labels>()>;
 
-    template <bool Train, typename Layer, typename Inputs, typename Context, cpp_enable_iff(is_merge_layer<Layer>)>
-    static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
-        context.input = inputs;
+        auto batch_labels = [&]() {
+            if constexpr (etl::dimensions<Labels>() == 1) {
+                return label_batch_t(batch_size);
+            } else {
+                return label_batch_t(batch_size, width);
+            }
+        }();
 
-        // Fully forward each group
+        std::copy(pending_labels.begin(), pending_labels.end(), batch_labels.memory_start());
 
-        forward_layer_merge<Train, 0>(layer, context.input, context);
+        cpu_modified(batch_labels);
 
-        // Concatenate all the sub contexts
+        {
+            dll::auto_timer timer("sgd::forward");
 
-        cpp::for_each_i(context.sub_contexts, [&context](size_t i, auto& sub_context){
-            batch_merge(context.output, get_output(sub_context), i);
-        });
+            forward_batch_helper<true>(pending_inputs);
+        }
+
+        train_forwarded(epoch, batch_size, batch_labels);
+
+        pending_samples = 0;
+
+        trained_samples += batch_size;
+        train_ns += watch.stop_ns();
+    }
+
+    /*!
+     * \brief Display the number of backpropagated samples and the estimated
+     * speedup of the selective backprop
+     *
+     * The speedup is estimated against the training of all the scored
+     * samples at the measured cost of the trained samples.
+     *
+     * \param stream The stream to print to
+     */
+    void selective_report(std::ostream& stream) const {
+        if (!scored_samples || !trained_samples) {
+            return;
+        }
+
+        const double full = double(train_ns) * double(scored_samples) / double(trained_samples);
+
+        stream << "Selective backprop: " << trained_samples << "/" << scored_samples << " samples backpropagated ("
+               << (100.0 * trained_samples) / scored_samples << "%), estimated speedup: " << full / double(score_ns + train_ns) << "x" << std::endl;
+    }
+
+    /*!
+     * \brief Train over all the ranks of the given communicator.
+     *
+     * The weights of the rank 0 are broadcast to all the ranks, so that
+     * all the replicas start from the same network.
+     *
+     * \param communicator The communicator, it must outlive the training
+     */
+    void init_distributed(communicator& communicator) {
+        static_assert(distributed_trainer, "Distributed training cannot be used with parallel_sgd, sgd_checkpoint, gradient_accumulation or frozen_layers");
+
+        comm    = &communicator;
+        reducer = std::make_unique<gradient_reducer<weight>>(communicator);
+
+        cpp::for_each(full_context, [&communicator](auto& layer_ctx) {
+            this_type::broadcast_weights_layer(communicator, layer_ctx.first);
+        });
+    }
+
+    /*!
+     * \brief Indicates if the trainer is training over several ranks
+     */
+    bool is_distributed() const {
+        return comm && comm->size() > 1;
+    }
+
+    /*!
+     * \brief Train a batch of data on this rank, the gradients being summed
+     * over all the ranks before the weights are updated.
+     *
+     * The gradients of each layer are submitted for reduction as soon as
+     * the errors have been backpropagated through it, the reduction of the
+     * last layers is thus overlapped with the backward pass of the first
+     * layers. This is equivalent to training with the union of the batches
+     * of all the ranks.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss over the batches of all the ranks
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_distributed(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        dll::auto_timer timer("sgd::train_batch_distributed");
+
+        cpp_assert(comm && reducer, "The distributed training has not been initialized");
+
+        const auto n = etl::dim<0>(inputs);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            forward_batch_helper<true>(inputs);
+        }
+
+        std::array<double, 3> totals;
+
+        {
+            dll::auto_timer timer("sgd::backward");
+
+            auto metrics = last_errors<dbn_t::loss>(full_context, n, labels);
+
+            totals = {{double(n), metrics.first, metrics.second}};
+
+            bool last = true;
+
+            backward_distributed(last, std::make_index_sequence<layers>());
+        }
+
+        {
+            dll::auto_timer timer("sgd::all_reduce");
+
+            reducer->wait();
+
+            comm->all_reduce(totals.data(), totals.size());
+        }
+
+        const size_t total = size_t(totals[0]);
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            batched_biases_update([this, epoch, total]() {
+                cpp::for_each(full_context, [this, epoch, total](auto& layer_ctx) {
+                    this->update_weights_layer(epoch, total, layer_ctx.first, *layer_ctx.second);
+                });
+            });
+        }
+
+        ++iteration;
+
+        return std::make_pair(totals[1] / total, totals[2] / total);
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer through the full
+     * context, submitting the gradients of each layer for reduction
+     */
+    template <size_t... I>
+    void backward_distributed(bool& last, std::index_sequence<I...> /*seq*/) {
+        (backward_layer_distributed<layers - 1 - I>(last), ...);
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the layer I of the full
+     * context and submit its gradients for reduction
+     */
+    template <size_t I>
+    void backward_layer_distributed(bool& last) {
+        auto& layer = std::get<I>(full_context).first;
+        auto& ctx   = *std::get<I>(full_context).second;
+
+        if constexpr (I == 0) {
+            layer.adapt_errors(ctx);
+        } else {
+            backward_layer(layer, ctx, get_errors(*std::get<I - 1>(full_context).second), last);
+        }
+
+        compute_gradients_layer(layer, ctx);
+
+        submit_gradients_layer(layer, ctx);
+    }
+
+    /*!
+     * \brief Submit the computed gradients of the given layer for reduction
+     */
+    template <typename Layer, typename Context>
+    void submit_gradients_layer(Layer& layer, Context& context) {
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [this](auto& sub_layer, auto& sub_context) {
+                this->submit_gradients_layer(sub_layer, sub_context);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            submit_gradients_variables(context, std::make_index_sequence<N>());
+        } else {
+            cpp_unused(layer);
+            cpp_unused(context);
+        }
+    }
+
+    template <typename Context, size_t... I>
+    void submit_gradients_variables(Context& context, std::index_sequence<I...> /*seq*/) {
+        (submit_gradients(*std::get<I>(context.up.context)), ...);
+    }
+
+    /*!
+     * \brief Submit the gradients of one variable for reduction
+     */
+    template <typename Sub>
+    void submit_gradients(Sub& sub) {
+        static_assert(!has_sparse_rows<Sub>::value, "Distributed training does not support sparse gradients");
+
+        cpu_access(sub.grad);
+
+        reducer->submit(sub.grad.memory_start(), etl::size(sub.grad));
+
+        cpu_modified(sub.grad);
+    }
+
+    /*!
+     * \brief Broadcast the weights of the given layer from the rank 0
+     */
+    template <typename Layer>
+    static void broadcast_weights_layer(communicator& communicator, Layer& layer) {
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, [&communicator](auto& sub_layer) {
+                this_type::broadcast_weights_layer(communicator, sub_layer);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            cpp::for_each(layer.trainable_parameters(), [&communicator](auto& variable) {
+                cpu_access(variable);
+
+                communicator.broadcast(variable.memory_start(), etl::size(variable));
+
+                cpu_modified(variable);
+            });
+        } else {
+            cpp_unused(communicator);
+            cpp_unused(layer);
+        }
+    }
+
+    /*!
+     * \brief Train a batch of data, recording the time spent in each layer
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_profiled(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        const auto n = etl::dim<0>(inputs);
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            restore_segments(std::make_index_sequence<layers>());
+
+            load_inputs(full_context, inputs);
+
+            forward_profiled(std::make_index_sequence<layers>());
+        }
+
+        std::pair<double, double> metrics;
+
+        {
+            dll::auto_timer timer("sgd::backward");
+
+            metrics = last_errors<dbn_t::loss>(full_context, n, labels);
+
+            bool last = true;
+
+            backward_profiled(last, std::make_index_sequence<layers>());
+        }
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            cpp::for_each_i(full_context, [this, epoch, n](size_t i, auto& layer_ctx) {
+                // The frozen layers are never updated
+                if (i < frozen) {
+                    return;
+                }
+
+                stop_timer watch;
+                watch.start();
+
+                this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+
+                profile.layers[i].gradients += watch.stop_ns();
+            });
+
+            apply_clipped_updates();
+        }
+
+        ++iteration;
+
+        profile.samples += n;
+        ++profile.batches;
+
+        return std::make_pair(metrics.first / n, metrics.second / n);
+    }
+
+    /*!
+     * \brief Forward propagate the inputs loaded in the full context,
+     * recording the time spent in each layer
+     */
+    template <size_t... I>
+    void forward_profiled(std::index_sequence<I...> /*seq*/) {
+        (forward_layer_profiled<I>(), ...);
+    }
+
+    /*!
+     * \brief Forward propagate the layer I of the full context, recording
+     * the time spent
+     */
+    template <size_t I>
+    void forward_layer_profiled() {
+        auto& layer = std::get<I>(full_context).first;
+        auto& ctx   = *std::get<I>(full_context).second;
+
+        stop_timer watch;
+        watch.start();
+
+        if constexpr (I == 0) {
+            this_type::template forward_first_layer<true>(layer, ctx);
+        } else {
+            this_type::template forward_layer<true>(layer, get_output(*std::get<I - 1>(full_context).second), ctx);
+        }
+
+        profile.layers[I].forward += watch.stop_ns();
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer through the full
+     * context, recording the time spent in each layer
+     */
+    template <size_t... I>
+    void backward_profiled(bool& last, std::index_sequence<I...> /*seq*/) {
+        (backward_layer_profiled<layers - 1 - I>(last), ...);
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the layer I of the full
+     * context, recording the time spent
+     */
+    template <size_t I>
+    void backward_layer_profiled(bool& last) {
+        auto& layer = std::get<I>(full_context).first;
+        auto& ctx   = *std::get<I>(full_context).second;
+
+        stop_timer watch;
+        watch.start();
+
+        if constexpr (I == 0) {
+            layer.adapt_errors(ctx);
+        } else {
+            backward_layer(layer, ctx, get_errors(*std::get<I - 1>(full_context).second), last);
+        }
+
+        profile.layers[I].backward += watch.stop_ns();
+    }
+
+    /*!
+     * \brief Accumulate the gradients of a mini-batch, without updating the
+     * weights.
+     *
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     */
+    template <typename Inputs, typename Labels>
+    void accumulate_batch(const Inputs& inputs, const Labels& labels) {
+        dll::auto_timer timer("sgd::accumulate_batch");
+
+        static_assert(accumulate > 1, "accumulate_batch needs gradient_accumulation");
+
+        const auto n = etl::dim<0>(inputs);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            forward_batch_helper<true>(inputs);
+        }
+
+        std::pair<double, double> metrics;
+
+        {
+            dll::auto_timer timer("sgd::backward");
+
+            metrics = last_errors<dbn_t::loss>(full_context, n, labels);
+
+            backward_context(full_context);
+        }
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            const bool first = accumulated == 0;
+
+            cpp::for_each(full_context, [](auto& layer_ctx) {
+                this_type::compute_gradients_layer(layer_ctx.first, *layer_ctx.second);
+            });
+
+            accumulate_gradients<false>(first, std::make_index_sequence<layers>());
+        }
+
+        if (!accumulated) {
+            accumulated_error = 0.0;
+            accumulated_loss  = 0.0;
+        }
+
+        accumulated_error += metrics.first;
+        accumulated_loss += metrics.second;
+        accumulated += n;
+    }
+
+    /*!
+     * \brief Update the weights once with the gradients of all the
+     * accumulated mini-batches
+     *
+     * \param epoch The current epoch
+     * \return a pair containing the error and the loss for all the accumulated batches
+     */
+    std::pair<double, double> train_accumulated_batches(size_t epoch) {
+        dll::auto_timer timer("sgd::train_accumulated_batches");
+
+        cpp_assert(accumulated > 0, "No accumulated batches");
+
+        const size_t n = accumulated;
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            accumulate_gradients<true>(true, std::make_index_sequence<layers>());
+
+            batched_biases_update([this, epoch, n]() {
+                cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
+                    this->update_weights_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+                });
+            });
+        }
+
+        ++iteration;
+
+        accumulated = 0;
+
+        return std::make_pair(accumulated_error / n, accumulated_loss / n);
+    }
+
+    /*!
+     * \brief Train a batch of data, computing and applying the gradients of
+     * each layer while the errors are propagated to the lower layers.
+     *
+     * The backward pass runs on the calling thread. As soon as the errors
+     * of a layer have been propagated below, nothing reads its weights
+     * anymore, its gradients are computed and applied by a task of the
+     * work-stealing pool. The calling thread then executes the remaining
+     * tasks itself. The small biases are not batched in this mode.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_overlapped(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        const auto n = etl::dim<0>(inputs);
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            forward_batch_helper<true>(inputs);
+        }
+
+        std::pair<double, double> metrics;
+
+        {
+            dll::auto_timer timer("sgd::backward:overlapped");
+
+            metrics = last_errors<dbn_t::loss>(full_context, n, labels);
+
+            task_group group;
+
+            bool last = true;
+
+            cpp::for_each_rpair(full_context, [this, epoch, n, &group, &last](auto& layer_ctx_1, auto& layer_ctx_2) {
+                backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
+
+                gradient_tasks->submit(group, [this, epoch, n, &layer_ctx_2]() {
+                    this->apply_gradients_layer(epoch, n, layer_ctx_2.first, *layer_ctx_2.second);
+                });
+            });
+
+            auto& first_layer = std::get<0>(full_context).first;
+            auto& first_ctx   = *std::get<0>(full_context).second;
+
+            first_layer.adapt_errors(first_ctx);
+
+            apply_gradients_layer(epoch, n, first_layer, first_ctx);
+
+            gradient_tasks->wait(group);
+        }
+
+        ++iteration;
+
+        return std::make_pair(metrics.first / n, metrics.second / n);
+    }
+
+    /*!
+     * \brief Train a batch of data, the gradients being computed and applied
+     * in the background, overlapped with the forward pass of the next batch.
+     *
+     * Before a layer is forward propagated, its own pending update and the
+     * one of the next layer (whose input is the output of the layer) are
+     * waited for. The updates of the deep layers thus run while the shallow
+     * layers of the next batch are forward propagated.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_pipelined(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        const auto n = etl::dim<0>(inputs);
+
+        {
+            dll::auto_timer timer("sgd::forward:pipelined");
+
+            wait_update(0);
+            wait_update(1);
+
+            load_inputs(full_context, inputs);
+
+            forward_first_layer<true>(std::get<0>(full_context).first, *std::get<0>(full_context).second);
+
+            size_t l = 1;
+
+            cpp::for_each_pair(full_context, [this, &l](auto& layer_ctx_1, auto& layer_ctx_2) {
+                this->wait_update(l + 1);
+
+                this_type::template forward_layer<true>(layer_ctx_2.first, get_output(*layer_ctx_1.second), *layer_ctx_2.second);
+
+                ++l;
+            });
+
+            // All the updates of the previous batch are done
+            count_pending_iteration();
+        }
+
+        std::pair<double, double> metrics;
+
+        {
+            dll::auto_timer timer("sgd::backward");
+
+            metrics = last_errors<dbn_t::loss>(full_context, n, labels);
+
+            backward_context(full_context);
+        }
+
+        // The first layers are submitted first, they are the first needed by the next batch
+
+        size_t l = 0;
+
+        cpp::for_each(full_context, [this, epoch, n, &l](auto& layer_ctx) {
+            gradient_tasks->submit(pending_updates[l++], [this, epoch, n, &layer_ctx]() {
+                this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+            });
+        });
+
+        pending_iteration = true;
+
+        return std::make_pair(metrics.first / n, metrics.second / n);
+    }
+
+    /*!
+     * \brief Wait for the pending updates of the weights (pipeline_updates),
+     * before the weights are used outside of the training of the batches.
+     */
+    void flush_updates() {
+        if constexpr (pipelined) {
+            for (size_t l = 0; l < layers; ++l) {
+                wait_update(l);
+            }
+
+            count_pending_iteration();
+        }
+    }
+
+    /*!
+     * \brief Wait for the pending update of the layer l, if any
+     */
+    void wait_update(size_t l) {
+        if (l < layers) {
+            gradient_tasks->wait(pending_updates[l]);
+        }
+    }
+
+    /*!
+     * \brief Count the iteration of the completed pending updates
+     */
+    void count_pending_iteration() {
+        if (pending_iteration) {
+            ++iteration;
+            pending_iteration = false;
+        }
+    }
+
+    /*!
+     * \brief Train a batch of data, keeping only the activations of the
+     * checkpointed layers between the forward and the backward passes.
+     *
+     * The network is split in segments of checkpoint layers. The output of
+     * the last layer of each segment is kept, the other activations are
+     * released during the forward pass. During the backward pass, the
+     * forward pass of each segment is computed again from its checkpoint,
+     * then its errors are backpropagated and its gradients applied before
+     * its activations are released again. The last segment is never
+     * released.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_checkpointed(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        const auto n = etl::dim<0>(inputs);
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            load_inputs(full_context, inputs);
+
+            forward_checkpointed(std::make_index_sequence<layers>());
+        }
+
+        std::pair<double, double> metrics;
+
+        {
+            dll::auto_timer timer("sgd::backward");
+
+            metrics = last_errors<dbn_t::loss>(full_context, n, labels);
+
+            bool last = true;
+
+            backward_segment<last_segment>(epoch, n, last);
+
+            apply_clipped_updates();
+        }
+
+        ++iteration;
+
+        return std::make_pair(metrics.first / n, metrics.second / n);
+    }
+
+    /*!
+     * \brief Train a batch of features of the last frozen layer.
+     *
+     * The features are the output of the frozen layers, computed once for
+     * the whole training, for instance by the dbn_trainer. Only the trained
+     * layers are forward and backward propagated.
+     *
+     * \param epoch The current epoch
+     * \param features A batch of outputs of the last frozen layer
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Features, typename Labels>
+    std::pair<double, double> train_batch_frozen(size_t epoch, const Features& features, const Labels& labels) {
+        static_assert(frozen > 0, "train_batch_frozen() needs frozen_layers");
+
+        using first_layer_t = std::decay_t<decltype(std::get<frozen>(full_context).first)>;
+
+        static_assert(!dbn_detail::is_inplace_layer<first_layer_t>::value, "The first trained layer must store its input");
+
+        dll::auto_timer timer("sgd::train_batch");
+
+        auto& first_layer = std::get<frozen>(full_context).first;
+        auto& first_ctx   = *std::get<frozen>(full_context).second;
+
+        const auto n          = etl::dim<0>(features);
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            if (cpp_unlikely(!full_batch)) {
+                first_ctx.input  = 0;
+                first_ctx.output = 0;
+
+                for (size_t i = 0; i < n; ++i) {
+                    first_ctx.input(i) = features(i);
+                }
+            } else {
+                first_ctx.input = features;
+            }
+
+            forward_first_layer<true>(first_layer, first_ctx);
+
+            forward_trained(std::make_index_sequence<layers - frozen - 1>());
+        }
+
+        std::pair<double, double> metrics;
+
+        {
+            dll::auto_timer timer("sgd::backward");
+
+            metrics = last_errors<dbn_t::loss>(full_context, n, labels);
+
+            backward_trained(std::make_index_sequence<layers - frozen>());
+        }
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            batched_biases_update([this, epoch, n]() {
+                this->apply_trained_gradients(epoch, n, std::make_index_sequence<layers - frozen>());
+            });
+        }
+
+        ++iteration;
+
+        return std::make_pair(metrics.first / n, metrics.second / n);
+    }
+
+    /*!
+     * \brief Forward propagate the output of the first trained layer through
+     * the next layers
+     */
+    template <size_t... I>
+    void forward_trained(std::index_sequence<I...> /*seq*/) {
+        (forward_layer_at<frozen + 1 + I>(), ...);
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer through the trained
+     * layers only.
+     *
+     * The errors of the output of the frozen layers are never needed.
+     */
+    template <size_t... I>
+    void backward_trained(std::index_sequence<I...> /*seq*/) {
+        bool last = true;
+
+        (backward_layer_trained<layers - 1 - I>(last), ...);
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the trained layer I
+     */
+    template <size_t I>
+    void backward_layer_trained(bool& last) {
+        auto& layer = std::get<I>(full_context).first;
+        auto& ctx   = *std::get<I>(full_context).second;
+
+        if constexpr (I == frozen) {
+            if (!last) {
+                layer.adapt_errors(ctx);
+            }
+        } else {
+            backward_layer(layer, ctx, get_errors(*std::get<I - 1>(full_context).second), last);
+        }
+    }
+
+    /*!
+     * \brief Compute and apply the gradients of the trained layers
+     */
+    template <size_t... I>
+    void apply_trained_gradients(size_t epoch, size_t n, std::index_sequence<I...> /*seq*/) {
+        (apply_gradients_layer(epoch, n, std::get<frozen + I>(full_context).first, *std::get<frozen + I>(full_context).second), ...);
+    }
+
+    /*!
+     * \brief Forward propagate the inputs loaded in the full context through
+     * the layer I, from the output of the previous layer
+     */
+    template <size_t I>
+    void forward_layer_at() {
+        auto& layer = std::get<I>(full_context).first;
+        auto& ctx   = *std::get<I>(full_context).second;
+
+        if constexpr (I == 0) {
+            this_type::template forward_first_layer<true>(layer, ctx);
+        } else {
+            this_type::template forward_layer<true>(layer, get_output(*std::get<I - 1>(full_context).second), ctx);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate the inputs loaded in the full context,
+     * releasing the activations that are not checkpointed
+     */
+    template <size_t... I>
+    void forward_checkpointed(std::index_sequence<I...> /*seq*/) {
+        (forward_layer_checkpointed<I>(), ...);
+    }
+
+    /*!
+     * \brief Forward propagate through the layer I and release the
+     * activations of the previous layer, unless they are checkpointed
+     */
+    template <size_t I>
+    void forward_layer_checkpointed() {
+        restore_buffers<I, true, true, false>();
+
+        forward_layer_at<I>();
+
+        if constexpr (I > 0 && I - 1 < last_segment) {
+            release_layer<I - 1>();
+        }
+    }
+
+    /*!
+     * \brief Compute again the forward pass of the segment starting at S,
+     * backpropagate its errors and apply its gradients, then continue with
+     * the previous segment
+     */
+    template <size_t S>
+    void backward_segment(size_t epoch, size_t n, bool& last) {
+        constexpr size_t E = std::min(S + checkpoint, layers);
+
+        if constexpr (S != last_segment) {
+            recompute_segment<S>(std::make_index_sequence<E - S>());
+        }
+
+        if constexpr (S > 0) {
+            restore_buffers<S - 1, false, false, true>();
+        }
+
+        backward_segment_layers<S>(epoch, n, last, std::make_index_sequence<E - S>());
+
+        if constexpr (S > 0) {
+            backward_segment<S - checkpoint>(epoch, n, last);
+        }
+    }
+
+    /*!
+     * \brief Compute again the forward pass of the segment starting at S
+     * from its checkpoint
+     */
+    template <size_t S, size_t... I>
+    void recompute_segment(std::index_sequence<I...> /*seq*/) {
+        ((restore_buffers<S + I, true, true, true>(), forward_layer_at<S + I>()), ...);
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the layers of the segment
+     * starting at S, in reverse order
+     */
+    template <size_t S, size_t... I>
+    void backward_segment_layers(size_t epoch, size_t n, bool& last, std::index_sequence<I...> /*seq*/) {
+        (backward_layer_checkpointed<S + sizeof...(I) - 1 - I>(epoch, n, last), ...);
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the layer I and apply its
+     * gradients, then release its activations
+     */
+    template <size_t I>
+    void backward_layer_checkpointed(size_t epoch, size_t n, bool& last) {
+        auto& layer = std::get<I>(full_context).first;
+        auto& ctx   = *std::get<I>(full_context).second;
+
+        if constexpr (I == 0) {
+            layer.adapt_errors(ctx);
+        } else {
+            backward_layer(layer, ctx, get_errors(*std::get<I - 1>(full_context).second), last);
+        }
+
+        // The weights of the layer are not used by the remaining segments
+        apply_gradients_layer(epoch, n, layer, ctx);
+
+        if constexpr (I < last_segment) {
+            release_buffers<I, (I > 0), true, true>();
+        }
+    }
+
+    /*!
+     * \brief Release the activations of the layers before the last segment
+     * that are not checkpointed
+     */
+    template <size_t... I>
+    void release_segments(std::index_sequence<I...> /*seq*/) {
+        (release_layer<I>(), ...);
+    }
+
+    /*!
+     * \brief Release the activations of the layer I that are not needed
+     * until its segment is computed again.
+     *
+     * The input of the first layer holds the batch and the output of the
+     * last layer of each segment is its checkpoint.
+     */
+    template <size_t I>
+    void release_layer() {
+        release_buffers<I, (I > 0), !checkpoint_output<I>(), (I + 1 < last_segment)>();
+    }
+
+    /*!
+     * \brief Indicates if the output of the layer I is the checkpoint of its
+     * segment, directly or through the view layers that follow it
+     */
+    template <size_t I>
+    static constexpr bool checkpoint_output() {
+        if constexpr ((I + 1) % checkpoint == 0) {
+            return true;
+        } else if constexpr (I + 1 < layers && dbn_detail::is_view_layer<typename dbn_t::template layer_type<I + 1>>::value) {
+            return checkpoint_output<I + 1>();
+        } else {
+            return false;
+        }
+    }
+
+    /*!
+     * \brief Allocate again all the released activations
+     */
+    template <size_t... I>
+    void restore_segments(std::index_sequence<I...> /*seq*/) {
+        if constexpr (checkpoint > 0) {
+            (restore_buffers<I, true, true, true>(), ...);
+        }
+    }
+
+    /*!
+     * \brief Release the selected buffers of the context of the layer I
+     */
+    template <size_t I, bool Input, bool Output, bool Errors>
+    void release_buffers() {
+        // The buffers of a view layer are the buffers of the previous layer
+        if constexpr (!is_utility_layer<typename dbn_t::template layer_type<I>> && !dbn_detail::is_view_layer<typename dbn_t::template layer_type<I>>::value) {
+            auto& ctx    = *std::get<I>(full_context).second;
+            auto& shapes = released[I];
+
+            if constexpr (Input) {
+                released_bytes += release_buffer(ctx.input, shapes[0]);
+            }
+
+            if constexpr (Output) {
+                released_bytes += release_buffer(ctx.output, shapes[1]);
+            }
+
+            if constexpr (Errors) {
+                released_bytes += release_buffer(ctx.errors, shapes[2]);
+            }
+        }
+    }
+
+    /*!
+     * \brief Allocate again the selected buffers of the context of the
+     * layer I, if they have been released
+     */
+    template <size_t I, bool Input, bool Output, bool Errors>
+    void restore_buffers() {
+        if constexpr (!is_utility_layer<typename dbn_t::template layer_type<I>> && !dbn_detail::is_view_layer<typename dbn_t::template layer_type<I>>::value) {
+            auto& ctx    = *std::get<I>(full_context).second;
+            auto& shapes = released[I];
+
+            if constexpr (Input) {
+                released_bytes -= restore_buffer(ctx.input, shapes[0]);
+            }
+
+            if constexpr (Output) {
+                released_bytes -= restore_buffer(ctx.output, shapes[1]);
+            }
+
+            if constexpr (Errors) {
+                released_bytes -= restore_buffer(ctx.errors, shapes[2]);
+            }
+
+            memory.checkpointed = std::max(memory.checkpointed, memory.full - released_bytes);
+
+            rebind_views<I>();
+        }
+    }
+
+    /*!
+     * \brief Stage a batch of data in the given shard for data-parallel
+     * training
+     *
+     * \param shard The index of the shard
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     */
+    template <typename Inputs, typename Labels>
+    void stage_batch(size_t shard, const Inputs& inputs, const Labels& labels) {
+        dll::auto_timer timer("sgd::stage_batch");
+
+        cpp_assert(shard < shard_contexts.size(), "Invalid shard");
+
+        auto& replica   = shard_contexts[shard];
+        auto& first_ctx = *std::get<0>(replica.context).second;
+
+        const auto n = etl::dim<0>(inputs);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        load_inputs(replica.context, inputs);
+
+        if constexpr (etl::dimensions<Labels>() == 1 && etl::dimensions<decltype(replica.labels)>() == 2) {
+            // The sparse labels are expanded in the one-hot labels of the replica
+            replica.labels = 0;
+
+            for (size_t i = 0; i < n; ++i) {
+                replica.labels(i, size_t(labels(i))) = 1;
+            }
+        } else if (cpp_unlikely(n != etl::dim<0>(first_ctx.input))) {
+            replica.labels = 0;
+
+            for (size_t i = 0; i < n; ++i) {
+                replica.labels(i) = labels(i);
+            }
+        } else {
+            replica.labels = labels;
+        }
+
+        replica.n = n;
+    }
+
+    /*!
+     * \brief Train on the staged batches, one per shard, in parallel.
+     *
+     * The gradients of each shard are summed into the main context and
+     * the weights are updated once for all the staged samples.
+     *
+     * \param epoch The current epoch
+     * \param staged The number of shards that have been staged
+     *
+     * \return a pair containing the error and the loss for all the staged batches
+     */
+    std::pair<double, double> train_staged_batches(size_t epoch, size_t staged) {
+        dll::auto_timer timer("sgd::train_batch:parallel");
+
+        cpp_assert(staged > 0 && staged <= shard_contexts.size(), "Invalid number of staged shards");
+
+        if constexpr (stages > 1) {
+            return train_staged_pipelined(epoch, staged);
+        }
+
+        // Forward, backward and gradients of each shard in parallel
+
+        {
+            dll::auto_timer timer("sgd::shards");
+
+            auto& pool = dbn.get_pool();
+
+            for (size_t s = 0; s < staged; ++s) {
+                pool.do_task([this, s]() {
+                    auto& replica = shard_contexts[s];
+
+                    // The shards are already running in parallel, avoid oversubscription
+                    worker_section section;
+
+                    // The dropout masks of the shard do not depend on the scheduling of the shards
+                    random_shard_section random(iteration, s);
+
+                    forward_context<true>(replica.context);
+
+                    replica.metrics = last_errors<dbn_t::loss>(replica.context, replica.n, replica.labels);
+
+                    backward_context(replica.context);
+
+                    cpp::for_each(replica.context, [](auto& layer_ctx) {
+                        this_type::compute_gradients_layer(layer_ctx.first, *layer_ctx.second);
+                    });
+                });
+            }
+
+            pool.wait();
+        }
+
+        // Reduce the gradients and apply them
+
+        size_t n = 0;
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            for (size_t s = 0; s < staged; ++s) {
+                n += shard_contexts[s].n;
+
+                cpp::for_each(full_context, shard_contexts[s].context, [s](auto& layer_ctx, auto& shard_layer_ctx) {
+                    this_type::reduce_gradients_layer(layer_ctx.first, *layer_ctx.second, *shard_layer_ctx.second, s == 0);
+                });
+            }
+
+            batched_biases_update([this, epoch, n]() {
+                cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
+                    this->update_weights_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
+                });
+            });
+        }
+
+        // Update the counter of iterations
+        ++iteration;
+
+        // Reduce the error and the loss computed by each shard
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t s = 0; s < staged; ++s) {
+            error += shard_contexts[s].metrics.first;
+            loss += shard_contexts[s].metrics.second;
+        }
+
+        return std::make_pair(error / n, loss / n);
+    }
+
+    /*!
+     * \brief Train on the staged micro-batches, through the stages of the
+     * pipeline (GPipe schedule).
+     *
+     * Each stage forward propagates the micro-batches in order, as soon as
+     * the previous stage is done with them, the last stage computing their
+     * errors. Then each stage backpropagates the micro-batches in reverse
+     * order, as soon as the next stage is done with them, and computes the
+     * gradients of its layers for each of them. Once a stage is done with
+     * all the micro-batches, it sums the gradients of its layers and updates
+     * its weights, while the lower stages are still backpropagating.
+     *
+     * \param epoch The current epoch
+     * \param staged The number of micro-batches that have been staged
+     *
+     * \return a pair containing the error and the loss for all the staged batches
+     */
+    std::pair<double, double> train_staged_pipelined(size_t epoch, size_t staged) {
+        dll::auto_timer timer("sgd::train_batch:pipeline");
+
+        size_t n = 0;
+
+        for (size_t m = 0; m < staged; ++m) {
+            n += shard_contexts[m].n;
+        }
+
+        stop_timer watch;
+        watch.start();
+
+        stage_workers->run([this, epoch, staged, n](size_t s) {
+            this->run_stage(s, epoch, staged, n);
+        });
+
+        if (cpp_unlikely(profiling)) {
+            // The rest of the step, the stage was waiting for the others
+            const size_t duration = watch.stop_ns();
+
+            for (size_t s = 0; s < stages; ++s) {
+                profile.stages[s].idle += duration > stage_busy[s] ? duration - stage_busy[s] : 0;
+            }
+
+            profile.samples += n;
+            profile.batches += staged;
+        }
+
+        ++iteration;
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t m = 0; m < staged; ++m) {
+            error += shard_contexts[m].metrics.first;
+            loss += shard_contexts[m].metrics.second;
+        }
+
+        return std::make_pair(error / n, loss / n);
+    }
+
+    /*!
+     * \brief Run the stage s of the pipeline on the staged micro-batches
+     *
+     * \param s The stage
+     * \param epoch The current epoch
+     * \param staged The number of micro-batches that have been staged
+     * \param n The number of samples of all the micro-batches
+     */
+    void run_stage(size_t s, size_t epoch, size_t staged, size_t n) {
+        const size_t first = stage_bounds[s];
+        const size_t last  = stage_bounds[s + 1];
+
+        stop_timer watch;
+
+        size_t forward   = 0;
+        size_t backward  = 0;
+        size_t gradients = 0;
+
+        for (size_t m = 0; m < staged; ++m) {
+            if (s > 0) {
+                stage_workers->wait_forward(s - 1, m);
+            }
+
+            auto& replica = shard_contexts[m];
+
+            watch.start();
+
+            forward_stage(replica.context, first, last, std::make_index_sequence<layers>());
+
+            if (last == layers) {
+                replica.metrics = last_errors<dbn_t::loss>(replica.context, replica.n, replica.labels);
+            }
+
+            forward += watch.stop_ns();
+
+            stage_workers->forward_done(s);
+        }
+
+        // The last micro-batch is the first one to be backpropagated, it was just forwarded by the last stage
+        for (size_t i = 0; i < staged; ++i) {
+            if (s + 1 < stages) {
+                stage_workers->wait_backward(s + 1, i);
+            }
+
+            auto& replica = shard_contexts[staged - 1 - i];
+
+            watch.start();
+
+            backward_stage(replica.context, first, last, std::make_index_sequence<layers>());
+
+            backward += watch.stop_ns();
+
+            // The lower stage only needs the errors, not the gradients
+            stage_workers->backward_done(s);
+
+            watch.start();
+
+            gradients_stage(replica.context, first, last, std::make_index_sequence<layers>());
+
+            gradients += watch.stop_ns();
+        }
+
+        watch.start();
+
+        update_stage(epoch, n, staged, first, last, std::make_index_sequence<layers>());
+
+        gradients += watch.stop_ns();
+
+        // Each stage only writes its own profile
+        if (cpp_unlikely(profiling)) {
+            profile.stages[s].forward += forward;
+            profile.stages[s].backward += backward;
+            profile.stages[s].gradients += gradients;
+        }
+
+        stage_busy[s] = forward + backward + gradients;
+    }
+
+    /*!
+     * \brief Forward propagate the layers [first, last) of the given context
+     */
+    template <size_t... I>
+    void forward_stage(context_t& context, size_t first, size_t last, std::index_sequence<I...> /*seq*/) {
+        ((I >= first && I < last ? forward_stage_layer<I>(context) : void()), ...);
+    }
+
+    /*!
+     * \brief Forward propagate the layer I of the given context, from the
+     * output of the previous layer
+     */
+    template <size_t I>
+    void forward_stage_layer(context_t& context) {
+        auto& layer = std::get<I>(context).first;
+        auto& ctx   = *std::get<I>(context).second;
+
+        stop_timer watch;
+        watch.start();
+
+        if constexpr (I == 0) {
+            this_type::template forward_first_layer<true>(layer, ctx);
+        } else {
+            this_type::template forward_layer<true>(layer, get_output(*std::get<I - 1>(context).second), ctx);
+        }
+
+        if (cpp_unlikely(profiling)) {
+            profile.layers[I].forward += watch.stop_ns();
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the layers [first, last) of
+     * the given context
+     */
+    template <size_t... I>
+    void backward_stage(context_t& context, size_t first, size_t last, std::index_sequence<I...> /*seq*/) {
+        // The errors of the last layer are already adapted by the loss
+        bool output = last == layers;
+
+        ((layers - 1 - I >= first && layers - 1 - I < last ? backward_stage_layer<layers - 1 - I>(context, output) : void()), ...);
+    }
+
+    /*!
+     * \brief Backpropagate the errors through the layer I of the given
+     * context
+     */
+    template <size_t I>
+    void backward_stage_layer(context_t& context, bool& output) {
+        auto& layer = std::get<I>(context).first;
+        auto& ctx   = *std::get<I>(context).second;
+
+        stop_timer watch;
+        watch.start();
+
+        if constexpr (I == 0) {
+            layer.adapt_errors(ctx);
+            cpp_unused(output);
+        } else {
+            backward_layer(layer, ctx, get_errors(*std::get<I - 1>(context).second), output);
+        }
+
+        if (cpp_unlikely(profiling)) {
+            profile.layers[I].backward += watch.stop_ns();
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the layers [first, last) of the given
+     * context
+     */
+    template <size_t... I>
+    void gradients_stage(context_t& context, size_t first, size_t last, std::index_sequence<I...> /*seq*/) {
+        ((I >= first && I < last ? gradients_stage_layer<I>(context) : void()), ...);
+    }
+
+    /*!
+     * \brief Compute the gradients of the layer I of the given context
+     */
+    template <size_t I>
+    void gradients_stage_layer(context_t& context) {
+        stop_timer watch;
+        watch.start();
+
+        compute_gradients_layer(std::get<I>(context).first, *std::get<I>(context).second);
+
+        if (cpp_unlikely(profiling)) {
+            profile.layers[I].gradients += watch.stop_ns();
+        }
+    }
+
+    /*!
+     * \brief Sum the gradients of the micro-batches of the layers [first,
+     * last) and update their weights
+     */
+    template <size_t... I>
+    void update_stage(size_t epoch, size_t n, size_t staged, size_t first, size_t last, std::index_sequence<I...> /*seq*/) {
+        ((I >= first && I < last ? update_stage_layer<I>(epoch, n, staged) : void()), ...);
+    }
+
+    /*!
+     * \brief Sum the gradients of the micro-batches of the layer I and
+     * update its weights
+     */
+    template <size_t I>
+    void update_stage_layer(size_t epoch, size_t n, size_t staged) {
+        auto& layer = std::get<I>(full_context).first;
+        auto& ctx   = *std::get<I>(full_context).second;
+
+        stop_timer watch;
+        watch.start();
+
+        for (size_t m = 0; m < staged; ++m) {
+            reduce_gradients_layer(layer, ctx, *std::get<I>(shard_contexts[m].context).second, m == 0);
+        }
+
+        update_weights_layer(epoch, n, layer, ctx);
+
+        if (cpp_unlikely(profiling)) {
+            profile.layers[I].gradients += watch.stop_ns();
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the given layer, without applying them
+     */
+    template <typename Layer, typename Context>
+    static void compute_gradients_layer(Layer& layer, Context& context){
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [](auto& sub_layer, auto& sub_context) {
+                this_type::compute_gradients_layer(sub_layer, sub_context);
+            });
+        } else {
+            layer.compute_gradients(context);
+        }
+    }
+
+    /*!
+     * \brief Apply the already computed gradients of the given layer
+     */
+    template <typename Layer, typename Context>
+    void update_weights_layer(size_t epoch, size_t n, Layer& layer, Context& context){
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n](auto& sub_layer, auto& sub_context) {
+                this->update_weights_layer(epoch, n, sub_layer, sub_context);
+            });
+        } else if constexpr (dbn_traits<dbn_t>::has_global_clip_gradients()) {
+            this->defer_update(epoch, n, layer, context);
+        } else {
+            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+        }
+    }
+
+    /*!
+     * \brief Accumulate the gradients of a shard context into the main context
+     * \param layer The layer
+     * \param context The main context of the layer
+     * \param shard_context The shard context of the layer
+     * \param first Indicates if this is the first shard being reduced
+     */
+    template <typename Layer, typename Context>
+    static void reduce_gradients_layer(Layer& layer, Context& context, Context& shard_context, bool first){
+        if constexpr (is_utility_layer<Layer>) {
+            reduce_gradients_group(layer, context, shard_context, first, std::make_index_sequence<Layer::n_layers>());
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            reduce_gradients_variables(context, shard_context, first, std::make_index_sequence<N>());
+        }
+    }
+
+    template <typename Layer, typename Context, size_t... I>
+    static void reduce_gradients_group(Layer& layer, Context& context, Context& shard_context, bool first, std::index_sequence<I...> /*seq*/){
+        (reduce_gradients_layer(std::get<I>(layer.layers), std::get<I>(context.sub_contexts), std::get<I>(shard_context.sub_contexts), first), ...);
+    }
+
+    template <typename Context, size_t... I>
+    static void reduce_gradients_variables(Context& context, Context& shard_context, bool first, std::index_sequence<I...> /*seq*/){
+        (reduce_gradients_variable<I>(context, shard_context, first), ...);
+    }
+
+    template <size_t I, typename Context>
+    static void reduce_gradients_variable(Context& context, Context& shard_context, bool first){
+        reduce_gradients(*std::get<I>(context.up.context), *std::get<I>(shard_context.up.context), first);
+    }
+
+    /*!
+     * \brief Reduce the gradients of one variable into the gradients of
+     * another updater sub context
+     * \param sub The sub context to reduce into
+     * \param shard The sub context to reduce
+     * \param first Indicates if this is the first reduction into sub
+     */
+    template <typename Sub, typename Shard>
+    static void reduce_gradients(Sub& sub, const Shard& shard, bool first){
+        if constexpr (has_sparse_rows<Sub>::value && has_sparse_rows<Shard>::value) {
+            reduce_sparse_gradients(sub, shard, first);
+        } else if (first) {
+            sub.grad = shard.grad;
+        } else {
+            sub.grad += shard.grad;
+        }
+    }
+
+    /*!
+     * \brief Accumulate the gradients of the given layer into its
+     * accumulators, or collect the accumulated gradients back into its
+     * context.
+     *
+     * \tparam Collect Indicates if the accumulated gradients are collected
+     */
+    template <bool Collect, typename Layer, typename Context, typename Accumulators>
+    static void accumulate_gradients_layer(Layer& layer, Context& context, Accumulators& accumulators, bool first){
+        static_assert(!is_utility_layer<Layer>, "gradient_accumulation does not support group and merge layers");
+
+        if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            accumulate_gradients_variables<Collect>(context, accumulators, first, std::make_index_sequence<N>());
+        } else {
+            cpp_unused(context);
+            cpp_unused(accumulators);
+            cpp_unused(first);
+        }
+    }
+
+    /*!
+     * \brief Accumulate the gradients of all the layers, or collect them
+     * back into the full context
+     */
+    template <bool Collect, size_t... I>
+    void accumulate_gradients(bool first, std::index_sequence<I...> /*seq*/){
+        (accumulate_gradients_layer<Collect>(std::get<I>(full_context).first, *std::get<I>(full_context).second, std::get<I>(accumulators), first), ...);
+    }
+
+    template <bool Collect, typename Context, typename Accumulators, size_t... I>
+    static void accumulate_gradients_variables(Context& context, Accumulators& accumulators, bool first, std::index_sequence<I...> /*seq*/){
+        if constexpr (Collect) {
+            (reduce_gradients(*std::get<I>(context.up.context), *std::get<I>(accumulators), true), ...);
+        } else {
+            (reduce_gradients(*std::get<I>(accumulators), *std::get<I>(context.up.context), first), ...);
+        }
+    }
+
+    template <typename Layer, typename Context>
+    void apply_gradients_layer(size_t epoch, size_t n, Layer& layer, Context& context){
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n](auto& sub_layer, auto& sub_context) {
+                this->apply_gradients_layer(epoch, n, sub_layer, sub_context);
+            });
+        } else {
+            // Compute the gradients
+            layer.compute_gradients(context);
+
+            // Apply the gradients (once the global norm is known with global clipping)
+            if constexpr (dbn_traits<dbn_t>::has_global_clip_gradients()) {
+                this->defer_update(epoch, n, layer, context);
+            } else {
+                this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+            }
+        }
+    }
+
+    template <typename Layer, typename Context, typename Errors, cpp_disable_iff(is_utility_layer<Layer>)>
+    static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
+        if(!last){
+            layer.adapt_errors(context);
+        }
+
+        last = false;
+
+        layer.backward_batch(errors, context);
+    }
+
+    template <size_t L, typename Layer, typename Context, typename Errors>
+    static void backward_layer_group(Layer& layer, Context& context, Errors&& errors, bool& last){
+        auto& sub_layer   = std::get<L>(layer.layers);
+        auto& sub_context = std::get<L>(context.sub_contexts);
+
+        if (!last) {
+            sub_layer.adapt_errors(sub_context);
+        }
+
+        last = false;
+
+        if constexpr (L == 0) {
+            sub_layer.backward_batch(errors, sub_context);
+        } else {
+            auto& prev_sub_context = std::get<L - 1>(context.sub_contexts);
+
+            sub_layer.backward_batch(prev_sub_context.errors, sub_context);
+
+            backward_layer_group<L - 1>(layer, context, errors, last);
+        }
+    }
+
+    template <typename Layer, typename Context, typename Errors, cpp_enable_iff(is_group_layer<Layer>)>
+    static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
+        backward_layer_group<Layer::n_layers - 1>(layer, context, errors, last);
+    }
+
+    template <typename Layer, typename Context, typename Errors, cpp_enable_iff(is_merge_layer<Layer>)>
+    static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
+        // The errors of the previous layer may be a view (after a view
+        // layer), each branch needs its own memory
+        using errors_t = etl::dyn_matrix<weight, etl::decay_traits<Errors>::dimensions()>;
+
+        // Each branch is backpropagated on its own thread, into its own errors
+
+        std::vector<errors_t> back_errors(Layer::n_layers, errors_t(errors));
+
+        const auto offsets = merge_offsets(context);
+
+        dll::parallel_static_for<Layer::n_layers>([&layer, &context, &back_errors, &offsets, last](auto i) {
+            constexpr size_t I = decltype(i)::value;
+
+            auto& sub_layer   = std::get<I>(layer.layers);
+            auto& sub_context = std::get<I>(context.sub_contexts);
+
+            SERIAL_SECTION {
+                batch_dispatch_at<Layer::merge_dim + 1>(get_errors(sub_context), context.errors, offsets[I]);
+
+                bool sub_last = last;
+                backward_layer(sub_layer, sub_context, back_errors[I], sub_last);
+            }
+        });
+
+        // Accumulate the errors of all the branches
+
+        errors = back_errors[0];
+
+        for (size_t i = 1; i < Layer::n_layers; ++i) {
+            errors += back_errors[i];
+        }
+
+        last = false;
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer through the given
+     * full context
+     */
+    template <typename Context>
+    static void backward_context(Context& context){
+        auto& first_layer = std::get<0>(context).first;
+        auto& first_ctx   = *std::get<0>(context).second;
+
+        bool last = true;
+
+        cpp::for_each_rpair(context, [&last](auto& layer_ctx_1, auto& layer_ctx_2) {
+            backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
+        });
+
+        first_layer.adapt_errors(first_ctx);
+    }
+
+    /*!
+     * \brief Forward propagate the first layer of a context, whose input is
+     * already loaded
+     */
+    template <bool Train, typename Layer, typename Context>
+    static void forward_first_layer(Layer& layer, Context& context) {
+        if constexpr (Train && is_sampled_softmax_layer<std::decay_t<Layer>>::value) {
+            // The sampled softmax is computed with the labels, by last_errors
+            cpp_unused(layer);
+            cpp_unused(context);
+        }
+        // The output of a view layer is its input, nothing is computed
+        else if constexpr (!dbn_detail::is_view_layer<std::decay_t<Layer>>::value) {
+            if constexpr (Train) {
+                layer.train_forward_batch(context.output, context.input);
+            } else {
+                layer.test_forward_batch(context.output, context.input);
+            }
+        } else {
+            cpp_unused(layer);
+            cpp_unused(context);
+        }
+    }
+
+    template <bool Train, typename Layer, typename Inputs, typename Context, cpp_disable_iff(is_utility_layer<Layer>)>
+    static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
+        if constexpr (Train && is_sampled_softmax_layer<std::decay_t<Layer>>::value) {
+            // The sampled softmax is computed with the labels, by last_errors
+            cpp_unused(layer);
+
+            context.input = inputs;
+        } else if constexpr (dbn_detail::is_view_layer<std::decay_t<Layer>>::value) {
+            // The input of a bound view layer is the output of the previous
+            // layer, nothing is copied
+            cpp_unused(layer);
+
+            if (context.bound()) {
+                cpu_access(inputs);
+                cpu_modified(context.input, context.output);
+            } else {
+                context.input = inputs;
+            }
+        } else if constexpr (dbn_detail::is_inplace_layer<std::decay_t<Layer>>::value) {
+            // The backward pass of the layer does not need its input, the
+            // output of the previous layer is used directly
+            if constexpr (Train) {
+                layer.train_forward_batch(context.output, inputs);
+            } else {
+                layer.test_forward_batch(context.output, inputs);
+            }
+        } else {
+            context.input = inputs;
+
+            if constexpr (Train) {
+                layer.train_forward_batch(context.output, context.input);
+            } else {
+                layer.test_forward_batch(context.output, context.input);
+            }
+        }
+    }
+
+    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
+    static void forward_layer_group(Layer& layer, Inputs&& inputs, Context& context) {
+        if constexpr (L < Layer::n_layers) {
+            auto& sub_layer   = std::get<L>(layer.layers);
+            auto& sub_context = std::get<L>(context.sub_contexts);
+
+            sub_context.input = inputs;
+
+            if constexpr (Train) {
+                sub_layer.train_forward_batch(sub_context.output, sub_context.input);
+            } else {
+                sub_layer.test_forward_batch(sub_context.output, sub_context.input);
+            }
+
+            forward_layer_group<Train, L + 1>(layer, sub_context.output, context);
+        }
+    }
+
+    template <bool Train, typename Layer, typename Inputs, typename Context, cpp_enable_iff(is_group_layer<Layer>)>
+    static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
+        forward_layer_group<Train, 0>(layer, inputs, context);
+    }
+
+    template <bool Train, typename Layer, typename Inputs, typename Context, cpp_enable_iff(is_merge_layer<Layer>)>
+    static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
+        context.input = inputs;
+
+        // Fully forward each group on its own thread, each group is copied
+        // directly to its own slice of the output
+
+        const auto offsets = merge_offsets(context);
+
+        dll::parallel_static_for<Layer::n_layers>([&layer, &context, &offsets](auto i) {
+            constexpr size_t I = decltype(i)::value;
+
+            auto& sub_context = std::get<I>(context.sub_contexts);
+
+            SERIAL_SECTION {
+                forward_layer<Train>(std::get<I>(layer.layers), context.input, sub_context);
+
+                batch_merge_at<Layer::merge_dim + 1>(context.output, get_output(sub_context), offsets[I]);
+            }
+        });
+    }
+
+    /*!
+     * \brief Return the offsets of the outputs of the branches of a merge
+     * layer in its merged output, at the merge dimension
+     */
+    template <typename Context>
+    static auto merge_offsets(Context& context) {
+        constexpr size_t D = Context::layer_t::merge_dim + 1;
+
+        std::array<size_t, Context::layer_t::n_layers> offsets;
+
+        size_t i      = 0;
+        size_t offset = 0;
+
+        cpp::for_each(context.sub_contexts, [&](auto& sub_context) {
+            offsets[i++] = offset;
+            offset += etl::dim(get_output(sub_context), D);
+        });
+
+        return offsets;
     }
 
     template <typename Context>
     static auto& get_output(Context& context) {
         if constexpr (is_group_layer<typename Context::layer_t>) {
             return get_output(std::get<Context::n_layers - 1>(context.sub_contexts));
+        } else if constexpr (dbn_detail::is_view_layer<typename Context::layer_t>::value) {
+            return context.input;
         } else {
             return context.output;
         }
@@ -854,11 +2955,21 @@ struct sgd_trainer {
 
     template <bool Train, typename Inputs>
     auto& forward_batch_helper(Inputs&& inputs) {
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+        restore_segments(std::make_index_sequence<layers>());
+
+        load_inputs(full_context, inputs);
+
+        return forward_context<Train>(full_context);
+    }
+
+    /*!
+     * \brief Load a batch of inputs into the first layer of the given full context
+     */
+    template <typename Context, typename Inputs>
+    static void load_inputs(Context& context, Inputs&& inputs) {
+        auto& first_ctx = *std::get<0>(context).second;
 
-        const auto n          = etl::dim<0>(inputs);
+        const auto n = etl::dim<0>(inputs);
         const bool full_batch = n == etl::dim<0>(first_ctx.input);
 
         // Ensure that the context can hold the inputs
@@ -874,18 +2985,73 @@ struct sgd_trainer {
         } else {
             first_ctx.input = inputs;
         }
+    }
 
-        if constexpr (Train) {
-            first_layer.train_forward_batch(first_ctx.output, first_ctx.input);
-        } else {
-            first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
-        }
+    /*!
+     * \brief Forward propagate the inputs already loaded into the given full context
+     * \return A reference to the output of the last layer
+     */
+    template <bool Train, typename Context>
+    static auto& forward_context(Context& context) {
+        auto& first_layer = std::get<0>(context).first;
+        auto& first_ctx   = *std::get<0>(context).second;
+        auto& last_ctx    = *std::get<layers - 1>(context).second;
+
+        forward_first_layer<Train>(first_layer, first_ctx);
 
-        cpp::for_each_pair(full_context, [this](auto& layer_ctx_1, auto& layer_ctx_2) {
-            this->template forward_layer<Train>(layer_ctx_2.first, get_output(*layer_ctx_1.second), *layer_ctx_2.second);
+        cpp::for_each_pair(context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
+            this_type::template forward_layer<Train>(layer_ctx_2.first, get_output(*layer_ctx_1.second), *layer_ctx_2.second);
         });
 
-        return last_ctx.output;
+        return get_output(last_ctx);
+    }
+
+    /*!
+     * \brief Collect the state of the updater of the given layer
+     */
+    template <typename Layer, typename Context>
+    static void updater_state_layer(Layer& layer, Context& context, parameter_store<weight>& state, std::vector<double*>& scalars) {
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [&state, &scalars](auto& sub_layer, auto& sub_context) {
+                this_type::updater_state_layer(sub_layer, sub_context, state, scalars);
+            });
+        } else if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            cpp::for_each(context.up.context, [&state, &scalars](auto& sub_context) {
+                this_type::updater_state_variable(*sub_context, state, scalars);
+            });
+        }
+    }
+
+    /*!
+     * \brief Collect the state of the updater of one variable
+     */
+    template <typename Sub>
+    static void updater_state_variable(Sub& sub, parameter_store<weight>& state, [[maybe_unused]] std::vector<double*>& scalars) {
+        constexpr auto UT = dbn_traits<dbn_t>::updater();
+
+        auto add = [&state](auto& tensor) {
+            state.add(tensor.memory_start(), etl::size(tensor));
+        };
+
+        if constexpr (UT == updater_type::MOMENTUM || UT == updater_type::RMSPROP || UT == updater_type::ADAGRAD) {
+            add(sub.inc);
+        } else if constexpr (UT == updater_type::NESTEROV) {
+            add(sub.inc);
+            add(sub.inc_prev);
+        } else if constexpr (UT == updater_type::ADADELTA) {
+            add(sub.g);
+            add(sub.x);
+            add(sub.v);
+        } else if constexpr (UT != updater_type::SGD) {
+            add(sub.m);
+            add(sub.v);
+
+            if constexpr (UT == updater_type::NADAM) {
+                scalars.push_back(&sub.m_schedule);
+            }
+        } else {
+            cpp_unused(add);
+        }
     }
 
     /*!
@@ -920,298 +3086,400 @@ struct sgd_trainer {
             eps *= 1.0 / (1.0 + eps_decay * iteration);
         }
 
-        //2. Update the gradients (L1/L2 and gradient clipping)
+        using sub_context_t = std::decay_t<decltype(*std::get<I>(context.up.context))>;
 
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
+        if constexpr (is_fused_updater(UT) && !has_sparse_rows<sub_context_t>::value) {
+            // 2. Update the gradients and apply them in a single pass
 
-        // Note the distinction for w and b for decay is far from optimal...
-        if constexpr (I == 0) {
-            this->update_grad<w_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+            fused_update_variable<I, UT>(layer, context, n, eps);
+
+            cpp_unused(epoch);
         } else {
-            this->update_grad<b_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
-        }
+            //2. Update the gradients (L1/L2 and gradient clipping)
 
-        // 3. Apply the gradients
+            auto& w      = std::get<I>(layer.trainable_parameters());
+            auto& w_grad = std::get<I>(context.up.context)->grad;
 
-        apply_gradients<I, UT>(epoch, layer, context, n, eps);
-    }
+            // Note the distinction for w and b for decay is far from optimal...
+            if constexpr (has_sparse_rows<std::decay_t<decltype(*std::get<I>(context.up.context))>>::value) {
+                // Sparse gradients are only decayed on the touched rows
+                for (auto r : std::get<I>(context.up.context)->rows) {
+                    auto w_row    = w(r);
+                    auto grad_row = w_grad(r);
 
-    /*!
-     * \brief Apply the gradients to the given layer
-     */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::SGD)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:sgd");
+                    const auto scale = this->update_grad<w_decay(dbn_traits<dbn_t>::decay())>(w_row, grad_row, n);
 
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
+                    if (scale != 1.0) {
+                        grad_row = grad_row >> scale;
+                    }
+                }
+            } else {
+                static constexpr auto D = variable_decay<L, I>();
 
-        w += (eps / n) * w_grad;
+                const auto scale = this->update_grad<D>(w, w_grad, n);
 
-        nan_check_deep(w);
+                // The updates linear in the gradients take the clipping in their learning rate
+                if constexpr (UT == updater_type::SGD || UT == updater_type::MOMENTUM || UT == updater_type::NESTEROV) {
+                    eps *= scale;
+                } else if (scale != 1.0) {
+                    w_grad = w_grad >> scale;
+                }
+            }
 
-        cpp_unused(epoch);
+            // 3. Apply the gradients
+
+            apply_gradients<I, UT>(epoch, layer, context, n, eps);
+        }
     }
 
     /*!
-     * \brief Apply the gradients to the given layer
+     * \brief Update a variable of the layer with the fused kernel of the
+     * updater.
+     *
+     * When the updates of the biases are batched, the small biases are only
+     * prepared here and updated together by update_pending_biases().
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::MOMENTUM)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:momentum");
+    /*!
+     * \brief Returns the decay of the variable I of a layer of type L.
+     *
+     * The first variable is the weights, the next ones are biases. The tied
+     * layers only have biases, their weights are decayed by their encoder.
+     */
+    template <typename L, size_t I>
+    static constexpr decay_type variable_decay() {
+        constexpr bool weights = I == 0 && !cpp::is_specialization_of_v<dll::tied_dense_layer_impl, std::decay_t<L>>;
 
-        const auto momentum = dbn.momentum;
+        return weights ? w_decay(dbn_traits<dbn_t>::decay()) : b_decay(dbn_traits<dbn_t>::decay());
+    }
 
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_inc  = std::get<I>(context.up.context)->inc;
+    template <size_t I, updater_type UT, typename L, typename C>
+    void fused_update_variable(L& layer, C& context, size_t n, weight eps) {
+        static constexpr auto D = variable_decay<L, I>();
 
-        //Update with momentum and learning rate
+        auto& w   = std::get<I>(layer.trainable_parameters());
+        auto& ctx = *std::get<I>(context.up.context);
 
-        w_inc = momentum * w_inc + (eps / n) * w_grad;
+        using value_type = etl::value_t<std::decay_t<decltype(w)>>;
 
-        w += w_inc;
+        fused_tensor<value_type> t;
 
-        nan_check_deep(w);
+        t.w    = w.memory_start();
+        t.g    = ctx.grad.memory_start();
+        t.size = etl::size(w);
 
-        cpp_unused(epoch);
-    }
+        auto& step = t.step;
 
-    /*!
-     * \brief Apply the gradients to the given layer
-     */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::NESTEROV)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:nesterov");
+        step.eps = eps;
+        step.l1  = dbn.l1_weight_cost;
+        step.l2  = dbn.l2_weight_cost;
 
-        const auto momentum = dbn.momentum;
+        if constexpr (UT == updater_type::RMSPROP) {
+            t.s0       = ctx.inc.memory_start();
+            step.beta1 = dbn.rmsprop_decay;
+        } else if constexpr (UT == updater_type::ADADELTA) {
+            t.s0       = ctx.g.memory_start();
+            t.s1       = ctx.x.memory_start();
+            t.s2       = ctx.v.memory_start();
+            step.beta1 = dbn.adadelta_beta;
+        } else {
+            t.s0       = ctx.m.memory_start();
+            t.s1       = ctx.v.memory_start();
+            step.beta1 = dbn.adam_beta1;
+            step.beta2 = dbn.adam_beta2;
+        }
 
-        auto& w          = std::get<I>(layer.trainable_parameters());
-        auto& w_grad     = std::get<I>(context.up.context)->grad;
-        auto& w_inc      = std::get<I>(context.up.context)->inc;
-        auto& w_inc_prev = std::get<I>(context.up.context)->inc_prev;
+        if constexpr (UT == updater_type::ADAM_CORRECT) {
+            // Correct the bias (towards zero) of the first and second moments
+            step.c1 = 1.0 / (1.0 - std::pow(step.beta1, double(iteration)));
+            step.c2 = 1.0 / (1.0 - std::pow(step.beta2, double(iteration)));
+        } else if constexpr (UT == updater_type::NADAM) {
+            const double t_it           = iteration;
+            const double schedule_decay = dbn.nadam_schedule_decay;
 
-        //Update with momentum and learning rate
+            // Compute the schedule for momentum
 
-        w_inc_prev = w_inc;
+            const double momentum_cache_t   = step.beta1 * (1.0 - 0.5 * (std::pow(0.96, t_it * schedule_decay)));
+            const double momentum_cache_t_1 = step.beta1 * (1.0 - 0.5 * (std::pow(0.96, (t_it + 1) * schedule_decay)));
 
-        w_inc = momentum * w_inc + (eps / n) * w_grad;
+            const double m_schedule_new  = ctx.m_schedule * momentum_cache_t;
+            const double m_schedule_next = ctx.m_schedule * momentum_cache_t * momentum_cache_t_1;
 
-        w += -momentum * w_inc_prev + (1.0 + momentum) * w_inc;
+            if constexpr (I == 0) {
+                ctx.m_schedule = m_schedule_new;
+            }
 
-        nan_check_deep(w);
+            step.c1 = 1.0 / (1.0 - m_schedule_next);
+            step.c2 = 1.0 / (1.0 - std::pow(step.beta2, t_it));
+            step.m1 = eps * ((1.0 - momentum_cache_t) / (1.0 - m_schedule_new));
+            step.m2 = eps * momentum_cache_t_1;
+        }
 
-        cpp_unused(epoch);
+        if constexpr (dbn_traits<dbn_t>::has_global_clip_gradients()) {
+            step.scale = global_scale;
+            cpp_unused(n);
+        } else if constexpr (dbn_traits<dbn_t>::has_clip_gradients()) {
+            step.scale = clip_scale<D>(t, n, dbn.gradient_clip);
+        } else {
+            cpp_unused(n);
+        }
+
+        if constexpr (I > 0 && std::is_same<value_type, weight>::value) {
+            if (batch_biases && t.size <= fused_multi_tensor_max) {
+                pending_biases.push_back(t);
+                return;
+            }
+        }
+
+        dll::auto_timer timer("sgd::apply_grad:fused");
+
+        fused_update<UT, D>(t);
+
+        nan_check_deep(w);
     }
 
     /*!
-     * \brief Apply the gradients to the given layer
+     * \brief Call the functor, which updates the weights of several layers,
+     * while updating all the small biases together in one parallel launch.
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAGRAD)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adagrad");
+    template <typename Functor>
+    void batched_biases_update(Functor&& fun) {
+        if constexpr (is_fused_updater(dbn_traits<dbn_t>::updater())) {
+            batch_biases = true;
+            fun();
+            apply_clipped_updates();
+            batch_biases = false;
+
+            update_pending_biases();
+        } else {
+            fun();
+            apply_clipped_updates();
+        }
+    }
 
-        const auto e = 1e-8;
+    /*!
+     * \brief Collect the gradients of the given layer for the global norm and
+     * defer its update until the norm of the gradients of all the layers is
+     * known.
+     */
+    template <typename L, typename C>
+    void defer_update(size_t epoch, size_t n, L& layer, C& context) {
+        if constexpr (decay_layer_traits<L>::is_neural_layer()) {
+            static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_inc  = std::get<I>(context.up.context)->inc;
+            collect_clipped(layer, context, std::make_index_sequence<N>());
 
-        w_inc = w_inc + (w_grad >> w_grad);
+            clipped_n = n;
 
-        w += (eps * w_grad) / etl::sqrt(w_inc + e);
+            // A plain record, the vector keeps its capacity from one batch to the next
+            clipped_updates.push_back({&apply_clipped_update<L, C>, &layer, &context, epoch, n});
+        } else {
+            cpp_unused(epoch);
+            cpp_unused(n);
+            cpp_unused(layer);
+            cpp_unused(context);
+        }
+    }
 
-        nan_check_deep(w);
+    /*!
+     * \brief Apply a deferred update of a layer of type L with a context of
+     * type C
+     */
+    template <typename L, typename C>
+    static void apply_clipped_update(sgd_trainer& trainer, const clipped_update& update) {
+        trainer.template update_weights<dbn_traits<dbn_t>::updater()>(update.epoch, *static_cast<L*>(update.layer), *static_cast<C*>(update.context), update.n);
+    }
 
-        cpp_unused(n);
-        cpp_unused(epoch);
+    template <typename L, typename C, size_t... I>
+    void collect_clipped(L& layer, C& context, std::index_sequence<I...> /*seq*/) {
+        (collect_clipped_variable<I>(layer, context), ...);
     }
 
     /*!
-     * \brief Apply the gradients to the given layer
+     * \brief Collect the gradients of the variable I of the layer for the
+     * global norm, with the weight decay of the variable
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADADELTA)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adadelta");
+    template <size_t I, typename L, typename C>
+    void collect_clipped_variable(L& layer, C& context) {
+        static constexpr auto D = variable_decay<L, I>();
 
-        const auto beta = dbn.adadelta_beta;
-        const auto e = 1e-8;
+        auto& w   = std::get<I>(layer.trainable_parameters());
+        auto& ctx = *std::get<I>(context.up.context);
 
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_g    = std::get<I>(context.up.context)->g;
-        auto& w_v    = std::get<I>(context.up.context)->v;
-        auto& w_x    = std::get<I>(context.up.context)->x;
+        using value_type = etl::value_t<std::decay_t<decltype(w)>>;
 
-        w_g = beta * w_g + ((1.0 - beta) * (w_grad >> w_grad));
-        w_v = (sqrt(w_x + e) >> w_grad) / sqrt(w_g + e);
-        w_x = beta * w_x + ((1.0 - beta) * (w_v >> w_v));
+        fused_tensor<value_type> t;
 
-        w += w_v;
+        t.w       = w.memory_start();
+        t.g       = ctx.grad.memory_start();
+        t.size    = etl::size(w);
+        t.step.l1 = D == decay_type::L1 || D == decay_type::L1L2 ? double(dbn.l1_weight_cost) : 0.0;
+        t.step.l2 = D == decay_type::L2 || D == decay_type::L1L2 ? double(dbn.l2_weight_cost) : 0.0;
 
-        nan_check_deep(w);
+        auto& rows = kernel_scratch<fused_tensor<value_type>>(0);
 
-        cpp_unused(n);
-        cpp_unused(epoch);
-        cpp_unused(eps);
+        if constexpr (has_sparse_rows<std::decay_t<decltype(ctx)>>::value) {
+            // Only the touched rows have gradients and are decayed
+            const size_t row_size = etl::size(w) / etl::dim<0>(w);
+
+            for (auto r : ctx.rows) {
+                auto row = t;
+
+                row.w    = t.w + r * row_size;
+                row.g    = t.g + r * row_size;
+                row.size = row_size;
+
+                rows.push_back(row);
+            }
+        } else {
+            rows.push_back(t);
+        }
+
+        if constexpr (std::is_same<value_type, weight>::value) {
+            clipped_tensors.insert(clipped_tensors.end(), rows.begin(), rows.end());
+        } else {
+            clipped_sum += squared_sum(rows);
+        }
     }
 
     /*!
-     * \brief Apply the gradients to the given layer
+     * \brief Apply the deferred updates of all the layers, with their
+     * gradients scaled by the global norm of the gradients, computed in one
+     * parallel reduction over all the gradients.
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAM)>
-    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adam");
-
-        const auto beta1 = dbn.adam_beta1;
-        const auto beta2 = dbn.adam_beta2;
-        const auto e = 1e-8;
+    void apply_clipped_updates() {
+        if constexpr (dbn_traits<dbn_t>::has_global_clip_gradients()) {
+            if (clipped_updates.empty()) {
+                return;
+            }
 
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_m    = std::get<I>(context.up.context)->m;
-        auto& w_v    = std::get<I>(context.up.context)->v;
+            {
+                dll::auto_timer timer("sgd::clip:global");
 
-        // Standard Adam estimations of the first and second moments
+                global_scale = clip_scale(squared_sum(clipped_tensors) + clipped_sum, clipped_n, dbn.gradient_clip);
+            }
 
-        w_m = beta1 * w_m + ((1.0 - beta1) * w_grad);
-        w_v = beta2 * w_v + ((1.0 - beta2) * (w_grad >> w_grad));
+            for (auto& update : clipped_updates) {
+                update.apply(*this, update);
+            }
 
-        // Update the parameters
+            clipped_updates.clear();
+            clipped_tensors.clear();
+            clipped_sum = 0.0;
+        }
+    }
 
-        w += (eps * w_m) / (etl::sqrt(w_v) + e);
+    /*!
+     * \brief Update all the pending biases in one parallel launch
+     */
+    void update_pending_biases() {
+        if (!pending_biases.empty()) {
+            dll::auto_timer timer("sgd::apply_grad:fused_biases");
 
-        nan_check_deep(w);
+            fused_update<dbn_traits<dbn_t>::updater(), b_decay(dbn_traits<dbn_t>::decay())>(pending_biases);
 
-        cpp_unused(n);
-        cpp_unused(epoch);
+            pending_biases.clear();
+        }
     }
 
     /*!
      * \brief Apply the gradients to the given layer
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAM_CORRECT)>
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::SGD)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adam_correct");
-
-        const auto beta1 = dbn.adam_beta1;
-        const auto beta2 = dbn.adam_beta2;
-        const auto e = 1e-8;
-        const auto t = iteration;
+        dll::auto_timer timer("sgd::apply_grad:sgd");
 
         auto& w      = std::get<I>(layer.trainable_parameters());
         auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_m    = std::get<I>(context.up.context)->m;
-        auto& w_mt   = std::get<I>(context.up.context)->mt;
-        auto& w_v    = std::get<I>(context.up.context)->v;
-        auto& w_vt   = std::get<I>(context.up.context)->vt;
-
-        // Standard Adam estimations of the first and second moments
-
-        w_m = beta1 * w_m + ((1.0 - beta1) * w_grad);
-        w_v = beta2 * w_v + ((1.0 - beta2) * (w_grad >> w_grad));
-
-        // Correct the bias (towards zero) of the first and second moments
 
-        w_mt = w_m / (1.0 - std::pow(beta1, t));
-        w_vt = w_v / (1.0 - std::pow(beta2, t));
-
-        // Update the parameters
-
-        w += (eps * w_m) / (etl::sqrt(w_v) + e);
+        if constexpr (has_sparse_rows<std::decay_t<decltype(*std::get<I>(context.up.context))>>::value) {
+            for (auto r : std::get<I>(context.up.context)->rows) {
+                w(r) += (eps / n) * w_grad(r);
+            }
+        } else {
+            w += (eps / n) * w_grad;
+        }
 
         nan_check_deep(w);
 
-        cpp_unused(n);
         cpp_unused(epoch);
     }
 
     /*!
      * \brief Apply the gradients to the given layer
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAMAX)>
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::MOMENTUM)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:adamax");
+        dll::auto_timer timer("sgd::apply_grad:momentum");
 
-        const auto beta1 = dbn.adam_beta1;
-        const auto beta2 = dbn.adam_beta2;
+        const auto momentum = dbn.momentum;
 
         auto& w      = std::get<I>(layer.trainable_parameters());
         auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_m    = std::get<I>(context.up.context)->m;
-        auto& w_v    = std::get<I>(context.up.context)->v;
-
-        // Standard Adam estimations of the first moment
-
-        w_m = beta1 * w_m + ((1.0 - beta1) >> w_grad);
-
-        // Estimation of the second moment with infinite-norm
+        auto& w_inc  = std::get<I>(context.up.context)->inc;
 
-        w_v = etl::max(beta2 * w_v, etl::abs(w_grad));
+        //Update with momentum and learning rate
 
-        // Update the parameters
+        w_inc = momentum * w_inc + (eps / n) * w_grad;
 
-        w += (eps >> w_m) / w_v;
+        w += w_inc;
 
         nan_check_deep(w);
 
-        cpp_unused(n);
         cpp_unused(epoch);
     }
 
     /*!
      * \brief Apply the gradients to the given layer
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::NADAM)>
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::NESTEROV)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:nadam");
+        dll::auto_timer timer("sgd::apply_grad:nesterov");
 
-        const weight beta1          = dbn.adam_beta1;
-        const weight beta2          = dbn.adam_beta2;
-        const weight schedule_decay = dbn.nadam_schedule_decay;
-        const weight e              = 1e-8;
-        const weight t              = iteration;
+        const auto momentum = dbn.momentum;
 
         auto& w          = std::get<I>(layer.trainable_parameters());
         auto& w_grad     = std::get<I>(context.up.context)->grad;
-        auto& w_m        = std::get<I>(context.up.context)->m;
-        auto& w_mt       = std::get<I>(context.up.context)->mt;
-        auto& w_v        = std::get<I>(context.up.context)->v;
-        auto& w_vt       = std::get<I>(context.up.context)->vt;
-        auto& m_schedule = std::get<I>(context.up.context)->m_schedule;
+        auto& w_inc      = std::get<I>(context.up.context)->inc;
+        auto& w_inc_prev = std::get<I>(context.up.context)->inc_prev;
 
-        // Compute the schedule for momentum
+        //Update with momentum and learning rate
 
-        weight momentum_cache_t   = beta1 * (1.0 - 0.5 * (std::pow(0.96, t * schedule_decay)));
-        weight momentum_cache_t_1 = beta1 * (1.0 - 0.5 * (std::pow(0.96, (t + 1) * schedule_decay)));
+        w_inc_prev = w_inc;
 
-        weight m_schedule_new  = m_schedule * momentum_cache_t;
-        weight m_schedule_next = m_schedule * momentum_cache_t * momentum_cache_t_1;
+        w_inc = momentum * w_inc + (eps / n) * w_grad;
 
-        if constexpr (I == 0) {
-            m_schedule = m_schedule_new;
-        }
+        w += -momentum * w_inc_prev + (1.0 + momentum) * w_inc;
 
-        // Standard Adam estimations of the first and second order moments
+        nan_check_deep(w);
 
-        w_m = beta1 * w_m + ((1.0 - beta1) >> w_grad);
-        w_v = beta2 * w_v + ((1.0 - beta2) >> (w_grad >> w_grad));
+        cpp_unused(epoch);
+    }
 
-        // Correct the bias (towards zero) of the first and second moments
+    /*!
+     * \brief Apply the gradients to the given layer
+     */
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAGRAD)>
+    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
+        dll::auto_timer timer("sgd::apply_grad:adagrad");
 
-        w_mt = w_m / (1.0 - m_schedule_next);
-        w_vt = w_v / (1.0 - std::pow(beta2, t));
+        const auto e = 1e-8;
 
-        // Update the parameters
+        auto& w      = std::get<I>(layer.trainable_parameters());
+        auto& w_grad = std::get<I>(context.up.context)->grad;
+        auto& w_inc  = std::get<I>(context.up.context)->inc;
 
-        weight f1 = 1.0 - momentum_cache_t;
-        weight f2 = 1.0 - m_schedule_new;
+        if constexpr (has_sparse_rows<std::decay_t<decltype(*std::get<I>(context.up.context))>>::value) {
+            // Lazy update of the touched rows
+            for (auto r : std::get<I>(context.up.context)->rows) {
+                w_inc(r) = w_inc(r) + (w_grad(r) >> w_grad(r));
 
-        weight m1 = eps * (f1 / f2);
-        weight m2 = eps * momentum_cache_t_1;
+                w(r) += (eps * w_grad(r)) / etl::sqrt(w_inc(r) + e);
+            }
+        } else {
+            w_inc = w_inc + (w_grad >> w_grad);
 
-        w += (m1 * w_grad + m2 * w_mt) / (etl::sqrt(w_vt) + e);
+            w += (eps * w_grad) / etl::sqrt(w_inc + e);
+        }
 
         nan_check_deep(w);
 
@@ -1220,22 +3488,31 @@ struct sgd_trainer {
     }
 
     /*!
-     * \brief Apply the gradients to the given layer
+     * \brief Apply the gradients to the given layer.
+     *
+     * Only the sparse variables use this version, the dense variables
+     * are updated by the fused kernel.
      */
-    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::RMSPROP)>
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::ADAM)>
     void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
-        dll::auto_timer timer("sgd::apply_grad:rmsprop");
+        dll::auto_timer timer("sgd::apply_grad:adam");
 
-        const auto decay = dbn.rmsprop_decay;
+        const auto beta1 = dbn.adam_beta1;
+        const auto beta2 = dbn.adam_beta2;
         const auto e = 1e-8;
 
         auto& w      = std::get<I>(layer.trainable_parameters());
         auto& w_grad = std::get<I>(context.up.context)->grad;
-        auto& w_inc  = std::get<I>(context.up.context)->inc;
+        auto& w_m    = std::get<I>(context.up.context)->m;
+        auto& w_v    = std::get<I>(context.up.context)->v;
 
-        w_inc = decay * w_inc + (1 - decay) * (w_grad >> w_grad);
+        // Lazy update of the moments and parameters of the touched rows
+        for (auto r : std::get<I>(context.up.context)->rows) {
+            w_m(r) = beta1 * w_m(r) + ((1.0 - beta1) * w_grad(r));
+            w_v(r) = beta2 * w_v(r) + ((1.0 - beta2) * (w_grad(r) >> w_grad(r)));
 
-        w += (eps >> w_grad) / etl::sqrt(w_inc + e);
+            w(r) += (eps * w_m(r)) / (etl::sqrt(w_v(r)) + e);
+        }
 
         nan_check_deep(w);
 
@@ -1244,25 +3521,41 @@ struct sgd_trainer {
     }
 
     /*!
-     * \brief Update the given gradients according to the given decay function
+     * \brief Returns the scale of the given gradients with gradient clipping.
+     *
+     * The gradients are not modified, the scale is applied by the update.
      */
     template <typename G>
-    void clip_gradients(G& grad, size_t n) {
-        if constexpr (dbn_traits<dbn_t>::has_clip_gradients()) {
-            const auto t            = dbn.gradient_clip;
-            const auto grad_l2_norm = std::sqrt(etl::sum(grad >> grad) / (n * n));
+    double clip_gradients(const G& grad, size_t n) const {
+        if constexpr (dbn_traits<dbn_t>::has_global_clip_gradients()) {
+            cpp_unused(grad);
+            cpp_unused(n);
 
-            if (grad_l2_norm > t) {
-                grad = grad >> (t / grad_l2_norm);
-            }
+            return global_scale;
+        } else if constexpr (dbn_traits<dbn_t>::has_clip_gradients()) {
+            // The norm is reduced by fixed blocks, it does not depend on the number of threads
+            cpu_access(grad);
+
+            fused_tensor<etl::value_t<G>> t;
+
+            t.g    = grad.memory_start();
+            t.size = etl::size(grad);
+
+            return clip_scale<decay_type::NONE>(t, n, dbn.gradient_clip);
+        } else {
+            cpp_unused(grad);
+            cpp_unused(n);
+
+            return 1.0;
         }
     }
 
     /*!
      * \brief Update the given gradients according to the given decay function
+     * \return The scale of the gradients with gradient clipping
      */
     template <decay_type decay, typename V, typename G>
-    void update_grad(const V& value, G& grad, size_t n) {
+    double update_grad(const V& value, G& grad, size_t n) {
         if constexpr (decay == decay_type::L1) {
             grad = grad - dbn.l1_weight_cost * abs(value);
         } else if constexpr (decay == decay_type::L2) {
@@ -1271,7 +3564,7 @@ struct sgd_trainer {
             grad = grad - dbn.l1_weight_cost * abs(value) - dbn.l2_weight_cost * value;
         }
 
-        clip_gradients(grad, n);
+        return clip_gradients(grad, n);
     }
 
     /*!
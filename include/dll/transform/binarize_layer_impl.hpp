@@ -27,6 +27,7 @@ struct binarize_layer_impl : transform_layer<binarize_layer_impl<Desc>> {
     using dyn_layer_t = typename desc::dyn_layer_t;                 ///< The dynamic version of this layer
 
     static constexpr size_t Threshold = desc::T;
+    static constexpr bool inplace = true; ///< The layer can be computed in place
 
     binarize_layer_impl() = default;
 
@@ -171,8 +172,8 @@ struct cg_context<binarize_layer_impl<Desc>> {
     etl::fast_matrix<weight, 1, 1> gr_w_tmp;
     etl::fast_vector<weight, 1> gr_b_tmp;
 
-    std::vector<etl::dyn_vector<weight>> gr_probs_a;
-    std::vector<etl::dyn_vector<weight>> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_probs_a; ///< The activation probabilities of the batch
+    etl::dyn_matrix<weight, 2> gr_diffs;   ///< The errors of the batch
 };
 
 } //end of dll namespace
@@ -70,6 +70,18 @@ struct dyn_lcn_layer_impl : transform_layer<dyn_lcn_layer_impl<Desc>> {
         return w;
     }
 
+    /*!
+     * \brief Returns the 1D filter of the layer, see lcn_filter_1d
+     */
+    template <typename W>
+    etl::dyn_matrix<W, 1> filter_1d(double sigma) const {
+        etl::dyn_matrix<W, 1> w(K);
+
+        lcn_filter_1d(w, K, Mid, sigma);
+
+        return w;
+    }
+
     /*!
      * \brief Apply the layer to the batch of input
      * \param output The batch of output
@@ -81,11 +93,9 @@ struct dyn_lcn_layer_impl : transform_layer<dyn_lcn_layer_impl<Desc>> {
 
         using weight_t = etl::value_t<Input>;
 
-        auto w = filter<weight_t>(sigma);
+        auto w = filter_1d<weight_t>(sigma);
 
-        for (size_t b = 0; b < etl::dim<0>(input); ++b) {
-            lcn_compute(output(b), input(b), w, K, Mid);
-        }
+        lcn_compute_batch(output, input, w, K, Mid);
     }
 };
 
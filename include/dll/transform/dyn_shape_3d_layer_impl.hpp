@@ -9,6 +9,8 @@
 
 #include "dll/base_traits.hpp"
 #include "transform_layer.hpp"
+#include "view_context.hpp"
+#include "dll/util/gpu.hpp"
 #include "lcn.hpp"
 
 namespace dll {
@@ -24,6 +26,8 @@ struct dyn_shape_3d_layer_impl : transform_layer<dyn_shape_3d_layer_impl<Desc>>
 
     static constexpr size_t D = 3; ///< The number of dimensions
 
+    static constexpr bool view_layer = true; ///< The output of the layer is its input
+
     using input_one_t  = etl::dyn_matrix<weight, 3>; ///< The preferred type of input
     using output_one_t = etl::dyn_matrix<weight, 3>; ///< The type of output
 
@@ -95,6 +99,15 @@ struct dyn_shape_3d_layer_impl : transform_layer<dyn_shape_3d_layer_impl<Desc>>
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
+        // The output of a view context is already its input
+        if constexpr (etl::all_dma<Input, Output>) {
+            if (output.memory_start() == input.memory_start()) {
+                cpu_access(input);
+                cpu_modified(output);
+                return;
+            }
+        }
+
         output = input;
     }
 
@@ -111,14 +124,25 @@ struct dyn_shape_3d_layer_impl : transform_layer<dyn_shape_3d_layer_impl<Desc>>
     }
 
     /*!
-     * \brief Backpropagate the errors to the previous layers
+     * \brief Backpropagate the errors to the previous layers.
+     *
+     * The errors are given back unchanged, only their shape changes.
+     *
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        cpp_unused(output);
-        cpp_unused(context);
+        // The errors of a bound context are already the errors of the previous layer
+        if constexpr (etl::all_dma<std::decay_t<H>>) {
+            if (output.memory_start() == context.errors.memory_start()) {
+                cpu_access(context.errors);
+                cpu_modified(output);
+                return;
+            }
+        }
+
+        output = context.errors;
     }
 
     /*!
@@ -155,19 +179,13 @@ struct layer_base_traits<dyn_shape_3d_layer_impl<Desc>> {
  * \brief Specialization of sgd_context for dyn_lcn_layer_impl
  */
 template <typename DBN, typename Desc, size_t L>
-struct sgd_context<DBN, dyn_shape_3d_layer_impl<Desc>, L> {
+struct sgd_context<DBN, dyn_shape_3d_layer_impl<Desc>, L> : view_context<typename DBN::weight, 4> {
     using layer_t = dyn_shape_3d_layer_impl<Desc>;
     using weight  = typename DBN::weight; ///< The data type for this layer
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    using inputs_t = etl::dyn_matrix<weight, 4>;
-
-    inputs_t input;  ///< A batch of input
-    inputs_t output; ///< A batch of output
-    inputs_t errors; ///< A batch of errors
-
-    sgd_context(const layer_t& layer) : input(batch_size, layer.C, layer.W, layer.H), output(batch_size, layer.C, layer.W, layer.H), errors(batch_size, layer.C, layer.W, layer.H){}
+    sgd_context(const layer_t& layer) : view_context<weight, 4>(batch_size, layer.C, layer.W, layer.H) {}
 };
 
 } //end of dll namespace
@@ -7,6 +7,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "dll/util/cpu.hpp"
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
 namespace dll {
 
 inline double gaussian(double x, double y, double sigma) {
@@ -26,12 +34,32 @@ void lcn_filter(W& w, size_t K, size_t Mid, double sigma){
 }
 
 /*!
- * \brief Apply the layer to the input
+ * \brief Compute the 1D LCN filter.
+ *
+ * The gaussian is separable, the 2D filter computed by lcn_filter is the
+ * outer product of this filter with itself.
+ */
+template <typename W>
+void lcn_filter_1d(W& w, size_t K, size_t Mid, double sigma){
+    for (size_t i = 0; i < K; ++i) {
+        auto x = double(i) - double(Mid);
+        w[i] = std::exp(-(x * x) / (2.0 * sigma * sigma));
+    }
+
+    w /= etl::sum(w);
+}
+
+/*!
+ * \brief Apply the layer to the input, with the direct 2D filter.
+ *
+ * This is the reference implementation of lcn_compute_batch, it is only
+ * kept for testing.
+ *
  * \param y The output
  * \param x The input to apply the layer to
  */
 template <typename Input, typename Output, typename W>
-void lcn_compute(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
+void lcn_compute_reference(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
     using weight_t = etl::value_t<Input>;
 
     auto v = etl::force_temporary(x(0));
@@ -82,4 +110,128 @@ void lcn_compute(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
     }
 }
 
+namespace lcn_detail {
+
+/*!
+ * \brief Filter a [H x W] image with the separable filter w, zero padded
+ * \param out The output image
+ * \param tmp A temporary image
+ * \param in The input image
+ */
+template <typename T>
+DLL_KERNEL_CLONES void separable_filter(T* out, T* tmp, const T* in, const T* w, size_t K, size_t Mid, size_t H, size_t W) {
+    std::fill(tmp, tmp + H * W, T(0));
+    std::fill(out, out + H * W, T(0));
+
+    // Horizontal pass, only the valid range of each tap is computed
+
+    for (size_t j = 0; j < H; ++j) {
+        const T* in_row = in + j * W;
+        T* tmp_row      = tmp + j * W;
+
+        for (size_t q = 0; q < K; ++q) {
+            const size_t first = q < Mid ? std::min(Mid - q, W) : 0;
+            const size_t last  = q > Mid ? W - std::min(q - Mid, W) : W;
+            const T wq         = w[q];
+
+            for (size_t k = first; k < last; ++k) {
+                tmp_row[k] += wq * in_row[k + q - Mid];
+            }
+        }
+    }
+
+    // Vertical pass, on full rows
+
+    for (size_t j = 0; j < H; ++j) {
+        T* out_row = out + j * W;
+
+        for (size_t p = 0; p < K; ++p) {
+            if (j + p < Mid || j + p - Mid >= H) {
+                continue;
+            }
+
+            const T* tmp_row = tmp + (j + p - Mid) * W;
+            const T wp       = w[p];
+
+            for (size_t k = 0; k < W; ++k) {
+                out_row[k] += wp * tmp_row[k];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Normalize one [H x W] image
+ * \param y The output image (can be the input image)
+ * \param x The input image
+ */
+template <typename T>
+void lcn_image(T* y, const T* x, const T* w, size_t K, size_t Mid, size_t H, size_t W) {
+    const size_t N = H * W;
+
+    thread_local std::vector<T> workspace;
+    workspace.resize(4 * N);
+
+    T* m   = workspace.data();
+    T* o   = m + N;
+    T* sq  = o + N;
+    T* tmp = sq + N;
+
+    //1. Weighted mean of the neighborhood
+    separable_filter(m, tmp, x, w, K, Mid, H, W);
+
+    //2. Weighted norm of the neighborhood
+    for (size_t i = 0; i < N; ++i) {
+        sq[i] = x[i] * x[i];
+    }
+
+    separable_filter(o, tmp, sq, w, K, Mid, H, W);
+
+    T sum(0);
+    for (size_t i = 0; i < N; ++i) {
+        o[i] = std::sqrt(o[i]);
+        sum += o[i];
+    }
+
+    const T cst = sum / N;
+
+    for (size_t i = 0; i < N; ++i) {
+        y[i] = (x[i] - m[i]) / std::max(o[i], cst);
+    }
+}
+
+} //end of namespace lcn_detail
+
+/*!
+ * \brief Apply the layer to a batch of input.
+ *
+ * The filter is separable and applied in two passes on each image, the
+ * images of the batch and their channels are normalized in parallel.
+ *
+ * \param y The batch of output [B x C x H x W]
+ * \param x The batch of input [B x C x H x W]
+ * \param w The 1D filter, see lcn_filter_1d
+ */
+template <typename Input, typename Output, typename W>
+void lcn_compute_batch(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
+    using weight_t = etl::value_t<Input>;
+
+    const size_t B = etl::dim<0>(x);
+    const size_t C = etl::dim<1>(x);
+    const size_t H = etl::dim<2>(x);
+    const size_t N = H * etl::dim<3>(x);
+
+    const weight_t* x_m = x.memory_start();
+    weight_t* y_m       = y.memory_start();
+    const weight_t* w_m = w.memory_start();
+
+    cpu_access(x, w);
+
+    parallel_kernel(0, B * C, [&](size_t i) {
+        lcn_detail::lcn_image(y_m + i * N, x_m + i * N, w_m, K, Mid, H, etl::dim<3>(x));
+    });
+
+    cpu_modified(y);
+}
+
 } //end of dll namespace
@@ -27,6 +27,8 @@ struct normalize_layer_impl : transform_layer<normalize_layer_impl<Desc>> {
     using layer_t     = this_type;                                   ///< This layer's type
     using dyn_layer_t = typename desc::dyn_layer_t;                  ///< The dynamic version of this layer
 
+    static constexpr bool inplace = true; ///< The layer can be computed in place
+
     /*!
      * \brief Returns a string representation of the layer
      */
@@ -26,6 +26,7 @@ struct rectifier_layer_impl : transform_layer<rectifier_layer_impl<Desc>> {
     using dyn_layer_t = typename desc::dyn_layer_t;                  ///< The dynamic version of this layer
 
     static constexpr rectifier_method method = desc::method; ///< The rectifier method
+    static constexpr bool inplace = true; ///< The layer can be computed in place
 
     static_assert(method == rectifier_method::ABS, "Only ABS rectifier has been implemented");
 
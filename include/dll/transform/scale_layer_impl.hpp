@@ -28,6 +28,7 @@ struct scale_layer_impl : transform_layer<scale_layer_impl<Desc>> {
 
     static constexpr int A = desc::A; ///< The scale multiplier
     static constexpr int B = desc::B; ///< The scale divisor
+    static constexpr bool inplace = true; ///< The layer can be computed in place
 
     /*!
      * \brief Returns a string representation of the layer
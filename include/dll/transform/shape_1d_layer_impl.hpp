@@ -9,6 +9,8 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/transform/transform_layer.hpp"
+#include "dll/transform/view_context.hpp"
+#include "dll/util/gpu.hpp"
 
 namespace dll {
 
@@ -27,6 +29,8 @@ struct shape_1d_layer_impl : transform_layer<shape_1d_layer_impl<Desc>> {
     static constexpr size_t Size = desc::S; ///< The input size
     static constexpr size_t D    = 1;       ///< The number of dimensions
 
+    static constexpr bool view_layer = true; ///< The output of the layer is its input
+
     using input_one_t  = etl::fast_dyn_matrix<weight, Size>; ///< The preferred type of input
     using output_one_t = etl::fast_dyn_matrix<weight, Size>; ///< The type of output
 
@@ -83,6 +87,15 @@ struct shape_1d_layer_impl : transform_layer<shape_1d_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
+        // The output of a view context is already its input
+        if constexpr (etl::all_dma<Input, Output>) {
+            if (output.memory_start() == input.memory_start()) {
+                cpu_access(input);
+                cpu_modified(output);
+                return;
+            }
+        }
+
         output = input;
     }
 
@@ -99,14 +112,25 @@ struct shape_1d_layer_impl : transform_layer<shape_1d_layer_impl<Desc>> {
     }
 
     /*!
-     * \brief Backpropagate the errors to the previous layers
+     * \brief Backpropagate the errors to the previous layers.
+     *
+     * The errors are given back unchanged, only their shape changes.
+     *
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        cpp_unused(output);
-        cpp_unused(context);
+        // The errors of a bound context are already the errors of the previous layer
+        if constexpr (etl::all_dma<std::decay_t<H>>) {
+            if (output.memory_start() == context.errors.memory_start()) {
+                cpu_access(context.errors);
+                cpu_modified(output);
+                return;
+            }
+        }
+
+        output = context.errors;
     }
 
     /*!
@@ -148,17 +172,13 @@ struct layer_base_traits<shape_1d_layer_impl<Desc>> {
  * \brief Specialization of sgd_context for shape_layer
  */
 template <typename DBN, typename Desc, size_t L>
-struct sgd_context<DBN, shape_1d_layer_impl<Desc>, L> {
+struct sgd_context<DBN, shape_1d_layer_impl<Desc>, L> : view_context<typename DBN::weight, 2> {
     using layer_t = shape_1d_layer_impl<Desc>;
     using weight  = typename DBN::weight; ///< The data type for this layer
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, layer_t::Size> input;
-    etl::fast_matrix<weight, batch_size, layer_t::Size> output;
-    etl::fast_matrix<weight, batch_size, layer_t::Size> errors;
-
-    sgd_context(const shape_1d_layer_impl<Desc>& /* layer */){}
+    sgd_context(const shape_1d_layer_impl<Desc>& /* layer */) : view_context<weight, 2>(batch_size, layer_t::Size) {}
 };
 
 } //end of dll namespace
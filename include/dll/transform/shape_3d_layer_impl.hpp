@@ -9,6 +9,8 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/transform/transform_layer.hpp"
+#include "dll/transform/view_context.hpp"
+#include "dll/util/gpu.hpp"
 
 namespace dll {
 
@@ -29,6 +31,8 @@ struct shape_3d_layer_impl : transform_layer<shape_3d_layer_impl<Desc>> {
     static constexpr size_t W = desc::W; ///< The height of the input
     static constexpr size_t H = desc::H; ///< The width of the input
 
+    static constexpr bool view_layer = true; ///< The output of the layer is its input
+
     using input_one_t  = etl::fast_dyn_matrix<weight, C, W, H>; ///< The preferred type of input
     using output_one_t = etl::fast_dyn_matrix<weight, C, W, H>; ///< The type of output
 
@@ -85,6 +89,15 @@ struct shape_3d_layer_impl : transform_layer<shape_3d_layer_impl<Desc>> {
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
+        // The output of a view context is already its input
+        if constexpr (etl::all_dma<Input, Output>) {
+            if (output.memory_start() == input.memory_start()) {
+                cpu_access(input);
+                cpu_modified(output);
+                return;
+            }
+        }
+
         output = input;
     }
 
@@ -101,14 +114,25 @@ struct shape_3d_layer_impl : transform_layer<shape_3d_layer_impl<Desc>> {
     }
 
     /*!
-     * \brief Backpropagate the errors to the previous layers
+     * \brief Backpropagate the errors to the previous layers.
+     *
+     * The errors are given back unchanged, only their shape changes.
+     *
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        cpp_unused(output);
-        cpp_unused(context);
+        // The errors of a bound context are already the errors of the previous layer
+        if constexpr (etl::all_dma<std::decay_t<H>>) {
+            if (output.memory_start() == context.errors.memory_start()) {
+                cpu_access(context.errors);
+                cpu_modified(output);
+                return;
+            }
+        }
+
+        output = context.errors;
     }
 
     /*!
@@ -156,17 +180,13 @@ struct layer_base_traits<shape_3d_layer_impl<Desc>> {
  * \brief Specialization of sgd_context for lcn_layer_impl
  */
 template <typename DBN, typename Desc, size_t L>
-struct sgd_context<DBN, shape_3d_layer_impl<Desc>, L> {
+struct sgd_context<DBN, shape_3d_layer_impl<Desc>, L> : view_context<typename DBN::weight, 4> {
     using layer_t = shape_3d_layer_impl<Desc>;
     using weight  = typename DBN::weight; ///< The data type for this layer
 
     static constexpr auto batch_size = DBN::batch_size;
 
-    etl::fast_matrix<weight, batch_size, layer_t::C, layer_t::H, layer_t::W> input;
-    etl::fast_matrix<weight, batch_size, layer_t::C, layer_t::H, layer_t::W> output;
-    etl::fast_matrix<weight, batch_size, layer_t::C, layer_t::H, layer_t::W> errors;
-
-    sgd_context(const shape_3d_layer_impl<Desc>& /* layer */){}
+    sgd_context(const shape_3d_layer_impl<Desc>& /* layer */) : view_context<weight, 4>(batch_size, layer_t::C, layer_t::H, layer_t::W) {}
 };
 
 } //end of dll namespace
@@ -0,0 +1,93 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Training context of the view layers
+ */
+
+#pragma once
+
+#include <array>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief The training context of a view layer.
+ *
+ * The output of a view layer is its input and its errors are the errors of
+ * its input. Once the context is bound to the output and the errors of the
+ * previous layer, its buffers are views over them and nothing is ever
+ * copied. A context that is not bound (the first layer of the network or a
+ * layer inside a group or a merge) holds its own memory.
+ *
+ * \tparam T The type of the values
+ * \tparam D The number of dimensions of the buffers (with the batch)
+ */
+template <typename T, size_t D>
+struct view_context {
+    using buffer_t = etl::custom_dyn_matrix<T, D>; ///< The type of the buffers
+
+    std::array<size_t, D> dims; ///< The dimensions of the buffers
+    std::vector<T> storage;     ///< The memory of the context, while it is not bound
+
+    buffer_t input;  ///< A batch of input
+    buffer_t output; ///< A batch of output, the memory of the input
+    buffer_t errors; ///< A batch of errors
+
+    /*!
+     * \brief Create a context owning buffers of the given dimensions
+     */
+    template <typename... S>
+    explicit view_context(S... sizes)
+            : dims{{size_t(sizes)...}},
+              storage(2 * (size_t(sizes) * ...)),
+              input(storage.data(), size_t(sizes)...),
+              output(storage.data(), size_t(sizes)...),
+              errors(storage.data() + storage.size() / 2, size_t(sizes)...) {}
+
+    view_context(const view_context& rhs) = delete;
+    view_context& operator=(const view_context& rhs) = delete;
+
+    /*!
+     * \brief Indicates if the buffers are views over the previous layer
+     */
+    bool bound() const {
+        return storage.empty();
+    }
+
+    /*!
+     * \brief Point the buffers to the output and the errors of the
+     * previous layer, the own memory of the context is released.
+     *
+     * \param input_memory The memory of the output of the previous layer
+     * \param errors_memory The memory of the errors of the previous layer
+     */
+    void bind(T* input_memory, T* errors_memory) {
+        rebind(input, input_memory, std::make_index_sequence<D>());
+        rebind(output, input_memory, std::make_index_sequence<D>());
+        rebind(errors, errors_memory, std::make_index_sequence<D>());
+
+        storage = std::vector<T>();
+    }
+
+private:
+    /*!
+     * \brief Point the given buffer to another memory. A custom matrix
+     * cannot change its memory, it is built again in place.
+     */
+    template <size_t... I>
+    void rebind(buffer_t& buffer, T* memory, std::index_sequence<I...> /*seq*/) {
+        buffer.~buffer_t();
+        new (&buffer) buffer_t(memory, dims[I]...);
+    }
+};
+
+} //end of dll namespace
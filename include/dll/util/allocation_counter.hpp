@@ -0,0 +1,160 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Opt-in counter of the heap allocations, to check that the steady
+ * state of the training does not allocate.
+ *
+ * The counter is only active in a program that replaces the global
+ * operator new with DLL_DEFINE_ALLOCATION_COUNTER, in exactly one
+ * translation unit. Otherwise, the counted allocations are always zero.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace dll {
+
+namespace allocation_detail {
+
+/*!
+ * \brief Returns the number of allocations counted so far
+ */
+inline std::atomic<size_t>& allocations() {
+    static std::atomic<size_t> count(0);
+    return count;
+}
+
+/*!
+ * \brief Returns the number of counters currently alive
+ */
+inline std::atomic<size_t>& counters() {
+    static std::atomic<size_t> count(0);
+    return count;
+}
+
+/*!
+ * \brief Count one allocation, if a counter is alive
+ */
+inline void count_allocation() {
+    if (counters().load(std::memory_order_relaxed)) {
+        allocations().fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/*!
+ * \brief Allocate size bytes with the given alignment (0 for the default
+ * alignment), nullptr on failure
+ */
+inline void* allocate(size_t size, size_t alignment) {
+    count_allocation();
+
+    if (!size) {
+        size = 1;
+    }
+
+    if (alignment > alignof(std::max_align_t)) {
+        return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    }
+
+    return std::malloc(size);
+}
+
+} //end of namespace allocation_detail
+
+/*!
+ * \brief Count the heap allocations of all the threads while it is alive.
+ *
+ * Only the allocations done with the global operator new are counted, and
+ * only when DLL_DEFINE_ALLOCATION_COUNTER is used by the program.
+ */
+struct allocation_counter {
+    allocation_counter() : first(allocation_detail::allocations().load()) {
+        allocation_detail::counters()++;
+    }
+
+    allocation_counter(const allocation_counter& rhs) = delete;
+    allocation_counter& operator=(const allocation_counter& rhs) = delete;
+
+    ~allocation_counter() {
+        allocation_detail::counters()--;
+    }
+
+    /*!
+     * \brief Returns the number of allocations since the creation of the
+     * counter
+     */
+    size_t count() const {
+        return allocation_detail::allocations().load() - first;
+    }
+
+private:
+    size_t first; ///< The number of allocations at the creation of the counter
+};
+
+} //end of dll namespace
+
+/*!
+ * \brief Replace the global operator new and delete with versions counting
+ * the allocations for dll::allocation_counter.
+ *
+ * This must be used at most once in a program, at global scope.
+ */
+#define DLL_DEFINE_ALLOCATION_COUNTER                                                                             \
+    void* operator new(std::size_t size) {                                                                        \
+        if (void* p = dll::allocation_detail::allocate(size, 0)) {                                                \
+            return p;                                                                                             \
+        }                                                                                                         \
+        throw std::bad_alloc();                                                                                   \
+    }                                                                                                             \
+    void* operator new[](std::size_t size) {                                                                      \
+        return ::operator new(size);                                                                              \
+    }                                                                                                             \
+    void* operator new(std::size_t size, std::align_val_t alignment) {                                            \
+        if (void* p = dll::allocation_detail::allocate(size, static_cast<std::size_t>(alignment))) {              \
+            return p;                                                                                             \
+        }                                                                                                         \
+        throw std::bad_alloc();                                                                                   \
+    }                                                                                                             \
+    void* operator new[](std::size_t size, std::align_val_t alignment) {                                          \
+        return ::operator new(size, alignment);                                                                   \
+    }                                                                                                             \
+    void* operator new(std::size_t size, const std::nothrow_t&) noexcept {                                        \
+        return dll::allocation_detail::allocate(size, 0);                                                         \
+    }                                                                                                             \
+    void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {                                      \
+        return dll::allocation_detail::allocate(size, 0);                                                         \
+    }                                                                                                             \
+    void operator delete(void* p) noexcept {                                                                      \
+        std::free(p);                                                                                             \
+    }                                                                                                             \
+    void operator delete[](void* p) noexcept {                                                                    \
+        std::free(p);                                                                                             \
+    }                                                                                                             \
+    void operator delete(void* p, std::size_t) noexcept {                                                         \
+        std::free(p);                                                                                             \
+    }                                                                                                             \
+    void operator delete[](void* p, std::size_t) noexcept {                                                       \
+        std::free(p);                                                                                             \
+    }                                                                                                             \
+    void operator delete(void* p, std::align_val_t) noexcept {                                                    \
+        std::free(p);                                                                                             \
+    }                                                                                                             \
+    void operator delete[](void* p, std::align_val_t) noexcept {                                                  \
+        std::free(p);                                                                                             \
+    }                                                                                                             \
+    void operator delete(void* p, std::size_t, std::align_val_t) noexcept {                                       \
+        std::free(p);                                                                                             \
+    }                                                                                                             \
+    void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {                                     \
+        std::free(p);                                                                                             \
+    }
@@ -0,0 +1,214 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Arena allocator for the training state
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief A bump allocator for the training state of a network.
+ *
+ * The memory is allocated in 64-byte aligned chunks. The first chunk is
+ * sized by reserve() so that the training state of a network is laid out
+ * in one contiguous block. Once every allocation has been released, the
+ * arena is rewound and the same block is reused by the next trainer.
+ */
+struct training_arena {
+    static constexpr size_t alignment = 64; ///< The alignment of every allocation
+
+private:
+    /*!
+     * \brief A chunk of memory of the arena
+     */
+    struct chunk {
+        char* memory;    ///< The start of the chunk
+        size_t capacity; ///< The size of the chunk, in bytes
+    };
+
+    std::mutex lock;           ///< The lock protecting the arena
+    std::vector<chunk> chunks; ///< The chunks, the first one is the main block
+    size_t current = 0;        ///< The index of the chunk used for bump allocation
+    size_t offset  = 0;        ///< The offset in the current chunk
+    size_t live    = 0;        ///< The number of live allocations
+    size_t used    = 0;        ///< The number of bytes currently allocated
+    size_t peak    = 0;        ///< The maximum number of bytes allocated at once
+    size_t reuses  = 0;        ///< The number of times the arena was rewound
+
+    static size_t align(size_t n) {
+        return (n + alignment - 1) & ~(alignment - 1);
+    }
+
+    static chunk allocate_chunk(size_t capacity) {
+        auto* memory = static_cast<char*>(std::aligned_alloc(alignment, align(capacity)));
+
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+
+        return {memory, align(capacity)};
+    }
+
+public:
+    training_arena() = default;
+
+    training_arena(const training_arena& rhs) = delete;
+    training_arena& operator=(const training_arena& rhs) = delete;
+
+    ~training_arena() {
+        for (auto& c : chunks) {
+            std::free(c.memory);
+        }
+    }
+
+    /*!
+     * \brief Make sure the main block can hold at least the given number
+     * of bytes.
+     *
+     * This has no effect while allocations are still live.
+     */
+    void reserve(size_t bytes) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (live || (chunks.size() == 1 && chunks.front().capacity >= bytes)) {
+            return;
+        }
+
+        // Merge all the chunks in a single block big enough for everything
+        size_t capacity = bytes;
+        for (auto& c : chunks) {
+            capacity = std::max(capacity, c.capacity);
+            std::free(c.memory);
+        }
+
+        chunks.clear();
+        chunks.push_back(allocate_chunk(capacity));
+
+        current = 0;
+        offset  = 0;
+    }
+
+    /*!
+     * \brief Allocate the given number of bytes from the arena
+     */
+    void* allocate(size_t bytes) {
+        std::lock_guard<std::mutex> l(lock);
+
+        bytes = align(bytes);
+
+        while (chunks.empty() || offset + bytes > chunks[current].capacity) {
+            if (!chunks.empty() && current + 1 < chunks.size()) {
+                ++current;
+            } else {
+                auto last = chunks.empty() ? size_t(0) : chunks.back().capacity;
+                chunks.push_back(allocate_chunk(std::max(bytes, last)));
+                current = chunks.size() - 1;
+            }
+
+            offset = 0;
+        }
+
+        void* memory = chunks[current].memory + offset;
+
+        offset += bytes;
+        used += bytes;
+        peak = std::max(peak, used);
+        ++live;
+
+        return memory;
+    }
+
+    /*!
+     * \brief Release an allocation of the given number of bytes.
+     *
+     * The memory is only given back once every allocation is released.
+     */
+    void deallocate(void* /*memory*/, size_t bytes) {
+        std::lock_guard<std::mutex> l(lock);
+
+        used -= align(bytes);
+
+        if (--live == 0) {
+            current = 0;
+            offset  = 0;
+            ++reuses;
+        }
+    }
+
+    /*!
+     * \brief Returns the number of bytes reserved by the arena
+     */
+    size_t footprint() const {
+        size_t bytes = 0;
+        for (auto& c : chunks) {
+            bytes += c.capacity;
+        }
+        return bytes;
+    }
+
+    /*!
+     * \brief Returns the maximum number of bytes allocated at once
+     */
+    size_t peak_usage() const {
+        return peak;
+    }
+
+    /*!
+     * \brief Display the footprint of the arena on the given stream
+     */
+    void display(std::ostream& os) const {
+        os << "Training arena: " << footprint() / 1024 << "KiB in " << chunks.size() << " block(s), "
+           << "peak " << peak / 1024 << "KiB, reused " << reuses << " time(s)" << std::endl;
+    }
+};
+
+/*!
+ * \brief A standard allocator allocating from a training_arena
+ */
+template <typename T>
+struct arena_allocator {
+    using value_type = T; ///< The type of the allocated values
+
+    training_arena* arena; ///< The arena to allocate from
+
+    explicit arena_allocator(training_arena& arena) : arena(&arena) {}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& rhs) : arena(rhs.arena) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* memory, size_t n) {
+        arena->deallocate(memory, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U>& rhs) const {
+        return arena == rhs.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const arena_allocator<U>& rhs) const {
+        return arena != rhs.arena;
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,135 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Logger writing lines to a stream from a background thread
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace dll {
+
+/*!
+ * \brief A logger writing its lines to a stream from a background thread.
+ *
+ * The caller only moves the line into a queue, the formatting of the
+ * stream, the writes and the flushes are done by the logging thread, which
+ * flushes the stream once per burst of lines. The thread is only started at
+ * the first line.
+ */
+struct async_logger {
+    /*!
+     * \brief Create a new logger
+     * \param os The stream to write the lines to
+     */
+    explicit async_logger(std::ostream& os = std::cout) : os(os) {}
+
+    async_logger(const async_logger& rhs) = delete;
+    async_logger& operator=(const async_logger& rhs) = delete;
+
+    /*!
+     * \brief Write the remaining lines and stop the logging thread
+     */
+    ~async_logger() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                running = false;
+            }
+
+            ready.notify_all();
+
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Queue a line to be written, without its end of line
+     * \param line The line to write
+     */
+    void log(std::string line) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            if (!thread.joinable()) {
+                running = true;
+                thread  = std::thread([this] { run(); });
+            }
+
+            lines.push_back(std::move(line));
+        }
+
+        ready.notify_all();
+    }
+
+    /*!
+     * \brief Wait until all the queued lines have been written and flushed
+     */
+    void flush() {
+        std::unique_lock<std::mutex> ulock(lock);
+
+        written.wait(ulock, [this] { return lines.empty() && !writing; });
+    }
+
+private:
+    /*!
+     * \brief The loop of the logging thread
+     */
+    void run() {
+        std::deque<std::string> burst;
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        while (true) {
+            ready.wait(ulock, [this] { return !running || !lines.empty(); });
+
+            if (lines.empty()) {
+                break;
+            }
+
+            burst.swap(lines);
+            writing = true;
+
+            ulock.unlock();
+
+            for (auto& line : burst) {
+                os << line << '\n';
+            }
+
+            os.flush();
+            burst.clear();
+
+            ulock.lock();
+
+            writing = false;
+
+            written.notify_all();
+        }
+    }
+
+    std::ostream& os;   ///< The output stream
+    std::thread thread; ///< The logging thread
+
+    std::mutex lock;                 ///< The lock protecting the queue
+    std::condition_variable ready;   ///< Signals new lines or the end of the logger
+    std::condition_variable written; ///< Signals that a burst of lines has been written
+
+    std::deque<std::string> lines; ///< The queued lines
+    bool running = false;          ///< Indicates if the logging thread is running
+    bool writing = false;          ///< Indicates if the logging thread is writing a burst
+};
+
+} //end of dll namespace
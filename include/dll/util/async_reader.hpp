@@ -0,0 +1,559 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Asynchronous reads of ranges of a file into a set of buffers.
+ *
+ * On Linux, the reads are done with io_uring, into buffers registered with
+ * the kernel when possible. When io_uring is not available (older kernels,
+ * sandboxes, or other systems), the reads are done by a few threads.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "cpp_utils/assert.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#ifdef __NR_io_uring_setup
+#define DLL_IO_URING
+#endif
+#endif
+
+namespace dll {
+
+/*!
+ * \brief Reads ranges of a file asynchronously into a fixed set of slots.
+ *
+ * Each slot is an aligned buffer receiving one read at a time. The reads
+ * are extended to aligned offsets and lengths, the data of a read is at an
+ * offset of its slot. A slot must be waited for before being reused.
+ */
+struct async_reader {
+    static constexpr size_t alignment = 4096; ///< The alignment of the reads and of the buffers
+
+    /*!
+     * \brief Open the given file for reading into the given number of slots
+     * \param path The path of the file
+     * \param slots The number of slots
+     * \param slot_size The maximum number of bytes of a read
+     * \param threads The number of threads of the fallback
+     * \param use_uring Indicates if io_uring can be used
+     */
+    async_reader(const std::string& path, size_t slots, size_t slot_size, size_t threads = 2, bool use_uring = true) {
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0) {
+            file_size = st.st_size;
+        }
+
+        // One more aligned block for the alignment of the start of the reads
+        capacity = align_up(slot_size) + alignment;
+
+        state.resize(slots);
+
+        for (auto& s : state) {
+            void* memory = nullptr;
+
+            if (::posix_memalign(&memory, alignment, capacity)) {
+                close();
+                return;
+            }
+
+            s.buffer = static_cast<char*>(memory);
+        }
+
+#ifdef DLL_IO_URING
+        uring = use_uring && init_uring();
+#else
+        cpp_unused(use_uring);
+#endif
+
+        if (!uring) {
+            for (size_t t = 0; t < std::max(threads, size_t(1)); ++t) {
+                workers.emplace_back([this] { work(); });
+            }
+        }
+    }
+
+    async_reader(const async_reader& rhs) = delete;
+    async_reader& operator=(const async_reader& rhs) = delete;
+
+    /*!
+     * \brief Wait for the reads in progress and release the resources
+     */
+    ~async_reader() {
+        close();
+    }
+
+    /*!
+     * \brief Indicates if the file could be opened
+     */
+    bool valid() const {
+        return fd >= 0;
+    }
+
+    /*!
+     * \brief Indicates if the reads are done with io_uring
+     */
+    bool uses_uring() const {
+        return uring;
+    }
+
+    /*!
+     * \brief Returns the name of the backend of the reads
+     */
+    const char* backend() const {
+        return uring ? (registered ? "io_uring (registered buffers)" : "io_uring") : "threads";
+    }
+
+    /*!
+     * \brief Read n bytes at the given offset of the file into the given
+     * slot, asynchronously.
+     *
+     * The slot must not have a read in progress.
+     *
+     * \param slot The slot receiving the read
+     * \param offset The offset of the first byte
+     * \param n The number of bytes to read (at most the size of a slot)
+     */
+    void submit(size_t slot, size_t offset, size_t n) {
+        auto& s = state[slot];
+
+        cpp_assert(!s.pending, "The slot already has a read in progress");
+        cpp_assert(n + alignment <= capacity, "The read is too large for the slot");
+
+        const size_t start = offset / alignment * alignment;
+
+        s.skip      = offset - start;
+        s.offset    = start;
+        s.length    = std::min(align_up(s.skip + n), file_size > start ? file_size - start : 0);
+        s.requested = n;
+        s.done      = 0;
+        s.failed    = false;
+        s.pending   = true;
+
+#ifdef DLL_IO_URING
+        if (uring) {
+            submit_uring(slot);
+            return;
+        }
+#endif
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            queue.push_back(slot);
+        }
+
+        ready.notify_one();
+    }
+
+    /*!
+     * \brief Wait for the read of the given slot
+     * \param slot The slot to wait for
+     * \return A pointer to the bytes of the read, or nullptr if the read
+     * failed
+     */
+    const char* wait(size_t slot) {
+        auto& s = state[slot];
+
+#ifdef DLL_IO_URING
+        if (uring) {
+            while (s.pending) {
+                reap_uring();
+            }
+        }
+#endif
+
+        if (!uring) {
+            std::unique_lock<std::mutex> l(lock);
+            finished.wait(l, [&s] { return !s.pending; });
+        }
+
+        if (s.failed || s.done < s.skip + s.requested) {
+            return nullptr;
+        }
+
+        return s.buffer + s.skip;
+    }
+
+    /*!
+     * \brief Wait for all the reads in progress
+     */
+    void drain() {
+        for (size_t slot = 0; slot < state.size(); ++slot) {
+            if (is_pending(slot)) {
+                wait(slot);
+            }
+        }
+    }
+
+private:
+    /*!
+     * \brief The state of one slot
+     */
+    struct slot_state {
+        char* buffer     = nullptr; ///< The aligned buffer of the slot
+        size_t offset    = 0;       ///< The aligned offset of the read
+        size_t length    = 0;       ///< The aligned length of the read
+        size_t skip      = 0;       ///< The offset of the requested data in the buffer
+        size_t requested = 0;       ///< The number of requested bytes
+        size_t done      = 0;       ///< The number of bytes already read
+        bool pending     = false;   ///< Indicates if a read is in progress
+        bool failed      = false;   ///< Indicates if the read failed
+    };
+
+    /*!
+     * \brief Round up to the alignment
+     */
+    static size_t align_up(size_t n) {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    /*!
+     * \brief Indicates if the given slot has a read in progress
+     */
+    bool is_pending(size_t slot) {
+        if (uring) {
+            return state[slot].pending;
+        }
+
+        std::lock_guard<std::mutex> l(lock);
+        return state[slot].pending;
+    }
+
+    /*!
+     * \brief Read the slot with blocking reads (fallback)
+     */
+    void read_slot(slot_state& s) {
+        while (s.done < s.length) {
+            const ssize_t r = ::pread(fd, s.buffer + s.done, s.length - s.done, s.offset + s.done);
+
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (r <= 0) {
+                s.failed = r < 0;
+                break;
+            }
+
+            s.done += r;
+        }
+    }
+
+    /*!
+     * \brief The loop of a thread of the fallback
+     */
+    void work() {
+        while (true) {
+            size_t slot;
+
+            {
+                std::unique_lock<std::mutex> l(lock);
+                ready.wait(l, [this] { return stop || !queue.empty(); });
+
+                if (queue.empty()) {
+                    return;
+                }
+
+                slot = queue.front();
+                queue.pop_front();
+            }
+
+            read_slot(state[slot]);
+
+            {
+                std::lock_guard<std::mutex> l(lock);
+                state[slot].pending = false;
+            }
+
+            finished.notify_all();
+        }
+    }
+
+#ifdef DLL_IO_URING
+    /*!
+     * \brief Create the ring and register the buffers of the slots
+     * \return true if io_uring can be used, false otherwise
+     */
+    bool init_uring() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        ring_fd = ::syscall(__NR_io_uring_setup, unsigned(std::max(state.size(), size_t(2))), &params);
+
+        if (ring_fd < 0) {
+            return false;
+        }
+
+        sq_length  = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_length  = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqe_length = params.sq_entries * sizeof(io_uring_sqe);
+
+        const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+
+        if (single) {
+            sq_length = cq_length = std::max(sq_length, cq_length);
+        }
+
+        sq_ring = ::mmap(nullptr, sq_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        cq_ring = single ? sq_ring : ::mmap(nullptr, cq_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        sqes_memory = ::mmap(nullptr, sqe_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+
+        if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes_memory == MAP_FAILED) {
+            close_uring();
+            return false;
+        }
+
+        auto* sq = static_cast<char*>(sq_ring);
+        auto* cq = static_cast<char*>(cq_ring);
+
+        sq_tail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask  = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes     = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        sqes     = static_cast<io_uring_sqe*>(sqes_memory);
+
+        iovecs.resize(state.size());
+
+        for (size_t slot = 0; slot < state.size(); ++slot) {
+            iovecs[slot].iov_base = state[slot].buffer;
+            iovecs[slot].iov_len  = capacity;
+        }
+
+        // The registration can fail because of the limit of locked memory
+        registered = ::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, iovecs.data(), unsigned(iovecs.size())) == 0;
+
+        return true;
+    }
+
+    /*!
+     * \brief Submit the remaining part of the read of the slot to the ring
+     */
+    void submit_uring(size_t slot) {
+        auto& s = state[slot];
+
+        if (s.done >= s.length) {
+            s.pending = false;
+            return;
+        }
+
+        const unsigned tail  = *sq_tail;
+        const unsigned index = tail & *sq_mask;
+
+        auto& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+
+        sqe.fd        = fd;
+        sqe.off       = s.offset + s.done;
+        sqe.user_data = slot;
+
+        if (registered) {
+            sqe.opcode    = IORING_OP_READ_FIXED;
+            sqe.addr      = reinterpret_cast<uint64_t>(s.buffer + s.done);
+            sqe.len       = unsigned(s.length - s.done);
+            sqe.buf_index = uint16_t(slot);
+        } else {
+            iovecs[slot].iov_base = s.buffer + s.done;
+            iovecs[slot].iov_len  = s.length - s.done;
+
+            sqe.opcode = IORING_OP_READV;
+            sqe.addr   = reinterpret_cast<uint64_t>(&iovecs[slot]);
+            sqe.len    = 1;
+        }
+
+        sq_array[index] = index;
+
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        ++unsubmitted;
+
+        enter(0, 0);
+    }
+
+    /*!
+     * \brief Submit the new entries to the ring and wait for the given
+     * number of completions
+     */
+    void enter(unsigned completions, unsigned flags) {
+        const long submitted = ::syscall(__NR_io_uring_enter, ring_fd, unsubmitted, completions, flags, nullptr, 0);
+
+        // The entries not consumed are submitted again by the next call
+        if (submitted > 0) {
+            unsubmitted -= unsigned(submitted);
+        }
+    }
+
+    /*!
+     * \brief Wait for at least one completion and process the completions
+     */
+    void reap_uring() {
+        unsigned head = *cq_head;
+
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            enter(1, IORING_ENTER_GETEVENTS);
+            return;
+        }
+
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            const auto& cqe = cqes[head & *cq_mask];
+
+            auto& s = state[cqe.user_data];
+
+            if (cqe.res < 0) {
+                s.failed  = true;
+                s.pending = false;
+            } else if (cqe.res == 0) {
+                // End of file
+                s.pending = false;
+            } else {
+                s.done += cqe.res;
+
+                // Short reads are continued
+                if (s.done < s.length) {
+                    submit_uring(cqe.user_data);
+                } else {
+                    s.pending = false;
+                }
+            }
+
+            ++head;
+        }
+
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    /*!
+     * \brief Release the ring
+     */
+    void close_uring() {
+        if (sqes_memory && sqes_memory != MAP_FAILED) {
+            ::munmap(sqes_memory, sqe_length);
+        }
+
+        if (cq_ring && cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+            ::munmap(cq_ring, cq_length);
+        }
+
+        if (sq_ring && sq_ring != MAP_FAILED) {
+            ::munmap(sq_ring, sq_length);
+        }
+
+        sq_ring = cq_ring = sqes_memory = nullptr;
+
+        if (ring_fd >= 0) {
+            ::close(ring_fd);
+            ring_fd = -1;
+        }
+    }
+#endif
+
+    /*!
+     * \brief Wait for the reads in progress and release everything
+     */
+    void close() {
+        if (fd >= 0) {
+            drain();
+        }
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
+
+        ready.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        workers.clear();
+
+#ifdef DLL_IO_URING
+        close_uring();
+#endif
+
+        for (auto& s : state) {
+            std::free(s.buffer);
+            s.buffer = nullptr;
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    int fd           = -1;    ///< The file descriptor of the file
+    size_t file_size = 0;     ///< The size of the file
+    size_t capacity  = 0;     ///< The size of the buffer of a slot
+    bool uring       = false; ///< Indicates if io_uring is used
+    bool registered  = false; ///< Indicates if the buffers are registered
+
+    std::vector<slot_state> state; ///< The state of each slot
+    std::vector<iovec> iovecs;     ///< The buffers of the slots, for the ring
+
+    // The fallback
+
+    std::mutex lock;                  ///< The lock protecting the queue and the slots
+    std::condition_variable ready;    ///< Signals a new read or the stop
+    std::condition_variable finished; ///< Signals the end of a read
+    std::deque<size_t> queue;         ///< The slots waiting to be read
+    std::vector<std::thread> workers; ///< The threads of the fallback
+    bool stop = false;                ///< Indicates to the threads to stop
+
+#ifdef DLL_IO_URING
+    // The ring
+
+    int ring_fd          = -1;      ///< The file descriptor of the ring
+    unsigned unsubmitted = 0;       ///< The number of entries not yet consumed by the kernel
+    void* sq_ring        = nullptr; ///< The mapping of the submission ring
+    void* cq_ring        = nullptr; ///< The mapping of the completion ring
+    void* sqes_memory    = nullptr; ///< The mapping of the submission entries
+    size_t sq_length     = 0;       ///< The length of the submission ring
+    size_t cq_length     = 0;       ///< The length of the completion ring
+    size_t sqe_length    = 0;       ///< The length of the submission entries
+    unsigned* sq_tail    = nullptr; ///< The tail of the submission ring
+    unsigned* sq_mask    = nullptr; ///< The mask of the submission ring
+    unsigned* sq_array   = nullptr; ///< The indices of the submission ring
+    unsigned* cq_head    = nullptr; ///< The head of the completion ring
+    unsigned* cq_tail    = nullptr; ///< The tail of the completion ring
+    unsigned* cq_mask    = nullptr; ///< The mask of the completion ring
+    io_uring_cqe* cqes   = nullptr; ///< The completion entries
+    io_uring_sqe* sqes   = nullptr; ///< The submission entries
+#endif
+};
+
+} //end of dll namespace
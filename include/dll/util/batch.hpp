@@ -8,9 +8,12 @@
 #pragma once
 
 #include <iterator>
+#include <utility>
 
 #include "cpp_utils/assert.hpp"
 
+#include "etl/etl.hpp"
+
 namespace dll {
 
 /*!
@@ -68,4 +71,38 @@ batch<Iterator> make_batch(Iterator&& first, Iterator&& last) {
     return {std::forward<Iterator>(first), std::forward<Iterator>(last)};
 }
 
+/*!
+ * \brief The type of a copy of a batch of a generator
+ */
+template <typename Batch>
+using batch_copy_t = etl::dyn_matrix<etl::value_t<std::decay_t<Batch>>, etl::dimensions<std::decay_t<Batch>>()>;
+
+namespace batch_detail {
+
+template <typename Buffer, typename Batch, size_t... I>
+void resize_batch(Buffer& buffer, const Batch& batch, std::index_sequence<I...> /*seq*/) {
+    buffer = Buffer(etl::dim<I>(batch)...);
+}
+
+} //end of namespace batch_detail
+
+/*!
+ * \brief Copy a batch of a generator into the given buffer, resizing the
+ * buffer if necessary.
+ *
+ * This is used by the trainers whose workers train their batches while the
+ * generator moves on.
+ *
+ * \param buffer The destination buffer
+ * \param batch The batch to copy
+ */
+template <typename Buffer, typename Batch>
+void copy_batch(Buffer& buffer, const Batch& batch) {
+    if (etl::size(buffer) != etl::size(batch) || etl::dim<0>(buffer) != etl::dim<0>(batch)) {
+        batch_detail::resize_batch(buffer, batch, std::make_index_sequence<etl::dimensions<Batch>()>());
+    }
+
+    buffer = batch;
+}
+
 } //end of dll namespace
@@ -0,0 +1,121 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Strided merge and dispatch of batches, for the merge layers.
+ *
+ * The slice of one branch inside the merged batch is a sequence of
+ * contiguous blocks, one for each index of the dimensions before the merge
+ * dimension. Each block is copied directly from the memory of the branch
+ * to its offset in the merged batch, the branches can have different sizes
+ * at the merge dimension.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+
+namespace dll {
+
+namespace merge_detail {
+
+/*!
+ * \brief Returns the number of blocks of the slice of a branch, the product
+ * of the dimensions before D
+ */
+template <size_t D, typename E>
+size_t outer_size(const E& e) {
+    size_t s = 1;
+
+    for (size_t d = 0; d < D; ++d) {
+        s *= etl::dim(e, d);
+    }
+
+    return s;
+}
+
+/*!
+ * \brief Returns the product of the dimensions after D
+ */
+template <size_t D, typename E>
+size_t inner_size(const E& e) {
+    size_t s = 1;
+
+    for (size_t d = D + 1; d < etl::dimensions(e); ++d) {
+        s *= etl::dim(e, d);
+    }
+
+    return s;
+}
+
+} //end of namespace merge_detail
+
+/*!
+ * \brief Copy the given batch of one branch into its slice of the merged
+ * batch.
+ *
+ * \param merged The merged batch
+ * \param sub The batch of the branch
+ * \param offset The first index of the branch at the dimension D of the merged batch
+ *
+ * \tparam D The merge dimension, in the batch (1 is the first dimension of a sample)
+ */
+template <size_t D, typename M, typename S>
+void batch_merge_at(M&& merged, const S& sub, size_t offset) {
+    const size_t outer  = merge_detail::outer_size<D>(sub);
+    const size_t inner  = merge_detail::inner_size<D>(sub);
+    const size_t block  = etl::dim(sub, D) * inner;
+    const size_t stride = etl::dim(merged, D) * inner;
+
+    // Only a part of the merged batch is written
+    cpu_access(merged, sub);
+
+    auto* out      = merged.memory_start() + offset * inner;
+    const auto* in = sub.memory_start();
+
+    for (size_t o = 0; o < outer; ++o) {
+        std::copy(in + o * block, in + (o + 1) * block, out + o * stride);
+    }
+
+    cpu_modified(merged);
+}
+
+/*!
+ * \brief Copy the slice of one branch of the merged batch into the batch of
+ * the branch. This is the inverse of batch_merge_at.
+ *
+ * \param sub The batch of the branch
+ * \param merged The merged batch
+ * \param offset The first index of the branch at the dimension D of the merged batch
+ *
+ * \tparam D The merge dimension, in the batch (1 is the first dimension of a sample)
+ */
+template <size_t D, typename S, typename M>
+void batch_dispatch_at(S&& sub, const M& merged, size_t offset) {
+    const size_t outer  = merge_detail::outer_size<D>(sub);
+    const size_t inner  = merge_detail::inner_size<D>(sub);
+    const size_t block  = etl::dim(sub, D) * inner;
+    const size_t stride = etl::dim(merged, D) * inner;
+
+    cpu_access(merged);
+
+    auto* out      = sub.memory_start();
+    const auto* in = merged.memory_start() + offset * inner;
+
+    for (size_t o = 0; o < outer; ++o) {
+        std::copy(in + o * stride, in + o * stride + block, out + o * block);
+    }
+
+    cpu_modified(sub);
+}
+
+} //end of dll namespace
@@ -0,0 +1,244 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernels for the batch normalization layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+#include "dll/function.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the number of features handled by one task of the batch
+ * normalization kernels.
+ *
+ * When each feature is a single value (dense inputs), the features are
+ * processed by blocks, so that each sample is read contiguously.
+ */
+inline size_t batch_norm_block(size_t SP) {
+    return SP == 1 ? 64 : 1;
+}
+
+/*!
+ * \brief Compute the training forward pass of a batch normalization.
+ *
+ * The inputs are laid out as [B x F x SP], the statistics of each of the F
+ * features are computed over B * SP values. The mean and the variance are
+ * computed in a single pass, with sums shifted by the first value of the
+ * feature for numerical stability. The normalized values and the output are
+ * then computed in a second pass. The statistics of a feature are reduced
+ * by a single task, in the order of the samples, they do not depend on the
+ * number of threads.
+ *
+ * \param input The input
+ * \param x_hat The normalized input
+ * \param output The output
+ * \param gamma The scale of each feature
+ * \param beta The shift of each feature
+ * \param mean The mean of each feature
+ * \param var The (biased) variance of each feature
+ * \param inv_var The inverse standard deviation of each feature
+ * \param B The number of samples
+ * \param F The number of features
+ * \param SP The number of values of a feature in a sample
+ * \param e Epsilon for numerical stability
+ */
+template <typename I, typename X, typename O, typename G, typename S, typename T>
+void batch_norm_train_forward(const I& input, X& x_hat, O& output, const G& gamma, const G& beta, S& mean, S& var, S& inv_var, size_t B, size_t F, size_t SP, T e) {
+    const size_t block = batch_norm_block(SP);
+    const double n     = B * SP;
+
+    parallel_kernel(0, (F + block - 1) / block, [&](size_t task) {
+        const size_t first = task * block;
+        const size_t last  = std::min(F, first + block);
+
+        double shift[64];
+        double sum[64];
+        double sum_sq[64];
+
+        for (size_t f = first; f < last; ++f) {
+            shift[f - first]  = input[f * SP];
+            sum[f - first]    = 0.0;
+            sum_sq[f - first] = 0.0;
+        }
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t f = first; f < last; ++f) {
+                const size_t base = (b * F + f) * SP;
+                const double k    = shift[f - first];
+
+                double s  = 0.0;
+                double sq = 0.0;
+
+                for (size_t i = 0; i < SP; ++i) {
+                    const double d = input[base + i] - k;
+                    s += d;
+                    sq += d * d;
+                }
+
+                sum[f - first] += s;
+                sum_sq[f - first] += sq;
+            }
+        }
+
+        for (size_t f = first; f < last; ++f) {
+            const double m = sum[f - first] / n;
+
+            mean[f]    = shift[f - first] + m;
+            var[f]     = std::max(0.0, sum_sq[f - first] / n - m * m);
+            inv_var[f] = 1.0 / std::sqrt(var[f] + e);
+        }
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t f = first; f < last; ++f) {
+                const size_t base = (b * F + f) * SP;
+
+                const T m  = mean[f];
+                const T iv = inv_var[f];
+                const T g  = gamma[f];
+                const T bt = beta[f];
+
+                for (size_t i = 0; i < SP; ++i) {
+                    const T xh = (input[base + i] - m) * iv;
+
+                    x_hat[base + i]  = xh;
+                    output[base + i] = g * xh + bt;
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the inference forward pass of a batch normalization,
+ * followed by the given element-wise activation function.
+ *
+ * The normalization of each feature is reduced to one scale and one shift,
+ * the normalization and the activation are done in a single traversal of
+ * the input.
+ *
+ * \param input The input [B x F x SP]
+ * \param output The output
+ * \param gamma The scale of each feature
+ * \param beta The shift of each feature
+ * \param mean The mean of each feature
+ * \param var The variance of each feature
+ * \param B The number of samples
+ * \param F The number of features
+ * \param SP The number of values of a feature in a sample
+ * \param e Epsilon for numerical stability
+ *
+ * \tparam A The activation function applied to the normalized values
+ */
+template <function A, typename I, typename O, typename G, typename S, typename T>
+void batch_norm_test_forward(const I& input, O& output, const G& gamma, const G& beta, const S& mean, const S& var, size_t B, size_t F, size_t SP, T e) {
+    std::vector<T> scale(F);
+    std::vector<T> shift(F);
+
+    for (size_t f = 0; f < F; ++f) {
+        scale[f] = gamma[f] / std::sqrt(var[f] + e);
+        shift[f] = beta[f] - mean[f] * scale[f];
+    }
+
+    parallel_kernel(0, B, [&](size_t b) {
+        for (size_t f = 0; f < F; ++f) {
+            const size_t base = (b * F + f) * SP;
+
+            const T sc = scale[f];
+            const T sh = shift[f];
+
+            for (size_t i = 0; i < SP; ++i) {
+                output[base + i] = f_activate_scalar<A>(sc * input[base + i] + sh);
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the backward pass of a batch normalization.
+ *
+ * The gradients of gamma and beta are accumulated in a single traversal of
+ * the errors and the normalized input, the errors of the input are then
+ * computed in a second traversal.
+ *
+ * \param errors The errors of the output [B x F x SP]
+ * \param x_hat The normalized input
+ * \param output The errors of the input
+ * \param gamma The scale of each feature
+ * \param inv_var The inverse standard deviation of each feature
+ * \param dgamma The gradients of gamma
+ * \param dbeta The gradients of beta
+ * \param B The number of samples
+ * \param F The number of features
+ * \param SP The number of values of a feature in a sample
+ */
+template <typename E, typename X, typename O, typename G, typename S, typename DG>
+void batch_norm_backward(const E& errors, const X& x_hat, O& output, const G& gamma, const S& inv_var, DG& dgamma, DG& dbeta, size_t B, size_t F, size_t SP) {
+    using T = std::decay_t<decltype(dgamma[0])>;
+
+    const size_t block = batch_norm_block(SP);
+    const T n          = B * SP;
+
+    parallel_kernel(0, (F + block - 1) / block, [&](size_t task) {
+        const size_t first = task * block;
+        const size_t last  = std::min(F, first + block);
+
+        double sum_dy[64];
+        double sum_dy_xh[64];
+
+        std::fill_n(sum_dy, last - first, 0.0);
+        std::fill_n(sum_dy_xh, last - first, 0.0);
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t f = first; f < last; ++f) {
+                const size_t base = (b * F + f) * SP;
+
+                double s  = 0.0;
+                double sx = 0.0;
+
+                for (size_t i = 0; i < SP; ++i) {
+                    s += errors[base + i];
+                    sx += errors[base + i] * x_hat[base + i];
+                }
+
+                sum_dy[f - first] += s;
+                sum_dy_xh[f - first] += sx;
+            }
+        }
+
+        for (size_t f = first; f < last; ++f) {
+            dbeta[f]  = sum_dy[f - first];
+            dgamma[f] = sum_dy_xh[f - first];
+        }
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t f = first; f < last; ++f) {
+                const size_t base = (b * F + f) * SP;
+
+                const T scale = gamma[f] * inv_var[f] / n;
+                const T db    = dbeta[f];
+                const T dg    = dgamma[f];
+
+                for (size_t i = 0; i < SP; ++i) {
+                    output[base + i] = scale * (n * errors[base + i] - db - x_hat[base + i] * dg);
+                }
+            }
+        }
+    });
+}
+
+} //end of dll namespace
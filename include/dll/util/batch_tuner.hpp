@@ -0,0 +1,171 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Calibration of the batch size for the training throughput of the
+ * current machine
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/memory.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The throughput of the training measured for one batch size
+ */
+struct batch_size_measure {
+    size_t batch_size;         ///< The measured batch size
+    double samples_per_second; ///< The number of samples trained per second
+    size_t memory;             ///< The peak of tracked memory during the training
+};
+
+/*!
+ * \brief The result of a batch size calibration
+ */
+struct batch_size_tuning {
+    std::vector<batch_size_measure> measures; ///< The measure of each batch size
+
+    size_t batch_size     = 0; ///< The batch size with the best throughput
+    size_t big_batch_size = 1; ///< The recommended number of batches kept in cache by the generators
+
+    /*!
+     * \brief Returns the parameters of the network descriptor for the
+     * recommended sizes, to rebuild the network statically
+     */
+    std::string desc_parameters() const {
+        return "dll::batch_size<" + std::to_string(batch_size) + ">, dll::big_batch_size<" + std::to_string(big_batch_size) + ">";
+    }
+};
+
+namespace batch_tuner_detail {
+
+/*!
+ * \brief The maximum size of the samples kept in cache by a big batch
+ */
+constexpr size_t big_batch_budget = 256UL * 1024UL * 1024UL;
+
+/*!
+ * \brief Measure the throughput of the training of the network created by
+ * the factory for the batch size B
+ */
+template <size_t B, typename Factory, typename Inputs, typename Labels>
+void measure(batch_size_tuning& tuning, Factory& factory, const Inputs& inputs, const Labels& labels, size_t iterations, size_t available) {
+    if (B > etl::dim<0>(inputs)) {
+        return;
+    }
+
+    // Skip the sizes that would not fit, from the growth of the previous ones
+    if (available && !tuning.measures.empty()) {
+        auto& last = tuning.measures.back();
+
+        if (last.memory * B / last.batch_size > available / 2) {
+            return;
+        }
+    }
+
+    reset_memory_peaks();
+
+    const size_t before = get_memory_usage().live;
+
+    auto net = factory(std::integral_constant<size_t, B>{});
+
+    using net_t     = std::decay_t<decltype(*net)>;
+    using trainer_t = typename net_t::desc::template trainer_t<net_t>;
+
+    static_assert(net_t::batch_size == B, "The factory must create networks with the given batch size");
+
+    trainer_t trainer(*net);
+
+    trainer.init_training(B);
+
+    auto batch       = etl::slice(inputs, 0, B);
+    auto batch_label = etl::slice(labels, 0, B);
+
+    // The first batch allocates all the buffers
+    trainer.train_batch(0, batch, batch_label);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; ++i) {
+        trainer.train_batch(0, batch, batch_label);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    const size_t peak = get_memory_usage().peak;
+
+    tuning.measures.push_back({B, seconds > 0.0 ? (B * iterations) / seconds : 0.0, peak > before ? peak - before : 0});
+}
+
+} //end of namespace batch_tuner_detail
+
+/*!
+ * \brief Measure the training throughput (samples per second of
+ * train_batch) of a network over a range of batch sizes and recommend
+ * the best batch size and big batch size for the current machine.
+ *
+ * The batch size of a network is static, the factory is called with each
+ * std::integral_constant<size_t, B> and must return a unique_ptr to a
+ * network whose batch size is B, with its dynamic layers initialized. The
+ * sizes are measured in order, a size is skipped if the extrapolated
+ * memory would not fit in half of the available memory.
+ *
+ * The big batch size is chosen such that the samples kept in cache by a
+ * generator fit in a quarter of the available memory, and at most in
+ * 256MB.
+ *
+ * \param factory The factory of the networks
+ * \param inputs The inputs [N x ...], with at least as many samples as the largest size
+ * \param labels The labels of the inputs
+ * \param iterations The number of batches trained for each size
+ *
+ * \tparam Sizes The batch sizes to measure
+ *
+ * \return the measures and the recommended sizes
+ */
+template <size_t... Sizes, typename Factory, typename Inputs, typename Labels>
+batch_size_tuning tune_batch_size(Factory&& factory, const Inputs& inputs, const Labels& labels, size_t iterations = 10) {
+    static_assert(sizeof...(Sizes) > 0, "At least one batch size must be measured");
+
+    batch_size_tuning tuning;
+
+    const size_t available = available_memory();
+
+    (batch_tuner_detail::measure<Sizes>(tuning, factory, inputs, labels, iterations, available), ...);
+
+    if (tuning.measures.empty()) {
+        return tuning;
+    }
+
+    auto best = std::max_element(tuning.measures.begin(), tuning.measures.end(), [](auto& lhs, auto& rhs) {
+        return lhs.samples_per_second < rhs.samples_per_second;
+    });
+
+    tuning.batch_size = best->batch_size;
+
+    const size_t sample_bytes = sizeof(etl::value_t<Inputs>) * (etl::size(inputs) / etl::dim<0>(inputs));
+    const size_t budget       = available ? std::min(batch_tuner_detail::big_batch_budget, available / 4) : batch_tuner_detail::big_batch_budget;
+
+    tuning.big_batch_size = std::max(size_t(1), budget / (sample_bytes * tuning.batch_size));
+
+    return tuning;
+}
+
+} //end of dll namespace
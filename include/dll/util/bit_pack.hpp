@@ -0,0 +1,318 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bit-packed batches of binary units and their products with dense
+ * and binarized weights, for the layers with binary input.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A batch of binary samples, packed in 64 bits words.
+ *
+ * Each sample is stored in its own words, the unused bits of the last word
+ * of a sample are zero. Any non-zero value is packed as a one.
+ */
+struct bit_batch {
+    static constexpr size_t word_bits = 64; ///< The number of units in a word
+
+    size_t rows    = 0;          ///< The number of samples
+    size_t columns = 0;          ///< The number of units of each sample
+    size_t words   = 0;          ///< The number of words of each sample
+    std::vector<uint64_t> bits; ///< The packed units
+
+    bit_batch() = default;
+
+    /*!
+     * \brief Build the bit batch of the given dense batch [B x N]
+     */
+    template <typename M>
+    explicit bit_batch(const M& batch) {
+        assign(batch);
+    }
+
+    /*!
+     * \brief Set the bit batch to the given dense batch [B x N].
+     *
+     * The memory of the previous batch is reused.
+     */
+    template <typename M>
+    void assign(const M& batch) {
+        static_assert(etl::decay_traits<M>::dimensions() == 2, "Only 2D batches can be packed");
+
+        using T = etl::value_t<M>;
+
+        cpu_access(batch);
+
+        rows    = etl::dim<0>(batch);
+        columns = etl::dim<1>(batch);
+        words   = (columns + word_bits - 1) / word_bits;
+
+        bits.resize(rows * words);
+
+        const T* in = batch.memory_start();
+
+        for (size_t r = 0; r < rows; ++r) {
+            const T* sample = in + r * columns;
+
+            for (size_t k = 0; k < words; ++k) {
+                const size_t first = k * word_bits;
+                const size_t n     = std::min(word_bits, columns - first);
+
+                uint64_t word = 0;
+
+                for (size_t j = 0; j < n; ++j) {
+                    word |= uint64_t(sample[first + j] != T(0)) << j;
+                }
+
+                bits[r * words + k] = word;
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the words of the given sample
+     */
+    const uint64_t* row(size_t r) const {
+        return bits.data() + r * words;
+    }
+
+    /*!
+     * \brief Returns the number of ones of the given sample
+     */
+    size_t count(size_t r) const {
+        size_t n = 0;
+
+        for (size_t k = 0; k < words; ++k) {
+            n += __builtin_popcountll(row(r)[k]);
+        }
+
+        return n;
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the packed units
+     */
+    size_t bytes() const {
+        return bits.size() * sizeof(uint64_t);
+    }
+};
+
+/*!
+ * \brief Returns the bit batch of the calling thread, to pack the batches
+ * without allocating each time.
+ */
+inline bit_batch& bit_workspace() {
+    thread_local bit_batch batch;
+    return batch;
+}
+
+/*!
+ * \brief Weights binarized to their sign, with one scale per output.
+ *
+ * The signs of the weights of each output are packed like the samples of a
+ * bit_batch (one for the positive weights), the scale of an output is the
+ * mean of the absolute values of its weights.
+ */
+template <typename T>
+struct binary_weights {
+    size_t inputs  = 0;         ///< The number of inputs
+    size_t outputs = 0;         ///< The number of outputs
+    size_t words   = 0;         ///< The number of words of each output
+    std::vector<uint64_t> bits; ///< The packed signs [outputs x words]
+    std::vector<T> scales;      ///< The scale of each output
+
+    /*!
+     * \brief Indicates if the weights have been binarized
+     */
+    bool empty() const {
+        return bits.empty();
+    }
+
+    /*!
+     * \brief Returns the words of the given output
+     */
+    const uint64_t* output(size_t h) const {
+        return bits.data() + h * words;
+    }
+};
+
+/*!
+ * \brief Binarize the given weights [V x H] to their sign
+ * \param w The weights
+ * \return The binarized weights, with the scale of each output
+ */
+template <typename W>
+binary_weights<etl::value_t<W>> binarize_weights(const W& w) {
+    using T = etl::value_t<W>;
+
+    binary_weights<T> bw;
+
+    bw.inputs  = etl::dim<0>(w);
+    bw.outputs = etl::dim<1>(w);
+    bw.words   = (bw.inputs + bit_batch::word_bits - 1) / bit_batch::word_bits;
+
+    bw.bits.assign(bw.outputs * bw.words, 0);
+    bw.scales.assign(bw.outputs, T(0));
+
+    for (size_t v = 0; v < bw.inputs; ++v) {
+        for (size_t h = 0; h < bw.outputs; ++h) {
+            const T value = w(v, h);
+
+            if (value > T(0)) {
+                bw.bits[h * bw.words + v / bit_batch::word_bits] |= uint64_t(1) << (v % bit_batch::word_bits);
+            }
+
+            bw.scales[h] += std::abs(value);
+        }
+    }
+
+    for (auto& scale : bw.scales) {
+        scale /= T(bw.inputs);
+    }
+
+    return bw;
+}
+
+/*!
+ * \brief Compute the product of a bit batch with a dense matrix.
+ *
+ * Each output row is the sum of the rows of the matrix of the ones of the
+ * sample, the cost is proportional to the number of ones.
+ *
+ * \param output The output [B x H]
+ * \param batch The binary batch [B x V]
+ * \param w The matrix [V x H]
+ */
+template <typename O, typename W>
+void bit_mul(O&& output, const bit_batch& batch, const W& w) {
+    using T = etl::value_t<W>;
+
+    const size_t H = etl::dim<1>(w);
+
+    cpu_access(w);
+
+    const T* wm = w.memory_start();
+    T* out      = output.memory_start();
+
+    parallel_kernel(0, batch.rows, [&](size_t r) {
+        T* o = out + r * H;
+
+        std::fill_n(o, H, T(0));
+
+        const uint64_t* words = batch.row(r);
+
+        for (size_t k = 0; k < batch.words; ++k) {
+            for (uint64_t word = words[k]; word; word &= word - 1) {
+                const T* wr = wm + (k * bit_batch::word_bits + __builtin_ctzll(word)) * H;
+
+                for (size_t j = 0; j < H; ++j) {
+                    o[j] += wr[j];
+                }
+            }
+        }
+    });
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Compute the product of a bit batch with binarized weights, with
+ * popcounts.
+ *
+ * With x the ones of the sample and p the positive weights of the output,
+ * the product is scale * (popcount(x & p) - popcount(x & ~p)).
+ *
+ * \param output The output [B x H]
+ * \param batch The binary batch [B x V]
+ * \param w The binarized weights [V x H]
+ */
+template <typename O, typename T>
+void binary_weights_mul(O&& output, const bit_batch& batch, const binary_weights<T>& w) {
+    const size_t H = w.outputs;
+
+    T* out = output.memory_start();
+
+    parallel_kernel(0, batch.rows, [&](size_t r) {
+        const uint64_t* x = batch.row(r);
+        const auto ones   = int64_t(batch.count(r));
+
+        for (size_t h = 0; h < H; ++h) {
+            const uint64_t* p = w.output(h);
+
+            int64_t positive = 0;
+
+            for (size_t k = 0; k < w.words; ++k) {
+                positive += __builtin_popcountll(x[k] & p[k]);
+            }
+
+            out[r * H + h] = w.scales[h] * T(2 * positive - ones);
+        }
+    });
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Compute the outer product of a bit batch and a dense batch,
+ * grad = bits^T * errors.
+ *
+ * The rows of the gradients are computed in parallel by words of units,
+ * each row only being written by one task.
+ *
+ * \param grad The gradients [V x H]
+ * \param batch The binary batch [B x V]
+ * \param errors The dense batch [B x H]
+ */
+template <typename G, typename E>
+void bit_batch_outer(G&& grad, const bit_batch& batch, const E& errors) {
+    using T = etl::value_t<E>;
+
+    const size_t H = etl::dim<1>(errors);
+
+    cpu_access(errors);
+
+    const T* e = errors.memory_start();
+    T* g       = grad.memory_start();
+
+    parallel_kernel(0, batch.words, [&](size_t k) {
+        const size_t first = k * bit_batch::word_bits;
+        const size_t last  = std::min(batch.columns, first + bit_batch::word_bits);
+
+        std::fill(g + first * H, g + last * H, T(0));
+
+        for (size_t r = 0; r < batch.rows; ++r) {
+            const T* er = e + r * H;
+
+            for (uint64_t word = batch.row(r)[k]; word; word &= word - 1) {
+                T* gr = g + (first + __builtin_ctzll(word)) * H;
+
+                for (size_t j = 0; j < H; ++j) {
+                    gr[j] += er[j];
+                }
+            }
+        }
+    });
+
+    cpu_modified(grad);
+}
+
+} //end of dll namespace
@@ -0,0 +1,139 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the channels-last (NHWC) layout: the conversions from
+ * and to the [C x H x W] layout, the patches of the convolutions and the
+ * max pooling.
+ *
+ * In the channels-last layout, the C values of one position are
+ * contiguous, the kernels work on runs of C values.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Convert n samples from the [C x H x W] layout to the [H x W x C]
+ * layout
+ * \param out The converted samples
+ * \param in The samples
+ */
+template <typename T>
+void to_channels_last(T* out, const T* in, size_t n, size_t C, size_t H, size_t W) {
+    const size_t HW = H * W;
+
+    parallel_kernel(0, n, [&](size_t s) {
+        const T* a = in + s * C * HW;
+        T* b       = out + s * C * HW;
+
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t x = 0; x < HW; ++x) {
+                b[x * C + c] = a[c * HW + x];
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Convert n samples from the [H x W x C] layout to the [C x H x W]
+ * layout
+ * \param out The converted samples
+ * \param in The samples
+ */
+template <typename T>
+void to_channels_first(T* out, const T* in, size_t n, size_t C, size_t H, size_t W) {
+    const size_t HW = H * W;
+
+    parallel_kernel(0, n, [&](size_t s) {
+        const T* a = in + s * C * HW;
+        T* b       = out + s * C * HW;
+
+        for (size_t x = 0; x < HW; ++x) {
+            for (size_t c = 0; c < C; ++c) {
+                b[c * HW + x] = a[x * C + c];
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Extract the patches of one channels-last sample for a convolution
+ * with NW1 x NW2 filters and a zero padding of P1 x P2.
+ *
+ * Each output position has a row of NW1 x NW2 x C values, the filter rows
+ * being contiguous runs of C values of the input.
+ *
+ * \param patch The patches [NH1 * NH2 x NW1 * NW2 * C]
+ * \param in The sample [H x W x C]
+ */
+template <typename T>
+void channels_last_patches(T* patch, const T* in, size_t C, size_t H, size_t W, size_t NW1, size_t NW2, size_t P1, size_t P2) {
+    const size_t NH1 = H + 2 * P1 - NW1 + 1;
+    const size_t NH2 = W + 2 * P2 - NW2 + 1;
+
+    for (size_t i = 0; i < NH1; ++i) {
+        for (size_t j = 0; j < NH2; ++j) {
+            for (size_t p = 0; p < NW1; ++p) {
+                const size_t y = i + p;
+
+                for (size_t q = 0; q < NW2; ++q, patch += C) {
+                    const size_t x = j + q;
+
+                    // The positions are shifted by the padding
+                    if (y < P1 || y >= H + P1 || x < P2 || x >= W + P2) {
+                        std::fill_n(patch, C, T(0));
+                    } else {
+                        std::memcpy(patch, in + ((y - P1) * W + x - P2) * C, C * sizeof(T));
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Max pooling of n channels-last samples with non-overlapping
+ * windows of C1 x C2 positions
+ * \param out The pooled samples [H / C1 x W / C2 x C]
+ * \param in The samples [H x W x C]
+ */
+template <typename T>
+void channels_last_max_pool(T* out, const T* in, size_t n, size_t C, size_t H, size_t W, size_t C1, size_t C2) {
+    const size_t O1 = H / C1;
+    const size_t O2 = W / C2;
+
+    parallel_kernel(0, n, [&](size_t s) {
+        const T* a = in + s * H * W * C;
+        T* b       = out + s * O1 * O2 * C;
+
+        for (size_t i = 0; i < O1; ++i) {
+            for (size_t j = 0; j < O2; ++j, b += C) {
+                std::memcpy(b, a + (i * C1 * W + j * C2) * C, C * sizeof(T));
+
+                for (size_t p = 0; p < C1; ++p) {
+                    for (size_t q = 0; q < C2; ++q) {
+                        const T* v = a + ((i * C1 + p) * W + j * C2 + q) * C;
+
+                        for (size_t c = 0; c < C; ++c) {
+                            b[c] = std::max(b[c], v[c]);
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+} //end of dll namespace
@@ -0,0 +1,454 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Binary checkpoints of the training, written in background.
+ *
+ * A checkpoint holds the parameters of the network, the state of the
+ * updater (momentum, moments, ...), the iteration of the trainer and the
+ * state of the training loop (position in the epoch, random states,
+ * early stopping), so that a training can be resumed where it stopped. The
+ * trainer only copies its tensors into a snapshot buffer, the checksums and
+ * the writes are done by a background thread.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "dll/util/parameter_store.hpp"
+#include "dll/generators/mmap_data_generator.hpp" // For mapped_file
+
+namespace dll {
+
+/*!
+ * \brief The header of a checkpoint file.
+ *
+ * The header is followed by the parameters, the state of the updater, the
+ * scalar state of the updater (as double) and the opaque state of the
+ * training loop, without padding.
+ */
+struct checkpoint_file_header {
+    char magic[4]                = {'D', 'L', 'L', 'C'}; ///< The magic of the file
+    uint32_t version             = 2;                    ///< The version of the format
+    uint32_t dtype               = 0;                    ///< The size of one value, in bytes
+    uint32_t updater             = 0;                    ///< The updater of the trainer
+    uint64_t epoch               = 0;                    ///< The epoch of the checkpoint
+    uint64_t batch               = 0;                    ///< The number of mini-batches trained in the epoch
+    uint64_t iteration           = 0;                    ///< The iteration of the trainer
+    uint64_t parameters          = 0;                    ///< The number of parameters
+    uint64_t state               = 0;                    ///< The number of values of the state of the updater
+    uint64_t scalars             = 0;                    ///< The number of scalars of the state of the updater
+    uint64_t training            = 0;                    ///< The number of bytes of the state of the training loop
+    uint64_t parameters_checksum = 0;                    ///< The checksum of the parameters
+    uint64_t state_checksum      = 0;                    ///< The checksum of the state of the updater
+    uint64_t scalars_checksum    = 0;                    ///< The checksum of the scalars
+    uint64_t training_checksum   = 0;                    ///< The checksum of the state of the training loop
+};
+
+/*!
+ * \brief Compute the FNV-1a checksum of the given memory
+ * \param memory The memory to hash
+ * \param bytes The number of bytes to hash
+ */
+inline uint64_t checkpoint_checksum(const void* memory, size_t bytes) {
+    auto* data = static_cast<const unsigned char*>(memory);
+
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < bytes; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/*!
+ * \brief Append a value to the state of the training loop
+ * \param out The serialized state
+ * \param value The value to append
+ */
+template <typename V>
+void checkpoint_write(std::string& out, const V& value) {
+    static_assert(std::is_trivially_copyable_v<V>, "Only trivial values can be written to the state of the training");
+
+    out.append(reinterpret_cast<const char*>(&value), sizeof(V));
+}
+
+/*!
+ * \copydoc checkpoint_write
+ */
+inline void checkpoint_write(std::string& out, const std::string& value) {
+    checkpoint_write(out, uint64_t(value.size()));
+    out.append(value);
+}
+
+/*!
+ * \copydoc checkpoint_write
+ */
+inline void checkpoint_write(std::string& out, const std::vector<size_t>& value) {
+    checkpoint_write(out, uint64_t(value.size()));
+
+    for (auto v : value) {
+        checkpoint_write(out, uint64_t(v));
+    }
+}
+
+/*!
+ * \brief Reader of the state of the training loop, in the order of the
+ * writes.
+ *
+ * Once a read goes past the end of the state, the reader is invalid and
+ * the next reads leave the values as they are.
+ */
+struct checkpoint_reader {
+    /*!
+     * \brief Create a reader of the given serialized state
+     */
+    explicit checkpoint_reader(const std::string& in) : in(in) {}
+
+    /*!
+     * \brief Read the next value
+     */
+    template <typename V>
+    void read(V& value) {
+        static_assert(std::is_trivially_copyable_v<V>, "Only trivial values can be read from the state of the training");
+
+        if (valid && position + sizeof(V) <= in.size()) {
+            std::memcpy(&value, in.data() + position, sizeof(V));
+            position += sizeof(V);
+        } else {
+            valid = false;
+        }
+    }
+
+    /*!
+     * \copydoc read
+     */
+    void read(std::string& value) {
+        uint64_t size = 0;
+        read(size);
+
+        if (valid && position + size <= in.size()) {
+            value.assign(in.data() + position, size);
+            position += size;
+        } else {
+            valid = false;
+        }
+    }
+
+    /*!
+     * \copydoc read
+     */
+    void read(std::vector<size_t>& value) {
+        uint64_t size = 0;
+        read(size);
+
+        if (valid && position + size * sizeof(uint64_t) <= in.size()) {
+            value.resize(size);
+
+            for (auto& v : value) {
+                uint64_t x = 0;
+                read(x);
+                v = x;
+            }
+        } else {
+            valid = false;
+        }
+    }
+
+    const std::string& in;  ///< The serialized state
+    size_t position = 0;    ///< The position of the next read
+    bool valid      = true; ///< Indicates if all the reads were inside the state
+};
+
+/*!
+ * \brief One snapshot of the training
+ */
+template <typename T>
+struct checkpoint_snapshot {
+    std::vector<T> parameters;     ///< The parameters of the network
+    std::vector<T> state;          ///< The state of the updater
+    std::vector<double> scalars;   ///< The scalar state of the updater
+    std::string training;          ///< The state of the training loop
+    checkpoint_file_header header; ///< The header of the snapshot
+};
+
+/*!
+ * \brief Write a snapshot to the given file.
+ *
+ * The snapshot is written to a temporary file which is then renamed, so
+ * that the file always holds a complete checkpoint.
+ *
+ * \return true if the file was written, false otherwise
+ */
+template <typename T>
+bool write_checkpoint(const std::string& path, checkpoint_snapshot<T>& snapshot) {
+    auto& header = snapshot.header;
+
+    header.dtype               = sizeof(T);
+    header.parameters          = snapshot.parameters.size();
+    header.state               = snapshot.state.size();
+    header.scalars             = snapshot.scalars.size();
+    header.training            = snapshot.training.size();
+    header.parameters_checksum = checkpoint_checksum(snapshot.parameters.data(), snapshot.parameters.size() * sizeof(T));
+    header.state_checksum      = checkpoint_checksum(snapshot.state.data(), snapshot.state.size() * sizeof(T));
+    header.scalars_checksum    = checkpoint_checksum(snapshot.scalars.data(), snapshot.scalars.size() * sizeof(double));
+    header.training_checksum   = checkpoint_checksum(snapshot.training.data(), snapshot.training.size());
+
+    const std::string tmp = path + ".tmp";
+
+    {
+        std::ofstream os(tmp, std::ofstream::binary);
+
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(snapshot.parameters.data()), snapshot.parameters.size() * sizeof(T));
+        os.write(reinterpret_cast<const char*>(snapshot.state.data()), snapshot.state.size() * sizeof(T));
+        os.write(reinterpret_cast<const char*>(snapshot.scalars.data()), snapshot.scalars.size() * sizeof(double));
+        os.write(snapshot.training.data(), snapshot.training.size());
+
+        if (!os) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+    }
+
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+/*!
+ * \brief Load a checkpoint from the given file.
+ *
+ * The file is mapped in memory and copied directly into the parameters and
+ * into the state of the updater. Nothing is modified if the file does not
+ * match the stores or if one of its checksums is wrong.
+ *
+ * \param path The path of the file
+ * \param parameters The store of the parameters
+ * \param state The store of the state of the updater
+ * \param scalars The scalar state of the updater
+ * \param updater The updater of the trainer
+ * \param header The header of the file, filled on success
+ * \param training The state of the training loop, filled on success
+ *
+ * \return true if the checkpoint was loaded, false otherwise
+ */
+template <typename T>
+bool load_checkpoint(const std::string& path, parameter_store<T>& parameters, parameter_store<T>& state, const std::vector<double*>& scalars, uint32_t updater, checkpoint_file_header& header, std::string& training) {
+    mapped_file file(path);
+
+    if (!file.memory || file.length < sizeof(checkpoint_file_header)) {
+        return false;
+    }
+
+    checkpoint_file_header h;
+    std::memcpy(&h, file.at(0), sizeof(h));
+
+    if (std::memcmp(h.magic, "DLLC", 4) != 0 || h.version != 2 || h.dtype != sizeof(T)) {
+        return false;
+    }
+
+    if (h.updater != updater || h.parameters != parameters.size() || h.state != state.size() || h.scalars != scalars.size()) {
+        return false;
+    }
+
+    const size_t parameters_offset = sizeof(h);
+    const size_t state_offset      = parameters_offset + h.parameters * sizeof(T);
+    const size_t scalars_offset    = state_offset + h.state * sizeof(T);
+    const size_t training_offset   = scalars_offset + h.scalars * sizeof(double);
+
+    if (file.length < training_offset + h.training) {
+        return false;
+    }
+
+    if (checkpoint_checksum(file.at(parameters_offset), h.parameters * sizeof(T)) != h.parameters_checksum
+        || checkpoint_checksum(file.at(state_offset), h.state * sizeof(T)) != h.state_checksum
+        || checkpoint_checksum(file.at(scalars_offset), h.scalars * sizeof(double)) != h.scalars_checksum
+        || checkpoint_checksum(file.at(training_offset), h.training) != h.training_checksum) {
+        return false;
+    }
+
+    // The header is a multiple of 8 bytes, the tensors are aligned
+    parameters.scatter(reinterpret_cast<const T*>(file.at(parameters_offset)));
+    state.scatter(reinterpret_cast<const T*>(file.at(state_offset)));
+
+    for (size_t i = 0; i < scalars.size(); ++i) {
+        std::memcpy(scalars[i], file.at(scalars_offset + i * sizeof(double)), sizeof(double));
+    }
+
+    training.assign(static_cast<const char*>(file.at(training_offset)), h.training);
+
+    header = h;
+
+    return true;
+}
+
+/*!
+ * \brief Writer of the checkpoints of a training, in background.
+ *
+ * The writer holds two snapshots: the trainer copies its tensors into the
+ * back snapshot while the background thread writes the front snapshot. If
+ * the trainer saves faster than the files are written, the latest snapshot
+ * waiting to be written is replaced, the training never waits for the disk.
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct checkpoint_writer {
+    /*!
+     * \brief Create a writer for the given file
+     * \param path The path of the checkpoint file
+     */
+    explicit checkpoint_writer(const std::string& path) : path(path) {
+        writer = std::thread([this] { write_loop(); });
+    }
+
+    checkpoint_writer(const checkpoint_writer& rhs) = delete;
+    checkpoint_writer operator=(const checkpoint_writer& rhs) = delete;
+
+    /*!
+     * \brief Write the last snapshot and stop the background writer
+     */
+    ~checkpoint_writer() {
+        cpp::with_lock(lock, [this] { stop_flag = true; });
+
+        ready.notify_all();
+
+        writer.join();
+    }
+
+    /*!
+     * \brief Take a snapshot of the training, to be written in background
+     * \param parameters The store of the parameters
+     * \param state The store of the state of the updater
+     * \param scalars The scalar state of the updater
+     * \param updater The updater of the trainer
+     * \param epoch The current epoch
+     * \param batch The number of mini-batches trained in the epoch
+     * \param iteration The current iteration of the trainer
+     * \param training The state of the training loop
+     */
+    void save(const parameter_store<T>& parameters, const parameter_store<T>& state, const std::vector<double*>& scalars, uint32_t updater, size_t epoch, size_t batch, size_t iteration, const std::string& training) {
+        {
+            // The writer only holds the lock to swap the snapshots
+            std::unique_lock<std::mutex> ulock(lock);
+
+            back.parameters.resize(parameters.size());
+            back.state.resize(state.size());
+            back.scalars.resize(scalars.size());
+
+            parameters.gather(back.parameters.data());
+            state.gather(back.state.data());
+
+            for (size_t i = 0; i < scalars.size(); ++i) {
+                back.scalars[i] = *scalars[i];
+            }
+
+            back.training = training;
+
+            back.header.updater   = updater;
+            back.header.epoch     = epoch;
+            back.header.batch     = batch;
+            back.header.iteration = iteration;
+
+            has_pending = true;
+            ++saved;
+        }
+
+        ready.notify_all();
+    }
+
+    /*!
+     * \brief Wait until all the snapshots are written
+     */
+    void wait() {
+        std::unique_lock<std::mutex> ulock(lock);
+
+        ready.wait(ulock, [this] { return !has_pending && !writing; });
+    }
+
+    /*!
+     * \brief Returns the number of checkpoint files written
+     */
+    size_t written() {
+        std::unique_lock<std::mutex> ulock(lock);
+        return files;
+    }
+
+    /*!
+     * \brief Returns the number of snapshots taken
+     */
+    size_t snapshots() {
+        std::unique_lock<std::mutex> ulock(lock);
+        return saved;
+    }
+
+private:
+    /*!
+     * \brief The main loop of the background writer
+     */
+    void write_loop() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                ready.wait(ulock, [this] { return has_pending || stop_flag; });
+
+                if (!has_pending) {
+                    return;
+                }
+
+                std::swap(front, back);
+
+                has_pending = false;
+                writing     = true;
+            }
+
+            // The front snapshot is never touched by the trainer
+            const bool success = write_checkpoint(path, front);
+
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                writing = false;
+
+                if (success) {
+                    ++files;
+                }
+            }
+
+            ready.notify_all();
+        }
+    }
+
+    std::string path; ///< The path of the checkpoint file
+
+    checkpoint_snapshot<T> front; ///< The snapshot being written
+    checkpoint_snapshot<T> back;  ///< The snapshot being filled
+
+    std::mutex lock;               ///< The lock protecting the snapshots
+    std::condition_variable ready; ///< Signals a change of the snapshots
+    bool has_pending = false;      ///< Indicates if the back snapshot must be written
+    bool writing     = false;      ///< Indicates if the front snapshot is being written
+    bool stop_flag   = false;      ///< Indicates to the background writer to stop
+    size_t saved     = 0;          ///< The number of snapshots taken
+    size_t files     = 0;          ///< The number of files written
+    std::thread writer;            ///< The background writer
+};
+
+} //end of dll namespace
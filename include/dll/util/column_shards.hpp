@@ -0,0 +1,264 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the dense layers whose weights are sharded by output
+ * columns.
+ *
+ * The weights [V x H] are stored as S contiguous shards [V x H / S], the
+ * shard s holding the columns [s * H / S, (s + 1) * H / S). Each shard is
+ * processed by a single task, which computes its columns of the output, of
+ * the errors and its gradients: the weights of a shard are only read and
+ * written by the task of the shard. Only the activations are shared between
+ * the shards, the errors backpropagated by each shard being reduced at the
+ * end of the backward pass.
+ *
+ * On NUMA machines, each shard is bound to a node and, when the kernel
+ * threads are pinned, its task is run by a thread of this node.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "dll/function.hpp"
+#include "dll/util/cpu.hpp"
+#include "dll/util/gemv.hpp"
+#include "dll/util/numa.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/thread_budget.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the NUMA node of the shard s among the given number of
+ * shards, the shards being split in contiguous ranges of nodes
+ */
+inline size_t shard_node(size_t s, size_t shards) {
+    return s * get_numa_topology().nodes() / shards;
+}
+
+/*!
+ * \brief Call the functor on each of the shards, in parallel.
+ *
+ * On a NUMA machine, each thread first processes the shards of its own
+ * node and then helps with the remaining shards of the other nodes.
+ *
+ * \param shards The number of shards
+ * \param fun The functor to call with each shard
+ */
+template <typename Functor>
+void for_each_shard(size_t shards, Functor&& fun) {
+    const size_t nodes = get_numa_topology().nodes();
+
+    if (nodes < 2) {
+        parallel_kernel(0, shards, fun);
+        return;
+    }
+
+    std::unique_ptr<std::atomic<bool>[]> claimed(new std::atomic<bool>[shards]);
+
+    for (size_t s = 0; s < shards; ++s) {
+        claimed[s] = false;
+    }
+
+    parallel_kernel(0, std::min(shards, thread_budget()), [&](size_t /*task*/) {
+        const size_t node = numa_current_node();
+
+        for (size_t pass = 0; pass < 2; ++pass) {
+            for (size_t s = 0; s < shards; ++s) {
+                if ((pass || shard_node(s, shards) == node) && !claimed[s].exchange(true)) {
+                    fun(s);
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the columns of a shard of the output of a dense layer,
+ * out[:, first:first + Hs] = f(in * w_s + b[first:first + Hs])
+ *
+ * The activation is only applied if it is element-wise.
+ *
+ * \param out The output [B x H]
+ * \param in The input [B x V]
+ * \param w The weights of the shard [V x Hs]
+ * \param b The biases [H]
+ * \param first The first column of the shard
+ */
+template <function F, typename T>
+DLL_KERNEL_CLONES void shard_forward(T* out, const T* in, const T* w, const T* b, size_t B, size_t V, size_t H, size_t first, size_t Hs) {
+    constexpr size_t R = 4;
+
+    for (size_t r0 = 0; r0 < B; r0 += R) {
+        const size_t r1 = std::min(B, r0 + R);
+
+        for (size_t r = r0; r < r1; ++r) {
+            std::copy_n(b + first, Hs, out + r * H + first);
+        }
+
+        // Each row of the weights is reused for the R rows of the tile
+        for (size_t v = 0; v < V; ++v) {
+            const T* row = w + v * Hs;
+
+            for (size_t r = r0; r < r1; ++r) {
+                const T x = in[r * V + v];
+                T* o      = out + r * H + first;
+
+                for (size_t h = 0; h < Hs; ++h) {
+                    o[h] += x * row[h];
+                }
+            }
+        }
+
+        if constexpr (F != function::SOFTMAX) {
+            for (size_t r = r0; r < r1; ++r) {
+                activate_one<F>(out + r * H + first, Hs);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Multiply the columns of a shard of the errors by the derivative of
+ * the activation function and reduce them into the gradients of the biases
+ * of the shard.
+ *
+ * \param errors The errors [B x H]
+ * \param output The output [B x H]
+ * \param b_grad The gradients of the biases [H]
+ * \param derivative Indicates if the derivative must be applied
+ * \param first The first column of the shard
+ */
+template <function F, typename T>
+void shard_derivative(T* errors, const T* output, T* b_grad, bool derivative, size_t B, size_t H, size_t first, size_t Hs) {
+    T* g = b_grad + first;
+
+    std::fill_n(g, Hs, T(0));
+
+    for (size_t r = 0; r < B; ++r) {
+        T* e       = errors + r * H + first;
+        const T* o = output + r * H + first;
+
+        if (derivative) {
+            for (size_t h = 0; h < Hs; ++h) {
+                e[h] *= f_derivative_scalar<F>(o[h]);
+            }
+        }
+
+        for (size_t h = 0; h < Hs; ++h) {
+            g[h] += e[h];
+        }
+    }
+}
+
+/*!
+ * \brief Compute the errors backpropagated by a shard,
+ * partial = errors[:, first:first + Hs] * w_s^T
+ *
+ * \param partial The errors of the shard [B x V]
+ * \param errors The errors of the layer [B x H]
+ * \param w The weights of the shard [V x Hs]
+ * \param first The first column of the shard
+ */
+template <typename T>
+DLL_KERNEL_CLONES void shard_backward(T* partial, const T* errors, const T* w, size_t B, size_t V, size_t H, size_t first, size_t Hs) {
+    constexpr size_t P = 8;
+
+    for (size_t r = 0; r < B; ++r) {
+        const T* e = errors + r * H + first;
+
+        for (size_t v = 0; v < V; ++v) {
+            const T* row = w + v * Hs;
+
+            // Independent accumulators, for the dot product to be vectorized
+            T acc[P] = {};
+
+            size_t h = 0;
+
+            for (; h + P <= Hs; h += P) {
+                for (size_t k = 0; k < P; ++k) {
+                    acc[k] += e[h + k] * row[h + k];
+                }
+            }
+
+            T sum = 0;
+
+            for (; h < Hs; ++h) {
+                sum += e[h] * row[h];
+            }
+
+            for (size_t k = 0; k < P; ++k) {
+                sum += acc[k];
+            }
+
+            partial[r * V + v] = sum;
+        }
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the weights of a shard,
+ * grad_s = in^T * errors[:, first:first + Hs]
+ *
+ * \param grad The gradients of the shard [V x Hs]
+ * \param in The input [B x V]
+ * \param errors The errors of the layer [B x H]
+ * \param first The first column of the shard
+ */
+template <typename T>
+DLL_KERNEL_CLONES void shard_gradients(T* grad, const T* in, const T* errors, size_t B, size_t V, size_t H, size_t first, size_t Hs) {
+    std::fill_n(grad, V * Hs, T(0));
+
+    for (size_t v = 0; v < V; ++v) {
+        T* g = grad + v * Hs;
+
+        for (size_t r = 0; r < B; ++r) {
+            const T x = in[r * V + v];
+
+            if (x == T(0)) {
+                continue;
+            }
+
+            const T* e = errors + r * H + first;
+
+            for (size_t h = 0; h < Hs; ++h) {
+                g[h] += x * e[h];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Sum the errors backpropagated by each shard,
+ * out = sum(partials[s])
+ *
+ * \param out The errors of the previous layer [B x V]
+ * \param partials The errors of each shard [S x B x V]
+ */
+template <typename T>
+void reduce_shards(T* out, const T* partials, size_t S, size_t B, size_t V) {
+    parallel_kernel(0, B, [&](size_t r) {
+        T* o = out + r * V;
+
+        std::copy_n(partials + r * V, V, o);
+
+        for (size_t s = 1; s < S; ++s) {
+            const T* p = partials + (s * B + r) * V;
+
+            for (size_t v = 0; v < V; ++v) {
+                o[v] += p[v];
+            }
+        }
+    });
+}
+
+} //end of dll namespace
@@ -0,0 +1,231 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Compact (8 or 16 bits) storage of samples
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "dll/storage_type.hpp"
+
+namespace dll {
+
+namespace compact_detail {
+
+inline uint32_t as_uint(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    return x;
+}
+
+inline float as_float(uint32_t x) {
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+} //end of namespace compact_detail
+
+/*!
+ * \brief Convert a float to IEEE half precision, rounding to the nearest
+ * even value
+ */
+inline uint16_t float_to_half(float value) {
+    using namespace compact_detail;
+
+    constexpr uint32_t f32_infinity   = 255u << 23;
+    constexpr uint32_t f16_max        = (127u + 16u) << 23;
+    constexpr uint32_t denormal_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t x = as_uint(value);
+
+    const uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+
+    uint16_t h;
+
+    if (x >= f16_max) {
+        // Overflow to infinity, or NaN
+        h = x > f32_infinity ? 0x7E00 : 0x7C00;
+    } else if (x < (113u << 23)) {
+        // Denormal: let the FPU do the rounding
+        h = as_uint(as_float(x) + as_float(denormal_magic)) - denormal_magic;
+    } else {
+        const uint32_t odd = (x >> 13) & 1u;
+
+        x += ((15u - 127u) << 23) + 0xFFFu + odd;
+
+        h = x >> 13;
+    }
+
+    return h | (sign >> 16);
+}
+
+/*!
+ * \brief Convert an IEEE half precision value to float
+ */
+inline float half_to_float(uint16_t h) {
+    using namespace compact_detail;
+
+    constexpr uint32_t magic       = 113u << 23;
+    constexpr uint32_t shifted_exp = 0x7C00u << 13;
+
+    uint32_t x = (h & 0x7FFFu) << 13;
+
+    const uint32_t exp = shifted_exp & x;
+
+    x += (127u - 15u) << 23;
+
+    if (exp == shifted_exp) {
+        // Infinity or NaN
+        x += (128u - 16u) << 23;
+    } else if (exp == 0) {
+        // Zero or denormal
+        x += 1u << 23;
+        x = as_uint(as_float(x) - as_float(magic));
+    }
+
+    return as_float(x | (uint32_t(h & 0x8000u) << 16));
+}
+
+/*!
+ * \brief Convert a float to bfloat16, rounding to the nearest even value
+ */
+inline uint16_t float_to_bf16(float value) {
+    uint32_t x = compact_detail::as_uint(value);
+
+    if ((x & 0x7FFFFFFFu) > 0x7F800000u) {
+        // Keep the NaN quiet
+        return (x >> 16) | 0x40u;
+    }
+
+    x += 0x7FFFu + ((x >> 16) & 1u);
+
+    return x >> 16;
+}
+
+/*!
+ * \brief Convert a bfloat16 value to float
+ */
+inline float bf16_to_float(uint16_t h) {
+    return compact_detail::as_float(uint32_t(h) << 16);
+}
+
+/*!
+ * \brief Compact storage of a set of samples of the same size.
+ *
+ * The values are narrowed when they are stored and widened to T when they
+ * are read back. UINT8 storage is only suited to raw pixels, the values are
+ * rounded and clamped to [0, 255].
+ *
+ * \tparam T The type of the values
+ * \tparam S The storage type
+ */
+template <typename T, storage_type S>
+struct compact_storage {
+    static_assert(S != storage_type::NATIVE, "compact_storage is only for compact storage types");
+
+    using value_type   = T;                                                                  ///< The type of the values
+    using storage_unit = std::conditional_t<S == storage_type::UINT8, uint8_t, uint16_t>; ///< The type of the stored values
+
+    /*!
+     * \brief Narrow one value
+     */
+    static storage_unit narrow(T value) {
+        if constexpr (S == storage_type::UINT8) {
+            return storage_unit(std::min(T(255), std::max(T(0), std::round(value))));
+        } else if constexpr (S == storage_type::FP16) {
+            return float_to_half(float(value));
+        } else {
+            return float_to_bf16(float(value));
+        }
+    }
+
+    /*!
+     * \brief Widen one value
+     */
+    static T widen(storage_unit value) {
+        if constexpr (S == storage_type::UINT8) {
+            return T(value);
+        } else if constexpr (S == storage_type::FP16) {
+            return T(half_to_float(value));
+        } else {
+            return T(bf16_to_float(value));
+        }
+    }
+
+    /*!
+     * \brief Initialize the storage for n samples of the given size
+     */
+    void init(size_t n, size_t sample_size) {
+        this->sample_size = sample_size;
+        values.assign(n * sample_size, storage_unit(0));
+    }
+
+    /*!
+     * \brief Release the memory of the storage
+     */
+    void clear() {
+        values.clear();
+        values.shrink_to_fit();
+    }
+
+    /*!
+     * \brief Returns the number of samples of the storage
+     */
+    size_t size() const {
+        return sample_size ? values.size() / sample_size : 0;
+    }
+
+    /*!
+     * \brief Returns the number of bytes used by the storage
+     */
+    size_t bytes() const {
+        return values.size() * sizeof(storage_unit);
+    }
+
+    /*!
+     * \brief Store consecutive samples, starting at the sample i
+     * \param i The index of the first sample
+     * \param samples The samples (any iterable of values)
+     */
+    template <typename E>
+    void set(size_t i, const E& samples) {
+        auto* out = values.data() + i * sample_size;
+
+        for (auto v : samples) {
+            *out++ = narrow(v);
+        }
+    }
+
+    /*!
+     * \brief Widen the sample i in the given memory
+     * \param i The index of the sample
+     * \param out The memory to widen the sample into
+     */
+    void get(size_t i, T* out) const {
+        const auto* in = values.data() + i * sample_size;
+
+        for (size_t k = 0; k < sample_size; ++k) {
+            out[k] = widen(in[k]);
+        }
+    }
+
+private:
+    std::vector<storage_unit> values; ///< The values
+    size_t sample_size = 0;           ///< The number of values of a sample
+};
+
+} //end of dll namespace
@@ -0,0 +1,313 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Compact storage of samples compressed by blocks
+ */
+
+#pragma once
+
+#include <array>
+#include <future>
+#include <vector>
+
+#include "dll/util/compact_storage.hpp"
+#include "dll/util/lz4.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Compact storage of a set of samples of the same size, compressed
+ * by blocks of B samples with LZ4.
+ *
+ * The samples are narrowed like with the compact storage. A block is
+ * compressed once all its samples have been stored, each sample must be
+ * stored only once. A few blocks are kept decompressed. The next blocks to
+ * be read can be decompressed ahead, on their own threads.
+ *
+ * The samples are read and prefetched by a single thread.
+ *
+ * \tparam T The type of the values
+ * \tparam S The storage type
+ * \tparam B The number of samples of a block
+ */
+template <typename T, storage_type S, size_t B>
+struct compressed_storage {
+    using compact_t    = compact_storage<T, S>;            ///< The compact storage, for the conversions
+    using value_type   = T;                                ///< The type of the values
+    using storage_unit = typename compact_t::storage_unit; ///< The type of the stored values
+
+    static constexpr size_t block = B; ///< The number of samples of a block
+    static constexpr size_t slots = 4; ///< The number of decompressed blocks
+
+    static_assert(B > 0, "The blocks need at least one sample");
+
+    /*!
+     * \brief Initialize the storage for n samples of the given size
+     */
+    void init(size_t n, size_t sample_size) {
+        reset_slots();
+
+        this->n           = n;
+        this->sample_size = sample_size;
+
+        const size_t blocks = (n + B - 1) / B;
+
+        compressed.assign(blocks, {});
+        staged.assign(blocks, {});
+        filled.assign(blocks, 0);
+    }
+
+    /*!
+     * \brief Release the memory of the storage
+     */
+    void clear() {
+        reset_slots();
+
+        n = 0;
+
+        compressed.clear();
+        staged.clear();
+        filled.clear();
+
+        compressed.shrink_to_fit();
+        staged.shrink_to_fit();
+        filled.shrink_to_fit();
+    }
+
+    /*!
+     * \brief Returns the number of samples of the storage
+     */
+    size_t size() const {
+        return n;
+    }
+
+    /*!
+     * \brief Returns the number of bytes used by the compressed blocks and
+     * the blocks not yet complete
+     */
+    size_t bytes() const {
+        size_t bytes = 0;
+
+        for (size_t b = 0; b < compressed.size(); ++b) {
+            bytes += compressed[b].size() + staged[b].size() * sizeof(storage_unit);
+        }
+
+        return bytes;
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the decompressed blocks
+     */
+    size_t decoded_bytes() const {
+        return slots * std::min(B, n) * sample_size * sizeof(storage_unit);
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the samples once narrowed but
+     * not compressed
+     */
+    size_t raw_bytes() const {
+        return n * sample_size * sizeof(storage_unit);
+    }
+
+    /*!
+     * \brief Store consecutive samples, starting at the sample i
+     * \param i The index of the first sample
+     * \param samples The samples (any iterable of values)
+     */
+    template <typename E>
+    void set(size_t i, const E& samples) {
+        const size_t block_size = B * sample_size;
+
+        size_t k = i * sample_size;
+
+        for (auto v : samples) {
+            const size_t b = k / block_size;
+
+            cpp_assert(compressed[b].empty(), "A sample of a compressed block can only be stored once");
+
+            if (staged[b].empty()) {
+                staged[b].resize(block_samples(b) * sample_size);
+            }
+
+            staged[b][k - b * block_size] = compact_t::narrow(v);
+
+            // The block is compressed as soon as all its samples are stored
+            if (++k % sample_size == 0 && ++filled[b] == block_samples(b)) {
+                compress(b);
+            }
+        }
+    }
+
+    /*!
+     * \brief Widen the sample i in the given memory
+     * \param i The index of the sample
+     * \param out The memory to widen the sample into
+     */
+    void get(size_t i, T* out) const {
+        const auto* in = block_values(i / B) + (i % B) * sample_size;
+
+        for (size_t k = 0; k < sample_size; ++k) {
+            out[k] = compact_t::widen(in[k]);
+        }
+    }
+
+    /*!
+     * \brief Decompress, on its own thread, the block of the sample i, if
+     * it is not already decompressed.
+     * \param i The index of the sample
+     */
+    void prefetch(size_t i) const {
+        const size_t b = i / B;
+
+        if (!staged[b].empty() || find(b)) {
+            return;
+        }
+
+        auto& slot = victim();
+
+        slot.block   = b;
+        slot.used    = ++clock;
+        slot.pending = std::async(std::launch::async, [this, &slot, b]() { decompress(b, slot.values); });
+    }
+
+private:
+    /*!
+     * \brief A decompressed block
+     */
+    struct decoded_block {
+        size_t block = size_t(-1);        ///< The index of the block
+        size_t used  = 0;                 ///< The last use of the slot
+        std::vector<storage_unit> values; ///< The decompressed values
+        std::future<void> pending;        ///< The decompression in progress
+    };
+
+    /*!
+     * \brief Returns the number of samples of the block b
+     */
+    size_t block_samples(size_t b) const {
+        return std::min(B, n - b * B);
+    }
+
+    /*!
+     * \brief Compress the staged block b
+     */
+    void compress(size_t b) {
+        lz4_compress(compressed[b], reinterpret_cast<const uint8_t*>(staged[b].data()), staged[b].size() * sizeof(storage_unit));
+
+        compressed[b].shrink_to_fit();
+
+        staged[b].clear();
+        staged[b].shrink_to_fit();
+    }
+
+    /*!
+     * \brief Decompress the block b into the given values
+     */
+    void decompress(size_t b, std::vector<storage_unit>& values) const {
+        values.resize(block_samples(b) * sample_size);
+
+        const bool valid = lz4_decompress(
+            reinterpret_cast<uint8_t*>(values.data()), values.size() * sizeof(storage_unit),
+            compressed[b].data(), compressed[b].size());
+
+        cpp_assert(valid, "Invalid compressed block");
+        cpp_unused(valid);
+    }
+
+    /*!
+     * \brief Returns the values of the block b, decompressing it if
+     * necessary
+     */
+    const storage_unit* block_values(size_t b) const {
+        // A block not yet complete is not compressed
+        if (!staged[b].empty()) {
+            return staged[b].data();
+        }
+
+        auto* slot = find(b);
+
+        if (!slot) {
+            slot = &victim();
+
+            slot->block = b;
+
+            decompress(b, slot->values);
+        } else if (slot->pending.valid()) {
+            slot->pending.get();
+        }
+
+        slot->used = ++clock;
+
+        return slot->values.data();
+    }
+
+    /*!
+     * \brief Returns the slot of the block b, if it is decompressed
+     */
+    decoded_block* find(size_t b) const {
+        for (auto& slot : decoded) {
+            if (slot.block == b) {
+                return &slot;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /*!
+     * \brief Returns the least recently used slot, once it is not used by
+     * a decompression anymore
+     */
+    decoded_block& victim() const {
+        auto* lru = &decoded[0];
+
+        for (auto& slot : decoded) {
+            if (slot.used < lru->used) {
+                lru = &slot;
+            }
+        }
+
+        if (lru->pending.valid()) {
+            lru->pending.get();
+        }
+
+        lru->block = size_t(-1);
+
+        return *lru;
+    }
+
+    /*!
+     * \brief Wait for the decompressions in progress and release the
+     * decompressed blocks
+     */
+    void reset_slots() {
+        for (auto& slot : decoded) {
+            if (slot.pending.valid()) {
+                slot.pending.get();
+            }
+
+            slot.block = size_t(-1);
+            slot.used  = 0;
+            slot.values.clear();
+        }
+    }
+
+    size_t n           = 0; ///< The number of samples
+    size_t sample_size = 0; ///< The number of values of a sample
+
+    std::vector<std::vector<uint8_t>> compressed;  ///< The compressed blocks
+    std::vector<std::vector<storage_unit>> staged; ///< The blocks not yet complete
+    std::vector<size_t> filled;                    ///< The number of samples stored in each block
+
+    mutable size_t clock = 0;                         ///< The clock of the uses of the slots
+    mutable std::array<decoded_block, slots> decoded; ///< The decompressed blocks, destroyed first
+};
+
+} //end of dll namespace
@@ -0,0 +1,172 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Streaming confusion matrix of a classification
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A confusion matrix, accumulated batch by batch.
+ *
+ * The rows are the expected classes and the columns the predicted classes.
+ * The number of classes is taken from the first batch if it is not given.
+ */
+struct confusion_matrix {
+    size_t classes = 0;         ///< The number of classes
+    std::vector<size_t> counts; ///< The counts, [expected x predicted]
+
+    confusion_matrix() = default;
+
+    /*!
+     * \brief Create an empty confusion matrix for the given number of classes
+     */
+    explicit confusion_matrix(size_t classes) : classes(classes), counts(classes * classes, 0) {}
+
+    /*!
+     * \brief Add the n first samples of a batch of output and of one-hot
+     * labels
+     */
+    template <typename Output, typename Labels>
+    void add_batch(const Output& output, const Labels& labels, size_t n) {
+        static_assert(etl::decay_traits<Output>::dimensions() == 2, "The confusion matrix only supports vector outputs");
+
+        cpu_access(output, labels);
+
+        if (!classes) {
+            *this = confusion_matrix(etl::dim<1>(output));
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            ++counts[etl::max_index(labels(i)) * classes + etl::max_index(output(i))];
+        }
+    }
+
+    /*!
+     * \brief Add the counts of another confusion matrix
+     */
+    void merge(const confusion_matrix& rhs) {
+        if (!rhs.classes) {
+            return;
+        }
+
+        if (!classes) {
+            *this = confusion_matrix(rhs.classes);
+        }
+
+        cpp_assert(classes == rhs.classes, "Cannot merge confusion matrices of different sizes");
+
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += rhs.counts[i];
+        }
+    }
+
+    /*!
+     * \brief Returns the number of samples of the expected class predicted
+     * as the given class
+     */
+    size_t operator()(size_t expected, size_t predicted) const {
+        return counts[expected * classes + predicted];
+    }
+
+    /*!
+     * \brief Returns the number of samples
+     */
+    size_t total() const {
+        size_t total = 0;
+
+        for (auto c : counts) {
+            total += c;
+        }
+
+        return total;
+    }
+
+    /*!
+     * \brief Returns the classification error
+     */
+    double error() const {
+        const size_t n = total();
+
+        if (!n) {
+            return 0.0;
+        }
+
+        size_t correct = 0;
+
+        for (size_t c = 0; c < classes; ++c) {
+            correct += (*this)(c, c);
+        }
+
+        return double(n - correct) / n;
+    }
+
+    /*!
+     * \brief Returns the precision of the given class
+     */
+    double precision(size_t c) const {
+        size_t predicted = 0;
+
+        for (size_t e = 0; e < classes; ++e) {
+            predicted += (*this)(e, c);
+        }
+
+        return predicted ? double((*this)(c, c)) / predicted : 0.0;
+    }
+
+    /*!
+     * \brief Returns the recall of the given class
+     */
+    double recall(size_t c) const {
+        size_t expected = 0;
+
+        for (size_t p = 0; p < classes; ++p) {
+            expected += (*this)(c, p);
+        }
+
+        return expected ? double((*this)(c, c)) / expected : 0.0;
+    }
+
+    /*!
+     * \brief Print the matrix, and the precision and the recall of each
+     * class, to the given stream
+     */
+    void print(std::ostream& os = std::cout) const {
+        char buffer[64];
+
+        os << "expected \\ predicted\n";
+
+        for (size_t e = 0; e < classes; ++e) {
+            snprintf(buffer, 64, "%4lu |", e);
+            os << buffer;
+
+            for (size_t p = 0; p < classes; ++p) {
+                snprintf(buffer, 64, " %6lu", (*this)(e, p));
+                os << buffer;
+            }
+
+            snprintf(buffer, 64, " | precision: %.4f recall: %.4f\n", precision(e), recall(e));
+            os << buffer;
+        }
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,327 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fast paths of the "same" convolutions with small kernels: a direct
+ * 3x3 convolution and a 1x1 convolution computed as a GEMM.
+ *
+ * All the convolutions are computed without flipping the kernels, like
+ * etl::ml::convolution_forward, with a stride of 1 and a padding of
+ * (NW - 1) / 2.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/conv_tuner.hpp" // for conv_workspace
+#include "dll/util/cpu.hpp"
+#include "dll/util/gpu.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The kernel used by a "same" convolution
+ */
+enum class same_conv_kernel {
+    ETL,        ///< The generic convolution of ETL
+    DIRECT_3X3, ///< The direct 3x3 convolution
+    GEMM_1X1    ///< The 1x1 convolution as a GEMM
+};
+
+/*!
+ * \brief Returns the kernel to use for a "same" convolution with filters
+ * of the given size
+ */
+constexpr same_conv_kernel select_same_conv_kernel(size_t nw1, size_t nw2) {
+    if (nw1 == 1 && nw2 == 1) {
+        return same_conv_kernel::GEMM_1X1;
+    } else if (nw1 == 3 && nw2 == 3) {
+        return same_conv_kernel::DIRECT_3X3;
+    }
+
+    return same_conv_kernel::ETL;
+}
+
+/*!
+ * \brief Indicates if the fast paths can be used for the given output and
+ * input types: 4D batches in directly accessible memory
+ */
+template <typename O, typename I>
+constexpr bool same_conv_fast_path = etl::decay_traits<I>::dimensions() == 4 && etl::all_dma<std::decay_t<O>, I>;
+
+namespace conv_direct_detail {
+
+/*!
+ * \brief Compute KB output channels of one sample with a direct 3x3
+ * convolution.
+ *
+ * The weights of the KB filters are kept in registers for each input
+ * channel and each input row is read once for the KB outputs.
+ *
+ * \param out The KB planes of output [KB x H x W]
+ * \param in The planes of input [C x H x W]
+ * \param w The KB filters [KB x C x 3 x 3]
+ */
+template <size_t KB, typename T>
+DLL_KERNEL_CLONES void conv3x3_block(T* out, const T* in, const T* w, size_t C, size_t H, size_t W) {
+    const size_t HW = H * W;
+
+    std::fill(out, out + KB * HW, T(0));
+
+    for (size_t c = 0; c < C; ++c) {
+        T wr[KB][9];
+
+        for (size_t kk = 0; kk < KB; ++kk) {
+            std::copy_n(w + (kk * C + c) * 9, 9, wr[kk]);
+        }
+
+        const T* plane = in + c * HW;
+
+        for (size_t y = 0; y < H; ++y) {
+            const T* rows[3] = {y > 0 ? plane + (y - 1) * W : nullptr, plane + y * W, y + 1 < H ? plane + (y + 1) * W : nullptr};
+
+            T* o = out + y * W;
+
+            for (size_t x = 0; x < W; ++x) {
+                T acc[KB] = {};
+
+                for (size_t p = 0; p < 3; ++p) {
+                    if (!rows[p]) {
+                        continue;
+                    }
+
+                    const T l = x > 0 ? rows[p][x - 1] : T(0);
+                    const T m = rows[p][x];
+                    const T r = x + 1 < W ? rows[p][x + 1] : T(0);
+
+                    for (size_t kk = 0; kk < KB; ++kk) {
+                        acc[kk] += wr[kk][3 * p] * l + wr[kk][3 * p + 1] * m + wr[kk][3 * p + 2] * r;
+                    }
+                }
+
+                for (size_t kk = 0; kk < KB; ++kk) {
+                    o[kk * HW + x] += acc[kk];
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Direct 3x3 "same" convolution of a batch, with the output
+ * channels processed by blocks of four
+ *
+ * \param out The output [B x K x H x W]
+ * \param in The input [B x C x H x W]
+ * \param w The filters [K x C x 3 x 3]
+ */
+template <typename T>
+void conv3x3(T* out, const T* in, const T* w, size_t B, size_t C, size_t K, size_t H, size_t W) {
+    constexpr size_t KB = 4;
+
+    const size_t HW = H * W;
+
+    for (size_t b = 0; b < B; ++b) {
+        size_t k = 0;
+
+        for (; k + KB <= K; k += KB) {
+            conv3x3_block<KB>(out + (b * K + k) * HW, in + b * C * HW, w + k * C * 9, C, H, W);
+        }
+
+        for (; k < K; ++k) {
+            conv3x3_block<1>(out + (b * K + k) * HW, in + b * C * HW, w + k * C * 9, C, H, W);
+        }
+    }
+}
+
+} //end of namespace conv_direct_detail
+
+/*!
+ * \brief Direct 3x3 "same" convolution of a batch of input with a set of
+ * filters.
+ * \param output The output [B x K x H x W]
+ * \param input The input [B x C x H x W]
+ * \param w The filters [K x C x 3 x 3]
+ */
+template <typename O, typename I, typename W>
+void direct_conv3x3_forward(O&& output, const I& input, const W& w) {
+    cpu_access(input, w);
+
+    conv_direct_detail::conv3x3(output.memory_start(), input.memory_start(), w.memory_start(),
+        etl::dim<0>(input), etl::dim<1>(w), etl::dim<0>(w), etl::dim<2>(input), etl::dim<3>(input));
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Gradients of a direct 3x3 "same" convolution with respect to its
+ * input.
+ *
+ * This is the "same" convolution of the errors with the transposed and
+ * flipped filters, computed with the same direct kernel.
+ *
+ * \param output The gradients of the input [B x C x H x W]
+ * \param errors The errors [B x K x H x W]
+ * \param w The filters [K x C x 3 x 3]
+ */
+template <typename O, typename E, typename W>
+void direct_conv3x3_backward(O&& output, const E& errors, const W& w) {
+    using T = etl::value_t<W>;
+
+    const size_t K = etl::dim<0>(w);
+    const size_t C = etl::dim<1>(w);
+
+    cpu_access(errors, w);
+
+    T* wt       = conv_workspace<T>(C * K * 9);
+    const T* wm = w.memory_start();
+
+    for (size_t k = 0; k < K; ++k) {
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t t = 0; t < 9; ++t) {
+                wt[(c * K + k) * 9 + t] = wm[(k * C + c) * 9 + (8 - t)];
+            }
+        }
+    }
+
+    conv_direct_detail::conv3x3(output.memory_start(), errors.memory_start(), wt,
+        etl::dim<0>(errors), K, C, etl::dim<2>(errors), etl::dim<3>(errors));
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Gradients of a direct 3x3 "same" convolution with respect to its
+ * filters.
+ * \param grad The gradients of the filters [K x C x 3 x 3]
+ * \param input The input [B x C x H x W]
+ * \param errors The errors [B x K x H x W]
+ */
+template <typename G, typename I, typename E>
+void direct_conv3x3_backward_filter(G&& grad, const I& input, const E& errors) {
+    using T = etl::value_t<std::decay_t<G>>;
+
+    const size_t B = etl::dim<0>(input);
+    const size_t C = etl::dim<1>(input);
+    const size_t H = etl::dim<2>(input);
+    const size_t W = etl::dim<3>(input);
+    const size_t K = etl::dim<1>(errors);
+
+    const size_t HW = H * W;
+
+    cpu_access(input, errors);
+
+    T* g       = grad.memory_start();
+    const T* i = input.memory_start();
+    const T* e = errors.memory_start();
+
+    std::fill(g, g + K * C * 9, T(0));
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t k = 0; k < K; ++k) {
+            const T* ek = e + (b * K + k) * HW;
+
+            for (size_t c = 0; c < C; ++c) {
+                const T* ic = i + (b * C + c) * HW;
+
+                for (size_t p = 0; p < 3; ++p) {
+                    // Output rows whose input row y + p - 1 is inside the image
+                    const size_t y_first = p == 0 ? 1 : 0;
+                    const size_t y_last  = p == 2 ? H - 1 : H;
+
+                    for (size_t q = 0; q < 3; ++q) {
+                        const size_t x_first = q == 0 ? 1 : 0;
+                        const size_t x_last  = q == 2 ? W - 1 : W;
+
+                        T sum(0);
+
+                        for (size_t y = y_first; y < y_last; ++y) {
+                            const T* er = ek + y * W;
+                            const T* ir = ic + (y + p - 1) * W;
+
+                            for (size_t x = x_first; x < x_last; ++x) {
+                                sum += er[x] * ir[x + q - 1];
+                            }
+                        }
+
+                        g[(k * C + c) * 9 + p * 3 + q] += sum;
+                    }
+                }
+            }
+        }
+    }
+
+    cpu_modified(grad);
+}
+
+/*!
+ * \brief 1x1 convolution of a batch of input with a set of filters, as one
+ * GEMM per sample.
+ * \param output The output [B x K x H x W]
+ * \param input The input [B x C x H x W]
+ * \param w The filters [K x C x 1 x 1]
+ */
+template <typename O, typename I, typename W>
+void gemm_conv1x1_forward(O&& output, const I& input, const W& w) {
+    const size_t K  = etl::dim<0>(w);
+    const size_t C  = etl::dim<1>(w);
+    const size_t HW = etl::dim<2>(input) * etl::dim<3>(input);
+
+    auto w_2d = etl::reshape(w, K, C);
+
+    for (size_t b = 0; b < etl::dim<0>(input); ++b) {
+        etl::reshape(output(b), K, HW) = w_2d * etl::reshape(input(b), C, HW);
+    }
+}
+
+/*!
+ * \brief Gradients of a 1x1 convolution with respect to its input, as one
+ * GEMM per sample.
+ * \param output The gradients of the input [B x C x H x W]
+ * \param errors The errors [B x K x H x W]
+ * \param w The filters [K x C x 1 x 1]
+ */
+template <typename O, typename E, typename W>
+void gemm_conv1x1_backward(O&& output, const E& errors, const W& w) {
+    const size_t K  = etl::dim<0>(w);
+    const size_t C  = etl::dim<1>(w);
+    const size_t HW = etl::dim<2>(errors) * etl::dim<3>(errors);
+
+    auto w_2d = etl::reshape(w, K, C);
+
+    for (size_t b = 0; b < etl::dim<0>(errors); ++b) {
+        etl::reshape(output(b), C, HW) = etl::trans(w_2d) * etl::reshape(errors(b), K, HW);
+    }
+}
+
+/*!
+ * \brief Gradients of a 1x1 convolution with respect to its filters, as one
+ * GEMM per sample.
+ * \param grad The gradients of the filters [K x C x 1 x 1]
+ * \param input The input [B x C x H x W]
+ * \param errors The errors [B x K x H x W]
+ */
+template <typename G, typename I, typename E>
+void gemm_conv1x1_backward_filter(G&& grad, const I& input, const E& errors) {
+    const size_t K  = etl::dim<0>(grad);
+    const size_t C  = etl::dim<1>(grad);
+    const size_t HW = etl::dim<2>(input) * etl::dim<3>(input);
+
+    auto g_2d = etl::reshape(grad, K, C);
+
+    g_2d = 0;
+
+    for (size_t b = 0; b < etl::dim<0>(input); ++b) {
+        g_2d += etl::reshape(errors(b), K, HW) * etl::trans(etl::reshape(input(b), C, HW));
+    }
+}
+
+} //end of dll namespace
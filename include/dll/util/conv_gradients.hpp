@@ -0,0 +1,149 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Gradients of the weights of the convolutional RBMs as GEMMs over
+ * the whole batch.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The maximum number of elements of the unrolled inputs of one GEMM
+ * of the convolutional weight gradients
+ */
+constexpr size_t conv_gradients_workspace = 1UL << 22;
+
+namespace conv_gradients_detail {
+
+/*!
+ * \brief Unroll the patches of one sample (im2col) into the rows of col and
+ * copy its hidden activations, multiplied by sign, into the columns of a
+ *
+ * \param col The unrolled patches [S x (C * NW1 * NW2)], one row per hidden position
+ * \param a The hidden activations [K x ld], the block of this sample starts at a
+ * \param ld The leading dimension of a
+ * \param v The visible units of the sample [C x NV1 x NV2]
+ * \param h The hidden activations of the sample [K x NH1 x NH2]
+ */
+template <typename T>
+void unroll_sample(T* col, T* a, size_t ld, const T* v, const T* h, T sign,
+                   size_t C, size_t NV1, size_t NV2, size_t K, size_t NH1, size_t NH2) {
+    const size_t NW1 = NV1 - NH1 + 1;
+    const size_t NW2 = NV2 - NH2 + 1;
+    const size_t S   = NH1 * NH2;
+    const size_t F   = C * NW1 * NW2;
+
+    for (size_t i = 0; i < NH1; ++i) {
+        for (size_t j = 0; j < NH2; ++j) {
+            T* row = col + (i * NH2 + j) * F;
+
+            for (size_t c = 0; c < C; ++c) {
+                for (size_t p = 0; p < NW1; ++p) {
+                    std::copy_n(v + (c * NV1 + i + p) * NV2 + j, NW2, row + (c * NW1 + p) * NW2);
+                }
+            }
+        }
+    }
+
+    for (size_t k = 0; k < K; ++k) {
+        for (size_t s = 0; s < S; ++s) {
+            a[k * ld + s] = sign * h[k * S + s];
+        }
+    }
+}
+
+} //end of namespace conv_gradients_detail
+
+/*!
+ * \brief Compute the gradients of the weights of a convolutional RBM, the
+ * difference of the positive and the negative correlations:
+ *
+ * grad(k, c) = sum_b corr(v_pos(b, c), h_pos(b, k)) - corr(v_neg(b, c), h_neg(b, k))
+ *
+ * The patches of all the samples of both phases are unrolled (im2col) and
+ * the negative activations are negated, the whole difference is then
+ * computed by a single GEMM (or several ones if the unrolled batch does not
+ * fit in the workspace).
+ *
+ * \param grad The gradients [K x C x NW1 x NW2]
+ * \param v_pos The positive visible units [B x C x NV1 x NV2]
+ * \param h_pos The positive hidden activations [B x K x NH1 x NH2]
+ * \param v_neg The negative visible units [B x C x NV1 x NV2]
+ * \param h_neg The negative hidden activations [B x K x NH1 x NH2]
+ */
+template <typename G, typename V, typename H>
+void cd_conv_weight_gradients(G&& grad, const V& v_pos, const H& h_pos, const V& v_neg, const H& h_neg) {
+    using T = etl::value_t<std::decay_t<G>>;
+
+    const size_t B   = etl::dim<0>(v_pos);
+    const size_t C   = etl::dim<1>(v_pos);
+    const size_t NV1 = etl::dim<2>(v_pos);
+    const size_t NV2 = etl::dim<3>(v_pos);
+    const size_t K   = etl::dim<1>(h_pos);
+    const size_t NH1 = etl::dim<2>(h_pos);
+    const size_t NH2 = etl::dim<3>(h_pos);
+
+    const size_t S = NH1 * NH2;
+    const size_t F = C * (NV1 - NH1 + 1) * (NV2 - NH2 + 1);
+
+    // The number of samples of each phase in one GEMM
+    const size_t Bc = std::max(size_t(1), std::min(B, conv_gradients_workspace / (2 * S * F)));
+
+    const size_t L = 2 * Bc * S;
+
+    etl::dyn_matrix<T, 2> a(K, L);
+    etl::dyn_matrix<T, 2> col(L, F);
+
+    cpu_access(v_pos, h_pos, v_neg, h_neg);
+
+    auto g = etl::reshape(grad, K, F);
+
+    for (size_t first = 0; first < B; first += Bc) {
+        const size_t n = std::min(Bc, B - first);
+
+        // The unused part of a last partial group does not contribute
+        if (n < Bc) {
+            a   = T(0);
+            col = T(0);
+        }
+
+        T* a_m   = a.memory_start();
+        T* col_m = col.memory_start();
+
+        parallel_kernel(0, 2 * n, [&](size_t t) {
+            const bool pos = t < n;
+            const size_t b = first + (pos ? t : t - n);
+            const size_t r = (pos ? t : Bc + t - n) * S;
+
+            const T* v = (pos ? v_pos : v_neg).memory_start() + b * C * NV1 * NV2;
+            const T* h = (pos ? h_pos : h_neg).memory_start() + b * K * S;
+
+            conv_gradients_detail::unroll_sample(col_m + r * F, a_m + r, L, v, h, pos ? T(1) : T(-1), C, NV1, NV2, K, NH1, NH2);
+        });
+
+        cpu_modified(a, col);
+
+        if (first == 0) {
+            g = a * col;
+        } else {
+            g += a * col;
+        }
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,542 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Auto-tuning of the convolution strategies
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A strategy to compute a convolution
+ */
+enum class conv_strategy {
+    ETL,   ///< Let ETL select the implementation
+    IM2COL ///< Lower the convolution to GEMM with an im2col workspace
+};
+
+/*!
+ * \brief Returns the workspace shared by all the convolutional layers of
+ * the current thread, with at least the given size.
+ */
+template <typename T>
+T* conv_workspace(size_t size) {
+    thread_local etl::dyn_matrix<T, 1> workspace;
+
+    if (etl::size(workspace) < size) {
+        workspace = etl::dyn_matrix<T, 1>(size);
+    }
+
+    return workspace.memory_start();
+}
+
+/*!
+ * \brief Selects, and remembers, the fastest convolution strategy for
+ * each operation and shape.
+ *
+ * The winners are cached in a file, keyed by the shape and by the CPU, so
+ * that the benchmarks are only run once per machine. The file is given by
+ * the DLL_CONV_CACHE environment variable, or is .dll_conv_cache in the
+ * home directory.
+ */
+struct conv_tuner {
+    /*!
+     * \brief Returns the tuner of the process
+     */
+    static conv_tuner& instance() {
+        static conv_tuner tuner;
+        return tuner;
+    }
+
+    /*!
+     * \brief Returns the strategy to use for the given key, running both
+     * strategies to find the fastest if it is not known.
+     *
+     * The benchmarks compute the real result, so the output is valid after
+     * this call whatever the strategy.
+     *
+     * \param key The key of the operation and shape
+     * \param etl_impl The operation computed by ETL
+     * \param im2col_impl The operation computed with im2col
+     */
+    template <typename F1, typename F2>
+    conv_strategy select(const std::string& key, F1&& etl_impl, F2&& im2col_impl) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            auto it = winners.find(cpu + ":" + key);
+            if (it != winners.end()) {
+                return it->second;
+            }
+        }
+
+        const auto etl_time    = benchmark(etl_impl);
+        const auto im2col_time = benchmark(im2col_impl);
+
+        const auto strategy = im2col_time < etl_time ? conv_strategy::IM2COL : conv_strategy::ETL;
+
+        std::lock_guard<std::mutex> l(lock);
+
+        if (winners.emplace(cpu + ":" + key, strategy).second) {
+            std::ofstream os(path(), std::ios::app);
+
+            if (os) {
+                os << cpu << ":" << key << " " << int(strategy) << " " << etl_time << " " << im2col_time << "\n";
+            }
+        }
+
+        return strategy;
+    }
+
+private:
+    std::mutex lock;                                        ///< The lock protecting the winners
+    std::string cpu;                                        ///< The signature of the CPU
+    std::unordered_map<std::string, conv_strategy> winners; ///< The known winners
+
+    conv_tuner() : cpu(cpu_signature()) {
+        std::ifstream is(path());
+
+        std::string key;
+        int strategy;
+        size_t etl_time;
+        size_t im2col_time;
+
+        while (is >> key >> strategy >> etl_time >> im2col_time) {
+            winners[key] = conv_strategy(strategy);
+        }
+    }
+
+    /*!
+     * \brief Returns the path to the cache file
+     */
+    static std::string path() {
+        if (auto* file = std::getenv("DLL_CONV_CACHE")) {
+            return file;
+        }
+
+        if (auto* home = std::getenv("HOME")) {
+            return std::string(home) + "/.dll_conv_cache";
+        }
+
+        return ".dll_conv_cache";
+    }
+
+    /*!
+     * \brief Returns a signature of the CPU, without spaces
+     */
+    static std::string cpu_signature() {
+        std::string model = "unknown";
+
+        std::ifstream is("/proc/cpuinfo");
+        std::string line;
+
+        while (std::getline(is, line)) {
+            if (line.compare(0, 10, "model name") == 0) {
+                model = line.substr(line.find(':') + 2);
+                break;
+            }
+        }
+
+        for (auto& c : model) {
+            if (c == ' ' || c == ':') {
+                c = '_';
+            }
+        }
+
+        return model + "_" + std::to_string(std::thread::hardware_concurrency());
+    }
+
+    /*!
+     * \brief Returns the best duration of the given operation, in microseconds
+     */
+    template <typename F>
+    static size_t benchmark(F&& functor) {
+        size_t best = std::numeric_limits<size_t>::max();
+
+        for (size_t i = 0; i < 3; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            functor();
+            auto end = std::chrono::steady_clock::now();
+
+            best = std::min(best, size_t(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()));
+        }
+
+        return best;
+    }
+};
+
+/*!
+ * \brief Returns the key of a convolution operation
+ */
+template <typename A, typename B>
+std::string conv_key(const char* op, const A& a, const B& b) {
+    std::string key = op;
+
+    for (size_t d = 0; d < 4; ++d) {
+        key += "_" + std::to_string(etl::dim(a, d));
+    }
+
+    for (size_t d = 0; d < 4; ++d) {
+        key += "_" + std::to_string(etl::dim(b, d));
+    }
+
+    return key;
+}
+
+/*!
+ * \brief Copy the windows of one sample of input in the columns of a
+ * [C * NW1 * NW2 x NH1 * NH2] matrix
+ */
+template <typename T, typename I>
+void im2col(T* col, const I& input, size_t b, size_t C, size_t NW1, size_t NW2, size_t NH1, size_t NH2) {
+    for (size_t c = 0; c < C; ++c) {
+        for (size_t p = 0; p < NW1; ++p) {
+            for (size_t q = 0; q < NW2; ++q) {
+                for (size_t i = 0; i < NH1; ++i) {
+                    for (size_t j = 0; j < NH2; ++j) {
+                        *col++ = input(b, c, i + p, j + q);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Valid convolution (without flipping) of a batch of input with a
+ * set of filters, lowered to one GEMM per sample.
+ * \param output The output [B x K x NH1 x NH2]
+ * \param input The input [B x C x NV1 x NV2]
+ * \param w The filters [K x C x NW1 x NW2]
+ */
+template <typename O, typename I, typename W>
+void im2col_conv_forward(O&& output, const I& input, const W& w) {
+    using T = etl::value_t<W>;
+
+    const size_t B = etl::dim<0>(input);
+    const size_t K = etl::dim<0>(w);
+    const size_t C = etl::dim<1>(w);
+    const size_t NW1 = etl::dim<2>(w);
+    const size_t NW2 = etl::dim<3>(w);
+    const size_t NH1 = etl::dim<2>(output);
+    const size_t NH2 = etl::dim<3>(output);
+
+    const size_t CW = C * NW1 * NW2;
+    const size_t NH = NH1 * NH2;
+
+    T* workspace = conv_workspace<T>(K * CW + CW * NH + K * NH);
+
+    auto w_2d   = etl::custom_dyn_matrix<T, 2>(workspace, K, CW);
+    auto col    = etl::custom_dyn_matrix<T, 2>(workspace + K * CW, CW, NH);
+    auto result = etl::custom_dyn_matrix<T, 2>(workspace + K * CW + CW * NH, K, NH);
+
+    cpu_access(input, w);
+
+    std::copy(w.memory_start(), w.memory_end(), workspace);
+
+    cpu_modified(w_2d);
+
+    for (size_t b = 0; b < B; ++b) {
+        im2col(workspace + K * CW, input, b, C, NW1, NW2, NH1, NH2);
+
+        cpu_modified(col);
+
+        result = w_2d * col;
+
+        cpu_access(result);
+
+        for (size_t k = 0; k < K; ++k) {
+            for (size_t i = 0; i < NH1; ++i) {
+                for (size_t j = 0; j < NH2; ++j) {
+                    output(b, k, i, j) = result(k, i * NH2 + j);
+                }
+            }
+        }
+    }
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Gradients of a valid convolution with respect to its input,
+ * lowered to one GEMM and one col2im per sample.
+ * \param output The gradients of the input [B x C x NV1 x NV2]
+ * \param errors The errors [B x K x NH1 x NH2]
+ * \param w The filters [K x C x NW1 x NW2]
+ * \tparam Flip Flip the filters before the convolution
+ */
+template <bool Flip = false, typename O, typename E, typename W>
+void im2col_conv_backward(O&& output, const E& errors, const W& w) {
+    using T = etl::value_t<W>;
+
+    const size_t B = etl::dim<0>(errors);
+    const size_t K = etl::dim<0>(w);
+    const size_t C = etl::dim<1>(w);
+    const size_t NW1 = etl::dim<2>(w);
+    const size_t NW2 = etl::dim<3>(w);
+    const size_t NH1 = etl::dim<2>(errors);
+    const size_t NH2 = etl::dim<3>(errors);
+
+    const size_t CW = C * NW1 * NW2;
+    const size_t NH = NH1 * NH2;
+
+    T* workspace = conv_workspace<T>(K * CW + K * NH + CW * NH);
+
+    auto w_2d  = etl::custom_dyn_matrix<T, 2>(workspace, K, CW);
+    auto e_2d  = etl::custom_dyn_matrix<T, 2>(workspace + K * CW, K, NH);
+    auto d_col = etl::custom_dyn_matrix<T, 2>(workspace + K * CW + K * NH, CW, NH);
+
+    cpu_access(errors, w);
+
+    if constexpr (Flip) {
+        const size_t NW = NW1 * NW2;
+
+        for (size_t f = 0; f < K * C; ++f) {
+            std::reverse_copy(w.memory_start() + f * NW, w.memory_start() + (f + 1) * NW, workspace + f * NW);
+        }
+    } else {
+        std::copy(w.memory_start(), w.memory_end(), workspace);
+    }
+
+    cpu_modified(w_2d);
+
+    output = 0;
+
+    cpu_access(output);
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t k = 0; k < K; ++k) {
+            for (size_t i = 0; i < NH1; ++i) {
+                for (size_t j = 0; j < NH2; ++j) {
+                    e_2d(k, i * NH2 + j) = errors(b, k, i, j);
+                }
+            }
+        }
+
+        cpu_modified(e_2d);
+
+        d_col = trans(w_2d) * e_2d;
+
+        cpu_access(d_col);
+
+        // col2im: accumulate the columns back in the input
+        const T* col = workspace + K * CW + K * NH;
+
+        for (size_t c = 0; c < C; ++c) {
+            for (size_t p = 0; p < NW1; ++p) {
+                for (size_t q = 0; q < NW2; ++q) {
+                    for (size_t i = 0; i < NH1; ++i) {
+                        for (size_t j = 0; j < NH2; ++j) {
+                            output(b, c, i + p, j + q) += *col++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Gradients of a valid convolution with respect to its filters,
+ * lowered to one GEMM per sample.
+ * \param grad The gradients of the filters [K x C x NW1 x NW2]
+ * \param input The input [B x C x NV1 x NV2]
+ * \param errors The errors [B x K x NH1 x NH2]
+ */
+template <typename G, typename I, typename E>
+void im2col_conv_backward_filter(G&& grad, const I& input, const E& errors) {
+    using T = etl::value_t<std::decay_t<G>>;
+
+    const size_t B = etl::dim<0>(input);
+    const size_t K = etl::dim<0>(grad);
+    const size_t C = etl::dim<1>(grad);
+    const size_t NW1 = etl::dim<2>(grad);
+    const size_t NW2 = etl::dim<3>(grad);
+    const size_t NH1 = etl::dim<2>(errors);
+    const size_t NH2 = etl::dim<3>(errors);
+
+    const size_t CW = C * NW1 * NW2;
+    const size_t NH = NH1 * NH2;
+
+    T* workspace = conv_workspace<T>(K * CW + K * NH + CW * NH);
+
+    auto g_2d = etl::custom_dyn_matrix<T, 2>(workspace, K, CW);
+    auto e_2d = etl::custom_dyn_matrix<T, 2>(workspace + K * CW, K, NH);
+    auto col  = etl::custom_dyn_matrix<T, 2>(workspace + K * CW + K * NH, CW, NH);
+
+    cpu_access(input, errors);
+
+    g_2d = 0;
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t k = 0; k < K; ++k) {
+            for (size_t i = 0; i < NH1; ++i) {
+                for (size_t j = 0; j < NH2; ++j) {
+                    e_2d(k, i * NH2 + j) = errors(b, k, i, j);
+                }
+            }
+        }
+
+        im2col(workspace + K * CW + K * NH, input, b, C, NW1, NW2, NH1, NH2);
+
+        cpu_modified(e_2d, col);
+
+        g_2d += e_2d * trans(col);
+    }
+
+    cpu_access(g_2d);
+
+    std::copy(workspace, workspace + K * CW, grad.memory_start());
+
+    cpu_modified(grad);
+}
+
+/*!
+ * \brief Transposed convolution of a batch of input with a set of filters,
+ * lowered to one GEMM and one col2im per sample.
+ *
+ * This computes the same result as etl::conv_4d_full_flipped.
+ *
+ * \param output The output [B x K x NV1 + NW1 - 1 x NV2 + NW2 - 1]
+ * \param input The input [B x C x NV1 x NV2]
+ * \param w The filters [C x K x NW1 x NW2]
+ */
+template <typename O, typename I, typename W>
+void im2col_deconv_forward(O&& output, const I& input, const W& w) {
+    im2col_conv_backward<true>(output, input, w);
+}
+
+/*!
+ * \brief Gradients of a transposed convolution with respect to its input,
+ * lowered to one GEMM per sample.
+ *
+ * This computes the same result as etl::conv_4d_valid_flipped.
+ *
+ * \param output The gradients of the input [B x C x NV1 x NV2]
+ * \param errors The errors [B x K x NH1 x NH2]
+ * \param w The filters [C x K x NW1 x NW2]
+ */
+template <typename O, typename E, typename W>
+void im2col_deconv_backward(O&& output, const E& errors, const W& w) {
+    im2col_conv_forward(output, errors, w);
+}
+
+/*!
+ * \brief Gradients of a transposed convolution with respect to its
+ * filters, lowered to one GEMM per sample.
+ *
+ * This computes the same result as etl::conv_4d_valid_filter_flipped.
+ *
+ * \param grad The gradients of the filters [C x K x NW1 x NW2]
+ * \param input The input [B x C x NV1 x NV2]
+ * \param errors The errors [B x K x NH1 x NH2]
+ */
+template <typename G, typename I, typename E>
+void im2col_deconv_backward_filter(G&& grad, const I& input, const E& errors) {
+    im2col_conv_backward_filter(grad, errors, input);
+}
+
+/*!
+ * \brief Valid convolution of a batch with the fastest strategy for its shape
+ */
+template <typename O, typename I, typename W>
+void tuned_conv_forward(O&& output, const I& input, const W& w) {
+    static thread_local std::unordered_map<std::string, conv_strategy> local;
+
+    auto key = conv_key("forward", input, w);
+    auto it  = local.find(key);
+
+    if (it == local.end()) {
+        auto strategy = conv_tuner::instance().select(key,
+            [&] { output = etl::ml::convolution_forward(input, w); },
+            [&] { im2col_conv_forward(output, input, w); });
+
+        local[key] = strategy;
+
+        // The output has already been computed by the benchmarks
+        return;
+    }
+
+    if (it->second == conv_strategy::IM2COL) {
+        im2col_conv_forward(output, input, w);
+    } else {
+        output = etl::ml::convolution_forward(input, w);
+    }
+}
+
+/*!
+ * \brief Gradients of a convolution with respect to its input, with the
+ * fastest strategy for its shape
+ */
+template <typename O, typename E, typename W>
+void tuned_conv_backward(O&& output, const E& errors, const W& w) {
+    static thread_local std::unordered_map<std::string, conv_strategy> local;
+
+    auto key = conv_key("backward", errors, w);
+    auto it  = local.find(key);
+
+    if (it == local.end()) {
+        local[key] = conv_tuner::instance().select(key,
+            [&] { output = etl::ml::convolution_backward(errors, w); },
+            [&] { im2col_conv_backward(output, errors, w); });
+
+        return;
+    }
+
+    if (it->second == conv_strategy::IM2COL) {
+        im2col_conv_backward(output, errors, w);
+    } else {
+        output = etl::ml::convolution_backward(errors, w);
+    }
+}
+
+/*!
+ * \brief Gradients of a convolution with respect to its filters, with the
+ * fastest strategy for its shape
+ */
+template <typename G, typename I, typename E>
+void tuned_conv_backward_filter(G&& grad, const I& input, const E& errors) {
+    static thread_local std::unordered_map<std::string, conv_strategy> local;
+
+    auto key = conv_key("filter", input, errors);
+    auto it  = local.find(key);
+
+    if (it == local.end()) {
+        local[key] = conv_tuner::instance().select(key,
+            [&] { grad = etl::ml::convolution_backward_filter(input, errors); },
+            [&] { im2col_conv_backward_filter(grad, input, errors); });
+
+        return;
+    }
+
+    if (it->second == conv_strategy::IM2COL) {
+        im2col_conv_backward_filter(grad, input, errors);
+    } else {
+        grad = etl::ml::convolution_backward_filter(input, errors);
+    }
+}
+
+} //end of dll namespace
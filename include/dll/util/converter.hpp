@@ -12,11 +12,47 @@
 #include <list>
 #include <vector>
 #include <deque>
+#include <iterator>
+#include <utility>
+
+#include "dll/util/parallel.hpp"
 
 namespace dll {
 
 #define debug_convert(X) etl::inc_counter(X)
 
+namespace converter_detail {
+
+/*!
+ * \brief Returns a view of the given expression with the dimensions of the
+ * given shape
+ */
+template <typename E, typename S, size_t... I>
+decltype(auto) reshape_as(const E& from, const S& shape, std::index_sequence<I...> /*seq*/) {
+    return etl::reshape(from, etl::dim(shape, I)...);
+}
+
+/*!
+ * \brief Returns a view of the given contiguous expression with the D
+ * dimensions of the input of the layer, without copying it.
+ *
+ * The expression is returned as is when it already has D dimensions.
+ */
+template <size_t D, typename T, typename L, typename E>
+decltype(auto) input_view(const L& l, const E& from) {
+    if constexpr (etl::dimensions<E>() == D) {
+        return from;
+    } else if constexpr (D == 1) {
+        return etl::reshape(from, etl::size(from));
+    } else {
+        etl::dyn_matrix<T, D> shape;
+        l.prepare_input(shape);
+        return reshape_as(from, shape, std::make_index_sequence<D>());
+    }
+}
+
+} //end of namespace converter_detail
+
 /*!
  * \brief Simple helper to form nicer display for static_assert
  */
@@ -291,11 +327,15 @@ struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_
      * \return the converted result
      */
     template<typename L>
-    static etl::fast_dyn_matrix<T_T, Dims2...> convert(const L&, const etl::fast_dyn_matrix<T_F, Dims...>& from){
-        debug_convert("converter::one");
-        etl::fast_dyn_matrix<T_T, Dims2...> c;
-        c = from;
-        return c;
+    static decltype(auto) convert(const L&, const etl::fast_dyn_matrix<T_F, Dims...>& from){
+        if constexpr (std::is_same<T_F, T_T>::value) {
+            return etl::reshape<Dims2...>(from);
+        } else {
+            debug_convert("converter::one");
+            etl::fast_dyn_matrix<T_T, Dims2...> c;
+            c = from;
+            return c;
+        }
     }
 };
 
@@ -315,11 +355,15 @@ struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::fast_dyn_matrix<T_T, D
      * \return the converted result
      */
     template<typename L>
-    static etl::fast_dyn_matrix<T_T, Dims2...> convert(const L&, const etl::fast_matrix<T_F, Dims...>& from){
-        debug_convert("converter::one");
-        etl::fast_dyn_matrix<T_T, Dims2...> c;
-        c = from;
-        return c;
+    static decltype(auto) convert(const L&, const etl::fast_matrix<T_F, Dims...>& from){
+        if constexpr (std::is_same<T_F, T_T>::value) {
+            return etl::reshape<Dims2...>(from);
+        } else {
+            debug_convert("converter::one");
+            etl::fast_dyn_matrix<T_T, Dims2...> c;
+            c = from;
+            return c;
+        }
     }
 };
 
@@ -339,12 +383,16 @@ struct converter_one<etl::fast_dyn_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>
      * \return the converted result
      */
     template<typename L>
-    static etl::dyn_matrix<T_T, D> convert(const L& l, const etl::fast_dyn_matrix<T_F, Dims...>& from){
-        debug_convert("converter::one");
-        etl::dyn_matrix<T_T, D> converted;
-        l.prepare_input(converted);
-        converted = from;
-        return converted;
+    static decltype(auto) convert(const L& l, const etl::fast_dyn_matrix<T_F, Dims...>& from){
+        if constexpr (std::is_same<T_F, T_T>::value) {
+            return converter_detail::input_view<D, T_T>(l, from);
+        } else {
+            debug_convert("converter::one");
+            etl::dyn_matrix<T_T, D> converted;
+            l.prepare_input(converted);
+            converted = from;
+            return converted;
+        }
     }
 };
 
@@ -364,12 +412,16 @@ struct converter_one<etl::fast_matrix<T_F, Dims...>, etl::dyn_matrix<T_T, D>> {
      * \return the converted result
      */
     template<typename L>
-    static etl::dyn_matrix<T_T, D> convert(const L& l, const etl::fast_matrix<T_F, Dims...>& from){
-        debug_convert("converter::one");
-        etl::dyn_matrix<T_T, D> converted;
-        l.prepare_input(converted);
-        converted = from;
-        return converted;
+    static decltype(auto) convert(const L& l, const etl::fast_matrix<T_F, Dims...>& from){
+        if constexpr (std::is_same<T_F, T_T>::value) {
+            return converter_detail::input_view<D, T_T>(l, from);
+        } else {
+            debug_convert("converter::one");
+            etl::dyn_matrix<T_T, D> converted;
+            l.prepare_input(converted);
+            converted = from;
+            return converted;
+        }
     }
 };
 
@@ -389,11 +441,15 @@ struct converter_one<etl::dyn_matrix<T_F, D>, etl::fast_dyn_matrix<T_T, Dims...>
      * \return the converted result
      */
     template<typename L>
-    static etl::fast_dyn_matrix<T_T, Dims...> convert(const L&, const etl::dyn_matrix<T_F, D>& from){
-        debug_convert("converter::one");
-        etl::fast_dyn_matrix<T_T, Dims...> c;
-        c = from;
-        return c;
+    static decltype(auto) convert(const L&, const etl::dyn_matrix<T_F, D>& from){
+        if constexpr (std::is_same<T_F, T_T>::value) {
+            return etl::reshape<Dims...>(from);
+        } else {
+            debug_convert("converter::one");
+            etl::fast_dyn_matrix<T_T, Dims...> c;
+            c = from;
+            return c;
+        }
     }
 };
 
@@ -437,12 +493,16 @@ struct converter_one<etl::dyn_matrix<T_F, D>, etl::dyn_matrix<T_T, D2>, std::ena
      * \return the converted result
      */
     template<typename L>
-    static etl::dyn_matrix<T_T, D2> convert(const L& l, const etl::dyn_matrix<T_F, D>& from){
-        debug_convert("converter::one");
-        etl::dyn_matrix<T_T, D2> converted;
-        l.prepare_input(converted);
-        converted = from;
-        return converted;
+    static decltype(auto) convert(const L& l, const etl::dyn_matrix<T_F, D>& from){
+        if constexpr (std::is_same<T_F, T_T>::value) {
+            return converter_detail::input_view<D2, T_T>(l, from);
+        } else {
+            debug_convert("converter::one");
+            etl::dyn_matrix<T_T, D2> converted;
+            l.prepare_input(converted);
+            converted = from;
+            return converted;
+        }
     }
 };
 
@@ -452,17 +512,31 @@ struct converter_many {
 };
 
 // Only convert the sub types not the outer container
+// The samples of random access containers are converted in one parallel pass
 template<template<typename...> typename Container, typename From, typename To>
 struct converter_many <Container<From>, Container<To>> {
     template<typename L>
     static Container<To> convert(const L& l, const Container<From>& from){
         debug_convert("converter::many");
-        Container<To> to;
-        to.reserve(from.size());
-        for(auto& value : from){
-            to.emplace_back(converter_one<From, To>::convert(l, value));
+
+        using iterator_category = typename std::iterator_traits<typename Container<From>::const_iterator>::iterator_category;
+
+        if constexpr (std::is_base_of<std::random_access_iterator_tag, iterator_category>::value) {
+            Container<To> to(from.size());
+
+            parallel_kernel(0, from.size(), [&](size_t i) {
+                to[i] = converter_one<From, To>::convert(l, from[i]);
+            });
+
+            return to;
+        } else {
+            Container<To> to;
+            for(auto& value : from){
+                to.emplace_back();
+                to.back() = converter_one<From, To>::convert(l, value);
+            }
+            return to;
         }
-        return to;
     }
 };
 
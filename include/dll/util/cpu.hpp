@@ -0,0 +1,91 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Runtime dispatch of the DLL kernels on the instruction sets of
+ * the CPU.
+ *
+ * When DLL_CPU_DISPATCH is defined, the leaf kernels annotated with
+ * DLL_KERNEL_CLONES are compiled once for each of AVX-512, AVX2, SSE4.2
+ * and the baseline and the best version for the CPU is selected once, by
+ * the loader, from CPUID. This lets a single portable binary use the wide
+ * instructions of the machine it is running on. This is only supported
+ * by GCC and Clang on x86-64 Linux, the macro is empty otherwise.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace dll {
+
+#if defined(DLL_CPU_DISPATCH) && defined(__x86_64__) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+#define DLL_KERNEL_CLONES __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+#define DLL_KERNEL_CLONES_ENABLED
+#else
+#define DLL_KERNEL_CLONES
+#endif
+
+/*!
+ * \brief The instruction sets of the CPU used by the kernels
+ */
+struct cpu_features {
+    bool sse4_2  = false; ///< SSE 4.2 is supported
+    bool avx2    = false; ///< AVX2 is supported
+    bool avx512f = false; ///< AVX-512 (foundation) is supported
+
+    /*!
+     * \brief Returns the name of the widest supported instruction set
+     */
+    std::string name() const {
+        if (avx512f) {
+            return "avx512f";
+        } else if (avx2) {
+            return "avx2";
+        } else if (sse4_2) {
+            return "sse4.2";
+        } else {
+            return "default";
+        }
+    }
+};
+
+/*!
+ * \brief Returns the instruction sets of the CPU, detected once
+ */
+inline const cpu_features& get_cpu_features() {
+    static const cpu_features features = [] {
+        cpu_features f;
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+
+        f.sse4_2  = __builtin_cpu_supports("sse4.2");
+        f.avx2    = __builtin_cpu_supports("avx2");
+        f.avx512f = __builtin_cpu_supports("avx512f");
+#endif
+
+        return f;
+    }();
+
+    return features;
+}
+
+/*!
+ * \brief Returns the instruction set used by the DLL kernels, "default"
+ * if the runtime dispatch is disabled
+ */
+inline std::string kernels_instruction_set() {
+#ifdef DLL_KERNEL_CLONES_ENABLED
+    return get_cpu_features().name();
+#else
+    return "default";
+#endif
+}
+
+} //end of dll namespace
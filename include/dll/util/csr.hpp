@@ -0,0 +1,225 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Compressed Sparse Row (CSR) batches and their products with dense
+ * matrices, for the layers with sparse input.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/sparse_rows.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A batch of samples in Compressed Sparse Row format.
+ *
+ * Only the non-zero values of each sample are stored, with their column.
+ */
+template <typename T>
+struct csr_batch {
+    size_t rows    = 0;            ///< The number of samples
+    size_t columns = 0;            ///< The number of features of each sample
+    std::vector<size_t> row_start; ///< The first non-zero of each sample, and the total number of non-zeros
+    std::vector<size_t> indices;   ///< The column of each non-zero
+    std::vector<T> values;         ///< The value of each non-zero
+
+    csr_batch() = default;
+
+    /*!
+     * \brief Build the CSR batch of the given dense batch [B x N]
+     */
+    template <typename M>
+    explicit csr_batch(const M& batch) {
+        assign(batch);
+    }
+
+    /*!
+     * \brief Set the CSR batch to the non-zeros of the given dense batch
+     * [B x N].
+     *
+     * The memory of the previous batch is reused.
+     */
+    template <typename M>
+    void assign(const M& batch) {
+        static_assert(etl::decay_traits<M>::dimensions() == 2, "Only 2D batches can be converted to CSR");
+
+        cpu_access(batch);
+
+        rows    = etl::dim<0>(batch);
+        columns = etl::dim<1>(batch);
+
+        row_start.resize(rows + 1);
+        indices.clear();
+        values.clear();
+
+        const T* in = batch.memory_start();
+
+        for (size_t r = 0; r < rows; ++r) {
+            row_start[r] = values.size();
+
+            for (size_t c = 0; c < columns; ++c) {
+                const T v = in[r * columns + c];
+
+                if (v != T(0)) {
+                    indices.push_back(c);
+                    values.push_back(v);
+                }
+            }
+        }
+
+        row_start[rows] = values.size();
+    }
+
+    /*!
+     * \brief Returns the number of non-zeros
+     */
+    size_t nnz() const {
+        return values.size();
+    }
+
+    /*!
+     * \brief Returns the ratio of non-zeros
+     */
+    double density() const {
+        return rows && columns ? double(nnz()) / (rows * columns) : 0.0;
+    }
+};
+
+/*!
+ * \brief Returns the CSR batch of the calling thread, to convert the
+ * batches without allocating each time.
+ */
+template <typename T>
+csr_batch<T>& csr_workspace() {
+    thread_local csr_batch<T> csr;
+    return csr;
+}
+
+/*!
+ * \brief Compute the product of a CSR batch with a dense matrix.
+ *
+ * Each output row is the sum of the rows of the matrix of the non-zeros of
+ * the sample, the cost is proportional to the number of non-zeros.
+ *
+ * \param output The output [B x H]
+ * \param csr The sparse batch [B x V]
+ * \param w The matrix [V x H]
+ */
+template <typename O, typename T, typename W>
+void csr_mul(O&& output, const csr_batch<T>& csr, const W& w) {
+    const size_t H = etl::dim<1>(w);
+
+    cpu_access(w);
+
+    const T* wm = w.memory_start();
+    T* out      = output.memory_start();
+
+    parallel_kernel(0, csr.rows, [&](size_t r) {
+        T* o = out + r * H;
+
+        std::fill_n(o, H, T(0));
+
+        for (size_t k = csr.row_start[r]; k < csr.row_start[r + 1]; ++k) {
+            const T v   = csr.values[k];
+            const T* wr = wm + csr.indices[k] * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                o[j] += v * wr[j];
+            }
+        }
+    });
+
+    cpu_modified(output);
+}
+
+namespace csr_detail {
+
+/*!
+ * \brief Accumulate the outer products of a CSR batch and a dense batch
+ * into the rows of the gradients of the non-zero columns
+ */
+template <typename G, typename T, typename E>
+void accumulate_outer(G& grad, const csr_batch<T>& csr, const E& errors) {
+    const size_t H = etl::dim<1>(errors);
+
+    cpu_access(errors);
+
+    const T* e = errors.memory_start();
+    T* g       = grad.memory_start();
+
+    for (size_t r = 0; r < csr.rows; ++r) {
+        const T* er = e + r * H;
+
+        for (size_t k = csr.row_start[r]; k < csr.row_start[r + 1]; ++k) {
+            const T v = csr.values[k];
+            T* gr     = g + csr.indices[k] * H;
+
+            for (size_t j = 0; j < H; ++j) {
+                gr[j] += v * er[j];
+            }
+        }
+    }
+
+    cpu_modified(grad);
+}
+
+} //end of namespace csr_detail
+
+/*!
+ * \brief Compute the outer product of a CSR batch and a dense batch,
+ * grad = csr^T * errors.
+ *
+ * \param grad The gradients [V x H]
+ * \param csr The sparse batch [B x V]
+ * \param errors The dense batch [B x H]
+ */
+template <typename G, typename T, typename E>
+void csr_batch_outer(G&& grad, const csr_batch<T>& csr, const E& errors) {
+    grad = 0;
+
+    csr_detail::accumulate_outer(grad, csr, errors);
+}
+
+/*!
+ * \brief Compute the sparse gradients of a layer with sparse input.
+ *
+ * Like for the embeddings, the rows touched by the previous batch are
+ * cleared and only the rows of the non-zero columns of the batch are
+ * computed and given to the updater.
+ *
+ * \param sub The updater sub context of the weights
+ * \param csr The sparse batch of input [B x V]
+ * \param errors The batch of errors [B x H]
+ */
+template <typename Sub, typename T, typename E>
+void sparse_csr_gradients(Sub& sub, const csr_batch<T>& csr, const E& errors) {
+    auto& grad = sub.grad;
+    auto& rows = sub.rows;
+
+    for (auto r : rows) {
+        grad(r) = 0;
+    }
+
+    rows.assign(csr.indices.begin(), csr.indices.end());
+
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    csr_detail::accumulate_outer(grad, csr, errors);
+}
+
+} //end of dll namespace
@@ -0,0 +1,62 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernels of the backward pass of the dense layers
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "dll/function.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the number of rows of errors processed by one step of the
+ * fused backward pass of a dense layer with the given number of hidden
+ * units.
+ *
+ * A tile of rows stays in cache between the derivative, the reduction of
+ * the biases and the product with the weights, while being tall enough for
+ * the product to remain efficient.
+ */
+constexpr size_t dense_backward_rows(size_t hidden) {
+    return std::max(size_t(32), (size_t(1) << 16) / std::max(hidden, size_t(1)));
+}
+
+/*!
+ * \brief Multiply the rows [first, last) of the errors by the derivative of
+ * the activation function F and accumulate them into the gradients of the
+ * biases, in a single sweep.
+ *
+ * \param errors The errors of the layer [Batch x H]
+ * \param output The output of the layer [Batch x H]
+ * \param b_grad The gradients of the biases (H values), nullptr if the layer has none
+ */
+template <function F, typename T>
+void dense_derivative_rows(T* errors, const T* output, T* b_grad, size_t first, size_t last, size_t H) {
+    for (size_t b = first; b < last; ++b) {
+        T* e       = errors + b * H;
+        const T* o = output + b * H;
+
+        if (b_grad) {
+            for (size_t j = 0; j < H; ++j) {
+                e[j] *= f_derivative_scalar<F>(o[j]);
+                b_grad[j] += e[j];
+            }
+        } else {
+            for (size_t j = 0; j < H; ++j) {
+                e[j] *= f_derivative_scalar<F>(o[j]);
+            }
+        }
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,615 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Communication between the ranks of a distributed training, over a
+ * ring of TCP sockets
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace dll {
+
+/*!
+ * \brief A communicator between the ranks of a distributed training.
+ *
+ * The ranks are connected in a ring: each rank is connected to the next
+ * rank, (rank + 1) % size, and accepts the connection of the previous one.
+ * The collective operations must be called in the same order by all the
+ * ranks.
+ */
+struct communicator {
+    communicator() = default;
+
+    communicator(const communicator& rhs) = delete;
+    communicator& operator=(const communicator& rhs) = delete;
+
+    /*!
+     * \brief Close the connections
+     */
+    ~communicator() {
+        close_sockets();
+    }
+
+    /*!
+     * \brief Connect this rank to the ring.
+     *
+     * \param rank The rank of this process
+     * \param peers The endpoints (host:port) of all the ranks, in order of rank
+     * \param timeout The maximum time to wait for the next rank, in seconds
+     *
+     * \return true if the ring is connected, false otherwise
+     */
+    bool connect(size_t rank, const std::vector<std::string>& peers, size_t timeout = 60) {
+        close_sockets();
+
+        rank_ = rank;
+        size_ = std::max(peers.size(), size_t(1));
+
+        if (rank_ >= size_) {
+            std::cerr << "ERROR: Invalid rank " << rank_ << " for " << size_ << " ranks" << std::endl;
+            return false;
+        }
+
+        if (size_ == 1) {
+            return true;
+        }
+
+        // Listen first, so that the previous rank can connect at any time
+        if (!listen_on(peers[rank_])) {
+            std::cerr << "ERROR: Impossible to listen on " << peers[rank_] << std::endl;
+            return false;
+        }
+
+        if (!connect_to(peers[(rank_ + 1) % size_], timeout)) {
+            std::cerr << "ERROR: Impossible to connect to " << peers[(rank_ + 1) % size_] << std::endl;
+            close_sockets();
+            return false;
+        }
+
+        prev_fd = ::accept(listen_fd, nullptr, nullptr);
+
+        ::close(listen_fd);
+        listen_fd = -1;
+
+        if (prev_fd < 0) {
+            std::cerr << "ERROR: Impossible to accept the previous rank" << std::endl;
+            close_sockets();
+            return false;
+        }
+
+        configure(prev_fd);
+
+        // Check that the ring is coherent
+        uint32_t id      = uint32_t(rank_);
+        uint32_t prev_id = 0;
+
+        send_all(&id, sizeof(id));
+
+        if (!recv_all(&prev_id, sizeof(prev_id)) || prev_id != (rank_ + size_ - 1) % size_) {
+            std::cerr << "ERROR: Invalid previous rank in the ring" << std::endl;
+            close_sockets();
+            return false;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Connect this rank to the ring described by the environment.
+     *
+     * DLL_RANK is the rank of this process and DLL_PEERS the comma-separated
+     * list of the endpoints (host:port) of all the ranks. Without these
+     * variables, the communicator has a single rank.
+     *
+     * \return true if the ring is connected, false otherwise
+     */
+    bool connect_from_environment() {
+        auto* rank  = std::getenv("DLL_RANK");
+        auto* peers = std::getenv("DLL_PEERS");
+
+        if (!rank || !peers) {
+            return connect(0, {});
+        }
+
+        std::vector<std::string> endpoints;
+
+        std::string list(peers);
+        size_t start = 0;
+
+        while (start <= list.size()) {
+            const size_t end = std::min(list.find(',', start), list.size());
+
+            if (end > start) {
+                endpoints.push_back(list.substr(start, end - start));
+            }
+
+            start = end + 1;
+        }
+
+        return connect(std::strtoul(rank, nullptr, 10), endpoints);
+    }
+
+    /*!
+     * \brief Returns the rank of this process
+     */
+    size_t rank() const {
+        return rank_;
+    }
+
+    /*!
+     * \brief Returns the number of ranks
+     */
+    size_t size() const {
+        return size_;
+    }
+
+    /*!
+     * \brief Sum the given values over all the ranks, in place.
+     *
+     * This is a ring all-reduce: the values are split in one chunk per
+     * rank, the chunks are first reduced around the ring (reduce-scatter)
+     * and the reduced chunks are then passed around the ring (all-gather).
+     * Each rank sends and receives 2 * (size - 1) / size of the values and
+     * all the ranks get exactly the same sums.
+     *
+     * \param data The values
+     * \param n The number of values
+     */
+    template <typename T>
+    void all_reduce(T* data, size_t n) {
+        if (size_ == 1 || !n) {
+            return;
+        }
+
+        const size_t P = size_;
+
+        auto first = [n, P](size_t c) { return (c % P) * n / P; };
+        auto count = [n, P, &first](size_t c) { return ((c % P) + 1) * n / P - first(c); };
+
+        buffer.resize(((n + P - 1) / P) * sizeof(T));
+
+        T* recv = reinterpret_cast<T*>(buffer.data());
+
+        // Reduce-scatter: after this, the rank owns the sum of the chunk rank + 1
+
+        for (size_t s = 0; s < P - 1; ++s) {
+            const size_t send_chunk = rank_ + P - s;
+            const size_t recv_chunk = rank_ + P - s - 1;
+
+            exchange(data + first(send_chunk), count(send_chunk) * sizeof(T), recv, count(recv_chunk) * sizeof(T));
+
+            T* out = data + first(recv_chunk);
+
+            for (size_t i = 0; i < count(recv_chunk); ++i) {
+                out[i] += recv[i];
+            }
+        }
+
+        // All-gather: pass the reduced chunks around the ring
+
+        for (size_t s = 0; s < P - 1; ++s) {
+            const size_t send_chunk = rank_ + P + 1 - s;
+            const size_t recv_chunk = rank_ + P - s;
+
+            exchange(data + first(send_chunk), count(send_chunk) * sizeof(T), data + first(recv_chunk), count(recv_chunk) * sizeof(T));
+        }
+    }
+
+    /*!
+     * \brief Broadcast the values of the rank 0 to all the ranks, along the
+     * ring
+     *
+     * \param data The values
+     * \param n The number of values
+     */
+    template <typename T>
+    void broadcast(T* data, size_t n) {
+        if (size_ == 1 || !n) {
+            return;
+        }
+
+        if (rank_ > 0) {
+            recv_all(data, n * sizeof(T));
+        }
+
+        if (rank_ + 1 < size_) {
+            send_all(data, n * sizeof(T));
+        }
+    }
+
+    /*!
+     * \brief Wait until all the ranks have reached the barrier
+     */
+    void barrier() {
+        double value = 0.0;
+        all_reduce(&value, 1);
+    }
+
+private:
+    /*!
+     * \brief Split an endpoint into its host and its port
+     */
+    static std::pair<std::string, std::string> split_endpoint(const std::string& endpoint) {
+        const size_t colon = endpoint.rfind(':');
+
+        if (colon == std::string::npos) {
+            return {"127.0.0.1", endpoint};
+        }
+
+        return {endpoint.substr(0, colon), endpoint.substr(colon + 1)};
+    }
+
+    /*!
+     * \brief Configure a connected socket
+     */
+    static void configure(int fd) {
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    /*!
+     * \brief Open the listening socket on the port of the given endpoint
+     */
+    bool listen_on(const std::string& endpoint) {
+        auto [host, port] = split_endpoint(endpoint);
+
+        listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+        if (listen_fd < 0) {
+            return false;
+        }
+
+        int one = 1;
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in address{};
+        address.sin_family      = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port        = htons(uint16_t(std::strtoul(port.c_str(), nullptr, 10)));
+
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listen_fd, 1) < 0) {
+            ::close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Connect to the given endpoint, retrying until the timeout
+     */
+    bool connect_to(const std::string& endpoint, size_t timeout) {
+        auto [host, port] = split_endpoint(endpoint);
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+
+        while (true) {
+            addrinfo hints{};
+            hints.ai_family   = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+
+            addrinfo* result = nullptr;
+
+            if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &result) == 0) {
+                for (auto* it = result; it; it = it->ai_next) {
+                    int fd = ::socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+
+                    if (fd < 0) {
+                        continue;
+                    }
+
+                    if (::connect(fd, it->ai_addr, it->ai_addrlen) == 0) {
+                        ::freeaddrinfo(result);
+
+                        configure(fd);
+                        next_fd = fd;
+
+                        return true;
+                    }
+
+                    ::close(fd);
+                }
+
+                ::freeaddrinfo(result);
+            }
+
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+
+            // The next rank may not be listening yet
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    /*!
+     * \brief Send the given bytes to the next rank
+     */
+    bool send_all(const void* data, size_t bytes) {
+        auto* it = static_cast<const char*>(data);
+
+        while (bytes) {
+            auto sent = ::send(next_fd, it, bytes, MSG_NOSIGNAL);
+
+            if (sent <= 0) {
+                return false;
+            }
+
+            it += sent;
+            bytes -= sent;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Receive the given bytes from the previous rank
+     */
+    bool recv_all(void* data, size_t bytes) {
+        auto* it = static_cast<char*>(data);
+
+        while (bytes) {
+            auto received = ::recv(prev_fd, it, bytes, 0);
+
+            if (received <= 0) {
+                return false;
+            }
+
+            it += received;
+            bytes -= received;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Send bytes to the next rank while receiving bytes from the
+     * previous rank.
+     *
+     * Both directions progress at the same time, so that the ring cannot
+     * deadlock on full socket buffers.
+     */
+    bool exchange(const void* send_data, size_t send_bytes, void* recv_data, size_t recv_bytes) {
+        auto* out = static_cast<const char*>(send_data);
+        auto* in  = static_cast<char*>(recv_data);
+
+        while (send_bytes || recv_bytes) {
+            pollfd fds[2];
+            fds[0] = {next_fd, short(send_bytes ? POLLOUT : 0), 0};
+            fds[1] = {prev_fd, short(recv_bytes ? POLLIN : 0), 0};
+
+            if (::poll(fds, 2, -1) < 0) {
+                return false;
+            }
+
+            if (send_bytes && (fds[0].revents & POLLOUT)) {
+                auto sent = ::send(next_fd, out, send_bytes, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+                if (sent > 0) {
+                    out += sent;
+                    send_bytes -= sent;
+                } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    return false;
+                }
+            }
+
+            if (recv_bytes && (fds[1].revents & (POLLIN | POLLHUP))) {
+                auto received = ::recv(prev_fd, in, recv_bytes, MSG_DONTWAIT);
+
+                if (received > 0) {
+                    in += received;
+                    recv_bytes -= received;
+                } else if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Close all the sockets
+     */
+    void close_sockets() {
+        for (int* fd : {&listen_fd, &next_fd, &prev_fd}) {
+            if (*fd >= 0) {
+                ::close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+    size_t rank_ = 0; ///< The rank of this process
+    size_t size_ = 1; ///< The number of ranks
+
+    int listen_fd = -1; ///< The listening socket
+    int next_fd   = -1; ///< The connection to the next rank
+    int prev_fd   = -1; ///< The connection from the previous rank
+
+    std::vector<char> buffer; ///< The reception buffer of the all-reduce
+};
+
+/*!
+ * \brief Sum gradients over all the ranks in background, by buckets.
+ *
+ * The gradients are submitted as soon as they are computed and reduced by
+ * a communication thread, while the errors are still backpropagated through
+ * the previous layers. The small gradients (biases for instance) are
+ * copied together in a bucket, to be reduced at once, the large gradients
+ * are reduced in place. A submitted gradient must not be used until wait()
+ * returns.
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct gradient_reducer {
+    /*!
+     * \brief Create a reducer on top of the given communicator
+     * \param comm The communicator, it must outlive the reducer
+     * \param bucket_size The number of values of one bucket
+     */
+    explicit gradient_reducer(communicator& comm, size_t bucket_size = 256 * 1024) : comm(comm), bucket_size(bucket_size) {
+        worker = std::thread([this] { run(); });
+    }
+
+    gradient_reducer(const gradient_reducer& rhs) = delete;
+    gradient_reducer& operator=(const gradient_reducer& rhs) = delete;
+
+    /*!
+     * \brief Stop the communication thread
+     */
+    ~gradient_reducer() {
+        {
+            std::unique_lock<std::mutex> ulock(lock);
+            stop_flag = true;
+        }
+
+        ready.notify_all();
+
+        worker.join();
+    }
+
+    /*!
+     * \brief Submit a gradient to be summed over all the ranks
+     * \param data The values of the gradient
+     * \param n The number of values
+     */
+    void submit(T* data, size_t n) {
+        if (n >= bucket_size) {
+            push(bucket{{}, {{data, n}}});
+            return;
+        }
+
+        current.values.insert(current.values.end(), data, data + n);
+        current.parts.emplace_back(data, n);
+
+        if (current.values.size() >= bucket_size) {
+            push(std::move(current));
+            current = bucket{};
+        }
+    }
+
+    /*!
+     * \brief Wait for all the submitted gradients to be summed
+     */
+    void wait() {
+        if (!current.parts.empty()) {
+            push(std::move(current));
+            current = bucket{};
+        }
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        done.wait(ulock, [this] { return queue.empty() && !busy; });
+    }
+
+private:
+    /*!
+     * \brief A bucket of gradients
+     */
+    struct bucket {
+        std::vector<T> values;                    ///< The copied values (empty for an in-place gradient)
+        std::vector<std::pair<T*, size_t>> parts; ///< The gradients of the bucket
+    };
+
+    /*!
+     * \brief Push a bucket to the communication thread
+     */
+    void push(bucket&& b) {
+        {
+            std::unique_lock<std::mutex> ulock(lock);
+            queue.push_back(std::move(b));
+        }
+
+        ready.notify_one();
+    }
+
+    /*!
+     * \brief The main loop of the communication thread
+     */
+    void run() {
+        while (true) {
+            bucket b;
+
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                ready.wait(ulock, [this] { return stop_flag || !queue.empty(); });
+
+                if (queue.empty()) {
+                    return;
+                }
+
+                b = std::move(queue.front());
+                queue.pop_front();
+
+                busy = true;
+            }
+
+            if (b.values.empty()) {
+                comm.all_reduce(b.parts.front().first, b.parts.front().second);
+            } else {
+                comm.all_reduce(b.values.data(), b.values.size());
+
+                const T* it = b.values.data();
+
+                for (auto& [data, n] : b.parts) {
+                    std::copy(it, it + n, data);
+                    it += n;
+                }
+            }
+
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+                busy = false;
+            }
+
+            done.notify_all();
+        }
+    }
+
+    communicator& comm;       ///< The communicator
+    const size_t bucket_size; ///< The number of values of one bucket
+
+    bucket current; ///< The bucket being filled
+
+    std::mutex lock;               ///< The lock protecting the queue
+    std::condition_variable ready; ///< Signals a new bucket
+    std::condition_variable done;  ///< Signals a reduced bucket
+    std::deque<bucket> queue;      ///< The buckets to reduce
+    bool busy      = false;        ///< Indicates that a bucket is being reduced
+    bool stop_flag = false;        ///< Indicates to the thread to stop
+
+    std::thread worker; ///< The communication thread
+};
+
+} //end of dll namespace
@@ -15,8 +15,15 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "format.hpp"
+#include "dll/generators/mmap_data_generator.hpp"
 
 namespace dll {
 
@@ -39,4 +46,304 @@ void export_features_dll(const Features& features, const std::string& file) {
     os << '\n';
 }
 
+/*!
+ * \brief The header of a raw tensor file (format::BINARY).
+ *
+ * The header is followed by the shape of the tensor, one 64 bits integer
+ * per dimension, the first one being the number of samples, and then by
+ * the values. Everything is stored in little-endian.
+ */
+struct binary_tensor_header {
+    char magic[4]       = {'D', 'L', 'L', 'T'}; ///< The magic number of the format
+    uint32_t dtype      = 0;                    ///< The type of the values (0: float, 1: double)
+    uint32_t dimensions = 0;                    ///< The number of dimensions of the tensor
+    uint32_t reserved   = 0;                    ///< Padding, always zero
+};
+
+/*!
+ * \brief Indicates if the host stores the values in little-endian
+ */
+inline bool is_little_endian() {
+    const uint32_t one = 1;
+    char first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+/*!
+ * \brief Writer of the features of many samples into one file, in large
+ * buffered writes.
+ *
+ * The features are accumulated in a large buffer. When it is full, it is
+ * either written directly or handed to a background writer thread while
+ * the next features are computed.
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct features_writer {
+    static constexpr size_t capacity = 8 * 1024 * 1024; ///< The size of the buffer, in bytes
+
+    /*!
+     * \brief Create the given file
+     * \param path The path of the file
+     * \param f The format of the file
+     * \param samples The number of samples that will be written
+     * \param background Indicates if the writes are done by a background thread
+     */
+    features_writer(const std::string& path, format f, size_t samples, bool background)
+            : path(path), os(path, std::ofstream::binary), f(f), samples(samples), background(background) {
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open the features file: " << path << std::endl;
+        }
+
+        buffer.reserve(capacity);
+
+        if (background) {
+            writer = std::thread([this] { write_loop(); });
+        }
+    }
+
+    features_writer(const features_writer& rhs) = delete;
+    features_writer operator=(const features_writer& rhs) = delete;
+
+    /*!
+     * \brief Wait for the background writer
+     */
+    ~features_writer() {
+        stop();
+    }
+
+    /*!
+     * \brief Append the features of a collection of samples
+     * \param features The collection of features
+     */
+    template <typename Features>
+    void append(const Features& features) {
+        for (auto& sample : features) {
+            if (!written) {
+                start(sample);
+            }
+
+            cpp_assert(written < samples, "Too many samples for the features file");
+            cpp_assert(etl::size(sample) == sample_size, "All the samples must have the same shape");
+
+            if (f == format::DLL) {
+                std::string comma = "";
+
+                for (auto feature : sample) {
+                    char value[32];
+                    const int length = std::snprintf(value, sizeof(value), "%g", double(feature));
+
+                    push(comma.data(), comma.size());
+                    push(value, length);
+
+                    comma = ";";
+                }
+
+                push("\n", 1);
+            } else {
+                const size_t offset = buffer.size();
+
+                buffer.resize(offset + sample_size * sizeof(T));
+
+                T* values = reinterpret_cast<T*>(buffer.data() + offset);
+                std::copy(sample.begin(), sample.end(), values);
+
+                if (!is_little_endian()) {
+                    for (size_t i = 0; i < sample_size; ++i) {
+                        auto* bytes = buffer.data() + offset + i * sizeof(T);
+                        std::reverse(bytes, bytes + sizeof(T));
+                    }
+                }
+
+                position += sample_size * sizeof(T);
+            }
+
+            ++written;
+
+            if (buffer.size() >= capacity) {
+                flush();
+            }
+        }
+    }
+
+    /*!
+     * \brief Write the end of the file and close it
+     * \return true if the complete file was written, false otherwise
+     */
+    bool finish() {
+        if (f == format::MMAP) {
+            pad(header.labels_offset);
+
+            const uint32_t zero = 0;
+            for (size_t i = 0; i < samples; ++i) {
+                push(reinterpret_cast<const char*>(&zero), sizeof(zero));
+            }
+        }
+
+        flush();
+        stop();
+
+        os.close();
+
+        if (!os || written != samples) {
+            std::cerr << "ERROR: Incomplete features file: " << path << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    /*!
+     * \brief Write the header of the file, from the shape of the first sample
+     */
+    template <typename Sample>
+    void start(const Sample& one) {
+        constexpr size_t D = etl::decay_traits<Sample>::dimensions();
+
+        sample_size = etl::size(one);
+
+        if (f == format::BINARY) {
+            binary_tensor_header tensor;
+            tensor.dtype      = binary_dtype<T>();
+            tensor.dimensions = D + 1;
+
+            push(reinterpret_cast<const char*>(&tensor), sizeof(tensor));
+
+            push_u64(samples);
+
+            for (size_t d = 0; d < D; ++d) {
+                push_u64(etl::dim(one, d));
+            }
+        } else if (f == format::MMAP) {
+            static_assert(D <= binary_dataset_header::max_dimensions, "Too many dimensions for the binary format");
+
+            header.dtype      = binary_dtype<T>();
+            header.dimensions = D;
+            header.samples    = samples;
+
+            for (size_t d = 0; d < D; ++d) {
+                header.shape[d] = etl::dim(one, d);
+            }
+
+            header.data_offset   = align(sizeof(binary_dataset_header));
+            header.labels_offset = align(header.data_offset + samples * sample_size * sizeof(T));
+
+            push(reinterpret_cast<const char*>(&header), sizeof(header));
+            pad(header.data_offset);
+        }
+    }
+
+    static size_t align(size_t offset) {
+        return (offset + binary_dataset_header::alignment - 1) / binary_dataset_header::alignment * binary_dataset_header::alignment;
+    }
+
+    void push(const char* data, size_t n) {
+        buffer.insert(buffer.end(), data, data + n);
+        position += n;
+    }
+
+    void push_u64(uint64_t value) {
+        char bytes[8];
+
+        for (size_t i = 0; i < 8; ++i) {
+            bytes[i] = char((value >> (8 * i)) & 0xFF);
+        }
+
+        push(bytes, 8);
+    }
+
+    void pad(size_t offset) {
+        while (position < offset) {
+            buffer.push_back(0);
+            ++position;
+        }
+    }
+
+    /*!
+     * \brief Write the buffer, or hand it to the background writer
+     */
+    void flush() {
+        if (buffer.empty()) {
+            return;
+        }
+
+        if (background) {
+            std::unique_lock<std::mutex> ulock(lock);
+
+            ready.wait(ulock, [this] { return !has_pending; });
+
+            std::swap(buffer, pending);
+            has_pending = true;
+
+            ready.notify_all();
+        } else {
+            os.write(buffer.data(), buffer.size());
+        }
+
+        buffer.clear();
+    }
+
+    void stop() {
+        if (writer.joinable()) {
+            cpp::with_lock(lock, [this] { stop_flag = true; });
+
+            ready.notify_all();
+
+            writer.join();
+        }
+    }
+
+    /*!
+     * \brief The main loop of the background writer
+     */
+    void write_loop() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                ready.wait(ulock, [this] { return has_pending || stop_flag; });
+
+                if (!has_pending) {
+                    return;
+                }
+            }
+
+            // The pending buffer is not touched until has_pending is reset
+            os.write(pending.data(), pending.size());
+
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                pending.clear();
+                has_pending = false;
+            }
+
+            ready.notify_all();
+        }
+    }
+
+    std::string path;             ///< The path of the file
+    std::ofstream os;             ///< The output stream
+    const format f;               ///< The format of the file
+    const size_t samples;         ///< The number of samples of the file
+    const bool background;        ///< Indicates if the writes are done in background
+    binary_dataset_header header; ///< The header of the file (format::MMAP)
+
+    size_t written     = 0; ///< The number of samples already appended
+    size_t sample_size = 0; ///< The number of values of a sample
+    size_t position    = 0; ///< The number of bytes already appended
+
+    std::vector<char> buffer;  ///< The buffer being filled
+    std::vector<char> pending; ///< The buffer being written by the background writer
+
+    std::mutex lock;               ///< The lock protecting the pending buffer
+    std::condition_variable ready; ///< Signals a change of the pending buffer
+    bool has_pending = false;      ///< Indicates if the pending buffer must be written
+    bool stop_flag   = false;      ///< Indicates to the background writer to stop
+    std::thread writer;            ///< The background writer
+};
+
 } //end of dll namespace
@@ -0,0 +1,106 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fast approximations of the exponential, the sigmoid and the
+ * hyperbolic tangent, for the layers with fast activations.
+ *
+ * The exponential is computed as 2^n * 2^f, with n the nearest integer of
+ * x / ln(2), 2^n built directly in the exponent bits and 2^f a polynomial
+ * on [-0.5, 0.5]. The functions have no branches and no calls, so that the
+ * loops of the activations are vectorized. In single precision, the
+ * relative error of the exponential is below 2e-6 and the absolute error of
+ * the sigmoid and of the hyperbolic tangent is below 1e-6. The polynomial
+ * is the same in double precision, with a relative error below 1e-8.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace dll {
+
+namespace fast_math_detail {
+
+/*!
+ * \brief Returns 2^n for an integer n in the range of the normal numbers of T
+ */
+template <typename T>
+inline T pow2(T n) {
+    if constexpr (std::is_same<T, float>::value) {
+        const auto bits = uint32_t(int32_t(n) + 127) << 23;
+
+        T result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    } else {
+        const auto bits = uint64_t(int64_t(n) + 1023) << 52;
+
+        T result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+}
+
+} //end of namespace fast_math_detail
+
+/*!
+ * \brief Fast approximation of exp(x).
+ *
+ * Outside of the range of the normal numbers, the result saturates to the
+ * smallest or the largest power of two (for |x| < 5e6). The exponent is
+ * clamped rather than the input, a clamped input would let the compiler
+ * split the loops in branches with constant results, which are not
+ * vectorized.
+ */
+template <typename T>
+inline T fast_exp(T x) {
+    static_assert(std::is_floating_point<T>::value, "fast_exp is only implemented for floating point numbers");
+
+    constexpr bool single = std::is_same<T, float>::value;
+
+    // The nearest integer, by rounding in the addition of 1.5 * 2^mantissa
+    const T round = single ? T(12582912.0) : T(6755399441055744.0);
+
+    const T t = x * T(1.44269504088896341);
+    const T n = (t + round) - round;
+    const T f = t - n;
+
+    // 2^f on [-0.5, 0.5] (Cephes exp2f)
+    T p = T(1.535336188319500e-4);
+    p   = p * f + T(1.339887440266574e-3);
+    p   = p * f + T(9.618437357674640e-3);
+    p   = p * f + T(5.550332471162809e-2);
+    p   = p * f + T(2.402264791363012e-1);
+    p   = p * f + T(6.931472028550421e-1);
+    p   = p * f + T(1);
+
+    return p * fast_math_detail::pow2(std::min(std::max(n, T(single ? -126 : -1022)), T(single ? 127 : 1023)));
+}
+
+/*!
+ * \brief Fast approximation of the logistic sigmoid, 1 / (1 + exp(-x))
+ */
+template <typename T>
+inline T fast_sigmoid(T x) {
+    return T(1) / (T(1) + fast_exp(-x));
+}
+
+/*!
+ * \brief Fast approximation of tanh(x), 1 - 2 / (exp(2x) + 1)
+ */
+template <typename T>
+inline T fast_tanh(T x) {
+    return T(1) - T(2) / (fast_exp(T(2) * x) + T(1));
+}
+
+} //end of dll namespace
@@ -0,0 +1,463 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Counter-based random streams for sampling
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Philox4x32-10 counter-based random number generator.
+ *
+ * Each (counter, key) pair is mapped to four independent 32 bits random
+ * numbers, without any state. Blocks of numbers can thus be generated
+ * independently, in any order and in parallel.
+ */
+struct philox4x32 {
+    /*!
+     * \brief Generate the four random numbers of the given counter
+     * \param counter The counter of the block
+     * \param key The key of the stream
+     * \param shard The high word of the counter (see random_shard_section)
+     */
+    static std::array<uint32_t, 4> generate(uint64_t counter, uint64_t key, uint64_t shard = 0) {
+        constexpr uint32_t M0 = 0xD2511F53;
+        constexpr uint32_t M1 = 0xCD9E8D57;
+        constexpr uint32_t W0 = 0x9E3779B9;
+        constexpr uint32_t W1 = 0xBB67AE85;
+
+        uint32_t c0 = uint32_t(counter);
+        uint32_t c1 = uint32_t(counter >> 32);
+        uint32_t c2 = uint32_t(shard);
+        uint32_t c3 = uint32_t(shard >> 32);
+
+        uint32_t k0 = uint32_t(key);
+        uint32_t k1 = uint32_t(key >> 32);
+
+        for (size_t r = 0; r < 10; ++r) {
+            const uint64_t p0 = uint64_t(M0) * c0;
+            const uint64_t p1 = uint64_t(M1) * c2;
+
+            const uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+            const uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+
+            c1 = uint32_t(p1);
+            c3 = uint32_t(p0);
+            c0 = n0;
+            c2 = n2;
+
+            k0 += W0;
+            k1 += W1;
+        }
+
+        return {c0, c1, c2, c3};
+    }
+};
+
+/*!
+ * \brief Returns a uniform number in [0, 1) from 32 random bits
+ */
+template <typename T>
+inline T to_uniform(uint32_t r) {
+    return T(r >> 8) * T(1.0 / 16777216.0);
+}
+
+/*!
+ * \brief Returns a uniform number in (0, 1) from 32 random bits
+ */
+template <typename T>
+inline T to_open_uniform(uint32_t r) {
+    return (T(r >> 8) + T(0.5)) * T(1.0 / 16777216.0);
+}
+
+namespace fast_random_detail {
+
+/*!
+ * \brief The counters of the shard section of a thread
+ */
+struct shard_counters {
+    uint64_t shard = 0; ///< The high word of the counters, 0 outside of a section
+    uint64_t next  = 0; ///< The next free counter of the section
+};
+
+/*!
+ * \brief Returns the counters of the shard section of the current thread
+ */
+inline shard_counters& local_shard() {
+    thread_local shard_counters counters;
+    return counters;
+}
+
+} //end of namespace fast_random_detail
+
+/*!
+ * \brief Draw the random numbers of the current thread from the counters
+ * of one shard of one batch while the section is alive.
+ *
+ * Outside of a section, each call to a stream takes the next counters of
+ * the stream. When several shards of a batch use the same stream in
+ * parallel, the counters would then be distributed in the order in which
+ * the threads reach the stream. Inside a section, the counters are derived
+ * from the batch and the shard indices, so that each shard gets the same
+ * numbers whatever the scheduling of the threads.
+ */
+struct random_shard_section {
+    /*!
+     * \brief Enter the section of the given shard of the given batch
+     * \param batch The index of the batch, must be different for each parallel region
+     * \param shard The index of the shard in the batch
+     */
+    random_shard_section(uint64_t batch, size_t shard) : previous(fast_random_detail::local_shard()) {
+        cpp_assert(shard < (1UL << 16), "Too many random shards");
+
+        auto& local = fast_random_detail::local_shard();
+
+        local.shard = ((batch + 1) << 16) | shard;
+        local.next  = 0;
+    }
+
+    random_shard_section(const random_shard_section& rhs) = delete;
+    random_shard_section& operator=(const random_shard_section& rhs) = delete;
+
+    ~random_shard_section() {
+        fast_random_detail::local_shard() = previous;
+    }
+
+private:
+    fast_random_detail::shard_counters previous; ///< The counters of the enclosing section
+};
+
+/*!
+ * \brief A reproducible stream of random numbers, for one layer.
+ *
+ * The stream key is derived from the DLL seed and from the creation order
+ * of the stream, so that every layer has its own sequence and that the
+ * same network gets the same sequences for the same seed. Every call
+ * reserves a range of counters atomically, the stream can be used from
+ * several threads at once without any lock.
+ *
+ * With concurrent users, the numbers each user gets depend on the order in
+ * which the threads reserve their counters. The parallel shards of the
+ * trainers use a random_shard_section to stay reproducible. The
+ * asynchronous trainers (Hogwild and the asynchronous RBM training) are
+ * not reproducible anyway and do not use sections.
+ */
+struct random_stream {
+    random_stream() : id(next_id()) {}
+
+    random_stream(const random_stream& rhs) : id(rhs.id), counter(rhs.counter.load()) {}
+
+    random_stream& operator=(const random_stream& rhs) {
+        id = rhs.id;
+        counter.store(rhs.counter.load());
+        return *this;
+    }
+
+    /*!
+     * \brief Returns the key of the stream
+     */
+    uint64_t key() const {
+        // splitmix64 of the seed and the stream id
+        uint64_t z = uint64_t(dll::seed()) + (id + 1) * 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /*!
+     * \brief Reserve blocks of 4 random numbers, from the counters of the
+     * shard section of the thread if any
+     * \param n The number of values needed
+     * \return the counter of the first block
+     */
+    uint64_t reserve(size_t n) {
+        auto& local = fast_random_detail::local_shard();
+
+        if (local.shard) {
+            const uint64_t first = local.next;
+            local.next += (n + 3) / 4;
+            return first;
+        }
+
+        return counter.fetch_add((n + 3) / 4, std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Generate n values, calling fun(i, r) with the 32 random bits
+     * r of the i-th value
+     */
+    template <typename Functor>
+    void generate(size_t n, Functor&& fun) {
+        generate_blocks(n, [&fun, n](size_t b, const std::array<uint32_t, 4>& r) {
+            for (size_t j = 0; j < 4 && 4 * b + j < n; ++j) {
+                fun(4 * b + j, r[j]);
+            }
+        });
+    }
+
+    /*!
+     * \brief Generate the blocks of 4 values for n values, calling fun(b,
+     * r) with the four 32 bits random numbers r of the b-th block
+     */
+    template <typename Functor>
+    void generate_blocks(size_t n, Functor&& fun) {
+        const uint64_t k     = key();
+        const uint64_t s     = fast_random_detail::local_shard().shard;
+        const uint64_t first = reserve(n);
+
+        for (size_t b = 0; b < (n + 3) / 4; ++b) {
+            fun(b, philox4x32::generate(first + b, k, s));
+        }
+    }
+
+    /*!
+     * \brief Generate the blocks of 4 values for n values in parallel,
+     * calling fun(b, r) with the four 32 bits random numbers r of the b-th
+     * block.
+     *
+     * The blocks are split in chunks given to the threads of the kernel
+     * pool. Since each block only depends on its counter, the values are
+     * the same as with generate_blocks(), whatever the number of threads.
+     */
+    template <typename Functor>
+    void generate_blocks_parallel(size_t n, Functor&& fun) {
+        constexpr size_t chunk = 4096; // Blocks per task
+
+        const uint64_t k     = key();
+        const uint64_t s     = fast_random_detail::local_shard().shard;
+        const uint64_t first = reserve(n);
+
+        const size_t blocks = (n + 3) / 4;
+
+        parallel_kernel(0, (blocks + chunk - 1) / chunk, [&fun, k, s, first, blocks](size_t c) {
+            const size_t last = std::min(blocks, (c + 1) * chunk);
+
+            for (size_t b = c * chunk; b < last; ++b) {
+                fun(b, philox4x32::generate(first + b, k, s));
+            }
+        });
+    }
+
+private:
+    static size_t next_id() {
+        static std::atomic<size_t> ids{0};
+        return ids++;
+    }
+
+    size_t id;                        ///< The creation index of the stream
+    std::atomic<uint64_t> counter{0}; ///< The next free counter
+};
+
+/*!
+ * \brief Fill the given matrix with uniform numbers in [0, 1)
+ */
+template <typename M>
+void uniform_fill(random_stream& stream, M&& m) {
+    using T = etl::value_t<M>;
+
+    T* out = m.memory_start();
+
+    stream.generate(etl::size(m), [out](size_t i, uint32_t r) { out[i] = to_uniform<T>(r); });
+
+    cpu_modified(m);
+}
+
+/*!
+ * \brief Sample binary states from the given probabilities.
+ *
+ * \param stream The random stream
+ * \param s The samples, set to 1 with the probability in p, 0 otherwise
+ * \param p The probabilities (can be the same as s)
+ */
+template <typename S, typename P>
+void sample_bernoulli(random_stream& stream, S&& s, const P& p) {
+    using T = etl::value_t<S>;
+
+    cpu_access(p);
+
+    T* out      = s.memory_start();
+    const T* in = p.memory_start();
+
+    stream.generate(etl::size(s), [out, in](size_t i, uint32_t r) { out[i] = to_uniform<T>(r) < in[i] ? T(1) : T(0); });
+
+    cpu_modified(s);
+}
+
+namespace fast_random_detail {
+
+/*!
+ * \brief Compute the standard normal numbers of one block of random
+ * numbers, two for each pair of uniforms (Box-Muller), calling fun(i, z)
+ * for the values of the block that are lower than n
+ */
+template <typename T, typename Functor>
+void normal_block(size_t b, const std::array<uint32_t, 4>& r, size_t n, Functor& fun) {
+    for (size_t j = 0; j < 4 && 4 * b + j < n; j += 2) {
+        const T radius = std::sqrt(T(-2) * std::log(to_open_uniform<T>(r[j])));
+        const T theta  = T(2.0 * M_PI) * to_uniform<T>(r[j + 1]);
+
+        fun(4 * b + j, radius * std::cos(theta));
+
+        if (4 * b + j + 1 < n) {
+            fun(4 * b + j + 1, radius * std::sin(theta));
+        }
+    }
+}
+
+} //end of namespace fast_random_detail
+
+/*!
+ * \brief Generate n standard normal numbers, calling fun(i, z) with the
+ * i-th number z
+ */
+template <typename T, typename Functor>
+void generate_normal(random_stream& stream, size_t n, Functor&& fun) {
+    stream.generate_blocks(n, [&fun, n](size_t b, const std::array<uint32_t, 4>& r) {
+        fast_random_detail::normal_block<T>(b, r, n, fun);
+    });
+}
+
+/*!
+ * \brief Generate n standard normal numbers in parallel, calling fun(i, z)
+ * with the i-th number z. The numbers are the same as with
+ * generate_normal(), the functor must be thread-safe.
+ */
+template <typename T, typename Functor>
+void generate_normal_parallel(random_stream& stream, size_t n, Functor&& fun) {
+    stream.generate_blocks_parallel(n, [&fun, n](size_t b, const std::array<uint32_t, 4>& r) {
+        fast_random_detail::normal_block<T>(b, r, n, fun);
+    });
+}
+
+/*!
+ * \brief Sample from normal distributions of unit variance.
+ *
+ * \param stream The random stream
+ * \param s The samples
+ * \param mean The means of the distributions (can be the same as s)
+ */
+template <typename S, typename P>
+void sample_normal(random_stream& stream, S&& s, const P& mean) {
+    using T = etl::value_t<S>;
+
+    cpu_access(mean);
+
+    T* out      = s.memory_start();
+    const T* in = mean.memory_start();
+
+    generate_normal<T>(stream, etl::size(s), [out, in](size_t i, T z) { out[i] = in[i] + z; });
+
+    cpu_modified(s);
+}
+
+/*!
+ * \brief Generate a bit-packed dropout mask of n values: each bit is
+ * cleared with probability p.
+ *
+ * The random numbers are compared directly to the 32 bits threshold, the
+ * uniform numbers are never computed.
+ *
+ * \param stream The random stream
+ * \param mask The mask, one bit per value
+ * \param n The number of values
+ * \param p The dropout probability
+ */
+inline void dropout_bits(random_stream& stream, std::vector<uint64_t>& mask, size_t n, float p) {
+    const uint32_t threshold = uint32_t(std::min(double(p), 1.0) * 4294967295.0);
+
+    mask.assign((n + 63) / 64, 0);
+
+    uint64_t* out = mask.data();
+
+    stream.generate(n, [out, threshold](size_t i, uint32_t r) { out[i / 64] |= uint64_t(r >= threshold) << (i % 64); });
+}
+
+/*!
+ * \brief Apply a bit-packed inverted dropout mask: each value is either
+ * dropped or scaled by 1 / (1 - p).
+ *
+ * \param output The output
+ * \param input The input (can be the same as output)
+ * \param mask The bit-packed mask
+ * \param p The dropout probability
+ */
+template <typename O, typename I>
+void apply_dropout_bits(O&& output, const I& input, const std::vector<uint64_t>& mask, float p) {
+    using T = etl::value_t<O>;
+
+    cpu_access(input);
+
+    T* out      = output.memory_start();
+    const T* in = input.memory_start();
+
+    const size_t n = etl::size(output);
+    const T scale  = T(1) / (T(1) - T(p));
+
+    for (size_t w = 0; w < (n + 63) / 64; ++w) {
+        const uint64_t bits = mask[w];
+        const size_t last   = std::min(n - w * 64, size_t(64));
+
+        for (size_t j = 0; j < last; ++j) {
+            out[w * 64 + j] = (bits >> j) & 1 ? in[w * 64 + j] * scale : T(0);
+        }
+    }
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Apply masking noise: each value of the input is set to zero with
+ * the probability p, the others are copied.
+ *
+ * The blocks of random numbers are generated in parallel and compared
+ * directly to the 32 bits threshold.
+ *
+ * \param stream The random stream
+ * \param output The output
+ * \param input The input (can be the same as output)
+ * \param p The probability to mask a value
+ */
+template <typename O, typename I>
+void masking_noise(random_stream& stream, O&& output, const I& input, float p) {
+    using T = etl::value_t<O>;
+
+    const uint32_t threshold = uint32_t(std::min(double(p), 1.0) * 4294967295.0);
+
+    cpu_access(input);
+
+    T* out      = output.memory_start();
+    const T* in = input.memory_start();
+
+    const size_t n = etl::size(output);
+
+    stream.generate_blocks_parallel(n, [out, in, n, threshold](size_t b, const std::array<uint32_t, 4>& r) {
+        for (size_t j = 0; j < 4 && 4 * b + j < n; ++j) {
+            out[4 * b + j] = r[j] >= threshold ? in[4 * b + j] : T(0);
+        }
+    });
+
+    cpu_modified(output);
+}
+
+} //end of dll namespace
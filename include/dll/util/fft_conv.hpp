@@ -0,0 +1,488 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Convolutions of the convolutional RBMs in the frequency domain,
+ * for large kernels.
+ *
+ * All the planes are zero-padded to the power of two sizes P1 x P2 larger
+ * than the visible planes. At this size, the circular convolutions and
+ * correlations give exactly the valid correlations (hidden activations and
+ * weight gradients) and the full convolutions (visible activations) of the
+ * RBM, without any aliasing.
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace fft_detail {
+
+/*!
+ * \brief Returns the smallest power of two larger or equal to n
+ */
+inline size_t next_power_of_two(size_t n) {
+    size_t p = 1;
+
+    while (p < n) {
+        p *= 2;
+    }
+
+    return p;
+}
+
+/*!
+ * \brief Returns the twiddle factors exp(-2 i pi k / n) of a FFT of size n,
+ * cached for the calling thread
+ */
+template <typename T>
+const std::vector<std::complex<T>>& twiddles(size_t n) {
+    constexpr double pi = 3.14159265358979323846;
+
+    thread_local std::array<std::vector<std::complex<T>>, 32> cache;
+
+    size_t log = 0;
+    while ((size_t(1) << log) < n) {
+        ++log;
+    }
+
+    auto& tw = cache[log];
+
+    if (tw.size() != n / 2) {
+        tw.resize(n / 2);
+
+        for (size_t k = 0; k < n / 2; ++k) {
+            tw[k] = std::polar(T(1), T(-2.0 * pi * double(k) / double(n)));
+        }
+    }
+
+    return tw;
+}
+
+/*!
+ * \brief In-place iterative radix-2 FFT of n contiguous values (n is a
+ * power of two). The inverse transform is not scaled.
+ */
+template <typename T>
+void fft_1d(std::complex<T>* x, size_t n, bool inverse) {
+    const auto& tw = twiddles<T>(n);
+
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+
+        j ^= bit;
+
+        if (i < j) {
+            std::swap(x[i], x[j]);
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half = len / 2;
+        const size_t step = n / len;
+
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t j = 0; j < half; ++j) {
+                const auto w = inverse ? std::conj(tw[j * step]) : tw[j * step];
+                const auto u = x[i + j];
+                const auto v = x[i + j + half] * w;
+
+                x[i + j]        = u + v;
+                x[i + j + half] = u - v;
+            }
+        }
+    }
+}
+
+/*!
+ * \brief In-place 2D FFT of a P1 x P2 plane, the rows and then the columns
+ */
+template <typename T>
+void fft_2d(std::complex<T>* x, size_t P1, size_t P2, bool inverse) {
+    thread_local std::vector<std::complex<T>> column;
+
+    column.resize(P1);
+
+    for (size_t r = 0; r < P1; ++r) {
+        fft_1d(x + r * P2, P2, inverse);
+    }
+
+    for (size_t c = 0; c < P2; ++c) {
+        for (size_t r = 0; r < P1; ++r) {
+            column[r] = x[r * P2 + c];
+        }
+
+        fft_1d(column.data(), P1, inverse);
+
+        for (size_t r = 0; r < P1; ++r) {
+            x[r * P2 + c] = column[r];
+        }
+    }
+}
+
+/*!
+ * \brief Returns a plane of the calling thread for the accumulations
+ */
+template <typename T>
+std::complex<T>* scratch_plane(size_t size) {
+    thread_local std::vector<std::complex<T>> plane;
+
+    plane.assign(size, std::complex<T>(0));
+
+    return plane.data();
+}
+
+} //end of namespace fft_detail
+
+/*!
+ * \brief The spectra of a set of planes
+ */
+template <typename T>
+struct fft_spectra {
+    const T* source = nullptr;                 ///< The memory the spectra have been computed from
+    size_t planes   = 0;                       ///< The number of planes
+    std::vector<std::complex<T>> values;       ///< The spectra, [planes x P1 x P2]
+
+    /*!
+     * \brief Returns the spectrum of the given plane
+     */
+    const std::complex<T>* operator[](size_t i) const {
+        return values.data() + i * (values.size() / planes);
+    }
+};
+
+/*!
+ * \brief The FFT convolutions of a convolutional RBM.
+ *
+ * During the training of a batch, the spectra of the weights are locked:
+ * they are computed once and reused by all the activations, and the
+ * spectra of the visible batches are kept for the gradients of the
+ * weights. Outside of the training, everything is computed on the fly and
+ * the plan can be used by several threads at once.
+ */
+template <typename T>
+struct fft_conv_plan {
+    using complex_t = std::complex<T>; ///< The type of the coefficients
+
+    fft_conv_plan() = default;
+
+    // The spectra only make sense for the weights of the layer they were computed from
+    fft_conv_plan(const fft_conv_plan& /*rhs*/) {}
+
+    fft_conv_plan& operator=(const fft_conv_plan& /*rhs*/) {
+        unlock_weights();
+        return *this;
+    }
+
+    /*!
+     * \brief Compute the spectra of the weights and keep them until
+     * unlock_weights(), with the spectra of the visible batches if
+     * cache_inputs is true.
+     *
+     * \param w The filters [K x C x NW1 x NW2]
+     * \param nv1 The first dimension of the visible planes
+     * \param nv2 The second dimension of the visible planes
+     * \param cache_inputs Indicates if the spectra of the visible batches are kept
+     */
+    template <typename W>
+    void lock_weights(const W& w, size_t nv1, size_t nv2, bool cache_inputs) {
+        unlock_weights();
+
+        transform(w_f, w, etl::dim<0>(w) * etl::dim<1>(w), etl::dim<2>(w), etl::dim<3>(w), padded(nv1), padded(nv2));
+
+        locked = true;
+        cache  = cache_inputs;
+    }
+
+    /*!
+     * \brief Release the spectra of the weights, after they are updated
+     */
+    void unlock_weights() {
+        locked = false;
+        cache  = false;
+        inputs = {};
+        next   = 0;
+    }
+
+    /*!
+     * \brief Compute the valid correlations of a batch of visible units
+     * with the filters (the hidden activations, without the biases).
+     *
+     * \param h_a The output [B x K x NH1 x NH2]
+     * \param v The visible units [B x C x NV1 x NV2]
+     * \param w The filters [K x C x NW1 x NW2]
+     */
+    template <typename H, typename V, typename W>
+    void valid_correlation(H&& h_a, const V& v, const W& w) const {
+        const size_t B   = etl::dim<0>(v);
+        const size_t C   = etl::dim<1>(v);
+        const size_t K   = etl::dim<0>(w);
+        const size_t NH1 = etl::dim<2>(h_a);
+        const size_t NH2 = etl::dim<3>(h_a);
+        const size_t P1  = padded(etl::dim<2>(v));
+        const size_t P2  = padded(etl::dim<3>(v));
+
+        fft_spectra<T> local_w;
+        fft_spectra<T> local_v;
+
+        const auto& wf = weights_spectra(local_w, w, P1, P2);
+        const auto& vf = visible_spectra(local_v, v, P1, P2);
+
+        T* out = h_a.memory_start();
+
+        parallel_kernel(0, B * K, [&](size_t t) {
+            const size_t b = t / K;
+            const size_t k = t % K;
+
+            auto* acc = fft_detail::scratch_plane<T>(P1 * P2);
+
+            for (size_t c = 0; c < C; ++c) {
+                const auto* x = vf[b * C + c];
+                const auto* y = wf[k * C + c];
+
+                for (size_t i = 0; i < P1 * P2; ++i) {
+                    acc[i] += x[i] * std::conj(y[i]);
+                }
+            }
+
+            extract(out + t * NH1 * NH2, acc, NH1, NH2, P1, P2);
+        });
+
+        cpu_modified(h_a);
+    }
+
+    /*!
+     * \brief Compute the full convolutions of a batch of hidden units with
+     * the filters (the visible activations, without the biases).
+     *
+     * \param v_a The output [B x C x NV1 x NV2]
+     * \param h The hidden units [B x K x NH1 x NH2]
+     * \param w The filters [K x C x NW1 x NW2]
+     */
+    template <typename V, typename H, typename W>
+    void full_convolution(V&& v_a, const H& h, const W& w) const {
+        const size_t B   = etl::dim<0>(h);
+        const size_t K   = etl::dim<1>(h);
+        const size_t C   = etl::dim<1>(w);
+        const size_t NV1 = etl::dim<2>(v_a);
+        const size_t NV2 = etl::dim<3>(v_a);
+        const size_t P1  = padded(NV1);
+        const size_t P2  = padded(NV2);
+
+        fft_spectra<T> local_w;
+        fft_spectra<T> hf;
+
+        const auto& wf = weights_spectra(local_w, w, P1, P2);
+
+        transform(hf, h, B * K, etl::dim<2>(h), etl::dim<3>(h), P1, P2);
+
+        T* out = v_a.memory_start();
+
+        // The spectra of the previous values of v_a are not valid anymore (CD-k)
+        for (auto& input : inputs) {
+            if (input.source == out) {
+                input = {};
+            }
+        }
+
+        parallel_kernel(0, B * C, [&](size_t t) {
+            const size_t b = t / C;
+            const size_t c = t % C;
+
+            auto* acc = fft_detail::scratch_plane<T>(P1 * P2);
+
+            for (size_t k = 0; k < K; ++k) {
+                const auto* x = hf[b * K + k];
+                const auto* y = wf[k * C + c];
+
+                for (size_t i = 0; i < P1 * P2; ++i) {
+                    acc[i] += x[i] * y[i];
+                }
+            }
+
+            extract(out + t * NV1 * NV2, acc, NV1, NV2, P1, P2);
+        });
+
+        cpu_modified(v_a);
+    }
+
+    /*!
+     * \brief Compute the gradients of the weights, the difference of the
+     * positive and the negative correlations, in a single pass over the
+     * spectra. The spectra of the visible batches are reused if they have
+     * been kept by the hidden activations.
+     *
+     * \param grad The gradients [K x C x NW1 x NW2]
+     * \param v_pos The positive visible units [B x C x NV1 x NV2]
+     * \param h_pos The positive hidden activations [B x K x NH1 x NH2]
+     * \param v_neg The negative visible units [B x C x NV1 x NV2]
+     * \param h_neg The negative hidden activations [B x K x NH1 x NH2]
+     */
+    template <typename G, typename V, typename H>
+    void weight_gradients(G&& grad, const V& v_pos, const H& h_pos, const V& v_neg, const H& h_neg) {
+        const size_t B   = etl::dim<0>(v_pos);
+        const size_t C   = etl::dim<1>(v_pos);
+        const size_t K   = etl::dim<1>(h_pos);
+        const size_t NW1 = etl::dim<2>(grad);
+        const size_t NW2 = etl::dim<3>(grad);
+        const size_t P1  = padded(etl::dim<2>(v_pos));
+        const size_t P2  = padded(etl::dim<3>(v_pos));
+
+        fft_spectra<T> local_pos;
+        fft_spectra<T> local_neg;
+        fft_spectra<T> hp_f;
+        fft_spectra<T> hn_f;
+
+        const auto& vp_f = visible_spectra(local_pos, v_pos, P1, P2);
+        const auto& vn_f = visible_spectra(local_neg, v_neg, P1, P2);
+
+        transform(hp_f, h_pos, B * K, etl::dim<2>(h_pos), etl::dim<3>(h_pos), P1, P2);
+        transform(hn_f, h_neg, B * K, etl::dim<2>(h_neg), etl::dim<3>(h_neg), P1, P2);
+
+        T* out = grad.memory_start();
+
+        parallel_kernel(0, K * C, [&](size_t t) {
+            const size_t k = t / C;
+            const size_t c = t % C;
+
+            auto* acc = fft_detail::scratch_plane<T>(P1 * P2);
+
+            for (size_t b = 0; b < B; ++b) {
+                const auto* xp = vp_f[b * C + c];
+                const auto* yp = hp_f[b * K + k];
+                const auto* xn = vn_f[b * C + c];
+                const auto* yn = hn_f[b * K + k];
+
+                for (size_t i = 0; i < P1 * P2; ++i) {
+                    acc[i] += xp[i] * std::conj(yp[i]) - xn[i] * std::conj(yn[i]);
+                }
+            }
+
+            extract(out + t * NW1 * NW2, acc, NW1, NW2, P1, P2);
+        });
+
+        cpu_modified(grad);
+    }
+
+private:
+    /*!
+     * \brief Returns the padded size of a visible dimension
+     */
+    static size_t padded(size_t nv) {
+        return fft_detail::next_power_of_two(nv);
+    }
+
+    /*!
+     * \brief Compute the spectra of the given planes, zero-padded to P1 x P2
+     */
+    template <typename M>
+    static void transform(fft_spectra<T>& spectra, const M& m, size_t planes, size_t R, size_t S, size_t P1, size_t P2) {
+        cpu_access(m);
+
+        const T* in = m.memory_start();
+
+        spectra.source = in;
+        spectra.planes = planes;
+        spectra.values.assign(planes * P1 * P2, complex_t(0));
+
+        complex_t* out = spectra.values.data();
+
+        parallel_kernel(0, planes, [=](size_t p) {
+            complex_t* x = out + p * P1 * P2;
+
+            for (size_t i = 0; i < R; ++i) {
+                for (size_t j = 0; j < S; ++j) {
+                    x[i * P2 + j] = in[(p * R + i) * S + j];
+                }
+            }
+
+            fft_detail::fft_2d(x, P1, P2, false);
+        });
+    }
+
+    /*!
+     * \brief Inverse the transform of the accumulated plane and write its
+     * R x S top-left values
+     */
+    static void extract(T* out, complex_t* acc, size_t R, size_t S, size_t P1, size_t P2) {
+        fft_detail::fft_2d(acc, P1, P2, true);
+
+        const T scale = T(1) / T(P1 * P2);
+
+        for (size_t i = 0; i < R; ++i) {
+            for (size_t j = 0; j < S; ++j) {
+                out[i * S + j] = acc[i * P2 + j].real() * scale;
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the spectra of the weights, the locked ones or the one
+     * computed in local
+     */
+    template <typename W>
+    const fft_spectra<T>& weights_spectra(fft_spectra<T>& local, const W& w, size_t P1, size_t P2) const {
+        if (locked && w_f.values.size() == w_f.planes * P1 * P2) {
+            return w_f;
+        }
+
+        transform(local, w, etl::dim<0>(w) * etl::dim<1>(w), etl::dim<2>(w), etl::dim<3>(w), P1, P2);
+
+        return local;
+    }
+
+    /*!
+     * \brief Returns the spectra of the given visible batch, from the cache
+     * if possible. The spectra are kept in the cache, if enabled.
+     */
+    template <typename V>
+    const fft_spectra<T>& visible_spectra(fft_spectra<T>& local, const V& v, size_t P1, size_t P2) const {
+        const size_t planes = etl::dim<0>(v) * etl::dim<1>(v);
+
+        if (cache) {
+            for (auto& input : inputs) {
+                if (input.source == v.memory_start() && input.planes == planes && input.values.size() == planes * P1 * P2) {
+                    return input;
+                }
+            }
+
+            auto& slot = inputs[next];
+            next       = (next + 1) % inputs.size();
+
+            transform(slot, v, planes, etl::dim<2>(v), etl::dim<3>(v), P1, P2);
+
+            return slot;
+        }
+
+        transform(local, v, planes, etl::dim<2>(v), etl::dim<3>(v), P1, P2);
+
+        return local;
+    }
+
+    fft_spectra<T> w_f;                          ///< The spectra of the locked weights
+    mutable std::array<fft_spectra<T>, 2> inputs; ///< The spectra of the last visible batches
+    mutable size_t next = 0;                     ///< The next slot of the cache
+    bool locked         = false;                 ///< Indicates if the spectra of the weights are locked
+    bool cache          = false;                 ///< Indicates if the spectra of the visible batches are kept
+};
+
+} //end of dll namespace
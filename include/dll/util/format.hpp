@@ -18,7 +18,9 @@ namespace dll {
  * \brief An activation function
  */
 enum class format {
-    DLL ///< Default simple format of the DLL library
+    DLL,    ///< Default simple format of the DLL library
+    BINARY, ///< Raw little-endian tensor, with a shape header
+    MMAP    ///< DLL binary dataset, readable by the mmap data generator
 };
 
 } //end of dll namespace
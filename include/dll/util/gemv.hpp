@@ -0,0 +1,281 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Matrix products with weights pre-packed in panels, for the
+ * inference of the dense and convolutional layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/util/cpu.hpp"
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The weights [V x H] and the biases of a layer packed for the
+ * products with its inputs.
+ *
+ * The outputs are grouped in panels of P consecutive outputs. The weights of
+ * the panel are stored input by input, the P weights of one input being
+ * contiguous. The product with one input reads all the weights exactly once,
+ * in order, and keeps the P accumulators of a panel in registers. The
+ * product with several inputs computes them by tiles of rows, the panel
+ * staying in cache for all the rows.
+ *
+ * \tparam T The type of the weights
+ * \tparam P The number of outputs of a panel
+ */
+template <typename T, size_t P = 8>
+struct packed_gemv_weights {
+    static constexpr size_t panel = P; ///< The number of outputs of a panel
+
+    size_t inputs  = 0;    ///< The number of inputs (V)
+    size_t outputs = 0;    ///< The number of outputs (H)
+    std::vector<T> values; ///< The weights of each panel [V x P], padded with zeros
+    std::vector<T> biases; ///< The biases, zero if the layer has none
+
+    /*!
+     * \brief Pack the weights [V x H] given by a functor and the biases
+     * \param w The functor returning the weight of the input v for the output h
+     * \param b The biases, or nullptr if the layer has none
+     * \param V The number of inputs
+     * \param H The number of outputs
+     */
+    template <typename W>
+    void pack(W&& w, const T* b, size_t V, size_t H) {
+        inputs  = V;
+        outputs = H;
+
+        const size_t panels = (H + P - 1) / P;
+
+        values.assign(panels * V * P, T(0));
+        biases.assign(H, T(0));
+
+        for (size_t p = 0; p < panels; ++p) {
+            const size_t first = p * P;
+            const size_t last  = std::min(first + P, H);
+
+            T* out = values.data() + p * V * P;
+
+            for (size_t v = 0; v < V; ++v) {
+                for (size_t h = first; h < last; ++h) {
+                    out[v * P + h - first] = w(v, h);
+                }
+            }
+        }
+
+        if (b) {
+            std::copy_n(b, H, biases.data());
+        }
+    }
+
+    /*!
+     * \brief Release the packed weights
+     */
+    void clear() {
+        inputs = outputs = 0;
+
+        values.clear();
+        biases.clear();
+    }
+
+    /*!
+     * \brief Indicates if no weights are packed
+     */
+    bool empty() const {
+        return values.empty();
+    }
+
+    /*!
+     * \brief Returns the memory of the packed weights, in bytes
+     */
+    size_t memory() const {
+        return (values.size() + biases.size()) * sizeof(T);
+    }
+};
+
+/*!
+ * \brief Compute the product of one input with packed weights and add the
+ * biases, y = x * w + b.
+ *
+ * \param y The output (H values)
+ * \param x The input (V values)
+ * \param w The packed weights
+ */
+template <typename T, size_t P>
+void packed_gemv(T* y, const T* x, const packed_gemv_weights<T, P>& w) {
+    const size_t V = w.inputs;
+    const size_t H = w.outputs;
+
+    const T* panel = w.values.data();
+
+    for (size_t first = 0; first < H; first += P, panel += V * P) {
+        T acc[P] = {};
+
+        for (size_t v = 0; v < V; ++v) {
+            const T value = x[v];
+            const T* row  = panel + v * P;
+
+            for (size_t k = 0; k < P; ++k) {
+                acc[k] += value * row[k];
+            }
+        }
+
+        const size_t last = std::min(P, H - first);
+
+        for (size_t k = 0; k < last; ++k) {
+            y[first + k] = acc[k] + w.biases[first + k];
+        }
+    }
+}
+
+/*!
+ * \brief Compute the product of m inputs with packed weights and add the
+ * biases, out = in * w + b.
+ *
+ * Each panel of outputs is computed by one task, by tiles of 4 rows.
+ *
+ * \param out The output [m x H], with the given strides
+ * \param in The inputs [m x V]
+ * \param m The number of inputs
+ * \param w The packed weights
+ * \param row_stride The distance between two output rows
+ * \param column_stride The distance between two output columns
+ */
+template <typename T, size_t P>
+void packed_gemm(T* out, const T* in, size_t m, const packed_gemv_weights<T, P>& w, size_t row_stride, size_t column_stride) {
+    constexpr size_t R = 4;
+
+    const size_t V = w.inputs;
+    const size_t H = w.outputs;
+
+    parallel_kernel(0, (H + P - 1) / P, [&](size_t p) {
+        const T* panel     = w.values.data() + p * V * P;
+        const size_t first = p * P;
+        const size_t last  = std::min(P, H - first);
+
+        for (size_t r = 0; r < m; r += R) {
+            const size_t rows = std::min(R, m - r);
+
+            // The missing rows of the last tile compute the last row again
+            const T* x[R];
+
+            for (size_t i = 0; i < R; ++i) {
+                x[i] = in + std::min(r + i, m - 1) * V;
+            }
+
+            T acc[R][P] = {};
+
+            for (size_t v = 0; v < V; ++v) {
+                const T* row = panel + v * P;
+
+                for (size_t i = 0; i < R; ++i) {
+                    const T value = x[i][v];
+
+                    for (size_t k = 0; k < P; ++k) {
+                        acc[i][k] += value * row[k];
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < rows; ++i) {
+                for (size_t k = 0; k < last; ++k) {
+                    out[(r + i) * row_stride + (first + k) * column_stride] = acc[i][k] + w.biases[first + k];
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Apply the activation function F in place on the n values of one
+ * sample
+ *
+ * \tparam Fast Use the fast approximations of exp, of the sigmoid and of tanh
+ */
+template <function F, bool Fast = false, typename T>
+void activate_one(T* y, size_t n) {
+    if constexpr (F == function::SOFTMAX) {
+        const T max = *std::max_element(y, y + n);
+
+        T sum = 0;
+
+        for (size_t i = 0; i < n; ++i) {
+            if constexpr (Fast) {
+                y[i] = fast_exp(y[i] - max);
+            } else {
+                y[i] = std::exp(y[i] - max);
+            }
+
+            sum += y[i];
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            y[i] /= sum;
+        }
+    } else if constexpr (F != function::IDENTITY) {
+        for (size_t i = 0; i < n; ++i) {
+            y[i] = f_activate_scalar<F, Fast>(y[i]);
+        }
+    } else {
+        (void)y;
+        (void)n;
+    }
+}
+
+namespace gemv_detail {
+
+/*!
+ * \brief Apply the fast activation function F in place on one row of n
+ * values
+ */
+template <function F, typename T>
+DLL_KERNEL_CLONES void fast_activate_row(T* y, size_t n) {
+    activate_one<F, true>(y, n);
+}
+
+} //end of namespace gemv_detail
+
+/*!
+ * \brief Apply the fast approximation of the activation function F in place
+ * on a batch [B x N], in parallel by rows.
+ *
+ * This is used by the layers with fast activations, instead of the exact
+ * ETL expressions of f_activate.
+ */
+template <function F, typename E>
+void f_activate_fast(E&& output) {
+    static_assert(has_fast_activation(F), "The activation function has no fast approximation");
+
+    using T = etl::value_t<E>;
+
+    cpu_access(output);
+
+    T* y = output.memory_start();
+
+    const size_t rows = etl::dim<0>(output);
+    const size_t n    = etl::size(output) / rows;
+
+    parallel_kernel(0, rows, [&](size_t r) {
+        gemv_detail::fast_activate_row<F>(y + r * n, n);
+    });
+
+    cpu_modified(output);
+}
+
+} //end of dll namespace
@@ -0,0 +1,73 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Synchronization of the GPU memory for the kernels working directly
+ * on the CPU memory.
+ *
+ * With ETL_GPU, the ETL expressions are computed on the GPU and the buffers
+ * stay resident on the device between the layers. The kernels of DLL that
+ * work on the raw CPU memory must mark their input as needed on the CPU and
+ * their output as modified on the CPU, otherwise they would read stale
+ * values and the next ETL expressions would use the old device copy.
+ * Without ETL_GPU, all these functions do nothing.
+ */
+
+#pragma once
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the buffers are resident on the GPU
+ */
+#ifdef ETL_GPU
+constexpr bool gpu_resident = true;
+#else
+constexpr bool gpu_resident = false;
+#endif
+
+/*!
+ * \brief Ensure that the CPU memory of the given buffers is up to date,
+ * before it is read (or partially written) directly.
+ */
+template <typename... E>
+void cpu_access(const E&... buffers) {
+    if constexpr (gpu_resident) {
+        (buffers.ensure_cpu_up_to_date(), ...);
+    } else {
+        ((void)buffers, ...);
+    }
+}
+
+/*!
+ * \brief Mark the given buffers as modified directly in CPU memory, their
+ * device copy is invalidated.
+ */
+template <typename... E>
+void cpu_modified(E&&... buffers) {
+    if constexpr (gpu_resident) {
+        (buffers.invalidate_gpu(), ...);
+    } else {
+        ((void)buffers, ...);
+    }
+}
+
+/*!
+ * \brief Upload the given buffers to the GPU memory, if they are not already
+ * up to date on the device.
+ */
+template <typename... E>
+void gpu_upload(const E&... buffers) {
+    if constexpr (gpu_resident) {
+        (buffers.ensure_gpu_up_to_date(), ...);
+    } else {
+        ((void)buffers, ...);
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,322 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the grouped "valid" convolutions.
+ *
+ * The C input channels and the K filters are split in G groups, the
+ * filters of a group only see the C / G input channels of their group. The
+ * depthwise convolutions are the grouped convolutions with one input
+ * channel per group.
+ *
+ * All the convolutions are computed without flipping the kernels, like
+ * etl::ml::convolution_forward, with a stride of 1 and no padding.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/cpu.hpp"
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The shape of a grouped convolution
+ */
+struct grouped_conv_shape {
+    size_t C;   ///< The number of input channels
+    size_t K;   ///< The number of filters
+    size_t G;   ///< The number of groups
+    size_t NV1; ///< The first dimension of the input
+    size_t NV2; ///< The second dimension of the input
+    size_t NW1; ///< The first dimension of the filters
+    size_t NW2; ///< The second dimension of the filters
+
+    /*!
+     * \brief Returns the number of input channels of a group
+     */
+    size_t channels() const {
+        return C / G;
+    }
+
+    /*!
+     * \brief Returns the number of filters of a group
+     */
+    size_t filters() const {
+        return K / G;
+    }
+
+    /*!
+     * \brief Returns the first dimension of the output
+     */
+    size_t nh1() const {
+        return NV1 - NW1 + 1;
+    }
+
+    /*!
+     * \brief Returns the second dimension of the output
+     */
+    size_t nh2() const {
+        return NV2 - NW2 + 1;
+    }
+};
+
+namespace grouped_conv_detail {
+
+/*!
+ * \brief Compute the output of one sample
+ * \param out The output of the sample [K x NH1 x NH2]
+ * \param in The input of the sample [C x NV1 x NV2]
+ * \param w The filters [K x (C / G) x NW1 x NW2]
+ */
+template <typename T>
+DLL_KERNEL_CLONES void forward_sample(T* out, const T* in, const T* w, const grouped_conv_shape& s) {
+    const size_t CG  = s.channels();
+    const size_t KG  = s.filters();
+    const size_t NH1 = s.nh1();
+    const size_t NH2 = s.nh2();
+    const size_t NV  = s.NV1 * s.NV2;
+    const size_t NW  = s.NW1 * s.NW2;
+
+    std::fill(out, out + s.K * NH1 * NH2, T(0));
+
+    for (size_t k = 0; k < s.K; ++k) {
+        T* o = out + k * NH1 * NH2;
+
+        for (size_t c = 0; c < CG; ++c) {
+            const T* plane = in + ((k / KG) * CG + c) * NV;
+            const T* wk    = w + (k * CG + c) * NW;
+
+            if (NW == 1) {
+                // Pointwise: one axpy over the whole plane
+                const T wv = wk[0];
+
+                for (size_t i = 0; i < NV; ++i) {
+                    o[i] += wv * plane[i];
+                }
+
+                continue;
+            }
+
+            for (size_t p = 0; p < s.NW1; ++p) {
+                for (size_t q = 0; q < s.NW2; ++q) {
+                    const T wv = wk[p * s.NW2 + q];
+
+                    for (size_t i = 0; i < NH1; ++i) {
+                        const T* row = plane + (i + p) * s.NV2 + q;
+                        T* orow      = o + i * NH2;
+
+                        for (size_t j = 0; j < NH2; ++j) {
+                            orow[j] += wv * row[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the input of one sample
+ * \param d_in The gradients of the input of the sample [C x NV1 x NV2]
+ * \param errors The errors of the sample [K x NH1 x NH2]
+ * \param w The filters [K x (C / G) x NW1 x NW2]
+ */
+template <typename T>
+DLL_KERNEL_CLONES void backward_sample(T* d_in, const T* errors, const T* w, const grouped_conv_shape& s) {
+    const size_t CG  = s.channels();
+    const size_t KG  = s.filters();
+    const size_t NH1 = s.nh1();
+    const size_t NH2 = s.nh2();
+    const size_t NV  = s.NV1 * s.NV2;
+    const size_t NW  = s.NW1 * s.NW2;
+
+    std::fill(d_in, d_in + s.C * NV, T(0));
+
+    for (size_t k = 0; k < s.K; ++k) {
+        const T* e = errors + k * NH1 * NH2;
+
+        for (size_t c = 0; c < CG; ++c) {
+            T* plane    = d_in + ((k / KG) * CG + c) * NV;
+            const T* wk = w + (k * CG + c) * NW;
+
+            for (size_t p = 0; p < s.NW1; ++p) {
+                for (size_t q = 0; q < s.NW2; ++q) {
+                    const T wv = wk[p * s.NW2 + q];
+
+                    for (size_t i = 0; i < NH1; ++i) {
+                        T* row        = plane + (i + p) * s.NV2 + q;
+                        const T* erow = e + i * NH2;
+
+                        for (size_t j = 0; j < NH2; ++j) {
+                            row[j] += wv * erow[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute the gradients of one filter over the whole batch
+ * \param grad The gradients of the filter [(C / G) x NW1 x NW2]
+ * \param input The input [B x C x NV1 x NV2]
+ * \param errors The errors [B x K x NH1 x NH2]
+ * \param k The index of the filter
+ */
+template <typename T>
+DLL_KERNEL_CLONES void filter_gradients(T* grad, const T* input, const T* errors, size_t B, size_t k, const grouped_conv_shape& s) {
+    const size_t CG  = s.channels();
+    const size_t KG  = s.filters();
+    const size_t NH1 = s.nh1();
+    const size_t NH2 = s.nh2();
+    const size_t NV  = s.NV1 * s.NV2;
+    const size_t NH  = NH1 * NH2;
+    const size_t NW  = s.NW1 * s.NW2;
+
+    std::fill(grad, grad + CG * NW, T(0));
+
+    for (size_t b = 0; b < B; ++b) {
+        const T* e = errors + (b * s.K + k) * NH;
+
+        for (size_t c = 0; c < CG; ++c) {
+            const T* plane = input + (b * s.C + (k / KG) * CG + c) * NV;
+
+            for (size_t p = 0; p < s.NW1; ++p) {
+                for (size_t q = 0; q < s.NW2; ++q) {
+                    T sum(0);
+
+                    for (size_t i = 0; i < NH1; ++i) {
+                        const T* row  = plane + (i + p) * s.NV2 + q;
+                        const T* erow = e + i * NH2;
+
+                        for (size_t j = 0; j < NH2; ++j) {
+                            sum += erow[j] * row[j];
+                        }
+                    }
+
+                    grad[c * NW + p * s.NW2 + q] += sum;
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Returns the shape of the grouped convolution of the given input
+ * [B x C x NV1 x NV2] with the given filters [K x (C / G) x NW1 x NW2]
+ */
+template <typename I, typename W>
+grouped_conv_shape shape_of(const I& input, const W& w, size_t groups) {
+    return {etl::dim<1>(input), etl::dim<0>(w), groups, etl::dim<2>(input), etl::dim<3>(input), etl::dim<2>(w), etl::dim<3>(w)};
+}
+
+} //end of namespace grouped_conv_detail
+
+/*!
+ * \brief Grouped convolution of a batch of input with a set of filters,
+ * the samples being computed in parallel.
+ *
+ * \param output The output [B x K x NH1 x NH2]
+ * \param input The input [B x C x NV1 x NV2]
+ * \param w The filters [K x (C / G) x NW1 x NW2]
+ * \param groups The number of groups
+ */
+template <typename O, typename I, typename W>
+void grouped_conv_forward(O&& output, const I& input, const W& w, size_t groups) {
+    using T = etl::value_t<W>;
+
+    const auto s = grouped_conv_detail::shape_of(input, w, groups);
+
+    cpu_access(input, w);
+
+    T* out      = output.memory_start();
+    const T* in = input.memory_start();
+    const T* ws = w.memory_start();
+
+    const size_t out_size = s.K * s.nh1() * s.nh2();
+    const size_t in_size  = s.C * s.NV1 * s.NV2;
+
+    parallel_kernel(0, etl::dim<0>(input), [&](size_t b) {
+        grouped_conv_detail::forward_sample(out + b * out_size, in + b * in_size, ws, s);
+    });
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Gradients of a grouped convolution with respect to its input,
+ * the samples being computed in parallel.
+ *
+ * \param output The gradients of the input [B x C x NV1 x NV2]
+ * \param errors The errors [B x K x NH1 x NH2]
+ * \param w The filters [K x (C / G) x NW1 x NW2]
+ * \param groups The number of groups
+ */
+template <typename O, typename E, typename W>
+void grouped_conv_backward(O&& output, const E& errors, const W& w, size_t groups) {
+    using T = etl::value_t<W>;
+
+    const size_t NW1 = etl::dim<2>(w);
+    const size_t NW2 = etl::dim<3>(w);
+
+    const grouped_conv_shape s{etl::dim<1>(w) * groups, etl::dim<0>(w), groups, etl::dim<2>(errors) + NW1 - 1, etl::dim<3>(errors) + NW2 - 1, NW1, NW2};
+
+    cpu_access(errors, w);
+
+    T* d_in     = output.memory_start();
+    const T* e  = errors.memory_start();
+    const T* ws = w.memory_start();
+
+    const size_t in_size     = s.C * s.NV1 * s.NV2;
+    const size_t errors_size = s.K * s.nh1() * s.nh2();
+
+    parallel_kernel(0, etl::dim<0>(errors), [&](size_t b) {
+        grouped_conv_detail::backward_sample(d_in + b * in_size, e + b * errors_size, ws, s);
+    });
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Gradients of a grouped convolution with respect to its filters,
+ * the filters being computed in parallel.
+ *
+ * \param grad The gradients of the filters [K x (C / G) x NW1 x NW2]
+ * \param input The input [B x C x NV1 x NV2]
+ * \param errors The errors [B x K x NH1 x NH2]
+ * \param groups The number of groups
+ */
+template <typename G, typename I, typename E>
+void grouped_conv_backward_filter(G&& grad, const I& input, const E& errors, size_t groups) {
+    using T = etl::value_t<std::decay_t<G>>;
+
+    const auto s = grouped_conv_detail::shape_of(input, grad, groups);
+
+    cpu_access(input, errors);
+
+    T* g        = grad.memory_start();
+    const T* in = input.memory_start();
+    const T* e  = errors.memory_start();
+
+    const size_t filter_size = s.channels() * s.NW1 * s.NW2;
+
+    parallel_kernel(0, s.K, [&](size_t k) {
+        grouped_conv_detail::filter_gradients(g + k * filter_size, in, e, etl::dim<0>(input), k, s);
+    });
+
+    cpu_modified(grad);
+}
+
+} //end of dll namespace
@@ -0,0 +1,147 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Statistics of the features of a training set, computed in a
+ * single pass.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The statistics of each feature of a set of samples
+ */
+struct input_statistics {
+    size_t samples = 0;           ///< The number of samples
+    std::vector<size_t> ones;     ///< The number of samples equal to one, for each feature
+    std::vector<double> mean;     ///< The mean of each feature
+    std::vector<double> variance; ///< The variance of each feature
+
+    /*!
+     * \brief Returns the number of features
+     */
+    size_t features() const {
+        return mean.size();
+    }
+
+    /*!
+     * \brief Returns the standard deviation of the given feature
+     */
+    double stddev(size_t i) const {
+        return std::sqrt(variance[i]);
+    }
+
+    /*!
+     * \brief Returns the ratio of samples equal to one for the given feature
+     */
+    double ones_ratio(size_t i) const {
+        return samples ? double(ones[i]) / samples : 0.0;
+    }
+
+    /*!
+     * \brief Accumulate the n first samples of a batch [B x N]
+     */
+    template <typename M>
+    void add_batch(const M& batch, size_t n) {
+        // The features are split in chunks given to the kernel threads
+        constexpr size_t chunk = 64;
+
+        const size_t N = etl::size(batch) / etl::dim<0>(batch);
+
+        if (mean.empty()) {
+            ones.assign(N, 0);
+            mean.assign(N, 0.0);
+            variance.assign(N, 0.0);
+        }
+
+        cpu_access(batch);
+
+        const auto* in = batch.memory_start();
+
+        // mean and variance hold the sums of the values and of their squares until finalize()
+        parallel_kernel(0, (N + chunk - 1) / chunk, [this, in, n, N](size_t c) {
+            const size_t last = std::min(N, (c + 1) * chunk);
+
+            for (size_t b = 0; b < n; ++b) {
+                const auto* row = in + b * N;
+
+                for (size_t i = c * chunk; i < last; ++i) {
+                    const double v = row[i];
+
+                    ones[i] += v == 1.0;
+                    mean[i] += v;
+                    variance[i] += v * v;
+                }
+            }
+        });
+
+        samples += n;
+    }
+
+    /*!
+     * \brief Compute the means and the variances from the accumulated sums
+     */
+    void finalize() {
+        if (!samples) {
+            return;
+        }
+
+        for (size_t i = 0; i < mean.size(); ++i) {
+            mean[i] /= samples;
+            variance[i] = std::max(variance[i] / samples - mean[i] * mean[i], 0.0);
+        }
+    }
+};
+
+/*!
+ * \brief Compute the statistics of the features of the inputs of the given
+ * generator in a single pass over its batches.
+ *
+ * The label batches are used, i.e. the inputs without noise for an
+ * autoencoder generator.
+ *
+ * \param generator The generator of the training set
+ * \param max_samples The maximum number of samples to use, 0 for all the samples
+ */
+template <typename Generator>
+input_statistics compute_input_statistics(Generator& generator, size_t max_samples = 0) {
+    input_statistics stats;
+
+    generator.reset();
+
+    while (generator.has_next_batch() && (!max_samples || stats.samples < max_samples)) {
+        auto batch = generator.label_batch();
+
+        size_t n = etl::dim<0>(batch);
+
+        if (max_samples) {
+            n = std::min(n, max_samples - stats.samples);
+        }
+
+        stats.add_batch(batch, n);
+
+        generator.next_batch();
+    }
+
+    stats.finalize();
+
+    return stats;
+}
+
+} //end of dll namespace
@@ -0,0 +1,348 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernels for the loss functions.
+ *
+ * Each kernel computes, in a single traversal of the output of the network,
+ * the errors of the output, the loss and the error of the batch. The rows
+ * are processed in parallel, by blocks, and the partial sums of each block
+ * are reduced with a fixed tree, the result does not depend on the number
+ * of threads.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dll/loss.hpp"
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/reduction.hpp"
+
+namespace dll {
+
+namespace loss_detail {
+
+/*!
+ * \brief Returns the number of rows handled by one task of the loss kernels
+ */
+inline size_t loss_block(size_t C) {
+    return std::max(size_t(1), size_t(4096) / std::max(size_t(1), C));
+}
+
+/*!
+ * \brief Call the functor on each block of rows of [0, n) in parallel and
+ * return the sum of the (error, loss) pairs of each block.
+ */
+template <typename Functor>
+std::pair<double, double> reduce_rows(size_t n, size_t C, Functor&& fun) {
+    const size_t block = loss_block(C);
+    const size_t tasks = (n + block - 1) / block;
+
+    auto& partials = kernel_scratch<std::pair<double, double>>(tasks);
+
+    parallel_kernel(0, tasks, [&](size_t task) {
+        partials[task] = fun(task * block, std::min(n, (task + 1) * block));
+    });
+
+    return tree_sum(partials);
+}
+
+/*!
+ * \brief Returns the rank of the label in the given row of outputs, the
+ * number of classes ranked before it.
+ *
+ * The ties are broken by the index of the classes, like for the top-1
+ * error. The row is scanned without any branch nor sort, the comparisons
+ * are vectorized by the compiler, which makes a partial selection of the K
+ * largest outputs unnecessary: the label is in the top-K if less than K
+ * classes are ranked before it.
+ */
+template <typename T>
+size_t label_rank(const T* row, size_t C, size_t label) {
+    const T l = row[label];
+
+    size_t rank = 0;
+
+    for (size_t j = 0; j < C; ++j) {
+        rank += size_t(row[j] > l) | (size_t(row[j] == l) & size_t(j < label));
+    }
+
+    return rank;
+}
+
+/*!
+ * \brief Reset the errors of the rows [n, B) that are not part of the batch
+ */
+template <typename E>
+void clear_rows(E& errors, size_t n, size_t B, size_t C) {
+    for (size_t i = n * C; i < B * C; ++i) {
+        errors[i] = 0;
+    }
+}
+
+/*!
+ * \brief Kernel for the categorical cross entropy.
+ *
+ * The labels are either one-hot [B x C] or sparse [B], one class index per
+ * sample.
+ *
+ * \tparam Errors Indicates if the errors must be computed
+ * \tparam TopK The number of classes considered by the error of a sample
+ */
+template <bool Errors, size_t TopK, typename O, typename L, typename E>
+std::pair<double, double> cce(const O& output, const L& labels, E& errors, size_t n) {
+    static constexpr bool sparse = etl::dimensions<L>() == 1;
+
+    const size_t B = etl::dim<0>(output);
+    const size_t C = etl::size(output) / B;
+
+    auto result = reduce_rows(n, C, [&](size_t first, size_t last) {
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t i = first; i < last; ++i) {
+            const size_t row = i * C;
+
+            size_t best  = 0;
+            size_t label = 0;
+
+            if constexpr (sparse) {
+                label = size_t(labels[i]);
+            }
+
+            for (size_t j = 0; j < C; ++j) {
+                const auto o = output[row + j];
+
+                if (o > output[row + best]) {
+                    best = j;
+                }
+
+                if constexpr (sparse) {
+                    if constexpr (Errors) {
+                        errors[row + j] = (j == label ? 1.0 : 0.0) - o;
+                    }
+                } else {
+                    const auto l = labels[row + j];
+
+                    if (l > labels[row + label]) {
+                        label = j;
+                    }
+
+                    if (l != 0) {
+                        loss += l * std::log(o);
+                    }
+
+                    if constexpr (Errors) {
+                        errors[row + j] = l - o;
+                    }
+                }
+            }
+
+            if constexpr (sparse) {
+                loss += std::log(output[row + label]);
+            }
+
+            if constexpr (TopK > 1) {
+                // The row is still in the cache
+                error += label_rank(output.memory_start() + row, C, label) >= TopK;
+            } else {
+                error += best != label;
+            }
+        }
+
+        return std::make_pair(error, -loss);
+    });
+
+    if constexpr (Errors) {
+        clear_rows(errors, n, B, C);
+    }
+
+    return result;
+}
+
+/*!
+ * \brief Kernel for the binary cross entropy.
+ *
+ * The output is clipped to [0.001, 0.999] to avoid NaN in the logarithms
+ * and in the divisions of the errors.
+ *
+ * \tparam Errors Indicates if the errors must be computed
+ */
+template <bool Errors, typename O, typename L, typename E>
+std::pair<double, double> bce(const O& output, const L& labels, E& errors, size_t n) {
+    using T = std::decay_t<decltype(output[0])>;
+
+    const size_t B = etl::dim<0>(output);
+    const size_t C = etl::size(output) / B;
+
+    auto result = reduce_rows(n, C, [&](size_t first, size_t last) {
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t k = first * C; k < last * C; ++k) {
+            const T o  = output[k];
+            const T l  = labels[k];
+            const T oc = std::clamp(o, T(0.001), T(0.999));
+
+            loss += l * std::log(oc) + (1.0 - l) * std::log(1.0 - oc);
+            error += std::abs(l - o);
+
+            if constexpr (Errors) {
+                errors[k] = (l - oc) / ((1.0 - oc) * oc);
+            }
+        }
+
+        return std::make_pair(error / C, -loss / C);
+    });
+
+    if constexpr (Errors) {
+        clear_rows(errors, n, B, C);
+    }
+
+    return result;
+}
+
+/*!
+ * \brief Kernel for the mean squared error.
+ *
+ * \tparam Errors Indicates if the errors must be computed
+ */
+template <bool Errors, typename O, typename L, typename E>
+std::pair<double, double> mse(const O& output, const L& labels, E& errors, size_t n) {
+    const size_t B = etl::dim<0>(output);
+    const size_t C = etl::size(output) / B;
+
+    auto result = reduce_rows(n, C, [&](size_t first, size_t last) {
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t k = first * C; k < last * C; ++k) {
+            const auto d = labels[k] - output[k];
+
+            loss += d * d;
+            error += std::abs(d);
+
+            if constexpr (Errors) {
+                errors[k] = 2.0 * d;
+            }
+        }
+
+        return std::make_pair(error, 0.5 * loss);
+    });
+
+    if constexpr (Errors) {
+        clear_rows(errors, n, B, C);
+    }
+
+    return result;
+}
+
+} //end of namespace loss_detail
+
+/*!
+ * \brief Compute the errors of the output, the error and the loss of the n
+ * first samples of a batch.
+ *
+ * The errors of the rows after n are set to zero. The error and the loss
+ * are the sums over the samples, they are not normalized.
+ *
+ * \param output The output of the network [B x ...]
+ * \param labels The labels of the batch
+ * \param errors The errors of the output, of the same shape as the output
+ * \param n The number of samples of the batch
+ *
+ * \tparam TopK The number of classes considered by the error of a sample
+ * (categorical cross entropy only)
+ *
+ * \return A pair containing the error and the loss
+ */
+template <loss_function F, size_t TopK = 1, typename O, typename L, typename E>
+std::pair<double, double> loss_errors(const O& output, const L& labels, E& errors, size_t n) {
+    // Only the output of the last layer is brought back from the device
+    cpu_access(output, labels);
+
+    std::pair<double, double> metrics;
+
+    if constexpr (F == loss_function::CATEGORICAL_CROSS_ENTROPY) {
+        metrics = loss_detail::cce<true, TopK>(output, labels, errors, n);
+    } else if constexpr (F == loss_function::BINARY_CROSS_ENTROPY) {
+        metrics = loss_detail::bce<true>(output, labels, errors, n);
+    } else {
+        metrics = loss_detail::mse<true>(output, labels, errors, n);
+    }
+
+    cpu_modified(errors);
+
+    return metrics;
+}
+
+/*!
+ * \brief Compute the error and the loss of the n first samples of a batch.
+ *
+ * The error and the loss are the sums over the samples, they are not
+ * normalized.
+ *
+ * \param output The output of the network [B x ...]
+ * \param labels The labels of the batch
+ * \param n The number of samples of the batch
+ *
+ * \tparam TopK The number of classes considered by the error of a sample
+ * (categorical cross entropy only)
+ *
+ * \return A pair containing the error and the loss
+ */
+template <loss_function F, size_t TopK = 1, typename O, typename L>
+std::pair<double, double> loss_metrics(const O& output, const L& labels, size_t n) {
+    cpu_access(output, labels);
+
+    if constexpr (F == loss_function::CATEGORICAL_CROSS_ENTROPY) {
+        return loss_detail::cce<false, TopK>(output, labels, output, n);
+    } else if constexpr (F == loss_function::BINARY_CROSS_ENTROPY) {
+        return loss_detail::bce<false>(output, labels, output, n);
+    } else {
+        return loss_detail::mse<false>(output, labels, output, n);
+    }
+}
+
+/*!
+ * \brief Compute the top-k error of the n first samples of a batch: the
+ * number of samples whose label is not one of the k largest outputs.
+ *
+ * \param output The output of the network [B x ...]
+ * \param n The number of samples of the batch
+ * \param k The number of classes considered for each sample
+ * \param label The functor returning the label of the sample i
+ *
+ * \return The number of misclassified samples, not normalized
+ */
+template <typename O, typename Label>
+double top_k_errors(const O& output, size_t n, size_t k, Label&& label) {
+    cpu_access(output);
+
+    const size_t C = etl::size(output) / etl::dim<0>(output);
+
+    const auto* out = output.memory_start();
+
+    return loss_detail::reduce_rows(n, C, [&](size_t first, size_t last) {
+        double error = 0.0;
+
+        for (size_t i = first; i < last; ++i) {
+            error += loss_detail::label_rank(out + i * C, C, size_t(label(i))) >= k;
+        }
+
+        return std::make_pair(error, 0.0);
+    }).first;
+}
+
+} //end of dll namespace
@@ -0,0 +1,238 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Compression and decompression of blocks in the LZ4 block format
+ *
+ * The compressor is a simple greedy compressor with one hash table, it
+ * favours speed over ratio. The decompressor checks all its reads and
+ * writes.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace dll {
+
+namespace lz4_detail {
+
+constexpr size_t min_match    = 4;     ///< The minimum length of a match
+constexpr size_t last_literal = 5;     ///< The number of bytes at the end that are always literals
+constexpr size_t match_limit  = 12;    ///< The last match must start this number of bytes before the end
+constexpr size_t hash_log     = 16;    ///< The log2 of the size of the hash table
+constexpr size_t max_offset   = 65535; ///< The maximum distance of a match
+
+/*!
+ * \brief Read four bytes
+ */
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*!
+ * \brief Hash four bytes into the table
+ */
+inline uint32_t hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - hash_log);
+}
+
+/*!
+ * \brief Write the extension bytes of a length
+ */
+inline void write_length(std::vector<uint8_t>& dst, size_t length) {
+    for (; length >= 255; length -= 255) {
+        dst.push_back(255);
+    }
+
+    dst.push_back(uint8_t(length));
+}
+
+/*!
+ * \brief Write one sequence: the literals from src and the match (if any)
+ */
+inline void write_sequence(std::vector<uint8_t>& dst, const uint8_t* literals, size_t n_literals, size_t offset, size_t length) {
+    const size_t l = n_literals < 15 ? n_literals : 15;
+    const size_t m = length ? (length - min_match < 15 ? length - min_match : 15) : 0;
+
+    dst.push_back(uint8_t((l << 4) | m));
+
+    if (n_literals >= 15) {
+        write_length(dst, n_literals - 15);
+    }
+
+    dst.insert(dst.end(), literals, literals + n_literals);
+
+    if (length) {
+        dst.push_back(uint8_t(offset & 0xFF));
+        dst.push_back(uint8_t(offset >> 8));
+
+        if (length - min_match >= 15) {
+            write_length(dst, length - min_match - 15);
+        }
+    }
+}
+
+} //end of namespace lz4_detail
+
+/*!
+ * \brief Returns the maximum size of the compression of n bytes
+ */
+constexpr size_t lz4_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+/*!
+ * \brief Compress n bytes into dst, in the LZ4 block format
+ * \param dst The compressed block (replaced)
+ * \param src The bytes to compress
+ * \param n The number of bytes to compress
+ */
+inline void lz4_compress(std::vector<uint8_t>& dst, const uint8_t* src, size_t n) {
+    using namespace lz4_detail;
+
+    dst.clear();
+    dst.reserve(lz4_bound(n));
+
+    size_t anchor = 0;
+
+    if (n > match_limit) {
+        std::vector<uint32_t> table(size_t(1) << hash_log, 0);
+
+        const size_t last  = n - match_limit;
+        const size_t limit = n - last_literal;
+
+        size_t ip = 0;
+
+        while (ip < last) {
+            const uint32_t sequence = read32(src + ip);
+            const uint32_t h        = hash(sequence);
+            const size_t ref        = table[h];
+
+            table[h] = uint32_t(ip);
+
+            if (ref < ip && ip - ref <= max_offset && read32(src + ref) == sequence) {
+                size_t length = min_match;
+
+                while (ip + length < limit && src[ref + length] == src[ip + length]) {
+                    ++length;
+                }
+
+                write_sequence(dst, src + anchor, ip - anchor, ip - ref, length);
+
+                ip += length;
+                anchor = ip;
+            } else {
+                ++ip;
+            }
+        }
+    }
+
+    // The last literals
+    write_sequence(dst, src + anchor, n - anchor, 0, 0);
+}
+
+/*!
+ * \brief Decompress a block in the LZ4 block format
+ * \param dst The decompressed bytes
+ * \param size The expected number of decompressed bytes
+ * \param src The compressed block
+ * \param n The size of the compressed block
+ * \return true if the block has been decompressed to exactly size bytes,
+ * false if it is malformed
+ */
+inline bool lz4_decompress(uint8_t* dst, size_t size, const uint8_t* src, size_t n) {
+    using namespace lz4_detail;
+
+    size_t ip = 0;
+    size_t op = 0;
+
+    auto read_length = [&](size_t& length) {
+        uint8_t b;
+
+        do {
+            if (ip >= n) {
+                return false;
+            }
+
+            b = src[ip++];
+            length += b;
+        } while (b == 255);
+
+        return true;
+    };
+
+    while (ip < n) {
+        const uint8_t token = src[ip++];
+
+        size_t literals = token >> 4;
+
+        if (literals == 15 && !read_length(literals)) {
+            return false;
+        }
+
+        if (literals > n - ip || literals > size - op) {
+            return false;
+        }
+
+        std::memcpy(dst + op, src + ip, literals);
+
+        ip += literals;
+        op += literals;
+
+        // The last sequence has no match
+        if (ip == n) {
+            break;
+        }
+
+        if (n - ip < 2) {
+            return false;
+        }
+
+        const size_t offset = size_t(src[ip]) | (size_t(src[ip + 1]) << 8);
+
+        ip += 2;
+
+        if (!offset || offset > op) {
+            return false;
+        }
+
+        size_t length = token & 15;
+
+        if (length == 15 && !read_length(length)) {
+            return false;
+        }
+
+        length += min_match;
+
+        if (length > size - op) {
+            return false;
+        }
+
+        const uint8_t* match = dst + op - offset;
+
+        if (offset >= length) {
+            std::memcpy(dst + op, match, length);
+        } else {
+            // Overlapping match, repeating the last offset bytes
+            for (size_t k = 0; k < length; ++k) {
+                dst[op + k] = match[k];
+            }
+        }
+
+        op += length;
+    }
+
+    return op == size;
+}
+
+} //end of dll namespace
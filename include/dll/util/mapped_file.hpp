@@ -0,0 +1,103 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Memory mapping of a file
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dll {
+
+/*!
+ * \brief Hint the kernel that the n bytes at the given address of a mapping
+ * will soon be read
+ */
+inline void will_need_memory(const void* memory, size_t n) {
+    const size_t page  = ::sysconf(_SC_PAGESIZE);
+    const auto address = reinterpret_cast<uintptr_t>(memory);
+    const auto start   = address / page * page;
+
+    ::madvise(reinterpret_cast<void*>(start), n + (address - start), MADV_WILLNEED);
+}
+
+/*!
+ * \brief A mapping of a file in memory, either private (copy-on-write) or
+ * read-only
+ */
+struct mapped_file {
+    void* memory  = nullptr; ///< The start of the mapping
+    size_t length = 0;       ///< The length of the mapping
+
+    /*!
+     * \brief Map the given file in memory
+     * \param path The path of the file
+     * \param read_only If true, the mapping is shared and cannot be written
+     */
+    explicit mapped_file(const std::string& path, bool read_only = false) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            // Private mapping: the pages are shared with the page cache
+            // and would only be copied if written to. A read-only mapping
+            // can never be copied.
+            void* m = read_only
+                          ? ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0)
+                          : ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+            if (m != MAP_FAILED) {
+                memory = m;
+                length = st.st_size;
+            }
+        }
+
+        ::close(fd);
+    }
+
+    mapped_file(const mapped_file& rhs) = delete;
+    mapped_file& operator=(const mapped_file& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~mapped_file() {
+        if (memory) {
+            ::munmap(memory, length);
+        }
+    }
+
+    /*!
+     * \brief Returns a pointer at the given offset of the mapping
+     */
+    char* at(size_t offset) const {
+        return static_cast<char*>(memory) + offset;
+    }
+
+    /*!
+     * \brief Hint the kernel that the given range will soon be read
+     */
+    void will_need(size_t offset, size_t n) const {
+        will_need_memory(at(offset), std::min(length - offset, n));
+    }
+};
+
+} //end of dll namespace
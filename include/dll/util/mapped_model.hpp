@@ -0,0 +1,147 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Model files mapped in memory and used in place by the inference
+ * engine
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "dll/util/mapped_file.hpp"
+#include "dll/util/parameter_store.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The header of a mapped model file.
+ *
+ * The parameters of the network follow at data_offset, contiguous, in the
+ * order of the flat parameter store.
+ */
+struct mapped_model_header {
+    static constexpr size_t alignment = 4096; ///< The alignment of the parameters in the file
+
+    char magic[4]        = {'D', 'L', 'L', 'M'}; ///< The magic of the file
+    uint32_t version     = 1;                    ///< The version of the format
+    uint32_t dtype       = 0;                    ///< The size of one parameter, in bytes
+    uint32_t tensors     = 0;                    ///< The number of tensors
+    uint64_t size        = 0;                    ///< The total number of parameters
+    uint64_t data_offset = alignment;            ///< The offset of the parameters in the file
+};
+
+/*!
+ * \brief Write the parameters of the given store in a mapped model file
+ * \param path The path of the file
+ * \param parameters The flat store of the parameters of the network
+ * \return true if the file was written, false otherwise
+ */
+template <typename T>
+bool write_mapped_model(const std::string& path, parameter_store<T>& parameters) {
+    parameters.snapshot();
+
+    mapped_model_header header;
+
+    header.dtype   = sizeof(T);
+    header.tensors = parameters.tensors();
+    header.size    = parameters.size();
+
+    std::ofstream os(path, std::ofstream::binary);
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // The parameters start on a page boundary
+    for (size_t i = sizeof(header); i < header.data_offset; ++i) {
+        os.put(0);
+    }
+
+    os.write(reinterpret_cast<const char*>(parameters.data()), parameters.size() * sizeof(T));
+
+    return bool(os);
+}
+
+/*!
+ * \brief A model file mapped in memory.
+ *
+ * The parameters are never read nor copied at load, the pages are only
+ * read from the page cache when they are first used, and are shared
+ * between all the processes mapping the same file. The mapping is
+ * private, a modification of the parameters is never written back to the
+ * file. A read-only mapping cannot be modified at all, its pages can never
+ * be copied in a process, the inference engine only reads them.
+ *
+ * \tparam T The type of the parameters
+ */
+template <typename T>
+struct mapped_model {
+    /*!
+     * \brief Map the given model file
+     * \param path The path of the file, written by store_mapped()
+     * \param read_only If true, the parameters are mapped read-only
+     */
+    explicit mapped_model(const std::string& path, bool read_only = false) : file(path, read_only) {
+        if (!file.memory || file.length < sizeof(mapped_model_header)) {
+            return;
+        }
+
+        std::memcpy(&header, file.memory, sizeof(header));
+
+        if (std::memcmp(header.magic, "DLLM", 4) != 0 || header.version != 1 || header.dtype != sizeof(T)
+            || header.data_offset % alignof(T) || header.data_offset + header.size * sizeof(T) > file.length) {
+            return;
+        }
+
+        parameters = reinterpret_cast<T*>(file.at(header.data_offset));
+
+        // The parameters are read at the first inference
+        file.will_need(header.data_offset, header.size * sizeof(T));
+    }
+
+    mapped_model(const mapped_model& rhs) = delete;
+    mapped_model& operator=(const mapped_model& rhs) = delete;
+
+    /*!
+     * \brief Indicates if the file has been mapped and is a valid model
+     */
+    bool valid() const {
+        return parameters;
+    }
+
+    /*!
+     * \brief Returns the parameters, in the order of the flat store
+     */
+    T* data() const {
+        return parameters;
+    }
+
+    /*!
+     * \brief Returns the total number of parameters
+     */
+    size_t size() const {
+        return header.size;
+    }
+
+    /*!
+     * \brief Returns the number of tensors
+     */
+    size_t tensors() const {
+        return header.tensors;
+    }
+
+private:
+    mapped_file file;           ///< The mapping of the file
+    mapped_model_header header; ///< The header of the file
+    T* parameters = nullptr;    ///< The parameters in the mapping
+};
+
+} //end of dll namespace
@@ -0,0 +1,324 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Tracking of the memory used by the training
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The categories of tracked memory
+ */
+enum class memory_category {
+    WEIGHTS,   ///< The parameters of the layers
+    CONTEXT,   ///< The training contexts of the SGD trainer (activations, gradients and updater state)
+    TRAINER,   ///< The buffers of the RBM trainers (Contrastive Divergence)
+    GENERATOR  ///< The caches of the data generators
+};
+
+constexpr size_t memory_categories = 4; ///< The number of memory categories
+
+/*!
+ * \brief Returns a string representation of a memory category
+ */
+inline const char* to_string(memory_category category) {
+    switch (category) {
+        case memory_category::WEIGHTS:
+            return "weights";
+        case memory_category::CONTEXT:
+            return "contexts";
+        case memory_category::TRAINER:
+            return "trainers";
+        case memory_category::GENERATOR:
+            return "generators";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * \brief The live and peak bytes of a category
+ */
+struct memory_counter {
+    std::atomic<size_t> live{0}; ///< The number of bytes currently allocated
+    std::atomic<size_t> peak{0}; ///< The maximum number of bytes allocated at once
+
+    /*!
+     * \brief Add the given number of bytes
+     */
+    void allocate(size_t bytes) {
+        const size_t current = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+        size_t previous = peak.load(std::memory_order_relaxed);
+        while (current > previous && !peak.compare_exchange_weak(previous, current, std::memory_order_relaxed)) {}
+    }
+
+    /*!
+     * \brief Remove the given number of bytes
+     */
+    void release(size_t bytes) {
+        live.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+};
+
+/*!
+ * \brief The counters of all the memory categories
+ */
+struct memory_stats_t {
+    std::array<memory_counter, memory_categories> categories; ///< The counter of each category
+    memory_counter total;                                     ///< The counter of all the categories together
+
+    /*!
+     * \brief Reset the peaks to the currently allocated memory
+     */
+    void reset_peaks() {
+        for (auto& counter : categories) {
+            counter.peak = counter.live.load();
+        }
+
+        total.peak = total.live.load();
+    }
+};
+
+/*!
+ * \brief Get a reference to the memory counters
+ */
+inline memory_stats_t& get_memory_stats() {
+    static memory_stats_t stats;
+    return stats;
+}
+
+/*!
+ * \brief Record an allocation of the given category
+ */
+inline void memory_allocated(memory_category category, size_t bytes) {
+    if (bytes) {
+        decltype(auto) stats = get_memory_stats();
+
+        stats.categories[size_t(category)].allocate(bytes);
+        stats.total.allocate(bytes);
+    }
+}
+
+/*!
+ * \brief Record a release of memory of the given category
+ */
+inline void memory_released(memory_category category, size_t bytes) {
+    if (bytes) {
+        decltype(auto) stats = get_memory_stats();
+
+        stats.categories[size_t(category)].release(bytes);
+        stats.total.release(bytes);
+    }
+}
+
+/*!
+ * \brief A snapshot of the memory usage
+ */
+struct memory_usage {
+    size_t live; ///< The number of bytes currently allocated
+    size_t peak; ///< The maximum number of bytes allocated at once
+};
+
+/*!
+ * \brief Returns the memory usage of the given category
+ */
+inline memory_usage get_memory_usage(memory_category category) {
+    auto& counter = get_memory_stats().categories[size_t(category)];
+    return {counter.live.load(), counter.peak.load()};
+}
+
+/*!
+ * \brief Returns the memory usage of all the categories together
+ */
+inline memory_usage get_memory_usage() {
+    auto& counter = get_memory_stats().total;
+    return {counter.live.load(), counter.peak.load()};
+}
+
+/*!
+ * \brief Reset the peaks to the currently allocated memory
+ */
+inline void reset_memory_peaks() {
+    get_memory_stats().reset_peaks();
+}
+
+/*!
+ * \brief Returns a human-readable string of the given number of bytes
+ */
+inline std::string memory_str(size_t bytes) {
+    std::ostringstream out;
+    out << std::setprecision(4);
+
+    if (bytes >= 1024UL * 1024UL * 1024UL) {
+        out << bytes / (1024.0 * 1024.0 * 1024.0) << "GB";
+    } else if (bytes >= 1024UL * 1024UL) {
+        out << bytes / (1024.0 * 1024.0) << "MB";
+    } else if (bytes >= 1024UL) {
+        out << bytes / 1024.0 << "KB";
+    } else {
+        out << bytes << "B";
+    }
+
+    return out.str();
+}
+
+/*!
+ * \brief Returns a one-line summary of the memory usage, with the live and
+ * peak bytes of each category
+ */
+inline std::string memory_summary() {
+    std::string summary;
+
+    for (size_t i = 0; i < memory_categories; ++i) {
+        auto usage = get_memory_usage(memory_category(i));
+
+        summary += std::string(to_string(memory_category(i))) + ": " + memory_str(usage.live) + " (peak " + memory_str(usage.peak) + ") ";
+    }
+
+    auto total = get_memory_usage();
+
+    return summary + "total: " + memory_str(total.live) + " (peak " + memory_str(total.peak) + ")";
+}
+
+/*!
+ * \brief Dump the memory usage of each category to the console in the form
+ * of a nice table.
+ */
+inline void dump_memory_pretty() {
+    std::cout << std::endl;
+
+    std::cout << " " << std::string(40, '-') << '\n';
+    printf(" | %-10s | %-10s | %-10s |\n", "Memory", "Live", "Peak");
+    std::cout << " " << std::string(40, '-') << '\n';
+
+    for (size_t i = 0; i < memory_categories; ++i) {
+        auto usage = get_memory_usage(memory_category(i));
+
+        printf(" | %-10s | %-10s | %-10s |\n", to_string(memory_category(i)), memory_str(usage.live).c_str(), memory_str(usage.peak).c_str());
+    }
+
+    auto total = get_memory_usage();
+
+    std::cout << " " << std::string(40, '-') << '\n';
+    printf(" | %-10s | %-10s | %-10s |\n", "total", memory_str(total.live).c_str(), memory_str(total.peak).c_str());
+    std::cout << " " << std::string(40, '-') << '\n';
+}
+
+/*!
+ * \brief A tracked amount of memory, with RAII.
+ *
+ * The tracked bytes are recorded in their category as long as the tracker
+ * is alive. A copy of the tracker tracks the bytes a second time, like the
+ * copy of the buffers it tracks.
+ */
+struct tracked_memory {
+    memory_category category; ///< The category of the memory
+    size_t bytes = 0;         ///< The number of tracked bytes
+
+    /*!
+     * \brief Track the given bytes in the given category
+     */
+    explicit tracked_memory(memory_category category, size_t bytes = 0) : category(category), bytes(bytes) {
+        memory_allocated(category, bytes);
+    }
+
+    tracked_memory(const tracked_memory& rhs) : category(rhs.category), bytes(rhs.bytes) {
+        memory_allocated(category, bytes);
+    }
+
+    tracked_memory(tracked_memory&& rhs) noexcept : category(rhs.category), bytes(rhs.bytes) {
+        rhs.bytes = 0;
+    }
+
+    tracked_memory& operator=(const tracked_memory& rhs) {
+        if (this != &rhs) {
+            memory_released(category, bytes);
+
+            category = rhs.category;
+            bytes    = rhs.bytes;
+
+            memory_allocated(category, bytes);
+        }
+
+        return *this;
+    }
+
+    tracked_memory& operator=(tracked_memory&& rhs) noexcept {
+        if (this != &rhs) {
+            memory_released(category, bytes);
+
+            category = rhs.category;
+            bytes    = rhs.bytes;
+
+            rhs.bytes = 0;
+        }
+
+        return *this;
+    }
+
+    ~tracked_memory() {
+        memory_released(category, bytes);
+    }
+
+    /*!
+     * \brief Change the number of tracked bytes
+     */
+    void track(size_t new_bytes) {
+        if (new_bytes > bytes) {
+            memory_allocated(category, new_bytes - bytes);
+        } else {
+            memory_released(category, bytes - new_bytes);
+        }
+
+        bytes = new_bytes;
+    }
+};
+
+/*!
+ * \brief Returns the number of bytes of the given buffer
+ */
+template <typename M>
+size_t buffer_bytes(const M& m) {
+    return etl::size(m) * sizeof(etl::value_t<M>);
+}
+
+/*!
+ * \brief Returns the memory available on the machine, 0 if it is unknown
+ */
+inline size_t available_memory() {
+    std::ifstream meminfo("/proc/meminfo");
+
+    std::string key;
+    size_t value = 0;
+    std::string unit;
+
+    while (meminfo >> key >> value >> unit) {
+        if (key == "MemAvailable:") {
+            return value * 1024UL;
+        }
+    }
+
+    return 0;
+}
+
+} //end of namespace dll
@@ -0,0 +1,260 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Compile-time planning of the memory of the activations and errors
+ * of one training step
+ */
+
+#pragma once
+
+#include <array>
+#include <type_traits>
+#include <utility>
+
+#include "dll/dbn_detail.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/util/arena.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A tensor of a training step, placed in the arena
+ */
+struct planned_tensor {
+    size_t bytes  = 0; ///< The size of the tensor, in bytes
+    size_t first  = 0; ///< The first step using the tensor
+    size_t last   = 0; ///< The last step using the tensor
+    size_t offset = 0; ///< The offset of the tensor in the arena
+
+    /*!
+     * \brief Indicates if the two tensors are alive at the same time
+     */
+    constexpr bool overlaps(const planned_tensor& rhs) const {
+        return first <= rhs.last && rhs.first <= last;
+    }
+};
+
+namespace memory_plan_detail {
+
+/*!
+ * \brief The size of one output of a layer, if it is known at compile
+ * time. The transform layers have no size of their own.
+ */
+template <typename L, typename Enable = void>
+struct static_output_size {
+    static constexpr bool known  = false; ///< Indicates if the size is known
+    static constexpr size_t value = 0;    ///< The size of one output
+};
+
+template <typename L>
+struct static_output_size<L, std::void_t<std::integral_constant<size_t, L::output_size()>>> {
+    static constexpr bool known  = true;             ///< Indicates if the size is known
+    static constexpr size_t value = L::output_size(); ///< The size of one output
+};
+
+/*!
+ * \brief Returns the size of a tensor of n values, aligned as in the
+ * training arena
+ */
+template <typename T>
+constexpr size_t tensor_bytes(size_t n) {
+    return (n * sizeof(T) + training_arena::alignment - 1) & ~(training_arena::alignment - 1);
+}
+
+/*!
+ * \brief Compute the plan of the tensors of a training step of the DBN.
+ *
+ * The steps are the forward pass of each layer (0 to L - 1), the loss (L)
+ * and the backward pass of each layer, from the last (L + 1) to the first
+ * (2L). The output of a layer is used until its backward pass, which is
+ * also the end of the forward pass of the next layer, the errors of the
+ * output of a layer are produced by the backward pass of the next layer
+ * and used by its own. The view layers share the tensors of their
+ * previous layer.
+ *
+ * The tensors are placed from the largest to the smallest, each one at the
+ * lowest offset that does not overlap a tensor alive at the same time.
+ */
+template <typename DBN, size_t... I>
+constexpr auto make_plan(std::index_sequence<I...> /*seq*/) {
+    using weight = typename DBN::weight;
+
+    constexpr size_t L = sizeof...(I);
+    constexpr size_t B = DBN::batch_size;
+
+    constexpr std::array<bool, L> known{{static_output_size<typename DBN::template layer_type<I>>::known...}};
+    constexpr std::array<size_t, L> sizes{{static_output_size<typename DBN::template layer_type<I>>::value...}};
+    constexpr std::array<bool, L> views{{dbn_detail::is_view_layer<typename DBN::template layer_type<I>>::value...}};
+
+    // 0 is the input, 1 + l the output of l and 1 + L + l its errors
+    std::array<planned_tensor, 2 * L + 1> plan{};
+
+    size_t size = DBN::template layer_type<0>::input_size();
+
+    plan[0].bytes = tensor_bytes<weight>(B * size);
+    plan[0].first = 0;
+    plan[0].last  = 2 * L;
+
+    for (size_t l = 0; l < L; ++l) {
+        // The transform layers keep the size of their input
+        if (known[l]) {
+            size = sizes[l];
+        }
+
+        const size_t bytes = views[l] ? 0 : tensor_bytes<weight>(B * size);
+
+        plan[1 + l].bytes = bytes;
+        plan[1 + l].first = l;
+        plan[1 + l].last  = 2 * L - l;
+
+        plan[1 + L + l].bytes = bytes;
+        plan[1 + L + l].first = 2 * L - l - 1;
+        plan[1 + L + l].last  = 2 * L - l;
+
+        // The errors of a view layer are the errors of its input
+        if (views[l] && l > 0) {
+            plan[L + l].first = plan[1 + L + l].first;
+        }
+    }
+
+    // Order the tensors by decreasing size
+
+    std::array<size_t, 2 * L + 1> order{};
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+
+    for (size_t i = 1; i < order.size(); ++i) {
+        for (size_t j = i; j > 0 && plan[order[j]].bytes > plan[order[j - 1]].bytes; --j) {
+            const size_t tmp = order[j];
+            order[j]         = order[j - 1];
+            order[j - 1]     = tmp;
+        }
+    }
+
+    // Place each tensor at the first offset free during its lifetime
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        auto& tensor = plan[order[i]];
+
+        if (!tensor.bytes) {
+            continue;
+        }
+
+        bool moved = true;
+
+        while (moved) {
+            moved = false;
+
+            for (size_t j = 0; j < i; ++j) {
+                auto& placed = plan[order[j]];
+
+                if (placed.bytes && tensor.overlaps(placed) && tensor.offset < placed.offset + placed.bytes && placed.offset < tensor.offset + tensor.bytes) {
+                    tensor.offset = placed.offset + placed.bytes;
+                    moved         = true;
+                }
+            }
+        }
+    }
+
+    return plan;
+}
+
+/*!
+ * \brief Returns the end of the last tensor of the plan
+ */
+template <size_t N>
+constexpr size_t plan_peak(const std::array<planned_tensor, N>& plan) {
+    size_t peak = 0;
+
+    for (size_t i = 0; i < N; ++i) {
+        peak = plan[i].offset + plan[i].bytes > peak ? plan[i].offset + plan[i].bytes : peak;
+    }
+
+    return peak;
+}
+
+/*!
+ * \brief Returns the size of all the tensors of the plan
+ */
+template <size_t N>
+constexpr size_t plan_naive(const std::array<planned_tensor, N>& plan) {
+    size_t naive = 0;
+
+    for (size_t i = 0; i < N; ++i) {
+        naive += plan[i].bytes;
+    }
+
+    return naive;
+}
+
+/*!
+ * \brief Indicates if all the layers of the DBN are static
+ */
+template <typename DBN, size_t... I>
+constexpr bool all_static(std::index_sequence<I...> /*seq*/) {
+    return (!decay_layer_traits<typename DBN::template layer_type<I>>::is_dynamic() && ...);
+}
+
+} //end of namespace memory_plan_detail
+
+/*!
+ * \brief The compile-time plan of the memory of the activations and errors
+ * of one training step of a network whose layers are all static.
+ *
+ * Each tensor (the input, the output of each layer and its errors) gets
+ * an offset in a single arena, the tensors that are not alive at the same
+ * time share the same memory. The peak of the plan is a constant
+ * expression:
+ *
+ * \code
+ * static_assert(dll::training_memory_plan<dbn_t>::peak <= 64 * 1024 * 1024, "Too much memory");
+ * \endcode
+ */
+template <typename DBN>
+struct training_memory_plan {
+    static constexpr size_t layers  = DBN::layers;   ///< The number of layers
+    static constexpr size_t tensors = 2 * layers + 1; ///< The number of planned tensors
+
+    static_assert(memory_plan_detail::all_static<DBN>(std::make_index_sequence<layers>()), "The memory can only be planned for static layers");
+
+    /*!
+     * \brief The planned tensors: the input, the output of each layer and
+     * the errors of each output
+     */
+    static constexpr std::array<planned_tensor, tensors> plan = memory_plan_detail::make_plan<DBN>(std::make_index_sequence<layers>());
+
+    /*!
+     * \brief Returns the offset of the input of the network in the arena
+     */
+    static constexpr size_t input_offset() {
+        return plan[0].offset;
+    }
+
+    /*!
+     * \brief Returns the offset of the output of the layer l in the arena
+     */
+    static constexpr size_t output_offset(size_t l) {
+        return plan[1 + l].offset;
+    }
+
+    /*!
+     * \brief Returns the offset of the errors of the output of the layer l
+     * in the arena
+     */
+    static constexpr size_t errors_offset(size_t l) {
+        return plan[1 + layers + l].offset;
+    }
+
+    static constexpr size_t peak  = memory_plan_detail::plan_peak(plan);  ///< The size of the arena, in bytes
+    static constexpr size_t naive = memory_plan_detail::plan_naive(plan); ///< The size of all the tensors without reuse, in bytes
+};
+
+} //end of dll namespace
@@ -0,0 +1,517 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Export of the timers as metrics, pushed to StatsD or served to
+ * Prometheus
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cpp_utils/assert.hpp"
+
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The metrics of one timer
+ */
+struct timer_metric {
+    std::string name;       ///< The name of the timer
+    size_t count;           ///< The number of times it was incremented
+    size_t duration;        ///< The total duration, in nanoseconds
+    bool histogram = false; ///< Indicates if the percentiles were recorded (see histogram_timers())
+    size_t p50     = 0;     ///< The median duration, in nanoseconds
+    size_t p90     = 0;     ///< The 90th percentile duration, in nanoseconds
+    size_t p99     = 0;     ///< The 99th percentile duration, in nanoseconds
+    size_t max     = 0;     ///< The maximum duration, in nanoseconds
+};
+
+/*!
+ * \brief Returns a snapshot of the timers merged over all the threads,
+ * without resetting them
+ */
+inline std::vector<timer_metric> timer_metrics() {
+    std::vector<timer_metric> metrics;
+
+#ifndef DLL_NO_TIMERS
+    for (auto& timer : merged_timers()) {
+        metrics.push_back({timer.name, timer.count, timer.duration});
+
+        if (timer.has_latencies()) {
+            auto& metric = metrics.back();
+
+            metric.histogram = true;
+            metric.p50       = timer.latency(0.5);
+            metric.p90       = timer.latency(0.9);
+            metric.p99       = timer.latency(0.99);
+            metric.max       = timer.latency_max;
+        }
+    }
+#endif
+
+    return metrics;
+}
+
+/*!
+ * \brief Exporter of the timers and of custom gauges as metrics.
+ *
+ * The metrics are either pushed periodically to a StatsD endpoint (UDP) or
+ * served on a Prometheus text endpoint (HTTP), or both, from a background
+ * thread. For each timer, the number of calls, the total duration and the
+ * average duration are exported, and the percentiles of the timers whose
+ * latency histograms are recorded. The timers are never reset by the
+ * exporter.
+ *
+ * Custom gauges (the statistics of an inference server for instance) are
+ * evaluated by the exporter thread and must thus be thread-safe.
+ */
+struct metrics_exporter {
+    /*!
+     * \brief Create a new exporter
+     * \param prefix The prefix of the names of the metrics
+     * \param period_ms The period of the StatsD pushes, in milliseconds
+     */
+    explicit metrics_exporter(std::string prefix = "dll", size_t period_ms = 10000)
+            : prefix(std::move(prefix)), period(std::max(period_ms, size_t(1))) {}
+
+    metrics_exporter(const metrics_exporter& rhs) = delete;
+    metrics_exporter& operator=(const metrics_exporter& rhs) = delete;
+
+    /*!
+     * \brief Stop the exporter
+     */
+    ~metrics_exporter() {
+        stop();
+    }
+
+    /*!
+     * \brief Add a custom gauge to the exported metrics
+     * \param name The name of the gauge
+     * \param value The functor returning the current value of the gauge
+     */
+    void add_gauge(const std::string& name, std::function<double()> value) {
+        std::lock_guard<std::mutex> l(lock);
+
+        gauges.emplace_back(sanitize(name), std::move(value));
+    }
+
+    /*!
+     * \brief Push the metrics periodically to the given StatsD endpoint
+     * \param endpoint The endpoint, as host:port
+     * \return true if the endpoint could be resolved, false otherwise
+     */
+    bool push_statsd(const std::string& endpoint) {
+        auto [host, port] = split_endpoint(endpoint, "8125");
+
+        addrinfo hints{};
+        hints.ai_family   = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        addrinfo* result = nullptr;
+
+        if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+            std::cerr << "ERROR: Impossible to resolve the StatsD endpoint " << endpoint << std::endl;
+            return false;
+        }
+
+        int fd = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+
+        // The socket is connected so that each push is a simple send
+        if (fd >= 0 && ::connect(fd, result->ai_addr, result->ai_addrlen) < 0) {
+            ::close(fd);
+            fd = -1;
+        }
+
+        ::freeaddrinfo(result);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to connect to the StatsD endpoint " << endpoint << std::endl;
+            return false;
+        }
+
+        join();
+
+        if (statsd_fd >= 0) {
+            ::close(statsd_fd);
+        }
+
+        statsd_fd = fd;
+
+        start();
+
+        return true;
+    }
+
+    /*!
+     * \brief Serve the metrics on a Prometheus text endpoint
+     * \param port The TCP port to listen on
+     * \return true if the port could be bound, false otherwise
+     */
+    bool serve_prometheus(size_t port) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to create the Prometheus socket" << std::endl;
+            return false;
+        }
+
+        int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in address{};
+        address.sin_family      = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port        = htons(uint16_t(port));
+
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(fd, 16) < 0) {
+            ::close(fd);
+
+            std::cerr << "ERROR: Impossible to listen on port " << port << " for Prometheus" << std::endl;
+            return false;
+        }
+
+        join();
+
+        if (listen_fd >= 0) {
+            ::close(listen_fd);
+        }
+
+        listen_fd = fd;
+
+        start();
+
+        return true;
+    }
+
+    /*!
+     * \brief Stop the exporter thread and close the sockets
+     */
+    void stop() {
+        join();
+
+        if (statsd_fd >= 0) {
+            ::close(statsd_fd);
+            statsd_fd = -1;
+        }
+
+        if (listen_fd >= 0) {
+            ::close(listen_fd);
+            listen_fd = -1;
+        }
+    }
+
+    /*!
+     * \brief Returns the metrics in the Prometheus text exposition format
+     */
+    std::string prometheus_text() {
+        auto timers = timer_metrics();
+
+        std::ostringstream os;
+        os.precision(9);
+
+        os << "# TYPE " << prefix << "_timer_calls_total counter\n";
+        for (auto& timer : timers) {
+            os << prefix << "_timer_calls_total{timer=\"" << escape(timer.name) << "\"} " << timer.count << '\n';
+        }
+
+        os << "# TYPE " << prefix << "_timer_seconds_total counter\n";
+        for (auto& timer : timers) {
+            os << prefix << "_timer_seconds_total{timer=\"" << escape(timer.name) << "\"} " << timer.duration * 1e-9 << '\n';
+        }
+
+        os << "# TYPE " << prefix << "_timer_average_seconds gauge\n";
+        for (auto& timer : timers) {
+            os << prefix << "_timer_average_seconds{timer=\"" << escape(timer.name) << "\"} " << average(timer) * 1e-9 << '\n';
+        }
+
+        if (std::any_of(timers.begin(), timers.end(), [](auto& timer) { return timer.histogram; })) {
+            os << "# TYPE " << prefix << "_timer_latency_seconds summary\n";
+            for (auto& timer : timers) {
+                if (timer.histogram) {
+                    const auto label = prefix + "_timer_latency_seconds{timer=\"" + escape(timer.name) + "\",quantile=";
+
+                    os << label << "\"0.5\"} " << timer.p50 * 1e-9 << '\n';
+                    os << label << "\"0.9\"} " << timer.p90 * 1e-9 << '\n';
+                    os << label << "\"0.99\"} " << timer.p99 * 1e-9 << '\n';
+                    os << label << "\"1\"} " << timer.max * 1e-9 << '\n';
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> l(lock);
+
+        for (auto& [name, value] : gauges) {
+            os << "# TYPE " << prefix << "_" << name << " gauge\n";
+            os << prefix << "_" << name << " " << value() << '\n';
+        }
+
+        return os.str();
+    }
+
+    /*!
+     * \brief Returns the metrics as StatsD lines.
+     *
+     * The numbers of calls are sent as counters, incremented by the calls
+     * since the previous call of this function, the durations (in
+     * milliseconds) and the custom gauges as gauges.
+     */
+    std::vector<std::string> statsd_lines() {
+        auto timers = timer_metrics();
+
+        std::vector<std::string> lines;
+
+        std::lock_guard<std::mutex> l(lock);
+
+        for (auto& timer : timers) {
+            const auto name = prefix + "." + sanitize(timer.name);
+
+            auto it = std::find_if(sent.begin(), sent.end(), [&timer](auto& previous) { return previous.first == timer.name; });
+
+            if (it == sent.end()) {
+                sent.emplace_back(timer.name, 0);
+                it = sent.end() - 1;
+            }
+
+            // The timers may have been reset since the previous push
+            const size_t delta = timer.count >= it->second ? timer.count - it->second : timer.count;
+
+            it->second = timer.count;
+
+            lines.push_back(name + ".calls:" + std::to_string(delta) + "|c");
+            lines.push_back(name + ".total_ms:" + number(timer.duration * 1e-6) + "|g");
+            lines.push_back(name + ".average_ms:" + number(average(timer) * 1e-6) + "|g");
+
+            if (timer.histogram) {
+                lines.push_back(name + ".p50_ms:" + number(timer.p50 * 1e-6) + "|g");
+                lines.push_back(name + ".p90_ms:" + number(timer.p90 * 1e-6) + "|g");
+                lines.push_back(name + ".p99_ms:" + number(timer.p99 * 1e-6) + "|g");
+                lines.push_back(name + ".max_ms:" + number(timer.max * 1e-6) + "|g");
+            }
+        }
+
+        for (auto& [name, value] : gauges) {
+            lines.push_back(prefix + "." + name + ":" + number(value()) + "|g");
+        }
+
+        return lines;
+    }
+
+private:
+    static constexpr size_t max_datagram = 1432; ///< The maximum size of a StatsD datagram
+
+    /*!
+     * \brief Stop the exporter thread, keeping the sockets open
+     */
+    void join() {
+        if (thread.joinable()) {
+            running = false;
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Start the exporter thread
+     */
+    void start() {
+        running = true;
+        thread  = std::thread([this] { run(); });
+    }
+
+    /*!
+     * \brief The loop of the exporter thread
+     */
+    void run() {
+        auto next_push = std::chrono::steady_clock::now();
+
+        while (running) {
+            if (statsd_fd >= 0 && std::chrono::steady_clock::now() >= next_push) {
+                push();
+
+                next_push += period;
+            }
+
+            // Wake up regularly to react to stop()
+            const int timeout = 100;
+
+            if (listen_fd >= 0) {
+                pollfd p{listen_fd, POLLIN, 0};
+
+                if (::poll(&p, 1, timeout) > 0 && (p.revents & POLLIN)) {
+                    answer();
+                }
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+            }
+        }
+    }
+
+    /*!
+     * \brief Push the metrics to StatsD, several lines per datagram
+     */
+    void push() {
+        std::string datagram;
+
+        for (auto& line : statsd_lines()) {
+            if (!datagram.empty() && datagram.size() + 1 + line.size() > max_datagram) {
+                ::send(statsd_fd, datagram.data(), datagram.size(), MSG_NOSIGNAL);
+                datagram.clear();
+            }
+
+            if (!datagram.empty()) {
+                datagram += '\n';
+            }
+
+            datagram += line;
+        }
+
+        if (!datagram.empty()) {
+            ::send(statsd_fd, datagram.data(), datagram.size(), MSG_NOSIGNAL);
+        }
+    }
+
+    /*!
+     * \brief Answer one scrape of Prometheus
+     */
+    void answer() {
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+
+        if (fd < 0) {
+            return;
+        }
+
+        // Any request (normally GET /metrics) is answered with the metrics
+        pollfd p{fd, POLLIN, 0};
+
+        if (::poll(&p, 1, 1000) > 0) {
+            char request[1024];
+            cpp_unused(::recv(fd, request, sizeof(request), 0));
+        }
+
+        auto body = prometheus_text();
+
+        auto response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+        const char* it = response.data();
+        size_t bytes   = response.size();
+
+        while (bytes) {
+            auto written = ::send(fd, it, bytes, MSG_NOSIGNAL);
+
+            if (written <= 0) {
+                break;
+            }
+
+            it += written;
+            bytes -= written;
+        }
+
+        ::close(fd);
+    }
+
+    /*!
+     * \brief Returns the average duration of a timer, in nanoseconds
+     */
+    static double average(const timer_metric& timer) {
+        return timer.count ? double(timer.duration) / timer.count : 0.0;
+    }
+
+    /*!
+     * \brief Format a number for StatsD
+     */
+    static std::string number(double value) {
+        char buffer[64];
+        snprintf(buffer, 64, "%.6f", value);
+        return buffer;
+    }
+
+    /*!
+     * \brief Returns the name of a metric with only [a-zA-Z0-9_]
+     */
+    static std::string sanitize(const std::string& name) {
+        std::string result = name;
+
+        for (auto& c : result) {
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') {
+                c = '_';
+            }
+        }
+
+        return result;
+    }
+
+    /*!
+     * \brief Escape a label value for Prometheus
+     */
+    static std::string escape(const std::string& value) {
+        std::string result;
+
+        for (auto c : value) {
+            if (c == '\\' || c == '"') {
+                result += '\\';
+                result += c;
+            } else if (c == '\n') {
+                result += "\\n";
+            } else {
+                result += c;
+            }
+        }
+
+        return result;
+    }
+
+    /*!
+     * \brief Split an endpoint into host and port
+     */
+    static std::pair<std::string, std::string> split_endpoint(const std::string& endpoint, const std::string& default_port) {
+        const size_t colon = endpoint.rfind(':');
+
+        if (colon == std::string::npos) {
+            return {endpoint, default_port};
+        }
+
+        return {endpoint.substr(0, colon), endpoint.substr(colon + 1)};
+    }
+
+    const std::string prefix;               ///< The prefix of the names of the metrics
+    const std::chrono::milliseconds period; ///< The period of the StatsD pushes
+
+    std::mutex lock;                                                     ///< The lock protecting the gauges and the sent counts
+    std::vector<std::pair<std::string, std::function<double()>>> gauges; ///< The custom gauges
+    std::vector<std::pair<std::string, size_t>> sent;                    ///< The counts of the timers at the previous push
+
+    std::thread thread;               ///< The exporter thread
+    std::atomic<bool> running{false}; ///< Indicates if the exporter thread must run
+    int statsd_fd = -1;               ///< The StatsD socket
+    int listen_fd = -1;               ///< The Prometheus listening socket
+};
+
+} //end of dll namespace
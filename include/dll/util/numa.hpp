@@ -0,0 +1,433 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief NUMA placement of the data caches, pinning of the worker threads
+ * and per-node replicas of networks.
+ *
+ * The policy is given by the numa parameter of the network (interleave and
+ * pin) or by the DLL_NUMA environment variable, a comma-separated list of
+ * interleave, pin and replicate (or all). On a single-node machine, or on
+ * other systems than Linux, all the functions do nothing.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "cpp_utils/assert.hpp"
+#include "cpp_utils/maybe_parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The NUMA policy
+ */
+struct numa_config {
+    bool interleave = false; ///< Interleave the data caches on all the nodes
+    bool pin        = false; ///< Pin the worker threads to cores
+    bool replicate  = false; ///< Replicate the networks on each node for inference
+};
+
+/*!
+ * \brief Returns the NUMA policy given by the DLL_NUMA environment variable
+ */
+inline const numa_config& numa_env() {
+    static const numa_config config = [] {
+        numa_config c;
+
+        if (auto* env = std::getenv("DLL_NUMA")) {
+            const std::string value(env);
+            const bool all = value == "1" || value == "all";
+
+            c.interleave = all || value.find("interleave") != std::string::npos;
+            c.pin        = all || value.find("pin") != std::string::npos;
+            c.replicate  = all || value.find("replicate") != std::string::npos;
+        }
+
+        return c;
+    }();
+
+    return config;
+}
+
+/*!
+ * \brief The NUMA nodes of the machine and their CPUs
+ */
+struct numa_topology {
+    std::vector<size_t> ids;               ///< The system identifier of each node
+    std::vector<std::vector<size_t>> cpus; ///< The CPUs of each node
+
+    /*!
+     * \brief Returns the number of nodes
+     */
+    size_t nodes() const {
+        return ids.size();
+    }
+
+    /*!
+     * \brief Returns the node of the given CPU
+     */
+    size_t node_of(size_t cpu) const {
+        for (size_t n = 0; n < cpus.size(); ++n) {
+            for (auto c : cpus[n]) {
+                if (c == cpu) {
+                    return n;
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    /*!
+     * \brief Returns the CPU to use for the ith worker.
+     *
+     * The workers fill the first node before using the next one.
+     */
+    size_t worker_cpu(size_t i) const {
+        size_t total = 0;
+        for (auto& node : cpus) {
+            total += node.size();
+        }
+
+        i = i % total;
+
+        for (auto& node : cpus) {
+            if (i < node.size()) {
+                return node[i];
+            }
+
+            i -= node.size();
+        }
+
+        return 0;
+    }
+};
+
+namespace numa_detail {
+
+/*!
+ * \brief Parse a list of CPUs ("0-3,8-11")
+ */
+inline std::vector<size_t> parse_cpu_list(const std::string& list) {
+    std::vector<size_t> cpus;
+
+    std::istringstream is(list);
+    std::string range;
+
+    while (std::getline(is, range, ',')) {
+        if (range.empty() || range[0] == '\n') {
+            continue;
+        }
+
+        auto dash = range.find('-');
+
+        const size_t first = std::stoul(range.substr(0, dash));
+        const size_t last  = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+
+        for (size_t c = first; c <= last; ++c) {
+            cpus.push_back(c);
+        }
+    }
+
+    return cpus;
+}
+
+} //end of namespace numa_detail
+
+/*!
+ * \brief Returns the NUMA topology of the machine
+ */
+inline const numa_topology& get_numa_topology() {
+    static const numa_topology topology = [] {
+        numa_topology t;
+
+        for (size_t id = 0; id < 256; ++id) {
+            std::ifstream is("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+
+            std::string list;
+            if (is && std::getline(is, list)) {
+                auto cpus = numa_detail::parse_cpu_list(list);
+
+                if (!cpus.empty()) {
+                    t.ids.push_back(id);
+                    t.cpus.push_back(std::move(cpus));
+                }
+            }
+        }
+
+        // Without NUMA support, all the CPUs are on a single node
+        if (t.ids.empty()) {
+            t.ids.push_back(0);
+            t.cpus.emplace_back();
+
+            for (size_t c = 0; c < std::max(1U, std::thread::hardware_concurrency()); ++c) {
+                t.cpus.back().push_back(c);
+            }
+        }
+
+        return t;
+    }();
+
+    return topology;
+}
+
+/*!
+ * \brief Returns the node of the calling thread
+ */
+inline size_t numa_current_node() {
+#ifdef __linux__
+    const int cpu = sched_getcpu();
+
+    if (cpu >= 0) {
+        return get_numa_topology().node_of(cpu);
+    }
+#endif
+
+    return 0;
+}
+
+/*!
+ * \brief Interleave the pages of the given memory on all the nodes. The
+ * pages already allocated are moved.
+ *
+ * \return true if the memory has been interleaved, false otherwise
+ */
+inline bool numa_interleave(const void* memory, size_t bytes) {
+#ifdef __linux__
+    auto& topology = get_numa_topology();
+
+    if (topology.nodes() < 2 || !memory || !bytes) {
+        return false;
+    }
+
+    unsigned long mask[256 / (8 * sizeof(unsigned long))] = {};
+
+    for (auto id : topology.ids) {
+        mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+    }
+
+    const auto page  = size_t(sysconf(_SC_PAGESIZE));
+    const auto first = reinterpret_cast<uintptr_t>(memory) & ~(page - 1);
+    const auto last  = reinterpret_cast<uintptr_t>(memory) + bytes;
+
+    constexpr int mpol_interleave = 3; // MPOL_INTERLEAVE
+    constexpr int mpol_mf_move    = 2; // MPOL_MF_MOVE
+
+    return syscall(SYS_mbind, first, last - first, mpol_interleave, mask, 8 * sizeof(mask) + 1, mpol_mf_move) == 0;
+#else
+    cpp_unused(memory);
+    cpp_unused(bytes);
+    return false;
+#endif
+}
+
+/*!
+ * \brief Bind the pages of the given memory to the given node. The pages
+ * already allocated are moved.
+ *
+ * \return true if the memory has been bound, false otherwise
+ */
+inline bool numa_bind(const void* memory, size_t bytes, size_t node) {
+#ifdef __linux__
+    auto& topology = get_numa_topology();
+
+    if (topology.nodes() < 2 || !memory || !bytes) {
+        return false;
+    }
+
+    const auto id = topology.ids[node % topology.nodes()];
+
+    unsigned long mask[256 / (8 * sizeof(unsigned long))] = {};
+    mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+
+    const auto page  = size_t(sysconf(_SC_PAGESIZE));
+    const auto first = reinterpret_cast<uintptr_t>(memory) & ~(page - 1);
+    const auto last  = reinterpret_cast<uintptr_t>(memory) + bytes;
+
+    constexpr int mpol_bind    = 2; // MPOL_BIND
+    constexpr int mpol_mf_move = 2; // MPOL_MF_MOVE
+
+    return syscall(SYS_mbind, first, last - first, mpol_bind, mask, 8 * sizeof(mask) + 1, mpol_mf_move) == 0;
+#else
+    cpp_unused(memory);
+    cpp_unused(bytes);
+    cpp_unused(node);
+    return false;
+#endif
+}
+
+/*!
+ * \brief Pin the calling thread to the CPU of the ith worker
+ */
+inline bool numa_pin_worker(size_t i) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(get_numa_topology().worker_cpu(i), &set);
+
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    cpp_unused(i);
+    return false;
+#endif
+}
+
+/*!
+ * \brief Pin the calling thread to the CPUs of the given node
+ */
+inline bool numa_pin_node(size_t node) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (auto cpu : get_numa_topology().cpus[node]) {
+        CPU_SET(cpu, &set);
+    }
+
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    cpp_unused(node);
+    return false;
+#endif
+}
+
+/*!
+ * \brief Pin each of the threads of the given pool on its own core.
+ *
+ * One task is given per thread and the tasks wait for each other (up to a
+ * timeout), so that each thread of the pool gets exactly one task.
+ *
+ * \param pool The thread pool
+ * \param threads The number of threads of the pool
+ */
+template <bool Parallel>
+void numa_pin_pool(cpp::thread_pool<Parallel>& pool, size_t threads) {
+    // A serial pool runs the tasks on the calling thread
+    if constexpr (Parallel) {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> started{0};
+
+        for (size_t t = 0; t < threads; ++t) {
+            pool.do_task([&next, &started, threads]() {
+                numa_pin_worker(next++);
+
+                ++started;
+
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+
+                while (started < threads && std::chrono::steady_clock::now() < deadline) {
+                    std::this_thread::yield();
+                }
+            });
+        }
+
+        pool.wait();
+    } else {
+        cpp_unused(pool);
+        cpp_unused(threads);
+    }
+}
+
+/*!
+ * \brief Read-only replicas of a network, one per NUMA node.
+ *
+ * Each replica is allocated, and first touched, by a thread running on its
+ * node, so its weights are local to the threads of this node. The replicas
+ * are only made if the replicate policy is active (DLL_NUMA) and if there
+ * are several nodes, otherwise there is a single copy.
+ *
+ * The replicas are not updated when the network is trained, sync()
+ * must be called again.
+ */
+template <typename DBN>
+struct numa_replicas {
+    std::vector<std::unique_ptr<DBN>> replicas; ///< The replica of each node
+
+    /*!
+     * \brief Build the replicas of the given network
+     */
+    explicit numa_replicas(const DBN& dbn) {
+        sync(dbn);
+    }
+
+    /*!
+     * \brief Copy the weights of the given network into all the replicas
+     */
+    void sync(const DBN& dbn) {
+        std::stringstream stream;
+        dbn.store(stream);
+
+        const std::string weights = stream.str();
+
+        auto& topology = get_numa_topology();
+
+        replicas.resize(numa_env().replicate ? topology.nodes() : 1);
+
+        std::vector<std::thread> threads;
+
+        for (size_t n = 0; n < replicas.size(); ++n) {
+            threads.emplace_back([this, n, &weights]() {
+                if (replicas.size() > 1) {
+                    numa_pin_node(n);
+                }
+
+                if (!replicas[n]) {
+                    replicas[n] = std::make_unique<DBN>();
+                }
+
+                std::istringstream is(weights);
+                replicas[n]->load(is);
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of replicas
+     */
+    size_t size() const {
+        return replicas.size();
+    }
+
+    /*!
+     * \brief Returns the replica of the given node
+     */
+    const DBN& node(size_t n) const {
+        return *replicas[n];
+    }
+
+    /*!
+     * \brief Returns the replica of the node of the calling thread
+     */
+    DBN& local() {
+        return *replicas[replicas.size() > 1 ? numa_current_node() % replicas.size() : 0];
+    }
+};
+
+} //end of dll namespace
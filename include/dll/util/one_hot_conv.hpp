@@ -0,0 +1,176 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the "valid" convolutions of one-hot encoded sequences,
+ * given by the indices of their hot elements.
+ *
+ * The input of a sample is a sequence of I indices in [0, V), standing for
+ * a one-hot matrix [V x I]. Only one weight per filter and position of the
+ * kernel is hit by each index, the convolution gathers these weights
+ * instead of multiplying the zeros of the one-hot matrix.
+ *
+ * The weights are stored [V x NW x K], the K filters of one index at one
+ * position of the kernel being contiguous. The outputs are [K x NH x 1],
+ * with NH = I - NW + 1, like the outputs of a convolutional layer.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/sparse_rows.hpp"
+
+namespace dll {
+
+namespace one_hot_detail {
+
+/*!
+ * \brief Returns the index of the given input value
+ */
+template <typename T>
+size_t index_of(T value, size_t V) {
+    const auto c = size_t(value);
+
+    cpp_assert(c < V, "Invalid index in one-hot input");
+    cpp_unused(V);
+
+    return c;
+}
+
+} //end of namespace one_hot_detail
+
+/*!
+ * \brief Compute the convolution of a batch of one-hot sequences, with the
+ * biases, the samples being computed in parallel.
+ *
+ * \param output The output [B x K x NH x 1]
+ * \param input The indices [B x I]
+ * \param w The weights [V x NW x K]
+ * \param b The biases [K]
+ */
+template <typename O, typename In, typename W, typename Bias>
+void one_hot_conv_forward(O&& output, const In& input, const W& w, const Bias& b) {
+    using T = etl::value_t<W>;
+
+    const size_t V  = etl::dim<0>(w);
+    const size_t NW = etl::dim<1>(w);
+    const size_t K  = etl::dim<2>(w);
+    const size_t I  = etl::dim<1>(input);
+    const size_t NH = I - NW + 1;
+
+    cpu_access(input, w, b);
+
+    T* out         = output.memory_start();
+    const auto* in = input.memory_start();
+    const T* ws    = w.memory_start();
+    const T* bias  = b.memory_start();
+
+    parallel_kernel(0, etl::dim<0>(input), [&](size_t s) {
+        T* o            = out + s * K * NH;
+        const auto* idx = in + s * I;
+
+        for (size_t k = 0; k < K; ++k) {
+            std::fill_n(o + k * NH, NH, bias[k]);
+        }
+
+        for (size_t i = 0; i < NH; ++i) {
+            for (size_t p = 0; p < NW; ++p) {
+                const T* wr = ws + (one_hot_detail::index_of(idx[i + p], V) * NW + p) * K;
+
+                for (size_t k = 0; k < K; ++k) {
+                    o[k * NH + i] += wr[k];
+                }
+            }
+        }
+    });
+
+    cpu_modified(output);
+}
+
+/*!
+ * \brief Compute the gradients of the weights of a convolution of one-hot
+ * sequences.
+ *
+ * Only the rows of the weights of the indices of the batch are non-zero.
+ * When the updater of the weights supports sparse rows, only the rows
+ * touched by the previous batch are cleared and the touched rows are
+ * recorded, otherwise the complete gradients are cleared.
+ *
+ * \param sub The updater sub context of the weights [V x NW x K]
+ * \param input The indices [B x I]
+ * \param errors The errors [B x K x NH x 1]
+ */
+template <typename Sub, typename In, typename E>
+void one_hot_conv_gradients(Sub& sub, const In& input, const E& errors) {
+    using T = etl::value_t<decltype(sub.grad)>;
+
+    auto& grad = sub.grad;
+
+    const size_t V  = etl::dim<0>(grad);
+    const size_t NW = etl::dim<1>(grad);
+    const size_t K  = etl::dim<2>(grad);
+    const size_t B  = etl::dim<0>(input);
+    const size_t I  = etl::dim<1>(input);
+    const size_t NH = I - NW + 1;
+
+    if constexpr (has_sparse_rows<Sub>::value) {
+        for (auto r : sub.rows) {
+            grad(r) = 0;
+        }
+
+        sub.rows.clear();
+    } else {
+        grad = 0;
+    }
+
+    cpu_access(input, errors, grad);
+
+    T* g           = grad.memory_start();
+    const auto* in = input.memory_start();
+    const T* e     = errors.memory_start();
+
+    // The scatter is serial, several samples hit the same rows
+    for (size_t s = 0; s < B; ++s) {
+        const auto* idx = in + s * I;
+        const T* es     = e + s * K * NH;
+
+        for (size_t i = 0; i < NH; ++i) {
+            for (size_t p = 0; p < NW; ++p) {
+                const size_t c = one_hot_detail::index_of(idx[i + p], V);
+
+                T* gr = g + (c * NW + p) * K;
+
+                for (size_t k = 0; k < K; ++k) {
+                    gr[k] += es[k * NH + i];
+                }
+            }
+        }
+
+        if constexpr (has_sparse_rows<Sub>::value) {
+            for (size_t i = 0; i < I; ++i) {
+                sub.rows.push_back(one_hot_detail::index_of(idx[i], V));
+            }
+        }
+    }
+
+    if constexpr (has_sparse_rows<Sub>::value) {
+        std::sort(sub.rows.begin(), sub.rows.end());
+        sub.rows.erase(std::unique(sub.rows.begin(), sub.rows.end()), sub.rows.end());
+    }
+
+    cpu_modified(grad);
+}
+
+} //end of dll namespace
@@ -0,0 +1,209 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Parallel loops for the compute kernels
+ */
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/maybe_parallel.hpp"
+
+#include "dll/util/numa.hpp"
+#include "dll/util/thread_budget.hpp"
+
+namespace dll {
+
+namespace parallel_detail {
+
+/*!
+ * \brief Returns the thread pool shared by all the kernels
+ */
+inline cpp::thread_pool<true>& kernel_pool() {
+    static cpp::thread_pool<true> pool(thread_budget());
+    return pool;
+}
+
+/*!
+ * \brief Returns the lock serializing the users of the kernel pool
+ */
+inline std::mutex& kernel_lock() {
+    static std::mutex lock;
+    return lock;
+}
+
+/*!
+ * \brief Returns the flag indicating that the current thread is running a
+ * kernel functor, whatever the type of the functor
+ */
+inline bool& nested_kernels() {
+    thread_local bool nested = false;
+    return nested;
+}
+
+/*!
+ * \brief Returns the flag indicating that the kernels of the current
+ * thread are run serially
+ */
+inline bool& serial_kernels() {
+    thread_local bool serial = false;
+    return serial;
+}
+
+} //end of namespace parallel_detail
+
+/*!
+ * \brief Returns a buffer of n elements for the temporaries of a kernel
+ * (partial sums, blocks, ...), owned by the calling thread and reused by
+ * its next calls.
+ *
+ * The buffer never shrinks, once it has reached its largest size, the
+ * kernels running in steady state do not allocate anymore. The content of
+ * the buffer is unspecified. Only one kernel at a time can use the buffer
+ * of a type on a thread, the Tag distinguishes the buffers that are alive
+ * at the same time.
+ *
+ * \param n The number of elements
+ */
+template <typename T, typename Tag = void>
+std::vector<T>& kernel_scratch(size_t n) {
+    thread_local std::vector<T> buffer;
+    buffer.resize(n);
+    return buffer;
+}
+
+/*!
+ * \brief Run the kernels of the current thread serially while the section
+ * is alive, for threads that are already running in parallel.
+ */
+struct serial_kernels_section {
+    serial_kernels_section() : previous(parallel_detail::serial_kernels()) {
+        parallel_detail::serial_kernels() = true;
+    }
+
+    serial_kernels_section(const serial_kernels_section& rhs) = delete;
+    serial_kernels_section& operator=(const serial_kernels_section& rhs) = delete;
+
+    ~serial_kernels_section() {
+        parallel_detail::serial_kernels() = previous;
+    }
+
+private:
+    bool previous; ///< The previous state of the thread
+};
+
+/*!
+ * \brief Run the current thread as one of the workers of a parallel section
+ * while the section is alive.
+ *
+ * The parallelism is already provided by the workers, the ETL expressions,
+ * the kernels and the BLAS calls of the worker are run serially.
+ */
+struct worker_section {
+    worker_section() : etl_serial(etl::local_context().serial) {
+        etl::local_context().serial = true;
+
+#ifdef ETL_MKL_MODE
+        blas_threads = mkl_set_num_threads_local(1);
+#endif
+    }
+
+    worker_section(const worker_section& rhs) = delete;
+    worker_section& operator=(const worker_section& rhs) = delete;
+
+    ~worker_section() {
+#ifdef ETL_MKL_MODE
+        mkl_set_num_threads_local(blas_threads);
+#endif
+
+        etl::local_context().serial = etl_serial;
+    }
+
+private:
+    serial_kernels_section kernels; ///< The kernels are run serially
+    bool etl_serial;                ///< The previous state of ETL for the thread
+    int blas_threads = 0;           ///< The previous number of BLAS threads of the thread (0 for the global one)
+};
+
+/*!
+ * \brief Call the given functor for each index in [first, last), in
+ * parallel.
+ *
+ * All the kernels share a single thread pool, sized from the thread
+ * budget, concurrent callers are serialized. Nested calls, from inside a
+ * functor of any kernel, and calls inside a serial_kernels_section are run
+ * serially. The functors are run inside a worker_section.
+ *
+ * \param first The first index
+ * \param last The end of the indices
+ * \param fun The functor to call with each index
+ */
+template <typename Functor>
+void parallel_kernel(size_t first, size_t last, Functor&& fun) {
+    if (last - first < 2 || parallel_detail::nested_kernels() || parallel_detail::serial_kernels()) {
+        for (size_t i = first; i < last; ++i) {
+            fun(i);
+        }
+
+        return;
+    }
+
+    std::lock_guard<std::mutex> l(parallel_detail::kernel_lock());
+
+    cpp::maybe_parallel_foreach_n(parallel_detail::kernel_pool(), first, last, [&fun](size_t i) {
+        worker_section section;
+
+        auto& nested = parallel_detail::nested_kernels();
+
+        nested = true;
+        fun(i);
+        nested = false;
+    });
+}
+
+/*!
+ * \brief Pin the threads of the kernel pool to cores (see numa_pin_pool)
+ */
+inline void numa_pin_kernels() {
+    std::lock_guard<std::mutex> l(parallel_detail::kernel_lock());
+
+    numa_pin_pool(parallel_detail::kernel_pool(), thread_budget());
+}
+
+namespace parallel_detail {
+
+template <typename Functor, size_t... I>
+void parallel_static_for(Functor& fun, std::index_sequence<I...> /*seq*/) {
+    std::array<std::function<void()>, sizeof...(I)> tasks = {{[&fun] { fun(std::integral_constant<size_t, I>()); }...}};
+
+    parallel_kernel(0, sizeof...(I), [&tasks](size_t i) { tasks[i](); });
+}
+
+} //end of namespace parallel_detail
+
+/*!
+ * \brief Call the given functor for each index in [0, N), in parallel,
+ * with a std::integral_constant of the index.
+ *
+ * This is used to process the elements of a tuple (the branches of a merge
+ * layer for instance) in parallel.
+ *
+ * \param fun The functor to call with each index
+ */
+template <size_t N, typename Functor>
+void parallel_static_for(Functor&& fun) {
+    parallel_detail::parallel_static_for(fun, std::make_index_sequence<N>());
+}
+
+} //end of dll namespace
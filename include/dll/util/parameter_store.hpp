@@ -0,0 +1,242 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Flat storage of the parameters of a network
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <new>
+#include <ostream>
+#include <vector>
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The header of a flat parameter file
+ */
+struct parameter_file_header {
+    char magic[4]    = {'D', 'L', 'L', 'P'}; ///< The magic of the file
+    uint32_t version = 1;                    ///< The version of the format
+    uint32_t dtype   = 0;                    ///< The size of one parameter, in bytes
+    uint32_t tensors = 0;                    ///< The number of tensors
+    uint64_t size    = 0;                    ///< The total number of parameters
+};
+
+/*!
+ * \brief A flat store of all the parameters of a network.
+ *
+ * The store references each parameter tensor of the layers, in the order
+ * of the layers, and holds a single contiguous, 64-byte aligned, buffer
+ * large enough for all the parameters. The parameters are copied into the
+ * buffer in one pass over all the tensors, which makes the backups and the
+ * serialization of the whole network a single copy, or a single write.
+ */
+template <typename T>
+struct parameter_store {
+    static constexpr size_t alignment = 64; ///< The alignment of the buffer
+
+    /*!
+     * \brief A parameter tensor of a layer
+     */
+    struct span {
+        T* memory;     ///< The memory of the tensor
+        size_t size;   ///< The number of parameters of the tensor
+        size_t offset; ///< The offset of the tensor in the flat buffer
+    };
+
+    parameter_store() = default;
+
+    parameter_store(const parameter_store& rhs) = delete;
+    parameter_store& operator=(const parameter_store& rhs) = delete;
+
+    ~parameter_store() {
+        std::free(buffer);
+    }
+
+    /*!
+     * \brief Remove all the tensors from the store.
+     *
+     * The buffer is kept, with its content.
+     */
+    void clear() {
+        spans.clear();
+        total = 0;
+    }
+
+    /*!
+     * \brief Add a tensor to the store
+     * \param memory The memory of the tensor
+     * \param n The number of parameters of the tensor
+     */
+    void add(T* memory, size_t n) {
+        spans.push_back({memory, n, total});
+        total += n;
+    }
+
+    /*!
+     * \brief Returns the total number of parameters
+     */
+    size_t size() const {
+        return total;
+    }
+
+    /*!
+     * \brief Returns the number of tensors
+     */
+    size_t tensors() const {
+        return spans.size();
+    }
+
+    /*!
+     * \brief Indicates if the buffer holds a snapshot of the parameters
+     */
+    bool saved() const {
+        return snapshot_size && snapshot_size == total;
+    }
+
+    /*!
+     * \brief Returns the flat buffer
+     */
+    T* data() {
+        return buffer;
+    }
+
+    /*!
+     * \brief Returns the flat buffer
+     */
+    const T* data() const {
+        return buffer;
+    }
+
+    /*!
+     * \brief Copy all the parameters into the flat buffer
+     */
+    void snapshot() {
+        reserve();
+        gather(buffer);
+
+        snapshot_size = total;
+    }
+
+    /*!
+     * \brief Copy all the parameters into the given memory, of at least
+     * size() parameters
+     */
+    void gather(T* out) const {
+        parallel_kernel(0, spans.size(), [this, out](size_t s) {
+            std::copy_n(spans[s].memory, spans[s].size, out + spans[s].offset);
+        });
+    }
+
+    /*!
+     * \brief Copy the given memory, of at least size() parameters, back into
+     * the parameters
+     */
+    void scatter(const T* in) {
+        parallel_kernel(0, spans.size(), [this, in](size_t s) {
+            std::copy_n(in + spans[s].offset, spans[s].size, spans[s].memory);
+        });
+    }
+
+    /*!
+     * \brief Copy the flat buffer back into the parameters.
+     *
+     * This has no effect if no snapshot was taken with the same shapes.
+     */
+    void restore() {
+        if (!saved()) {
+            return;
+        }
+
+        scatter(buffer);
+    }
+
+    /*!
+     * \brief Write a snapshot of the parameters to the stream, with a
+     * single write of the flat buffer
+     */
+    void write(std::ostream& os) {
+        snapshot();
+
+        parameter_file_header header;
+
+        header.dtype   = sizeof(T);
+        header.tensors = spans.size();
+        header.size    = total;
+
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(buffer), total * sizeof(T));
+    }
+
+    /*!
+     * \brief Read the parameters from the stream, with a single read into
+     * the flat buffer
+     * \return true if the parameters were read, false otherwise
+     */
+    bool read(std::istream& is) {
+        parameter_file_header header;
+
+        if (!is.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return false;
+        }
+
+        if (std::memcmp(header.magic, "DLLP", 4) != 0 || header.version != 1 || header.dtype != sizeof(T) || header.tensors != spans.size() || header.size != total) {
+            return false;
+        }
+
+        reserve();
+
+        if (!is.read(reinterpret_cast<char*>(buffer), total * sizeof(T))) {
+            return false;
+        }
+
+        snapshot_size = total;
+
+        restore();
+
+        return true;
+    }
+
+private:
+    /*!
+     * \brief Ensure that the buffer can hold all the parameters
+     */
+    void reserve() {
+        if (capacity < total) {
+            std::free(buffer);
+
+            const size_t bytes = ((total * sizeof(T) + alignment - 1) / alignment) * alignment;
+
+            buffer = static_cast<T*>(std::aligned_alloc(alignment, bytes));
+
+            if (!buffer) {
+                throw std::bad_alloc();
+            }
+
+            capacity      = total;
+            snapshot_size = 0;
+        }
+    }
+
+    std::vector<span> spans;        ///< The tensors of the store
+    size_t total         = 0;       ///< The total number of parameters
+    T* buffer            = nullptr; ///< The flat buffer
+    size_t capacity      = 0;       ///< The capacity of the buffer, in parameters
+    size_t snapshot_size = 0;       ///< The number of parameters of the last snapshot
+};
+
+} //end of dll namespace
@@ -0,0 +1,234 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Hardware performance counters of the current thread
+ *
+ * On Linux, the counters are read with perf_event_open: the cycles, the
+ * instructions and the last level cache misses, and, on Intel processors,
+ * the single precision floating point operations (FP_ARITH_INST_RETIRED).
+ * On other systems, or when the counters are not allowed (see
+ * perf_event_paranoid), the counters are not available and read as zero.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#endif
+
+namespace dll {
+
+/*!
+ * \brief The values of the counters
+ */
+struct perf_sample {
+    uint64_t cycles       = 0; ///< The number of cycles
+    uint64_t instructions = 0; ///< The number of retired instructions
+    uint64_t misses       = 0; ///< The number of last level cache misses
+    uint64_t flops        = 0; ///< The number of floating point operations
+
+    /*!
+     * \brief Returns the difference between this sample and an earlier one
+     */
+    perf_sample operator-(const perf_sample& rhs) const {
+        perf_sample delta;
+
+        delta.cycles       = cycles - rhs.cycles;
+        delta.instructions = instructions - rhs.instructions;
+        delta.misses       = misses - rhs.misses;
+        delta.flops        = flops - rhs.flops;
+
+        return delta;
+    }
+};
+
+/*!
+ * \brief The hardware performance counters of the thread that created it.
+ *
+ * The counters are opened in two groups, the generic hardware events and
+ * the floating point events, so that the floating point events do not
+ * prevent the generic counters when they cannot be scheduled. When the
+ * groups are multiplexed, the values are scaled by the time the groups
+ * were running.
+ */
+struct perf_counters {
+    static constexpr size_t line_size = 64; ///< The number of bytes of a cache line, to estimate the memory traffic
+
+    perf_counters() {
+#ifdef __linux__
+        hardware = open_group(PERF_TYPE_HARDWARE, {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES}, hardware_fds);
+
+        if (intel()) {
+            // FP_ARITH_INST_RETIRED (event 0xC7), for scalar, 128, 256 and 512 bits single precision
+            floating = open_group(PERF_TYPE_RAW, {0x02C7, 0x08C7, 0x20C7, 0x80C7}, floating_fds);
+        }
+#endif
+    }
+
+    perf_counters(const perf_counters& rhs) = delete;
+    perf_counters& operator=(const perf_counters& rhs) = delete;
+
+    ~perf_counters() {
+#ifdef __linux__
+        for (auto fd : hardware_fds) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+
+        for (auto fd : floating_fds) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+#endif
+    }
+
+    /*!
+     * \brief Indicates if the generic counters are available
+     */
+    bool valid() const {
+        return hardware;
+    }
+
+    /*!
+     * \brief Indicates if the floating point operations are counted
+     */
+    bool has_flops() const {
+        return floating;
+    }
+
+    /*!
+     * \brief Read the current values of the counters
+     */
+    perf_sample read() const {
+        perf_sample sample;
+
+#ifdef __linux__
+        uint64_t values[4];
+
+        if (hardware && read_group(hardware_fds[0], values, 3)) {
+            sample.cycles       = values[0];
+            sample.instructions = values[1];
+            sample.misses       = values[2];
+        }
+
+        // One operation per scalar instruction and one per lane of the packed instructions
+        if (floating && read_group(floating_fds[0], values, 4)) {
+            sample.flops = values[0] + 4 * values[1] + 8 * values[2] + 16 * values[3];
+        }
+#endif
+
+        return sample;
+    }
+
+private:
+#ifdef __linux__
+    /*!
+     * \brief Indicates if the processor is an Intel processor, the only ones
+     * whose floating point events are known
+     */
+    static bool intel() {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int eax, ebx, ecx, edx;
+
+        if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+
+        char vendor[12];
+        std::memcpy(vendor, &ebx, 4);
+        std::memcpy(vendor + 4, &edx, 4);
+        std::memcpy(vendor + 8, &ecx, 4);
+
+        return !std::memcmp(vendor, "GenuineIntel", 12);
+#else
+        return false;
+#endif
+    }
+
+    /*!
+     * \brief Open a group of counters of the calling thread
+     * \return true if all the counters of the group could be opened
+     */
+    template <size_t N>
+    static bool open_group(uint32_t type, const uint64_t (&configs)[N], int (&fds)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+
+            attr.size           = sizeof(attr);
+            attr.type           = type;
+            attr.config         = configs[i];
+            attr.disabled       = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            fds[i] = ::syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+
+            if (fds[i] < 0) {
+                for (size_t j = 0; j < i; ++j) {
+                    ::close(fds[j]);
+                    fds[j] = -1;
+                }
+
+                return false;
+            }
+        }
+
+        ::ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ::ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+        return true;
+    }
+
+    /*!
+     * \brief Read the n values of the group of the given leader, scaled
+     * when the group was multiplexed
+     */
+    static bool read_group(int leader, uint64_t* values, size_t n) {
+        // nr, time_enabled, time_running and the values
+        uint64_t buffer[3 + 4];
+
+        const ssize_t expected = (3 + n) * sizeof(uint64_t);
+
+        if (::read(leader, buffer, expected) != expected || buffer[0] != n) {
+            return false;
+        }
+
+        const uint64_t enabled = buffer[1];
+        const uint64_t running = buffer[2];
+
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = running && running < enabled ? uint64_t(double(buffer[3 + i]) * enabled / running) : buffer[3 + i];
+        }
+
+        return true;
+    }
+
+    int hardware_fds[3] = {-1, -1, -1};     ///< The generic counters (cycles, instructions, misses)
+    int floating_fds[4] = {-1, -1, -1, -1}; ///< The floating point counters
+#endif
+
+    bool hardware = false; ///< Indicates if the generic counters are available
+    bool floating = false; ///< Indicates if the floating point counters are available
+};
+
+} //end of dll namespace
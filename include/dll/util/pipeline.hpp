@@ -0,0 +1,249 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Workers of the stages of a pipeline-parallel training
+ *
+ * The layers of the network are split in contiguous stages, each stage is
+ * run by its own thread. The micro-batches flow through the stages: a
+ * stage forward propagates a micro-batch as soon as the previous stage is
+ * done with it and backpropagates it as soon as the next stage is done
+ * with its errors (GPipe schedule).
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "dll/util/numa.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Split a sequence of layers in contiguous stages of balanced cost.
+ *
+ * Each stage has at least one layer.
+ *
+ * \param costs The cost of each layer
+ * \param stages The number of stages
+ *
+ * \return The bounds of the stages, the stage s being made of the layers [bounds[s], bounds[s + 1])
+ */
+inline std::vector<size_t> partition_stages(const std::vector<size_t>& costs, size_t stages) {
+    const size_t layers = costs.size();
+
+    cpp_assert(stages > 0 && stages <= layers, "Invalid number of stages");
+
+    size_t total = 0;
+
+    for (auto cost : costs) {
+        total += cost;
+    }
+
+    std::vector<size_t> bounds(stages + 1, 0);
+    bounds[stages] = layers;
+
+    size_t l   = 0;
+    size_t sum = 0;
+
+    for (size_t s = 1; s < stages; ++s) {
+        // Take at least one layer and leave at least one layer for each of the next stages
+        do {
+            sum += costs[l++];
+        } while (l < layers - (stages - s) && (sum + costs[l] / 2) * stages < total * s);
+
+        bounds[s] = l;
+    }
+
+    return bounds;
+}
+
+/*!
+ * \brief The threads of the stages of a pipeline and the progress of the
+ * micro-batches through the stages.
+ *
+ * The stage 0 is run by the calling thread, the other stages by their own
+ * persistent threads. The stages are run inside a worker_section, their
+ * ETL expressions and kernels are serial.
+ */
+struct pipeline_workers {
+    /*!
+     * \brief Create the workers of the given number of stages
+     * \param stages The number of stages
+     */
+    explicit pipeline_workers(size_t stages) : stages(stages), forwarded(new std::atomic<size_t>[stages]), backwarded(new std::atomic<size_t>[stages]) {
+        for (size_t s = 1; s < stages; ++s) {
+            workers.emplace_back([this, s] { work(s); });
+        }
+    }
+
+    pipeline_workers(const pipeline_workers& rhs) = delete;
+    pipeline_workers& operator=(const pipeline_workers& rhs) = delete;
+
+    /*!
+     * \brief Stop the workers
+     */
+    ~pipeline_workers() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            running = false;
+        }
+
+        start.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /*!
+     * \brief Run the given functor on each stage, in parallel, and wait
+     * for all the stages.
+     *
+     * \param fun The functor to call with the index of each stage
+     */
+    void run(const std::function<void(size_t)>& fun) {
+        for (size_t s = 0; s < stages; ++s) {
+            forwarded[s]  = 0;
+            backwarded[s] = 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            task = &fun;
+            done = 0;
+            ++generation;
+        }
+
+        start.notify_all();
+
+        {
+            worker_section section;
+
+            fun(0);
+        }
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        finished.wait(ulock, [this] { return done == stages - 1; });
+
+        task = nullptr;
+    }
+
+    /*!
+     * \brief Mark the next micro-batch forward propagated by the stage s
+     */
+    void forward_done(size_t s) {
+        ++forwarded[s];
+    }
+
+    /*!
+     * \brief Mark the next micro-batch backpropagated by the stage s
+     */
+    void backward_done(size_t s) {
+        ++backwarded[s];
+    }
+
+    /*!
+     * \brief Wait for the stage s to have forward propagated the
+     * micro-batch m
+     */
+    void wait_forward(size_t s, size_t m) const {
+        wait(forwarded[s], m);
+    }
+
+    /*!
+     * \brief Wait for the stage s to have backpropagated the micro-batch m,
+     * the micro-batches being backpropagated in reverse order
+     *
+     * \param s The stage
+     * \param m The index of the micro-batch, in the order of the backward pass
+     */
+    void wait_backward(size_t s, size_t m) const {
+        wait(backwarded[s], m);
+    }
+
+private:
+    /*!
+     * \brief Wait for the counter to go past the given value.
+     *
+     * The work of a stage on a micro-batch is short, the waiting thread
+     * only yields.
+     */
+    static void wait(const std::atomic<size_t>& counter, size_t m) {
+        while (counter.load(std::memory_order_acquire) <= m) {
+            std::this_thread::yield();
+        }
+    }
+
+    /*!
+     * \brief The loop of the worker of the stage s
+     */
+    void work(size_t s) {
+        if (numa_env().pin) {
+            numa_pin_worker(s);
+        }
+
+        worker_section section;
+
+        size_t seen = 0;
+
+        while (true) {
+            const std::function<void(size_t)>* fun = nullptr;
+
+            {
+                std::unique_lock<std::mutex> ulock(lock);
+
+                start.wait(ulock, [this, seen] { return !running || generation != seen; });
+
+                if (!running) {
+                    return;
+                }
+
+                seen = generation;
+                fun  = task;
+            }
+
+            (*fun)(s);
+
+            {
+                std::lock_guard<std::mutex> l(lock);
+                ++done;
+            }
+
+            finished.notify_one();
+        }
+    }
+
+    const size_t stages; ///< The number of stages
+
+    std::unique_ptr<std::atomic<size_t>[]> forwarded;  ///< The number of micro-batches forward propagated by each stage
+    std::unique_ptr<std::atomic<size_t>[]> backwarded; ///< The number of micro-batches backpropagated by each stage
+
+    std::vector<std::thread> workers; ///< The threads of the stages 1 to S - 1
+
+    std::mutex lock;                                   ///< The lock protecting the state of the run
+    std::condition_variable start;                     ///< Signals a new run or the end of the workers
+    std::condition_variable finished;                  ///< Signals the end of a stage
+    const std::function<void(size_t)>* task = nullptr; ///< The functor of the current run
+    size_t generation = 0;                             ///< The index of the current run
+    size_t done       = 0;                             ///< The number of workers done with the current run
+    bool running      = true;                          ///< Indicates if the workers are running
+};
+
+} //end of dll namespace
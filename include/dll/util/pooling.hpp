@@ -0,0 +1,552 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Direct kernels for the 2D max and average pooling of feature maps.
+ *
+ * The max pooling can record the position of the maximum of each window
+ * (its offset in the window, y * c2 + x) so that its backward pass is a
+ * scatter of the errors instead of a comparison of the input with its
+ * upsampled output. The 2x2 windows, by far the most common, and the
+ * overlapping 3x3 windows with a stride of 2 have their own branchless
+ * kernels.
+ *
+ * The windows are separated by a stride (s1, s2), they overlap when the
+ * stride is smaller than the pooling ratio. A stride of 0 is the pooling
+ * ratio. A plane [I2 x I3] gives [(I2 - c1) / s1 + 1 x (I3 - c2) / s2 + 1]
+ * outputs.
+ *
+ * The global average pooling reduces each plane to its mean in a single
+ * pass, with independent accumulators so that the sum can be vectorized.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "dll/util/cpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the direct kernels can be used for the given runtime
+ * pooling ratios, the offsets in the windows must fit in one byte.
+ */
+inline bool pool_kernel_supported(size_t c1, size_t c2) {
+    return c1 * c2 <= 256;
+}
+
+namespace pooling_detail {
+
+/*!
+ * \brief Max pooling of one plane with 2x2 windows
+ * \param argmax The offsets of the maximums, can be null
+ */
+template <typename T>
+DLL_KERNEL_CLONES void max_pool_2x2_plane(T* out, uint8_t* argmax, const T* in, size_t O2, size_t O3, size_t I3) {
+    for (size_t i = 0; i < O2; ++i) {
+        const T* r0 = in + 2 * i * I3;
+        const T* r1 = r0 + I3;
+        T* o        = out + i * O3;
+
+        if (argmax) {
+            uint8_t* a = argmax + i * O3;
+
+            for (size_t j = 0; j < O3; ++j) {
+                const T v0 = r0[2 * j];
+                const T v1 = r0[2 * j + 1];
+                const T v2 = r1[2 * j];
+                const T v3 = r1[2 * j + 1];
+
+                const T m0 = v1 > v0 ? v1 : v0;
+                const T m1 = v3 > v2 ? v3 : v2;
+
+                const uint8_t k0 = v1 > v0 ? 1 : 0;
+                const uint8_t k1 = v3 > v2 ? 3 : 2;
+
+                o[j] = m1 > m0 ? m1 : m0;
+                a[j] = m1 > m0 ? k1 : k0;
+            }
+        } else {
+            for (size_t j = 0; j < O3; ++j) {
+                o[j] = std::max(std::max(r0[2 * j], r0[2 * j + 1]), std::max(r1[2 * j], r1[2 * j + 1]));
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Max pooling of one plane with 3x3 windows and a stride of 2
+ * \param argmax The offsets of the maximums, can be null
+ */
+template <typename T>
+DLL_KERNEL_CLONES void max_pool_3x3s2_plane(T* out, uint8_t* argmax, const T* in, size_t O2, size_t O3, size_t I3) {
+    for (size_t i = 0; i < O2; ++i) {
+        const T* r0 = in + 2 * i * I3;
+        const T* r1 = r0 + I3;
+        const T* r2 = r1 + I3;
+        T* o        = out + i * O3;
+
+        if (argmax) {
+            uint8_t* a = argmax + i * O3;
+
+            for (size_t j = 0; j < O3; ++j) {
+                T m       = r0[2 * j];
+                uint8_t k = 0;
+
+                for (size_t x = 1; x < 3; ++x) {
+                    k = r0[2 * j + x] > m ? uint8_t(x) : k;
+                    m = r0[2 * j + x] > m ? r0[2 * j + x] : m;
+                }
+
+                for (size_t x = 0; x < 3; ++x) {
+                    k = r1[2 * j + x] > m ? uint8_t(3 + x) : k;
+                    m = r1[2 * j + x] > m ? r1[2 * j + x] : m;
+                }
+
+                for (size_t x = 0; x < 3; ++x) {
+                    k = r2[2 * j + x] > m ? uint8_t(6 + x) : k;
+                    m = r2[2 * j + x] > m ? r2[2 * j + x] : m;
+                }
+
+                o[j] = m;
+                a[j] = k;
+            }
+        } else {
+            for (size_t j = 0; j < O3; ++j) {
+                const T m0 = std::max(std::max(r0[2 * j], r0[2 * j + 1]), r0[2 * j + 2]);
+                const T m1 = std::max(std::max(r1[2 * j], r1[2 * j + 1]), r1[2 * j + 2]);
+                const T m2 = std::max(std::max(r2[2 * j], r2[2 * j + 1]), r2[2 * j + 2]);
+
+                o[j] = std::max(std::max(m0, m1), m2);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Max pooling of one plane with c1 x c2 windows separated by a stride
+ * of s1 x s2
+ * \param argmax The offsets of the maximums, can be null
+ */
+template <typename T>
+DLL_KERNEL_CLONES void max_pool_plane(T* out, uint8_t* argmax, const T* in, size_t O2, size_t O3, size_t I3, size_t c1, size_t c2, size_t s1, size_t s2) {
+    for (size_t i = 0; i < O2; ++i) {
+        for (size_t j = 0; j < O3; ++j) {
+            const T* window = in + i * s1 * I3 + j * s2;
+
+            T m       = window[0];
+            size_t mk = 0;
+
+            for (size_t y = 0; y < c1; ++y) {
+                for (size_t x = 0; x < c2; ++x) {
+                    if (window[y * I3 + x] > m) {
+                        m  = window[y * I3 + x];
+                        mk = y * c2 + x;
+                    }
+                }
+            }
+
+            out[i * O3 + j] = m;
+
+            if (argmax) {
+                argmax[i * O3 + j] = uint8_t(mk);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Scatter the errors of one plane of a 2x2 max pooling to the
+ * positions of the maximums. The covered part of the plane is entirely
+ * written.
+ */
+template <typename T>
+DLL_KERNEL_CLONES void max_pool_2x2_plane_backward(T* out, const uint8_t* argmax, const T* errors, size_t O2, size_t O3, size_t I3) {
+    for (size_t i = 0; i < O2; ++i) {
+        T* r0         = out + 2 * i * I3;
+        T* r1         = r0 + I3;
+        const T* e    = errors + i * O3;
+        const auto* a = argmax + i * O3;
+
+        for (size_t j = 0; j < O3; ++j) {
+            r0[2 * j]     = a[j] == 0 ? e[j] : T(0);
+            r0[2 * j + 1] = a[j] == 1 ? e[j] : T(0);
+            r1[2 * j]     = a[j] == 2 ? e[j] : T(0);
+            r1[2 * j + 1] = a[j] == 3 ? e[j] : T(0);
+        }
+    }
+}
+
+/*!
+ * \brief Average pooling of one plane with 2x2 windows
+ */
+template <typename T>
+DLL_KERNEL_CLONES void avg_pool_2x2_plane(T* out, const T* in, size_t O2, size_t O3, size_t I3) {
+    for (size_t i = 0; i < O2; ++i) {
+        const T* r0 = in + 2 * i * I3;
+        const T* r1 = r0 + I3;
+        T* o        = out + i * O3;
+
+        for (size_t j = 0; j < O3; ++j) {
+            o[j] = T(0.25) * ((r0[2 * j] + r0[2 * j + 1]) + (r1[2 * j] + r1[2 * j + 1]));
+        }
+    }
+}
+
+/*!
+ * \brief Average pooling of one plane with c1 x c2 windows separated by a
+ * stride of s1 x s2
+ */
+template <typename T>
+DLL_KERNEL_CLONES void avg_pool_plane(T* out, const T* in, size_t O2, size_t O3, size_t I3, size_t c1, size_t c2, size_t s1, size_t s2) {
+    const T scale = T(1) / T(c1 * c2);
+
+    for (size_t i = 0; i < O2; ++i) {
+        T* o = out + i * O3;
+
+        std::fill_n(o, O3, T(0));
+
+        for (size_t y = 0; y < c1; ++y) {
+            const T* row = in + (i * s1 + y) * I3;
+
+            for (size_t j = 0; j < O3; ++j) {
+                for (size_t x = 0; x < c2; ++x) {
+                    o[j] += row[j * s2 + x];
+                }
+            }
+        }
+
+        for (size_t j = 0; j < O3; ++j) {
+            o[j] *= scale;
+        }
+    }
+}
+
+/*!
+ * \brief Spread the errors of one plane of a 2x2 average pooling on their
+ * windows. The covered part of the plane is entirely written.
+ */
+template <typename T>
+DLL_KERNEL_CLONES void avg_pool_2x2_plane_backward(T* out, const T* errors, size_t O2, size_t O3, size_t I3) {
+    for (size_t i = 0; i < O2; ++i) {
+        T* r0      = out + 2 * i * I3;
+        T* r1      = r0 + I3;
+        const T* e = errors + i * O3;
+
+        for (size_t j = 0; j < O3; ++j) {
+            const T v = T(0.25) * e[j];
+
+            r0[2 * j]     = v;
+            r0[2 * j + 1] = v;
+            r1[2 * j]     = v;
+            r1[2 * j + 1] = v;
+        }
+    }
+}
+
+/*!
+ * \brief Spread the errors of one plane of an average pooling uniformly on
+ * their c1 x c2 windows. The covered part of the plane is entirely
+ * written.
+ */
+template <typename T>
+DLL_KERNEL_CLONES void avg_pool_plane_backward(T* out, const T* errors, size_t O2, size_t O3, size_t I3, size_t c1, size_t c2) {
+    const T scale = T(1) / T(c1 * c2);
+
+    for (size_t i = 0; i < O2; ++i) {
+        const T* e = errors + i * O3;
+
+        for (size_t y = 0; y < c1; ++y) {
+            T* row = out + (i * c1 + y) * I3;
+
+            for (size_t j = 0; j < O3; ++j) {
+                for (size_t x = 0; x < c2; ++x) {
+                    row[j * c2 + x] = scale * e[j];
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Accumulate the errors of one plane of an average pooling with
+ * strided windows on their c1 x c2 windows. The plane must be cleared.
+ */
+template <typename T>
+DLL_KERNEL_CLONES void avg_pool_strided_plane_backward(T* out, const T* errors, size_t O2, size_t O3, size_t I3, size_t c1, size_t c2, size_t s1, size_t s2) {
+    const T scale = T(1) / T(c1 * c2);
+
+    for (size_t i = 0; i < O2; ++i) {
+        const T* e = errors + i * O3;
+
+        for (size_t y = 0; y < c1; ++y) {
+            T* row = out + (i * s1 + y) * I3;
+
+            for (size_t j = 0; j < O3; ++j) {
+                for (size_t x = 0; x < c2; ++x) {
+                    row[j * s2 + x] += scale * e[j];
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Clear the part of a plane of input errors that is not covered
+ * by the pooling windows (the last rows and columns when the dimensions
+ * are not divisible by the ratios)
+ */
+template <typename T>
+void clear_uncovered(T* out, size_t I2, size_t I3, size_t O2, size_t O3, size_t c1, size_t c2) {
+    if (O3 * c2 < I3) {
+        for (size_t i = 0; i < O2 * c1; ++i) {
+            std::fill(out + i * I3 + O3 * c2, out + (i + 1) * I3, T(0));
+        }
+    }
+
+    std::fill(out + O2 * c1 * I3, out + I2 * I3, T(0));
+}
+
+} //end of namespace pooling_detail
+
+/*!
+ * \brief Returns the number of outputs of a pooling dimension
+ * \param i The input dimension
+ * \param c The pooling ratio
+ * \param s The stride, 0 for the pooling ratio
+ */
+inline size_t pool_output_dim(size_t i, size_t c, size_t s) {
+    return (i - c) / (s ? s : c) + 1;
+}
+
+/*!
+ * \brief Max pooling of each plane of the input with c1 x c2 windows.
+ *
+ * \param output The output [planes x O2 x O3]
+ * \param argmax The offset of the maximum of each window, with the size of
+ * the output, or nullptr if they are not needed
+ * \param input The input [planes x I2 x I3]
+ * \param planes The number of planes (samples times channels)
+ * \param I2 The number of rows of a plane of the input
+ * \param I3 The number of columns of a plane of the input
+ * \param c1 The pooling ratio of the rows
+ * \param c2 The pooling ratio of the columns
+ * \param s1 The stride of the rows, 0 for c1
+ * \param s2 The stride of the columns, 0 for c2
+ */
+template <typename T>
+void max_pool_2d_forward(T* output, uint8_t* argmax, const T* input, size_t planes, size_t I2, size_t I3, size_t c1, size_t c2, size_t s1 = 0, size_t s2 = 0) {
+    s1 = s1 ? s1 : c1;
+    s2 = s2 ? s2 : c2;
+
+    const size_t O2 = pool_output_dim(I2, c1, s1);
+    const size_t O3 = pool_output_dim(I3, c2, s2);
+
+    parallel_kernel(0, planes, [=](size_t p) {
+        T* out      = output + p * O2 * O3;
+        uint8_t* a  = argmax ? argmax + p * O2 * O3 : nullptr;
+        const T* in = input + p * I2 * I3;
+
+        if (c1 == 2 && c2 == 2 && s1 == 2 && s2 == 2) {
+            pooling_detail::max_pool_2x2_plane(out, a, in, O2, O3, I3);
+        } else if (c1 == 3 && c2 == 3 && s1 == 2 && s2 == 2) {
+            pooling_detail::max_pool_3x3s2_plane(out, a, in, O2, O3, I3);
+        } else {
+            pooling_detail::max_pool_plane(out, a, in, O2, O3, I3, c1, c2, s1, s2);
+        }
+    });
+}
+
+/*!
+ * \brief Compute the errors of the input of a max pooling from the offsets
+ * of the maximums recorded by max_pool_2d_forward: the errors of each
+ * window go to its maximum, the other values have no errors. With
+ * overlapping windows, the errors of the windows sharing a maximum are
+ * summed.
+ *
+ * \param output The errors of the input [planes x I2 x I3]
+ * \param argmax The offset of the maximum of each window
+ * \param errors The errors of the output [planes x O2 x O3]
+ * \param planes The number of planes (samples times channels)
+ * \param I2 The number of rows of a plane of the input
+ * \param I3 The number of columns of a plane of the input
+ * \param c1 The pooling ratio of the rows
+ * \param c2 The pooling ratio of the columns
+ * \param s1 The stride of the rows, 0 for c1
+ * \param s2 The stride of the columns, 0 for c2
+ */
+template <typename T>
+void max_pool_2d_backward(T* output, const uint8_t* argmax, const T* errors, size_t planes, size_t I2, size_t I3, size_t c1, size_t c2, size_t s1 = 0, size_t s2 = 0) {
+    s1 = s1 ? s1 : c1;
+    s2 = s2 ? s2 : c2;
+
+    const size_t O2 = pool_output_dim(I2, c1, s1);
+    const size_t O3 = pool_output_dim(I3, c2, s2);
+
+    parallel_kernel(0, planes, [=](size_t p) {
+        T* out        = output + p * I2 * I3;
+        const auto* a = argmax + p * O2 * O3;
+        const T* e    = errors + p * O2 * O3;
+
+        if (c1 == 2 && c2 == 2 && s1 == 2 && s2 == 2) {
+            pooling_detail::max_pool_2x2_plane_backward(out, a, e, O2, O3, I3);
+            pooling_detail::clear_uncovered(out, I2, I3, O2, O3, c1, c2);
+        } else {
+            std::fill_n(out, I2 * I3, T(0));
+
+            for (size_t i = 0; i < O2; ++i) {
+                for (size_t j = 0; j < O3; ++j) {
+                    const size_t k = a[i * O3 + j];
+
+                    out[(i * s1 + k / c2) * I3 + j * s2 + k % c2] += e[i * O3 + j];
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Average pooling of each plane of the input with c1 x c2 windows.
+ *
+ * \param output The output [planes x O2 x O3]
+ * \param input The input [planes x I2 x I3]
+ * \param planes The number of planes (samples times channels)
+ * \param I2 The number of rows of a plane of the input
+ * \param I3 The number of columns of a plane of the input
+ * \param c1 The pooling ratio of the rows
+ * \param c2 The pooling ratio of the columns
+ * \param s1 The stride of the rows, 0 for c1
+ * \param s2 The stride of the columns, 0 for c2
+ */
+template <typename T>
+void avg_pool_2d_forward(T* output, const T* input, size_t planes, size_t I2, size_t I3, size_t c1, size_t c2, size_t s1 = 0, size_t s2 = 0) {
+    s1 = s1 ? s1 : c1;
+    s2 = s2 ? s2 : c2;
+
+    const size_t O2 = pool_output_dim(I2, c1, s1);
+    const size_t O3 = pool_output_dim(I3, c2, s2);
+
+    parallel_kernel(0, planes, [=](size_t p) {
+        T* out      = output + p * O2 * O3;
+        const T* in = input + p * I2 * I3;
+
+        if (c1 == 2 && c2 == 2 && s1 == 2 && s2 == 2) {
+            pooling_detail::avg_pool_2x2_plane(out, in, O2, O3, I3);
+        } else {
+            pooling_detail::avg_pool_plane(out, in, O2, O3, I3, c1, c2, s1, s2);
+        }
+    });
+}
+
+/*!
+ * \brief Compute the errors of the input of an average pooling: each value
+ * receives the errors of its windows divided by the size of the windows.
+ *
+ * \param output The errors of the input [planes x I2 x I3]
+ * \param errors The errors of the output [planes x O2 x O3]
+ * \param planes The number of planes (samples times channels)
+ * \param I2 The number of rows of a plane of the input
+ * \param I3 The number of columns of a plane of the input
+ * \param c1 The pooling ratio of the rows
+ * \param c2 The pooling ratio of the columns
+ * \param s1 The stride of the rows, 0 for c1
+ * \param s2 The stride of the columns, 0 for c2
+ */
+template <typename T>
+void avg_pool_2d_backward(T* output, const T* errors, size_t planes, size_t I2, size_t I3, size_t c1, size_t c2, size_t s1 = 0, size_t s2 = 0) {
+    s1 = s1 ? s1 : c1;
+    s2 = s2 ? s2 : c2;
+
+    const size_t O2 = pool_output_dim(I2, c1, s1);
+    const size_t O3 = pool_output_dim(I3, c2, s2);
+
+    parallel_kernel(0, planes, [=](size_t p) {
+        T* out     = output + p * I2 * I3;
+        const T* e = errors + p * O2 * O3;
+
+        if (s1 != c1 || s2 != c2) {
+            std::fill_n(out, I2 * I3, T(0));
+
+            pooling_detail::avg_pool_strided_plane_backward(out, e, O2, O3, I3, c1, c2, s1, s2);
+        } else {
+            if (c1 == 2 && c2 == 2) {
+                pooling_detail::avg_pool_2x2_plane_backward(out, e, O2, O3, I3);
+            } else {
+                pooling_detail::avg_pool_plane_backward(out, e, O2, O3, I3, c1, c2);
+            }
+
+            pooling_detail::clear_uncovered(out, I2, I3, O2, O3, c1, c2);
+        }
+    });
+}
+
+namespace pooling_detail {
+
+/*!
+ * \brief Returns the mean of the n values of one plane
+ *
+ * The sum is split into eight independent accumulators, which breaks the
+ * dependency chain of the additions and lets the compiler vectorize it.
+ */
+template <typename T>
+DLL_KERNEL_CLONES T global_avg_pool_plane(const T* in, size_t n) {
+    T acc[8] = {T(0), T(0), T(0), T(0), T(0), T(0), T(0), T(0)};
+
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        for (size_t k = 0; k < 8; ++k) {
+            acc[k] += in[i + k];
+        }
+    }
+
+    for (; i < n; ++i) {
+        acc[i & 7] += in[i];
+    }
+
+    return (((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]))) / T(n);
+}
+
+} //end of namespace pooling_detail
+
+/*!
+ * \brief Compute the global average pooling of planes: each plane is
+ * reduced to the mean of its values.
+ *
+ * \param output The output [planes]
+ * \param input The input [planes x n]
+ * \param planes The number of planes (samples times channels)
+ * \param n The number of values of a plane
+ */
+template <typename T>
+void global_avg_pool_forward(T* output, const T* input, size_t planes, size_t n) {
+    parallel_kernel(0, planes, [=](size_t p) {
+        output[p] = pooling_detail::global_avg_pool_plane(input + p * n, n);
+    });
+}
+
+/*!
+ * \brief Compute the errors of the input of a global average pooling: each
+ * value of a plane receives the error of the plane divided by its size.
+ *
+ * \param output The errors of the input [planes x n]
+ * \param errors The errors of the output [planes]
+ * \param planes The number of planes (samples times channels)
+ * \param n The number of values of a plane
+ */
+template <typename T>
+void global_avg_pool_backward(T* output, const T* errors, size_t planes, size_t n) {
+    parallel_kernel(0, planes, [=](size_t p) {
+        std::fill_n(output + p * n, n, errors[p] / T(n));
+    });
+}
+
+} //end of dll namespace
@@ -0,0 +1,304 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Magnitude pruning of the weights and block-sparse weights for
+ * inference
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The scope of the threshold of the magnitude pruning
+ */
+enum class prune_scope {
+    LAYER, ///< Each layer is pruned to the target sparsity
+    GLOBAL ///< A single threshold for all the layers
+};
+
+/*!
+ * \brief Indicates if the weights of the layer can be pruned
+ */
+template <typename Layer>
+struct is_prunable_layer : std::false_type {};
+
+template <typename Desc>
+struct is_prunable_layer<dense_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_prunable_layer<dyn_dense_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_prunable_layer<rbm_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_prunable_layer<dyn_rbm_impl<Desc>> : std::true_type {};
+
+namespace prune_detail {
+
+/*!
+ * \brief Append the magnitude (L1 norm) of each group of block
+ * consecutive weights of each row of w [V x H] to the scores
+ */
+template <typename W>
+void group_scores(std::vector<double>& scores, const W& w, size_t block) {
+    const size_t V = etl::dim<0>(w);
+    const size_t H = etl::dim<1>(w);
+
+    cpu_access(w);
+
+    const auto* wm = w.memory_start();
+
+    for (size_t v = 0; v < V; ++v) {
+        for (size_t g = 0; g < H; g += block) {
+            double score = 0.0;
+
+            for (size_t j = g; j < std::min(g + block, H); ++j) {
+                score += std::abs(wm[v * H + j]);
+            }
+
+            scores.push_back(score);
+        }
+    }
+}
+
+/*!
+ * \brief Returns the threshold under which the groups must be pruned to
+ * reach the given sparsity (negative to prune nothing)
+ */
+inline double sparsity_threshold(std::vector<double>& scores, double sparsity) {
+    const size_t k = std::min(scores.size(), size_t(sparsity * scores.size()));
+
+    if (!k) {
+        return -1.0;
+    }
+
+    std::nth_element(scores.begin(), scores.begin() + (k - 1), scores.end());
+
+    return scores[k - 1];
+}
+
+/*!
+ * \brief Set to zero the groups of weights of w whose magnitude is not
+ * more than the threshold
+ * \return The number of zero weights of w
+ */
+template <typename W>
+size_t zero_groups(W& w, size_t block, double threshold) {
+    const size_t V = etl::dim<0>(w);
+    const size_t H = etl::dim<1>(w);
+
+    cpu_access(w);
+
+    auto* wm = w.memory_start();
+
+    size_t zeros = 0;
+
+    for (size_t v = 0; v < V; ++v) {
+        for (size_t g = 0; g < H; g += block) {
+            const size_t last = std::min(g + block, H);
+
+            double score = 0.0;
+
+            for (size_t j = g; j < last; ++j) {
+                score += std::abs(wm[v * H + j]);
+            }
+
+            if (score <= threshold) {
+                std::fill(wm + v * H + g, wm + v * H + last, 0);
+            }
+
+            for (size_t j = g; j < last; ++j) {
+                zeros += wm[v * H + j] == 0;
+            }
+        }
+    }
+
+    cpu_modified(w);
+
+    return zeros;
+}
+
+} //end of namespace prune_detail
+
+/*!
+ * \brief The weights of a dense layer [V x H] stored by blocks.
+ *
+ * Each row of the weights is split into blocks of B consecutive columns,
+ * only the blocks with a non-zero weight are stored. The product of a
+ * sample with the weights only visits the stored blocks of the non-zero
+ * inputs, each block being a fixed-size loop the compiler vectorizes.
+ *
+ * \tparam T The type of the weights
+ * \tparam B The number of weights of a block
+ */
+template <typename T, size_t B = 8>
+struct block_sparse_weights {
+    static constexpr size_t block = B; ///< The number of weights of a block
+
+    size_t rows    = 0;            ///< The number of rows (inputs)
+    size_t columns = 0;            ///< The number of columns (outputs)
+    size_t padded  = 0;            ///< The number of columns, rounded to blocks
+    std::vector<size_t> row_start; ///< The first block of each row, and the total number of blocks
+    std::vector<uint32_t> blocks;  ///< The first column of each block
+    std::vector<T> values;         ///< The B values of each block
+
+    /*!
+     * \brief Store the non-zero blocks of the given weights [V x H]
+     */
+    template <typename W>
+    void assign(const W& w) {
+        rows    = etl::dim<0>(w);
+        columns = etl::dim<1>(w);
+        padded  = (columns + B - 1) / B * B;
+
+        row_start.resize(rows + 1);
+        blocks.clear();
+        values.clear();
+
+        cpu_access(w);
+
+        const T* wm = w.memory_start();
+
+        for (size_t v = 0; v < rows; ++v) {
+            row_start[v] = blocks.size();
+
+            for (size_t g = 0; g < columns; g += B) {
+                const size_t last = std::min(g + B, columns);
+
+                if (std::any_of(wm + v * columns + g, wm + v * columns + last, [](T x) { return x != T(0); })) {
+                    blocks.push_back(uint32_t(g));
+
+                    for (size_t j = g; j < g + B; ++j) {
+                        values.push_back(j < last ? wm[v * columns + j] : T(0));
+                    }
+                }
+            }
+        }
+
+        row_start[rows] = blocks.size();
+    }
+
+    /*!
+     * \brief Release the blocks
+     */
+    void clear() {
+        rows = columns = padded = 0;
+
+        row_start.clear();
+        blocks.clear();
+        values.clear();
+    }
+
+    /*!
+     * \brief Indicates if no weights are stored
+     */
+    bool empty() const {
+        return row_start.empty();
+    }
+
+    /*!
+     * \brief Returns the ratio of stored blocks
+     */
+    double density() const {
+        return rows && padded ? double(blocks.size()) / (rows * (padded / B)) : 0.0;
+    }
+
+    /*!
+     * \brief Returns the memory of the stored weights, in bytes
+     */
+    size_t memory() const {
+        return row_start.size() * sizeof(size_t) + blocks.size() * sizeof(uint32_t) + values.size() * sizeof(T);
+    }
+};
+
+/*!
+ * \brief Returns the ratio of the non-zero blocks of B weights of the given
+ * weights [V x H], without storing them
+ */
+template <size_t B, typename W>
+double block_density(const W& w) {
+    const size_t V = etl::dim<0>(w);
+    const size_t H = etl::dim<1>(w);
+
+    cpu_access(w);
+
+    const auto* wm = w.memory_start();
+
+    size_t non_zeros = 0;
+    size_t total     = 0;
+
+    for (size_t v = 0; v < V; ++v) {
+        for (size_t g = 0; g < H; g += B, ++total) {
+            non_zeros += std::any_of(wm + v * H + g, wm + v * H + std::min(g + B, H), [](auto x) { return x != 0; });
+        }
+    }
+
+    return total ? double(non_zeros) / total : 0.0;
+}
+
+/*!
+ * \brief Compute the product of n samples with block-sparse weights,
+ * output = input * w.
+ *
+ * \param output The output [n x H]
+ * \param input The input [n x V]
+ * \param w The block-sparse weights [V x H]
+ * \param n The number of samples
+ */
+template <typename O, typename I, typename T, size_t B>
+void block_sparse_mul(O&& output, const I& input, const block_sparse_weights<T, B>& w, size_t n) {
+    cpu_access(input);
+
+    const T* in = input.memory_start();
+    T* out      = output.memory_start();
+
+    parallel_kernel(0, n, [&](size_t s) {
+        thread_local std::vector<T> acc;
+
+        acc.assign(w.padded, T(0));
+
+        const T* x = in + s * w.rows;
+
+        for (size_t v = 0; v < w.rows; ++v) {
+            const T value = x[v];
+
+            if (value == T(0)) {
+                continue;
+            }
+
+            for (size_t k = w.row_start[v]; k < w.row_start[v + 1]; ++k) {
+                T* a       = acc.data() + w.blocks[k];
+                const T* b = w.values.data() + k * B;
+
+                for (size_t j = 0; j < B; ++j) {
+                    a[j] += value * b[j];
+                }
+            }
+        }
+
+        std::copy_n(acc.data(), w.columns, out + s * w.columns);
+    });
+
+    cpu_modified(output);
+}
+
+} //end of dll namespace
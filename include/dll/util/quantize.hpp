@@ -0,0 +1,147 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Post-training int8 quantization
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief Symmetric int8 weights, quantized per output channel.
+ *
+ * The weights of each channel are stored contiguously, so that each output
+ * is the dot product of two int8 vectors.
+ */
+struct int8_weights {
+    std::vector<int8_t> values; ///< The quantized weights [channels x inputs]
+    std::vector<float> scales;  ///< The scale of each channel
+    size_t channels = 0;        ///< The number of output channels
+    size_t inputs   = 0;        ///< The number of inputs of each channel
+
+    /*!
+     * \brief Indicates if the weights have been quantized
+     */
+    bool empty() const {
+        return values.empty();
+    }
+
+    /*!
+     * \brief Returns the quantized weights of the given channel
+     */
+    const int8_t* channel(size_t c) const {
+        return values.data() + c * inputs;
+    }
+};
+
+/*!
+ * \brief Quantize a value with the given inverse scale
+ */
+inline int8_t quantize_int8(float value, float inv_scale) {
+    return int8_t(std::max(-127.0f, std::min(127.0f, std::nearbyint(value * inv_scale))));
+}
+
+/*!
+ * \brief Returns the scale mapping [-range, range] to [-127, 127]
+ */
+inline float int8_scale(float range) {
+    return range > 0.0f ? range / 127.0f : 1.0f;
+}
+
+/*!
+ * \brief Quantize weights per output channel.
+ *
+ * \param q The quantized weights
+ * \param w The weights, as a function (channel, input) -> value
+ * \param channels The number of output channels
+ * \param inputs The number of inputs of each channel
+ */
+template <typename F>
+void quantize_channels(int8_weights& q, F&& w, size_t channels, size_t inputs) {
+    q.channels = channels;
+    q.inputs   = inputs;
+    q.values.resize(channels * inputs);
+    q.scales.resize(channels);
+
+    for (size_t c = 0; c < channels; ++c) {
+        float range = 0.0f;
+        for (size_t i = 0; i < inputs; ++i) {
+            range = std::max(range, std::abs(float(w(c, i))));
+        }
+
+        q.scales[c] = int8_scale(range);
+
+        const float inv_scale = 1.0f / q.scales[c];
+
+        for (size_t i = 0; i < inputs; ++i) {
+            q.values[c * inputs + i] = quantize_int8(w(c, i), inv_scale);
+        }
+    }
+}
+
+/*!
+ * \brief Quantize n values with the given scale
+ * \param out The quantized values
+ * \param in The values, must be indexable
+ * \param n The number of values
+ * \param scale The scale of the values
+ */
+template <typename In>
+void quantize_values(int8_t* out, const In& in, size_t n, float scale) {
+    const float inv_scale = 1.0f / scale;
+
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = quantize_int8(in[i], inv_scale);
+    }
+}
+
+/*!
+ * \brief Compute the dot product of two int8 vectors, accumulated in int32
+ */
+inline int32_t dot_int8(const int8_t* a, const int8_t* b, size_t n) {
+    int32_t acc = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        acc += int32_t(a[i]) * int32_t(b[i]);
+    }
+
+    return acc;
+}
+
+/*!
+ * \brief Compute the int8 GEMM of m input rows with the quantized weights
+ * and dequantize the result.
+ *
+ * \param out The output, [m x channels], with the given strides
+ * \param in The quantized inputs [m x inputs]
+ * \param m The number of input rows
+ * \param w The quantized weights
+ * \param in_scale The scale of the inputs
+ * \param row_stride The distance between two output rows
+ * \param channel_stride The distance between two output channels
+ */
+template <typename T>
+void int8_gemm(T* out, const int8_t* in, size_t m, const int8_weights& w, float in_scale, size_t row_stride, size_t channel_stride) {
+    for (size_t c = 0; c < w.channels; ++c) {
+        const int8_t* wc  = w.channel(c);
+        const float scale = in_scale * w.scales[c];
+
+        for (size_t r = 0; r < m; ++r) {
+            out[r * row_stride + c * channel_stride] = T(scale * dot_int8(in + r * w.inputs, wc, w.inputs));
+        }
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,308 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused activation kernels of the units of the RBM.
+ *
+ * The product of the input with the weights is computed directly in the
+ * output, then each kernel applies the bias, the activation function and
+ * the sampling of the units in a single pass over this output.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "etl/etl.hpp"
+
+#include "dll/unit_type.hpp"
+#include "dll/util/cpu.hpp"
+#include "dll/util/fast_math.hpp"
+#include "dll/util/fast_random.hpp"
+#include "dll/util/gpu.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The size (in bytes) of the weights from which the reconstruction
+ * and the second hidden activation are computed tile by tile
+ */
+constexpr size_t blocked_gibbs_threshold = 1UL << 23;
+
+/*!
+ * \brief The size (in bytes) of one tile of the weights of the blocked
+ * Gibbs step
+ */
+constexpr size_t blocked_gibbs_tile = 1UL << 18;
+
+namespace rbm_kernels_detail {
+
+/*!
+ * \brief The logistic sigmoid, approximated if F is set
+ */
+template <bool F, typename T>
+inline T sigmoid(T x) {
+    if constexpr (F) {
+        return fast_sigmoid(x);
+    } else {
+        return T(1) / (T(1) + std::exp(-x));
+    }
+}
+
+/*!
+ * \brief Returns the activation probability of a hidden unit from its
+ * input
+ */
+template <unit_type U, bool F, typename T>
+inline T hidden_activation(T x) {
+    if constexpr (U == unit_type::BINARY) {
+        return sigmoid<F>(x);
+    } else if constexpr (U == unit_type::RELU) {
+        return std::max(x, T(0));
+    } else if constexpr (U == unit_type::RELU1) {
+        return std::min(std::max(x, T(0)), T(1));
+    } else {
+        return std::min(std::max(x, T(0)), T(6));
+    }
+}
+
+/*!
+ * \brief Returns a sample of a rectified hidden unit from its input and
+ * from a standard normal number.
+ *
+ * The noise is the same as etl::logistic_noise (ReLU) and
+ * etl::ranged_noise (ReLU1 and ReLU6).
+ */
+template <unit_type U, bool F, typename T>
+inline T relu_sample(T x, T z) {
+    if constexpr (U == unit_type::RELU) {
+        return std::max(x + sigmoid<F>(x) * z, T(0));
+    } else {
+        constexpr T cap = U == unit_type::RELU1 ? T(1) : T(6);
+
+        const T noisy = x == T(0) || x == cap ? x : x + z;
+
+        return std::min(std::max(noisy, T(0)), cap);
+    }
+}
+
+/*!
+ * \brief Apply the bias and the activation function to n values of rows of
+ * H hidden units
+ */
+template <unit_type U, bool F, typename T>
+DLL_KERNEL_CLONES void hidden_activation_rows(T* a, const T* x, const T* bias, size_t n, size_t H) {
+    for (size_t i = 0; i < n; i += H) {
+        for (size_t j = 0; j < H; ++j) {
+            a[i + j] = hidden_activation<U, F>(x[i + j] + bias[j]);
+        }
+    }
+}
+
+/*!
+ * \brief Apply the bias and the activation function to n values of rows of
+ * V visible units, in place
+ */
+template <unit_type U, bool F, typename T>
+DLL_KERNEL_CLONES void visible_activation_rows(T* a, const T* bias, size_t n, size_t V) {
+    for (size_t i = 0; i < n; i += V) {
+        for (size_t j = 0; j < V; ++j) {
+            const T pre = a[i + j] + bias[j];
+
+            if constexpr (U == unit_type::BINARY) {
+                a[i + j] = sigmoid<F>(pre);
+            } else if constexpr (U == unit_type::GAUSSIAN) {
+                a[i + j] = pre;
+            } else {
+                a[i + j] = std::max(pre, T(0));
+            }
+        }
+    }
+}
+
+} //end of namespace rbm_kernels_detail
+
+/*!
+ * \brief Apply the bias, the activation function and the sampling of the
+ * hidden units in a single pass.
+ *
+ * On entry, h_a (h_s if the probabilities are not computed) holds the
+ * product of the input with the weights [B x H].
+ *
+ * \tparam U The type of the hidden units
+ * \tparam P Compute the activation probabilities into h_a
+ * \tparam S Compute the samples into h_s
+ * \tparam F Use the fast approximation of the sigmoid
+ *
+ * \param stream The random stream of the RBM
+ * \param h_a The activation probabilities
+ * \param h_s The samples
+ * \param b The hidden biases
+ */
+template <unit_type U, bool P, bool S, bool F = false, typename HA, typename HS, typename B>
+void fused_hidden_activation(random_stream& stream, HA&& h_a, HS&& h_s, const B& b) {
+    static_assert(U == unit_type::BINARY || U == unit_type::RELU || U == unit_type::RELU1 || U == unit_type::RELU6,
+                  "The fused activation only supports element-wise hidden units");
+
+    using T = etl::value_t<HA>;
+
+    cpu_access(b);
+
+    T* a          = h_a.memory_start();
+    T* s          = h_s.memory_start();
+    const T* bias = b.memory_start();
+
+    const size_t H = etl::size(b);
+    const size_t n = P ? etl::size(h_a) : etl::size(h_s);
+
+    // The product is in h_a if there is one, it is read before being overwritten
+    const T* x = P ? a : s;
+
+    if constexpr (P && !S) {
+        rbm_kernels_detail::hidden_activation_rows<U, F>(a, x, bias, n, H);
+    } else if constexpr (U == unit_type::BINARY) {
+        stream.generate(n, [=](size_t i, uint32_t r) {
+            const T p = rbm_kernels_detail::sigmoid<F>(x[i] + bias[i % H]);
+
+            if constexpr (P) {
+                a[i] = p;
+            }
+
+            s[i] = to_uniform<T>(r) < p ? T(1) : T(0);
+        });
+    } else {
+        generate_normal<T>(stream, n, [=](size_t i, T z) {
+            const T pre = x[i] + bias[i % H];
+
+            if constexpr (P) {
+                a[i] = rbm_kernels_detail::hidden_activation<U, F>(pre);
+            }
+
+            s[i] = rbm_kernels_detail::relu_sample<U, F>(pre, z);
+        });
+    }
+
+    if constexpr (P) {
+        cpu_modified(h_a);
+    }
+
+    if constexpr (S) {
+        cpu_modified(h_s);
+    }
+}
+
+/*!
+ * \brief Apply the bias and the activation function of the visible units
+ * in a single pass.
+ *
+ * On entry, v_a holds the product of the hidden units with the transposed
+ * weights [B x V].
+ *
+ * \tparam U The type of the visible units
+ * \tparam F Use the fast approximation of the sigmoid
+ *
+ * \param v_a The activation probabilities
+ * \param c The visible biases
+ */
+template <unit_type U, bool F = false, typename VA, typename C>
+void fused_visible_activation(VA&& v_a, const C& c) {
+    static_assert(U == unit_type::BINARY || U == unit_type::GAUSSIAN || U == unit_type::RELU,
+                  "The fused activation only supports binary, gaussian and ReLU visible units");
+
+    using T = etl::value_t<VA>;
+
+    cpu_access(c);
+
+    T* a          = v_a.memory_start();
+    const T* bias = c.memory_start();
+
+    const size_t V = etl::size(c);
+    const size_t n = etl::size(v_a);
+
+    rbm_kernels_detail::visible_activation_rows<U, F>(a, bias, n, V);
+
+    cpu_modified(v_a);
+}
+
+/*!
+ * \brief Compute the reconstruction of the visible units and the
+ * activation of the hidden units from it, tile by tile over the visible
+ * units.
+ *
+ * The rows of the weights of a tile are used by the two products in a row
+ * (the reconstruction of the tile, then its contribution to the hidden
+ * activations), while they are still in cache. The weights are only read
+ * once from memory instead of twice.
+ *
+ * \tparam VU The type of the visible units
+ * \tparam HU The type of the hidden units
+ * \tparam S Compute the samples of the hidden units into h2_s
+ * \tparam F Use the fast approximation of the sigmoid
+ *
+ * \param stream The random stream of the RBM
+ * \param h_s The samples of the hidden units [B x H]
+ * \param v_a The reconstructed visible probabilities [B x V]
+ * \param h2_a The hidden activation probabilities [B x H]
+ * \param h2_s The hidden samples [B x H], can be h_s
+ * \param b The hidden biases
+ * \param c The visible biases
+ * \param w The weights [V x H]
+ */
+template <unit_type VU, unit_type HU, bool S, bool F = false, typename HS, typename VA, typename HA2, typename HS2, typename B, typename C, typename W>
+void blocked_visible_hidden_activation(random_stream& stream, const HS& h_s, VA&& v_a, HA2&& h2_a, HS2&& h2_s, const B& b, const C& c, const W& w) {
+    using T = etl::value_t<VA>;
+
+    const size_t Batch = etl::dim<0>(v_a);
+    const size_t V     = etl::dim<0>(w);
+    const size_t H     = etl::dim<1>(w);
+    const size_t tile  = std::min(V, std::max(size_t(1), blocked_gibbs_tile / (H * sizeof(T))));
+
+    auto step = [&](auto& rec, size_t first) {
+        const size_t n = etl::dim<1>(rec);
+
+        auto w_t = etl::slice(w, first, first + n);
+
+        rec = h_s * etl::transpose(w_t);
+
+        fused_visible_activation<VU, F>(rec, etl::slice(c, first, first + n));
+
+        h2_a += rec * w_t;
+
+        cpu_access(rec);
+
+        for (size_t i = 0; i < Batch; ++i) {
+            std::memcpy(v_a.memory_start() + i * V + first, rec.memory_start() + i * n, n * sizeof(T));
+        }
+    };
+
+    cpu_access(v_a);
+
+    // The products are accumulated in h2_a
+    h2_a = T(0);
+
+    etl::dyn_matrix<T, 2> rec(Batch, tile);
+
+    size_t first = 0;
+
+    for (; first + tile <= V; first += tile) {
+        step(rec, first);
+    }
+
+    if (first < V) {
+        etl::dyn_matrix<T, 2> last(Batch, V - first);
+        step(last, first);
+    }
+
+    cpu_modified(v_a);
+
+    fused_hidden_activation<HU, true, S, F>(stream, h2_a, h2_s, b);
+}
+
+} //end of dll namespace
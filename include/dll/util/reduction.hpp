@@ -0,0 +1,98 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Deterministic reductions of partial sums
+ *
+ * The parallel reductions of the library compute one partial sum per fixed
+ * block of work (rows, units, batches, ...), never per thread, and the
+ * partial sums are then reduced with a tree whose shape only depends on
+ * the number of blocks. The results are therefore bitwise identical for
+ * any number of threads and any scheduling of the blocks.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace dll {
+
+namespace reduction_detail {
+
+constexpr size_t leaf = 8; ///< The number of partial sums added sequentially at the leaves of the tree
+
+/*!
+ * \brief Reduce the partial sums [first, last) of values with a fixed
+ * pairwise tree
+ */
+template <typename T, typename Add>
+T tree_reduce(const T* values, size_t first, size_t last, Add&& add) {
+    if (last - first <= leaf) {
+        T sum = values[first];
+
+        for (size_t i = first + 1; i < last; ++i) {
+            sum = add(sum, values[i]);
+        }
+
+        return sum;
+    }
+
+    const size_t middle = first + (last - first) / 2;
+
+    return add(tree_reduce(values, first, middle, add), tree_reduce(values, middle, last, add));
+}
+
+} //end of namespace reduction_detail
+
+/*!
+ * \brief Returns the sum of the given partial sums, reduced with a tree
+ * whose shape only depends on their number.
+ *
+ * \param partials The partial sums, one per block of work
+ * \param n The number of partial sums
+ * \return The sum of the partial sums (zero if there are none)
+ */
+inline double tree_sum(const double* partials, size_t n) {
+    if (!n) {
+        return 0.0;
+    }
+
+    return reduction_detail::tree_reduce(partials, 0, n, [](double a, double b) { return a + b; });
+}
+
+/*!
+ * \brief Returns the sum of the given partial sums, reduced with a tree
+ * whose shape only depends on their number.
+ *
+ * \param partials The partial sums, one per block of work
+ * \return The sum of the partial sums (zero if there are none)
+ */
+inline double tree_sum(const std::vector<double>& partials) {
+    return tree_sum(partials.data(), partials.size());
+}
+
+/*!
+ * \brief Returns the sums of the given pairs of partial sums, reduced with
+ * a tree whose shape only depends on their number.
+ *
+ * \param partials The pairs of partial sums, one per block of work
+ * \return The sums of the first and of the second elements
+ */
+inline std::pair<double, double> tree_sum(const std::vector<std::pair<double, double>>& partials) {
+    if (partials.empty()) {
+        return {0.0, 0.0};
+    }
+
+    return reduction_detail::tree_reduce(partials.data(), 0, partials.size(), [](const std::pair<double, double>& a, const std::pair<double, double>& b) {
+        return std::make_pair(a.first + b.first, a.second + b.second);
+    });
+}
+
+} //end of dll namespace
@@ -0,0 +1,306 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Sampled softmax, for the training of the output layers with a very
+ * large number of classes.
+ *
+ * During training, the softmax is only computed over a set of candidate
+ * classes: the classes of the samples of the batch and a number of negative
+ * classes sampled uniformly. The logits, the errors and the gradients are
+ * only computed for the candidates. Since the negatives are sampled
+ * uniformly, the correction of the logits by the sampling probabilities is
+ * the same for all the candidates and cancels in the softmax. The full
+ * softmax is still used outside of training.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/gpu.hpp"
+#include "dll/util/loss_kernels.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the layer is trained with a sampled softmax
+ */
+template <typename L, typename Enable = void>
+struct is_sampled_softmax_layer : std::false_type {};
+
+template <typename L>
+struct is_sampled_softmax_layer<L, std::enable_if_t<(L::sampled_negatives > 0)>> : std::true_type {};
+
+/*!
+ * \brief Indicates if only the last layer of the DBN, if any, is trained
+ * with a sampled softmax
+ */
+template <typename DBN, size_t... I>
+constexpr bool only_last_sampled_softmax(std::index_sequence<I...> /*seq*/) {
+    return ((I + 1 == sizeof...(I) || !is_sampled_softmax_layer<typename DBN::template layer_type<I>>::value) && ...);
+}
+
+/*!
+ * \brief The state of the sampled softmax of a layer for one mini-batch.
+ *
+ * The buffers keep their memory from one mini-batch to the next, only the
+ * number of candidates changes.
+ */
+template <typename T>
+struct sampled_softmax_state {
+    std::vector<size_t> classes;   ///< The candidate classes, the classes of the samples first
+    std::vector<size_t> targets;   ///< The index of the class of each sample in the candidates
+    std::vector<size_t> positions; ///< The index + 1 of each class in the candidates, 0 for the other classes
+    std::vector<T> w;              ///< The weights of the candidates [V x K]
+    std::vector<T> errors;         ///< The errors of the candidates [B x K]
+    std::vector<T> grad;           ///< The gradients of the weights of the candidates [V x K]
+
+    size_t V = 0; ///< The number of inputs
+    size_t B = 0; ///< The number of rows of the batch
+
+    bool active = false; ///< Indicates if the errors of the batch are sampled
+
+    /*!
+     * \brief Returns the number of candidates
+     */
+    size_t candidates() const {
+        return classes.size();
+    }
+
+    /*!
+     * \brief Returns a view of the weights of the candidates [V x K]
+     */
+    auto weights() {
+        return etl::custom_dyn_matrix<T, 2>(w.data(), V, candidates());
+    }
+
+    /*!
+     * \brief Returns a view of the errors of the candidates [B x K]
+     */
+    auto sampled_errors() {
+        return etl::custom_dyn_matrix<T, 2>(errors.data(), B, candidates());
+    }
+};
+
+/*!
+ * \brief Select the candidate classes of a mini-batch.
+ *
+ * The classes of the samples are always candidates, the negatives are
+ * sampled uniformly among the other classes. When there are not enough
+ * other classes, all the classes are candidates.
+ *
+ * \param state The state of the sampled softmax
+ * \param labels The labels of the batch, one-hot [B x C] or sparse [B]
+ * \param n The number of samples of the batch
+ * \param C The number of classes
+ * \param S The number of sampled negatives
+ */
+template <typename T, typename Labels>
+void sample_classes(sampled_softmax_state<T>& state, const Labels& labels, size_t n, size_t C, size_t S) {
+    static constexpr bool sparse = etl::dimensions<Labels>() == 1;
+
+    cpu_access(labels);
+
+    state.positions.resize(C, 0);
+    state.targets.resize(n);
+    state.classes.clear();
+
+    auto add = [&state](size_t c) {
+        if (!state.positions[c]) {
+            state.classes.push_back(c);
+            state.positions[c] = state.classes.size();
+        }
+
+        return state.positions[c] - 1;
+    };
+
+    for (size_t i = 0; i < n; ++i) {
+        size_t label = 0;
+
+        if constexpr (sparse) {
+            label = size_t(labels[i]);
+        } else {
+            for (size_t j = 1; j < C; ++j) {
+                if (labels[i * C + j] > labels[i * C + label]) {
+                    label = j;
+                }
+            }
+        }
+
+        state.targets[i] = add(label);
+    }
+
+    if (state.classes.size() + S >= C) {
+        for (size_t c = 0; c < C; ++c) {
+            add(c);
+        }
+    } else {
+        std::uniform_int_distribution<size_t> dist(0, C - 1);
+
+        const size_t K = state.classes.size() + S;
+
+        while (state.classes.size() < K) {
+            add(dist(dll::rand_engine()));
+        }
+    }
+
+    // Only the positions of the candidates have been set
+    for (auto c : state.classes) {
+        state.positions[c] = 0;
+    }
+}
+
+/*!
+ * \brief Compute the sampled softmax of a batch and its errors.
+ *
+ * The candidates must have been selected with sample_classes. The errors of
+ * the rows after n are set to zero. The error is the error of the
+ * prediction among the candidates.
+ *
+ * \param state The state of the sampled softmax
+ * \param input The input of the layer [B x V]
+ * \param w The weights of the layer [V x C]
+ * \param b The biases of the layer [C], nullptr if there are none
+ * \param n The number of samples of the batch
+ *
+ * \return A pair containing the error and the loss of the batch, not normalized
+ */
+template <typename T, typename Input, typename W>
+std::pair<double, double> sampled_softmax_errors(sampled_softmax_state<T>& state, const Input& input, const W& w, const T* b, size_t n) {
+    const size_t B = etl::dim<0>(input);
+    const size_t V = etl::dim<0>(w);
+    const size_t C = etl::dim<1>(w);
+    const size_t K = state.candidates();
+
+    state.V = V;
+    state.B = B;
+
+    state.w.resize(V * K);
+    state.errors.resize(B * K);
+    state.grad.resize(V * K);
+
+    cpu_access(w);
+
+    const T* wm = w.memory_start();
+
+    parallel_kernel(0, V, [&](size_t v) {
+        for (size_t k = 0; k < K; ++k) {
+            state.w[v * K + k] = wm[v * C + state.classes[k]];
+        }
+    });
+
+    auto logits = state.sampled_errors();
+
+    logits = etl::reshape(input, B, V) * state.weights();
+
+    cpu_access(logits);
+
+    T* e = state.errors.data();
+
+    auto metrics = loss_detail::reduce_rows(n, K, [&](size_t first, size_t last) {
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (size_t i = first; i < last; ++i) {
+            T* row = e + i * K;
+
+            if (b) {
+                for (size_t k = 0; k < K; ++k) {
+                    row[k] += b[state.classes[k]];
+                }
+            }
+
+            const size_t target = state.targets[i];
+            const size_t best   = std::max_element(row, row + K) - row;
+            const T max         = row[best];
+
+            T sum = 0;
+
+            for (size_t k = 0; k < K; ++k) {
+                row[k] = std::exp(row[k] - max);
+                sum += row[k];
+            }
+
+            loss += std::log(row[target] / sum);
+            error += best != target;
+
+            for (size_t k = 0; k < K; ++k) {
+                row[k] = (k == target ? T(1) : T(0)) - row[k] / sum;
+            }
+        }
+
+        return std::make_pair(error, -loss);
+    });
+
+    std::fill(e + n * K, e + B * K, T(0));
+
+    state.active = true;
+
+    return metrics;
+}
+
+/*!
+ * \brief Compute the gradients of the weights and of the biases from the
+ * sampled errors.
+ *
+ * Only the columns of the candidates are non-zero.
+ *
+ * \param state The state of the sampled softmax
+ * \param input The input of the layer [B x V]
+ * \param w_grad The gradients of the weights [V x C]
+ * \param b_grad The gradients of the biases [C], nullptr if there are none
+ */
+template <typename T, typename Input, typename G>
+void sampled_softmax_gradients(sampled_softmax_state<T>& state, const Input& input, G& w_grad, T* b_grad) {
+    const size_t V = state.V;
+    const size_t K = state.candidates();
+    const size_t C = etl::dim<1>(w_grad);
+
+    auto grad = etl::custom_dyn_matrix<T, 2>(state.grad.data(), V, K);
+
+    grad = etl::transpose(etl::reshape(input, state.B, V)) * state.sampled_errors();
+
+    cpu_access(grad);
+
+    w_grad = 0;
+    cpu_access(w_grad);
+
+    T* g = w_grad.memory_start();
+
+    parallel_kernel(0, V, [&](size_t v) {
+        for (size_t k = 0; k < K; ++k) {
+            g[v * C + state.classes[k]] = state.grad[v * K + k];
+        }
+    });
+
+    cpu_modified(w_grad);
+
+    if (b_grad) {
+        std::fill_n(b_grad, C, T(0));
+
+        for (size_t i = 0; i < state.B; ++i) {
+            for (size_t k = 0; k < K; ++k) {
+                b_grad[state.classes[k]] += state.errors[i * K + k];
+            }
+        }
+    }
+
+    state.active = false;
+}
+
+} //end of dll namespace
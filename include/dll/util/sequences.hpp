@@ -0,0 +1,103 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Utilities for the variable-length sequences, padded with zeros
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the length of a sequence [T x S] padded with zeros at its
+ * end, i.e. one more than its last time step with a non-zero value.
+ *
+ * A sequence of zeros has a length of one.
+ */
+template <typename Sequence>
+size_t sequence_length(const Sequence& sequence) {
+    const size_t T = etl::dim<0>(sequence);
+    const size_t S = etl::dim<1>(sequence);
+
+    for (size_t t = T; t > 1; --t) {
+        for (size_t i = 0; i < S; ++i) {
+            if (sequence(t - 1, i) != 0) {
+                return t;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/*!
+ * \brief Compute the length of each sequence of a batch [B x T x S]
+ *
+ * \param lengths The output lengths
+ * \param batch The batch of sequences
+ *
+ * \return The length of the longest sequence of the batch
+ */
+template <typename Batch>
+size_t sequence_lengths(std::vector<size_t>& lengths, const Batch& batch) {
+    const size_t B = etl::dim<0>(batch);
+
+    lengths.resize(B);
+
+    size_t longest = 1;
+
+    for (size_t b = 0; b < B; ++b) {
+        lengths[b] = sequence_length(batch(b));
+        longest    = std::max(longest, lengths[b]);
+    }
+
+    return longest;
+}
+
+/*!
+ * \brief Shuffle a permutation of the indices of the samples such that each
+ * batch contains sequences of similar lengths.
+ *
+ * The samples are shuffled and then sorted by length, which gives a random
+ * order among the sequences of the same length. The order of the full
+ * batches is then shuffled, the last partial batch, if any, stays at the
+ * end.
+ *
+ * \param order The permutation to fill
+ * \param lengths The length of each sample
+ * \param batch The size of the batches
+ * \param g The random generator
+ */
+template <typename G>
+void length_bucket_shuffle(std::vector<size_t>& order, const std::vector<size_t>& lengths, size_t batch, G&& g) {
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), g);
+
+    std::stable_sort(order.begin(), order.end(), [&lengths](size_t a, size_t b) { return lengths[a] < lengths[b]; });
+
+    const size_t full = order.size() / batch;
+
+    std::vector<size_t> batch_order(full);
+    std::iota(batch_order.begin(), batch_order.end(), 0);
+    std::shuffle(batch_order.begin(), batch_order.end(), g);
+
+    std::vector<size_t> sorted(order);
+
+    for (size_t i = 0; i < full; ++i) {
+        std::copy_n(sorted.begin() + batch_order[i] * batch, batch, order.begin() + i * batch);
+    }
+}
+
+} //end of dll namespace
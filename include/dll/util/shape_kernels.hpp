@@ -0,0 +1,234 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the dynamic layers specialized at compile-time for some
+ * shapes.
+ *
+ * The shapes of the dynamic layers are only known at runtime, so their
+ * loops cannot be unrolled and vectorized like the ones of the static
+ * layers. A dynamic layer is given a list of shapes (dll::fixed_shapes) and
+ * selects, when it is initialized, the kernel precompiled for its shape, if
+ * it is in the list.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+#include "cpp_utils/assert.hpp"
+
+#include "dll/base_conf.hpp"
+#include "dll/function.hpp"
+#include "dll/util/cpu.hpp"
+#include "dll/util/gemv.hpp"
+#include "dll/util/gpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace shape_detail {
+
+constexpr size_t dense_rows = 4; ///< The number of rows of input reusing one row of weights
+
+/*!
+ * \brief Returns the kernel of the given shape if it matches the dimensions,
+ * nullptr otherwise
+ */
+template <typename Factory, size_t... Dims, size_t N>
+typename Factory::kernel_t select(shape<Dims...> s, const std::array<size_t, N>& dims) {
+    if constexpr (sizeof...(Dims) == N) {
+        if (dims == std::array<size_t, N>{{Dims...}}) {
+            return Factory::get(s);
+        }
+    } else {
+        cpp_unused(s);
+        cpp_unused(dims);
+    }
+
+    return nullptr;
+}
+
+/*!
+ * \brief Compute the rows [first, last) of the output of a dense layer
+ * [V x H], out = f(in * w + b)
+ */
+template <function F, bool Fast, size_t V, size_t H, typename T>
+DLL_KERNEL_CLONES void dense_forward_rows(T* out, const T* in, const T* w, const T* b, size_t first, size_t last) {
+    for (size_t r = first; r < last; ++r) {
+        if (b) {
+            std::copy_n(b, H, out + r * H);
+        } else {
+            std::fill_n(out + r * H, H, T(0));
+        }
+    }
+
+    for (size_t v = 0; v < V; ++v) {
+        const T* row = w + v * H;
+
+        for (size_t r = first; r < last; ++r) {
+            const T x = in[r * V + v];
+            T* o      = out + r * H;
+
+            for (size_t h = 0; h < H; ++h) {
+                o[h] += x * row[h];
+            }
+        }
+    }
+
+    for (size_t r = first; r < last; ++r) {
+        activate_one<F, Fast>(out + r * H, H);
+    }
+}
+
+/*!
+ * \brief Compute a batch of output of a dense layer [V x H],
+ * out = f(in * w + b)
+ *
+ * \param out The output [batch x H]
+ * \param in The input [batch x V]
+ * \param w The weights [V x H]
+ * \param b The biases, or nullptr if there are none
+ * \param batch The number of samples
+ */
+template <function F, bool Fast, size_t V, size_t H, typename T>
+void dense_forward(T* out, const T* in, const T* w, const T* b, size_t batch) {
+    parallel_kernel(0, (batch + dense_rows - 1) / dense_rows, [&](size_t task) {
+        const size_t first = task * dense_rows;
+
+        dense_forward_rows<F, Fast, V, H>(out, in, w, b, first, std::min(batch, first + dense_rows));
+    });
+}
+
+/*!
+ * \brief Compute the valid convolution of one sample [C x V1 x V2] with one
+ * filter [C x NW1 x NW2]
+ */
+template <size_t NW1, size_t NW2, typename T>
+DLL_KERNEL_CLONES void valid_conv_filter(T* out, const T* in, const T* w, size_t C, size_t V1, size_t V2) {
+    const size_t H1 = V1 - NW1 + 1;
+    const size_t H2 = V2 - NW2 + 1;
+
+    std::fill_n(out, H1 * H2, T(0));
+
+    for (size_t c = 0; c < C; ++c) {
+        T wr[NW1 * NW2];
+
+        std::copy_n(w + c * NW1 * NW2, NW1 * NW2, wr);
+
+        const T* plane = in + c * V1 * V2;
+
+        for (size_t i = 0; i < H1; ++i) {
+            T* o = out + i * H2;
+
+            for (size_t p = 0; p < NW1; ++p) {
+                const T* row = plane + (i + p) * V2;
+
+                for (size_t q = 0; q < NW2; ++q) {
+                    const T weight = wr[p * NW2 + q];
+
+                    for (size_t j = 0; j < H2; ++j) {
+                        o[j] += weight * row[j + q];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute the valid convolution of a batch with a set of filters of
+ * size [NW1 x NW2]
+ *
+ * \param out The output [B x K x H1 x H2]
+ * \param in The input [B x C x V1 x V2]
+ * \param w The filters [K x C x NW1 x NW2]
+ */
+template <size_t NW1, size_t NW2, typename T>
+void valid_conv(T* out, const T* in, const T* w, size_t B, size_t C, size_t K, size_t V1, size_t V2) {
+    const size_t plane = (V1 - NW1 + 1) * (V2 - NW2 + 1);
+
+    parallel_kernel(0, B * K, [&](size_t task) {
+        const size_t b = task / K;
+        const size_t k = task % K;
+
+        valid_conv_filter<NW1, NW2>(out + task * plane, in + b * C * V1 * V2, w + k * C * NW1 * NW2, C, V1, V2);
+    });
+}
+
+} //end of namespace shape_detail
+
+/*!
+ * \brief The kernels of the dense layers (and of the RBMs), for shapes
+ * [V x H]
+ *
+ * \tparam F The activation function applied to the output
+ * \tparam T The type of the weights
+ * \tparam Fast Use the fast approximation of the activation function
+ */
+template <function F, typename T, bool Fast = false>
+struct dense_shape_kernels {
+    /*!
+     * \brief The type of a kernel, out = f(in * w + b), the biases being
+     * nullptr if the layer has none
+     */
+    using kernel_t = void (*)(T* out, const T* in, const T* w, const T* b, size_t batch);
+
+    /*!
+     * \brief Returns the kernel for the given shape
+     */
+    template <size_t V, size_t H>
+    static kernel_t get(shape<V, H> /*shape*/) {
+        return &shape_detail::dense_forward<F, Fast, V, H, T>;
+    }
+};
+
+/*!
+ * \brief The kernels of the valid convolutions, for filters [NW1 x NW2]
+ *
+ * \tparam T The type of the weights
+ */
+template <typename T>
+struct conv_shape_kernels {
+    /*!
+     * \brief The type of a kernel, the convolution of a batch [B x C x V1 x
+     * V2] with the filters [K x C x NW1 x NW2]
+     */
+    using kernel_t = void (*)(T* out, const T* in, const T* w, size_t B, size_t C, size_t K, size_t V1, size_t V2);
+
+    /*!
+     * \brief Returns the kernel for the given shape
+     */
+    template <size_t NW1, size_t NW2>
+    static kernel_t get(shape<NW1, NW2> /*shape*/) {
+        return &shape_detail::valid_conv<NW1, NW2, T>;
+    }
+};
+
+/*!
+ * \brief Select the kernel of the first of the shapes matching the given
+ * dimensions.
+ *
+ * \param shapes The list of shapes
+ * \param dims The dimensions of the layer
+ *
+ * \return The kernel of the matching shape, or nullptr if there is none
+ */
+template <typename Factory, typename... Shapes, size_t N>
+typename Factory::kernel_t select_shape_kernel(cpp::type_list<Shapes...> shapes, const std::array<size_t, N>& dims) {
+    cpp_unused(shapes);
+
+    typename Factory::kernel_t kernel = nullptr;
+
+    ((kernel = kernel ? kernel : shape_detail::select<Factory>(Shapes{}, dims)), ...);
+
+    return kernel;
+}
+
+} //end of dll namespace
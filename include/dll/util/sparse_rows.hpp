@@ -0,0 +1,122 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Sparse-row gradients
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief Storage of the touched rows of a gradient.
+ *
+ * By default, the gradients are dense and nothing is stored.
+ */
+template <typename Layer, size_t I, typename Enable = void>
+struct sparse_rows {
+    static constexpr bool sparse = false; ///< Indicates if the gradients are sparse
+};
+
+/*!
+ * \brief Storage of the touched rows of a gradient, for the first variable
+ * of layers with sparse gradients (embeddings).
+ *
+ * The gradient is kept as a dense matrix, whose rows are all zero except
+ * for the touched rows, so that the updaters can only update these rows.
+ */
+template <typename Layer, size_t I>
+struct sparse_rows<Layer, I, std::enable_if_t<Layer::sparse_gradients && I == 0>> {
+    static constexpr bool sparse = true; ///< Indicates if the gradients are sparse
+
+    std::vector<size_t> rows; ///< The (sorted) rows touched by the gradients
+};
+
+/*!
+ * \brief Indicates if the updater sub context Sub stores sparse gradients.
+ *
+ * Not all the updater sub contexts are derived from sparse_rows.
+ */
+template <typename Sub, typename Enable = void>
+struct has_sparse_rows : std::false_type {};
+
+template <typename Sub>
+struct has_sparse_rows<Sub, std::enable_if_t<Sub::sparse>> : std::true_type {};
+
+/*!
+ * \brief Compute the sparse gradients of an embedding.
+ *
+ * The rows touched by the previous batch are cleared and the errors of
+ * each input index are accumulated in its row.
+ *
+ * \param sub The updater sub context of the embedding weights
+ * \param input The batch of input indices
+ * \param errors The batch of errors
+ */
+template <typename Sub, typename Input, typename Errors>
+void sparse_embedding_gradients(Sub& sub, const Input& input, const Errors& errors) {
+    auto& grad = sub.grad;
+    auto& rows = sub.rows;
+
+    for (auto r : rows) {
+        grad(r) = 0;
+    }
+
+    rows.clear();
+
+    const size_t B = etl::dim<0>(input);
+    const size_t N = etl::dim<1>(input);
+
+    for (size_t b = 0; b < B; ++b) {
+        for (size_t i = 0; i < N; ++i) {
+            const size_t r = input(b, i);
+
+            grad(r) += errors(b)(i);
+            rows.push_back(r);
+        }
+    }
+
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+}
+
+/*!
+ * \brief Reduce the sparse gradients of a shard into the sparse gradients
+ * of the full context
+ * \param sub The updater sub context of the full context
+ * \param shard The updater sub context of the shard
+ * \param first Indicates if this is the first shard to reduce
+ */
+template <typename Sub, typename Shard>
+void reduce_sparse_gradients(Sub& sub, const Shard& shard, bool first) {
+    if (first) {
+        for (auto r : sub.rows) {
+            sub.grad(r) = 0;
+        }
+
+        sub.rows.clear();
+    }
+
+    for (auto r : shard.rows) {
+        sub.grad(r) += shard.grad(r);
+    }
+
+    std::vector<size_t> merged;
+    merged.reserve(sub.rows.size() + shard.rows.size());
+    std::set_union(sub.rows.begin(), sub.rows.end(), shard.rows.begin(), shard.rows.end(), std::back_inserter(merged));
+
+    sub.rows = std::move(merged);
+}
+
+} //end of dll namespace
@@ -0,0 +1,208 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Single-producer/single-consumer ring of slots with atomic indices.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace dll {
+
+/*!
+ * \brief Relax the CPU inside a spin loop
+ */
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/*!
+ * \brief A waiting spot where a thread first spins on a predicate and then
+ * parks on a condition variable.
+ *
+ * The notifier only takes the lock when the waiter is parked, so that the
+ * fast path does not touch any lock. All the accesses are sequentially
+ * consistent so that either the waiter sees the new state or the notifier
+ * sees the parked flag.
+ */
+struct parking_spot {
+    static constexpr size_t spin_count = 2048; ///< The number of iterations to spin before parking
+
+    std::mutex lock;                 ///< The lock for parking
+    std::condition_variable cv;      ///< The condition variable for parking
+    std::atomic<bool> parked{false}; ///< Indicates if the waiter is parked
+
+    /*!
+     * \brief Wait until the given predicate is true
+     * \param pred The predicate to wait for
+     */
+    template <typename Pred>
+    void wait(Pred&& pred) {
+        for (size_t i = 0; i < spin_count; ++i) {
+            if (pred()) {
+                return;
+            }
+
+            cpu_relax();
+        }
+
+        std::unique_lock<std::mutex> ulock(lock);
+
+        parked = true;
+
+        cv.wait(ulock, pred);
+
+        parked = false;
+    }
+
+    /*!
+     * \brief Wake up the waiter if it is parked
+     */
+    void notify() {
+        if (parked) {
+            std::lock_guard<std::mutex> l(lock);
+            cv.notify_one();
+        }
+    }
+};
+
+/*!
+ * \brief Single-producer/single-consumer ring of batch slots.
+ *
+ * The ring does not store the data itself, it only synchronizes the
+ * producer and the consumer over capacity slots. The producer fills the
+ * slot (head % capacity) and publishes it, the consumer reads the slot
+ * (tail % capacity) and releases it.
+ *
+ * The consumer can also ask the producer to restart from the beginning
+ * (reset) or to stop.
+ */
+struct spsc_ring {
+    const size_t capacity; ///< The number of slots
+
+    std::atomic<size_t> head{0}; ///< The number of slots published by the producer
+    std::atomic<size_t> tail{0}; ///< The number of slots released by the consumer
+
+    std::atomic<bool> stop_flag{false};  ///< Indicates to the producer to stop
+    std::atomic<bool> reset_flag{false}; ///< Indicates to the producer to restart
+
+    parking_spot producer_spot; ///< Waiting spot of the producer
+    parking_spot consumer_spot; ///< Waiting spot of the consumer
+
+    /*!
+     * \brief Construct a new spsc_ring
+     * \param capacity The number of slots
+     */
+    explicit spsc_ring(size_t capacity) : capacity(capacity) {}
+
+    spsc_ring(const spsc_ring& rhs) = delete;
+    spsc_ring& operator=(const spsc_ring& rhs) = delete;
+
+    /*!
+     * \brief Producer: wait for a free slot.
+     *
+     * If a reset is requested, the on_reset functor is called from the
+     * producer thread before the ring is restarted.
+     *
+     * \param limit The total number of slots to produce before waiting for a reset
+     * \param on_reset Functor called on reset
+     *
+     * \return The index of the produced item (the slot is index % capacity), or -1 if the producer must stop
+     */
+    template <typename Reset>
+    size_t producer_acquire(size_t limit, Reset&& on_reset) {
+        while (true) {
+            producer_spot.wait([this, limit] {
+                const size_t h = head;
+                return stop_flag || reset_flag || (h < limit && h - tail < capacity);
+            });
+
+            if (stop_flag) {
+                return size_t(-1);
+            }
+
+            if (reset_flag) {
+                on_reset();
+
+                head = 0;
+                tail = 0;
+
+                reset_flag = false;
+
+                consumer_spot.notify();
+
+                continue;
+            }
+
+            return head;
+        }
+    }
+
+    /*!
+     * \brief Producer: publish the slot previously acquired
+     */
+    void producer_publish() {
+        head.fetch_add(1);
+
+        consumer_spot.notify();
+    }
+
+    /*!
+     * \brief Consumer: wait for the given item to be published
+     * \param index The index of the item
+     */
+    void consumer_wait(size_t index) {
+        consumer_spot.wait([this, index] { return head > index; });
+    }
+
+    /*!
+     * \brief Consumer: release the oldest published slot
+     */
+    void consumer_release() {
+        tail.fetch_add(1);
+
+        producer_spot.notify();
+    }
+
+    /*!
+     * \brief Consumer: restart the production from the beginning.
+     *
+     * This waits for the producer to acknowledge the reset.
+     */
+    void reset() {
+        reset_flag = true;
+
+        producer_spot.notify();
+
+        consumer_spot.wait([this] { return !reset_flag; });
+    }
+
+    /*!
+     * \brief Ask the producer to stop
+     */
+    void stop() {
+        stop_flag = true;
+
+        producer_spot.notify();
+    }
+};
+
+} //end of dll namespace
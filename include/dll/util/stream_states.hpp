@@ -0,0 +1,178 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief The recurrent states of the streams of a streaming inference.
+ *
+ * Each stream has one slot holding the hidden state (and the cell state of
+ * the LSTM layers) of each recurrent layer. The states of a batch of
+ * streams are gathered in contiguous rows before a step and scattered back
+ * after it. The slots of the closed streams are reused by the next opened
+ * streams.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The recurrent states of a set of streams
+ */
+template <typename T>
+struct stream_states {
+    /*!
+     * \brief Add a recurrent layer to the states of the streams
+     * \param hidden_units The size of the hidden state of the layer
+     * \param cell Indicates if the layer has a cell state
+     */
+    void add_layer(size_t hidden_units, bool cell) {
+        cpp_assert(counts.empty(), "The layers must be added before the streams are opened");
+
+        units.push_back(hidden_units);
+        cells.push_back(cell);
+        h.emplace_back();
+        c.emplace_back();
+    }
+
+    /*!
+     * \brief Open a new stream, with zero states
+     * \return the identifier of the stream
+     */
+    size_t open() {
+        size_t s = counts.size();
+
+        if (free.empty()) {
+            counts.push_back(0);
+            opened.push_back(true);
+
+            for (size_t l = 0; l < units.size(); ++l) {
+                h[l].resize((s + 1) * units[l], T(0));
+
+                if (cells[l]) {
+                    c[l].resize((s + 1) * units[l], T(0));
+                }
+            }
+        } else {
+            s = free.back();
+            free.pop_back();
+
+            opened[s] = true;
+            reset(s);
+        }
+
+        return s;
+    }
+
+    /*!
+     * \brief Close the given stream, its slot can be reused
+     */
+    void close(size_t s) {
+        cpp_assert(is_open(s), "The stream is not open");
+
+        opened[s] = false;
+        free.push_back(s);
+    }
+
+    /*!
+     * \brief Reset the states of the given stream, as if it was just opened
+     */
+    void reset(size_t s) {
+        counts[s] = 0;
+
+        for (size_t l = 0; l < units.size(); ++l) {
+            std::fill_n(h[l].begin() + s * units[l], units[l], T(0));
+
+            if (cells[l]) {
+                std::fill_n(c[l].begin() + s * units[l], units[l], T(0));
+            }
+        }
+    }
+
+    /*!
+     * \brief Indicates if the given stream is open
+     */
+    bool is_open(size_t s) const {
+        return s < opened.size() && opened[s];
+    }
+
+    /*!
+     * \brief Returns the number of steps computed for the given stream
+     */
+    size_t steps(size_t s) const {
+        return counts[s];
+    }
+
+    /*!
+     * \brief Copy the states of a layer of the given streams in contiguous
+     * rows [n x H]
+     *
+     * \param l The index of the recurrent layer
+     * \param streams The streams
+     * \param h_out The hidden states
+     * \param c_out The cell states, only written if the layer has cell states
+     */
+    void gather(size_t l, const std::vector<size_t>& streams, T* h_out, T* c_out) const {
+        const size_t H = units[l];
+
+        for (size_t i = 0; i < streams.size(); ++i) {
+            std::copy_n(h[l].begin() + streams[i] * H, H, h_out + i * H);
+
+            if (cells[l]) {
+                std::copy_n(c[l].begin() + streams[i] * H, H, c_out + i * H);
+            }
+        }
+    }
+
+    /*!
+     * \brief Copy back the states of a layer of the given streams from
+     * contiguous rows [n x H]
+     *
+     * \param l The index of the recurrent layer
+     * \param streams The streams
+     * \param h_in The hidden states
+     * \param c_in The cell states, only read if the layer has cell states
+     */
+    void scatter(size_t l, const std::vector<size_t>& streams, const T* h_in, const T* c_in) {
+        const size_t H = units[l];
+
+        for (size_t i = 0; i < streams.size(); ++i) {
+            std::copy_n(h_in + i * H, H, h[l].begin() + streams[i] * H);
+
+            if (cells[l]) {
+                std::copy_n(c_in + i * H, H, c[l].begin() + streams[i] * H);
+            }
+        }
+    }
+
+    /*!
+     * \brief Count k more steps for each of the given streams
+     */
+    void advance(const std::vector<size_t>& streams, size_t k) {
+        for (auto s : streams) {
+            counts[s] += k;
+        }
+    }
+
+private:
+    std::vector<size_t> units; ///< The size of the hidden state of each layer
+    std::vector<bool> cells;   ///< Indicates if each layer has a cell state
+
+    std::vector<std::vector<T>> h; ///< The hidden states of each layer [slots x H]
+    std::vector<std::vector<T>> c; ///< The cell states of each layer [slots x H]
+
+    std::vector<size_t> counts; ///< The number of steps of each slot
+    std::vector<bool> opened;   ///< Indicates if each slot is in use
+    std::vector<size_t> free;   ///< The slots of the closed streams
+};
+
+} //end of dll namespace
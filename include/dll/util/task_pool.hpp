@@ -0,0 +1,254 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Work-stealing pool of tasks
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A group of tasks that can be waited for together
+ */
+struct task_group {
+    std::atomic<size_t> pending{0}; ///< The number of tasks not yet finished
+};
+
+/*!
+ * \brief A pool of threads executing tasks with work stealing.
+ *
+ * Each worker has its own queue. A worker takes its own last task first
+ * (the most recent, still hot in its cache) and steals the oldest task of
+ * the other queues when its own is empty. The thread waiting for a group
+ * executes the tasks itself instead of sleeping.
+ *
+ * The tasks are run inside a worker_section, their ETL expressions and
+ * kernels are serial.
+ */
+struct work_stealing_pool {
+    /*!
+     * \brief Create a pool with the given number of workers
+     * \param threads The number of worker threads
+     */
+    explicit work_stealing_pool(size_t threads) {
+        threads = std::max(threads, size_t(1));
+
+        for (size_t t = 0; t < threads; ++t) {
+            queues.emplace_back(std::make_unique<task_queue>());
+        }
+
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([this, t] { work(t); });
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool& rhs) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool& rhs) = delete;
+
+    /*!
+     * \brief Stop the workers, the submitted tasks must have been waited
+     * for
+     */
+    ~work_stealing_pool() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            running = false;
+        }
+
+        ready.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of workers of the pool
+     */
+    size_t size() const {
+        return workers.size();
+    }
+
+    /*!
+     * \brief Submit a task of the given group.
+     *
+     * A task submitted from a worker goes to its own queue, the other tasks
+     * are distributed over the queues.
+     *
+     * \param group The group of the task
+     * \param fun The task
+     */
+    template <typename Functor>
+    void submit(task_group& group, Functor&& fun) {
+        ++group.pending;
+
+        const size_t q = current_worker() < queues.size() ? current_worker() : next_queue++ % queues.size();
+
+        // Counted before being queued, so that the counter never goes below zero
+        {
+            std::lock_guard<std::mutex> l(lock);
+            ++queued;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(queues[q]->lock);
+            queues[q]->tasks.push_back({&group, std::forward<Functor>(fun)});
+        }
+
+        ready.notify_one();
+    }
+
+    /*!
+     * \brief Wait for all the tasks of the group, executing the queued
+     * tasks in the meantime
+     * \param group The group to wait for
+     */
+    void wait(task_group& group) {
+        while (group.pending) {
+            task t;
+
+            if (steal(queues.size(), t)) {
+                run(t);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    /*!
+     * \brief A task of the pool
+     */
+    struct task {
+        task_group* group = nullptr; ///< The group of the task
+        std::function<void()> fun;   ///< The functor of the task
+    };
+
+    /*!
+     * \brief The queue of one worker
+     */
+    struct task_queue {
+        std::mutex lock;        ///< The lock protecting the queue
+        std::deque<task> tasks; ///< The tasks of the queue
+    };
+
+    /*!
+     * \brief Returns the index of the worker of the current thread, or -1
+     * if the thread is not a worker
+     */
+    static size_t& current_worker() {
+        thread_local size_t index = size_t(-1);
+        return index;
+    }
+
+    /*!
+     * \brief Take a task, first the last of the given queue (if any), then
+     * the first of the other queues
+     * \return true if a task has been taken, false otherwise
+     */
+    bool steal(size_t own, task& t) {
+        if (own < queues.size()) {
+            std::lock_guard<std::mutex> l(queues[own]->lock);
+
+            if (!queues[own]->tasks.empty()) {
+                t = std::move(queues[own]->tasks.back());
+                queues[own]->tasks.pop_back();
+                taken();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i <= queues.size(); ++i) {
+            const size_t q = (own + i) % queues.size();
+
+            if (q == own) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> l(queues[q]->lock);
+
+            if (!queues[q]->tasks.empty()) {
+                t = std::move(queues[q]->tasks.front());
+                queues[q]->tasks.pop_front();
+                taken();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Account for a task taken out of a queue
+     */
+    void taken() {
+        std::lock_guard<std::mutex> l(lock);
+        --queued;
+    }
+
+    /*!
+     * \brief Run a task and mark it finished in its group
+     */
+    static void run(task& t) {
+        {
+            worker_section section;
+
+            t.fun();
+        }
+
+        --t.group->pending;
+    }
+
+    /*!
+     * \brief The loop of the worker w
+     */
+    void work(size_t w) {
+        current_worker() = w;
+
+        while (true) {
+            task t;
+
+            if (steal(w, t)) {
+                run(t);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> ulock(lock);
+
+            ready.wait(ulock, [this] { return !running || queued > 0; });
+
+            if (!running && !queued) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<task_queue>> queues; ///< The queue of each worker
+    std::vector<std::thread> workers;                ///< The worker threads
+    std::atomic<size_t> next_queue{0};               ///< The next queue for the tasks of external threads
+
+    std::mutex lock;               ///< The lock protecting the counter of queued tasks
+    std::condition_variable ready; ///< Signals new tasks or the end of the pool
+    size_t queued = 0;             ///< The number of queued tasks
+    bool running  = true;          ///< Indicates if the pool is running
+};
+
+} //end of dll namespace
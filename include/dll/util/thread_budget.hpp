@@ -0,0 +1,167 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief The process-wide budget of threads of the library
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+#include "etl/etl.hpp"
+
+#ifdef ETL_MKL_MODE
+#include <mkl_service.h>
+#endif
+
+namespace dll {
+
+namespace budget_detail {
+
+/*!
+ * \brief Returns the default budget, from the DLL_THREADS environment
+ * variable, or the number of threads of ETL.
+ */
+inline size_t default_budget() {
+    if (auto* value = std::getenv("DLL_THREADS")) {
+        const long threads = std::strtol(value, nullptr, 10);
+
+        if (threads > 0) {
+            return threads;
+        }
+    }
+
+    return std::max(size_t(1), size_t(etl::threads));
+}
+
+/*!
+ * \brief Returns the number of threads of the budget
+ */
+inline std::atomic<size_t>& budget() {
+    static std::atomic<size_t> threads{default_budget()};
+    return threads;
+}
+
+/*!
+ * \brief Returns the number of threads reserved by the background workers
+ */
+inline std::atomic<size_t>& reserved() {
+    static std::atomic<size_t> threads{0};
+    return threads;
+}
+
+/*!
+ * \brief Set the number of threads of the BLAS library, when it can be set
+ * at runtime.
+ */
+inline void configure_blas(size_t threads) {
+#ifdef ETL_MKL_MODE
+    mkl_set_num_threads(int(threads));
+#else
+    (void)threads;
+#endif
+}
+
+/*!
+ * \brief Configure the libraries from the default budget, once, before the
+ * first pool is created
+ */
+inline size_t configured_budget() {
+    static const bool configured = (configure_blas(budget()), true);
+    (void)configured;
+
+    return budget();
+}
+
+} //end of namespace budget_detail
+
+/*!
+ * \brief Returns the number of threads of the process-wide budget.
+ *
+ * All the pools of the library (the kernels, the DBN pool, the default
+ * number of workers of the asynchronous trainers, the decoders) are sized
+ * from this budget and the threads of BLAS (MKL) are configured from it.
+ *
+ * ETL sizes its own pool itself (etl::threads, the default budget), its
+ * expressions are run serially inside the workers of the library (see
+ * worker_section).
+ */
+inline size_t thread_budget() {
+    return budget_detail::configured_budget();
+}
+
+/*!
+ * \brief Set the number of threads of the process-wide budget.
+ *
+ * This must be called before the first network is created, the pools are
+ * not resized.
+ *
+ * \param threads The number of threads (at least one)
+ */
+inline void set_thread_budget(size_t threads) {
+    threads = std::max(threads, size_t(1));
+
+    budget_detail::budget() = threads;
+    budget_detail::configure_blas(threads);
+}
+
+/*!
+ * \brief Returns the number of threads of the budget not reserved by
+ * background workers (at least one).
+ */
+inline size_t available_threads() {
+    const size_t budget   = thread_budget();
+    const size_t reserved = budget_detail::reserved();
+
+    return reserved < budget ? budget - reserved : 1;
+}
+
+/*!
+ * \brief Returns the number of workers to use for the given number of
+ * independent tasks.
+ *
+ * \param tasks The number of tasks
+ * \param requested The requested number of workers (0 for the available threads)
+ */
+inline size_t budget_workers(size_t tasks, size_t requested = 0) {
+    const size_t threads = requested ? requested : available_threads();
+
+    return std::max(size_t(1), std::min(tasks, threads));
+}
+
+/*!
+ * \brief Reserve threads of the budget for background workers that run
+ * concurrently with the training (the augmentation threads of the
+ * generators for instance), while alive.
+ */
+struct thread_reservation {
+    /*!
+     * \brief Reserve the given number of threads
+     */
+    explicit thread_reservation(size_t threads) : threads(threads) {
+        budget_detail::reserved() += threads;
+    }
+
+    thread_reservation(const thread_reservation& rhs) = delete;
+    thread_reservation& operator=(const thread_reservation& rhs) = delete;
+
+    /*!
+     * \brief Release the threads
+     */
+    ~thread_reservation() {
+        budget_detail::reserved() -= threads;
+    }
+
+private:
+    size_t threads; ///< The number of reserved threads
+};
+
+} //end of dll namespace
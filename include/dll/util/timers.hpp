@@ -8,13 +8,28 @@
 #pragma once
 
 #include <chrono>
+#include <string>
+#include <vector>
 
 #ifndef DLL_NO_TIMERS
 
-#include <iosfwd>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
 #include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <sstream>
 
+#ifdef DLL_PERF_COUNTERS
+#include "dll/util/perf_counters.hpp"
+#endif
+
 #endif
 
 namespace dll {
@@ -40,6 +55,15 @@ struct stop_timer {
         auto end = std::chrono::steady_clock::now();
         return std::chrono::duration_cast<std::chrono::milliseconds>(end - start_time).count();
     }
+
+    /*!
+     * \brief Stop the timer and get the elapsed since start
+     * \return elapsed time since start(), in nanoseconds
+     */
+    size_t stop_ns() const {
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_time).count();
+    }
 };
 
 #ifdef DLL_NO_TIMERS
@@ -70,6 +94,46 @@ inline void dump_timers_pretty() {
     std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
 }
 
+/*!
+ * \brief Dump the timers as a tree of nested scopes on the console.
+ */
+inline void dump_timers_tree() {
+    std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
+}
+
+/*!
+ * \brief Export the recorded trace events in the Chrome trace event format.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline bool dump_timers_trace(const std::string& /*path*/) {
+    return false;
+}
+
+/*!
+ * \brief Enable or disable the recording of the trace events.
+ */
+inline void trace_timers(bool /*enable*/ = true) {}
+
+/*!
+ * \brief Reset all timers
+ */
+inline void reset_timers() {}
+
+/*!
+ * \brief Record the latency histograms of the given timers.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void histogram_timers(const std::vector<std::string>& /*names*/ = {}) {}
+
+/*!
+ * \brief Add one duration, measured by the caller, to the given timer.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void record_timer(const char* /*name*/, size_t /*duration*/) {}
+
 struct auto_timer {
     auto_timer(const char* /*name*/) {}
 };
@@ -80,78 +144,357 @@ struct unsafe_auto_timer {
 
 #else
 
-constexpr size_t max_timers = 128; ///< The maximum number of timers
+/*
+ * The scopes are keyed by (name, parent scope), so a timer used from
+ * several scopes takes several entries. The library alone has about 150
+ * timer names, the table is sized for several parents per name. It can be
+ * changed by defining DLL_MAX_TIMERS.
+ */
+
+#ifdef DLL_MAX_TIMERS
+constexpr size_t max_timers = DLL_MAX_TIMERS; ///< The maximum number of timer scopes per thread
+#else
+constexpr size_t max_timers = 1024; ///< The maximum number of timer scopes per thread
+#endif
+
+constexpr size_t max_trace_events = 1 << 20;    ///< The maximum number of trace events per thread
+constexpr size_t no_timer         = max_timers; ///< The index of the root scope
 
 /*!
- * \brief A timer
+ * \brief A histogram of durations with a bounded relative error, in the
+ * style of HDR histograms.
+ *
+ * The durations (in nanoseconds) below 2^S are counted exactly, the larger
+ * ones in 2^(S-1) buckets per power of two, the relative error of the
+ * percentiles is below 2^(1-S), about 3%.
+ *
+ * The counts are only written by the owning thread, like the counters of
+ * the timers.
  */
-struct timer_t {
-    const char* name;             ///< The name of the timer
-    std::atomic<size_t> count;    ///< The number of times it was incremented
-    std::atomic<size_t> duration; ///< The total duration
+struct latency_histogram {
+    static constexpr size_t sub_bits = 6;                                       ///< The number of bits of the exact durations
+    static constexpr size_t sub      = size_t(1) << sub_bits;                   ///< The number of exact durations
+    static constexpr size_t half     = sub / 2;                                 ///< The number of buckets per power of two
+    static constexpr size_t max_bits = 44;                                      ///< The number of bits of the largest duration (about 4.9 hours)
+    static constexpr size_t buckets  = sub + (max_bits - sub_bits) * half;      ///< The number of buckets
+
+    std::array<std::atomic<uint64_t>, buckets> counts; ///< The count of each bucket
+    std::atomic<uint64_t> max{0};                      ///< The largest recorded duration
+
+    latency_histogram() {
+        clear();
+    }
 
     /*!
-     * \brief Initialize an empty counter
+     * \brief Returns the bucket of the given duration
      */
-    timer_t()
-            : name(nullptr), count(0), duration(0) {}
+    static size_t index(uint64_t value) {
+        if (value < sub) {
+            return value;
+        }
+
+        const size_t e = 63 - __builtin_clzll(value);
+
+        if (e >= max_bits) {
+            return buckets - 1;
+        }
+
+        const size_t shift = e - sub_bits + 1;
+
+        return sub + (shift - 1) * half + ((value >> shift) - half);
+    }
+
+    /*!
+     * \brief Returns the largest duration of the given bucket
+     */
+    static uint64_t upper(size_t index) {
+        if (index < sub) {
+            return index;
+        }
+
+        const size_t shift = (index - sub) / half + 1;
+
+        return (((index - sub) % half + half + 1) << shift) - 1;
+    }
+
+    /*!
+     * \brief Record one duration
+     */
+    void record(uint64_t value) {
+        auto& count = counts[index(value)];
+
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if (value > max.load(std::memory_order_relaxed)) {
+            max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    /*!
+     * \brief Add the counts of the histogram to the given counts
+     */
+    void add_to(std::vector<uint64_t>& merged, uint64_t& merged_max) const {
+        merged.resize(buckets, 0);
+
+        for (size_t i = 0; i < buckets; ++i) {
+            merged[i] += counts[i].load(std::memory_order_relaxed);
+        }
+
+        merged_max = std::max(merged_max, max.load(std::memory_order_relaxed));
+    }
+
+    /*!
+     * \brief Reset the histogram
+     */
+    void clear() {
+        for (auto& count : counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+
+        max.store(0, std::memory_order_relaxed);
+    }
 
     /*!
-     * \brief Copy a timer
+     * \brief Returns the given percentile of the given counts
+     * \param merged The counts of each bucket
+     * \param merged_max The largest duration
+     * \param q The percentile, in [0, 1]
+     * \return The largest duration of the bucket of the percentile, at most the largest duration
      */
-    timer_t(const timer_t& rhs)
-            : name(rhs.name), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    static uint64_t percentile(const std::vector<uint64_t>& merged, uint64_t merged_max, double q) {
+        const uint64_t total = std::accumulate(merged.begin(), merged.end(), uint64_t(0));
+
+        if (!total) {
+            return 0;
+        }
+
+        const uint64_t rank = std::max(uint64_t(1), uint64_t(std::ceil(q * total)));
+
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < merged.size(); ++i) {
+            seen += merged[i];
+
+            if (seen >= rank) {
+                return std::min(upper(i), merged_max);
+            }
+        }
+
+        return merged_max;
+    }
+};
+
+/*!
+ * \brief The names of the timers whose latency histograms are recorded
+ */
+struct histogram_selection {
+    std::mutex lock;                     ///< The lock protecting the names
+    std::vector<std::string> names;      ///< The names of the selected timers
+    std::atomic<size_t> generation{0};   ///< Incremented when the names change
+
+    /*!
+     * \brief Indicates if the histogram of the given timer is recorded
+     */
+    bool contains(const char* name) {
+        std::lock_guard<std::mutex> l(lock);
+
+        return std::find(names.begin(), names.end(), name) != names.end();
+    }
+};
+
+/*!
+ * \brief Get a reference to the selection of the histograms
+ */
+inline histogram_selection& get_histogram_selection() {
+    static histogram_selection selection;
+    return selection;
+}
+
+/*!
+ * \brief A timer scope of one thread.
+ *
+ * The counters are only written by the owning thread, they are atomic so
+ * that they can be read concurrently by the dump functions, but they are
+ * never incremented with a locked instruction.
+ */
+struct timer_node {
+    const char* name = nullptr;       ///< The name of the timer
+    size_t parent    = no_timer;      ///< The index of the enclosing scope
+    std::atomic<size_t> count{0};     ///< The number of times it was incremented
+    std::atomic<size_t> duration{0};  ///< The total duration
+
+    std::atomic<latency_histogram*> histogram{nullptr}; ///< The latency histogram, if selected
+    size_t generation = 0;                              ///< The generation of the selection last checked
+
+#ifdef DLL_PERF_COUNTERS
+    std::atomic<uint64_t> cycles{0};       ///< The total number of cycles
+    std::atomic<uint64_t> instructions{0}; ///< The total number of instructions
+    std::atomic<uint64_t> misses{0};       ///< The total number of last level cache misses
+    std::atomic<uint64_t> flops{0};        ///< The total number of floating point operations
+#endif
+};
+
+/*!
+ * \brief A complete timer event, for the trace
+ */
+struct trace_event {
+    const char* name; ///< The name of the timer
+    size_t start;     ///< The start time, in nanoseconds since the timers epoch
+    size_t duration;  ///< The duration, in nanoseconds
+};
+
+/*!
+ * \brief The counters of one thread.
+ */
+struct thread_timers {
+    std::array<timer_node, max_timers> nodes; ///< The scopes of the thread
+    std::atomic<size_t> size{0};              ///< The number of used scopes
+    size_t current = no_timer;                ///< The current scope
+    size_t id;                                ///< The identifier of the thread
+
+    std::mutex events_lock;          ///< The lock protecting the trace events
+    std::vector<trace_event> events; ///< The trace events
+
+    std::vector<std::unique_ptr<latency_histogram>> histograms; ///< The latency histograms of the scopes
+
+#ifdef DLL_PERF_COUNTERS
+    perf_counters counters; ///< The hardware counters of the thread
+#endif
+
+    explicit thread_timers(size_t id) : id(id) {}
 
     /*!
-     * \brief Copy assign a timer
+     * \brief Enter the scope of the given timer, in the current scope
+     * \return The index of the scope or no_timer if there is no room left
      */
-    timer_t& operator=(const timer_t& rhs) {
-        if (&rhs != this) {
-            name     = rhs.name;
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    size_t enter(const char* name) {
+        const size_t n = size.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i < n; ++i) {
+            if (nodes[i].name == name && nodes[i].parent == current) {
+                select(i);
+                return current = i;
+            }
         }
 
-        return *this;
+        if (n == max_timers) {
+            static std::atomic<bool> reported{false};
+
+            if (!reported.exchange(true, std::memory_order_relaxed)) {
+                std::cerr << "Unable to register timer " << name << " (more than " << max_timers
+                          << " scopes, define DLL_MAX_TIMERS to increase the limit), the next timers are not reported" << std::endl;
+            }
+
+            return no_timer;
+        }
+
+        nodes[n].name   = name;
+        nodes[n].parent = current;
+        size.store(n + 1, std::memory_order_release);
+
+        select(n);
+
+        return current = n;
     }
 
     /*!
-     * \brief Move construct a timer
+     * \brief Create the histogram of the given scope if its timer has been
+     * selected since the last check
      */
-    timer_t(timer_t&& rhs)
-            : name(std::move(rhs.name)), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    void select(size_t i) {
+        auto& selection = get_histogram_selection();
+
+        const size_t generation = selection.generation.load(std::memory_order_acquire);
+
+        auto& node = nodes[i];
+
+        if (node.generation != generation) {
+            node.generation = generation;
+
+            if (!node.histogram.load(std::memory_order_relaxed) && selection.contains(node.name)) {
+                histograms.push_back(std::make_unique<latency_histogram>());
+                node.histogram.store(histograms.back().get(), std::memory_order_release);
+            }
+        }
+    }
 
     /*!
-     * \brief Move assign a timer
+     * \brief Leave the given scope and add the given duration to it
      */
-    timer_t& operator=(timer_t&& rhs) {
-        if (&rhs != this) {
-            name     = std::move(rhs.name);
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    void leave(size_t node, size_t previous, size_t duration) {
+        current = previous;
+
+        if (node != no_timer) {
+            auto& timer = nodes[node];
+            timer.count.store(timer.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            timer.duration.store(timer.duration.load(std::memory_order_relaxed) + duration, std::memory_order_relaxed);
+
+            if (auto* histogram = timer.histogram.load(std::memory_order_relaxed)) {
+                histogram->record(duration);
+            }
         }
+    }
 
-        return *this;
+#ifdef DLL_PERF_COUNTERS
+    /*!
+     * \brief Add the given counters to the given scope
+     */
+    void count(size_t node, const perf_sample& delta) {
+        if (node != no_timer) {
+            auto add = [](std::atomic<uint64_t>& counter, uint64_t value) {
+                counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            };
+
+            auto& timer = nodes[node];
+
+            add(timer.cycles, delta.cycles);
+            add(timer.instructions, delta.instructions);
+            add(timer.misses, delta.misses);
+            add(timer.flops, delta.flops);
+        }
     }
+#endif
 };
 
 /*!
- * \brief The structure holding all the timers
+ * \brief The registry of the counters of all the threads.
+ *
+ * The counters of a thread are kept after it exits, so that they are still
+ * reported.
  */
 struct timers_t {
-    std::array<timer_t, max_timers> timers; ///< The timers
-    std::mutex lock; ///< The lock to protect the timers
+    std::mutex lock;                                     ///< The lock to protect the registry
+    std::vector<std::shared_ptr<thread_timers>> threads; ///< The counters of each thread
+    std::atomic<bool> trace{false};                      ///< Indicates if the trace events are recorded
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now(); ///< The origin of the trace
 
     /*!
      * \brief Reset the status of the timers
      */
-    void reset(){
+    void reset() {
         std::lock_guard<std::mutex> l(lock);
 
-        for(auto& timer : timers){
-            timer.name = nullptr;
-            timer.duration = 0;
-            timer.count = 0;
+        for (auto& local : threads) {
+            const size_t n = local->size.load(std::memory_order_acquire);
+
+            for (size_t i = 0; i < n; ++i) {
+                local->nodes[i].count    = 0;
+                local->nodes[i].duration = 0;
+
+                if (auto* histogram = local->nodes[i].histogram.load(std::memory_order_acquire)) {
+                    histogram->clear();
+                }
+
+#ifdef DLL_PERF_COUNTERS
+                local->nodes[i].cycles       = 0;
+                local->nodes[i].instructions = 0;
+                local->nodes[i].misses       = 0;
+                local->nodes[i].flops        = 0;
+#endif
+            }
+
+            std::lock_guard<std::mutex> el(local->events_lock);
+            local->events.clear();
         }
     }
 };
@@ -164,6 +507,178 @@ inline timers_t& get_timers() {
     return timers;
 }
 
+/*!
+ * \brief Get a reference to the counters of the current thread
+ */
+inline thread_timers& local_timers() {
+    thread_local std::shared_ptr<thread_timers> local = [] {
+        decltype(auto) timers = get_timers();
+
+        std::lock_guard<std::mutex> l(timers.lock);
+
+        timers.threads.push_back(std::make_shared<thread_timers>(timers.threads.size()));
+
+        return timers.threads.back();
+    }();
+
+    return *local;
+}
+
+/*!
+ * \brief A timer merged over all the threads
+ */
+struct timer_t {
+    std::string name;  ///< The name of the timer
+    size_t parent;     ///< The index of the enclosing timer (no_timer for the top level)
+    size_t depth;      ///< The nesting depth of the timer
+    size_t count;      ///< The number of times it was incremented
+    size_t duration;   ///< The total duration
+
+    uint64_t cycles       = 0; ///< The total number of cycles (with DLL_PERF_COUNTERS)
+    uint64_t instructions = 0; ///< The total number of instructions (with DLL_PERF_COUNTERS)
+    uint64_t misses       = 0; ///< The total number of last level cache misses (with DLL_PERF_COUNTERS)
+    uint64_t flops        = 0; ///< The total number of floating point operations (with DLL_PERF_COUNTERS)
+
+    std::vector<uint64_t> latencies{}; ///< The counts of the latency histogram (empty if not selected)
+    uint64_t latency_max = 0;          ///< The largest latency
+
+    /*!
+     * \brief Add the counts of the given timer to this timer
+     */
+    void add(const timer_t& rhs) {
+        count += rhs.count;
+        duration += rhs.duration;
+        cycles += rhs.cycles;
+        instructions += rhs.instructions;
+        misses += rhs.misses;
+        flops += rhs.flops;
+
+        if (!rhs.latencies.empty()) {
+            latencies.resize(latency_histogram::buckets, 0);
+
+            for (size_t i = 0; i < latencies.size(); ++i) {
+                latencies[i] += rhs.latencies[i];
+            }
+
+            latency_max = std::max(latency_max, rhs.latency_max);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the latency histogram of the timer is recorded
+     */
+    bool has_latencies() const {
+        return !latencies.empty();
+    }
+
+    /*!
+     * \brief Returns the given percentile of the latencies, in nanoseconds
+     * \param q The percentile, in [0, 1]
+     */
+    uint64_t latency(double q) const {
+        return latency_histogram::percentile(latencies, latency_max, q);
+    }
+};
+
+/*!
+ * \brief Merge the scopes of all the threads into a single tree.
+ *
+ * Two scopes are merged when they have the same name and the same chain of
+ * enclosing scopes. The parents are always before their children.
+ */
+inline std::vector<timer_t> merged_timer_tree() {
+    decltype(auto) timers = get_timers();
+
+    std::lock_guard<std::mutex> l(timers.lock);
+
+    std::vector<timer_t> tree;
+    std::vector<size_t> mapping;
+
+    for (auto& local : timers.threads) {
+        const size_t n = local->size.load(std::memory_order_acquire);
+
+        mapping.resize(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            auto& node = local->nodes[i];
+
+            const size_t parent = node.parent == no_timer ? no_timer : mapping[node.parent];
+
+            size_t m = 0;
+            while (m < tree.size() && !(tree[m].parent == parent && tree[m].name == node.name)) {
+                ++m;
+            }
+
+            if (m == tree.size()) {
+                tree.push_back({node.name, parent, parent == no_timer ? 0 : tree[parent].depth + 1, 0, 0});
+            }
+
+            tree[m].count += node.count.load(std::memory_order_relaxed);
+            tree[m].duration += node.duration.load(std::memory_order_relaxed);
+
+            if (auto* histogram = node.histogram.load(std::memory_order_acquire)) {
+                histogram->add_to(tree[m].latencies, tree[m].latency_max);
+            }
+
+#ifdef DLL_PERF_COUNTERS
+            tree[m].cycles += node.cycles.load(std::memory_order_relaxed);
+            tree[m].instructions += node.instructions.load(std::memory_order_relaxed);
+            tree[m].misses += node.misses.load(std::memory_order_relaxed);
+            tree[m].flops += node.flops.load(std::memory_order_relaxed);
+#endif
+
+            mapping[i] = m;
+        }
+    }
+
+    return tree;
+}
+
+/*!
+ * \brief Merge the timers of all the threads and all the scopes by name,
+ * sorted by duration (DESC).
+ *
+ * A timer nested in a timer of the same name is only counted once.
+ */
+inline std::vector<timer_t> merged_timers() {
+    auto tree = merged_timer_tree();
+
+    std::vector<timer_t> flat;
+
+    for (size_t i = 0; i < tree.size(); ++i) {
+        auto& node = tree[i];
+
+        if (!node.count) {
+            continue;
+        }
+
+        bool recursive = false;
+        for (size_t p = node.parent; p != no_timer && !recursive; p = tree[p].parent) {
+            recursive = tree[p].name == node.name;
+        }
+
+        if (recursive) {
+            continue;
+        }
+
+        auto it = std::find_if(flat.begin(), flat.end(), [&node](auto& timer) { return timer.name == node.name; });
+
+        if (it == flat.end()) {
+            flat.push_back(node);
+            flat.back().parent = no_timer;
+            flat.back().depth  = 0;
+        } else {
+            it->add(node);
+        }
+    }
+
+    std::sort(flat.begin(), flat.end(), [](auto& left, auto& right) {
+        return left.duration > right.duration;
+    });
+
+    return flat;
+}
+
 inline std::string to_string_precision(double duration, int precision = 6) {
     std::ostringstream out;
     out << std::setprecision(precision) << duration;
@@ -190,28 +705,82 @@ inline void reset_timers() {
     timers.reset();
 }
 
+/*!
+ * \brief Enable or disable the recording of the trace events.
+ *
+ * The trace events are disabled by default. When enabled, every timer
+ * records one event, which can be exported with dump_timers_trace().
+ */
+inline void trace_timers(bool enable = true) {
+    get_timers().trace.store(enable, std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Returns the timers whose latency histograms are recorded by
+ * default: the training batches, the batches of the generators and the
+ * requests of the inference server.
+ */
+inline std::vector<std::string> default_histogram_timers() {
+    return {"sgd::train_batch", "sgd::train_batch:parallel", "generator:next_batch", "inference:request"};
+}
+
+/*!
+ * \brief Record the latency histograms of the given timers.
+ *
+ * Only the count and the total duration of the other timers are
+ * recorded. The histograms give the percentiles of the durations in
+ * dump_timers_pretty() and in the metrics exporter, with a relative error
+ * below 3%. The selection takes effect at the next entry of each scope.
+ *
+ * \param names The names of the timers (the default timers if empty)
+ */
+inline void histogram_timers(const std::vector<std::string>& names = {}) {
+    auto& selection = get_histogram_selection();
+
+    {
+        std::lock_guard<std::mutex> l(selection.lock);
+
+        for (auto& name : names.empty() ? default_histogram_timers() : names) {
+            if (std::find(selection.names.begin(), selection.names.end(), name) == selection.names.end()) {
+                selection.names.push_back(name);
+            }
+        }
+    }
+
+    selection.generation.fetch_add(1, std::memory_order_release);
+}
+
+/*!
+ * \brief Add one duration, measured by the caller, to the given timer,
+ * nested in the current scope of the calling thread.
+ *
+ * \param name The name of the timer (must be a string literal)
+ * \param duration The duration, in nanoseconds
+ */
+inline void record_timer(const char* name, size_t duration) {
+    auto& local = local_timers();
+
+    const size_t previous = local.current;
+    const size_t node     = local.enter(name);
+
+    local.leave(node, previous, duration);
+}
+
 /*!
  * \brief Dump the values of the timer on the console.
  *
  * This has no effect if the timers were disabled.
  */
 inline void dump_timers() {
-    decltype(auto) timers = get_timers().timers;
-
-    //Sort the timers by duration (DESC)
-    std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
-        return left.duration > right.duration;
-    });
+    auto timers = merged_timers();
 
     // Print all the used timers
     for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-            std::cout << timer.name << "(" << count << ") : "
-                      << duration_str(duration)
-                      << " (" << duration_str(duration / count) << ")" << std::endl;
-        }
+        size_t count = timer.count;
+        size_t duration = timer.duration;
+        std::cout << timer.name << "(" << count << ") : "
+                  << duration_str(duration)
+                  << " (" << duration_str(duration / count) << ")" << std::endl;
     }
 }
 
@@ -222,36 +791,131 @@ inline void dump_timers() {
  * The total is the counter with the maximum total time
  */
 inline void dump_timers_one() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = merged_timers();
 
     if(timers.empty()){
         return;
     }
 
-    //Sort the timers by duration (DESC)
-    std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
-        return left.duration > right.duration;
-    });
-
-    double total_duration = timers.front().duration.load();
+    double total_duration = timers.front().duration;
 
     // Print all the used timers
     for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-            std::cout << timer.name << "(" << count << ") : "
-                      << duration_str(duration)
-                      << " (" << 100.0 * (duration / total_duration) << "%, " << duration_str(duration / count) << ")" << std::endl;
+        size_t count = timer.count;
+        size_t duration = timer.duration;
+        std::cout << timer.name << "(" << count << ") : "
+                  << duration_str(duration)
+                  << " (" << 100.0 * (duration / total_duration) << "%, " << duration_str(duration / count) << ")" << std::endl;
+    }
+}
+
+#ifdef DLL_PERF_COUNTERS
+
+/*!
+ * \brief Returns the hardware counters columns of the given timer: the
+ * instructions per cycle, the last level cache misses, the floating point
+ * operations and the bytes (estimated from the cache misses) per floating
+ * point operation.
+ */
+inline std::array<std::string, 4> perf_columns(const timer_t& timer) {
+    std::array<std::string, 4> columns{{"-", "-", "-", "-"}};
+
+    if (timer.cycles) {
+        columns[0] = to_string_precision(double(timer.instructions) / timer.cycles, 3);
+        columns[1] = std::to_string(timer.misses);
+    }
+
+    if (timer.flops) {
+        columns[2] = std::to_string(timer.flops);
+
+        if (timer.cycles) {
+            columns[3] = to_string_precision(double(timer.misses * perf_counters::line_size) / timer.flops, 3);
+        }
+    }
+
+    return columns;
+}
+
+#endif
+
+/*!
+ * \brief Dump the percentiles of the latency histograms of the given
+ * timers on the console, if any has been recorded.
+ */
+inline void dump_timers_latencies(const std::vector<timer_t>& timers) {
+    constexpr size_t columns = 6;
+
+    std::array<std::string, columns> column_name{{"Timer", "Count", "p50", "p90", "p99", "Max"}};
+
+    size_t column_length[columns];
+
+    for (size_t c = 0; c < columns; ++c) {
+        column_length[c] = column_name[c].size();
+    }
+
+    auto values = [](const timer_t& timer) {
+        return std::array<std::string, columns>{{timer.name, std::to_string(timer.count), duration_str(timer.latency(0.5), 4),
+                                                 duration_str(timer.latency(0.9), 4), duration_str(timer.latency(0.99), 4),
+                                                 duration_str(timer.latency_max, 4)}};
+    };
+
+    bool any = false;
+
+    for (decltype(auto) timer : timers) {
+        if (timer.has_latencies()) {
+            any = true;
+
+            auto row = values(timer);
+
+            for (size_t c = 0; c < columns; ++c) {
+                column_length[c] = std::max(column_length[c], row[c].size());
+            }
+        }
+    }
+
+    if (!any) {
+        return;
+    }
+
+    const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length, column_length + columns, 0);
+
+    auto print = [&](const std::array<std::string, columns>& row) {
+        printf(" |");
+
+        for (size_t c = 0; c < columns; ++c) {
+            printf(" %-*s |", int(column_length[c]), row[c].c_str());
+        }
+
+        printf("\n");
+    };
+
+    std::cout << '\n' << " " << std::string(line_length, '-') << '\n';
+    print(column_name);
+    std::cout << " " << std::string(line_length, '-') << '\n';
+
+    for (decltype(auto) timer : timers) {
+        if (timer.has_latencies()) {
+            print(values(timer));
         }
     }
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
 }
 
 /*!
  * \brief Dump all timers values to the console in the form of a nice table.
+ *
+ * With DLL_PERF_COUNTERS, the table also contains the instructions per
+ * cycle, the last level cache misses, the floating point operations and
+ * the number of bytes from memory (estimated from the cache misses) per
+ * floating point operation of each timer. The values not available on the
+ * machine are shown as "-".
+ *
+ * The percentiles of the timers selected with histogram_timers() are
+ * shown in a second table.
  */
 inline void dump_timers_pretty() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = merged_timers();
 
     if(timers.empty()){
         std::cout << "No timers have been recorded!" << std::endl;
@@ -260,14 +924,13 @@ inline void dump_timers_pretty() {
 
     std::cout << std::endl;
 
-    //Sort the timers by duration (DESC)
-    std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
-        return left.duration > right.duration;
-    });
-
-    double total_duration = timers.front().duration.load();
+    double total_duration = timers.front().duration;
 
+#ifdef DLL_PERF_COUNTERS
+    constexpr size_t columns = 9;
+#else
     constexpr size_t columns = 5;
+#endif
 
     std::string column_name[columns];
     column_name[0] = "%";
@@ -276,178 +939,253 @@ inline void dump_timers_pretty() {
     column_name[3] = "Total";
     column_name[4] = "Average";
 
+#ifdef DLL_PERF_COUNTERS
+    column_name[5] = "IPC";
+    column_name[6] = "LLC misses";
+    column_name[7] = "FLOPs";
+    column_name[8] = "Bytes/FLOP";
+#endif
+
     size_t column_length[columns];
     column_length[0] = 8;
-    column_length[1] = column_name[1].size();
-    column_length[2] = column_name[2].size();
-    column_length[3] = column_name[3].size();
-    column_length[4] = column_name[4].size();
+
+    for (size_t c = 1; c < columns; ++c) {
+        column_length[c] = column_name[c].size();
+    }
 
     // Compute the width of each column
     for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-
-            column_length[1] = std::max(column_length[1], std::string(timer.name).size());
-            column_length[2] = std::max(column_length[2], std::to_string(count).size());
-            column_length[3] = std::max(column_length[3], duration_str(duration).size());
-            column_length[4] = std::max(column_length[4], duration_str(duration / count).size());
+        size_t count = timer.count;
+        size_t duration = timer.duration;
+
+        column_length[1] = std::max(column_length[1], timer.name.size());
+        column_length[2] = std::max(column_length[2], std::to_string(count).size());
+        column_length[3] = std::max(column_length[3], duration_str(duration).size());
+        column_length[4] = std::max(column_length[4], duration_str(duration / count).size());
+
+#ifdef DLL_PERF_COUNTERS
+        auto perf = perf_columns(timer);
+
+        for (size_t c = 0; c < perf.size(); ++c) {
+            column_length[5 + c] = std::max(column_length[5 + c], perf[c].size());
         }
+#endif
     }
 
     const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length, column_length + columns, 0);
 
     std::cout << " " << std::string(line_length, '-') << '\n';
 
-    printf(" | %-*s | %-*s | %-*s | %-*s | %-*s |\n",
+    printf(" | %-*s | %-*s | %-*s | %-*s | %-*s |",
         int(column_length[0]), column_name[0].c_str(),
         int(column_length[1]), column_name[1].c_str(),
         int(column_length[2]), column_name[2].c_str(),
         int(column_length[3]), column_name[3].c_str(),
         int(column_length[4]), column_name[4].c_str());
 
+    for (size_t c = 5; c < columns; ++c) {
+        printf(" %-*s |", int(column_length[c]), column_name[c].c_str());
+    }
+
+    printf("\n");
+
     std::cout << " " << std::string(line_length, '-') << '\n';
 
     // Print all the used timers
     for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-
-            printf(" | %*.3f%% | %-*s | %-*s | %-*s | %-*s |\n",
-                int(column_length[0] - 1), 100.0 * (duration / double(total_duration)),
-                int(column_length[1]), timer.name,
-                int(column_length[2]), std::to_string(count).c_str(),
-                int(column_length[3]), duration_str(duration).c_str(),
-                int(column_length[4]), duration_str(duration / count).c_str());
+        size_t count = timer.count;
+        size_t duration = timer.duration;
+
+        printf(" | %*.3f%% | %-*s | %-*s | %-*s | %-*s |",
+            int(column_length[0] - 1), 100.0 * (duration / double(total_duration)),
+            int(column_length[1]), timer.name.c_str(),
+            int(column_length[2]), std::to_string(count).c_str(),
+            int(column_length[3]), duration_str(duration).c_str(),
+            int(column_length[4]), duration_str(duration / count).c_str());
+
+#ifdef DLL_PERF_COUNTERS
+        auto perf = perf_columns(timer);
+
+        for (size_t c = 0; c < perf.size(); ++c) {
+            printf(" %-*s |", int(column_length[5 + c]), perf[c].c_str());
         }
+#endif
+
+        printf("\n");
     }
 
     std::cout << " " << std::string(line_length, '-') << '\n';
+
+    dump_timers_latencies(timers);
 }
 
 /*!
- * \brief Automatic timer with RAII.
+ * \brief Dump the timers as a tree of nested scopes on the console, with
+ * the percentage of time from the enclosing scope.
  */
-struct auto_timer {
-    const char* name;                               ///< The name of the timer
-    std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
-    std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
+inline void dump_timers_tree() {
+    auto tree = merged_timer_tree();
 
-    /*!
-     * \brief Create an auto_timer witht the given name
-     * \param name The name of the timer
-     */
-    auto_timer(const char* name) : name(name) {
-        start = std::chrono::steady_clock::now();
+    if (tree.empty()) {
+        std::cout << "No timers have been recorded!" << std::endl;
+        return;
     }
 
-    /*!
-     * \brief Destructs the timer, effectively incrementing the timer.
-     */
-    ~auto_timer() {
-        end           = std::chrono::steady_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    // Print the children of the given scope, by duration (DESC)
+    auto print = [&tree](auto& self, size_t parent) -> void {
+        std::vector<size_t> children;
 
-        decltype(auto) timers = get_timers();
+        for (size_t i = 0; i < tree.size(); ++i) {
+            if (tree[i].parent == parent && tree[i].count) {
+                children.push_back(i);
+            }
+        }
 
-        // Try to increment without the lock
+        std::sort(children.begin(), children.end(), [&tree](size_t left, size_t right) {
+            return tree[left].duration > tree[right].duration;
+        });
 
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
+        for (auto i : children) {
+            auto& timer = tree[i];
 
-                return;
+            std::cout << std::string(2 * timer.depth, ' ') << timer.name << "(" << timer.count << ") : "
+                      << duration_str(timer.duration) << " (";
+
+            if (parent != no_timer && tree[parent].duration) {
+                std::cout << 100.0 * (timer.duration / double(tree[parent].duration)) << "%, ";
             }
+
+            std::cout << duration_str(timer.duration / timer.count) << ")" << std::endl;
+
+            self(self, i);
         }
+    };
 
-        {
-            std::lock_guard<std::mutex> lock(timers.lock);
+    print(print, no_timer);
+}
 
-            // Retry again to increment with lock
+/*!
+ * \brief Export the recorded trace events in the Chrome trace event format,
+ * which can be loaded in chrome://tracing or Perfetto.
+ *
+ * The trace events must have been enabled with trace_timers().
+ *
+ * \param path The path of the JSON file
+ * \return true if the file was written, false otherwise
+ */
+inline bool dump_timers_trace(const std::string& path) {
+    std::ofstream os(path);
 
-            for (decltype(auto) timer : timers.timers) {
-                if (timer.name == name) {
-                    timer.duration += duration;
-                    ++timer.count;
+    if (!os) {
+        std::cerr << "ERROR: Impossible to write the trace to " << path << std::endl;
+        return false;
+    }
 
-                    return;
-                }
-            }
+    decltype(auto) timers = get_timers();
+
+    std::lock_guard<std::mutex> l(timers.lock);
+
+    os << "{\"traceEvents\":[";
 
-            // At this point the timer does not exist, create it
+    bool first = true;
 
-            for (decltype(auto) timer : timers.timers) {
-                if (!timer.name) {
-                    timer.name     = name;
-                    timer.duration = duration;
-                    timer.count    = 1;
+    for (auto& local : timers.threads) {
+        std::lock_guard<std::mutex> el(local->events_lock);
 
-                    return;
+        for (auto& event : local->events) {
+            os << (first ? "\n" : ",\n") << "{\"name\":\"";
+
+            for (const char* c = event.name; *c; ++c) {
+                if (*c == '"' || *c == '\\') {
+                    os << '\\';
                 }
+
+                os << *c;
             }
-        }
 
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
+            os << "\",\"cat\":\"dll\",\"ph\":\"X\",\"pid\":0,\"tid\":" << local->id
+               << ",\"ts\":" << to_string_precision(event.start / 1000.0, 15)
+               << ",\"dur\":" << to_string_precision(event.duration / 1000.0, 15) << "}";
+
+            first = false;
+        }
     }
-};
+
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return true;
+}
 
 /*!
- * \brief Automatic timer with RAII, without synchronization.
+ * \brief Automatic timer with RAII.
+ *
+ * The timer is recorded in the counters of the current thread, as a child
+ * of the enclosing timer of the thread.
+ *
+ * With DLL_PERF_COUNTERS, the hardware counters of the thread during the
+ * scope are recorded as well.
  */
-struct unsafe_auto_timer {
-    const char* name;                                         ///< The name of the timer
+struct auto_timer {
+    thread_timers& local;                                     ///< The counters of the thread
+    size_t node;                                              ///< The scope of the timer
+    size_t previous;                                          ///< The enclosing scope
     std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
-    std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
+
+#ifdef DLL_PERF_COUNTERS
+    perf_sample counters; ///< The hardware counters at the start
+#endif
 
     /*!
-     * \brief Create an unsafe_auto_timer witht the given name
+     * \brief Create an auto_timer witht the given name
      * \param name The name of the timer
      */
-    unsafe_auto_timer(const char* name) : name(name) {
+    auto_timer(const char* name) : local(local_timers()), previous(local.current) {
+        node  = local.enter(name);
+
+#ifdef DLL_PERF_COUNTERS
+        counters = local.counters.read();
+#endif
+
         start = std::chrono::steady_clock::now();
     }
 
+    auto_timer(const auto_timer& rhs) = delete;
+    auto_timer& operator=(const auto_timer& rhs) = delete;
+
     /*!
      * \brief Destructs the timer, effectively incrementing the timer.
      */
-    ~unsafe_auto_timer() {
-        end           = std::chrono::steady_clock::now();
+    ~auto_timer() {
+        auto end      = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
-        decltype(auto) timers = get_timers();
-
-        // Increment the timer if it exists
+#ifdef DLL_PERF_COUNTERS
+        local.count(node, local.counters.read() - counters);
+#endif
 
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
+        local.leave(node, previous, duration);
 
-                return;
-            }
-        }
+        decltype(auto) timers = get_timers();
 
-        // At this point the timer does not exist, create it
+        if (timers.trace.load(std::memory_order_relaxed) && node != no_timer) {
+            size_t offset = std::chrono::duration_cast<std::chrono::nanoseconds>(start - timers.epoch).count();
 
-        for (decltype(auto) timer : timers.timers) {
-            if (!timer.name) {
-                timer.name     = name;
-                timer.duration = duration;
-                timer.count    = 1;
+            std::lock_guard<std::mutex> l(local.events_lock);
 
-                return;
+            if (local.events.size() < max_trace_events) {
+                local.events.push_back({local.nodes[node].name, offset, size_t(duration)});
             }
         }
-
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
     }
 };
 
+/*!
+ * \brief Automatic timer with RAII.
+ *
+ * Since the timers are thread-local, this is the same as auto_timer.
+ */
+using unsafe_auto_timer = auto_timer;
+
 #endif
 
 } //end of namespace dll
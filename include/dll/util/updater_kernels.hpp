@@ -0,0 +1,352 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused kernels for the updaters of the SGD trainer and for the
+ * updates of Contrastive Divergence.
+ *
+ * Each kernel reads the gradients, the parameters and the state of the
+ * updater once and writes the parameters and the state once. The weight
+ * decay and the gradient clipping are folded into the kernels.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "dll/decay_type.hpp"
+#include "dll/updater_type.hpp"
+#include "dll/util/cpu.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/reduction.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the given updater has a fused kernel
+ */
+constexpr bool is_fused_updater(updater_type t) {
+    return t == updater_type::RMSPROP || t == updater_type::ADADELTA || t == updater_type::ADAM || t == updater_type::ADAM_CORRECT
+           || t == updater_type::ADAMAX || t == updater_type::NADAM;
+}
+
+/*!
+ * \brief The maximum size of the tensors updated together by the
+ * multi-tensor kernel
+ */
+constexpr size_t fused_multi_tensor_max = 4096;
+
+/*!
+ * \brief The scalars of one step of an updater, computed once per
+ * variable.
+ */
+struct updater_step {
+    double eps     = 0.0;  ///< The learning rate
+    double scale   = 1.0;  ///< The scale of the gradients (gradient clipping)
+    double l1      = 0.0;  ///< The L1 weight cost
+    double l2      = 0.0;  ///< The L2 weight cost
+    double penalty = 0.0;  ///< The penalty subtracted from the gradients (sparsity of the RBMs)
+    double beta1   = 0.0;  ///< The decay of the first moment (or of the squared gradients, or the momentum)
+    double beta2   = 0.0;  ///< The decay of the second moment
+    double e       = 1e-8; ///< Epsilon for numerical stability
+    double c1      = 1.0;  ///< The bias correction of the first moment
+    double c2      = 1.0;  ///< The bias correction of the second moment
+    double m1      = 0.0;  ///< The factor of the gradients (NAdam)
+    double m2      = 0.0;  ///< The factor of the corrected first moment (NAdam)
+};
+
+/*!
+ * \brief A variable to update with a fused kernel
+ */
+template <typename T>
+struct fused_tensor {
+    T* w        = nullptr; ///< The parameters
+    const T* g  = nullptr; ///< The gradients
+    T* s0       = nullptr; ///< The first state of the updater
+    T* s1       = nullptr; ///< The second state of the updater
+    T* s2       = nullptr; ///< The third state of the updater
+    size_t size = 0;       ///< The number of parameters
+    updater_step step;     ///< The scalars of the step
+};
+
+namespace updater_detail {
+
+/*!
+ * \brief The number of parameters updated by one task
+ */
+constexpr size_t update_block = 16384;
+
+/*!
+ * \brief Returns the gradient i of the tensor, with the weight decay and
+ * the penalty applied, but not the clipping
+ */
+template <decay_type D, typename T>
+inline double decayed(const fused_tensor<T>& t, size_t i) {
+    double g = t.g[i] - t.step.penalty;
+
+    if constexpr (D == decay_type::L1 || D == decay_type::L1L2) {
+        g -= t.step.l1 * std::abs(t.w[i]);
+    }
+
+    if constexpr (D == decay_type::L2 || D == decay_type::L1L2) {
+        g -= t.step.l2 * t.w[i];
+    }
+
+    return g;
+}
+
+/*!
+ * \brief Update the parameters [first, last) of the tensor
+ */
+template <updater_type UT, decay_type D, typename T>
+DLL_KERNEL_CLONES void update_range(const fused_tensor<T>& t, size_t first, size_t last) {
+    const auto& s = t.step;
+
+    for (size_t i = first; i < last; ++i) {
+        const double g = s.scale * decayed<D>(t, i);
+
+        if constexpr (UT == updater_type::RMSPROP) {
+            const double inc = s.beta1 * t.s0[i] + (1.0 - s.beta1) * g * g;
+
+            t.s0[i] = inc;
+            t.w[i] += s.eps * g / std::sqrt(inc + s.e);
+        } else if constexpr (UT == updater_type::ADADELTA) {
+            const double acc_g = s.beta1 * t.s0[i] + (1.0 - s.beta1) * g * g;
+            const double v     = std::sqrt(t.s1[i] + s.e) * g / std::sqrt(acc_g + s.e);
+
+            t.s0[i] = acc_g;
+            t.s1[i] = s.beta1 * t.s1[i] + (1.0 - s.beta1) * v * v;
+            t.s2[i] = v;
+            t.w[i] += v;
+        } else if constexpr (UT == updater_type::ADAMAX) {
+            const double m = s.beta1 * t.s0[i] + (1.0 - s.beta1) * g;
+            const double v = std::max(s.beta2 * t.s1[i], std::abs(g));
+
+            t.s0[i] = m;
+            t.s1[i] = v;
+            t.w[i] += s.eps * m / (v + s.e);
+        } else {
+            const double m = s.beta1 * t.s0[i] + (1.0 - s.beta1) * g;
+            const double v = s.beta2 * t.s1[i] + (1.0 - s.beta2) * g * g;
+
+            t.s0[i] = m;
+            t.s1[i] = v;
+
+            if constexpr (UT == updater_type::NADAM) {
+                t.w[i] += (s.m1 * g + s.m2 * (m * s.c1)) / (std::sqrt(v * s.c2) + s.e);
+            } else {
+                // Adam, with the bias corrections (1.0 for the uncorrected Adam)
+                t.w[i] += s.eps * (m * s.c1) / (std::sqrt(v * s.c2) + s.e);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Update the parameters [first, last) of the tensor with the rule of
+ * Contrastive Divergence, the gradients being ascended.
+ *
+ * With momentum, the increments are kept in the first state of the tensor,
+ * inc = momentum * inc + eps * g and w += inc.
+ */
+template <bool M, decay_type D, typename T>
+DLL_KERNEL_CLONES void cd_update_range(const fused_tensor<T>& t, size_t first, size_t last) {
+    const auto& s = t.step;
+
+    for (size_t i = first; i < last; ++i) {
+        const double g = s.scale * decayed<D>(t, i);
+
+        if constexpr (M) {
+            const double inc = s.beta1 * t.s0[i] + s.eps * g;
+
+            t.s0[i] = inc;
+            t.w[i] += inc;
+        } else {
+            t.w[i] += s.eps * g;
+        }
+    }
+}
+
+/*!
+ * \brief Apply the functor to all the blocks of all the tensors, in one
+ * parallel launch.
+ *
+ * \param tensors The tensors
+ * \param functor The functor, called with the tensor and the range of the block
+ */
+template <typename T, typename Functor>
+void for_each_block(const std::vector<fused_tensor<T>>& tensors, Functor functor) {
+    struct block {
+        size_t tensor;
+        size_t first;
+        size_t last;
+    };
+
+    auto& blocks = kernel_scratch<block>(0);
+
+    for (size_t t = 0; t < tensors.size(); ++t) {
+        for (size_t first = 0; first < tensors[t].size; first += update_block) {
+            blocks.push_back({t, first, std::min(tensors[t].size, first + update_block)});
+        }
+    }
+
+    parallel_kernel(0, blocks.size(), [&](size_t b) {
+        functor(tensors[blocks[b].tensor], blocks[b].first, blocks[b].last);
+    });
+}
+
+/*!
+ * \brief Returns the sum of the squares of the gradients [first, last) of
+ * the tensor, with the weight decay applied
+ */
+template <decay_type D, typename T>
+inline double squared_sum(const fused_tensor<T>& t, size_t first, size_t last) {
+    double sum = 0.0;
+
+    for (size_t i = first; i < last; ++i) {
+        const double g = decayed<D>(t, i);
+        sum += g * g;
+    }
+
+    return sum;
+}
+
+} //end of namespace updater_detail
+
+/*!
+ * \brief Compute the scale of gradients with gradient clipping, from the
+ * sum of their squares.
+ *
+ * \param sum The sum of the squares of the gradients
+ * \param n The number of samples of the batch
+ * \param threshold The maximum L2 norm of the gradients
+ */
+inline double clip_scale(double sum, size_t n, double threshold) {
+    const double norm = std::sqrt(sum / (double(n) * n));
+
+    return norm > threshold ? threshold / norm : 1.0;
+}
+
+/*!
+ * \brief Compute the scale of the gradients of the tensor with gradient
+ * clipping.
+ *
+ * \param t The tensor
+ * \param n The number of samples of the batch
+ * \param threshold The maximum L2 norm of the gradients
+ */
+template <decay_type D, typename T>
+double clip_scale(const fused_tensor<T>& t, size_t n, double threshold) {
+    const size_t tasks = (t.size + updater_detail::update_block - 1) / updater_detail::update_block;
+
+    auto& partials = kernel_scratch<double>(tasks);
+
+    parallel_kernel(0, tasks, [&](size_t task) {
+        const size_t first = task * updater_detail::update_block;
+        const size_t last  = std::min(t.size, first + updater_detail::update_block);
+
+        partials[task] = updater_detail::squared_sum<D>(t, first, last);
+    });
+
+    return clip_scale(tree_sum(partials), n, threshold);
+}
+
+/*!
+ * \brief Compute the sum of the squares of the gradients of several
+ * tensors in one parallel reduction.
+ *
+ * The weight decay of each tensor is given by its L1 and L2 costs, a
+ * tensor whose gradients are not decayed has zero costs.
+ *
+ * \param tensors The tensors
+ */
+template <typename T>
+double squared_sum(const std::vector<fused_tensor<T>>& tensors) {
+    auto& blocks = kernel_scratch<std::pair<size_t, size_t>>(0);
+
+    for (size_t t = 0; t < tensors.size(); ++t) {
+        for (size_t first = 0; first < tensors[t].size; first += updater_detail::update_block) {
+            blocks.emplace_back(t, first);
+        }
+    }
+
+    auto& partials = kernel_scratch<double>(blocks.size());
+
+    parallel_kernel(0, blocks.size(), [&](size_t b) {
+        const auto& t      = tensors[blocks[b].first];
+        const size_t first = blocks[b].second;
+
+        partials[b] = updater_detail::squared_sum<decay_type::L1L2>(t, first, std::min(t.size, first + updater_detail::update_block));
+    });
+
+    return tree_sum(partials);
+}
+
+/*!
+ * \brief Update a tensor in one pass
+ */
+template <updater_type UT, decay_type D, typename T>
+void fused_update(const fused_tensor<T>& t) {
+    const size_t tasks = (t.size + updater_detail::update_block - 1) / updater_detail::update_block;
+
+    parallel_kernel(0, tasks, [&](size_t task) {
+        const size_t first = task * updater_detail::update_block;
+
+        updater_detail::update_range<UT, D>(t, first, std::min(t.size, first + updater_detail::update_block));
+    });
+}
+
+/*!
+ * \brief Update several (small) tensors in one parallel launch.
+ *
+ * The tensors are split in blocks, all the blocks of all the tensors are
+ * distributed together on the threads.
+ */
+template <updater_type UT, decay_type D, typename T>
+void fused_update(const std::vector<fused_tensor<T>>& tensors) {
+    updater_detail::for_each_block(tensors, [](const fused_tensor<T>& t, size_t first, size_t last) {
+        updater_detail::update_range<UT, D>(t, first, last);
+    });
+}
+
+/*!
+ * \brief Update a tensor of an RBM with the rule of Contrastive Divergence
+ * (decay, penalty, clipping, momentum and learning rate) in one pass
+ *
+ * \tparam M Indicates if the first state of the tensor is the momentum increments
+ * \tparam D The decay applied to the gradients
+ */
+template <bool M, decay_type D, typename T>
+void cd_fused_update(const fused_tensor<T>& t) {
+    const size_t tasks = (t.size + updater_detail::update_block - 1) / updater_detail::update_block;
+
+    parallel_kernel(0, tasks, [&](size_t task) {
+        const size_t first = task * updater_detail::update_block;
+
+        updater_detail::cd_update_range<M, D>(t, first, std::min(t.size, first + updater_detail::update_block));
+    });
+}
+
+/*!
+ * \brief Update several (small) tensors of an RBM with the rule of
+ * Contrastive Divergence, in one parallel launch.
+ *
+ * \tparam M Indicates if the first states of the tensors are the momentum increments
+ * \tparam D The decay applied to the gradients
+ */
+template <bool M, decay_type D, typename T>
+void cd_fused_update(const std::vector<fused_tensor<T>>& tensors) {
+    updater_detail::for_each_block(tensors, [](const fused_tensor<T>& t, size_t first, size_t last) {
+        updater_detail::cd_update_range<M, D>(t, first, last);
+    });
+}
+
+} //end of dll namespace
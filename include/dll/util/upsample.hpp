@@ -0,0 +1,127 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Direct kernels for the nearest upsampling of feature maps
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "dll/util/cpu.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace upsample_detail {
+
+/*!
+ * \brief Upsample one plane [I2 x I3] into [I2 * C2 x I3 * C3]
+ */
+template <size_t C2, size_t C3, typename T>
+DLL_KERNEL_CLONES void upsample_plane_forward(T* output, const T* input, size_t I2, size_t I3) {
+    const size_t O3 = I3 * C3;
+
+    for (size_t i = 0; i < I2; ++i) {
+        const T* in = input + i * I3;
+        T* out      = output + i * C2 * O3;
+
+        for (size_t j = 0; j < I3; ++j) {
+            for (size_t c = 0; c < C3; ++c) {
+                out[j * C3 + c] = in[j];
+            }
+        }
+
+        for (size_t r = 1; r < C2; ++r) {
+            std::copy(out, out + O3, out + r * O3);
+        }
+    }
+}
+
+/*!
+ * \brief Sum the errors of the C2 x C3 blocks of one plane of errors
+ * [I2 * C2 x I3 * C3] into [I2 x I3]
+ */
+template <size_t C2, size_t C3, typename T>
+DLL_KERNEL_CLONES void upsample_plane_backward(T* output, const T* errors, size_t I2, size_t I3) {
+    const size_t O3 = I3 * C3;
+
+    for (size_t i = 0; i < I2; ++i) {
+        T* out = output + i * I3;
+
+        std::fill_n(out, I3, T(0));
+
+        for (size_t r = 0; r < C2; ++r) {
+            const T* err = errors + (i * C2 + r) * O3;
+
+            for (size_t j = 0; j < I3; ++j) {
+                T s(0);
+
+                for (size_t c = 0; c < C3; ++c) {
+                    s += err[j * C3 + c];
+                }
+
+                out[j] += s;
+            }
+        }
+    }
+}
+
+} //end of namespace upsample_detail
+
+/*!
+ * \brief Indicates if the direct kernels can be used for the given runtime
+ * upsampling ratios.
+ */
+inline bool upsample_kernel_supported(size_t c1, size_t c2, size_t c3) {
+    return c1 == 1 && c2 == c3 && (c2 == 2 || c2 == 4);
+}
+
+/*!
+ * \brief Upsample each plane of the input by replicating each value into a
+ * C2 x C3 block of the output.
+ *
+ * Each output row is built once from the input row and then copied to the
+ * C2 - 1 following rows.
+ *
+ * \param output The output [planes x I2 * C2 x I3 * C3]
+ * \param input The input [planes x I2 x I3]
+ * \param planes The number of planes (samples times channels)
+ * \param I2 The number of rows of a plane of the input
+ * \param I3 The number of columns of a plane of the input
+ */
+template <size_t C2, size_t C3, typename T>
+void upsample_2d_forward(T* output, const T* input, size_t planes, size_t I2, size_t I3) {
+    const size_t plane = I2 * I3;
+
+    parallel_kernel(0, planes, [=](size_t p) {
+        upsample_detail::upsample_plane_forward<C2, C3>(output + p * plane * C2 * C3, input + p * plane, I2, I3);
+    });
+}
+
+/*!
+ * \brief Compute the errors of the input of an upsampling: each value is
+ * the sum of the errors of its C2 x C3 block of the output.
+ *
+ * \param output The errors of the input [planes x I2 x I3]
+ * \param errors The errors of the output [planes x I2 * C2 x I3 * C3]
+ * \param planes The number of planes (samples times channels)
+ * \param I2 The number of rows of a plane of the input
+ * \param I3 The number of columns of a plane of the input
+ */
+template <size_t C2, size_t C3, typename T>
+void upsample_2d_backward(T* output, const T* errors, size_t planes, size_t I2, size_t I3) {
+    const size_t plane = I2 * I3;
+
+    parallel_kernel(0, planes, [=](size_t p) {
+        upsample_detail::upsample_plane_backward<C2, C3>(output + p * plane, errors + p * plane * C2 * C3, I2, I3);
+    });
+}
+
+} //end of dll namespace
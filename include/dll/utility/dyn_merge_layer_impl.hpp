@@ -9,6 +9,8 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/batch_merge.hpp"
+#include "dll/util/parallel.hpp"
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -127,6 +129,24 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
         return output;
     }
 
+    /*!
+     * \brief Return the offsets of the outputs of the layers in the merged
+     * output, at the merge dimension
+     */
+    std::array<size_t, n_layers> branch_offsets() const {
+        std::array<size_t, n_layers> offsets;
+
+        size_t i      = 0;
+        size_t offset = 0;
+
+        cpp::for_each(layers, [&](auto& layer) {
+            offsets[i++] = offset;
+            offset += etl::dim<D>(layer.template prepare_one_output<input_one_t>());
+        });
+
+        return offsets;
+    }
+
     using base_type::forward_batch;
     using base_type::train_forward_batch;
     using base_type::test_forward_batch;
@@ -139,10 +159,16 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void test_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.test_forward_batch(input);
+        // The branches are independent, each is forwarded on its own thread
+        // and copied directly to its own slice of the output
+        const auto offsets = branch_offsets();
+
+        dll::parallel_static_for<n_layers>([this, &input, &output, &offsets](auto i) {
+            SERIAL_SECTION {
+                auto sub_output = std::get<decltype(i)::value>(layers).test_forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+                dll::batch_merge_at<D + 1>(output, sub_output, offsets[decltype(i)::value]);
+            }
         });
     }
 
@@ -154,10 +180,16 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void train_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.train_forward_batch(input);
+        // The branches are independent, each is forwarded on its own thread
+        // and copied directly to its own slice of the output
+        const auto offsets = branch_offsets();
+
+        dll::parallel_static_for<n_layers>([this, &input, &output, &offsets](auto i) {
+            SERIAL_SECTION {
+                auto sub_output = std::get<decltype(i)::value>(layers).train_forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+                dll::batch_merge_at<D + 1>(output, sub_output, offsets[decltype(i)::value]);
+            }
         });
     }
 
@@ -169,10 +201,16 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.forward_batch(input);
+        // The branches are independent, each is forwarded on its own thread
+        // and copied directly to its own slice of the output
+        const auto offsets = branch_offsets();
+
+        dll::parallel_static_for<n_layers>([this, &input, &output, &offsets](auto i) {
+            SERIAL_SECTION {
+                auto sub_output = std::get<decltype(i)::value>(layers).forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+                dll::batch_merge_at<D + 1>(output, sub_output, offsets[decltype(i)::value]);
+            }
         });
     }
 
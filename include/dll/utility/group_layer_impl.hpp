@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/dbn_detail.hpp" // For the fusion rules
 
 #include "dll/util/timers.hpp" // for auto_timer
 
@@ -102,12 +103,46 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
     using base_type::train_forward_batch;
     using base_type::test_forward_batch;
 
+    /*!
+     * \brief Indicates if the Lth layer can be fused with the following layer
+     * for inference
+     */
+    template <size_t L, typename Enable = void>
+    struct fuse_next : std::false_type {};
+
+    template <size_t L>
+    struct fuse_next<L, std::enable_if_t<(L + 1 < n_layers)>> : dbn_detail::is_fusable_pair<layer_type<L>, layer_type<L + 1>> {};
+
+    /*!
+     * \brief Forward the input through the layers from L, for inference.
+     *
+     * The same rules as the network are applied to the sub-layers: fusable
+     * pairs are computed at once, the identity layers are skipped and the
+     * in-place layers overwrite the intermediate buffers instead of
+     * allocating new ones.
+     */
     template <size_t L, typename H1, typename V>
-    void test_forward_batch_sub(H1&& output, const V& input) const {
-        if constexpr (L != n_layers - 1) {
+    void test_forward_batch_sub(H1&& output, V&& input) const {
+        constexpr size_t last = n_layers - 1;
+
+        if constexpr (L < last && fuse_next<L>::value) {
+            auto next_input = std::get<L>(layers).test_forward_batch_fused(std::get<L + 1>(layers), input);
+
+            if constexpr (L + 1 == last) {
+                output = next_input;
+            } else {
+                test_forward_batch_sub<L + 2>(output, std::move(next_input));
+            }
+        } else if constexpr (L < last && dbn_detail::is_inference_identity<layer_type<L>>::value) {
+            test_forward_batch_sub<L + 1>(output, std::forward<V>(input));
+        } else if constexpr (L < last && dbn_detail::is_inplace_layer<layer_type<L>>::value && !std::is_reference<V>::value) {
+            std::get<L>(layers).test_forward_batch(input, input);
+
+            test_forward_batch_sub<L + 1>(output, std::move(input));
+        } else if constexpr (L < last) {
             auto next_input = std::get<L>(layers).test_forward_batch(input);
 
-            test_forward_batch_sub<L + 1>(output, next_input);
+            test_forward_batch_sub<L + 1>(output, std::move(next_input));
         } else {
             std::get<L>(layers).test_forward_batch(output, input);
         }
@@ -124,12 +159,22 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
         test_forward_batch_sub<0>(output, input);
     }
 
+    /*!
+     * \brief Forward the input through the layers from L, for training.
+     *
+     * Only the in-place layers are applied on the intermediate buffers, the
+     * other layers must keep their own outputs.
+     */
     template <size_t L, typename H1, typename V>
-    void train_forward_batch_sub(H1&& output, const V& input) const {
-        if constexpr (L != n_layers - 1) {
+    void train_forward_batch_sub(H1&& output, V&& input) const {
+        if constexpr (L != n_layers - 1 && dbn_detail::is_inplace_layer<layer_type<L>>::value && !std::is_reference<V>::value) {
+            std::get<L>(layers).train_forward_batch(input, input);
+
+            train_forward_batch_sub<L + 1>(output, std::move(input));
+        } else if constexpr (L != n_layers - 1) {
             auto next_input = std::get<L>(layers).train_forward_batch(input);
 
-            train_forward_batch_sub<L + 1>(output, next_input);
+            train_forward_batch_sub<L + 1>(output, std::move(next_input));
         } else {
             std::get<L>(layers).train_forward_batch(output, input);
         }
@@ -146,17 +191,6 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
         train_forward_batch_sub<0>(output, input);
     }
 
-    template <size_t L, typename H1, typename V>
-    void forward_batch_sub(H1&& output, const V& input) const {
-        if constexpr (L != n_layers - 1) {
-            auto next_input = std::get<L>(layers).forward_batch(input);
-
-            forward_batch_sub<L + 1>(output, next_input);
-        } else {
-            std::get<L>(layers).forward_batch(output, input);
-        }
-    }
-
     /*!
      * \brief Apply the layer to the given batch of input.
      *
@@ -165,7 +199,7 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& input) const {
-        forward_batch_sub<0>(output, input);
+        test_forward_batch_sub<0>(output, input);
     }
 
     /*!
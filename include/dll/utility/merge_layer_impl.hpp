@@ -9,6 +9,8 @@
 
 #include "dll/neural_layer.hpp"
 
+#include "dll/util/batch_merge.hpp"
+#include "dll/util/parallel.hpp"
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -128,6 +130,20 @@ struct merge_layer_impl <merge_layer_desc<D, Layers...>> final : layer<merge_lay
         return output;
     }
 
+    /*!
+     * \brief Return the offset of the output of the Lth layer in the merged
+     * output, at the merge dimension
+     * \tparam L The layer index
+     */
+    template <size_t L>
+    static constexpr size_t branch_offset() noexcept {
+        if constexpr (L == 0) {
+            return 0;
+        } else {
+            return branch_offset<L - 1>() + etl::decay_traits<typename layer_type<L - 1>::output_one_t>::template dim<D>();
+        }
+    }
+
     using base_type::forward_batch;
     using base_type::train_forward_batch;
     using base_type::test_forward_batch;
@@ -140,10 +156,14 @@ struct merge_layer_impl <merge_layer_desc<D, Layers...>> final : layer<merge_lay
      */
     template <typename H1, typename V>
     void test_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.test_forward_batch(input);
+        // The branches are independent, each is forwarded on its own thread
+        // and copied directly to its own slice of the output
+        dll::parallel_static_for<n_layers>([this, &input, &output](auto i) {
+            SERIAL_SECTION {
+                auto sub_output = std::get<decltype(i)::value>(layers).test_forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+                dll::batch_merge_at<D + 1>(output, sub_output, branch_offset<decltype(i)::value>());
+            }
         });
     }
 
@@ -155,10 +175,14 @@ struct merge_layer_impl <merge_layer_desc<D, Layers...>> final : layer<merge_lay
      */
     template <typename H1, typename V>
     void train_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.train_forward_batch(input);
+        // The branches are independent, each is forwarded on its own thread
+        // and copied directly to its own slice of the output
+        dll::parallel_static_for<n_layers>([this, &input, &output](auto i) {
+            SERIAL_SECTION {
+                auto sub_output = std::get<decltype(i)::value>(layers).train_forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+                dll::batch_merge_at<D + 1>(output, sub_output, branch_offset<decltype(i)::value>());
+            }
         });
     }
 
@@ -170,10 +194,14 @@ struct merge_layer_impl <merge_layer_desc<D, Layers...>> final : layer<merge_lay
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.forward_batch(input);
+        // The branches are independent, each is forwarded on its own thread
+        // and copied directly to its own slice of the output
+        dll::parallel_static_for<n_layers>([this, &input, &output](auto i) {
+            SERIAL_SECTION {
+                auto sub_output = std::get<decltype(i)::value>(layers).forward_batch(input);
 
-            etl::batch_merge(output, sub_output, i);
+                dll::batch_merge_at<D + 1>(output, sub_output, branch_offset<decltype(i)::value>());
+            }
         });
     }
 
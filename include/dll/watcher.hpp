@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <fstream>
 #include <cstring>
 
@@ -15,6 +16,9 @@
 #include "cpp_utils/stop_watch.hpp"
 
 #include "trainer/rbm_training_context.hpp"
+#include "trainer/layer_profile.hpp"
+#include "util/memory.hpp"
+#include "util/async_logger.hpp"
 #include "layer_traits.hpp"
 #include "dbn_traits.hpp"
 
@@ -131,6 +135,124 @@ struct default_rbm_watcher {
     }
 };
 
+/*!
+ * \brief The configuration of the rate-limited watchers
+ * \tparam I The minimum interval between two batch lines, in milliseconds
+ */
+template <size_t I = 1000>
+struct rate_limit_config {
+    static constexpr size_t interval_ms = I; ///< The minimum interval between two batch lines, in milliseconds
+};
+
+/*!
+ * \brief A watcher for RBM pretraining that aggregates the statistics of
+ * the batches and writes them at most once per interval, from a background
+ * logging thread.
+ *
+ * \tparam R The RBM type
+ * \tparam C The configuration (rate_limit_config)
+ */
+template <typename R, typename C = rate_limit_config<>>
+struct rate_limited_rbm_watcher : default_rbm_watcher<R> {
+    using clock = std::chrono::steady_clock; ///< The clock of the interval
+
+    static constexpr auto interval = std::chrono::milliseconds(C::interval_ms); ///< The minimum interval between two batch lines
+
+    async_logger logger; ///< The logger of the batches and the epochs
+
+    /*!
+     * \brief Indicates that the training of the given RBM started.
+     * \param rbm The rbm that started training.
+     */
+    template <typename RBM = R>
+    void training_begin(const RBM& rbm) {
+        default_rbm_watcher<R>::training_begin(rbm);
+
+        reset(clock::now());
+    }
+
+    /*!
+     * \brief Indicates the end of an epoch of pretraining.
+     * \param epoch The epoch that just finished training
+     * \param context The RBM's training context
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        char formatted[1024];
+        if (rbm_layer_traits<RBM>::free_energy()) {
+            snprintf(formatted, 1024, "epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f", epoch,
+                     context.reconstruction_error, context.free_energy, context.sparsity);
+        } else {
+            snprintf(formatted, 1024, "epoch %ld - Reconstruction error: %.5f - Sparsity: %.5f", epoch, context.reconstruction_error, context.sparsity);
+        }
+
+        logger.log(formatted);
+
+        reset(clock::now());
+
+        cpp_unused(rbm);
+    }
+
+    /*!
+     * \brief Indicates the end of a batch of pretraining.
+     * \param batch The batch that just finished training
+     * \param batches The total number of batches
+     * \param context The RBM's training context
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
+        ++count;
+        error += context.batch_error;
+        sparsity += context.batch_sparsity;
+
+        auto now = clock::now();
+
+        // The batches of the RBM trainer are counted from one
+        if (now - last >= interval || batch >= batches) {
+            const double duration = std::chrono::duration<double, std::milli>(now - last).count();
+
+            char formatted[1024];
+            snprintf(formatted, 1024, "Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f (%ld batches, %.2fms/batch)",
+                batch, batches, error / count, sparsity / count, count, duration / count);
+
+            logger.log(formatted);
+
+            reset(now);
+        }
+
+        cpp_unused(rbm);
+    }
+
+    /*!
+     * \brief Indicates the end of pretraining.
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void training_end(const RBM& rbm) {
+        logger.flush();
+
+        default_rbm_watcher<R>::training_end(rbm);
+    }
+
+private:
+    /*!
+     * \brief Start a new interval
+     */
+    void reset(clock::time_point now) {
+        last     = now;
+        count    = 0;
+        error    = 0.0;
+        sparsity = 0.0;
+    }
+
+    clock::time_point last; ///< The start of the current interval
+    size_t count    = 0;    ///< The number of batches of the current interval
+    double error    = 0.0;  ///< The sum of the batch errors of the current interval
+    double sparsity = 0.0;  ///< The sum of the batch sparsities of the current interval
+};
+
 /*!
  * \brief The default watcher for DBN training/pretraining
  */
@@ -411,6 +533,305 @@ struct silent_dbn_watcher : default_dbn_watcher<DBN> {
     static constexpr bool replace_sub = false; ///< For pretraining of a DBN, indicates if the DBN watcher should replace (true) the RBM watcher or not (false)
 };
 
+/*!
+ * \brief A DBN watcher that aggregates the statistics of the fine-tuning
+ * batches and writes them at most once per interval.
+ *
+ * The lines are written by a background logging thread, the training
+ * thread never formats the stream nor flushes it. Each batch line reports
+ * the mean error and loss of the batches since the previous line and their
+ * mean duration.
+ *
+ * \tparam DBN The network type
+ * \tparam C The configuration (rate_limit_config)
+ */
+template <typename DBN, typename C = rate_limit_config<>>
+struct rate_limited_dbn_watcher : default_dbn_watcher<DBN> {
+    using base_type = default_dbn_watcher<DBN>; ///< The base watcher
+    using clock     = std::chrono::steady_clock; ///< The clock of the interval
+
+    static constexpr auto interval = std::chrono::milliseconds(C::interval_ms); ///< The minimum interval between two batch lines
+
+    async_logger logger; ///< The logger of the batches and the epochs
+
+    /*!
+     * \brief One fine-tuning epoch is starting
+     * \param epoch The current epoch
+     * \param dbn The network being trained
+     */
+    void ft_epoch_start(size_t epoch, const DBN& dbn) {
+        base_type::ft_epoch_start(epoch, dbn);
+
+        reset(clock::now());
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is over
+     * \param epoch The current epoch
+     * \param error The current error
+     * \param loss The current loss
+     * \param dbn The network being trained
+     */
+    void ft_epoch_end(size_t epoch, double error, double loss, const DBN& dbn) {
+        cpp_unused(dbn);
+
+        auto duration = this->ft_epoch_timer.stop();
+
+        char buffer[512];
+
+        if (dbn_traits<DBN>::error_on_epoch()){
+            snprintf(buffer, 512, "epoch %3ld/%ld - error: %.5f loss: %.5f time %ldms",
+                epoch, this->ft_max_epochs, error, loss, duration);
+        } else {
+            snprintf(buffer, 512, "epoch %3ld/%ld - loss: %.5f time %ldms",
+                epoch, this->ft_max_epochs, loss, duration);
+        }
+
+        logger.log(buffer);
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is over
+     * \param epoch The current epoch
+     * \param train_error The current error
+     * \param train_loss The current loss
+     * \param val_error The current validation error
+     * \param val_loss The current validation loss
+     * \param dbn The network being trained
+     */
+    void ft_epoch_end(size_t epoch, double train_error, double train_loss, double val_error, double val_loss, const DBN& dbn) {
+        cpp_unused(dbn);
+
+        auto duration = this->ft_epoch_timer.stop();
+
+        char buffer[512];
+
+        if constexpr (dbn_traits<DBN>::error_on_epoch()){
+            snprintf(buffer, 512, "epoch %3ld/%ld - error: %.5f loss: %.5f val_error: %.5f val_loss: %.5f time %ldms",
+                epoch, this->ft_max_epochs, train_error, train_loss, val_error, val_loss, duration);
+        } else {
+            snprintf(buffer, 512, "epoch %3ld/%ld - loss: %.5f val_loss: %.5f time %ldms",
+                epoch, this->ft_max_epochs, train_loss, val_loss, duration);
+        }
+
+        logger.log(buffer);
+    }
+
+    /*!
+     * \brief Indicates the beginning of a fine-tuning batch, the batches
+     * are not timed one by one
+     * \param epoch The current epoch
+     * \param dbn The DBN being trained
+     */
+    void ft_batch_start(size_t epoch, const DBN& dbn) {
+        cpp_unused(epoch);
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief Indicates the end of a fine-tuning batch
+     * \param epoch The current epoch
+     * \param batch The current batch
+     * \param batches THe total number of batches
+     * \param batch_error The batch error
+     * \param batch_loss The batch loss
+     * \param dbn The DBN being trained
+     */
+    void ft_batch_end(size_t epoch, size_t batch, size_t batches, double batch_error, double batch_loss, const DBN& dbn) {
+        ++count;
+        error += batch_error;
+        loss += batch_loss;
+
+        auto now = clock::now();
+
+        if (now - last >= interval || batch + 1 == batches) {
+            const double duration = std::chrono::duration<double, std::milli>(now - last).count();
+
+            char buffer[512];
+            snprintf(buffer, 512, "epoch %3ld/%ld batch %4ld/%4ld - error: %.5f loss: %.5f (%ld batches, %.2fms/batch)",
+                epoch, this->ft_max_epochs, batch + 1, batches, error / count, loss / count, count, duration / count);
+
+            logger.log(buffer);
+
+            reset(now);
+        }
+
+        this->max_batches = batches;
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief Fine-tuning of the given network just finished
+     * \param dbn The DBN that is being trained
+     */
+    void fine_tuning_end(const DBN& dbn) {
+        logger.flush();
+
+        base_type::fine_tuning_end(dbn);
+    }
+
+private:
+    /*!
+     * \brief Start a new interval
+     */
+    void reset(clock::time_point now) {
+        last  = now;
+        count = 0;
+        error = 0.0;
+        loss  = 0.0;
+    }
+
+    clock::time_point last; ///< The start of the current interval
+    size_t count = 0;       ///< The number of batches of the current interval
+    double error = 0.0;     ///< The sum of the batch errors of the current interval
+    double loss  = 0.0;     ///< The sum of the batch losses of the current interval
+};
+
+/*!
+ * \brief A DBN watcher that profiles each layer during fine-tuning.
+ *
+ * At the end of each epoch, one JSON line per layer is written to the
+ * profile file (dll_profile.jsonl by default), with the time spent in
+ * forward propagation, backward propagation and gradients, the achieved
+ * GFLOP/s against the theoretical FLOP count of the layer, the number of
+ * bytes moved and the throughput in samples per second.
+ *
+ * With pipeline-parallel SGD, one more JSON line per stage gives its
+ * layers, the time spent in each pass, the time spent waiting for the
+ * other stages and the resulting bubble, against the ideal bubble of the
+ * GPipe schedule, (S - 1) / (M + S - 1).
+ *
+ * Only the SGD trainer is supported, without data-parallel shards.
+ */
+template <typename DBN>
+struct profile_dbn_watcher : default_dbn_watcher<DBN> {
+    static constexpr bool profile_layers = true; ///< Indicates that the layers must be profiled
+
+    std::string profile_file = "dll_profile.jsonl"; ///< The file the profile is appended to
+
+    /*!
+     * \brief The profile of a fine-tuning epoch is available
+     * \param epoch The current epoch
+     * \param profile The profile of the epoch
+     * \param dbn The network being trained
+     */
+    void ft_epoch_profile(size_t epoch, const network_profile& profile, const DBN& dbn) {
+        cpp_unused(dbn);
+
+        std::ofstream os(profile_file, std::ios::app);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to write the profile to " << profile_file << std::endl;
+            return;
+        }
+
+        // FLOP per nanosecond are GFLOP/s
+        auto gflops = [&profile](size_t flops, size_t duration) {
+            return duration ? double(flops) * profile.samples / duration : 0.0;
+        };
+
+        char buffer[1024];
+
+        for (size_t i = 0; i < profile.layers.size(); ++i) {
+            auto& layer = profile.layers[i];
+
+            const size_t total = layer.forward + layer.backward + layer.gradients;
+
+            // The parameters are read once per batch in each pass
+            const size_t bytes = layer.bytes * profile.samples + 3 * layer.parameters * sizeof(typename DBN::weight) * profile.batches;
+
+            snprintf(buffer, 1024,
+                "{\"epoch\":%lu,\"layer\":%lu,\"name\":\"%s\",\"samples\":%lu,\"batches\":%lu,"
+                "\"forward_ns\":%lu,\"backward_ns\":%lu,\"gradients_ns\":%lu,"
+                "\"flops\":%lu,\"forward_gflops\":%.3f,\"backward_gflops\":%.3f,\"gradients_gflops\":%.3f,"
+                "\"bytes\":%lu,\"samples_per_second\":%.1f}",
+                epoch, i, layer.name.c_str(), profile.samples, profile.batches,
+                layer.forward, layer.backward, layer.gradients,
+                layer.flops, gflops(layer.flops, layer.forward), gflops(layer.flops, layer.backward), gflops(layer.flops, layer.gradients),
+                bytes, total ? profile.samples * 1e9 / total : 0.0);
+
+            os << buffer << '\n';
+        }
+
+        const size_t stages = profile.stages.size();
+
+        for (size_t s = 0; s < stages; ++s) {
+            auto& stage = profile.stages[s];
+
+            const size_t total = stage.forward + stage.backward + stage.gradients + stage.idle;
+
+            snprintf(buffer, 1024,
+                "{\"epoch\":%lu,\"stage\":%lu,\"first_layer\":%lu,\"last_layer\":%lu,\"micro_batches\":%lu,"
+                "\"forward_ns\":%lu,\"backward_ns\":%lu,\"gradients_ns\":%lu,\"idle_ns\":%lu,"
+                "\"bubble\":%.3f,\"ideal_bubble\":%.3f}",
+                epoch, s, stage.first, stage.last - 1, profile.micro_batches,
+                stage.forward, stage.backward, stage.gradients, stage.idle,
+                total ? double(stage.idle) / total : 0.0, double(stages - 1) / (profile.micro_batches + stages - 1));
+
+            os << buffer << '\n';
+        }
+    }
+};
+
+/*!
+ * \brief Traits to test if a watcher profiles the layers
+ */
+template <typename W, typename Enable = void>
+struct is_profile_watcher : std::false_type {};
+
+/*!
+ * \copydoc is_profile_watcher
+ */
+template <typename W>
+struct is_profile_watcher<W, std::void_t<decltype(W::profile_layers)>> : std::integral_constant<bool, W::profile_layers> {};
+
+/*!
+ * \brief A DBN watcher that reports the memory usage of the training.
+ *
+ * The live and peak bytes of each category of tracked memory (weights,
+ * training contexts, RBM trainers and data generators) are displayed after
+ * each fine-tuning epoch and after the pretraining of each layer.
+ */
+template <typename DBN>
+struct memory_dbn_watcher : default_dbn_watcher<DBN> {
+    static constexpr bool watch_memory = true; ///< Indicates that the memory must be reported
+
+    /*!
+     * \brief One fine-tuning epoch is over, report the memory
+     * \param epoch The current epoch
+     * \param dbn The network being trained
+     */
+    void ft_epoch_memory(size_t epoch, const DBN& dbn) {
+        cpp_unused(dbn);
+
+        std::cout << "epoch " << epoch << " memory - " << memory_summary() << std::endl;
+    }
+
+    /*!
+     * \brief The pretraining of a layer is over, report the memory
+     * \param dbn The network being pretrained
+     * \param I The index of the pretrained layer
+     */
+    void pretraining_memory(const DBN& dbn, size_t I) {
+        cpp_unused(dbn);
+
+        std::cout << "DBN: Layer " << I << " memory - " << memory_summary() << std::endl;
+    }
+};
+
+/*!
+ * \brief Traits to test if a watcher reports the memory
+ */
+template <typename W, typename Enable = void>
+struct is_memory_watcher : std::false_type {};
+
+/*!
+ * \copydoc is_memory_watcher
+ */
+template <typename W>
+struct is_memory_watcher<W, std::void_t<decltype(W::watch_memory)>> : std::integral_constant<bool, W::watch_memory> {};
+
 template <typename DBN>
 struct mute_dbn_watcher {
     static constexpr bool ignore_sub  = true; ///< For pretraining of a DBN, indicates if the regular RBM watcher should be used (false) or ignored (true)
@@ -0,0 +1,15 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// The prebuilt library of the common layers and trainers (see
+// dll/extern.hpp)
+
+#define DLL_EXTERN_IMPL
+
+#include "dll/extern.hpp"
+
+DLL_EXTERN_TYPES(DLL_EXTERN_DEFINE)
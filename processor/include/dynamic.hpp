@@ -0,0 +1,44 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Dynamic backend of the processor.
+ *
+ * The network of the configuration is built at runtime from the dynamic
+ * layers of DLL and trained directly by dllp, without generating and
+ * compiling a program for the configuration.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "dll/processor/processor.hpp"
+
+#include "layer.hpp"
+
+namespace dllp {
+
+/*!
+ * \brief Indicates if the given network can be executed by the dynamic backend
+ * \param layers The layers of the network
+ * \param reason The reason why the network is not supported, filled on failure
+ */
+bool dynamic_supported(const layers_t& layers, std::string& reason);
+
+/*!
+ * \brief Execute the actions of the task on the network, in process
+ * \param t The task
+ * \param layers The layers of the network
+ * \param actions The actions to execute
+ * \return 0 on success, 1 otherwise
+ */
+int execute_dynamic(const dll::processor::task& t, const layers_t& layers, const std::vector<std::string>& actions);
+
+} //end of namespace dllp
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <sstream>
 
 #include "cpp_utils/string.hpp"
 
@@ -26,12 +27,15 @@ bool valid_trainer(const std::string& unit);
 bool valid_ft_trainer(const std::string& unit);
 bool valid_activation(const std::string& unit);
 bool valid_sparsity(const std::string& unit);
+bool valid_loss(const std::string& loss);
 
 std::string unit_type(const std::string& unit);
 std::string activation_function(const std::string& unit);
 std::string decay_to_str(const std::string& decay);
 std::string sparsity_to_str(const std::string& decay);
+std::string loss_to_str(const std::string& loss);
 
 std::vector<std::string> read_lines(const std::string& source_file);
+std::vector<std::string> split_values(const std::string& values);
 
 } //end of namespace dllp
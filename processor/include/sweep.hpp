@@ -0,0 +1,39 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Parallel execution of the tasks of a sweep.
+ *
+ * The tasks of a sweep are independent runs of the same compiled program,
+ * each with its own seed and/or training data source. They run in parallel
+ * processes, each bound to its own set of cores, and their results are
+ * aggregated in a single report.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "dll/processor/processor.hpp"
+
+namespace dllp {
+
+/*!
+ * \brief Run all the tasks of the sweep of the given task with the given
+ * program and print the aggregated report.
+ *
+ * \param opt The options of the processor
+ * \param t The task, with the description of the sweep
+ * \param exe The compiled program
+ * \param report The aggregated report, filled on success
+ *
+ * \return true if all the tasks were executed, false otherwise
+ */
+bool run_sweep(const dll::processor::options& opt, const dll::processor::task& t, const std::string& exe, std::string& report);
+
+} //end of namespace dllp
@@ -0,0 +1,723 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <fstream>
+#include <memory>
+#include <tuple>
+
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/util/loss_kernels.hpp"
+
+#include "dynamic.hpp"
+
+namespace {
+
+using weight  = float;                      ///< The data type of the dynamic networks
+using batch_t = etl::dyn_matrix<weight, 2>; ///< A batch of inputs or outputs
+
+/*!
+ * \brief A layer of a dynamic network, with its training context
+ */
+struct dynamic_layer {
+    virtual ~dynamic_layer() = default;
+
+    /*!
+     * \brief Returns the output size of the layer
+     */
+    virtual size_t output_size() const = 0;
+
+    /*!
+     * \brief Returns a description of the layer
+     */
+    virtual std::string to_string() const = 0;
+
+    /*!
+     * \brief Prepare the context of the layer for batches of n samples
+     */
+    virtual void prepare(size_t n) = 0;
+
+    /*!
+     * \brief Returns the output of the last forward pass
+     */
+    virtual batch_t& output() = 0;
+
+    /*!
+     * \brief Returns the errors of the output of the layer
+     */
+    virtual batch_t& errors() = 0;
+
+    /*!
+     * \brief Compute the output of the layer for the given input
+     */
+    virtual void forward(const batch_t& input) = 0;
+
+    /*!
+     * \brief Multiply the errors by the derivative of the activation function
+     */
+    virtual void adapt_errors() = 0;
+
+    /*!
+     * \brief Backpropagate the errors into the errors of the previous layer
+     */
+    virtual void backward(batch_t& errors) = 0;
+
+    /*!
+     * \brief Compute the gradients of the layer and update its parameters
+     * \param desc The training description
+     * \param n The number of samples of the batch
+     */
+    virtual void update(const dll::processor::training_desc& desc, size_t n) = 0;
+
+    /*!
+     * \brief Store the parameters of the layer to the stream
+     */
+    virtual void store(std::ostream& /*os*/) const {}
+
+    /*!
+     * \brief Load the parameters of the layer from the stream
+     */
+    virtual void load(std::istream& /*is*/) {}
+};
+
+/*!
+ * \brief The state of the updater for one parameter of a layer
+ */
+template <size_t D>
+struct dynamic_updater_context {
+    etl::dyn_matrix<weight, D> grad; ///< The gradients of the parameter
+    etl::dyn_matrix<weight, D> inc;  ///< The momentum of the parameter
+
+    template <typename... S>
+    explicit dynamic_updater_context(S... sizes) : grad(sizes..., 0.0), inc(sizes..., 0.0) {}
+};
+
+/*!
+ * \brief Indicates if the weights are decayed with the given decay
+ */
+bool decay_weights(const std::string& decay) {
+    return decay != "none";
+}
+
+/*!
+ * \brief Indicates if the biases are decayed with the given decay
+ */
+bool decay_biases(const std::string& decay) {
+    return decay == "l1_full" || decay == "l2_full" || decay == "l1l2_full";
+}
+
+/*!
+ * \brief Apply the weight decay to the gradients of the given parameter
+ */
+template <typename V, typename G>
+void decay_gradients(const dll::processor::training_desc& desc, const V& value, G& grad) {
+    const bool l1 = desc.decay == "l1" || desc.decay == "l1_full" || desc.decay == "l1l2" || desc.decay == "l1l2_full";
+    const bool l2 = desc.decay == "l2" || desc.decay == "l2_full" || desc.decay == "l1l2" || desc.decay == "l1l2_full";
+
+    if (l1 && desc.l1_weight_cost != dll::processor::stupid_default) {
+        grad = grad - weight(desc.l1_weight_cost) * abs(value);
+    }
+
+    if (l2 && desc.l2_weight_cost != dll::processor::stupid_default) {
+        grad = grad - weight(desc.l2_weight_cost) * value;
+    }
+}
+
+/*!
+ * \brief Update a parameter with its gradients
+ */
+template <typename V, typename C>
+void apply_gradients(const dll::processor::training_desc& desc, V& value, C& context, size_t n) {
+    const weight eps = desc.learning_rate != dll::processor::stupid_default ? desc.learning_rate : 0.1;
+
+    if (desc.momentum != dll::processor::stupid_default) {
+        context.inc = weight(desc.momentum) * context.inc + (eps / n) * context.grad;
+        value += context.inc;
+    } else {
+        value += (eps / n) * context.grad;
+    }
+}
+
+/*!
+ * \brief A dense layer of a dynamic network
+ */
+template <dll::function F>
+struct dynamic_dense final : dynamic_layer {
+    using layer_t = typename dll::dyn_dense_layer_desc<dll::activation<F>>::layer_t; ///< The DLL layer
+
+    /*!
+     * \brief The training context of the layer, with the members used by
+     * the DLL layer to compute its gradients
+     */
+    struct context_t {
+        batch_t input;  ///< The input of the layer
+        batch_t output; ///< The output of the layer
+        batch_t errors; ///< The errors of the output
+
+        struct {
+            std::tuple<std::unique_ptr<dynamic_updater_context<2>>, std::unique_ptr<dynamic_updater_context<1>>> context;
+        } up; ///< The state of the updater
+    };
+
+    layer_t layer;     ///< The DLL layer
+    context_t context; ///< The training context
+
+    dynamic_dense(size_t visible, size_t hidden) {
+        layer.init_layer(visible, hidden);
+
+        std::get<0>(context.up.context) = std::make_unique<dynamic_updater_context<2>>(visible, hidden);
+        std::get<1>(context.up.context) = std::make_unique<dynamic_updater_context<1>>(hidden);
+    }
+
+    size_t output_size() const override {
+        return layer.output_size();
+    }
+
+    std::string to_string() const override {
+        return layer.to_full_string();
+    }
+
+    void prepare(size_t n) override {
+        if (etl::dim<0>(context.output) != n) {
+            context.input  = batch_t(n, layer.input_size(), 0.0);
+            context.output = batch_t(n, layer.output_size(), 0.0);
+            context.errors = batch_t(n, layer.output_size(), 0.0);
+        }
+    }
+
+    batch_t& output() override {
+        return context.output;
+    }
+
+    batch_t& errors() override {
+        return context.errors;
+    }
+
+    void forward(const batch_t& input) override {
+        context.input = input;
+        layer.forward_batch(context.output, context.input);
+    }
+
+    void adapt_errors() override {
+        layer.adapt_errors(context);
+    }
+
+    void backward(batch_t& errors) override {
+        layer.backward_batch(errors, context);
+    }
+
+    void update(const dll::processor::training_desc& desc, size_t n) override {
+        layer.compute_gradients(context);
+
+        auto& w_context = *std::get<0>(context.up.context);
+        auto& b_context = *std::get<1>(context.up.context);
+
+        if (decay_weights(desc.decay)) {
+            decay_gradients(desc, layer.w, w_context.grad);
+        }
+
+        if (decay_biases(desc.decay)) {
+            decay_gradients(desc, layer.b, b_context.grad);
+        }
+
+        apply_gradients(desc, layer.w, w_context, n);
+        apply_gradients(desc, layer.b, b_context, n);
+    }
+
+    void store(std::ostream& os) const override {
+        layer.store(os);
+    }
+
+    void load(std::istream& is) override {
+        layer.load(is);
+    }
+};
+
+/*!
+ * \brief An activation layer of a dynamic network
+ */
+template <dll::function F>
+struct dynamic_activation final : dynamic_layer {
+    size_t size;  ///< The size of the input and of the output
+    batch_t out;  ///< The output of the layer
+    batch_t errs; ///< The errors of the output
+
+    explicit dynamic_activation(size_t size) : size(size) {}
+
+    size_t output_size() const override {
+        return size;
+    }
+
+    std::string to_string() const override {
+        return "Activation(" + dll::to_string(F) + ")";
+    }
+
+    void prepare(size_t n) override {
+        if (etl::dim<0>(out) != n) {
+            out  = batch_t(n, size, 0.0);
+            errs = batch_t(n, size, 0.0);
+        }
+    }
+
+    batch_t& output() override {
+        return out;
+    }
+
+    batch_t& errors() override {
+        return errs;
+    }
+
+    void forward(const batch_t& input) override {
+        out = dll::f_activate<F>(input);
+    }
+
+    void adapt_errors() override {
+        errs = dll::f_derivative<F>(out) >> errs;
+    }
+
+    void backward(batch_t& errors) override {
+        errors = errs;
+    }
+
+    void update(const dll::processor::training_desc& /*desc*/, size_t /*n*/) override {
+        // Nothing to learn
+    }
+};
+
+/*!
+ * \brief Get the activation function of the given name, the default
+ * activation of DLL (sigmoid) if the name is empty.
+ * \return true if the function is supported by the dynamic backend, false
+ * otherwise
+ */
+bool to_function(const std::string& activation, dll::function& f) {
+    if (activation.empty() || activation == "sigmoid") {
+        f = dll::function::SIGMOID;
+    } else if (activation == "tanh") {
+        f = dll::function::TANH;
+    } else if (activation == "relu") {
+        f = dll::function::RELU;
+    } else if (activation == "softmax") {
+        f = dll::function::SOFTMAX;
+    } else if (activation == "identity") {
+        f = dll::function::IDENTITY;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Returns the activation function of the given name, which must be
+ * supported (see dynamic_supported)
+ */
+dll::function to_function(const std::string& activation) {
+    dll::function f = dll::function::SIGMOID;
+    const bool supported = to_function(activation, f);
+    cpp_assert(supported, "Unsupported activation function in the dynamic backend");
+    cpp_unused(supported);
+    return f;
+}
+
+/*!
+ * \brief Returns the activation of the given layer of the configuration,
+ * or nullptr if it is not a dense or activation layer
+ */
+const std::string* layer_activation(const dllp::layer& layer) {
+    if (auto* dense = dynamic_cast<const dllp::dense_layer*>(&layer)) {
+        return &dense->activation;
+    } else if (auto* function = dynamic_cast<const dllp::function_layer*>(&layer)) {
+        return &function->activation;
+    }
+
+    return nullptr;
+}
+
+/*!
+ * \brief Create the dynamic layer for the given layer type and activation
+ * function
+ */
+template <template <dll::function> class L, typename... Args>
+std::unique_ptr<dynamic_layer> make_layer(dll::function f, Args... args) {
+    switch (f) {
+        case dll::function::TANH:
+            return std::make_unique<L<dll::function::TANH>>(args...);
+        case dll::function::RELU:
+            return std::make_unique<L<dll::function::RELU>>(args...);
+        case dll::function::SOFTMAX:
+            return std::make_unique<L<dll::function::SOFTMAX>>(args...);
+        case dll::function::IDENTITY:
+            return std::make_unique<L<dll::function::IDENTITY>>(args...);
+        default:
+            return std::make_unique<L<dll::function::SIGMOID>>(args...);
+    }
+}
+
+/*!
+ * \brief A network built at runtime from dynamic layers
+ */
+struct dynamic_network {
+    std::vector<std::unique_ptr<dynamic_layer>> layers; ///< The layers of the network
+    size_t input_size = 0;                              ///< The input size of the network
+
+    /*!
+     * \brief Build the network from the layers of the configuration
+     */
+    explicit dynamic_network(const dllp::layers_t& conf) {
+        size_t size = 0;
+
+        for (auto& layer : conf) {
+            if (auto* dense = dynamic_cast<const dllp::dense_layer*>(layer.get())) {
+                if (layers.empty()) {
+                    input_size = dense->visible;
+                }
+
+                layers.push_back(make_layer<dynamic_dense>(to_function(dense->activation), dense->visible, dense->hidden));
+                size = dense->hidden;
+            } else if (auto* function = dynamic_cast<const dllp::function_layer*>(layer.get())) {
+                layers.push_back(make_layer<dynamic_activation>(to_function(function->activation), size));
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the output size of the network
+     */
+    size_t output_size() const {
+        return layers.back()->output_size();
+    }
+
+    /*!
+     * \brief Display the network on the standard output
+     */
+    void display() const {
+        for (auto& layer : layers) {
+            std::cout << layer->to_string() << std::endl;
+        }
+    }
+
+    /*!
+     * \brief Prepare the network for batches of n samples
+     */
+    void prepare(size_t n) {
+        for (auto& layer : layers) {
+            layer->prepare(n);
+        }
+    }
+
+    /*!
+     * \brief Compute the output of the network for the given batch
+     */
+    const batch_t& forward(const batch_t& input) {
+        const batch_t* current = &input;
+
+        for (auto& layer : layers) {
+            layer->forward(*current);
+            current = &layer->output();
+        }
+
+        return *current;
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the last layer and update all the
+     * parameters of the network
+     */
+    void backward(const dll::processor::training_desc& desc, size_t n) {
+        for (size_t l = layers.size() - 1; l > 0; --l) {
+            // The errors of the last layer are already complete
+            if (l != layers.size() - 1) {
+                layers[l]->adapt_errors();
+            }
+
+            layers[l]->backward(layers[l - 1]->errors());
+        }
+
+        // With a single layer, the errors of the first layer are the complete errors of the last layer
+        if (layers.size() > 1) {
+            layers.front()->adapt_errors();
+        }
+
+        for (auto& layer : layers) {
+            layer->update(desc, n);
+        }
+    }
+
+    /*!
+     * \brief Store the network to the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+
+        for (auto& layer : layers) {
+            layer->store(os);
+        }
+    }
+
+    /*!
+     * \brief Load the network from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+
+        for (auto& layer : layers) {
+            layer->load(is);
+        }
+    }
+};
+
+/*!
+ * \brief Copy the samples [first, first + n) into the batch
+ */
+template <typename Samples>
+void fill_batch(batch_t& batch, const Samples& samples, size_t first, size_t n, size_t size) {
+    if (etl::dim<0>(batch) != n) {
+        batch = batch_t(n, size, 0.0);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < size; ++j) {
+            batch(i, j) = samples[first + i][j];
+        }
+    }
+}
+
+/*!
+ * \brief Copy the one-hot labels [first, first + n) into the batch
+ */
+void fill_labels(batch_t& batch, const std::vector<size_t>& labels, size_t first, size_t n, size_t classes) {
+    if (etl::dim<0>(batch) != n || etl::dim<1>(batch) != classes) {
+        batch = batch_t(n, classes, 0.0);
+    } else {
+        batch = 0.0;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        batch(i, labels[first + i]) = 1.0;
+    }
+}
+
+/*!
+ * \brief Returns the index of the maximum value of the given row of the batch
+ */
+size_t max_index(const batch_t& batch, size_t i) {
+    size_t index = 0;
+
+    for (size_t j = 1; j < etl::dim<1>(batch); ++j) {
+        if (batch(i, j) > batch(i, index)) {
+            index = j;
+        }
+    }
+
+    return index;
+}
+
+/*!
+ * \brief Train the network on the given samples, with the given loss
+ * \return The classification error of the last epoch
+ */
+template <dll::loss_function Loss, typename Samples>
+double train(dynamic_network& network, const dll::processor::training_desc& desc, const Samples& samples, const std::vector<size_t>& labels) {
+    const size_t batch_size = desc.batch_size > 0 ? desc.batch_size : 1;
+    const size_t classes    = network.output_size();
+
+    batch_t inputs;
+    batch_t outputs;
+
+    double error = 0.0;
+
+    for (size_t epoch = 0; epoch < desc.epochs; ++epoch) {
+        double epoch_error = 0.0;
+        double epoch_loss  = 0.0;
+
+        for (size_t first = 0; first < samples.size(); first += batch_size) {
+            const size_t n = std::min(batch_size, samples.size() - first);
+
+            network.prepare(n);
+
+            fill_batch(inputs, samples, first, n, network.input_size);
+            fill_labels(outputs, labels, first, n, classes);
+
+            auto& output = network.forward(inputs);
+            auto& last   = *network.layers.back();
+
+            auto metrics = dll::loss_errors<Loss>(output, outputs, last.errors(), n);
+
+            epoch_error += metrics.first;
+            epoch_loss += metrics.second;
+
+            network.backward(desc, n);
+        }
+
+        error = epoch_error / samples.size();
+
+        std::cout << "epoch " << epoch << "/" << desc.epochs << " - error: " << error << " loss: " << epoch_loss / samples.size() << std::endl;
+    }
+
+    return error;
+}
+
+/*!
+ * \brief Train the network on the given samples, with the configured loss
+ * (the categorical cross entropy by default, as in DLL)
+ * \return The classification error of the last epoch
+ */
+template <typename Samples>
+double train(dynamic_network& network, const dll::processor::training_desc& desc, const Samples& samples, const std::vector<size_t>& labels) {
+    if (desc.loss == "bce") {
+        return train<dll::loss_function::BINARY_CROSS_ENTROPY>(network, desc, samples, labels);
+    } else if (desc.loss == "mse") {
+        return train<dll::loss_function::MEAN_SQUARED_ERROR>(network, desc, samples, labels);
+    } else {
+        return train<dll::loss_function::CATEGORICAL_CROSS_ENTROPY>(network, desc, samples, labels);
+    }
+}
+
+/*!
+ * \brief Compute the classification error of the network on the given samples
+ */
+template <typename Samples>
+double test(dynamic_network& network, const dll::processor::training_desc& desc, const Samples& samples, const std::vector<size_t>& labels) {
+    const size_t batch_size = desc.batch_size > 0 ? desc.batch_size : 1;
+
+    batch_t inputs;
+
+    size_t errors = 0;
+
+    for (size_t first = 0; first < samples.size(); first += batch_size) {
+        const size_t n = std::min(batch_size, samples.size() - first);
+
+        network.prepare(n);
+
+        fill_batch(inputs, samples, first, n, network.input_size);
+
+        auto& output = network.forward(inputs);
+
+        for (size_t i = 0; i < n; ++i) {
+            if (max_index(output, i) != labels[first + i]) {
+                ++errors;
+            }
+        }
+    }
+
+    return errors / double(samples.size());
+}
+
+/*!
+ * \brief Read the samples and the labels of the given data source
+ */
+template <typename Samples>
+bool read_data(const dll::processor::datasource_pack& pack, Samples& samples, std::vector<size_t>& labels, const char* name) {
+    if (!dll::processor::read_samples<false>(pack.samples, samples)) {
+        std::cout << "dllp: error: failed to read the " << name << " samples" << std::endl;
+        return false;
+    }
+
+    if (!dll::processor::read_labels(pack.labels, labels)) {
+        std::cout << "dllp: error: failed to read the " << name << " labels" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+} //end of anonymous namespace
+
+bool dllp::dynamic_supported(const layers_t& layers, std::string& reason) {
+    for (auto& layer : layers) {
+        if (!dynamic_cast<const dllp::dense_layer*>(layer.get()) && !dynamic_cast<const dllp::function_layer*>(layer.get())) {
+            reason = "the dynamic backend only supports dense and activation layers";
+            return false;
+        }
+    }
+
+    if (!dynamic_cast<const dllp::dense_layer*>(layers.front().get())) {
+        reason = "the first layer must be a dense layer";
+        return false;
+    }
+
+    for (auto& layer : layers) {
+        dll::function f;
+
+        if (!to_function(*layer_activation(*layer), f)) {
+            reason = "the dynamic backend does not support the activation function " + *layer_activation(*layer);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int dllp::execute_dynamic(const dll::processor::task& t, const layers_t& layers, const std::vector<std::string>& actions) {
+    using samples_t = std::vector<etl::dyn_vector<weight>>;
+
+    std::string reason;
+    if (!dynamic_supported(layers, reason)) {
+        std::cout << "dllp: error: " << reason << std::endl;
+        return 1;
+    }
+
+    dynamic_network network(layers);
+
+    dll::processor::print_title("Network");
+    network.display();
+
+    for (auto& action : actions) {
+        if (action == "train") {
+            dll::processor::print_title("Training");
+
+            if (t.training.samples.empty() || t.training.labels.empty()) {
+                std::cout << "dllp: error: train is not possible without samples and labels" << std::endl;
+                return 1;
+            }
+
+            samples_t samples;
+            std::vector<size_t> labels;
+
+            if (!read_data(t.training, samples, labels, "training")) {
+                return 1;
+            }
+
+            auto ft_error = train(network, t.ft_desc, samples, labels);
+            std::cout << "Train Classification Error:" << ft_error << std::endl;
+        } else if (action == "test") {
+            dll::processor::print_title("Testing");
+
+            if (t.testing.samples.empty() || t.testing.labels.empty()) {
+                std::cout << "dllp: error: test is not possible without samples and labels" << std::endl;
+                return 1;
+            }
+
+            samples_t samples;
+            std::vector<size_t> labels;
+
+            if (!read_data(t.testing, samples, labels, "test")) {
+                return 1;
+            }
+
+            auto test_error = test(network, t.ft_desc, samples, labels);
+
+            std::cout << "Error rate: " << test_error << std::endl;
+            std::cout << "Accuracy: " << (1.0 - test_error) << std::endl;
+        } else if (action == "save") {
+            dll::processor::print_title("Save Weights");
+
+            network.store(t.w_desc.file);
+            std::cout << "Weights saved" << std::endl;
+        } else if (action == "load") {
+            dll::processor::print_title("Load Weights");
+
+            network.load(t.w_desc.file);
+            std::cout << "Weights loaded" << std::endl;
+        } else {
+            std::cout << "dllp: error: Invalid action for the dynamic backend: " << action << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -22,7 +22,7 @@
 namespace {
 
 void print_usage() {
-    std::cout << "Usage: dllp conf_file action" << std::endl;
+    std::cout << "Usage: dllp [--mkl] [--cublas] [--cufft] [--gpu] [--cache] [--pch] [--release] [--pgo] [--lto] [--dynamic] conf_file action" << std::endl;
 }
 
 void parse_options(int argc, char* argv[], dll::processor::options& opt, std::vector<std::string>& actions, std::string& source_file) {
@@ -38,9 +38,27 @@ void parse_options(int argc, char* argv[], dll::processor::options& opt, std::ve
         } else if (std::string(argv[i]) == "--cublas") {
             opt.cublas = true;
             ++i;
+        } else if (std::string(argv[i]) == "--gpu") {
+            opt.gpu = true;
+            ++i;
         } else if (std::string(argv[i]) == "--cache") {
             opt.cache = true;
             ++i;
+        } else if (std::string(argv[i]) == "--pch") {
+            opt.pch = true;
+            ++i;
+        } else if (std::string(argv[i]) == "--release") {
+            opt.release = true;
+            ++i;
+        } else if (std::string(argv[i]) == "--pgo") {
+            opt.pgo = true;
+            ++i;
+        } else if (std::string(argv[i]) == "--lto") {
+            opt.lto = true;
+            ++i;
+        } else if (std::string(argv[i]) == "--dynamic") {
+            opt.dynamic = true;
+            ++i;
         } else {
             break;
         }
@@ -70,6 +70,18 @@ std::string dllp::sparsity_to_str(const std::string& sparsity) {
     }
 }
 
+std::string dllp::loss_to_str(const std::string& loss) {
+    if (loss == "cce") {
+        return "CATEGORICAL_CROSS_ENTROPY";
+    } else if (loss == "bce") {
+        return "BINARY_CROSS_ENTROPY";
+    } else if (loss == "mse") {
+        return "MEAN_SQUARED_ERROR";
+    } else {
+        return "INVALID";
+    }
+}
+
 bool dllp::valid_unit(const std::string& unit) {
     return unit == "binary" || unit == "softmax" || unit == "gaussian";
 }
@@ -86,10 +98,31 @@ bool dllp::valid_activation(const std::string& function) {
     return function == "sigmoid" || function == "softmax" || function == "tanh" || function == "relu" || function == "identity";
 }
 
+bool dllp::valid_loss(const std::string& loss) {
+    return loss == "cce" || loss == "bce" || loss == "mse";
+}
+
 bool dllp::valid_sparsity(const std::string& sparsity) {
     return sparsity == "global" || sparsity == "local" || sparsity == "lee";
 }
 
+std::vector<std::string> dllp::split_values(const std::string& values) {
+    std::vector<std::string> result;
+
+    std::stringstream stream(values);
+    std::string value;
+
+    while (std::getline(stream, value, ',')) {
+        std::string processed(cpp::trim(value));
+
+        if (!processed.empty()) {
+            result.emplace_back(std::move(processed));
+        }
+    }
+
+    return result;
+}
+
 std::vector<std::string> dllp::read_lines(const std::string& source_file) {
     std::vector<std::string> lines;
 
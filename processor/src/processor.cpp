@@ -10,6 +10,10 @@
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <iterator>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 
 #include <sys/stat.h>
@@ -19,6 +23,8 @@
 
 #include "parse_utils.hpp"
 #include "layer.hpp"
+#include "dynamic.hpp"
+#include "sweep.hpp"
 
 #include "dll/processor/processor.hpp"
 
@@ -116,7 +122,67 @@ void parse_datasource_pack(dll::processor::datasource_pack& pack, const std::vec
 }
 
 void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions);
-bool compile(const options& opt);
+bool compile_flags(const options& opt, std::string& flags);
+bool compile(const options& opt, const std::string& flags, const std::string& output, const std::string& object = "");
+
+/*!
+ * \brief The DLL headers included by all the generated programs, they are
+ * the content of the precompiled header
+ */
+const std::vector<std::string> generated_headers = {
+    "dll/processor/processor.hpp",
+    "dll/rbm/rbm.hpp",
+    "dll/rbm/conv_rbm.hpp",
+    "dll/rbm/conv_rbm_mp.hpp",
+    "dll/neural/dense_layer.hpp",
+    "dll/neural/conv_layer.hpp",
+    "dll/pooling/mp_layer.hpp",
+    "dll/pooling/avgp_layer.hpp",
+    "dll/neural/activation_layer.hpp",
+    "dll/dbn.hpp"};
+
+/*!
+ * \brief Returns the directory of the build cache
+ */
+std::string cache_directory() {
+    const auto* dir = std::getenv("DLLP_CACHE");
+    return dir ? dir : ".dllp_cache";
+}
+
+/*!
+ * \brief Returns the content of the given file, empty if it cannot be read
+ */
+std::string read_file(const std::string& file) {
+    std::ifstream stream(file);
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    return buffer.str();
+}
+
+/*!
+ * \brief Returns the FNV-1a hash of the given string, in hexadecimal
+ */
+std::string hash_string(const std::string& str) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (unsigned char c : str) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+
+    return buffer;
+}
+
+/*!
+ * \brief Indicates if the given file exists
+ */
+bool file_exists(const std::string& file) {
+    struct stat attr;
+    return !stat(file.c_str(), &attr);
+}
 
 void process_includes(std::vector<std::string>& lines){
     for (size_t i = 0; i < lines.size();) {
@@ -225,6 +291,62 @@ bool process_options(size_t& i, const std::vector<std::string>& lines, dll::proc
                         return false;
                     }
 
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "loss: ")) {
+                    t.ft_desc.loss = dllp::extract_value(lines[i], "loss: ");
+
+                    if (!dllp::valid_loss(t.ft_desc.loss)) {
+                        std::cout << "dllp: error: invalid loss must be one of [cce, bce, mse]" << std::endl;
+                        return false;
+                    }
+
+                    ++i;
+                } else {
+                    break;
+                }
+            }
+        } else if (lines[i] == "sweep:") {
+            ++i;
+
+            while (i < lines.size()) {
+                if (dllp::starts_with(lines[i], "seeds:")) {
+                    for (auto& seed : dllp::split_values(dllp::extract_value(lines[i], "seeds: "))) {
+                        t.sweep.seeds.push_back(std::stoul(seed));
+                    }
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "samples:")) {
+                    t.sweep.samples = dllp::split_values(dllp::extract_value(lines[i], "samples: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "labels:")) {
+                    t.sweep.labels = dllp::split_values(dllp::extract_value(lines[i], "labels: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "threads:")) {
+                    t.sweep.threads = std::stol(dllp::extract_value(lines[i], "threads: "));
+                    ++i;
+                } else {
+                    break;
+                }
+            }
+
+            if (t.sweep.samples.size() != t.sweep.labels.size()) {
+                std::cout << "dllp: error: the sweep needs as many training labels as training samples" << std::endl;
+                return false;
+            }
+        } else if (lines[i] == "bench:") {
+            ++i;
+
+            while (i < lines.size()) {
+                if (dllp::starts_with(lines[i], "warmup:")) {
+                    t.bench.warmup = std::stol(dllp::extract_value(lines[i], "warmup: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "epochs:")) {
+                    t.bench.epochs = std::stol(dllp::extract_value(lines[i], "epochs: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "samples:")) {
+                    t.bench.samples = std::stol(dllp::extract_value(lines[i], "samples: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "fresh:")) {
+                    t.bench.fresh = dllp::extract_value(lines[i], "fresh: ") == "true";
                     ++i;
                 } else {
                     break;
@@ -391,41 +513,184 @@ bool parse_file(const std::string& source_file, dll::processor::task& t, std::ve
     return true;
 }
 
-bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers) {
-    bool process = true;
+/*!
+ * \brief Build the precompiled header of the DLL headers for the given
+ * flags, if it is not already in the cache.
+ *
+ * \param opt The options of the processor
+ * \param flags The compilation flags, extended with the flags to use the header
+ *
+ * \return true if the header is ready, false otherwise
+ */
+bool precompile_header(const options& opt, std::string& flags) {
+    const std::string cxx(std::getenv("CXX"));
+
+    const bool clang = command_result(cxx + " --version").find("clang") != std::string::npos;
+
+    // The header is only valid for the same compiler and the same flags
+    const std::string dir    = cache_directory() + "/pch-" + hash_string(cxx + flags);
+    const std::string header = dir + "/dllp_pch.hpp";
+    const std::string output = clang ? header + ".pch" : header + ".gch";
+
+    if (!file_exists(output)) {
+        if (!opt.quiet) {
+            std::cout << "Precompiling the DLL headers..." << std::endl;
+        }
 
-    if (opt.cache) {
-        struct stat attr_conf;
-        struct stat attr_exec;
+        mkdir(dir.c_str(), 0755);
 
-        if (!stat(source_file.c_str(), &attr_conf)) {
-            if (!stat("./.dbn.out", &attr_exec)) {
-                auto mtime_conf = attr_conf.st_mtime;
-                auto mtime_exec = attr_exec.st_mtime;
+        {
+            std::ofstream header_stream(header);
 
-                if (mtime_exec > mtime_conf) {
-                    if (!opt.quiet) {
-                        std::cout << "Skip compilation" << std::endl;
-                    }
-                    process = false;
-                }
+            header_stream << "#include <memory>\n";
+
+            for (auto& h : generated_headers) {
+                header_stream << "#include \"" << h << "\"\n";
             }
         }
+
+        const std::string command = cxx + " " + flags + " -x c++-header " + header + " -o " + output + ".tmp";
+
+        if (system(command.c_str()) || std::rename((output + ".tmp").c_str(), output.c_str())) {
+            std::cout << "Precompilation of the headers failed" << std::endl;
+            return false;
+        }
+    }
+
+    if (clang) {
+        flags += " -include-pch " + output + " ";
+    } else {
+        flags += " -include " + header + " ";
     }
 
-    if (process) {
-        //Generate the CPP file
-        dllp::generate(layers, t, actions);
+    return true;
+}
+
+/*!
+ * \brief Train the profile of the program with an instrumented build, if it
+ * is not already in the cache.
+ *
+ * The instrumented program runs the bench action on the synthetic data of
+ * the configuration. The profile is only valid for the same compiler, the
+ * same flags and the same generated source.
+ *
+ * \param opt The options of the processor
+ * \param flags The compilation flags, extended with the flags to use the profile
+ * \param object The object file of the program, filled on success
+ *
+ * \return true if the profile is ready, false otherwise
+ */
+bool profile_guided_flags(const options& opt, std::string& flags, std::string& object) {
+    const std::string cxx(std::getenv("CXX"));
+
+    const bool clang = command_result(cxx + " --version").find("clang") != std::string::npos;
+
+    const std::string dir     = cache_directory() + "/pgo-" + hash_string(cxx + flags + read_file(".dbn.cpp"));
+    const std::string profile = clang ? dir + "/dbn.profdata" : dir + "/complete";
+
+    // GCC names the profile after the object, it must be the same for both builds
+    object = dir + "/dbn.o";
+
+    if (!file_exists(profile)) {
+        if (!opt.quiet) {
+            std::cout << "Training the profile of the program..." << std::endl;
+        }
+
+        mkdir(dir.c_str(), 0755);
+
+        const std::string instrumented = dir + "/dbn.gen";
+
+        if (!dllp::compile(opt, flags + " -fprofile-generate=" + dir + " ", instrumented, object)) {
+            return false;
+        }
+
+        const std::string run_command = instrumented + " bench > " + dir + "/train.log 2>&1";
 
-        //Compile the generate file
-        if (!dllp::compile(opt)) {
+        if (system(run_command.c_str())) {
+            std::cout << "dllp: error: the instrumented program failed (see " << dir << "/train.log)" << std::endl;
             return false;
         }
+
+        if (clang) {
+            const std::string merge_command = "llvm-profdata merge -o " + profile + ".tmp " + dir + "/*.profraw";
+
+            if (system(merge_command.c_str()) || std::rename((profile + ".tmp").c_str(), profile.c_str())) {
+                std::cout << "dllp: error: failed to merge the profile" << std::endl;
+                return false;
+            }
+        } else {
+            std::ofstream marker(profile);
+        }
+    }
+
+    if (clang) {
+        flags += " -fprofile-use=" + profile + " ";
+    } else {
+        flags += " -fprofile-use=" + dir + " -fprofile-correction -Wno-missing-profile ";
     }
 
     return true;
 }
 
+/*!
+ * \brief Generate and compile the program for the given configuration.
+ *
+ * With the cache, the executable is stored in the cache directory, under
+ * the hash of the generated source and of the compilation flags, and is
+ * only compiled if it is not already there.
+ *
+ * \param exe The path to the executable, filled on success
+ */
+bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actions, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers, std::string& exe) {
+    //Generate the CPP file
+    dllp::generate(layers, t, actions);
+
+    std::string flags;
+    if (!dllp::compile_flags(opt, flags)) {
+        return false;
+    }
+
+    if (!opt.cache && !opt.pch && !opt.pgo) {
+        exe = "./.dbn.out";
+        return dllp::compile(opt, flags, exe);
+    }
+
+    mkdir(cache_directory().c_str(), 0755);
+
+    // The profiles are not valid with a precompiled header, PGO takes precedence
+    std::string object;
+
+    if (opt.pgo) {
+        if (!profile_guided_flags(opt, flags, object)) {
+            return false;
+        }
+    } else if (opt.pch && !precompile_header(opt, flags)) {
+        return false;
+    }
+
+    if (!opt.cache) {
+        exe = "./.dbn.out";
+        return dllp::compile(opt, flags, exe, object);
+    }
+
+    exe = cache_directory() + "/" + hash_string(std::getenv("CXX") + flags + read_file(".dbn.cpp")) + ".out";
+
+    if (file_exists(exe)) {
+        if (!opt.quiet) {
+            std::cout << "Skip compilation (cached " << exe << ")" << std::endl;
+        }
+
+        return true;
+    }
+
+    // The executable is only visible in the cache once complete
+    if (!dllp::compile(opt, flags, exe + ".tmp", object)) {
+        return false;
+    }
+
+    return !std::rename((exe + ".tmp").c_str(), exe.c_str());
+}
+
 std::string datasource_to_string(const std::string& lhs, const dll::processor::datasource& ds) {
     std::string result;
 
@@ -466,6 +731,17 @@ std::string w_desc_to_string(const std::string& lhs, const dll::processor::weigh
     return result;
 }
 
+std::string bench_desc_to_string(const std::string& lhs, const dll::processor::bench_desc& desc) {
+    std::string result;
+
+    result += lhs + ".warmup = " + std::to_string(desc.warmup) + ";\n";
+    result += lhs + ".epochs = " + std::to_string(desc.epochs) + ";\n";
+    result += lhs + ".samples = " + std::to_string(desc.samples) + ";\n";
+    result += lhs + ".fresh = " + (desc.fresh ? "true" : "false") + ";\n";
+
+    return result;
+}
+
 std::string task_to_string(const std::string& name, const dll::processor::task& t) {
     std::string result;
 
@@ -490,6 +766,7 @@ std::string task_to_string(const std::string& name, const dll::processor::task&
     result += "\n";
     result += w_desc_to_string("   " + name + ".w_desc", t.w_desc);
     result += "\n";
+    result += bench_desc_to_string("   " + name + ".bench", t.bench);
 
     return result;
 }
@@ -524,8 +801,8 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
     } else if(!t.pretraining_clean.samples.reader.empty()){
         reader = t.pretraining_clean.samples.reader;
     } else {
-        std::cerr << "dllp: error: no reader specified " << std::endl;
-        return "";
+        // Without any data (bench), the samples have the shape of the input of the network
+        return "dbn_t::input_one_t";
     }
 
     if(reader == "mnist"){
@@ -546,21 +823,49 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
     }
 }
 
+/*!
+ * \brief Returns the actions to execute, the default actions of the task
+ * replace the "auto" action
+ */
+std::vector<std::string> final_actions(const dll::processor::task& t, const std::vector<std::string>& actions) {
+    if (std::find(actions.begin(), actions.end(), "auto") != actions.end()) {
+        return t.default_actions;
+    }
+
+    return actions;
+}
+
+/*!
+ * \brief Indicates if the actions are a sweep
+ */
+bool is_sweep(const std::vector<std::string>& actions) {
+    return std::find(actions.begin(), actions.end(), "sweep") != actions.end();
+}
+
+/*!
+ * \brief Returns the actions of each task of a sweep, all the actions except
+ * "sweep", the training and the test by default
+ */
+std::vector<std::string> sweep_actions(const std::vector<std::string>& actions) {
+    std::vector<std::string> result;
+
+    std::copy_if(actions.begin(), actions.end(), std::back_inserter(result), [](auto& action) { return action != "sweep"; });
+
+    if (result.empty()) {
+        result = {"train", "test"};
+    }
+
+    return result;
+}
+
 void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions) {
     std::ofstream out_stream(".dbn.cpp");
 
     out_stream << "#include <memory>\n";
 
-    out_stream << "#include \"dll/processor/processor.hpp\"\n";
-    out_stream << "#include \"dll/rbm/rbm.hpp\"\n";
-    out_stream << "#include \"dll/rbm/conv_rbm.hpp\"\n";
-    out_stream << "#include \"dll/rbm/conv_rbm_mp.hpp\"\n";
-    out_stream << "#include \"dll/neural/dense_layer.hpp\"\n";
-    out_stream << "#include \"dll/neural/conv_layer.hpp\"\n";
-    out_stream << "#include \"dll/pooling/mp_layer.hpp\"\n";
-    out_stream << "#include \"dll/pooling/avgp_layer.hpp\"\n";
-    out_stream << "#include \"dll/neural/activation_layer.hpp\"\n";
-    out_stream << "#include \"dll/dbn.hpp\"\n";
+    for (auto& header : generated_headers) {
+        out_stream << "#include \"" << header << "\"\n";
+    }
 
     out_stream << "using dbn_t = dll::dbn_desc<dll::dbn_layers<\n";
 
@@ -580,6 +885,10 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
         out_stream << ", dll::trainer<dll::cg_trainer_simple>\n";
     }
 
+    if (t.ft_desc.loss != "none") {
+        out_stream << ", dll::loss<dll::loss_function::" << loss_to_str(t.ft_desc.loss) << ">\n";
+    }
+
     if (t.ft_desc.momentum != dll::processor::stupid_default) {
         out_stream << ", dll::updater<dll::updater_type::MOMENTUM>\n";
     }
@@ -605,6 +914,7 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
     out_stream << ">::dbn_t;\n\n";
 
     out_stream << "int main(int argc, char* argv[]){\n";
+    out_stream << "   dll::processor::sweep_seed();\n";
     out_stream << "   auto dbn = std::make_unique<dbn_t>();\n";
 
     if (t.ft_desc.learning_rate != dll::processor::stupid_default) {
@@ -630,14 +940,12 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
         layer->set(out_stream, "   dbn->layer_get<" + std::to_string(i) + ">()");
     }
 
-    auto final_actions = actions;
-
-    if(std::find(actions.begin(), actions.end(), "auto") != actions.end()){
-        final_actions = t.default_actions;
-    }
-
     out_stream << task_to_string("t", t) << "\n";
-    out_stream << vector_to_string("actions", final_actions) << "\n";
+    out_stream << "   dll::processor::sweep_sources(t);\n";
+    out_stream << vector_to_string("actions", final_actions(t, actions)) << "\n";
+    out_stream << "   if (argc > 1) {\n";
+    out_stream << "      actions.assign(argv + 1, argv + argc);\n";
+    out_stream << "   }\n";
     out_stream << "   using data_type = " << get_data_type(layers, t) << ";\n";
     out_stream << "   static constexpr bool three = " << layers.front()->is_conv() << ";\n";
     out_stream << "   dll::processor::execute<data_type, three>(*dbn, t, actions);\n";
@@ -667,21 +975,20 @@ bool append_pkg_flags(std::string& flags, const std::string& pkg) {
     return true;
 }
 
-bool compile(const options& opt) {
-    if (!opt.quiet) {
-        std::cout << "Compiling the program..." << std::endl;
+bool compile_flags(const options& opt, std::string& compile_command) {
+    if (opt.release) {
+        compile_command += " -O3 -march=native -DETL_VECTORIZE_FULL ";
+    } else {
+        compile_command += " -g ";
+        compile_command += " -O2 -DETL_VECTORIZE_FULL ";
     }
 
-    const auto* cxx = std::getenv("CXX");
-
-    std::string compile_command(cxx);
-
-    compile_command += " -o .dbn.out ";
-    compile_command += " -g ";
-    compile_command += " -O2 -DETL_VECTORIZE_FULL ";
     compile_command += " -std=c++1z ";
     compile_command += " -pthread ";
-    compile_command += " .dbn.cpp ";
+
+    if (opt.lto) {
+        compile_command += " -flto ";
+    }
 
     if (opt.mkl) {
         compile_command += " -DETL_MKL_MODE ";
@@ -691,6 +998,19 @@ bool compile(const options& opt) {
         }
     }
 
+    // Full GPU support, the buffers stay resident on the device
+    if (opt.gpu) {
+        compile_command += " -DETL_GPU -DETL_EGBLAS_MODE ";
+
+        for (auto* lib : {"cublas", "cufft", "cudnn", "curand", "egblas"}) {
+            if (!append_pkg_flags(compile_command, lib)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     if (opt.cublas) {
         compile_command += " -DETL_CUBLAS_MODE ";
 
@@ -707,6 +1027,33 @@ bool compile(const options& opt) {
         }
     }
 
+    return true;
+}
+
+bool compile(const options& opt, const std::string& flags, const std::string& output, const std::string& object) {
+    if (!opt.quiet) {
+        std::cout << "Compiling the program..." << std::endl;
+    }
+
+    const auto* cxx = std::getenv("CXX");
+
+    std::string compile_command(cxx);
+
+    if (object.empty()) {
+        compile_command += " -o " + output + " ";
+        compile_command += flags;
+        compile_command += " .dbn.cpp ";
+    } else {
+        // Compile and link separately, for the object to keep its path
+        compile_command += " -c -o " + object + " ";
+        compile_command += flags;
+        compile_command += " .dbn.cpp && ";
+        compile_command += cxx;
+        compile_command += " -o " + output + " ";
+        compile_command += object + " ";
+        compile_command += flags;
+    }
+
     int compile_result = system(compile_command.c_str());
 
     if (compile_result) {
@@ -733,19 +1080,34 @@ int dll::processor::process_file(const dllp::options& opt, const std::vector<std
         return 1;
     }
 
-    //2. Generate the executable
+    //2. Execute the network directly with the dynamic backend
 
-    if (!dllp::compile_exe(opt, actions, source_file, t, layers)) {
+    if (opt.dynamic && !dllp::is_sweep(actions)) {
+        return dllp::execute_dynamic(t, layers, dllp::final_actions(t, actions));
+    }
+
+    //3. Generate the executable
+
+    const auto program_actions = dllp::is_sweep(actions) ? dllp::sweep_actions(actions) : actions;
+
+    std::string exe;
+
+    if (!dllp::compile_exe(opt, program_actions, t, layers, exe)) {
         return 1;
     }
 
-    //3. Run the generated program
+    if (dllp::is_sweep(actions)) {
+        std::string report;
+        return dllp::run_sweep(opt, t, exe, report) ? 0 : 1;
+    }
+
+    //4. Run the generated program
 
     if (!opt.quiet) {
         std::cout << "Executing the program" << std::endl;
     }
 
-    auto exec_result = system("./.dbn.out");
+    auto exec_result = system(exe.c_str());
 
     if (exec_result) {
         std::cout << "Impossible to execute the generated file" << std::endl;
@@ -765,13 +1127,35 @@ std::string dll::processor::process_file_result(const dllp::options& opt, const
         return "";
     }
 
-    //2. Generate the executable
+    //2. Execute the network directly with the dynamic backend
+
+    if (opt.dynamic && !dllp::is_sweep(actions)) {
+        std::stringstream result;
+
+        auto* buffer = std::cout.rdbuf(result.rdbuf());
+        dllp::execute_dynamic(t, layers, dllp::final_actions(t, actions));
+        std::cout.rdbuf(buffer);
+
+        return result.str();
+    }
+
+    //3. Generate the executable
+
+    const auto program_actions = dllp::is_sweep(actions) ? dllp::sweep_actions(actions) : actions;
+
+    std::string exe;
 
-    if (!dllp::compile_exe(opt, actions, source_file, t, layers)) {
+    if (!dllp::compile_exe(opt, program_actions, t, layers, exe)) {
         return "";
     }
 
-    //3. Execute and return the result directly
+    if (dllp::is_sweep(actions)) {
+        std::string report;
+        dllp::run_sweep(opt, t, exe, report);
+        return report;
+    }
+
+    //4. Execute and return the result directly
 
-    return dllp::command_result("./.dbn.out");
+    return dllp::command_result(exe);
 }
@@ -0,0 +1,261 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cpp_utils/string.hpp"
+
+#include "parse_utils.hpp"
+#include "sweep.hpp"
+
+namespace {
+
+/*!
+ * \brief The result of one task of a sweep
+ */
+struct sweep_result {
+    bool success        = false; ///< Indicates if the task was executed successfully
+    bool has_ft_error   = false; ///< Indicates if the training error was found
+    bool has_test_error = false; ///< Indicates if the test error was found
+    double ft_error     = 0.0;   ///< The training error
+    double test_error   = 0.0;   ///< The test error
+};
+
+/*!
+ * \brief Returns the log file of the given task
+ */
+std::string log_file(size_t task) {
+    return ".dllp_sweep_" + std::to_string(task) + ".log";
+}
+
+/*!
+ * \brief Start one task of the sweep in a child process
+ *
+ * \param t The task, with the description of the sweep
+ * \param exe The compiled program
+ * \param task The index of the task
+ * \param first_core The first core of the task
+ * \param cores The number of cores of the task
+ *
+ * \return the pid of the child process, -1 on failure
+ */
+pid_t start_task(const dll::processor::task& t, const std::string& exe, size_t task, size_t first_core, size_t cores) {
+    const auto& sweep = t.sweep;
+
+    // The strings are prepared before the fork, the child only does system calls before exec
+    const auto output  = log_file(task);
+    const auto threads = std::to_string(cores);
+    const auto seed    = task < sweep.seeds.size() ? std::to_string(sweep.seeds[task]) : std::string();
+
+    pid_t pid = fork();
+
+    if (pid != 0) {
+        return pid;
+    }
+
+    int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (size_t c = first_core; c < first_core + cores; ++c) {
+        CPU_SET(c, &set);
+    }
+
+    sched_setaffinity(0, sizeof(set), &set);
+
+    // The BLAS libraries only use the cores of the task
+    setenv("OMP_NUM_THREADS", threads.c_str(), 1);
+    setenv("MKL_NUM_THREADS", threads.c_str(), 1);
+
+    if (!seed.empty()) {
+        setenv("DLLP_SEED", seed.c_str(), 1);
+    }
+
+    if (task < sweep.samples.size()) {
+        setenv("DLLP_SWEEP_SAMPLES", sweep.samples[task].c_str(), 1);
+        setenv("DLLP_SWEEP_LABELS", sweep.labels[task].c_str(), 1);
+    }
+
+    execl(exe.c_str(), exe.c_str(), static_cast<char*>(nullptr));
+
+    _exit(127);
+}
+
+/*!
+ * \brief Extract the results of a task from its log file
+ */
+void parse_result(size_t task, sweep_result& result) {
+    for (auto& line : dllp::read_lines(log_file(task))) {
+        if (dllp::starts_with(line, "Train Classification Error:")) {
+            result.ft_error     = std::stod(dllp::extract_value(line, "Train Classification Error:"));
+            result.has_ft_error = true;
+        } else if (dllp::starts_with(line, "Error rate: ")) {
+            result.test_error     = std::stod(dllp::extract_value(line, "Error rate: "));
+            result.has_test_error = true;
+        }
+    }
+}
+
+/*!
+ * \brief Append the mean and the standard deviation of the given values to
+ * the report
+ */
+void append_statistics(std::ostream& out, const std::string& name, const std::vector<double>& values) {
+    if (values.empty()) {
+        return;
+    }
+
+    double mean = 0.0;
+
+    for (auto v : values) {
+        mean += v;
+    }
+
+    mean /= values.size();
+
+    double stddev = 0.0;
+
+    for (auto v : values) {
+        stddev += (v - mean) * (v - mean);
+    }
+
+    stddev = std::sqrt(stddev / values.size());
+
+    out << "Mean " << name << ": " << mean << std::endl;
+    out << "Stddev " << name << ": " << stddev << std::endl;
+}
+
+} //end of anonymous namespace
+
+bool dllp::run_sweep(const dll::processor::options& opt, const dll::processor::task& t, const std::string& exe, std::string& report) {
+    const auto& sweep = t.sweep;
+
+    const size_t tasks = sweep.tasks();
+
+    if (!tasks) {
+        std::cout << "dllp: error: sweep is not possible without seeds or training sources" << std::endl;
+        return false;
+    }
+
+    const size_t cores = std::max(1U, std::thread::hardware_concurrency());
+
+    // Each slot is a set of cores, running one task at a time
+    const size_t task_cores = sweep.threads ? std::min(sweep.threads, cores) : std::max<size_t>(1, cores / tasks);
+    const size_t slots      = std::max<size_t>(1, cores / task_cores);
+
+    if (!opt.quiet) {
+        std::cout << "Sweep: " << tasks << " tasks, " << std::min(slots, tasks) << " in parallel with " << task_cores << " cores each" << std::endl;
+    }
+
+    std::vector<sweep_result> results(tasks);
+    std::vector<pid_t> running(slots, -1);
+    std::vector<size_t> running_task(slots);
+
+    size_t next = 0;
+    size_t done = 0;
+
+    while (done < tasks) {
+        // Fill all the free slots
+        for (size_t s = 0; s < slots && next < tasks; ++s) {
+            if (running[s] == -1) {
+                running[s] = start_task(t, exe, next, s * task_cores, task_cores);
+
+                if (running[s] == -1) {
+                    std::cout << "dllp: error: impossible to start the task " << next << std::endl;
+                    ++done;
+                } else {
+                    running_task[s] = next;
+                }
+
+                ++next;
+            }
+        }
+
+        int status = 0;
+        pid_t pid  = wait(&status);
+
+        if (pid == -1) {
+            break;
+        }
+
+        for (size_t s = 0; s < slots; ++s) {
+            if (running[s] == pid) {
+                auto& result = results[running_task[s]];
+
+                result.success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+                parse_result(running_task[s], result);
+
+                running[s] = -1;
+                ++done;
+            }
+        }
+    }
+
+    std::stringstream out;
+
+    out << "Sweep Report" << std::endl;
+
+    std::vector<double> ft_errors;
+    std::vector<double> test_errors;
+
+    for (size_t task = 0; task < tasks; ++task) {
+        auto& result = results[task];
+
+        out << "Task " << task << ":";
+
+        if (task < sweep.seeds.size()) {
+            out << " seed=" << sweep.seeds[task];
+        }
+
+        if (task < sweep.samples.size()) {
+            out << " samples=" << sweep.samples[task];
+        }
+
+        if (!result.success) {
+            out << " failed (see " << log_file(task) << ")";
+        }
+
+        if (result.has_ft_error) {
+            out << " train_error=" << result.ft_error;
+            ft_errors.push_back(result.ft_error);
+        }
+
+        if (result.has_test_error) {
+            out << " test_error=" << result.test_error;
+            test_errors.push_back(result.test_error);
+        }
+
+        out << std::endl;
+    }
+
+    append_statistics(out, "train error", ft_errors);
+    append_statistics(out, "test error", test_errors);
+
+    report = out.str();
+
+    std::cout << report;
+
+    return std::all_of(results.begin(), results.end(), [](auto& result) { return result.success; });
+}
@@ -85,3 +85,31 @@ TEST_CASE("dbn/svm/3", "dbn::svm_simple") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.2);
 }
+
+TEST_CASE("dbn/svm/4", "dbn::svm_reuse_problem") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    svm::rbf_grid grid;
+    grid.c_steps     = 2;
+    grid.gamma_steps = 2;
+
+    REQUIRE(dbn->svm_grid_search(dataset.training_images, dataset.training_labels, 3, grid));
+
+    // The problem of the grid search is used again for the training
+    REQUIRE(dbn->svm_train());
+
+    auto test_error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::svm_predictor());
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.2);
+}
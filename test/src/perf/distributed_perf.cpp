@@ -0,0 +1,119 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <thread>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+using distributed_dbn_t = dll::dbn_desc<
+    dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 500>::layer_t,
+        dll::dense_layer_desc<500, 250>::layer_t,
+        dll::dense_layer_desc<250, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+    dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<100>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+constexpr size_t distributed_epochs = 10;
+
+/*!
+ * \brief Fine-tune one rank and return its final error
+ */
+template <typename Dataset>
+double train_rank(dll::communicator& comm, Dataset& dataset) {
+    auto dbn = std::make_unique<distributed_dbn_t>();
+
+    dbn->distributed = &comm;
+
+    return dbn->fine_tune(dataset.training_images, dataset.training_labels, distributed_epochs);
+}
+
+} // end of anonymous namespace
+
+// Scaling of the distributed fine-tuning.
+//
+// When DLL_RANK and DLL_PEERS are set, this process is one rank of a real
+// cluster. Otherwise, 1 to 4 ranks are run on the local host.
+TEST_CASE("dbn/distributed/perf/1", "[dbn][mnist][sgd][perf]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(8000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    const size_t samples = distributed_epochs * dataset.training_images.size();
+
+    if (std::getenv("DLL_PEERS")) {
+        dll::communicator comm;
+        REQUIRE(comm.connect_from_environment());
+
+        dll::stop_timer timer;
+        timer.start();
+
+        auto ft_error = train_rank(comm, dataset);
+
+        auto duration = std::max(size_t(1), timer.stop());
+
+        std::cout << "rank " << comm.rank() << "/" << comm.size() << ": " << 1000.0 * samples / duration << " samples/s, ft_error:" << ft_error << std::endl;
+
+        CHECK(ft_error < 5e-2);
+
+        return;
+    }
+
+    double base = 0.0;
+
+    for (size_t ranks = 1; ranks <= 4; ranks *= 2) {
+        std::vector<std::string> peers;
+
+        for (size_t r = 0; r < ranks; ++r) {
+            peers.push_back("127.0.0.1:" + std::to_string(27100 + 10 * ranks + r));
+        }
+
+        std::vector<double> errors(ranks, 1.0);
+        std::vector<std::thread> threads;
+
+        dll::stop_timer timer;
+        timer.start();
+
+        for (size_t r = 0; r < ranks; ++r) {
+            threads.emplace_back([&, r] {
+                dll::communicator comm;
+
+                if (comm.connect(r, peers)) {
+                    errors[r] = train_rank(comm, dataset);
+                }
+            });
+        }
+
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        auto duration = std::max(size_t(1), timer.stop());
+
+        const double throughput = 1000.0 * samples / duration;
+
+        if (ranks == 1) {
+            base = throughput;
+        }
+
+        std::cout << ranks << " ranks: " << throughput << " samples/s (x" << throughput / base << "), ft_error:" << errors[0] << std::endl;
+
+        // All the replicas hold the same network
+        for (size_t r = 1; r < ranks; ++r) {
+            CHECK(errors[r] == errors[0]);
+        }
+
+        CHECK(errors[0] < 5e-2);
+    }
+}
@@ -0,0 +1,130 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "dll_test.hpp"
+
+#include "dll/generators.hpp"
+#include "dll/util/spsc_ring.hpp"
+#include "dll/util/timers.hpp"
+
+namespace {
+
+constexpr size_t handoffs = 1000000;
+constexpr size_t slots    = 2;
+
+// The lock-based handoff previously used by the threaded generators
+size_t locked_handoff() {
+    std::mutex main_lock;
+    std::condition_variable condition;
+    std::condition_variable ready_condition;
+
+    size_t head = 0;
+    size_t tail = 0;
+
+    dll::stop_timer timer;
+    timer.start();
+
+    std::thread producer([&] {
+        for (size_t i = 0; i < handoffs; ++i) {
+            std::unique_lock<std::mutex> ulock(main_lock);
+            condition.wait(ulock, [&] { return head - tail < slots; });
+            ++head;
+            ready_condition.notify_one();
+        }
+    });
+
+    for (size_t i = 0; i < handoffs; ++i) {
+        std::unique_lock<std::mutex> ulock(main_lock);
+        ready_condition.wait(ulock, [&] { return head > i; });
+        ++tail;
+        condition.notify_one();
+    }
+
+    producer.join();
+
+    return timer.stop();
+}
+
+size_t ring_handoff() {
+    dll::spsc_ring ring(slots);
+
+    dll::stop_timer timer;
+    timer.start();
+
+    std::thread producer([&] {
+        while (ring.producer_acquire(handoffs, [] {}) != size_t(-1)) {
+            ring.producer_publish();
+        }
+    });
+
+    for (size_t i = 0; i < handoffs; ++i) {
+        ring.consumer_wait(i);
+        ring.consumer_release();
+    }
+
+    ring.stop();
+    producer.join();
+
+    return timer.stop();
+}
+
+template <typename G>
+double generator_throughput(G& generator, size_t epochs) {
+    size_t batches = 0;
+
+    dll::stop_timer timer;
+    timer.start();
+
+    for (size_t e = 0; e < epochs; ++e) {
+        generator.reset();
+
+        while (generator.has_next_batch()) {
+            auto batch = generator.data_batch();
+            cpp_unused(batch);
+
+            generator.next_batch();
+            ++batches;
+        }
+    }
+
+    auto duration = std::max(size_t(1), timer.stop());
+
+    return 1000.0 * batches / duration;
+}
+
+} // end of anonymous namespace
+
+TEST_CASE("generator/perf/handoff", "[generator][perf]") {
+    auto locked = locked_handoff();
+    auto ring   = ring_handoff();
+
+    std::cout << "mutex/condvar handoff: " << 1000.0 * handoffs / std::max(size_t(1), locked) << " batches/s" << std::endl;
+    std::cout << "spsc_ring handoff:     " << 1000.0 * handoffs / std::max(size_t(1), ring) << " batches/s" << std::endl;
+}
+
+TEST_CASE("generator/perf/threaded", "[generator][perf]") {
+    std::vector<etl::dyn_matrix<float, 1>> images(10000, etl::dyn_matrix<float, 1>(28 * 28));
+    std::vector<size_t> labels(10000);
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        images[i] = etl::uniform_generator(0.0, 255.0);
+        labels[i] = i % 10;
+    }
+
+    using inmemory_t  = dll::inmemory_data_generator_desc<dll::batch_size<64>, dll::categorical, dll::noise<10>>;
+    using outmemory_t = dll::outmemory_data_generator_desc<dll::batch_size<64>, dll::big_batch_size<4>, dll::categorical, dll::threaded>;
+
+    auto inmemory  = dll::make_generator(images, labels, 10, inmemory_t{});
+    auto outmemory = dll::make_generator(images, labels, images.size(), 10, outmemory_t{});
+
+    std::cout << "inmemory augmented:  " << generator_throughput(*inmemory, 5) << " batches/s" << std::endl;
+    std::cout << "outmemory threaded:  " << generator_throughput(*outmemory, 5) << " batches/s" << std::endl;
+}
@@ -0,0 +1,71 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <thread>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+template <template <typename> typename Trainer>
+using hogwild_dbn_t = dll::dbn_desc<
+    dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 500>::layer_t,
+        dll::dense_layer_desc<500, 250>::layer_t,
+        dll::dense_layer_desc<250, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+    dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>, dll::trainer<Trainer>>::dbn_t;
+
+/*!
+ * \brief Fine-tune a network and return the reduction of the error per second
+ */
+template <typename DBN, typename Dataset>
+double error_per_second(const char* name, size_t threads, Dataset& dataset) {
+    auto dbn = std::make_unique<DBN>();
+
+    if constexpr (std::is_same<DBN, hogwild_dbn_t<dll::hogwild_trainer>>::value) {
+        dbn->hogwild_threads = threads;
+    }
+
+    const double initial = dbn->evaluate_error(dataset.training_images, dataset.training_labels);
+
+    dll::stop_timer timer;
+    timer.start();
+
+    auto ft_error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 10);
+
+    auto duration = std::max(size_t(1), timer.stop());
+
+    const double speed = 1000.0 * (initial - ft_error) / duration;
+
+    std::cout << name << " (" << threads << " threads): " << duration << "ms, ft_error:" << ft_error << ", " << speed << " error/s" << std::endl;
+
+    CHECK(ft_error < 5e-2);
+
+    return speed;
+}
+
+} // end of anonymous namespace
+
+// Convergence per second of the synchronous and the Hogwild trainers
+TEST_CASE("dbn/hogwild/perf/1", "[dbn][mnist][sgd][perf]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(8000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    error_per_second<hogwild_dbn_t<dll::sgd_trainer>>("sgd_trainer", 1, dataset);
+
+    for (size_t threads = 1; threads <= std::max(1U, std::thread::hardware_concurrency()); threads *= 2) {
+        error_per_second<hogwild_dbn_t<dll::hogwild_trainer>>("hogwild_trainer", threads, dataset);
+    }
+}
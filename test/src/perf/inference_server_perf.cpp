@@ -0,0 +1,290 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// Drive an inference server with concurrent clients
+TEST_CASE("inference/server/perf/1", "[dbn][mnist][perf]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 250>::layer_t,
+            dll::dense_layer_desc<250, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<100>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    constexpr size_t clients  = 16;
+    constexpr size_t requests = 2000;
+
+    // Baseline: one sample at a time
+    {
+        dll::stop_timer timer;
+        timer.start();
+
+        for (size_t i = 0; i < clients * requests / 10; ++i) {
+            auto result = dbn->features(dataset.training_images[i % dataset.training_images.size()]);
+            cpp_unused(result);
+        }
+
+        auto duration = std::max(size_t(1), timer.stop());
+
+        std::cout << "single-sample: " << 1000.0 * (clients * requests / 10) / duration << " requests/s" << std::endl;
+    }
+
+    auto server = dbn->make_inference_server(64, std::chrono::microseconds(500));
+
+    std::vector<std::thread> threads;
+
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c] {
+            for (size_t i = 0; i < requests; ++i) {
+                auto future = server->submit(dataset.training_images[(c * requests + i) % dataset.training_images.size()]);
+                auto result = future.get();
+                cpp_unused(result);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    auto stats = server->stats();
+
+    std::cout << "server: " << stats.throughput << " requests/s" << std::endl;
+    std::cout << "    p50: " << stats.p50 << "us" << std::endl;
+    std::cout << "    p99: " << stats.p99 << "us" << std::endl;
+    std::cout << "  batch: " << stats.average_batch() << std::endl;
+
+    REQUIRE(stats.requests == clients * requests);
+}
+
+// Drive an inference server with several workers per replica (one replica
+// per NUMA node with DLL_NUMA=replicate)
+TEST_CASE("inference/server/perf/2", "[dbn][mnist][perf]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 250>::layer_t,
+            dll::dense_layer_desc<250, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<100>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    constexpr size_t clients  = 16;
+    constexpr size_t requests = 2000;
+
+    auto server = dbn->make_inference_server(64, std::chrono::microseconds(500), {}, 4);
+
+    std::vector<std::thread> threads;
+
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c] {
+            for (size_t i = 0; i < requests; ++i) {
+                auto future = server->submit(dataset.training_images[(c * requests + i) % dataset.training_images.size()]);
+                auto result = future.get();
+                cpp_unused(result);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    auto stats = server->stats();
+
+    std::cout << "server: " << stats.throughput << " requests/s" << std::endl;
+    std::cout << "    p50: " << stats.p50 << "us" << std::endl;
+    std::cout << "    p99: " << stats.p99 << "us" << std::endl;
+    std::cout << "  batch: " << stats.average_batch() << std::endl;
+
+    size_t total = 0;
+
+    for (size_t n = 0; n < server->replica_count(); ++n) {
+        auto node = server->stats(n);
+
+        std::cout << "  node " << n << ": " << node.throughput << " requests/s" << std::endl;
+
+        total += node.requests;
+    }
+
+    REQUIRE(stats.requests == clients * requests);
+    REQUIRE(total == stats.requests);
+}
+
+// Speed of the block-sparse weights of a pruned network
+TEST_CASE("inference/sparse/perf/1", "[dbn][mnist][perf]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 1000>::layer_t,
+            dll::dense_layer_desc<1000, 1000>::layer_t,
+            dll::dense_layer_desc<1000, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<100>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 100, 28 * 28> batch;
+
+    for (size_t i = 0; i < 100; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    auto engine = dbn->make_inference_engine(100);
+
+    auto timed = [&](const char* name) {
+        dll::stop_timer timer;
+        timer.start();
+
+        for (size_t i = 0; i < 100; ++i) {
+            auto output = engine.forward(batch);
+            cpp_unused(output);
+        }
+
+        std::cout << name << ": " << timer.stop() << "ms" << std::endl;
+    };
+
+    timed("dense");
+
+    for (double sparsity : {0.5, 0.8, 0.9, 0.95}) {
+        dbn->prune(sparsity, dll::prune_scope::LAYER, 8);
+
+        REQUIRE(engine.sparsify(0.0) == 3);
+
+        std::cout << "sparsity " << sparsity << " (" << engine.sparse_memory() / 1024 << "KB) ";
+        timed("sparse");
+
+        engine.densify();
+    }
+}
+
+// Startup time of a service: parsing the model or mapping it
+TEST_CASE("inference/mapped/perf/1", "[dbn][mnist][perf]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 2000>::layer_t,
+            dll::dense_layer_desc<2000, 2000>::layer_t,
+            dll::dense_layer_desc<2000, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<100>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->store("/tmp/dll_perf.dat");
+    REQUIRE(dbn->store_mapped("/tmp/dll_perf.dllm"));
+
+    // Startup until the first prediction
+    {
+        dll::stop_timer timer;
+        timer.start();
+
+        auto service = std::make_unique<dbn_t>();
+        service->load("/tmp/dll_perf.dat");
+
+        auto engine = service->make_inference_engine(1);
+        auto output = engine.forward(etl::reshape(dataset.training_images[0], 1, 28 * 28));
+        cpp_unused(output);
+
+        std::cout << "load: " << timer.stop() << "ms" << std::endl;
+    }
+
+    {
+        dll::stop_timer timer;
+        timer.start();
+
+        auto service = std::make_unique<dbn_t>();
+
+        dll::mapped_model<float> model("/tmp/dll_perf.dllm");
+
+        auto engine = service->make_inference_engine(1);
+        REQUIRE(engine.map(model));
+
+        auto output = engine.forward(etl::reshape(dataset.training_images[0], 1, 28 * 28));
+        cpp_unused(output);
+
+        std::cout << "mapped: " << timer.stop() << "ms" << std::endl;
+    }
+
+    std::remove("/tmp/dll_perf.dat");
+    std::remove("/tmp/dll_perf.dllm");
+}
+
+// Latency of the single-sample path, compared to the network
+TEST_CASE("inference/one/perf/1", "[dbn][mnist][perf]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::dense_layer_desc<500, 250>::layer_t,
+            dll::dense_layer_desc<250, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<100>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto engine = dbn->make_inference_engine(1);
+
+    etl::fast_dyn_matrix<float, 10> output;
+
+    constexpr size_t requests = 20000;
+
+    auto latencies = [&](const char* name, auto&& request) {
+        std::vector<double> times(requests);
+
+        for (size_t i = 0; i < requests; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            request(dataset.training_images[i % dataset.training_images.size()]);
+            auto end = std::chrono::steady_clock::now();
+
+            times[i] = std::chrono::duration<double, std::micro>(end - start).count();
+        }
+
+        std::sort(times.begin(), times.end());
+
+        std::cout << name << ": p50=" << times[requests / 2] << "us p99=" << times[requests * 99 / 100] << "us" << std::endl;
+    };
+
+    latencies("features", [&](auto& sample) {
+        auto result = dbn->features(sample);
+        cpp_unused(result);
+    });
+
+    latencies("forward_one", [&](auto& sample) {
+        engine.forward_one(sample, output);
+    });
+}
@@ -46,3 +46,28 @@ TEST_CASE("rbm/perf/2", "rbm::slow") {
 
     dll::dump_timers();
 }
+
+// Scaling of the asynchronous CD training with the number of workers
+TEST_CASE("rbm/perf/async", "rbm::slow") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(10000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto train = [&](auto& rbm, const char* name) {
+        dll::stop_timer timer;
+        timer.start();
+
+        auto error = rbm.train(dataset.training_images, 10);
+
+        std::cout << name << ": " << timer.stop() << "ms, error:" << error << std::endl;
+
+        REQUIRE(error < 5e-2);
+    };
+
+    dll::rbm_desc<28 * 28, 500, dll::batch_size<50>, dll::momentum>::layer_t sync_rbm;
+    dll::rbm_desc<28 * 28, 500, dll::batch_size<50>, dll::momentum, dll::async_cd<>>::layer_t async_rbm;
+
+    train(sync_rbm, "sync");
+    train(async_rbm, "async");
+}
@@ -0,0 +1,159 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// The steady state of the training must not allocate: once the first epoch
+// has sized all the buffers, each batch is trained without any heap
+// allocation.
+//
+// The batches are trained inside a worker_section: the dispatch of the
+// tasks to the thread pools (of the kernels and of ETL) is not part of the
+// library and is not checked here.
+
+#include <memory>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/grouped_conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/rbm/rbm.hpp"
+#include "dll/dbn.hpp"
+#include "dll/util/allocation_counter.hpp"
+
+DLL_DEFINE_ALLOCATION_COUNTER
+
+namespace {
+
+constexpr size_t warmup_batches = 5; ///< The batches of the first epoch
+constexpr size_t steady_batches = 5; ///< The batches checked for allocations
+
+/*!
+ * \brief Train the network with SGD on random batches and returns the
+ * number of allocations of the batches after the first epoch
+ */
+template <typename DBN, typename Inputs>
+size_t sgd_allocations(DBN& dbn, Inputs& inputs) {
+    etl::fast_dyn_matrix<float, etl::decay_traits<Inputs>::template dim<0>(), 10> labels;
+
+    inputs = etl::uniform_generator(-1.0, 1.0);
+    labels = 0;
+
+    for (size_t i = 0; i < etl::dim<0>(labels); ++i) {
+        labels(i, i % 10) = 1.0;
+    }
+
+    dll::sgd_trainer<DBN> trainer(dbn);
+
+    dll::worker_section section;
+
+    for (size_t b = 0; b < warmup_batches; ++b) {
+        trainer.train_batch(0, inputs, labels);
+    }
+
+    dll::allocation_counter counter;
+
+    for (size_t b = 0; b < steady_batches; ++b) {
+        trainer.train_batch(1, inputs, labels);
+    }
+
+    return counter.count();
+}
+
+} //end of anonymous namespace
+
+TEST_CASE("unit/allocations/counter", "[unit][allocations]") {
+    dll::allocation_counter counter;
+
+    auto p = std::make_unique<int>(1);
+
+    REQUIRE(counter.count() == 1);
+}
+
+TEST_CASE("unit/allocations/dense", "[unit][allocations][dense][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<64, 32>::layer_t,
+            dll::dense_layer_desc<32, 10, dll::softmax>::layer_t>,
+        dll::momentum, dll::weight_decay<dll::decay_type::L2>, dll::batch_size<20>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 20, 64> inputs;
+
+    REQUIRE(sgd_allocations(*dbn, inputs) == 0);
+}
+
+TEST_CASE("unit/allocations/dense/clip", "[unit][allocations][dense][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<64, 32>::layer_t,
+            dll::dense_layer_desc<32, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::global_clip_gradients, dll::batch_size<20>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 20, 64> inputs;
+
+    REQUIRE(sgd_allocations(*dbn, inputs) == 0);
+}
+
+TEST_CASE("unit/allocations/conv", "[unit][allocations][conv][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 12, 12, 4, 3, 3, dll::relu>::layer_t,
+            dll::dense_layer_desc<4 * 10 * 10, 10, dll::softmax>::layer_t>,
+        dll::momentum, dll::batch_size<10>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 10, 1, 12, 12> inputs;
+
+    REQUIRE(sgd_allocations(*dbn, inputs) == 0);
+}
+
+TEST_CASE("unit/allocations/grouped_conv", "[unit][allocations][conv][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 12, 12, 4, 3, 3, dll::relu>::layer_t,
+            dll::depthwise_conv_layer_desc<4, 10, 10, 3, 3, dll::relu>::layer_t,
+            dll::grouped_conv_layer_desc<4, 8, 8, 4, 1, 1, 2, dll::relu>::layer_t,
+            dll::dense_layer_desc<4 * 8 * 8, 10, dll::softmax>::layer_t>,
+        dll::momentum, dll::batch_size<10>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 10, 1, 12, 12> inputs;
+
+    REQUIRE(sgd_allocations(*dbn, inputs) == 0);
+}
+
+TEST_CASE("unit/allocations/rbm", "[unit][allocations][rbm][cd]") {
+    using rbm_t = dll::rbm_desc<64, 32, dll::batch_size<20>, dll::momentum, dll::weight_decay<dll::decay_type::L2>>::layer_t;
+
+    auto rbm     = std::make_unique<rbm_t>();
+    auto trainer = std::make_unique<dll::cd1_trainer_t<rbm_t>>(*rbm);
+
+    etl::fast_dyn_matrix<float, 20, 64> inputs;
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+
+    dll::rbm_training_context context;
+
+    dll::worker_section section;
+
+    for (size_t b = 0; b < warmup_batches; ++b) {
+        trainer->train_batch(inputs, inputs, context);
+    }
+
+    dll::allocation_counter counter;
+
+    for (size_t b = 0; b < steady_batches; ++b) {
+        trainer->train_batch(inputs, inputs, context);
+    }
+
+    REQUIRE(counter.count() == 0);
+}
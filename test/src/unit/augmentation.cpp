@@ -328,3 +328,494 @@ TEST_CASE("unit/augment/mnist/8", "[dbn][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.3);
 }
+
+// Use an in-memory generator with several augmentation threads
+TEST_CASE("unit/augment/mnist/9", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<
+        dll::batch_size<20>, dll::big_batch_size<4>, dll::augmentation_threads<2>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 60);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// The number of batches cached by the threaded generators from a memory budget
+TEST_CASE("unit/augment/mnist/budget", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<
+        dll::batch_size<20>, dll::big_batch_budget<1>, dll::augmentation_threads<2>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    using threaded_generator_t = dll::outmemory_data_generator_desc<
+        dll::batch_size<20>, dll::big_batch_budget<1>, dll::threaded, dll::categorical, dll::scale_pre<255>>;
+
+    using free_generator_t = dll::outmemory_data_generator_desc<
+        dll::batch_size<20>, dll::big_batch_free_memory<10>, dll::threaded, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto threaded_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        threaded_generator_t{});
+
+    auto free_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        free_generator_t{});
+
+    const size_t data_bytes  = 20 * 28 * 28 * sizeof(float);
+    const size_t label_bytes = 20 * 10 * sizeof(float);
+
+    // 1MB of batches, rounded to the two augmentation threads
+    REQUIRE(train_generator->big_batch_size == (1024 * 1024 / data_bytes) / 2 * 2);
+    REQUIRE(threaded_generator->big_batch_size == 1024 * 1024 / (data_bytes + label_bytes));
+
+    // At most one epoch is cached
+    REQUIRE(free_generator->big_batch_size >= 1);
+    REQUIRE(free_generator->big_batch_size <= free_generator->batches());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 60);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*free_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use a memory-mapped generator on a binary dump of the dataset
+TEST_CASE("unit/augment/mnist/10", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    REQUIRE(dll::write_binary_dataset("/tmp/dll_mnist_train.bin", dataset.training_images, dataset.training_labels));
+
+    using train_generator_t = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::categorical>;
+
+    auto train_generator = dll::make_mmap_generator<float, 1>("/tmp/dll_mnist_train.bin", 10, train_generator_t{});
+
+    REQUIRE(train_generator->size() == dataset.training_images.size());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+}
+
+// Read the batches of a binary dump of the dataset asynchronously
+TEST_CASE("unit/augment/mnist/async", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(510);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    REQUIRE(dll::write_binary_dataset("/tmp/dll_mnist_async.bin", dataset.training_images, dataset.training_labels));
+
+    using mmap_generator_t  = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::categorical>;
+    using async_generator_t = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::async_reads<3>>;
+
+    auto mmap_generator  = dll::make_mmap_generator<float, 1>("/tmp/dll_mnist_async.bin", 10, mmap_generator_t{});
+    auto async_generator = dll::make_mmap_generator<float, 1>("/tmp/dll_mnist_async.bin", 10, async_generator_t{});
+
+    REQUIRE(async_generator->size() == dataset.training_images.size());
+    REQUIRE(async_generator->reader);
+
+    // The same shuffled order must give the same batches, including the last partial batch
+    async_generator->reset_shuffle();
+    mmap_generator->order = async_generator->order;
+
+    size_t seen = 0;
+    while (async_generator->has_next_batch()) {
+        auto data = async_generator->data_batch();
+        auto ref  = mmap_generator->data_batch();
+
+        REQUIRE(etl::dim<0>(data) == etl::dim<0>(ref));
+        REQUIRE(data.memory_start() != ref.memory_start());
+
+        for (size_t i = 0; i < etl::size(data); ++i) {
+            REQUIRE(data[i] == ref[i]);
+        }
+
+        seen += etl::dim<0>(data);
+
+        async_generator->next_batch();
+        mmap_generator->next_batch();
+    }
+
+    REQUIRE(seen == dataset.training_images.size());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*async_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+}
+
+// Use a pipeline of parallel stages, batched in the order of the source
+TEST_CASE("unit/augment/mnist/pipeline", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(510);
+    REQUIRE(!dataset.training_images.empty());
+
+    const size_t n = dataset.training_images.size();
+
+    auto binarized = dataset;
+    mnist::binarize_dataset(binarized);
+
+    // The raw pixels, decoded and binarized by the stages
+    auto generator = dll::make_pipeline(n, [&](size_t i) { return std::make_pair(i, dataset.training_labels[i]); }, 2)
+        .stage([&](size_t&& i) { return etl::dyn_matrix<float, 1>(dataset.training_images[i]); }, 3, "pipeline:decode")
+        .stage([](etl::dyn_matrix<float, 1>&& image) {
+            for (auto& v : image) {
+                v = v > 30.0f ? 1.0f : 0.0f;
+            }
+
+            return std::move(image);
+        }, 2, "pipeline:binarize")
+        .template generator<25>(10, 3);
+
+    REQUIRE(generator->size() == n);
+    REQUIRE(generator->batches() == (n + 24) / 25);
+
+    size_t seen = 0;
+    while (generator->has_next_batch()) {
+        auto& data   = generator->data_batch();
+        auto& labels = generator->label_batch();
+
+        for (size_t i = 0; i < etl::dim<0>(data); ++i) {
+            REQUIRE(etl::sum(etl::abs(data(i) - binarized.training_images[seen + i])) == 0.0f);
+            REQUIRE(labels(i, dataset.training_labels[seen + i]) == 1.0f);
+        }
+
+        seen += etl::dim<0>(data);
+
+        generator->next_batch();
+    }
+
+    REQUIRE(seen == n);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+}
+
+// Use a sharded out-memory generator, shuffled at each epoch
+TEST_CASE("unit/augment/mnist/11", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::outmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<2>, dll::sharded<60, 120>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    // A shuffled epoch still sees each sample exactly once
+    train_generator->reset_shuffle();
+
+    size_t seen = 0;
+    while (train_generator->has_next_batch()) {
+        seen += etl::dim<0>(train_generator->data_batch());
+        train_generator->next_batch();
+    }
+
+    REQUIRE(seen == dataset.training_images.size());
+}
+
+// Use an in-memory generator reusing the augmented samples for several epochs
+TEST_CASE("unit/augment/mnist/12", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::noise<20>, dll::augment_cache<4, 400>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 60);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    // Most of the samples were augmented only once every four epochs
+    CHECK(train_generator->augmented.hits > 0);
+    CHECK(train_generator->augmented.misses < 60 * 600);
+}
+
+// The fused crop and mirror gives the same images as the crop followed by the mirror
+TEST_CASE("unit/augment/crop_mirror/0", "[unit]") {
+    using desc = dll::inmemory_data_generator_desc<dll::random_crop<5, 4>, dll::horizontal_mirroring, dll::vertical_mirroring>;
+
+    etl::dyn_matrix<float, 3> image(3, 9, 8);
+    image = etl::sequence_generator(1.0);
+
+    dll::random_cropper<desc> cropper(image);
+    dll::random_mirrorer<desc> mirrorer(image);
+
+    for (size_t seed = 0; seed < 16; ++seed) {
+        etl::dyn_matrix<float, 3> expected(3, 4, 5);
+        etl::dyn_matrix<float, 3> fused(3, 4, 5);
+
+        dll::random_engine g1(seed);
+        cropper.transform_first(expected, image, g1);
+        mirrorer.transform(expected, g1);
+
+        dll::random_engine g2(seed);
+        cropper.transform_first_mirror(fused, image, mirrorer, g2);
+
+        REQUIRE(etl::sum(etl::abs(expected - fused)) == Approx(0.0f));
+    }
+}
+
+// Train a network on the features of another network
+TEST_CASE("unit/augment/features/1", "[dbn][unit]") {
+    using features_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t>,
+        dll::batch_size<25>>::dbn_t;
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    auto features_dbn = std::make_unique<features_dbn_t>();
+
+    dll::feature_data_generator<std::decay_t<decltype(*generator)>, features_dbn_t> features(*generator, *features_dbn, true);
+
+    REQUIRE(features.size() == dataset.training_images.size());
+    REQUIRE(features.dimensions() == 1);
+
+    features.set_test();
+    features.reset();
+
+    while (features.has_next_batch()) {
+        auto expected = features_dbn->forward_batch(generator->data_batch());
+
+        REQUIRE(etl::dim<1>(features.data_batch()) == 100);
+        REQUIRE(etl::sum(etl::abs(expected - features.data_batch())) == Approx(0.0f));
+        REQUIRE(etl::sum(features.label_batch()) == Approx(float(etl::dim<0>(expected))));
+
+        features.next_batch();
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(features, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 0.1);
+}
+
+// The samples of the caller are read in place
+TEST_CASE("unit/augment/borrowed/1", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    const size_t n = dataset.training_images.size();
+
+    // All the samples in one block of memory
+    etl::dyn_matrix<float, 2> storage(n, 28 * 28);
+
+    std::vector<etl::custom_dyn_matrix<float, 1>> samples;
+
+    for (size_t i = 0; i < n; ++i) {
+        storage(i) = dataset.training_images[i];
+        samples.emplace_back(storage.memory_start() + i * 28 * 28, 28 * 28);
+    }
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical>;
+
+    auto contiguous = dll::make_borrowed_generator(samples, dataset.training_labels, n, 10, generator_t{});
+    auto gathered   = dll::make_borrowed_generator(dataset.training_images, dataset.training_labels, n, 10, generator_t{});
+
+    REQUIRE(contiguous->contiguous());
+    REQUIRE(!gathered->contiguous());
+
+    contiguous->reset();
+
+    REQUIRE(contiguous->data_batch().memory_start() == storage.memory_start());
+
+    contiguous->reset_shuffle();
+    gathered->reset_shuffle();
+
+    auto check = [&](auto& generator) {
+        size_t seen = 0;
+
+        generator->reset();
+
+        while (generator->has_next_batch()) {
+            auto data   = generator->data_batch();
+            auto labels = generator->label_batch();
+
+            for (size_t i = 0; i < etl::dim<0>(data); ++i) {
+                // Find the sample to check its label
+                bool found = false;
+
+                for (size_t j = 0; j < n && !found; ++j) {
+                    if (etl::sum(etl::abs(data(i) - dataset.training_images[j])) == 0.0f && labels(i, dataset.training_labels[j]) == 1.0f) {
+                        found = true;
+                    }
+                }
+
+                REQUIRE(found);
+            }
+
+            seen += etl::dim<0>(data);
+
+            generator->next_batch();
+        }
+
+        REQUIRE(seen == n);
+    };
+
+    check(contiguous);
+    check(gathered);
+}
+
+// The labels of the auto-encoder generators are their data
+TEST_CASE("unit/augment/ae/aliased", "[unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    const size_t n = dataset.training_images.size();
+
+    using ae_generator_t    = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::autoencoder, dll::scale_pre<255>>;
+    using noisy_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::autoencoder, dll::scale_pre<255>, dll::noise<30>>;
+
+    auto generator = dll::make_generator(dataset.training_images, dataset.training_images, n, 10, ae_generator_t{});
+    auto noisy     = dll::make_generator(dataset.training_images, dataset.training_images, n, 10, noisy_generator_t{});
+
+    REQUIRE(generator->labels_as_data);
+    REQUIRE(noisy->labels_as_data);
+    REQUIRE(etl::size(generator->label_cache) == 0);
+    REQUIRE(etl::size(noisy->label_cache) == 0);
+
+    // Labels different from the data are still stored
+    auto copies   = dataset.training_images;
+    auto separate = dll::make_generator(dataset.training_images, copies, n, 10, ae_generator_t{});
+
+    REQUIRE(!separate->labels_as_data);
+    REQUIRE(etl::dim<0>(separate->label_cache) == n);
+
+    generator->reset_shuffle();
+    separate->reset_shuffle();
+
+    while (generator->has_next_batch()) {
+        REQUIRE(generator->label_batch().memory_start() == generator->data_batch().memory_start());
+        REQUIRE(etl::max(separate->data_batch()) <= 1.0f);
+        REQUIRE(etl::max(separate->label_batch()) <= 1.0f);
+
+        generator->next_batch();
+        separate->next_batch();
+    }
+
+    // The labels of the noisy generator are the data before noise
+    noisy->set_train();
+    noisy->reset();
+
+    size_t i = 0;
+
+    while (noisy->has_next_batch()) {
+        auto labels = noisy->label_batch();
+
+        for (size_t j = 0; j < etl::dim<0>(labels); ++j, ++i) {
+            REQUIRE(etl::sum(etl::abs(labels(j) - dataset.training_images[i] / 255.0f)) < 1e-3f);
+        }
+
+        noisy->next_batch();
+    }
+
+    REQUIRE(i == n);
+}
@@ -14,6 +14,7 @@
 #include "dll/neural/activation_layer.hpp"
 #include "dll/neural/batch_normalization_layer.hpp"
 #include "dll/pooling/mp_layer.hpp"
+#include "dll/utility/group_layer.hpp"
 #include "dll/network.hpp"
 #include "dll/datasets.hpp"
 
@@ -204,3 +205,119 @@ TEST_CASE("unit/bn/5", "[unit][bn]") {
     FT_CHECK_2_VAL(net, dataset, 50, 5e-2);
     TEST_CHECK_2(net, dataset, 0.25);
 }
+
+// Folding of the BN layers for inference
+TEST_CASE("unit/bn/fold/1", "[unit][bn]") {
+    constexpr size_t K = 4;
+
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, K, 5, 5, dll::no_activation>::layer_t,
+            dll::batch_normalization_4d_layer_desc<K, 24, 24>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<K * 24 * 24, 100, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<100>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 1000, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    net->fine_tune(dataset.train(), 5);
+
+    etl::fast_matrix<float, 25, 1, 28, 28> input;
+    input = etl::uniform_generator(0.0, 1.0);
+
+    auto expected = net->forward_batch(input);
+
+    REQUIRE(net->fold_batch_normalization() == 2);
+    REQUIRE(net->is_folded(1));
+    REQUIRE(net->is_folded(4));
+
+    auto engine = net->make_inference_engine(25);
+    auto output = engine.forward(input);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-3));
+    }
+}
+
+// The fused kernels must compute the same statistics as the reductions
+TEST_CASE("unit/bn/kernels/1", "[unit][bn]") {
+    etl::fast_matrix<float, 8, 3, 4, 4> input;
+    etl::fast_matrix<float, 8, 3, 4, 4> x_hat;
+    etl::fast_matrix<float, 8, 3, 4, 4> output;
+    etl::fast_matrix<float, 3> gamma;
+    etl::fast_matrix<float, 3> beta;
+    etl::fast_matrix<float, 3> mean;
+    etl::fast_matrix<float, 3> var;
+    etl::fast_matrix<float, 3> inv_var;
+
+    input = 100.0 + etl::uniform_generator(-1.0, 1.0);
+    gamma = 2.0;
+    beta  = 0.5;
+
+    dll::batch_norm_train_forward(input, x_hat, output, gamma, beta, mean, var, inv_var, 8, 3, 16, 1e-8f);
+
+    auto ref_mean = etl::force_temporary(etl::bias_batch_mean_4d(input));
+
+    for (size_t k = 0; k < 3; ++k) {
+        REQUIRE(mean(k) == Approx(ref_mean(k)).epsilon(1e-5));
+
+        float ref_var = 0.0;
+        for (size_t b = 0; b < 8; ++b) {
+            ref_var += etl::sum((input(b)(k) - ref_mean(k)) >> (input(b)(k) - ref_mean(k)));
+        }
+
+        REQUIRE(var(k) == Approx(ref_var / 128.0f).epsilon(1e-3));
+    }
+
+    // The normalized output has the mean beta
+    auto out_mean = etl::force_temporary(etl::bias_batch_mean_4d(output));
+
+    for (size_t k = 0; k < 3; ++k) {
+        REQUIRE(out_mean(k) == Approx(0.5f).epsilon(1e-3));
+    }
+}
+
+// The fused group must compute the same output as the separate layers
+TEST_CASE("unit/bn/fused/1", "[unit][bn]") {
+    constexpr size_t K = 4;
+
+    using group_t = dll::group_layer_desc<
+        dll::conv_layer_desc<1, 28, 28, K, 5, 5, dll::no_activation>::layer_t,
+        dll::batch_normalization_4d_layer_desc<K, 24, 24>::layer_t,
+        dll::activation_layer_desc<dll::function::RELU>::layer_t,
+        dll::mp_2d_layer_desc<K, 24, 24, 2, 2>::layer_t>::layer_t;
+
+    static_assert(group_t::fuse_next<1>::value, "BN and RELU must be fused");
+
+    group_t group;
+
+    auto& bn = std::get<1>(group.layers);
+
+    bn.mean  = etl::uniform_generator(-0.5, 0.5);
+    bn.var   = etl::uniform_generator(0.5, 1.5);
+    bn.gamma = etl::uniform_generator(0.5, 1.5);
+    bn.beta  = etl::uniform_generator(-0.5, 0.5);
+
+    etl::fast_matrix<float, 10, 1, 28, 28> input;
+    input = etl::uniform_generator(0.0, 1.0);
+
+    auto a = std::get<0>(group.layers).test_forward_batch(input);
+    auto b = std::get<1>(group.layers).test_forward_batch(a);
+    auto c = std::get<2>(group.layers).test_forward_batch(b);
+    auto expected = std::get<3>(group.layers).test_forward_batch(c);
+
+    etl::fast_matrix<float, 10, K, 12, 12> output;
+    group.test_forward_batch(output, input);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
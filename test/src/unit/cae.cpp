@@ -113,3 +113,28 @@ TEST_CASE("conv/ae/2", "[dense][dbn][mnist][sgd][ae]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.15);
 }
+
+// The direct upsampling kernels
+TEST_CASE("unit/upsample/kernels/1", "[unit][upsample]") {
+    etl::fast_matrix<float, 3, 2, 5, 4> input;
+    etl::fast_matrix<float, 3, 2, 10, 8> output;
+    etl::fast_matrix<float, 3, 2, 5, 4> errors;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    dll::upsample_2d_forward<2, 2>(output.memory_start(), input.memory_start(), 3 * 2, 5, 4);
+
+    etl::fast_matrix<float, 3, 2, 10, 8> expected;
+    expected = etl::upsample_3d<1, 2, 2>(input);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == expected[i]);
+    }
+
+    // The errors of each input are the sum of the errors of its block
+    dll::upsample_2d_backward<2, 2>(errors.memory_start(), output.memory_start(), 3 * 2, 5, 4);
+
+    for (size_t i = 0; i < etl::size(input); ++i) {
+        REQUIRE(errors[i] == Approx(4.0f * input[i]));
+    }
+}
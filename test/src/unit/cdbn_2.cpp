@@ -80,6 +80,46 @@ TEST_CASE("unit/cdbn/mnist/8", "[cdbn][ap][svm][unit]") {
     REQUIRE(test_error < 0.1);
 }
 
+// The pooling and transform layers between two RBMs are propagated at once
+TEST_CASE("unit/cdbn/mnist/9", "[cdbn][unit]") {
+    using layers_t = dll::dbn_layers<
+        dll::conv_rbm_desc<1, 28, 28, 20, 17, 17, dll::momentum, dll::batch_size<25>>::layer_t,
+        dll::mp_3d_layer_desc<20, 12, 12, 1, 2, 2>::layer_t,
+        dll::rectifier_layer_desc<>::layer_t,
+        dll::conv_rbm_desc<20, 6, 6, 10, 3, 3, dll::momentum, dll::batch_size<25>>::layer_t>;
+
+    using dbn_t       = dll::dbn_desc<layers_t>::dbn_t;
+    using spill_dbn_t = dll::dbn_desc<layers_t, dll::spill_pretrain>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->output_size() == 10 * 4 * 4);
+
+    auto initial = dbn->template layer_get<3>().w;
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    // The last RBM has been trained on the output of the run
+    REQUIRE(etl::sum(etl::abs(dbn->template layer_get<3>().w - initial)) > 0.0);
+
+    auto output = dbn->forward_one(dataset.training_images.front());
+    REQUIRE(output.size() == 10 * 4 * 4);
+
+    // The output of the run can also be spilled to a file
+    auto spill_dbn = std::make_unique<spill_dbn_t>();
+
+    auto spill_initial = spill_dbn->template layer_get<3>().w;
+
+    spill_dbn->pretrain(dataset.training_images, 5);
+
+    REQUIRE(etl::sum(etl::abs(spill_dbn->template layer_get<3>().w - spill_initial)) > 0.0);
+}
+
 TEST_CASE("hybrid/mnist/5", "[cdbn][rectifier][svm][unit]") {
     using dbn_t =
         dll::dyn_dbn_desc<dll::dbn_layers<
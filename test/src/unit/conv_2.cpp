@@ -10,6 +10,7 @@
 #include "dll_test.hpp"
 
 #include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dyn_conv_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/pooling/mp_layer.hpp"
@@ -92,3 +93,65 @@ TEST_CASE("unit/conv/sgd/8", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.25);
 }
+
+TEST_CASE("unit/conv/sgd/strided/1", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer<1, 28, 28, 6, 5, 5, dll::relu>,
+            dll::mp_2d_layer<6, 24, 24, 3, 3, dll::pool_stride<2>>,
+            dll::conv_layer<6, 11, 11, 6, 3, 3, dll::relu>,
+            dll::avgp_2d_layer<6, 9, 9, 3, 3, dll::pool_stride<2>>,
+            dll::dense_layer<6 * 4 * 4, 100, dll::relu>,
+            dll::dense_layer<100, 10, dll::softmax>
+        >,
+        dll::updater<dll::updater_type::ADAM>,
+        dll::batch_size<20>
+    >::dbn_t dbn_t;
+
+    static_assert(dbn_t::layer_type<1>::O2 == 11, "Invalid output of the strided max pooling");
+    static_assert(dbn_t::layer_type<3>::O3 == 4, "Invalid output of the strided average pooling");
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(2000);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->display();
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK(25, 6e-2);
+    TEST_CHECK(0.25);
+}
+
+// The kernel of the filter shape of the layer computes the same output as the generic code
+TEST_CASE("unit/conv/shape/1", "[unit][conv]") {
+    dll::dyn_conv_layer_desc<dll::relu, dll::fixed_shapes<>>::layer_t generic;
+    dll::dyn_conv_layer_desc<dll::relu, dll::fixed_shapes<dll::shape<5, 5>>>::layer_t fixed;
+
+    generic.init_layer(3, 14, 12, 4, 5, 5);
+    fixed.init_layer(3, 14, 12, 4, 5, 5);
+
+    REQUIRE(!generic.forward_kernel);
+    REQUIRE(fixed.forward_kernel);
+
+    generic.b = etl::normal_generator<float>();
+
+    fixed.w = generic.w;
+    fixed.b = generic.b;
+
+    etl::dyn_matrix<float, 4> input(5, 3, 14, 12);
+    etl::dyn_matrix<float, 4> output_generic(5, 4, 10, 8);
+    etl::dyn_matrix<float, 4> output_fixed(5, 4, 10, 8);
+
+    input = etl::normal_generator<float>();
+
+    generic.forward_batch(output_generic, input);
+    fixed.forward_batch(output_fixed, input);
+
+    for (size_t i = 0; i < etl::size(output_fixed); ++i) {
+        REQUIRE(output_fixed[i] == Approx(output_generic[i]).epsilon(1e-4));
+    }
+}
@@ -10,11 +10,19 @@
 #include "dll_test.hpp"
 
 #include "dll/neural/conv_layer.hpp"
+#include "dll/neural/conv_same_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
 #include "dll/neural/activation_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/pooling/avgp_layer.hpp"
+#include "dll/pooling/global_avgp_layer.hpp"
+#include "dll/neural/dyn_conv_layer.hpp"
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/pooling/dyn_mp_layer.hpp"
+#include "dll/pooling/dyn_global_avgp_layer.hpp"
+#include "dll/util/conv_tuner.hpp"
+#include "dll/util/pooling.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -70,3 +78,358 @@ TEST_CASE("unit/conv/sgd/10", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.22);
 }
+
+TEST_CASE("unit/conv/im2col/1", "[unit][conv]") {
+    etl::fast_matrix<float, 3, 2, 9, 8> input;
+    etl::fast_matrix<float, 4, 2, 3, 2> w;
+    etl::fast_matrix<float, 3, 4, 7, 7> errors;
+
+    input  = etl::uniform_generator(-1.0, 1.0);
+    w      = etl::uniform_generator(-1.0, 1.0);
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    // The im2col strategies must compute the same results as ETL
+
+    etl::fast_matrix<float, 3, 4, 7, 7> output;
+    dll::im2col_conv_forward(output, input, w);
+    etl::fast_matrix<float, 3, 4, 7, 7> output_ref = etl::ml::convolution_forward(input, w);
+
+    etl::fast_matrix<float, 3, 2, 9, 8> d_input;
+    dll::im2col_conv_backward(d_input, errors, w);
+    etl::fast_matrix<float, 3, 2, 9, 8> d_input_ref = etl::ml::convolution_backward(errors, w);
+
+    etl::fast_matrix<float, 4, 2, 3, 2> d_w;
+    dll::im2col_conv_backward_filter(d_w, input, errors);
+    etl::fast_matrix<float, 4, 2, 3, 2> d_w_ref = etl::ml::convolution_backward_filter(input, errors);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(output_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(d_input); ++i) {
+        REQUIRE(d_input[i] == Approx(d_input_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(d_w); ++i) {
+        REQUIRE(d_w[i] == Approx(d_w_ref[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/conv/fused/1", "[unit][conv][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<2, 12, 12, 4, 5, 5, dll::activation<dll::function::TANH>>::layer_t,
+            dll::mp_3d_layer_desc<4, 8, 8, 1, 2, 2>::layer_t,
+            dll::dense_layer_desc<4 * 4 * 4, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<5>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_matrix<float, 5, 2, 12, 12> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    // The fused convolution and pooling must compute the same results as the two layers
+    auto fused = dbn->test_forward_batch<1>(input);
+
+    auto conv = dbn->template layer_get<0>().test_forward_batch(input);
+    auto ref  = dbn->template layer_get<1>().test_forward_batch(conv);
+
+    REQUIRE(etl::size(fused) == etl::size(ref));
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(fused[i] == Approx(ref[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/conv/int8/1", "[unit][conv][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<2, 12, 12, 4, 5, 5, dll::activation<dll::function::TANH>>::layer_t,
+            dll::dense_layer_desc<4 * 8 * 8, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<5>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    std::vector<etl::fast_dyn_matrix<float, 2, 12, 12>> samples(20);
+    std::vector<size_t> labels(20);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = etl::uniform_generator(-1.0, 1.0);
+        labels[i]  = i % 10;
+    }
+
+    auto generator = make_generator(samples, labels, 10, dll::inmemory_data_generator_desc<dll::batch_size<5>, dll::categorical>{});
+
+    auto engine = dbn->make_inference_engine(5);
+
+    etl::fast_matrix<float, 5, 2, 12, 12> input;
+    for (size_t i = 0; i < 5; ++i) {
+        input(i) = samples[i];
+    }
+
+    etl::fast_matrix<float, 5, 10> ref;
+    ref = engine.forward(input);
+
+    engine.quantize(*generator);
+
+    REQUIRE(engine.is_quantized());
+
+    // The int8 outputs must stay close to the floating point outputs
+    auto output = engine.forward(input);
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(std::abs(output[i] - ref[i]) < 2e-2);
+    }
+}
+
+TEST_CASE("unit/conv/packed/1", "[unit][conv][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<2, 12, 12, 4, 5, 5, dll::activation<dll::function::TANH>>::layer_t,
+            dll::dense_layer_desc<4 * 8 * 8, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<5>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_matrix<float, 5, 2, 12, 12> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto engine = dbn->make_inference_engine(5);
+
+    // The weights of the small batches are packed by the engine
+    REQUIRE(engine.is_packed(0));
+    REQUIRE(engine.is_packed(1));
+    REQUIRE(engine.packed_memory() > 0);
+
+    etl::fast_matrix<float, 5, 10> ref;
+    ref = dbn->forward_batch(input);
+
+    auto output = engine.forward(input);
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(output[i] == Approx(ref[i]).epsilon(1e-4));
+    }
+
+    engine.unpack();
+
+    REQUIRE(!engine.is_packed(0));
+
+    auto unpacked = engine.forward(input);
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(unpacked[i] == Approx(ref[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/conv/channels_last/1", "[unit][conv][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<2, 12, 12, 4, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::mp_3d_layer_desc<4, 10, 10, 1, 2, 2>::layer_t,
+            dll::conv_same_desc<4, 5, 5, 6, 3, 3, dll::activation<dll::function::TANH>>::layer_t,
+            dll::dense_layer_desc<6 * 5 * 5, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::channels_last, dll::batch_size<5>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_matrix<float, 5, 2, 12, 12> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto engine = dbn->make_inference_engine(5);
+
+    REQUIRE(engine.is_packed(0));
+
+    // The convolutional stack is channels-last, the output is not
+    etl::fast_matrix<float, 5, 10> ref;
+    ref = dbn->forward_batch(input);
+
+    auto output = engine.forward(input);
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(output[i] == Approx(ref[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/conv/im2col/2", "[unit][conv]") {
+    etl::fast_matrix<float, 3, 2, 7, 6> input;
+    etl::fast_matrix<float, 2, 4, 3, 2> w;
+    etl::fast_matrix<float, 3, 4, 9, 7> errors;
+
+    input  = etl::uniform_generator(-1.0, 1.0);
+    w      = etl::uniform_generator(-1.0, 1.0);
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    // The im2col deconvolutions must compute the same results as ETL
+
+    etl::fast_matrix<float, 3, 4, 9, 7> output;
+    dll::im2col_deconv_forward(output, input, w);
+    etl::fast_matrix<float, 3, 4, 9, 7> output_ref = etl::conv_4d_full_flipped(input, w);
+
+    etl::fast_matrix<float, 3, 2, 7, 6> d_input;
+    dll::im2col_deconv_backward(d_input, errors, w);
+    etl::fast_matrix<float, 3, 2, 7, 6> d_input_ref = etl::conv_4d_valid_flipped(errors, w);
+
+    etl::fast_matrix<float, 2, 4, 3, 2> d_w;
+    dll::im2col_deconv_backward_filter(d_w, input, errors);
+    etl::fast_matrix<float, 2, 4, 3, 2> d_w_ref = etl::conv_4d_valid_filter_flipped(errors, input);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(output_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(d_input); ++i) {
+        REQUIRE(d_input[i] == Approx(d_input_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(d_w); ++i) {
+        REQUIRE(d_w[i] == Approx(d_w_ref[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/pooling/kernels/1", "[unit][pooling]") {
+    etl::fast_matrix<float, 3, 2, 8, 8> input;
+    etl::fast_matrix<float, 3, 2, 4, 4> errors;
+
+    input  = etl::uniform_generator(-1.0, 1.0);
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    // The direct kernels must compute the same results as ETL
+
+    std::vector<uint8_t> argmax(etl::size(errors));
+
+    etl::fast_matrix<float, 3, 2, 4, 4> mp;
+    dll::max_pool_2d_forward(mp.memory_start(), argmax.data(), input.memory_start(), 6, 8, 8, 2, 2);
+    etl::fast_matrix<float, 3, 2, 4, 4> mp_ref = etl::ml::max_pool_forward<2, 2>(input);
+
+    etl::fast_matrix<float, 3, 2, 8, 8> mp_d;
+    dll::max_pool_2d_backward(mp_d.memory_start(), argmax.data(), errors.memory_start(), 6, 8, 8, 2, 2);
+    etl::fast_matrix<float, 3, 2, 8, 8> mp_d_ref = etl::ml::max_pool_backward<2, 2>(input, mp_ref, errors);
+
+    etl::fast_matrix<float, 3, 2, 4, 4> avg;
+    dll::avg_pool_2d_forward(avg.memory_start(), input.memory_start(), 6, 8, 8, 2, 2);
+    etl::fast_matrix<float, 3, 2, 4, 4> avg_ref = etl::ml::avg_pool_forward<2, 2>(input);
+
+    for (size_t i = 0; i < etl::size(mp); ++i) {
+        REQUIRE(mp[i] == Approx(mp_ref[i]));
+        REQUIRE(avg[i] == Approx(avg_ref[i]));
+    }
+
+    for (size_t i = 0; i < etl::size(mp_d); ++i) {
+        REQUIRE(mp_d[i] == Approx(mp_d_ref[i]));
+    }
+
+    // The generic windows (2x4 here) must give the same results
+
+    etl::fast_matrix<float, 3, 2, 4, 2> mp_2;
+    dll::max_pool_2d_forward(mp_2.memory_start(), argmax.data(), input.memory_start(), 6, 8, 8, 2, 4);
+    etl::fast_matrix<float, 3, 2, 4, 2> mp_2_ref = etl::ml::max_pool_forward<2, 4>(input);
+
+    for (size_t i = 0; i < etl::size(mp_2); ++i) {
+        REQUIRE(mp_2[i] == Approx(mp_2_ref[i]));
+    }
+}
+
+TEST_CASE("unit/pooling/global/1", "[unit][pooling][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<2, 12, 12, 4, 5, 5, dll::activation<dll::function::TANH>>::layer_t,
+            dll::global_avgp_layer_desc<4, 8, 8>::layer_t,
+            dll::dense_layer_desc<4, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<5>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_matrix<float, 5, 2, 12, 12> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto conv   = dbn->template layer_get<0>().test_forward_batch(input);
+    auto pooled = dbn->template layer_get<1>().test_forward_batch(conv);
+    auto ref    = dbn->template layer_get<2>().test_forward_batch(pooled);
+
+    // Each channel is reduced to its mean
+    for (size_t i = 0; i < 5; ++i) {
+        for (size_t c = 0; c < 4; ++c) {
+            REQUIRE(pooled(i, c) == Approx(etl::mean(conv(i)(c))).epsilon(1e-4));
+        }
+    }
+
+    // The fused pooling and dense layer must compute the same results as the two layers
+    auto fused = dbn->test_forward_batch<2>(input);
+
+    auto engine = dbn->make_inference_engine(5);
+    auto output = engine.forward(input);
+
+    REQUIRE(etl::size(fused) == etl::size(ref));
+    REQUIRE(etl::size(output) == etl::size(ref));
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(fused[i] == Approx(ref[i]).epsilon(1e-4));
+        REQUIRE(output[i] == Approx(ref[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/pooling/global/progressive/1", "[unit][pooling][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_conv_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_mp_2d_layer_desc<>::layer_t,
+            dll::dyn_global_avgp_layer_desc<>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::ADAM>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template init_layer<0>(1, 28, 28, 8, 5, 5);
+    dbn->template init_layer<1>(8, 24, 24, 2, 2);
+    dbn->template init_layer<2>(8, 12, 12);
+    dbn->template init_layer<3>(8, 10);
+
+    dbn->learning_rate = 0.01;
+
+    // Two epochs at the half resolution, then one at the full resolution
+    auto error = dbn->fine_tune_progressive(*generator, {{2, 14, 14}, {1, 28, 28}});
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 0.9);
+
+    // The network is back at the full resolution
+    REQUIRE(dbn->template layer_get<0>().nv1 == 28);
+    REQUIRE(dbn->template layer_get<1>().o2 == 12);
+    REQUIRE(dbn->template layer_get<2>().i2 == 12);
+
+    auto engine = dbn->make_inference_engine(25);
+    auto output = engine.forward(generator->data_batch());
+
+    REQUIRE(etl::dim<1>(output) == 10);
+}
+
+TEST_CASE("unit/pooling/global/progressive/2", "[unit][pooling]") {
+    etl::dyn_matrix<float, 3> image(1, 4, 4);
+
+    for (size_t i = 0; i < 16; ++i) {
+        image[i] = i;
+    }
+
+    // Integer factors use the box filter
+    etl::dyn_matrix<float, 3> box(1, 2, 2);
+    dll::resize_image(box.memory_start(), image.memory_start(), 1, 4, 4, 2, 2);
+
+    REQUIRE(box(0, 0, 0) == Approx(2.5f));
+    REQUIRE(box(0, 0, 1) == Approx(4.5f));
+    REQUIRE(box(0, 1, 0) == Approx(10.5f));
+    REQUIRE(box(0, 1, 1) == Approx(12.5f));
+
+    // The other factors use a bilinear interpolation
+    etl::dyn_matrix<float, 3> bilinear(1, 3, 3);
+    dll::resize_image(bilinear.memory_start(), image.memory_start(), 1, 4, 4, 3, 3);
+
+    REQUIRE(bilinear(0, 1, 1) == Approx(7.5f));
+    REQUIRE(bilinear(0, 0, 0) == Approx(5.0f / 6.0f));
+}
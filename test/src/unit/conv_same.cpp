@@ -14,6 +14,7 @@
 #include "dll/neural/dense_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/pooling/mp_layer.hpp"
+#include "dll/util/conv_direct.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -58,3 +59,64 @@ TEST_CASE("unit/conv/same/2", "[conv][dbn][mnist][sgd]") {
     FT_CHECK(100, 5e-2);
     TEST_CHECK(0.2);
 }
+
+TEST_CASE("unit/conv/same/direct/1", "[unit][conv]") {
+    etl::fast_matrix<float, 2, 3, 7, 6> input;
+    etl::fast_matrix<float, 6, 3, 3, 3> w3;
+    etl::fast_matrix<float, 6, 3, 1, 1> w1;
+    etl::fast_matrix<float, 2, 6, 7, 6> errors;
+
+    input  = etl::uniform_generator(-1.0, 1.0);
+    w3     = etl::uniform_generator(-1.0, 1.0);
+    w1     = etl::uniform_generator(-1.0, 1.0);
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    // The fast paths must compute the same results as ETL
+
+    etl::fast_matrix<float, 2, 6, 7, 6> output;
+    etl::fast_matrix<float, 2, 3, 7, 6> d_input;
+    etl::fast_matrix<float, 6, 3, 3, 3> d_w3;
+    etl::fast_matrix<float, 6, 3, 1, 1> d_w1;
+
+    dll::direct_conv3x3_forward(output, input, w3);
+    etl::fast_matrix<float, 2, 6, 7, 6> output_ref = etl::ml::convolution_forward<1, 1, 1, 1>(input, w3);
+
+    dll::direct_conv3x3_backward(d_input, errors, w3);
+    etl::fast_matrix<float, 2, 3, 7, 6> d_input_ref = etl::ml::convolution_backward<1, 1, 1, 1>(errors, w3);
+
+    dll::direct_conv3x3_backward_filter(d_w3, input, errors);
+    etl::fast_matrix<float, 6, 3, 3, 3> d_w3_ref = etl::ml::convolution_backward_filter<1, 1, 1, 1>(input, errors);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(output_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(d_input); ++i) {
+        REQUIRE(d_input[i] == Approx(d_input_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(d_w3); ++i) {
+        REQUIRE(d_w3[i] == Approx(d_w3_ref[i]).epsilon(1e-4));
+    }
+
+    dll::gemm_conv1x1_forward(output, input, w1);
+    output_ref = etl::ml::convolution_forward(input, w1);
+
+    dll::gemm_conv1x1_backward(d_input, errors, w1);
+    d_input_ref = etl::ml::convolution_backward(errors, w1);
+
+    dll::gemm_conv1x1_backward_filter(d_w1, input, errors);
+    etl::fast_matrix<float, 6, 3, 1, 1> d_w1_ref = etl::ml::convolution_backward_filter(input, errors);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(output_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(d_input); ++i) {
+        REQUIRE(d_input[i] == Approx(d_input_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(d_w1); ++i) {
+        REQUIRE(d_w1[i] == Approx(d_w1_ref[i]).epsilon(1e-4));
+    }
+}
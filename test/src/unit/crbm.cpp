@@ -12,6 +12,8 @@
 #include "cpp_utils/data.hpp"
 
 #include "dll/rbm/conv_rbm.hpp"
+#include "dll/util/conv_gradients.hpp"
+#include "dll/util/fft_conv.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -160,3 +162,89 @@ TEST_CASE("unit/crbm/mnist/7", "[crbm][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 7e-2);
 }
+
+TEST_CASE("unit/crbm/mnist/8", "[crbm][unit]") {
+    dll::conv_rbm_square_desc<
+        1, 28, 20, 17,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::fft_conv>::layer_t rbm;
+
+    REQUIRE(dll::rbm_layer_traits<decltype(rbm)>::has_fft_conv());
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 25);
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/crbm/gradients/1", "[crbm][unit]") {
+    etl::dyn_matrix<float, 4> v_pos(5, 2, 12, 12);
+    etl::dyn_matrix<float, 4> v_neg(5, 2, 12, 12);
+    etl::dyn_matrix<float, 4> h_pos(5, 3, 8, 8);
+    etl::dyn_matrix<float, 4> h_neg(5, 3, 8, 8);
+
+    v_pos = etl::uniform_generator(0.0, 1.0);
+    v_neg = etl::uniform_generator(0.0, 1.0);
+    h_pos = etl::uniform_generator(0.0, 1.0);
+    h_neg = etl::uniform_generator(0.0, 1.0);
+
+    etl::dyn_matrix<float, 4> expected(3, 2, 5, 5);
+    expected = etl::conv_4d_valid_filter_flipped(v_pos, h_pos) - etl::conv_4d_valid_filter_flipped(v_neg, h_neg);
+
+    etl::dyn_matrix<float, 4> grad(3, 2, 5, 5);
+    dll::cd_conv_weight_gradients(grad, v_pos, h_pos, v_neg, h_neg);
+
+    for (size_t i = 0; i < etl::size(grad); ++i) {
+        REQUIRE(grad[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/crbm/fft/1", "[crbm][unit]") {
+    etl::dyn_matrix<float, 4> v_pos(5, 2, 12, 12);
+    etl::dyn_matrix<float, 4> v_neg(5, 2, 12, 12);
+    etl::dyn_matrix<float, 4> h_pos(5, 3, 4, 4);
+    etl::dyn_matrix<float, 4> h_neg(5, 3, 4, 4);
+    etl::dyn_matrix<float, 4> w(3, 2, 9, 9);
+
+    v_pos = etl::uniform_generator(0.0, 1.0);
+    v_neg = etl::uniform_generator(0.0, 1.0);
+    h_pos = etl::uniform_generator(0.0, 1.0);
+    h_neg = etl::uniform_generator(0.0, 1.0);
+    w     = etl::uniform_generator(-1.0, 1.0);
+
+    dll::fft_conv_plan<float> plan;
+    plan.lock_weights(w, 12, 12, true);
+
+    etl::dyn_matrix<float, 4> h_a(5, 3, 4, 4);
+    etl::dyn_matrix<float, 4> h_e(5, 3, 4, 4);
+    plan.valid_correlation(h_a, v_pos, w);
+    h_e = etl::conv_4d_valid_flipped(v_pos, w);
+
+    for (size_t i = 0; i < etl::size(h_a); ++i) {
+        REQUIRE(h_a[i] == Approx(h_e[i]).epsilon(1e-4));
+    }
+
+    etl::dyn_matrix<float, 4> v_a(5, 2, 12, 12);
+    etl::dyn_matrix<float, 4> v_e(5, 2, 12, 12);
+    plan.full_convolution(v_a, h_pos, w);
+    v_e = etl::conv_4d_full(h_pos, w);
+
+    for (size_t i = 0; i < etl::size(v_a); ++i) {
+        REQUIRE(v_a[i] == Approx(v_e[i]).epsilon(1e-4));
+    }
+
+    etl::dyn_matrix<float, 4> grad(3, 2, 9, 9);
+    etl::dyn_matrix<float, 4> expected(3, 2, 9, 9);
+    plan.weight_gradients(grad, v_pos, h_pos, v_neg, h_neg);
+    expected = etl::conv_4d_valid_filter_flipped(v_pos, h_pos) - etl::conv_4d_valid_filter_flipped(v_neg, h_neg);
+
+    plan.unlock_weights();
+
+    for (size_t i = 0; i < etl::size(grad); ++i) {
+        REQUIRE(grad[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
@@ -157,3 +157,26 @@ TEST_CASE("unit/crbm_mp/mnist/7", "[crbm_mp][lee][gaussian][unit]") {
     auto error = rbm.train(dataset.training_images, 30);
     REQUIRE(error < 0.1);
 }
+
+TEST_CASE("unit/crbm_mp/pmp/1", "[crbm_mp][unit]") {
+    etl::fast_matrix<float, 3, 4, 6, 8> x;
+    x = etl::uniform_generator(-4.0, 4.0);
+
+    // The kernels must compute the same probabilities as ETL
+
+    etl::fast_matrix<float, 3, 4, 6, 8> h = x;
+    dll::prob_max_pool_h(h, 2);
+    etl::fast_matrix<float, 3, 4, 6, 8> h_ref = etl::p_max_pool_h(x, 2, 2);
+
+    etl::fast_matrix<float, 3, 4, 3, 4> p;
+    dll::prob_max_pool_p(p, x, 2);
+    etl::fast_matrix<float, 3, 4, 3, 4> p_ref = etl::p_max_pool_p(x, 2, 2);
+
+    for (size_t i = 0; i < etl::size(h); ++i) {
+        REQUIRE(h[i] == Approx(h_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(p); ++i) {
+        REQUIRE(p[i] == Approx(p_ref[i]).epsilon(1e-4));
+    }
+}
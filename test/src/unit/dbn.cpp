@@ -6,6 +6,7 @@
 //=======================================================================
 
 #include <deque>
+#include <numeric>
 
 #include "dll_test.hpp"
 
@@ -16,6 +17,8 @@
 #include "dll/rbm/dyn_rbm.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
 #include "dll/transform/binarize_layer.hpp"
+#include "dll/utility/merge_layer.hpp"
+#include "dll/util/metrics.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -220,6 +223,78 @@ TEST_CASE("unit/dbn/mnist/7", "[dbn][svm][unit]") {
     REQUIRE(test_error < 0.2);
 }
 
+// The concatenated features are computed by batches
+TEST_CASE("unit/dbn/svm/concatenate/1", "[dbn][svm][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 50, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::svm_concatenate, dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(110);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    auto features = dbn->full_activation_probabilities_many(dataset.training_images.begin(), dataset.training_images.end());
+
+    REQUIRE(etl::dim<0>(features) == dataset.training_images.size());
+    REQUIRE(etl::dim<1>(features) == dbn->full_output_size());
+
+    for (size_t i = 0; i < dataset.training_images.size(); ++i) {
+        auto expected = dbn->full_activation_probabilities(dataset.training_images[i]);
+
+        for (size_t j = 0; j < etl::size(expected); ++j) {
+            REQUIRE(features(i, j) == Approx(expected[j]));
+        }
+    }
+
+    auto result = dbn->svm_train(dataset.training_images, dataset.training_labels);
+
+    REQUIRE(result);
+}
+
+TEST_CASE("unit/dbn/svm/generator/1", "[dbn][svm][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 50, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t;
+
+    using svm_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<50, 50, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>>;
+
+    auto generator = dll::make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, generator_t{});
+
+    // The features of the first network are given to the second one, without being stored
+    auto features = dll::make_feature_generator(*generator, *dbn);
+
+    auto svm_dbn = std::make_unique<svm_dbn_t>();
+
+    auto result = svm_dbn->svm_train(features);
+
+    REQUIRE(result);
+}
+
 // Pretrain with binarize layer
 TEST_CASE("unit/dbn/mnist/8", "[dbn][unit]") {
     typedef dll::dbn_desc<
@@ -391,6 +466,44 @@ TEST_CASE("unit/dbn/mnist/11", "[dbn][denoising][unit]") {
     dbn->pretrain_denoising(*generator, 50);
 }
 
+TEST_CASE("unit/dbn/mnist/denoising/noisy", "[dbn][denoising][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>>;
+
+    auto clean = make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, generator_t{});
+
+    dll::noisy_data_generator<std::decay_t<decltype(*clean)>, 30> generator(*clean);
+
+    REQUIRE(generator.size() == 100);
+
+    // The labels are the clean samples and each value is either masked or kept
+    size_t ones   = 0;
+    size_t masked = 0;
+
+    while (generator.has_next_batch()) {
+        auto& noisy = generator.data_batch();
+        auto clean_batch = generator.label_batch();
+
+        REQUIRE(etl::size(noisy) == etl::size(clean_batch));
+
+        for (size_t i = 0; i < etl::size(noisy); ++i) {
+            REQUIRE((noisy[i] == clean_batch[i] || noisy[i] == 0.0f));
+
+            ones += clean_batch[i] == 1.0f;
+            masked += clean_batch[i] == 1.0f && noisy[i] == 0.0f;
+        }
+
+        generator.next_batch();
+    }
+
+    REQUIRE(masked > ones / 5);
+    REQUIRE(masked < ones * 2 / 5);
+}
+
 // Batch mode
 TEST_CASE("unit/dbn/mnist/12", "[dbn][unit]") {
     dll::reset_timers();
@@ -431,3 +544,395 @@ TEST_CASE("unit/dbn/mnist/12", "[dbn][unit]") {
 
     dll::dump_timers();
 }
+
+// Nested timers
+TEST_CASE("unit/dbn/timers/1", "[dbn][unit]") {
+    dll::reset_timers();
+
+    for (size_t i = 0; i < 2; ++i) {
+        dll::auto_timer timer("test:outer");
+
+        for (size_t j = 0; j < 3; ++j) {
+            dll::auto_timer inner("test:inner");
+        }
+    }
+
+    auto tree = dll::merged_timer_tree();
+
+    auto outer = std::find_if(tree.begin(), tree.end(), [](auto& t) { return t.name == "test:outer"; });
+    auto inner = std::find_if(tree.begin(), tree.end(), [](auto& t) { return t.name == "test:inner"; });
+
+    REQUIRE(outer != tree.end());
+    REQUIRE(inner != tree.end());
+
+    REQUIRE(outer->count == 2);
+    REQUIRE(inner->count == 6);
+    REQUIRE(inner->parent == size_t(std::distance(tree.begin(), outer)));
+    REQUIRE(inner->duration <= outer->duration);
+
+    dll::dump_timers_tree();
+}
+
+// Hardware counters of the timers (zero when not enabled or not available)
+TEST_CASE("unit/dbn/timers/counters", "[dbn][unit]") {
+    dll::reset_timers();
+
+    std::vector<float> values(1 << 16, 1.0f);
+
+    float sum = 0.0f;
+
+    for (size_t i = 0; i < 2; ++i) {
+        dll::auto_timer timer("test:counters:outer");
+
+        dll::auto_timer inner("test:counters:inner");
+
+        sum += std::accumulate(values.begin(), values.end(), 0.0f);
+    }
+
+    REQUIRE(sum == 2.0f * values.size());
+
+    auto tree = dll::merged_timer_tree();
+
+    auto outer = std::find_if(tree.begin(), tree.end(), [](auto& t) { return t.name == "test:counters:outer"; });
+    auto inner = std::find_if(tree.begin(), tree.end(), [](auto& t) { return t.name == "test:counters:inner"; });
+
+    REQUIRE(outer != tree.end());
+    REQUIRE(inner != tree.end());
+
+#ifdef DLL_PERF_COUNTERS
+    if (dll::local_timers().counters.valid()) {
+        REQUIRE(inner->instructions > 0);
+        REQUIRE(inner->cycles <= outer->cycles);
+        REQUIRE(inner->instructions <= outer->instructions);
+    }
+#else
+    REQUIRE(!outer->cycles);
+    REQUIRE(!outer->instructions);
+#endif
+
+    dll::dump_timers_pretty();
+}
+
+// Export of the timers as metrics
+TEST_CASE("unit/dbn/timers/metrics", "[dbn][unit]") {
+    dll::reset_timers();
+
+    for (size_t i = 0; i < 3; ++i) {
+        dll::auto_timer timer("test:metric");
+    }
+
+    dll::metrics_exporter exporter("dll");
+
+    exporter.add_gauge("test gauge", [] { return 2.5; });
+
+    auto text = exporter.prometheus_text();
+
+    REQUIRE(text.find("dll_timer_calls_total{timer=\"test:metric\"} 3\n") != std::string::npos);
+    REQUIRE(text.find("dll_timer_seconds_total{timer=\"test:metric\"}") != std::string::npos);
+    REQUIRE(text.find("dll_test_gauge 2.5\n") != std::string::npos);
+
+    auto calls = [&exporter] {
+        auto lines = exporter.statsd_lines();
+        auto it    = std::find(lines.begin(), lines.end(), "dll.test_metric.calls:3|c");
+        return it != lines.end();
+    };
+
+    // The counters are sent as increments, the timers are not reset
+    REQUIRE(calls());
+    REQUIRE(!calls());
+
+    text = exporter.prometheus_text();
+
+    REQUIRE(text.find("dll_timer_calls_total{timer=\"test:metric\"} 3\n") != std::string::npos);
+}
+
+// Latency histograms of the selected timers
+TEST_CASE("unit/dbn/timers/histograms", "[dbn][unit]") {
+    dll::reset_timers();
+    dll::histogram_timers({"test:latency"});
+
+    for (size_t i = 1; i <= 1000; ++i) {
+        dll::record_timer("test:latency", i * 1000);
+        dll::record_timer("test:plain", i * 1000);
+    }
+
+    auto timers = dll::merged_timers();
+
+    auto latency = std::find_if(timers.begin(), timers.end(), [](auto& t) { return t.name == "test:latency"; });
+    auto plain   = std::find_if(timers.begin(), timers.end(), [](auto& t) { return t.name == "test:plain"; });
+
+    REQUIRE(latency != timers.end());
+    REQUIRE(plain != timers.end());
+
+    REQUIRE(latency->has_latencies());
+    REQUIRE(!plain->has_latencies());
+
+    // The percentiles are within the relative error of the histogram
+    REQUIRE(latency->latency(0.5) == Approx(500000).epsilon(0.04));
+    REQUIRE(latency->latency(0.9) == Approx(900000).epsilon(0.04));
+    REQUIRE(latency->latency(0.99) == Approx(990000).epsilon(0.04));
+    REQUIRE(latency->latency_max == 1000000);
+
+    dll::dump_timers_pretty();
+
+    dll::metrics_exporter exporter("dll");
+
+    auto text = exporter.prometheus_text();
+
+    REQUIRE(text.find("dll_timer_latency_seconds{timer=\"test:latency\",quantile=\"0.99\"}") != std::string::npos);
+    REQUIRE(text.find("dll_timer_latency_seconds{timer=\"test:plain\"") == std::string::npos);
+
+    auto lines = exporter.statsd_lines();
+
+    REQUIRE(std::find(lines.begin(), lines.end(), "dll.test_latency.max_ms:1.000000|g") != lines.end());
+}
+
+// Pipelined pretraining
+TEST_CASE("unit/dbn/mnist/pipelined", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 150, dll::momentum, dll::batch_size<10>, dll::init_weights>,
+            dll::rbm<150, 250, dll::momentum, dll::batch_size<10>>,
+            dll::rbm<250, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::batch_size<25>, dll::binarize_pre<30>, dll::pipelined_pretrain, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 50);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+    std::cout << "error:" << error << std::endl;
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.3);
+}
+
+// Pretraining of the siblings RBMs of a merge layer
+TEST_CASE("unit/dbn/mnist/siblings", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::merge_layer<
+                0,
+                dll::rbm<28 * 28, 50, dll::momentum, dll::batch_size<10>, dll::init_weights>,
+                dll::rbm<28 * 28, 60, dll::momentum, dll::batch_size<20>, dll::init_weights>>,
+            dll::rbm<110, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::trainer<dll::sgd_trainer>, dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    // Both branches have been trained on the same input
+    auto& merge = dbn->template layer_get<0>();
+
+    REQUIRE(std::get<0>(merge.layers).reconstruction_error(dataset.training_images[1]) < 5e-2);
+    REQUIRE(std::get<1>(merge.layers).reconstruction_error(dataset.training_images[1]) < 5e-2);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 50);
+    std::cout << "ft_error:" << error << std::endl;
+    REQUIRE(error < 1e-1);
+
+    TEST_CHECK(0.3);
+}
+
+// Pretraining with the representations spilled to files
+TEST_CASE("unit/dbn/mnist/spill", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 150, dll::momentum, dll::batch_size<10>, dll::init_weights>,
+            dll::rbm<150, 250, dll::momentum, dll::batch_size<10>>,
+            dll::rbm<250, 10, dll::momentum, dll::batch_size<10>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::batch_size<25>, dll::binarize_pre<30>, dll::spill_pretrain, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->spill_directory = ".";
+
+    dbn->pretrain(dataset.training_images, 50);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+    std::cout << "error:" << error << std::endl;
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/dbn/mnist/compact", "[dbn][unit]") {
+    REQUIRE(dll::half_to_float(dll::float_to_half(0.5f)) == 0.5f);
+    REQUIRE(dll::bf16_to_float(dll::float_to_bf16(-2.0f)) == -2.0f);
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>,
+            dll::rbm<100, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::binarize_pre<30>, dll::data_storage<dll::storage_type::UINT8>>;
+
+    auto generator = make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, generator_t{});
+
+    REQUIRE(generator->input_cache.bytes() == dataset.training_images.size() * 28 * 28);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(*generator, 20);
+
+    auto error = dbn->fine_tune(*generator, 10);
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/dbn/mnist/compressed", "[dbn][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>,
+            dll::rbm<100, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using compact_t    = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::binarize_pre<30>, dll::data_storage<dll::storage_type::UINT8>>;
+    using compressed_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::binarize_pre<30>, dll::data_storage<dll::storage_type::UINT8>, dll::compressed_cache<100>>;
+
+    auto compact   = make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, compact_t{});
+    auto generator = make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, compressed_t{});
+
+    // The raw MNIST pixels are mostly zeroes
+    REQUIRE(generator->input_cache.raw_bytes() == dataset.training_images.size() * 28 * 28);
+    REQUIRE(generator->input_cache.bytes() < generator->input_cache.raw_bytes() / 2);
+
+    // In order, the batches are the same as the ones of the compact cache
+    compact->reset();
+    generator->reset();
+
+    while (generator->has_next_batch()) {
+        REQUIRE(etl::sum(etl::abs(generator->data_batch() - compact->data_batch())) == 0.0f);
+
+        compact->next_batch();
+        generator->next_batch();
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(*generator, 20);
+
+    auto error = dbn->fine_tune(*generator, 10);
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/dbn/sampling/0", "[dbn][sampling][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 100, dll::momentum, dll::batch_size<25>>,
+            dll::rbm<100, 50, dll::momentum, dll::batch_size<25>>>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+
+    etl::dyn_matrix<float, 2> init(4, 28 * 28);
+
+    for (size_t c = 0; c < 4; ++c) {
+        init(c) = dataset.training_images[c];
+    }
+
+    etl::dyn_matrix<float, 2> samples(10, 28 * 28);
+
+    dbn->sample_chains(samples, init, 5);
+
+    REQUIRE(etl::min(samples) >= 0.0f);
+    REQUIRE(etl::max(samples) <= 1.0f);
+}
+
+// The workers of the library share the thread budget and run ETL serially
+TEST_CASE("unit/dbn/threads/budget", "[dbn][unit]") {
+    const size_t budget = dll::thread_budget();
+
+    REQUIRE(budget >= 1);
+    REQUIRE(dll::available_threads() <= budget);
+    REQUIRE(dll::budget_workers(1) == 1);
+    REQUIRE(dll::budget_workers(1000, 3) == 3);
+
+    {
+        const size_t available = dll::available_threads();
+
+        dll::thread_reservation reservation(1);
+
+        REQUIRE(dll::available_threads() == std::max(size_t(1), std::min(available, budget - 1)));
+    }
+
+    REQUIRE(!etl::local_context().serial);
+
+    {
+        dll::worker_section section;
+
+        REQUIRE(etl::local_context().serial);
+    }
+
+    REQUIRE(!etl::local_context().serial);
+
+    std::vector<int> serial(64, 0);
+
+    dll::parallel_kernel(0, serial.size(), [&serial](size_t i) { serial[i] = etl::local_context().serial; });
+
+    REQUIRE(std::all_of(serial.begin(), serial.end(), [](int s) { return s == 1; }));
+}
+
+// The reductions do not depend on the number of threads
+TEST_CASE("unit/dbn/threads/deterministic", "[dbn][unit]") {
+    std::vector<double> values(1000);
+    std::iota(values.begin(), values.end(), 1.0);
+
+    REQUIRE(dll::tree_sum(values) == 500500.0);
+    REQUIRE(dll::tree_sum(std::vector<double>{}) == 0.0);
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>,
+            dll::rbm<100, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::binarize_pre<30>>;
+
+    auto generator = make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->fine_tune(*generator, 5);
+
+    auto [error, loss] = dbn->evaluate_metrics(*generator);
+
+    // With all the threads but one reserved, a single worker evaluates all the batches
+    {
+        dll::thread_reservation reservation(dll::thread_budget() - 1);
+
+        auto [serial_error, serial_loss] = dbn->evaluate_metrics(*generator);
+
+        REQUIRE(serial_error == error);
+        REQUIRE(serial_loss == loss);
+    }
+}
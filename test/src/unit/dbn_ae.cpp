@@ -49,3 +49,33 @@ TEST_CASE("dbn/ae/1", "[unit][rbm][dbn][mnist][sgd][ae]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.1);
 }
+
+// The batched evaluation of the reconstructions matches the per-sample one
+TEST_CASE("dbn/ae/evaluate", "[unit][rbm][dbn][mnist][sgd][ae]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 32, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<32, 28 * 28, dll::momentum, dll::batch_size<25>>::layer_t
+        >, dll::autoencoder, dll::loss<dll::loss_function::BINARY_CROSS_ENTROPY>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    // Not a multiple of the batch size
+    dataset.test_images.resize(255);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    dbn->learning_rate = 0.1;
+
+    dbn->fine_tune_ae(dataset.training_images, 5);
+
+    auto test_error = dbn->evaluate_error_ae(dataset.test_images);
+    std::cout << "test_error:" << test_error << std::endl;
+
+    REQUIRE(test_error == Approx(dll::test_set_ae(*dbn, dataset.test_images)).epsilon(1e-3));
+}
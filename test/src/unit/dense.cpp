@@ -5,15 +5,25 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithm>
+#include <cstdio>
 #include <deque>
+#include <sstream>
+#include <thread>
 
 #include "dll_test.hpp"
 
 #include "dll/neural/dense_layer.hpp"
+#include "dll/neural/sharded_dense_layer.hpp"
+#include "dll/neural/tied_dense_layer.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
 #include "dll/neural/activation_layer.hpp"
+#include "dll/utility/merge_layer.hpp"
 #include "dll/dbn.hpp"
+#include "dll/ensemble_engine.hpp"
 #include "dll/datasets.hpp"
+#include "dll/util/batch_tuner.hpp"
+#include "dll/util/memory_plan.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -310,3 +320,1959 @@ TEST_CASE("unit/dense/sgd/14", "[unit][dense][dbn][mnist][sgd]") {
     FT_CHECK(50, 5e-2);
     TEST_CHECK(0.2);
 }
+
+// Test data-parallel SGD
+TEST_CASE("unit/dense/sgd/15", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::parallel_sgd<4>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->initial_momentum = 0.9;
+    dbn->final_momentum   = 0.9;
+    dbn->learning_rate    = 0.1;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.2);
+}
+
+TEST_CASE("unit/dense/sgd/16", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 5e-2);
+
+    // The inference engine must compute the same outputs as the network
+
+    auto engine = dbn->make_inference_engine(32);
+
+    etl::fast_dyn_matrix<float, 25, 28 * 28> batch;
+
+    for (size_t i = 0; i < 25; ++i) {
+        batch(i) = dataset.test_images[i];
+    }
+
+    auto expected = dbn->forward_batch(batch);
+    auto output   = engine.forward(batch);
+
+    REQUIRE(etl::dim<0>(output) == 25);
+
+    for (size_t i = 0; i < 25; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output(i, j) == Approx(expected(i, j)));
+        }
+    }
+}
+
+// Test the arena for the training contexts
+TEST_CASE("unit/dense/sgd/17", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::arena>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 5e-2);
+
+    auto footprint = dbn->get_arena().footprint();
+
+    REQUIRE(footprint > 0);
+
+    // A second training must reuse the same block
+    FT_CHECK(5, 5e-2);
+
+    REQUIRE(dbn->get_arena().footprint() == footprint);
+
+    TEST_CHECK(0.2);
+}
+
+// Test the per-layer profile
+TEST_CASE("unit/dense/sgd/18", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::watcher<dll::profile_dbn_watcher>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    std::remove("dll_profile.jsonl");
+
+    FT_CHECK(25, 5e-2);
+
+    // One line per layer and per epoch
+    std::ifstream is("dll_profile.jsonl");
+
+    size_t lines = 0;
+    std::string line;
+    while (std::getline(is, line)) {
+        REQUIRE(line.find("\"forward_gflops\"") != std::string::npos);
+        ++lines;
+    }
+
+    REQUIRE(lines == 2 * 25);
+
+    TEST_CHECK(0.2);
+}
+
+// Test the int8 inference
+TEST_CASE("unit/dense/sgd/19", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 5e-2);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical>;
+
+    auto calibration = make_generator(dataset.training_images, dataset.training_labels, 10, generator_t{});
+    auto test        = make_generator(dataset.test_images, dataset.test_labels, 10, generator_t{});
+
+    auto report = dll::int8_quantization_report(*dbn, *calibration, *test);
+
+    REQUIRE(report.int8_error < report.fp32_error + 0.05);
+}
+
+// Test the in-place activation layers
+TEST_CASE("unit/dense/sgd/20", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SOFTMAX>::layer_t
+        >,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 5e-2);
+
+    etl::fast_dyn_matrix<float, 25, 28 * 28> batch;
+
+    for (size_t i = 0; i < 25; ++i) {
+        batch(i) = dataset.test_images[i];
+    }
+
+    // Each layer computed separately, without any temporary reused
+    auto h1 = dbn->template layer_get<0>().test_forward_batch(batch);
+    auto a1 = dbn->template layer_get<1>().test_forward_batch(h1);
+    auto h2 = dbn->template layer_get<2>().test_forward_batch(a1);
+    auto a2 = dbn->template layer_get<3>().test_forward_batch(h2);
+
+    auto expected = dbn->forward_batch(batch);
+
+    auto engine = dbn->make_inference_engine(25);
+    auto output = engine.forward(batch);
+
+    for (size_t i = 0; i < 25; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(expected(i, j) == Approx(a2(i, j)));
+            REQUIRE(output(i, j) == Approx(a2(i, j)));
+        }
+    }
+}
+
+// Test the gradient accumulation
+TEST_CASE("unit/dense/sgd/21", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::gradient_accumulation<4>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<40>>::dbn_t large_dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn   = std::make_unique<dbn_t>();
+    auto large = std::make_unique<large_dbn_t>();
+
+    large->template layer_get<0>().w = dbn->template layer_get<0>().w;
+    large->template layer_get<0>().b = dbn->template layer_get<0>().b;
+    large->template layer_get<1>().w = dbn->template layer_get<1>().w;
+    large->template layer_get<1>().b = dbn->template layer_get<1>().b;
+
+    // Four accumulated batches of 10 samples must be one batch of 40 samples
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+    dll::sgd_trainer<large_dbn_t> large_trainer(*large);
+
+    etl::fast_dyn_matrix<float, 10, 28 * 28> inputs;
+    etl::fast_dyn_matrix<float, 10, 10> labels;
+
+    etl::fast_dyn_matrix<float, 40, 28 * 28> large_inputs;
+    etl::fast_dyn_matrix<float, 40, 10> large_labels;
+
+    large_labels = 0;
+
+    for (size_t b = 0; b < 4; ++b) {
+        labels = 0;
+
+        for (size_t i = 0; i < 10; ++i) {
+            inputs(i)                = dataset.training_images[b * 10 + i];
+            large_inputs(b * 10 + i) = dataset.training_images[b * 10 + i];
+
+            labels(i, dataset.training_labels[b * 10 + i])                = 1.0;
+            large_labels(b * 10 + i, dataset.training_labels[b * 10 + i]) = 1.0;
+        }
+
+        trainer.accumulate_batch(inputs, labels);
+    }
+
+    auto result       = trainer.train_accumulated_batches(0);
+    auto large_result = large_trainer.train_batch(0, large_inputs, large_labels);
+
+    REQUIRE(result.first == Approx(large_result.first));
+    REQUIRE(result.second == Approx(large_result.second));
+
+    for (size_t i = 0; i < etl::size(dbn->template layer_get<0>().w); ++i) {
+        REQUIRE(dbn->template layer_get<0>().w[i] == Approx(large->template layer_get<0>().w[i]));
+    }
+
+    FT_CHECK(25, 5e-2);
+}
+
+// Test the frozen layers
+TEST_CASE("unit/dense/sgd/22", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::frozen_layers<1>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    etl::fast_dyn_matrix<float, 28 * 28, 100> w = dbn->template layer_get<0>().w;
+
+    FT_CHECK(50, 0.3);
+
+    // The frozen layer is never updated
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(dbn->template layer_get<0>().w[i] == w[i]);
+    }
+}
+
+// Sparse categorical labels
+TEST_CASE("unit/dense/sgd/23", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::sparse_labels, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.25);
+}
+
+// Batched export of the features
+TEST_CASE("unit/dense/export/0", "[unit][dense][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->export_features(dataset.training_images, "/tmp/dll_features.dlld", dll::format::MMAP, 32));
+
+    using generator_t = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::autoencoder>;
+
+    auto generator = dll::make_mmap_generator<float, 1>("/tmp/dll_features.dlld", 1, generator_t{});
+
+    REQUIRE(generator->size() == dataset.training_images.size());
+
+    auto features = dbn->features(dataset.training_images[0]);
+
+    for (size_t i = 0; i < 10; ++i) {
+        REQUIRE(generator->data_batch()(0, i) == Approx(features[i]));
+    }
+
+    REQUIRE(dbn->export_features(dataset.training_images, "/tmp/dll_features.bin", dll::format::BINARY, 32, false));
+
+    std::ifstream is("/tmp/dll_features.bin", std::ios::binary);
+
+    dll::binary_tensor_header header;
+    is.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    uint64_t shape[2];
+    is.read(reinterpret_cast<char*>(shape), sizeof(shape));
+
+    REQUIRE(header.dimensions == 2);
+    REQUIRE(shape[0] == dataset.training_images.size());
+    REQUIRE(shape[1] == 10);
+
+    std::remove("/tmp/dll_features.dlld");
+    std::remove("/tmp/dll_features.bin");
+}
+
+// The fused loss kernels must compute the same metrics as the reductions
+TEST_CASE("unit/dense/loss/0", "[unit][dense]") {
+    etl::fast_matrix<float, 16, 10> output;
+    etl::fast_matrix<float, 16, 10> labels;
+    etl::fast_matrix<float, 16, 10> errors;
+    etl::fast_matrix<float, 16> sparse;
+
+    output = etl::uniform_generator(0.01, 1.0);
+    labels = 0.0;
+
+    for (size_t i = 0; i < 16; ++i) {
+        output(i) = output(i) / etl::sum(output(i));
+        sparse(i) = i % 10;
+        labels(i, i % 10) = 1.0;
+    }
+
+    auto [error, loss] = dll::loss_errors<dll::loss_function::CATEGORICAL_CROSS_ENTROPY>(output, labels, errors, 16);
+
+    REQUIRE(loss == Approx(etl::ml::cce_loss(output, labels, -1.0)).epsilon(1e-4));
+    REQUIRE(error == Approx(etl::ml::cce_error(output, labels, 1.0)));
+
+    for (size_t i = 0; i < etl::size(errors); ++i) {
+        REQUIRE(errors[i] == Approx(labels[i] - output[i]));
+    }
+
+    // The sparse labels must give the same results on a partial batch
+
+    auto [sparse_error, sparse_loss] = dll::loss_errors<dll::loss_function::CATEGORICAL_CROSS_ENTROPY>(output, sparse, errors, 12);
+
+    auto [partial_error, partial_loss] = dll::loss_metrics<dll::loss_function::CATEGORICAL_CROSS_ENTROPY>(output, labels, 12);
+
+    REQUIRE(sparse_loss == Approx(partial_loss));
+    REQUIRE(sparse_error == Approx(partial_error));
+
+    for (size_t i = 0; i < etl::size(errors); ++i) {
+        REQUIRE(errors[i] == Approx(i < 12 * 10 ? labels[i] - output[i] : 0.0f));
+    }
+}
+
+// The top-k error of the loss kernels must rank the labels like a sort
+TEST_CASE("unit/dense/loss/1", "[unit][dense]") {
+    etl::fast_matrix<float, 32, 10> output;
+    etl::fast_matrix<float, 32, 10> labels;
+    etl::fast_matrix<float, 32> sparse;
+
+    output = etl::uniform_generator(0.01, 1.0);
+    labels = 0.0;
+
+    for (size_t i = 0; i < 32; ++i) {
+        output(i) = output(i) / etl::sum(output(i));
+        sparse(i) = (i * 7) % 10;
+        labels(i, (i * 7) % 10) = 1.0;
+    }
+
+    // Reference: the label is one of the 3 largest outputs
+    size_t expected = 0;
+
+    for (size_t i = 0; i < 32; ++i) {
+        std::vector<std::pair<float, size_t>> row;
+
+        for (size_t j = 0; j < 10; ++j) {
+            row.emplace_back(-output(i, j), j);
+        }
+
+        std::sort(row.begin(), row.end());
+
+        expected += std::none_of(row.begin(), row.begin() + 3, [&](auto& p) { return p.second == size_t(sparse(i)); });
+    }
+
+    constexpr auto cce = dll::loss_function::CATEGORICAL_CROSS_ENTROPY;
+
+    auto [top_1, loss_1] = dll::loss_metrics<cce>(output, labels, 32);
+    auto [top_3, loss_3] = dll::loss_metrics<cce, 3>(output, sparse, 32);
+    auto [top_10, loss_10] = dll::loss_metrics<cce, 10>(output, labels, 32);
+
+    REQUIRE(top_3 == Approx(double(expected)));
+    REQUIRE(top_3 <= top_1);
+    REQUIRE(top_10 == 0.0);
+    REQUIRE(loss_3 == Approx(loss_1));
+    REQUIRE(loss_10 == Approx(loss_1));
+
+    // The top-1 error of the rank is the error of the argmax
+    REQUIRE(dll::top_k_errors(output, 32, 1, [&](size_t i) { return sparse(i); }) == Approx(top_1));
+    REQUIRE(dll::top_k_errors(output, 32, 3, [&](size_t i) { return sparse(i); }) == Approx(top_3));
+}
+
+// The top-5 error is used by the evaluation and the harness
+TEST_CASE("unit/dense/top_k/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::momentum, dll::top_k_error<5>, dll::batch_size<20>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(10, 5e-2);
+
+    auto top_5 = dbn->evaluate_error(dataset.test_images, dataset.test_labels);
+    auto top_1 = dll::test_set_batch(dbn, dataset.test_images, dataset.test_labels, dll::batch_predictor());
+
+    std::cout << "top_1:" << top_1 << " top_5:" << top_5 << std::endl;
+
+    REQUIRE(top_5 <= top_1);
+    REQUIRE(top_5 == Approx(dll::test_set_top_k(dbn, dataset.test_images, dataset.test_labels, 5)));
+    REQUIRE(top_5 < 0.1);
+}
+
+// Adam with bias correction and gradient clipping, with the fused updaters
+TEST_CASE("unit/dense/sgd/24", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM_CORRECT>, dll::clip_gradients, dll::weight_decay<dll::decay_type::L2_FULL>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Momentum and Adam with gradient clipping on the global norm of the gradients
+TEST_CASE("unit/dense/sgd/25", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::global_clip_gradients, dll::weight_decay<dll::decay_type::L2>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::global_clip_gradients,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t adam_dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    {
+        auto dbn = std::make_unique<dbn_t>();
+
+        dbn->learning_rate = 0.1;
+        dbn->gradient_clip = 1.0;
+
+        FT_CHECK(50, 5e-2);
+        TEST_CHECK(0.3);
+    }
+
+    {
+        auto dbn = std::make_unique<adam_dbn_t>();
+
+        dbn->learning_rate = 0.001;
+        dbn->gradient_clip = 1.0;
+
+        FT_CHECK(50, 5e-2);
+        TEST_CHECK(0.3);
+    }
+}
+
+// The gradients of the upper layers overlap the backward pass of the lower layers
+TEST_CASE("unit/dense/sgd/26", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            dll::dense_layer_desc<150, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::overlap_gradients,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.002;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/27", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            dll::dense_layer_desc<150, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::pipeline_updates,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.002;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// The backward pass of the first layer goes through several tiles of rows
+TEST_CASE("unit/dense/sgd/28", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 1000, dll::tanh>::layer_t,
+            dll::dense_layer_desc<1000, 10, dll::sigmoid>::layer_t>,
+        dll::loss<dll::loss_function::MEAN_SQUARED_ERROR>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<100>>::dbn_t dbn_t;
+
+    static_assert(dll::dense_backward_rows(1000) < 100, "The errors must span several tiles");
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// The tasks of a group are all executed, including the tasks they submit
+TEST_CASE("unit/dense/tasks/0", "[unit][dense]") {
+    dll::work_stealing_pool pool(3);
+
+    for (size_t r = 0; r < 20; ++r) {
+        dll::task_group group;
+        std::atomic<size_t> sum{0};
+
+        for (size_t i = 0; i < 50; ++i) {
+            pool.submit(group, [&pool, &group, &sum, i]() {
+                sum += i;
+
+                if (i % 10 == 0) {
+                    pool.submit(group, [&sum]() { sum += 1000; });
+                }
+            });
+        }
+
+        pool.wait(group);
+
+        REQUIRE(sum == 1225 + 5000);
+    }
+}
+
+// The norm of several tensors is the norm of their concatenation
+TEST_CASE("unit/dense/updater/clip", "[unit][dense]") {
+    etl::dyn_matrix<float, 1> w(40000);
+    etl::dyn_matrix<float, 1> g(40000);
+
+    w = etl::uniform_generator(-1.0, 1.0);
+    g = etl::uniform_generator(-1.0, 1.0);
+
+    std::vector<dll::fused_tensor<float>> tensors(2);
+
+    tensors[0].w       = w.memory_start();
+    tensors[0].g       = g.memory_start();
+    tensors[0].size    = 30000;
+    tensors[0].step.l2 = 0.1;
+
+    tensors[1].w    = w.memory_start() + 30000;
+    tensors[1].g    = g.memory_start() + 30000;
+    tensors[1].size = 10000;
+
+    double expected = 0.0;
+
+    for (size_t i = 0; i < 40000; ++i) {
+        const double x = i < 30000 ? g[i] - 0.1 * w[i] : g[i];
+        expected += x * x;
+    }
+
+    const double sum = dll::squared_sum(tensors);
+
+    REQUIRE(sum == Approx(expected));
+
+    REQUIRE(dll::clip_scale(sum, 10, 1.0) == Approx(1.0 / std::sqrt(expected / 100.0)));
+    REQUIRE(dll::clip_scale(sum, 10, 1e6) == Approx(1.0));
+    REQUIRE(dll::clip_scale<dll::decay_type::L2>(tensors[0], 10, 1.0) == Approx(dll::clip_scale(dll::squared_sum(std::vector<dll::fused_tensor<float>>{tensors[0]}), 10, 1.0)));
+}
+
+// The multi-tensor update must give the same results as the single updates
+TEST_CASE("unit/dense/updater/0", "[unit][dense]") {
+    etl::fast_matrix<float, 3, 100> w;
+    etl::fast_matrix<float, 3, 100> g;
+    etl::fast_matrix<float, 3, 100> m;
+    etl::fast_matrix<float, 3, 100> v;
+
+    w = etl::uniform_generator(-1.0, 1.0);
+    g = etl::uniform_generator(-1.0, 1.0);
+    m = 0.0;
+    v = 0.0;
+
+    etl::fast_matrix<float, 3, 100> w_ref = w;
+    etl::fast_matrix<float, 3, 100> m_ref = m;
+    etl::fast_matrix<float, 3, 100> v_ref = v;
+
+    std::vector<dll::fused_tensor<float>> tensors(3);
+
+    for (size_t i = 0; i < 3; ++i) {
+        auto& t = tensors[i];
+
+        t.w          = w.memory_start() + i * 100;
+        t.g          = g.memory_start() + i * 100;
+        t.s0         = m.memory_start() + i * 100;
+        t.s1         = v.memory_start() + i * 100;
+        t.size       = 100;
+        t.step.eps   = 0.01;
+        t.step.beta1 = 0.9;
+        t.step.beta2 = 0.999;
+    }
+
+    dll::fused_update<dll::updater_type::ADAM, dll::decay_type::NONE>(tensors);
+
+    m_ref = 0.1 * g;
+    v_ref = 0.001 * (g >> g);
+    w_ref += (0.01 * m_ref) / (etl::sqrt(v_ref) + 1e-8);
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(m[i] == Approx(m_ref[i]));
+        REQUIRE(v[i] == Approx(v_ref[i]));
+        REQUIRE(w[i] == Approx(w_ref[i]));
+    }
+}
+
+// Backups and storage through the flat parameters
+TEST_CASE("unit/dense/flat/0", "[unit][dense][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::flat_parameters, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->flat_parameters().size() == 28 * 28 * 100 + 100 + 100 * 10 + 10);
+    REQUIRE(dbn->flat_parameters().tensors() == 4);
+
+    etl::fast_dyn_matrix<float, 28 * 28, 100> w = dbn->template layer_get<0>().w;
+
+    dbn->backup_weights();
+
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+    dbn->store_parameters("/tmp/dll_flat.dllp");
+
+    dbn->restore_weights();
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(dbn->template layer_get<0>().w[i] == w[i]);
+    }
+
+    REQUIRE(dbn->load_parameters("/tmp/dll_flat.dllp"));
+
+    auto dbn2 = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn2->load_parameters("/tmp/dll_flat.dllp"));
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(dbn2->template layer_get<0>().w[i] == dbn->template layer_get<0>().w[i]);
+    }
+
+    std::remove("/tmp/dll_flat.dllp");
+}
+
+TEST_CASE("unit/dense/checkpoint/0", "[unit][dense][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::checkpoint_every<5>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->checkpoint_file = "/tmp/dll_checkpoint.dllc";
+    dbn->learning_rate   = 0.001;
+
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+    // The last batch was checkpointed, resume from it without learning
+    auto dbn2 = std::make_unique<dbn_t>();
+
+    dbn2->checkpoint_file   = "/tmp/dll_checkpoint.dllc";
+    dbn2->resume_checkpoint = true;
+    dbn2->learning_rate     = 0.0;
+
+    dbn2->fine_tune(dataset.training_images, dataset.training_labels, 1);
+
+    for (size_t i = 0; i < etl::size(dbn->template layer_get<0>().w); ++i) {
+        REQUIRE(dbn2->template layer_get<0>().w[i] == dbn->template layer_get<0>().w[i]);
+    }
+
+    std::remove("/tmp/dll_checkpoint.dllc");
+}
+
+TEST_CASE("unit/dense/checkpoint/1", "[unit][dense][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::checkpoint_every<15>, dll::shuffle, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->checkpoint_file = "/tmp/dll_checkpoint_1.dllc";
+    dbn->learning_rate   = 0.001;
+
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+    // The last checkpoint is in the middle of the second epoch, resume
+    // from it and train the rest of the epoch, in the same order
+    auto dbn2 = std::make_unique<dbn_t>();
+
+    dbn2->checkpoint_file   = "/tmp/dll_checkpoint_1.dllc";
+    dbn2->resume_checkpoint = true;
+    dbn2->learning_rate     = 0.001;
+
+    dbn2->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+    for (size_t i = 0; i < etl::size(dbn->template layer_get<0>().w); ++i) {
+        REQUIRE(dbn2->template layer_get<0>().w[i] == Approx(dbn->template layer_get<0>().w[i]));
+    }
+
+    std::remove("/tmp/dll_checkpoint_1.dllc");
+}
+
+// Merge of two branches of different sizes
+TEST_CASE("unit/dense/merge/0", "[unit][dense][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::merge_layer<
+                0,
+                dll::dense_layer_desc<28 * 28, 30>::layer_t,
+                dll::dense_layer_desc<28 * 28, 20>::layer_t>,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::momentum, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto& merge = dbn->template layer_get<0>();
+
+    // The second branch starts after the 30 outputs of the first one
+    auto output = merge.forward_one(dataset.training_images[0]);
+
+    auto first  = std::get<0>(merge.layers).forward_one(dataset.training_images[0]);
+    auto second = std::get<1>(merge.layers).forward_one(dataset.training_images[0]);
+
+    for (size_t i = 0; i < 30; ++i) {
+        REQUIRE(output[i] == Approx(first[i]));
+    }
+
+    for (size_t i = 0; i < 20; ++i) {
+        REQUIRE(output[30 + i] == Approx(second[i]));
+    }
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.25);
+}
+
+// Test the memory tracking of the training
+TEST_CASE("unit/dense/memory/0", "[unit][dense][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::watcher<dll::memory_dbn_watcher>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    const size_t weights_before = dll::get_memory_usage(dll::memory_category::WEIGHTS).live;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    const size_t weights = (28 * 28 * 100 + 100 + 100 * 10 + 10) * sizeof(float);
+
+    REQUIRE(dll::get_memory_usage(dll::memory_category::WEIGHTS).live == weights_before + weights);
+
+    const size_t contexts   = dll::get_memory_usage(dll::memory_category::CONTEXT).live;
+    const size_t generators = dll::get_memory_usage(dll::memory_category::GENERATOR).live;
+
+    dll::reset_memory_peaks();
+
+    FT_CHECK(25, 5e-2);
+
+    // The contexts and the generator are released after the training
+    REQUIRE(dll::get_memory_usage(dll::memory_category::CONTEXT).live == contexts);
+    REQUIRE(dll::get_memory_usage(dll::memory_category::GENERATOR).live == generators);
+
+    // The contexts hold at least the gradients and the momentum, the generator the whole dataset
+    REQUIRE(dll::get_memory_usage(dll::memory_category::CONTEXT).peak >= contexts + 2 * weights);
+    REQUIRE(dll::get_memory_usage(dll::memory_category::GENERATOR).peak >= generators + 350 * 28 * 28 * sizeof(float));
+
+    TEST_CHECK(0.2);
+}
+
+// Test the rate-limited watcher and its background logger
+TEST_CASE("unit/dense/watcher/rate_limited", "[unit][dense][dbn][mnist]") {
+    std::ostringstream os;
+
+    {
+        dll::async_logger logger(os);
+
+        for (size_t i = 0; i < 100; ++i) {
+            logger.log("line " + std::to_string(i));
+        }
+
+        logger.flush();
+
+        const auto written = os.str();
+
+        REQUIRE(std::count(written.begin(), written.end(), '\n') == 100);
+
+        logger.log("last");
+    }
+
+    // The remaining lines are written at destruction
+    const auto written = os.str();
+
+    REQUIRE(written.substr(written.size() - 5) == "last\n");
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::watcher<dll::rate_limited_dbn_watcher>, dll::verbose, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 5e-2);
+    TEST_CHECK(0.2);
+}
+
+// Test the batched evaluation of the network
+TEST_CASE("unit/dense/test_batch/1", "[unit][dense][dbn][mnist]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 5e-2);
+
+    auto error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::predictor());
+
+    // The last batch is incomplete
+    REQUIRE(dll::test_set_batch(dbn, dataset.training_images, dataset.training_labels, dll::batch_predictor(), 64) == Approx(error));
+    REQUIRE(dll::test_set_batch(dbn, dataset.training_images, dataset.training_labels, dll::batch_predictor(), 1000) == Approx(error));
+}
+
+// Hybrid network, only the hidden layer is kept static
+TEST_CASE("unit/dense/hybrid/0", "[unit][dense][dbn][mnist][sgd]") {
+    using hidden_t = dll::dense_layer_desc<150, 100>::layer_t;
+
+    using dbn_t = dll::hybrid_dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            hidden_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::fast_layers<hidden_t>, dll::batch_size<20>
+    >::dbn_t;
+
+    static_assert(dll::decay_layer_traits<dbn_t::layer_type<0>>::is_dynamic(), "The first layer must be dynamic");
+    static_assert(std::is_same<dbn_t::layer_type<1>, hidden_t>::value, "The hidden layer must be kept static");
+    static_assert(dll::decay_layer_traits<dbn_t::layer_type<2>>::is_dynamic(), "The last layer must be dynamic");
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->template layer_get<0>().input_size() == 28 * 28);
+    REQUIRE(dbn->template layer_get<2>().output_size() == 10);
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Index shuffle of the in-memory generator
+TEST_CASE("unit/dense/index_shuffle/0", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<20>, dll::shuffle
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<20>, dll::categorical, dll::normalize_pre, dll::index_shuffle<64>>;
+
+    auto generator = make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, generator_t{});
+
+    etl::dyn_vector<float> first_sample(generator->input_cache(0));
+
+    generator->reset_shuffle();
+
+    // The cache is not moved, only the order is shuffled
+    REQUIRE(etl::sum(generator->input_cache(0) - first_sample) == Approx(0.0f));
+    auto sorted = generator->order;
+    std::sort(sorted.begin(), sorted.end());
+
+    REQUIRE(sorted != generator->order);
+
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        REQUIRE(sorted[i] == i);
+    }
+
+    // The batches are gathered in the shuffled order
+    auto batch = generator->data_batch();
+    REQUIRE(etl::sum(batch(1) - generator->input_cache(generator->order[1])) == Approx(0.0f));
+
+    generator->reset();
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    auto error = dbn->fine_tune(*generator, 30);
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/dense/fused_pre/0", "[unit][dense][dbn][mnist][sgd]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>, dll::threaded>;
+
+    auto generator = make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, generator_t{});
+
+    // The fused copy gives the same cache as the transformations of the samples
+    for (size_t i = 0; i < dataset.training_images.size(); i += 37) {
+        etl::dyn_vector<float> expected(dataset.training_images[i] / 255.0f);
+
+        REQUIRE(etl::sum(generator->input_cache(i) - expected) == Approx(0.0f));
+    }
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<25>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    auto error = dbn->fine_tune(*generator, 30);
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/dense/parallel_eval/0", "[unit][dense][dbn][mnist][sgd]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical>;
+
+    auto generator = make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, generator_t{});
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<25>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    dbn->fine_tune(*generator, 10);
+
+    // The parallel evaluation gives the same metrics as the serial one
+    auto serial_helper = [&dbn](auto&& input_batch) { return dbn->forward_batch(input_batch); };
+
+    auto [serial_error, serial_loss]     = dbn->evaluate_metrics(*generator, serial_helper);
+    auto [parallel_error, parallel_loss] = dbn->evaluate_metrics(*generator);
+
+    REQUIRE(parallel_error == Approx(serial_error));
+    REQUIRE(parallel_loss == Approx(serial_loss));
+
+    auto confusion = dbn->evaluate_confusion(*generator);
+
+    REQUIRE(confusion.classes == 10);
+    REQUIRE(confusion.total() == dataset.training_images.size());
+    REQUIRE(confusion.error() == Approx(serial_error));
+}
+
+TEST_CASE("unit/dense/async_val/0", "[unit][dense][dbn][mnist][sgd]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical>;
+
+    auto train_generator = make_generator(dataset.training_images.begin(), dataset.training_images.begin() + 800,
+                                          dataset.training_labels.begin(), dataset.training_labels.begin() + 800, 800, 10, generator_t{});
+
+    auto val_generator = make_generator(dataset.training_images.begin() + 800, dataset.training_images.end(),
+                                        dataset.training_labels.begin() + 800, dataset.training_labels.end(), 200, 10, generator_t{});
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<25>, dll::early_stopping<dll::strategy::ERROR_BEST>, dll::async_validation
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    auto error = dbn->fine_tune_val(*train_generator, *val_generator, 20);
+    REQUIRE(error < 5e-2);
+
+    // The weights left in the network are the ones of a validated epoch
+    REQUIRE(dbn->evaluate_error(*val_generator) < 0.2);
+}
+
+TEST_CASE("unit/dense/backup_every/0", "[unit][dense][dbn][mnist][sgd]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical>;
+
+    auto train_generator = make_generator(dataset.training_images.begin(), dataset.training_images.begin() + 800,
+                                          dataset.training_labels.begin(), dataset.training_labels.begin() + 800, 800, 10, generator_t{});
+
+    auto val_generator = make_generator(dataset.training_images.begin() + 800, dataset.training_images.end(),
+                                        dataset.training_labels.begin() + 800, dataset.training_labels.end(), 200, 10, generator_t{});
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<25>, dll::early_stopping<dll::strategy::ERROR_BEST>, dll::backup_every<3>, dll::flat_parameters
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    auto error = dbn->fine_tune_val(*train_generator, *val_generator, 20);
+    REQUIRE(error < 5e-2);
+
+    REQUIRE(dbn->evaluate_error(*val_generator) < 0.2);
+}
+
+TEST_CASE("unit/dense/validation_subset/0", "[unit][dense][dbn][mnist][sgd]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical>;
+
+    auto train_generator = make_generator(dataset.training_images.begin(), dataset.training_images.begin() + 800,
+                                          dataset.training_labels.begin(), dataset.training_labels.begin() + 800, 800, 10, generator_t{});
+
+    auto val_generator = make_generator(dataset.training_images.begin() + 800, dataset.training_images.end(),
+                                        dataset.training_labels.begin() + 800, dataset.training_labels.end(), 200, 10, generator_t{});
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<25>, dll::early_stopping<dll::strategy::ERROR_BEST>
+    >::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate         = 0.05;
+    dbn->validation_subset     = 50;
+    dbn->full_validation_every = 5;
+
+    // The subset is made of validation samples
+    {
+        auto trainer = dbn->get_trainer();
+        auto subset  = trainer.make_validation_subset(*dbn, *val_generator);
+
+        REQUIRE(subset);
+        REQUIRE(subset->size() == 50);
+        REQUIRE(subset->batches() == 2);
+    }
+
+    auto error = dbn->fine_tune_val(*train_generator, *val_generator, 20);
+    REQUIRE(error < 5e-2);
+
+    REQUIRE(dbn->evaluate_error(*val_generator) < 0.2);
+}
+
+// Test a network with sparse (binarized) input
+TEST_CASE("unit/dense/sparse/0", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::sparse_input>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::batch_size<20>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Calibration of the batch size
+TEST_CASE("unit/dense/tune/1", "[unit][dense][dbn]") {
+    auto factory = [](auto B) {
+        using dbn_t = dll::dbn_desc<
+            dll::dbn_layers<
+                dll::dense_layer_desc<28 * 28, 100>::layer_t,
+                dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+            dll::batch_size<decltype(B)::value>
+        >::dbn_t;
+
+        return std::make_unique<dbn_t>();
+    };
+
+    etl::dyn_matrix<float, 2> inputs(64, 28 * 28);
+    etl::dyn_matrix<float, 2> labels(64, 10);
+
+    inputs = etl::uniform_generator(0.0, 1.0);
+    labels = 0;
+
+    for (size_t i = 0; i < 64; ++i) {
+        labels(i, i % 10) = 1;
+    }
+
+    auto tuning = dll::tune_batch_size<8, 16, 32, 64, 128>(factory, inputs, labels, 3);
+
+    // 128 is larger than the number of samples
+    REQUIRE(tuning.measures.size() == 4);
+
+    for (auto& measure : tuning.measures) {
+        REQUIRE(measure.samples_per_second > 0.0);
+    }
+
+    REQUIRE(tuning.batch_size >= 8);
+    REQUIRE(tuning.batch_size <= 64);
+    REQUIRE(tuning.big_batch_size >= 1);
+    REQUIRE(tuning.desc_parameters().find("dll::batch_size<" + std::to_string(tuning.batch_size) + ">") == 0);
+}
+
+// Test the shape layers as views, at the front and in the middle of the network
+TEST_CASE("unit/dense/shape/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::shape_1d_layer_desc<28 * 28>::layer_t,
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::shape_1d_layer_desc<100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // The errors must go through the shape layer for the first layer to learn
+    FT_CHECK(25, 5e-2);
+
+    auto engine = dbn->make_inference_engine(25);
+
+    etl::fast_dyn_matrix<float, 25, 28 * 28> batch;
+
+    for (size_t i = 0; i < 25; ++i) {
+        batch(i) = dataset.test_images[i];
+    }
+
+    auto expected = dbn->forward_batch(batch);
+    auto output   = engine.forward(batch);
+
+    for (size_t i = 0; i < 25; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output(i, j) == Approx(expected(i, j)));
+        }
+    }
+}
+
+TEST_CASE("unit/dense/memory_plan/1", "[unit][dense][dbn]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t small_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::shape_1d_layer_desc<28 * 28>::layer_t,
+            dll::dense_layer_desc<28 * 28, 500>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::dense_layer_desc<500, 250>::layer_t,
+            dll::dense_layer_desc<250, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t deep_t;
+
+    using small_plan = dll::training_memory_plan<small_t>;
+    using deep_plan  = dll::training_memory_plan<deep_t>;
+
+    // All the tensors of two layers are alive at the same time
+    static_assert(small_plan::peak == small_plan::naive, "No reuse is possible");
+    static_assert(small_plan::peak == 31360 + 2 * 4032 + 2 * 448, "Invalid plan");
+
+    // The errors of the last layers reuse the memory of the first outputs
+    static_assert(deep_plan::peak < deep_plan::naive, "The memory must be reused");
+    static_assert(deep_plan::peak == 121536, "Invalid plan");
+
+    // The shape layer shares the input of the network
+    REQUIRE(deep_plan::plan[1].bytes == 0);
+
+    // The tensors alive at the same time never overlap
+    for (size_t i = 0; i < deep_plan::tensors; ++i) {
+        for (size_t j = i + 1; j < deep_plan::tensors; ++j) {
+            auto& a = deep_plan::plan[i];
+            auto& b = deep_plan::plan[j];
+
+            if (a.bytes && b.bytes && a.overlaps(b)) {
+                REQUIRE((a.offset + a.bytes <= b.offset || b.offset + b.bytes <= a.offset));
+            }
+        }
+    }
+}
+
+// Hogwild with 4 workers updating the same weights
+TEST_CASE("unit/dense/hogwild/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::hogwild_trainer>, dll::batch_size<10>
+    >::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate   = 0.05;
+    dbn->hogwild_threads = 4;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Continuous training on a stream of samples
+TEST_CASE("unit/dense/online/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    dll::online_data_generator<etl::dyn_matrix<float, 1>, 10> generator(10, 4, 50);
+
+    // The samples arrive while the network is trained
+    std::thread producer([&] {
+        for (size_t pass = 0; pass < 30; ++pass) {
+            for (size_t i = 0; i < dataset.training_images.size(); ++i) {
+                generator.push(dataset.training_images[i], dataset.training_labels[i]);
+            }
+        }
+
+        generator.close();
+    });
+
+    auto ft_error = dbn->fine_tune_online(generator);
+
+    producer.join();
+
+    REQUIRE(generator.finished());
+    REQUIRE(generator.size() == 30 * dataset.training_images.size());
+    REQUIRE(ft_error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(dataset.training_images, dataset.training_labels);
+    REQUIRE(test_error < 5e-2);
+}
+
+// Magnitude pruning and block-sparse inference
+TEST_CASE("unit/dense/prune/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 5e-2);
+
+    // Prune 80% of the blocks of 8 weights of each layer
+    auto zeros = dbn->prune(0.8, dll::prune_scope::LAYER, 8);
+
+    REQUIRE(zeros >= size_t(0.8 * (28 * 28 * 100 + 100 * 10)) - 8 * 28 * 28);
+    REQUIRE(dll::block_density<8>(dbn->template layer_get<0>().w) <= 0.21);
+
+    auto engine = dbn->make_inference_engine(25);
+
+    REQUIRE(engine.sparsify(0.5) == 2);
+    REQUIRE(engine.is_sparse(0));
+    REQUIRE(engine.sparse_memory() < sizeof(float) * (28 * 28 * 100 + 100 * 10) / 2);
+
+    // The sparse path must compute the same outputs as the pruned network
+
+    etl::fast_dyn_matrix<float, 25, 28 * 28> batch;
+
+    for (size_t i = 0; i < 25; ++i) {
+        batch(i) = dataset.test_images[i];
+    }
+
+    auto expected = dbn->forward_batch(batch);
+    auto output   = engine.forward(batch);
+
+    for (size_t i = 0; i < 25; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output(i, j) == Approx(expected(i, j)));
+        }
+    }
+
+    // A global threshold prunes the same ratio of all the groups
+    auto global = std::make_unique<dbn_t>();
+    global->prune(0.5, dll::prune_scope::GLOBAL);
+
+    size_t total_zeros = 0;
+    global->for_each_layer([&total_zeros](auto& layer) {
+        total_zeros += std::count(layer.w.memory_start(), layer.w.memory_end(), 0.0f);
+    });
+
+    REQUIRE(total_zeros >= (28 * 28 * 100 + 100 * 10) / 2);
+}
+
+// Inference with the parameters of a mapped model file
+TEST_CASE("unit/dense/mapped/1", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 5e-2);
+
+    REQUIRE(dbn->store_mapped("/tmp/dll_mapped.dllm"));
+
+    etl::fast_dyn_matrix<float, 25, 28 * 28> batch;
+
+    for (size_t i = 0; i < 25; ++i) {
+        batch(i) = dataset.test_images[i];
+    }
+
+    auto expected = dbn->forward_batch(batch);
+
+    // A fresh network only provides the structure, the parameters are mapped
+    auto empty = std::make_unique<dbn_t>();
+
+    dll::mapped_model<float> model("/tmp/dll_mapped.dllm");
+    REQUIRE(model.valid());
+    REQUIRE(model.size() == 28 * 28 * 100 + 100 + 100 * 10 + 10);
+
+    auto engine = empty->make_inference_engine(25);
+
+    REQUIRE(engine.map(model));
+    REQUIRE(engine.is_mapped(0));
+    REQUIRE(engine.is_mapped(1));
+
+    auto output = engine.forward(batch);
+
+    for (size_t i = 0; i < 25; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output(i, j) == Approx(expected(i, j)));
+        }
+    }
+
+    // A model of another network is refused
+    using other_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t;
+
+    auto other        = std::make_unique<other_t>();
+    auto other_engine = other->make_inference_engine(25);
+
+    REQUIRE(!other_engine.map(model));
+
+    std::remove("/tmp/dll_mapped.dllm");
+}
+
+// Test the single-sample path of the inference engine
+TEST_CASE("unit/dense/one/1", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::shape_1d_layer_desc<28 * 28>::layer_t,
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dropout_layer_desc<50>::layer_t,
+            dll::dense_layer_desc<100, 30, dll::relu>::layer_t,
+            dll::dense_layer_desc<30, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 5e-2);
+
+    auto engine = dbn->make_inference_engine(1);
+
+    static_assert(decltype(engine)::single_sample, "The network must have a single-sample path");
+
+    REQUIRE(engine.is_one_packed());
+
+    etl::fast_dyn_matrix<float, 10> output;
+
+    for (size_t i = 0; i < 25; ++i) {
+        auto expected = dbn->features(dataset.test_images[i]);
+
+        engine.forward_one(dataset.test_images[i], output);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output(j) == Approx(expected[j]));
+        }
+
+        REQUIRE(engine.predict_one(dataset.test_images[i]) == dbn->predict(dataset.test_images[i]));
+    }
+}
+
+TEST_CASE("unit/dense/ensemble/1", "[unit][dense][dbn]") {
+    using dense_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<20, 30, dll::tanh>::layer_t,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t;
+
+    using shaped_dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::shape_1d_layer_desc<20>::layer_t,
+            dll::dense_layer_desc<20, 30, dll::relu>::layer_t,
+            dll::dense_layer_desc<30, 5, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t;
+
+    etl::fast_matrix<float, 7, 20> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto check = [&input](auto& members) {
+        using dbn_t = typename std::decay_t<decltype(members)>::value_type::element_type;
+
+        std::vector<const dbn_t*> pointers;
+
+        etl::fast_matrix<float, 7, 5> expected(0.0);
+
+        for (auto& member : members) {
+            pointers.push_back(member.get());
+
+            etl::fast_matrix<float, 7, 5> output;
+            output = member->forward_batch(input);
+            expected += output;
+        }
+
+        expected /= float(members.size());
+
+        dll::ensemble_engine<dbn_t> ensemble(pointers, 10);
+
+        REQUIRE(ensemble.size() == members.size());
+
+        auto output = ensemble.forward(input);
+
+        REQUIRE(etl::dim<0>(output) == 7);
+        REQUIRE(etl::dim<1>(output) == 5);
+
+        for (size_t i = 0; i < etl::size(expected); ++i) {
+            REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+        }
+    };
+
+    // The first layers are computed by a single GEMM
+    std::vector<std::unique_ptr<dense_dbn_t>> dense_members;
+
+    for (size_t m = 0; m < 5; ++m) {
+        dense_members.push_back(std::make_unique<dense_dbn_t>());
+    }
+
+    static_assert(dll::ensemble_engine<dense_dbn_t>::fused, "The first layers must be fused");
+
+    check(dense_members);
+
+    // The first layers are computed by each member
+    std::vector<std::unique_ptr<shaped_dbn_t>> shaped_members;
+
+    for (size_t m = 0; m < 3; ++m) {
+        shaped_members.push_back(std::make_unique<shaped_dbn_t>());
+    }
+
+    static_assert(!dll::ensemble_engine<shaped_dbn_t>::fused, "The first layers must not be fused");
+
+    check(shaped_members);
+}
+
+// Fast activations are close to the exact ones
+TEST_CASE("unit/dense/fast/1", "[unit][dense]") {
+    for (float x = -80.0f; x <= 80.0f; x += 0.01f) {
+        REQUIRE(std::abs(dll::fast_exp(x) - std::exp(x)) <= 2e-6f * std::exp(x));
+        REQUIRE(std::abs(dll::fast_sigmoid(x) - 1.0f / (1.0f + std::exp(-x))) < 1e-6f);
+        REQUIRE(std::abs(dll::fast_tanh(x) - std::tanh(x)) < 1e-6f);
+    }
+
+    auto check = [](auto& exact, auto& fast) {
+        fast.w = exact.w;
+        fast.b = exact.b;
+
+        etl::fast_matrix<float, 8, 20> input;
+        input = etl::uniform_generator(-2.0, 2.0);
+
+        etl::fast_matrix<float, 8, 30> expected;
+        etl::fast_matrix<float, 8, 30> output;
+
+        exact.test_forward_batch(expected, input);
+        fast.test_forward_batch(output, input);
+
+        for (size_t i = 0; i < etl::size(expected); ++i) {
+            REQUIRE(output[i] == Approx(expected[i]).margin(1e-5));
+        }
+    };
+
+    dll::dense_layer_desc<20, 30, dll::sigmoid>::layer_t sigmoid_exact;
+    dll::dense_layer_desc<20, 30, dll::sigmoid, dll::fast_activations>::layer_t sigmoid_fast;
+    check(sigmoid_exact, sigmoid_fast);
+
+    dll::dense_layer_desc<20, 30, dll::tanh>::layer_t tanh_exact;
+    dll::dense_layer_desc<20, 30, dll::tanh, dll::fast_activations>::layer_t tanh_fast;
+    check(tanh_exact, tanh_fast);
+
+    dll::dense_layer_desc<20, 30, dll::softmax>::layer_t softmax_exact;
+    dll::dense_layer_desc<20, 30, dll::softmax, dll::fast_activations>::layer_t softmax_fast;
+    check(softmax_exact, softmax_fast);
+}
+
+// Train the last layer with a sampled softmax
+TEST_CASE("unit/dense/sampled/1", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax, dll::sampled_softmax<3>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<5>>::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<5>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(30, 0.1);
+    TEST_CHECK_DATASET(0.3);
+
+    // The classes of the samples are always candidates
+    dll::sampled_softmax_state<float> state;
+
+    etl::dyn_vector<float> labels({7.0f, 2.0f, 7.0f, 900.0f});
+
+    dll::sample_classes(state, labels, 4, 1000, 10);
+
+    REQUIRE(state.candidates() == 13);
+
+    for (size_t i = 0; i < 4; ++i) {
+        REQUIRE(float(state.classes[state.targets[i]]) == labels[i]);
+    }
+
+    std::vector<size_t> classes = state.classes;
+    std::sort(classes.begin(), classes.end());
+
+    REQUIRE(std::unique(classes.begin(), classes.end()) == classes.end());
+}
+
+// Dense layer with the weights sharded by output columns
+TEST_CASE("unit/dense/sharded/1", "[unit][dense][dbn][mnist][sgd]") {
+    dll::dense_layer_desc<20, 12, dll::tanh>::layer_t dense;
+    dll::sharded_dense_layer_desc<20, 12, 3, dll::tanh>::layer_t sharded;
+
+    for (size_t v = 0; v < 20; ++v) {
+        for (size_t h = 0; h < 12; ++h) {
+            sharded.weight_at(v, h) = dense.w(v, h);
+        }
+    }
+
+    sharded.b = dense.b;
+
+    etl::fast_matrix<float, 7, 20> input;
+    input = etl::uniform_generator(-2.0, 2.0);
+
+    etl::fast_matrix<float, 7, 12> expected;
+    etl::fast_matrix<float, 7, 12> output;
+
+    dense.test_forward_batch(expected, input);
+    sharded.test_forward_batch(output, input);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).margin(1e-5));
+    }
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::sharded_dense_layer_desc<28 * 28, 100, 4>::layer_t,
+            dll::sharded_dense_layer_desc<100, 10, 2, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<10>>::dbn_t;
+
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::normalize_pre{}, dll::batch_size<10>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.05;
+
+    FT_CHECK_DATASET(30, 0.1);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Pipeline-parallel training over three stages
+TEST_CASE("unit/dense/pipeline/1", "[unit][dense][dbn][mnist][sgd]") {
+    // The stages are contiguous, balanced and never empty
+    REQUIRE(dll::partition_stages({10, 10, 10, 10}, 2) == std::vector<size_t>({0, 2, 4}));
+    REQUIRE(dll::partition_stages({100, 1, 1, 1}, 2) == std::vector<size_t>({0, 1, 4}));
+    REQUIRE(dll::partition_stages({1, 1, 1, 100}, 3) == std::vector<size_t>({0, 2, 3, 4}));
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 100>::layer_t,
+            dll::dense_layer_desc<100, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::pipeline_stages<3>, dll::micro_batches<4>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Selective backprop of half of the samples
+TEST_CASE("unit/dense/selective/1", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::selective_backprop<50>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // The selected samples of two batches make one trained batch
+
+    {
+        dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+        etl::fast_dyn_matrix<float, 10, 28 * 28> inputs;
+        etl::fast_dyn_matrix<float, 10, 10> labels;
+
+        etl::fast_dyn_matrix<float, 100, 10> w = dbn->template layer_get<1>().w;
+
+        auto updated = [&]() {
+            for (size_t i = 0; i < etl::size(w); ++i) {
+                if (dbn->template layer_get<1>().w[i] != w[i]) {
+                    return true;
+                }
+            }
+
+            return false;
+        };
+
+        for (size_t b = 0; b < 2; ++b) {
+            labels = 0;
+
+            for (size_t i = 0; i < 10; ++i) {
+                inputs(i) = dataset.training_images[b * 10 + i];
+                labels(i, dataset.training_labels[b * 10 + i]) = 1.0;
+            }
+
+            trainer.train_batch(0, inputs, labels);
+
+            REQUIRE(trainer.scored_samples == 10 * (b + 1));
+            REQUIRE(trainer.pending_samples == (b ? 0 : 5));
+
+            REQUIRE(updated() == (b > 0));
+        }
+
+        REQUIRE(trainer.trained_samples == 10);
+    }
+
+    FT_CHECK(50, 0.1);
+    TEST_CHECK(0.3);
+}
+
+// Decoder tied to the transpose of the weights of the encoder
+TEST_CASE("unit/dense/tied/1", "[unit][dense][dbn][mnist][sgd][ae]") {
+    dll::dense_layer_desc<20, 12, dll::tanh>::layer_t encoder;
+    dll::tied_dense_layer_desc<12, 20, dll::sigmoid>::layer_t decoder;
+    dll::dense_layer_desc<12, 20, dll::sigmoid>::layer_t untied;
+
+    decoder.tie(encoder);
+
+    decoder.b = etl::uniform_generator(-1.0, 1.0);
+    untied.b  = decoder.b;
+    untied.w  = etl::transpose(encoder.w);
+
+    etl::fast_matrix<float, 7, 12> input;
+    input = etl::uniform_generator(-2.0, 2.0);
+
+    etl::fast_matrix<float, 7, 20> expected;
+    etl::fast_matrix<float, 7, 20> output;
+
+    untied.test_forward_batch(expected, input);
+    decoder.test_forward_batch(output, input);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).margin(1e-5));
+    }
+
+    using network_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 64, dll::sigmoid>::layer_t,
+            dll::tied_dense_layer_desc<64, 28 * 28, dll::sigmoid>::layer_t>,
+        dll::autoencoder, dll::loss<dll::loss_function::BINARY_CROSS_ENTROPY>, dll::momentum, dll::batch_size<20>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto net = std::make_unique<network_t>();
+
+    net->template layer_get<1>().tie(net->template layer_get<0>());
+
+    // Only the biases of the decoder are added to the parameters
+    REQUIRE(net->template layer_get<1>().parameters() == 28 * 28);
+
+    net->learning_rate = 0.1;
+
+    auto ft_error = net->fine_tune_ae(dataset.training_images, 25);
+    std::cout << "ft_error:" << ft_error << std::endl;
+
+    CHECK(ft_error < 0.1);
+
+    auto test_error = dll::test_set_ae(*net, dataset.test_images);
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.1);
+}
+
+// Distill a small student network from a larger teacher
+TEST_CASE("unit/dense/distill/1", "[unit][dense][dbn][mnist][sgd][distill]") {
+    using teacher_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::softmax>::layer_t>,
+        dll::momentum, dll::batch_size<20>>::dbn_t;
+
+    using student_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::momentum, dll::batch_size<20>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(1000);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto teacher = std::make_unique<teacher_t>();
+    auto student = std::make_unique<student_t>();
+
+    teacher->learning_rate = 0.1;
+    student->learning_rate = 0.1;
+
+    teacher->fine_tune(dataset.training_images, dataset.training_labels, 30);
+
+    dll::distillation_options options;
+    options.temperature = 2.0;
+    options.alpha       = 0.5;
+    options.cache       = "distill.cache";
+
+    auto ft_error = student->fine_tune_distill(*teacher, dataset.training_images, dataset.training_labels, 30, options);
+    std::cout << "ft_error:" << ft_error << std::endl;
+
+    // The second computation of the targets is read from the cache
+    auto targets = dll::distillation_targets(*teacher, dataset.training_images, dataset.training_labels, options);
+    REQUIRE(targets.size() == dataset.training_images.size());
+    REQUIRE(etl::sum(targets[0]) == Approx(1.0f).epsilon(1e-3));
+
+    std::remove("distill.cache");
+
+    auto test_error = student->evaluate_error(dataset.test_images, dataset.test_labels);
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.3);
+}
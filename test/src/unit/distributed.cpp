@@ -0,0 +1,202 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <mutex>
+#include <thread>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+/*!
+ * \brief Run the given functor on ranks local ranks, connected on the local
+ * host, each in its own thread
+ */
+template <typename Functor>
+void run_ranks(size_t ranks, size_t port, Functor fun) {
+    std::vector<std::string> peers;
+
+    for (size_t r = 0; r < ranks; ++r) {
+        peers.push_back("127.0.0.1:" + std::to_string(port + r));
+    }
+
+    std::vector<std::thread> threads;
+
+    for (size_t r = 0; r < ranks; ++r) {
+        threads.emplace_back([&, r] {
+            dll::communicator comm;
+
+            if (comm.connect(r, peers)) {
+                fun(comm);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+/*!
+ * \brief The batches trained by each rank
+ */
+std::mutex batches_lock;
+std::vector<std::vector<size_t>> rank_batches;
+
+/*!
+ * \brief A watcher recording the batches trained by each rank
+ */
+template <typename DBN>
+struct batches_watcher : dll::silent_dbn_watcher<DBN> {
+    void ft_batch_end(size_t /*epoch*/, size_t batch, size_t /*batches*/, double /*batch_error*/, double /*batch_loss*/, const DBN& dbn) {
+        std::lock_guard<std::mutex> l(batches_lock);
+        rank_batches[dbn.distributed->rank()].push_back(batch);
+    }
+};
+
+} // end of anonymous namespace
+
+TEST_CASE("unit/distributed/ring/1", "[distributed][unit]") {
+    constexpr size_t ranks = 3;
+    constexpr size_t n     = 1001; // Not a multiple of the number of ranks
+
+    std::vector<std::vector<float>> sums(ranks);
+    std::vector<std::vector<double>> broadcasts(ranks);
+
+    run_ranks(ranks, 27400, [&](dll::communicator& comm) {
+        const size_t rank = comm.rank();
+
+        std::vector<float> values(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = float(rank + 1) * float(i % 17);
+        }
+
+        comm.all_reduce(values.data(), n);
+
+        std::vector<double> broadcast(7, double(rank));
+
+        if (!rank) {
+            for (size_t i = 0; i < broadcast.size(); ++i) {
+                broadcast[i] = 0.5 * i;
+            }
+        }
+
+        comm.broadcast(broadcast.data(), broadcast.size());
+
+        sums[rank]       = std::move(values);
+        broadcasts[rank] = std::move(broadcast);
+    });
+
+    for (size_t r = 0; r < ranks; ++r) {
+        REQUIRE(sums[r].size() == n);
+        REQUIRE(broadcasts[r].size() == 7);
+
+        // 1 + 2 + 3 = 6, the sums are exact and the same on all the ranks
+        for (size_t i = 0; i < n; ++i) {
+            REQUIRE(sums[r][i] == 6.0f * float(i % 17));
+        }
+
+        for (size_t i = 0; i < 7; ++i) {
+            REQUIRE(broadcasts[r][i] == 0.5 * i);
+        }
+    }
+}
+
+TEST_CASE("unit/distributed/reducer/1", "[distributed][unit]") {
+    constexpr size_t ranks = 2;
+
+    std::vector<std::vector<float>> smalls(ranks);
+    std::vector<std::vector<float>> larges(ranks);
+
+    run_ranks(ranks, 27410, [&](dll::communicator& comm) {
+        const size_t rank = comm.rank();
+
+        // The small gradients are merged in buckets, the large one is reduced in place
+        dll::gradient_reducer<float> reducer(comm, 64);
+
+        std::vector<float> small_a(10, float(rank + 1));
+        std::vector<float> small_b(20, float(2 * rank + 1));
+        std::vector<float> large(100, float(rank));
+
+        reducer.submit(small_a.data(), small_a.size());
+        reducer.submit(large.data(), large.size());
+        reducer.submit(small_b.data(), small_b.size());
+        reducer.wait();
+
+        small_a.insert(small_a.end(), small_b.begin(), small_b.end());
+
+        smalls[rank] = std::move(small_a);
+        larges[rank] = std::move(large);
+    });
+
+    for (size_t r = 0; r < ranks; ++r) {
+        REQUIRE(smalls[r].size() == 30);
+        REQUIRE(larges[r].size() == 100);
+
+        for (size_t i = 0; i < 10; ++i) {
+            REQUIRE(smalls[r][i] == 3.0f);
+        }
+
+        for (size_t i = 10; i < 30; ++i) {
+            REQUIRE(smalls[r][i] == 4.0f);
+        }
+
+        for (size_t i = 0; i < 100; ++i) {
+            REQUIRE(larges[r][i] == 1.0f);
+        }
+    }
+}
+
+TEST_CASE("unit/distributed/dense/1", "[distributed][dense][sgd][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::watcher<batches_watcher>, dll::batch_size<10>>::dbn_t;
+
+    constexpr size_t ranks = 3;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rank_batches.assign(ranks, {});
+
+    std::vector<etl::dyn_matrix<float, 2>> weights(ranks, etl::dyn_matrix<float, 2>(28 * 28, 50));
+
+    run_ranks(ranks, 27420, [&](dll::communicator& comm) {
+        auto dbn = std::make_unique<dbn_t>();
+
+        dbn->distributed = &comm;
+
+        dbn->fine_tune(dataset.training_images, dataset.training_labels, 1);
+
+        weights[comm.rank()] = dbn->template layer_get<0>().w;
+    });
+
+    // The 20 batches are distributed in round-robin, the last two cannot be given to all the ranks
+    for (size_t r = 0; r < ranks; ++r) {
+        REQUIRE(rank_batches[r].size() == 6);
+
+        for (size_t i = 0; i < rank_batches[r].size(); ++i) {
+            REQUIRE(rank_batches[r][i] == i * ranks + r);
+        }
+    }
+
+    // All the replicas hold the same network
+    for (size_t r = 1; r < ranks; ++r) {
+        REQUIRE(weights[r] == weights[0]);
+    }
+}
@@ -192,3 +192,119 @@ TEST_CASE("unit/dyn_dense/sgd/7", "[unit][dyn_dense][dbn][mnist][sgd]") {
     FT_CHECK(50, 5e-2);
     TEST_CHECK(0.2);
 }
+
+// Test the activation checkpointing
+TEST_CASE("unit/dyn_dense/sgd/8", "[unit][dyn_dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>::layer_t,
+            dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::sgd_checkpoint<2>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t checkpointed_dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn  = std::make_unique<dbn_t>();
+    auto cdbn = std::make_unique<checkpointed_dbn_t>();
+
+    dbn->template layer_get<0>().init_layer(28 * 28, 150);
+    dbn->template layer_get<1>().init_layer(150, 150);
+    dbn->template layer_get<2>().init_layer(150, 150);
+    dbn->template layer_get<3>().init_layer(150, 10);
+
+    cdbn->template layer_get<0>().init_layer(28 * 28, 150);
+    cdbn->template layer_get<1>().init_layer(150, 150);
+    cdbn->template layer_get<2>().init_layer(150, 150);
+    cdbn->template layer_get<3>().init_layer(150, 10);
+
+    cdbn->template layer_get<0>().w = dbn->template layer_get<0>().w;
+    cdbn->template layer_get<0>().b = dbn->template layer_get<0>().b;
+    cdbn->template layer_get<1>().w = dbn->template layer_get<1>().w;
+    cdbn->template layer_get<1>().b = dbn->template layer_get<1>().b;
+    cdbn->template layer_get<2>().w = dbn->template layer_get<2>().w;
+    cdbn->template layer_get<2>().b = dbn->template layer_get<2>().b;
+    cdbn->template layer_get<3>().w = dbn->template layer_get<3>().w;
+    cdbn->template layer_get<3>().b = dbn->template layer_get<3>().b;
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+    dll::sgd_trainer<checkpointed_dbn_t> ctrainer(*cdbn);
+
+    etl::fast_dyn_matrix<float, 10, 28 * 28> inputs;
+    etl::fast_dyn_matrix<float, 10, 10> labels;
+
+    for (size_t b = 0; b < 5; ++b) {
+        labels = 0;
+
+        for (size_t i = 0; i < 10; ++i) {
+            inputs(i) = dataset.training_images[b * 10 + i];
+
+            labels(i, dataset.training_labels[b * 10 + i]) = 1.0;
+        }
+
+        auto result  = trainer.train_batch(0, inputs, labels);
+        auto cresult = ctrainer.train_batch(0, inputs, labels);
+
+        REQUIRE(cresult.first == Approx(result.first));
+        REQUIRE(cresult.second == Approx(result.second));
+    }
+
+    for (size_t i = 0; i < etl::size(dbn->template layer_get<3>().w); ++i) {
+        REQUIRE(cdbn->template layer_get<3>().w[i] == Approx(dbn->template layer_get<3>().w[i]));
+    }
+
+    // The activations of the first segment are only kept during its recomputation
+    auto memory  = trainer.context_memory();
+    auto cmemory = ctrainer.context_memory();
+
+    REQUIRE(cmemory.full == memory.full);
+    REQUIRE(cmemory.checkpointed < cmemory.full);
+}
+
+// The kernel of the shape of the layer computes the same output as the generic code
+TEST_CASE("unit/dyn_dense/shape/1", "[unit][dyn_dense]") {
+    dll::dyn_dense_layer_desc<dll::softmax, dll::fixed_shapes<>>::layer_t generic;
+    dll::dyn_dense_layer_desc<dll::softmax, dll::fixed_shapes<dll::shape<28 * 28, 10>>>::layer_t fixed;
+
+    generic.init_layer(28 * 28, 10);
+    fixed.init_layer(28 * 28, 10);
+
+    REQUIRE(!generic.forward_kernel);
+    REQUIRE(fixed.forward_kernel);
+
+    generic.b = etl::normal_generator<float>();
+
+    fixed.w = generic.w;
+    fixed.b = generic.b;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(7);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    etl::dyn_matrix<float, 2> input(7, 28 * 28);
+    etl::dyn_matrix<float, 2> output_generic(7, 10);
+    etl::dyn_matrix<float, 2> output_fixed(7, 10);
+
+    for (size_t i = 0; i < 7; ++i) {
+        input(i) = dataset.training_images[i];
+    }
+
+    generic.forward_batch(output_generic, input);
+    fixed.forward_batch(output_fixed, input);
+
+    for (size_t i = 0; i < etl::size(output_fixed); ++i) {
+        REQUIRE(output_fixed[i] == Approx(output_generic[i]).epsilon(1e-4));
+    }
+}
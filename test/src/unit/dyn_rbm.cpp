@@ -54,3 +54,85 @@ TEST_CASE("unit/dyn_rbm/mnist/3", "[rbm][dyn][relu][momentum][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 5e-2);
 }
+
+TEST_CASE("unit/dyn_rbm/mnist/4", "[rbm][dyn][sparse][unit]") {
+    dll::dyn_rbm_desc<
+        dll::momentum,
+        dll::sparsity<dll::sparsity_method::LOCAL_TARGET>>::layer_t rbm(28 * 28, 100);
+
+    //0.01 (default) is way too low for 100 hidden units
+    rbm.sparsity_target = 0.1;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/dyn_rbm/blocked/1", "[rbm][dyn][unit]") {
+    // The weights are larger than the threshold of the blocked Gibbs step
+    dll::dyn_rbm_desc<>::layer_t rbm(28 * 28, 3000);
+
+    REQUIRE(etl::size(rbm.w) * sizeof(float) >= dll::blocked_gibbs_threshold);
+
+    etl::dyn_matrix<float, 2> h_s(10, 3000);
+    etl::dyn_matrix<float, 2> v_a(10, 28 * 28);
+    etl::dyn_matrix<float, 2> v_s(10, 28 * 28);
+    etl::dyn_matrix<float, 2> h2_a(10, 3000);
+    etl::dyn_matrix<float, 2> h2_s(10, 3000);
+
+    h_s = etl::uniform_generator(0.0, 1.0);
+
+    rbm.batch_activate_visible_hidden<false>(h_s, h_s, v_a, v_s, h2_a, h2_s);
+
+    etl::dyn_matrix<float, 2> v_e(10, 28 * 28);
+    etl::dyn_matrix<float, 2> h_e(10, 3000);
+
+    rbm.batch_activate_visible<true, false>(h_s, h_s, v_e, v_s);
+    rbm.batch_activate_hidden<true, false>(h_e, h2_s, v_e, v_e);
+
+    for (size_t i = 0; i < etl::size(v_a); ++i) {
+        REQUIRE(v_a[i] == Approx(v_e[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(h2_a); ++i) {
+        REQUIRE(h2_a[i] == Approx(h_e[i]).epsilon(1e-4));
+    }
+}
+
+// The kernel of the shape of the RBM computes the same activations as the generic code
+TEST_CASE("unit/dyn_rbm/shape/1", "[rbm][dyn][unit]") {
+    dll::dyn_rbm_desc<dll::fixed_shapes<>>::layer_t generic(28 * 28, 100);
+    dll::dyn_rbm_desc<dll::fixed_shapes<dll::shape<28 * 28, 100>>>::layer_t fixed(28 * 28, 100);
+
+    REQUIRE(!generic.product_kernel);
+    REQUIRE(fixed.product_kernel);
+
+    generic.b = etl::normal_generator<float>();
+
+    fixed.w = generic.w;
+    fixed.b = generic.b;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(9);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    etl::dyn_matrix<float, 2> input(9, 28 * 28);
+    etl::dyn_matrix<float, 2> output_generic(9, 100);
+    etl::dyn_matrix<float, 2> output_fixed(9, 100);
+
+    for (size_t i = 0; i < 9; ++i) {
+        input(i) = dataset.training_images[i];
+    }
+
+    generic.forward_batch(output_generic, input);
+    fixed.forward_batch(output_fixed, input);
+
+    for (size_t i = 0; i < etl::size(output_fixed); ++i) {
+        REQUIRE(output_fixed[i] == Approx(output_generic[i]).epsilon(1e-4));
+    }
+}
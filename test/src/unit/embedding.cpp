@@ -5,6 +5,7 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cstdio>
 #include <unordered_map>
 
 #include "dll_test.hpp"
@@ -12,6 +13,7 @@
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "dll/neural/embedding_layer.hpp"
+#include "dll/neural/one_hot_conv_layer.hpp"
 #include "dll/neural/conv_layer.hpp"
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
@@ -142,3 +144,140 @@ TEST_CASE("unit/embedding/2", "[unit][embedding]") {
     REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
     REQUIRE(net->evaluate_error(samples, labels) < 5e-2);
 }
+
+// Simple embedding with one CNN, with sparse updates of the embedding
+TEST_CASE("unit/embedding/3", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam (lazy updates of the embedding rows)
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
+
+// Convolution directly on the one-hot characters
+TEST_CASE("unit/embedding/one_hot/1", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t length = 15;
+
+    using one_hot_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+              dll::one_hot_conv_layer<26, length, 16, 3>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>     // Nesterov Adam (NADAM)
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<one_hot_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
+
+// Convolution directly on the one-hot characters, with sparse updates
+TEST_CASE("unit/embedding/one_hot/2", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t length = 15;
+
+    using one_hot_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+              dll::one_hot_conv_layer<26, length, 16, 3, dll::relu>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAGRAD>   // Adagrad (sparse updates)
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<one_hot_network_t>();
+
+    net->learning_rate = 0.1;
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
+
+// Inference with the embeddings in a read-only mapped model file
+TEST_CASE("unit/embedding/mapped/1", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    // The layers of a dynamic network cannot all be mapped
+    using embedding_network_t = dll::fast_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<50>
+        , dll::shuffle
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 20) < 0.2);
+
+    REQUIRE(net->store_mapped("/tmp/dll_embedding.dllm"));
+
+    etl::fast_dyn_matrix<float, 25, length> batch;
+
+    for (size_t i = 0; i < 25; ++i) {
+        batch(i) = samples[i];
+    }
+
+    auto expected = net->forward_batch(batch);
+
+    // A fresh network only provides the structure, the parameters are mapped
+    auto empty = std::make_unique<embedding_network_t>();
+
+    dll::mapped_model<float> model("/tmp/dll_embedding.dllm", true);
+    REQUIRE(model.valid());
+
+    auto engine = empty->make_inference_engine(25);
+
+    REQUIRE(engine.map(model));
+    REQUIRE(engine.is_mapped(0));
+    REQUIRE(engine.is_mapped(1));
+
+    // The rows of the first letters are the hot rows
+    engine.will_need_rows<0>(std::vector<size_t>{0, 1, 2, 3, 4});
+
+    auto output = engine.forward(batch);
+
+    for (size_t i = 0; i < 25; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output(i, j) == Approx(expected(i, j)));
+        }
+    }
+
+    std::remove("/tmp/dll_embedding.dllm");
+}
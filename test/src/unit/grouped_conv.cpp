@@ -0,0 +1,183 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/grouped_conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+#include "dll/util/grouped_conv.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+/*!
+ * \brief Check the grouped kernels against the ETL convolutions of each
+ * group
+ */
+template <size_t B, size_t C, size_t K, size_t G, size_t NV1, size_t NV2, size_t NW1, size_t NW2>
+void check_grouped_kernels() {
+    constexpr size_t CG  = C / G;
+    constexpr size_t KG  = K / G;
+    constexpr size_t NH1 = NV1 - NW1 + 1;
+    constexpr size_t NH2 = NV2 - NW2 + 1;
+
+    etl::fast_matrix<float, B, C, NV1, NV2> input;
+    etl::fast_matrix<float, K, CG, NW1, NW2> w;
+    etl::fast_matrix<float, B, K, NH1, NH2> errors;
+
+    input  = etl::uniform_generator(-1.0, 1.0);
+    w      = etl::uniform_generator(-1.0, 1.0);
+    errors = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_matrix<float, B, K, NH1, NH2> output;
+    etl::fast_matrix<float, B, C, NV1, NV2> d_input;
+    etl::fast_matrix<float, K, CG, NW1, NW2> d_w;
+
+    dll::grouped_conv_forward(output, input, w, G);
+    dll::grouped_conv_backward(d_input, errors, w, G);
+    dll::grouped_conv_backward_filter(d_w, input, errors, G);
+
+    for (size_t g = 0; g < G; ++g) {
+        etl::fast_matrix<float, B, CG, NV1, NV2> input_g;
+        etl::fast_matrix<float, KG, CG, NW1, NW2> w_g;
+        etl::fast_matrix<float, B, KG, NH1, NH2> errors_g;
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t c = 0; c < CG; ++c) {
+                input_g(b)(c) = input(b)(g * CG + c);
+            }
+
+            for (size_t k = 0; k < KG; ++k) {
+                errors_g(b)(k) = errors(b)(g * KG + k);
+            }
+        }
+
+        for (size_t k = 0; k < KG; ++k) {
+            w_g(k) = w(g * KG + k);
+        }
+
+        etl::fast_matrix<float, B, KG, NH1, NH2> output_ref = etl::ml::convolution_forward(input_g, w_g);
+        etl::fast_matrix<float, B, CG, NV1, NV2> d_input_ref = etl::ml::convolution_backward(errors_g, w_g);
+        etl::fast_matrix<float, KG, CG, NW1, NW2> d_w_ref = etl::ml::convolution_backward_filter(input_g, errors_g);
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t k = 0; k < KG; ++k) {
+                for (size_t i = 0; i < NH1 * NH2; ++i) {
+                    REQUIRE(output(b)(g * KG + k)[i] == Approx(output_ref(b)(k)[i]).epsilon(1e-4));
+                }
+            }
+
+            for (size_t c = 0; c < CG; ++c) {
+                for (size_t i = 0; i < NV1 * NV2; ++i) {
+                    REQUIRE(d_input(b)(g * CG + c)[i] == Approx(d_input_ref(b)(c)[i]).epsilon(1e-4));
+                }
+            }
+        }
+
+        for (size_t k = 0; k < KG; ++k) {
+            for (size_t i = 0; i < CG * NW1 * NW2; ++i) {
+                REQUIRE(d_w(g * KG + k)[i] == Approx(d_w_ref(k)[i]).epsilon(1e-4));
+            }
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+// The grouped kernels compute the same results as the convolutions of each group
+TEST_CASE("unit/conv/grouped/kernels/1", "[unit][conv]") {
+    // Grouped
+    check_grouped_kernels<2, 4, 6, 2, 7, 6, 3, 3>();
+
+    // Depthwise
+    check_grouped_kernels<2, 4, 4, 4, 7, 6, 3, 3>();
+
+    // Depthwise, two filters per channel
+    check_grouped_kernels<2, 3, 6, 3, 6, 6, 2, 3>();
+
+    // Grouped pointwise
+    check_grouped_kernels<3, 4, 8, 2, 5, 5, 1, 1>();
+}
+
+TEST_CASE("unit/conv/grouped/1", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 8, 5, 5, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::depthwise_conv_layer_desc<8, 24, 24, 3, 3, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::grouped_conv_layer_desc<8, 22, 22, 8, 1, 1, 2, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::dense_layer_desc<8 * 22 * 22, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->template layer_get<1>().parameters() == 8 * 3 * 3);
+    REQUIRE(dbn->template layer_get<2>().parameters() == 8 * 4);
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK(25, 0.2);
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/conv/grouped/dyn/1", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 8, 5, 5, dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::dyn_grouped_conv_layer_desc<dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::dyn_grouped_conv_layer_desc<dll::activation<dll::function::RELU>, dll::initializer<dll::init_he>>::layer_t,
+            dll::dense_layer_desc<8 * 22 * 22, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->template init_layer<1>(8, 24, 24, 8, 3, 3, 8);
+    dbn->template init_layer<2>(8, 22, 22, 8, 1, 1, 2);
+
+    REQUIRE(dbn->template layer_get<1>().parameters() == 8 * 3 * 3);
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK(25, 0.2);
+    TEST_CHECK(0.3);
+}
+
+// The 1x1 convolutions of the standard layer use the GEMM fast path
+TEST_CASE("unit/conv/pointwise/1", "[unit][conv]") {
+    dll::conv_layer_desc<4, 7, 6, 6, 1, 1, dll::relu>::layer_t layer;
+
+    static_assert(decltype(layer)::pointwise, "The 1x1 conv layer must be pointwise");
+
+    layer.b = etl::normal_generator<float>();
+
+    etl::fast_matrix<float, 3, 4, 7, 6> input;
+    etl::fast_matrix<float, 3, 6, 7, 6> output;
+
+    input = etl::normal_generator<float>();
+
+    layer.forward_batch(output, input);
+
+    etl::fast_matrix<float, 3, 6, 7, 6> output_ref = etl::ml::convolution_forward(input, layer.w);
+    output_ref = etl::relu(etl::bias_add_4d(output_ref, layer.b));
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(output_ref[i]).epsilon(1e-4));
+    }
+}
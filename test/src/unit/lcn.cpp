@@ -260,3 +260,28 @@ TEST_CASE("unit/cdbn/lcn/mnist/8", "[cdbn][lcn][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.1);
 }
+
+TEST_CASE("unit/lcn/reference/1", "[lcn][unit]") {
+    using layer_t = dll::lcn_layer_desc<5>::layer_t;
+
+    layer_t layer;
+
+    etl::fast_matrix<float, 3, 2, 11, 13> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_matrix<float, 3, 2, 11, 13> output;
+    layer.forward_batch(output, input);
+
+    // The separable filter must compute the same results as the direct filter
+
+    auto w = layer_t::filter<float>(layer.sigma);
+
+    etl::fast_matrix<float, 3, 2, 11, 13> ref;
+    for (size_t b = 0; b < 3; ++b) {
+        dll::lcn_compute_reference(ref(b), input(b), w, 5, 2);
+    }
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(output[i] == Approx(ref[i]).epsilon(1e-3));
+    }
+}
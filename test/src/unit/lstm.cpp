@@ -85,3 +85,216 @@ TEST_CASE("unit/lstm/3", "[unit][lstm]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// Dynamic LSTM on sequences of variable lengths
+TEST_CASE("unit/lstm/4", "[unit][lstm]") {
+    auto dataset = dll::make_mnist_dataset_nc_sub(0, 2000, dll::batch_size<100>{}, dll::scale_pre<255>{}, dll::length_buckets{});
+
+    constexpr size_t time_steps      = 28;
+    constexpr size_t sequence_length = 28;
+    constexpr size_t hidden_units    = 75;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::dyn_lstm_layer<dll::last_only, dll::variable_length>,
+            dll::dyn_recurrent_last_layer<dll::variable_length>,
+            dll::dense_layer<hidden_units, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam
+        , dll::batch_size<100>                       // The mini-batch size
+        , dll::shuffle                               // Shuffle the buckets
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    net->template layer_get<0>().init_layer(time_steps, sequence_length, hidden_units);
+    net->template layer_get<1>().init_layer(time_steps, hidden_units);
+
+    REQUIRE(net->fine_tune(dataset.train(), 30) < 0.15);
+    REQUIRE(net->evaluate_error(dataset.test()) < 0.25);
+}
+
+// LSTM with fast activations
+TEST_CASE("unit/lstm/fast/1", "[unit][lstm]") {
+    auto dataset = dll::make_mnist_dataset_nc_sub(0, 2000, dll::batch_size<100>{}, dll::scale_pre<255>{});
+
+    constexpr size_t time_steps      = 28;
+    constexpr size_t sequence_length = 28;
+    constexpr size_t hidden_units    = 75;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::lstm_layer<time_steps, sequence_length, hidden_units, dll::last_only, dll::fast_activations>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 10, dll::softmax, dll::fast_activations>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam
+        , dll::batch_size<100>                       // The mini-batch size
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    REQUIRE(net->fine_tune(dataset.train(), 30) < 0.15);
+    REQUIRE(net->evaluate_error(dataset.test()) < 0.25);
+}
+
+// The length buckets keep the batches homogeneous
+TEST_CASE("unit/lstm/buckets/1", "[unit][lstm]") {
+    std::vector<size_t> lengths(100);
+
+    for (size_t i = 0; i < lengths.size(); ++i) {
+        lengths[i] = 1 + (i * 37) % 10;
+    }
+
+    std::vector<size_t> order(lengths.size());
+
+    dll::length_bucket_shuffle(order, lengths, 10, dll::random_engine());
+
+    auto sorted = order;
+    std::sort(sorted.begin(), sorted.end());
+
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        REQUIRE(sorted[i] == i);
+    }
+
+    // Each length appears exactly ten times, so each batch has a single length
+    for (size_t b = 0; b < 10; ++b) {
+        for (size_t i = 1; i < 10; ++i) {
+            REQUIRE(lengths[order[b * 10 + i]] == lengths[order[b * 10]]);
+        }
+    }
+
+    etl::dyn_matrix<float, 2> sequence(5, 3, 0.0f);
+    REQUIRE(dll::sequence_length(sequence) == 1);
+
+    sequence(2, 1) = 1.0f;
+    REQUIRE(dll::sequence_length(sequence) == 3);
+}
+
+// Streaming a sequence frame by frame gives the outputs of the whole sequence
+TEST_CASE("unit/lstm/stream/1", "[unit][lstm]") {
+    constexpr size_t time_steps      = 6;
+    constexpr size_t sequence_length = 5;
+    constexpr size_t hidden_units    = 8;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::lstm_layer<time_steps, sequence_length, hidden_units, dll::last_only>,
+            dll::lstm_layer<time_steps, hidden_units, hidden_units, dll::last_only>
+        >
+        , dll::batch_size<4>
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    auto engine = net->make_inference_engine(4);
+
+    etl::fast_matrix<float, 3, time_steps, sequence_length> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_matrix<float, 3, time_steps, hidden_units> ref;
+    ref = engine.forward(input);
+
+    // Two streams stepped one frame at a time, the third one two frames at a time
+    std::vector<size_t> ones{engine.open_stream(), engine.open_stream()};
+    std::vector<size_t> twos{engine.open_stream()};
+
+    for (size_t t = 0; t < time_steps; ++t) {
+        etl::fast_matrix<float, 2, sequence_length> frames;
+
+        for (size_t i = 0; i < 2; ++i) {
+            frames(i) = input(i)(t);
+        }
+
+        auto output = engine.step(ones, frames);
+
+        for (size_t i = 0; i < 2; ++i) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                REQUIRE(output(i, 0, j) == Approx(ref(i, t, j)).epsilon(1e-4));
+            }
+        }
+    }
+
+    for (size_t t = 0; t < time_steps; t += 2) {
+        etl::fast_matrix<float, 1, 2, sequence_length> frames;
+
+        frames(0)(0) = input(2)(t);
+        frames(0)(1) = input(2)(t + 1);
+
+        auto output = engine.step(twos, frames);
+
+        for (size_t s = 0; s < 2; ++s) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                REQUIRE(output(0, s, j) == Approx(ref(2, t + s, j)).epsilon(1e-4));
+            }
+        }
+    }
+
+    REQUIRE(engine.stream_steps(ones[0]) == time_steps);
+    REQUIRE(engine.stream_steps(twos[0]) == time_steps);
+
+    // A closed stream is reused with zero states
+    engine.close_stream(ones[1]);
+
+    std::vector<size_t> reused{engine.open_stream()};
+
+    REQUIRE(reused[0] == ones[1]);
+    REQUIRE(engine.stream_steps(reused[0]) == 0);
+
+    etl::fast_matrix<float, 1, sequence_length> first;
+    first(0) = input(0)(0);
+
+    auto output = engine.step(reused, first);
+
+    for (size_t j = 0; j < hidden_units; ++j) {
+        REQUIRE(output(0, 0, j) == Approx(ref(0, 0, j)).epsilon(1e-4));
+    }
+}
+
+// The layers after recurrent_last only see the last frame of each stream
+TEST_CASE("unit/lstm/stream/2", "[unit][lstm]") {
+    constexpr size_t time_steps      = 6;
+    constexpr size_t sequence_length = 5;
+    constexpr size_t hidden_units    = 8;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::lstm_layer<time_steps, sequence_length, hidden_units, dll::last_only>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 10, dll::softmax>
+        >
+        , dll::batch_size<4>
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    auto engine = net->make_inference_engine(4);
+
+    etl::fast_matrix<float, 2, time_steps, sequence_length> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_matrix<float, 2, 10> ref;
+    ref = engine.forward(input);
+
+    std::vector<size_t> streams{engine.open_stream(), engine.open_stream()};
+
+    for (size_t t = 0; t + 1 < time_steps; ++t) {
+        etl::fast_matrix<float, 2, sequence_length> frames;
+
+        frames(0) = input(0)(t);
+        frames(1) = input(1)(t);
+
+        engine.step(streams, frames);
+    }
+
+    etl::fast_matrix<float, 2, sequence_length> frames;
+
+    frames(0) = input(0)(time_steps - 1);
+    frames(1) = input(1)(time_steps - 1);
+
+    auto output = engine.step(streams, frames);
+
+    for (size_t i = 0; i < etl::size(ref); ++i) {
+        REQUIRE(output[i] == Approx(ref[i]).epsilon(1e-4));
+    }
+}
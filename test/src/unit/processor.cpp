@@ -212,6 +212,57 @@ TEST_CASE("unit/processor/dense/sgd/2", "[unit][dense][dbn][mnist][sgd][proc]")
     TEST_ERROR_BELOW(0.3);
 }
 
+TEST_CASE("unit/processor/dense/dynamic/1", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto opt    = default_options();
+    opt.dynamic = true;
+
+    auto lines = get_result(opt, {"auto"}, "dense_sgd_1.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
+TEST_CASE("unit/processor/dense/sweep/1", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto lines = get_result(default_options(), {"sweep", "train", "test"}, "dense_sweep_1.conf");
+    REQUIRE(!lines.empty());
+
+    double test_error = 1.0;
+    REQUIRE(get_error(lines, test_error, "Mean test error: "));
+    REQUIRE(test_error < 0.3);
+}
+
+TEST_CASE("unit/processor/cache/1", "[unit][dense][mnist][proc]") {
+    using sample_t = etl::dyn_vector<float>;
+
+    dll::processor::datasource ds("/home/wichtounet/dev/mnist/train-images-idx3-ubyte", "mnist");
+    ds.limit   = 100;
+    ds.scale   = true;
+    ds.scale_d = 0.00390625;
+
+    auto cache_file = dll::processor::samples_cache_file<false, sample_t>(ds);
+    REQUIRE(!cache_file.empty());
+
+    std::remove(cache_file.c_str());
+
+    std::vector<sample_t> parsed;
+    REQUIRE(dll::processor::read_samples<false>(ds, parsed));
+
+    // The second read only maps the cache
+    std::vector<sample_t> cached;
+    REQUIRE(dll::processor::read_cached_samples(cache_file, cached));
+
+    REQUIRE(cached.size() == parsed.size());
+
+    for (size_t i = 0; i < parsed.size(); ++i) {
+        REQUIRE(etl::size(cached[i]) == etl::size(parsed[i]));
+
+        for (size_t j = 0; j < etl::size(parsed[i]); ++j) {
+            REQUIRE(cached[i][j] == parsed[i][j]);
+        }
+    }
+}
+
 // Conv+Dense (SGD)
 
 TEST_CASE("unit/processor/conv/sgd/1", "[unit][conv][dense][dbn][mnist][sgd][proc]") {
@@ -414,3 +465,22 @@ TEST_CASE("unit/processor/cdbn/2", "[unit][dbn][mnist][conv][proc]") {
     SPARSITY_BELOW("epoch 24", 0.4, 0);
     SPARSITY_BELOW("epoch 24", 0.35, 1);
 }
+
+// Benchmark
+
+TEST_CASE("unit/processor/bench/1", "[unit][dense][dbn][sgd][proc]") {
+    auto lines = get_result(default_options(), {"bench"}, "dense_bench_1.conf");
+    REQUIRE(!lines.empty());
+
+    // No data is needed, a throughput is reported for each phase
+    bool train     = false;
+    bool inference = false;
+
+    for (auto& line : lines) {
+        train     = train || starts_with(line, "train ");
+        inference = inference || starts_with(line, "inference ");
+    }
+
+    REQUIRE(train);
+    REQUIRE(inference);
+}
@@ -13,6 +13,7 @@
 #include "dll/rbm/conv_rbm.hpp"
 #include "dll/dbn.hpp"
 #include "dll/transform/random_layer.hpp"
+#include "dll/util/fast_random.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -73,3 +74,119 @@ TEST_CASE("unit/cdbn/random/mnist/2", "[cdbn][rectifier][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 1.0);
 }
+
+TEST_CASE("unit/random/stream/1", "[random][unit]") {
+    dll::random_stream a;
+    dll::random_stream b;
+    dll::random_stream c(a);
+
+    etl::dyn_matrix<float, 2> ua(100, 101);
+    etl::dyn_matrix<float, 2> ub(100, 101);
+    etl::dyn_matrix<float, 2> uc(100, 101);
+
+    dll::uniform_fill(a, ua);
+    dll::uniform_fill(b, ub);
+    dll::uniform_fill(c, uc);
+
+    // Each stream has its own sequence, copies replay the same sequence
+    REQUIRE(etl::min(ua) >= 0.0f);
+    REQUIRE(etl::max(ua) < 1.0f);
+    REQUIRE(etl::mean(ua) == Approx(0.5).epsilon(0.02));
+    REQUIRE(ua != ub);
+    REQUIRE(ua == uc);
+
+    etl::dyn_matrix<float, 2> p(100, 101);
+    p = 0.2f;
+
+    etl::dyn_matrix<float, 2> s(100, 101);
+    dll::sample_bernoulli(a, s, p);
+    REQUIRE(etl::mean(s) == Approx(0.2).epsilon(0.1));
+
+    p = 1.0f;
+    dll::sample_normal(a, s, p);
+    REQUIRE(etl::mean(s) == Approx(1.0).epsilon(0.05));
+    REQUIRE(etl::stddev(s) == Approx(1.0).epsilon(0.05));
+}
+
+TEST_CASE("unit/random/dropout/1", "[random][unit]") {
+    dll::random_stream stream;
+
+    etl::dyn_matrix<float, 2> input(100, 101);
+    etl::dyn_matrix<float, 2> output(100, 101);
+    etl::dyn_matrix<float, 2> errors(100, 101);
+
+    input = 1.0f;
+
+    std::vector<uint64_t> mask;
+    dll::dropout_bits(stream, mask, etl::size(input), 0.25f);
+
+    REQUIRE(mask.size() == (100 * 101 + 63) / 64);
+
+    // Inverted dropout keeps the expectation of the input
+    dll::apply_dropout_bits(output, input, mask, 0.25f);
+    REQUIRE(etl::mean(output) == Approx(1.0).epsilon(0.05));
+
+    // The errors are masked with the same mask
+    errors = 2.0f;
+    dll::apply_dropout_bits(errors, errors, mask, 0.25f);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(errors[i] == Approx(2.0f * output[i]));
+    }
+}
+
+TEST_CASE("unit/random/stream/2", "[random][unit]") {
+    dll::random_stream a;
+    dll::random_stream b(a);
+
+    etl::dyn_matrix<float, 2> za(100, 1001);
+    etl::dyn_matrix<float, 2> zb(100, 1001);
+
+    dll::generate_normal<float>(a, etl::size(za), [&za](size_t i, float z) { za[i] = z; });
+    dll::generate_normal_parallel<float>(b, etl::size(zb), [&zb](size_t i, float z) { zb[i] = z; });
+
+    // The parallel generation gives the same numbers
+    REQUIRE(za == zb);
+    REQUIRE(etl::mean(za) == Approx(0.0).margin(0.01));
+    REQUIRE(etl::stddev(za) == Approx(1.0).epsilon(0.01));
+
+    etl::dyn_matrix<float, 2> w(100, 1001);
+    dll::init_uniform<>::initialize(w, 100, 1001);
+
+    REQUIRE(etl::min(w) >= -0.05f);
+    REQUIRE(etl::max(w) < 0.05f);
+
+    dll::init_he::initialize(w, 100, 1001);
+
+    REQUIRE(etl::stddev(w) == Approx(std::sqrt(2.0 / 100)).epsilon(0.02));
+}
+
+TEST_CASE("unit/random/shards/1", "[random][unit]") {
+    dll::random_stream a;
+    dll::random_stream b(a);
+
+    etl::dyn_matrix<float, 3> ua(4, 10, 11);
+    etl::dyn_matrix<float, 3> ub(4, 10, 11);
+
+    // The shards draw the same numbers whatever the order in which they are run
+    for (size_t s = 0; s < 4; ++s) {
+        dll::random_shard_section section(7, s);
+        dll::uniform_fill(a, ua(s));
+    }
+
+    for (size_t s = 4; s > 0; --s) {
+        dll::random_shard_section section(7, s - 1);
+        dll::uniform_fill(b, ub(s - 1));
+    }
+
+    REQUIRE(ua == ub);
+    REQUIRE(ua(0) != ua(1));
+
+    // Each batch gets other numbers
+    {
+        dll::random_shard_section section(8, 0);
+        dll::uniform_fill(b, ub(0));
+    }
+
+    REQUIRE(ua(0) != ub(0));
+}
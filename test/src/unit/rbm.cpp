@@ -212,3 +212,321 @@ TEST_CASE("unit/rbm/mnist/10", "[rbm][pcd][unit]") {
         REQUIRE(error < 15e-2);
     }
 }
+
+TEST_CASE("unit/rbm/mnist/11", "[rbm][pcd][parallel][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<20>,
+        dll::momentum,
+        dll::parallel_gibbs,
+        dll::trainer_rbm<pcd2_trainer_t>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+TEST_CASE("unit/rbm/mnist/12", "[rbm][free_energy][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum,
+        dll::free_energy>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    etl::fast_dyn_matrix<float, 25, 28 * 28> v;
+    etl::fast_dyn_matrix<float, 25, 100> h;
+
+    double free_energy = 0.0;
+
+    for (size_t i = 0; i < 25; ++i) {
+        v(i) = dataset.training_images[i];
+        free_energy += rbm.free_energy(dataset.training_images[i]);
+    }
+
+    rbm.batch_activate_hidden(h, v);
+
+    REQUIRE(rbm.batch_free_energy(v, h, 25) == Approx(free_energy).epsilon(1e-3));
+}
+
+TEST_CASE("unit/rbm/mnist/13", "[rbm][statistics][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::statistics_every<4>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/14", "[rbm][sparse][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum,
+        dll::sparse_input>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/15", "[rbm][sampling][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.train(dataset.training_images, 20);
+
+    etl::dyn_matrix<float, 2> init(8, 28 * 28);
+
+    for (size_t c = 0; c < 8; ++c) {
+        init(c) = dataset.training_images[c];
+    }
+
+    etl::dyn_matrix<float, 2> samples(20, 28 * 28);
+
+    rbm.sample_chains(samples, init, 10, 2);
+
+    REQUIRE(etl::min(samples) >= 0.0f);
+    REQUIRE(etl::max(samples) <= 1.0f);
+    REQUIRE(etl::sum(samples(19)) > 0.0f);
+}
+
+TEST_CASE("unit/rbm/mnist/16", "[rbm][relu][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::hidden<dll::unit_type::RELU6>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+
+    etl::dyn_matrix<float, 2> v(25, 28 * 28);
+
+    for (size_t i = 0; i < 25; ++i) {
+        v(i) = dataset.training_images[i];
+    }
+
+    etl::dyn_matrix<float, 2> h_a(25, 100);
+    etl::dyn_matrix<float, 2> h_s(25, 100);
+
+    rbm.batch_activate_hidden<true, true>(h_a, h_s, v, v);
+
+    REQUIRE(etl::min(h_a) >= 0.0f);
+    REQUIRE(etl::max(h_a) <= 6.0f);
+    REQUIRE(etl::min(h_s) >= 0.0f);
+    REQUIRE(etl::max(h_s) <= 6.0f);
+}
+
+TEST_CASE("unit/rbm/mnist/17", "[rbm][init][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::init_weights,
+        dll::momentum>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::autoencoder>;
+
+    auto generator = make_generator(dataset.training_images, dataset.training_images, dataset.training_images.size(), generator_t{});
+
+    auto stats = rbm.init_weights(*generator, 50);
+
+    REQUIRE(stats.samples == 50);
+    REQUIRE(stats.features() == 28 * 28);
+
+    // The ratio of ones of binary inputs is their mean
+    for (size_t i = 0; i < 28 * 28; ++i) {
+        REQUIRE(stats.ones_ratio(i) == Approx(stats.mean[i]));
+        REQUIRE(stats.variance[i] == Approx(stats.mean[i] * (1.0 - stats.mean[i])).margin(1e-6));
+    }
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/18", "[rbm][async][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::async_cd<4>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(200);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/19", "[rbm][binary][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum,
+        dll::binary_input>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+
+    etl::dyn_matrix<float, 2> input(25, 28 * 28);
+
+    for (size_t i = 0; i < 25; ++i) {
+        input(i) = dataset.training_images[i];
+    }
+
+    dll::bit_batch bits(input);
+
+    // 13 words of 64 units per sample
+    REQUIRE(bits.bytes() == 25 * 13 * sizeof(uint64_t));
+
+    // The products with the bit-packed input are the dense products
+    etl::dyn_matrix<float, 2> h_bits(25, 100);
+    etl::dyn_matrix<float, 2> h_s(25, 100);
+
+    rbm.batch_activate_hidden<true, false>(h_bits, h_s, bits);
+
+    etl::dyn_matrix<float, 2> h_dense(25, 100);
+    h_dense = etl::sigmoid(etl::rep_l(rbm.b, 25) + input * rbm.w);
+
+    REQUIRE(etl::max(etl::abs(h_bits - h_dense)) < 1e-4f);
+
+    // With the binarized weights, only the signs of the weights are used
+    auto bw = dll::binarize_weights(rbm.w);
+
+    etl::dyn_matrix<float, 2> h_binary(25, 100);
+
+    rbm.batch_activate_hidden(h_binary, bits, bw);
+
+    REQUIRE(etl::min(h_binary) >= 0.0f);
+    REQUIRE(etl::max(h_binary) <= 1.0f);
+}
+
+TEST_CASE("unit/rbm/mnist/20", "[rbm][transposed][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum,
+        dll::transposed_weights>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 5e-2);
+
+    // The reconstructions with the transposed weights are the reconstructions with the weights
+    etl::dyn_matrix<float, 2> input(25, 28 * 28);
+
+    for (size_t i = 0; i < 25; ++i) {
+        input(i) = dataset.training_images[i];
+    }
+
+    etl::dyn_matrix<float, 2> h_a(25, 100);
+    etl::dyn_matrix<float, 2> h_s(25, 100);
+
+    rbm.batch_activate_hidden<true, true>(h_a, h_s, input, input);
+
+    etl::dyn_matrix<float, 2> w_t(100, 28 * 28);
+    w_t = etl::transpose(rbm.w);
+
+    etl::dyn_matrix<float, 2> v_t(25, 28 * 28);
+    etl::dyn_matrix<float, 2> v_a(25, 28 * 28);
+    etl::dyn_matrix<float, 2> v_s(25, 28 * 28);
+
+    rbm.batch_activate_visible_transposed(h_a, h_s, v_t, v_s, w_t);
+    rbm.batch_activate_visible<true, false>(h_a, h_s, v_a, v_s);
+
+    REQUIRE(etl::max(etl::abs(v_t - v_a)) < 1e-4f);
+}
+
+// The fused update of CD must give the same results as the separate passes
+TEST_CASE("unit/rbm/update/0", "[rbm][unit]") {
+    etl::fast_matrix<float, 20, 100> w;
+    etl::fast_matrix<float, 20, 100> g;
+    etl::fast_matrix<float, 20, 100> inc;
+
+    w   = etl::uniform_generator(-1.0, 1.0);
+    g   = etl::uniform_generator(-1.0, 1.0);
+    inc = etl::uniform_generator(-0.1, 0.1);
+
+    etl::fast_matrix<float, 20, 100> w_ref   = w;
+    etl::fast_matrix<float, 20, 100> g_ref   = g;
+    etl::fast_matrix<float, 20, 100> inc_ref = inc;
+
+    dll::fused_tensor<float> t;
+
+    t.w            = w.memory_start();
+    t.g            = g.memory_start();
+    t.s0           = inc.memory_start();
+    t.size         = etl::size(w);
+    t.step.eps     = 0.01;
+    t.step.l1      = 0.001;
+    t.step.l2      = 0.002;
+    t.step.penalty = 0.05;
+    t.step.beta1   = 0.9;
+
+    dll::cd_fused_update<true, dll::decay_type::L1L2>(t);
+
+    g_ref   = g_ref - 0.001 * abs(w_ref) - 0.002 * w_ref - 0.05;
+    inc_ref = 0.9 * inc_ref + 0.01 * g_ref;
+    w_ref += inc_ref;
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(inc[i] == Approx(inc_ref[i]));
+        REQUIRE(w[i] == Approx(w_ref[i]));
+    }
+}
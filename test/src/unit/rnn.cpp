@@ -85,3 +85,57 @@ TEST_CASE("unit/rnn/3", "[unit][rnn]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// Streaming a sequence frame by frame gives the outputs of the whole sequence
+TEST_CASE("unit/rnn/stream/1", "[unit][rnn]") {
+    constexpr size_t time_steps      = 6;
+    constexpr size_t sequence_length = 5;
+    constexpr size_t hidden_units    = 8;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::rnn_layer<time_steps, sequence_length, hidden_units, dll::last_only>,
+            dll::rnn_layer<time_steps, hidden_units, hidden_units, dll::last_only>
+        >
+        , dll::batch_size<4>
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    auto engine = net->make_inference_engine(4);
+
+    etl::fast_matrix<float, 2, time_steps, sequence_length> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_matrix<float, 2, time_steps, hidden_units> ref;
+    ref = engine.forward(input);
+
+    std::vector<size_t> streams{engine.open_stream(), engine.open_stream()};
+
+    for (size_t t = 0; t < time_steps; ++t) {
+        etl::fast_matrix<float, 2, sequence_length> frames;
+
+        frames(0) = input(0)(t);
+        frames(1) = input(1)(t);
+
+        auto output = engine.step(streams, frames);
+
+        for (size_t i = 0; i < 2; ++i) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                REQUIRE(output(i, 0, j) == Approx(ref(i, t, j)).epsilon(1e-4));
+            }
+        }
+    }
+
+    // A reset stream starts a new sequence
+    engine.reset_stream(streams[1]);
+
+    etl::fast_matrix<float, 1, sequence_length> first;
+    first(0) = input(1)(0);
+
+    auto output = engine.step({streams[1]}, first);
+
+    for (size_t j = 0; j < hidden_units; ++j) {
+        REQUIRE(output(0, 0, j) == Approx(ref(1, 0, j)).epsilon(1e-4));
+    }
+}
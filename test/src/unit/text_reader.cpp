@@ -124,3 +124,24 @@ TEST_CASE("unit/text_reader/images/5", "[unit][reader]") {
     REQUIRE(samples[7](0, 17, 16) == 9);
     REQUIRE(samples[8](0, 17, 15) == 253);
 }
+
+TEST_CASE("unit/text_reader/images/6", "[unit][reader]") {
+    auto samples = dll::text::read_images_tensor<float>("test/text_db/images", 20);
+
+    REQUIRE(etl::dim<0>(samples) == 9);
+    REQUIRE(etl::dim<1>(samples) == 1);
+    REQUIRE(etl::dim<2>(samples) == 28);
+    REQUIRE(etl::dim<3>(samples) == 28);
+
+    REQUIRE(samples(0, 0, 17, 16) == 254);
+    REQUIRE(samples(1, 0, 15, 12) == 189);
+    REQUIRE(samples(2, 0, 16, 13) == 232);
+    REQUIRE(samples(3, 0,  9, 13) == 253);
+    REQUIRE(samples(4, 0, 17, 16) == 251);
+    REQUIRE(samples(5, 0, 16, 13) == 254);
+    REQUIRE(samples(6, 0, 17, 15) == 254);
+    REQUIRE(samples(7, 0, 17, 16) == 9);
+    REQUIRE(samples(8, 0, 17, 15) == 253);
+
+    REQUIRE(etl::dim<0>(dll::text::read_images_tensor<float>("test/text_db/images", 4)) == 4);
+}
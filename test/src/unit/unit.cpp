@@ -11,6 +11,8 @@
 
 #include "dll/rbm/rbm.hpp"
 #include "dll/ocv_visualizer.hpp"
+#include "dll/util/cpu.hpp"
+#include "dll/util/upsample.hpp"
 
 TEST_CASE("unit/unit_1", "[unit]") {
     REQUIRE(dll::detail::ct_sqrt(1) == 1);
@@ -68,3 +70,33 @@ TEST_CASE("unit/unit_5", "[unit]") {
     REQUIRE(dll::detail::best_width(444444) == 667);
     REQUIRE(dll::detail::best_height(444444) == 667);
 }
+
+TEST_CASE("unit/cpu/1", "[unit]") {
+    auto& features = dll::get_cpu_features();
+
+    // The wider instruction sets imply the narrower ones
+    REQUIRE((!features.avx512f || features.avx2));
+    REQUIRE((!features.avx2 || features.sse4_2));
+
+    REQUIRE(!dll::kernels_instruction_set().empty());
+
+    // The dispatched kernel gives the same result on any instruction set
+    std::vector<float> input(2 * 3 * 5);
+    std::vector<float> output(2 * 6 * 10);
+    std::vector<float> back(2 * 3 * 5);
+
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = float(i);
+    }
+
+    dll::upsample_2d_forward<2, 2>(output.data(), input.data(), 2, 3, 5);
+    dll::upsample_2d_backward<2, 2>(back.data(), output.data(), 2, 3, 5);
+
+    REQUIRE(output[0] == 0.0f);
+    REQUIRE(output[1 * 10 + 1] == 0.0f);
+    REQUIRE(output[60 + 5 * 10 + 9] == 29.0f);
+
+    for (size_t i = 0; i < input.size(); ++i) {
+        REQUIRE(back[i] == 4.0f * input[i]);
+    }
+}
@@ -0,0 +1,326 @@
+#!/usr/bin/env python3
+#=======================================================================
+# Copyright (c) 2014-2017 Baptiste Wicht
+# Distributed under the terms of the MIT License.
+# (See accompanying file LICENSE or copy at
+#  http://opensource.org/licenses/MIT)
+#=======================================================================
+
+"""Performance regression database for the DLL benchmarks.
+
+The run command executes a set of benchmark programs several times and
+stores their timings in a local results file, one record per commit,
+machine and metric. The compare command compares the timings of a commit
+with the timings of a baseline commit, on the same machine, and flags the
+slowdowns that are statistically significant (one-sided Mann-Whitney U
+test) and larger than a threshold.
+
+The compile programs are not run, their source is compiled (in release
+mode, with the Makefile) and the compile time and the peak memory of the
+compiler are tracked, to catch regressions of the metaprogramming.
+
+Usage:
+    tools/perf_regress.py run [--programs a,b] [--repeat N] [--results FILE]
+    tools/perf_regress.py compare [--baseline COMMIT] [--commit COMMIT] [--threshold PCT] [--alpha A] [--results FILE]
+    tools/perf_regress.py list [--results FILE]
+"""
+
+import argparse
+import json
+import math
+import os
+import platform
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+# The programs that can be run, with the way their timings are extracted:
+#  - bench: the JSON output of dll_bench (median of each benchmark)
+#  - lines: the "name: Xms" lines printed by the program
+#  - wall: the wall time of the complete program
+#  - compile: the compile time (ms) and the peak memory (KB) of the compiler
+PROGRAMS = {
+    "dll_bench": ("release/bin/dll_bench", "bench"),
+    "dll_perf_paper": ("release/bin/dll_perf_paper", "lines"),
+    "dll_perf_paper_conv": ("release/bin/dll_perf_paper_conv", "lines"),
+    "dll_dyn_perf": ("release/bin/dll_dyn_perf", "lines"),
+    "dll_sgd_perf": ("release/bin/dll_sgd_perf", "wall"),
+    "dll_imagenet_perf": ("release/bin/dll_imagenet_perf", "wall"),
+    "compile_deep": ("workbench/src/compile_deep.cpp", "compile"),
+    "compile_rbm": ("workbench/src/compile_rbm.cpp", "compile"),
+    "compile_crbm": ("workbench/src/compile_crbm.cpp", "compile"),
+}
+
+DEFAULT_PROGRAMS = "dll_bench,dll_perf_paper,dll_dyn_perf,dll_sgd_perf,compile_deep"
+DEFAULT_RESULTS = ".dll_perf/results.jsonl"
+
+LINE_RE = re.compile(r"^(\S+): ([0-9]+(?:\.[0-9]+)?)ms$")
+
+
+def git(*args):
+    return subprocess.check_output(["git"] + list(args), universal_newlines=True).strip()
+
+
+def machine_id():
+    """Identify the machine by its name and its processor"""
+    cpu = platform.processor()
+
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    cpu = line.split(":", 1)[1].strip()
+                    break
+    except OSError:
+        pass
+
+    return "{}/{}".format(platform.node(), cpu)
+
+
+def compile_program(name, path, repeat):
+    """Compile one source several times, returns the samples of the compile
+    time (ms) and of the peak memory of the compiler (KB)"""
+    samples = {}
+
+    for _ in range(repeat):
+        with tempfile.NamedTemporaryFile(suffix=".time") as f:
+            start = time.time()
+            subprocess.check_call(["/usr/bin/time", "-f", "%M", "-o", f.name, "make", "-B", "release/" + path + ".o"], stdout=subprocess.DEVNULL)
+            elapsed = (time.time() - start) * 1000.0
+
+            rss = float(open(f.name).read().split()[-1])
+
+        samples.setdefault(name + ":time", []).append(elapsed)
+        samples.setdefault(name + ":rss", []).append(rss)
+
+    return samples
+
+
+def run_program(name, repeat):
+    """Run one program several times, returns the samples of each metric, in ms"""
+    path, kind = PROGRAMS[name]
+
+    if kind == "compile":
+        return compile_program(name, path, repeat)
+
+    if not os.path.exists(path):
+        print("perf_regress: {} not found, build it first (make release_{})".format(path, name))
+        return {}
+
+    samples = {}
+
+    for _ in range(repeat):
+        if kind == "bench":
+            with tempfile.NamedTemporaryFile(suffix=".json") as f:
+                subprocess.check_call([path, "--json=" + f.name], stdout=subprocess.DEVNULL)
+                for b in json.load(open(f.name))["benchmarks"]:
+                    samples.setdefault(name + ":" + b["name"], []).append(b["median_ns"] / 1e6)
+        else:
+            start = time.time()
+            output = subprocess.check_output([path], universal_newlines=True)
+            elapsed = (time.time() - start) * 1000.0
+
+            if kind == "lines":
+                for line in output.splitlines():
+                    match = LINE_RE.match(line.strip())
+                    if match:
+                        samples.setdefault(name + ":" + match.group(1), []).append(float(match.group(2)))
+            else:
+                samples.setdefault(name + ":wall", []).append(elapsed)
+
+    return samples
+
+
+def unit(metric):
+    return "KB" if metric.endswith(":rss") else "ms"
+
+
+def load_results(path):
+    results = []
+
+    if os.path.exists(path):
+        with open(path) as f:
+            for line in f:
+                if line.strip():
+                    results.append(json.loads(line))
+
+    return results
+
+
+def command_run(args):
+    commit = git("rev-parse", "HEAD")
+    machine = machine_id()
+    date = time.strftime("%Y-%m-%dT%H:%M:%S")
+
+    if git("status", "--porcelain", "--untracked-files=no"):
+        commit += "-dirty"
+
+    os.makedirs(os.path.dirname(args.results) or ".", exist_ok=True)
+
+    with open(args.results, "a") as out:
+        for name in args.programs.split(","):
+            if name not in PROGRAMS:
+                print("perf_regress: unknown program {}".format(name))
+                return 1
+
+            for metric, values in sorted(run_program(name, args.repeat).items()):
+                record = {"commit": commit, "machine": machine, "date": date, "metric": metric, "samples": values}
+                out.write(json.dumps(record) + "\n")
+                print("{:48} median:{:12.3f}{} ({} samples)".format(metric, median(values), unit(metric), len(values)))
+
+    return 0
+
+
+def median(values):
+    v = sorted(values)
+    n = len(v)
+    return v[n // 2] if n % 2 else (v[n // 2 - 1] + v[n // 2]) / 2.0
+
+
+def mann_whitney_greater(a, b):
+    """One-sided p-value of the hypothesis that the samples of a are greater
+    than the samples of b, with the normal approximation of the U statistic"""
+    values = sorted([(x, 0) for x in a] + [(x, 1) for x in b])
+    n = len(values)
+
+    # Average ranks, with the correction for ties
+    ranks = [0.0] * n
+    ties = 0.0
+    i = 0
+    while i < n:
+        j = i
+        while j + 1 < n and values[j + 1][0] == values[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = (i + j) / 2.0 + 1
+        t = j - i + 1
+        ties += t ** 3 - t
+        i = j + 1
+
+    n1 = len(a)
+    n2 = len(b)
+
+    r1 = sum(r for r, (_, g) in zip(ranks, values) if g == 0)
+    u1 = r1 - n1 * (n1 + 1) / 2.0
+
+    mean = n1 * n2 / 2.0
+    var = n1 * n2 / 12.0 * ((n1 + n2 + 1) - ties / ((n1 + n2) * (n1 + n2 - 1)))
+
+    if var <= 0:
+        return 1.0
+
+    z = (u1 - mean - 0.5) / math.sqrt(var)
+
+    return 0.5 * math.erfc(z / math.sqrt(2))
+
+
+def command_compare(args):
+    machine = machine_id()
+    results = [r for r in load_results(args.results) if r["machine"] == machine]
+
+    if not results:
+        print("perf_regress: no results for this machine in {}".format(args.results))
+        return 1
+
+    commits = []
+    for r in results:
+        if r["commit"] not in commits:
+            commits.append(r["commit"])
+
+    commit = args.commit or commits[-1]
+    if commit not in commits:
+        print("perf_regress: no results for the commit {}".format(commit))
+        return 1
+
+    baseline = args.baseline
+    if not baseline:
+        index = commits.index(commit)
+        if index == 0:
+            print("perf_regress: no baseline before the commit {}".format(commit))
+            return 1
+        baseline = commits[index - 1]
+
+    def collect(c):
+        samples = {}
+        for r in results:
+            if r["commit"] == c:
+                samples.setdefault(r["metric"], []).extend(r["samples"])
+        return samples
+
+    current = collect(commit)
+    base = collect(baseline)
+
+    print("Comparing {} against the baseline {} on {}".format(commit, baseline, machine))
+
+    regressions = 0
+
+    for metric in sorted(set(current) & set(base)):
+        a = current[metric]
+        b = base[metric]
+
+        change = 100.0 * (median(a) - median(b)) / median(b) if median(b) > 0 else 0.0
+        p = mann_whitney_greater(a, b) if len(a) > 1 and len(b) > 1 else 1.0
+
+        flag = ""
+        if change > args.threshold and p < args.alpha:
+            flag = "  SLOWDOWN"
+            regressions += 1
+
+        print("{:48} {:12.3f}{u} -> {:12.3f}{u} {:+7.2f}% p={:.3f}{}".format(metric, median(b), median(a), change, p, flag, u=unit(metric)))
+
+    if regressions:
+        print("{} significant slowdown(s)".format(regressions))
+        return 1
+
+    return 0
+
+
+def command_list(args):
+    seen = []
+
+    for r in load_results(args.results):
+        key = (r["commit"], r["machine"], r["date"])
+        if key not in seen:
+            seen.append(key)
+
+    for commit, machine, date in seen:
+        print("{} {} {}".format(date, commit[:12], machine))
+
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Performance regression database for the DLL benchmarks")
+    parser.add_argument("--results", default=DEFAULT_RESULTS, help="The results file")
+
+    sub = parser.add_subparsers(dest="command")
+
+    run = sub.add_parser("run", help="Run the benchmarks and store the results of the current commit")
+    run.add_argument("--programs", default=DEFAULT_PROGRAMS, help="The programs to run: " + ",".join(sorted(PROGRAMS)))
+    run.add_argument("--repeat", type=int, default=5, help="The number of runs of each program")
+
+    compare = sub.add_parser("compare", help="Compare the results of a commit against a baseline")
+    compare.add_argument("--commit", help="The compared commit (default: the last one)")
+    compare.add_argument("--baseline", help="The baseline commit (default: the previous one)")
+    compare.add_argument("--threshold", type=float, default=5.0, help="The minimum slowdown, in percent")
+    compare.add_argument("--alpha", type=float, default=0.05, help="The significance level")
+
+    sub.add_parser("list", help="List the stored runs")
+
+    args = parser.parse_args()
+
+    if args.command == "run":
+        return command_run(args)
+    elif args.command == "compare":
+        return command_compare(args)
+    elif args.command == "list":
+        return command_list(args)
+
+    parser.print_help()
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,49 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <iostream>
+#include <chrono>
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/activation_layer.hpp"
+#include "dll/neural/dropout_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// 1 deep network of 25 layers, to measure the cost of the metaprogramming
+// of the network itself (tools/perf_regress.py tracks its compile time)
+
+int main(int, char**) {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(1000);
+
+    mnist::normalize_dataset(dataset);
+
+#define deep_block(F)                                                       \
+    dll::dense_layer_desc<100 + F, 101 + F, dll::no_activation>::layer_t,  \
+    dll::activation_layer_desc<dll::function::RELU>::layer_t,              \
+    dll::dropout_layer_desc<10>::layer_t
+
+    using dbn_t =
+        dll::dbn_desc<
+            dll::dbn_layers<
+                dll::dense_layer_desc<28 * 28, 100>::layer_t,
+                deep_block(0), deep_block(1), deep_block(2), deep_block(3),
+                deep_block(4), deep_block(5), deep_block(6), deep_block(7),
+                dll::dense_layer_desc<108, 10, dll::softmax>::layer_t>,
+            dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<100>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->display();
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+
+    std::cout << "test_error:" << dbn->evaluate_error(dataset.test_images, dataset.test_labels) << std::endl;
+
+    return 0;
+}
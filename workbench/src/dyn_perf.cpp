@@ -6,10 +6,15 @@
 //=======================================================================
 
 #include <iostream>
+#include <iomanip>
 #include <chrono>
 
 #include "dll/rbm/dyn_rbm.hpp"
 #include "dll/rbm/rbm.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/dyn_dense_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dyn_conv_layer.hpp"
 #include "dll/dbn.hpp"
 
 #include "mnist/mnist_reader.hpp"
@@ -51,6 +56,100 @@ struct perf_timer {
         result = duration;                                                           \
     }
 
+constexpr size_t BATCH      = 64;  ///< The number of samples of one forward pass
+constexpr size_t ITERATIONS = 200; ///< The number of forward passes per measure
+
+/*!
+ * \brief Returns the throughput of the forward pass of the layer, in
+ * samples per second
+ */
+template <typename Layer, typename Output, typename Input>
+double forward_throughput(Layer& layer, Output& output, const Input& input) {
+    // Warmup
+    layer.forward_batch(output, input);
+
+    time_point start = clock::now();
+
+    for (size_t i = 0; i < ITERATIONS; ++i) {
+        layer.forward_batch(output, input);
+    }
+
+    time_point end = clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    return (BATCH * ITERATIONS) / (std::max<double>(duration, 1.0) * 1e-6);
+}
+
+/*!
+ * \brief Print one row of the table of the static and dynamic throughputs
+ */
+void throughput_row(const std::string& name, double fast, double generic, double dynamic) {
+    std::cout << std::left << std::setw(20) << name << std::right
+              << std::setw(14) << size_t(fast)
+              << std::setw(14) << size_t(generic)
+              << std::setw(14) << size_t(dynamic)
+              << std::setw(10) << std::fixed << std::setprecision(1) << 100.0 * dynamic / fast << "%" << std::endl;
+}
+
+/*!
+ * \brief Compare the forward throughput of the static layers with the
+ * dynamic layers, with and without the kernels of their shape
+ */
+void throughput_table() {
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(20) << "Layer" << std::right
+              << std::setw(14) << "Static" << std::setw(14) << "Dyn (generic)" << std::setw(14) << "Dyn (shape)" << std::setw(11) << "Ratio" << std::endl;
+
+    {
+        dll::dense_layer_desc<500, 10, dll::softmax>::layer_t fast;
+        dll::dyn_dense_layer_desc<dll::softmax, dll::fixed_shapes<>>::layer_t generic;
+        dll::dyn_dense_layer_desc<dll::softmax>::layer_t dynamic;
+
+        generic.init_layer(500, 10);
+        dynamic.init_layer(500, 10);
+
+        etl::dyn_matrix<float, 2> input(BATCH, 500);
+        etl::dyn_matrix<float, 2> output(BATCH, 10);
+
+        input = etl::normal_generator<float>();
+
+        throughput_row("dense 500x10", forward_throughput(fast, output, input), forward_throughput(generic, output, input), forward_throughput(dynamic, output, input));
+    }
+
+    {
+        dll::rbm_desc<784, 100, dll::batch_size<BATCH>>::layer_t fast;
+        dll::dyn_rbm_desc<dll::batch_size<BATCH>, dll::fixed_shapes<>>::layer_t generic;
+        dll::dyn_rbm_desc<dll::batch_size<BATCH>>::layer_t dynamic;
+
+        generic.init_layer(784, 100);
+        dynamic.init_layer(784, 100);
+
+        etl::dyn_matrix<float, 2> input(BATCH, 784);
+        etl::dyn_matrix<float, 2> output(BATCH, 100);
+
+        input = etl::uniform_generator<float>(0.0, 1.0);
+
+        throughput_row("rbm 784x100", forward_throughput(fast, output, input), forward_throughput(generic, output, input), forward_throughput(dynamic, output, input));
+    }
+
+    {
+        dll::conv_layer_desc<1, 28, 28, 20, 5, 5, dll::relu>::layer_t fast;
+        dll::dyn_conv_layer_desc<dll::relu, dll::fixed_shapes<>>::layer_t generic;
+        dll::dyn_conv_layer_desc<dll::relu>::layer_t dynamic;
+
+        generic.init_layer(1, 28, 28, 20, 5, 5);
+        dynamic.init_layer(1, 28, 28, 20, 5, 5);
+
+        etl::dyn_matrix<float, 4> input(BATCH, 1, 28, 28);
+        etl::dyn_matrix<float, 4> output(BATCH, 20, 24, 24);
+
+        input = etl::normal_generator<float>();
+
+        throughput_row("conv 1x28x28 20x5x5", forward_throughput(fast, output, input), forward_throughput(generic, output, input), forward_throughput(dynamic, output, input));
+    }
+}
+
 } //end of anonymous namespace
 
 int main(int, char**) {
@@ -101,5 +200,7 @@ int main(int, char**) {
 
     std::cout << "Ratio:" << 100.0 * (double(static_duration) / double(dyn_duration)) << std::endl;
 
+    throughput_table();
+
     return 0;
 }
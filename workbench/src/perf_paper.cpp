@@ -9,6 +9,7 @@
 #include <chrono>
 
 #include "dll/rbm/rbm.hpp"
+#include "dll/rbm/dyn_rbm.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -107,5 +108,22 @@ int main(int argc, char* argv []) {
         BATCH_MEASURE(512);
     }
 
+    if(number.empty() || number == "4"){
+        // Large RBM, whose weights do not fit in the caches
+        std::vector<etl::dyn_vector<float>> data_5(2048, etl::dyn_vector<float>(4096));
+
+        for(auto& sample : data_5){
+            sample = etl::normal_generator() * 255.0;
+        }
+
+        mnist::binarize_each(data_5);
+
+        dll::dyn_rbm_desc<dll::batch_size<64>, dll::weight_type<float>>::layer_t rbm_1(4096, 4096);
+        dll::dyn_rbm_desc<dll::batch_size<64>, dll::weight_type<float>, dll::transposed_weights>::layer_t rbm_2(4096, 4096);
+
+        MEASURE(rbm_1, "rbm_4096_4096_blocked", data_5);
+        MEASURE(rbm_2, "rbm_4096_4096_transposed", data_5);
+    }
+
     return 0;
 }